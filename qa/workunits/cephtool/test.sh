@@ -330,6 +330,15 @@ ceph osd pool set data size 2
 ceph osd pool set data hashpspool true
 ceph osd pool set data hashpspool false
 
+ceph osd pool set data target_max_objects 1000
+ceph osd pool set data target_max_objects 0
+ceph osd pool set data cache_target_dirty_ratio .5
+expect_false ceph osd pool set data cache_target_dirty_ratio 1.5
+ceph osd pool set data cache_target_dirty_ratio .4
+ceph osd pool set data hit_set_type explicit_hash
+expect_false ceph osd pool set data hit_set_type foo
+ceph osd pool set data hit_set_type bloom
+
 ceph osd pool get rbd crush_ruleset | grep 'crush_ruleset: 2'
 
 ceph osd thrash 10
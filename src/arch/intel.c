@@ -1,7 +1,11 @@
 #include "arch/probe.h"
 
 /* flags we export */
+int ceph_arch_intel_ssse3 = 0;
 int ceph_arch_intel_sse42 = 0;
+int ceph_arch_intel_pclmul = 0;
+int ceph_arch_intel_avx2 = 0;
+int ceph_arch_intel_aesni = 0;
 
 
 #ifdef __x86_64__
@@ -23,14 +27,48 @@ static void do_cpuid(unsigned int *eax, unsigned int *ebx, unsigned int *ecx,
                 : "eax", "ebx", "ecx", "edx");
 }
 
+/* leaf 7 is indexed by ecx, which do_cpuid leaves alone */
+static void do_cpuid_count(unsigned int leaf, unsigned int subleaf,
+			   unsigned int *eax, unsigned int *ebx,
+			   unsigned int *ecx, unsigned int *edx)
+{
+	asm("cpuid"
+	    : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+	    : "a" (leaf), "c" (subleaf));
+}
+
+/* the os has to save the ymm registers for us to use avx at all */
+static int os_saves_ymm(void)
+{
+	unsigned int lo, hi;
+	asm("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	return (lo & 6) == 6;
+}
+
 int ceph_arch_intel_probe(void)
 {
 	/* i know how to check this on x86_64... */
 	unsigned int eax = 1, ebx, ecx, edx;
 	do_cpuid(&eax, &ebx, &ecx, &edx);
+	if ((ecx & (1 << 9)) != 0) {
+		ceph_arch_intel_ssse3 = 1;
+	}
 	if ((ecx & (1 << 20)) != 0) {
 		ceph_arch_intel_sse42 = 1;
 	}
+	if ((ecx & (1 << 1)) != 0) {
+		ceph_arch_intel_pclmul = 1;
+	}
+	if ((ecx & (1 << 25)) != 0) {
+		ceph_arch_intel_aesni = 1;
+	}
+	/* osxsave and avx */
+	if ((ecx & (1 << 27)) != 0 && (ecx & (1 << 28)) != 0 && os_saves_ymm()) {
+		do_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+		if ((ebx & (1 << 5)) != 0) {
+			ceph_arch_intel_avx2 = 1;
+		}
+	}
 	return 0;
 }
 
@@ -5,7 +5,11 @@
 extern "C" {
 #endif
 
+extern int ceph_arch_intel_ssse3;  /* true if we have ssse3 features */
 extern int ceph_arch_intel_sse42;  /* true if we have sse 4.2 features */
+extern int ceph_arch_intel_pclmul; /* true if we have carry-less multiply */
+extern int ceph_arch_intel_avx2;   /* true if we have avx2, and the os saves ymm */
+extern int ceph_arch_intel_aesni;  /* true if we have the aes instructions */
 
 extern int ceph_arch_intel_probe(void);
 
@@ -24,12 +24,15 @@
 #endif
 
 #include "include/assert.h"
+#include "arch/intel.h"
+#include "auth/aes_intel_aesni.h"
 #include "common/Clock.h"
 #include "common/armor.h"
 #include "common/ceph_crypto.h"
 #include "common/config.h"
 #include "common/debug.h"
 #include "common/hex.h"
+#include "common/Mutex.h"
 #include "common/safe_io.h"
 #include "include/ceph_fs.h"
 #include "include/compat.h"
@@ -216,6 +219,107 @@ static void nss_aes_operation(CK_ATTRIBUTE_TYPE op, const bufferptr& secret,
 # error "No supported crypto implementation found."
 #endif
 
+class AESNIKeyHandler : public CryptoKeyHandler {
+  unsigned char round_keys[CEPH_AES128_ROUND_KEYS_LEN];
+public:
+  AESNIKeyHandler(const bufferptr& secret) {
+    ceph_aes128_intel_aesni_expand_key((const unsigned char *)secret.c_str(),
+				       round_keys);
+  }
+  int encrypt_block(const unsigned char *in, unsigned char *out,
+		    std::string &error) const {
+    ceph_aes128_intel_aesni_encrypt(round_keys, in, out);
+    return 0;
+  }
+};
+
+#ifdef USE_CRYPTOPP
+class CryptoPPAESKeyHandler : public CryptoKeyHandler {
+  CryptoPP::AES::Encryption enc;
+public:
+  CryptoPPAESKeyHandler(const bufferptr& secret)
+    : enc((const byte*)secret.c_str(), AES_KEY_LEN) {}
+  int encrypt_block(const unsigned char *in, unsigned char *out,
+		    std::string &error) const {
+    enc.ProcessBlock(in, out);
+    return 0;
+  }
+};
+#elif USE_NSS
+class NSSAESKeyHandler : public CryptoKeyHandler {
+  PK11SlotInfo *slot;
+  PK11SymKey *key;
+  PK11Context *ctx;
+  // a pipe signs from its writer and checks from its reader
+  mutable Mutex lock;
+
+public:
+  NSSAESKeyHandler()
+    : slot(NULL), key(NULL), ctx(NULL), lock("NSSAESKeyHandler::lock") {}
+  ~NSSAESKeyHandler() {
+    if (ctx)
+      PK11_DestroyContext(ctx, PR_TRUE);
+    if (key)
+      PK11_FreeSymKey(key);
+    if (slot)
+      PK11_FreeSlot(slot);
+  }
+
+  int init(const bufferptr& secret, std::string &error) {
+    // ecb keeps no state between blocks, so one context does for the
+    // lifetime of the key
+    const CK_MECHANISM_TYPE mechanism = CKM_AES_ECB;
+    slot = PK11_GetBestSlot(mechanism, NULL);
+    if (!slot) {
+      ostringstream oss;
+      oss << "cannot find NSS slot to use: " << PR_GetError();
+      error = oss.str();
+      return -EIO;
+    }
+    SECItem keyItem;
+    keyItem.type = siBuffer;
+    keyItem.data = (unsigned char*)secret.c_str();
+    keyItem.len = AES_KEY_LEN;
+    key = PK11_ImportSymKey(slot, mechanism, PK11_OriginUnwrap, CKA_ENCRYPT,
+			    &keyItem, NULL);
+    if (!key) {
+      ostringstream oss;
+      oss << "cannot convert AES key for NSS: " << PR_GetError();
+      error = oss.str();
+      return -EIO;
+    }
+    SECItem *param = PK11_ParamFromIV(mechanism, NULL);
+    ctx = PK11_CreateContextBySymKey(mechanism, CKA_ENCRYPT, key, param);
+    if (param)
+      SECITEM_FreeItem(param, PR_TRUE);
+    if (!ctx) {
+      ostringstream oss;
+      oss << "cannot create NSS context: " << PR_GetError();
+      error = oss.str();
+      return -EIO;
+    }
+    return 0;
+  }
+
+  int encrypt_block(const unsigned char *in, unsigned char *out,
+		    std::string &error) const {
+    unsigned char in_buf[AES_BLOCK_LEN];
+    memcpy(in_buf, in, sizeof(in_buf));
+    int written = 0;
+    Mutex::Locker l(lock);
+    SECStatus ret = PK11_CipherOp(ctx, out, &written, AES_BLOCK_LEN,
+				  in_buf, sizeof(in_buf));
+    if (ret != SECSuccess || written != (int)AES_BLOCK_LEN) {
+      ostringstream oss;
+      oss << "NSS AES failed: " << PR_GetError();
+      error = oss.str();
+      return -EIO;
+    }
+    return 0;
+  }
+};
+#endif
+
 int CryptoAES::create(bufferptr& secret)
 {
   bufferlist bl;
@@ -310,6 +414,30 @@ void CryptoAES::decrypt(const bufferptr& secret, const bufferlist& in,
 }
 
 
+CryptoKeyHandler *CryptoAES::get_key_handler(const bufferptr& secret,
+					     std::string &error) const
+{
+  // nss uses all of a longer secret and cryptopp the first 16 bytes;
+  // leave those to encrypt() rather than pick one here
+  if (secret.length() != AES_KEY_LEN)
+    return NULL;
+  if (ceph_arch_intel_aesni && ceph_aes128_intel_aesni_exists())
+    return new AESNIKeyHandler(secret);
+#ifdef USE_CRYPTOPP
+  return new CryptoPPAESKeyHandler(secret);
+#elif USE_NSS
+  NSSAESKeyHandler *h = new NSSAESKeyHandler;
+  if (h->init(secret, error) < 0) {
+    delete h;
+    return NULL;
+  }
+  return h;
+#else
+# error "No supported crypto implementation found."
+#endif
+}
+
+
 // ---------------------------------------------------
 
 int CryptoKey::set_secret(CephContext *cct, int type, bufferptr& s)
@@ -371,6 +499,19 @@ void CryptoKey::decrypt(CephContext *cct, const bufferlist& in, bufferlist& out,
   ch->decrypt(this->secret, in, out, error);
 }
 
+CryptoKeyHandler *CryptoKey::get_key_handler(CephContext *cct,
+					     std::string &error) const
+{
+  CryptoHandler *h = cct->get_crypto_handler(type);
+  if (!h) {
+    ostringstream oss;
+    oss << "CryptoKey::get_key_handler: key type " << type << " not supported.";
+    error = oss.str();
+    return NULL;
+  }
+  return h->get_key_handler(secret, error);
+}
+
 void CryptoKey::print(std::ostream &out) const
 {
   out << encode_base64();
@@ -25,6 +25,7 @@
 
 class CephContext;
 class CryptoHandler;
+class CryptoKeyHandler;
 
 /*
  * match encoding of struct ceph_secret
@@ -97,6 +98,9 @@ public:
   void encrypt(CephContext *cct, const bufferlist& in, bufferlist& out, std::string &error) const;
   void decrypt(CephContext *cct, const bufferlist& in, bufferlist& out, std::string &error) const;
 
+  /// the key set up for repeated use, or NULL; the caller owns it
+  CryptoKeyHandler *get_key_handler(CephContext *cct, std::string &error) const;
+
   void to_str(std::string& s) const;
 };
 WRITE_CLASS_ENCODER(CryptoKey);
@@ -108,6 +112,22 @@ static inline ostream& operator<<(ostream& out, const CryptoKey& k)
 }
 
 
+/*
+ * A key set up once for many operations
+ *
+ * CryptoHandler::encrypt imports the secret and builds a fresh cipher
+ * context on every call.  That is fine for tickets, but the message
+ * signatures encrypt a single block per message with the same session
+ * key, and there the setup is most of the cost.
+ */
+class CryptoKeyHandler {
+public:
+  virtual ~CryptoKeyHandler() {}
+  /// encrypt a single 16 byte block, without chaining or padding
+  virtual int encrypt_block(const unsigned char *in, unsigned char *out,
+			    std::string &error) const = 0;
+};
+
 /*
  * Driver for a particular algorithm
  *
@@ -124,6 +144,11 @@ public:
 		      bufferlist& out, std::string &error) const = 0;
   virtual void decrypt(const bufferptr& secret, const bufferlist& in,
 		      bufferlist& out, std::string &error) const = 0;
+  /// NULL if the algorithm or the secret has no fast path
+  virtual CryptoKeyHandler *get_key_handler(const bufferptr& secret,
+					    std::string &error) const {
+    return NULL;
+  }
 };
 
 extern int get_random_bytes(char *buf, int len);
@@ -157,6 +182,8 @@ public:
 	       bufferlist& out, std::string &error) const;
   void decrypt(const bufferptr& secret, const bufferlist& in, 
 	      bufferlist& out, std::string &error) const;
+  CryptoKeyHandler *get_key_handler(const bufferptr& secret,
+				    std::string &error) const;
 };
 
 #endif
@@ -0,0 +1,87 @@
+#include "acconfig.h"
+#include "include/int_types.h"
+#include "auth/aes_intel_aesni.h"
+
+#ifdef HAVE_INTEL_AESNI
+
+#include <wmmintrin.h>
+
+/*
+ * One step of the AES-128 key schedule.  aeskeygenassist does the
+ * SubWord(RotWord()) ^ rcon on the last word; the shifted xors
+ * propagate it through the other three.
+ */
+static inline __m128i expand_step(__m128i key, __m128i assist)
+{
+	assist = _mm_shuffle_epi32(assist, 0xff);
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, assist);
+}
+
+/* the round constant has to be an immediate */
+#define EXPAND(i, rcon)							\
+	rk[i] = expand_step(rk[i - 1],					\
+			    _mm_aeskeygenassist_si128(rk[i - 1], rcon))
+
+void ceph_aes128_intel_aesni_expand_key(const unsigned char *key,
+					unsigned char *round_keys)
+{
+	__m128i rk[11];
+	int i;
+
+	rk[0] = _mm_loadu_si128((const __m128i *)key);
+	EXPAND(1, 0x01);
+	EXPAND(2, 0x02);
+	EXPAND(3, 0x04);
+	EXPAND(4, 0x08);
+	EXPAND(5, 0x10);
+	EXPAND(6, 0x20);
+	EXPAND(7, 0x40);
+	EXPAND(8, 0x80);
+	EXPAND(9, 0x1b);
+	EXPAND(10, 0x36);
+	for (i = 0; i < 11; i++)
+		_mm_storeu_si128((__m128i *)(round_keys + 16 * i), rk[i]);
+}
+
+void ceph_aes128_intel_aesni_encrypt(const unsigned char *round_keys,
+				     const unsigned char *in,
+				     unsigned char *out)
+{
+	const __m128i *rk = (const __m128i *)round_keys;
+	__m128i x = _mm_loadu_si128((const __m128i *)in);
+	int i;
+
+	x = _mm_xor_si128(x, _mm_loadu_si128(rk));
+	for (i = 1; i < 10; i++)
+		x = _mm_aesenc_si128(x, _mm_loadu_si128(rk + i));
+	x = _mm_aesenclast_si128(x, _mm_loadu_si128(rk + 10));
+	_mm_storeu_si128((__m128i *)out, x);
+}
+
+int ceph_aes128_intel_aesni_exists(void)
+{
+	return 1;
+}
+
+#else
+
+int ceph_aes128_intel_aesni_exists(void)
+{
+	return 0;
+}
+
+void ceph_aes128_intel_aesni_expand_key(const unsigned char *key,
+					unsigned char *round_keys)
+{
+}
+
+void ceph_aes128_intel_aesni_encrypt(const unsigned char *round_keys,
+				     const unsigned char *in,
+				     unsigned char *out)
+{
+}
+
+#endif
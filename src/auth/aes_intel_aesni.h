@@ -0,0 +1,28 @@
+#ifndef CEPH_AUTH_AES_INTEL_AESNI_H
+#define CEPH_AUTH_AES_INTEL_AESNI_H
+
+#include "include/int_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the expanded key: 11 round keys of 16 bytes */
+#define CEPH_AES128_ROUND_KEYS_LEN 176
+
+/* is the aes-ni version compiled in */
+extern int ceph_aes128_intel_aesni_exists(void);
+
+extern void ceph_aes128_intel_aesni_expand_key(const unsigned char *key,
+					       unsigned char *round_keys);
+
+/* encrypt a single 16 byte block */
+extern void ceph_aes128_intel_aesni_encrypt(const unsigned char *round_keys,
+					    const unsigned char *in,
+					    unsigned char *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
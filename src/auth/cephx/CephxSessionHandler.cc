@@ -24,42 +24,104 @@
 
 #define dout_subsys ceph_subsys_auth
 
-int CephxSessionHandler::sign_message(Message *m)
+CephxSessionHandler::CephxSessionHandler(CephContext *cct_,
+					 CryptoKey session_key,
+					 uint64_t features)
+  : AuthSessionHandler(cct_, CEPH_AUTH_CEPHX, session_key),
+    features(features),
+    key_handler(NULL)
 {
-  bufferlist bl_plaintext, bl_encrypted;
-  ceph_msg_header header = m->get_header();
   std::string error;
+  key_handler = key.get_key_handler(cct, error);
+  if (!error.empty())
+    ldout(cct, 0) << "cannot set up session key, signing the slow way: "
+		  << error << dendl;
+}
 
-  // If runtime signing option is off, just return success without signing.
-  if (!cct->_conf->cephx_sign_messages) {
+CephxSessionHandler::~CephxSessionHandler()
+{
+  delete key_handler;
+}
+
+int CephxSessionHandler::_calc_signature(Message *m, uint64_t *psig)
+{
+  const ceph_msg_header& header = m->get_header();
+  const ceph_msg_footer& footer = m->get_footer();
+
+  if (key_handler) {
+    // encode_encrypt() below encrypts struct_v, the magic, the length
+    // of the crcs and the crcs with AES-CBC, and the signature is the
+    // first 8 bytes of the result.  That is the first cipher block
+    // alone, so encrypt just that block with the key we already have:
+    // 1 byte struct_v, 8 of magic, 4 of length and 3 of header.crc.
+    unsigned char block[16], out[16];
+    block[0] = 1;
+    ceph_le64 magic;
+    magic = AUTH_ENC_MAGIC;
+    memcpy(block + 1, &magic, 8);
+    ceph_le32 len;
+    len = 4 * sizeof(__u32);
+    memcpy(block + 9, &len, 4);
+    ceph_le32 crc;
+    crc = header.crc;
+    memcpy(block + 13, &crc, 3);
+    for (unsigned i = 0; i < sizeof(block); i++)
+      block[i] ^= CEPH_AES_IV[i];
+
+    std::string error;
+    if (key_handler->encrypt_block(block, out, error) < 0) {
+      ldout(cct, 0) << "error encrypting message signature: " << error << dendl;
+      return SESSION_SIGNATURE_FAILURE;
+    }
+    ceph_le64 sig;
+    memcpy(&sig, out, 8);
+    *psig = sig;
     return 0;
   }
 
-  ceph_msg_footer& en_footer = m->get_footer();
-
+  bufferlist bl_plaintext, bl_encrypted;
+  std::string error;
   ::encode(header.crc, bl_plaintext);
-  ::encode(en_footer.front_crc, bl_plaintext);
-  ::encode(en_footer.middle_crc, bl_plaintext);
-  ::encode(en_footer.data_crc, bl_plaintext);
-
-  ldout(cct, 10) <<  "sign_message: seq # " << header.seq << " CRCs are: header " << header.crc
-		 << " front " << en_footer.front_crc << " middle " << en_footer.middle_crc
-		 << " data " << en_footer.data_crc << dendl;
+  ::encode(footer.front_crc, bl_plaintext);
+  ::encode(footer.middle_crc, bl_plaintext);
+  ::encode(footer.data_crc, bl_plaintext);
 
   if (encode_encrypt(cct, bl_plaintext, key, bl_encrypted, error)) {
     ldout(cct, 0) << "error encrypting message signature: " << error << dendl;
-    ldout(cct, 0) << "no signature put on message" << dendl;
     return SESSION_SIGNATURE_FAILURE;
-  } 
+  }
 
   bufferlist::iterator ci = bl_encrypted.begin();
   // Skip the magic number up front. PLR
   ci.advance(4);
-  ::decode(en_footer.sig, ci);
+  ::decode(*psig, ci);
 
   // There's potentially an issue with whether the encoding and decoding done here will work
   // properly when a big endian and little endian machine are talking.  We think it's OK,
   // but it should be tested to be sure.  PLR
+  return 0;
+}
+
+int CephxSessionHandler::sign_message(Message *m)
+{
+  // If runtime signing option is off, just return success without signing.
+  if (!cct->_conf->cephx_sign_messages) {
+    return 0;
+  }
+
+  ceph_msg_header& header = m->get_header();
+  ceph_msg_footer& en_footer = m->get_footer();
+
+  ldout(cct, 10) <<  "sign_message: seq # " << header.seq << " CRCs are: header " << header.crc
+		 << " front " << en_footer.front_crc << " middle " << en_footer.middle_crc
+		 << " data " << en_footer.data_crc << dendl;
+
+  uint64_t sig;
+  if (_calc_signature(m, &sig) < 0) {
+    ldout(cct, 0) << "no signature put on message" << dendl;
+    return SESSION_SIGNATURE_FAILURE;
+  }
+  en_footer.sig = sig;
 
   // Receiver won't trust this flag to decide if msg should have been signed.  It's primarily
   // to debug problems where sender and receiver disagree on need to sign msg.  PLR
@@ -71,8 +133,6 @@ int CephxSessionHandler::sign_message(Message *m)
 
 int CephxSessionHandler::check_message_signature(Message *m)
 {
-  bufferlist bl_plaintext, bl_ciphertext;
-  std::string sig_error;
   ceph_msg_header& header = m->get_header();
   ceph_msg_footer& footer = m->get_footer();
 
@@ -90,26 +150,13 @@ int CephxSessionHandler::check_message_signature(Message *m)
 
   ldout(cct, 10) << "check_message_signature: seq # = " << m->get_seq() << " front_crc_ = " << footer.front_crc
 		 << " middle_crc = " << footer.middle_crc << " data_crc = " << footer.data_crc << dendl;
-  ::encode(header.crc, bl_plaintext);
-  ::encode(footer.front_crc, bl_plaintext);
-  ::encode(footer.middle_crc, bl_plaintext);
-  ::encode(footer.data_crc, bl_plaintext);
-
-  // Encrypt the buffer containing the checksums to calculate the signature. PLR
-  if (encode_encrypt(cct, bl_plaintext, key, bl_ciphertext, sig_error)) {
-    ldout(cct, 0) << "error in encryption for checking message signature: " << sig_error << dendl;
-    return (SESSION_SIGNATURE_FAILURE);
-  } 
 
-  bufferlist::iterator ci = bl_ciphertext.begin();
-  // Skip the magic number at the front. PLR
-  ci.advance(4);
+  // Encrypt the checksums to calculate the signature. PLR
   uint64_t sig_check;
-  ::decode(sig_check, ci);
-
-  // There's potentially an issue with whether the encoding and decoding done here will work
-  // properly when a big endian and little endian machine are talking.  We think it's OK,
-  // but it should be tested to be sure.  PLR
+  if (_calc_signature(m, &sig_check) < 0) {
+    ldout(cct, 0) << "error in encryption for checking message signature" << dendl;
+    return (SESSION_SIGNATURE_FAILURE);
+  }
 
   if (sig_check != footer.sig) {
     // Should have been signed, but signature check failed.  PLR
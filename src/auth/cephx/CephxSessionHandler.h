@@ -21,11 +21,14 @@ class CephContext;
 class CephxSessionHandler  : public AuthSessionHandler {
   uint64_t features;
 
+  // the session key set up once for all signatures, if it can be
+  CryptoKeyHandler *key_handler;
+
+  int _calc_signature(Message *m, uint64_t *psig);
+
 public:
-  CephxSessionHandler(CephContext *cct_, CryptoKey session_key, uint64_t features)
-    : AuthSessionHandler(cct_, CEPH_AUTH_CEPHX, session_key),
-      features(features) {}
-  ~CephxSessionHandler() {}
+  CephxSessionHandler(CephContext *cct_, CryptoKey session_key, uint64_t features);
+  ~CephxSessionHandler();
   
   bool no_security() {
     return false;
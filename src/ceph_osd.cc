@@ -374,11 +374,15 @@ int main(int argc, const char **argv)
   
   ms_cluster->set_default_policy(Messenger::Policy::stateless_server(0, 0));
   ms_cluster->set_policy(entity_name_t::TYPE_MON, Messenger::Policy::lossy_client(0,0));
-  ms_cluster->set_policy(entity_name_t::TYPE_OSD,
-			 Messenger::Policy::lossless_peer(supported,
-							  CEPH_FEATURE_UID |
-							  CEPH_FEATURE_PGID64 |
-							  CEPH_FEATURE_OSDENC));
+  {
+    Messenger::Policy p = Messenger::Policy::lossless_peer(supported,
+							   CEPH_FEATURE_UID |
+							   CEPH_FEATURE_PGID64 |
+							   CEPH_FEATURE_OSDENC);
+    p.compress = g_conf->osd_cluster_compress;
+    p.rdma = g_conf->ms_cluster_rdma;
+    ms_cluster->set_policy(entity_name_t::TYPE_OSD, p);
+  }
   ms_cluster->set_policy(entity_name_t::TYPE_CLIENT,
 			 Messenger::Policy::stateless_server(0, 0));
 
@@ -394,7 +398,21 @@ int main(int argc, const char **argv)
   r = ms_public->bind(g_conf->public_addr);
   if (r < 0)
     exit(1);
-  r = ms_cluster->bind(g_conf->cluster_addr);
+  // the other osds learn from our cluster address that it takes rdma
+  entity_addr_t cluster_addr = g_conf->cluster_addr;
+  if (g_conf->ms_cluster_rdma) {
+    if (g_conf->ms_type != "simple") {
+      derr << "ms_cluster_rdma needs ms_type = simple" << dendl;
+      exit(1);
+    }
+    if (cluster_addr.is_blank_ip()) {
+      derr << "ms_cluster_rdma needs a cluster_addr or cluster_network on the "
+	   << "rdma network" << dendl;
+      exit(1);
+    }
+    cluster_addr.type = entity_addr_t::TYPE_RDMA;
+  }
+  r = ms_cluster->bind(cluster_addr);
   if (r < 0)
     exit(1);
 
@@ -119,6 +119,8 @@ bool Client::CommandHook::call(std::string command, cmdmap_t& cmdmap,
     m_client->dump_mds_sessions(f);
   else if (command == "dump_cache")
     m_client->dump_cache(f);
+  else if (command == "cache_status")
+    m_client->dump_cache_status(f);
   else
     assert(0 == "bad command registered");
   m_client->client_lock.Unlock();
@@ -154,7 +156,9 @@ Client::Client(Messenger *m, MonClient *mc)
     getgroups_cb_handle(NULL),
     async_ino_invalidator(m->cct),
     async_dentry_invalidator(m->cct),
-    tick_event(NULL),
+    async_io_finisher(m->cct),
+    async_io_worker(m->cct),
+    tick_event(NULL), cap_batch_flush(NULL),
     monclient(mc), messenger(m), whoami(m->get_myname().num()),
     initialized(false), mounted(false), unmounting(false),
     local_osd(-1), local_osd_epoch(0),
@@ -173,6 +177,7 @@ Client::Client(Messenger *m, MonClient *mc)
 
   num_flushing_caps = 0;
 
+  dn_bytes = 0;
   lru.lru_set_max(cct->_conf->client_cache_size);
   lru.lru_set_midpoint(cct->_conf->client_cache_mid);
 
@@ -326,6 +331,23 @@ void Client::dump_cache(Formatter *f)
     f->close_section();
 }
 
+uint64_t Client::cache_bytes()
+{
+  return dn_bytes + inode_map.size() * sizeof(Inode);
+}
+
+void Client::dump_cache_status(Formatter *f)
+{
+  f->dump_unsigned("dentries", lru.lru_get_size());
+  f->dump_unsigned("dentries_max", lru.lru_get_max());
+  f->dump_unsigned("inodes", inode_map.size());
+  f->dump_unsigned("bytes", cache_bytes());
+  f->dump_unsigned("bytes_max", cct->_conf->client_cache_size_bytes);
+  f->dump_unsigned("lookup_hit", logger->get(l_c_dentry_hit));
+  f->dump_unsigned("lookup_negative_hit", logger->get(l_c_dentry_neg_hit));
+  f->dump_unsigned("lookup_miss", logger->get(l_c_dentry_miss));
+}
+
 int Client::init()
 {
   client_lock.Lock();
@@ -334,6 +356,8 @@ int Client::init()
   timer.init();
 
   objectcacher->start();
+  async_io_finisher.start();
+  async_io_worker.start();
 
   // ok!
   messenger->add_dispatcher_head(this);
@@ -343,6 +367,8 @@ int Client::init()
     // need to do cleanup because we're in an intermediate init state
     timer.shutdown();
     client_lock.Unlock();
+    async_io_worker.stop();
+    async_io_finisher.stop();
     objectcacher->stop();
     monclient->shutdown();
     return r;
@@ -366,6 +392,12 @@ int Client::init()
   plb.add_time_avg(l_c_wrlat, "wrlat");
   plb.add_time_avg(l_c_owrlat, "owrlat");
   plb.add_time_avg(l_c_ordlat, "ordlat");
+  plb.add_u64_counter(l_c_readahead_bytes, "readahead_bytes");
+  plb.add_u64_counter(l_c_readahead_hit_bytes, "readahead_hit_bytes");
+  plb.add_u64_counter(l_c_readahead_wasted_bytes, "readahead_wasted_bytes");
+  plb.add_u64_counter(l_c_dentry_hit, "dentry_hit");          // lookups answered from cache
+  plb.add_u64_counter(l_c_dentry_neg_hit, "dentry_neg_hit");  // ... with ENOENT
+  plb.add_u64_counter(l_c_dentry_miss, "dentry_miss");        // lookups sent to the mds
   logger = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 
@@ -396,6 +428,14 @@ int Client::init()
     lderr(cct) << "error registering admin socket command: "
 	       << cpp_strerror(-ret) << dendl;
   }
+  ret = admin_socket->register_command("cache_status",
+				       "cache_status",
+				       &m_command_hook,
+				       "show metadata cache size and lookup hit rate");
+  if (ret < 0) {
+    lderr(cct) << "error registering admin socket command: "
+	       << cpp_strerror(-ret) << dendl;
+  }
 
   client_lock.Lock();
   initialized = true;
@@ -411,6 +451,7 @@ void Client::shutdown()
   admin_socket->unregister_command("mds_requests");
   admin_socket->unregister_command("mds_sessions");
   admin_socket->unregister_command("dump_cache");
+  admin_socket->unregister_command("cache_status");
 
   if (ino_invalidate_cb) {
     ldout(cct, 10) << "shutdown stopping cache invalidator finisher" << dendl;
@@ -424,6 +465,12 @@ void Client::shutdown()
     async_dentry_invalidator.stop();
   }
 
+  ldout(cct, 10) << "shutdown stopping aio finishers" << dendl;
+  async_io_worker.wait_for_empty();
+  async_io_worker.stop();
+  async_io_finisher.wait_for_empty();
+  async_io_finisher.stop();
+
   objectcacher->stop();  // outside of client_lock! this does a join.
 
   client_lock.Lock();
@@ -455,7 +502,10 @@ void Client::trim_cache()
   while (lru.lru_get_size() != last) {
     last = lru.lru_get_size();
 
-    if (lru.lru_get_size() <= lru.lru_get_max())  break;
+    if (lru.lru_get_size() <= lru.lru_get_max() &&
+	(!cct->_conf->client_cache_size_bytes ||
+	 cache_bytes() <= cct->_conf->client_cache_size_bytes))
+      break;
 
     // trim!
     Dentry *dn = static_cast<Dentry*>(lru.lru_expire());
@@ -479,7 +529,7 @@ void Client::trim_dentry(Dentry *dn)
   ldout(cct, 15) << "trim_dentry unlinking dn " << dn->name 
 		 << " in dir " << hex << dn->dir->parent_inode->ino 
 		 << dendl;
-  if (dn->dir->parent_inode->flags & I_COMPLETE) {
+  if (dn->inode && (dn->dir->parent_inode->flags & I_COMPLETE)) {
     ldout(cct, 10) << " clearing I_COMPLETE on " << *dn->dir->parent_inode << dendl;
     dn->dir->parent_inode->flags &= ~I_COMPLETE;
     dn->dir->release_count++;
@@ -606,8 +656,10 @@ Inode * Client::add_update_inode(InodeStat *st, utime_t from, MetaSession *sessi
   if (was_new)
     ldout(cct, 12) << "add_update_inode adding " << *in << " caps " << ccap_string(st->cap.caps) << dendl;
 
-  if (!st->cap.caps)
-    return in;   // as with readdir returning indoes in different snaprealms (no caps!)
+  // as with readdir returning inodes in different snaprealms (no caps!).
+  // a new inode still gets the stat, or readdirplus would hand out zeros.
+  if (!st->cap.caps && !was_new)
+    return in;
 
   // only update inode if mds info is strictly newer, or it is the same and projected (odd).
   bool updating_inode = false;
@@ -660,6 +712,9 @@ Inode * Client::add_update_inode(InodeStat *st, utime_t from, MetaSession *sessi
   // move me if/when version reflects fragtree changes.
   in->dirfragtree = st->dirfragtree;
 
+  if (!st->cap.caps)
+    return in;
+
   if (in->snapid == CEPH_NOSNAP)
     add_update_cap(in, session, st->cap.cap_id, st->cap.caps, st->cap.seq, st->cap.mseq, inodeno_t(st->cap.realm), st->cap.flags);
   else
@@ -738,7 +793,7 @@ void Client::update_dentry_lease(Dentry *dn, LeaseStat *dlease, utime_t from, Me
   utime_t dttl = from;
   dttl += (float)dlease->duration_ms / 1000.0;
   
-  assert(dn && dn->inode);
+  assert(dn);
 
   if (dlease->mask & CEPH_LOCK_DN) {
     if (dttl > dn->lease_ttl) {
@@ -989,10 +1044,24 @@ Inode* Client::insert_trace(MetaRequest *request, MetaSession *session)
                           ((request->head.op == CEPH_MDS_OP_RENAME) ?
                                         request->old_dentry() : NULL));
     } else {
+      // remember the name doesn't exist, for as long as the dir's Fs
+      // (or a dentry lease) says nobody else can create it
+      bool negative = cct->_conf->client_negative_dentries &&
+	((dlease.mask & CEPH_LOCK_DN) ||
+	 diri->caps_issued_mask(CEPH_CAP_FILE_SHARED));
+      Dentry *dn = NULL;
       if (diri->dir && diri->dir->dentries.count(dname)) {
-	Dentry *dn = diri->dir->dentries[dname];
-	if (dn->inode)
-	  unlink(dn, false);
+	dn = diri->dir->dentries[dname];
+	if (dn->inode) {
+	  unlink(dn, negative);
+	  dn = NULL;
+	}
+      }
+      if (negative) {
+	if (!dn)
+	  dn = link(diri->open_dir(), dname, NULL, NULL);
+	ldout(cct, 15) << " negative dentry '" << dname << "' in " << *diri << dendl;
+	update_dentry_lease(dn, &dlease, request->sent_stamp, session);
       }
     }
   } else if (reply->head.op == CEPH_MDS_OP_LOOKUPSNAP ||
@@ -1191,9 +1260,21 @@ int Client::verify_reply_trace(int r,
     // if the extra bufferlist has a buffer, we assume its the created inode
     // and that this request to create succeeded in actually creating
     // the inode (won the race with other create requests)
-    ::decode(created_ino, extra_bl);
+    bufferlist::iterator bp = extra_bl.begin();
+    ::decode(created_ino, bp);
     got_created_ino = true;
     ldout(cct, 10) << "make_request created ino " << created_ino << dendl;
+
+    // followed by more inos we may use, if we asked
+    if (!bp.end() && mds_sessions.count(request->mds)) {
+      interval_set<inodeno_t> deleg, have;
+      ::decode(deleg, bp);
+      MetaSession *session = mds_sessions[request->mds];
+      have.intersection_of(deleg, session->delegated_inos);
+      deleg.subtract(have);
+      session->delegated_inos.insert(deleg);
+      ldout(cct, 10) << "make_request mds." << request->mds << " delegated " << deleg << dendl;
+    }
   }
 
   if (pcreated)
@@ -1542,6 +1623,7 @@ void Client::_close_mds_session(MetaSession *s)
 {
   ldout(cct, 2) << "_close_mds_session mds." << s->mds_num << " seq " << s->seq << dendl;
   s->state = MetaSession::STATE_CLOSING;
+  flush_cap_batch(s);
   messenger->send_message(new MClientSession(CEPH_SESSION_REQUEST_CLOSE, s->seq),
 			  s->con);
 }
@@ -1613,6 +1695,8 @@ void Client::send_request(MetaRequest *request, MetaSession *session)
   int mds = session->mds_num;
   ldout(cct, 10) << "send_request rebuilding request " << request->get_tid()
 		 << " for mds." << mds << dendl;
+  if (!request->got_unsafe)
+    pick_delegated_ino(request, session);
   MClientRequest *r = build_client_request(request);
   if (request->dentry()) {
     r->set_dentry_wanted();
@@ -1638,9 +1722,40 @@ void Client::send_request(MetaRequest *request, MetaSession *session)
   session->requests.push_back(&request->item);
 
   ldout(cct, 10) << "send_request " << *r << " to mds." << mds << dendl;
+  flush_cap_batch(session);
   messenger->send_message(r, session->con);
 }
 
+/*
+ * name the new inode of a create ourselves, from the inos the mds
+ * delegated to us.  the ino is then known before the reply, and a
+ * replay after an mds restart recreates the same one.
+ */
+void Client::pick_delegated_ino(MetaRequest *request, MetaSession *session)
+{
+  int op = request->get_op();
+  if (op != CEPH_MDS_OP_CREATE && op != CEPH_MDS_OP_MKNOD &&
+      op != CEPH_MDS_OP_MKDIR && op != CEPH_MDS_OP_SYMLINK)
+    return;
+
+  if (op == CEPH_MDS_OP_CREATE)
+    request->head.flags = request->head.flags | CEPH_MDS_FLAG_WANT_INOS;
+
+  if (request->head.ino && request->deleg_ino_mds == session->mds_num)
+    return;
+  // sent elsewhere before; that mds's ino is no good here
+  request->head.ino = 0;
+  request->deleg_ino_mds = -1;
+  if (session->delegated_inos.empty())
+    return;
+  inodeno_t ino = session->delegated_inos.range_start();
+  session->delegated_inos.erase(ino);
+  request->head.ino = ino;
+  request->deleg_ino_mds = session->mds_num;
+  ldout(cct, 10) << "pick_delegated_ino " << ino << " from mds." << session->mds_num
+		 << ", " << session->delegated_inos.size() << " left" << dendl;
+}
+
 MClientRequest* Client::build_client_request(MetaRequest *request)
 {
   MClientRequest *req = new MClientRequest(request->get_op());
@@ -1950,6 +2065,15 @@ void Client::send_reconnect(MetaSession *session)
   int mds = session->mds_num;
   ldout(cct, 10) << "send_reconnect to mds." << mds << dendl;
 
+  // it forgot what it delegated to us; unsafe requests keep theirs
+  session->delegated_inos.clear();
+
+  // held flushes went nowhere; kick_flushing_caps resends them
+  if (session->cap_batch) {
+    session->cap_batch->put();
+    session->cap_batch = NULL;
+  }
+
   MClientReconnect *m = new MClientReconnect;
 
   // i have an open session.
@@ -2162,6 +2286,7 @@ Dentry* Client::link(Dir *dir, const string& name, Inode *in, Dentry *dn)
     dir->dentries[dn->name] = dn;
     dir->dentry_map[dn->name] = dn;
     lru.lru_insert_mid(dn);    // mid or top?
+    dn_bytes += sizeof(Dentry) + name.length();
 
     ldout(cct, 15) << "link dir " << dir->parent_inode << " '" << name << "' to inode " << in
 		   << " dn " << dn << " (new dn)" << dendl;
@@ -2219,6 +2344,7 @@ void Client::unlink(Dentry *dn, bool keepdir)
 
   // delete den
   lru.lru_remove(dn);
+  dn_bytes -= sizeof(Dentry) + dn->name.length();
   dn->put();
 }
 
@@ -2386,15 +2512,83 @@ void Client::send_cap(Inode *in, MetaSession *session, Cap *cap,
     
   in->reported_size = in->size;
   m->set_snap_follows(follows);
+
+  // a plain flush can wait a bit for others; anything the mds (or a
+  // writer of ours) is waiting on goes now
+  bool batch = flush && !revoking && want == cap->wanted &&
+    !(cap == in->auth_cap && in->wanted_max_size > in->requested_max_size);
+
   cap->wanted = want;
   if (cap == in->auth_cap) {
     m->set_max_size(in->wanted_max_size);
     in->requested_max_size = in->wanted_max_size;
     ldout(cct, 15) << "auth cap, setting max_size = " << in->requested_max_size << dendl;
   }
+  if (batch &&
+      cct->_conf->client_cap_batch_window > 0 &&
+      session->con->has_feature(CEPH_FEATURE_MDS_CAPS_BATCH)) {
+    batch_cap_flush(m, session);
+    return;
+  }
+  flush_cap_batch(session);
   messenger->send_message(m, session->con);
 }
 
+class C_C_FlushCapBatches : public Context {
+  Client *client;
+public:
+  C_C_FlushCapBatches(Client *c) : client(c) {}
+  void finish(int r) {
+    client->cap_batch_flush = 0;
+    client->flush_cap_batches();
+  }
+};
+
+/*
+ * dirty metadata flushes to the same mds are held for up to
+ * client_cap_batch_window seconds and go out piggybacked on a single
+ * message, which the mds applies with a single log flush.  anything
+ * else sent to the session pushes the batch out first, so the mds
+ * still sees our messages in order.
+ */
+void Client::batch_cap_flush(MClientCaps *m, MetaSession *session)
+{
+  ldout(cct, 10) << "batch_cap_flush mds." << session->mds_num << " " << *m << dendl;
+  if (!session->cap_batch) {
+    session->cap_batch = m;
+  } else {
+    session->cap_batch->add_batched(m);
+    m->put();
+    if (session->cap_batch->batched.size() + 1 >= (unsigned)cct->_conf->client_cap_batch_max) {
+      flush_cap_batch(session);
+      return;
+    }
+  }
+
+  if (!cap_batch_flush) {
+    cap_batch_flush = new C_C_FlushCapBatches(this);
+    timer.add_event_after(cct->_conf->client_cap_batch_window, cap_batch_flush);
+  }
+}
+
+void Client::flush_cap_batch(MetaSession *session)
+{
+  MClientCaps *m = session->cap_batch;
+  if (!m)
+    return;
+  session->cap_batch = NULL;
+  ldout(cct, 10) << "flush_cap_batch mds." << session->mds_num << " " << *m << dendl;
+  messenger->send_message(m, session->con);
+}
+
+void Client::flush_cap_batches()
+{
+  for (map<int,MetaSession*>::iterator p = mds_sessions.begin();
+       p != mds_sessions.end();
+       ++p)
+    flush_cap_batch(p->second);
+}
+
 
 void Client::check_caps(Inode *in, bool is_delayed)
 {
@@ -2625,6 +2819,7 @@ void Client::flush_snaps(Inode *in, bool all_again, CapSnap *again)
     capsnap->atime.encode_timeval(&m->head.atime);
     m->head.time_warp_seq = capsnap->time_warp_seq;
 
+    flush_cap_batch(session);
     messenger->send_message(m, session->con);
   }
 }
@@ -3371,6 +3566,20 @@ void Client::handle_snap(MClientSnap *m)
 
 void Client::handle_caps(MClientCaps *m)
 {
+  if (!m->batched.empty()) {
+    // the mds piggybacked more grants/revokes/flush acks; each one is its own push
+    vector<MClientCaps*> more;
+    for (unsigned i = 0; i < m->batched.size(); i++)
+      more.push_back(m->get_batched(i));
+    m->batched.clear();
+    m->batched_tid.clear();
+    ldout(cct, 10) << "handle_caps " << more.size() << " batched after " << *m << dendl;
+    handle_caps(m);
+    for (unsigned i = 0; i < more.size(); i++)
+      handle_caps(more[i]);
+    return;
+  }
+
   int mds = m->get_source().num();
   MetaSession *session = _get_mds_session(mds, m->get_connection().get());
   if (!session) {
@@ -3832,6 +4041,10 @@ void Client::unmount()
   if (tick_event)
     timer.cancel_event(tick_event);
   tick_event = 0;
+  if (cap_batch_flush)
+    timer.cancel_event(cap_batch_flush);
+  cap_batch_flush = 0;
+  flush_cap_batches();
 
   if (cwd)
     put_inode(cwd);
@@ -3941,6 +4154,7 @@ void Client::flush_cap_releases()
        p != mds_sessions.end();
        ++p) {
     if (p->second->release && mdsmap->is_clientreplay_or_active_or_stopping(p->first)) {
+      flush_cap_batch(p->second);
       messenger->send_message(p->second->release, p->second->con);
       p->second->release = 0;
     }
@@ -4077,12 +4291,11 @@ int Client::_lookup(Inode *dir, const string& dname, Inode **target)
       MetaSession *s = mds_sessions[dn->lease_mds];
       if (s->cap_ttl > now &&
 	  s->cap_gen == dn->lease_gen) {
-	*target = dn->inode;
 	// touch this mds's dir cap too, even though we don't _explicitly_ use it here, to
 	// make trim_caps() behave.
 	dir->try_touch_cap(dn->lease_mds);
 	touch_dn(dn);
-	goto done;
+	goto hit;
       }
       ldout(cct, 20) << " bad lease, cap_ttl " << s->cap_ttl << ", cap_gen " << s->cap_gen
 	       << " vs lease_gen " << dn->lease_gen << dendl;
@@ -4090,20 +4303,35 @@ int Client::_lookup(Inode *dir, const string& dname, Inode **target)
     // dir lease?
     if (dir->caps_issued_mask(CEPH_CAP_FILE_SHARED) &&
 	dn->cap_shared_gen == dir->shared_gen) {
-      *target = dn->inode;
       touch_dn(dn);
-      goto done;
+      goto hit;
     }
   } else {
     // can we conclude ENOENT locally?
     if (dir->caps_issued_mask(CEPH_CAP_FILE_SHARED) &&
 	(dir->flags & I_COMPLETE)) {
       ldout(cct, 10) << "_lookup concluded ENOENT locally for " << *dir << " dn '" << dname << "'" << dendl;
+      logger->inc(l_c_dentry_neg_hit);
       return -ENOENT;
     }
   }
 
+  logger->inc(l_c_dentry_miss);
   r = _do_lookup(dir, dname, target);
+  goto done;
+
+ hit:
+  {
+    Dentry *dn = dir->dir->dentries[dname];
+    if (dn->inode) {
+      *target = dn->inode;
+      logger->inc(l_c_dentry_hit);
+    } else {
+      ldout(cct, 10) << "_lookup negative dentry for " << *dir << " dn '" << dname << "'" << dendl;
+      logger->inc(l_c_dentry_neg_hit);
+      r = -ENOENT;
+    }
+  }
 
  done:
   if (r < 0)
@@ -5020,6 +5248,8 @@ int Client::_readdir_get_frag(dir_result_t *dirp)
   }
   req->readdir_offset = dirp->next_offset;
   req->readdir_frag = fg;
+  if (cct->_conf->client_readdirplus && op == CEPH_MDS_OP_READDIR)
+    req->set_readdirplus();
   
   
   bufferlist dirbl;
@@ -5770,15 +6000,68 @@ int Client::read(int fd, char *buf, loff_t size, loff_t offset)
   return r;
 }
 
+int Client::preadv(int fd, const struct iovec *iov, int iovcnt, loff_t offset)
+{
+  if (iovcnt < 0)
+    return -EINVAL;
+  loff_t size = 0;
+  for (int i = 0; i < iovcnt; i++)
+    size += iov[i].iov_len;
+
+  Mutex::Locker lock(client_lock);
+  tout(cct) << "preadv" << std::endl;
+  tout(cct) << fd << std::endl;
+  tout(cct) << iovcnt << std::endl;
+  tout(cct) << offset << std::endl;
+
+  Fh *f = get_filehandle(fd);
+  if (!f)
+    return -EBADF;
+  bufferlist bl;
+  int r = _read(f, offset, size, &bl);
+  ldout(cct, 3) << "preadv(" << fd << ", " << iovcnt << " iovs, " << size << ", " << offset << ") = " << r << dendl;
+  if (r >= 0) {
+    unsigned pos = 0;
+    for (int i = 0; i < iovcnt && pos < bl.length(); i++) {
+      unsigned len = MIN(iov[i].iov_len, bl.length() - pos);
+      bl.copy(pos, len, (char*)iov[i].iov_base);
+      pos += len;
+    }
+    r = bl.length();
+  }
+  return r;
+}
+
+/*
+ * big, stripe unit aligned ios (and O_DIRECT ones) skip the
+ * ObjectCacher: copying them through the cache only to write them back
+ * later costs memory bandwidth and runs into client_oc_max_dirty, and
+ * the Filer already sends all of their object extents in parallel.
+ */
+bool Client::_use_direct_io(Fh *f, int64_t offset, uint64_t size)
+{
+  if (f->flags & O_DIRECT)
+    return true;
+  uint64_t min = cct->_conf->client_direct_io_min;
+  if (!min || size < min || offset < 0)
+    return false;
+  uint64_t su = f->inode->layout.fl_stripe_unit;
+  return su && (offset % su) == 0 && (size % su) == 0;
+}
+
 int Client::_read(Fh *f, int64_t offset, uint64_t size, bufferlist *bl)
 {
   const md_config_t *conf = cct->_conf;
   Inode *in = f->inode;
 
-  //bool lazy = f->mode == CEPH_FILE_MODE_LAZY;
+  // lazy io keeps caching under Fl, after the mds takes Fc away for
+  // other writers; the application syncs things up by itself
+  int cache_caps = CEPH_CAP_FILE_CACHE;
+  if (f->mode & CEPH_FILE_MODE_LAZY)
+    cache_caps |= CEPH_CAP_FILE_LAZYIO;
 
   int have;
-  int r = get_caps(in, CEPH_CAP_FILE_RD, CEPH_CAP_FILE_CACHE, &have, -1);
+  int r = get_caps(in, CEPH_CAP_FILE_RD, cache_caps, &have, -1);
   if (r < 0)
     return r;
 
@@ -5789,14 +6072,19 @@ int Client::_read(Fh *f, int64_t offset, uint64_t size, bufferlist *bl)
     movepos = true;
   }
 
+  bool direct = _use_direct_io(f, offset, size);
   if (!conf->client_debug_force_sync_read &&
-      (cct->_conf->client_oc && (have & CEPH_CAP_FILE_CACHE))) {
+      (cct->_conf->client_oc && (have & cache_caps)) &&
+      !direct) {
 
     if (f->flags & O_RSYNC) {
       _flush_range(in, offset, size);
     }
     r = _read_async(f, offset, size, bl);
   } else {
+    // going around the cache; it may still hold newer data of ours
+    if (direct && cct->_conf->client_oc)
+      _flush_range(in, offset, size);
     r = _read_sync(f, offset, size, bl);
   }
 
@@ -5811,19 +6099,6 @@ int Client::_read(Fh *f, int64_t offset, uint64_t size, bufferlist *bl)
     unlock_fh_pos(f);
   }
 
-  // adjust readahead state
-  if (f->last_pos != offset) {
-    f->nr_consec_read = f->consec_read_bytes = 0;
-  } else {
-    f->nr_consec_read++;
-  }
-  f->consec_read_bytes += bl->length();
-  ldout(cct, 10) << "readahead nr_consec_read " << f->nr_consec_read
-	   << " for " << f->consec_read_bytes << " bytes" 
-	   << " .. last_pos " << f->last_pos << " .. offset " << offset
-	   << dendl;
-  f->last_pos = offset+bl->length();
-
 done:
   // done!
   put_cap_ref(in, CEPH_CAP_FILE_RD);
@@ -5834,68 +6109,40 @@ int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
 {
   const md_config_t *conf = cct->_conf;
   Inode *in = f->inode;
-  bool readahead = true;
 
   ldout(cct, 10) << "_read_async " << *in << " " << off << "~" << len << dendl;
 
   // trim read based on file size?
   if (off >= in->size)
     return 0;
-  if (off + len > in->size) {
+  if (off + len > in->size)
     len = in->size - off;    
-    readahead = false;
-  }
 
   // we will populate the cache here
   if (in->cap_refs[CEPH_CAP_FILE_CACHE] == 0)
     in->get_cap_ref(CEPH_CAP_FILE_CACHE);
   
-  ldout(cct, 10) << "readahead=" << readahead << " nr_consec=" << f->nr_consec_read
-	   << " max_byes=" << conf->client_readahead_max_bytes
-	   << " max_periods=" << conf->client_readahead_max_periods << dendl;
-
   // readahead?
-  if (readahead &&
-      f->nr_consec_read &&
-      (conf->client_readahead_max_bytes ||
-       conf->client_readahead_max_periods)) {
-    loff_t l = f->consec_read_bytes * 2;
-    if (conf->client_readahead_min)
-      l = MAX(l, conf->client_readahead_min);
-    if (conf->client_readahead_max_bytes)
-      l = MIN(l, conf->client_readahead_max_bytes);
-    loff_t p = in->layout.fl_stripe_count * in->layout.fl_object_size;
-    if (conf->client_readahead_max_periods)
-      l = MIN(l, conf->client_readahead_max_periods * p);
-
-    if (l >= 2*p)
-      // align large readahead with period
-      l -= (off+l) % p;
-    else {
-      // align readahead with stripe unit if we cross su boundary
-      int su = in->layout.fl_stripe_unit;
-      if ((off+l)/su != off/su) l -= (off+l) % su;
-    }
-    
-    // don't read past end of file
-    if (off+l > in->size)
-      l = in->size - off;
-    
-    loff_t min = MIN((loff_t)len, l/2);
-
-    ldout(cct, 20) << "readahead " << f->nr_consec_read << " reads " 
-	     << f->consec_read_bytes << " bytes ... readahead " << off << "~" << l
-	     << " min " << min
-	     << " (caller wants " << off << "~" << len << ")" << dendl;
-    if (l > (loff_t)len) {
-      if (objectcacher->file_is_cached(&in->oset, &in->layout, in->snapid, off, min))
-	ldout(cct, 20) << "readahead already have min" << dendl;
-      else {
-	objectcacher->file_read(&in->oset, &in->layout, in->snapid, off, l, NULL, 0, 0);
-	ldout(cct, 20) << "readahead initiated" << dendl;
-      }
-    }
-  }
+  uint64_t p = (uint64_t)in->layout.fl_stripe_count * in->layout.fl_object_size;
+  uint64_t max = conf->client_readahead_max_bytes;
+  if (conf->client_readahead_max_periods) {
+    uint64_t max_periods = conf->client_readahead_max_periods * p;
+    max = max ? MIN(max, max_periods) : max_periods;
+  }
+  f->readahead.set_limits(conf->client_readahead_min, max,
+			  conf->client_readahead_streams);
+  f->readahead.set_alignments(p, in->layout.fl_stripe_unit);
+  Readahead::extent_t ra = f->readahead.update(off, len, in->size);
+  if (ra.second) {
+    ldout(cct, 20) << "readahead " << ra.first << "~" << ra.second
+		   << " (caller wants " << off << "~" << len << ")" << dendl;
+    objectcacher->file_read(&in->oset, &in->layout, in->snapid,
+			    ra.first, ra.second, NULL, 0, 0);
+  }
+  Readahead::stats_t rs = f->readahead.take_stats();
+  logger->inc(l_c_readahead_bytes, rs.issued);
+  logger->inc(l_c_readahead_hit_bytes, rs.hit);
+  logger->inc(l_c_readahead_wasted_bytes, rs.wasted);
   
   // read (and possibly block)
   int r, rvalue = 0;
@@ -5929,29 +6176,11 @@ int Client::_read_sync(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
 
   ldout(cct, 10) << "_read_sync " << *in << " " << off << "~" << len << dendl;
 
-  Mutex flock("Client::_read_sync flock");
-  Cond cond;
   while (left > 0) {
-    int r = 0;
-    bool done = false;
-    Context *onfinish = new C_SafeCond(&flock, &cond, &done, &r);
     bufferlist tbl;
     
     int wanted = left;
-    filer->read_trunc(in->ino, &in->layout, in->snapid,
-		      pos, left, &tbl, 0,
-		      in->truncate_size, in->truncate_seq,
-		      onfinish);
-    client_lock.Unlock();
-    flock.Lock();
-    while (!done)
-      cond.Wait(flock);
-    flock.Unlock();
-    client_lock.Lock();
-
-    // if we get ENOENT from OSD, assume 0 bytes returned
-    if (r == -ENOENT)
-      r = 0;
+    int r = _read_striped(in, pos, left, &tbl);
     if (r < 0)
       return r;
     if (tbl.length()) {
@@ -5993,6 +6222,89 @@ int Client::_read_sync(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
 }
 
 
+/*
+ * read off~len from the osds, like a single Filer::read_trunc would
+ * (holes zeroed, short at the end of the data), but a layout period (one
+ * full object set) at a time with up to client_read_periods_inflight of
+ * them outstanding.  one big read then keeps every object of the stripe
+ * busy from start to end, instead of queueing all of it on the objecter
+ * at once and waiting for the slowest op before anything is returned.
+ */
+struct striped_read_chunk_t {
+  uint64_t off, len;
+  bufferlist bl;
+  int r;
+  bool done;
+  striped_read_chunk_t() : off(0), len(0), r(0), done(false) {}
+};
+
+int Client::_read_striped(Inode *in, uint64_t off, uint64_t len, bufferlist *bl)
+{
+  uint64_t period = (uint64_t)in->layout.fl_stripe_count * in->layout.fl_object_size;
+  unsigned window = cct->_conf->client_read_periods_inflight;
+  if (!period || !window)
+    period = len;
+
+  vector<striped_read_chunk_t> chunks((off + len - 1) / period - off / period + 1);
+  uint64_t pos = off;
+  for (unsigned i = 0; i < chunks.size(); i++) {
+    chunks[i].off = pos;
+    chunks[i].len = MIN(off + len, (pos / period + 1) * period) - pos;
+    pos += chunks[i].len;
+  }
+  ldout(cct, 15) << "_read_striped " << off << "~" << len << " in " << chunks.size()
+		 << " periods, window " << window << dendl;
+
+  Mutex flock("Client::_read_striped flock");
+  Cond cond;
+  unsigned issue_max = chunks.size();
+  unsigned next = 0;
+  int r = 0;
+  for (unsigned i = 0; i < next || i < issue_max; i++) {
+    // keep the window full
+    while (next < issue_max && next <= i + window - 1) {
+      striped_read_chunk_t &c = chunks[next++];
+      filer->read_trunc(in->ino, &in->layout, in->snapid,
+			c.off, c.len, &c.bl, 0,
+			in->truncate_size, in->truncate_seq,
+			new C_SafeCond(&flock, &cond, &c.done, &c.r));
+    }
+
+    striped_read_chunk_t &c = chunks[i];
+    client_lock.Unlock();
+    flock.Lock();
+    while (!c.done)
+      cond.Wait(flock);
+    flock.Unlock();
+    client_lock.Lock();
+
+    // if we get ENOENT from OSD, assume 0 bytes returned
+    if (c.r == -ENOENT)
+      c.r = 0;
+    if (c.r < 0) {
+      // stop issuing, but reap what is still in flight
+      if (!r)
+	r = c.r;
+      issue_max = next;
+      continue;
+    }
+    if (r < 0 || !c.bl.length())
+      continue;
+
+    // zero whatever came back short before this data
+    uint64_t have = bl->length();
+    if (c.off - off > have) {
+      bufferptr z(c.off - off - have);
+      z.zero();
+      bl->push_back(z);
+    }
+    bl->claim_append(c.bl);
+  }
+  if (r < 0)
+    return r;
+  return bl->length();
+}
+
 /*
  * we keep count of uncommitted sync writes on the inode, so that
  * fsync can DDRT.
@@ -6027,6 +6339,12 @@ void Client::sync_write_commit(Inode *in)
 
 int Client::write(int fd, const char *buf, loff_t size, loff_t offset) 
 {
+  // copy into a fresh buffer (the write may be resubmitted, async)
+  // before taking client_lock
+  bufferlist bl;
+  if (size > 0)
+    bl.append(buffer::copy(buf, size));
+
   Mutex::Locker lock(client_lock);
   tout(cct) << "write" << std::endl;
   tout(cct) << fd << std::endl;
@@ -6036,13 +6354,193 @@ int Client::write(int fd, const char *buf, loff_t size, loff_t offset)
   Fh *fh = get_filehandle(fd);
   if (!fh)
     return -EBADF;
-  int r = _write(fh, offset, size, buf);
+  int r = _write(fh, offset, size, bl);
   ldout(cct, 3) << "write(" << fd << ", \"...\", " << size << ", " << offset << ") = " << r << dendl;
   return r;
 }
 
+int Client::pwritev(int fd, const struct iovec *iov, int iovcnt, loff_t offset)
+{
+  if (iovcnt < 0)
+    return -EINVAL;
+  bufferlist bl;
+  for (int i = 0; i < iovcnt; i++)
+    if (iov[i].iov_len)
+      bl.append(buffer::copy((const char*)iov[i].iov_base, iov[i].iov_len));
+
+  Mutex::Locker lock(client_lock);
+  tout(cct) << "pwritev" << std::endl;
+  tout(cct) << fd << std::endl;
+  tout(cct) << iovcnt << std::endl;
+  tout(cct) << offset << std::endl;
+
+  Fh *fh = get_filehandle(fd);
+  if (!fh)
+    return -EBADF;
+  int r = _write(fh, offset, bl.length(), bl);
+  ldout(cct, 3) << "pwritev(" << fd << ", " << iovcnt << " iovs, " << bl.length() << ", " << offset << ") = " << r << dendl;
+  return r;
+}
+
+
+// -- aio --
+//
+// a read whose caps are already in hand goes straight to the
+// ObjectCacher, a buffered write straight into it.  anything that would
+// have to wait for caps (or reads around the cache) runs the ordinary
+// blocking path on async_io_worker.  either way the caller's completion
+// runs on async_io_finisher, without client_lock, so it may call back
+// into the client.
+
+class C_Client_AioCopyOut : public Context {
+  bufferlist bl;
+  char *buf;
+  Context *onfinish;
+public:
+  C_Client_AioCopyOut(bufferlist& b, char *bf, Context *c) : buf(bf), onfinish(c) {
+    bl.claim(b);
+  }
+  void finish(int r) {
+    if (r >= 0) {
+      bl.copy(0, bl.length(), buf);
+      r = bl.length();
+    }
+    onfinish->complete(r);
+  }
+};
+
+class C_Client_AioRead : public Context {
+  Client *client;
+  Inode *in;
+  char *buf;
+  Context *onfinish;
+public:
+  bufferlist bl;
+  C_Client_AioRead(Client *c, Inode *i, char *b, Context *f) :
+    client(c), in(i), buf(b), onfinish(f) {
+    in->get();
+  }
+  void finish(int r) {
+    // under client_lock: the ObjectCacher calls us with it held
+    assert(client->client_lock.is_locked());
+    client->put_cap_ref(in, CEPH_CAP_FILE_RD);
+    client->put_inode(in);
+    client->async_io_finisher.queue(new C_Client_AioCopyOut(bl, buf, onfinish), r);
+  }
+};
+
+class C_Client_AioSync : public Context {
+  Client *client;
+  int fd;
+  char *rbuf;
+  bufferlist wbl;
+  loff_t size, offset;
+  Context *onfinish;
+public:
+  C_Client_AioSync(Client *c, int f, char *b, loff_t s, loff_t o, Context *fin) :
+    client(c), fd(f), rbuf(b), size(s), offset(o), onfinish(fin) {}
+  C_Client_AioSync(Client *c, int f, bufferlist& bl, loff_t o, Context *fin) :
+    client(c), fd(f), rbuf(NULL), size(bl.length()), offset(o), onfinish(fin) {
+    wbl.claim(bl);
+  }
+  void finish(int r) {
+    if (rbuf) {
+      r = client->read(fd, rbuf, size, offset);
+    } else {
+      client->client_lock.Lock();
+      Fh *fh = client->get_filehandle(fd);
+      r = fh ? client->_write(fh, offset, size, wbl) : -EBADF;
+      client->client_lock.Unlock();
+    }
+    onfinish->complete(r);
+  }
+};
+
+int Client::aio_read(int fd, char *buf, loff_t size, loff_t offset, Context *onfinish)
+{
+  Mutex::Locker lock(client_lock);
+  tout(cct) << "aio_read" << std::endl;
+  tout(cct) << fd << std::endl;
+  tout(cct) << size << std::endl;
+  tout(cct) << offset << std::endl;
+
+  if (offset < 0 || size < 0)
+    return -EINVAL;
+  Fh *f = get_filehandle(fd);
+  if (!f)
+    return -EBADF;
+  if ((f->mode & CEPH_FILE_MODE_RD) == 0)
+    return -EBADF;
+  Inode *in = f->inode;
+
+  if (!cct->_conf->client_oc || cct->_conf->client_debug_force_sync_read ||
+      (f->flags & O_RSYNC) ||
+      !in->caps_issued_mask(CEPH_CAP_FILE_RD | CEPH_CAP_FILE_CACHE)) {
+    ldout(cct, 10) << "aio_read " << *in << " " << offset << "~" << size << " via worker" << dendl;
+    async_io_worker.queue(new C_Client_AioSync(this, fd, buf, size, offset, onfinish));
+    return 0;
+  }
+
+  uint64_t len = size;
+  if ((uint64_t)offset >= in->size)
+    len = 0;
+  else if (offset + len > in->size)
+    len = in->size - offset;
+  ldout(cct, 10) << "aio_read " << *in << " " << offset << "~" << len << dendl;
+
+  get_cap_ref(in, CEPH_CAP_FILE_RD);
+  if (in->cap_refs[CEPH_CAP_FILE_CACHE] == 0)
+    in->get_cap_ref(CEPH_CAP_FILE_CACHE);
+  C_Client_AioRead *c = new C_Client_AioRead(this, in, buf, onfinish);
+  int r = 0;
+  if (len)
+    r = objectcacher->file_read(&in->oset, &in->layout, in->snapid,
+				offset, len, &c->bl, 0, c);
+  if (r != 0 || !len)
+    c->complete(r);   // cached (or nothing to read)
+  return 0;
+}
+
+int Client::aio_write(int fd, const char *buf, loff_t size, loff_t offset, Context *onfinish)
+{
+  if (offset < 0 || size < 0)
+    return -EINVAL;
+  bufferlist bl;
+  if (size > 0)
+    bl.append(buffer::copy(buf, size));
 
-int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf)
+  Mutex::Locker lock(client_lock);
+  tout(cct) << "aio_write" << std::endl;
+  tout(cct) << fd << std::endl;
+  tout(cct) << size << std::endl;
+  tout(cct) << offset << std::endl;
+
+  Fh *f = get_filehandle(fd);
+  if (!f)
+    return -EBADF;
+  if ((f->mode & CEPH_FILE_MODE_WR) == 0)
+    return -EBADF;
+  Inode *in = f->inode;
+
+  // a buffered write within max_size doesn't wait on the mds or osds
+  if (cct->_conf->client_oc &&
+      !(f->flags & (O_SYNC | O_DSYNC)) &&
+      !_use_direct_io(f, offset, size) &&
+      (uint64_t)(offset + size) <= in->max_size &&
+      in->caps_issued_mask(CEPH_CAP_FILE_WR | CEPH_CAP_FILE_BUFFER)) {
+    int r = _write(f, offset, size, bl);
+    ldout(cct, 10) << "aio_write " << *in << " " << offset << "~" << size << " buffered = " << r << dendl;
+    async_io_finisher.queue(onfinish, r);
+    return 0;
+  }
+
+  ldout(cct, 10) << "aio_write " << *in << " " << offset << "~" << size << " via worker" << dendl;
+  async_io_worker.queue(new C_Client_AioSync(this, fd, bl, offset, onfinish));
+  return 0;
+}
+
+
+int Client::_write(Fh *f, int64_t offset, uint64_t size, bufferlist& bl)
 {
   if ((uint64_t)(offset+size) > mdsmap->get_max_filesize()) //too large!
     return -EFBIG;
@@ -6073,30 +6571,36 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf)
     unlock_fh_pos(f);
   }
 
-  //bool lazy = f->mode == CEPH_FILE_MODE_LAZY;
+  // ... and buffering under Fl, see _read
+  int buffer_caps = CEPH_CAP_FILE_BUFFER;
+  if (f->mode & CEPH_FILE_MODE_LAZY)
+    buffer_caps |= CEPH_CAP_FILE_LAZYIO;
 
   ldout(cct, 10) << "cur file size is " << in->size << dendl;
 
   // time it.
   utime_t start = ceph_clock_now(cct);
 
-  // copy into fresh buffer (since our write may be resub, async)
-  bufferptr bp;
-  if (size > 0) bp = buffer::copy(buf, size);
-  bufferlist bl;
-  bl.push_back( bp );
-
   utime_t lat;
   uint64_t totalwritten;
   uint64_t endoff = offset + size;
   int have;
-  int r = get_caps(in, CEPH_CAP_FILE_WR, CEPH_CAP_FILE_BUFFER, &have, endoff);
+  int r = get_caps(in, CEPH_CAP_FILE_WR, buffer_caps, &have, endoff);
   if (r < 0)
     return r;
 
   ldout(cct, 10) << " snaprealm " << *in->snaprealm << dendl;
 
-  if (cct->_conf->client_oc && (have & CEPH_CAP_FILE_BUFFER)) {
+  bool direct = _use_direct_io(f, offset, size);
+  if (direct && cct->_conf->client_oc && !in->oset.objects.empty()) {
+    // the write goes around the cache: get anything dirty there out
+    // first, then drop the cached copy of the range it replaces
+    ldout(cct, 10) << " direct write " << offset << "~" << size << ", flushing cached range" << dendl;
+    _flush_range(in, offset, size);
+    _invalidate_inode_cache(in, offset, size, true);
+  }
+
+  if (cct->_conf->client_oc && (have & buffer_caps) && !direct) {
     // do buffered write
     if (!in->oset.dirty_or_tx)
       get_cap_ref(in, CEPH_CAP_FILE_BUFFER);
@@ -6468,22 +6972,65 @@ int64_t Client::drop_caches()
 }
 
 
-int Client::lazyio_propogate(int fd, loff_t offset, size_t count)
+int Client::_lazyio(Fh *fh, int enable)
+{
+  Inode *in = fh->inode;
+  int orig_mode = fh->mode;
+  if (enable)
+    fh->mode |= CEPH_FILE_MODE_LAZY;
+  else
+    fh->mode &= ~CEPH_FILE_MODE_LAZY;
+  if (fh->mode == orig_mode)
+    return 0;
+
+  ldout(cct, 10) << "_lazyio " << fh << " mode " << orig_mode << " -> " << fh->mode
+		 << " on " << *in << dendl;
+
+  // move our open ref over so that we want (or stop wanting) Fl
+  in->get_open_ref(fh->mode);
+  in->put_open_ref(orig_mode);
+  check_caps(in, true);
+  return 0;
+}
+
+int Client::lazyio(int fd, int enable)
 {
   Mutex::Locker l(client_lock);
-  ldout(cct, 3) << "op: client->lazyio_propogate(" << fd
+  ldout(cct, 3) << "op: client->lazyio(" << fd << ", " << enable << ")" << dendl;
+
+  Fh *f = get_filehandle(fd);
+  if (!f)
+    return -EBADF;
+  return _lazyio(f, enable);
+}
+
+/*
+ * make our writes to the range visible to the other lazy io clients:
+ * get them out of the cache, and tell the mds about the new size.
+ */
+int Client::lazyio_propagate(int fd, loff_t offset, size_t count)
+{
+  Mutex::Locker l(client_lock);
+  ldout(cct, 3) << "op: client->lazyio_propagate(" << fd
           << ", " << offset << ", " << count << ")" << dendl;
   
   Fh *f = get_filehandle(fd);
   if (!f)
     return -EBADF;
+  Inode *in = f->inode;
 
-  // for now
-  _fsync(f, true);
-
+  if (count)
+    _flush_range(in, offset, count);
+  else
+    _fsync(f, true);
+  check_caps(in, true);
   return 0;
 }
 
+/*
+ * see the writes others have propagated: push ours out first, then
+ * drop what we have cached of the range and refetch the size.
+ */
 int Client::lazyio_synchronize(int fd, loff_t offset, size_t count)
 {
   Mutex::Locker l(client_lock);
@@ -6495,9 +7042,14 @@ int Client::lazyio_synchronize(int fd, loff_t offset, size_t count)
     return -EBADF;
   Inode *in = f->inode;
   
-  _fsync(f, true);
-  _release(in);
-  return 0;
+  if (count) {
+    _flush_range(in, offset, count);
+    _invalidate_inode_cache(in, offset, count, true);
+  } else {
+    _fsync(f, true);
+    _invalidate_inode_cache(in, true);
+  }
+  return _getattr(in, CEPH_STAT_CAP_SIZE, -1, -1, true);
 }
 
 
@@ -7631,6 +8183,15 @@ int Client::ll_describe_layout(Fh *fh, ceph_file_layout* lp)
   return 0;
 }
 
+int Client::ll_lazyio(Fh *fh, int enable)
+{
+  Mutex::Locker lock(client_lock);
+  ldout(cct, 3) << "ll_lazyio " << fh << " " << fh->inode->ino << " " << enable << dendl;
+  tout(cct) << "ll_lazyio" << std::endl;
+
+  return _lazyio(fh, enable);
+}
+
 int Client::ll_opendir(vinodeno_t vino, void **dirpp, int uid, int gid)
 {
   Mutex::Locker lock(client_lock);
@@ -7769,6 +8330,11 @@ int Client::ll_read(Fh *fh, loff_t off, loff_t len, bufferlist *bl)
 
 int Client::ll_write(Fh *fh, loff_t off, loff_t len, const char *data)
 {
+  // copy before taking client_lock, see write()
+  bufferlist bl;
+  if (len > 0)
+    bl.append(buffer::copy(data, len));
+
   Mutex::Locker lock(client_lock);
   ldout(cct, 3) << "ll_write " << fh << " " << fh->inode->ino << " " << off << "~" << len << dendl;
   tout(cct) << "ll_write" << std::endl;
@@ -7776,7 +8342,7 @@ int Client::ll_write(Fh *fh, loff_t off, loff_t len, const char *data)
   tout(cct) << off << std::endl;
   tout(cct) << len << std::endl;
 
-  int r = _write(fh, off, len, data);
+  int r = _write(fh, off, len, bl);
   ldout(cct, 3) << "ll_write " << fh << " " << off << "~" << len << " = " << r << dendl;
   return r;
 }
@@ -23,6 +23,7 @@
 #include <set>
 #include <map>
 #include <fstream>
+#include <sys/uio.h>
 using std::set;
 using std::map;
 using std::fstream;
@@ -80,6 +81,12 @@ enum {
   l_c_owrlat,
   l_c_ordlat,
   l_c_wrlat,
+  l_c_readahead_bytes,
+  l_c_readahead_hit_bytes,
+  l_c_readahead_wasted_bytes,
+  l_c_dentry_hit,
+  l_c_dentry_neg_hit,
+  l_c_dentry_miss,
   l_c_last,
 };
 
@@ -223,7 +230,11 @@ class Client : public Dispatcher {
   Finisher async_ino_invalidator;
   Finisher async_dentry_invalidator;
 
+  Finisher async_io_finisher;   // aio completions, called without client_lock
+  Finisher async_io_worker;     // aio that has to wait for caps or the osds
+
   Context *tick_event;
+  Context *cap_batch_flush;
   utime_t last_cap_renew;
   void renew_caps();
   void renew_caps(MetaSession *session);
@@ -276,6 +287,7 @@ public:
   int choose_target_mds(MetaRequest *req);
   void connect_mds_targets(int mds);
   void send_request(MetaRequest *request, MetaSession *session);
+  void pick_delegated_ino(MetaRequest *request, MetaSession *session);
   MClientRequest *build_client_request(MetaRequest *request);
   void kick_requests(MetaSession *session);
   void kick_requests_closed(MetaSession *session);
@@ -305,6 +317,7 @@ protected:
   hash_map<vinodeno_t, Inode*> inode_map;
   Inode*                 root;
   LRU                    lru;    // lru list of Dentry's in our local metadata cache.
+  uint64_t               dn_bytes;  // dentries and their names, see cache_bytes()
 
   // all inodes with caps sit on either cap_list or delayed_caps.
   xlist<Inode*> delayed_caps, cap_list;
@@ -366,6 +379,9 @@ protected:
   friend class C_Client_PutInode; // calls put_inode()
   friend class C_Client_CacheInvalidate;  // calls ino_invalidate_cb
   friend class C_Client_DentryInvalidate;  // calls dentry_invalidate_cb
+  friend class C_Client_AioRead;   // puts cap refs
+  friend class C_Client_AioSync;   // calls _write()
+  friend class C_C_FlushCapBatches; // flushes the held cap flushes
 
   //int get_cache_size() { return lru.lru_get_size(); }
   //void set_cache_size(int m) { lru.lru_set_max(m); }
@@ -391,6 +407,8 @@ protected:
   
   void dump_inode(Formatter *f, Inode *in, set<Inode*>& did, bool disconnected);
   void dump_cache(Formatter *f);  // debug
+  void dump_cache_status(Formatter *f);
+  uint64_t cache_bytes();
   
   // trace generation
   ofstream traceout;
@@ -441,6 +459,9 @@ protected:
   int mark_caps_flushing(Inode *in);
   void flush_caps();
   void flush_caps(Inode *in, MetaSession *session);
+  void batch_cap_flush(MClientCaps *m, MetaSession *session);
+  void flush_cap_batch(MetaSession *session);
+  void flush_cap_batches();
   void kick_flushing_caps(MetaSession *session);
   void kick_maxsize_requests(MetaSession *session);
   int get_caps(Inode *in, int need, int want, int *have, loff_t endoff);
@@ -491,6 +512,7 @@ protected:
    */
   bool _flush(Inode *in, Context *c=NULL);
   void _flush_range(Inode *in, int64_t off, uint64_t size);
+  int _lazyio(Fh *fh, int enable);
   void _flushed(Inode *in);
   void flush_set_callback(ObjectCacher::ObjectSet *oset);
 
@@ -542,7 +564,9 @@ private:
   Fh *_create_fh(Inode *in, int flags, int cmode);
   int _release_fh(Fh *fh);
 
+  bool _use_direct_io(Fh *f, int64_t offset, uint64_t size);
   int _read_sync(Fh *f, uint64_t off, uint64_t len, bufferlist *bl);
+  int _read_striped(Inode *in, uint64_t off, uint64_t len, bufferlist *bl);
   int _read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl);
 
   // internal interface
@@ -569,7 +593,7 @@ private:
 	      bool *created = NULL, int uid=-1, int gid=-1);
   loff_t _lseek(Fh *fh, loff_t offset, int whence);
   int _read(Fh *fh, int64_t offset, uint64_t size, bufferlist *bl);
-  int _write(Fh *fh, int64_t offset, uint64_t size, const char *buf);
+  int _write(Fh *fh, int64_t offset, uint64_t size, bufferlist& bl);
   int _flush(Fh *fh);
   int _fsync(Fh *fh, bool syncdataonly);
   int _sync_fs();
@@ -668,6 +692,10 @@ public:
   loff_t lseek(int fd, loff_t offset, int whence);
   int read(int fd, char *buf, loff_t size, loff_t offset=-1);
   int write(int fd, const char *buf, loff_t size, loff_t offset=-1);
+  int preadv(int fd, const struct iovec *iov, int iovcnt, loff_t offset=-1);
+  int pwritev(int fd, const struct iovec *iov, int iovcnt, loff_t offset=-1);
+  int aio_read(int fd, char *buf, loff_t size, loff_t offset, Context *onfinish);
+  int aio_write(int fd, const char *buf, loff_t size, loff_t offset, Context *onfinish);
   int fake_write_size(int fd, loff_t size);
   int ftruncate(int fd, loff_t size);
   int fsync(int fd, bool syncdataonly);
@@ -688,7 +716,8 @@ public:
   int64_t drop_caches();
 
   // hpc lazyio
-  int lazyio_propogate(int fd, loff_t offset, size_t count);
+  int lazyio(int fd, int enable);
+  int lazyio_propagate(int fd, loff_t offset, size_t count);
   int lazyio_synchronize(int fd, loff_t offset, size_t count);
 
   // expose file layout
@@ -736,6 +765,7 @@ public:
   int ll_rename(vinodeno_t parent, const char *name, vinodeno_t newparent, const char *newname, int uid = -1, int gid = -1);
   int ll_link(vinodeno_t vino, vinodeno_t newparent, const char *newname, struct stat *attr, int uid = -1, int gid = -1);
   int ll_describe_layout(Fh *fh, ceph_file_layout* layout);
+  int ll_lazyio(Fh *fh, int enable);
   int ll_open(vinodeno_t vino, int flags, Fh **fh, int uid = -1, int gid = -1);
   int ll_create(vinodeno_t parent, const char *name, mode_t mode, int flags, struct stat *attr, Fh **fh, int uid = -1, int gid = -1);
   int ll_read(Fh *fh, loff_t off, loff_t len, bufferlist *bl);
@@ -45,6 +45,7 @@ public:
   int      resend_mds;         // someone wants you to (re)send the request here
   bool     send_to_auth;       // must send to auth mds
   __u32    sent_on_mseq;       // mseq at last submission of this request
+  int      deleg_ino_mds;      // whose delegated ino is in head.ino
   int      num_fwd;            // # of times i've been forwarded
   int      retry_attempt;
   int      ref;
@@ -86,6 +87,7 @@ public:
     other_inode_drop(0), other_inode_unless(0),
     regetattr_mask(0),
     mds(-1), resend_mds(-1), send_to_auth(false), sent_on_mseq(0),
+    deleg_ino_mds(-1),
     num_fwd(0), retry_attempt(0),
     ref(1), reply(0), 
     kick(false),
@@ -153,6 +155,9 @@ public:
   void set_dentry_wanted() {
     head.flags = head.flags | CEPH_MDS_FLAG_WANT_DENTRY;
   }
+  void set_readdirplus() {
+    head.flags = head.flags | CEPH_MDS_FLAG_READDIRPLUS;
+  }
   int get_op() { return head.op; }
   tid_t get_tid() { return tid; }
   filepath& get_filepath() { return path; }
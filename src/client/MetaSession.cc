@@ -6,6 +6,8 @@
 #include "MetaSession.h"
 
 #include "common/Formatter.h"
+#include "mds/mdstypes.h"
+#include "messages/MClientCaps.h"
 
 const char *MetaSession::get_state_name() const
 {
@@ -36,4 +38,6 @@ MetaSession::~MetaSession()
 {
   if (release)
     release->put();
+  if (cap_batch)
+    cap_batch->put();
 }
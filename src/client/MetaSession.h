@@ -8,6 +8,7 @@
 #include "include/utime.h"
 #include "msg/msg_types.h"
 #include "include/xlist.h"
+#include "include/interval_set.h"
 
 #include "messages/MClientCapRelease.h"
 
@@ -16,6 +17,7 @@ class Inode;
 struct CapSnap;
 struct MetaRequest;
 class MClientCapRelease;
+class MClientCaps;
 
 struct MetaSession {
   int mds_num;
@@ -46,12 +48,15 @@ struct MetaSession {
   Cap *s_cap_iterator;
 
   MClientCapRelease *release;
+  MClientCaps *cap_batch;  // cap flushes held for client_cap_batch_window
+
+  interval_set<inodeno_t> delegated_inos;  // the mds lets us pick these for creates
   
   MetaSession()
     : mds_num(-1), con(NULL),
       seq(0), cap_gen(0), cap_renew_seq(0), num_caps(0),
       state(STATE_NEW), s_cap_iterator(NULL),
-      release(NULL)
+      release(NULL), cap_batch(NULL)
   {}
   ~MetaSession();
 
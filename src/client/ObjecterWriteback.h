@@ -31,6 +31,23 @@ class ObjecterWriteback : public WritebackHandler {
 				   trunc_size, trunc_seq, NULL, oncommit);
   }
 
+  virtual bool can_write_extents() { return true; }
+  virtual tid_t write_extents(const object_t& oid, const object_locator_t& oloc,
+			      const vector<pair<uint64_t, bufferlist> >& extents,
+			      const SnapContext& snapc, utime_t mtime,
+			      uint64_t trunc_size, __u32 trunc_seq,
+			      Context *oncommit) {
+    ObjectOperation op;
+    for (vector<pair<uint64_t, bufferlist> >::const_iterator p = extents.begin();
+	 p != extents.end(); ++p) {
+      bufferlist bl = p->second;
+      op.write(p->first, bl);
+      op.ops.back().op.extent.truncate_size = trunc_size;
+      op.ops.back().op.extent.truncate_seq = trunc_seq;
+    }
+    return m_objecter->mutate(oid, oloc, op, snapc, mtime, 0, NULL, oncommit);
+  }
+
   virtual tid_t lock(const object_t& oid, const object_locator_t& oloc, int op,
 		     int flags, Context *onack, Context *oncommit) {
     return m_objecter->lock(oid, oloc, op, flags, onack, oncommit);
@@ -346,10 +346,26 @@ static void fuse_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
   Fh *fh = (Fh*)fi->fh;
   bufferlist bl;
   int r = cfuse->client->ll_read(fh, off, size, &bl);
-  if (r >= 0)
-    fuse_reply_buf(req, bl.c_str(), bl.length());
-  else
+  if (r >= 0) {
+    // hand fuse the buffers as they are instead of flattening them
+    vector<struct iovec> iov(bl.buffers().size());
+    int n = 0;
+    for (list<bufferptr>::const_iterator p = bl.buffers().begin();
+	 p != bl.buffers().end();
+	 ++p) {
+      if (!p->length())
+	continue;
+      iov[n].iov_base = (void*)p->c_str();
+      iov[n].iov_len = p->length();
+      n++;
+    }
+    if (n)
+      fuse_reply_iov(req, &iov[0], n);
+    else
+      fuse_reply_buf(req, NULL, 0);
+  } else {
     fuse_reply_err(req, -r);
+  }
 }
 
 static void fuse_ll_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
@@ -394,6 +410,15 @@ static void fuse_ll_ioctl(fuse_req_t req, fuse_ino_t ino, int cmd, void *arg, st
       fuse_reply_ioctl(req, 0, &l, sizeof(struct ceph_ioctl_layout));
     }
     break;
+    case CEPH_IOC_LAZYIO: {
+      Fh *fh = (Fh*)fi->fh;
+      int r = cfuse->client->ll_lazyio(fh, 1);
+      if (r < 0)
+	fuse_reply_err(req, -r);
+      else
+	fuse_reply_ioctl(req, 0, NULL, 0);
+    }
+    break;
     default:
       fuse_reply_err(req, EINVAL);
   }
@@ -769,6 +794,10 @@ done:
 
 int CephFuse::Handle::loop()
 {
+  // the Client drops client_lock while it waits on the osds, so with
+  // several fuse threads ios to different files overlap
+  if (client->cct->_conf->fuse_multithreaded)
+    return fuse_session_loop_mt(se);
   return fuse_session_loop(se);
 }
 
@@ -48,6 +48,17 @@ static void get_index_time_prefix(utime_t& ts, string& index)
   index = log_index_prefix + buf;
 }
 
+/* the first key past all those that start with prefix, "" if there is none */
+static string key_past_prefix(const string& prefix)
+{
+  string key = prefix;
+  while (!key.empty() && (unsigned char)key[key.size() - 1] == 0xff)
+    key.erase(key.size() - 1);
+  if (!key.empty())
+    key[key.size() - 1]++;
+  return key;
+}
+
 static int read_header(cls_method_context_t hctx, cls_log_header& header)
 {
   bufferlist header_bl;
@@ -172,12 +183,15 @@ static int cls_log_list(cls_method_context_t hctx, bufferlist *in, bufferlist *o
   if (use_time_boundary)
     get_index_time_prefix(op.to_time, to_index);
 
-#define MAX_ENTRIES 1000
+#define MAX_ENTRIES 10000
+#define MAX_LIST_BYTES (4 * 1024 * 1024)
   size_t max_entries = op.max_entries;
   if (!max_entries || max_entries > MAX_ENTRIES)
     max_entries = MAX_ENTRIES;
 
-  int rc = cls_cxx_map_get_vals(hctx, from_index, log_index_prefix, max_entries + 1, &keys);
+  bool more;
+  int rc = cls_cxx_map_get_vals(hctx, from_index, log_index_prefix, max_entries + 1,
+                                MAX_LIST_BYTES, &keys, &more);
   if (rc < 0)
     return rc;
 
@@ -209,7 +223,7 @@ static int cls_log_list(cls_method_context_t hctx, bufferlist *in, bufferlist *o
     }
   }
 
-  if (iter == keys.end())
+  if (iter == keys.end() && !more)
     done = true;
 
   ret.marker = marker;
@@ -233,8 +247,6 @@ static int cls_log_trim(cls_method_context_t hctx, bufferlist *in, bufferlist *o
     return -EINVAL;
   }
 
-  map<string, bufferlist> keys;
-
   string from_index;
   string to_index;
 
@@ -249,38 +261,35 @@ static int cls_log_trim(cls_method_context_t hctx, bufferlist *in, bufferlist *o
     to_index = op.to_marker;
   }
 
-#define MAX_TRIM_ENTRIES 1000
-  size_t max_entries = MAX_TRIM_ENTRIES;
+  /*
+   * the keys after from_index that, cut to the length of to_index, are
+   * no greater than it: that is [begin_key, end_key), removed at once
+   */
+  string begin_key = from_index;
+  begin_key.push_back('\0');
+  if (begin_key < log_index_prefix)
+    begin_key = log_index_prefix;
+  string end_key = key_past_prefix(to_index);
+  string log_end = key_past_prefix(log_index_prefix);
+  if (end_key.empty() || end_key > log_end)
+    end_key = log_end;
 
-  int rc = cls_cxx_map_get_vals(hctx, from_index, log_index_prefix, max_entries, &keys);
+  map<string, bufferlist> keys;
+  int rc = cls_cxx_map_get_vals(hctx, from_index, log_index_prefix, 1, &keys);
   if (rc < 0)
     return rc;
 
-  map<string, bufferlist>::iterator iter = keys.begin();
-
-  size_t i;
-  bool removed = false;
-  for (i = 0; i < max_entries && iter != keys.end(); ++i, ++iter) {
-    const string& index = iter->first;
-
-    CLS_LOG(20, "index=%s to_index=%s", index.c_str(), to_index.c_str());
-
-    if (index.compare(0, to_index.size(), to_index) > 0)
-      break;
+  if (keys.empty() || keys.begin()->first >= end_key)
+    return -ENODATA;
 
-    CLS_LOG(20, "removing key: index=%s", index.c_str());
+  CLS_LOG(20, "removing keys: [%s, %s)", begin_key.c_str(), end_key.c_str());
 
-    int rc = cls_cxx_map_remove_key(hctx, index);
-    if (rc < 0) {
-      CLS_LOG(1, "ERROR: cls_cxx_map_remove_key failed rc=%d", rc);
-      return -EINVAL;
-    }
-    removed = true;
+  rc = cls_cxx_map_remove_range(hctx, begin_key, end_key);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: cls_cxx_map_remove_range failed rc=%d", rc);
+    return -EINVAL;
   }
 
-  if (!removed)
-    return -ENODATA;
-
   return 0;
 }
 
@@ -77,14 +77,19 @@ cls_method_handle_t h_get_children;
 cls_method_handle_t h_get_snapcontext;
 cls_method_handle_t h_get_object_prefix;
 cls_method_handle_t h_get_snapshot_name;
+cls_method_handle_t h_get_refresh_info;
+cls_method_handle_t h_snapshot_list_range;
 cls_method_handle_t h_snapshot_add;
 cls_method_handle_t h_snapshot_remove;
 cls_method_handle_t h_get_all_features;
 cls_method_handle_t h_copyup;
+cls_method_handle_t h_object_map_update;
+cls_method_handle_t h_object_map_merge;
 cls_method_handle_t h_get_id;
 cls_method_handle_t h_set_id;
 cls_method_handle_t h_dir_get_id;
 cls_method_handle_t h_dir_get_name;
+cls_method_handle_t h_dir_get_names;
 cls_method_handle_t h_dir_list;
 cls_method_handle_t h_dir_add_image;
 cls_method_handle_t h_dir_remove_image;
@@ -1184,6 +1189,211 @@ int get_snapshot_name(cls_method_context_t hctx, bufferlist *in, bufferlist *out
   return 0;
 }
 
+static void encode_parent(const cls_rbd_parent &parent, bufferlist *out)
+{
+  ::encode(parent.pool, *out);
+  ::encode(parent.id, *out);
+  ::encode(parent.snapid, *out);
+  ::encode(parent.overlap, *out);
+}
+
+/**
+ * Read the metadata of up to max_return snapshots with ids above
+ * start_after (0 for the first one), in ascending order of id.  The
+ * snapshots' keys sort by id, so this is a walk of a key range.
+ */
+static int read_snaps(cls_method_context_t hctx, uint64_t start_after,
+		      uint64_t max_return, vector<cls_rbd_snap> *snaps,
+		      bool *more)
+{
+  string start_key = RBD_SNAP_KEY_PREFIX;
+  if (start_after)
+    key_from_snap_id(start_after, &start_key);
+
+  // one past max_return tells whether there are more
+  cls_map_iterator it(hctx, RBD_SNAP_KEY_PREFIX,
+		      max_return < RBD_MAX_KEYS_READ ? max_return + 1 :
+		      RBD_MAX_KEYS_READ);
+  for (it.seek(start_key); it.valid() && snaps->size() < max_return;
+       it.next()) {
+    cls_rbd_snap snap;
+    bufferlist::iterator p = it.value().begin();
+    try {
+      ::decode(snap, p);
+    } catch (const buffer::error &err) {
+      CLS_ERR("error decoding snapshot metadata for snap_id: %llu",
+	      (unsigned long long)snap_id_from_key(it.key()).val);
+      return -EIO;
+    }
+    snaps->push_back(snap);
+  }
+  if (it.status() < 0)
+    return it.status();
+  *more = it.valid();
+  return 0;
+}
+
+/**
+ * Get the metadata of the snapshots of an image a page at a time, each
+ * page with a single call.
+ *
+ * Input:
+ * @param start_after list the snapshots with ids above this (uint64_t),
+ *   0 to start with the first one
+ * @param max_return the most snapshots to return (uint64_t)
+ *
+ * Output:
+ * @param count the number of snapshots that follow (uint32_t)
+ * @param snaps for each, in ascending order of id: its id, name, size,
+ *   features, parent (pool, image id, snapid, overlap) and protection
+ *   status
+ * @param more whether there are snapshots past these (bool)
+ * @returns 0 on success, negative error code on failure
+ */
+int snapshot_list_range(cls_method_context_t hctx, bufferlist *in,
+			bufferlist *out)
+{
+  uint64_t start_after, max_return;
+
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(start_after, iter);
+    ::decode(max_return, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  CLS_LOG(20, "snapshot_list_range start_after=%llu max_return=%llu",
+	  (unsigned long long)start_after, (unsigned long long)max_return);
+
+  int r = check_exists(hctx);
+  if (r < 0)
+    return r;
+
+  vector<cls_rbd_snap> snaps;
+  bool more;
+  r = read_snaps(hctx, start_after, max_return, &snaps, &more);
+  if (r < 0)
+    return r;
+
+  ::encode((uint32_t)snaps.size(), *out);
+  for (vector<cls_rbd_snap>::iterator it = snaps.begin(); it != snaps.end();
+       ++it) {
+    ::encode(it->id, *out);
+    ::encode(it->name, *out);
+    ::encode(it->image_size, *out);
+    ::encode(it->features, *out);
+    encode_parent(it->parent, out);
+    ::encode(it->protection_status, *out);
+  }
+  ::encode(more, *out);
+
+  return 0;
+}
+
+/**
+ * Get what a client needs to refresh its view of an image in one
+ * call: the head's size, features, snap context and parent, and each
+ * snapshot's protection status.  The rest of a snapshot's metadata
+ * never changes, so it is only sent for snapshots the client doesn't
+ * know about yet.
+ *
+ * Input:
+ * @param known_snaps ids of the snapshots the client has (set<uint64_t>)
+ *
+ * Output:
+ * @param order bits to shift to get the size of data objects (uint8_t)
+ * @param size size of the head in bytes (uint64_t)
+ * @param features features of the head (uint64_t)
+ * @param incompatible those of them a client must understand (uint64_t)
+ * @param snap_seq the highest snapshot id ever associated with the image (uint64_t)
+ * @param snap_ids existing snapshot ids in descending order (vector<uint64_t>)
+ * @param parent the head's parent pool, image id, snapid and overlap
+ * @param snaps for each of snap_ids: its protection status (uint8_t),
+ *   whether it is new to the client (bool), and if it is, its name,
+ *   size, features and parent, as above
+ * @returns 0 on success, negative error code on failure
+ */
+int get_refresh_info(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  set<uint64_t> known_snaps;
+
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(known_snaps, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  CLS_LOG(20, "get_refresh_info known_snaps=%llu",
+	  (unsigned long long)known_snaps.size());
+
+  uint8_t order;
+  uint64_t size, features, snap_seq;
+  int r = read_key(hctx, "order", &order);
+  if (r < 0) {
+    CLS_ERR("failed to read the order off of disk: %s", strerror(r));
+    return r;
+  }
+  r = read_key(hctx, "size", &size);
+  if (r < 0) {
+    CLS_ERR("failed to read the image's size off of disk: %s", strerror(r));
+    return r;
+  }
+  r = read_key(hctx, "features", &features);
+  if (r < 0) {
+    CLS_ERR("failed to read features off disk: %s", strerror(r));
+    return r;
+  }
+  r = read_key(hctx, "snap_seq", &snap_seq);
+  if (r < 0) {
+    CLS_ERR("could not read the image's snap_seq off disk: %s", strerror(r));
+    return r;
+  }
+  cls_rbd_parent parent;
+  if (features & RBD_FEATURE_LAYERING) {
+    r = read_key(hctx, "parent", &parent);
+    if (r < 0 && r != -ENOENT)
+      return r;
+  }
+
+  vector<cls_rbd_snap> snaps;
+  bool more;
+  r = read_snaps(hctx, 0, (uint64_t)-1, &snaps, &more);
+  if (r < 0)
+    return r;
+
+  // snap_ids must be descending in a snap context
+  std::reverse(snaps.begin(), snaps.end());
+  vector<snapid_t> snap_ids;
+  for (vector<cls_rbd_snap>::iterator it = snaps.begin(); it != snaps.end();
+       ++it)
+    snap_ids.push_back(it->id);
+
+  uint64_t incompatible = features & RBD_FEATURES_INCOMPATIBLE;
+  ::encode(order, *out);
+  ::encode(size, *out);
+  ::encode(features, *out);
+  ::encode(incompatible, *out);
+  ::encode(snap_seq, *out);
+  ::encode(snap_ids, *out);
+  encode_parent(parent, out);
+  for (vector<cls_rbd_snap>::iterator it = snaps.begin(); it != snaps.end();
+       ++it) {
+    bool is_new = known_snaps.count(it->id) == 0;
+    ::encode(it->protection_status, *out);
+    ::encode(is_new, *out);
+    if (is_new) {
+      ::encode(it->name, *out);
+      ::encode(it->image_size, *out);
+      ::encode(it->features, *out);
+      encode_parent(it->parent, out);
+    }
+  }
+
+  return 0;
+}
+
 /**
  * Adds a snapshot to an rbd header. Ensures the id and name are unique.
  *
@@ -1380,6 +1590,126 @@ int copyup(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
   return cls_cxx_write(hctx, 0, in->length(), in);
 }
 
+/************************ object map methods **************************/
+
+/**
+ * Set or clear the bits for a range of objects in an object map.
+ * Bit n of the map is bit n % 8 of byte n / 8; bytes past the end of
+ * the object are zero, so setting bits there extends it and clearing
+ * them does nothing.
+ *
+ * Input:
+ * @param start first object number
+ * @param end object number after the last
+ * @param exists whether to set (1) or clear (0) the bits
+ *
+ * Output:
+ * @returns 0 on success, -ENOENT if the map does not exist,
+ *  negative error code on other error
+ */
+int object_map_update(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  uint64_t start, end;
+  uint8_t exists;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(start, iter);
+    ::decode(end, iter);
+    ::decode(exists, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+  if (start > end)
+    return -EINVAL;
+
+  uint64_t size;
+  int r = cls_cxx_stat(hctx, &size, NULL);
+  if (r < 0)
+    return r;
+
+  uint64_t byte_start = start / 8;
+  uint64_t byte_end = (end + 7) / 8;
+  if (!exists)
+    byte_end = MIN(byte_end, size);
+  if (byte_start >= byte_end)
+    return 0;
+
+  bufferlist data;
+  if (byte_start < size) {
+    uint64_t len = MIN(byte_end, size) - byte_start;
+    r = cls_cxx_read(hctx, byte_start, len, &data);
+    if (r < 0)
+      return r;
+  }
+  bufferptr bp(byte_end - byte_start);
+  bp.zero();
+  if (data.length())
+    data.copy(0, MIN(data.length(), bp.length()), bp.c_str());
+
+  unsigned char *p = (unsigned char *)bp.c_str();
+  for (uint64_t i = start; i < end && i / 8 < byte_end; ++i) {
+    unsigned char bit = 1 << (i % 8);
+    if (exists)
+      p[i / 8 - byte_start] |= bit;
+    else
+      p[i / 8 - byte_start] &= ~bit;
+  }
+
+  CLS_LOG(20, "object_map_update: %llu~%llu exists=%d\n",
+	  (unsigned long long)start, (unsigned long long)(end - start),
+	  (int)exists);
+  bufferlist bl;
+  bl.push_back(bp);
+  return cls_cxx_write(hctx, byte_start, bl.length(), &bl);
+}
+
+/**
+ * Set every bit of an object map that is set in another, so that an
+ * object is in the result if it is in either.  The map is extended
+ * as needed.
+ *
+ * Input:
+ * @param bits the map to merge, in the same layout
+ *
+ * Output:
+ * @returns 0 on success, -ENOENT if the map does not exist,
+ *  negative error code on other error
+ */
+int object_map_merge(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  bufferlist bits;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(bits, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  uint64_t size;
+  int r = cls_cxx_stat(hctx, &size, NULL);
+  if (r < 0)
+    return r;
+  if (bits.is_zero())
+    return 0;
+
+  bufferlist data;
+  if (size) {
+    r = cls_cxx_read(hctx, 0, MIN(size, (uint64_t)bits.length()), &data);
+    if (r < 0)
+      return r;
+  }
+  bufferptr bp(bits.length());
+  bits.copy(0, bits.length(), bp.c_str());
+  unsigned char *p = (unsigned char *)bp.c_str();
+  const unsigned char *q = (const unsigned char *)data.c_str();
+  for (unsigned i = 0; i < data.length(); ++i)
+    p[i] |= q[i];
+
+  CLS_LOG(20, "object_map_merge: %u bytes\n", bits.length());
+  bufferlist bl;
+  bl.push_back(bp);
+  return cls_cxx_write(hctx, 0, bl.length(), &bl);
+}
 
 /************************ rbd_id object methods **************************/
 
@@ -1661,6 +1991,58 @@ int dir_get_name(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
   return 0;
 }
 
+/**
+ * Get the names of several images given their ids, with a single read
+ * of the directory.
+ *
+ * Input:
+ * @param ids the ids of the images (set<string>)
+ *
+ * Output:
+ * @param names map from id to name of those of them in the directory
+ * @returns 0 on success, negative error code on failure
+ */
+int dir_get_names(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  set<string> ids;
+
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(ids, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  CLS_LOG(20, "dir_get_names: %llu ids", (unsigned long long)ids.size());
+
+  set<string> keys;
+  for (set<string>::iterator it = ids.begin(); it != ids.end(); ++it)
+    keys.insert(dir_key_for_id(*it));
+
+  map<string, bufferlist> vals;
+  int r = cls_cxx_map_get_vals_by_keys(hctx, keys, &vals);
+  if (r < 0) {
+    CLS_ERR("error reading names of %llu ids: %d",
+	    (unsigned long long)ids.size(), r);
+    return r;
+  }
+
+  map<string, string> names;
+  for (map<string, bufferlist>::iterator it = vals.begin();
+       it != vals.end(); ++it) {
+    string id = it->first.substr(strlen(RBD_DIR_ID_KEY_PREFIX));
+    bufferlist::iterator p = it->second.begin();
+    try {
+      ::decode(names[id], p);
+    } catch (const buffer::error &err) {
+      CLS_ERR("could not decode name of image id '%s'", id.c_str());
+      return -EIO;
+    }
+  }
+  ::encode(names, *out);
+  return 0;
+}
+
 /**
  * List the names and ids of the images in the directory, sorted by
  * name.
@@ -2007,6 +2389,12 @@ void __cls_init()
   cls_register_cxx_method(h_class, "get_snapshot_name",
 			  CLS_METHOD_RD,
 			  get_snapshot_name, &h_get_snapshot_name);
+  cls_register_cxx_method(h_class, "get_refresh_info",
+			  CLS_METHOD_RD,
+			  get_refresh_info, &h_get_refresh_info);
+  cls_register_cxx_method(h_class, "snapshot_list_range",
+			  CLS_METHOD_RD,
+			  snapshot_list_range, &h_snapshot_list_range);
   cls_register_cxx_method(h_class, "snapshot_add",
 			  CLS_METHOD_RD | CLS_METHOD_WR,
 			  snapshot_add, &h_snapshot_add);
@@ -2019,6 +2407,12 @@ void __cls_init()
   cls_register_cxx_method(h_class, "copyup",
 			  CLS_METHOD_RD | CLS_METHOD_WR,
 			  copyup, &h_copyup);
+  cls_register_cxx_method(h_class, "object_map_update",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  object_map_update, &h_object_map_update);
+  cls_register_cxx_method(h_class, "object_map_merge",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  object_map_merge, &h_object_map_merge);
   cls_register_cxx_method(h_class, "get_parent",
 			  CLS_METHOD_RD,
 			  get_parent, &h_get_parent);
@@ -2067,6 +2461,9 @@ void __cls_init()
   cls_register_cxx_method(h_class, "dir_get_name",
 			  CLS_METHOD_RD,
 			  dir_get_name, &h_dir_get_name);
+  cls_register_cxx_method(h_class, "dir_get_names",
+			  CLS_METHOD_RD,
+			  dir_get_names, &h_dir_get_names);
   cls_register_cxx_method(h_class, "dir_list",
 			  CLS_METHOD_RD,
 			  dir_list, &h_dir_list);
@@ -117,6 +117,88 @@ namespace librbd {
       return 0;
     }
 
+    static void decode_parent(bufferlist::iterator &iter, parent_info *parent)
+    {
+      ::decode(parent->spec.pool_id, iter);
+      ::decode(parent->spec.image_id, iter);
+      ::decode(parent->spec.snap_id, iter);
+      ::decode(parent->overlap, iter);
+    }
+
+    int get_refresh_info(librados::IoCtx *ioctx, const std::string &oid,
+			 const std::set<uint64_t> &known_snaps,
+			 uint64_t *size, uint64_t *features,
+			 uint64_t *incompatible_features,
+			 map<rados::cls::lock::locker_id_t,
+			     rados::cls::lock::locker_info_t> *lockers,
+			 bool *exclusive_lock,
+			 string *lock_tag,
+			 ::SnapContext *snapc,
+			 parent_info *parent,
+			 std::vector<bool> *new_snaps,
+			 std::vector<string> *snap_names,
+			 std::vector<uint64_t> *snap_sizes,
+			 std::vector<uint64_t> *snap_features,
+			 std::vector<parent_info> *snap_parents,
+			 std::vector<uint8_t> *protection_statuses)
+    {
+      librados::ObjectReadOperation op;
+      bufferlist inbl;
+      ::encode(known_snaps, inbl);
+      op.exec("rbd", "get_refresh_info", inbl);
+      rados::cls::lock::get_lock_info_start(&op, RBD_LOCK_NAME);
+
+      bufferlist outbl;
+      int r = ioctx->operate(oid, &op, &outbl);
+      if (r < 0)
+	return r;
+
+      try {
+	bufferlist::iterator iter = outbl.begin();
+	uint8_t order;
+	::decode(order, iter);
+	::decode(*size, iter);
+	::decode(*features, iter);
+	::decode(*incompatible_features, iter);
+	::decode(*snapc, iter);
+	decode_parent(iter, parent);
+
+	size_t n = snapc->snaps.size();
+	new_snaps->assign(n, false);
+	snap_names->assign(n, string());
+	snap_sizes->assign(n, 0);
+	snap_features->assign(n, 0);
+	snap_parents->assign(n, parent_info());
+	protection_statuses->assign(n, 0);
+	for (size_t i = 0; i < n; ++i) {
+	  bool is_new;
+	  ::decode((*protection_statuses)[i], iter);
+	  ::decode(is_new, iter);
+	  (*new_snaps)[i] = is_new;
+	  if (is_new) {
+	    ::decode((*snap_names)[i], iter);
+	    ::decode((*snap_sizes)[i], iter);
+	    ::decode((*snap_features)[i], iter);
+	    decode_parent(iter, &(*snap_parents)[i]);
+	  }
+	}
+
+	// get_lock_info
+	ClsLockType lock_type = LOCK_NONE;
+	r = rados::cls::lock::get_lock_info_finish(&iter, lockers, &lock_type,
+						   lock_tag);
+	// see get_mutable_metadata()
+	if (r < 0 && ((r != -EOPNOTSUPP) && (r != -EIO)))
+	  return r;
+
+	*exclusive_lock = (lock_type == LOCK_EXCLUSIVE);
+      } catch (const buffer::error &err) {
+	return -EBADMSG;
+      }
+
+      return 0;
+    }
+
     int create_image(librados::IoCtx *ioctx, const std::string &oid,
 		     uint64_t size, uint8_t order, uint64_t features,
 		     const std::string &object_prefix)
@@ -394,6 +476,53 @@ namespace librbd {
       return 0;
     }
 
+    int snapshot_list_range(librados::IoCtx *ioctx, const std::string &oid,
+			    snapid_t start_after, uint64_t max_return,
+			    std::vector<snapid_t> *ids,
+			    std::vector<string> *names,
+			    std::vector<uint64_t> *sizes,
+			    std::vector<uint64_t> *features,
+			    std::vector<parent_info> *parents,
+			    std::vector<uint8_t> *protection_statuses,
+			    bool *more)
+    {
+      bufferlist in, out;
+      ::encode(start_after.val, in);
+      ::encode(max_return, in);
+
+      int r = ioctx->exec(oid, "rbd", "snapshot_list_range", in, out);
+      if (r < 0)
+	return r;
+
+      try {
+	bufferlist::iterator iter = out.begin();
+	uint32_t count;
+	::decode(count, iter);
+	ids->resize(count);
+	names->resize(count);
+	sizes->resize(count);
+	features->resize(count);
+	parents->resize(count);
+	protection_statuses->resize(count);
+	for (uint32_t i = 0; i < count; ++i) {
+	  ::decode((*ids)[i], iter);
+	  ::decode((*names)[i], iter);
+	  ::decode((*sizes)[i], iter);
+	  ::decode((*features)[i], iter);
+	  ::decode((*parents)[i].spec.pool_id, iter);
+	  ::decode((*parents)[i].spec.image_id, iter);
+	  ::decode((*parents)[i].spec.snap_id, iter);
+	  ::decode((*parents)[i].overlap, iter);
+	  ::decode((*protection_statuses)[i], iter);
+	}
+	::decode(*more, iter);
+      } catch (const buffer::error &err) {
+	return -EBADMSG;
+      }
+
+      return 0;
+    }
+
     int old_snapshot_add(librados::IoCtx *ioctx, const std::string &oid,
 			 snapid_t snap_id, const std::string &snap_name)
     {
@@ -451,6 +580,34 @@ namespace librbd {
       return ioctx->exec(oid, "rbd", "copyup", data, out);
     }
 
+    void object_map_update(librados::ObjectWriteOperation *op,
+			   uint64_t start, uint64_t end, bool exists)
+    {
+      bufferlist in;
+      ::encode(start, in);
+      ::encode(end, in);
+      ::encode((uint8_t)exists, in);
+      op->exec("rbd", "object_map_update", in);
+    }
+
+    int object_map_update(librados::IoCtx *ioctx, const std::string &oid,
+			  uint64_t start, uint64_t end, bool exists)
+    {
+      librados::ObjectWriteOperation op;
+      object_map_update(&op, start, end, exists);
+      return ioctx->operate(oid, &op);
+    }
+
+    int object_map_merge(librados::IoCtx *ioctx, const std::string &oid,
+			 const bufferlist &bits)
+    {
+      bufferlist in;
+      ::encode(bits, in);
+      librados::ObjectWriteOperation op;
+      op.exec("rbd", "object_map_merge", in);
+      return ioctx->operate(oid, &op);
+    }
+
     int get_protection_status(librados::IoCtx *ioctx, const std::string &oid,
 			      snapid_t snap_id, uint8_t *protection_status)
     {
@@ -582,6 +739,26 @@ namespace librbd {
       return 0;
     }
 
+    int dir_get_names(librados::IoCtx *ioctx, const std::string &oid,
+		      const std::set<std::string> &ids,
+		      map<string, string> *names)
+    {
+      bufferlist in, out;
+      ::encode(ids, in);
+      int r = ioctx->exec(oid, "rbd", "dir_get_names", in, out);
+      if (r < 0)
+	return r;
+
+      bufferlist::iterator iter = out.begin();
+      try {
+	::decode(*names, iter);
+      } catch (const buffer::error &err) {
+	return -EBADMSG;
+      }
+
+      return 0;
+    }
+
     int dir_list(librados::IoCtx *ioctx, const std::string &oid,
 		 const std::string &start, uint64_t max_return,
 		 map<string, string> *images)
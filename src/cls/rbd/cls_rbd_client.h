@@ -10,6 +10,7 @@
 #include "include/types.h"
 #include "librbd/parent_types.h"
 
+#include <set>
 #include <string>
 #include <vector>
 
@@ -27,6 +28,29 @@ namespace librbd {
 			     std::string *lock_tag,
 			     ::SnapContext *snapc,
 			     parent_info *parent);
+    /**
+     * Like get_mutable_metadata() and snapshot_list() of the whole snap
+     * context together, in one call.  Only the protection status is
+     * returned for snapshots in known_snaps; new_snaps tells which
+     * ones the rest is returned for.  Needs an OSD with
+     * get_refresh_info, or fails with -EOPNOTSUPP.
+     */
+    int get_refresh_info(librados::IoCtx *ioctx, const std::string &oid,
+			 const std::set<uint64_t> &known_snaps,
+			 uint64_t *size, uint64_t *features,
+			 uint64_t *incompatible_features,
+			 map<rados::cls::lock::locker_id_t,
+			     rados::cls::lock::locker_info_t> *lockers,
+			 bool *exclusive_lock,
+			 std::string *lock_tag,
+			 ::SnapContext *snapc,
+			 parent_info *parent,
+			 std::vector<bool> *new_snaps,
+			 std::vector<string> *snap_names,
+			 std::vector<uint64_t> *snap_sizes,
+			 std::vector<uint64_t> *snap_features,
+			 std::vector<parent_info> *snap_parents,
+			 std::vector<uint8_t> *protection_statuses);
 
     // low-level interface (mainly for testing)
     int create_image(librados::IoCtx *ioctx, const std::string &oid,
@@ -67,8 +91,28 @@ namespace librbd {
 		      std::vector<uint64_t> *features,
 		      std::vector<parent_info> *parents,
 		      std::vector<uint8_t> *protection_statuses);
+    /**
+     * The metadata of up to max_return snapshots with ids above
+     * start_after (0 for the first), in ascending order of id, with a
+     * single call.  *more says whether there are snapshots past them.
+     */
+    int snapshot_list_range(librados::IoCtx *ioctx, const std::string &oid,
+			    snapid_t start_after, uint64_t max_return,
+			    std::vector<snapid_t> *ids,
+			    std::vector<string> *names,
+			    std::vector<uint64_t> *sizes,
+			    std::vector<uint64_t> *features,
+			    std::vector<parent_info> *parents,
+			    std::vector<uint8_t> *protection_statuses,
+			    bool *more);
     int copyup(librados::IoCtx *ioctx, const std::string &oid,
 	       bufferlist data);
+    void object_map_update(librados::ObjectWriteOperation *op,
+			   uint64_t start, uint64_t end, bool exists);
+    int object_map_update(librados::IoCtx *ioctx, const std::string &oid,
+			  uint64_t start, uint64_t end, bool exists);
+    int object_map_merge(librados::IoCtx *ioctx, const std::string &oid,
+			 const bufferlist &bits);
     int get_protection_status(librados::IoCtx *ioctx, const std::string &oid,
 			      snapid_t snap_id, uint8_t *protection_status);
     int set_protection_status(librados::IoCtx *ioctx, const std::string &oid,
@@ -87,6 +131,10 @@ namespace librbd {
 		   const std::string &name, std::string *id);
     int dir_get_name(librados::IoCtx *ioctx, const std::string &oid,
 		     const std::string &id, std::string *name);
+    /// names of those of ids that are in the directory, by id
+    int dir_get_names(librados::IoCtx *ioctx, const std::string &oid,
+		      const std::set<std::string> &ids,
+		      map<string, string> *names);
     int dir_list(librados::IoCtx *ioctx, const std::string &oid,
 		 const std::string &start, uint64_t max_return,
 		 map<string, string> *images);
@@ -27,6 +27,7 @@ cls_method_handle_t h_rgw_bucket_check_index;
 cls_method_handle_t h_rgw_bucket_rebuild_index;
 cls_method_handle_t h_rgw_bucket_prepare_op;
 cls_method_handle_t h_rgw_bucket_complete_op;
+cls_method_handle_t h_rgw_bucket_complete_ops;
 cls_method_handle_t h_rgw_bi_log_list_op;
 cls_method_handle_t h_rgw_dir_suggest_changes;
 cls_method_handle_t h_rgw_user_usage_log_add;
@@ -134,21 +135,26 @@ static int log_index_operation(cls_method_context_t hctx, string& obj, RGWModify
   return cls_cxx_map_set_val(hctx, key, &bl);
 }
 
+/* stop a listing batch once this much key and value data was read */
+#define LIST_MAX_BYTES (4 * 1024 * 1024)
+
 /*
  * read list of objects, skips objects in the ugly namespace
+ *
+ * *more is set if further entries may follow the returned ones
  */
 static int get_obj_vals(cls_method_context_t hctx, const string& start, const string& filter_prefix,
-                        int num_entries, map<string, bufferlist> *pkeys)
+                        int num_entries, map<string, bufferlist> *pkeys, bool *more)
 {
-  int ret = cls_cxx_map_get_vals(hctx, start, filter_prefix, num_entries, pkeys);
+  int ret = cls_cxx_map_get_vals(hctx, start, filter_prefix, num_entries, LIST_MAX_BYTES, pkeys, more);
   if (ret < 0)
     return ret;
 
   if (pkeys->empty())
     return 0;
 
-  map<string, bufferlist>::reverse_iterator last_element = pkeys->rbegin();
-  if ((unsigned char)last_element->first[0] < BI_PREFIX_CHAR) {
+  string last_key = pkeys->rbegin()->first;
+  if ((unsigned char)last_key[0] < BI_PREFIX_CHAR) {
     /* nothing to see here, move along */
     return 0;
   }
@@ -168,15 +174,21 @@ static int get_obj_vals(cls_method_context_t hctx, const string& start, const st
     }
   }
 
-  if (num_entries == (int)pkeys->size())
+  if (!*more || num_entries == (int)pkeys->size())
     return 0;
 
-  map<string, bufferlist> new_keys;
-  char c[] = { (char)(BI_PREFIX_CHAR + 1), 0 };
-  string new_start = c;
+  /* continue past the special namespace, or past what we already have */
+  string new_start;
+  if ((unsigned char)last_key[0] == BI_PREFIX_CHAR) {
+    char c[] = { (char)(BI_PREFIX_CHAR + 1), 0 };
+    new_start = c;
+  } else {
+    new_start = last_key;
+  }
 
   /* now get some more keys */
-  ret = cls_cxx_map_get_vals(hctx, new_start, filter_prefix, num_entries - pkeys->size(), &new_keys);
+  map<string, bufferlist> new_keys;
+  ret = cls_cxx_map_get_vals(hctx, new_start, filter_prefix, num_entries - pkeys->size(), LIST_MAX_BYTES, &new_keys, more);
   if (ret < 0)
     return ret;
 
@@ -187,6 +199,129 @@ static int get_obj_vals(cls_method_context_t hctx, const string& start, const st
   return 0;
 }
 
+static int decode_list_entry(const string& key, bufferlist& entrybl, struct rgw_bucket_dir_entry *entry)
+{
+  bufferlist::iterator eiter = entrybl.begin();
+  try {
+    ::decode(*entry, eiter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_list(): failed to decode entry, key=%s\n", key.c_str());
+    return -EINVAL;
+  }
+  return 0;
+}
+
+static int list_entries(cls_method_context_t hctx, struct rgw_cls_list_op& op, struct rgw_cls_list_ret& ret)
+{
+  map<string, bufferlist> keys;
+  bool more;
+  int rc = get_obj_vals(hctx, op.start_obj, op.filter_prefix, op.num_entries + 1, &keys, &more);
+  if (rc < 0)
+    return rc;
+
+  std::map<string, struct rgw_bucket_dir_entry>& m = ret.dir.m;
+  std::map<string, bufferlist>::iterator kiter = keys.begin();
+  uint32_t i;
+
+  bool done = false;
+
+  for (i = 0; i < op.num_entries && kiter != keys.end(); ++i, ++kiter) {
+    struct rgw_bucket_dir_entry entry;
+
+    if (!bi_is_objs_index(kiter->first)) {
+      done = true;
+      break;
+    }
+
+    rc = decode_list_entry(kiter->first, kiter->second, &entry);
+    if (rc < 0)
+      return rc;
+
+    m[kiter->first] = entry;
+  }
+
+  ret.is_truncated = (!done && (kiter != keys.end() || more));
+  return 0;
+}
+
+/*
+ * The names that have the delimiter past the prefix are listed once,
+ * as their common prefix, and the listing seeks past all of them, so a
+ * "directory" costs one entry however many names are in it.  A start
+ * within a common prefix (the last one listed, say) continues past it.
+ */
+#define LIST_SKIP_CHAR ((char)0xff)  /* sorts after anything in a utf-8 name */
+
+static int list_with_delimiter(cls_method_context_t hctx, struct rgw_cls_list_op& op, struct rgw_cls_list_ret& ret)
+{
+  const string& prefix = op.filter_prefix;
+  const string& delim = op.delimiter;
+
+  string start = op.start_obj;
+  if (start.compare(0, prefix.size(), prefix) == 0) {
+    size_t pos = start.find(delim, prefix.size());
+    if (pos != string::npos) {
+      start = start.substr(0, pos + delim.size());
+      start.append(1, LIST_SKIP_CHAR);
+    }
+  }
+
+  std::map<string, struct rgw_bucket_dir_entry>& m = ret.dir.m;
+  uint32_t count = 0;
+  ret.is_truncated = false;
+
+  while (true) {
+    map<string, bufferlist> keys;
+    bool more;
+    int rc = get_obj_vals(hctx, start, prefix, op.num_entries - count + 1, &keys, &more);
+    if (rc < 0)
+      return rc;
+    if (keys.empty())
+      return 0;
+
+    std::map<string, bufferlist>::iterator kiter;
+    for (kiter = keys.begin(); kiter != keys.end(); ++kiter) {
+      const string& key = kiter->first;
+      if (!bi_is_objs_index(key))
+        return 0;
+
+      /* within a common prefix we already have */
+      if (key <= start)
+        continue;
+
+      if (count == op.num_entries) {
+        ret.is_truncated = true;
+        return 0;
+      }
+
+      size_t pos = key.find(delim, prefix.size());
+      if (pos != string::npos) {
+        string common_prefix = key.substr(0, pos + delim.size());
+        ret.common_prefixes.push_back(common_prefix);
+        count++;
+        start = common_prefix;
+        start.append(1, LIST_SKIP_CHAR);
+        continue;
+      }
+
+      struct rgw_bucket_dir_entry entry;
+      rc = decode_list_entry(key, kiter->second, &entry);
+      if (rc < 0)
+        return rc;
+      m[key] = entry;
+      count++;
+      start = key;
+    }
+
+    if (!more)
+      return 0;
+    if (count == op.num_entries) {
+      ret.is_truncated = true;
+      return 0;
+    }
+  }
+}
+
 int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 {
   bufferlist::iterator iter = in->begin();
@@ -213,41 +348,16 @@ int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
     return -EINVAL;
   }
 
-  bufferlist bl;
-
-  map<string, bufferlist> keys;
-  rc = get_obj_vals(hctx, op.start_obj, op.filter_prefix, op.num_entries + 1, &keys);
+  /* no entries asked for, it's the stats that are wanted */
+  if (!op.num_entries)
+    rc = 0;
+  else if (!op.delimiter.empty())
+    rc = list_with_delimiter(hctx, op, ret);
+  else
+    rc = list_entries(hctx, op, ret);
   if (rc < 0)
     return rc;
 
-  std::map<string, struct rgw_bucket_dir_entry>& m = new_dir.m;
-  std::map<string, bufferlist>::iterator kiter = keys.begin();
-  uint32_t i;
-
-  bool done = false;
-
-  for (i = 0; i < op.num_entries && kiter != keys.end(); ++i, ++kiter) {
-    struct rgw_bucket_dir_entry entry;
-
-    if (!bi_is_objs_index(kiter->first)) {
-      done = true;
-      break;
-    }
-
-    bufferlist& entrybl = kiter->second;
-    bufferlist::iterator eiter = entrybl.begin();
-    try {
-      ::decode(entry, eiter);
-    } catch (buffer::error& err) {
-      CLS_LOG(1, "ERROR: rgw_bucket_list(): failed to decode entry, key=%s\n", kiter->first.c_str());
-      return -EINVAL;
-    }
-    
-    m[kiter->first] = entry;
-  }
-
-  ret.is_truncated = (kiter != keys.end() && !done);
-
   ::encode(ret, *out);
   return 0;
 }
@@ -277,9 +387,11 @@ static int check_index(cls_method_context_t hctx, struct rgw_bucket_dir_header *
 
 #define CHECK_CHUNK_SIZE 1000
   bool done = false;
+  bool more;
 
   do {
-    rc = get_obj_vals(hctx, start_obj, filter_prefix, CHECK_CHUNK_SIZE, &keys);
+    keys.clear();
+    rc = get_obj_vals(hctx, start_obj, filter_prefix, CHECK_CHUNK_SIZE, &keys, &more);
     if (rc < 0)
       return rc;
 
@@ -305,7 +417,7 @@ static int check_index(cls_method_context_t hctx, struct rgw_bucket_dir_header *
 
       start_obj = kiter->first;
     }
-  } while (keys.size() == CHECK_CHUNK_SIZE && !done);
+  } while (more && !done);
 
   return 0;
 }
@@ -487,6 +599,13 @@ int rgw_bucket_prepare_op(cls_method_context_t hctx, bufferlist *in, bufferlist
   if (rc < 0)
     return rc;
 
+  /*
+   * the stats only change on completion; the version needs to move on
+   * only when a log entry was keyed by it
+   */
+  if (!op.log_op)
+    return 0;
+
   return write_bucket_header(hctx, &header);
 }
 
@@ -520,39 +639,19 @@ static int read_index_entry(cls_method_context_t hctx, string& name, struct rgw_
   return 0;
 }
 
-int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+/* apply a completion to the index, and to header in memory */
+static int complete_op(cls_method_context_t hctx, struct rgw_bucket_dir_header& header,
+                       rgw_cls_obj_complete_op& op)
 {
-  // decode request
-  rgw_cls_obj_complete_op op;
-  bufferlist::iterator iter = in->begin();
-  try {
-    ::decode(op, iter);
-  } catch (buffer::error& err) {
-    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to decode request\n");
-    return -EINVAL;
-  }
   CLS_LOG(1, "rgw_bucket_complete_op(): request: op=%d name=%s ver=%lu:%llu tag=%s\n",
           op.op, op.name.c_str(),
           (unsigned long)op.ver.pool, (unsigned long long)op.ver.epoch,
           op.tag.c_str());
 
-  bufferlist header_bl;
-  struct rgw_bucket_dir_header header;
-  int rc = cls_cxx_map_read_header(hctx, &header_bl);
-  if (rc < 0)
-    return rc;
-  bufferlist::iterator header_iter = header_bl.begin();
-  try {
-    ::decode(header, header_iter);
-  } catch (buffer::error& err) {
-    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to decode header\n");
-    return -EINVAL;
-  }
-
   struct rgw_bucket_dir_entry entry;
   bool ondisk = true;
 
-  rc = read_index_entry(hctx, op.name, &entry);
+  int rc = read_index_entry(hctx, op.name, &entry);
   if (rc == -ENOENT) {
     entry.name = op.name;
     entry.ver = op.ver;
@@ -655,20 +754,37 @@ int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist
       return rc;
   }
 
-  list<string>::iterator remove_iter;
   CLS_LOG(20, "rgw_bucket_complete_op(): remove_objs.size()=%d\n", (int)op.remove_objs.size());
-  for (remove_iter = op.remove_objs.begin(); remove_iter != op.remove_objs.end(); ++remove_iter) {
-    string& remove_oid_name = *remove_iter;
-    CLS_LOG(1, "rgw_bucket_complete_op(): removing entries, read_index_entry name=%s\n", remove_oid_name.c_str());
+  if (op.remove_objs.empty())
+    return 0;
+
+  /* read and remove the entries in one op each; entries that are not
+   * there, or fail to decode, are skipped as before */
+  set<string> remove_names(op.remove_objs.begin(), op.remove_objs.end());
+  map<string, bufferlist> remove_vals;
+  int ret = cls_cxx_map_get_vals_by_keys(hctx, remove_names, &remove_vals);
+  if (ret < 0) {
+    CLS_LOG(1, "rgw_bucket_complete_op(): removing entries, failed to read entries ret=%d\n", ret);
+    return 0;
+  }
+
+  set<string> to_remove;
+  for (map<string, bufferlist>::iterator remove_iter = remove_vals.begin();
+       remove_iter != remove_vals.end(); ++remove_iter) {
+    const string& remove_oid_name = remove_iter->first;
     struct rgw_bucket_dir_entry remove_entry;
-    int ret = read_index_entry(hctx, remove_oid_name, &remove_entry);
-    if (ret < 0) {
-      CLS_LOG(1, "rgw_bucket_complete_op(): removing entries, read_index_entry name=%s ret=%d\n", remove_oid_name.c_str(), rc);
+    bufferlist::iterator entry_iter = remove_iter->second.begin();
+    try {
+      ::decode(remove_entry, entry_iter);
+    } catch (buffer::error& err) {
+      CLS_LOG(1, "rgw_bucket_complete_op(): removing entries, failed to decode entry name=%s\n", remove_oid_name.c_str());
       continue;
     }
     CLS_LOG(0, "rgw_bucket_complete_op(): entry.name=%s entry.meta.category=%d\n", remove_entry.name.c_str(), remove_entry.meta.category);
     unaccount_entry(header, remove_entry);
 
+    /* each log entry is keyed by the internal op that writes it, so
+     * these stay one op apiece */
     if (op.log_op) {
       rc = log_index_operation(hctx, op.name, CLS_RGW_OP_DEL, op.tag, remove_entry.meta.mtime,
                                remove_entry.ver, CLS_RGW_STATE_COMPLETE, header.ver, header.max_marker);
@@ -676,11 +792,89 @@ int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist
         continue;
     }
 
-    ret = cls_cxx_map_remove_key(hctx, remove_oid_name);
-    if (ret < 0) {
-      CLS_LOG(1, "rgw_bucket_complete_op(): cls_cxx_map_remove_key, failed to remove entry, name=%s read_index_entry ret=%d\n", remove_oid_name.c_str(), rc);
-      continue;
+    to_remove.insert(remove_oid_name);
+  }
+
+  ret = cls_cxx_map_remove_keys(hctx, to_remove);
+  if (ret < 0) {
+    CLS_LOG(1, "rgw_bucket_complete_op(): cls_cxx_map_remove_keys, failed to remove %d entries ret=%d\n", (int)to_remove.size(), ret);
+  }
+
+  return 0;
+}
+
+
+static int read_bucket_header(cls_method_context_t hctx, struct rgw_bucket_dir_header *header)
+{
+  bufferlist header_bl;
+  int rc = cls_cxx_map_read_header(hctx, &header_bl);
+  if (rc < 0)
+    return rc;
+  bufferlist::iterator header_iter = header_bl.begin();
+  try {
+    ::decode(*header, header_iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: read_bucket_header(): failed to decode header\n");
+    return -EINVAL;
+  }
+  return 0;
+}
+
+int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  rgw_cls_obj_complete_op op;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(op, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to decode request\n");
+    return -EINVAL;
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0)
+    return rc;
+
+  rc = complete_op(hctx, header, op);
+  if (rc < 0)
+    return rc;
+
+  return write_bucket_header(hctx, &header);
+}
+
+/*
+ * several completions at once; one that fails is skipped, as it would
+ * have failed on its own, without holding up the others.  The entries
+ * written here are not read back, so the names must be distinct.
+ */
+int rgw_bucket_complete_ops(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  rgw_cls_obj_complete_ops ops;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(ops, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_ops(): failed to decode request\n");
+    return -EINVAL;
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0)
+    return rc;
+
+  for (list<rgw_cls_obj_complete_op>::iterator op_iter = ops.ops.begin();
+       op_iter != ops.ops.end(); ++op_iter) {
+    rc = complete_op(hctx, header, *op_iter);
+    if (rc < 0) {
+      CLS_LOG(1, "rgw_bucket_complete_ops(): completion of name=%s tag=%s failed, rc=%d\n",
+              op_iter->name.c_str(), op_iter->tag.c_str(), rc);
     }
+    /* each completion is a version of its own, which also keeps their
+     * bucket index log keys apart */
+    header.ver++;
   }
 
   return write_bucket_header(hctx, &header);
@@ -709,27 +903,42 @@ int rgw_dir_suggest_changes(cls_method_context_t hctx, bufferlist *in, bufferlis
 
   tag_timeout = (header.tag_timeout ? header.tag_timeout : CEPH_RGW_TAG_TIMEOUT);
 
+  /* decode all the suggestions first, so that the entries they touch
+   * can be read, and then written and removed, with an op apiece */
+  list<pair<__u8, rgw_bucket_dir_entry> > changes;
+  set<string> names;
   bufferlist::iterator in_iter = in->begin();
-
   while (!in_iter.end()) {
-    __u8 op;
-    rgw_bucket_dir_entry cur_change;
-    rgw_bucket_dir_entry cur_disk;
+    changes.push_back(pair<__u8, rgw_bucket_dir_entry>());
     try {
-      ::decode(op, in_iter);
-      ::decode(cur_change, in_iter);
+      ::decode(changes.back().first, in_iter);
+      ::decode(changes.back().second, in_iter);
     } catch (buffer::error& err) {
       CLS_LOG(1, "ERROR: rgw_dir_suggest_changes(): failed to decode request\n");
       return -EINVAL;
     }
+    names.insert(changes.back().second.name);
+  }
 
-    bufferlist cur_disk_bl;
-    int ret = cls_cxx_map_get_val(hctx, cur_change.name, &cur_disk_bl);
-    if (ret < 0 && ret != -ENOENT)
-      return -EINVAL;
+  map<string, bufferlist> disk;
+  rc = cls_cxx_map_get_vals_by_keys(hctx, names, &disk);
+  if (rc < 0)
+    return -EINVAL;
+
+  /* a name may be suggested more than once; later suggestions see the
+   * outcome of the earlier ones through disk */
+  map<string, bufferlist> to_set;
+  set<string> to_remove;
 
-    if (cur_disk_bl.length()) {
-      bufferlist::iterator cur_disk_iter = cur_disk_bl.begin();
+  for (list<pair<__u8, rgw_bucket_dir_entry> >::iterator change_iter = changes.begin();
+       change_iter != changes.end(); ++change_iter) {
+    __u8 op = change_iter->first;
+    rgw_bucket_dir_entry& cur_change = change_iter->second;
+    rgw_bucket_dir_entry cur_disk;
+
+    map<string, bufferlist>::iterator disk_iter = disk.find(cur_change.name);
+    if (disk_iter != disk.end() && disk_iter->second.length()) {
+      bufferlist::iterator cur_disk_iter = disk_iter->second.begin();
       try {
         ::decode(cur_disk, cur_disk_iter);
       } catch (buffer::error& error) {
@@ -766,9 +975,9 @@ int rgw_dir_suggest_changes(cls_method_context_t hctx, bufferlist *in, bufferlis
       switch(op) {
       case CEPH_RGW_REMOVE:
         CLS_LOG(10, "CEPH_RGW_REMOVE name=%s\n", cur_change.name.c_str());
-	ret = cls_cxx_map_remove_key(hctx, cur_change.name);
-	if (ret < 0)
-	  return ret;
+        to_set.erase(cur_change.name);
+        to_remove.insert(cur_change.name);
+        disk.erase(cur_change.name);
         break;
       case CEPH_RGW_UPDATE:
         CLS_LOG(10, "CEPH_RGW_UPDATE name=%s total_entries: %"PRId64" -> %"PRId64"\n", cur_change.name.c_str(), stats.num_entries, stats.num_entries + 1);
@@ -779,14 +988,23 @@ int rgw_dir_suggest_changes(cls_method_context_t hctx, bufferlist *in, bufferlis
         cur_change.index_ver = header.ver;
         bufferlist cur_state_bl;
         ::encode(cur_change, cur_state_bl);
-        ret = cls_cxx_map_set_val(hctx, cur_change.name, &cur_state_bl);
-        if (ret < 0)
-	  return ret;
+        to_remove.erase(cur_change.name);
+        to_set[cur_change.name] = cur_state_bl;
+        disk[cur_change.name] = cur_state_bl;
         break;
       }
     }
   }
 
+  rc = cls_cxx_map_remove_keys(hctx, to_remove);
+  if (rc < 0)
+    return rc;
+  if (!to_set.empty()) {
+    rc = cls_cxx_map_set_vals(hctx, &to_set);
+    if (rc < 0)
+      return rc;
+  }
+
   if (header_changed) {
     return write_bucket_header(hctx, &header);
   }
@@ -936,35 +1154,6 @@ static int rgw_bi_log_list(cls_method_context_t hctx, bufferlist *in, bufferlist
   return 0;
 }
 
-static int bi_log_list_trim_cb(cls_method_context_t hctx, const string& key, rgw_bi_log_entry& info, void *param)
-{
-  list<rgw_bi_log_entry> *entries = (list<rgw_bi_log_entry> *)param;
-
-  entries->push_back(info);
-  return 0;
-}
-
-static int bi_log_remove_entry(cls_method_context_t hctx, rgw_bi_log_entry& entry)
-{
-  string key;
-  key = BI_PREFIX_CHAR;
-  key.append(bucket_index_prefixes[BI_BUCKET_LOG_INDEX]);
-  key.append(entry.id);
-  return cls_cxx_map_remove_key(hctx, key);
-}
-
-static int bi_log_list_trim_entries(cls_method_context_t hctx,
-                                    const string& start_marker, const string& end_marker,
-			            list<rgw_bi_log_entry>& entries, bool *truncated)
-{
-  string key_iter;
-#define MAX_TRIM_ENTRIES 1000 /* max entries to trim in a single operation */
-  int ret = bi_log_iterate_entries(hctx, start_marker, end_marker,
-                              key_iter, MAX_TRIM_ENTRIES, truncated,
-                              bi_log_list_trim_cb, &entries);
-  return ret;
-}
-
 static int rgw_bi_log_trim(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 {
   bufferlist::iterator in_iter = in->begin();
@@ -977,27 +1166,38 @@ static int rgw_bi_log_trim(cls_method_context_t hctx, bufferlist *in, bufferlist
     return -EINVAL;
   }
 
-  cls_rgw_bi_log_list_ret op_ret;
-  list<rgw_bi_log_entry> entries;
-#define MAX_TRIM_ENTRIES 1000 /* don't do more than that in a single operation */
-  bool truncated;
-  int ret = bi_log_list_trim_entries(hctx, op.start_marker, op.end_marker, entries, &truncated);
-  if (ret < 0)
-    return ret;
+  /* from start_marker up to and including end_marker, or to the end of
+   * the log: [start_key, end_key), removed at once */
+  string start_key;
+  start_key = BI_PREFIX_CHAR;
+  start_key.append(bucket_index_prefixes[BI_BUCKET_LOG_INDEX]);
+  string end_key = start_key;
+  start_key.append(op.start_marker);
+  if (op.end_marker.empty()) {
+    end_key = BI_PREFIX_CHAR;
+    end_key.append(bucket_index_prefixes[BI_BUCKET_LAST_INDEX]);
+  } else {
+    end_key.append(op.end_marker);
+    end_key.push_back('\0');
+  }
 
-  if (entries.empty())
+  if (start_key >= end_key)
     return -ENODATA;
 
-  list<rgw_bi_log_entry>::iterator iter;
-  for (iter = entries.begin(); iter != entries.end(); ++iter) {
-    rgw_bi_log_entry& entry = *iter;
-
-    ret = bi_log_remove_entry(hctx, entry);
+  bufferlist start_bl;
+  int ret = cls_cxx_map_get_val(hctx, start_key, &start_bl);
+  if (ret < 0 && ret != -ENOENT)
+    return ret;
+  if (ret == -ENOENT) {
+    set<string> keys;
+    ret = cls_cxx_map_get_keys(hctx, start_key, 1, &keys);
     if (ret < 0)
       return ret;
+    if (keys.empty() || *keys.begin() >= end_key)
+      return -ENODATA;
   }
 
-  return 0;
+  return cls_cxx_map_remove_range(hctx, start_key, end_key);
 }
 
 static void usage_record_prefix_by_time(uint64_t epoch, string& key)
@@ -1605,6 +1805,7 @@ void __cls_init()
   cls_register_cxx_method(h_class, "bucket_rebuild_index", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_rebuild_index, &h_rgw_bucket_rebuild_index);
   cls_register_cxx_method(h_class, "bucket_prepare_op", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_prepare_op, &h_rgw_bucket_prepare_op);
   cls_register_cxx_method(h_class, "bucket_complete_op", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_complete_op, &h_rgw_bucket_complete_op);
+  cls_register_cxx_method(h_class, "bucket_complete_ops", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_complete_ops, &h_rgw_bucket_complete_ops);
   cls_register_cxx_method(h_class, "bi_log_list", CLS_METHOD_RD, rgw_bi_log_list, &h_rgw_bi_log_list_op);
   cls_register_cxx_method(h_class, "bi_log_trim", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bi_log_trim, &h_rgw_bi_log_list_op);
   cls_register_cxx_method(h_class, "dir_suggest_changes", CLS_METHOD_RD | CLS_METHOD_WR, rgw_dir_suggest_changes, &h_rgw_dir_suggest_changes);
@@ -57,6 +57,15 @@ void cls_rgw_bucket_complete_op(ObjectWriteOperation& o, RGWModifyOp op, string&
   o.exec("rgw", "bucket_complete_op", in);
 }
 
+void cls_rgw_bucket_complete_ops(ObjectWriteOperation& o, list<rgw_cls_obj_complete_op>& ops)
+{
+  bufferlist in;
+  struct rgw_cls_obj_complete_ops call;
+  call.ops = ops;
+  ::encode(call, in);
+  o.exec("rgw", "bucket_complete_ops", in);
+}
+
 
 int cls_rgw_list_op(IoCtx& io_ctx, string& oid, string& start_obj,
                     string& filter_prefix, uint32_t num_entries,
@@ -88,6 +97,40 @@ int cls_rgw_list_op(IoCtx& io_ctx, string& oid, string& start_obj,
  return r;
 }
 
+class BucketListCompletion : public ObjectOperationCompletion {
+  rgw_cls_list_ret *result;
+  int *prval;
+public:
+  BucketListCompletion(rgw_cls_list_ret *_result, int *_prval) : result(_result), prval(_prval) {}
+  void handle_completion(int r, bufferlist& outbl) {
+    if (r >= 0) {
+      try {
+        bufferlist::iterator iter = outbl.begin();
+        ::decode(*result, iter);
+      } catch (buffer::error& err) {
+        r = -EIO;
+      }
+    }
+    if (prval)
+      *prval = r;
+  }
+};
+
+void cls_rgw_bucket_list_op(ObjectReadOperation& op, const string& start_obj,
+                            const string& filter_prefix, uint32_t num_entries,
+                            rgw_cls_list_ret *result, int *prval,
+                            const string& delimiter)
+{
+  bufferlist in;
+  struct rgw_cls_list_op call;
+  call.start_obj = start_obj;
+  call.filter_prefix = filter_prefix;
+  call.num_entries = num_entries;
+  call.delimiter = delimiter;
+  ::encode(call, in);
+  op.exec("rgw", "bucket_list", in, new BucketListCompletion(result, prval));
+}
+
 int cls_rgw_bucket_check_index_op(IoCtx& io_ctx, string& oid,
 				  rgw_bucket_dir_header *existing_header,
 				  rgw_bucket_dir_header *calculated_header)
@@ -6,6 +6,9 @@
 #include "cls_rgw_types.h"
 #include "common/RefCountedObj.h"
 
+struct rgw_cls_list_ret;
+struct rgw_cls_obj_complete_op;
+
 class RGWGetDirHeader_CB : public RefCountedObject {
 public:
   virtual ~RGWGetDirHeader_CB() {}
@@ -24,10 +27,23 @@ void cls_rgw_bucket_complete_op(librados::ObjectWriteOperation& o, RGWModifyOp o
                                 rgw_bucket_entry_ver& ver, string& name, rgw_bucket_dir_entry_meta& dir_meta,
 				list<string> *remove_objs, bool log_op);
 
+/* several completions in one call; the names must be distinct */
+void cls_rgw_bucket_complete_ops(librados::ObjectWriteOperation& o, list<rgw_cls_obj_complete_op>& ops);
+
 int cls_rgw_list_op(librados::IoCtx& io_ctx, string& oid, string& start_obj,
                     string& filter_prefix, uint32_t num_entries,
                     rgw_bucket_dir *dir, bool *is_truncated);
 
+/*
+ * a listing to send along with others, e.g. one per index shard; with
+ * a delimiter, names that have it past the prefix come back as common
+ * prefixes instead (osds that predate it list them all)
+ */
+void cls_rgw_bucket_list_op(librados::ObjectReadOperation& op, const string& start_obj,
+                            const string& filter_prefix, uint32_t num_entries,
+                            rgw_cls_list_ret *result, int *prval,
+                            const string& delimiter = string());
+
 int cls_rgw_bucket_check_index_op(librados::IoCtx& io_ctx, string& oid,
 				  rgw_bucket_dir_header *existing_header,
 				  rgw_bucket_dir_header *calculated_header);
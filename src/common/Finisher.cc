@@ -1,6 +1,8 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <sstream>
+
 #include "common/config.h"
 #include "Finisher.h"
 
@@ -84,3 +86,45 @@ void *Finisher::finisher_thread_entry()
   return 0;
 }
 
+
+ShardedFinisher::ShardedFinisher(CephContext *cct, unsigned num_shards,
+				 string name)
+{
+  if (num_shards < 1)
+    num_shards = 1;
+  for (unsigned i = 0; i < num_shards; i++) {
+    if (name.empty()) {
+      shards.push_back(new Finisher(cct));
+    } else {
+      std::ostringstream ss;
+      ss << name;
+      if (num_shards > 1)
+	ss << "-" << i;
+      shards.push_back(new Finisher(cct, ss.str()));
+    }
+  }
+}
+
+ShardedFinisher::~ShardedFinisher()
+{
+  for (unsigned i = 0; i < shards.size(); i++)
+    delete shards[i];
+}
+
+void ShardedFinisher::start()
+{
+  for (unsigned i = 0; i < shards.size(); i++)
+    shards[i]->start();
+}
+
+void ShardedFinisher::stop()
+{
+  for (unsigned i = 0; i < shards.size(); i++)
+    shards[i]->stop();
+}
+
+void ShardedFinisher::wait_for_empty()
+{
+  for (unsigned i = 0; i < shards.size(); i++)
+    shards[i]->wait_for_empty();
+}
@@ -109,6 +109,48 @@ class Finisher {
   }
 };
 
+/**
+ * ShardedFinisher
+ *
+ * A Finisher with several threads.  Each context is queued with an
+ * ordering key, the address of whatever its completion must stay in
+ * order for (a PG, an object, a sequencer, an IoCtx).  Contexts with
+ * the same key go to the same shard, and so complete on one thread in
+ * the order they were queued; contexts with different keys may
+ * complete in parallel.  With one shard this is a plain Finisher.
+ */
+class ShardedFinisher {
+  vector<Finisher*> shards;
+
+public:
+  ShardedFinisher(CephContext *cct, unsigned num_shards, string name = "");
+  ~ShardedFinisher();
+
+  unsigned get_num_shards() const {
+    return shards.size();
+  }
+  Finisher *get_shard(const void *key) {
+    if (shards.size() == 1)
+      return shards[0];
+    // allocations are aligned and far apart; fold the high bits in
+    uintptr_t k = (uintptr_t)key;
+    k ^= k >> 16;
+    k ^= k >> 6;
+    return shards[k % shards.size()];
+  }
+
+  void queue(const void *key, Context *c, int r = 0) {
+    get_shard(key)->queue(c, r);
+  }
+  void queue(const void *key, vector<Context*>& ls) {
+    get_shard(key)->queue(ls);
+  }
+
+  void start();
+  void stop();
+  void wait_for_empty();
+};
+
 class C_OnFinisher : public Context {
   Context *con;
   Finisher *fin;
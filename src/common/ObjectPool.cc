@@ -0,0 +1,195 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <stdlib.h>
+#include <new>
+
+#include "common/ObjectPool.h"
+#include "include/assert.h"
+
+/// objects moved between a thread's list and the shared list at once
+#define BATCH 32
+/// longest thread free list
+#define MAX_CACHED (2 * BATCH)
+/// longest shared free list, per pool
+#define MAX_SHARED 1024
+
+static simple_spinlock_t pools_lock = SIMPLE_SPINLOCK_INITIALIZER;
+static ObjectPool *pools = NULL;
+
+ObjectPool::ObjectPool(const char *n, size_t s, size_t a)
+  : name(n),
+    size(s < sizeof(Free) ? sizeof(Free) : s),
+    align(a),
+    lock(SIMPLE_SPINLOCK_INITIALIZER),
+    shared(NULL), shared_count(0),
+    caches(NULL),
+    exited_hits(0), exited_misses(0),
+    next_pool(NULL)
+{
+  int r = pthread_key_create(&key, cache_exit);
+  assert(r == 0);
+
+  simple_spin_lock(&pools_lock);
+  next_pool = pools;
+  pools = this;
+  simple_spin_unlock(&pools_lock);
+}
+
+void *ObjectPool::heap_alloc()
+{
+  if (!align)
+    return ::operator new(size);
+  void *p;
+  if (::posix_memalign(&p, align, size))
+    throw std::bad_alloc();
+  return p;
+}
+
+void ObjectPool::heap_free(void *p)
+{
+  if (!align)
+    ::operator delete(p);
+  else
+    ::free(p);
+}
+
+ObjectPool::ThreadCache *ObjectPool::get_cache()
+{
+  ThreadCache *c = (ThreadCache *)pthread_getspecific(key);
+  if (!c) {
+    c = new ThreadCache(this);
+    pthread_setspecific(key, c);
+    simple_spin_lock(&lock);
+    c->next = caches;
+    caches = c;
+    simple_spin_unlock(&lock);
+  }
+  return c;
+}
+
+void ObjectPool::refill(ThreadCache *c)
+{
+  simple_spin_lock(&lock);
+  for (unsigned i = 0; i < BATCH && shared; i++) {
+    Free *f = shared;
+    shared = f->next;
+    shared_count--;
+    f->next = c->head;
+    c->head = f;
+    c->count++;
+  }
+  simple_spin_unlock(&lock);
+}
+
+void ObjectPool::release(ThreadCache *c, unsigned n)
+{
+  Free *heap = NULL;
+  simple_spin_lock(&lock);
+  for (unsigned i = 0; i < n && c->head; i++) {
+    Free *f = c->head;
+    c->head = f->next;
+    c->count--;
+    if (shared_count < MAX_SHARED) {
+      f->next = shared;
+      shared = f;
+      shared_count++;
+    } else {
+      f->next = heap;
+      heap = f;
+    }
+  }
+  simple_spin_unlock(&lock);
+
+  while (heap) {
+    Free *f = heap;
+    heap = f->next;
+    heap_free(f);
+  }
+}
+
+void ObjectPool::cache_exit(void *p)
+{
+  ThreadCache *c = (ThreadCache *)p;
+  ObjectPool *pool = c->pool;
+  pool->release(c, c->count);
+
+  simple_spin_lock(&pool->lock);
+  ThreadCache **pc = &pool->caches;
+  while (*pc != c)
+    pc = &(*pc)->next;
+  *pc = c->next;
+  pool->exited_hits += c->hits;
+  pool->exited_misses += c->misses;
+  simple_spin_unlock(&pool->lock);
+  delete c;
+}
+
+void *ObjectPool::alloc(size_t num_bytes)
+{
+  if (num_bytes != size)
+    return ::operator new(num_bytes);
+
+  ThreadCache *c = get_cache();
+  if (!c->head)
+    refill(c);
+  if (!c->head) {
+    c->misses++;
+    return heap_alloc();
+  }
+  c->hits++;
+  Free *f = c->head;
+  c->head = f->next;
+  c->count--;
+  return f;
+}
+
+void ObjectPool::free(void *p, size_t num_bytes)
+{
+  if (!p)
+    return;
+  if (num_bytes != size) {
+    ::operator delete(p);
+    return;
+  }
+
+  ThreadCache *c = get_cache();
+  Free *f = (Free *)p;
+  f->next = c->head;
+  c->head = f;
+  c->count++;
+  if (c->count > MAX_CACHED)
+    release(c, BATCH);
+}
+
+void ObjectPool::get_stats(stats_t *s)
+{
+  simple_spin_lock(&lock);
+  uint64_t cached = shared_count;
+  s->hits += exited_hits;
+  s->misses += exited_misses;
+  for (ThreadCache *c = caches; c; c = c->next) {
+    s->hits += c->hits;
+    s->misses += c->misses;
+    cached += c->count;
+  }
+  simple_spin_unlock(&lock);
+  s->cached_bytes += cached * size;
+}
+
+void ObjectPool::get_total_stats(stats_t *s)
+{
+  simple_spin_lock(&pools_lock);
+  for (ObjectPool *p = pools; p; p = p->next_pool)
+    p->get_stats(s);
+  simple_spin_unlock(&pools_lock);
+}
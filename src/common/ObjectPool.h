@@ -0,0 +1,108 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OBJECTPOOL_H
+#define CEPH_OBJECTPOOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/simple_spin.h"
+
+/**
+ * a pool of fixed size objects, with per thread free lists
+ *
+ * For classes that are allocated and freed many times per op.  A
+ * class opts in with a static pool sized for it and the class
+ * specific operator new/delete from OBJECT_POOL_ALLOCATOR().
+ *
+ * A freed object goes on the free list of the thread freeing it, and
+ * is reused by that thread's next allocation without taking any
+ * lock.  A thread whose list grows too long hands a batch of objects
+ * to the shared list of the pool, and a thread whose list is empty
+ * takes a batch from there before falling back to the heap.  Requests
+ * for any other size (a derived class) go straight to the heap.
+ *
+ * Pools are never destroyed.  Objects can be given a stronger
+ * alignment than operator new provides.
+ */
+class ObjectPool {
+  struct Free {
+    Free *next;
+  };
+
+  struct ThreadCache {
+    ObjectPool *pool;
+    Free *head;
+    unsigned count;
+    uint64_t hits, misses;
+    ThreadCache *next;
+
+    ThreadCache(ObjectPool *p)
+      : pool(p), head(NULL), count(0), hits(0), misses(0), next(NULL) {}
+  };
+
+  const char *name;
+  const size_t size;
+  const size_t align;  ///< 0 for operator new's
+  pthread_key_t key;
+
+  simple_spinlock_t lock;  ///< protects the rest
+  Free *shared;
+  unsigned shared_count;
+  ThreadCache *caches;
+  uint64_t exited_hits, exited_misses;  ///< of threads that are gone
+  ObjectPool *next_pool;
+
+  void *heap_alloc();
+  void heap_free(void *p);
+  ThreadCache *get_cache();
+  void refill(ThreadCache *c);
+  void release(ThreadCache *c, unsigned n);
+  static void cache_exit(void *p);
+
+  ObjectPool(const ObjectPool&);
+  ObjectPool& operator=(const ObjectPool&);
+
+public:
+  ObjectPool(const char *name, size_t size, size_t align = 0);
+
+  void *alloc(size_t num_bytes);
+  void free(void *p, size_t num_bytes);
+
+  struct stats_t {
+    uint64_t hits;          ///< allocations served from a free list
+    uint64_t misses;        ///< allocations that went to the heap
+    uint64_t cached_bytes;  ///< bytes sitting on free lists
+    stats_t() : hits(0), misses(0), cached_bytes(0) {}
+  };
+
+  const char *get_name() const {
+    return name;
+  }
+  /// add the stats of this pool to s; racy, but good enough for counters
+  void get_stats(stats_t *s);
+  /// add the stats of all pools to s
+  static void get_total_stats(stats_t *s);
+};
+
+/// class specific operator new/delete allocating from pool
+#define OBJECT_POOL_ALLOCATOR(pool)				\
+  static void *operator new(size_t num_bytes) {			\
+    return pool.alloc(num_bytes);				\
+  }								\
+  static void operator delete(void *p, size_t num_bytes) {	\
+    pool.free(p, num_bytes);					\
+  }
+
+#endif
@@ -0,0 +1,81 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef OP_QUEUE_H
+#define OP_QUEUE_H
+
+#include "include/utime.h"
+#include "common/Formatter.h"
+
+#include <list>
+
+/**
+ * The interface of a queue of ops, so the OSD can pick its scheduler.
+ *
+ * Items are queued per class K (e.g., the client) either strictly,
+ * i.e. served ahead of everything else by priority, or subject to the
+ * queue's scheduling policy.
+ */
+template <typename T, typename K>
+class OpQueue {
+public:
+  /// selects items for remove_by_filter
+  struct Filter {
+    virtual bool operator()(const T &item) = 0;
+    virtual ~Filter() {}
+  };
+
+  virtual unsigned length() = 0;
+  virtual bool empty() = 0;
+
+  virtual void remove_by_filter(Filter &f, std::list<T> *removed = 0) = 0;
+  virtual void remove_by_class(K k, std::list<T> *out = 0) = 0;
+
+  virtual void enqueue_strict(K cl, unsigned priority, T item) = 0;
+  virtual void enqueue_strict_front(K cl, unsigned priority, T item) = 0;
+  virtual void enqueue(K cl, unsigned priority, unsigned cost, T item) = 0;
+  virtual void enqueue_front(K cl, unsigned priority, unsigned cost,
+			     T item) = 0;
+
+  /**
+   * enqueue an item from a client that also talks to other servers
+   *
+   * @param delta requests of the client completed anywhere since its
+   *              last request to us, this one included
+   * @param rho the share of those served for the client's reservation
+   *
+   * Queues without a notion of distributed scheduling ignore both.
+   */
+  virtual void enqueue_distributed(K cl, unsigned priority, unsigned cost,
+				   T item, unsigned delta, unsigned rho) {
+    enqueue(cl, priority, cost, item);
+  }
+
+  /**
+   * whether dequeue() would return an item at @now
+   *
+   * A queue may hold items back, e.g. to enforce a rate limit.  While
+   * it only has such items it returns false and sets *next to the time
+   * the first of them becomes eligible.
+   */
+  virtual bool can_dequeue(utime_t now, utime_t *next) {
+    return !empty();
+  }
+
+  virtual T dequeue() = 0;
+
+  virtual void dump(Formatter *f) const = 0;
+
+  virtual ~OpQueue() {}
+};
+
+#endif
@@ -47,7 +47,7 @@ protected:
   bool do_accept();
 
   void handle_connection(int fd);
-  void close_connection(int fd);
+  virtual void close_connection(int fd);
 
   int dump_data(int fd);
 
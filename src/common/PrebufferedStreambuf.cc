@@ -1,5 +1,7 @@
 
 #include "common/PrebufferedStreambuf.h"
+#include <string.h>
+#include <algorithm>
 
 PrebufferedStreambuf::PrebufferedStreambuf(char *buf, size_t len)
   : m_buf(buf), m_buf_len(len)
@@ -61,3 +63,24 @@ std::string PrebufferedStreambuf::get_str() const
     return std::string(m_buf, this->pptr() - m_buf);
   }  
 }
+
+size_t PrebufferedStreambuf::size() const
+{
+  if (m_overflow.size())
+    return m_buf_len + (this->pptr() - &m_overflow[0]);
+  return this->pptr() - m_buf;
+}
+
+size_t PrebufferedStreambuf::copy_out(char *dst, size_t len) const
+{
+  if (m_overflow.size()) {
+    size_t n = std::min(len, m_buf_len);
+    memcpy(dst, m_buf, n);
+    size_t o = std::min(len - n, (size_t)(this->pptr() - &m_overflow[0]));
+    memcpy(dst + n, &m_overflow[0], o);
+    return n + o;
+  }
+  size_t n = std::min(len, (size_t)(this->pptr() - m_buf));
+  memcpy(dst, m_buf, n);
+  return n;
+}
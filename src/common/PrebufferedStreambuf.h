@@ -37,6 +37,12 @@ public:
 
   /// return a string copy (inefficiently)
   std::string get_str() const;
+
+  /// number of bytes written so far
+  size_t size() const;
+
+  /// copy up to len bytes of the content into dst, return how many
+  size_t copy_out(char *dst, size_t len) const;
 };    
 
 #endif
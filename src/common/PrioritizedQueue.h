@@ -17,6 +17,7 @@
 
 #include "common/Mutex.h"
 #include "common/Formatter.h"
+#include "common/OpQueue.h"
 
 #include <map>
 #include <utility>
@@ -44,7 +45,7 @@
  * to provide fairness for different clients.
  */
 template <typename T, typename K>
-class PrioritizedQueue {
+class PrioritizedQueue : public OpQueue<T, K> {
   int64_t total_priority;
   int64_t max_tokens_per_subqueue;
   int64_t min_cost;
@@ -275,6 +276,16 @@ public:
     }
   }
 
+  struct FilterRef {
+    typename OpQueue<T, K>::Filter *f;
+    FilterRef(typename OpQueue<T, K>::Filter *f) : f(f) {}
+    bool operator()(const T &item) { return (*f)(item); }
+  };
+  void remove_by_filter(typename OpQueue<T, K>::Filter &f,
+			list<T> *removed = 0) {
+    remove_by_filter(FilterRef(&f), removed);
+  }
+
   void remove_by_class(K k, list<T> *out = 0) {
     for (typename map<unsigned, SubQueue>::iterator i = queue.begin();
 	 i != queue.end();
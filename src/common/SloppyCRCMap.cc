@@ -3,6 +3,20 @@
 
 #include "common/SloppyCRCMap.h"
 #include "common/Formatter.h"
+#include "include/crc32c.h"
+
+bool SloppyCRCMap::extend_crc32c(uint64_t offset, uint32_t *crc) const
+{
+  if (!block_size || offset % block_size)
+    return false;
+  std::map<uint64_t,uint32_t>::const_iterator p = crc_map.find(offset);
+  if (p == crc_map.end())
+    return false;
+  // crc32c is linear: running the block from *crc instead of crc_iv
+  // differs by what the difference of the two does over zeros
+  *crc = p->second ^ ceph_crc32c(*crc ^ crc_iv, NULL, block_size);
+  return true;
+}
 
 void SloppyCRCMap::write(uint64_t offset, uint64_t len, const bufferlist& bl,
 			 std::ostream *out)
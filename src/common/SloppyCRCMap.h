@@ -43,6 +43,26 @@ public:
     }
   }
 
+  uint32_t get_block_size() const {
+    return block_size;
+  }
+
+  /// whether we have the crc of the whole block at @offset
+  bool has_crc(uint64_t offset) const {
+    return block_size && offset % block_size == 0 && crc_map.count(offset);
+  }
+
+  /**
+   * extend a crc32c over the block at @offset without reading it
+   *
+   * Gives what bufferlist::crc32c(*crc) over the block's data would.
+   *
+   * @param offset block aligned offset
+   * @param crc running crc, updated
+   * @returns false if the block's crc is not known
+   */
+  bool extend_crc32c(uint64_t offset, uint32_t *crc) const;
+
   /// update based on a write
   void write(uint64_t offset, uint64_t len, const bufferlist& bl,
 	     std::ostream *out = NULL);
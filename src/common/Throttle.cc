@@ -26,6 +26,8 @@ enum {
   l_throttle_put,
   l_throttle_put_sum,
   l_throttle_wait,
+  l_throttle_waiters,
+  l_throttle_get_async_wait,
   l_throttle_last,
 };
 
@@ -51,7 +53,9 @@ Throttle::Throttle(CephContext *cct, std::string n, int64_t m, bool _use_perf)
   b.add_u64_counter(l_throttle_take_sum, "take_sum");
   b.add_u64_counter(l_throttle_put, "put");
   b.add_u64_counter(l_throttle_put_sum, "put_sum");
-  b.add_time_avg(l_throttle_wait, "wait");
+  b.add_time_size_histogram(l_throttle_wait, "wait");
+  b.add_u64(l_throttle_waiters, "waiters");
+  b.add_u64_counter(l_throttle_get_async_wait, "get_async_wait");
 
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
@@ -60,11 +64,20 @@ Throttle::Throttle(CephContext *cct, std::string n, int64_t m, bool _use_perf)
 
 Throttle::~Throttle()
 {
-  while (!cond.empty()) {
-    Cond *cv = cond.front();
-    delete cv;
-    cond.pop_front();
+  // blocked threads are left hanging; there is nothing they could do
+  list<Context*> canceled;
+  {
+    Mutex::Locker l(lock);
+    while (!waiters.empty()) {
+      Waiter *w = waiters.front();
+      waiters.pop_front();
+      if (w->onfinish) {
+	canceled.push_back(w->onfinish);
+	delete w;
+      }
+    }
   }
+  finish_contexts(cct, canceled, -ECANCELED);
 
   if (!use_perf)
     return;
@@ -76,55 +89,88 @@ Throttle::~Throttle()
 void Throttle::_reset_max(int64_t m)
 {
   assert(lock.is_locked());
-  if (!cond.empty())
-    cond.front()->SignalOne();
   if (logger)
     logger->set(l_throttle_max, m);
   max.set((size_t)m);
 }
 
-bool Throttle::_wait(int64_t c)
+/**
+ * Serve the waiter at the front of the queue if it fits: a blocked
+ * thread is signaled, and takes its count and serves the next one
+ * itself; an async waiter is given its count here, and its context
+ * added to finished, to be completed once the lock is dropped.
+ */
+void Throttle::_grant(list<Context*> *finished)
 {
-  utime_t start;
-  bool waited = false;
-  if (_should_wait(c) || !cond.empty()) { // always wait behind other waiters.
-    Cond *cv = new Cond;
-    cond.push_back(cv);
-    do {
-      if (!waited) {
-	ldout(cct, 2) << "_wait waiting..." << dendl;
-	start = ceph_clock_now(cct);
-      }
-      waited = true;
-      cv->Wait(lock);
-    } while (_should_wait(c) || cv != cond.front());
-
-    if (waited) {
-      ldout(cct, 3) << "_wait finished waiting" << dendl;
-      utime_t dur = ceph_clock_now(cct) - start;
-      if (logger)
-        logger->tinc(l_throttle_wait, dur);
+  assert(lock.is_locked());
+  while (!waiters.empty()) {
+    Waiter *w = waiters.front();
+    if (_should_wait(w->count))
+      break;
+    if (w->cond) {
+      w->cond->Signal();
+      break;
     }
+    waiters.pop_front();
+    count.add(w->count);
+    _account_wait(w);
+    finished->push_back(w->onfinish);
+    delete w;
+  }
+  if (logger) {
+    logger->set(l_throttle_val, count.read());
+    logger->set(l_throttle_waiters, waiters.size());
+  }
+}
 
-    delete cv;
-    cond.pop_front();
+void Throttle::_account_wait(Waiter *w)
+{
+  if (logger)
+    logger->hinc(l_throttle_wait, ceph_clock_now(cct) - w->start, w->count);
+}
 
-    // wake up the next guy
-    if (!cond.empty())
-      cond.front()->SignalOne();
+bool Throttle::_wait(int64_t c, list<Context*> *finished)
+{
+  if (!_should_wait(c) && waiters.empty()) {
+    count.add(c);
+    return false;
   }
-  return waited;
+
+  // always wait behind other waiters.
+  ldout(cct, 2) << "_wait waiting..." << dendl;
+  Cond cv;
+  Waiter w(c, &cv, NULL, ceph_clock_now(cct));
+  waiters.push_back(&w);
+  if (logger)
+    logger->set(l_throttle_waiters, waiters.size());
+  while (_should_wait(c) || waiters.front() != &w)
+    cv.Wait(lock);
+  ldout(cct, 3) << "_wait finished waiting" << dendl;
+  waiters.pop_front();
+  count.add(c);
+  _account_wait(&w);
+
+  // wake up the next guy
+  _grant(finished);
+  return true;
 }
 
 bool Throttle::wait(int64_t m)
 {
-  Mutex::Locker l(lock);
-  if (m) {
-    assert(m > 0);
-    _reset_max(m);
+  list<Context*> finished;
+  bool waited;
+  {
+    Mutex::Locker l(lock);
+    if (m) {
+      assert(m > 0);
+      _reset_max(m);
+      _grant(&finished);
+    }
+    ldout(cct, 10) << "wait" << dendl;
+    waited = _wait(0, &finished);
   }
-  ldout(cct, 10) << "wait" << dendl;
-  return _wait(0);
+  finish_contexts(cct, finished);
+  return waited;
 }
 
 int64_t Throttle::take(int64_t c)
@@ -147,16 +193,18 @@ bool Throttle::get(int64_t c, int64_t m)
 {
   assert(c >= 0);
   ldout(cct, 10) << "get " << c << " (" << count.read() << " -> " << (count.read() + c) << ")" << dendl;
+  list<Context*> finished;
   bool waited = false;
   {
     Mutex::Locker l(lock);
     if (m) {
       assert(m > 0);
       _reset_max(m);
+      _grant(&finished);
     }
-    waited = _wait(c);
-    count.add(c);
+    waited = _wait(c, &finished);
   }
+  finish_contexts(cct, finished);
   if (logger) {
     logger->inc(l_throttle_get);
     logger->inc(l_throttle_get_sum, c);
@@ -165,6 +213,32 @@ bool Throttle::get(int64_t c, int64_t m)
   return waited;
 }
 
+bool Throttle::get_async(int64_t c, Context *onfinish)
+{
+  assert(c >= 0);
+  assert(onfinish);
+  Mutex::Locker l(lock);
+  if (logger) {
+    logger->inc(l_throttle_get);
+    logger->inc(l_throttle_get_sum, c);
+  }
+  if (!_should_wait(c) && waiters.empty()) {
+    ldout(cct, 10) << "get_async " << c << " (" << count.read() << " -> " << (count.read() + c) << ")" << dendl;
+    count.add(c);
+    if (logger)
+      logger->set(l_throttle_val, count.read());
+    delete onfinish;
+    return true;
+  }
+  ldout(cct, 10) << "get_async " << c << " waiting behind " << waiters.size() << dendl;
+  waiters.push_back(new Waiter(c, NULL, onfinish, ceph_clock_now(cct)));
+  if (logger) {
+    logger->inc(l_throttle_get_async_wait);
+    logger->set(l_throttle_waiters, waiters.size());
+  }
+  return false;
+}
+
 /* Returns true if it successfully got the requested amount,
  * or false if it would block.
  */
@@ -172,7 +246,7 @@ bool Throttle::get_or_fail(int64_t c)
 {
   assert (c >= 0);
   Mutex::Locker l(lock);
-  if (_should_wait(c) || !cond.empty()) {
+  if (_should_wait(c) || !waiters.empty()) {
     ldout(cct, 10) << "get_or_fail " << c << " failed" << dendl;
     if (logger) {
       logger->inc(l_throttle_get_or_fail_fail);
@@ -195,19 +269,24 @@ int64_t Throttle::put(int64_t c)
 {
   assert(c >= 0);
   ldout(cct, 10) << "put " << c << " (" << count.read() << " -> " << (count.read()-c) << ")" << dendl;
-  Mutex::Locker l(lock);
-  if (c) {
-    if (!cond.empty())
-      cond.front()->SignalOne();
-    assert(((int64_t)count.read()) >= c); //if count goes negative, we failed somewhere!
-    count.sub(c);
-    if (logger) {
-      logger->inc(l_throttle_put);
-      logger->inc(l_throttle_put_sum, c);
-      logger->set(l_throttle_val, count.read());
+  list<Context*> finished;
+  int64_t r;
+  {
+    Mutex::Locker l(lock);
+    if (c) {
+      assert(((int64_t)count.read()) >= c); //if count goes negative, we failed somewhere!
+      count.sub(c);
+      if (logger) {
+	logger->inc(l_throttle_put);
+	logger->inc(l_throttle_put_sum, c);
+	logger->set(l_throttle_val, count.read());
+      }
     }
+    r = count.read();
+    _grant(&finished);
   }
-  return count.read();
+  finish_contexts(cct, finished);
+  return r;
 }
 
 SimpleThrottle::SimpleThrottle(uint64_t max, bool ignore_enoent)
@@ -8,17 +8,38 @@
 #include "Cond.h"
 #include <list>
 #include "include/atomic.h"
+#include "include/Context.h"
+#include "include/utime.h"
 
 class CephContext;
 class PerfCounters;
 
+/**
+ * @class Throttle
+ * Bounds the sum of the counts gotten and not yet put back.
+ *
+ * Waiters are served strictly in the order they arrived, and only the
+ * one at the front is woken, once its count fits, so a large get is
+ * not starved by a stream of smaller ones slipping in ahead of it.  A
+ * waiter is either a thread blocked in get() or wait(), or a Context
+ * queued by get_async().
+ */
 class Throttle {
+  struct Waiter {
+    int64_t count;
+    Cond *cond;          ///< to signal a blocked thread, or
+    Context *onfinish;   ///< to complete for get_async()
+    utime_t start;
+    Waiter(int64_t c, Cond *cv, Context *fin, utime_t s)
+      : count(c), cond(cv), onfinish(fin), start(s) {}
+  };
+
   CephContext *cct;
   std::string name;
   PerfCounters *logger;
 	ceph::atomic_t count, max;
   Mutex lock;
-  list<Cond*> cond;
+  list<Waiter*> waiters;
   bool use_perf;
   
 public:
@@ -36,7 +57,9 @@ private:
        (c >= m && cur > m));     // except for large c
   }
 
-  bool _wait(int64_t c);
+  bool _wait(int64_t c, list<Context*> *finished);
+  void _grant(list<Context*> *finished);
+  void _account_wait(Waiter *w);
 
 public:
   int64_t get_current() {
@@ -45,11 +68,27 @@ public:
 
   int64_t get_max() { return max.read(); }
 
+  /// the number of threads and contexts waiting
+  unsigned get_waiters() {
+    Mutex::Locker l(lock);
+    return waiters.size();
+  }
+
   bool wait(int64_t m = 0);
 
   int64_t take(int64_t c = 1);
   bool get(int64_t c = 1, int64_t m = 0);
 
+  /**
+   * Get c without blocking.  Returns true if it got c right away, in
+   * which case onfinish is deleted unused.  Otherwise onfinish is
+   * queued behind the other waiters and completed with 0 once c has
+   * been gotten on its behalf, from the thread calling put(), or with
+   * -ECANCELED if the Throttle is destroyed first; it should not do
+   * more than to hand the work over to some other thread.
+   */
+  bool get_async(int64_t c, Context *onfinish);
+
   /**
    * Returns true if it successfully got the requested amount,
    * or false if it would block.
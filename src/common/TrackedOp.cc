@@ -12,6 +12,7 @@
 
 #include "TrackedOp.h"
 #include "common/Formatter.h"
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include "common/debug.h"
@@ -84,76 +85,173 @@ void OpHistory::dump_ops(utime_t now, Formatter *f)
   f->close_section();
 }
 
+OpTracker::OpTracker(CephContext *cct_, uint32_t num_shards)
+  : history_lock("OpTracker::history_lock"),
+    history(this), complaint_time(0), log_threshold(0),
+    client_latency_sum(0), client_latency_count(0), cct(cct_)
+{
+  if (num_shards < 1)
+    num_shards = 1;
+  for (uint32_t i = 0; i < num_shards; i++)
+    shards.push_back(new ShardedTrackingData);
+}
+
+OpTracker::~OpTracker()
+{
+  while (!shards.empty()) {
+    assert(shards.back()->ops_in_flight.empty());
+    delete shards.back();
+    shards.pop_back();
+  }
+}
+
+void OpTracker::lock_all_shards()
+{
+  for (vector<ShardedTrackingData*>::iterator i = shards.begin();
+       i != shards.end();
+       ++i)
+    (*i)->ops_in_flight_lock.Lock();
+}
+
+void OpTracker::unlock_all_shards()
+{
+  for (vector<ShardedTrackingData*>::reverse_iterator i = shards.rbegin();
+       i != shards.rend();
+       ++i)
+    (*i)->ops_in_flight_lock.Unlock();
+}
+
 void OpTracker::dump_historic_ops(Formatter *f)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
+  Mutex::Locker locker(history_lock);
   utime_t now = ceph_clock_now(cct);
   history.dump_ops(now, f);
 }
 
 void OpTracker::dump_ops_in_flight(Formatter *f)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
+  lock_all_shards();
+  uint64_t num_ops = 0;
+  for (vector<ShardedTrackingData*>::iterator i = shards.begin();
+       i != shards.end();
+       ++i)
+    num_ops += (*i)->ops_in_flight.size();
+  // oldest first, as a single list would have them
+  vector<pair<utime_t, TrackedOp*> > ops;
+  ops.reserve(num_ops);
+  for (vector<ShardedTrackingData*>::iterator i = shards.begin();
+       i != shards.end();
+       ++i)
+    for (xlist<TrackedOp*>::iterator p = (*i)->ops_in_flight.begin();
+	 !p.end();
+	 ++p)
+      ops.push_back(make_pair((*p)->get_arrived(), *p));
+  sort(ops.begin(), ops.end());
+
   f->open_object_section("ops_in_flight"); // overall dump
-  f->dump_int("num_ops", ops_in_flight.size());
+  f->dump_int("num_ops", num_ops);
   f->open_array_section("ops"); // list of TrackedOps
   utime_t now = ceph_clock_now(cct);
-  for (xlist<TrackedOp*>::iterator p = ops_in_flight.begin(); !p.end(); ++p) {
+  for (vector<pair<utime_t, TrackedOp*> >::iterator p = ops.begin();
+       p != ops.end();
+       ++p) {
     f->open_object_section("op");
-    (*p)->dump(now, f);
+    p->second->dump(now, f);
     f->close_section(); // this TrackedOp
   }
   f->close_section(); // list of TrackedOps
   f->close_section(); // overall dump
+  unlock_all_shards();
 }
 
 void OpTracker::register_inflight_op(xlist<TrackedOp*>::item *i)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
-  ops_in_flight.push_back(i);
-  ops_in_flight.back()->seq = seq++;
+  uint64_t current_seq = seq.inc();
+  ShardedTrackingData *shard = shards[current_seq % shards.size()];
+  Mutex::Locker locker(shard->ops_in_flight_lock);
+  shard->ops_in_flight.push_back(i);
+  shard->ops_in_flight.back()->seq = current_seq;
 }
 
 void OpTracker::unregister_inflight_op(TrackedOp *i)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
-  assert(i->xitem.get_list() == &ops_in_flight);
+  ShardedTrackingData *shard = shards[i->seq % shards.size()];
+  {
+    Mutex::Locker locker(shard->ops_in_flight_lock);
+    assert(i->xitem.get_list() == &shard->ops_in_flight);
+    i->xitem.remove_myself();
+  }
   utime_t now = ceph_clock_now(cct);
-  i->xitem.remove_myself();
   i->request->clear_data();
+  Mutex::Locker locker(history_lock);
+  if (i->request->get_source().is_client()) {
+    client_latency_sum += now - i->get_arrived();
+    ++client_latency_count;
+  }
   history.insert(now, TrackedOpRef(i));
 }
 
-bool OpTracker::check_ops_in_flight(std::vector<string> &warning_vector)
+double OpTracker::take_client_latency(uint64_t *count)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
-  if (!ops_in_flight.size())
-    return false;
+  Mutex::Locker locker(history_lock);
+  double ret = client_latency_count ?
+    client_latency_sum / client_latency_count : 0;
+  *count = client_latency_count;
+  client_latency_sum = 0;
+  client_latency_count = 0;
+  return ret;
+}
 
+bool OpTracker::check_ops_in_flight(std::vector<string> &warning_vector)
+{
   utime_t now = ceph_clock_now(cct);
   utime_t too_old = now;
   too_old -= complaint_time;
 
-  utime_t oldest_secs = now - ops_in_flight.front()->get_arrived();
+  lock_all_shards();
+
+  // the ops of each shard are in arrival order; merge the old ones
+  uint64_t total_ops = 0;
+  vector<pair<utime_t, TrackedOp*> > old_ops;
+  for (vector<ShardedTrackingData*>::iterator s = shards.begin();
+       s != shards.end();
+       ++s) {
+    total_ops += (*s)->ops_in_flight.size();
+    for (xlist<TrackedOp*>::iterator i = (*s)->ops_in_flight.begin();
+	 !i.end() && (*i)->get_arrived() < too_old;
+	 ++i)
+      old_ops.push_back(make_pair((*i)->get_arrived(), *i));
+  }
+  if (!total_ops) {
+    unlock_all_shards();
+    return false;
+  }
+  if (old_ops.empty()) {
+    dout(10) << "ops_in_flight.size: " << total_ops
+	     << "; none older than " << complaint_time << " seconds" << dendl;
+    unlock_all_shards();
+    return false;
+  }
+  sort(old_ops.begin(), old_ops.end());
 
-  dout(10) << "ops_in_flight.size: " << ops_in_flight.size()
+  utime_t oldest_secs = now - old_ops.front().first;
+
+  dout(10) << "ops_in_flight.size: " << total_ops
            << "; oldest is " << oldest_secs
            << " seconds old" << dendl;
 
-  if (oldest_secs < complaint_time)
-    return false;
-
-  xlist<TrackedOp*>::iterator i = ops_in_flight.begin();
+  vector<pair<utime_t, TrackedOp*> >::iterator i = old_ops.begin();
   warning_vector.reserve(log_threshold + 1);
 
   int slow = 0;     // total slow
   int warned = 0;   // total logged
-  while (!i.end() && (*i)->get_arrived() < too_old) {
+  while (i != old_ops.end()) {
+    TrackedOp *op = i->second;
     slow++;
 
     // exponential backoff of warning intervals
-    if (((*i)->get_arrived() +
-	 (complaint_time * (*i)->warn_interval_multiplier)) < now) {
+    if ((op->get_arrived() +
+	 (complaint_time * op->warn_interval_multiplier)) < now) {
       // will warn
       if (warning_vector.empty())
 	warning_vector.push_back("");
@@ -161,18 +259,19 @@ bool OpTracker::check_ops_in_flight(std::vector<string> &warning_vector)
       if (warned > log_threshold)
         break;
 
-      utime_t age = now - (*i)->get_arrived();
+      utime_t age = now - op->get_arrived();
       stringstream ss;
-      ss << "slow request " << age << " seconds old, received at " << (*i)->get_arrived()
-	 << ": " << *((*i)->request) << " currently "
-	 << ((*i)->current.size() ? (*i)->current : (*i)->state_string());
+      ss << "slow request " << age << " seconds old, received at " << op->get_arrived()
+	 << ": " << *(op->request) << " currently "
+	 << (op->current.size() ? op->current : op->state_string());
       warning_vector.push_back(ss.str());
 
       // only those that have been shown will backoff
-      (*i)->warn_interval_multiplier *= 2;
+      op->warn_interval_multiplier *= 2;
     }
     ++i;
   }
+  unlock_all_shards();
 
   // only summarize if we warn about any.  if everything has backed
   // off, we will stay silent.
@@ -188,17 +287,28 @@ bool OpTracker::check_ops_in_flight(std::vector<string> &warning_vector)
 
 void OpTracker::get_age_ms_histogram(pow2_hist_t *h)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
-
   h->clear();
 
   utime_t now = ceph_clock_now(NULL);
+  vector<uint32_t> ages;  // ms, oldest first
+  lock_all_shards();
+  for (vector<ShardedTrackingData*>::iterator s = shards.begin();
+       s != shards.end();
+       ++s)
+    for (xlist<TrackedOp*>::iterator i = (*s)->ops_in_flight.begin();
+	 !i.end();
+	 ++i) {
+      utime_t age = now - (*i)->get_arrived();
+      ages.push_back((long)(age * 1000.0));
+    }
+  unlock_all_shards();
+  sort(ages.rbegin(), ages.rend());
+
   unsigned bin = 30;
   uint32_t lb = 1 << (bin-1);  // lower bound for this bin
   int count = 0;
-  for (xlist<TrackedOp*>::iterator i = ops_in_flight.begin(); !i.end(); ++i) {
-    utime_t age = now - (*i)->get_arrived();
-    uint32_t ms = (long)(age * 1000.0);
+  for (vector<uint32_t>::iterator i = ages.begin(); i != ages.end(); ++i) {
+    uint32_t ms = *i;
     if (ms >= lb) {
       count++;
       continue;
@@ -215,16 +325,9 @@ void OpTracker::get_age_ms_histogram(pow2_hist_t *h)
     h->set(bin, count);
 }
 
-void OpTracker::mark_event(TrackedOp *op, const string &dest)
-{
-  utime_t now = ceph_clock_now(cct);
-  return _mark_event(op, dest, now);
-}
-
-void OpTracker::_mark_event(TrackedOp *op, const string &evt,
+void OpTracker::_mark_event(TrackedOp *op, const char *evt,
 			    utime_t time)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
   dout(5) << //"reqid: " << op->get_reqid() <<
 	     ", seq: " << op->seq
 	  << ", time: " << time << ", event: " << evt
@@ -237,14 +340,25 @@ void OpTracker::RemoveOnDelete::operator()(TrackedOp *op) {
   // Do not delete op, unregister_inflight_op took control
 }
 
+void TrackedOp::mark_event(const char *event)
+{
+  utime_t now = ceph_clock_now(g_ceph_context);
+  {
+    Spinlock::Locker l(lock);
+    events.push_back(Event(now, event));
+  }
+  tracker->_mark_event(this, event, now);
+  _event_marked();
+}
+
 void TrackedOp::mark_event(const string &event)
 {
   utime_t now = ceph_clock_now(g_ceph_context);
   {
-    Mutex::Locker l(lock);
-    events.push_back(make_pair(now, event));
+    Spinlock::Locker l(lock);
+    events.push_back(Event(now, event));
   }
-  tracker->mark_event(this, event);
+  tracker->_mark_event(this, event.c_str(), now);
   _event_marked();
 }
 
@@ -17,6 +17,8 @@
 #include <stdint.h>
 #include <include/utime.h>
 #include "common/Mutex.h"
+#include "include/Spinlock.h"
+#include "include/atomic.h"
 #include "include/histogram.h"
 #include "include/xlist.h"
 #include "msg/Message.h"
@@ -60,17 +62,32 @@ class OpTracker {
   };
   friend class RemoveOnDelete;
   friend class OpHistory;
-  uint64_t seq;
-  Mutex ops_in_flight_lock;
-  xlist<TrackedOp *> ops_in_flight;
+
+  /// ops in flight whose seq is the index of the shard modulo the count
+  struct ShardedTrackingData {
+    Mutex ops_in_flight_lock;
+    xlist<TrackedOp *> ops_in_flight;
+    ShardedTrackingData()
+      : ops_in_flight_lock("OpTracker::ShardedTrackingData::lock",
+			   false, false) {}
+  };
+  atomic_t seq;
+  vector<ShardedTrackingData*> shards;
+  Mutex history_lock; ///< protects history and the client latency
   OpHistory history;
   float complaint_time;
   int log_threshold;
+  double client_latency_sum;  ///< of client ops completed since last taken
+  uint64_t client_latency_count;
+
+  /// lock every shard, in order, for a consistent view of the ops
+  void lock_all_shards();
+  void unlock_all_shards();
 
 public:
   CephContext *cct;
-  OpTracker(CephContext *cct_) : seq(0), ops_in_flight_lock("OpTracker mutex"),
-      history(this), complaint_time(0), log_threshold(0), cct(cct_) {}
+  OpTracker(CephContext *cct_, uint32_t num_shards = 1);
+  ~OpTracker();
   void set_complaint_and_threshold(float time, int threshold) {
     complaint_time = time;
     log_threshold = threshold;
@@ -85,6 +102,12 @@ public:
 
   void get_age_ms_histogram(pow2_hist_t *h);
 
+  /**
+   * Return the mean latency of the ops from clients that completed
+   * since the last call, and how many there were.
+   */
+  double take_client_latency(uint64_t *count);
+
   /**
    * Look for Ops which are too old, and insert warning
    * strings for each Op that is too old.
@@ -94,16 +117,12 @@ public:
    * @return True if there are any Ops to warn on, false otherwise.
    */
   bool check_ops_in_flight(std::vector<string> &warning_strings);
-  void mark_event(TrackedOp *op, const string &evt);
-  void _mark_event(TrackedOp *op, const string &evt, utime_t now);
+  void _mark_event(TrackedOp *op, const char *evt, utime_t now);
 
   void on_shutdown() {
-    Mutex::Locker l(ops_in_flight_lock);
+    Mutex::Locker l(history_lock);
     history.on_shutdown();
   }
-  ~OpTracker() {
-    assert(ops_in_flight.empty());
-  }
 
   template <typename T>
   typename T::Ref create_request(Message *ref)
@@ -131,9 +150,20 @@ protected:
   Message *request; /// the logical request we are tracking
   OpTracker *tracker; /// the tracker we are associated with
 
-  list<pair<utime_t, string> > events; /// list of events and their times
-  Mutex lock; /// to protect the events list
-  string current; /// the current state the event is in
+  struct Event {
+    utime_t stamp;
+    const char *name; /// a static string, or NULL if desc is used
+    string desc;
+    Event(utime_t s, const char *n) : stamp(s), name(n) {}
+    Event(utime_t s, const string &d) : stamp(s), name(NULL), desc(d) {}
+    const char *str() const {
+      return name ? name : desc.c_str();
+    }
+  };
+  static const unsigned EVENTS_RESERVED = 16; /// enough for most ops
+  vector<Event> events; /// events and their times
+  Spinlock lock; /// to protect the events list
+  string current; /// the current state the event is in, if not state_string()
   uint64_t seq; /// a unique value set by the OpTracker
 
   uint32_t warn_interval_multiplier; // limits output of a given op warning
@@ -142,10 +172,10 @@ protected:
     xitem(this),
     request(req),
     tracker(_tracker),
-    lock("TrackedOp::lock"),
     seq(0),
     warn_interval_multiplier(1)
   {
+    events.reserve(EVENTS_RESERVED);
     tracker->register_inflight_op(&xitem);
   }
 
@@ -163,15 +193,20 @@ public:
   }
   // This function maybe needs some work; assumes last event is completion time
   double get_duration() const {
+    Spinlock::Locker l(lock);
     return events.size() ?
-      (events.rbegin()->first - get_arrived()) :
+      (events.rbegin()->stamp - get_arrived()) :
       0.0;
   }
   Message *get_req() const { return request; }
+  uint64_t get_seq() const { return seq; }
 
+  /// event must be a string literal, it is not copied
+  void mark_event(const char *event);
   void mark_event(const string &event);
   virtual const char *state_string() const {
-    return events.rbegin()->second.c_str();
+    Spinlock::Locker l(lock);
+    return events.rbegin()->str();
   }
   void dump(utime_t now, Formatter *f) const;
 };
@@ -35,7 +35,8 @@ ThreadPool::ThreadPool(CephContext *cct_, string nm, int n, const char *option)
     _draining(0),
     _num_threads(n),
     last_work_queue(0),
-    processing(0)
+    processing(0),
+    _prefetch(0)
 {
   if (option) {
     _thread_num_option = option;
@@ -149,6 +150,165 @@ void ThreadPool::worker(WorkThread *wt)
   _lock.Unlock();
 }
 
+/*
+ * Items a worker has dequeued count as processing until they are
+ * finished, so pause() and drain() also wait for the prefetched ones.
+ * A paused or stopping worker therefore still works through its own
+ * deque, and may steal from others, but dequeues nothing new.
+ */
+void ThreadPool::stealing_worker(WorkThread *wt)
+{
+  _lock.Lock();
+  ldout(cct,10) << "worker start (work stealing, prefetch " << _prefetch
+		<< ")" << dendl;
+
+  std::stringstream ss;
+  ss << name << " thread " << (void*)pthread_self();
+  heartbeat_handle_d *hb = cct->get_heartbeat_map()->add_worker(ss.str());
+
+  bool retiring = false;
+  while (true) {
+    finish_processed(wt);
+
+    // manage dynamic thread pool
+    join_old_threads();
+    if (!retiring && !_stop && _threads.size() > _num_threads) {
+      ldout(cct,1) << " worker shutting down; too many threads (" << _threads.size() << " > " << _num_threads << ")" << dendl;
+      // nobody can steal from us once we are out of _threads
+      _threads.erase(wt);
+      _old_threads.push_back(wt);
+      retiring = true;
+    }
+
+    WorkItem item;
+    bool got = pop_prefetched(wt, &item);
+    if (!got && !_stop && !retiring) {
+      if (!_pause)
+	got = prefetch(wt, &item);
+      if (!got)
+	got = steal(wt, &item);
+    }
+    if (!got) {
+      if (_stop || retiring)
+	break;
+      ldout(cct,20) << "worker waiting" << dendl;
+      cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
+      _cond.WaitInterval(cct, _lock, utime_t(2, 0));
+      continue;
+    }
+
+    _lock.Unlock();
+    do {
+      ldout(cct,12) << "worker wq " << item.first->name << " start processing "
+		    << item.second << dendl;
+      TPHandle tp_handle(cct, hb, item.first->timeout_interval,
+			 item.first->suicide_interval);
+      tp_handle.reset_tp_timeout();
+      item.first->_void_process(item.second, tp_handle);
+      wt->processed.push_back(item);
+      // finish now if nobody holds the lock, or after the next batch
+      if (_lock.TryLock()) {
+	finish_processed(wt);
+	_lock.Unlock();
+      }
+    } while (pop_prefetched(wt, &item));
+    _lock.Lock();
+  }
+  assert(wt->processed.empty());
+  ldout(cct,1) << "worker finish" << dendl;
+
+  cct->get_heartbeat_map()->remove_worker(hb);
+
+  _lock.Unlock();
+}
+
+bool ThreadPool::pop_prefetched(WorkThread *wt, WorkItem *item)
+{
+  Spinlock::Locker l(wt->prefetch_lock);
+  if (wt->prefetched.empty())
+    return false;
+  *item = wt->prefetched.front();
+  wt->prefetched.pop_front();
+  return true;
+}
+
+bool ThreadPool::prefetch(WorkThread *wt, WorkItem *item)
+{
+  assert(_lock.is_locked());
+  int tries = work_queues.size();
+  while (tries-- > 0) {
+    last_work_queue++;
+    last_work_queue %= work_queues.size();
+    WorkQueue_ *wq = work_queues[last_work_queue];
+
+    void *p = wq->_void_dequeue();
+    if (!p)
+      continue;
+    processing++;
+    *item = WorkItem(wq, p);
+    if (!wq->prefetchable)
+      return true;
+
+    deque<WorkItem> more;
+    while (more.size() + 1 < _prefetch) {
+      p = wq->_void_dequeue();
+      if (!p)
+	break;
+      processing++;
+      more.push_back(WorkItem(wq, p));
+    }
+    if (!more.empty()) {
+      ldout(cct,15) << "worker wq " << wq->name << " prefetched "
+		    << more.size() << " (" << processing << " active)" << dendl;
+      {
+	Spinlock::Locker l(wt->prefetch_lock);
+	wt->prefetched.insert(wt->prefetched.end(), more.begin(), more.end());
+      }
+      // an idle worker can take some
+      _cond.Signal();
+    }
+    return true;
+  }
+  return false;
+}
+
+bool ThreadPool::steal(WorkThread *wt, WorkItem *item)
+{
+  assert(_lock.is_locked());
+  for (set<WorkThread*>::iterator p = _threads.begin();
+       p != _threads.end();
+       ++p) {
+    if (*p == wt)
+      continue;
+    Spinlock::Locker l((*p)->prefetch_lock);
+    if (!(*p)->prefetched.empty()) {
+      *item = (*p)->prefetched.back();
+      (*p)->prefetched.pop_back();
+      ldout(cct,15) << "worker stole " << item->second << " from "
+		    << *p << dendl;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::finish_processed(WorkThread *wt)
+{
+  assert(_lock.is_locked());
+  if (wt->processed.empty())
+    return;
+  while (!wt->processed.empty()) {
+    WorkItem &i = wt->processed.front();
+    i.first->_void_process_finish(i.second);
+    processing--;
+    ldout(cct,15) << "worker wq " << i.first->name << " done processing "
+		  << i.second << " (" << processing << " active)" << dendl;
+    wt->processed.pop_front();
+  }
+  if (_pause || _draining)
+    _wait_cond.Signal();
+}
+
 void ThreadPool::start_threads()
 {
   assert(_lock.is_locked());
@@ -254,3 +414,153 @@ void ThreadPool::drain(WorkQueue_* wq)
   _lock.Unlock();
 }
 
+
+ShardedThreadPool::ShardedThreadPool(CephContext *pcct_, string nm,
+				     uint32_t pnum_threads)
+  : cct(pcct_), name(nm),
+    lockname(nm + "::lock"),
+    shardedpool_lock(lockname.c_str()),
+    num_threads(pnum_threads),
+    stop_threads(0),
+    pause_threads(0),
+    drain_threads(0),
+    num_paused(0),
+    num_drained(0),
+    wq(NULL)
+{
+}
+
+void ShardedThreadPool::shardedthreadpool_worker(uint32_t thread_index)
+{
+  assert(wq != NULL);
+  ldout(cct,10) << "worker start" << dendl;
+
+  std::stringstream ss;
+  ss << name << " thread " << (void*)pthread_self();
+  heartbeat_handle_d *hb = cct->get_heartbeat_map()->add_worker(ss.str());
+
+  while (!stop_threads.read()) {
+    if (pause_threads.read()) {
+      shardedpool_lock.Lock();
+      ++num_paused;
+      wait_cond.Signal();
+      while (pause_threads.read()) {
+	cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
+	shardedpool_cond.WaitInterval(cct, shardedpool_lock, utime_t(2, 0));
+      }
+      --num_paused;
+      shardedpool_lock.Unlock();
+    }
+    if (drain_threads.read()) {
+      shardedpool_lock.Lock();
+      if (wq->is_shard_empty(thread_index)) {
+	++num_drained;
+	wait_cond.Signal();
+	while (drain_threads.read()) {
+	  cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
+	  shardedpool_cond.WaitInterval(cct, shardedpool_lock, utime_t(2, 0));
+	}
+	--num_drained;
+      }
+      shardedpool_lock.Unlock();
+    }
+
+    cct->get_heartbeat_map()->reset_timeout(hb, wq->timeout_interval,
+					    wq->suicide_interval);
+    wq->_process(thread_index, hb);
+  }
+
+  ldout(cct,10) << "sharded worker finish" << dendl;
+
+  cct->get_heartbeat_map()->remove_worker(hb);
+}
+
+void ShardedThreadPool::start_threads()
+{
+  assert(shardedpool_lock.is_locked());
+  int32_t thread_index = 0;
+  while (threads_shardedpool.size() < num_threads) {
+    WorkThreadSharded *wt = new WorkThreadSharded(this, thread_index);
+    ldout(cct, 10) << "start_threads creating and starting " << wt << dendl;
+    threads_shardedpool.push_back(wt);
+    wt->create();
+    thread_index++;
+  }
+}
+
+void ShardedThreadPool::start()
+{
+  ldout(cct,10) << "start" << dendl;
+
+  shardedpool_lock.Lock();
+  start_threads();
+  shardedpool_lock.Unlock();
+  ldout(cct,15) << "started" << dendl;
+}
+
+void ShardedThreadPool::stop()
+{
+  ldout(cct,10) << "stop" << dendl;
+  stop_threads.set(1);
+  assert(wq != NULL);
+  wq->return_waiting_threads();
+  for (vector<WorkThreadSharded*>::iterator p = threads_shardedpool.begin();
+       p != threads_shardedpool.end();
+       ++p) {
+    (*p)->join();
+    delete *p;
+  }
+  threads_shardedpool.clear();
+  ldout(cct,15) << "stopped" << dendl;
+}
+
+void ShardedThreadPool::pause()
+{
+  ldout(cct,10) << "pause" << dendl;
+  shardedpool_lock.Lock();
+  pause_threads.set(1);
+  assert(wq != NULL);
+  wq->return_waiting_threads();
+  while (num_threads != num_paused) {
+    wait_cond.Wait(shardedpool_lock);
+  }
+  shardedpool_lock.Unlock();
+  ldout(cct,10) << "paused" << dendl;
+}
+
+void ShardedThreadPool::pause_new()
+{
+  ldout(cct,10) << "pause_new" << dendl;
+  shardedpool_lock.Lock();
+  pause_threads.set(1);
+  assert(wq != NULL);
+  wq->return_waiting_threads();
+  shardedpool_lock.Unlock();
+  ldout(cct,10) << "paused_new" << dendl;
+}
+
+void ShardedThreadPool::unpause()
+{
+  ldout(cct,10) << "unpause" << dendl;
+  shardedpool_lock.Lock();
+  pause_threads.set(0);
+  shardedpool_cond.SignalAll();
+  shardedpool_lock.Unlock();
+  ldout(cct,10) << "unpaused" << dendl;
+}
+
+void ShardedThreadPool::drain()
+{
+  ldout(cct,10) << "drain" << dendl;
+  shardedpool_lock.Lock();
+  drain_threads.set(1);
+  assert(wq != NULL);
+  wq->return_waiting_threads();
+  while (num_threads != num_drained) {
+    wait_cond.Wait(shardedpool_lock);
+  }
+  drain_threads.set(0);
+  shardedpool_cond.SignalAll();
+  shardedpool_lock.Unlock();
+  ldout(cct,10) << "drained" << dendl;
+}
@@ -20,6 +20,8 @@
 #include "Thread.h"
 #include "common/config_obs.h"
 #include "common/HeartbeatMap.h"
+#include "include/atomic.h"
+#include "include/Spinlock.h"
 
 class CephContext;
 
@@ -41,13 +43,13 @@ public:
     heartbeat_handle_d *hb;
     time_t grace;
     time_t suicide_grace;
+  public:
     TPHandle(
       CephContext *cct,
       heartbeat_handle_d *hb,
       time_t grace,
       time_t suicide_grace)
       : cct(cct), hb(hb), grace(grace), suicide_grace(suicide_grace) {}
-  public:
     void reset_tp_timeout();
     void suspend_tp_timeout();
   };
@@ -56,10 +58,23 @@ private:
   struct WorkQueue_ {
     string name;
     time_t timeout_interval, suicide_interval;
+    /// may a work stealing pool dequeue our items ahead of time?
+    bool prefetchable;
     WorkQueue_(string n, time_t ti, time_t sti)
-      : name(n), timeout_interval(ti), suicide_interval(sti)
+      : name(n), timeout_interval(ti), suicide_interval(sti),
+	prefetchable(false)
     { }
     virtual ~WorkQueue_() {}
+
+    /**
+     * let a work stealing pool dequeue several of our items at once
+     * and process them on any of its threads, in any order.  Only for
+     * queues that neither rely on the order items are dequeued in nor
+     * dequeue() items that may already have been taken.
+     */
+    void set_prefetchable() {
+      prefetchable = true;
+    }
     virtual void _clear() = 0;
     virtual bool _empty() = 0;
     virtual void *_void_dequeue() = 0;
@@ -309,28 +324,58 @@ private:
   int last_work_queue;
  
 
+  typedef pair<WorkQueue_*, void*> WorkItem;
+
   // threads
   struct WorkThread : public Thread {
     ThreadPool *pool;
+    Spinlock prefetch_lock;      ///< protects prefetched
+    deque<WorkItem> prefetched;  ///< dequeued, not yet processed
+    list<WorkItem> processed;    ///< processed, not yet finished
     WorkThread(ThreadPool *p) : pool(p) {}
     void *entry() {
-      pool->worker(this);
+      if (pool->_prefetch)
+	pool->stealing_worker(this);
+      else
+	pool->worker(this);
       return 0;
     }
   };
   
   set<WorkThread*> _threads;
   list<WorkThread*> _old_threads;  ///< need to be joined
-  int processing;
+  int processing;  ///< items dequeued and not yet finished
+  unsigned _prefetch;  ///< items dequeued at once; 0 unless work stealing
 
   void start_threads();
   void join_old_threads();
   void worker(WorkThread *wt);
 
+  void stealing_worker(WorkThread *wt);
+  bool pop_prefetched(WorkThread *wt, WorkItem *item);
+  bool prefetch(WorkThread *wt, WorkItem *item);
+  bool steal(WorkThread *wt, WorkItem *item);
+  void finish_processed(WorkThread *wt);
+
 public:
   ThreadPool(CephContext *cct_, string nm, int n, const char *option = NULL);
   ~ThreadPool();
 
+  /**
+   * switch to work stealing; call before start()
+   *
+   * Each worker dequeues up to n items at once from a prefetchable
+   * queue into a deque of its own, and works through them without
+   * taking the pool lock, which it only tries for to finish them.  A
+   * worker that finds nothing queued steals from the other end of
+   * another worker's deque.  Queues that are not prefetchable are
+   * still served one item at a time.
+   */
+  void set_work_stealing(unsigned n) {
+    assert(_threads.empty());
+    _prefetch = n;
+  }
+
   /// return number of threads currently running
   int get_num_threads() {
     Mutex::Locker l(_lock);
@@ -429,4 +474,109 @@ public:
   }
 };
 
+/**
+ * ShardedThreadPool
+ *
+ * A thread pool driving a single sharded work queue.  Worker thread i
+ * always services shard (i % num_shards) of the queue, and each shard
+ * carries its own lock(s), so enqueue and dequeue on different shards
+ * never contend.  The queue implementation is responsible for blocking
+ * a worker in _process() while its shard is empty.
+ */
+class ShardedThreadPool {
+  CephContext *cct;
+  string name;
+  string lockname;
+  Mutex shardedpool_lock;
+  Cond shardedpool_cond;
+  Cond wait_cond;
+  uint32_t num_threads;
+  atomic_t stop_threads;
+  atomic_t pause_threads;
+  atomic_t drain_threads;
+  uint32_t num_paused;
+  uint32_t num_drained;
+
+public:
+  class BaseShardedWQ {
+  public:
+    time_t timeout_interval, suicide_interval;
+    BaseShardedWQ(time_t ti, time_t sti)
+      : timeout_interval(ti), suicide_interval(sti) {}
+    virtual ~BaseShardedWQ() {}
+
+    /// process (at most) one item from the shard owned by thread_index
+    virtual void _process(uint32_t thread_index, heartbeat_handle_d *hb) = 0;
+    /// kick any workers blocked waiting on an empty shard
+    virtual void return_waiting_threads() = 0;
+    virtual bool is_shard_empty(uint32_t thread_index) = 0;
+  };
+
+  template <typename T>
+  class ShardedWQ: public BaseShardedWQ {
+    ShardedThreadPool *sharded_pool;
+
+  protected:
+    virtual void _enqueue(T) = 0;
+    virtual void _enqueue_front(T) = 0;
+
+  public:
+    ShardedWQ(time_t ti, time_t sti, ShardedThreadPool *tp)
+      : BaseShardedWQ(ti, sti), sharded_pool(tp) {
+      tp->set_wq(this);
+    }
+    virtual ~ShardedWQ() {}
+
+    void queue(T item) {
+      _enqueue(item);
+    }
+    void queue_front(T item) {
+      _enqueue_front(item);
+    }
+    void drain() {
+      sharded_pool->drain();
+    }
+  };
+
+private:
+  BaseShardedWQ *wq;
+
+  // threads
+  struct WorkThreadSharded : public Thread {
+    ShardedThreadPool *pool;
+    uint32_t thread_index;
+    WorkThreadSharded(ShardedThreadPool *p, uint32_t pthread_index)
+      : pool(p), thread_index(pthread_index) {}
+    void *entry() {
+      pool->shardedthreadpool_worker(thread_index);
+      return 0;
+    }
+  };
+
+  vector<WorkThreadSharded*> threads_shardedpool;
+  void start_threads();
+  void shardedthreadpool_worker(uint32_t thread_index);
+  void set_wq(BaseShardedWQ *swq) {
+    wq = swq;
+  }
+
+public:
+  ShardedThreadPool(CephContext *cct_, string nm, uint32_t pnum_threads);
+  ~ShardedThreadPool() {}
+
+  /// start thread pool thread
+  void start();
+  /// stop thread pool thread
+  void stop();
+  /// pause thread pool (if it not already paused)
+  void pause();
+  /// pause initiation of new work
+  void pause_new();
+  /// resume work in thread pool.  must match each pause() call 1:1 to resume.
+  void unpause();
+  /// wait for all work to complete
+  void drain();
+};
+
+
 #endif
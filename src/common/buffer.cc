@@ -23,12 +23,15 @@
 #include "include/types.h"
 #include "include/compat.h"
 #include "include/Spinlock.h"
+#include "common/ObjectPool.h"
+#include "common/mempool.h"
 
 #include <errno.h>
 #include <fstream>
 #include <sstream>
 #include <sys/uio.h>
 #include <limits.h>
+#include <new>
 
 namespace ceph {
 
@@ -126,11 +129,20 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
     Spinlock crc_lock;
     map<pair<size_t, size_t>, pair<uint32_t, uint32_t> > crc_map;
 
-    raw(unsigned l) : data(NULL), len(l), nref(0)
-    { }
-    raw(char *c, unsigned l) : data(c), len(l), nref(0)
-    { }
-    virtual ~raw() {};
+    int mempool;  ///< the mempool::pool_index_t our bytes are charged to
+
+    raw(unsigned l)
+      : data(NULL), len(l), nref(0), mempool(mempool::mempool_buffer_anon) {
+      mempool::get_pool(mempool::mempool_buffer_anon).adjust_count(1, len);
+    }
+    raw(char *c, unsigned l)
+      : data(c), len(l), nref(0), mempool(mempool::mempool_buffer_anon) {
+      mempool::get_pool(mempool::mempool_buffer_anon).adjust_count(1, len);
+    }
+    virtual ~raw() {
+      mempool::get_pool((mempool::pool_index_t)mempool).adjust_count(
+	-1, -(int64_t)len);
+    }
 
     // no copying.
     raw(const raw &other);
@@ -157,6 +169,20 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
     bool is_n_page_sized() {
       return (len & ~CEPH_PAGE_MASK) == 0;
     }
+    void reassign_to_mempool(int pool) {
+      int old = __sync_lock_test_and_set(&mempool, pool);
+      if (old == pool)
+	return;
+      mempool::get_pool((mempool::pool_index_t)old).adjust_count(
+	-1, -(int64_t)len);
+      mempool::get_pool((mempool::pool_index_t)pool).adjust_count(1, len);
+    }
+    /// change len, keeping the mempool in step
+    void set_len(unsigned l) {
+      mempool::get_pool((mempool::pool_index_t)mempool).adjust_count(
+	0, (int64_t)l - (int64_t)len);
+      len = l;
+    }
     bool get_crc(const pair<size_t, size_t> &fromto,
 		 pair<uint32_t, uint32_t> *crc) const {
       Spinlock::Locker l(crc_lock);
@@ -343,7 +369,7 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
 	return r;
       }
       // update length with actual amount read
-      len = r;
+      set_len(r);
       return 0;
     }
 
@@ -487,6 +513,49 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
     }
   };
 
+  /*
+   * a raw whose data and header share one page aligned page, from a
+   * per thread pool.  lists built from many small appends (encoding)
+   * put them in one of these instead of a freshly allocated page plus
+   * a separate raw.  the header sits at the end of the page.
+   */
+  class buffer::raw_combined : public buffer::raw {
+    static ObjectPool& pool() {
+      static ObjectPool p("buffer::raw_combined", CEPH_PAGE_SIZE, CEPH_PAGE_SIZE);
+      return p;
+    }
+    static unsigned header_size() {
+      return (sizeof(raw_combined) + 15) & ~15;
+    }
+
+    raw_combined(char *page)
+      : raw(page, data_size()) {
+      inc_total_alloc(len);
+      bdout << "raw_combined " << this << " alloc " << (void *)data << " " << len << " " << buffer::get_total_alloc() << bendl;
+    }
+  public:
+    ~raw_combined() {
+      dec_total_alloc(len);
+      bdout << "raw_combined " << this << " free " << (void *)data << " " << buffer::get_total_alloc() << bendl;
+    }
+
+    /// the data that fits in a page
+    static unsigned data_size() {
+      return CEPH_PAGE_SIZE - header_size();
+    }
+    static raw* create() {
+      char *page = (char *)pool().alloc(CEPH_PAGE_SIZE);
+      return new (page + data_size()) raw_combined(page);
+    }
+    static void operator delete(void *p) {
+      pool().free((char *)p - data_size(), CEPH_PAGE_SIZE);
+    }
+
+    raw* clone_empty() {
+      return new raw_char(len);
+    }
+  };
+
   class buffer::raw_static : public buffer::raw {
   public:
     raw_static(const char *d, unsigned l) : raw((char*)d, l) { }
@@ -738,6 +807,12 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
     return _raw->zero_copy_to_fd(fd, offset);
   }
 
+  void buffer::ptr::reassign_to_mempool(int pool)
+  {
+    if (_raw)
+      _raw->reassign_to_mempool(pool);
+  }
+
   // -- buffer::list::iterator --
   /*
   buffer::list::iterator operator=(const buffer::list::iterator& other)
@@ -826,6 +901,13 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
   void buffer::list::iterator::copy(unsigned len, char *dest)
   {
     if (p == ls->end()) seek(off);
+    if (p != ls->end() && p_off + len < p->length()) {
+      // fast path: it is all in the current buffer (decode_raw)
+      p->copy_out(p_off, len, dest);
+      p_off += len;
+      off += len;
+      return;
+    }
     while (len > 0) {
       if (p == ls->end())
 	throw end_of_buffer();
@@ -1009,6 +1091,15 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
     return true;
   }
 
+  void buffer::list::reassign_to_mempool(int pool)
+  {
+    for (std::list<ptr>::iterator it = _buffers.begin();
+	 it != _buffers.end();
+	 ++it)
+      it->reassign_to_mempool(pool);
+    append_buffer.reassign_to_mempool(pool);
+  }
+
   bool buffer::list::is_page_aligned() const
   {
     for (std::list<ptr>::const_iterator it = _buffers.begin();
@@ -1205,20 +1296,25 @@ void buffer::list::rebuild_page_aligned()
 
   void buffer::list::append(char c)
   {
-    // put what we can into the existing append_buffer.
-    unsigned gap = append_buffer.unused_tail_length();
-    if (!gap) {
-      // make a new append_buffer!
-      unsigned alen = CEPH_PAGE_SIZE;
-      append_buffer = create_page_aligned(alen);
-      append_buffer.set_length(0);   // unused, so far.
-    }
-    append_buffer.append(c);
-    append(append_buffer, append_buffer.end() - 1, 1);	// add segment to the list
+    append(&c, 1);
   }
   
   void buffer::list::append(const char *data, unsigned len)
   {
+    // fast path: it fits in the append_buffer, right after our last
+    // segment, which simply grows.  this is every encode() of a small
+    // field but the first.
+    if (!_buffers.empty() && len <= append_buffer.unused_tail_length()) {
+      ptr &l = _buffers.back();
+      if (l.get_raw() == append_buffer.get_raw() &&
+	  l.end() == append_buffer.end()) {
+	append_buffer.append(data, len);
+	l.set_length(l.length() + len);
+	_len += len;
+	return;
+      }
+    }
+
     while (len > 0) {
       // put what we can into the existing append_buffer.
       unsigned gap = append_buffer.unused_tail_length();
@@ -1233,9 +1329,14 @@ void buffer::list::rebuild_page_aligned()
       if (len == 0)
 	break;  // done!
       
-      // make a new append_buffer!
-      unsigned alen = CEPH_PAGE_SIZE * (((len-1) / CEPH_PAGE_SIZE) + 1);
-      append_buffer = create_page_aligned(alen);
+      // make a new append_buffer!  small ones share their page with
+      // the raw header.
+      if (len < raw_combined::data_size()) {
+	append_buffer = raw_combined::create();
+      } else {
+	unsigned alen = CEPH_PAGE_SIZE * (((len-1) / CEPH_PAGE_SIZE) + 1);
+	append_buffer = create_page_aligned(alen);
+      }
       append_buffer.set_length(0);   // unused, so far.
     }
   }
@@ -1646,6 +1747,18 @@ int buffer::list::write_fd_zero_copy(int fd) const
   return 0;
 }
 
+/*
+ * Long ranges are checksummed in CRC_CHUNK sized pieces aligned to the
+ * start of the raw buffer, and the crc of every full piece is cached
+ * along with that of the whole range.  A ptr covering a different
+ * range of the same raw later on (e.g., the data of a transaction
+ * decoded out of a received message, or the payload re-encoded into a
+ * journal entry or a replication sub-op) then only has to checksum its
+ * unaligned head and tail; the pieces in between are stitched in from
+ * the cache in O(log n) each.
+ */
+static const size_t CRC_CHUNK = 64 << 10;
+
 __u32 buffer::list::crc32c(__u32 crc) const
 {
   for (std::list<ptr>::const_iterator it = _buffers.begin();
@@ -1674,6 +1787,27 @@ __u32 buffer::list::crc32c(__u32 crc) const
 	  if (buffer_track_crc)
 	    buffer_cached_crc_adjusted.inc();
 	}
+      } else if (it->length() >= 2 * CRC_CHUNK) {
+	uint32_t base = crc;
+	const char *p = it->c_str();
+	size_t pos = ofs.first;
+	while (pos < ofs.second) {
+	  size_t end = std::min(ofs.second, (pos / CRC_CHUNK + 1) * CRC_CHUNK);
+	  pair<size_t, size_t> chunk(pos, end);
+	  bool full = end - pos == CRC_CHUNK;
+	  if (full && r->get_crc(chunk, &ccrc)) {
+	    crc = ccrc.second ^ ceph_crc32c(ccrc.first ^ crc, NULL, end - pos);
+	    if (buffer_track_crc)
+	      buffer_cached_crc_adjusted.inc();
+	  } else {
+	    uint32_t chunk_base = crc;
+	    crc = ceph_crc32c(crc, (unsigned char*)p + (pos - ofs.first), end - pos);
+	    if (full)
+	      r->set_crc(chunk, make_pair(chunk_base, crc));
+	  }
+	  pos = end;
+	}
+	r->set_crc(ofs, make_pair(base, crc));
       } else {
 	uint32_t base = crc;
 	crc = ceph_crc32c(crc, (unsigned char*)it->c_str(), it->length());
@@ -16,6 +16,7 @@
 
 #include "common/admin_socket.h"
 #include "common/perf_counters.h"
+#include "common/perf_counters_stream.h"
 #include "common/Thread.h"
 #include "common/ceph_context.h"
 #include "common/config.h"
@@ -23,6 +24,7 @@
 #include "common/HeartbeatMap.h"
 #include "common/errno.h"
 #include "common/lockdep.h"
+#include "common/mempool.h"
 #include "common/Formatter.h"
 #include "log/Log.h"
 #include "auth/Crypto.h"
@@ -234,6 +236,9 @@ void CephContext::do_command(std::string command, cmdmap_t& cmdmap,
     else if (command == "log reopen") {
       _log->reopen_log_file();
     }
+    else if (command == "dump_mempools") {
+      mempool::dump(f);
+    }
     else {
       assert(0 == "registered under wrong command?");    
     }
@@ -255,6 +260,7 @@ CephContext::CephContext(uint32_t module_type_)
     _log_obs(NULL),
     _admin_socket(NULL),
     _perf_counters_collection(NULL),
+    _perf_stream(NULL),
     _perf_counters_conf_obs(NULL),
     _heartbeat_map(NULL),
     _crypto_none(NULL),
@@ -285,6 +291,7 @@ CephContext::CephContext(uint32_t module_type_)
   _admin_socket->register_command("log flush", "log flush", _admin_hook, "flush log entries to log file");
   _admin_socket->register_command("log dump", "log dump", _admin_hook, "dump recent log entries to log file");
   _admin_socket->register_command("log reopen", "log reopen", _admin_hook, "reopen log file");
+  _admin_socket->register_command("dump_mempools", "dump_mempools", _admin_hook, "dump bytes and items allocated by each mempool");
 
   _crypto_none = new CryptoNone;
   _crypto_aes = new CryptoAES;
@@ -294,6 +301,9 @@ CephContext::~CephContext()
 {
   join_service_thread();
 
+  delete _perf_stream;
+  _perf_stream = NULL;
+
   if (_conf->lockdep) {
     lockdep_unregister_ceph_context(this);
   }
@@ -310,6 +320,7 @@ CephContext::~CephContext()
   _admin_socket->unregister_command("log flush");
   _admin_socket->unregister_command("log dump");
   _admin_socket->unregister_command("log reopen");
+  _admin_socket->unregister_command("dump_mempools");
   delete _admin_hook;
   delete _admin_socket;
 
@@ -359,6 +370,15 @@ void CephContext::start_service_thread()
   // start admin socket
   if (_conf->admin_socket.length())
     _admin_socket->init(_conf->admin_socket);
+
+  if (_conf->perf_stream_path.length()) {
+    _perf_stream = new PerfCountersStream(this, _conf->perf_stream_backlog,
+					  _conf->perf_stream_interval);
+    if (!_perf_stream->init(_conf->perf_stream_path)) {
+      delete _perf_stream;
+      _perf_stream = NULL;
+    }
+  }
 }
 
 void CephContext::reopen_logs()
@@ -25,6 +25,7 @@
 class AdminSocket;
 class CephContextServiceThread;
 class PerfCountersCollection;
+class PerfCountersStream;
 class md_config_obs_t;
 struct md_config_t;
 class CephContextHook;
@@ -131,6 +132,9 @@ private:
   /* The collection of profiling loggers associated with this context */
   PerfCountersCollection *_perf_counters_collection;
 
+  /* Streams their samples to a collector, if perf_stream_path is set */
+  PerfCountersStream *_perf_stream;
+
   md_config_obs_t *_perf_counters_conf_obs;
 
   CephContextHook *_admin_hook;
@@ -80,6 +80,8 @@ SUBSYS(optracker, 0, 5)
 SUBSYS(objclass, 0, 5)
 SUBSYS(filestore, 1, 3)
 SUBSYS(journal, 1, 3)
+SUBSYS(blockstore, 1, 3)
+SUBSYS(keyvaluestore, 1, 3)
 SUBSYS(ms, 0, 5)
 SUBSYS(mon, 1, 5)
 SUBSYS(monc, 0, 10)
@@ -102,9 +104,17 @@ OPTION(heartbeat_interval, OPT_INT, 5)
 OPTION(heartbeat_file, OPT_STR, "")
 OPTION(heartbeat_inject_failure, OPT_INT, 0)    // force an unhealthy heartbeat for N seconds
 OPTION(perf, OPT_BOOL, true)       // enable internal perf counters
+OPTION(perf_stream_path, OPT_STR, "")  // unix socket to stream perf counter samples to collectors on
+OPTION(perf_stream_interval, OPT_DOUBLE, 1.0)  // seconds between samples
+OPTION(perf_stream_backlog, OPT_U64, 4 << 20)  // bytes of samples queued for a slow collector before dropping
 
+OPTION(ms_type, OPT_STR, "simple")   // messenger backend: simple, or async (linux only)
 OPTION(ms_tcp_nodelay, OPT_BOOL, true)
 OPTION(ms_tcp_rcvbuf, OPT_INT, 0)
+OPTION(ms_tcp_prefetch_max_size, OPT_INT, 4096) // reads shorter than this go through a read-ahead buffer
+OPTION(ms_max_send_batch_bytes, OPT_U64, 64 << 10) // stop adding queued messages to a writer batch past this many bytes
+OPTION(ms_max_send_batch_iov, OPT_U64, 256) // ... or past this many buffers
+OPTION(ms_compress_min_size, OPT_U64, 4096) // smallest data payload worth compressing, for policies with compress set
 OPTION(ms_initial_backoff, OPT_DOUBLE, .2)
 OPTION(ms_max_backoff, OPT_DOUBLE, 15.0)
 OPTION(ms_nocrc, OPT_BOOL, false)
@@ -124,6 +134,11 @@ OPTION(ms_inject_delay_type, OPT_STR, "")          // "osd mds mon client" allow
 OPTION(ms_inject_delay_max, OPT_DOUBLE, 1)         // seconds
 OPTION(ms_inject_delay_probability, OPT_DOUBLE, 0) // range [0, 1]
 OPTION(ms_inject_internal_delays, OPT_DOUBLE, 0)   // seconds
+OPTION(ms_async_op_threads, OPT_INT, 2)            // event loop threads for the async messenger
+OPTION(ms_cluster_rdma, OPT_BOOL, false)           // osds talk to each other over rdma (rsockets) on the cluster network
+OPTION(ms_rdma_buffer_size, OPT_INT, 0)            // registered ring per connection and direction; 0 for the rsockets default
+OPTION(ms_rdma_queue_size, OPT_INT, 0)             // send and receive queue depth; 0 for the rsockets default
+OPTION(ms_rdma_inline_size, OPT_INT, 0)            // sends up to this size go inline in the work request; 0 for the default
 
 OPTION(inject_early_sigterm, OPT_BOOL, false)
 
@@ -149,6 +164,7 @@ OPTION(mon_osd_min_up_ratio, OPT_DOUBLE, .3)    // min osds required to be up to
 OPTION(mon_osd_min_in_ratio, OPT_DOUBLE, .3)   // min osds required to be in to mark things out
 OPTION(mon_osd_max_op_age, OPT_DOUBLE, 32)     // max op age before we get concerned (make it a power of 2)
 OPTION(mon_stat_smooth_intervals, OPT_INT, 2)  // smooth stats over last N PGMap maps
+OPTION(mon_pg_stats_propose_interval, OPT_DOUBLE, 5.0) // propose pgmaps that only carry osd/pg stat reports at most this often
 OPTION(mon_lease, OPT_FLOAT, 5)       // lease interval
 OPTION(mon_lease_renew_interval, OPT_FLOAT, 3) // on leader, to renew the lease
 OPTION(mon_lease_ack_timeout, OPT_FLOAT, 10.0) // on leader, if lease isn't acked by all peons
@@ -168,6 +184,7 @@ OPTION(mon_globalid_prealloc, OPT_INT, 100)   // how many globalids to prealloc
 OPTION(mon_osd_report_timeout, OPT_INT, 900)    // grace period before declaring unresponsive OSDs dead
 OPTION(mon_force_standby_active, OPT_BOOL, true) // should mons force standby-replay mds to be active
 OPTION(mon_min_osdmap_epochs, OPT_INT, 500)
+OPTION(mon_osdmap_precompute_pg_mappings, OPT_BOOL, true)  // keep a crush mapping of every pg with the mon's osdmap
 OPTION(mon_max_pgmap_epochs, OPT_INT, 500)
 OPTION(mon_max_log_epochs, OPT_INT, 500)
 OPTION(mon_max_osd, OPT_INT, 10000)
@@ -183,6 +200,9 @@ OPTION(mon_data_avail_warn, OPT_INT, 30)
 OPTION(mon_config_key_max_entry_size, OPT_INT, 4096) // max num bytes per config-key entry
 OPTION(mon_sync_timeout, OPT_DOUBLE, 60.0)
 OPTION(mon_sync_max_payload_size, OPT_U32, 1048576) // max size for a sync chunk payload (say, 1MB)
+OPTION(mon_sync_chunks_inflight, OPT_INT, 4) // sync chunks a requester keeps requested ahead of the one it is applying
+OPTION(mon_sync_compress, OPT_BOOL, true) // have the sync provider snappy-compress the chunks it sends us
+OPTION(mon_sync_apply_batch_bytes, OPT_U64, 32 << 20) // gather this much of a full sync before applying it to the store
 OPTION(mon_sync_debug, OPT_BOOL, false) // enable sync-specific debug
 OPTION(mon_sync_debug_leader, OPT_INT, -1) // monitor to be used as the sync leader
 OPTION(mon_sync_debug_provider, OPT_INT, -1) // monitor to be used as the sync provider
@@ -206,11 +226,15 @@ OPTION(mon_leveldb_max_open_files, OPT_INT, 0) // monitor's leveldb max open fil
 OPTION(mon_leveldb_compression, OPT_BOOL, false) // monitor's leveldb uses compression
 OPTION(mon_leveldb_paranoid, OPT_BOOL, false)   // monitor's leveldb paranoid flag
 OPTION(mon_leveldb_log, OPT_STR, "/dev/null")
+OPTION(mon_keyvaluedb, OPT_STR, "leveldb")   // backend of new monitor stores: leveldb or rocksdb
+OPTION(mon_rocksdb_column_families, OPT_STR, "paxos:paxos")  // name:prefix-pattern pairs, fixed at creation
+OPTION(mon_rocksdb_column_family_options, OPT_STR, "")  // name:rocksdb-options pairs
 OPTION(mon_leveldb_size_warn, OPT_U64, 40*1024*1024*1024) // issue a warning when the monitor's leveldb goes over 40GB (in bytes)
 OPTION(paxos_stash_full_interval, OPT_INT, 25)   // how often (in commits) to stash a full copy of the PaxosService state
 OPTION(paxos_max_join_drift, OPT_INT, 10) // max paxos iterations before we must first sync the monitor stores
 OPTION(paxos_propose_interval, OPT_DOUBLE, 1.0)  // gather updates for this long before proposing a map update
 OPTION(paxos_min_wait, OPT_DOUBLE, 0.05)  // min time to gather updates for after period of inactivity
+OPTION(paxos_batch_proposals, OPT_BOOL, true)  // merge proposals queued behind an in-flight round into one round
 OPTION(paxos_min, OPT_INT, 500)       // minimum number of paxos states to keep around
 OPTION(paxos_trim_min, OPT_INT, 250)  // number of extra proposals tolerated before trimming
 OPTION(paxos_trim_max, OPT_INT, 500) // max number of extra proposals to trim at a time
@@ -231,11 +255,15 @@ OPTION(auth_service_ticket_ttl, OPT_DOUBLE, 60*60)
 OPTION(auth_debug, OPT_BOOL, false)          // if true, assert when weird things happen
 OPTION(mon_client_hunt_interval, OPT_DOUBLE, 3.0)   // try new mon every N seconds until we connect
 OPTION(mon_client_ping_interval, OPT_DOUBLE, 10.0)  // ping every N seconds
+OPTION(mon_client_hunt_parallel, OPT_INT, 2)   // how many mons to try at once while hunting
+OPTION(mon_client_backup_con, OPT_BOOL, false)  // keep a connection to a second mon to hunt from
 OPTION(mon_client_max_log_entries_per_message, OPT_INT, 1000)
 OPTION(mon_max_pool_pg_num, OPT_INT, 65536)
 OPTION(mon_pool_quota_warn_threshold, OPT_INT, 0) // percent of quota at which to issue warnings
 OPTION(mon_pool_quota_crit_threshold, OPT_INT, 0) // percent of quota at which to issue errors
 OPTION(client_cache_size, OPT_INT, 16384)
+OPTION(client_cache_size_bytes, OPT_U64, 128 << 20) // also trim the cache down to about this many bytes (0 = no limit)
+OPTION(client_negative_dentries, OPT_BOOL, true) // cache ENOENT lookups while the dir's Fs (or a dn lease) vouches for them
 OPTION(client_cache_mid, OPT_FLOAT, .75)
 OPTION(client_use_random_mds, OPT_BOOL, false)
 OPTION(client_mount_timeout, OPT_DOUBLE, 300.0)
@@ -244,17 +272,23 @@ OPTION(client_trace, OPT_STR, "")
 OPTION(client_readahead_min, OPT_LONGLONG, 128*1024)  // readahead at _least_ this much.
 OPTION(client_readahead_max_bytes, OPT_LONGLONG, 0)  //8 * 1024*1024
 OPTION(client_readahead_max_periods, OPT_LONGLONG, 4)  // as multiple of file layout period (object size * num stripes)
+OPTION(client_readahead_streams, OPT_INT, 4)  // sequential streams followed per open file
+OPTION(client_read_periods_inflight, OPT_INT, 8) // uncached reads: layout periods (object sets) read in parallel; 0 = all at once
 OPTION(client_snapdir, OPT_STR, ".snap")
+OPTION(client_readdirplus, OPT_BOOL, true)  // ask the mds to make readdir entries' stat readable
 OPTION(client_mountpoint, OPT_STR, "/")
 OPTION(client_notify_timeout, OPT_INT, 10) // in seconds
 OPTION(osd_client_watch_timeout, OPT_INT, 30) // in seconds
 OPTION(client_caps_release_delay, OPT_INT, 5) // in seconds
+OPTION(client_cap_batch_window, OPT_FLOAT, .002) // hold dirty metadata flushes to an mds this long to send them together (0 = off)
+OPTION(client_cap_batch_max, OPT_INT, 128)        // send a session's held flushes once there are this many
 OPTION(client_oc, OPT_BOOL, true)
 OPTION(client_oc_size, OPT_INT, 1024*1024* 200)    // MB * n
 OPTION(client_oc_max_dirty, OPT_INT, 1024*1024* 100)    // MB * n  (dirty OR tx.. bigish)
 OPTION(client_oc_target_dirty, OPT_INT, 1024*1024* 8) // target dirty (keep this smallish)
 OPTION(client_oc_max_dirty_age, OPT_DOUBLE, 5.0)      // max age in cache before writeback
 OPTION(client_oc_max_objects, OPT_INT, 1000)      // max objects in cache
+OPTION(client_direct_io_min, OPT_U64, 4 << 20) // aligned ios this big bypass the cache (0 = only O_DIRECT)
 OPTION(client_debug_force_sync_read, OPT_BOOL, false)     // always read synchronously (go to osds)
 OPTION(client_debug_inject_tick_delay, OPT_INT, 0) // delay the client tick for a number of seconds
 // note: the max amount of "in flight" dirty data is roughly (max - target)
@@ -264,20 +298,30 @@ OPTION(fuse_default_permissions, OPT_BOOL, true)
 OPTION(fuse_big_writes, OPT_BOOL, true)
 OPTION(fuse_atomic_o_trunc, OPT_BOOL, true)
 OPTION(fuse_debug, OPT_BOOL, false)
+OPTION(fuse_multithreaded, OPT_BOOL, true) // serve fuse requests from several threads
 OPTION(objecter_tick_interval, OPT_DOUBLE, 5.0)
 OPTION(objecter_timeout, OPT_DOUBLE, 10.0)    // before we ask for a map
 OPTION(objecter_inflight_op_bytes, OPT_U64, 1024*1024*100) // max in-flight data (both directions)
 OPTION(objecter_inflight_ops, OPT_U64, 1024)               // max in-flight ios
+OPTION(objecter_qos_deltas, OPT_BOOL, false)  // report dmclock deltas to osds running the mclock op queue
+OPTION(objecter_completion_threads, OPT_INT, 0)  // librados: threads to run op callbacks on; 0 runs them on the dispatch thread
+OPTION(librados_finisher_threads, OPT_INT, 1)  // threads running aio and watch callbacks; callbacks of an IoCtx stay ordered
+OPTION(filer_max_purge_ops, OPT_INT, 10)  // object removes in flight while purging files
+OPTION(filer_max_purge_ops_per_sec, OPT_DOUBLE, 0)  // object removes sent per second while purging files (mds only); 0 for no limit
+OPTION(filer_max_probe_periods, OPT_INT, 8)  // most stripe periods stat'ed at once when probing a file's size
 OPTION(journaler_allow_split_entries, OPT_BOOL, true)
 OPTION(journaler_write_head_interval, OPT_INT, 15)
 OPTION(journaler_prefetch_periods, OPT_INT, 10)   // * journal object size
+OPTION(journaler_prefetch_chunk, OPT_U64, 1<<20)  // split prefetch into reads of at most this size (rounded to a stripe unit); 0 for a period each
+OPTION(journaler_prefetch_max_bytes, OPT_U64, 0)  // cap on prefetched journal held (buffered + in flight); 0 for just the periods
 OPTION(journaler_prezero_periods, OPT_INT, 5)     // * journal object size
 OPTION(journaler_batch_interval, OPT_DOUBLE, .001)   // seconds.. max add'l latency we artificially incur
-OPTION(journaler_batch_max, OPT_U64, 0)  // max bytes we'll delay flushing; disable, for now....
+OPTION(journaler_batch_max, OPT_U64, 1<<20)  // max bytes we'll delay flushing behind an in-flight write; 0 to disable
 OPTION(mds_data, OPT_STR, "/var/lib/ceph/mds/$cluster-$id")
 OPTION(mds_max_file_size, OPT_U64, 1ULL << 40)
 OPTION(mds_cache_size, OPT_INT, 100000)
 OPTION(mds_cache_mid, OPT_FLOAT, .7)
+OPTION(mds_cache_memory_limit, OPT_U64, 0)  // bytes the cached inodes, dentries, dirfrags and caps may take up, roughly; 0 for no limit
 OPTION(mds_mem_max, OPT_INT, 1048576)        // KB
 OPTION(mds_dir_commit_ratio, OPT_FLOAT, .5)
 OPTION(mds_dir_max_commit_size, OPT_INT, 90) // MB
@@ -288,14 +332,21 @@ OPTION(mds_enforce_unique_name, OPT_BOOL, true)
 OPTION(mds_blacklist_interval, OPT_FLOAT, 24.0*60.0)  // how long to blacklist failed nodes
 OPTION(mds_session_timeout, OPT_FLOAT, 60)    // cap bits and leases time out if client idle
 OPTION(mds_session_autoclose, OPT_FLOAT, 300) // autoclose idle session
+OPTION(mds_recall_state_timeout, OPT_FLOAT, 60)  // a recall not met within this is counted as ignored
 OPTION(mds_reconnect_timeout, OPT_FLOAT, 45)  // seconds to wait for clients during mds restart
 	      //  make it (mds_session_timeout - mds_beacon_grace)
 OPTION(mds_tick_interval, OPT_FLOAT, 5)
 OPTION(mds_dirstat_min_interval, OPT_FLOAT, 1)    // try to avoid propagating more often than this
+OPTION(mds_dirstat_batch_parent, OPT_BOOL, true)  // apply that to a dirfrag's own inode too
+OPTION(mds_rstat_max_stale, OPT_FLOAT, 2)         // stat of a dir gathers rstat deferred longer than this (0 = never)
 OPTION(mds_scatter_nudge_interval, OPT_FLOAT, 5)  // how quickly dirstat changes propagate up the hierarchy
 OPTION(mds_client_prealloc_inos, OPT_INT, 1000)
+OPTION(mds_client_delegate_inos, OPT_INT, 100)  // how many of those the client may pick itself
+OPTION(mds_cap_batch_window, OPT_FLOAT, .002) // hold cap grants/revokes/flush acks to a client this long to send them together (0 = off)
+OPTION(mds_cap_batch_max, OPT_INT, 128)        // send a client's held cap messages once there are this many
 OPTION(mds_early_reply, OPT_BOOL, true)
 OPTION(mds_use_tmap, OPT_BOOL, true)        // use trivialmap for dir updates
+OPTION(mds_dir_use_omap, OPT_BOOL, false)   // keep dentries in omap; lookups fetch single dentries
 OPTION(mds_default_dir_hash, OPT_INT, CEPH_STR_HASH_RJENKINS)
 OPTION(mds_log, OPT_BOOL, true)
 OPTION(mds_log_skip_corrupt_events, OPT_BOOL, false)
@@ -307,7 +358,7 @@ OPTION(mds_log_max_expiring, OPT_INT, 20)
 OPTION(mds_bal_sample_interval, OPT_FLOAT, 3.0)  // every 5 seconds
 OPTION(mds_bal_replicate_threshold, OPT_FLOAT, 8000)
 OPTION(mds_bal_unreplicate_threshold, OPT_FLOAT, 0)
-OPTION(mds_bal_frag, OPT_BOOL, false)
+OPTION(mds_bal_frag, OPT_BOOL, true)
 OPTION(mds_bal_split_size, OPT_INT, 10000)
 OPTION(mds_bal_split_rd, OPT_FLOAT, 25000)
 OPTION(mds_bal_split_wr, OPT_FLOAT, 10000)
@@ -329,6 +380,9 @@ OPTION(mds_bal_midchunk, OPT_FLOAT, .3)       // any sub bigger than this taken
 OPTION(mds_bal_minchunk, OPT_FLOAT, .001)     // never take anything smaller than this
 OPTION(mds_bal_target_removal_min, OPT_INT, 5) // min balance iterations before old target is removed
 OPTION(mds_bal_target_removal_max, OPT_INT, 10) // max balance iterations before old target is removed
+OPTION(mds_bal_min_overload_epochs, OPT_INT, 2) // must be overloaded this many epochs before we export anything
+OPTION(mds_bal_import_hold, OPT_FLOAT, 60)   // don't export a subtree we imported less than this many seconds ago
+OPTION(mds_bal_migration_cost, OPT_FLOAT, .0001) // estimated load of migrating one (recursive) file or dir
 OPTION(mds_replay_interval, OPT_FLOAT, 1.0) // time to wait before starting replay again
 OPTION(mds_shutdown_check, OPT_INT, 0)
 OPTION(mds_thrash_exports, OPT_INT, 0)
@@ -360,6 +414,7 @@ OPTION(max_mds, OPT_INT, 1)
 OPTION(mds_standby_for_name, OPT_STR, "")
 OPTION(mds_standby_for_rank, OPT_INT, -1)
 OPTION(mds_standby_replay, OPT_BOOL, false)
+OPTION(mds_standby_prefetch_dirfrags, OPT_INT, 100) // dirfrags a standby-replay mds reads in after each replay pass
 
 // If true, compact leveldb store on mount
 OPTION(osd_compact_leveldb_on_mount, OPT_BOOL, false)
@@ -381,6 +436,7 @@ OPTION(osd_max_write_size, OPT_INT, 90)
 OPTION(osd_max_pgls, OPT_U64, 1024) // max number of pgls entries to return
 OPTION(osd_client_message_size_cap, OPT_U64, 500*1024L*1024L) // client data allowed in-memory (in bytes)
 OPTION(osd_client_message_cap, OPT_U64, 100)              // num client messages allowed in-memory
+OPTION(osd_cluster_compress, OPT_BOOL, false) // compress replication and recovery data between osds
 OPTION(osd_pg_bits, OPT_INT, 6)  // bits per osd
 OPTION(osd_pgp_bits, OPT_INT, 6)  // bits per osd
 OPTION(osd_crush_chooseleaf_type, OPT_INT, 1) // 1 = host
@@ -395,14 +451,31 @@ OPTION(osd_pool_default_flags, OPT_INT, 0)   // default flags for new pools
 OPTION(osd_pool_default_flag_hashpspool, OPT_BOOL, false)   // use new pg hashing to prevent pool/pg overlap
 OPTION(osd_map_dedup, OPT_BOOL, true)
 OPTION(osd_map_cache_size, OPT_INT, 500)
+OPTION(osd_map_dedup_bl, OPT_BOOL, true)  // share unchanged pages between cached full maps
+OPTION(osd_map_precompute_pg_mappings, OPT_BOOL, false)  // run crush for all pgs as maps arrive, reusing the previous epoch's where placement is unchanged
 OPTION(osd_map_message_max, OPT_INT, 100)  // max maps per MOSDMap message
 OPTION(osd_map_share_max_epochs, OPT_INT, 100)  // cap on # of inc maps we send to peers, clients
 OPTION(osd_op_threads, OPT_INT, 2)    // 0 == no threading
+OPTION(osd_peering_threads, OPT_INT, 4)  // threads handling peering events and map advances
+OPTION(osd_op_num_threads_per_shard, OPT_INT, 2)
+OPTION(osd_op_num_shards, OPT_INT, 5)
 OPTION(osd_peering_wq_batch_size, OPT_U64, 20)
 OPTION(osd_op_pq_max_tokens_per_priority, OPT_U64, 4194304)
 OPTION(osd_op_pq_min_cost, OPT_U64, 65536)
+OPTION(osd_obc_cache_max_bytes, OPT_U64, 32<<20)  // object contexts kept across all pgs
+OPTION(osd_repop_batch_window, OPT_DOUBLE, 0)  // seconds to hold replicated writes of a clean pg for batching; 0 disables
+OPTION(osd_repop_batch_max, OPT_INT, 16)        // ship a batch once it holds this many writes
+OPTION(osd_op_queue, OPT_STR, "prioritized") // op scheduler: prioritized or mclock
+// mclock reservation (ops/sec, 0 = none), weight and limit (ops/sec, 0 = none) per osd
+OPTION(osd_op_queue_mclock_client_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_client_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_client_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_osd_res, OPT_DOUBLE, 0.0)   // sub ops from peer osds
+OPTION(osd_op_queue_mclock_osd_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_osd_lim, OPT_DOUBLE, 0.0)
 OPTION(osd_disk_threads, OPT_INT, 1)
 OPTION(osd_recovery_threads, OPT_INT, 1)
+OPTION(osd_load_pgs_threads, OPT_INT, 4)   // threads reading pg state at startup; <= 1 reads them serially
 OPTION(osd_recover_clone_overlap, OPT_BOOL, true)   // preserve clone_overlap during recovery/migration
 
 // Only use clone_overlap for recovery if there are fewer than
@@ -411,9 +484,9 @@ OPTION(osd_recover_clone_overlap_limit, OPT_INT, 10)
 
 OPTION(osd_backfill_scan_min, OPT_INT, 64)
 OPTION(osd_backfill_scan_max, OPT_INT, 512)
+OPTION(osd_backfill_scan_prefetch, OPT_BOOL, true)  // ask for the peer's next interval while pushing this one
 OPTION(osd_op_thread_timeout, OPT_INT, 15)
 OPTION(osd_recovery_thread_timeout, OPT_INT, 30)
-OPTION(osd_snap_trim_thread_timeout, OPT_INT, 60*60*1)
 OPTION(osd_scrub_thread_timeout, OPT_INT, 60)
 OPTION(osd_scrub_finalize_thread_timeout, OPT_INT, 60*10)
 OPTION(osd_remove_thread_timeout, OPT_INT, 60*60)
@@ -421,8 +494,8 @@ OPTION(osd_command_thread_timeout, OPT_INT, 10*60)
 OPTION(osd_age, OPT_FLOAT, .8)
 OPTION(osd_age_time, OPT_INT, 0)
 OPTION(osd_heartbeat_addr, OPT_ADDR, entity_addr_t())
-OPTION(osd_heartbeat_interval, OPT_INT, 6)       // (seconds) how often we ping peers
-OPTION(osd_heartbeat_grace, OPT_INT, 20)         // (seconds) how long before we decide a peer has failed
+OPTION(osd_heartbeat_interval, OPT_DOUBLE, 6)    // (seconds) how often we ping peers; may be fractional
+OPTION(osd_heartbeat_grace, OPT_DOUBLE, 20)      // (seconds) how long before we decide a peer has failed; may be fractional
 OPTION(osd_heartbeat_min_peers, OPT_INT, 10)     // minimum number of peers
 
 // minimum number of peers tha tmust be reachable to mark ourselves
@@ -441,7 +514,30 @@ OPTION(osd_recovery_delay_start, OPT_FLOAT, 0)
 OPTION(osd_recovery_max_active, OPT_INT, 15)
 OPTION(osd_recovery_max_single_start, OPT_INT, 5)
 OPTION(osd_recovery_max_chunk, OPT_U64, 8<<20)  // max size of push chunk
+OPTION(osd_recovery_push_window, OPT_INT, 4)  // push chunks of one object in flight at once
+OPTION(osd_recovery_delta, OPT_BOOL, true)  // push only the extents the log says changed, if we can
+// recovery, backfill and scrub budget per osd, 0 = unlimited
+OPTION(osd_recovery_max_ops_per_sec, OPT_DOUBLE, 0)
+OPTION(osd_recovery_max_bytes_per_sec, OPT_DOUBLE, 0)
+OPTION(osd_recovery_budget_target_latency, OPT_DOUBLE, 0) // client op latency (sec) to back off above, 0 = fixed budget
+OPTION(osd_recovery_budget_min_fraction, OPT_DOUBLE, .1)  // lowest share of the budget we back off to
 OPTION(osd_copyfrom_max_chunk, OPT_U64, 8<<20)   // max size of a COPYFROM chunk
+// cache tiering agent
+OPTION(osd_agent_max_ops, OPT_INT, 4)  // flushes in flight per osd
+OPTION(osd_agent_max_ops_per_sec, OPT_DOUBLE, 0)  // agent ops started per osd, 0 = unlimited
+OPTION(osd_agent_scan_batch, OPT_INT, 32)  // objects looked at per pass over a pg
+OPTION(osd_agent_thread_timeout, OPT_INT, 60)
+OPTION(osd_agent_delay_time, OPT_DOUBLE, 5.0)  // rest after a pass over a pg that found nothing to do
+OPTION(osd_hit_set_target_size, OPT_INT, 1000)  // objects a pg's hit set is sized for
+OPTION(osd_hit_set_fpp, OPT_DOUBLE, .05)  // false positive rate of the hit sets
+OPTION(osd_hit_set_namespace, OPT_STR, ".ceph-internal")  // namespace of the hit set archive objects
+OPTION(osd_tier_proxy_reads, OPT_BOOL, true)  // read cache misses from the base pool instead of redirecting the client
+OPTION(osd_tier_promote_min_temperature, OPT_INT, 2)  // hit set intervals an object must be in to be promoted, 0 = always
+// snap trimming, queued with the client ops
+OPTION(osd_snap_trim_priority, OPT_U32, 5)
+OPTION(osd_snap_trim_cost, OPT_U32, 1<<20)  // queue cost of one batch
+OPTION(osd_snap_trim_batch, OPT_INT, 16)  // objects trimmed per pass over a pg
+OPTION(osd_snap_trim_max_objects_per_sec, OPT_DOUBLE, 0)  // per osd, 0 = unlimited
 OPTION(osd_push_per_object_cost, OPT_U64, 1000)  // push cost per object
 OPTION(osd_max_push_cost, OPT_U64, 8<<20)  // max size of push message
 OPTION(osd_max_push_objects, OPT_U64, 10)  // max objects in single push op
@@ -454,6 +550,11 @@ OPTION(osd_scrub_chunk_min, OPT_INT, 5)
 OPTION(osd_scrub_chunk_max, OPT_INT, 25)
 OPTION(osd_deep_scrub_interval, OPT_FLOAT, 60*60*24*7) // once a week
 OPTION(osd_deep_scrub_stride, OPT_INT, 524288)
+OPTION(osd_deep_scrub_crc_map, OPT_BOOL, false)  // digest data from the filestore's block crcs where it has them
+OPTION(osd_deep_scrub_crc_verify_ratio, OPT_FLOAT, .1)  // share of such objects with one block read back and checked
+OPTION(osd_deep_scrub_spread, OPT_BOOL, true)  // give each pg its own slot in the deep scrub interval
+OPTION(osd_deep_scrub_checkpoint_interval, OPT_FLOAT, 60)  // seconds between persisting deep scrub progress
+OPTION(osd_scrub_max_bytes_per_sec, OPT_DOUBLE, 0)  // scrub reads per osd, 0 = unlimited
 OPTION(osd_scan_list_ping_tp_interval, OPT_U64, 100)
 OPTION(osd_auto_weight, OPT_BOOL, false)
 OPTION(osd_class_dir, OPT_STR, CEPH_LIBDIR "/rados-classes") // where rados plugins are stored
@@ -484,7 +585,10 @@ OPTION(osd_debug_verify_stray_on_activate, OPT_BOOL, false)
 OPTION(osd_debug_skip_full_check_in_backfill_reservation, OPT_BOOL, false)
 OPTION(osd_op_history_size, OPT_U32, 20)    // Max number of completed ops to track
 OPTION(osd_op_history_duration, OPT_U32, 600) // Oldest completed op to track
+OPTION(osd_num_op_tracker_shard, OPT_U32, 32) // in flight op lists, each with its own lock
 OPTION(osd_target_transaction_size, OPT_INT, 30)     // to adjust various transactions that batch smaller items
+OPTION(osd_remove_transaction_size, OPT_INT, 300)    // objects removed per transaction when deleting a pg
+OPTION(osd_split_prepare_bits, OPT_INT, 1)   // have the store lay pgs out for a pg_num up to 2^this times larger, 0 to not
 OPTION(osd_failsafe_full_ratio, OPT_FLOAT, .97) // what % full makes an OSD "full" (failsafe)
 OPTION(osd_failsafe_nearfull_ratio, OPT_FLOAT, .90) // what % full makes an OSD near full (failsafe)
 OPTION(osd_leveldb_write_buffer_size, OPT_U64, 0) // OSD's leveldb write buffer size
@@ -495,6 +599,16 @@ OPTION(osd_leveldb_max_open_files, OPT_INT, 0) // OSD's leveldb max open files
 OPTION(osd_leveldb_compression, OPT_BOOL, true) // OSD's leveldb uses compression
 OPTION(osd_leveldb_paranoid, OPT_BOOL, false) // OSD's leveldb paranoid flag
 OPTION(osd_leveldb_log, OPT_STR, "/dev/null")  // enable OSD leveldb log file
+OPTION(rocksdb_write_buffer_size, OPT_U64, 0) // rocksdb write buffer size per column family
+OPTION(rocksdb_cache_size, OPT_U64, 128*1024*1024) // rocksdb block cache, shared by all column families
+OPTION(rocksdb_block_size, OPT_U64, 0) // rocksdb block size
+OPTION(rocksdb_bloom_size, OPT_INT, 10) // rocksdb bloom bits per entry
+OPTION(rocksdb_max_open_files, OPT_INT, 0) // rocksdb max open files
+OPTION(rocksdb_compression, OPT_BOOL, true) // rocksdb uses compression
+OPTION(rocksdb_max_background_compactions, OPT_INT, 4) // rocksdb compaction threads
+OPTION(rocksdb_max_background_flushes, OPT_INT, 2) // rocksdb memtable flush threads
+OPTION(rocksdb_paranoid, OPT_BOOL, false) // rocksdb paranoid flag
+OPTION(rocksdb_log, OPT_STR, "/dev/null")  // rocksdb log file
 
 // determines whether PGLog::check() compares written out log to stored log
 OPTION(osd_debug_pg_log_writeout, OPT_BOOL, false)
@@ -520,8 +634,14 @@ OPTION(osd_mon_shutdown_timeout, OPT_DOUBLE, 5)
 OPTION(osd_max_object_size, OPT_U64, 100*1024L*1024L*1024L) // OSD's maximum object size
 OPTION(osd_max_attr_size, OPT_U64, 0)
 
+OPTION(osd_objectstore, OPT_STR, "filestore")  // ObjectStore backend type
+
 OPTION(filestore, OPT_BOOL, false)
 
+OPTION(blockstore_block_size, OPT_U32, 4096)  // allocation and write unit, set at mkfs
+OPTION(blockstore_mkfs_size, OPT_U64, 10ULL*1024*1024*1024)  // size of <osd data>/block if mkfs creates it as a file
+OPTION(keyvaluestore_chunk_size, OPT_U32, 65536)  // object data is stored in keys of this size, set at mkfs
+
 /// filestore wb throttle limits
 OPTION(filestore_wbthrottle_enable, OPT_BOOL, true)
 OPTION(filestore_wbthrottle_btrfs_bytes_start_flusher, OPT_U64, 41943040)
@@ -539,6 +659,13 @@ OPTION(filestore_wbthrottle_xfs_inodes_start_flusher, OPT_U64, 500)
 OPTION(filestore_wbthrottle_btrfs_inodes_hard_limit, OPT_U64, 5000)
 OPTION(filestore_wbthrottle_xfs_inodes_hard_limit, OPT_U64, 5000)
 
+/// scale the wb throttle limits so that what they let pile up can be
+/// flushed within target_lag seconds at the measured flush throughput,
+/// staying within a factor of max_scale of the configured limits
+OPTION(filestore_wbthrottle_adaptive, OPT_BOOL, false)
+OPTION(filestore_wbthrottle_target_lag, OPT_DOUBLE, 2)
+OPTION(filestore_wbthrottle_adaptive_max_scale, OPT_DOUBLE, 4)
+
 // Tests index failure paths
 OPTION(filestore_index_retry_probability, OPT_DOUBLE, 0)
 
@@ -570,6 +697,8 @@ OPTION(filestore_btrfs_clone_range, OPT_BOOL, true)
 OPTION(filestore_zfs_snap, OPT_BOOL, false) // zfsonlinux is still unstable
 OPTION(filestore_fsync_flushes_journal_data, OPT_BOOL, false)
 OPTION(filestore_fiemap, OPT_BOOL, false)     // (try to) use fiemap
+OPTION(filestore_seek_data_hole, OPT_BOOL, false)  // (try to) use SEEK_DATA/SEEK_HOLE to skip holes when copying
+OPTION(filestore_reflink, OPT_BOOL, true)     // (try to) clone ranges with FICLONERANGE on non-btrfs
 OPTION(filestore_journal_parallel, OPT_BOOL, false)
 OPTION(filestore_journal_writeahead, OPT_BOOL, false)
 OPTION(filestore_journal_trailing, OPT_BOOL, false)
@@ -578,24 +707,49 @@ OPTION(filestore_queue_max_bytes, OPT_INT, 100 << 20)
 OPTION(filestore_queue_committing_max_ops, OPT_INT, 500)        // this is ON TOP of filestore_queue_max_*
 OPTION(filestore_queue_committing_max_bytes, OPT_INT, 100 << 20) //  "
 OPTION(filestore_op_threads, OPT_INT, 2)
+OPTION(filestore_op_fair_queue, OPT_BOOL, false)  // apply different sequencers in parallel, round robin
+OPTION(filestore_op_thread_prefetch, OPT_INT, 0)  // >0: sequencers each op thread dequeues at once, with work stealing
+OPTION(filestore_apply_finisher_threads, OPT_INT, 1)  // threads running onreadable callbacks; ordered per sequencer
+OPTION(filestore_ondisk_finisher_threads, OPT_INT, 1)  // threads running ondisk callbacks; ordered per sequencer
 OPTION(filestore_op_thread_timeout, OPT_INT, 60)
 OPTION(filestore_op_thread_suicide_timeout, OPT_INT, 180)
 OPTION(filestore_commit_timeout, OPT_FLOAT, 600)
 OPTION(filestore_fiemap_threshold, OPT_INT, 4096)
 OPTION(filestore_merge_threshold, OPT_INT, 10)
 OPTION(filestore_split_multiple, OPT_INT, 2)
+OPTION(filestore_sync_targeted, OPT_BOOL, false)  // without checkpoints, sync only what changed instead of syncfs
+OPTION(filestore_sync_targeted_max_objects, OPT_INT, 4096)  // ... unless more than this many objects did
+OPTION(filestore_sync_targeted_threads, OPT_INT, 4)  // threads syncing them in parallel
+OPTION(filestore_split_async, OPT_BOOL, false)  // split directories in a background thread
+OPTION(filestore_split_rate, OPT_INT, 1000)     // objects the split thread moves per second, 0 for no limit
+OPTION(filestore_split_defer_max, OPT_INT, 4)   // split inline once a directory is this many times over
+OPTION(filestore_list_cache_objects, OPT_U64, 524288)  // objects in cached sorted collection listings, 0 to disable
 OPTION(filestore_update_to, OPT_INT, 1000)
 OPTION(filestore_blackhole, OPT_BOOL, false)     // drop any new transactions on the floor
-OPTION(filestore_fd_cache_size, OPT_INT, 128)    // FD lru size
+OPTION(filestore_fd_cache_size, OPT_INT, 10240)    // FD lru size
+OPTION(filestore_fd_cache_shards, OPT_INT, 16)   // FD lru shards, each with 1/n of the size
+OPTION(filestore_xattr_cache_size, OPT_U64, 32 << 20)  // bytes of inline xattrs cached with the FD lru; 0 to disable
+OPTION(filestore_omap_header_cache_size, OPT_INT, 1024)   // decoded omap leaf headers cached
+OPTION(filestore_omap_header_cache_shards, OPT_INT, 16)  // omap header cache and object lock shards
+OPTION(filestore_omap_rmkeyrange_compact_min, OPT_INT, 128)  // compact the range once a range removal drops this many omap keys, 0 to never
+OPTION(filestore_omap_backend, OPT_STR, "leveldb")  // omap store of new filestores: leveldb or rocksdb
+OPTION(filestore_rocksdb_column_families, OPT_STR, "omap:_USER_*_USER_ xattr:_USER_*_AXATTR_")  // name:prefix-pattern pairs, fixed at creation
+OPTION(filestore_rocksdb_column_family_options, OPT_STR, "")  // name:rocksdb-options pairs
 OPTION(filestore_dump_file, OPT_STR, "")         // file onto which store transaction dumps
 OPTION(filestore_kill_at, OPT_INT, 0)            // inject a failure at the n'th opportunity
 OPTION(filestore_inject_stall, OPT_INT, 0)       // artificially stall for N seconds in op queue thread
 OPTION(filestore_fail_eio, OPT_BOOL, true)       // fail/crash on EIO
+OPTION(filestore_readv_max_gap, OPT_U64, 32768)  // read through holes up to this big between extents of a multi-extent read, to save syscalls
 OPTION(filestore_replica_fadvise, OPT_BOOL, true)
 OPTION(filestore_debug_verify_split, OPT_BOOL, false)
 OPTION(journal_dio, OPT_BOOL, true)
 OPTION(journal_aio, OPT_BOOL, true)
 OPTION(journal_force_aio, OPT_BOOL, false)
+OPTION(journal_aio_depth, OPT_INT, 1)         // aios kept in flight before waiting to batch more
+OPTION(journal_batch_max_wait, OPT_DOUBLE, 0) // seconds to let the queue fill while aios are in flight
+OPTION(journal_batch_min_bytes, OPT_INT, 64 << 10) // ... unless this much is already queued
+OPTION(journal_stripe_path, OPT_STR, "")      // second journal device to stripe entries across
+OPTION(journal_stripe_unit, OPT_INT, 1 << 20) // bytes per device before moving to the other
 
 // max bytes to search ahead in journal searching for corruption
 OPTION(journal_max_corrupt_search, OPT_U64, 10<<20)
@@ -617,7 +771,13 @@ OPTION(rbd_cache_max_dirty, OPT_LONGLONG, 24<<20)    // dirty limit in bytes - s
 OPTION(rbd_cache_target_dirty, OPT_LONGLONG, 16<<20) // target dirty limit in bytes
 OPTION(rbd_cache_max_dirty_age, OPT_FLOAT, 1.0)      // seconds in cache before writeback starts
 OPTION(rbd_cache_block_writes_upfront, OPT_BOOL, false) // whether to block writes to the cache before the aio_write call completes (true), or block before the aio completion is called (false)
-OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // how many operations can be in flight for a management operation like deleting or resizing an image
+OPTION(rbd_readahead_min_bytes, OPT_LONGLONG, 64<<10) // first readahead window of a sequential stream (needs rbd_cache)
+OPTION(rbd_readahead_max_bytes, OPT_LONGLONG, 512<<10) // largest readahead window; 0 disables readahead
+OPTION(rbd_readahead_streams, OPT_INT, 4) // sequential streams followed per image
+OPTION(rbd_persistent_cache_path, OPT_STR, "") // directory on a local device for write logs of images with the exclusive lock; empty disables them
+OPTION(rbd_persistent_cache_size, OPT_U64, 1<<30) // bytes of each image's write log
+OPTION(rbd_persistent_cache_max_writeback, OPT_INT, 16) // entries of a write log written back to the cluster at once
+OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // how many operations can be in flight for a management operation like deleting or resizing an image, or for copying, importing or exporting one
 OPTION(rbd_balance_snap_reads, OPT_BOOL, false)
 OPTION(rbd_localize_snap_reads, OPT_BOOL, false)
 
@@ -641,7 +801,8 @@ OPTION(rbd_default_format, OPT_INT, 1)
 OPTION(rbd_default_order, OPT_INT, 22)
 OPTION(rbd_default_stripe_count, OPT_U64, 1) // changing requires stripingv2 feature
 OPTION(rbd_default_stripe_unit, OPT_U64, 4194304) // changing to non-object size requires stripingv2 feature
-OPTION(rbd_default_features, OPT_INT, 3) // 1 for layering, 3 for layering+stripingv2. only applies to format 2 images
+OPTION(rbd_default_features, OPT_INT, 3) // 1 for layering, 3 for layering+stripingv2, +4 for the object map, +8 for fast diff (with the object map), +16 for the exclusive lock. only applies to format 2 images
+OPTION(rbd_lock_transfer_timeout, OPT_DOUBLE, 30) // seconds to wait for the owner of an image's exclusive lock to give it up
 
 OPTION(nss_db_path, OPT_STR, "") // path to nss db
 
@@ -649,9 +810,15 @@ OPTION(rgw_data, OPT_STR, "/var/lib/ceph/radosgw/$cluster-$id")
 OPTION(rgw_enable_apis, OPT_STR, "s3, swift, swift_auth, admin")
 OPTION(rgw_cache_enabled, OPT_BOOL, true)   // rgw cache enabled
 OPTION(rgw_cache_lru_size, OPT_INT, 10000)   // num of entries in rgw cache
+OPTION(rgw_cache_max_bytes, OPT_U64, 64 << 20)   // bytes of rgw cache
+OPTION(rgw_cache_shards, OPT_INT, 16)   // rgw cache shards, each with a lock of its own
+OPTION(rgw_cache_negative_ttl, OPT_INT, 60)   // seconds missing objects are cached as such; 0 to not cache them
 OPTION(rgw_socket_path, OPT_STR, "")   // path to unix domain socket, if not specified, rgw will not run as external fcgi
 OPTION(rgw_host, OPT_STR, "")  // host for radosgw, can be an IP, default is 0.0.0.0
 OPTION(rgw_port, OPT_STR, "")  // port to listen, format as "8080" "5000", if not specified, rgw will not run external fcgi
+OPTION(rgw_frontend, OPT_STR, "fastcgi")  // "fastcgi", or "http" to serve HTTP on rgw_host:rgw_port directly
+OPTION(rgw_http_max_connections, OPT_INT, 1024)  // client connections the http frontend keeps open at once
+OPTION(rgw_http_keepalive_timeout, OPT_INT, 60)  // seconds an idle or stalled http connection is kept
 OPTION(rgw_dns_name, OPT_STR, "")
 OPTION(rgw_script_uri, OPT_STR, "") // alternative value for SCRIPT_URI if not set in request
 OPTION(rgw_request_uri, OPT_STR,  "") // alternative value for REQUEST_URI if not set in request
@@ -667,6 +834,8 @@ OPTION(rgw_keystone_admin_tenant, OPT_STR, "")  // keystone admin user tenant
 OPTION(rgw_keystone_accepted_roles, OPT_STR, "Member, admin")  // roles required to serve requests
 OPTION(rgw_keystone_token_cache_size, OPT_INT, 10000)  // max number of entries in keystone token cache
 OPTION(rgw_keystone_revocation_interval, OPT_INT, 15 * 60)  // seconds between tokens revocation check
+OPTION(rgw_user_key_cache_size, OPT_INT, 10000)  // max number of users cached by access key
+OPTION(rgw_user_key_cache_ttl, OPT_INT, 30)  // seconds a user looked up by access key is cached; 0 to not cache
 OPTION(rgw_s3_auth_use_rados, OPT_BOOL, true)  // should we try to use the internal credentials for s3?
 OPTION(rgw_s3_auth_use_keystone, OPT_BOOL, false)  // should we try to use keystone for s3?
 OPTION(rgw_admin_entry, OPT_STR, "admin")  // entry point for which a url is considered an admin request
@@ -676,6 +845,8 @@ OPTION(rgw_print_continue, OPT_BOOL, true)  // enable if 100-Continue works
 OPTION(rgw_remote_addr_param, OPT_STR, "REMOTE_ADDR")  // e.g. X-Forwarded-For, if you have a reverse proxy
 OPTION(rgw_op_thread_timeout, OPT_INT, 10*60)
 OPTION(rgw_op_thread_suicide_timeout, OPT_INT, 0)
+OPTION(rgw_op_history_size, OPT_INT, 20)  // number of slowest recent requests kept for dump_historic_ops
+OPTION(rgw_op_history_duration, OPT_INT, 600)  // seconds requests stay in the dump_historic_ops history
 OPTION(rgw_thread_pool_size, OPT_INT, 100)
 OPTION(rgw_num_control_oids, OPT_INT, 8)
 
@@ -704,16 +875,24 @@ OPTION(rgw_gc_max_objs, OPT_INT, 32)
 OPTION(rgw_gc_obj_min_wait, OPT_INT, 2 * 3600)    // wait time before object may be handled by gc
 OPTION(rgw_gc_processor_max_time, OPT_INT, 3600)  // total run time for a single gc processor work
 OPTION(rgw_gc_processor_period, OPT_INT, 3600)  // gc processor cycle time
+OPTION(rgw_gc_max_concurrent_shards, OPT_INT, 4)  // gc shards processed at once
+OPTION(rgw_gc_max_concurrent_io, OPT_INT, 16)  // removals in flight per gc shard
 OPTION(rgw_s3_success_create_obj_status, OPT_INT, 0) // alternative success status response for create-obj (0 - default)
 OPTION(rgw_resolve_cname, OPT_BOOL, false)  // should rgw try to resolve hostname as a dns cname record
 OPTION(rgw_obj_stripe_size, OPT_INT, 4 << 20)
 OPTION(rgw_extended_http_attrs, OPT_STR, "") // list of extended attrs that can be set on objects (beyond the default)
 OPTION(rgw_exit_timeout_secs, OPT_INT, 120) // how many seconds to wait for process to go down before exiting unconditionally
 OPTION(rgw_get_obj_window_size, OPT_INT, 16 << 20) // window size in bytes for single get obj request
+OPTION(rgw_get_obj_max_window_size, OPT_INT, 64 << 20) // the window may grow up to this while the client is faster than the reads
+OPTION(rgw_put_obj_max_window_size, OPT_INT, 16 << 20) // bytes of a single upload in flight to the cluster
 OPTION(rgw_get_obj_max_req_size, OPT_INT, 4 << 20) // max length of a single get obj rados op
+OPTION(rgw_omap_get_max_aio, OPT_INT, 8) // concurrent omap reads of e.g. multipart upload parts
+OPTION(rgw_copy_obj_max_aio, OPT_INT, 16) // concurrent reference updates of a copied object's tail
 OPTION(rgw_relaxed_s3_bucket_names, OPT_BOOL, false) // enable relaxed bucket name rules for US region buckets
 OPTION(rgw_defer_to_bucket_acls, OPT_STR, "") // if the user has bucket perms, use those before key perms (recurse and full_control)
 OPTION(rgw_list_buckets_max_chunk, OPT_INT, 1000) // max buckets to retrieve in a single op when listing user buckets
+OPTION(rgw_bucket_index_max_shards, OPT_INT, 0) // number of objects the index of a new bucket is sharded over (0 for a single object)
+OPTION(rgw_bucket_index_max_complete_batch, OPT_INT, 64) // completions to an index object sent together while one is in flight (1 sends them one by one)
 OPTION(rgw_md_log_max_shards, OPT_INT, 64) // max shards for metadata log
 OPTION(rgw_num_zone_opstate_shards, OPT_INT, 128) // max shards for keeping inter-region copy progress info
 OPTION(rgw_opstate_ratelimit_sec, OPT_INT, 30) // min time between opstate updates on a single upload (0 for disabling ratelimit)
@@ -722,6 +901,7 @@ OPTION(rgw_copy_obj_progress, OPT_BOOL, true) // should dump progress during lon
 OPTION(rgw_copy_obj_progress_every_bytes, OPT_INT, 1024 * 1024) // min bytes between copy progress output
 
 OPTION(rgw_data_log_window, OPT_INT, 30) // data log entries window (in seconds)
+OPTION(rgw_log_batch_window_ms, OPT_INT, 2) // how long an append to a metadata or data log shard waits for others to send along
 OPTION(rgw_data_log_changes_size, OPT_INT, 1000) // number of in-memory entries to hold for data changes log
 OPTION(rgw_data_log_num_shards, OPT_INT, 128) // number of objects to keep data changes log on
 OPTION(rgw_data_log_obj_prefix, OPT_STR, "data_log") // 
@@ -730,6 +910,10 @@ OPTION(rgw_replica_log_obj_prefix, OPT_STR, "replica_log") //
 OPTION(rgw_bucket_quota_ttl, OPT_INT, 600) // time for cached bucket stats to be cached within rgw instance
 OPTION(rgw_bucket_quota_soft_threshold, OPT_DOUBLE, 0.95) // threshold from which we don't rely on cached info for quota decisions
 OPTION(rgw_bucket_quota_cache_size, OPT_INT, 10000) // number of entries in bucket quota cache
+OPTION(rgw_bucket_quota_stale_grace, OPT_INT, 60) // how long past their ttl cached bucket stats may be used while another thread reads them
+
+OPTION(rgw_admin_max_concurrent_ops, OPT_INT, 32) // objects removed (or usage shards trimmed) at once by bulk admin operations
+OPTION(rgw_admin_progress_every, OPT_INT, 10000) // report progress of bulk object removal every this many objects
 
 OPTION(mutex_perf_counter, OPT_BOOL, false) // enable/disable mutex perf counter
 
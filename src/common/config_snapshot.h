@@ -0,0 +1,81 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_CONFIG_SNAPSHOT_H
+#define CEPH_COMMON_CONFIG_SNAPSHOT_H
+
+#include <tr1/memory>
+
+#include "common/simple_spin.h"
+#include "include/int_types.h"
+
+struct md_config_t;
+
+/**
+ * an immutable copy of the config values a hot path needs
+ *
+ * Reading md_config_t fields while injectargs changes them is racy
+ * (strings in particular), and taking md_config_t::lock for every
+ * read is too slow.  Instead the owner keeps its values in a plain
+ * struct T with a T(const md_config_t *) constructor, calls update()
+ * from its handle_conf_change(), and readers call get().
+ *
+ * get() only takes a spinlock for as long as it takes to copy the
+ * shared_ptr; a reader that holds on to the Ref sees one consistent
+ * version however long it runs, and an old version is freed when its
+ * last reader lets go.
+ */
+template <typename T>
+class ConfigSnapshot {
+public:
+  typedef std::tr1::shared_ptr<const T> Ref;
+
+  explicit ConfigSnapshot(const md_config_t *conf)
+    : cur(new T(conf)), version(1), lock(SIMPLE_SPINLOCK_INITIALIZER) {}
+
+  /// @return the current version; never NULL
+  Ref get() const {
+    simple_spin_lock(&lock);
+    Ref r = cur;
+    simple_spin_unlock(&lock);
+    return r;
+  }
+
+  /// @return how many versions have been published, starting at 1
+  uint64_t get_version() const {
+    simple_spin_lock(&lock);
+    uint64_t v = version;
+    simple_spin_unlock(&lock);
+    return v;
+  }
+
+  /// build and publish a new version from conf
+  void update(const md_config_t *conf) {
+    Ref n(new T(conf));
+    simple_spin_lock(&lock);
+    cur.swap(n);
+    ++version;
+    simple_spin_unlock(&lock);
+    // n now holds the old version; it goes away outside the lock
+  }
+
+private:
+  Ref cur;
+  uint64_t version;
+  mutable simple_spinlock_t lock;
+
+  // not copyable
+  ConfigSnapshot(const ConfigSnapshot&);
+  ConfigSnapshot& operator=(const ConfigSnapshot&);
+};
+
+#endif
@@ -5,9 +5,12 @@
 
 #include "arch/probe.h"
 #include "arch/intel.h"
+#include "arch/neon.h"
 #include "common/sctp_crc32.h"
 #include "common/crc32c_intel_baseline.h"
 #include "common/crc32c_intel_fast.h"
+#include "common/crc32c_intel_pclmul.h"
+#include "common/crc32c_aarch64.h"
 
 /*
  * choose best implementation based on the CPU architecture.
@@ -20,9 +23,16 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
 
   // if the CPU supports it, *and* the fast version is compiled in,
   // use that.
+  if (ceph_arch_intel_sse42 && ceph_arch_intel_pclmul &&
+      ceph_crc32c_intel_pclmul_exists()) {
+    return ceph_crc32c_intel_pclmul;
+  }
   if (ceph_arch_intel_sse42 && ceph_crc32c_intel_fast_exists()) {
     return ceph_crc32c_intel_fast;
   }
+  if (ceph_arch_aarch64_crc32 && ceph_crc32c_aarch64_exists()) {
+    return ceph_crc32c_aarch64;
+  }
 
   // default
   return ceph_crc32c_sctp;
@@ -39,3 +49,52 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
  */
 ceph_crc32c_func_t ceph_crc32c_func = ceph_choose_crc32();
 
+
+
+/*
+ * x^(2^k) mod P for k = 0..30, bit reflected (0x80000000 is x^0).
+ * x^(2^31) == x mod P for the Castagnoli polynomial, so the table
+ * repeats with period 31.
+ */
+static const uint32_t crc32c_x2n_table[] = {
+  0x40000000, 0x20000000, 0x08000000, 0x00800000,
+  0x00008000, 0x82f63b78, 0x6ea2d55c, 0x18b8ea18,
+  0x510ac59a, 0xb82be955, 0xb8fdb1e7, 0x88e56f72,
+  0x74c360a4, 0xe4172b16, 0x0d65762a, 0x35d73a62,
+  0x28461564, 0xbf455269, 0xe2ea32dc, 0xfe7740e6,
+  0xf946610b, 0x3c204f8f, 0x538586e3, 0x59726915,
+  0x734d5309, 0xbc1ac763, 0x7d0722cc, 0xd289cabe,
+  0xe94ca9bc, 0x05b74f3f, 0xa51e1f42,
+};
+
+/* a * b mod P, bit reflected */
+static uint32_t crc32c_multmodp(uint32_t a, uint32_t b)
+{
+  uint32_t m = 1u << 31;
+  uint32_t p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0)
+	break;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ 0x82f63b78 : b >> 1;
+  }
+  return p;
+}
+
+uint32_t ceph_crc32c_zeros(uint32_t crc, unsigned length)
+{
+  if (!crc)
+    return 0;
+  // multiply by x^(8 * length), one table entry per set bit
+  unsigned k = 3;
+  while (length) {
+    if (length & 1)
+      crc = crc32c_multmodp(crc32c_x2n_table[k % 31], crc);
+    length >>= 1;
+    k++;
+  }
+  return crc;
+}
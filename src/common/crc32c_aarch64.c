@@ -0,0 +1,66 @@
+#include "acconfig.h"
+#include "include/int_types.h"
+#include "include/crc32c.h"
+#include "common/crc32c_aarch64.h"
+
+#if defined(HAVE_ARMV8_CRC) && defined(__aarch64__)
+
+#define CRC32CX(crc, value) __asm__("crc32cx %w[c], %w[c], %x[v]" : [c]"+r"(crc) : [v]"r"(value))
+#define CRC32CW(crc, value) __asm__("crc32cw %w[c], %w[c], %w[v]" : [c]"+r"(crc) : [v]"r"(value))
+#define CRC32CB(crc, value) __asm__("crc32cb %w[c], %w[c], %w[v]" : [c]"+r"(crc) : [v]"r"(value))
+
+uint32_t ceph_crc32c_aarch64(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	if (!buffer)
+		return ceph_crc32c_zeros(crc, len);
+
+	/* align, so the word loads below never straddle a cache line */
+	while (len && ((unsigned long)buffer & 7)) {
+		CRC32CB(crc, *buffer);
+		buffer++;
+		len--;
+	}
+	while (len >= 32) {
+		const uint64_t *p = (const uint64_t *)buffer;
+		CRC32CX(crc, p[0]);
+		CRC32CX(crc, p[1]);
+		CRC32CX(crc, p[2]);
+		CRC32CX(crc, p[3]);
+		buffer += 32;
+		len -= 32;
+	}
+	while (len >= 8) {
+		CRC32CX(crc, *(const uint64_t *)buffer);
+		buffer += 8;
+		len -= 8;
+	}
+	if (len >= 4) {
+		CRC32CW(crc, *(const uint32_t *)buffer);
+		buffer += 4;
+		len -= 4;
+	}
+	while (len--) {
+		CRC32CB(crc, *buffer);
+		buffer++;
+	}
+	return crc;
+}
+
+int ceph_crc32c_aarch64_exists(void)
+{
+	return 1;
+}
+
+#else
+
+int ceph_crc32c_aarch64_exists(void)
+{
+	return 0;
+}
+
+uint32_t ceph_crc32c_aarch64(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,112 @@
+#include "acconfig.h"
+#include "include/int_types.h"
+#include "include/crc32c.h"
+#include "common/crc32c_intel_pclmul.h"
+
+#ifdef HAVE_INTEL_PCLMUL
+
+#include <string.h>
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+
+/*
+ * The crc32 instruction has a latency of 3 cycles but a throughput of
+ * one per cycle, so a single dependency chain runs at a third of the
+ * possible speed.  Cut the buffer into runs of three equal blocks,
+ * crc them as three independent streams, and fold the results:
+ *
+ *   crc(A|B|C) = crc(A) * x^(16 len) ^ crc(B) * x^(8 len) ^ crc(C)
+ *
+ * Multiplying by x^n mod P is a carry-less multiply (pclmulqdq) by the
+ * constant x^(n-33) mod P followed by a crc32 of the 64 bit product,
+ * which supplies the missing x^33 and the reduction.
+ */
+#define LONG_BLOCK  1024
+#define SHORT_BLOCK 128
+
+/* x^(8 * block - 33) and x^(16 * block - 33) mod P, bit reflected */
+static const uint64_t long_k1 = 0x170076fa, long_k2 = 0xa51b6135;
+static const uint64_t short_k1 = 0x0d3b6092, short_k2 = 0xb9e02b86;
+
+static inline uint64_t load64(unsigned char const *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t fold3(uint32_t c0, uint32_t c1, uint32_t c2,
+			     uint64_t k1, uint64_t k2)
+{
+	__m128i k = _mm_set_epi64x(k1, k2);
+	__m128i a = _mm_clmulepi64_si128(_mm_cvtsi32_si128(c0), k, 0x00);
+	__m128i b = _mm_clmulepi64_si128(_mm_cvtsi32_si128(c1), k, 0x10);
+	a = _mm_xor_si128(a, b);
+	return _mm_crc32_u64(0, _mm_cvtsi128_si64(a)) ^ c2;
+}
+
+static inline uint32_t crc32c_3way(uint32_t crc, unsigned char const **pbuf,
+				   unsigned *plen, unsigned block,
+				   uint64_t k1, uint64_t k2)
+{
+	unsigned char const *p = *pbuf;
+	unsigned len = *plen;
+
+	while (len >= 3 * block) {
+		uint64_t c0 = crc, c1 = 0, c2 = 0;
+		unsigned char const *end = p + block;
+		while (p < end) {
+			c0 = _mm_crc32_u64(c0, load64(p));
+			c1 = _mm_crc32_u64(c1, load64(p + block));
+			c2 = _mm_crc32_u64(c2, load64(p + 2 * block));
+			p += 8;
+		}
+		crc = fold3(c0, c1, c2, k1, k2);
+		p += 2 * block;
+		len -= 3 * block;
+	}
+	*pbuf = p;
+	*plen = len;
+	return crc;
+}
+
+uint32_t ceph_crc32c_intel_pclmul(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	uint64_t c;
+
+	if (!buffer)
+		return ceph_crc32c_zeros(crc, len);
+
+	crc = crc32c_3way(crc, &buffer, &len, LONG_BLOCK, long_k1, long_k2);
+	crc = crc32c_3way(crc, &buffer, &len, SHORT_BLOCK, short_k1, short_k2);
+
+	c = crc;
+	while (len >= 8) {
+		c = _mm_crc32_u64(c, load64(buffer));
+		buffer += 8;
+		len -= 8;
+	}
+	crc = c;
+	while (len--)
+		crc = _mm_crc32_u8(crc, *buffer++);
+	return crc;
+}
+
+int ceph_crc32c_intel_pclmul_exists(void)
+{
+	return 1;
+}
+
+#else
+
+int ceph_crc32c_intel_pclmul_exists(void)
+{
+	return 0;
+}
+
+uint32_t ceph_crc32c_intel_pclmul(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	return 0;
+}
+
+#endif
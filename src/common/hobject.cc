@@ -23,6 +23,74 @@ static void append_escaped(const string &in, string *out)
   }
 }
 
+// big-endian, so that memcmp orders like the integer
+static void append_be64(uint64_t v, string *out)
+{
+  for (int shift = 56; shift >= 0; shift -= 8)
+    out->push_back((char)(v >> shift));
+}
+
+// a string followed by a terminator that sorts before any character,
+// so that a prefix sorts before the strings it prefixes
+static void append_sort_string(const string &in, string *out)
+{
+  for (string::const_iterator i = in.begin(); i != in.end(); ++i) {
+    out->push_back(*i);
+    if (*i == '\0')
+      out->push_back('\xff');
+  }
+  out->push_back('\0');
+  out->push_back('\x01');
+}
+
+void hobject_t::append_sort_key(string *out) const
+{
+  out->push_back(max ? 1 : 0);
+  uint32_t k = max ? 0 : get_filestore_key_u32();
+  for (int shift = 24; shift >= 0; shift -= 8)
+    out->push_back((char)(k >> shift));
+  append_sort_string(nspace, out);
+  append_be64((uint64_t)pool ^ (1ull << 63), out);
+  append_sort_string(get_effective_key(), out);
+  append_sort_string(oid.name, out);
+  append_be64(snap, out);
+}
+
+void ghobject_t::append_sort_key(string *out) const
+{
+  hobj.append_sort_key(out);
+  out->push_back(shard_id);
+  append_be64(generation, out);
+}
+
+template <typename T>
+static void _sort_by_key(vector<T> &v)
+{
+  if (v.size() < 2)
+    return;
+  vector<pair<string, unsigned> > keys(v.size());
+  for (unsigned i = 0; i < v.size(); ++i) {
+    v[i].append_sort_key(&keys[i].first);
+    keys[i].second = i;
+  }
+  sort(keys.begin(), keys.end());
+  vector<T> sorted;
+  sorted.reserve(v.size());
+  for (unsigned i = 0; i < keys.size(); ++i)
+    sorted.push_back(v[keys[i].second]);
+  v.swap(sorted);
+}
+
+void sort_by_key(vector<hobject_t> &v)
+{
+  _sort_by_key(v);
+}
+
+void sort_by_key(vector<ghobject_t> &v)
+{
+  _sort_by_key(v);
+}
+
 set<string> hobject_t::get_prefixes(
   uint32_t bits,
   uint32_t mask,
@@ -183,6 +183,21 @@ public:
     return nspace;
   }
 
+  /**
+   * append a key that sorts under memcmp (or string compare) the way
+   * this object sorts under operator<
+   *
+   * Sorting many objects by precomputed keys avoids redoing the
+   * field-by-field comparison (and the hash bit reversal) for every
+   * pair.  The key is for in-memory use only; it is not encoded anywhere.
+   */
+  void append_sort_key(string *out) const;
+  string get_sort_key() const {
+    string out;
+    append_sort_key(&out);
+    return out;
+  }
+
   void encode(bufferlist& bl) const;
   void decode(bufferlist::iterator& bl);
   void decode(json_spirit::Value& v);
@@ -211,15 +226,50 @@ namespace __gnu_cxx {
 ostream& operator<<(ostream& out, const hobject_t& o);
 
 WRITE_EQ_OPERATORS_7(hobject_t, oid, get_key(), snap, hash, max, pool, nspace)
-// sort hobject_t's by <max, get_filestore_key(hash), key, oid, snapid>
-WRITE_CMP_OPERATORS_7(hobject_t,
-		      max,
-		      get_filestore_key(),
-		      nspace,
-		      pool,
-		      get_effective_key(),
-		      oid,
-		      snap)
+
+/**
+ * compare hobject_t's by <max, get_filestore_key(hash), nspace, pool,
+ * effective key, oid, snapid>
+ *
+ * @return <0, 0 or >0 as l sorts before, with or after r
+ */
+inline int cmp(const hobject_t& l, const hobject_t& r)
+{
+  if (l.is_max() != r.is_max())
+    return l.is_max() ? 1 : -1;
+  if (l.hash != r.hash && !l.is_max()) {
+    filestore_hobject_key_t lk = l.get_filestore_key_u32();
+    filestore_hobject_key_t rk = r.get_filestore_key_u32();
+    if (lk != rk)
+      return lk < rk ? -1 : 1;
+  }
+  int c = l.nspace.compare(r.nspace);
+  if (c)
+    return c;
+  if (l.pool != r.pool)
+    return l.pool < r.pool ? -1 : 1;
+  c = l.get_effective_key().compare(r.get_effective_key());
+  if (c)
+    return c;
+  c = l.oid.name.compare(r.oid.name);
+  if (c)
+    return c;
+  if (l.snap != r.snap)
+    return l.snap < r.snap ? -1 : 1;
+  return 0;
+}
+inline bool operator<(const hobject_t& l, const hobject_t& r) {
+  return cmp(l, r) < 0;
+}
+inline bool operator<=(const hobject_t& l, const hobject_t& r) {
+  return cmp(l, r) <= 0;
+}
+inline bool operator>(const hobject_t& l, const hobject_t& r) {
+  return cmp(l, r) > 0;
+}
+inline bool operator>=(const hobject_t& l, const hobject_t& r) {
+  return cmp(l, r) >= 0;
+}
 
 typedef uint64_t gen_t;
 typedef uint8_t shard_t;
@@ -283,6 +333,14 @@ public:
     (*this) = temp;
   }
 
+  /// see hobject_t::append_sort_key()
+  void append_sort_key(string *out) const;
+  string get_sort_key() const {
+    string out;
+    append_sort_key(&out);
+    return out;
+  }
+
   void encode(bufferlist& bl) const;
   void decode(bufferlist::iterator& bl);
   void decode(json_spirit::Value& v);
@@ -315,8 +373,36 @@ WRITE_EQ_OPERATORS_3(ghobject_t, hobj, shard_id, generation)
 // Two objects which differ by generation are more related than
 // two objects of the same generation which differ by shard.
 // 
-WRITE_CMP_OPERATORS_3(ghobject_t,
-		      hobj,
-		      shard_id,
-		      generation)
+inline int cmp(const ghobject_t& l, const ghobject_t& r)
+{
+  int c = cmp(l.hobj, r.hobj);
+  if (c)
+    return c;
+  if (l.shard_id != r.shard_id)
+    return l.shard_id < r.shard_id ? -1 : 1;
+  if (l.generation != r.generation)
+    return l.generation < r.generation ? -1 : 1;
+  return 0;
+}
+inline bool operator<(const ghobject_t& l, const ghobject_t& r) {
+  return cmp(l, r) < 0;
+}
+inline bool operator<=(const ghobject_t& l, const ghobject_t& r) {
+  return cmp(l, r) <= 0;
+}
+inline bool operator>(const ghobject_t& l, const ghobject_t& r) {
+  return cmp(l, r) > 0;
+}
+inline bool operator>=(const ghobject_t& l, const ghobject_t& r) {
+  return cmp(l, r) >= 0;
+}
+
+/**
+ * sort objects by their sort keys, computing each key once
+ *
+ * Same result as std::sort(v.begin(), v.end()), but cheaper for long
+ * lists.
+ */
+void sort_by_key(vector<hobject_t> &v);
+void sort_by_key(vector<ghobject_t> &v);
 #endif
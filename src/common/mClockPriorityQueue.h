@@ -0,0 +1,401 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef MCLOCK_PRIORITY_QUEUE_H
+#define MCLOCK_PRIORITY_QUEUE_H
+
+#include "common/Clock.h"
+#include "common/Formatter.h"
+#include "common/OpQueue.h"
+#include "include/assert.h"
+
+#include <algorithm>
+#include <float.h>
+#include <map>
+#include <utility>
+#include <list>
+
+/// the share of a server one client class is entitled to, in ops/sec
+struct mClockClientInfo {
+  double reservation;  ///< minimum rate, 0 for none
+  double weight;       ///< proportional share of what is left over, > 0
+  double limit;        ///< maximum rate, 0 for none
+
+  mClockClientInfo(double r = 0, double w = 1, double l = 0)
+    : reservation(r), weight(w), limit(l) {}
+};
+
+/**
+ * Schedules the classes K of a queue by reservation, weight and limit
+ * (mClock), optionally across servers (dmClock).
+ *
+ * Each request is tagged on arrival with
+ *
+ *   R = max(R' + rho / reservation, now)
+ *   P = max(P' + delta / weight, now)
+ *   L = max(L' + delta / limit, now)
+ *
+ * where R', P', L' are the tags of the class's previous request and
+ * delta = rho = 1 unless the client reports how much it got elsewhere
+ * (enqueue_distributed).  On dequeue, the class with the smallest R
+ * tag that is due is served first, so reservations are met.  Failing
+ * that, the class with the smallest P tag among those whose L tag is
+ * due is served, and its pending R tags are moved back by one
+ * reservation interval since the op did not count against it.
+ * Classes over their limit are held back even if the queue is
+ * otherwise idle; can_dequeue() tells when the next one is due.
+ *
+ * Items queued with enqueue_strict go ahead of all of this in strict
+ * priority order, as in PrioritizedQueue.  The parameters of a class
+ * are looked up through the function given to the constructor when the
+ * class is first seen.  Costs are not used: every op counts as one.
+ */
+template <typename T, typename K>
+class mClockQueue : public OpQueue<T, K> {
+public:
+  typedef mClockClientInfo (*client_info_func_t)(const K &cl, void *arg);
+
+private:
+  struct Tags {
+    double r, p, l;
+    Tags() : r(0), p(0), l(0) {}
+  };
+
+  struct Request {
+    Tags tag;
+    T item;
+    Request(const Tags &t, const T &i) : tag(t), item(i) {}
+  };
+
+  struct Client {
+    mClockClientInfo info;
+    Tags prev;           ///< tags of the most recent arrival
+    list<Request> q;
+  };
+
+  CephContext *cct;
+  client_info_func_t client_info;
+  void *client_info_arg;
+
+  map<K, Client> clients;
+  unsigned num_queued;
+  map<unsigned, list<pair<K, T> > > high_queue;
+  unsigned num_high;
+
+  uint64_t num_reservation, num_weight, num_over_limit;
+  unsigned dequeues_since_trim;
+
+  /// a point in time no tag will ever reach
+  static double never() { return DBL_MAX; }
+
+  Client &get_client(const K &cl) {
+    typename map<K, Client>::iterator p = clients.find(cl);
+    if (p != clients.end())
+      return p->second;
+    Client &c = clients[cl];
+    if (client_info)
+      c.info = client_info(cl, client_info_arg);
+    if (c.info.weight <= 0)
+      c.info.weight = 1;
+    return c;
+  }
+
+  Tags next_tags(Client &c, double now, unsigned delta, unsigned rho) {
+    Tags t;
+    if (c.info.reservation > 0)
+      t.r = std::max(c.prev.r + (double)rho / c.info.reservation, now);
+    else
+      t.r = never();
+    t.p = std::max(c.prev.p + (double)delta / c.info.weight, now);
+    if (c.info.limit > 0)
+      t.l = std::max(c.prev.l + (double)delta / c.info.limit, now);
+    else
+      t.l = now;
+    return t;
+  }
+
+  void _enqueue(const K &cl, T item, unsigned delta, unsigned rho) {
+    Client &c = get_client(cl);
+    c.prev = next_tags(c, (double)ceph_clock_now(cct), delta, rho);
+    c.q.push_back(Request(c.prev, item));
+    ++num_queued;
+  }
+
+  /// pick the class to serve at @now, preferring reservations
+  Client *pick(double now, bool *reservation) {
+    Client *best = NULL;
+    for (typename map<K, Client>::iterator p = clients.begin();
+	 p != clients.end();
+	 ++p) {
+      if (p->second.q.empty())
+	continue;
+      const Tags &t = p->second.q.front().tag;
+      if (t.r <= now && (!best || t.r < best->q.front().tag.r))
+	best = &p->second;
+    }
+    if (best) {
+      *reservation = true;
+      return best;
+    }
+    for (typename map<K, Client>::iterator p = clients.begin();
+	 p != clients.end();
+	 ++p) {
+      if (p->second.q.empty())
+	continue;
+      const Tags &t = p->second.q.front().tag;
+      if (t.l <= now && (!best || t.p < best->q.front().tag.p))
+	best = &p->second;
+    }
+    *reservation = false;
+    return best;
+  }
+
+  /// forget idle classes whose tags no longer carry any history
+  void trim(double now) {
+    for (typename map<K, Client>::iterator p = clients.begin();
+	 p != clients.end();
+	 ) {
+      const Tags &t = p->second.prev;
+      if (p->second.q.empty() &&
+	  (t.r <= now || t.r == never()) && t.p <= now && t.l <= now)
+	clients.erase(p++);
+      else
+	++p;
+    }
+  }
+
+  template <class F>
+  static unsigned filter_list(list<Request> *l, F &f, list<T> *out) {
+    unsigned ret = 0;
+    for (typename list<Request>::iterator i = l->begin(); i != l->end(); ) {
+      if (f(i->item)) {
+	if (out)
+	  out->push_back(i->item);
+	l->erase(i++);
+	++ret;
+      } else {
+	++i;
+      }
+    }
+    return ret;
+  }
+
+public:
+  mClockQueue(CephContext *cct, client_info_func_t f = NULL, void *arg = NULL)
+    : cct(cct), client_info(f), client_info_arg(arg),
+      num_queued(0), num_high(0),
+      num_reservation(0), num_weight(0), num_over_limit(0),
+      dequeues_since_trim(0)
+  {}
+
+  unsigned length() {
+    return num_queued + num_high;
+  }
+
+  bool empty() {
+    return num_queued == 0 && num_high == 0;
+  }
+
+  void remove_by_filter(typename OpQueue<T, K>::Filter &f,
+			list<T> *removed = 0) {
+    for (typename map<unsigned, list<pair<K, T> > >::iterator i =
+	   high_queue.begin();
+	 i != high_queue.end();
+	 ) {
+      for (typename list<pair<K, T> >::iterator j = i->second.begin();
+	   j != i->second.end();
+	   ) {
+	if (f(j->second)) {
+	  if (removed)
+	    removed->push_back(j->second);
+	  i->second.erase(j++);
+	  --num_high;
+	} else {
+	  ++j;
+	}
+      }
+      if (i->second.empty())
+	high_queue.erase(i++);
+      else
+	++i;
+    }
+    for (typename map<K, Client>::iterator i = clients.begin();
+	 i != clients.end();
+	 ++i)
+      num_queued -= filter_list(&i->second.q, f, removed);
+  }
+
+  void remove_by_class(K k, list<T> *out = 0) {
+    for (typename map<unsigned, list<pair<K, T> > >::iterator i =
+	   high_queue.begin();
+	 i != high_queue.end();
+	 ) {
+      for (typename list<pair<K, T> >::iterator j = i->second.begin();
+	   j != i->second.end();
+	   ) {
+	if (j->first == k) {
+	  if (out)
+	    out->push_back(j->second);
+	  i->second.erase(j++);
+	  --num_high;
+	} else {
+	  ++j;
+	}
+      }
+      if (i->second.empty())
+	high_queue.erase(i++);
+      else
+	++i;
+    }
+    typename map<K, Client>::iterator i = clients.find(k);
+    if (i == clients.end())
+      return;
+    num_queued -= i->second.q.size();
+    if (out) {
+      for (typename list<Request>::iterator j = i->second.q.begin();
+	   j != i->second.q.end();
+	   ++j)
+	out->push_back(j->item);
+    }
+    i->second.q.clear();
+  }
+
+  void enqueue_strict(K cl, unsigned priority, T item) {
+    high_queue[priority].push_back(make_pair(cl, item));
+    ++num_high;
+  }
+
+  void enqueue_strict_front(K cl, unsigned priority, T item) {
+    high_queue[priority].push_front(make_pair(cl, item));
+    ++num_high;
+  }
+
+  void enqueue(K cl, unsigned priority, unsigned cost, T item) {
+    _enqueue(cl, item, 1, 1);
+  }
+
+  void enqueue_distributed(K cl, unsigned priority, unsigned cost,
+			   T item, unsigned delta, unsigned rho) {
+    delta = std::max(delta, 1u);
+    _enqueue(cl, item, delta, std::min(std::max(rho, 1u), delta));
+  }
+
+  /**
+   * Put an item back in front of its class.  It was charged when it
+   * was first dequeued, so it reuses the tags of whatever it now goes
+   * ahead of instead of advancing them.
+   */
+  void enqueue_front(K cl, unsigned priority, unsigned cost, T item) {
+    Client &c = get_client(cl);
+    Tags t;
+    if (!c.q.empty()) {
+      t = c.q.front().tag;
+    } else {
+      double now = (double)ceph_clock_now(cct);
+      t.r = c.info.reservation > 0 ? std::max(c.prev.r, now) : never();
+      t.p = std::max(c.prev.p, now);
+      t.l = std::max(c.prev.l, now);
+    }
+    c.q.push_front(Request(t, item));
+    ++num_queued;
+  }
+
+  bool can_dequeue(utime_t now, utime_t *next) {
+    if (num_high)
+      return true;
+    double n = (double)now;
+    double first = never();
+    for (typename map<K, Client>::iterator p = clients.begin();
+	 p != clients.end();
+	 ++p) {
+      if (p->second.q.empty())
+	continue;
+      const Tags &t = p->second.q.front().tag;
+      if (t.r <= n || t.l <= n)
+	return true;
+      first = std::min(first, std::min(t.r, t.l));
+    }
+    if (first != never() && next)
+      next->set_from_double(first);
+    return false;
+  }
+
+  T dequeue() {
+    return dequeue(ceph_clock_now(cct));
+  }
+
+  T dequeue(utime_t when) {
+    assert(!empty());
+
+    if (!high_queue.empty()) {
+      T ret = high_queue.rbegin()->second.front().second;
+      high_queue.rbegin()->second.pop_front();
+      if (high_queue.rbegin()->second.empty())
+	high_queue.erase(high_queue.rbegin()->first);
+      --num_high;
+      return ret;
+    }
+
+    double now = (double)when;
+    bool reservation;
+    Client *c = pick(now, &reservation);
+    if (!c) {
+      // a caller that did not check can_dequeue(); serve whoever is
+      // due soonest over its limit rather than fail
+      for (typename map<K, Client>::iterator p = clients.begin();
+	   p != clients.end();
+	   ++p) {
+	if (!p->second.q.empty() &&
+	    (!c || p->second.q.front().tag.l < c->q.front().tag.l))
+	  c = &p->second;
+      }
+      assert(c);
+      reservation = false;
+      ++num_over_limit;
+    }
+
+    T ret = c->q.front().item;
+    c->q.pop_front();
+    --num_queued;
+    if (reservation) {
+      ++num_reservation;
+    } else {
+      ++num_weight;
+      if (c->info.reservation > 0) {
+	double adj = 1.0 / c->info.reservation;
+	for (typename list<Request>::iterator i = c->q.begin();
+	     i != c->q.end();
+	     ++i)
+	  i->tag.r -= adj;
+	c->prev.r -= adj;
+      }
+    }
+
+    if (++dequeues_since_trim >= 1000) {
+      dequeues_since_trim = 0;
+      trim(now);
+    }
+    return ret;
+  }
+
+  void dump(Formatter *f) const {
+    f->dump_string("type", "mclock");
+    f->dump_int("num_clients", clients.size());
+    f->dump_int("queued", num_queued);
+    f->dump_int("queued_strict", num_high);
+    f->dump_unsigned("served_reservation", num_reservation);
+    f->dump_unsigned("served_weight", num_weight);
+    f->dump_unsigned("served_over_limit", num_over_limit);
+  }
+};
+
+#endif
@@ -0,0 +1,77 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/mempool.h"
+#include "common/Formatter.h"
+#include "include/assert.h"
+
+namespace mempool {
+
+// zero initialized before any constructor runs, so static objects
+// may allocate accounted memory
+static pool_t pools[num_pools];
+
+static const char *pool_names[] = {
+#define MEMPOOL_NAME(x) #x,
+  MEMPOOL_LIST(MEMPOOL_NAME)
+#undef MEMPOOL_NAME
+};
+
+const char *get_pool_name(pool_index_t ix)
+{
+  assert(ix < num_pools);
+  return pool_names[ix];
+}
+
+pool_t& get_pool(pool_index_t ix)
+{
+  return pools[ix];
+}
+
+int64_t pool_t::allocated_bytes() const
+{
+  int64_t r = 0;
+  for (unsigned i = 0; i < MEMPOOL_SHARDS; i++)
+    r += shard[i].bytes;
+  return r < 0 ? 0 : r;
+}
+
+int64_t pool_t::allocated_items() const
+{
+  int64_t r = 0;
+  for (unsigned i = 0; i < MEMPOOL_SHARDS; i++)
+    r += shard[i].items;
+  return r < 0 ? 0 : r;
+}
+
+void dump(ceph::Formatter *f)
+{
+  int64_t total_bytes = 0, total_items = 0;
+  f->open_object_section("mempool");
+  for (int i = 0; i < num_pools; i++) {
+    int64_t bytes = pools[i].allocated_bytes();
+    int64_t items = pools[i].allocated_items();
+    f->open_object_section(pool_names[i]);
+    f->dump_int("bytes", bytes);
+    f->dump_int("items", items);
+    f->close_section();
+    total_bytes += bytes;
+    total_items += items;
+  }
+  f->open_object_section("total");
+  f->dump_int("bytes", total_bytes);
+  f->dump_int("items", total_items);
+  f->close_section();
+  f->close_section();
+}
+
+}
@@ -0,0 +1,176 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MEMPOOL_H
+#define CEPH_MEMPOOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+
+namespace ceph {
+  class Formatter;
+}
+
+/**
+ * memory accounting by subsystem
+ *
+ * Each pool counts the bytes and items some subsystem has allocated,
+ * so that we can tell where the memory of a daemon went (pg logs,
+ * object contexts, osdmaps, message buffers, ...) without a heap
+ * profiler.  Nothing is allocated from a pool; the allocation still
+ * comes from the heap, and the pool only does the bookkeeping.
+ *
+ * Memory is charged to a pool by
+ *  - a pool_allocator<> given to an STL container,
+ *  - MEMPOOL_CLASS_HELPERS() in a class, for its operator new/delete,
+ *  - buffer::raw, which belongs to buffer_anon until it is reassigned
+ *    with reassign_to_mempool(),
+ *  - adjust_count() for anything else.
+ *
+ * The counters are sharded by thread to keep them off each other's
+ * cache lines; reading them sums the shards, and is only approximate
+ * while they are being updated.
+ */
+namespace mempool {
+
+#define MEMPOOL_LIST(f)				\
+  f(buffer_anon)				\
+  f(buffer_msg)					\
+  f(osd_pglog)					\
+  f(osd_obc)					\
+  f(osdmap)					\
+  f(osdmap_bl)
+
+enum pool_index_t {
+#define MEMPOOL_ENUM(x) mempool_##x,
+  MEMPOOL_LIST(MEMPOOL_ENUM)
+#undef MEMPOOL_ENUM
+  num_pools
+};
+
+const char *get_pool_name(pool_index_t ix);
+
+#define MEMPOOL_SHARDS 32
+
+struct shard_t {
+  int64_t bytes;
+  int64_t items;
+  char pad[64 - 2 * sizeof(int64_t)];
+};
+
+/// pick the shard for the calling thread
+inline size_t pick_shard() {
+  size_t me = (size_t)pthread_self();
+  // thread descriptors are far apart and aligned; fold the high bits in
+  me ^= me >> 21;
+  me ^= me >> 12;
+  return me & (MEMPOOL_SHARDS - 1);
+}
+
+/// the counters of one pool; a POD, so the static ones need no constructor
+struct pool_t {
+  shard_t shard[MEMPOOL_SHARDS];
+
+  void adjust_count(int64_t items, int64_t bytes) {
+    shard_t *s = &shard[pick_shard()];
+    __sync_fetch_and_add(&s->items, items);
+    __sync_fetch_and_add(&s->bytes, bytes);
+  }
+
+  int64_t allocated_bytes() const;
+  int64_t allocated_items() const;
+};
+
+pool_t& get_pool(pool_index_t ix);
+
+/// dump the bytes and items of every pool, and the totals
+void dump(ceph::Formatter *f);
+
+/// STL allocator charging its allocations to pool ix
+template<pool_index_t ix, typename T>
+class pool_allocator {
+public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template<typename U> struct rebind {
+    typedef pool_allocator<ix, U> other;
+  };
+
+  pool_allocator() {}
+  pool_allocator(const pool_allocator&) {}
+  template<typename U>
+  pool_allocator(const pool_allocator<ix, U>&) {}
+
+  pointer address(reference x) const {
+    return &x;
+  }
+  const_pointer address(const_reference x) const {
+    return &x;
+  }
+
+  pointer allocate(size_type n, const void * = 0) {
+    size_t total = sizeof(T) * n;
+    pointer r = reinterpret_cast<pointer>(::operator new(total));
+    get_pool(ix).adjust_count(n, total);
+    return r;
+  }
+  void deallocate(pointer p, size_type n) {
+    ::operator delete(p);
+    get_pool(ix).adjust_count(-(int64_t)n, -(int64_t)(sizeof(T) * n));
+  }
+
+  size_type max_size() const {
+    return (size_type)-1 / sizeof(T);
+  }
+  void construct(pointer p, const T& val) {
+    new ((void *)p) T(val);
+  }
+  void destroy(pointer p) {
+    p->~T();
+  }
+};
+
+template<pool_index_t ix, typename T, typename U>
+inline bool operator==(const pool_allocator<ix, T>&,
+		       const pool_allocator<ix, U>&) {
+  return true;
+}
+
+template<pool_index_t ix, typename T, typename U>
+inline bool operator!=(const pool_allocator<ix, T>&,
+		       const pool_allocator<ix, U>&) {
+  return false;
+}
+
+}
+
+/// class specific operator new/delete charging the class to pool ix
+#define MEMPOOL_CLASS_HELPERS(ix)					\
+  static void *operator new(size_t num_bytes) {				\
+    void *p = ::operator new(num_bytes);				\
+    mempool::get_pool(mempool::ix).adjust_count(1, num_bytes);		\
+    return p;								\
+  }									\
+  static void operator delete(void *p, size_t num_bytes) {		\
+    ::operator delete(p);						\
+    mempool::get_pool(mempool::ix).adjust_count(-1, -(int64_t)num_bytes); \
+  }
+
+#endif
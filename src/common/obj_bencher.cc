@@ -26,6 +26,8 @@
 #include <time.h>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <math.h>
 
 
 const std::string BENCH_LASTRUN_METADATA = "benchmark_last_metadata";
@@ -69,6 +71,72 @@ static void sanitize_object_contents (bench_data *data, int length) {
   memset(data->object_contents, 'z', length);
 }
 
+/// the value below which fraction p of v lies; sorts v
+static double vec_percentile(vector<double>& v, double p)
+{
+  if (v.empty())
+    return 0;
+  sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1) + .5)];
+}
+
+/**
+ * latencies counted in log scale buckets, 20 per decade from 10us up
+ *
+ * Good to about 12%, and small enough for every client of a run to
+ * publish its own so that the percentiles of the whole run can be
+ * worked out.
+ */
+struct bench_latency_histogram {
+  vector<uint64_t> buckets;
+
+  static const double MIN_LATENCY;
+  static const int BUCKETS_PER_DECADE = 20;
+  static const int MAX_BUCKETS = 200;
+
+  void add(double lat) {
+    int b = 0;
+    if (lat > MIN_LATENCY)
+      b = (int)ceil(log10(lat / MIN_LATENCY) * BUCKETS_PER_DECADE);
+    if (b >= MAX_BUCKETS)
+      b = MAX_BUCKETS - 1;
+    if ((int)buckets.size() <= b)
+      buckets.resize(b + 1);
+    ++buckets[b];
+  }
+  void merge(const bench_latency_histogram& o) {
+    if (buckets.size() < o.buckets.size())
+      buckets.resize(o.buckets.size());
+    for (unsigned b = 0; b < o.buckets.size(); ++b)
+      buckets[b] += o.buckets[b];
+  }
+  /// upper bound of the bucket fraction p of the samples fall in
+  double percentile(double p) const {
+    uint64_t total = 0;
+    for (unsigned b = 0; b < buckets.size(); ++b)
+      total += buckets[b];
+    if (!total)
+      return 0;
+    uint64_t want = (uint64_t)ceil(p * total);
+    uint64_t seen = 0;
+    unsigned b = 0;
+    for (; b < buckets.size(); ++b) {
+      seen += buckets[b];
+      if (seen >= want)
+	break;
+    }
+    return MIN_LATENCY * pow(10, (double)b / BUCKETS_PER_DECADE);
+  }
+  void encode(bufferlist& bl) const {
+    ::encode(buckets, bl);
+  }
+  void decode(bufferlist::iterator& p) {
+    ::decode(buckets, p);
+  }
+};
+const double bench_latency_histogram::MIN_LATENCY = .00001;
+WRITE_CLASS_ENCODER(bench_latency_histogram)
+
 ostream& ObjBencher::out(ostream& os, utime_t& t)
 {
   if (show_time)
@@ -97,7 +165,7 @@ void *ObjBencher::status_printer(void *_bencher) {
   while(!data.done) {
     utime_t cur_time = ceph_clock_now(bencher->cct);
 
-    if (i % 20 == 0) {
+    if (!bencher->formatter && i % 20 == 0) {
       if (i > 0)
 	cur_time.localtime(cout) << "min lat: " << data.min_latency
 	     << " max lat: " << data.max_latency
@@ -132,9 +200,30 @@ void *ObjBencher::status_printer(void *_bencher) {
 
     double avg_bandwidth = (double) (data.trans_size) * (data.finished)
       / (double)(cur_time - data.start_time) / (1024*1024);
-    if (previous_writes != data.finished) {
+    bool progressed = previous_writes != data.finished;
+    if (progressed) {
       previous_writes = data.finished;
       cycleSinceChange = 0;
+    }
+    if (bencher->formatter) {
+      Formatter *f = bencher->formatter;
+      f->open_object_section("status");
+      f->dump_int("sec", i);
+      f->dump_int("cur_ops", data.in_flight);
+      f->dump_int("started", data.started);
+      f->dump_int("finished", data.finished);
+      f->dump_float("avg_MBps", avg_bandwidth);
+      f->dump_float("cur_MBps", bandwidth);
+      f->dump_float("last_lat", progressed ? (double)data.cur_latency : 0);
+      f->dump_float("avg_lat", data.avg_latency);
+      f->dump_int("ops", data.interval_latency.size());
+      f->dump_float("p50_lat", vec_percentile(data.interval_latency, .5));
+      f->dump_float("p99_lat", vec_percentile(data.interval_latency, .99));
+      f->dump_float("p999_lat", vec_percentile(data.interval_latency, .999));
+      f->close_section();
+      f->flush(cout);
+      cout << std::endl;
+    } else if (progressed) {
       bencher->out(cout, cur_time) << setfill(' ')
 	   << setw(5) << i
 	   << setw(8) << data.in_flight
@@ -156,6 +245,7 @@ void *ObjBencher::status_printer(void *_bencher) {
 	   << setw(10) << '-'
 	   << setw(10) << data.avg_latency << std::endl;
     }
+    data.interval_latency.clear();
     ++i;
     ++cycleSinceChange;
     cond.WaitInterval(bencher->cct, bencher->lock, ONE_SECOND);
@@ -187,16 +277,27 @@ int ObjBencher::aio_bench(
     object_size = op_size;
   }
 
+  if (operation == OP_MIXED && (read_percent < 0 || read_percent > 100)) {
+    cerr << "read percentage must be between 0 and 100" << std::endl;
+    delete[] contentsChars;
+    return -EINVAL;
+  }
+
   lock.Lock();
   data.done = false;
   data.object_size = object_size;
-  data.trans_size = op_size;
+  // reads are always of whole objects
+  data.trans_size = operation == OP_WRITE ? op_size : object_size;
   data.in_flight = 0;
   data.started = 0;
   data.finished = num_objects;
   data.min_latency = 9999.0; // this better be higher than initial latency!
   data.max_latency = 0;
   data.avg_latency = 0;
+  data.total_latency = 0;
+  data.interval_latency.clear();
+  data.history.bandwidth.clear();
+  data.history.latency.clear();
   data.idata.min_bandwidth = 99999999.0;
   data.idata.max_bandwidth = 0;
   data.object_contents = contentsChars;
@@ -205,6 +306,12 @@ int ObjBencher::aio_bench(
   //fill in contentsChars deterministically so we can check returns
   sanitize_object_contents(&data, data.object_size);
 
+  if (!run_name.empty()) {
+    r = wait_for_clients();
+    if (r < 0)
+      goto out;
+  }
+
   if (OP_WRITE == operation) {
     r = write_bench(secondsToRun, maxObjectsToCreate, concurrentios);
     if (r != 0) goto out;
@@ -214,12 +321,23 @@ int ObjBencher::aio_bench(
     if (r != 0) goto out;
   }
   else if (OP_RAND_READ == operation) {
-    cerr << "Random test not implemented yet!" << std::endl;
-    r = -1;
+    r = rand_read_bench(secondsToRun, num_objects, concurrentios, prevPid, 100);
+    if (r != 0) goto out;
+  }
+  else if (OP_MIXED == operation) {
+    r = rand_read_bench(secondsToRun, num_objects, concurrentios, prevPid, read_percent);
+    if (r != 0) goto out;
+  }
+
+  if (!run_name.empty()) {
+    r = report_run(operation);
+    if (r < 0)
+      goto out;
   }
 
   if (OP_WRITE == operation && cleanup) {
-    r = fetch_bench_metadata(BENCH_LASTRUN_METADATA, &object_size, &num_objects, &prevPid);
+    // the last run may be another client's by now; clean up our own
+    r = fetch_bench_metadata(generate_metadata_name(), &object_size, &num_objects, &prevPid);
     if (r < 0) {
       if (r == -ENOENT)
 	cerr << "Should never happen: bench metadata missing for current run!" << std::endl;
@@ -229,9 +347,9 @@ int ObjBencher::aio_bench(
     r = clean_up(num_objects, prevPid, concurrentios);
     if (r != 0) goto out;
 
-    // lastrun file
+    // lastrun file, unless another client of the run got to it first
     r = sync_remove(BENCH_LASTRUN_METADATA);
-    if (r != 0) goto out;
+    if (r != 0 && r != -ENOENT) goto out;
 
     // prefix-based file
     r = sync_remove(generate_metadata_name());
@@ -242,6 +360,20 @@ int ObjBencher::aio_bench(
   return r;
 }
 
+void ObjBencher::finish_op(utime_t latency)
+{
+  assert(lock.is_locked());
+  data.cur_latency = latency;
+  data.history.latency.push_back(latency);
+  data.interval_latency.push_back(latency);
+  data.total_latency += latency;
+  if (latency > data.max_latency) data.max_latency = latency;
+  if (latency < data.min_latency) data.min_latency = latency;
+  ++data.finished;
+  data.avg_latency = data.total_latency / data.finished;
+  --data.in_flight;
+}
+
 struct lock_cond {
   lock_cond(Mutex *_lock) : lock(_lock) {}
   Mutex *lock;
@@ -303,7 +435,8 @@ int ObjBencher::write_bench(int secondsToRun, int maxObjectsToCreate,
 			    int concurrentios) {
   if (maxObjectsToCreate > 0 && concurrentios > maxObjectsToCreate)
     concurrentios = maxObjectsToCreate;
-  out(cout) << "Maintaining " << concurrentios << " concurrent writes of "
+  // keep stdout parseable when it carries formatted output
+  out(formatter ? cerr : cout) << "Maintaining " << concurrentios << " concurrent writes of "
 	    << data.object_size << " bytes for up to "
 	    << secondsToRun << " seconds or "
 	    << maxObjectsToCreate << " objects"
@@ -311,12 +444,11 @@ int ObjBencher::write_bench(int secondsToRun, int maxObjectsToCreate,
   bufferlist* newContents = 0;
 
   std::string prefix = generate_object_prefix();
-  out(cout) << "Object prefix: " << prefix << std::endl;
+  out(formatter ? cerr : cout) << "Object prefix: " << prefix << std::endl;
 
   std::vector<string> name(concurrentios);
   std::string newName;
   bufferlist* contents[concurrentios];
-  double total_latency = 0;
   std::vector<utime_t> start_times(concurrentios);
   utime_t stopTime;
   int r = 0;
@@ -397,14 +529,7 @@ int ObjBencher::write_bench(int secondsToRun, int maxObjectsToCreate,
       lock.Unlock();
       goto ERR;
     }
-    data.cur_latency = ceph_clock_now(cct) - start_times[slot];
-    data.history.latency.push_back(data.cur_latency);
-    total_latency += data.cur_latency;
-    if( data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
-    if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
-    ++data.finished;
-    data.avg_latency = total_latency / data.finished;
-    --data.in_flight;
+    finish_op(ceph_clock_now(cct) - start_times[slot]);
     lock.Unlock();
     release_completion(slot);
     timePassed = ceph_clock_now(cct) - data.start_time;
@@ -438,14 +563,7 @@ int ObjBencher::write_bench(int secondsToRun, int maxObjectsToCreate,
       lock.Unlock();
       goto ERR;
     }
-    data.cur_latency = ceph_clock_now(cct) - start_times[slot];
-    data.history.latency.push_back(data.cur_latency);
-    total_latency += data.cur_latency;
-    if (data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
-    if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
-    ++data.finished;
-    data.avg_latency = total_latency / data.finished;
-    --data.in_flight;
+    finish_op(ceph_clock_now(cct) - start_times[slot]);
     lock.Unlock();
     release_completion(slot);
     delete contents[slot];
@@ -453,6 +571,7 @@ int ObjBencher::write_bench(int secondsToRun, int maxObjectsToCreate,
 
   timePassed = ceph_clock_now(cct) - data.start_time;
   lock.Lock();
+  data.run_time = timePassed;
   data.done = true;
   lock.Unlock();
 
@@ -464,17 +583,22 @@ int ObjBencher::write_bench(int secondsToRun, int maxObjectsToCreate,
   char bw[20];
   snprintf(bw, sizeof(bw), "%.3lf \n", bandwidth);
 
-  out(cout) << "Total time run:         " << timePassed << std::endl
-       << "Total writes made:      " << data.finished << std::endl
-       << "Write size:             " << data.object_size << std::endl
-       << "Bandwidth (MB/sec):     " << bw << std::endl
-       << "Stddev Bandwidth:       " << vec_stddev(data.history.bandwidth) << std::endl
-       << "Max bandwidth (MB/sec): " << data.idata.max_bandwidth << std::endl
-       << "Min bandwidth (MB/sec): " << data.idata.min_bandwidth << std::endl
-       << "Average Latency:        " << data.avg_latency << std::endl
-       << "Stddev Latency:         " << vec_stddev(data.history.latency) << std::endl
-       << "Max latency:            " << data.max_latency << std::endl
-       << "Min latency:            " << data.min_latency << std::endl;
+  if (formatter) {
+    dump_summary("write", 0, data.finished);
+  } else {
+    out(cout) << "Total time run:         " << timePassed << std::endl
+         << "Total writes made:      " << data.finished << std::endl
+         << "Write size:             " << data.object_size << std::endl
+         << "Bandwidth (MB/sec):     " << bw << std::endl
+         << "Stddev Bandwidth:       " << vec_stddev(data.history.bandwidth) << std::endl
+         << "Max bandwidth (MB/sec): " << data.idata.max_bandwidth << std::endl
+         << "Min bandwidth (MB/sec): " << data.idata.min_bandwidth << std::endl
+         << "Average Latency:        " << data.avg_latency << std::endl
+         << "Stddev Latency:         " << vec_stddev(data.history.latency) << std::endl
+         << "Max latency:            " << data.max_latency << std::endl
+         << "Min latency:            " << data.min_latency << std::endl;
+    print_percentiles(cout);
+  }
 
   //write object size/number data for read benchmarks
   ::encode(data.object_size, b_write);
@@ -511,7 +635,6 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
   std::vector<utime_t> start_times(concurrentios);
   utime_t time_to_run;
   time_to_run.set_from_double(seconds_to_run);
-  double total_latency = 0;
   int r = 0;
   utime_t runtime;
   sanitize_object_contents(&data, data.object_size); //clean it up once; subsequent
@@ -590,13 +713,7 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
       lock.Unlock();
       goto ERR;
     }
-    data.cur_latency = ceph_clock_now(cct) - start_times[slot];
-    total_latency += data.cur_latency;
-    if( data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
-    if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
-    ++data.finished;
-    data.avg_latency = total_latency / data.finished;
-    --data.in_flight;
+    finish_op(ceph_clock_now(cct) - start_times[slot]);
     lock.Unlock();
     release_completion(slot);
     cur_contents = contents[slot];
@@ -633,13 +750,7 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
       lock.Unlock();
       goto ERR;
     }
-    data.cur_latency = ceph_clock_now(cct) - start_times[slot];
-    total_latency += data.cur_latency;
-    if (data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
-    if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
-    ++data.finished;
-    data.avg_latency = total_latency / data.finished;
-    --data.in_flight;
+    finish_op(ceph_clock_now(cct) - start_times[slot]);
     release_completion(slot);
     snprintf(data.object_contents, data.object_size, "I'm the %16dth object!", index[slot]);
     lock.Unlock();
@@ -652,6 +763,7 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
 
   runtime = ceph_clock_now(cct) - data.start_time;
   lock.Lock();
+  data.run_time = runtime;
   data.done = true;
   lock.Unlock();
 
@@ -663,13 +775,20 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
   char bw[20];
   snprintf(bw, sizeof(bw), "%.3lf \n", bandwidth);
 
-  out(cout) << "Total time run:        " << runtime << std::endl
-       << "Total reads made:     " << data.finished << std::endl
-       << "Read size:            " << data.object_size << std::endl
-       << "Bandwidth (MB/sec):    " << bw << std::endl
-       << "Average Latency:       " << data.avg_latency << std::endl
-       << "Max latency:           " << data.max_latency << std::endl
-       << "Min latency:           " << data.min_latency << std::endl;
+  if (formatter) {
+    dump_summary("seq", data.finished, 0);
+  } else {
+    out(cout) << "Total time run:        " << runtime << std::endl
+         << "Total reads made:     " << data.finished << std::endl
+         << "Read size:            " << data.object_size << std::endl
+         << "Bandwidth (MB/sec):    " << bw << std::endl
+         << "Average Latency:       " << data.avg_latency << std::endl
+         << "Max latency:           " << data.max_latency << std::endl
+         << "Min latency:           " << data.min_latency << std::endl;
+    print_percentiles(cout);
+  }
+  if (errors)
+    cerr << errors << " objects were not correct" << std::endl;
 
   completions_done();
 
@@ -683,6 +802,390 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
   return -5;
 }
 
+int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurrentios, int pid, int read_percent)
+{
+  lock_cond lc(&lock);
+  bufferlist* contents[concurrentios];
+  int index[concurrentios];
+  bool writing[concurrentios];
+  bool busy[concurrentios];
+  int busy_slots = 0;
+  int reads = 0;
+  int writes = 0;
+  int errors = 0;
+  std::vector<utime_t> start_times(concurrentios);
+  utime_t time_to_run;
+  time_to_run.set_from_double(seconds_to_run);
+  int r = 0;
+  utime_t runtime;
+  int slot = 0;
+
+  if (num_objects <= 0) {
+    cerr << "no objects left from the last write run" << std::endl;
+    return -ENOENT;
+  }
+
+  out(formatter ? cerr : cout) << "Maintaining " << concurrentios
+	    << " concurrent ops on " << num_objects << " objects of "
+	    << data.object_size << " bytes, " << read_percent
+	    << "% reads, for " << seconds_to_run << " seconds" << std::endl;
+
+  r = completions_init(concurrentios);
+  if (r < 0)
+    return r;
+
+  for (int i = 0; i < concurrentios; ++i) {
+    contents[i] = NULL;
+    busy[i] = false;
+  }
+
+  lock.Lock();
+  data.finished = 0;
+  data.start_time = ceph_clock_now(cct);
+  lock.Unlock();
+
+  pthread_t print_thread;
+  pthread_create(&print_thread, NULL, status_printer, (void *)this);
+
+  utime_t finish_time = data.start_time + time_to_run;
+  while (true) {
+    bool stopping = ceph_clock_now(cct) >= finish_time;
+    if (!stopping && data.started < concurrentios) {
+      // still filling the slots up
+      slot = data.started;
+    } else {
+      if (!busy_slots)
+	break;
+      lock.Lock();
+      int old_slot = slot;
+      bool found = false;
+      while (1) {
+	do {
+	  if (busy[slot] && completion_is_done(slot)) {
+	    found = true;
+	    break;
+	  }
+	  slot++;
+	  if (slot == concurrentios) {
+	    slot = 0;
+	  }
+	} while (slot != old_slot);
+	if (found) {
+	  break;
+	}
+	lc.cond.Wait(lock);
+      }
+      lock.Unlock();
+      completion_wait(slot);
+      lock.Lock();
+      r = completion_ret(slot);
+      if (r < 0) {
+	cerr << (writing[slot] ? "write" : "read") << " got " << r << std::endl;
+	lock.Unlock();
+	goto ERR;
+      }
+      finish_op(ceph_clock_now(cct) - start_times[slot]);
+      lock.Unlock();
+      release_completion(slot);
+      busy[slot] = false;
+      --busy_slots;
+      if (writing[slot]) {
+	++writes;
+      } else {
+	++reads;
+	snprintf(data.object_contents, data.object_size, "I'm the %16dth object!", index[slot]);
+	if (contents[slot]->length() != (unsigned)data.object_size ||
+	    memcmp(data.object_contents, contents[slot]->c_str(), data.object_size) != 0) {
+	  cerr << generate_object_name(index[slot], pid) << " is not correct!" << std::endl;
+	  ++errors;
+	}
+      }
+      delete contents[slot];
+      contents[slot] = NULL;
+      if (stopping)
+	continue;
+    }
+
+    // overwrites put back what the write run wrote, so that reads
+    // of the same objects can still be checked
+    index[slot] = rand() % num_objects;
+    writing[slot] = rand() % 100 >= read_percent;
+    contents[slot] = new bufferlist();
+    if (writing[slot]) {
+      snprintf(data.object_contents, data.object_size, "I'm the %16dth object!", index[slot]);
+      contents[slot]->append(data.object_contents, data.object_size);
+    }
+    start_times[slot] = ceph_clock_now(cct);
+    r = create_completion(slot, _aio_cb, (void *)&lc);
+    if (r < 0)
+      goto ERR;
+    if (writing[slot])
+      r = aio_write(generate_object_name(index[slot], pid), slot,
+		    *contents[slot], data.object_size);
+    else
+      r = aio_read(generate_object_name(index[slot], pid), slot,
+		   contents[slot], data.object_size);
+    if (r < 0) { //naughty, doesn't clean up heap
+      cerr << "r = " << r << std::endl;
+      goto ERR;
+    }
+    busy[slot] = true;
+    ++busy_slots;
+    lock.Lock();
+    ++data.started;
+    ++data.in_flight;
+    lock.Unlock();
+  }
+
+  runtime = ceph_clock_now(cct) - data.start_time;
+  lock.Lock();
+  data.run_time = runtime;
+  data.done = true;
+  lock.Unlock();
+
+  pthread_join(print_thread, NULL);
+
+  if (formatter) {
+    dump_summary(read_percent == 100 ? "rand" : "mixed", reads, writes);
+  } else {
+    double bandwidth;
+    bandwidth = ((double)data.finished)*((double)data.object_size)/(double)runtime;
+    bandwidth = bandwidth/(1024*1024); // we want it in MB/sec
+    char bw[20];
+    snprintf(bw, sizeof(bw), "%.3lf \n", bandwidth);
+
+    out(cout) << "Total time run:         " << runtime << std::endl
+	      << "Total reads made:       " << reads << std::endl
+	      << "Total writes made:      " << writes << std::endl
+	      << "Op size:                " << data.object_size << std::endl
+	      << "Bandwidth (MB/sec):     " << bw << std::endl
+	      << "Average IOPS:           " << (double)data.finished / (double)runtime << std::endl
+	      << "Average Latency:        " << data.avg_latency << std::endl
+	      << "Stddev Latency:         " << vec_stddev(data.history.latency) << std::endl
+	      << "Max latency:            " << data.max_latency << std::endl
+	      << "Min latency:            " << data.min_latency << std::endl;
+    print_percentiles(cout);
+  }
+  if (errors)
+    cerr << errors << " objects were not correct" << std::endl;
+
+  completions_done();
+
+  return 0;
+
+ ERR:
+  lock.Lock();
+  data.done = 1;
+  lock.Unlock();
+  pthread_join(print_thread, NULL);
+  return -5;
+}
+
+void ObjBencher::print_percentiles(ostream& os)
+{
+  os << "Latency p50:            " << vec_percentile(data.history.latency, .5) << std::endl
+     << "Latency p99:            " << vec_percentile(data.history.latency, .99) << std::endl
+     << "Latency p99.9:          " << vec_percentile(data.history.latency, .999) << std::endl;
+}
+
+void ObjBencher::dump_summary(const char *mode, int reads, int writes)
+{
+  double runtime = data.run_time;
+  double bandwidth = 0, iops = 0;
+  if (runtime > 0) {
+    iops = (double)data.finished / runtime;
+    bandwidth = iops * data.trans_size / (1024*1024);
+  }
+  formatter->open_object_section("summary");
+  formatter->dump_string("mode", mode);
+  formatter->dump_float("runtime", runtime);
+  formatter->dump_int("reads", reads);
+  formatter->dump_int("writes", writes);
+  formatter->dump_int("op_size", data.trans_size);
+  formatter->dump_float("bandwidth_MBps", bandwidth);
+  formatter->dump_float("stddev_bandwidth", vec_stddev(data.history.bandwidth));
+  formatter->dump_float("iops", iops);
+  formatter->dump_float("avg_lat", data.avg_latency);
+  formatter->dump_float("stddev_lat", vec_stddev(data.history.latency));
+  formatter->dump_float("min_lat", data.finished ? data.min_latency : 0);
+  formatter->dump_float("max_lat", data.max_latency);
+  formatter->dump_float("p50_lat", vec_percentile(data.history.latency, .5));
+  formatter->dump_float("p99_lat", vec_percentile(data.history.latency, .99));
+  formatter->dump_float("p999_lat", vec_percentile(data.history.latency, .999));
+  formatter->close_section();
+  formatter->flush(cout);
+  cout << std::endl;
+}
+
+std::string ObjBencher::run_object_name(int client, const char *what)
+{
+  std::ostringstream oss;
+  oss << BENCH_PREFIX << "_run_" << run_name << "_client" << client << "_" << what;
+  return oss.str();
+}
+
+int ObjBencher::wait_for_clients()
+{
+  // whatever an earlier run of the same name left behind is stale
+  sync_remove(run_object_name(client_id, "result"));
+
+  bufferlist bl;
+  ::encode(getpid(), bl);
+  int r = sync_write(run_object_name(client_id, "ready"), bl, bl.length());
+  if (r < 0) {
+    cerr << "could not join run " << run_name << ": " << r << std::endl;
+    return r;
+  }
+
+  out(formatter ? cerr : cout) << "Client " << client_id << " of run "
+			       << run_name << " waiting for "
+			       << num_clients << " clients" << std::endl;
+  for (int i = 0; i < num_clients; ) {
+    bufferlist in;
+    r = sync_read(run_object_name(i, "ready"), in, bl.length());
+    if (r == -ENOENT) {
+      usleep(100000);
+      continue;
+    }
+    if (r < 0)
+      return r;
+    ++i;
+  }
+  return 0;
+}
+
+static const char *bench_mode_name(int operation)
+{
+  switch (operation) {
+  case OP_WRITE: return "write";
+  case OP_SEQ_READ: return "seq";
+  case OP_RAND_READ: return "rand";
+  case OP_MIXED: return "mixed";
+  default: return "???";
+  }
+}
+
+int ObjBencher::report_run(int operation)
+{
+  bench_latency_histogram hist;
+  for (vector<double>::iterator p = data.history.latency.begin();
+       p != data.history.latency.end();
+       ++p)
+    hist.add(*p);
+
+  bufferlist bl;
+  ENCODE_START(1, 1, bl);
+  ::encode(data.finished, bl);
+  ::encode(data.trans_size, bl);
+  ::encode((double)data.run_time, bl);
+  ::encode(data.total_latency, bl);
+  ::encode(data.min_latency, bl);
+  ::encode(data.max_latency, bl);
+  ::encode(hist, bl);
+  ENCODE_FINISH(bl);
+  int r = sync_write(run_object_name(client_id, "result"), bl, bl.length());
+  if (r < 0) {
+    cerr << "could not publish the result of client " << client_id
+	 << ": " << r << std::endl;
+    return r;
+  }
+  if (client_id != 0)
+    return 0;
+
+  out(formatter ? cerr : cout) << "Waiting for the results of "
+			       << num_clients << " clients" << std::endl;
+  uint64_t ops = 0;
+  double bandwidth = 0, iops = 0, runtime = 0;
+  double total_latency = 0, min_latency = 0, max_latency = 0;
+  bench_latency_histogram all;
+  for (int i = 0; i < num_clients; ) {
+    bufferlist in;
+    r = sync_read(run_object_name(i, "result"), in, 1 << 20);
+    if (r == -ENOENT) {
+      sleep(1);
+      continue;
+    }
+    if (r < 0)
+      return r;
+
+    int finished, op_size;
+    double client_runtime, client_latency, client_min, client_max;
+    bench_latency_histogram client_hist;
+    try {
+      bufferlist::iterator p = in.begin();
+      DECODE_START(1, p);
+      ::decode(finished, p);
+      ::decode(op_size, p);
+      ::decode(client_runtime, p);
+      ::decode(client_latency, p);
+      ::decode(client_min, p);
+      ::decode(client_max, p);
+      ::decode(client_hist, p);
+      DECODE_FINISH(p);
+    } catch (buffer::error& e) {
+      cerr << "could not decode the result of client " << i << std::endl;
+      return -EIO;
+    }
+    if (finished) {
+      if (!ops || client_min < min_latency)
+	min_latency = client_min;
+      if (client_max > max_latency)
+	max_latency = client_max;
+    }
+    ops += finished;
+    if (client_runtime > 0) {
+      iops += finished / client_runtime;
+      bandwidth += (double)finished * op_size / client_runtime / (1024*1024);
+    }
+    if (client_runtime > runtime)
+      runtime = client_runtime;
+    total_latency += client_latency;
+    all.merge(client_hist);
+    ++i;
+  }
+
+  double avg_latency = ops ? total_latency / ops : 0;
+  if (formatter) {
+    formatter->open_object_section("run");
+    formatter->dump_string("name", run_name);
+    formatter->dump_string("mode", bench_mode_name(operation));
+    formatter->dump_int("clients", num_clients);
+    formatter->dump_float("runtime", runtime);
+    formatter->dump_unsigned("ops", ops);
+    formatter->dump_float("bandwidth_MBps", bandwidth);
+    formatter->dump_float("iops", iops);
+    formatter->dump_float("avg_lat", avg_latency);
+    formatter->dump_float("min_lat", min_latency);
+    formatter->dump_float("max_lat", max_latency);
+    formatter->dump_float("p50_lat", all.percentile(.5));
+    formatter->dump_float("p99_lat", all.percentile(.99));
+    formatter->dump_float("p999_lat", all.percentile(.999));
+    formatter->close_section();
+    formatter->flush(cout);
+    cout << std::endl;
+  } else {
+    out(cout) << "Run " << run_name << " of " << num_clients
+	      << " clients, " << bench_mode_name(operation) << std::endl
+	      << "Longest time run:       " << runtime << std::endl
+	      << "Total ops made:         " << ops << std::endl
+	      << "Bandwidth (MB/sec):     " << bandwidth << std::endl
+	      << "Average IOPS:           " << iops << std::endl
+	      << "Average Latency:        " << avg_latency << std::endl
+	      << "Max latency:            " << max_latency << std::endl
+	      << "Min latency:            " << min_latency << std::endl
+	      << "Latency p50:            " << all.percentile(.5) << std::endl
+	      << "Latency p99:            " << all.percentile(.99) << std::endl
+	      << "Latency p99.9:          " << all.percentile(.999) << std::endl;
+  }
+
+  // everyone got past the start line before they could publish a result
+  for (int i = 0; i < num_clients; ++i) {
+    sync_remove(run_object_name(i, "ready"));
+    sync_remove(run_object_name(i, "result"));
+  }
+  return 0;
+}
+
 int ObjBencher::clean_up(const std::string& prefix, int concurrentios) {
   int r = 0;
   int object_size;
@@ -17,6 +17,7 @@
 #include "common/config.h"
 #include "common/Cond.h"
 #include "common/ceph_context.h"
+#include "common/Formatter.h"
 
 struct bench_interval_data {
   double min_bandwidth;
@@ -39,19 +40,36 @@ struct bench_data {
   double min_latency;
   double max_latency;
   double avg_latency;
+  double total_latency; //sum of the latencies of the finished ops
+  vector<double> interval_latency; //latencies since the last status line
   struct bench_interval_data idata; // data that is updated by time intervals and not by events
   struct bench_history history; // data history, used to calculate stddev
   utime_t cur_latency; //latency of last completed transaction
   utime_t start_time; //start time for benchmark
+  utime_t run_time; //how long the benchmark ran
   char *object_contents; //pointer to the contents written to each object
 };
 
 const int OP_WRITE     = 1;
 const int OP_SEQ_READ  = 2;
 const int OP_RAND_READ = 3;
+const int OP_MIXED     = 4;
 
 class ObjBencher {
   bool show_time;
+  Formatter *formatter;
+  int read_percent;
+
+  // multi-client runs; see set_run()
+  std::string run_name;
+  int num_clients;
+  int client_id;
+
+  std::string run_object_name(int client, const char *what);
+  int wait_for_clients();
+  int report_run(int operation);
+  void dump_summary(const char *mode, int reads, int writes);
+  void print_percentiles(ostream& os);
 public:
   CephContext *cct;
 protected:
@@ -65,6 +83,9 @@ protected:
 
   int write_bench(int secondsToRun, int maxObjects, int concurrentios);
   int seq_read_bench(int secondsToRun, int concurrentios, int num_objects, int writePid);
+  int rand_read_bench(int secondsToRun, int num_objects, int concurrentios, int writePid, int read_percent);
+
+  void finish_op(utime_t latency);
 
   int clean_up(int num_objects, int prevPid, int concurrentios);
   int clean_up_slow(const std::string& prefix, int concurrentios);
@@ -92,7 +113,10 @@ protected:
   ostream& out(ostream& os);
   ostream& out(ostream& os, utime_t& t);
 public:
-  ObjBencher(CephContext *cct_) : show_time(false), cct(cct_), lock("ObjBencher::lock") {}
+  ObjBencher(CephContext *cct_)
+    : show_time(false), formatter(NULL), read_percent(50),
+      num_clients(1), client_id(0),
+      cct(cct_), lock("ObjBencher::lock") {}
   virtual ~ObjBencher() {}
   int aio_bench(
     int operation, int secondsToRun, int maxObjectsToCreate,
@@ -102,6 +126,27 @@ public:
   void set_show_time(bool dt) {
     show_time = dt;
   }
+  /// print the per-second status and the summaries with f instead of as text
+  void set_formatter(Formatter *f) {
+    formatter = f;
+  }
+  /// percentage of the ops of an OP_MIXED run that are reads
+  void set_read_percent(int p) {
+    read_percent = p;
+  }
+  /**
+   * run in step with other clients
+   *
+   * The num_clients benchers sharing a run name wait for each other
+   * before they start, and client 0 prints the aggregate of all of
+   * their results once everyone is done.  They meet through objects
+   * in the pool, so they have to bench the same one.
+   */
+  void set_run(const std::string& name, int clients, int id) {
+    run_name = name;
+    num_clients = clients;
+    client_id = id;
+  }
 };
 
 
@@ -30,7 +30,8 @@ using std::ostringstream;
 
 PerfCountersCollection::PerfCountersCollection(CephContext *cct)
   : m_cct(cct),
-    m_lock("PerfCountersCollection")
+    m_lock("PerfCountersCollection"),
+    m_version(0)
 {
 }
 
@@ -54,6 +55,7 @@ void PerfCountersCollection::add(class PerfCounters *l)
   }
 
   m_loggers.insert(l);
+  m_version++;
 }
 
 void PerfCountersCollection::remove(class PerfCounters *l)
@@ -62,6 +64,7 @@ void PerfCountersCollection::remove(class PerfCounters *l)
   perf_counters_set_t::iterator i = m_loggers.find(l);
   assert(i != m_loggers.end());
   m_loggers.erase(i);
+  m_version++;
 }
 
 void PerfCountersCollection::clear()
@@ -72,6 +75,7 @@ void PerfCountersCollection::clear()
   for (; i != i_end; ) {
     m_loggers.erase(i++);
   }
+  m_version++;
 }
 
 void PerfCountersCollection::dump_formatted(Formatter *f, bool schema)
@@ -90,26 +94,74 @@ void PerfCountersCollection::dump_formatted(Formatter *f, bool schema)
   f->close_section();
 }
 
+uint64_t PerfCountersCollection::get_schema(std::vector<std::string>& names,
+					    std::vector<int>& types)
+{
+  Mutex::Locker lck(m_lock);
+  names.clear();
+  types.clear();
+  for (perf_counters_set_t::iterator l = m_loggers.begin();
+       l != m_loggers.end();
+       ++l)
+    (*l)->get_schema(names, types);
+  return m_version;
+}
+
+uint64_t PerfCountersCollection::sample(std::vector<uint64_t>& values)
+{
+  Mutex::Locker lck(m_lock);
+  values.clear();
+  for (perf_counters_set_t::iterator l = m_loggers.begin();
+       l != m_loggers.end();
+       ++l)
+    (*l)->sample(values);
+  return m_version;
+}
+
 // ---------------------------
 
 PerfCounters::~PerfCounters()
 {
 }
 
+// the counters are updated without m_lock
+static inline uint64_t atomic_read(const uint64_t *v)
+{
+  return __sync_fetch_and_add(const_cast<uint64_t*>(v), 0);
+}
+
+static inline void atomic_store(uint64_t *v, uint64_t n)
+{
+  uint64_t old;
+  do {
+    old = *v;
+  } while (!__sync_bool_compare_and_swap(v, old, n));
+}
+
+/// bucket 0 for 0, i for [2^(i-1), 2^i), the last one for the rest
+static inline unsigned log2_bucket(uint64_t v, unsigned buckets)
+{
+  unsigned b = 0;
+  while (v && b < buckets - 1) {
+    b++;
+    v >>= 1;
+  }
+  return b;
+}
+
 void PerfCounters::inc(int idx, uint64_t amt)
 {
   if (!m_cct->_conf->perf)
     return;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  data.u64 += amt;
+  __sync_fetch_and_add(&data.u64, amt);
   if (data.type & PERFCOUNTER_LONGRUNAVG)
-    data.avgcount++;
+    __sync_fetch_and_add(&data.avgcount, 1);
 }
 
 void PerfCounters::dec(int idx, uint64_t amt)
@@ -117,15 +169,14 @@ void PerfCounters::dec(int idx, uint64_t amt)
   if (!m_cct->_conf->perf)
     return;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   assert(!(data.type & PERFCOUNTER_LONGRUNAVG));
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  assert(data.u64 >= amt);
-  data.u64 -= amt;
+  uint64_t was = __sync_fetch_and_sub(&data.u64, amt);
+  assert(was >= amt);
 }
 
 void PerfCounters::set(int idx, uint64_t amt)
@@ -133,15 +184,14 @@ void PerfCounters::set(int idx, uint64_t amt)
   if (!m_cct->_conf->perf)
     return;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  data.u64 = amt;
+  atomic_store(&data.u64, amt);
   if (data.type & PERFCOUNTER_LONGRUNAVG)
-    data.avgcount++;
+    __sync_fetch_and_add(&data.avgcount, 1);
 }
 
 uint64_t PerfCounters::get(int idx) const
@@ -149,13 +199,12 @@ uint64_t PerfCounters::get(int idx) const
   if (!m_cct->_conf->perf)
     return 0;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return 0;
-  return data.u64;
+  return atomic_read(&data.u64);
 }
 
 void PerfCounters::tinc(int idx, utime_t amt)
@@ -163,15 +212,18 @@ void PerfCounters::tinc(int idx, utime_t amt)
   if (!m_cct->_conf->perf)
     return;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  data.u64 += amt.to_nsec();
+  if (data.type & PERFCOUNTER_HISTOGRAM) {
+    hinc(idx, amt);
+    return;
+  }
+  __sync_fetch_and_add(&data.u64, amt.to_nsec());
   if (data.type & PERFCOUNTER_LONGRUNAVG)
-    data.avgcount++;
+    __sync_fetch_and_add(&data.avgcount, 1);
 }
 
 void PerfCounters::tset(int idx, utime_t amt)
@@ -179,13 +231,12 @@ void PerfCounters::tset(int idx, utime_t amt)
   if (!m_cct->_conf->perf)
     return;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  data.u64 = amt.to_nsec();
+  atomic_store(&data.u64, amt.to_nsec());
   if (data.type & PERFCOUNTER_LONGRUNAVG)
     assert(0);
 }
@@ -195,13 +246,31 @@ utime_t PerfCounters::tget(int idx) const
   if (!m_cct->_conf->perf)
     return utime_t();
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return utime_t();
-  return utime_t(data.u64 / 1000000000ull, data.u64 % 1000000000ull);
+  uint64_t v = atomic_read(&data.u64);
+  return utime_t(v / 1000000000ull, v % 1000000000ull);
+}
+
+void PerfCounters::hinc(int idx, utime_t amt, uint64_t size)
+{
+  if (!m_cct->_conf->perf)
+    return;
+
+  assert(idx > m_lower_bound);
+  assert(idx < m_upper_bound);
+  perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
+  if (!(data.type & PERFCOUNTER_HISTOGRAM))
+    return;
+  uint64_t nsec = amt.to_nsec();
+  __sync_fetch_and_add(&data.u64, nsec);
+  __sync_fetch_and_add(&data.avgcount, 1);
+  unsigned lat = log2_bucket(nsec / 1000, PERF_HIST_LAT_BUCKETS);
+  unsigned sz = log2_bucket(size, data.size_buckets);
+  __sync_fetch_and_add(&data.histogram[sz * PERF_HIST_LAT_BUCKETS + lat], 1);
 }
 
 pair<uint64_t, uint64_t> PerfCounters::get_tavg_ms(int idx) const
@@ -209,7 +278,6 @@ pair<uint64_t, uint64_t> PerfCounters::get_tavg_ms(int idx) const
   if (!m_cct->_conf->perf)
     return make_pair(0, 0);
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
@@ -217,7 +285,8 @@ pair<uint64_t, uint64_t> PerfCounters::get_tavg_ms(int idx) const
     return make_pair(0, 0);
   if (!(data.type & PERFCOUNTER_LONGRUNAVG))
     return make_pair(0, 0);
-  return make_pair(data.avgcount, data.u64/1000000);
+  uint64_t count = atomic_read(&data.avgcount);
+  return make_pair(count, atomic_read(&data.u64)/1000000);
 }
 
 void PerfCounters::dump_formatted(Formatter *f, bool schema)
@@ -237,27 +306,43 @@ void PerfCounters::dump_formatted(Formatter *f, bool schema)
       f->dump_int("type", d->type);
       f->close_section();
     } else {
+      uint64_t avgcount = atomic_read(&d->avgcount);
+      uint64_t u64 = atomic_read(&d->u64);
       if (d->type & PERFCOUNTER_LONGRUNAVG) {
 	f->open_object_section(d->name);
 	if (d->type & PERFCOUNTER_U64) {
-	  f->dump_unsigned("avgcount", d->avgcount);
-	  f->dump_unsigned("sum", d->u64);
+	  f->dump_unsigned("avgcount", avgcount);
+	  f->dump_unsigned("sum", u64);
 	} else if (d->type & PERFCOUNTER_TIME) {
-	  f->dump_unsigned("avgcount", d->avgcount);
+	  f->dump_unsigned("avgcount", avgcount);
 	  f->dump_format_unquoted("sum", "%"PRId64".%09"PRId64,
-				  d->u64 / 1000000000ull,
-				  d->u64 % 1000000000ull);
+				  u64 / 1000000000ull,
+				  u64 % 1000000000ull);
 	} else {
 	  assert(0);
 	}
+	if (d->type & PERFCOUNTER_HISTOGRAM) {
+	  // latency buckets, in one array per size bucket if by size
+	  f->open_array_section("histogram");
+	  for (unsigned s = 0; s < d->size_buckets; s++) {
+	    if (d->size_buckets > 1)
+	      f->open_array_section("size");
+	    for (unsigned l = 0; l < PERF_HIST_LAT_BUCKETS; l++)
+	      f->dump_unsigned("count",
+			       atomic_read(&d->histogram[s * PERF_HIST_LAT_BUCKETS + l]));
+	    if (d->size_buckets > 1)
+	      f->close_section();
+	  }
+	  f->close_section();
+	}
 	f->close_section();
       } else {
 	if (d->type & PERFCOUNTER_U64) {
-	  f->dump_unsigned(d->name, d->u64);
+	  f->dump_unsigned(d->name, u64);
 	} else if (d->type & PERFCOUNTER_TIME) {
 	  f->dump_format_unquoted(d->name, "%"PRId64".%09"PRId64,
-				  d->u64 / 1000000000ull,
-				  d->u64 % 1000000000ull);
+				  u64 / 1000000000ull,
+				  u64 % 1000000000ull);
 	} else {
 	  assert(0);
 	}
@@ -270,6 +355,27 @@ void PerfCounters::dump_formatted(Formatter *f, bool schema)
   f->close_section();
 }
 
+void PerfCounters::get_schema(std::vector<std::string>& names,
+			      std::vector<int>& types) const
+{
+  for (perf_counter_data_vec_t::const_iterator d = m_data.begin();
+       d != m_data.end();
+       ++d) {
+    names.push_back(m_name + "." + d->name);
+    types.push_back(d->type);
+  }
+}
+
+void PerfCounters::sample(std::vector<uint64_t>& values) const
+{
+  for (perf_counter_data_vec_t::const_iterator d = m_data.begin();
+       d != m_data.end();
+       ++d) {
+    values.push_back(atomic_read(&d->u64));
+    values.push_back(atomic_read(&d->avgcount));
+  }
+}
+
 const std::string &PerfCounters::get_name() const
 {
   return m_name;
@@ -291,7 +397,8 @@ PerfCounters::perf_counter_data_any_d::perf_counter_data_any_d()
   : name(NULL),
     type(PERFCOUNTER_NONE),
     u64(0),
-    avgcount(0)
+    avgcount(0),
+    size_buckets(1)
 {
 }
 
@@ -333,7 +440,20 @@ void PerfCountersBuilder::add_time_avg(int idx, const char *name)
   add_impl(idx, name, PERFCOUNTER_TIME | PERFCOUNTER_LONGRUNAVG);
 }
 
-void PerfCountersBuilder::add_impl(int idx, const char *name, int ty)
+void PerfCountersBuilder::add_time_histogram(int idx, const char *name)
+{
+  add_impl(idx, name, PERFCOUNTER_TIME | PERFCOUNTER_LONGRUNAVG |
+	   PERFCOUNTER_HISTOGRAM);
+}
+
+void PerfCountersBuilder::add_time_size_histogram(int idx, const char *name)
+{
+  add_impl(idx, name, PERFCOUNTER_TIME | PERFCOUNTER_LONGRUNAVG |
+	   PERFCOUNTER_HISTOGRAM, PERF_HIST_SIZE_BUCKETS);
+}
+
+void PerfCountersBuilder::add_impl(int idx, const char *name, int ty,
+				   unsigned size_buckets)
 {
   assert(idx > m_perf_counters->m_lower_bound);
   assert(idx < m_perf_counters->m_upper_bound);
@@ -343,6 +463,10 @@ void PerfCountersBuilder::add_impl(int idx, const char *name, int ty)
   assert(data.type == PERFCOUNTER_NONE);
   data.name = name;
   data.type = (enum perfcounter_type_d)ty;
+  if (ty & PERFCOUNTER_HISTOGRAM) {
+    data.size_buckets = size_buckets;
+    data.histogram.resize(size_buckets * PERF_HIST_LAT_BUCKETS);
+  }
 }
 
 PerfCounters *PerfCountersBuilder::create_perf_counters()
@@ -36,8 +36,17 @@ enum perfcounter_type_d
   PERFCOUNTER_U64 = 0x2,
   PERFCOUNTER_LONGRUNAVG = 0x4,
   PERFCOUNTER_COUNTER = 0x8,
+  PERFCOUNTER_HISTOGRAM = 0x10,
 };
 
+/*
+ * Histogram buckets are powers of two: bucket 0 counts values below
+ * 1, bucket i values in [2^(i-1), 2^i), and the last bucket everything
+ * above.  Latencies are in microseconds, sizes in bytes.
+ */
+#define PERF_HIST_LAT_BUCKETS  32   // up to ~18 minutes
+#define PERF_HIST_SIZE_BUCKETS 24   // up to 4MB
+
 /*
  * A PerfCounters object is usually associated with a single subsystem.
  * It contains counters which we modify to track performance and throughput
@@ -47,6 +56,7 @@ enum perfcounter_type_d
  * 1) integer values & counters
  * 2) floating-point values & counters
  * 3) floating-point averages
+ * 4) latency histograms, optionally also by size
  *
  * The difference between values and counters is in how they are initialized
  * and accessed. For a counter, use the inc(counter, amount) function (note
@@ -61,6 +71,13 @@ enum perfcounter_type_d
  * For the time average, it returns the current value and
  * the "avgcount" member when read off. avgcount is incremented when you call
  * tinc. Calling tset on an average is an error and will assert out.
+ *
+ * A histogram is a time average that also counts each latency given to
+ * hinc in its log2 bucket, and in the log2 bucket of the size if it
+ * was declared with one.
+ *
+ * Updates are atomic and do not take m_lock, so a reader may see the
+ * sum of an average a moment before its count.
  */
 class PerfCounters
 {
@@ -94,8 +111,16 @@ public:
   void tinc(int idx, utime_t v);
   utime_t tget(int idx) const;
 
+  void hinc(int idx, utime_t v, uint64_t size = 0);
+
   void dump_formatted(ceph::Formatter *f, bool schema);
 
+  /// append the "<logger>.<counter>" name and the type of each counter
+  void get_schema(std::vector<std::string>& names,
+		  std::vector<int>& types) const;
+  /// append the value and the number of samples averaged (0 if not an average) of each counter
+  void sample(std::vector<uint64_t>& values) const;
+
   pair<uint64_t, uint64_t> get_tavg_ms(int idx) const;
 
   const std::string& get_name() const;
@@ -119,6 +144,8 @@ private:
     enum perfcounter_type_d type;
     uint64_t u64;
     uint64_t avgcount;
+    unsigned size_buckets;          ///< 1 unless by size too
+    std::vector<uint64_t> histogram; ///< [size bucket][latency bucket]
   };
   typedef std::vector<perf_counter_data_any_d> perf_counter_data_vec_t;
 
@@ -128,7 +155,7 @@ private:
   std::string m_name;
   const std::string m_lock_name;
 
-  /** Protects m_data */
+  /** Serializes dumps; updates of m_data are atomic */
   mutable Mutex m_lock;
 
   perf_counter_data_vec_t m_data;
@@ -157,6 +184,21 @@ public:
   void remove(class PerfCounters *l);
   void clear();
   void dump_formatted(ceph::Formatter *f, bool schema);
+
+  /**
+   * the names and types of the counters sample() returns values for
+   *
+   * @return the version of the set of loggers this describes
+   */
+  uint64_t get_schema(std::vector<std::string>& names,
+		      std::vector<int>& types);
+  /**
+   * two values per counter, see PerfCounters::sample()
+   *
+   * Cheaper than dump_formatted(), for collectors that poll often.
+   * @return the version of the set of loggers sampled
+   */
+  uint64_t sample(std::vector<uint64_t>& values);
 private:
   CephContext *m_cct;
 
@@ -164,6 +206,7 @@ private:
   mutable Mutex m_lock;
 
   perf_counters_set_t m_loggers;
+  uint64_t m_version;		///< bumped when a logger comes or goes
 
   friend class PerfCountersCollectionTest;
 };
@@ -187,11 +230,13 @@ public:
   void add_u64_avg(int key, const char *name);
   void add_time(int key, const char *name);
   void add_time_avg(int key, const char *name);
+  void add_time_histogram(int key, const char *name);
+  void add_time_size_histogram(int key, const char *name);
   PerfCounters* create_perf_counters();
 private:
   PerfCountersBuilder(const PerfCountersBuilder &rhs);
   PerfCountersBuilder& operator=(const PerfCountersBuilder &rhs);
-  void add_impl(int idx, const char *name, int ty);
+  void add_impl(int idx, const char *name, int ty, unsigned size_buckets = 1);
 
   PerfCounters *m_perf_counters;
 };
@@ -0,0 +1,165 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/perf_counters_stream.h"
+#include "common/perf_counters.h"
+#include "common/ceph_context.h"
+#include "common/Clock.h"
+#include "common/dout.h"
+#include "include/encoding.h"
+
+#define dout_subsys ceph_subsys_perfcounter
+#undef dout_prefix
+#define dout_prefix *_dout << "perf_stream(" << (void*)m_cct << ") "
+
+PerfCountersStream::PerfCountersStream(CephContext *cct, uint64_t backlog,
+				       double i)
+  : OutputDataSocket(cct, backlog),
+    sample_thread(this),
+    streaming(false),
+    need_key(false),
+    stopping(false),
+    connection_seq(0),
+    schema_version(0)
+{
+  interval.set_from_double(i);
+}
+
+PerfCountersStream::~PerfCountersStream()
+{
+  m_lock.Lock();
+  stopping = true;
+  sample_cond.Signal();
+  m_lock.Unlock();
+  if (sample_thread.is_started())
+    sample_thread.join();
+  // ~OutputDataSocket shuts the socket down
+}
+
+bool PerfCountersStream::init(const std::string &path)
+{
+  if (!OutputDataSocket::init(path))
+    return false;
+  sample_thread.create();
+  return true;
+}
+
+void PerfCountersStream::init_connection(bufferlist& bl)
+{
+  // m_lock is held.  Whatever was queued was for the last collector.
+  ldout(m_cct, 10) << "collector connected" << dendl;
+  data.clear();
+  data_size = 0;
+  streaming = true;
+  need_key = true;
+  connection_seq++;
+  sample_cond.Signal();
+}
+
+void PerfCountersStream::close_connection(int fd)
+{
+  OutputDataSocket::close_connection(fd);
+  Mutex::Locker l(m_lock);
+  ldout(m_cct, 10) << "collector disconnected" << dendl;
+  streaming = false;
+}
+
+void PerfCountersStream::sample_entry()
+{
+  PerfCountersCollection *coll = m_cct->get_perfcounters_collection();
+  vector<uint64_t> values;
+
+  m_lock.Lock();
+  while (!stopping) {
+    if (!streaming) {
+      sample_cond.Wait(m_lock);
+      continue;
+    }
+    bool key = need_key;
+    need_key = false;
+    uint64_t seq = connection_seq;
+    m_lock.Unlock();
+
+    utime_t now = ceph_clock_now(m_cct);
+    uint64_t version = coll->sample(values);
+    bufferlist bl;
+    if (key || version != schema_version ||
+	values.size() != 2 * names.size()) {
+      // loggers may come and go between the two calls
+      while (coll->get_schema(names, types) != version)
+	version = coll->sample(values);
+      schema_version = version;
+      encode_schema(bl);
+      key = true;
+    }
+    encode_sample(now, key, values, bl);
+    last.swap(values);
+
+    m_lock.Lock();
+    if (seq != connection_seq) {
+      // a new collector showed up meanwhile; it gets a schema next
+    } else if (data_size + bl.length() > data_max_backlog) {
+      ldout(m_cct, 1) << "collector is not keeping up, dropping sample" << dendl;
+      need_key = true;
+    } else {
+      data.push_back(bl);
+      data_size += bl.length();
+      cond.Signal();
+    }
+    if (!stopping)
+      sample_cond.WaitInterval(m_cct, m_lock, interval);
+  }
+  m_lock.Unlock();
+}
+
+void PerfCountersStream::encode_schema(bufferlist& bl)
+{
+  bufferlist body;
+  __u8 t = FRAME_SCHEMA;
+  ::encode(t, body);
+  ::encode((__u32)names.size(), body);
+  for (unsigned i = 0; i < names.size(); i++) {
+    ::encode(names[i], body);
+    __u8 type = types[i];
+    ::encode(type, body);
+  }
+  ::encode((__u32)body.length(), bl);
+  bl.claim_append(body);
+}
+
+void PerfCountersStream::encode_sample(utime_t stamp, bool key,
+				       const vector<uint64_t>& values,
+				       bufferlist& bl)
+{
+  // only what changed; most counters are idle in any one interval
+  __u32 n = 0;
+  for (unsigned i = 0; i < values.size(); i++)
+    if (key ? values[i] : values[i] != last[i])
+      n++;
+
+  bufferlist body;
+  __u8 t = FRAME_SAMPLE;
+  ::encode(t, body);
+  ::encode(stamp, body);
+  __u8 k = key;
+  ::encode(k, body);
+  ::encode(n, body);
+  for (unsigned i = 0; i < values.size(); i++) {
+    uint64_t v = key ? values[i] : values[i] - last[i];
+    if (!v)
+      continue;
+    ::encode((__u32)i, body);
+    ::encode(v, body);
+  }
+  ::encode((__u32)body.length(), bl);
+  bl.claim_append(body);
+}
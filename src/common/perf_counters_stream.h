@@ -0,0 +1,80 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_PERF_COUNTERS_STREAM_H
+#define CEPH_COMMON_PERF_COUNTERS_STREAM_H
+
+#include "common/OutputDataSocket.h"
+#include "include/utime.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Streams the perf counters to a collector over a unix socket
+ *
+ * A collector connects to perf_stream_path once and from then on gets
+ * a binary sample of all counters every perf_stream_interval seconds,
+ * instead of asking for and parsing a 'perf dump' each time.  Samples
+ * are only taken while a collector is connected.  The format is in
+ * doc/dev/perf_counters.rst.
+ */
+class PerfCountersStream : public OutputDataSocket {
+public:
+  enum {
+    FRAME_SCHEMA = 1,
+    FRAME_SAMPLE = 2,
+  };
+
+  PerfCountersStream(CephContext *cct, uint64_t backlog, double interval);
+  ~PerfCountersStream();
+
+  /// listen on path and start sampling
+  bool init(const std::string &path);
+
+protected:
+  void init_connection(bufferlist& bl);
+  void close_connection(int fd);
+
+private:
+  class SampleThread : public Thread {
+    PerfCountersStream *stream;
+  public:
+    SampleThread(PerfCountersStream *s) : stream(s) {}
+    void *entry() {
+      stream->sample_entry();
+      return 0;
+    }
+  } sample_thread;
+
+  utime_t interval;
+
+  // protected by m_lock
+  bool streaming;		///< a collector is connected
+  bool need_key;		///< send a schema and a key sample next
+  bool stopping;
+  uint64_t connection_seq;
+  Cond sample_cond;
+
+  // only used by the sample thread
+  uint64_t schema_version;
+  std::vector<std::string> names;
+  std::vector<int> types;
+  std::vector<uint64_t> last;
+
+  void sample_entry();
+  void encode_schema(bufferlist& bl);
+  void encode_sample(utime_t stamp, bool key,
+		     const std::vector<uint64_t>& values, bufferlist& bl);
+};
+
+#endif
@@ -13,6 +13,7 @@
  */
 
 #define _XOPEN_SOURCE 500
+#define _BSD_SOURCE	// preadv
 
 #include <stdio.h>
 #include <string.h>
@@ -117,6 +118,39 @@ ssize_t safe_pwrite(int fd, const void *buf, size_t count, off_t offset)
 	return 0;
 }
 
+#ifdef CEPH_HAVE_PREADV
+ssize_t safe_preadv(int fd, struct iovec *iov, int iovcnt, off_t offset)
+{
+  size_t cnt = 0;
+
+  while (iovcnt > 0) {
+    ssize_t r = preadv(fd, iov, iovcnt, offset + cnt);
+    if (r <= 0) {
+      if (r == 0) {
+	// EOF
+	return cnt;
+      }
+      if (errno == EINTR)
+	continue;
+      return -errno;
+    }
+    cnt += r;
+
+    // skip what was filled
+    while (iovcnt > 0 && (size_t)r >= iov->iov_len) {
+      r -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (r > 0) {
+      iov->iov_base = (char *)iov->iov_base + r;
+      iov->iov_len -= r;
+    }
+  }
+  return cnt;
+}
+#endif
+
 #ifdef CEPH_HAVE_SPLICE
 ssize_t safe_splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out,
 		    size_t len, unsigned int flags)
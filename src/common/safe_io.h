@@ -18,6 +18,7 @@
 #include "acconfig.h"
 #include "common/compiler_extensions.h"
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -36,6 +37,15 @@ extern "C" {
       WARN_UNUSED_RESULT;
   ssize_t safe_pwrite(int fd, const void *buf, size_t count, off_t offset)
       WARN_UNUSED_RESULT;
+#ifdef CEPH_HAVE_PREADV
+  /*
+   * Like safe_pread, into several buffers.  Stops short only at EOF.
+   * iov is used up as data comes in, so its contents are undefined
+   * afterwards.
+   */
+  ssize_t safe_preadv(int fd, struct iovec *iov, int iovcnt, off_t offset)
+      WARN_UNUSED_RESULT;
+#endif
 #ifdef CEPH_HAVE_SPLICE
   /*
    * Similar to the above (non-exact version) and below (exact version).
@@ -32,11 +32,12 @@ class SharedLRU {
 
   map<K, typename list<pair<K, VPtr> >::iterator > contents;
   list<pair<K, VPtr> > lru;
+  size_t lru_size;  ///< lru.size(), which is linear
 
   map<K, WeakVPtr> weak_refs;
 
   void trim_cache(list<VPtr> *to_release) {
-    while (lru.size() > max_size) {
+    while (lru_size > max_size) {
       to_release->push_back(lru.back().second);
       lru_remove(lru.back().first);
     }
@@ -47,6 +48,7 @@ class SharedLRU {
       return;
     lru.erase(contents[key]);
     contents.erase(key);
+    --lru_size;
   }
 
   void lru_add(K key, VPtr val, list<VPtr> *to_release) {
@@ -55,6 +57,7 @@ class SharedLRU {
     } else {
       lru.push_front(make_pair(key, val));
       contents[key] = lru.begin();
+      ++lru_size;
       trim_cache(to_release);
     }
   }
@@ -77,11 +80,13 @@ class SharedLRU {
   };
 
 public:
-  SharedLRU(size_t max_size = 20) : lock("SharedLRU::lock"), max_size(max_size) {}
+  SharedLRU(size_t max_size = 20)
+    : lock("SharedLRU::lock"), max_size(max_size), lru_size(0) {}
   
   ~SharedLRU() {
     contents.clear();
     lru.clear();
+    lru_size = 0;
     assert(weak_refs.empty());
   }
 
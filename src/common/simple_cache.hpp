@@ -86,8 +86,25 @@ public:
 
   void add(K key, V value) {
     Mutex::Locker l(lock);
+    typename map<K, typename list<pair<K, V> >::iterator>::iterator i =
+      contents.find(key);
+    if (i != contents.end()) {
+      lru.erase(i->second);
+      contents.erase(i);
+    }
     _add(key, value);
   }
+
+  /// drop key from the lru (pinned entries are unaffected)
+  void clear(K key) {
+    Mutex::Locker l(lock);
+    typename map<K, typename list<pair<K, V> >::iterator>::iterator i =
+      contents.find(key);
+    if (i == contents.end())
+      return;
+    lru.erase(i->second);
+    contents.erase(i);
+  }
 };
 
 #endif
@@ -2,8 +2,211 @@
 #include "CrushTester.h"
 
 #include <algorithm>
+#include <math.h>
 #include <stdlib.h>
 
+#include "common/Clock.h"
+#include "common/Thread.h"
+
+
+// -- CrushDistribution --
+
+void CrushDistribution::add(const CrushDistribution& o)
+{
+  if (o.count.size() > count.size()) {
+    count.resize(o.count.size());
+    primary.resize(o.count.size());
+  }
+  for (unsigned i = 0; i < o.count.size(); i++) {
+    count[i] += o.count[i];
+    primary[i] += o.primary[i];
+  }
+  mappings += o.mappings;
+}
+
+void CrushDistribution::stats_t::calc(const map<int,int>& count,
+				      const map<int,double>& expected)
+{
+  double sum = 0, sq = 0;
+  bool first = true;
+  *this = stats_t();
+  for (map<int,double>::const_iterator p = expected.begin();
+       p != expected.end();
+       ++p) {
+    if (p->second <= 0)
+      continue;
+    map<int,int>::const_iterator q = count.find(p->first);
+    int c = q == count.end() ? 0 : q->second;
+    double d = c - p->second;
+    sum += c;
+    sq += d * d;
+    max_deviation = MAX(max_deviation, fabs(d) / p->second);
+    if (first || c < min) {
+      min = c;
+      min_item = p->first;
+    }
+    if (first || c > max) {
+      max = c;
+      max_item = p->first;
+    }
+    first = false;
+    items++;
+  }
+  if (items) {
+    mean = sum / items;
+    stddev = sqrt(sq / items);
+  }
+}
+
+static string item_name(CrushWrapper& crush, int id)
+{
+  const char *name = crush.get_item_name(id);
+  if (name)
+    return name;
+  ostringstream ss;
+  ss << (id >= 0 ? "device" : "bucket") << id;
+  return ss.str();
+}
+
+void CrushDistribution::stats_t::print(CrushWrapper& crush, ostream& out) const
+{
+  out << items << " items, mean " << mean << ", stddev " << stddev;
+  if (mean > 0)
+    out << " (" << 100.0 * stddev / mean << "%)";
+  if (items)
+    out << ", min " << min << " (" << item_name(crush, min_item) << ")"
+	<< ", max " << max << " (" << item_name(crush, max_item) << ")"
+	<< ", max deviation " << 100.0 * max_deviation << "%";
+  out << std::endl;
+}
+
+void CrushDistribution::stats_t::dump(CrushWrapper& crush, Formatter *f) const
+{
+  f->dump_unsigned("items", items);
+  f->dump_float("mean", mean);
+  f->dump_float("stddev", stddev);
+  f->dump_float("relative_stddev", mean > 0 ? stddev / mean : 0);
+  f->dump_int("min", min);
+  f->dump_string("min_item", items ? item_name(crush, min_item) : "");
+  f->dump_int("max", max);
+  f->dump_string("max_item", items ? item_name(crush, max_item) : "");
+  f->dump_float("max_deviation", max_deviation);
+}
+
+void CrushDistribution::calc(CrushWrapper& crush, const vector<float>& weight,
+			     int domain_type,
+			     map<int,double>& expected,
+			     map<int,double>& expected_primary,
+			     map<int,int>& domain_count,
+			     map<int,double>& domain_expected,
+			     stats_t& copies, stats_t& primaries,
+			     stats_t& domains) const
+{
+  uint64_t total = 0;
+  double weight_sum = 0;
+  for (unsigned i = 0; i < count.size(); i++) {
+    total += count[i];
+    if (i < weight.size() && weight[i] > 0)
+      weight_sum += weight[i];
+  }
+
+  map<int,int> counts, primaries_count;
+  for (unsigned i = 0; i < count.size(); i++) {
+    double w = i < weight.size() && weight_sum > 0 ? weight[i] / weight_sum : 0;
+    if (w <= 0 && !count[i])
+      continue;
+    counts[i] = count[i];
+    primaries_count[i] = primary[i];
+    expected[i] = total * w;
+    expected_primary[i] = mappings * w;
+
+    if (domain_type < 0)
+      continue;
+    int id = i, parent;
+    while (crush.get_immediate_parent_id(id, &parent) == 0) {
+      if (crush.get_bucket_type(parent) == domain_type) {
+	domain_count[parent] += count[i];
+	domain_expected[parent] += total * w;
+	break;
+      }
+      id = parent;
+    }
+  }
+  copies.calc(counts, expected);
+  primaries.calc(primaries_count, expected_primary);
+  domains.calc(domain_count, domain_expected);
+}
+
+void CrushDistribution::print(CrushWrapper& crush, const vector<float>& weight,
+			      int domain_type, ostream& out) const
+{
+  map<int,double> expected, expected_primary, domain_expected;
+  map<int,int> domain_count;
+  stats_t copies, primaries, domains;
+  calc(crush, weight, domain_type, expected, expected_primary,
+       domain_count, domain_expected, copies, primaries, domains);
+
+  out << "  " << mappings << " mappings" << std::endl;
+  out << "  copies per device: ";
+  copies.print(crush, out);
+  out << "  primaries per device: ";
+  primaries.print(crush, out);
+  if (domain_type >= 0) {
+    out << "  copies per " << crush.get_type_name(domain_type) << ": ";
+    domains.print(crush, out);
+  }
+}
+
+void CrushDistribution::dump(CrushWrapper& crush, const vector<float>& weight,
+			     int domain_type, Formatter *f) const
+{
+  map<int,double> expected, expected_primary, domain_expected;
+  map<int,int> domain_count;
+  stats_t copies, primaries, domains;
+  calc(crush, weight, domain_type, expected, expected_primary,
+       domain_count, domain_expected, copies, primaries, domains);
+
+  f->dump_unsigned("mappings", mappings);
+  f->open_object_section("copies");
+  copies.dump(crush, f);
+  f->close_section();
+  f->open_object_section("primaries");
+  primaries.dump(crush, f);
+  f->close_section();
+  f->open_array_section("devices");
+  for (map<int,double>::iterator p = expected.begin(); p != expected.end(); ++p) {
+    f->open_object_section("device");
+    f->dump_int("id", p->first);
+    f->dump_string("name", item_name(crush, p->first));
+    f->dump_int("count", count[p->first]);
+    f->dump_float("expected", p->second);
+    f->dump_int("primary", primary[p->first]);
+    f->dump_float("expected_primary", expected_primary[p->first]);
+    f->close_section();
+  }
+  f->close_section();
+  if (domain_type >= 0) {
+    f->open_object_section("failure_domain");
+    f->dump_string("type", crush.get_type_name(domain_type));
+    domains.dump(crush, f);
+    f->open_array_section("buckets");
+    for (map<int,double>::iterator p = domain_expected.begin();
+	 p != domain_expected.end();
+	 ++p) {
+      f->open_object_section("bucket");
+      f->dump_int("id", p->first);
+      f->dump_string("name", item_name(crush, p->first));
+      f->dump_int("count", domain_count[p->first]);
+      f->dump_float("expected", p->second);
+      f->close_section();
+    }
+    f->close_section();
+    f->close_section();
+  }
+}
+
+// -- CrushTester --
+
 
 void CrushTester::set_device_weight(int dev, float f)
 {
@@ -350,6 +553,90 @@ void CrushTester::write_integer_indexed_scalar_data_string(vector<string> &dst,
   dst.push_back( data_buffer.str() );
 }
 
+int CrushTester::benchmark(const vector<__u32>& weight)
+{
+  vector<int> x;
+  for (int i = min_x; i <= max_x; i++)
+    x.push_back(i);
+
+  for (int r = min_rule; r < crush.get_max_rules() && r <= max_rule; r++) {
+    if (!crush.rule_exists(r))
+      continue;
+    int minr = min_rep, maxr = max_rep;
+    if (min_rep < 0 || max_rep < 0) {
+      minr = crush.get_rule_mask_min_size(r);
+      maxr = crush.get_rule_mask_max_size(r);
+    }
+    for (int nr = minr; nr <= maxr; nr++) {
+      vector<vector<int> > out;
+      utime_t start = ceph_clock_now(NULL);
+      crush.do_rule_batch(r, x, out, nr, weight);
+      double elapsed = ceph_clock_now(NULL) - start;
+      err << "rule " << r << " (" << crush.get_rule_name(r) << ") num_rep " << nr
+	  << ": " << x.size() << " mappings in " << elapsed << "s";
+      if (elapsed > 0)
+	err << ", " << (uint64_t)(x.size() / elapsed) << " mappings/sec";
+      err << std::endl;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Maps a slice of the inputs with its own copy of the map, since a
+ * CrushWrapper only maps one input at a time.
+ */
+class CrushMapWorker : public Thread {
+  bufferlist crush_bl;
+  int ruleno, nr;
+  const vector<__u32>& weight;
+  vector<int> x;
+  vector<vector<int> >::iterator out;
+
+public:
+  CrushMapWorker(const bufferlist& bl, int r, int n, const vector<__u32>& w,
+		 int begin, int end, vector<vector<int> >::iterator o)
+    : crush_bl(bl), ruleno(r), nr(n), weight(w), out(o) {
+    for (int i = begin; i < end; i++)
+      x.push_back(i);
+  }
+
+  void *entry() {
+    CrushWrapper crush;
+    bufferlist::iterator p = crush_bl.begin();
+    crush.decode(p);
+    vector<vector<int> > result;
+    crush.do_rule_batch(ruleno, x, result, nr, weight);
+    for (unsigned i = 0; i < result.size(); i++)
+      (out + i)->swap(result[i]);
+    return 0;
+  }
+};
+
+void CrushTester::map_parallel(int ruleno, int nr, const vector<__u32>& weight,
+			       vector<vector<int> >& out)
+{
+  int num = max_x - min_x + 1;
+  out.resize(num);
+  bufferlist bl;
+  crush.encode(bl);
+  int per = (num + num_threads - 1) / num_threads;
+  vector<CrushMapWorker*> workers;
+  for (int b = 0; b < num; b += per) {
+    CrushMapWorker *w = new CrushMapWorker(bl, ruleno, nr, weight,
+					   min_x + b, min_x + MIN(b + per, num),
+					   out.begin() + b);
+    w->create();
+    workers.push_back(w);
+  }
+  for (vector<CrushMapWorker*>::iterator p = workers.begin();
+       p != workers.end();
+       ++p) {
+    (*p)->join();
+    delete *p;
+  }
+}
+
 int CrushTester::test()
 {
   if (min_rule < 0 || max_rule < 0) {
@@ -385,11 +672,32 @@ int CrushTester::test()
   adjust_weights(weight);
 
 
+  if (output_benchmark)
+    return benchmark(weight);
+
   int num_devices_active = 0;
   for (vector<__u32>::iterator p = weight.begin(); p != weight.end(); ++p)
     if (*p > 0)
       num_devices_active++;
 
+  // the choose profile is kept in the map, so only one can count
+  bool parallel = use_crush && num_threads > 1 && !output_choose_tries;
+
+  int domain_type = -1;
+  if (!failure_domain.empty()) {
+    domain_type = crush.get_type_id(failure_domain);
+    if (domain_type < 0)
+      err << "no bucket type " << failure_domain
+	  << ", not summarizing by failure domain" << std::endl;
+  }
+  vector<float> share;
+  for (unsigned i = 0; i < weight.size(); i++)
+    share.push_back(MAX(crush.get_item_weightf(i), 0) *
+		    (float)weight[i] / (float)0x10000);
+
+  if (formatter && output_distribution)
+    formatter->open_array_section("distributions");
+
   if (output_choose_tries)
     crush.start_choose_profile();
   
@@ -414,6 +722,11 @@ int CrushTester::test()
     for (int nr = minr; nr <= maxr; nr++) {
       vector<int> per(crush.get_max_devices());
       map<int,int> sizes;
+      CrushDistribution dist(crush.get_max_devices());
+
+      vector<vector<int> > mapped;
+      if (parallel)
+	map_parallel(r, nr, weight, mapped);
 
       int num_objects = ((max_x - min_x) + 1);
       float num_devices = (float) per.size(); // get the total number of devices, better to cast as a float here 
@@ -489,7 +802,10 @@ int CrushTester::test()
           if (use_crush) {
             if (output_statistics)
               err << "CRUSH"; // prepend CRUSH to placement output
-            crush.do_rule(r, x, out, nr, weight);
+            if (parallel)
+              out.swap(mapped[x - min_x]);
+            else
+              crush.do_rule(r, x, out, nr, weight);
           } else {
             if (output_statistics)
               err << "RNG"; // prepend RNG to placement output to denote simulation
@@ -510,6 +826,8 @@ int CrushTester::test()
 
           batch_per[current_batch] = temporary_per;
           sizes[out.size()]++;
+          if (output_distribution)
+            dist.add(out);
           if (output_bad_mappings && out.size() != (unsigned)nr) {
             cout << "bad mapping rule " << r << " x " << x << " num_rep " << nr << " result " << out << std::endl;
           }
@@ -567,6 +885,21 @@ int CrushTester::test()
         }
       }
 
+      if (output_distribution) {
+        if (formatter) {
+          formatter->open_object_section("distribution");
+          formatter->dump_int("rule", r);
+          formatter->dump_string("rule_name", crush.get_rule_name(r));
+          formatter->dump_int("num_rep", nr);
+          dist.dump(crush, share, domain_type, formatter);
+          formatter->close_section();
+        } else {
+          err << "rule " << r << " (" << crush.get_rule_name(r) << ") num_rep "
+              << nr << " distribution:" << std::endl;
+          dist.print(crush, share, domain_type, err);
+        }
+      }
+
       string rule_tag = crush.get_rule_name(r);
 
       if (output_csv)
@@ -588,5 +921,8 @@ int CrushTester::test()
     crush.stop_choose_profile();
   }
 
+  if (formatter && output_distribution)
+    formatter->close_section();
+
   return 0;
 }
@@ -5,10 +5,73 @@
 #define CEPH_CRUSH_TESTER_H
 
 #include "crush/CrushWrapper.h"
+#include "common/Formatter.h"
 
 #include <fstream>
 #include <sstream>
 
+/**
+ * How a set of mappings spread over the devices
+ *
+ * Counts the copies and the primaries (first device of a mapping) each
+ * device got, and compares them with the device's share by weight,
+ * both per device and rolled up to the buckets of a failure domain
+ * type.  Distributions gathered separately, e.g. by several threads,
+ * can be added up.
+ */
+class CrushDistribution {
+public:
+  vector<int> count;		///< copies on each device
+  vector<int> primary;		///< mappings each device came first in
+  uint64_t mappings;
+
+  CrushDistribution(int max_devices = 0)
+    : count(max_devices), primary(max_devices), mappings(0) {}
+
+  void add(const vector<int>& out) {
+    ++mappings;
+    bool first = true;
+    for (unsigned i = 0; i < out.size(); i++) {
+      if (out[i] < 0 || out[i] >= (int)count.size())
+	continue;	// CRUSH_ITEM_NONE holes
+      count[out[i]]++;
+      if (first)
+	primary[out[i]]++;
+      first = false;
+    }
+  }
+  void add(const CrushDistribution& o);
+
+  /**
+   * @param weight share of each device, zero for those that should get nothing
+   * @param domain_type bucket type to also summarize by, or -1
+   */
+  void print(CrushWrapper& crush, const vector<float>& weight,
+	     int domain_type, ostream& out) const;
+  void dump(CrushWrapper& crush, const vector<float>& weight,
+	    int domain_type, Formatter *f) const;
+
+private:
+  /// how far a set of counts is off the expected ones
+  struct stats_t {
+    unsigned items;
+    double mean, stddev, max_deviation;
+    int min, max;
+    int min_item, max_item;
+
+    stats_t() : items(0), mean(0), stddev(0), max_deviation(0),
+		min(0), max(0), min_item(0), max_item(0) {}
+    void calc(const map<int,int>& count, const map<int,double>& expected);
+    void print(CrushWrapper& crush, ostream& out) const;
+    void dump(CrushWrapper& crush, Formatter *f) const;
+  };
+
+  void calc(CrushWrapper& crush, const vector<float>& weight, int domain_type,
+	    map<int,double>& expected, map<int,double>& expected_primary,
+	    map<int,int>& domain_count, map<int,double>& domain_expected,
+	    stats_t& copies, stats_t& primaries, stats_t& domains) const;
+};
+
 class CrushTester {
   CrushWrapper& crush;
   ostream& err;
@@ -29,10 +92,16 @@ class CrushTester {
   bool output_statistics;
   bool output_bad_mappings;
   bool output_choose_tries;
+  bool output_benchmark;
 
+  bool output_distribution;
   bool output_data_file;
   bool output_csv;
 
+  int num_threads;
+  string failure_domain;
+  Formatter *formatter;
+
   string output_data_file_name;
 
 /*
@@ -73,6 +142,16 @@ class CrushTester {
    */
   int random_placement(int ruleno, vector<int>& out, int maxout, vector<__u32>& weight);
 
+  /*
+   * time the mapping of [min_x, max_x] for each rule and num_rep, and
+   * report mappings/sec instead of the usual output
+   */
+  int benchmark(const vector<__u32>& weight);
+
+  /// do_rule() for min_x..max_x, spread over num_threads copies of the map
+  void map_parallel(int ruleno, int nr, const vector<__u32>& weight,
+		    vector<vector<int> >& out);
+
   // scaffolding to store data for off-line processing
    struct tester_data_set {
      vector <string> device_utilization;
@@ -178,8 +257,12 @@ public:
       output_statistics(false),
       output_bad_mappings(false),
       output_choose_tries(false),
+      output_benchmark(false),
+      output_distribution(false),
       output_data_file(false),
       output_csv(false),
+      num_threads(1),
+      formatter(NULL),
       output_data_file_name("")
 
   { }
@@ -208,6 +291,23 @@ public:
   void set_output_choose_tries(bool b) {
     output_choose_tries = b;
   }
+  void set_output_benchmark(bool b) {
+    output_benchmark = b;
+  }
+  void set_output_distribution(bool b) {
+    output_distribution = b;
+  }
+  /// dump the distributions here instead of printing them
+  void set_formatter(Formatter *f) {
+    formatter = f;
+  }
+  /// bucket type the distribution is also summarized by, "" for none
+  void set_failure_domain(const string& type) {
+    failure_domain = type;
+  }
+  void set_threads(int n) {
+    num_threads = n > 0 ? n : 1;
+  }
 
   void set_batches(int b) {
     num_batches = b;
@@ -6,6 +6,20 @@
 
 #define dout_subsys ceph_subsys_crush
 
+void CrushWrapper::build_parent_map() const
+{
+  if (have_parents)
+    return;
+  parent_map.clear();
+  for (int i = 0; i < crush->max_buckets; i++) {
+    crush_bucket *b = crush->buckets[i];
+    if (!b)
+      continue;
+    for (unsigned j = 0; j < b->size; j++)
+      parent_map[b->items[j]].insert(b->id);
+  }
+  have_parents = true;
+}
 
 void CrushWrapper::find_takes(set<int>& roots) const
 {
@@ -60,6 +74,8 @@ bool CrushWrapper::_maybe_remove_last_instance(CephContext *cct, int item, bool
   if (item < 0 && !unlink_only) {
     crush_bucket *t = get_bucket(item);
     ldout(cct, 5) << "_maybe_remove_last_instance removing bucket " << item << dendl;
+    for (unsigned j = 0; j < t->size; j++)
+      unlink_parent(t->items[j], t->id);
     crush_remove_bucket(crush, t);
   }
   if ((item >= 0 || !unlink_only) && name_map.count(item)) {
@@ -85,20 +101,17 @@ int CrushWrapper::remove_item(CephContext *cct, int item, bool unlink_only)
     }
   }
 
-  for (int i = 0; i < crush->max_buckets; i++) {
-    if (!crush->buckets[i])
-      continue;
-    crush_bucket *b = crush->buckets[i];
-
-    for (unsigned i=0; i<b->size; ++i) {
-      int id = b->items[i];
-      if (id == item) {
-	adjust_item_weight(cct, item, 0);
-	ldout(cct, 5) << "remove_item removing item " << item
-		      << " from bucket " << b->id << dendl;
-	crush_bucket_remove_item(b, item);
-	ret = 0;
-      }
+  const set<int> *parents = get_parents(item);
+  if (parents) {
+    set<int> from = *parents;
+    for (set<int>::iterator p = from.begin(); p != from.end(); ++p) {
+      crush_bucket *b = get_bucket(*p);
+      adjust_item_weight(cct, item, 0);
+      ldout(cct, 5) << "remove_item removing item " << item
+		    << " from bucket " << b->id << dendl;
+      crush_bucket_remove_item(b, item);
+      unlink_parent(item, b->id);
+      ret = 0;
     }
   }
 
@@ -110,16 +123,7 @@ int CrushWrapper::remove_item(CephContext *cct, int item, bool unlink_only)
 
 bool CrushWrapper::_search_item_exists(int item) const
 {
-  for (int i = 0; i < crush->max_buckets; i++) {
-    if (!crush->buckets[i])
-      continue;
-    crush_bucket *b = crush->buckets[i];
-    for (unsigned i=0; i<b->size; ++i) {
-      if (b->items[i] == item)
-	return true;
-    }
-  }
-  return false;
+  return get_parents(item) != NULL;
 }
 
 int CrushWrapper::_remove_item_under(CephContext *cct, int item, int ancestor, bool unlink_only)
@@ -143,6 +147,7 @@ int CrushWrapper::_remove_item_under(CephContext *cct, int item, int ancestor, b
       adjust_item_weight(cct, item, 0);
       ldout(cct, 5) << "_remove_item_under removing item " << item << " from bucket " << b->id << dendl;
       crush_bucket_remove_item(b, item);
+      unlink_parent(item, b->id);
       ret = 0;
     } else if (id < 0) {
       int r = remove_item_under(cct, item, id, unlink_only);
@@ -417,6 +422,7 @@ int CrushWrapper::insert_item(CephContext *cct, int item, float weight, string n
 		  << " to bucket " << id << dendl;
     int r = crush_bucket_add_item(b, cur, 0);
     assert (!r);
+    link_parent(cur, b->id);
 
     // now that we've added the (0-weighted) item and any parent buckets, adjust the weight.
     adjust_item_weightf(cct, item, weight);
@@ -544,14 +550,14 @@ int CrushWrapper::update_item(CephContext *cct, int item, float weight, string n
 
 int CrushWrapper::get_item_weight(int id)
 {
-  for (int bidx = 0; bidx < crush->max_buckets; bidx++) {
-    crush_bucket *b = crush->buckets[bidx];
-    if (b == NULL)
-      continue;
-    for (unsigned i = 0; i < b->size; i++)
-      if (b->items[i] == id)
-	return crush_get_bucket_item_weight(b, i);
-  }
+  const set<int> *parents = get_parents(id);
+  if (!parents)
+    return -ENOENT;
+  // the first bucket in id order that holds it
+  crush_bucket *b = get_bucket(*parents->rbegin());
+  for (unsigned i = 0; i < b->size; i++)
+    if (b->items[i] == id)
+      return crush_get_bucket_item_weight(b, i);
   return -ENOENT;
 }
 
@@ -559,17 +565,14 @@ int CrushWrapper::adjust_item_weight(CephContext *cct, int id, int weight)
 {
   ldout(cct, 5) << "adjust_item_weight " << id << " weight " << weight << dendl;
   int changed = 0;
-  for (int bidx = 0; bidx < crush->max_buckets; bidx++) {
-    crush_bucket *b = crush->buckets[bidx];
-    if (b == 0)
-      continue;
-    for (unsigned i = 0; i < b->size; i++) {
-      if (b->items[i] == id) {
-	int diff = crush_bucket_adjust_item_weight(b, id, weight);
-	ldout(cct, 5) << "adjust_item_weight " << id << " diff " << diff << " in bucket " << bidx << dendl;
-	adjust_item_weight(cct, -1 - bidx, b->weight);
-	changed++;
-      }
+  const set<int> *parents = get_parents(id);
+  if (parents) {
+    for (set<int>::const_reverse_iterator p = parents->rbegin(); p != parents->rend(); ++p) {
+      crush_bucket *b = get_bucket(*p);
+      int diff = crush_bucket_adjust_item_weight(b, id, weight);
+      ldout(cct, 5) << "adjust_item_weight " << id << " diff " << diff << " in bucket " << b->id << dendl;
+      adjust_item_weight(cct, b->id, b->weight);
+      changed++;
     }
   }
   if (!changed)
@@ -598,17 +601,14 @@ pair<string,string> CrushWrapper::get_immediate_parent(int id, int *_ret)
   pair <string, string> loc;
   int ret = -ENOENT;
 
-  for (int bidx = 0; bidx < crush->max_buckets; bidx++) {
-    crush_bucket *b = crush->buckets[bidx];
-    if (b == 0)
-      continue;
-    for (unsigned i = 0; i < b->size; i++)
-      if (b->items[i] == id) {
-        string parent_id = name_map[b->id];
-        string parent_bucket_type = type_map[b->type];
-        loc = make_pair(parent_bucket_type, parent_id);
-        ret = 0;
-      }
+  // the last bucket in id order that holds it
+  const set<int> *parents = get_parents(id);
+  if (parents) {
+    crush_bucket *b = get_bucket(*parents->begin());
+    string parent_id = name_map[b->id];
+    string parent_bucket_type = type_map[b->type];
+    loc = make_pair(parent_bucket_type, parent_id);
+    ret = 0;
   }
 
   if (_ret)
@@ -619,18 +619,11 @@ pair<string,string> CrushWrapper::get_immediate_parent(int id, int *_ret)
 
 int CrushWrapper::get_immediate_parent_id(int id, int *parent)
 {
-  for (int bidx = 0; bidx < crush->max_buckets; bidx++) {
-    crush_bucket *b = crush->buckets[bidx];
-    if (b == 0)
-      continue;
-    for (unsigned i = 0; i < b->size; i++) {
-      if (b->items[i] == id) {
-	*parent = b->id;
-	return 0;
-      }
-    }
-  }
-  return -ENOENT;
+  const set<int> *parents = get_parents(id);
+  if (!parents)
+    return -ENOENT;
+  *parent = *parents->rbegin();
+  return 0;
 }
 
 void CrushWrapper::reweight(CephContext *cct)
@@ -765,6 +758,11 @@ void CrushWrapper::encode(bufferlist& bl, bool lean) const
       }
       break;
 
+    case CRUSH_BUCKET_STRAW2:
+      for (unsigned j=0; j<crush->buckets[i]->size; j++)
+	::encode(((crush_bucket_straw2*)crush->buckets[i])->item_weights[j], bl);
+      break;
+
     default:
       assert(0);
       break;
@@ -902,6 +900,9 @@ void CrushWrapper::decode_crush_bucket(crush_bucket** bptr, bufferlist::iterator
   case CRUSH_BUCKET_STRAW:
     size = sizeof(crush_bucket_straw);
     break;
+  case CRUSH_BUCKET_STRAW2:
+    size = sizeof(crush_bucket_straw2);
+    break;
   default:
     {
       char str[128];
@@ -965,6 +966,14 @@ void CrushWrapper::decode_crush_bucket(crush_bucket** bptr, bufferlist::iterator
     break;
   }
 
+  case CRUSH_BUCKET_STRAW2: {
+    crush_bucket_straw2* cbs = (crush_bucket_straw2*)bucket;
+    cbs->item_weights = (__u32*)calloc(1, bucket->size * sizeof(__u32));
+    for (unsigned j = 0; j < bucket->size; ++j)
+      ::decode(cbs->item_weights[j], blp);
+    break;
+  }
+
   default:
     // We should have handled this case in the first switch statement
     assert(0);
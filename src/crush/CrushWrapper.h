@@ -61,6 +61,10 @@ public:
   bool have_rmaps;
   std::map<string, int> type_rmap, name_rmap, rule_name_rmap;
 
+  /* item -> buckets that link to it; built on demand, then kept current */
+  mutable bool have_parents;
+  mutable std::map<int, std::set<int> > parent_map;
+
 private:
   void build_rmaps() {
     if (have_rmaps) return;
@@ -69,6 +73,28 @@ private:
     build_rmap(rule_name_map, rule_name_rmap);
     have_rmaps = true;
   }
+  void build_parent_map() const;
+  const std::set<int> *get_parents(int item) const {
+    build_parent_map();
+    std::map<int, std::set<int> >::const_iterator p = parent_map.find(item);
+    if (p == parent_map.end())
+      return NULL;
+    return &p->second;
+  }
+  void link_parent(int item, int bucket) {
+    if (have_parents)
+      parent_map[item].insert(bucket);
+  }
+  void unlink_parent(int item, int bucket) {
+    if (!have_parents)
+      return;
+    std::map<int, std::set<int> >::iterator p = parent_map.find(item);
+    if (p == parent_map.end())
+      return;
+    p->second.erase(bucket);
+    if (p->second.empty())
+      parent_map.erase(p);
+  }
   void build_rmap(const map<int, string> &f, std::map<string, int> &r) {
     r.clear();
     for (std::map<int, string>::const_iterator p = f.begin(); p != f.end(); ++p)
@@ -80,7 +106,7 @@ public:
   const CrushWrapper& operator=(const CrushWrapper& other);
 
   CrushWrapper() : mapper_lock("CrushWrapper::mapper_lock"),
-		   crush(0), have_rmaps(false) {
+		   crush(0), have_rmaps(false), have_parents(false) {
     create();
   }
   ~CrushWrapper() {
@@ -95,6 +121,8 @@ public:
     crush = crush_create();
     assert(crush);
     have_rmaps = false;
+    have_parents = false;
+    parent_map.clear();
   }
 
   // tunables
@@ -158,6 +186,12 @@ public:
     return
       crush->chooseleaf_descend_once != 0;
   }
+  bool has_v4_buckets() const {
+    for (int i = 0; i < crush->max_buckets; i++)
+      if (crush->buckets[i] && crush->buckets[i]->alg == CRUSH_BUCKET_STRAW2)
+	return true;
+    return false;
+  }
 
   // bucket types
   int get_num_type_names() const {
@@ -645,6 +679,7 @@ private:
     if (!IS_ERR(parent_bucket)) {
       // remove the bucket from the parent
       crush_bucket_remove_item(parent_bucket, item);
+      unlink_parent(item, parent_bucket->id);
     } else if (PTR_ERR(parent_bucket) != -ENOENT) {
       return PTR_ERR(parent_bucket);
     }
@@ -724,12 +759,19 @@ public:
 		 int *items, int *weights, int *idout) {
     crush_bucket *b = crush_make_bucket(alg, hash, type, size, items, weights);
     assert(b);
-    return crush_add_bucket(crush, bucketno, b, idout);
+    int r = crush_add_bucket(crush, bucketno, b, idout);
+    if (r == 0)
+      for (int i = 0; i < size; i++)
+	link_parent(items[i], *idout);
+    return r;
   }
   
+  /* call after changing the crush_map directly */
   void finalize() {
     assert(crush);
     crush_finalize(crush);
+    have_parents = false;
+    parent_map.clear();
   }
 
   void start_choose_profile() {
@@ -772,6 +814,25 @@ public:
       out[i] = rawout[i];
   }
 
+  /// do_rule() for each of x, taking the mapper lock once
+  void do_rule_batch(int rule, const vector<int>& x, vector<vector<int> >& out,
+		     int maxout, const vector<__u32>& weight) const {
+    out.resize(x.size());
+    if (x.empty())
+      return;
+    vector<int> rawout(x.size() * maxout);
+    vector<int> len(x.size());
+    {
+      Mutex::Locker l(mapper_lock);
+      crush_do_rule_batch(crush, rule, &x[0], x.size(), &rawout[0], &len[0],
+			  maxout, &weight[0], weight.size());
+    }
+    for (unsigned i = 0; i < x.size(); i++) {
+      vector<int>::iterator p = rawout.begin() + i * maxout;
+      out[i].assign(p, p + std::max(len[i], 0));
+    }
+  }
+
   int read_from_file(const char *fn) {
     bufferlist bl;
     std::string error;
@@ -7,6 +7,11 @@
 #endif
 
 #include "hash.h"
+#include "hash_simd.h"
+
+#include "arch/probe.h"
+#include "arch/intel.h"
+#include "arch/neon.h"
 
 /*
  * Robert Jenkins' function for mixing 32-bit values
@@ -25,8 +30,6 @@
 		c = c-a;  c = c-b;  c = c^(b>>15);	\
 	} while (0)
 
-#define crush_hash_seed 1315423911
-
 static __u32 crush_hash32_rjenkins1(__u32 a)
 {
 	__u32 hash = crush_hash_seed ^ a;
@@ -144,6 +147,52 @@ __u32 crush_hash32_5(int type, __u32 a, __u32 b, __u32 c, __u32 d, __u32 e)
 	}
 }
 
+typedef int (*crush_hash32_3_multi_t)(__u32 a, const __s32 *b, __u32 c,
+				      __u32 *out, int n);
+
+static int crush_hash32_rjenkins1_3_none(__u32 a, const __s32 *b, __u32 c,
+					 __u32 *out, int n)
+{
+	return 0;
+}
+
+/*
+ * choose the widest vector version the cpu supports and is compiled in.
+ */
+static crush_hash32_3_multi_t crush_choose_rjenkins1_3_multi(void)
+{
+	ceph_arch_probe();
+
+	if (ceph_arch_intel_avx2 && crush_hash_avx2_exists())
+		return crush_hash32_rjenkins1_3_avx2;
+	if (crush_hash_sse2_exists())
+		return crush_hash32_rjenkins1_3_sse2;
+	if (ceph_arch_neon && crush_hash_neon_exists())
+		return crush_hash32_rjenkins1_3_neon;
+	return crush_hash32_rjenkins1_3_none;
+}
+
+void crush_hash32_3_multi(int type, __u32 a, const __s32 *b, __u32 c,
+			  __u32 *out, int n)
+{
+	/* effectively constant; racing to set it is harmless */
+	static crush_hash32_3_multi_t rjenkins1_3_multi;
+	int i;
+
+	switch (type) {
+	case CRUSH_HASH_RJENKINS1:
+		if (!rjenkins1_3_multi)
+			rjenkins1_3_multi = crush_choose_rjenkins1_3_multi();
+		i = rjenkins1_3_multi(a, b, c, out, n);
+		for (; i < n; i++)
+			out[i] = crush_hash32_rjenkins1_3(a, b[i], c);
+		break;
+	default:
+		for (i = 0; i < n; i++)
+			out[i] = 0;
+	}
+}
+
 const char *crush_hash_name(int type)
 {
 	switch (type) {
@@ -0,0 +1,64 @@
+#include "acconfig.h"
+#include "include/int_types.h"
+
+#if defined(__linux__)
+#include <linux/types.h>
+#elif defined(__FreeBSD__)
+#include <sys/types.h>
+#endif
+
+#include "hash_simd.h"
+
+#ifdef HAVE_INTEL_AVX2
+
+#include <immintrin.h>
+
+#define VSUB(a, b) _mm256_sub_epi32(a, b)
+#define VXOR(a, b) _mm256_xor_si256(a, b)
+#define VSHL(a, n) _mm256_slli_epi32(a, n)
+#define VSHR(a, n) _mm256_srli_epi32(a, n)
+
+int crush_hash_avx2_exists(void)
+{
+	return 1;
+}
+
+int crush_hash32_rjenkins1_3_avx2(__u32 a, const __s32 *b, __u32 c,
+				  __u32 *out, int n)
+{
+	const __m256i va = _mm256_set1_epi32(a);
+	const __m256i vc = _mm256_set1_epi32(c);
+	const __m256i seed = _mm256_set1_epi32(crush_hash_seed ^ a ^ c);
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i xa = va, xc = vc;
+		__m256i x = _mm256_set1_epi32(231232);
+		__m256i y = _mm256_set1_epi32(1232);
+		__m256i xb = _mm256_loadu_si256((const __m256i *)(b + i));
+		__m256i hash = _mm256_xor_si256(seed, xb);
+
+		crush_hashmix_v(xa, xb, hash);
+		crush_hashmix_v(xc, x, hash);
+		crush_hashmix_v(y, xa, hash);
+		crush_hashmix_v(xb, x, hash);
+		crush_hashmix_v(y, xc, hash);
+		_mm256_storeu_si256((__m256i *)(out + i), hash);
+	}
+	return i;
+}
+
+#else
+
+int crush_hash_avx2_exists(void)
+{
+	return 0;
+}
+
+int crush_hash32_rjenkins1_3_avx2(__u32 a, const __s32 *b, __u32 c,
+				  __u32 *out, int n)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,127 @@
+#include "include/int_types.h"
+
+#if defined(__linux__)
+#include <linux/types.h>
+#elif defined(__FreeBSD__)
+#include <sys/types.h>
+#endif
+
+#include "hash_simd.h"
+
+/*
+ * The baseline vector units: sse2 on x86_64 and neon on aarch64 need
+ * no extra compiler flags.  avx2 lives in hash_avx2.c.
+ */
+
+#if defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#define VSUB(a, b) _mm_sub_epi32(a, b)
+#define VXOR(a, b) _mm_xor_si128(a, b)
+#define VSHL(a, n) _mm_slli_epi32(a, n)
+#define VSHR(a, n) _mm_srli_epi32(a, n)
+
+int crush_hash_sse2_exists(void)
+{
+	return 1;
+}
+
+int crush_hash32_rjenkins1_3_sse2(__u32 a, const __s32 *b, __u32 c,
+				  __u32 *out, int n)
+{
+	const __m128i va = _mm_set1_epi32(a);
+	const __m128i vc = _mm_set1_epi32(c);
+	const __m128i seed = _mm_set1_epi32(crush_hash_seed ^ a ^ c);
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i xa = va, xc = vc;
+		__m128i x = _mm_set1_epi32(231232);
+		__m128i y = _mm_set1_epi32(1232);
+		__m128i xb = _mm_loadu_si128((const __m128i *)(b + i));
+		__m128i hash = _mm_xor_si128(seed, xb);
+
+		crush_hashmix_v(xa, xb, hash);
+		crush_hashmix_v(xc, x, hash);
+		crush_hashmix_v(y, xa, hash);
+		crush_hashmix_v(xb, x, hash);
+		crush_hashmix_v(y, xc, hash);
+		_mm_storeu_si128((__m128i *)(out + i), hash);
+	}
+	return i;
+}
+
+#undef VSUB
+#undef VXOR
+#undef VSHL
+#undef VSHR
+
+#else
+
+int crush_hash_sse2_exists(void)
+{
+	return 0;
+}
+
+int crush_hash32_rjenkins1_3_sse2(__u32 a, const __s32 *b, __u32 c,
+				  __u32 *out, int n)
+{
+	return 0;
+}
+
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+#define VSUB(a, b) vsubq_u32(a, b)
+#define VXOR(a, b) veorq_u32(a, b)
+#define VSHL(a, n) vshlq_n_u32(a, n)
+#define VSHR(a, n) vshrq_n_u32(a, n)
+
+int crush_hash_neon_exists(void)
+{
+	return 1;
+}
+
+int crush_hash32_rjenkins1_3_neon(__u32 a, const __s32 *b, __u32 c,
+				  __u32 *out, int n)
+{
+	const uint32x4_t va = vdupq_n_u32(a);
+	const uint32x4_t vc = vdupq_n_u32(c);
+	const uint32x4_t seed = vdupq_n_u32(crush_hash_seed ^ a ^ c);
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		uint32x4_t xa = va, xc = vc;
+		uint32x4_t x = vdupq_n_u32(231232);
+		uint32x4_t y = vdupq_n_u32(1232);
+		uint32x4_t xb = vld1q_u32((const uint32_t *)(b + i));
+		uint32x4_t hash = veorq_u32(seed, xb);
+
+		crush_hashmix_v(xa, xb, hash);
+		crush_hashmix_v(xc, x, hash);
+		crush_hashmix_v(y, xa, hash);
+		crush_hashmix_v(xb, x, hash);
+		crush_hashmix_v(y, xc, hash);
+		vst1q_u32((uint32_t *)(out + i), hash);
+	}
+	return i;
+}
+
+#else
+
+int crush_hash_neon_exists(void)
+{
+	return 0;
+}
+
+int crush_hash32_rjenkins1_3_neon(__u32 a, const __s32 *b, __u32 c,
+				  __u32 *out, int n)
+{
+	return 0;
+}
+
+#endif
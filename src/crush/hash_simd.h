@@ -0,0 +1,43 @@
+#ifndef CEPH_CRUSH_HASH_SIMD_H
+#define CEPH_CRUSH_HASH_SIMD_H
+
+/*
+ * Vector versions of crush_hash32_rjenkins1_3(a, b[i], c), hashing
+ * one lane per item.  Each returns how many of the n hashes it did (a
+ * multiple of its width, or 0 if it is not compiled in); the caller
+ * does the rest.
+ *
+ * LGPL2
+ */
+
+#define crush_hash_seed 1315423911
+
+/*
+ * crush_hashmix over vectors.  The including file defines VSUB, VXOR,
+ * VSHL and VSHR for its vector type.
+ */
+#define crush_hashmix_v(a, b, c) do {					\
+		a = VSUB(VSUB(a, b), c);  a = VXOR(a, VSHR(c, 13));	\
+		b = VSUB(VSUB(b, c), a);  b = VXOR(b, VSHL(a, 8));	\
+		c = VSUB(VSUB(c, a), b);  c = VXOR(c, VSHR(b, 13));	\
+		a = VSUB(VSUB(a, b), c);  a = VXOR(a, VSHR(c, 12));	\
+		b = VSUB(VSUB(b, c), a);  b = VXOR(b, VSHL(a, 16));	\
+		c = VSUB(VSUB(c, a), b);  c = VXOR(c, VSHR(b, 5));	\
+		a = VSUB(VSUB(a, b), c);  a = VXOR(a, VSHR(c, 3));	\
+		b = VSUB(VSUB(b, c), a);  b = VXOR(b, VSHL(a, 10));	\
+		c = VSUB(VSUB(c, a), b);  c = VXOR(c, VSHR(b, 15));	\
+	} while (0)
+
+extern int crush_hash_sse2_exists(void);
+extern int crush_hash32_rjenkins1_3_sse2(__u32 a, const __s32 *b, __u32 c,
+					 __u32 *out, int n);
+
+extern int crush_hash_avx2_exists(void);
+extern int crush_hash32_rjenkins1_3_avx2(__u32 a, const __s32 *b, __u32 c,
+					 __u32 *out, int n);
+
+extern int crush_hash_neon_exists(void);
+extern int crush_hash32_rjenkins1_3_neon(__u32 a, const __s32 *b, __u32 c,
+					 __u32 *out, int n);
+
+#endif
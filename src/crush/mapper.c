@@ -4,6 +4,7 @@
 # include <linux/slab.h>
 # include <linux/bug.h>
 # include <linux/kernel.h>
+# include <linux/math64.h>
 # ifndef dprintk
 #  define dprintk(args...)
 # endif
@@ -16,6 +17,11 @@
 # define dprintk(args...) /* printf(args) */
 # define kmalloc(x, f) malloc(x)
 # define kfree(x) free(x)
+# define div64_s64(a, b) ((a) / (b))
+#endif
+
+#ifndef S64_MIN
+# define S64_MIN (-0x7fffffffffffffffLL - 1)
 #endif
 
 #include "crush.h"
@@ -217,21 +223,100 @@ static int bucket_tree_choose(struct crush_bucket_tree *bucket,
 
 /* straw */
 
+/* how many straws to hash at once */
+#define CRUSH_STRAW_HASH_BATCH 64
+
 static int bucket_straw_choose(struct crush_bucket_straw *bucket,
 			       int x, int r)
 {
-	__u32 i;
+	__u32 i, j, n;
 	int high = 0;
 	__u64 high_draw = 0;
 	__u64 draw;
+	__u32 hash[CRUSH_STRAW_HASH_BATCH];
+
+	for (i = 0; i < bucket->h.size; i += n) {
+		n = bucket->h.size - i;
+		if (n > CRUSH_STRAW_HASH_BATCH)
+			n = CRUSH_STRAW_HASH_BATCH;
+		crush_hash32_3_multi(bucket->h.hash, x, bucket->h.items + i, r,
+				     hash, n);
+		for (j = 0; j < n; j++) {
+			draw = hash[j] & 0xffff;
+			draw *= bucket->straws[i + j];
+			if (i + j == 0 || draw > high_draw) {
+				high = i + j;
+				high_draw = draw;
+			}
+		}
+	}
+	return bucket->h.items[high];
+}
+
+/* straw2 */
+
+/*
+ * crush_ln - 2^44 * log2(xin + 1) for xin in [0, 0xffff]
+ *
+ * Integer arithmetic only, so that every architecture computes the
+ * same draws.  The integer part of the log is the position of the top
+ * bit; the fraction comes a bit at a time from squaring the mantissa.
+ */
+static __u64 crush_ln(unsigned int xin)
+{
+	__u64 x = xin + 1;
+	__u64 m, result;
+	int iexpon = 0;
+	int i;
+
+	while (x >> (iexpon + 1))
+		iexpon++;
+	result = (__u64)iexpon << 44;
+
+	/* mantissa in [1, 2), 30 fraction bits */
+	m = x << (30 - iexpon);
+	for (i = 43; i >= 12; i--) {
+		m = (m * m) >> 30;
+		if (m >= (2ULL << 30)) {
+			m >>= 1;
+			result |= 1ULL << i;
+		}
+	}
+	return result;
+}
 
-	for (i = 0; i < bucket->h.size; i++) {
-		draw = crush_hash32_3(bucket->h.hash, x, bucket->h.items[i], r);
-		draw &= 0xffff;
-		draw *= bucket->straws[i];
-		if (i == 0 || draw > high_draw) {
-			high = i;
-			high_draw = draw;
+/*
+ * Each item draws ln(u) / weight for a uniform u in (0, 1]: an
+ * exponential variable with rate proportional to its weight, and the
+ * largest (closest to zero) wins.  An item's draw depends only on its
+ * own weight, so a reweight only moves data to or from that item.
+ */
+static int bucket_straw2_choose(struct crush_bucket_straw2 *bucket,
+				int x, int r)
+{
+	__u32 i, j, n;
+	int high = 0;
+	__s64 ln, draw, high_draw = 0;
+	__u32 hash[CRUSH_STRAW_HASH_BATCH];
+
+	for (i = 0; i < bucket->h.size; i += n) {
+		n = bucket->h.size - i;
+		if (n > CRUSH_STRAW_HASH_BATCH)
+			n = CRUSH_STRAW_HASH_BATCH;
+		crush_hash32_3_multi(bucket->h.hash, x, bucket->h.items + i, r,
+				     hash, n);
+		for (j = 0; j < n; j++) {
+			if (bucket->item_weights[i + j]) {
+				/* crush_ln(0xffff) is 2^48: ln is <= 0 */
+				ln = crush_ln(hash[j] & 0xffff) - 0x1000000000000LL;
+				draw = div64_s64(ln, bucket->item_weights[i + j]);
+			} else {
+				draw = S64_MIN;
+			}
+			if (i + j == 0 || draw > high_draw) {
+				high = i + j;
+				high_draw = draw;
+			}
 		}
 	}
 	return bucket->h.items[high];
@@ -254,6 +339,9 @@ static int crush_bucket_choose(struct crush_bucket *in, int x, int r)
 	case CRUSH_BUCKET_STRAW:
 		return bucket_straw_choose((struct crush_bucket_straw *)in,
 					   x, r);
+	case CRUSH_BUCKET_STRAW2:
+		return bucket_straw2_choose((struct crush_bucket_straw2 *)in,
+					    x, r);
 	default:
 		dprintk("unknown bucket %d alg %d\n", in->id, in->alg);
 		return in->items[0];
@@ -588,3 +676,25 @@ int crush_do_rule(const struct crush_map *map,
 }
 
 
+/**
+ * crush_do_rule_batch - calculate the mappings of many inputs
+ * @param map the crush_map
+ * @param ruleno the rule id
+ * @param x hash inputs
+ * @param count number of inputs
+ * @param result count result vectors of result_max each, back to back
+ * @param result_len where the size of each result goes
+ * @param result_max maximum result size
+ */
+void crush_do_rule_batch(const struct crush_map *map,
+			 int ruleno, const int *x, int count,
+			 int *result, int *result_len, int result_max,
+			 const __u32 *weight, int weight_max)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		result_len[i] = crush_do_rule(map, ruleno, x[i],
+					      result + i * result_max,
+					      result_max, weight, weight_max);
+}
@@ -15,5 +15,9 @@ extern int crush_do_rule(const struct crush_map *map,
 			 int ruleno,
 			 int x, int *result, int result_max,
 			 const __u32 *weights, int weight_max);
+extern void crush_do_rule_batch(const struct crush_map *map,
+				int ruleno, const int *x, int count,
+				int *result, int *result_len, int result_max,
+				const __u32 *weights, int weight_max);
 
 #endif
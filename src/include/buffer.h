@@ -142,6 +142,7 @@ private:
   class raw_hack_aligned;
   class raw_char;
   class raw_pipe;
+  class raw_combined;
 
   friend std::ostream& operator<<(std::ostream& out, const raw &r);
 
@@ -218,6 +219,9 @@ public:
     bool can_zero_copy() const;
     int zero_copy_to_fd(int fd, loff_t *offset) const;
 
+    /// charge the raw buffer to another mempool::pool_index_t
+    void reassign_to_mempool(int pool);
+
     unsigned wasted();
 
     int cmp(const ptr& o);
@@ -361,6 +365,9 @@ public:
 
     bool is_zero() const;
 
+    /// charge our raw buffers to another mempool::pool_index_t
+    void reassign_to_mempool(int pool);
+
     // modifiers
     void clear() {
       _buffers.clear();
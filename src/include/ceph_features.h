@@ -40,6 +40,14 @@
 #define CEPH_FEATURE_MON_SCRUB      (1ULL<<33)
 #define CEPH_FEATURE_OSD_PACKED_RECOVERY (1ULL<<34)
 #define CEPH_FEATURE_OSD_CACHEPOOL (1ULL<<35)
+#define CEPH_FEATURE_MSG_COMPRESS  (1ULL<<36)
+#define CEPH_FEATURE_OSD_REPOP_BATCH (1ULL<<37)
+#define CEPH_FEATURE_OSD_BALANCE_READS (1ULL<<38)
+#define CEPH_FEATURE_OSD_DELTA_RECOVERY (1ULL<<39)
+#define CEPH_FEATURE_MDS_CAPS_BATCH (1ULL<<40)
+#define CEPH_FEATURE_MON_PGMAP_COMPACT (1ULL<<41)
+#define CEPH_FEATURE_OSD_FAILURE_BATCH (1ULL<<42)
+#define CEPH_FEATURE_CRUSH_V4      (1ULL<<43)  /* straw2 buckets */
 
 /*
  * The introduction of CEPH_FEATURE_OSD_SNAPMAPPER caused the feature
@@ -103,6 +111,14 @@ static inline unsigned long long ceph_sanitize_features(unsigned long long f) {
 	 CEPH_FEATURE_MON_SCRUB	|	    \
 	 CEPH_FEATURE_OSD_PACKED_RECOVERY | \
 	 CEPH_FEATURE_OSD_CACHEPOOL | \
+	 CEPH_FEATURE_MSG_COMPRESS | \
+	 CEPH_FEATURE_OSD_REPOP_BATCH | \
+	 CEPH_FEATURE_OSD_BALANCE_READS | \
+	 CEPH_FEATURE_OSD_DELTA_RECOVERY | \
+	 CEPH_FEATURE_MDS_CAPS_BATCH | \
+	 CEPH_FEATURE_MON_PGMAP_COMPACT | \
+	 CEPH_FEATURE_OSD_FAILURE_BATCH | \
+	 CEPH_FEATURE_CRUSH_V4 | \
 	 0ULL)
 
 #define CEPH_FEATURES_SUPPORTED_DEFAULT  CEPH_FEATURES_ALL
@@ -112,6 +128,7 @@ static inline unsigned long long ceph_sanitize_features(unsigned long long f) {
  */
 #define CEPH_FEATURES_CRUSH			\
 	(CEPH_FEATURE_CRUSH_TUNABLES |		\
-	 CEPH_FEATURE_CRUSH_TUNABLES2)
+	 CEPH_FEATURE_CRUSH_TUNABLES2 |		\
+	 CEPH_FEATURE_CRUSH_V4)
 
 #endif
@@ -409,6 +409,8 @@ union ceph_mds_request_args {
 
 #define CEPH_MDS_FLAG_REPLAY        1  /* this is a replayed op */
 #define CEPH_MDS_FLAG_WANT_DENTRY   2  /* want dentry in reply */
+#define CEPH_MDS_FLAG_READDIRPLUS   4  /* readdir: caller will stat entries */
+#define CEPH_MDS_FLAG_WANT_INOS     8  /* create: delegate inos in reply */
 
 struct ceph_mds_request_head {
 	__le64 oldest_client_tid;
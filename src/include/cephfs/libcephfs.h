@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <sys/statvfs.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 // FreeBSD compatibility
 #ifdef __FreeBSD__
@@ -687,6 +688,78 @@ int ceph_read(struct ceph_mount_info *cmount, int fd, char *buf, loff_t size, lo
 int ceph_write(struct ceph_mount_info *cmount, int fd, const char *buf, loff_t size,
 	       loff_t offset);
 
+/**
+ * Read data from the file into several buffers.
+ *
+ * @param cmount the ceph mount handle to use for performing the read.
+ * @param fd the file descriptor of the open file to read from.
+ * @param iov the buffers to fill, in order
+ * @param iovcnt the number of entries in iov
+ * @param offset the offset in the file to read from.  If this value is negative, the
+ *        function reads from the current offset of the file descriptor.
+ * @returns the number of bytes read, or a negative error code on failure.
+ */
+int ceph_preadv(struct ceph_mount_info *cmount, int fd, const struct iovec *iov, int iovcnt,
+		loff_t offset);
+
+/**
+ * Write data from several buffers to a file.
+ *
+ * @param cmount the ceph mount handle to use for performing the write.
+ * @param fd the file descriptor of the open file to write to
+ * @param iov the buffers to write, in order
+ * @param iovcnt the number of entries in iov
+ * @param offset the offset of the file write into.  If this value is negative, the
+ *        function writes to the current offset of the file descriptor.
+ * @returns the number of bytes written, or a negative error code
+ */
+int ceph_pwritev(struct ceph_mount_info *cmount, int fd, const struct iovec *iov, int iovcnt,
+		 loff_t offset);
+
+/**
+ * Completion callback for ceph_aio_read and ceph_aio_write.
+ *
+ * Called from a libcephfs thread, once per request, with what the
+ * synchronous call would have returned.  It may call back into libcephfs
+ * but should not block for long: it holds up other completions.
+ */
+typedef void (*ceph_aio_callback_t)(int result, void *arg);
+
+/**
+ * Start reading data from a file.
+ *
+ * buf must stay valid, and fd open, until the callback has run.
+ *
+ * @param cmount the ceph mount handle to use for performing the read.
+ * @param fd the file descriptor of the open file to read from.
+ * @param buf the buffer to read data into
+ * @param size the size of the buffer
+ * @param offset the offset in the file to read from; must not be negative.
+ * @param cb called with the number of bytes read, or a negative error code
+ * @param arg passed to cb
+ * @returns 0 if the read was started, or a negative error code (and cb is not called).
+ */
+int ceph_aio_read(struct ceph_mount_info *cmount, int fd, char *buf, loff_t size,
+		  loff_t offset, ceph_aio_callback_t cb, void *arg);
+
+/**
+ * Start writing data to a file.
+ *
+ * The data is copied before this returns; fd must stay open until the
+ * callback has run.
+ *
+ * @param cmount the ceph mount handle to use for performing the write.
+ * @param fd the file descriptor of the open file to write to
+ * @param buf the bytes to write to the file
+ * @param size the size of the buf array
+ * @param offset the offset of the file write into; must not be negative.
+ * @param cb called with the number of bytes written, or a negative error code
+ * @param arg passed to cb
+ * @returns 0 if the write was started, or a negative error code (and cb is not called).
+ */
+int ceph_aio_write(struct ceph_mount_info *cmount, int fd, const char *buf, loff_t size,
+		   loff_t offset, ceph_aio_callback_t cb, void *arg);
+
 /**
  * Truncate a file to the given size.
  *
@@ -726,6 +799,48 @@ int ceph_fsync(struct ceph_mount_info *cmount, int fd, int syncdataonly);
 int ceph_fallocate(struct ceph_mount_info *cmount, int fd, int mode,
 	                      loff_t offset, loff_t length);
 
+/**
+ * Enable or disable lazy io on an open file.
+ *
+ * With lazy io the client keeps caching and buffering the file even
+ * when other clients have it open for writing, and the application
+ * takes care of consistency with ceph_lazyio_propagate and
+ * ceph_lazyio_synchronize.  Meant for writers of disjoint ranges of a
+ * shared file.
+ *
+ * @param cmount the ceph mount handle to use.
+ * @param fd the file descriptor of the open file.
+ * @param enable 1 to enable lazy io, 0 to disable it.
+ * @return 0 on success or a negative error code on failure.
+ */
+int ceph_lazyio(struct ceph_mount_info *cmount, int fd, int enable);
+
+/**
+ * Make our buffered writes to a range of a lazy io file visible to
+ * other clients.
+ *
+ * @param cmount the ceph mount handle to use.
+ * @param fd the file descriptor of the open file.
+ * @param offset the start of the range.
+ * @param count the length of the range, or 0 for the whole file.
+ * @return 0 on success or a negative error code on failure.
+ */
+int ceph_lazyio_propagate(struct ceph_mount_info *cmount, int fd,
+			  loff_t offset, size_t count);
+
+/**
+ * Drop our cached copy of a range of a lazy io file, so that writes
+ * propagated by other clients are seen.  Also refreshes the file size.
+ *
+ * @param cmount the ceph mount handle to use.
+ * @param fd the file descriptor of the open file.
+ * @param offset the start of the range.
+ * @param count the length of the range, or 0 for the whole file.
+ * @return 0 on success or a negative error code on failure.
+ */
+int ceph_lazyio_synchronize(struct ceph_mount_info *cmount, int fd,
+			    loff_t offset, size_t count);
+
 /**
  * Get the open file's statistics.
  *
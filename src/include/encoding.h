@@ -198,13 +198,31 @@ template<class A>
 inline void encode_array_nohead(const A a[], int n, bufferlist &bl)
 {
   for (int i=0; i<n; i++)
-    encode(a[n], bl);
+    encode(a[i], bl);
 }
 template<class A>
 inline void decode_array_nohead(A a[], int n, bufferlist::iterator &p)
 {
   for (int i=0; i<n; i++)
-    decode(a[n], p);
+    decode(a[i], p);
+}
+
+// bytes have no byte order: copy them in one go
+inline void encode_array_nohead(const __u8 a[], int n, bufferlist &bl)
+{
+  bl.append((const char *)a, n);
+}
+inline void decode_array_nohead(__u8 a[], int n, bufferlist::iterator &p)
+{
+  p.copy(n, (char *)a);
+}
+inline void encode_array_nohead(const char a[], int n, bufferlist &bl)
+{
+  bl.append(a, n);
+}
+inline void decode_array_nohead(char a[], int n, bufferlist::iterator &p)
+{
+  p.copy(n, a);
 }
 
 
@@ -465,6 +483,23 @@ inline void decode(std::vector<T>& v, bufferlist::iterator& p)
     decode(v[i], p);
 }
 
+// vector of bytes, in one go
+inline void encode(const std::vector<__u8>& v, bufferlist& bl)
+{
+  __u32 n = v.size();
+  encode(n, bl);
+  if (n)
+    bl.append((const char *)&v[0], n);
+}
+inline void decode(std::vector<__u8>& v, bufferlist::iterator& p)
+{
+  __u32 n;
+  decode(n, p);
+  v.resize(n);
+  if (n)
+    p.copy(n, (char *)&v[0]);
+}
+
 template<class T>
 inline void encode_nohead(const std::vector<T>& v, bufferlist& bl)
 {
@@ -714,6 +714,55 @@ int rados_objects_list_open(rados_ioctx_t io, rados_list_ctx_t *ctx);
  */
 int rados_objects_list_next(rados_list_ctx_t ctx, const char **entry, const char **key);
 
+/**
+ * Start listing one part of the objects in a pool
+ *
+ * The pool's placement groups are divided into nparts contiguous
+ * ranges, and only the objects in range part are listed.  The parts
+ * can be listed concurrently, from several threads or processes, and
+ * listing each in turn gives the same objects in the same order as
+ * rados_objects_list_open().
+ *
+ * @param io the pool to list from
+ * @param part which part to list, from 0 to nparts - 1
+ * @param nparts how many parts the pool is divided into
+ * @param ctx the handle to store list context in
+ * @returns 0 on success, negative error code on failure
+ * @returns -EINVAL if part is not less than nparts
+ */
+int rados_objects_list_open_part(rados_ioctx_t io, unsigned part,
+				 unsigned nparts, rados_list_ctx_t *ctx);
+
+/**
+ * Get an opaque cursor for where a listing is
+ *
+ * A listing opened from the cursor with
+ * rados_objects_list_open_cursor() goes on with the entry after the
+ * one last returned by rados_objects_list_next().  If the pool's
+ * placement groups are split in the meantime, the listing (or part)
+ * starts over.
+ *
+ * @param ctx the listing
+ * @param buf where to store the cursor
+ * @param len length of buf; set to the length of the cursor
+ * @returns 0 on success, negative error code on failure
+ * @returns -ERANGE if buf is too short, with *len set to what is needed
+ */
+int rados_objects_list_get_cursor(rados_list_ctx_t ctx, char *buf, size_t *len);
+
+/**
+ * Go on with a listing from a cursor
+ *
+ * @param io the pool the cursor was taken from
+ * @param buf the cursor, from rados_objects_list_get_cursor()
+ * @param len length of the cursor
+ * @param ctx the handle to store list context in
+ * @returns 0 on success, negative error code on failure
+ * @returns -EINVAL if the cursor is not valid for this pool
+ */
+int rados_objects_list_open_cursor(rados_ioctx_t io, const char *buf,
+				   size_t len, rados_list_ctx_t *ctx);
+
 /**
  * Close the object listing handle.
  *
@@ -1397,6 +1446,101 @@ int rados_aio_get_return_value(rados_completion_t c);
  */
 void rados_aio_release(rados_completion_t c);
 
+/**
+ * @typedef rados_completion_set_t
+ * A set of completions to wait on together, e.g. to keep a fixed
+ * number of operations in flight by starting a new one each time one
+ * completes.
+ */
+typedef void *rados_completion_set_t;
+
+/**
+ * Create an empty completion set
+ *
+ * @param pset where to store the set
+ * @returns 0
+ */
+int rados_aio_create_completion_set(rados_completion_set_t *pset);
+
+/**
+ * Add a completion to a set
+ *
+ * The completion is returned by rados_aio_completion_set_wait_for_any()
+ * once it is complete, and may be added before or after its operation
+ * is started.  A completion can be in only one set at a time, and must
+ * not be released while in one.
+ *
+ * @param set the set
+ * @param c completion to add
+ */
+void rados_aio_completion_set_add(rados_completion_set_t set,
+				  rados_completion_t c);
+
+/**
+ * Get the number of completions in a set
+ *
+ * @param set the set
+ * @returns completions added and not yet returned
+ */
+size_t rados_aio_completion_set_size(rados_completion_set_t set);
+
+/**
+ * Block until any completion in a set is complete, and remove it
+ *
+ * Completions are returned in the order they complete.
+ *
+ * @param set the set
+ * @param pc where to store the completion
+ * @returns 0 on success, -ENOENT if the set is empty
+ */
+int rados_aio_completion_set_wait_for_any(rados_completion_set_t set,
+					  rados_completion_t *pc);
+
+/**
+ * Remove completed completions from a set, without blocking
+ *
+ * Together with rados_aio_completion_set_get_fd() this lets a set be
+ * used as a completion queue: add each op's completion, then harvest
+ * completed ops in batches, without waiting on each one.  Leaving the
+ * completions' callbacks unset avoids the callback thread as well.
+ *
+ * @param set the set
+ * @param cs where to store the completions, in the order they completed
+ * @param max room in cs
+ * @returns the number of completions stored
+ */
+size_t rados_aio_completion_set_poll(rados_completion_set_t set,
+				     rados_completion_t *cs, size_t max);
+
+/**
+ * Get a file descriptor that polls readable while a set holds
+ * completed completions
+ *
+ * Use it with poll(2), select(2) or epoll to sleep until there is
+ * something for rados_aio_completion_set_poll() to return.  Do not
+ * read from or close it; it is closed when the set is released.
+ *
+ * @param set the set
+ * @returns the file descriptor, or a negative error code
+ */
+int rados_aio_completion_set_get_fd(rados_completion_set_t set);
+
+/**
+ * Block until every completion in a set is complete, and empty it
+ *
+ * @param set the set
+ */
+void rados_aio_completion_set_wait_for_all(rados_completion_set_t set);
+
+/**
+ * Release a completion set
+ *
+ * Any completions still in it are removed; they are not released.
+ *
+ * @param set the set to release
+ */
+void rados_aio_completion_set_release(rados_completion_set_t set);
+
 /**
  * Write data to an object asynchronously
  *
@@ -1498,6 +1642,48 @@ int rados_aio_read(rados_ioctx_t io, const char *oid,
 		   rados_completion_t completion,
 		   char *buf, size_t len, uint64_t off);
 
+/**
+ * Asynchronously read from several objects at once
+ *
+ * The same as calling rados_aio_read() for each, but all of them are
+ * submitted in one go, which is cheaper for large batches of small
+ * reads.  Entry i of each array describes the i-th read.
+ *
+ * @param io the context in which to perform the reads
+ * @param num the number of reads
+ * @param oids the names of the objects to read from
+ * @param completions what to do when each read is complete
+ * @param bufs where to store the results
+ * @param lens the number of bytes to read
+ * @param offs the offsets to start reading from
+ * @returns 0 on success, negative error code on failure, in which
+ * case no read was started
+ */
+int rados_aio_read_batch(rados_ioctx_t io, size_t num, const char **oids,
+			 rados_completion_t *completions,
+			 char **bufs, const size_t *lens, const uint64_t *offs);
+
+/**
+ * Asynchronously write to several objects at once
+ *
+ * The same as calling rados_aio_write() for each, but all of them are
+ * submitted in one go.  Entry i of each array describes the i-th write.
+ *
+ * @param io the context in which the writes will occur
+ * @param num the number of writes
+ * @param oids the names of the objects
+ * @param completions what to do when each write is safe and complete
+ * @param bufs data to write
+ * @param lens lengths of the data, in bytes
+ * @param offs byte offsets in the objects to begin writing at
+ * @returns 0 on success, -EROFS if the io context specifies a snap_seq
+ * other than LIBRADOS_SNAP_HEAD, in which case no write was started
+ */
+int rados_aio_write_batch(rados_ioctx_t io, size_t num, const char **oids,
+			  rados_completion_t *completions,
+			  const char **bufs, const size_t *lens,
+			  const uint64_t *offs);
+
 /**
  * Block until all pending writes in an io context are safe
  *
@@ -19,6 +19,7 @@ namespace librados
   using ceph::bufferlist;
 
   struct AioCompletionImpl;
+  struct AioCompletionSetImpl;
   class IoCtx;
   struct IoCtxImpl;
   class ObjectOperationImpl;
@@ -70,6 +71,8 @@ namespace librados
     const std::pair<std::string, std::string>* operator->() const;
     ObjectIterator &operator++(); // Preincrement
     ObjectIterator operator++(int); // Postincrement
+    /// opaque position after the current object; see IoCtx::objects_begin
+    void get_cursor(bufferlist *cursor) const;
     friend class IoCtx;
   private:
     void get_next();
@@ -102,6 +105,45 @@ namespace librados
     AioCompletionImpl *pc;
   };
 
+  /**
+   * A set of completions to wait on together
+   *
+   * A completion can be in only one set at a time, and must not be
+   * released while in one.
+   */
+  struct AioCompletionSet {
+    AioCompletionSet(AioCompletionSetImpl *pc_) : pc(pc_) {}
+    /// add a completion, before or after its operation is started
+    void add(AioCompletion *c);
+    /// completions added and not yet returned
+    size_t size();
+    /**
+     * wait for any completion in the set to complete, and remove it
+     *
+     * @returns the completion, or NULL if the set is empty
+     */
+    AioCompletion *wait_for_any();
+    /// wait for every completion in the set to complete, and empty it
+    void wait_for_all();
+    /**
+     * remove up to max completed completions, without blocking
+     *
+     * @param cs where to store them, in the order they completed
+     * @returns how many were stored
+     */
+    size_t poll(AioCompletion **cs, size_t max);
+    /**
+     * get a file descriptor that polls readable while the set holds
+     * completed completions; closed by release()
+     *
+     * @returns the file descriptor, or a negative error code
+     */
+    int get_fd();
+    /// free the set; any completions still in it are not released
+    void release();
+    AioCompletionSetImpl *pc;
+  };
+
   struct PoolAsyncCompletion {
     PoolAsyncCompletion(PoolAsyncCompletionImpl *pc_) : pc(pc_) {}
     int set_callback(void *cb_arg, callback_t cb);
@@ -585,6 +627,10 @@ namespace librados
 
 
     ObjectIterator objects_begin();
+    /// list only part of nparts contiguous ranges of pgs
+    ObjectIterator objects_begin(unsigned part, unsigned nparts);
+    /// go on from ObjectIterator::get_cursor()
+    ObjectIterator objects_begin(const bufferlist& cursor);
     const ObjectIterator& objects_end() const;
 
     uint64_t get_last_version();
@@ -704,6 +750,33 @@ namespace librados
     int aio_operate(const std::string& oid, AioCompletion *c,
 		    ObjectReadOperation *op, snap_t snapid, int flags,
 		    bufferlist *pbl);
+    /**
+     * Schedule several async write operations at once
+     *
+     * The same as calling aio_operate() for each, but they are handed
+     * to the objecter together, so that a large batch of small ops
+     * costs one pass through its locks rather than one each.  Entry i
+     * of each array describes the i-th op.
+     *
+     * @param num the number of ops
+     * @param oids the objects to operate on
+     * @param completions what to do when each op is complete and safe
+     * @param ops the operations to perform
+     * @returns 0 on success, negative error code on failure, in which
+     * case no op was started
+     */
+    int aio_operate_batch(size_t num, const std::string *oids,
+			  AioCompletion **completions,
+			  ObjectWriteOperation **ops);
+    /**
+     * Schedule several async read operations at once
+     *
+     * @param pbls where to store each op's data; may be NULL
+     * @see the write version above
+     */
+    int aio_operate_batch(size_t num, const std::string *oids,
+			  AioCompletion **completions,
+			  ObjectReadOperation **ops, bufferlist **pbls);
 
     // watch/notify
     int watch(const std::string& o, uint64_t ver, uint64_t *handle,
@@ -799,6 +872,7 @@ namespace librados
 
    // -- aio --
     static AioCompletion *aio_create_completion();
+    static AioCompletionSet *aio_create_completion_set();
     static AioCompletion *aio_create_completion(void *cb_arg, callback_t cb_complete,
 						callback_t cb_safe);
 
@@ -26,6 +26,7 @@ extern "C" {
 #include <sys/types.h>
 #endif
 #include <string.h>
+#include <sys/uio.h>
 #include "../rados/librados.h"
 #include "features.h"
 
@@ -355,11 +356,63 @@ int rbd_diff_iterate(rbd_image_t image,
 		     const char *fromsnapname,
 		     uint64_t ofs, uint64_t len,
 		     int (*cb)(uint64_t, size_t, int, void *), void *arg);
+/**
+ * get difference between two versions of an image, possibly by object
+ *
+ * Like rbd_diff_iterate(), but if whole_object is set, the changed
+ * extents may be reported as whole objects, when that lets them be
+ * found without looking at the objects themselves (see the fast diff
+ * feature).
+ *
+ * @param fromsnapname start snapshot name, or NULL
+ * @param ofs start offset
+ * @param len len in bytes of region to report on
+ * @param whole_object whether extents may be rounded out to objects
+ * @param cb callback to call for each allocated region
+ * @param arg argument to pass to the callback
+ * @returns 0 on success, or negative error code on error
+ */
+int rbd_diff_iterate2(rbd_image_t image,
+		      const char *fromsnapname,
+		      uint64_t ofs, uint64_t len, uint8_t whole_object,
+		      int (*cb)(uint64_t, size_t, int, void *), void *arg);
 ssize_t rbd_write(rbd_image_t image, uint64_t ofs, size_t len, const char *buf);
 int rbd_discard(rbd_image_t image, uint64_t ofs, uint64_t len);
 int rbd_aio_write(rbd_image_t image, uint64_t off, size_t len, const char *buf, rbd_completion_t c);
 int rbd_aio_read(rbd_image_t image, uint64_t off, size_t len, char *buf, rbd_completion_t c);
 int rbd_aio_discard(rbd_image_t image, uint64_t off, uint64_t len, rbd_completion_t c);
+/**
+ * Write from several buffers at once.
+ *
+ * Unlike rbd_aio_write(), the data is not copied unless a cache needs
+ * it, so the buffers must stay valid and unchanged until the
+ * completion is called.
+ *
+ * @param image the image to write to
+ * @param iov the buffers to write, in order
+ * @param iovcnt how many buffers there are
+ * @param off offset in the image
+ * @param c what to call when the write is complete
+ * @returns 0 on success, negative error code on failure
+ */
+int rbd_aio_writev(rbd_image_t image, const struct iovec *iov, int iovcnt,
+		   uint64_t off, rbd_completion_t c);
+/**
+ * Read into several buffers at once.
+ *
+ * Like rbd_aio_read(), the buffers must stay valid until the
+ * completion is called.  Without a cache, data is received straight
+ * into them where it can be, rather than copied.
+ *
+ * @param image the image to read from
+ * @param iov the buffers to fill, in order
+ * @param iovcnt how many buffers there are
+ * @param off offset in the image
+ * @param c what to call when the read is complete
+ * @returns 0 on success, negative error code on failure
+ */
+int rbd_aio_readv(rbd_image_t image, const struct iovec *iov, int iovcnt,
+		  uint64_t off, rbd_completion_t c);
 int rbd_aio_create_completion(void *cb_arg, rbd_callback_t complete_cb, rbd_completion_t *c);
 int rbd_aio_is_complete(rbd_completion_t c);
 int rbd_aio_wait_for_complete(rbd_completion_t c);
@@ -180,9 +180,31 @@ public:
   int diff_iterate(const char *fromsnapname,
 		   uint64_t ofs, uint64_t len,
 		   int (*cb)(uint64_t, size_t, int, void *), void *arg);
+  /**
+   * get difference between two versions of an image, possibly by object
+   *
+   * Like diff_iterate(), but if whole_object is set, the changed
+   * extents may be reported as whole objects, when that lets them be
+   * found without looking at the objects themselves (see the fast
+   * diff feature).
+   */
+  int diff_iterate2(const char *fromsnapname,
+		    uint64_t ofs, uint64_t len, bool whole_object,
+		    int (*cb)(uint64_t, size_t, int, void *), void *arg);
   ssize_t write(uint64_t ofs, size_t len, ceph::bufferlist& bl);
   int discard(uint64_t ofs, uint64_t len);
 
+  /**
+   * write async to image
+   *
+   * The buffers of bl are referenced, not copied, until the write
+   * completes, so their contents should not be changed before then.
+   *
+   * @param off offset in image
+   * @param len length of write
+   * @param bl data to write, at least len bytes
+   * @param c aio completion to notify when write is complete
+   */
   int aio_write(uint64_t off, size_t len, ceph::bufferlist& bl, RBD::AioCompletion *c);
 
   /**
@@ -27,11 +27,17 @@
  *   rbd_data.<id>.00000000
  *   rbd_data.<id>.00000001
  *   ...                     - data
+ *   rbd_object_map.<id>     - which data objects exist, with the
+ *   rbd_object_map.<id>.<snap id>  object map feature
+ *   rbd_diff_map.<id>       - which data objects changed since the
+ *   rbd_diff_map.<id>.<snap id>  previous snapshot, with fast diff
  */
 
 #define RBD_HEADER_PREFIX      "rbd_header."
 #define RBD_DATA_PREFIX        "rbd_data."
 #define RBD_ID_PREFIX          "rbd_id."
+#define RBD_OBJECT_MAP_PREFIX  "rbd_object_map."
+#define RBD_DIFF_MAP_PREFIX    "rbd_diff_map."
 
 /*
  * old-style rbd image 'foo' consists of objects
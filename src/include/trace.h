@@ -0,0 +1,54 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_TRACE_H
+#define CEPH_TRACE_H
+
+/*
+ * static tracepoints on the op path
+ *
+ * Built --with-usdt these are USDT probes of the "ceph" provider: a
+ * nop each until perf, systemtap or bpftrace attaches to them.
+ * Otherwise they compile to nothing.  Arguments are evaluated whenever
+ * the probes are built in, so pass integers that are already at hand.
+ *
+ * script/ceph-trace-latency.py turns a trace of them into a latency
+ * breakdown per op; see doc/dev/tracing.rst for the list of probes.
+ */
+
+#ifdef __CEPH__
+# include "acconfig.h"
+#endif
+
+#ifdef WITH_USDT
+
+#include <sys/sdt.h>
+
+#define CEPH_TRACE1(name, a) \
+  DTRACE_PROBE1(ceph, name, a)
+#define CEPH_TRACE2(name, a, b) \
+  DTRACE_PROBE2(ceph, name, a, b)
+#define CEPH_TRACE3(name, a, b, c) \
+  DTRACE_PROBE3(ceph, name, a, b, c)
+#define CEPH_TRACE4(name, a, b, c, d) \
+  DTRACE_PROBE4(ceph, name, a, b, c, d)
+
+#else
+
+#define CEPH_TRACE1(name, a) do { } while (0)
+#define CEPH_TRACE2(name, a, b) do { } while (0)
+#define CEPH_TRACE3(name, a, b, c) do { } while (0)
+#define CEPH_TRACE4(name, a, b, c, d) do { } while (0)
+
+#endif
+
+#endif
@@ -22,6 +22,8 @@ package com.ceph.fs;
 import java.io.IOException;
 import java.io.FileNotFoundException;
 import java.net.InetAddress;
+import java.nio.ByteBuffer;
+import java.util.List;
 import java.util.concurrent.locks.Lock;
 import java.util.concurrent.locks.ReentrantReadWriteLock;
 import java.lang.String;
@@ -297,6 +299,36 @@ public class CephMount {
 
   private static native String[] native_ceph_listdir(long mountp, String path);
 
+  /**
+   * List the contents of a directory along with the stats of the entries.
+   *
+   * This is one call for the whole directory, rather than a listdir()
+   * followed by an lstat() of every entry.  The stats are those lstat()
+   * would return.
+   *
+   * @param dir The directory.
+   * @param stats The stats of the entries are appended to this list, in
+   *              the order of the names returned.
+   * @return List of files and directories excluding "." and "..".
+   */
+  public String[] listdirplus(String dir, List<CephStat> stats) throws FileNotFoundException {
+    Object[] ents;
+    rlock.lock();
+    try {
+      ents = native_ceph_listdirplus(instance_ptr, dir);
+    } finally {
+      rlock.unlock();
+    }
+    String[] names = new String[ents.length / 2];
+    for (int i = 0; i < names.length; i++) {
+      names[i] = (String)ents[2 * i];
+      stats.add((CephStat)ents[2 * i + 1]);
+    }
+    return names;
+  }
+
+  private static native Object[] native_ceph_listdirplus(long mountp, String path);
+
   /**
    * Create a hard link to an existing file.
    *
@@ -631,6 +663,34 @@ public class CephMount {
 
   private static native long native_ceph_read(long mountp, int fd, byte[] buf, long size, long offset);
 
+  /**
+   * Read from a file into a direct buffer.
+   *
+   * The data is read straight into the buffer's memory, rather than
+   * through a copy of a Java array.  Reads up to buf.remaining() bytes
+   * at the buffer's position, and moves the position past them.
+   *
+   * @param fd The file descriptor.
+   * @param buf Direct buffer for the data read.
+   * @param offset Offset to read from (-1 for current position).
+   * @return The number of bytes read.
+   */
+  public long read(int fd, ByteBuffer buf, long offset) {
+    long ret;
+    rlock.lock();
+    try {
+      ret = native_ceph_read_direct(instance_ptr, fd, buf, buf.position(),
+          buf.remaining(), offset);
+    } finally {
+      rlock.unlock();
+    }
+    if (ret > 0)
+      buf.position(buf.position() + (int)ret);
+    return ret;
+  }
+
+  private static native long native_ceph_read_direct(long mountp, int fd, ByteBuffer buf, int pos, long size, long offset);
+
   /**
    * Write to a file at a specific offset.
    *
@@ -651,6 +711,33 @@ public class CephMount {
 
   private static native long native_ceph_write(long mountp, int fd, byte[] buf, long size, long offset);
 
+  /**
+   * Write to a file from a direct buffer.
+   *
+   * Writes the buffer's remaining bytes straight from its memory, and
+   * moves its position past the bytes written.
+   *
+   * @param fd The file descriptor.
+   * @param buf Direct buffer to write.
+   * @param offset Offset to write from (-1 for current position).
+   * @return The number of bytes written.
+   */
+  public long write(int fd, ByteBuffer buf, long offset) {
+    long ret;
+    rlock.lock();
+    try {
+      ret = native_ceph_write_direct(instance_ptr, fd, buf, buf.position(),
+          buf.remaining(), offset);
+    } finally {
+      rlock.unlock();
+    }
+    if (ret > 0)
+      buf.position(buf.position() + (int)ret);
+    return ret;
+  }
+
+  private static native long native_ceph_write_direct(long mountp, int fd, ByteBuffer buf, int pos, long size, long offset);
+
   /**
    * Truncate a file.
    *
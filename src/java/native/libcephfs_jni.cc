@@ -23,6 +23,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <sys/un.h>
 #include <jni.h>
 
@@ -141,6 +142,8 @@ static jfieldID cephstat_m_time_fid;
 static jfieldID cephstat_is_file_fid;
 static jfieldID cephstat_is_directory_fid;
 static jfieldID cephstat_is_symlink_fid;
+static jclass cephstat_global_cls;
+static jmethodID cephstat_ctor_fid;
 
 /* Cached field IDs for com.ceph.fs.CephStatVFS */
 static jfieldID cephstatvfs_bsize_fid;
@@ -308,6 +311,13 @@ static void setup_field_ids(JNIEnv *env, jclass clz)
 	GETFID(cephstat, is_directory, Z);
 	GETFID(cephstat, is_symlink, Z);
 
+	cephstat_global_cls = (jclass)env->NewGlobalRef(cephstat_cls);
+	env->DeleteLocalRef(cephstat_cls);
+
+	cephstat_ctor_fid = env->GetMethodID(cephstat_global_cls, "<init>", "()V");
+	if (!cephstat_ctor_fid)
+		return;
+
 	/* Cache CephStatVFS fields */
 
 	cephstatvfs_cls = env->FindClass(CEPH_STAT_VFS_CP);
@@ -860,6 +870,93 @@ out:
 	return NULL;
 }
 
+static void fill_cephstat(JNIEnv *env, jobject j_cephstat, struct stat *st);
+
+/*
+ * Class:     com_ceph_fs_CephMount
+ * Method:    native_ceph_listdirplus
+ * Signature: (JLjava/lang/String;)[Ljava/lang/Object;
+ *
+ * Returns the entries as name, CephStat, name, CephStat, ... so that a
+ * whole directory takes one JNI call and no stat per entry.
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_ceph_fs_CephMount_native_1ceph_1listdirplus
+	(JNIEnv *env, jclass clz, jlong j_mntp, jstring j_path)
+{
+	struct ceph_mount_info *cmount = get_ceph_mount(j_mntp);
+	CephContext *cct = ceph_get_mount_context(cmount);
+	struct ceph_dir_result *dirp;
+	vector<pair<string, struct stat> > contents;
+	struct dirent de;
+	struct stat st;
+	const char *c_path;
+	jobjectArray entlist;
+	jstring name;
+	jobject j_stat;
+	int ret, stmask;
+	unsigned i;
+
+	CHECK_ARG_NULL(j_path, "@path is null", NULL);
+	CHECK_MOUNTED(cmount, NULL);
+
+	c_path = env->GetStringUTFChars(j_path, NULL);
+	if (!c_path) {
+		cephThrowInternal(env, "failed to pin memory");
+		return NULL;
+	}
+
+	ldout(cct, 10) << "jni: listdirplus: opendir: path " << c_path << dendl;
+
+	ret = ceph_opendir(cmount, c_path, &dirp);
+	env->ReleaseStringUTFChars(j_path, c_path);
+	if (ret) {
+		handle_error(env, ret);
+		return NULL;
+	}
+
+	/* the stats come with the entries; no round trip per entry */
+	while ((ret = ceph_readdirplus_r(cmount, dirp, &de, &st, &stmask)) > 0) {
+		/* filter out dot files: xref: java.io.File::list() */
+		if (!strcmp(de.d_name, ".") || !strcmp(de.d_name, ".."))
+			continue;
+		contents.push_back(make_pair(string(de.d_name), st));
+	}
+
+	ceph_closedir(cmount, dirp);
+
+	ldout(cct, 10) << "jni: listdirplus: exit ret " << ret << " entries "
+		<< contents.size() << dendl;
+
+	if (ret < 0) {
+		handle_error(env, ret);
+		return NULL;
+	}
+
+	entlist = env->NewObjectArray(2 * contents.size(),
+			env->FindClass("java/lang/Object"), NULL);
+	if (!entlist)
+		return NULL;
+
+	for (i = 0; i < contents.size(); i++) {
+		name = env->NewStringUTF(contents[i].first.c_str());
+		if (!name)
+			return NULL;
+		env->SetObjectArrayElement(entlist, 2 * i, name);
+		env->DeleteLocalRef(name);
+
+		j_stat = env->NewObject(cephstat_global_cls, cephstat_ctor_fid);
+		if (!j_stat)
+			return NULL;
+		fill_cephstat(env, j_stat, &contents[i].second);
+		env->SetObjectArrayElement(entlist, 2 * i + 1, j_stat);
+		env->DeleteLocalRef(j_stat);
+		if (env->ExceptionOccurred())
+			return NULL;
+	}
+
+	return entlist;
+}
+
 /*
  * Class:     com_ceph_fs_CephMount
  * Method:    native_ceph_link
@@ -1713,6 +1810,97 @@ JNIEXPORT jlong JNICALL Java_com_ceph_fs_CephMount_native_1ceph_1write
 }
 
 
+/*
+ * Get the memory of a direct ByteBuffer from @pos to @pos + @size
+ */
+static char *get_direct_buffer(JNIEnv *env, jobject j_buf, jint j_pos, jlong j_size)
+{
+	char *c_buf;
+
+	c_buf = (char *)env->GetDirectBufferAddress(j_buf);
+	if (!c_buf) {
+		cephThrowIllegalArg(env, "@buf is not a direct buffer");
+		return NULL;
+	}
+
+	if (j_pos < 0 || j_size < 0 ||
+	    j_pos + j_size > env->GetDirectBufferCapacity(j_buf)) {
+		cephThrowIndexBounds(env, "@pos + @size > @buf.capacity");
+		return NULL;
+	}
+
+	return c_buf + j_pos;
+}
+
+/*
+ * Class:     com_ceph_fs_CephMount
+ * Method:    native_ceph_read_direct
+ * Signature: (JILjava/nio/ByteBuffer;IJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_com_ceph_fs_CephMount_native_1ceph_1read_1direct
+	(JNIEnv *env, jclass clz, jlong j_mntp, jint j_fd, jobject j_buf, jint j_pos,
+	 jlong j_size, jlong j_offset)
+{
+	struct ceph_mount_info *cmount = get_ceph_mount(j_mntp);
+	CephContext *cct = ceph_get_mount_context(cmount);
+	char *c_buf;
+	long ret;
+
+	CHECK_ARG_NULL(j_buf, "@buf is null", -1);
+	CHECK_MOUNTED(cmount, -1);
+
+	c_buf = get_direct_buffer(env, j_buf, j_pos, j_size);
+	if (!c_buf)
+		return -1;
+
+	ldout(cct, 10) << "jni: read_direct: fd " << (int)j_fd << " len " << (long)j_size <<
+		" offset " << (long)j_offset << dendl;
+
+	/* straight into the buffer; nothing to pin or copy back */
+	ret = ceph_read(cmount, (int)j_fd, c_buf, j_size, j_offset);
+
+	ldout(cct, 10) << "jni: read_direct: exit ret " << ret << dendl;
+
+	if (ret < 0)
+		handle_error(env, (int)ret);
+
+	return (jlong)ret;
+}
+
+/*
+ * Class:     com_ceph_fs_CephMount
+ * Method:    native_ceph_write_direct
+ * Signature: (JILjava/nio/ByteBuffer;IJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_com_ceph_fs_CephMount_native_1ceph_1write_1direct
+	(JNIEnv *env, jclass clz, jlong j_mntp, jint j_fd, jobject j_buf, jint j_pos,
+	 jlong j_size, jlong j_offset)
+{
+	struct ceph_mount_info *cmount = get_ceph_mount(j_mntp);
+	CephContext *cct = ceph_get_mount_context(cmount);
+	char *c_buf;
+	long ret;
+
+	CHECK_ARG_NULL(j_buf, "@buf is null", -1);
+	CHECK_MOUNTED(cmount, -1);
+
+	c_buf = get_direct_buffer(env, j_buf, j_pos, j_size);
+	if (!c_buf)
+		return -1;
+
+	ldout(cct, 10) << "jni: write_direct: fd " << (int)j_fd << " len " << (long)j_size <<
+		" offset " << (long)j_offset << dendl;
+
+	ret = ceph_write(cmount, (int)j_fd, c_buf, j_size, j_offset);
+
+	ldout(cct, 10) << "jni: write_direct: exit ret " << ret << dendl;
+
+	if (ret < 0)
+		handle_error(env, (int)ret);
+
+	return (jlong)ret;
+}
+
 /*
  * Class:     com_ceph_fs_CephMount
  * Method:    native_ceph_ftruncate
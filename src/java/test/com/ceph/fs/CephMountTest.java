@@ -23,6 +23,8 @@ package com.ceph.fs;
 import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.net.InetAddress;
+import java.nio.ByteBuffer;
+import java.util.ArrayList;
 import java.util.UUID;
 import org.junit.*;
 import static org.junit.Assert.*;
@@ -298,6 +300,44 @@ public class CephMountTest {
     mount.rmdir(dir);
   }
 
+  @Test(expected=FileNotFoundException.class)
+  public void test_listdirplus_dne() throws Exception {
+    mount.listdirplus("/this/path/does/not/exist/", new ArrayList<CephStat>());
+  }
+
+  @Test
+  public void test_listdirplus() throws Exception {
+    String dir = makePath();
+    mount.mkdir(dir, 0777);
+    ArrayList<CephStat> stats = new ArrayList<CephStat>();
+    String[] list = mount.listdirplus(dir, stats);
+    assertTrue(list.length == 0);
+    assertTrue(stats.size() == 0);
+
+    for (int i = 0; i < 30; i++)
+      mount.mkdir(dir + "/d" + i, 0777);
+    for (int i = 0; i < 3; i++)
+      mount.close(createFile(dir + "/f" + i, 10 * i));
+
+    list = mount.listdirplus(dir, stats);
+    assertTrue(list.length == 33);
+    assertTrue(stats.size() == 33);
+    for (int i = 0; i < list.length; i++) {
+      CephStat st = new CephStat();
+      mount.lstat(dir + "/" + list[i], st);
+      assertTrue(stats.get(i).isDir() == st.isDir());
+      assertTrue(stats.get(i).isFile() == st.isFile());
+      assertTrue(stats.get(i).size == st.size);
+      assertTrue(stats.get(i).mode == st.mode);
+    }
+
+    for (int i = 0; i < 30; i++)
+      mount.rmdir(dir + "/d" + i);
+    for (int i = 0; i < 3; i++)
+      mount.unlink(dir + "/f" + i);
+    mount.rmdir(dir);
+  }
+
   /*
    * Missing
    *
@@ -744,6 +784,49 @@ public class CephMountTest {
     mount.unlink(path);
   }
 
+  @Test
+  public void test_read_write_direct() throws Exception {
+    String path = makePath();
+    int fd = mount.open(path, CephMount.O_RDWR|CephMount.O_CREAT, 0600);
+    ByteBuffer buf = ByteBuffer.allocateDirect(1500);
+    for (int i = 0; i < 1500; i++)
+      buf.put((byte)i);
+    buf.flip();
+    long ret = mount.write(fd, buf, 0);
+    assertTrue(ret == 1500);
+    assertTrue(buf.remaining() == 0);
+
+    /* read into the middle of a buffer */
+    ByteBuffer rbuf = ByteBuffer.allocateDirect(2000);
+    rbuf.position(100);
+    rbuf.limit(1600);
+    ret = mount.read(fd, rbuf, 0);
+    assertTrue(ret == 1500);
+    assertTrue(rbuf.position() == 1600);
+    for (int i = 0; i < 1500; i++)
+      assertTrue(rbuf.get(100 + i) == (byte)i);
+
+    /* short read at the end of the file */
+    rbuf.clear();
+    ret = mount.read(fd, rbuf, 1000);
+    assertTrue(ret == 500);
+    assertTrue(rbuf.position() == 500);
+    mount.close(fd);
+    mount.unlink(path);
+  }
+
+  @Test(expected=IllegalArgumentException.class)
+  public void test_read_not_direct() throws Exception {
+    String path = makePath();
+    int fd = createFile(path, 1);
+    try {
+      mount.read(fd, ByteBuffer.allocate(1), 0);
+    } finally {
+      mount.close(fd);
+      mount.unlink(path);
+    }
+  }
+
   /*
    * ftruncate
    */
@@ -362,22 +362,30 @@ static int omap_insert(cls_method_context_t hctx,
   int assert_bound = bound;
 
   //if this is an exclusive insert, make sure the key doesn't already exist.
+  //all the keys are looked up at once rather than with an op each.
+  std::set<string> keys;
   for (map<string, bufferlist>::const_iterator it = omap.begin();
       it != omap.end(); ++it) {
-    bufferlist bl;
-    r = cls_cxx_map_get_val(hctx, it->first, &bl);
-    if (r == 0 && string(bl.c_str(), bl.length()) != ""){
-      if (exclusive) {
-	CLS_LOG(20, "error: this is an exclusive insert and %s exists.",
-	    it->first.c_str());
-	return -EEXIST;
-      }
-      assert_bound++;
-      CLS_LOG(20, "increased assert_bound to %d", assert_bound);
-    } else if (r != -ENODATA && r != -ENOENT) {
-      CLS_LOG(20, "error reading omap val for %s: %d", it->first.c_str(), r);
-      return r;
+    keys.insert(it->first);
+  }
+  map<string, bufferlist> existing;
+  r = cls_cxx_map_get_vals_by_keys(hctx, keys, &existing);
+  if (r < 0) {
+    CLS_LOG(20, "error reading omap vals: %d", r);
+    return r;
+  }
+  for (map<string, bufferlist>::iterator it = existing.begin();
+      it != existing.end(); ++it) {
+    if (string(it->second.c_str(), it->second.length()) == "") {
+      continue;
+    }
+    if (exclusive) {
+      CLS_LOG(20, "error: this is an exclusive insert and %s exists.",
+	  it->first.c_str());
+      return -EEXIST;
     }
+    assert_bound++;
+    CLS_LOG(20, "increased assert_bound to %d", assert_bound);
   }
 
   r = 0;
@@ -511,17 +519,19 @@ static int omap_remove(cls_method_context_t hctx,
     return r;
   }
 
-  //check for existance of the key first
+  //check for existance of the keys first
+  map<string, bufferlist> existing;
+  r = cls_cxx_map_get_vals_by_keys(hctx, omap, &existing);
+  if (r < 0) {
+    CLS_LOG(20, "error reading omap vals: %d", r);
+    return r;
+  }
   for (set<string>::const_iterator it = omap.begin();
       it != omap.end(); ++it) {
-    bufferlist bl;
-    r = cls_cxx_map_get_val(hctx, *it, &bl);
-    if (r == -ENOENT || r == -ENODATA
-	|| string(bl.c_str(), bl.length()) == ""){
+    map<string, bufferlist>::iterator e = existing.find(*it);
+    if (e == existing.end()
+	|| string(e->second.c_str(), e->second.length()) == ""){
       return -ENODATA;
-    } else if (r < 0) {
-      CLS_LOG(20, "error reading omap val for %s: %d", it->c_str(), r);
-      return r;
     }
   }
 
@@ -552,13 +562,10 @@ static int omap_remove(cls_method_context_t hctx,
     return r;
   }
 
-  for (std::set<string>::const_iterator it = omap.begin();
-      it != omap.end(); ++it) {
-    r = cls_cxx_map_remove_key(hctx, *it);
-    if (r < 0) {
-      CLS_LOG(20, "error removing omap: %d", r);
-      return r;
-    }
+  r = cls_cxx_map_remove_keys(hctx, omap);
+  if (r < 0) {
+    CLS_LOG(20, "error removing omap: %d", r);
+    return r;
   }
   return 0;
 }
@@ -776,11 +776,7 @@ void KvFlatBtreeAsync::set_up_ops(
     index_data this_entry(idata.to_create[i].max, idata.to_create[i].min,
 	idata.to_create[i].obj);
     to_insert[idata.to_create[i].max.encoded()] = to_bl(this_entry);
-    if (idata.to_create.size() <= 2) {
-      it->first = pair<int, string>(MAKE_OBJECT, idata.to_create[i].obj);
-    } else {
-      it->first = pair<int, string>(AIO_MAKE_OBJECT, idata.to_create[i].obj);
-    }
+    it->first = pair<int, string>(AIO_MAKE_OBJECT, idata.to_create[i].obj);
     set_up_make_object(create_vector[i].omap, it->second);
     ++it;
   }
@@ -906,34 +902,41 @@ int KvFlatBtreeAsync::perform_ops(const string &debug_prefix,
       }
       break;
     case AIO_MAKE_OBJECT:
-      cout << debug_prefix << " launching asynchronous create "
+      //the new objects are independent of each other, so they are all
+      //created at once and waited for together.
+      if (verbose) cout << debug_prefix << " launching asynchronous create "
 	  << it->first.second << std::endl;
       aiocs[count] = rados.aio_create_completion();
       io_ctx.aio_operate(it->first.second, aiocs[count], it->second);
       count++;
       if ((int)idata.to_create.size() == count) {
-	cout << "starting aiowrite waiting loop" << std::endl;
-	  for (count -= 1; count >= 0; count--) {
-	    aiocs[count]->wait_for_safe();
-	    err = aiocs[count]->get_return_value();
-	    if (err < 0) {
-	      //this can happen if someone else was cleaning up after us.
-	      cerr << debug_prefix << " a create failed"
-		  << " with code " << err << std::endl;
-	      if (err == -EEXIST) {
-		//someone thinks we died, so die
-		cerr << client_name << " is suiciding!" << std::endl;
-		return -ESUICIDE;
-	      } else {
-		assert(false);
-	      }
-	      return err;
-	    }
-	    if (verbose || idata.to_create.size() > 2) {
-	      cout << debug_prefix << " completed aio " << aiocs.size() - count
-		  << "/" << aiocs.size() << std::endl;
+	if (verbose) cout << debug_prefix << " waiting for " << count
+	    << " creates" << std::endl;
+	int first_err = 0;
+	for (count -= 1; count >= 0; count--) {
+	  aiocs[count]->wait_for_safe();
+	  err = aiocs[count]->get_return_value();
+	  aiocs[count]->release();
+	  if (err < 0) {
+	    //this can happen if someone else was cleaning up after us.
+	    cerr << debug_prefix << " a create failed"
+		<< " with code " << err << std::endl;
+	    if (first_err == 0) {
+	      first_err = err;
 	    }
+	    continue;
 	  }
+	  if (verbose) cout << debug_prefix << " completed aio "
+	      << aiocs.size() - count << "/" << aiocs.size() << std::endl;
+	}
+	if (first_err == -EEXIST) {
+	  //someone thinks we died, so die
+	  cerr << client_name << " is suiciding!" << std::endl;
+	  return -ESUICIDE;
+	} else if (first_err < 0) {
+	  assert(false);
+	}
+	err = 0;
       }
       break;
     case REMOVE_OBJECT://deleting
@@ -1437,7 +1440,13 @@ int KvFlatBtreeAsync::set_op(const string &key, const bufferlist &val,
     }
     case -EKEYREJECTED: {
       //the object needs to be split.
+      int attempt = 0;
       do {
+	if (attempt > 0) {
+	  //someone else is splitting it or changed it under us
+	  backoff(attempt);
+	}
+	attempt++;
 	if (verbose) cout << "\t" << client_name << ": running split on "
 	    << idata.obj
             << std::endl;
@@ -1483,6 +1492,9 @@ int KvFlatBtreeAsync::set_op(const string &key, const bufferlist &val,
       if (err == -ENOENT || err == -EACCES) {
 	if (err == -ENOENT) {
 	  if (verbose) cout << "CACHE FAILURE" << std::endl;
+	} else {
+	  //the object is being split or merged; give that a chance to finish
+	  backoff(0);
 	}
 	err = read_index(key, &idata, NULL, true);
 	if (err < 0) {
@@ -1558,7 +1570,13 @@ int KvFlatBtreeAsync::remove_op(const string &key, index_data &idata,
     }
     case -EKEYREJECTED: {
       //the object needs to be split.
+      int attempt = 0;
       do {
+        if (attempt > 0) {
+          //someone else is rebalancing it or changed it under us
+          backoff(attempt);
+        }
+        attempt++;
         if (verbose) cerr << "\t" << client_name << ": running rebalance on "
             << idata.obj << std::endl;
         err = read_index(key, &idata, &next_idata, true);
@@ -1622,6 +1640,10 @@ int KvFlatBtreeAsync::remove_op(const string &key, index_data &idata,
     }
     default:
       if (err == -ENOENT || err == -EACCES) {
+	if (err == -EACCES) {
+	  //the object is being split or merged; give that a chance to finish
+	  backoff(0);
+	}
 	err = read_index(key, &idata, &next_idata, true);
 	if (err < 0) {
 	  if (verbose) cout << "\t" << client_name
@@ -1672,6 +1694,14 @@ int KvFlatBtreeAsync::handle_set_rm_errors(int &err, string obj,
   return err;
 }
 
+void KvFlatBtreeAsync::backoff(int attempt) {
+  int ms = attempt < 6 ? 1 << attempt : max_backoff_ms;
+  if (ms > max_backoff_ms) {
+    ms = max_backoff_ms;
+  }
+  usleep((rand() % (ms * 1000)) + 1);
+}
+
 int KvFlatBtreeAsync::get(const string &key, bufferlist *val) {
   opmap['g']++;
   if (verbose) cout << client_name << ": getting " << key << std::endl;
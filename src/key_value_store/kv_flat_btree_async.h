@@ -502,6 +502,8 @@ protected:
   double cache_refresh; //read cache_size / cache_refresh entries each time the
 			//index is read
   bool verbose;//if true, display lots of debug output
+  int max_backoff_ms; //longest a client waits before retrying after losing
+		     //a race with another client
 
   //shared variables protected with mutexes
   Mutex client_index_lock;
@@ -721,6 +723,13 @@ protected:
   int handle_set_rm_errors(int &err, string key, string obj,
       index_data * idata, index_data * next_idata);
 
+  /**
+   * sleeps for a random time of up to 2^attempt ms (capped at
+   * max_backoff_ms), so that clients that lost a race for an object or
+   * for the index don't retry in lockstep while the winner finishes.
+   */
+  void backoff(int attempt);
+
   /**
    * called by aio_set, aio_remove, and aio_get, respectively.
    */
@@ -756,6 +765,7 @@ KvFlatBtreeAsync(int k_val, string name, int cache, double cache_r,
     cache_size(cache),
     cache_refresh(cache_r),
     verbose(verb),
+    max_backoff_ms(64),
     client_index_lock("client_index_lock"),
     client_index(0),
     icache_lock("icache_lock"),
@@ -686,6 +686,58 @@ extern "C" int ceph_write(struct ceph_mount_info *cmount, int fd, const char *bu
   return cmount->get_client()->write(fd, buf, size, offset);
 }
 
+extern "C" int ceph_preadv(struct ceph_mount_info *cmount, int fd,
+			   const struct iovec *iov, int iovcnt, loff_t offset)
+{
+  if (!cmount->is_mounted())
+    return -ENOTCONN;
+  return cmount->get_client()->preadv(fd, iov, iovcnt, offset);
+}
+
+extern "C" int ceph_pwritev(struct ceph_mount_info *cmount, int fd,
+			    const struct iovec *iov, int iovcnt, loff_t offset)
+{
+  if (!cmount->is_mounted())
+    return -ENOTCONN;
+  return cmount->get_client()->pwritev(fd, iov, iovcnt, offset);
+}
+
+class C_AioCallback : public Context {
+  ceph_aio_callback_t cb;
+  void *arg;
+public:
+  C_AioCallback(ceph_aio_callback_t c, void *a) : cb(c), arg(a) {}
+  void finish(int r) {
+    cb(r, arg);
+  }
+};
+
+extern "C" int ceph_aio_read(struct ceph_mount_info *cmount, int fd, char *buf,
+			     loff_t size, loff_t offset,
+			     ceph_aio_callback_t cb, void *arg)
+{
+  if (!cmount->is_mounted())
+    return -ENOTCONN;
+  Context *c = new C_AioCallback(cb, arg);
+  int r = cmount->get_client()->aio_read(fd, buf, size, offset, c);
+  if (r < 0)
+    delete c;
+  return r;
+}
+
+extern "C" int ceph_aio_write(struct ceph_mount_info *cmount, int fd, const char *buf,
+			      loff_t size, loff_t offset,
+			      ceph_aio_callback_t cb, void *arg)
+{
+  if (!cmount->is_mounted())
+    return -ENOTCONN;
+  Context *c = new C_AioCallback(cb, arg);
+  int r = cmount->get_client()->aio_write(fd, buf, size, offset, c);
+  if (r < 0)
+    delete c;
+  return r;
+}
+
 extern "C" int ceph_ftruncate(struct ceph_mount_info *cmount, int fd, loff_t size)
 {
   if (!cmount->is_mounted())
@@ -708,6 +760,29 @@ extern "C" int ceph_fallocate(struct ceph_mount_info *cmount, int fd, int mode,
   return cmount->get_client()->fallocate(fd, mode, offset, length);
 }
 
+extern "C" int ceph_lazyio(struct ceph_mount_info *cmount, int fd, int enable)
+{
+  if (!cmount->is_mounted())
+    return -ENOTCONN;
+  return cmount->get_client()->lazyio(fd, enable);
+}
+
+extern "C" int ceph_lazyio_propagate(struct ceph_mount_info *cmount, int fd,
+				     loff_t offset, size_t count)
+{
+  if (!cmount->is_mounted())
+    return -ENOTCONN;
+  return cmount->get_client()->lazyio_propagate(fd, offset, count);
+}
+
+extern "C" int ceph_lazyio_synchronize(struct ceph_mount_info *cmount, int fd,
+				       loff_t offset, size_t count)
+{
+  if (!cmount->is_mounted())
+    return -ENOTCONN;
+  return cmount->get_client()->lazyio_synchronize(fd, offset, count);
+}
+
 extern "C" int ceph_fstat(struct ceph_mount_info *cmount, int fd, struct stat *stbuf)
 {
   if (!cmount->is_mounted())
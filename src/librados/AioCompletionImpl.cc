@@ -0,0 +1,82 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "acconfig.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#include "AioCompletionImpl.h"
+
+librados::AioCompletionSetImpl::~AioCompletionSetImpl()
+{
+  if (fd[0] >= 0)
+    ::close(fd[0]);
+  if (fd[1] >= 0)
+    ::close(fd[1]);
+}
+
+int librados::AioCompletionSetImpl::get_fd()
+{
+  Mutex::Locker l(lock);
+  if (fd[0] >= 0)
+    return fd[0];
+#ifdef HAVE_SYS_EVENTFD_H
+  fd[0] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd[0] < 0)
+    return -errno;
+#else
+  if (::pipe(fd) < 0)
+    return -errno;
+  for (int i = 0; i < 2; ++i) {
+    ::fcntl(fd[i], F_SETFL, ::fcntl(fd[i], F_GETFL) | O_NONBLOCK);
+    ::fcntl(fd[i], F_SETFD, FD_CLOEXEC);
+  }
+#endif
+  if (!done.empty())
+    _fd_signal();
+  return fd[0];
+}
+
+void librados::AioCompletionSetImpl::_fd_signal()
+{
+  assert(lock.is_locked());
+  if (fd[0] < 0)
+    return;
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t v = 1;
+  int r = ::write(fd[0], &v, sizeof(v));
+#else
+  char v = 0;
+  int r = ::write(fd[1], &v, sizeof(v));
+#endif
+  assert(r == sizeof(v));
+}
+
+void librados::AioCompletionSetImpl::_fd_drain()
+{
+  assert(lock.is_locked());
+  if (fd[0] < 0)
+    return;
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t v;
+#else
+  char v;
+#endif
+  // we write at most once per time done fills up, so one read will do
+  int r = ::read(fd[0], &v, sizeof(v));
+  assert(r == sizeof(v) || (r < 0 && errno == EAGAIN));
+}
@@ -26,6 +26,10 @@
 
 class IoCtxImpl;
 
+namespace librados {
+  struct AioCompletionSetImpl;
+}
+
 struct librados::AioCompletionImpl {
   Mutex lock;
   Cond cond;
@@ -47,6 +51,8 @@ struct librados::AioCompletionImpl {
   tid_t aio_write_seq;
   xlist<AioCompletionImpl*>::item aio_write_list_item;
 
+  AioCompletionSetImpl *set;  ///< told when we complete, if any
+
   AioCompletionImpl() : lock("AioCompletionImpl lock", false, false),
 			ref(1), rval(0), released(false), ack(false), safe(false),
 			objver(0),
@@ -55,7 +61,8 @@ struct librados::AioCompletionImpl {
 			callback_complete_arg(0),
 			callback_safe_arg(0),
 			is_read(false), pbl(0), buf(0), maxlen(0),
-			io(NULL), aio_write_seq(0), aio_write_list_item(this) { }
+			io(NULL), aio_write_seq(0), aio_write_list_item(this),
+			set(NULL) { }
 
   int set_complete_callback(void *cb_arg, rados_callback_t cb) {
     lock.Lock();
@@ -136,6 +143,9 @@ struct librados::AioCompletionImpl {
     return v;
   }
 
+  /// with lock held, once ack is set and the result is in place
+  void _notify_set();
+
   void get() {
     lock.Lock();
     _get();
@@ -165,6 +175,178 @@ struct librados::AioCompletionImpl {
   }
 };
 
+/**
+ * A set of completions that can be waited on together.  Each holds a
+ * reference to its completion until it is handed back.
+ *
+ * It also serves as a completion queue for callers that would rather
+ * not block per op: poll() harvests whatever has completed, and
+ * get_fd() gives a descriptor that is readable while anything has.
+ */
+struct librados::AioCompletionSetImpl {
+  Mutex lock;
+  Cond cond;
+  int waiters;        ///< threads blocked in wait_for_*()
+  int fd[2];          ///< eventfd (fd[0] only) or pipe; -1 until asked for
+  map<AioCompletionImpl*, void*> pending;        ///< completion -> cookie
+  list<pair<AioCompletionImpl*, void*> > done;   ///< in completion order
+
+  AioCompletionSetImpl() : lock("AioCompletionSetImpl lock", false, false),
+			   waiters(0) {
+    fd[0] = fd[1] = -1;
+  }
+  ~AioCompletionSetImpl();
+
+  // fd is readable exactly while done is non-empty
+  void _fd_signal();
+  void _fd_drain();
+
+  void _push_done(const pair<AioCompletionImpl*, void*>& p) {
+    assert(lock.is_locked());
+    done.push_back(p);
+    if (done.size() == 1)
+      _fd_signal();
+    if (waiters)
+      cond.Signal();
+  }
+  pair<AioCompletionImpl*, void*> _pop_done() {
+    assert(lock.is_locked());
+    pair<AioCompletionImpl*, void*> p = done.front();
+    done.pop_front();
+    if (done.empty())
+      _fd_drain();
+    return p;
+  }
+
+  void add(AioCompletionImpl *c, void *cookie) {
+    c->lock.Lock();
+    assert(!c->set);
+    c->_get();
+    lock.Lock();
+    if (c->ack) {
+      _push_done(make_pair(c, cookie));
+    } else {
+      pending[c] = cookie;
+      c->set = this;
+    }
+    lock.Unlock();
+    c->lock.Unlock();
+  }
+
+  /// with c->lock held
+  void complete(AioCompletionImpl *c) {
+    Mutex::Locker l(lock);
+    map<AioCompletionImpl*, void*>::iterator p = pending.find(c);
+    if (p == pending.end())
+      return;  // we're being released
+    _push_done(*p);
+    pending.erase(p);
+  }
+
+  size_t size() {
+    Mutex::Locker l(lock);
+    return pending.size() + done.size();
+  }
+
+  /**
+   * get a descriptor that polls readable while completions are waiting
+   * to be harvested.  It stays open until the set is released.
+   *
+   * @return the fd, or negative error code
+   */
+  int get_fd();
+
+  /**
+   * take out up to max completed completions, without blocking
+   *
+   * @param cookies [out] cookies they were added with
+   * @return how many were taken
+   */
+  size_t poll(void **cookies, size_t max) {
+    vector<AioCompletionImpl*> ls;
+    lock.Lock();
+    while (ls.size() < max && !done.empty()) {
+      pair<AioCompletionImpl*, void*> p = _pop_done();
+      cookies[ls.size()] = p.second;
+      ls.push_back(p.first);
+    }
+    lock.Unlock();
+    for (vector<AioCompletionImpl*>::iterator p = ls.begin(); p != ls.end(); ++p)
+      (*p)->put();
+    return ls.size();
+  }
+
+  /**
+   * wait for any completion in the set to complete, and take it out
+   *
+   * @param cookie [out] cookie it was added with
+   * @return false if the set was empty
+   */
+  bool wait_for_any(void **cookie) {
+    lock.Lock();
+    ++waiters;
+    while (done.empty() && !pending.empty())
+      cond.Wait(lock);
+    --waiters;
+    if (done.empty()) {
+      lock.Unlock();
+      return false;
+    }
+    pair<AioCompletionImpl*, void*> p = _pop_done();
+    *cookie = p.second;
+    lock.Unlock();
+    p.first->put();
+    return true;
+  }
+
+  /// wait for every completion in the set to complete, and empty it
+  void wait_for_all() {
+    lock.Lock();
+    ++waiters;
+    while (!pending.empty())
+      cond.Wait(lock);
+    --waiters;
+    list<pair<AioCompletionImpl*, void*> > ls;
+    ls.swap(done);
+    _fd_drain();
+    lock.Unlock();
+    for (list<pair<AioCompletionImpl*, void*> >::iterator p = ls.begin();
+	 p != ls.end(); ++p)
+      p->first->put();
+  }
+
+  /// drop all completions, complete or not, and free the set
+  void release() {
+    lock.Lock();
+    map<AioCompletionImpl*, void*> ls;
+    ls.swap(pending);
+    list<pair<AioCompletionImpl*, void*> > dls;
+    dls.swap(done);
+    lock.Unlock();
+    for (map<AioCompletionImpl*, void*>::iterator p = ls.begin();
+	 p != ls.end(); ++p) {
+      // once detached under its lock, c won't look at us again
+      AioCompletionImpl *c = p->first;
+      c->lock.Lock();
+      c->set = NULL;
+      c->put_unlock();
+    }
+    for (list<pair<AioCompletionImpl*, void*> >::iterator p = dls.begin();
+	 p != dls.end(); ++p)
+      p->first->put();
+    delete this;
+  }
+};
+
+inline void librados::AioCompletionImpl::_notify_set()
+{
+  assert(lock.is_locked());
+  if (set) {
+    set->complete(this);
+    set = NULL;
+  }
+}
+
 namespace librados {
 struct C_AioComplete : public Context {
   AioCompletionImpl *c;
@@ -224,6 +406,7 @@ struct C_AioCompleteAndSafe : public Context {
     c->rval = r;
     c->ack = true;
     c->safe = true;
+    c->_notify_set();
     c->lock.Unlock();
     rados_callback_t cb_complete = c->callback_complete;
     void *cb_complete_arg = c->callback_complete_arg;
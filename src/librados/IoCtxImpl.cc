@@ -95,7 +95,7 @@ void librados::IoCtxImpl::complete_aio_write(AioCompletionImpl *c)
     ldout(client->cct, 20) << " waking waiters on seq " << waiters->first << dendl;
     for (std::list<AioCompletionImpl*>::iterator it = waiters->second.begin();
 	 it != waiters->second.end(); ++it) {
-      client->finisher.queue(new C_AioCompleteAndSafe(*it));
+      client->finisher.queue(this, new C_AioCompleteAndSafe(*it));
       (*it)->put();
     }
     aio_write_waiters.erase(waiters++);
@@ -115,7 +115,7 @@ void librados::IoCtxImpl::flush_aio_writes_async(AioCompletionImpl *c)
   if (aio_write_list.empty()) {
     ldout(client->cct, 20) << "flush_aio_writes_async no writes. (tid "
 			   << seq << ")" << dendl;
-    client->finisher.queue(new C_AioCompleteAndSafe(c));
+    client->finisher.queue(this, new C_AioCompleteAndSafe(c));
   } else {
     ldout(client->cct, 20) << "flush_aio_writes_async " << aio_write_list.size()
 			   << " writes in flight; waiting on tid " << seq << dendl;
@@ -508,11 +508,9 @@ int librados::IoCtxImpl::operate(const object_t& oid, ::ObjectOperation *o,
 
   int op = o->ops[0].op.op;
   ldout(client->cct, 10) << ceph_osd_op_name(op) << " oid=" << oid << " nspace=" << oloc.nspace << dendl;
-  lock->Lock();
   objecter->mutate(oid, oloc,
 	           *o, snapc, ut, 0,
 	           NULL, oncommit, &ver);
-  lock->Unlock();
 
   mylock.Lock();
   while (!done)
@@ -542,11 +540,9 @@ int librados::IoCtxImpl::operate_read(const object_t& oid,
 
   int op = o->ops[0].op.op;
   ldout(client->cct, 10) << ceph_osd_op_name(op) << " oid=" << oid << " nspace=" << oloc.nspace << dendl;
-  lock->Lock();
   objecter->read(oid, oloc,
 	           *o, snap_seq, pbl, 0,
 	           onack, &ver);
-  lock->Unlock();
 
   mylock.Lock();
   while (!done)
@@ -572,7 +568,6 @@ int librados::IoCtxImpl::aio_operate_read(const object_t &oid,
   c->io = this;
   c->pbl = pbl;
 
-  Mutex::Locker l(*lock);
   objecter->read(oid, oloc,
 		 *o, snap_seq, pbl, flags,
 		 onack, &c->objver);
@@ -594,13 +589,93 @@ int librados::IoCtxImpl::aio_operate(const object_t& oid,
   c->io = this;
   queue_aio_write(c);
 
-  Mutex::Locker l(*lock);
   objecter->mutate(oid, oloc, *o, snap_context, ut, 0, onack, oncommit,
 		   &c->objver);
 
   return 0;
 }
 
+int librados::IoCtxImpl::aio_operate_batch(size_t num, const object_t *oids,
+					   ::ObjectOperation **ops,
+					   AioCompletionImpl **cs,
+					   const SnapContext& snap_context)
+{
+  utime_t ut = ceph_clock_now(client->cct);
+  /* can't write to a snapshot */
+  if (snap_seq != CEPH_NOSNAP)
+    return -EROFS;
+
+  vector<Objecter::Op*> batch;
+  batch.reserve(num);
+  for (size_t i = 0; i < num; ++i) {
+    AioCompletionImpl *c = cs[i];
+    Context *onack = new C_aio_Ack(c);
+    Context *oncommit = new C_aio_Safe(c);
+
+    c->io = this;
+    queue_aio_write(c);
+
+    batch.push_back(objecter->prepare_mutate_op(oids[i], oloc, *ops[i],
+						snap_context, ut, 0,
+						onack, oncommit, &c->objver));
+  }
+  objecter->op_submit_batch(batch);
+  return 0;
+}
+
+int librados::IoCtxImpl::aio_operate_read_batch(size_t num,
+						const object_t *oids,
+						::ObjectOperation **ops,
+						AioCompletionImpl **cs,
+						int flags, bufferlist **pbls)
+{
+  vector<Objecter::Op*> batch;
+  batch.reserve(num);
+  for (size_t i = 0; i < num; ++i) {
+    AioCompletionImpl *c = cs[i];
+    Context *onack = new C_aio_Ack(c);
+
+    c->is_read = true;
+    c->io = this;
+    c->pbl = pbls ? pbls[i] : NULL;
+
+    batch.push_back(objecter->prepare_read_op(oids[i], oloc, *ops[i],
+					      snap_seq, &c->bl, flags,
+					      onack, &c->objver));
+  }
+  objecter->op_submit_batch(batch);
+  return 0;
+}
+
+int librados::IoCtxImpl::aio_read_batch(size_t num, const object_t *oids,
+					AioCompletionImpl **cs, char **bufs,
+					const size_t *lens, const uint64_t *offs,
+					uint64_t snapid)
+{
+  for (size_t i = 0; i < num; ++i)
+    if (lens[i] > (size_t) INT_MAX)
+      return -EDOM;
+
+  vector<Objecter::Op*> batch;
+  batch.reserve(num);
+  for (size_t i = 0; i < num; ++i) {
+    AioCompletionImpl *c = cs[i];
+    Context *onack = new C_aio_Ack(c);
+
+    c->is_read = true;
+    c->io = this;
+    c->buf = bufs[i];
+    c->maxlen = lens[i];
+
+    ::ObjectOperation op;
+    op.read(offs[i], lens[i], NULL, NULL);
+    batch.push_back(objecter->prepare_read_op(oids[i], oloc, op, snapid,
+					      &c->bl, 0, onack, &c->objver));
+  }
+  objecter->op_submit_batch(batch);
+  return 0;
+}
+
 int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
 				  bufferlist *pbl, size_t len, uint64_t off,
 				  uint64_t snapid)
@@ -614,7 +689,6 @@ int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
   c->io = this;
   c->pbl = pbl;
 
-  Mutex::Locker l(*lock);
   objecter->read(oid, oloc,
 		 off, len, snapid, &c->bl, 0,
 		 onack, &c->objver);
@@ -635,7 +709,6 @@ int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
   c->buf = buf;
   c->maxlen = len;
 
-  Mutex::Locker l(*lock);
   objecter->read(oid, oloc,
 		 off, len, snapid, &c->bl, 0,
 		 onack, &c->objver);
@@ -672,7 +745,6 @@ int librados::IoCtxImpl::aio_sparse_read(const object_t oid,
 
   onack->m_ops.sparse_read(off, len, m, data_bl, NULL);
 
-  Mutex::Locker l(*lock);
   objecter->read(oid, oloc,
 		 onack->m_ops, snap_seq, NULL, 0,
 		 onack, &c->objver);
@@ -696,7 +768,6 @@ int librados::IoCtxImpl::aio_write(const object_t &oid, AioCompletionImpl *c,
   Context *onack = new C_aio_Ack(c);
   Context *onsafe = new C_aio_Safe(c);
 
-  Mutex::Locker l(*lock);
   objecter->write(oid, oloc,
 		  off, len, snapc, bl, ut, 0,
 		  onack, onsafe, &c->objver);
@@ -719,7 +790,6 @@ int librados::IoCtxImpl::aio_append(const object_t &oid, AioCompletionImpl *c,
   Context *onack = new C_aio_Ack(c);
   Context *onsafe = new C_aio_Safe(c);
 
-  Mutex::Locker l(*lock);
   objecter->append(oid, oloc,
 		   len, snapc, bl, ut, 0,
 		   onack, onsafe, &c->objver);
@@ -743,7 +813,6 @@ int librados::IoCtxImpl::aio_write_full(const object_t &oid,
   Context *onack = new C_aio_Ack(c);
   Context *onsafe = new C_aio_Safe(c);
 
-  Mutex::Locker l(*lock);
   objecter->write_full(oid, oloc,
 		       snapc, bl, ut, 0,
 		       onack, onsafe, &c->objver);
@@ -765,7 +834,6 @@ int librados::IoCtxImpl::aio_remove(const object_t &oid, AioCompletionImpl *c)
   Context *onack = new C_aio_Ack(c);
   Context *onsafe = new C_aio_Safe(c);
 
-  Mutex::Locker l(*lock);
   objecter->remove(oid, oloc,
 		   snapc, ut, 0,
 		   onack, onsafe, &c->objver);
@@ -780,7 +848,6 @@ int librados::IoCtxImpl::aio_stat(const object_t& oid, AioCompletionImpl *c,
   c->io = this;
   C_aio_stat_Ack *onack = new C_aio_stat_Ack(c, pmtime);
 
-  Mutex::Locker l(*lock);
   objecter->stat(oid, oloc,
 		 snap_seq, psize, &onack->mtime, 0,
 		 onack, &c->objver);
@@ -848,7 +915,6 @@ int librados::IoCtxImpl::aio_exec(const object_t& oid, AioCompletionImpl *c,
   c->is_read = true;
   c->io = this;
 
-  Mutex::Locker l(*lock);
   ::ObjectOperation rd;
   prepare_assert_ops(&rd);
   rd.call(cls, method, inbl);
@@ -890,11 +956,9 @@ int librados::IoCtxImpl::mapext(const object_t& oid,
   int r;
   Context *onack = new C_SafeCond(&mylock, &cond, &done, &r);
 
-  lock->Lock();
   objecter->mapext(oid, oloc,
 		   off, len, snap_seq, &bl, 0,
 		   onack);
-  lock->Unlock();
 
   mylock.Lock();
   while (!done)
@@ -1187,15 +1251,23 @@ void librados::IoCtxImpl::C_aio_Ack::finish(int r)
   if (c->pbl) {
     *c->pbl = c->bl;
   }
+  c->_notify_set();
 
+  IoCtxImpl *io = c->io;
+  librados::RadosClient *client = io->client;
+  Context *complete = NULL, *safe = NULL;
   if (c->callback_complete) {
-    c->io->client->finisher.queue(new C_AioComplete(c));
+    complete = new C_AioComplete(c);
   }
   if (c->is_read && c->callback_safe) {
-    c->io->client->finisher.queue(new C_AioSafe(c));
+    safe = new C_AioSafe(c);
   }
 
   c->put_unlock();
+  if (complete)
+    client->queue_aio_callback(io, complete);
+  if (safe)
+    client->queue_aio_callback(io, safe);
 }
 
 ///////////////////////////// C_aio_stat_Ack ////////////////////////////
@@ -1217,12 +1289,18 @@ void librados::IoCtxImpl::C_aio_stat_Ack::finish(int r)
   if (r >= 0 && pmtime) {
     *pmtime = mtime.sec();
   }
+  c->_notify_set();
 
+  IoCtxImpl *io = c->io;
+  librados::RadosClient *client = io->client;
+  Context *complete = NULL;
   if (c->callback_complete) {
-    c->io->client->finisher.queue(new C_AioComplete(c));
+    complete = new C_AioComplete(c);
   }
 
   c->put_unlock();
+  if (complete)
+    client->queue_aio_callback(io, complete);
 }
 
 //////////////////////////// C_aio_Safe ////////////////////////////////
@@ -1238,17 +1316,23 @@ void librados::IoCtxImpl::C_aio_Safe::finish(int r)
   if (!c->ack) {
     c->rval = r;
     c->ack = true;
+    c->_notify_set();
   }
   c->safe = true;
   c->cond.Signal();
 
+  IoCtxImpl *io = c->io;
+  librados::RadosClient *client = io->client;
+  Context *safe = NULL;
   if (c->callback_safe) {
-    c->io->client->finisher.queue(new C_AioSafe(c));
+    safe = new C_AioSafe(c);
   }
 
   c->io->complete_aio_write(c);
 
   c->put_unlock();
+  if (safe)
+    client->queue_aio_callback(io, safe);
 }
 
 ///////////////////////// C_NotifyComplete /////////////////////////////
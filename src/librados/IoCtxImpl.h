@@ -141,6 +141,12 @@ struct librados::IoCtxImpl {
 		  AioCompletionImpl *c, const SnapContext& snap_context);
   int aio_operate_read(const object_t& oid, ::ObjectOperation *o,
 		       AioCompletionImpl *c, int flags, bufferlist *pbl);
+  int aio_operate_batch(size_t num, const object_t *oids,
+			::ObjectOperation **ops, AioCompletionImpl **cs,
+			const SnapContext& snap_context);
+  int aio_operate_read_batch(size_t num, const object_t *oids,
+			     ::ObjectOperation **ops, AioCompletionImpl **cs,
+			     int flags, bufferlist **pbls);
 
   struct C_aio_Ack : public Context {
     librados::AioCompletionImpl *c;
@@ -166,6 +172,9 @@ struct librados::IoCtxImpl {
 	       bufferlist *pbl, size_t len, uint64_t off, uint64_t snapid);
   int aio_read(object_t oid, AioCompletionImpl *c,
 	       char *buf, size_t len, uint64_t off, uint64_t snapid);
+  int aio_read_batch(size_t num, const object_t *oids, AioCompletionImpl **cs,
+		     char **bufs, const size_t *lens, const uint64_t *offs,
+		     uint64_t snapid);
   int aio_sparse_read(const object_t oid, AioCompletionImpl *c,
 		      std::map<uint64_t,uint64_t> *m, bufferlist *data_bl,
 		      size_t len, uint64_t off, uint64_t snapid);
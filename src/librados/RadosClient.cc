@@ -77,7 +77,7 @@ librados::RadosClient::RadosClient(CephContext *cct_)
     timer(cct, lock),
     refcnt(1),
     log_last_version(0), log_cb(NULL), log_cb_arg(NULL),
-    finisher(cct),
+    finisher(cct, cct->_conf->librados_finisher_threads),
     max_watch_cookie(0)
 {
 }
@@ -190,6 +190,7 @@ int librados::RadosClient::connect()
   if (!objecter)
     goto out;
   objecter->set_balanced_budget();
+  objecter->set_completion_threads(conf->objecter_completion_threads);
 
   monclient.set_messenger(messenger);
 
@@ -299,6 +300,14 @@ int librados::RadosClient::create_ioctx(const char *name, IoCtxImpl **io)
 
 bool librados::RadosClient::ms_dispatch(Message *m)
 {
+  // op replies need none of our state (the objecter does its own
+  // locking and aio completions take theirs), so don't serialize them
+  // behind everything else on our lock
+  if (m->get_type() == CEPH_MSG_OSD_OPREPLY) {
+    objecter->handle_osd_op_reply(static_cast<MOSDOpReply*>(m));
+    return true;
+  }
+
   Mutex::Locker l(lock);
   bool ret;
 
@@ -336,9 +345,6 @@ bool librados::RadosClient::_dispatch(Message *m)
 {
   switch (m->get_type()) {
   // OSD
-  case CEPH_MSG_OSD_OPREPLY:
-    objecter->handle_osd_op_reply(static_cast<MOSDOpReply*>(m));
-    break;
   case CEPH_MSG_OSD_MAP:
     objecter->handle_osd_map(static_cast<MOSDMap*>(m));
     cond.Signal();
@@ -578,6 +584,19 @@ public:
   }
 };
 
+/*
+ * When the objecter completes ops on threads of its own we are already
+ * on one of those, so there is no point in handing the callback to our
+ * finisher as well.
+ */
+void librados::RadosClient::queue_aio_callback(const void *key, Context *c)
+{
+  if (objecter->get_completion_threads())
+    c->complete(0);
+  else
+    finisher.queue(key, c);
+}
+
 void librados::RadosClient::watch_notify(MWatchNotify *m)
 {
   assert(lock.is_locked());
@@ -586,7 +605,7 @@ void librados::RadosClient::watch_notify(MWatchNotify *m)
     WatchContext *wc = iter->second;
     assert(wc);
     wc->get();
-    finisher.queue(new C_WatchNotify(wc, &lock, m->opcode, m->ver, m->notify_id, m->bl));
+    finisher.queue(wc, new C_WatchNotify(wc, &lock, m->opcode, m->ver, m->notify_id, m->bl));
   }
   m->put();
 }
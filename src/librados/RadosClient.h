@@ -73,7 +73,14 @@ private:
   void wait_for_osdmap();
 
 public:
-  Finisher finisher;
+  /// runs user callbacks, in order for each key
+  ShardedFinisher finisher;
+
+  /**
+   * run an aio user callback, on the finisher unless already off
+   * dispatch; callbacks with the same key (their IoCtxImpl) run in order
+   */
+  void queue_aio_callback(const void *key, Context *c);
 
   RadosClient(CephContext *cct_);
   ~RadosClient();
@@ -506,6 +506,12 @@ void librados::ObjectIterator::get_next()
   cur_obj = make_pair(entry, key ? key : string());
 }
 
+void librados::ObjectIterator::get_cursor(bufferlist *cursor) const
+{
+  assert(ctx);
+  ctx->lc->encode_cursor(*cursor);
+}
+
 const librados::ObjectIterator librados::ObjectIterator::__EndObjectIterator(NULL);
 
 ///////////////////////////// PoolAsyncCompletion //////////////////////////////
@@ -627,6 +633,46 @@ void librados::AioCompletion::AioCompletion::release()
   delete this;
 }
 
+///////////////////////////// AioCompletionSet //////////////////////////////
+void librados::AioCompletionSet::add(AioCompletion *c)
+{
+  pc->add(c->pc, c);
+}
+
+size_t librados::AioCompletionSet::size()
+{
+  return pc->size();
+}
+
+librados::AioCompletion *librados::AioCompletionSet::wait_for_any()
+{
+  void *c;
+  if (!pc->wait_for_any(&c))
+    return NULL;
+  return (AioCompletion *)c;
+}
+
+void librados::AioCompletionSet::wait_for_all()
+{
+  pc->wait_for_all();
+}
+
+size_t librados::AioCompletionSet::poll(AioCompletion **cs, size_t max)
+{
+  return pc->poll((void **)cs, max);
+}
+
+int librados::AioCompletionSet::get_fd()
+{
+  return pc->get_fd();
+}
+
+void librados::AioCompletionSet::release()
+{
+  pc->release();
+  delete this;
+}
+
 ///////////////////////////// IoCtx //////////////////////////////
 librados::IoCtx::IoCtx() : io_ctx_impl(NULL)
 {
@@ -979,6 +1025,41 @@ int librados::IoCtx::aio_operate(const std::string& oid, AioCompletion *c,
 				       op_flags, pbl);
 }
 
+int librados::IoCtx::aio_operate_batch(size_t num, const std::string *oids,
+				       AioCompletion **completions,
+				       librados::ObjectWriteOperation **ops)
+{
+  if (!num)
+    return 0;
+  vector<object_t> objs(oids, oids + num);
+  vector< ::ObjectOperation*> o(num);
+  vector<AioCompletionImpl*> cs(num);
+  for (size_t i = 0; i < num; ++i) {
+    o[i] = (::ObjectOperation*)ops[i]->impl;
+    cs[i] = completions[i]->pc;
+  }
+  return io_ctx_impl->aio_operate_batch(num, &objs[0], &o[0], &cs[0],
+					io_ctx_impl->snapc);
+}
+
+int librados::IoCtx::aio_operate_batch(size_t num, const std::string *oids,
+				       AioCompletion **completions,
+				       librados::ObjectReadOperation **ops,
+				       bufferlist **pbls)
+{
+  if (!num)
+    return 0;
+  vector<object_t> objs(oids, oids + num);
+  vector< ::ObjectOperation*> o(num);
+  vector<AioCompletionImpl*> cs(num);
+  for (size_t i = 0; i < num; ++i) {
+    o[i] = (::ObjectOperation*)ops[i]->impl;
+    cs[i] = completions[i]->pc;
+  }
+  return io_ctx_impl->aio_operate_read_batch(num, &objs[0], &o[0], &cs[0],
+					     0, pbls);
+}
+
 void librados::IoCtx::snap_set_read(snap_t seq)
 {
   io_ctx_impl->set_snap_read(seq);
@@ -1131,6 +1212,37 @@ librados::ObjectIterator librados::IoCtx::objects_begin()
   return iter;
 }
 
+librados::ObjectIterator librados::IoCtx::objects_begin(unsigned part,
+							 unsigned nparts)
+{
+  rados_list_ctx_t listh;
+  int r = rados_objects_list_open_part(io_ctx_impl, part, nparts, &listh);
+  if (r < 0) {
+    ostringstream oss;
+    oss << "rados returned " << cpp_strerror(r);
+    throw std::runtime_error(oss.str());
+  }
+  ObjectIterator iter((ObjListCtx*)listh);
+  iter.get_next();
+  return iter;
+}
+
+librados::ObjectIterator librados::IoCtx::objects_begin(const bufferlist& cursor)
+{
+  rados_list_ctx_t listh;
+  bufferlist bl(cursor);
+  int r = rados_objects_list_open_cursor(io_ctx_impl, bl.c_str(),
+					 bl.length(), &listh);
+  if (r < 0) {
+    ostringstream oss;
+    oss << "rados returned " << cpp_strerror(r);
+    throw std::runtime_error(oss.str());
+  }
+  ObjectIterator iter((ObjListCtx*)listh);
+  iter.get_next();
+  return iter;
+}
+
 const librados::ObjectIterator& librados::IoCtx::objects_end() const
 {
   return ObjectIterator::__EndObjectIterator;
@@ -1591,6 +1703,11 @@ librados::AioCompletion *librados::Rados::aio_create_completion()
   return new AioCompletion(c);
 }
 
+librados::AioCompletionSet *librados::Rados::aio_create_completion_set()
+{
+  return new AioCompletionSet(new AioCompletionSetImpl);
+}
+
 librados::AioCompletion *librados::Rados::aio_create_completion(void *cb_arg,
 								callback_t cb_complete,
 								callback_t cb_safe)
@@ -2539,6 +2656,63 @@ extern "C" int rados_objects_list_open(rados_ioctx_t io, rados_list_ctx_t *listh
   return 0;
 }
 
+extern "C" int rados_objects_list_open_part(rados_ioctx_t io, unsigned part,
+					   unsigned nparts,
+					   rados_list_ctx_t *listh)
+{
+  if (part >= nparts)
+    return -EINVAL;
+  librados::IoCtxImpl *ctx = (librados::IoCtxImpl *)io;
+  Objecter::ListContext *h = new Objecter::ListContext;
+  h->pool_id = ctx->poolid;
+  h->pool_snap_seq = ctx->snap_seq;
+  h->nspace = ctx->oloc.nspace;
+  h->part = part;
+  h->num_parts = nparts;
+  *listh = (void *)new librados::ObjListCtx(ctx, h);
+  return 0;
+}
+
+extern "C" int rados_objects_list_get_cursor(rados_list_ctx_t listctx,
+					    char *buf, size_t *len)
+{
+  librados::ObjListCtx *lh = (librados::ObjListCtx *)listctx;
+  bufferlist bl;
+  lh->lc->encode_cursor(bl);
+  if (bl.length() > *len) {
+    *len = bl.length();
+    return -ERANGE;
+  }
+  bl.copy(0, bl.length(), buf);
+  *len = bl.length();
+  return 0;
+}
+
+extern "C" int rados_objects_list_open_cursor(rados_ioctx_t io,
+					     const char *buf, size_t len,
+					     rados_list_ctx_t *listh)
+{
+  librados::IoCtxImpl *ctx = (librados::IoCtxImpl *)io;
+  Objecter::ListContext *h = new Objecter::ListContext;
+  bufferlist bl;
+  bl.append(buf, len);
+  bufferlist::iterator p = bl.begin();
+  try {
+    h->decode_cursor(p);
+  } catch (buffer::error& e) {
+    delete h;
+    return -EINVAL;
+  }
+  if (h->pool_id != ctx->poolid || h->nspace != ctx->oloc.nspace ||
+      h->part >= h->num_parts) {
+    delete h;
+    return -EINVAL;
+  }
+  h->pool_snap_seq = ctx->snap_seq;
+  *listh = (void *)new librados::ObjListCtx(ctx, h);
+  return 0;
+}
+
 extern "C" void rados_objects_list_close(rados_list_ctx_t h)
 {
   librados::ObjListCtx *lh = (librados::ObjListCtx *)h;
@@ -2648,6 +2822,54 @@ extern "C" void rados_aio_release(rados_completion_t c)
   ((librados::AioCompletionImpl*)c)->put();
 }
 
+extern "C" int rados_aio_create_completion_set(rados_completion_set_t *pset)
+{
+  *pset = (rados_completion_set_t)new librados::AioCompletionSetImpl;
+  return 0;
+}
+
+extern "C" void rados_aio_completion_set_add(rados_completion_set_t set,
+					     rados_completion_t c)
+{
+  ((librados::AioCompletionSetImpl*)set)->add((librados::AioCompletionImpl*)c,
+					      c);
+}
+
+extern "C" size_t rados_aio_completion_set_size(rados_completion_set_t set)
+{
+  return ((librados::AioCompletionSetImpl*)set)->size();
+}
+
+extern "C" int rados_aio_completion_set_wait_for_any(rados_completion_set_t set,
+						     rados_completion_t *pc)
+{
+  if (!((librados::AioCompletionSetImpl*)set)->wait_for_any(pc))
+    return -ENOENT;
+  return 0;
+}
+
+extern "C" size_t rados_aio_completion_set_poll(rados_completion_set_t set,
+						rados_completion_t *cs,
+						size_t max)
+{
+  return ((librados::AioCompletionSetImpl*)set)->poll(cs, max);
+}
+
+extern "C" int rados_aio_completion_set_get_fd(rados_completion_set_t set)
+{
+  return ((librados::AioCompletionSetImpl*)set)->get_fd();
+}
+
+extern "C" void rados_aio_completion_set_wait_for_all(rados_completion_set_t set)
+{
+  ((librados::AioCompletionSetImpl*)set)->wait_for_all();
+}
+
+extern "C" void rados_aio_completion_set_release(rados_completion_set_t set)
+{
+  ((librados::AioCompletionSetImpl*)set)->release();
+}
+
 extern "C" int rados_aio_read(rados_ioctx_t io, const char *o,
 			       rados_completion_t completion,
 			       char *buf, size_t len, uint64_t off)
@@ -2670,6 +2892,44 @@ extern "C" int rados_aio_write(rados_ioctx_t io, const char *o,
 			bl, len, off);
 }
 
+extern "C" int rados_aio_read_batch(rados_ioctx_t io, size_t num,
+				    const char **oids,
+				    rados_completion_t *completions,
+				    char **bufs, const size_t *lens,
+				    const uint64_t *offs)
+{
+  librados::IoCtxImpl *ctx = (librados::IoCtxImpl *)io;
+  if (!num)
+    return 0;
+  vector<object_t> objs(oids, oids + num);
+  return ctx->aio_read_batch(num, &objs[0],
+			     (librados::AioCompletionImpl**)completions,
+			     bufs, lens, offs, ctx->snap_seq);
+}
+
+extern "C" int rados_aio_write_batch(rados_ioctx_t io, size_t num,
+				     const char **oids,
+				     rados_completion_t *completions,
+				     const char **bufs, const size_t *lens,
+				     const uint64_t *offs)
+{
+  librados::IoCtxImpl *ctx = (librados::IoCtxImpl *)io;
+  if (!num)
+    return 0;
+  vector<object_t> objs(oids, oids + num);
+  vector< ::ObjectOperation> ops(num);
+  vector< ::ObjectOperation*> pops(num);
+  for (size_t i = 0; i < num; ++i) {
+    bufferlist bl;
+    bl.append(bufs[i], lens[i]);
+    ops[i].write(offs[i], bl);
+    pops[i] = &ops[i];
+  }
+  return ctx->aio_operate_batch(num, &objs[0], &pops[0],
+				(librados::AioCompletionImpl**)completions,
+				ctx->snapc);
+}
+
 extern "C" int rados_aio_append(rados_ioctx_t io, const char *o,
 				rados_completion_t completion,
 				const char *buf, size_t len)
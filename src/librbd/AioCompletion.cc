@@ -2,6 +2,7 @@
 // vim: ts=8 sw=2 smarttab
 
 #include <errno.h>
+#include <string.h>
 
 #include "common/ceph_context.h"
 #include "common/dout.h"
@@ -32,19 +33,45 @@ namespace librbd {
 
   void AioCompletion::finalize(CephContext *cct, ssize_t rval)
   {
-    ldout(cct, 20) << "AioCompletion::finalize() " << (void*)this << " rval " << rval << " read_buf " << (void*)read_buf
+    ldout(cct, 20) << "AioCompletion::finalize() " << (void*)this << " rval " << rval << " read_iov " << read_iov.size()
 		   << " read_bl " << (void*)read_bl << dendl;
     if (rval >= 0 && aio_type == AIO_TYPE_READ) {
       // FIXME: make the destriper write directly into a buffer so
       // that we avoid shuffling pointers and copying zeros around.
       bufferlist bl;
       destriper.assemble_result(cct, bl, true);
+      for (std::map<uint64_t, bufferlist>::iterator p = read_overlay.begin();
+	   p != read_overlay.end(); ++p)
+	bl.copy_in(p->first, p->second.length(), p->second);
 
-      if (read_buf) {
-	assert(bl.length() == read_buf_len);
-	bl.copy(0, read_buf_len, read_buf);
-	ldout(cct, 20) << "AioCompletion::finalize() copied resulting " << bl.length()
-		       << " bytes to " << (void*)read_buf << dendl;
+      if (!read_iov.empty()) {
+	// data received in place is already where it goes
+	uint64_t copied = 0;
+	std::vector<struct iovec>::iterator v = read_iov.begin();
+	size_t v_off = 0;
+	for (std::list<bufferptr>::const_iterator p = bl.buffers().begin();
+	     p != bl.buffers().end(); ++p) {
+	  const char *src = p->length() ? p->c_str() : NULL;
+	  size_t left = p->length();
+	  while (left && v != read_iov.end()) {
+	    size_t n = MIN(left, v->iov_len - v_off);
+	    char *dest = (char *)v->iov_base + v_off;
+	    if (dest != src) {
+	      memcpy(dest, src, n);
+	      copied += n;
+	    }
+	    src += n;
+	    left -= n;
+	    v_off += n;
+	    if (v_off == v->iov_len) {
+	      ++v;
+	      v_off = 0;
+	    }
+	  }
+	  assert(left == 0);
+	}
+	ldout(cct, 20) << "AioCompletion::finalize() copied " << copied << " of "
+		       << bl.length() << " resulting bytes to read_iov" << dendl;
       }
       if (read_bl) {
 	ldout(cct, 20) << "AioCompletion::finalize() moving resulting " << bl.length()
@@ -54,6 +81,20 @@ namespace librbd {
     }
   }
 
+  char *AioCompletion::get_read_dest(uint64_t off, uint64_t len) const
+  {
+    for (std::vector<struct iovec>::const_iterator v = read_iov.begin();
+	 v != read_iov.end(); ++v) {
+      if (off < v->iov_len) {
+	if (off + len > v->iov_len)
+	  return NULL;
+	return (char *)v->iov_base + off;
+      }
+      off -= v->iov_len;
+    }
+    return NULL;
+  }
+
   void AioCompletion::complete_request(CephContext *cct, ssize_t r)
   {
     ldout(cct, 20) << "AioCompletion::complete_request() "
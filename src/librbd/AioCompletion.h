@@ -3,6 +3,11 @@
 #ifndef CEPH_LIBRBD_AIOCOMPLETION_H
 #define CEPH_LIBRBD_AIOCOMPLETION_H
 
+#include <sys/uio.h>
+
+#include <map>
+#include <vector>
+
 #include "common/Cond.h"
 #include "common/Mutex.h"
 #include "common/ceph_context.h"
@@ -58,8 +63,10 @@ namespace librbd {
 
     Striper::StripedReadResult destriper;
     bufferlist *read_bl;
-    char *read_buf;
-    size_t read_buf_len;
+    /// where a read's result goes; it may be received in place
+    std::vector<struct iovec> read_iov;
+    /// data from the write log, by offset in the result
+    std::map<uint64_t, bufferlist> read_overlay;
 
     AioCompletion() : lock("AioCompletion::lock", true),
 		      done(false), rval(0), complete_cb(NULL),
@@ -67,7 +74,7 @@ namespace librbd {
 		      pending_count(0), building(true),
 		      ref(1), released(false), ictx(NULL),
 		      aio_type(AIO_TYPE_NONE),
-		      read_bl(NULL), read_buf(NULL), read_buf_len(0) {
+		      read_bl(NULL) {
     }
     ~AioCompletion() {
     }
@@ -89,6 +96,12 @@ namespace librbd {
 
     void finalize(CephContext *cct, ssize_t rval);
 
+    /**
+     * Where len bytes at off in the result go, if they go to one
+     * contiguous range of read_iov, or NULL.
+     */
+    char *get_read_dest(uint64_t off, uint64_t len) const;
+
     void finish_adding_requests(CephContext *cct);
 
     void init_time(ImageCtx *i, aio_type_t t) {
@@ -42,7 +42,11 @@ namespace librbd {
 
   void AioRequest::read_from_parent(vector<pair<uint64_t,uint64_t> >& image_extents)
   {
-    assert(!m_parent_completion);
+    // a write may need to copy up again, if its object went away
+    if (m_parent_completion) {
+      m_parent_completion->release();
+      m_read_data.clear();
+    }
     m_parent_completion = aio_create_completion_internal(this, rbd_req_cb);
     ldout(m_ictx->cct, 20) << "read_from_parent this = " << this
 			   << " parent completion " << m_parent_completion
@@ -96,10 +100,18 @@ namespace librbd {
     if (m_sparse) {
       op.sparse_read(m_object_off, m_object_len, &m_ext_map, &m_read_data,
 		     NULL);
+      r = m_ioctx->aio_operate(m_oid, rados_completion, &op, m_snap_id, flags,
+			       NULL);
     } else {
-      op.read(m_object_off, m_object_len, &m_read_data, NULL);
+      // the reply's data is claimed by the op's bufferlist; if it is
+      // already as long as the read, it is received into directly
+      m_read_data.clear();
+      if (m_read_dest)
+	m_read_data.push_back(buffer::create_static(m_object_len, m_read_dest));
+      op.read(m_object_off, m_object_len, NULL, NULL);
+      r = m_ioctx->aio_operate(m_oid, rados_completion, &op, m_snap_id, flags,
+			       &m_read_data);
     }
-    r = m_ioctx->aio_operate(m_oid, rados_completion, &op, m_snap_id, flags, NULL);
 
     rados_completion->release();
     return r;
@@ -109,7 +121,8 @@ namespace librbd {
 
   AbstractWrite::AbstractWrite()
     : m_state(LIBRBD_AIO_WRITE_FLAT),
-      m_parent_overlap(0) {}
+      m_parent_overlap(0),
+      m_copyup_leader(false) {}
   AbstractWrite::AbstractWrite(ImageCtx *ictx, const std::string &oid,
 			       uint64_t object_no, uint64_t object_off, uint64_t len,
 			       vector<pair<uint64_t,uint64_t> >& objectx,
@@ -119,7 +132,8 @@ namespace librbd {
 			       bool hide_enoent)
     : AioRequest(ictx, oid, object_no, object_off, len, snap_id, completion,
 		 hide_enoent),
-      m_state(LIBRBD_AIO_WRITE_FLAT), m_snap_seq(snapc.seq.val)
+      m_state(LIBRBD_AIO_WRITE_FLAT), m_snap_seq(snapc.seq.val),
+      m_copyup_leader(false)
   {
     m_object_image_extents = objectx;
     m_parent_overlap = object_overlap;
@@ -134,6 +148,13 @@ namespace librbd {
   void AbstractWrite::guard_write()
   {
     if (has_parent()) {
+      // we have copied up its parent's data already, and no one else
+      // can remove it
+      if (m_ictx->exclusive_lock.object_known_to_exist(m_object_no)) {
+	ldout(m_ictx->cct, 20) << __func__ << " object exists; not guarding"
+			       << dendl;
+	return;
+      }
       m_state = LIBRBD_AIO_WRITE_GUARD;
       m_write.assert_exists();
       ldout(m_ictx->cct, 20) << __func__ << " guarding write" << dendl;
@@ -183,6 +204,10 @@ namespace librbd {
 				 << newlen << " image_extents"
 				 << m_object_image_extents << dendl;
 
+	  if (!start_copyup()) {
+	    finished = false;
+	    break;
+	  }
 	  m_state = LIBRBD_AIO_WRITE_COPYUP;
 	  read_from_parent(m_object_image_extents);
 	} else {
@@ -195,6 +220,16 @@ namespace librbd {
 	finished = false;
 	break;
       }
+      if (r == -EEXIST) {
+	// someone else copied up the object first, so our guarded write
+	// can go ahead
+	ldout(m_ictx->cct, 20) << "object was copied up already" << dendl;
+	r = send();
+	if (r < 0)
+	  break;
+	finished = false;
+	break;
+      }
       if (r < 0) {
 	ldout(m_ictx->cct, 20) << "error checking for object existence" << dendl;
 	break;
@@ -220,9 +255,78 @@ namespace librbd {
       assert(0);
     }
 
+    if (finished && r >= 0 && has_parent())
+      m_ictx->exclusive_lock.mark_object_exists(m_object_no);
+    if (finished && m_copyup_leader)
+      finish_copyup();
     return finished;
   }
 
+  bool AbstractWrite::start_copyup()
+  {
+    if (m_copyup_leader)
+      return true;
+    Mutex::Locker l(m_ictx->copyup_lock);
+    map<uint64_t, vector<AbstractWrite*> >::iterator it =
+      m_ictx->copyup_waiters.find(m_object_no);
+    if (it != m_ictx->copyup_waiters.end()) {
+      ldout(m_ictx->cct, 20) << "waiting for the copyup of " << m_oid << dendl;
+      it->second.push_back(this);
+      return false;
+    }
+    m_ictx->copyup_waiters[m_object_no];
+    m_copyup_leader = true;
+    return true;
+  }
+
+  void AbstractWrite::finish_copyup()
+  {
+    vector<AbstractWrite*> waiters;
+    {
+      Mutex::Locker l(m_ictx->copyup_lock);
+      map<uint64_t, vector<AbstractWrite*> >::iterator it =
+	m_ictx->copyup_waiters.find(m_object_no);
+      assert(it != m_ictx->copyup_waiters.end());
+      waiters.swap(it->second);
+      m_ictx->copyup_waiters.erase(it);
+    }
+    m_copyup_leader = false;
+
+    // retry their guarded writes; any that still find no object will
+    // copy it up themselves
+    for (vector<AbstractWrite*>::iterator p = waiters.begin();
+	 p != waiters.end(); ++p) {
+      int r = (*p)->send();
+      if (r < 0)
+	(*p)->complete(r);
+    }
+  }
+
+  /**
+   * The extents of a copyup's data that are not zero, in blocks of
+   * COPYUP_BLOCK bytes; the rest reads back as zeros without being
+   * written.
+   */
+  static const uint64_t COPYUP_BLOCK = 4096;
+
+  static void get_data_extents(bufferlist &data,
+			       vector<pair<uint64_t,uint64_t> > *extents)
+  {
+    uint64_t len = data.length();
+    for (uint64_t off = 0; off < len; off += COPYUP_BLOCK) {
+      uint64_t block_len = MIN(COPYUP_BLOCK, len - off);
+      bufferlist block;
+      block.substr_of(data, off, block_len);
+      if (block.is_zero())
+	continue;
+      if (!extents->empty() &&
+	  extents->back().first + extents->back().second == off)
+	extents->back().second += block_len;
+      else
+	extents->push_back(make_pair(off, block_len));
+    }
+  }
+
   int AbstractWrite::send() {
     ldout(m_ictx->cct, 20) << "send " << this << " " << m_oid << " " << m_object_off << "~" << m_object_len << dendl;
     librados::AioCompletion *rados_completion =
@@ -236,13 +340,24 @@ namespace librbd {
   }
 
   void AbstractWrite::send_copyup() {
-    if (!m_read_data.is_zero())
-      m_copyup.exec("rbd", "copyup", m_read_data);
-    add_copyup_ops();
+    librados::ObjectWriteOperation copyup;
+    vector<pair<uint64_t,uint64_t> > extents;
+    get_data_extents(m_read_data, &extents);
+    if (!extents.empty()) {
+      // fails with -EEXIST if someone else copied up the object first
+      copyup.create(true);
+      for (vector<pair<uint64_t,uint64_t> >::iterator p = extents.begin();
+	   p != extents.end(); ++p) {
+	bufferlist bl;
+	bl.substr_of(m_read_data, p->first, p->second);
+	copyup.write(p->first, bl);
+      }
+    }
+    add_copyup_ops(&copyup);
 
     librados::AioCompletion *rados_completion =
       librados::Rados::aio_create_completion(this, NULL, rados_req_cb);
-    m_ictx->md_ctx.aio_operate(m_oid, rados_completion, &m_copyup,
+    m_ictx->md_ctx.aio_operate(m_oid, rados_completion, &copyup,
 			       m_snap_seq, m_snaps);
     rados_completion->release();
   }
@@ -69,12 +69,22 @@ namespace librbd {
       : AioRequest(ictx, oid, objectno, offset, len, snap_id, completion,
 		   false),
 	m_buffer_extents(be),
-	m_tried_parent(false), m_sparse(sparse) {
+	m_tried_parent(false), m_sparse(sparse), m_read_dest(NULL) {
     }
     virtual ~AioRead() {}
     virtual bool should_complete(int r);
     virtual int send();
 
+    /**
+     * Have the messenger put the object's data straight into dest,
+     * which must stay valid until the request completes.  The read is
+     * not sparse then, so holes come back as zeros.
+     */
+    void read_in_place(char *dest) {
+      m_read_dest = dest;
+      m_sparse = false;
+    }
+
     ceph::bufferlist &data() {
       return m_read_data;
     }
@@ -86,6 +96,7 @@ namespace librbd {
     vector<pair<uint64_t,uint64_t> > m_buffer_extents;
     bool m_tried_parent;
     bool m_sparse;
+    char *m_read_dest;
   };
 
   class AbstractWrite : public AioRequest {
@@ -123,6 +134,9 @@ namespace librbd {
      *
      * Writes start in LIBRBD_AIO_WRITE_GUARD or _FLAT, depending on whether
      * there is a parent or not.
+     *
+     * Only one write at a time copies up an object: others that need
+     * the same object wait for it, and then retry their guarded writes.
      */
     enum write_state_d {
       LIBRBD_AIO_WRITE_GUARD,
@@ -131,17 +145,20 @@ namespace librbd {
     };
 
   protected:
-    virtual void add_copyup_ops() = 0;
+    virtual void add_copyup_ops(librados::ObjectWriteOperation *copyup) = 0;
 
     write_state_d m_state;
     vector<pair<uint64_t,uint64_t> > m_object_image_extents;
     uint64_t m_parent_overlap;
     librados::ObjectWriteOperation m_write;
-    librados::ObjectWriteOperation m_copyup;
     uint64_t m_snap_seq;
     std::vector<librados::snap_t> m_snaps;
 
   private:
+    bool m_copyup_leader;  ///< other writes wait for our copyup
+
+    bool start_copyup();
+    void finish_copyup();
     void send_copyup();
   };
 
@@ -158,19 +175,44 @@ namespace librbd {
 		      objectx, object_overlap,
 		      snapc, snap_id,
 		      completion, false),
-	m_write_data(data) {
-      guard_write();
-      m_write.write(m_object_off, data);
+	m_write_data(1, make_pair(object_off, data)) {
+      init_write();
+    }
+    /// write several extents of the object in one op
+    AioWrite(ImageCtx *ictx, const std::string &oid,
+	     uint64_t object_no,
+	     const vector<pair<uint64_t, ceph::bufferlist> >& extents,
+	     vector<pair<uint64_t,uint64_t> >& objectx, uint64_t object_overlap,
+	     const ::SnapContext &snapc, librados::snap_t snap_id,
+	     Context *completion)
+      : AbstractWrite(ictx, oid,
+		      object_no, extents.front().first,
+		      extents.back().first + extents.back().second.length() -
+		      extents.front().first,
+		      objectx, object_overlap,
+		      snapc, snap_id,
+		      completion, false),
+	m_write_data(extents) {
+      init_write();
     }
     virtual ~AioWrite() {}
 
   protected:
-    virtual void add_copyup_ops() {
-      m_copyup.write(m_object_off, m_write_data);
+    virtual void add_copyup_ops(librados::ObjectWriteOperation *copyup) {
+      for (vector<pair<uint64_t, ceph::bufferlist> >::iterator p =
+	     m_write_data.begin(); p != m_write_data.end(); ++p)
+	copyup->write(p->first, p->second);
     }
 
   private:
-    ceph::bufferlist m_write_data;
+    void init_write() {
+      guard_write();
+      for (vector<pair<uint64_t, ceph::bufferlist> >::iterator p =
+	     m_write_data.begin(); p != m_write_data.end(); ++p)
+	m_write.write(p->first, p->second);
+    }
+
+    vector<pair<uint64_t, ceph::bufferlist> > m_write_data;
   };
 
   class AioRemove : public AbstractWrite {
@@ -193,7 +235,7 @@ namespace librbd {
     virtual ~AioRemove() {}
 
   protected:
-    virtual void add_copyup_ops() {
+    virtual void add_copyup_ops(librados::ObjectWriteOperation *copyup) {
       // removing an object never needs to copyup
       assert(0);
     }
@@ -217,8 +259,8 @@ namespace librbd {
     virtual ~AioTruncate() {}
 
   protected:
-    virtual void add_copyup_ops() {
-      m_copyup.truncate(m_object_off);
+    virtual void add_copyup_ops(librados::ObjectWriteOperation *copyup) {
+      copyup->truncate(m_object_off);
     }
   };
 
@@ -240,8 +282,8 @@ namespace librbd {
     virtual ~AioZero() {}
 
   protected:
-    virtual void add_copyup_ops() {
-      m_copyup.zero(m_object_off, m_object_len);
+    virtual void add_copyup_ops(librados::ObjectWriteOperation *copyup) {
+      copyup->zero(m_object_off, m_object_len);
     }
   };
 
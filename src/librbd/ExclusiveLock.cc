@@ -0,0 +1,294 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include <errno.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include "common/ceph_context.h"
+#include "common/Clock.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/Finisher.h"
+#include "cls/lock/cls_lock_client.h"
+#include "include/Context.h"
+#include "include/encoding.h"
+#include "include/rbd/features.h"
+#include "include/rbd_types.h"
+
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+#include "librbd/WriteLog.h"
+
+#include "librbd/ExclusiveLock.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::ExclusiveLock: "
+
+using std::map;
+using std::string;
+
+using ceph::bufferlist;
+
+namespace librbd {
+
+  static const uint8_t NOTIFY_OP_REQUEST_LOCK = 1;
+
+  class ExclusiveLock::C_Release : public Context {
+  public:
+    C_Release(ExclusiveLock *lock) : m_lock(lock) {}
+    virtual void finish(int r) {
+      m_lock->handle_release();
+    }
+  private:
+    ExclusiveLock *m_lock;
+  };
+
+  ExclusiveLock::ExclusiveLock(ImageCtx &image_ctx)
+    : m_image_ctx(image_ctx),
+      m_acquire_lock("librbd::ExclusiveLock::m_acquire_lock"),
+      m_lock("librbd::ExclusiveLock::m_lock"),
+      m_finisher(NULL),
+      m_release_queued(false),
+      m_shutdown(false)
+  {
+  }
+
+  ExclusiveLock::~ExclusiveLock()
+  {
+    assert(m_finisher == NULL);
+  }
+
+  bool ExclusiveLock::is_required() const
+  {
+    return !m_image_ctx.read_only &&
+      (m_image_ctx.features & (RBD_FEATURE_EXCLUSIVE_LOCK |
+			       RBD_FEATURE_OBJECT_MAP)) != 0;
+  }
+
+  bool ExclusiveLock::is_transferable() const
+  {
+    return (m_image_ctx.features & RBD_FEATURE_EXCLUSIVE_LOCK) != 0;
+  }
+
+  bool ExclusiveLock::is_owner() const
+  {
+    Mutex::Locker l(m_lock);
+    return !m_cookie.empty();
+  }
+
+  int ExclusiveLock::lock()
+  {
+    librados::Rados rados(m_image_ctx.md_ctx);
+    std::ostringstream cookie;
+    cookie << "auto " << rados.get_instance_id() << " " << this;
+    int r = rados::cls::lock::lock(&m_image_ctx.md_ctx,
+				   m_image_ctx.header_oid, RBD_LOCK_NAME,
+				   LOCK_EXCLUSIVE, cookie.str(), "",
+				   "librbd exclusive lock", utime_t(), 0);
+    // -EEXIST means we hold it already
+    if (r < 0 && r != -EEXIST) {
+      if (r != -EBUSY)
+	lderr(m_image_ctx.cct) << "error locking image: " << cpp_strerror(r)
+			       << dendl;
+      return r;
+    }
+
+    ldout(m_image_ctx.cct, 10) << "took the exclusive lock" << dendl;
+    Mutex::Locker l(m_lock);
+    m_cookie = cookie.str();
+    m_known_objects.clear();
+    return 0;
+  }
+
+  void ExclusiveLock::unlock()
+  {
+    Mutex::Locker l(m_lock);
+    if (m_cookie.empty())
+      return;
+    int r = rados::cls::lock::unlock(&m_image_ctx.md_ctx,
+				     m_image_ctx.header_oid, RBD_LOCK_NAME,
+				     m_cookie);
+    if (r < 0 && r != -ENOENT)
+      lderr(m_image_ctx.cct) << "error unlocking image: " << cpp_strerror(r)
+			     << dendl;
+    m_cookie.clear();
+    m_known_objects.clear();
+  }
+
+  int ExclusiveLock::try_lock()
+  {
+    if (!is_required())
+      return 0;
+
+    Mutex::Locker l(m_acquire_lock);
+    int r = lock();
+    if (r == -EBUSY) {
+      ldout(m_image_ctx.cct, 1) << "image is locked by another client; "
+				<< "it cannot be changed from here until "
+				<< "that client gives up the lock" << dendl;
+      return 0;
+    }
+    return r;
+  }
+
+  int ExclusiveLock::require_lock()
+  {
+    if (!is_required())
+      return 0;
+
+    CephContext *cct = m_image_ctx.cct;
+    Mutex::Locker l(m_acquire_lock);
+    if (is_owner())
+      return 0;
+    if (!is_transferable())
+      return -EROFS;
+
+    utime_t timeout;
+    timeout.set_from_double(cct->_conf->rbd_lock_transfer_timeout);
+    utime_t start = ceph_clock_now(cct);
+    useconds_t delay = 10000;
+    int r;
+    while ((r = lock()) == -EBUSY) {
+      if (ceph_clock_now(cct) - start > timeout) {
+	lderr(cct) << "timed out waiting for the owner of the exclusive "
+		   << "lock to give it up" << dendl;
+	return -EBUSY;
+      }
+      ldout(cct, 10) << "asking for the exclusive lock" << dendl;
+      bufferlist bl;
+      encode_request(&bl);
+      m_image_ctx.md_ctx.notify(m_image_ctx.header_oid, 0, bl);
+      usleep(delay);
+      delay = MIN(delay * 2, 1000000);
+    }
+    if (r < 0)
+      return r;
+
+    // the last owner may have changed the header and the object map
+    RWLock::WLocker l2(m_image_ctx.md_lock);
+    return ictx_refresh(&m_image_ctx);
+  }
+
+  void ExclusiveLock::shutdown()
+  {
+    Finisher *finisher;
+    {
+      Mutex::Locker l(m_lock);
+      m_shutdown = true;
+      finisher = m_finisher;
+      m_finisher = NULL;
+    }
+    if (finisher) {
+      finisher->stop();
+      delete finisher;
+    }
+    unlock();
+  }
+
+  void ExclusiveLock::refresh()
+  {
+    Mutex::Locker l(m_lock);
+    if (m_cookie.empty())
+      return;
+    map<rados::cls::lock::locker_id_t,
+	rados::cls::lock::locker_info_t>::const_iterator it;
+    for (it = m_image_ctx.lockers.begin(); it != m_image_ctx.lockers.end();
+	 ++it) {
+      if (it->first.cookie == m_cookie)
+	return;
+    }
+    lderr(m_image_ctx.cct) << "lost the image's exclusive lock; the image "
+			   << "cannot be changed from here" << dendl;
+    m_cookie.clear();
+    m_known_objects.clear();
+  }
+
+  void ExclusiveLock::encode_request(bufferlist *bl)
+  {
+    ::encode(NOTIFY_OP_REQUEST_LOCK, *bl);
+  }
+
+  bool ExclusiveLock::handle_notify(bufferlist &bl)
+  {
+    if (bl.length() == 0)
+      return false;
+    uint8_t op;
+    try {
+      bufferlist::iterator p = bl.begin();
+      ::decode(op, p);
+    } catch (const buffer::error &err) {
+      return false;
+    }
+    if (op != NOTIFY_OP_REQUEST_LOCK)
+      return false;
+
+    // we may not block the watch callback, so the lock is given up by
+    // a thread of our own
+    Mutex::Locker l(m_lock);
+    if (m_cookie.empty() || m_release_queued || m_shutdown ||
+	!is_transferable())
+      return true;
+    ldout(m_image_ctx.cct, 10) << "asked for the exclusive lock" << dendl;
+    if (!m_finisher) {
+      m_finisher = new Finisher(m_image_ctx.cct);
+      m_finisher->start();
+    }
+    m_release_queued = true;
+    m_finisher->queue(new C_Release(this));
+    return true;
+  }
+
+  void ExclusiveLock::handle_release()
+  {
+    CephContext *cct = m_image_ctx.cct;
+    // wait for writes that are being started
+    RWLock::WLocker l(m_image_ctx.owner_lock);
+    {
+      Mutex::Locker l2(m_lock);
+      m_release_queued = false;
+      if (m_cookie.empty() || m_shutdown)
+	return;
+    }
+
+    // the next owner may change any object, so what we wrote must be
+    // safe first
+    int r = _flush(&m_image_ctx);
+    if (r < 0) {
+      lderr(cct) << "error flushing writes; keeping the exclusive lock: "
+		 << cpp_strerror(r) << dendl;
+      return;
+    }
+    ldout(cct, 10) << "giving up the exclusive lock" << dendl;
+    unlock();
+    if (m_image_ctx.write_log)
+      m_image_ctx.write_log->invalidate();
+
+    RWLock::WLocker l2(m_image_ctx.snap_lock);
+    m_image_ctx.object_map.refresh();
+  }
+
+  bool ExclusiveLock::object_known_to_exist(uint64_t object_no) const
+  {
+    Mutex::Locker l(m_lock);
+    return !m_cookie.empty() && object_no < m_known_objects.size() &&
+      m_known_objects[object_no];
+  }
+
+  void ExclusiveLock::mark_object_exists(uint64_t object_no)
+  {
+    Mutex::Locker l(m_lock);
+    if (m_cookie.empty())
+      return;
+    if (object_no >= m_known_objects.size())
+      m_known_objects.resize(object_no + 1);
+    m_known_objects[object_no] = true;
+  }
+
+  void ExclusiveLock::forget_objects()
+  {
+    Mutex::Locker l(m_lock);
+    m_known_objects.clear();
+  }
+}
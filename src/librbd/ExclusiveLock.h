@@ -0,0 +1,98 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_EXCLUSIVELOCK_H
+#define CEPH_LIBRBD_EXCLUSIVELOCK_H
+
+#include "include/int_types.h"
+
+#include <string>
+#include <vector>
+
+#include "common/Mutex.h"
+#include "include/buffer.h"
+
+class Finisher;
+
+namespace librbd {
+
+  struct ImageCtx;
+
+  /**
+   * The image's exclusive lock, which a client must hold to change an
+   * image with the exclusive lock or object map features.
+   *
+   * A client opening such an image for writing takes the lock if it
+   * is free.  With the exclusive lock feature, a client that wants to
+   * write while another holds the lock asks it, by a notify on the
+   * header, to give the lock up; the owner does so once the writes it
+   * started are safe, and takes it back the same way when it writes
+   * again.  With only the object map, the first writer keeps the lock
+   * until it closes the image.
+   *
+   * No one else can remove our objects while we hold the lock, so the
+   * objects of a clone that we know to exist need no guard against
+   * having to copy up their parent's data first.
+   *
+   * Lock ordering: owner_lock, md_lock, ..., then m_lock.
+   */
+  class ExclusiveLock {
+  public:
+    ExclusiveLock(ImageCtx &image_ctx);
+    ~ExclusiveLock();
+
+    /// whether writers need the lock
+    bool is_required() const;
+    bool is_owner() const;
+
+    /// take the lock if no one has it, when opening for writing
+    int try_lock();
+    /**
+     * Make sure we hold the lock before changing the image, asking its
+     * owner for it if the image has the exclusive lock feature.  Call
+     * with owner_lock held for read.
+     *
+     * @returns 0 if we may change the image, -EROFS if another client
+     * keeps the lock, or -EBUSY if its owner did not give it up in time
+     */
+    int require_lock();
+    /// stop handing the lock over and give it up, when closing
+    void shutdown();
+    /// drop the lock if it was broken; call from refresh
+    void refresh();
+
+    /// the payload of a notify on the header that asks for the lock
+    static void encode_request(ceph::bufferlist *bl);
+    /**
+     * Handle a notify on the header, from the watch callback.
+     *
+     * @returns true if it was a request for the lock
+     */
+    bool handle_notify(ceph::bufferlist &bl);
+
+    bool object_known_to_exist(uint64_t object_no) const;
+    /// note that an object of a clone exists, after writing to it
+    void mark_object_exists(uint64_t object_no);
+    /// forget which objects exist, when some may have been removed
+    void forget_objects();
+
+  private:
+    class C_Release;
+
+    ImageCtx &m_image_ctx;
+    Mutex m_acquire_lock;       ///< serializes require_lock()
+    mutable Mutex m_lock;
+    std::string m_cookie;       ///< set while we hold the lock
+    Finisher *m_finisher;       ///< gives the lock up when asked to
+    bool m_release_queued;
+    bool m_shutdown;
+    std::vector<bool> m_known_objects;
+
+    bool is_transferable() const;
+    int lock();
+    void unlock();
+    void handle_release();
+  };
+
+}
+
+#endif
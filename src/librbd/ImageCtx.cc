@@ -9,6 +9,7 @@
 
 #include "librbd/internal.h"
 #include "librbd/WatchCtx.h"
+#include "librbd/WriteLog.h"
 
 #include "librbd/ImageCtx.h"
 
@@ -40,17 +41,22 @@ namespace librbd {
       wctx(NULL),
       refresh_seq(0),
       last_refresh(0),
+      owner_lock("librbd::ImageCtx::owner_lock"),
       md_lock("librbd::ImageCtx::md_lock"),
       cache_lock("librbd::ImageCtx::cache_lock"),
       snap_lock("librbd::ImageCtx::snap_lock"),
       parent_lock("librbd::ImageCtx::parent_lock"),
       refresh_lock("librbd::ImageCtx::refresh_lock"),
-      old_format(true),
+      copyup_lock("librbd::ImageCtx::copyup_lock"),
+      old_format(true), refresh_info_supported(true),
       order(0), size(0), features(0),
       format_string(NULL),
       id(image_id), parent(NULL),
       stripe_unit(0), stripe_count(0),
-      object_cacher(NULL), writeback_handler(NULL), object_set(NULL)
+      object_cacher(NULL), writeback_handler(NULL), object_set(NULL),
+      write_log(NULL),
+      exclusive_lock(*this),
+      object_map(*this)
   {
     md_ctx.dup(p);
     data_ctx.dup(p);
@@ -94,6 +100,10 @@ namespace librbd {
       object_set = new ObjectCacher::ObjectSet(NULL, data_ctx.get_id(), 0);
       object_set->return_enoent = true;
       object_cacher->start();
+
+      readahead.set_limits(cct->_conf->rbd_readahead_min_bytes,
+			   cct->_conf->rbd_readahead_max_bytes,
+			   cct->_conf->rbd_readahead_streams);
     }
   }
 
@@ -188,6 +198,7 @@ namespace librbd {
       ldout(cct, 10) << " cache bytes " << cct->_conf->rbd_cache_size << " order " << (int)order
 		     << " -> about " << obj << " objects" << dendl;
       object_cacher->set_max_objects(obj * 4 + 10);
+      readahead.set_alignments(get_stripe_period(), stripe_unit);
     }
 
     ldout(cct, 10) << "init_layout stripe_unit " << stripe_unit
@@ -227,6 +238,10 @@ namespace librbd {
     plb.add_u64_counter(l_librbd_snap_rollback, "snap_rollback");
     plb.add_u64_counter(l_librbd_notify, "notify");
     plb.add_u64_counter(l_librbd_resize, "resize");
+    plb.add_u64_counter(l_librbd_readahead, "readahead");
+    plb.add_u64_counter(l_librbd_readahead_bytes, "readahead_bytes");
+    plb.add_u64_counter(l_librbd_readahead_hit_bytes, "readahead_hit_bytes");
+    plb.add_u64_counter(l_librbd_readahead_wasted_bytes, "readahead_wasted_bytes");
 
     perfcounter = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perfcounter);
@@ -519,6 +534,35 @@ namespace librbd {
     return r;
   }
 
+  void ImageCtx::readahead_to_cache(uint64_t off, uint64_t len,
+				    uint64_t image_size) {
+    Readahead::extent_t ra = readahead.update(off, len, image_size);
+    if (ra.second) {
+      ldout(cct, 20) << "readahead " << ra.first << "~" << ra.second
+		     << " after " << off << "~" << len << dendl;
+      vector<ObjectExtent> extents;
+      Striper::file_to_extents(cct, format_string, &layout,
+			       ra.first, ra.second, 0, extents);
+      snap_lock.get_read();
+      snap_t snap = snap_id;
+      snap_lock.put_read();
+      cache_lock.Lock();
+      for (vector<ObjectExtent>::iterator p = extents.begin();
+	   p != extents.end(); ++p) {
+	// no bufferlist or waiter; this only fills the cache
+	ObjectCacher::OSDRead *rd = object_cacher->prepare_read(snap, NULL, 0);
+	rd->extents.push_back(*p);
+	object_cacher->readx(rd, object_set, NULL);
+      }
+      cache_lock.Unlock();
+      perfcounter->inc(l_librbd_readahead);
+    }
+    Readahead::stats_t rs = readahead.take_stats();
+    perfcounter->inc(l_librbd_readahead_bytes, rs.issued);
+    perfcounter->inc(l_librbd_readahead_hit_bytes, rs.hit);
+    perfcounter->inc(l_librbd_readahead_wasted_bytes, rs.wasted);
+  }
+
   void ImageCtx::user_flushed() {
     if (object_cacher && cct->_conf->rbd_cache_writethrough_until_flush) {
       md_lock.get_read();
@@ -569,8 +613,15 @@ namespace librbd {
   }
 
   void ImageCtx::invalidate_cache() {
+    if (write_log) {
+      int r = write_log->writeback();
+      if (r)
+	lderr(cct) << "writing back the write log returned " << r << dendl;
+      write_log->invalidate();
+    }
     if (!object_cacher)
       return;
+    readahead.reset();
     cache_lock.Lock();
     object_cacher->release_set(object_set);
     cache_lock.Unlock();
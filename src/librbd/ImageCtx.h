@@ -18,9 +18,12 @@
 #include "include/rbd_types.h"
 #include "include/types.h"
 #include "osdc/ObjectCacher.h"
+#include "osdc/Readahead.h"
 
 #include "cls/rbd/cls_rbd_client.h"
+#include "librbd/ExclusiveLock.h"
 #include "librbd/LibrbdWriteback.h"
+#include "librbd/ObjectMap.h"
 #include "librbd/SnapInfo.h"
 #include "librbd/parent_types.h"
 
@@ -29,7 +32,9 @@ class PerfCounters;
 
 namespace librbd {
 
+  class AbstractWrite;
   class WatchCtx;
+  class WriteLog;
 
   struct ImageCtx {
     CephContext *cct;
@@ -59,8 +64,11 @@ namespace librbd {
 
     /**
      * Lock ordering:
-     * md_lock, cache_lock, snap_lock, parent_lock, refresh_lock
+     * owner_lock, md_lock, cache_lock, snap_lock, parent_lock,
+     * refresh_lock, copyup_lock
      */
+    RWLock owner_lock; // held for read while starting changes that need
+                       // the exclusive lock, for write to give it up
     RWLock md_lock; // protects access to the mutable image metadata that
                    // isn't guarded by other locks below
                    // (size, features, image locks, etc)
@@ -68,8 +76,10 @@ namespace librbd {
     RWLock snap_lock; // protects snapshot-related member variables:
     RWLock parent_lock; // protects parent_md and parent
     Mutex refresh_lock; // protects refresh_seq and last_refresh
+    Mutex copyup_lock; // protects copyup_waiters
 
     bool old_format;
+    bool refresh_info_supported; ///< by the OSDs; protected by snap_lock
     uint8_t order;
     uint64_t size;
     uint64_t features;
@@ -86,6 +96,14 @@ namespace librbd {
     ObjectCacher *object_cacher;
     LibrbdWriteback *writeback_handler;
     ObjectCacher::ObjectSet *object_set;
+    Readahead readahead;
+    WriteLog *write_log;  ///< caches writes instead of the ObjectCacher
+
+    /// writes waiting for the copyup of an object, by object number
+    std::map<uint64_t, std::vector<AbstractWrite*> > copyup_waiters;
+
+    ExclusiveLock exclusive_lock;
+    ObjectMap object_map;
 
     /**
      * Either image_name or image_id must be set.
@@ -132,6 +150,7 @@ namespace librbd {
     void write_to_cache(object_t o, bufferlist& bl, size_t len, uint64_t off,
 			Context *onfinish);
     int read_from_cache(object_t o, bufferlist *bl, size_t len, uint64_t off);
+    void readahead_to_cache(uint64_t off, uint64_t len, uint64_t image_size);
     void user_flushed();
     void flush_cache_aio(Context *onfinish);
     int flush_cache();
@@ -138,6 +138,25 @@ namespace librbd {
 			       const bufferlist &bl, utime_t mtime,
 			       uint64_t trunc_size, __u32 trunc_seq,
 			       Context *oncommit)
+  {
+    vector<pair<uint64_t, bufferlist> > extents;
+    extents.push_back(make_pair(off, bl));
+    return send_write(oid, extents, snapc, oncommit);
+  }
+
+  tid_t LibrbdWriteback::write_extents(const object_t& oid,
+				       const object_locator_t& oloc,
+				       const vector<pair<uint64_t, bufferlist> >& extents,
+				       const SnapContext& snapc, utime_t mtime,
+				       uint64_t trunc_size, __u32 trunc_seq,
+				       Context *oncommit)
+  {
+    return send_write(oid, extents, snapc, oncommit);
+  }
+
+  tid_t LibrbdWriteback::send_write(const object_t& oid,
+				    const vector<pair<uint64_t, bufferlist> >& extents,
+				    const SnapContext& snapc, Context *oncommit)
   {
     m_ictx->snap_lock.get_read();
     librados::snap_t snap_id = m_ictx->snap_id;
@@ -160,8 +179,8 @@ namespace librbd {
     ldout(m_ictx->cct, 20) << "write will wait for result " << result << dendl;
     C_OrderedWrite *req_comp = new C_OrderedWrite(m_ictx->cct, result, this);
     AioWrite *req = new AioWrite(m_ictx, oid.name,
-				 object_no, off, objectx, object_overlap,
-				 bl, snapc, snap_id,
+				 object_no, extents, objectx, object_overlap,
+				 snapc, snap_id,
 				 req_comp);
     req->send();
     return ++m_tid;
@@ -37,6 +37,13 @@ namespace librbd {
 			const bufferlist &bl, utime_t mtime, uint64_t trunc_size,
 			__u32 trunc_seq, Context *oncommit);
 
+    virtual bool can_write_extents() { return true; }
+    virtual tid_t write_extents(const object_t& oid, const object_locator_t& oloc,
+				const vector<pair<uint64_t, bufferlist> >& extents,
+				const SnapContext& snapc, utime_t mtime,
+				uint64_t trunc_size, __u32 trunc_seq,
+				Context *oncommit);
+
     struct write_result_d {
       bool done;
       int ret;
@@ -51,6 +58,9 @@ namespace librbd {
 
   private:
     void complete_writes(const std::string& oid);
+    tid_t send_write(const object_t& oid,
+		     const vector<pair<uint64_t, bufferlist> >& extents,
+		     const SnapContext& snapc, Context *oncommit);
 
     tid_t m_tid;
     Mutex& m_lock;
@@ -0,0 +1,511 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include <errno.h>
+#include <string.h>
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "include/rbd_types.h"
+#include "osd/osd_types.h"
+
+#include "librbd/ImageCtx.h"
+
+#include "librbd/ObjectMap.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::ObjectMap: "
+
+using std::string;
+using std::vector;
+
+using ceph::bufferlist;
+
+namespace librbd {
+
+  ObjectMap::ObjectMap(ImageCtx &image_ctx)
+    : m_image_ctx(image_ctx),
+      m_lock("librbd::ObjectMap::m_lock"),
+      m_enabled(false),
+      m_snap_id(CEPH_NOSNAP)
+  {
+  }
+
+  static string map_name(const char *prefix, const string &image_id,
+			 uint64_t snap_id)
+  {
+    string oid(prefix + image_id);
+    if (snap_id != CEPH_NOSNAP) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), ".%016llx", (unsigned long long)snap_id);
+      oid += buf;
+    }
+    return oid;
+  }
+
+  string ObjectMap::object_map_name(const string &image_id, uint64_t snap_id)
+  {
+    return map_name(RBD_OBJECT_MAP_PREFIX, image_id, snap_id);
+  }
+
+  string ObjectMap::diff_map_name(const string &image_id, uint64_t snap_id)
+  {
+    return map_name(RBD_DIFF_MAP_PREFIX, image_id, snap_id);
+  }
+
+  int ObjectMap::create(librados::IoCtx &io_ctx, const string &image_id,
+			uint64_t features)
+  {
+    int r = io_ctx.create(object_map_name(image_id, CEPH_NOSNAP), true);
+    if (r < 0 || !(features & RBD_FEATURE_FAST_DIFF))
+      return r;
+    return io_ctx.create(diff_map_name(image_id, CEPH_NOSNAP), true);
+  }
+
+  int ObjectMap::remove(librados::IoCtx &io_ctx, const string &image_id,
+			uint64_t snap_id)
+  {
+    int r = io_ctx.remove(object_map_name(image_id, snap_id));
+    if (r < 0 && r != -ENOENT)
+      return r;
+    r = io_ctx.remove(diff_map_name(image_id, snap_id));
+    if (r == -ENOENT)
+      r = 0;
+    return r;
+  }
+
+  int ObjectMap::load(librados::IoCtx &io_ctx, const string &oid,
+		      vector<uint8_t> *map)
+  {
+    bufferlist bl;
+    int r = io_ctx.read(oid, bl, 0, 0);
+    if (r < 0)
+      return r;
+    map->resize(bl.length());
+    if (bl.length())
+      bl.copy(0, bl.length(), (char *)&(*map)[0]);
+    return 0;
+  }
+
+  int ObjectMap::load(librados::IoCtx &io_ctx, const string &image_id,
+		      uint64_t snap_id, vector<uint8_t> *map)
+  {
+    return load(io_ctx, object_map_name(image_id, snap_id), map);
+  }
+
+  int ObjectMap::load_diff(librados::IoCtx &io_ctx, const string &image_id,
+			   uint64_t snap_id, vector<uint8_t> *map)
+  {
+    return load(io_ctx, diff_map_name(image_id, snap_id), map);
+  }
+
+  bool ObjectMap::test(const vector<uint8_t> &map, uint64_t object_no)
+  {
+    return object_no / 8 < map.size() &&
+      (map[object_no / 8] & (1 << (object_no % 8)));
+  }
+
+  int ObjectMap::merge_diff(librados::IoCtx &io_ctx, const string &image_id,
+			    uint64_t snap_id, uint64_t next_snap_id,
+			    uint64_t num_objects)
+  {
+    bufferlist bl;
+    int r = io_ctx.read(diff_map_name(image_id, snap_id), bl, 0, 0);
+    if (r == -ENOENT) {
+      // what changed before the snapshot is not known, so neither is
+      // what changed since the one before it
+      if (next_snap_id != CEPH_NOSNAP) {
+	r = io_ctx.remove(diff_map_name(image_id, next_snap_id));
+	return r == -ENOENT ? 0 : r;
+      }
+      bufferptr bp((num_objects + 7) / 8);
+      memset(bp.c_str(), 0xff, bp.length());
+      bl.push_back(bp);
+    } else if (r < 0) {
+      return r;
+    }
+    r = cls_client::object_map_merge(&io_ctx,
+				     diff_map_name(image_id, next_snap_id), bl);
+    if (r == -ENOENT)
+      r = 0;
+    return r;
+  }
+
+  bool ObjectMap::has_feature() const
+  {
+    return (m_image_ctx.features & RBD_FEATURE_OBJECT_MAP) != 0;
+  }
+
+  bool ObjectMap::has_fast_diff() const
+  {
+    return (m_image_ctx.features & RBD_FEATURE_FAST_DIFF) != 0;
+  }
+
+  int ObjectMap::refresh()
+  {
+    CephContext *cct = m_image_ctx.cct;
+    bool owner = m_image_ctx.exclusive_lock.is_owner();
+    Mutex::Locker l(m_lock);
+    uint64_t snap_id = m_image_ctx.snap_id;
+    if (!has_feature()) {
+      m_enabled = false;
+      m_map.clear();
+      m_diff_map.clear();
+      return 0;
+    }
+
+    bool want = snap_id != CEPH_NOSNAP || owner;
+    if (want == m_enabled && snap_id == m_snap_id)
+      return 0;
+
+    m_enabled = false;
+    m_map.clear();
+    m_diff_map.clear();
+    m_snap_id = snap_id;
+    if (!want)
+      return 0;
+
+    string oid = object_map_name(m_image_ctx.id, snap_id);
+    int r = load(m_image_ctx.md_ctx, m_image_ctx.id, snap_id, &m_map);
+    if (r == -ENOENT && snap_id != CEPH_NOSNAP) {
+      ldout(cct, 10) << "snapshot " << snap_id << " has no object map" << dendl;
+      return 0;
+    }
+    if (r == -ENOENT) {
+      // every object may exist until the map is rebuilt by whatever
+      // removes them
+      lderr(cct) << "object map " << oid << " is missing; recreating it"
+		 << dendl;
+      m_map.assign((m_image_ctx.get_num_objects() + 7) / 8, 0xff);
+      bufferlist bl;
+      if (!m_map.empty())
+	bl.append((const char *)&m_map[0], m_map.size());
+      r = m_image_ctx.md_ctx.write_full(oid, bl);
+    }
+    if (r < 0) {
+      lderr(cct) << "error loading object map " << oid << ": "
+		 << cpp_strerror(r) << dendl;
+      m_map.clear();
+      return r;
+    }
+    if (snap_id == CEPH_NOSNAP && has_fast_diff()) {
+      r = load_head_diff();
+      if (r < 0) {
+	m_map.clear();
+	return r;
+      }
+    }
+    ldout(cct, 10) << "loaded object map " << oid << " (" << m_map.size()
+		   << " bytes)" << dendl;
+    m_enabled = true;
+    return 0;
+  }
+
+  int ObjectMap::load_head_diff()
+  {
+    assert(m_lock.is_locked());
+    CephContext *cct = m_image_ctx.cct;
+    string oid = diff_map_name(m_image_ctx.id, CEPH_NOSNAP);
+    int r = load(m_image_ctx.md_ctx, oid, &m_diff_map);
+    if (r == -ENOENT) {
+      lderr(cct) << "diff map " << oid << " is missing; recreating it"
+		 << dendl;
+      m_diff_map.assign((m_image_ctx.get_num_objects() + 7) / 8, 0xff);
+      bufferlist bl;
+      if (!m_diff_map.empty())
+	bl.append((const char *)&m_diff_map[0], m_diff_map.size());
+      r = m_image_ctx.md_ctx.write_full(oid, bl);
+    }
+    if (r < 0) {
+      lderr(cct) << "error loading diff map " << oid << ": "
+		 << cpp_strerror(r) << dendl;
+      m_diff_map.clear();
+    }
+    return r;
+  }
+
+  bool ObjectMap::enabled() const
+  {
+    Mutex::Locker l(m_lock);
+    return m_enabled;
+  }
+
+  bool ObjectMap::head_enabled() const
+  {
+    Mutex::Locker l(m_lock);
+    return m_enabled && m_snap_id == CEPH_NOSNAP;
+  }
+
+  int ObjectMap::check_writable() const
+  {
+    if (has_feature() && !head_enabled())
+      return -EROFS;
+    return 0;
+  }
+
+  bool ObjectMap::object_may_exist(uint64_t object_no) const
+  {
+    Mutex::Locker l(m_lock);
+    return !m_enabled || test(m_map, object_no);
+  }
+
+  int ObjectMap::mark_may_exist(const vector<ObjectExtent> &extents)
+  {
+    int r = check_writable();
+    if (r < 0 || !has_feature())
+      return r;
+
+    uint64_t start = 0, end = 0;
+    {
+      Mutex::Locker l(m_lock);
+      for (vector<ObjectExtent>::const_iterator p = extents.begin();
+	   p != extents.end(); ++p) {
+	if (test(m_map, p->objectno))
+	  continue;
+	if (start == end) {
+	  start = p->objectno;
+	  end = p->objectno + 1;
+	} else {
+	  start = MIN(start, p->objectno);
+	  end = MAX(end, p->objectno + 1);
+	}
+      }
+    }
+    if (start != end) {
+      r = update(start, end, true);
+      if (r < 0)
+	return r;
+    }
+    return mark_changed(extents);
+  }
+
+  int ObjectMap::mark_changed(const vector<ObjectExtent> &extents)
+  {
+    int r = check_writable();
+    if (r < 0 || !has_fast_diff() || extents.empty())
+      return r;
+
+    uint64_t start = extents.front().objectno;
+    uint64_t end = start + 1;
+    for (vector<ObjectExtent>::const_iterator p = extents.begin();
+	 p != extents.end(); ++p) {
+      start = MIN(start, p->objectno);
+      end = MAX(end, p->objectno + 1);
+    }
+    return mark_changed(start, end);
+  }
+
+  int ObjectMap::mark_changed(uint64_t start, uint64_t end)
+  {
+    if (start >= end || !has_fast_diff() || !head_enabled())
+      return 0;
+
+    {
+      Mutex::Locker l(m_lock);
+      uint64_t i;
+      for (i = start; i < end && test(m_diff_map, i); ++i) ;
+      if (i == end)
+	return 0;
+    }
+
+    ldout(m_image_ctx.cct, 20) << "mark_changed " << start << "~"
+			       << (end - start) << dendl;
+    int r = cls_client::object_map_update(&m_image_ctx.md_ctx,
+					  diff_map_name(m_image_ctx.id,
+							CEPH_NOSNAP),
+					  start, end, true);
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error updating diff map: "
+			     << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    Mutex::Locker l(m_lock);
+    set_bits(&m_diff_map, start, end, true);
+    return 0;
+  }
+
+  int ObjectMap::update(uint64_t start, uint64_t end, bool exists)
+  {
+    if (start >= end || !head_enabled())
+      return 0;
+
+    ldout(m_image_ctx.cct, 20) << "update " << start << "~" << (end - start)
+			       << " exists=" << exists << dendl;
+    // the map on disk always changes first, so that what we skip by
+    // is never ahead of it
+    int r = cls_client::object_map_update(&m_image_ctx.md_ctx,
+					  object_map_name(m_image_ctx.id,
+							  CEPH_NOSNAP),
+					  start, end, exists);
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error updating object map: "
+			     << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    Mutex::Locker l(m_lock);
+    set_bits(&m_map, start, end, exists);
+    return 0;
+  }
+
+  void ObjectMap::set_bits(vector<uint8_t> *map, uint64_t start, uint64_t end,
+			   bool exists)
+  {
+    if (exists && map->size() < (end + 7) / 8)
+      map->resize((end + 7) / 8, 0);
+    for (uint64_t i = start; i < end && i / 8 < map->size(); ++i) {
+      if (exists)
+	(*map)[i / 8] |= 1 << (i % 8);
+      else
+	(*map)[i / 8] &= ~(1 << (i % 8));
+    }
+  }
+
+  int ObjectMap::resize(uint64_t num_objects)
+  {
+    if (!head_enabled())
+      return 0;
+
+    uint64_t old_end;
+    {
+      Mutex::Locker l(m_lock);
+      old_end = m_map.size() * 8;
+    }
+    int r = update(num_objects, old_end, false);
+    if (r < 0)
+      return r;
+
+    uint64_t len = (num_objects + 7) / 8;
+    librados::ObjectWriteOperation op;
+    op.truncate(len);
+    r = m_image_ctx.md_ctx.operate(object_map_name(m_image_ctx.id,
+						   CEPH_NOSNAP), &op);
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error resizing object map: "
+			     << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    Mutex::Locker l(m_lock);
+    if (m_map.size() > len)
+      m_map.resize(len);
+    return 0;
+  }
+
+  int ObjectMap::snapshot(const vector<uint64_t> &snap_ids)
+  {
+    if (snap_ids.empty() || !head_enabled())
+      return 0;
+
+    // copy what is on disk: bits are set there first
+    CephContext *cct = m_image_ctx.cct;
+    bufferlist bl;
+    librados::IoCtx &io_ctx = m_image_ctx.md_ctx;
+    int r = io_ctx.read(object_map_name(m_image_ctx.id, CEPH_NOSNAP),
+			bl, 0, 0);
+    if (r < 0) {
+      lderr(cct) << "error reading object map: " << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    vector<uint64_t> taken;
+    for (vector<uint64_t>::const_iterator p = snap_ids.begin();
+	 p != snap_ids.end(); ++p) {
+      librados::ObjectWriteOperation op;
+      op.create(true);
+      op.write_full(bl);
+      r = io_ctx.operate(object_map_name(m_image_ctx.id, *p), &op);
+      if (r == -EEXIST) {
+	// a previous owner of the lock got to it first
+	ldout(cct, 10) << "snapshot " << *p << " already has an object map"
+		       << dendl;
+	continue;
+      }
+      if (r < 0) {
+	lderr(cct) << "error copying object map to snapshot " << *p << ": "
+		   << cpp_strerror(r) << dendl;
+	return r;
+      }
+      taken.push_back(*p);
+    }
+    if (taken.empty() || !has_fast_diff())
+      return 0;
+    return snapshot_diff(taken);
+  }
+
+  int ObjectMap::snapshot_diff(const vector<uint64_t> &snap_ids)
+  {
+    CephContext *cct = m_image_ctx.cct;
+    librados::IoCtx &io_ctx = m_image_ctx.md_ctx;
+    string head_oid = diff_map_name(m_image_ctx.id, CEPH_NOSNAP);
+    int r;
+    do {
+      bufferlist bl;
+      r = io_ctx.read(head_oid, bl, 0, 0);
+      if (r < 0)
+	break;
+      uint64_t ver = io_ctx.get_last_version();
+
+      // everything changed so far happened before the first of them
+      for (size_t i = 0; i < snap_ids.size() && r >= 0; ++i) {
+	bufferlist snap_bl;
+	if (i == 0)
+	  snap_bl = bl;
+	r = io_ctx.write_full(diff_map_name(m_image_ctx.id, snap_ids[i]),
+			      snap_bl);
+      }
+      if (r < 0)
+	break;
+
+      // start over if a removed snapshot's changes were merged meanwhile
+      librados::ObjectWriteOperation op;
+      op.assert_version(ver);
+      op.write_full(bufferlist());
+      r = io_ctx.operate(head_oid, &op);
+    } while (r == -ERANGE || r == -EOVERFLOW);
+    if (r < 0) {
+      lderr(cct) << "error moving diff map to snapshot " << snap_ids.front()
+		 << ": " << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    Mutex::Locker l(m_lock);
+    m_diff_map.clear();
+    return 0;
+  }
+
+  int ObjectMap::rollback(uint64_t snap_id)
+  {
+    if (!head_enabled())
+      return 0;
+
+    CephContext *cct = m_image_ctx.cct;
+    vector<uint8_t> snap_map;
+    int r = load(m_image_ctx.md_ctx, m_image_ctx.id, snap_id, &snap_map);
+    if (r == -ENOENT) {
+      ldout(cct, 10) << "snapshot " << snap_id << " has no object map; "
+		     << "every object may exist" << dendl;
+      return update(0, m_image_ctx.get_num_objects(), true);
+    }
+    if (r < 0)
+      return r;
+
+    bufferlist bl;
+    if (!snap_map.empty())
+      bl.append((const char *)&snap_map[0], snap_map.size());
+    r = m_image_ctx.md_ctx.write_full(object_map_name(m_image_ctx.id,
+						      CEPH_NOSNAP), bl);
+    if (r < 0) {
+      lderr(cct) << "error rolling back object map: " << cpp_strerror(r)
+		 << dendl;
+      return r;
+    }
+
+    Mutex::Locker l(m_lock);
+    m_map.swap(snap_map);
+    return 0;
+  }
+}
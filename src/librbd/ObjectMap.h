@@ -0,0 +1,128 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_OBJECTMAP_H
+#define CEPH_LIBRBD_OBJECTMAP_H
+
+#include "include/int_types.h"
+
+#include <string>
+#include <vector>
+
+#include "common/Mutex.h"
+#include "include/rados/librados.hpp"
+
+class ObjectExtent;
+
+namespace librbd {
+
+  struct ImageCtx;
+
+  /**
+   * Which of an image's data objects may exist, one bit per object.
+   *
+   * The head's map is kept in rbd_object_map.<id>, and each snapshot's
+   * in rbd_object_map.<id>.<snap id>; bytes past the end of a map are
+   * zero.  A bit is set before its object can be created, and cleared
+   * only once the object is known to be gone, so ops on objects whose
+   * bit is clear can be skipped.
+   *
+   * With fast diff, a diff map in rbd_diff_map.<id>[.<snap id>] in the
+   * same layout also records which objects changed between the
+   * previous snapshot and the snapshot (or the head).  Its bits are
+   * set before an object is written or removed, so a diff between two
+   * snapshots only needs to look at objects set in the diff maps of
+   * the snapshots after the first one.
+   *
+   * Only one client can keep the head's maps up to date, so an image
+   * with the object map feature cannot be changed without holding its
+   * ExclusiveLock, and only the owner loads the head's maps.  The
+   * owner gives each new snapshot its maps once it starts writing
+   * with a snap context that includes it; a snapshot that no owner saw
+   * has none.  The maps of a snapshot are used by everyone.
+   */
+  class ObjectMap {
+  public:
+    ObjectMap(ImageCtx &image_ctx);
+
+    static std::string object_map_name(const std::string &image_id,
+				       uint64_t snap_id);
+    static std::string diff_map_name(const std::string &image_id,
+				     uint64_t snap_id);
+    /// create the empty maps of a new image
+    static int create(librados::IoCtx &io_ctx, const std::string &image_id,
+		      uint64_t features);
+    static int remove(librados::IoCtx &io_ctx, const std::string &image_id,
+		      uint64_t snap_id);
+    /// read a map; -ENOENT if there is none
+    static int load(librados::IoCtx &io_ctx, const std::string &image_id,
+		    uint64_t snap_id, std::vector<uint8_t> *map);
+    static int load_diff(librados::IoCtx &io_ctx, const std::string &image_id,
+			 uint64_t snap_id, std::vector<uint8_t> *map);
+    static bool test(const std::vector<uint8_t> &map, uint64_t object_no);
+    /**
+     * Fold the diff map of a snapshot that is going away into that of
+     * the next snapshot, or of the head, so no change is lost.
+     */
+    static int merge_diff(librados::IoCtx &io_ctx, const std::string &image_id,
+			  uint64_t snap_id, uint64_t next_snap_id,
+			  uint64_t num_objects);
+
+    /**
+     * Load the map of the image's snapshot, or of the head if we hold
+     * the exclusive lock.  Call with md_lock or snap_lock held for
+     * write.
+     */
+    int refresh();
+
+    /// whether ops can be skipped by the map
+    bool enabled() const;
+    /// -EROFS if the image has a map that we may not change
+    int check_writable() const;
+    /// false only if the object is known not to exist
+    bool object_may_exist(uint64_t object_no) const;
+
+    /**
+     * Note that the objects of these extents may be created or
+     * changed.
+     *
+     * @returns 0 on success, -EROFS if we may not change the image
+     */
+    int mark_may_exist(const std::vector<ObjectExtent> &extents);
+    /// note that the objects of these extents may be changed
+    int mark_changed(const std::vector<ObjectExtent> &extents);
+    int mark_changed(uint64_t start, uint64_t end);
+    /// set or clear the bits of objects start to end - 1
+    int update(uint64_t start, uint64_t end, bool exists);
+    /// forget objects from num_objects on, which must be gone
+    int resize(uint64_t num_objects);
+    /**
+     * Give new snapshots of the head, in increasing order, copies of
+     * the maps.  Call with snap_lock held for write, as writes start
+     * using a snap context with them.
+     */
+    int snapshot(const std::vector<uint64_t> &snap_ids);
+    /// make the head's map that of the snapshot it was rolled back to
+    int rollback(uint64_t snap_id);
+
+  private:
+    ImageCtx &m_image_ctx;
+    mutable Mutex m_lock;
+    bool m_enabled;
+    uint64_t m_snap_id;         ///< whose map is loaded
+    std::vector<uint8_t> m_map;
+    std::vector<uint8_t> m_diff_map;  ///< the head's, with fast diff
+
+    static int load(librados::IoCtx &io_ctx, const std::string &oid,
+		    std::vector<uint8_t> *map);
+    bool has_feature() const;
+    bool has_fast_diff() const;
+    bool head_enabled() const;
+    int load_head_diff();
+    int snapshot_diff(const std::vector<uint64_t> &snap_ids);
+    static void set_bits(std::vector<uint8_t> *map, uint64_t start,
+			 uint64_t end, bool exists);
+  };
+
+}
+
+#endif
@@ -27,6 +27,8 @@ namespace librbd {
     Mutex::Locker l(lock);
     ldout(ictx->cct, 1) <<  " got notification opcode=" << (int)opcode
 			<< " ver=" << ver << " cookie=" << cookie << dendl;
+    if (valid && ictx->exclusive_lock.handle_notify(bl))
+      return;
     if (valid) {
       Mutex::Locker lictx(ictx->refresh_lock);
       ++ictx->refresh_seq;
@@ -0,0 +1,920 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include "common/ceph_context.h"
+#include "common/Clock.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/safe_io.h"
+#include "include/Context.h"
+#include "include/encoding.h"
+#include "include/intarith.h"
+#include "include/interval_set.h"
+#include "include/rbd/features.h"
+
+#include "librbd/AioCompletion.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+
+#include "librbd/WriteLog.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::WriteLog: "
+
+using std::map;
+using std::string;
+using std::vector;
+
+using ceph::bufferlist;
+
+namespace librbd {
+
+  static const uint64_t SUPERBLOCK_MAGIC = 0x726264776c6f6731ULL; // rbdwlog1
+  static const uint8_t SUPERBLOCK_VERSION = 1;
+  static const uint64_t SUPERBLOCK_SIZE = 4096;
+  static const uint32_t ENTRY_MAGIC = 0x656e7472; // entr
+  static const uint32_t ENTRY_DISCARD = 1;
+  static const uint64_t HEADER_SIZE = 64;
+  static const uint64_t BLOCK_SIZE = 512;  ///< entries are padded to it
+  static const uint64_t MIN_RING_SIZE = 16 << 20;
+  static const uint64_t MAX_ENTRY_LEN = 4 << 20;
+  /// how far past the oldest entry not written back to look for more
+  static const int WRITEBACK_WINDOW = 16;
+
+  class WriteLog::C_Writeback : public Context {
+  public:
+    C_Writeback(WriteLog *log, const std::list<Entry*> &entries)
+      : m_log(log), m_entries(entries) {}
+    virtual void finish(int r) {
+      m_log->handle_writeback(m_entries, r);
+    }
+  private:
+    WriteLog *m_log;
+    std::list<Entry*> m_entries;
+  };
+
+  /**
+   * An entry's header is its magic, the crc32c of the rest of the
+   * header and its data, then its seq, image extent, the seq of its
+   * snap context and flags.
+   */
+  static void encode_header(uint64_t seq, uint64_t image_off, uint64_t len,
+			    uint64_t snap_seq, bool discard,
+			    const bufferlist &data, bufferlist *bl)
+  {
+    bufferlist fields;
+    ::encode(seq, fields);
+    ::encode(image_off, fields);
+    ::encode(len, fields);
+    ::encode(snap_seq, fields);
+    ::encode(discard ? ENTRY_DISCARD : 0, fields);
+    uint32_t crc = data.crc32c(fields.crc32c(-1));
+
+    ::encode(ENTRY_MAGIC, *bl);
+    ::encode(crc, *bl);
+    bl->claim_append(fields);
+    assert(bl->length() <= HEADER_SIZE);
+    bl->append_zero(HEADER_SIZE - bl->length());
+  }
+
+  static void add_extent(interval_set<uint64_t> *s, uint64_t off, uint64_t len)
+  {
+    interval_set<uint64_t> one;
+    one.insert(off, len);
+    s->union_of(one);
+  }
+
+  WriteLog::WriteLog(ImageCtx &image_ctx)
+    : m_image_ctx(image_ctx),
+      m_fd(-1),
+      m_append_lock("librbd::WriteLog::m_append_lock"),
+      m_lock("librbd::WriteLog::m_lock"),
+      m_worker(this),
+      m_stopping(false),
+      m_error(0),
+      m_ring_size(0),
+      m_max_entry_len(0),
+      m_tail(0),
+      m_used(0),
+      m_next_seq(1),
+      m_appended_seq(1),
+      m_synced_seq(1),
+      m_persisted_seq(1),
+      m_clean_seq(1),
+      m_in_flight(0),
+      m_waiters(0),
+      m_writeback_error(0),
+      m_writeback_errors(0)
+  {
+  }
+
+  WriteLog::~WriteLog()
+  {
+    assert(m_fd < 0);
+    while (!m_entries.empty()) {
+      delete m_entries.front();
+      m_entries.pop_front();
+    }
+  }
+
+  bool WriteLog::is_wanted(const ImageCtx &image_ctx)
+  {
+    return !image_ctx.cct->_conf->rbd_persistent_cache_path.empty() &&
+      !image_ctx.read_only &&
+      (image_ctx.features & RBD_FEATURE_EXCLUSIVE_LOCK) != 0;
+  }
+
+  int WriteLog::init()
+  {
+    CephContext *cct = m_image_ctx.cct;
+    std::ostringstream path;
+    path << cct->_conf->rbd_persistent_cache_path << "/rbd-"
+	 << m_image_ctx.md_ctx.get_id() << "-" << m_image_ctx.id;
+    m_path = path.str();
+
+    int r;
+    Superblock sb;
+    m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT, 0600);
+    if (m_fd < 0) {
+      r = -errno;
+      lderr(cct) << "error opening write log " << m_path << ": "
+		 << cpp_strerror(r) << dendl;
+      return r;
+    }
+    // flock() locks are per open file, so this keeps out other images
+    // of this process as well
+    if (::flock(m_fd, LOCK_EX | LOCK_NB) < 0) {
+      r = -errno;
+      if (r == -EWOULDBLOCK)
+	r = -EBUSY;
+      else
+	lderr(cct) << "error locking write log " << m_path << ": "
+		   << cpp_strerror(r) << dendl;
+      goto err;
+    }
+
+    r = read_superblock(&sb);
+    if (r == 0 && (sb.pool_id != m_image_ctx.md_ctx.get_id() ||
+		   sb.image_id != m_image_ctx.id))
+      r = -EINVAL;
+    if (r == 0) {
+      r = load(sb);
+    } else if (r == -ENOENT || r == -EINVAL) {
+      if (r == -EINVAL)
+	lderr(cct) << "write log " << m_path << " is not valid; starting "
+		   << "it over" << dendl;
+      // so that nothing in it can pass for an entry
+      r = ::ftruncate(m_fd, 0) < 0 ? -errno : 0;
+    }
+    if (r == 0 && m_entries.empty())
+      r = reset();
+    if (r < 0)
+      goto err;
+
+    if (!m_entries.empty()) {
+      ldout(cct, 1) << "writing back " << m_entries.size() << " entries "
+		    << "left in write log " << m_path << dendl;
+      {
+	RWLock::RLocker l(m_image_ctx.owner_lock);
+	r = m_image_ctx.exclusive_lock.require_lock();
+      }
+      if (r < 0) {
+	lderr(cct) << "cannot write back write log " << m_path << " without "
+		   << "the image's exclusive lock: " << cpp_strerror(r)
+		   << dendl;
+	goto err;
+      }
+
+      // the snapshots each write came after
+      RWLock::RLocker l(m_image_ctx.snap_lock);
+      const vector<snapid_t> &snaps = m_image_ctx.snapc.snaps;
+      for (std::deque<Entry*>::iterator it = m_entries.begin();
+	   it != m_entries.end(); ++it) {
+	for (vector<snapid_t>::const_iterator s = snaps.begin();
+	     s != snaps.end(); ++s) {
+	  if (*s <= (*it)->snapc.seq)
+	    (*it)->snapc.snaps.push_back(*s);
+	}
+      }
+    }
+
+    m_worker.create();
+    return 0;
+
+  err:
+    while (!m_entries.empty()) {
+      delete m_entries.front();
+      m_entries.pop_front();
+    }
+    m_index.clear();
+    ::close(m_fd);
+    m_fd = -1;
+    return r;
+  }
+
+  int WriteLog::shutdown()
+  {
+    int r = writeback();
+    {
+      Mutex::Locker l(m_lock);
+      m_stopping = true;
+      m_cond.SignalAll();
+    }
+    m_worker.join();
+    ::close(m_fd);
+    m_fd = -1;
+    return r;
+  }
+
+  int WriteLog::read_superblock(Superblock *sb)
+  {
+    bufferptr bp(SUPERBLOCK_SIZE);
+    int r = safe_pread_exact(m_fd, bp.c_str(), SUPERBLOCK_SIZE, 0);
+    if (r == -EDOM)
+      return -ENOENT;
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error reading write log " << m_path << ": "
+			     << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    bufferlist bl;
+    bl.append(bp);
+    try {
+      bufferlist::iterator p = bl.begin();
+      uint64_t magic;
+      ::decode(magic, p);
+      if (magic != SUPERBLOCK_MAGIC)
+	return -EINVAL;
+      bufferlist body;
+      uint32_t crc;
+      ::decode(body, p);
+      ::decode(crc, p);
+      if (body.crc32c(-1) != crc)
+	return -EINVAL;
+
+      bufferlist::iterator q = body.begin();
+      uint8_t version;
+      ::decode(version, q);
+      if (version != SUPERBLOCK_VERSION)
+	return -EINVAL;
+      ::decode(sb->pool_id, q);
+      ::decode(sb->image_id, q);
+      ::decode(sb->ring_size, q);
+      ::decode(sb->first_seq, q);
+      ::decode(sb->first_off, q);
+    } catch (const buffer::error &err) {
+      return -EINVAL;
+    }
+    if (sb->ring_size < MIN_RING_SIZE || sb->first_off > sb->ring_size)
+      return -EINVAL;
+    return 0;
+  }
+
+  int WriteLog::write_superblock(uint64_t first_seq, uint64_t first_off)
+  {
+    bufferlist body;
+    ::encode(SUPERBLOCK_VERSION, body);
+    ::encode(m_image_ctx.md_ctx.get_id(), body);
+    ::encode(m_image_ctx.id, body);
+    ::encode(m_ring_size, body);
+    ::encode(first_seq, body);
+    ::encode(first_off, body);
+
+    bufferlist bl;
+    ::encode(SUPERBLOCK_MAGIC, bl);
+    ::encode(body, bl);
+    ::encode(body.crc32c(-1), bl);
+    assert(bl.length() <= SUPERBLOCK_SIZE);
+    bl.append_zero(SUPERBLOCK_SIZE - bl.length());
+
+    int r = safe_pwrite(m_fd, bl.c_str(), bl.length(), 0);
+    if (r == 0 && ::fdatasync(m_fd) < 0)
+      r = -errno;
+    if (r < 0)
+      lderr(m_image_ctx.cct) << "error writing write log " << m_path << ": "
+			     << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  /**
+   * Read the entry at pos in the ring, which should be the one with
+   * this seq.
+   *
+   * @returns 0 on success, -EINVAL if there is no such entry
+   */
+  int WriteLog::read_entry(uint64_t pos, uint64_t seq, Entry **entry)
+  {
+    if (pos + HEADER_SIZE > m_ring_size)
+      return -EINVAL;
+    bufferptr hp(HEADER_SIZE);
+    int r = safe_pread_exact(m_fd, hp.c_str(), HEADER_SIZE,
+			     SUPERBLOCK_SIZE + pos);
+    if (r < 0)
+      return r == -EDOM ? -EINVAL : r;
+
+    bufferlist header, fields;
+    header.append(hp);
+    fields.substr_of(header, 8, HEADER_SIZE - 8);
+    uint32_t magic, crc, flags;
+    uint64_t e_seq, image_off, len, snap_seq;
+    bufferlist::iterator p = header.begin();
+    ::decode(magic, p);
+    ::decode(crc, p);
+    ::decode(e_seq, p);
+    ::decode(image_off, p);
+    ::decode(len, p);
+    ::decode(snap_seq, p);
+    ::decode(flags, p);
+    if (magic != ENTRY_MAGIC || e_seq != seq || len == 0 ||
+	len > m_max_entry_len)
+      return -EINVAL;
+
+    bool discard = (flags & ENTRY_DISCARD) != 0;
+    uint64_t data_len = discard ? 0 : len;
+    uint64_t log_len = ROUND_UP_TO(HEADER_SIZE + data_len, BLOCK_SIZE);
+    if (pos + log_len > m_ring_size)
+      return -EINVAL;
+    bufferlist data;
+    if (data_len) {
+      bufferptr dp(data_len);
+      r = safe_pread_exact(m_fd, dp.c_str(), data_len,
+			   SUPERBLOCK_SIZE + pos + HEADER_SIZE);
+      if (r < 0)
+	return r == -EDOM ? -EINVAL : r;
+      data.append(dp);
+    }
+    // the crc covers the fields up to the padding
+    bufferlist covered;
+    covered.substr_of(fields, 0, 8 * 4 + 4);
+    if (data.crc32c(covered.crc32c(-1)) != crc)
+      return -EINVAL;
+
+    Entry *e = new Entry;
+    e->seq = seq;
+    e->log_off = pos;
+    e->log_len = log_len;
+    e->skipped = 0;
+    e->image_off = image_off;
+    e->len = len;
+    e->discard = discard;
+    e->snapc.seq = snap_seq;
+    e->state = STATE_DIRTY;
+    e->readers = 0;
+    e->on_safe = NULL;
+    *entry = e;
+    return 0;
+  }
+
+  /// load the entries from the superblock's first_seq on
+  int WriteLog::load(const Superblock &sb)
+  {
+    m_ring_size = sb.ring_size;
+    m_max_entry_len = MIN(MAX_ENTRY_LEN, m_ring_size / 4) & ~(BLOCK_SIZE - 1);
+    m_used = 0;
+
+    uint64_t seq = sb.first_seq;
+    uint64_t pos = sb.first_off;
+    while (true) {
+      Entry *e;
+      uint64_t skipped = 0;
+      int r = read_entry(pos, seq, &e);
+      if (r == -EINVAL && pos != 0) {
+	// it did not fit at the end of the ring
+	skipped = m_ring_size - pos;
+	r = read_entry(0, seq, &e);
+      }
+      if (r == -EINVAL)
+	break;
+      if (r < 0) {
+	lderr(m_image_ctx.cct) << "error reading write log " << m_path << ": "
+			       << cpp_strerror(r) << dendl;
+	return r;
+      }
+      e->skipped = skipped;
+      m_entries.push_back(e);
+      index_insert(e);
+      m_used += skipped + e->log_len;
+      pos = e->log_off + e->log_len;
+      ++seq;
+    }
+
+    m_tail = pos;
+    m_next_seq = m_appended_seq = m_synced_seq = seq;
+    m_persisted_seq = m_clean_seq = sb.first_seq;
+    return 0;
+  }
+
+  /// start an empty ring, of the configured size
+  int WriteLog::reset()
+  {
+    CephContext *cct = m_image_ctx.cct;
+    uint64_t size = cct->_conf->rbd_persistent_cache_size;
+    m_ring_size = size > SUPERBLOCK_SIZE ?
+      (size - SUPERBLOCK_SIZE) & ~(BLOCK_SIZE - 1) : 0;
+    if (m_ring_size < MIN_RING_SIZE) {
+      lderr(cct) << "rbd_persistent_cache_size must be at least "
+		 << SUPERBLOCK_SIZE + MIN_RING_SIZE << dendl;
+      return -EINVAL;
+    }
+    m_max_entry_len = MIN(MAX_ENTRY_LEN, m_ring_size / 4) & ~(BLOCK_SIZE - 1);
+    if (::ftruncate(m_fd, SUPERBLOCK_SIZE + m_ring_size) < 0) {
+      int r = -errno;
+      lderr(cct) << "error sizing write log " << m_path << ": "
+		 << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    // seqs go on from the last ones, so older entries never match
+    m_tail = 0;
+    m_used = 0;
+    m_appended_seq = m_synced_seq = m_persisted_seq = m_clean_seq = m_next_seq;
+    return write_superblock(m_next_seq, 0);
+  }
+
+  void WriteLog::append(uint64_t off, uint64_t len, const bufferlist &bl,
+			const ::SnapContext &snapc, Context *on_safe)
+  {
+    int r = 0;
+    {
+      Mutex::Locker l(m_append_lock);
+      uint64_t done = 0;
+      while (done < len) {
+	uint64_t n = MIN(len - done, m_max_entry_len);
+	bufferlist data;
+	if (bl.length())
+	  data.substr_of(bl, done, n);
+	bool last = done + n == len;
+	r = append_entry(off + done, n, data, snapc, last ? on_safe : NULL);
+	if (r < 0)
+	  break;
+	done += n;
+      }
+    }
+    if (r < 0)
+      on_safe->complete(r);
+  }
+
+  int WriteLog::append_entry(uint64_t off, uint64_t len, bufferlist &data,
+			     const ::SnapContext &snapc, Context *on_safe)
+  {
+    uint64_t log_len = ROUND_UP_TO(HEADER_SIZE + data.length(), BLOCK_SIZE);
+    Entry *e;
+    {
+      Mutex::Locker l(m_lock);
+      int r = reserve(log_len, &e);
+      if (r < 0)
+	return r;
+      e->image_off = off;
+      e->len = len;
+      e->discard = data.length() == 0;
+      e->snapc = snapc;
+    }
+
+    bufferlist bl;
+    encode_header(e->seq, off, len, snapc.seq, e->discard, data, &bl);
+    bl.append(data);
+    bl.append_zero(log_len - bl.length());
+    int r = safe_pwrite(m_fd, bl.c_str(), bl.length(),
+			SUPERBLOCK_SIZE + e->log_off);
+
+    Mutex::Locker l(m_lock);
+    m_appended_seq = e->seq + 1;
+    m_cond.SignalAll();
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error appending to write log " << m_path
+			     << ": " << cpp_strerror(r) << dendl;
+      // nothing can be appended after an entry that is not in the log
+      m_error = r;
+      e->state = STATE_CLEAN;
+      return r;
+    }
+    e->state = STATE_APPENDED;
+    e->on_safe = on_safe;
+    index_insert(e);
+    return 0;
+  }
+
+  /// make room for an entry at the tail of the ring
+  int WriteLog::reserve(uint64_t log_len, Entry **entry)
+  {
+    while (true) {
+      if (m_error)
+	return m_error;
+
+      uint64_t pos = m_tail;
+      uint64_t skipped = 0;
+      if (pos + log_len > m_ring_size) {
+	skipped = m_ring_size - pos;
+	pos = 0;
+      }
+      if (m_used + skipped + log_len <= m_ring_size) {
+	Entry *e = new Entry;
+	e->seq = m_next_seq++;
+	e->log_off = pos;
+	e->log_len = log_len;
+	e->skipped = skipped;
+	e->state = STATE_APPENDING;
+	e->readers = 0;
+	e->on_safe = NULL;
+	m_entries.push_back(e);
+	m_used += skipped + log_len;
+	m_tail = pos + log_len;
+	*entry = e;
+	return 0;
+      }
+
+      if (!reclaim()) {
+	ldout(m_image_ctx.cct, 20) << "write log is full; waiting for "
+				   << "writeback" << dendl;
+	++m_waiters;
+	m_cond.SignalAll();
+	m_cond.Wait(m_lock);
+	--m_waiters;
+      }
+    }
+  }
+
+  /// free the oldest entry, if it is written back and no one needs it
+  bool WriteLog::reclaim()
+  {
+    if (m_entries.empty())
+      return false;
+    Entry *e = m_entries.front();
+    if (e->state != STATE_CLEAN || e->readers || e->seq >= m_persisted_seq)
+      return false;
+    index_remove(e);
+    m_used -= e->skipped + e->log_len;
+    m_entries.pop_front();
+    delete e;
+    return true;
+  }
+
+  void WriteLog::index_insert(Entry *entry)
+  {
+    uint64_t off = entry->image_off;
+    uint64_t end = off + entry->len;
+    map<uint64_t, Extent>::iterator p = m_index.lower_bound(off);
+    if (p != m_index.begin()) {
+      --p;
+      if (p->first + p->second.len <= off)
+	++p;
+    }
+    while (p != m_index.end() && p->first < end) {
+      uint64_t start = p->first;
+      Extent ext = p->second;
+      m_index.erase(p++);
+      if (start < off) {
+	Extent left = ext;
+	left.len = off - start;
+	m_index[start] = left;
+      }
+      if (start + ext.len > end) {
+	Extent right = ext;
+	right.entry_off += end - start;
+	right.len = start + ext.len - end;
+	m_index[end] = right;
+      }
+    }
+    Extent ext = { entry, 0, entry->len };
+    m_index[off] = ext;
+  }
+
+  void WriteLog::index_remove(Entry *entry)
+  {
+    uint64_t end = entry->image_off + entry->len;
+    map<uint64_t, Extent>::iterator p = m_index.lower_bound(entry->image_off);
+    if (p != m_index.begin())
+      --p;
+    while (p != m_index.end() && p->first < end) {
+      if (p->second.entry == entry)
+	m_index.erase(p++);
+      else
+	++p;
+    }
+  }
+
+  int WriteLog::read(uint64_t off, uint64_t len,
+		     map<uint64_t, bufferlist> *data)
+  {
+    uint64_t end = off + len;
+    vector<std::pair<uint64_t, Extent> > extents;
+    {
+      Mutex::Locker l(m_lock);
+      map<uint64_t, Extent>::iterator p = m_index.lower_bound(off);
+      if (p != m_index.begin()) {
+	--p;
+	if (p->first + p->second.len <= off)
+	  ++p;
+      }
+      for (; p != m_index.end() && p->first < end; ++p) {
+	uint64_t start = MAX(p->first, off);
+	Extent ext = p->second;
+	ext.entry_off += start - p->first;
+	ext.len = MIN(p->first + p->second.len, end) - start;
+	++ext.entry->readers;
+	extents.push_back(std::make_pair(start, ext));
+      }
+    }
+
+    int r = 0;
+    for (vector<std::pair<uint64_t, Extent> >::iterator p = extents.begin();
+	 p != extents.end(); ++p) {
+      const Extent &ext = p->second;
+      bufferlist &bl = (*data)[p->first];
+      if (ext.entry->discard) {
+	bl.append_zero(ext.len);
+	continue;
+      }
+      bufferptr bp(ext.len);
+      r = safe_pread_exact(m_fd, bp.c_str(), ext.len,
+			   SUPERBLOCK_SIZE + ext.entry->log_off + HEADER_SIZE +
+			   ext.entry_off);
+      if (r < 0) {
+	lderr(m_image_ctx.cct) << "error reading write log " << m_path << ": "
+			       << cpp_strerror(r) << dendl;
+	break;
+      }
+      bl.append(bp);
+    }
+
+    Mutex::Locker l(m_lock);
+    for (vector<std::pair<uint64_t, Extent> >::iterator p = extents.begin();
+	 p != extents.end(); ++p)
+      --p->second.entry->readers;
+    m_cond.SignalAll();
+    return r;
+  }
+
+  void WriteLog::flush(Context *on_safe)
+  {
+    int r;
+    {
+      Mutex::Locker l(m_lock);
+      if (m_synced_seq < m_next_seq) {
+	m_flush_waiters.push_back(std::make_pair(m_next_seq, on_safe));
+	m_cond.SignalAll();
+	return;
+      }
+      r = m_error;
+    }
+    on_safe->complete(r);
+  }
+
+  int WriteLog::writeback()
+  {
+    Mutex::Locker l(m_lock);
+    uint64_t seq = m_next_seq;
+    uint64_t errors = m_writeback_errors;
+    int r = 0;
+    ++m_waiters;
+    m_cond.SignalAll();
+    while (m_persisted_seq < seq) {
+      if (m_writeback_errors != errors) {
+	r = m_writeback_error;
+	break;
+      }
+      if (m_error) {
+	r = m_error;
+	break;
+      }
+      m_cond.Wait(m_lock);
+    }
+    --m_waiters;
+    return r;
+  }
+
+  void WriteLog::invalidate()
+  {
+    Mutex::Locker l(m_lock);
+    map<uint64_t, Extent>::iterator p = m_index.begin();
+    while (p != m_index.end()) {
+      if (p->second.entry->state == STATE_CLEAN)
+	m_index.erase(p++);
+      else
+	++p;
+    }
+  }
+
+  WriteLog::Entry *WriteLog::entry_at(uint64_t seq) const
+  {
+    if (m_entries.empty() || seq < m_entries.front()->seq)
+      return NULL;
+    uint64_t i = seq - m_entries.front()->seq;
+    return i < m_entries.size() ? m_entries[i] : NULL;
+  }
+
+  WriteLog::Entry *WriteLog::first_unclean(uint64_t *seq)
+  {
+    Entry *e;
+    while ((e = entry_at(m_clean_seq)) != NULL && e->state == STATE_CLEAN)
+      ++m_clean_seq;
+    *seq = m_clean_seq;
+    return e;
+  }
+
+  void WriteLog::work()
+  {
+    Mutex::Locker l(m_lock);
+    while (true) {
+      if (m_synced_seq < m_appended_seq) {
+	sync();
+	continue;
+      }
+      if (send_writebacks() || persist())
+	continue;
+      if (m_stopping && !m_in_flight)
+	break;
+      if (!m_retry_time.is_zero())
+	m_cond.WaitUntil(m_lock, m_retry_time);
+      else
+	m_cond.Wait(m_lock);
+    }
+  }
+
+  /// make what was appended safe on the device
+  void WriteLog::sync()
+  {
+    uint64_t seq = m_appended_seq;
+    m_lock.Unlock();
+    int r = ::fdatasync(m_fd);
+    if (r < 0)
+      r = -errno;
+    m_lock.Lock();
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error syncing write log " << m_path << ": "
+			     << cpp_strerror(r) << dendl;
+      m_error = r;
+    }
+
+    std::list<Context*> finished;
+    for (uint64_t s = m_synced_seq; s < seq; ++s) {
+      Entry *e = entry_at(s);
+      assert(e);
+      if (e->state == STATE_APPENDED)
+	e->state = STATE_DIRTY;
+      if (e->on_safe) {
+	finished.push_back(e->on_safe);
+	e->on_safe = NULL;
+      }
+    }
+    m_synced_seq = seq;
+    while (!m_flush_waiters.empty() && m_flush_waiters.front().first <= seq) {
+      finished.push_back(m_flush_waiters.front().second);
+      m_flush_waiters.pop_front();
+    }
+    m_cond.SignalAll();
+
+    m_lock.Unlock();
+    for (std::list<Context*>::iterator it = finished.begin(); it != finished.end();
+	 ++it)
+      (*it)->complete(r);
+    m_lock.Lock();
+  }
+
+  /**
+   * Start writing back the entries that may go now: those after the
+   * oldest entry not written back, with the same snap context, that
+   * overlap no earlier entry still to be written back.
+   *
+   * @returns true if any were sent
+   */
+  bool WriteLog::send_writebacks()
+  {
+    CephContext *cct = m_image_ctx.cct;
+    int max = cct->_conf->rbd_persistent_cache_max_writeback;
+    if (m_in_flight >= max)
+      return false;
+    if (!m_retry_time.is_zero()) {
+      if (ceph_clock_now(cct) < m_retry_time)
+	return false;
+      m_retry_time = utime_t();
+    }
+
+    uint64_t seq;
+    Entry *first = first_unclean(&seq);
+    if (!first)
+      return false;
+
+    // each writeback is one entry, or a run of discards of consecutive
+    // entries that cover one extent, as a large discard is split into
+    // entries like a write is
+    interval_set<uint64_t> busy;
+    std::list<std::list<Entry*> > to_send;
+    for (int scanned = 0;
+	 m_in_flight + (int)to_send.size() < max &&
+	   scanned < max * WRITEBACK_WINDOW;
+	 ++seq, ++scanned) {
+      Entry *e = entry_at(seq);
+      if (!e || e->state == STATE_APPENDING || e->state == STATE_APPENDED)
+	break;
+      // writes from after a snapshot wait for those before it
+      if (e->snapc.seq != first->snapc.seq)
+	break;
+      if (e->state == STATE_CLEAN)
+	continue;
+      if (e->state == STATE_DIRTY && !busy.intersects(e->image_off, e->len)) {
+	e->state = STATE_WRITEBACK;
+	Entry *last = to_send.empty() ? NULL : to_send.back().back();
+	if (last && last->discard && e->discard && last->seq + 1 == e->seq &&
+	    last->image_off + last->len == e->image_off)
+	  to_send.back().push_back(e);
+	else
+	  to_send.push_back(std::list<Entry*>(1, e));
+      }
+      add_extent(&busy, e->image_off, e->len);
+    }
+    if (to_send.empty())
+      return false;
+
+    m_in_flight += to_send.size();
+    m_lock.Unlock();
+    for (std::list<std::list<Entry*> >::iterator it = to_send.begin();
+	 it != to_send.end(); ++it) {
+      Entry *e = it->front();
+      Context *ctx = new C_Writeback(this, *it);
+      if (e->discard) {
+	uint64_t len = it->back()->image_off + it->back()->len - e->image_off;
+	ldout(cct, 20) << "writing back " << e->seq << ".." << it->back()->seq
+		       << " " << e->image_off << "~" << len << " discard"
+		       << dendl;
+	aio_discard_back(&m_image_ctx, e->image_off, len, e->snapc,
+			 aio_create_completion_internal(ctx, rbd_ctx_cb));
+	continue;
+      }
+      ldout(cct, 20) << "writing back " << e->seq << " " << e->image_off
+		     << "~" << e->len << dendl;
+      bufferptr bp(e->len);
+      int r = safe_pread_exact(m_fd, bp.c_str(), e->len,
+			       SUPERBLOCK_SIZE + e->log_off + HEADER_SIZE);
+      if (r < 0) {
+	lderr(cct) << "error reading write log " << m_path << ": "
+		   << cpp_strerror(r) << dendl;
+	ctx->complete(r);
+	continue;
+      }
+      bufferlist bl;
+      bl.append(bp);
+      aio_write_back(&m_image_ctx, e->image_off, bl, e->snapc,
+		     aio_create_completion_internal(ctx, rbd_ctx_cb));
+    }
+    m_lock.Lock();
+    return true;
+  }
+
+  void WriteLog::handle_writeback(const std::list<Entry*> &entries, int r)
+  {
+    CephContext *cct = m_image_ctx.cct;
+    Mutex::Locker l(m_lock);
+    --m_in_flight;
+    if (r < 0) {
+      Entry *first = entries.front(), *last = entries.back();
+      lderr(cct) << "error writing back " << first->image_off << "~"
+		 << last->image_off + last->len - first->image_off
+		 << ", will retry: " << cpp_strerror(r) << dendl;
+      m_writeback_error = r;
+      ++m_writeback_errors;
+      m_retry_time = ceph_clock_now(cct);
+      m_retry_time += 1.0;
+    }
+    for (std::list<Entry*>::const_iterator it = entries.begin();
+	 it != entries.end(); ++it)
+      (*it)->state = r < 0 ? STATE_DIRTY : STATE_CLEAN;
+    m_cond.SignalAll();
+  }
+
+  /**
+   * Record in the superblock how far the log is written back, when
+   * someone is waiting for it or no writeback is in progress.
+   *
+   * @returns true if the superblock was written
+   */
+  bool WriteLog::persist()
+  {
+    uint64_t seq;
+    Entry *e = first_unclean(&seq);
+    if (seq <= m_persisted_seq || m_error || (m_in_flight && !m_waiters))
+      return false;
+    uint64_t off = e ? e->log_off : m_tail;
+
+    m_lock.Unlock();
+    int r = write_superblock(seq, off);
+    m_lock.Lock();
+    if (r < 0) {
+      m_error = r;
+      m_cond.SignalAll();
+      return false;
+    }
+    m_persisted_seq = seq;
+    m_cond.SignalAll();
+    return true;
+  }
+
+}
@@ -0,0 +1,193 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_WRITELOG_H
+#define CEPH_LIBRBD_WRITELOG_H
+
+#include "include/int_types.h"
+
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "common/snap_types.h"
+#include "include/buffer.h"
+#include "include/utime.h"
+
+class Context;
+
+namespace librbd {
+
+  struct ImageCtx;
+
+  /**
+   * A write-back cache of an image's writes, kept in a log on a local
+   * device under rbd_persistent_cache_path.
+   *
+   * The log is a superblock followed by a ring of entries, each a
+   * write or a discard with the snap context it was made with.  A
+   * write completes once its entry is on the local device; a thread
+   * writes entries back to the cluster in order, a few at a time,
+   * never overlapping ones or ones from before and after a snapshot at
+   * once, so the image in the cluster is always one the writer could
+   * have made.  The superblock records the oldest entry that is not
+   * written back yet, and when the image is opened again after a crash
+   * the entries from there on are loaded and written back first.
+   *
+   * Entries stay in the ring after they are written back until their
+   * room is needed, and reads of the head are served from the log
+   * where it has the newest data.
+   *
+   * The log needs the image's exclusive lock: it is written back, and
+   * what was written back dropped, before anyone else may change the
+   * image.
+   *
+   * Lock ordering: m_append_lock, then m_lock.  Neither is held while
+   * calling into the rest of librbd.
+   */
+  class WriteLog {
+  public:
+    WriteLog(ImageCtx &image_ctx);
+    ~WriteLog();
+
+    /// whether the image should be opened with a log
+    static bool is_wanted(const ImageCtx &image_ctx);
+
+    /**
+     * Open or create the image's log, loading the entries that were
+     * not written back the last time.  Writing those back needs the
+     * exclusive lock, which is taken here if need be.
+     *
+     * @returns 0 on success, -EBUSY if another process has the log open
+     */
+    int init();
+    /// write back everything and close the log
+    int shutdown();
+
+    /**
+     * Append a write of bl, or a discard if bl is empty, completing
+     * on_safe once it is on the local device.  Blocks while the log
+     * is full.
+     */
+    void append(uint64_t off, uint64_t len, const ceph::bufferlist &bl,
+		const ::SnapContext &snapc, Context *on_safe);
+    /**
+     * Get the newest data the log has within an extent of the head,
+     * by image offset; discarded ranges read as zeros.
+     */
+    int read(uint64_t off, uint64_t len,
+	     std::map<uint64_t, ceph::bufferlist> *data);
+    /// complete on_safe once what was appended so far is on the device
+    void flush(Context *on_safe);
+    /// write back what was appended so far to the cluster, and wait
+    int writeback();
+    /// stop serving reads from what was written back
+    void invalidate();
+
+  private:
+    enum {
+      STATE_APPENDING,	///< being written to the log
+      STATE_APPENDED,	///< in the log, maybe not on the device yet
+      STATE_DIRTY,	///< on the device, not written back
+      STATE_WRITEBACK,	///< being written back
+      STATE_CLEAN,	///< written back
+    };
+
+    struct Entry {
+      uint64_t seq;
+      uint64_t log_off;		///< of its header in the ring
+      uint64_t log_len;		///< of header and data, padded
+      uint64_t skipped;		///< unused bytes at the end of the ring before it
+      uint64_t image_off;
+      uint64_t len;
+      bool discard;
+      ::SnapContext snapc;
+      int state;
+      int readers;		///< reads of its data in progress
+      Context *on_safe;
+    };
+
+    /// the newest data of an extent of the image, at entry_off in an entry
+    struct Extent {
+      Entry *entry;
+      uint64_t entry_off;
+      uint64_t len;
+    };
+
+    struct Superblock {
+      int64_t pool_id;
+      std::string image_id;
+      uint64_t ring_size;
+      uint64_t first_seq;	///< of the oldest entry not written back
+      uint64_t first_off;	///< where it is, or would go
+    };
+
+    class C_Writeback;
+
+    class Worker : public Thread {
+    public:
+      Worker(WriteLog *log) : m_log(log) {}
+      void *entry() {
+	m_log->work();
+	return NULL;
+      }
+    private:
+      WriteLog *m_log;
+    };
+
+    ImageCtx &m_image_ctx;
+    std::string m_path;
+    int m_fd;
+    Mutex m_append_lock;	///< serializes appends
+    Mutex m_lock;
+    Cond m_cond;
+    Worker m_worker;
+    bool m_stopping;
+    int m_error;		///< of the device; appends fail after it
+    uint64_t m_ring_size;
+    uint64_t m_max_entry_len;	///< of an entry's data
+    uint64_t m_tail;		///< where the next entry goes
+    uint64_t m_used;		///< bytes of the ring in use
+    uint64_t m_next_seq;
+    uint64_t m_appended_seq;	///< entries before it are in the log
+    uint64_t m_synced_seq;	///< ... and on the device
+    uint64_t m_persisted_seq;	///< the superblock's first_seq
+    uint64_t m_clean_seq;	///< entries before it are written back
+    int m_in_flight;		///< writebacks in progress
+    int m_waiters;		///< for writeback or room in the ring
+    int m_writeback_error;
+    uint64_t m_writeback_errors;
+    utime_t m_retry_time;	///< of writebacks, after an error
+    std::deque<Entry*> m_entries;	///< by seq
+    std::map<uint64_t, Extent> m_index;	///< by image offset
+    std::list<std::pair<uint64_t, Context*> > m_flush_waiters;
+
+    int read_superblock(Superblock *sb);
+    int write_superblock(uint64_t first_seq, uint64_t first_off);
+    int read_entry(uint64_t pos, uint64_t seq, Entry **entry);
+    int load(const Superblock &sb);
+    int reset();
+
+    int append_entry(uint64_t off, uint64_t len, ceph::bufferlist &data,
+		     const ::SnapContext &snapc, Context *on_safe);
+    int reserve(uint64_t log_len, Entry **entry);
+    bool reclaim();
+    void index_insert(Entry *entry);
+    void index_remove(Entry *entry);
+
+    Entry *entry_at(uint64_t seq) const;
+    Entry *first_unclean(uint64_t *seq);
+    void work();
+    void sync();
+    bool send_writebacks();
+    void handle_writeback(const std::list<Entry*> &entries, int r);
+    bool persist();
+  };
+
+}
+
+#endif
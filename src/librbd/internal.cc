@@ -17,6 +17,8 @@
 #include "librbd/AioCompletion.h"
 #include "librbd/AioRequest.h"
 #include "librbd/ImageCtx.h"
+#include "librbd/ObjectMap.h"
+#include "librbd/WriteLog.h"
 
 #include "librbd/internal.h"
 #include "librbd/parent_types.h"
@@ -169,7 +171,10 @@ namespace librbd {
     if (delete_start < num_objects) {
       ldout(cct, 2) << "trim_image objects " << delete_start << " to "
 		    << (num_objects - 1) << dendl;
+      ictx->object_map.mark_changed(delete_start, num_objects);
       for (uint64_t i = delete_start; i < num_objects; ++i) {
+	if (!ictx->object_map.object_may_exist(i))
+	  continue;
 	string oid = ictx->get_object_name(i);
 	Context *req_comp = new C_SimpleThrottle(&throttle);
 	librados::AioCompletion *rados_completion =
@@ -187,9 +192,12 @@ namespace librbd {
       Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout,
 			       newsize, delete_off - newsize, 0, extents);
 
+      ictx->object_map.mark_changed(extents);
       for (vector<ObjectExtent>::iterator p = extents.begin();
 	   p != extents.end(); ++p) {
 	ldout(ictx->cct, 20) << " ex " << *p << dendl;
+	if (!ictx->object_map.object_may_exist(p->objectno))
+	  continue;
 	Context *req_comp = new C_SimpleThrottle(&throttle);
 	librados::AioCompletion *rados_completion =
 	  librados::Rados::aio_create_completion(req_comp, NULL, rados_ctx_cb);
@@ -207,6 +215,9 @@ namespace librbd {
     if (r < 0) {
       lderr(cct) << "warning: failed to remove some object(s): "
 		 << cpp_strerror(r) << dendl;
+    } else if (delete_start < num_objects) {
+      // only once they are all known to be gone
+      ictx->object_map.resize(delete_start);
     }
   }
 
@@ -429,17 +440,37 @@ namespace librbd {
 	return r;
       }
 
+      if (image_ids.empty())
+	continue;
+
+      map<string, string> id_names;
+      r = cls_client::dir_get_names(&ioctx, RBD_DIRECTORY, image_ids,
+				    &id_names);
+      if (r == -EOPNOTSUPP || r == -EIO) {
+	// an OSD without dir_get_names: one id at a time
+	for (set<string>::const_iterator id_it = image_ids.begin();
+	     id_it != image_ids.end(); ++id_it) {
+	  r = cls_client::dir_get_name(&ioctx, RBD_DIRECTORY,
+				       *id_it, &id_names[*id_it]);
+	  if (r < 0)
+	    break;
+	}
+      }
+      if (r < 0) {
+	lderr(cct) << "Error looking up names of children in pool " << *it
+		   << ": " << cpp_strerror(r) << dendl;
+	return r;
+      }
+
       for (set<string>::const_iterator id_it = image_ids.begin();
 	   id_it != image_ids.end(); ++id_it) {
-	string name;
-	r = cls_client::dir_get_name(&ioctx, RBD_DIRECTORY,
-				     *id_it, &name);
-	if (r < 0) {
+	map<string, string>::iterator n = id_names.find(*id_it);
+	if (n == id_names.end()) {
 	  lderr(cct) << "Error looking up name for image id " << *id_it
 		     << " in pool " << *it << dendl;
-	  return r;
+	  return -ENOENT;
 	}
-	names.insert(make_pair(*it, name));
+	names.insert(make_pair(*it, n->second));
       }
     }
 
@@ -457,6 +488,14 @@ namespace librbd {
     if (r < 0)
       return r;
 
+    if (ictx->write_log) {
+      // the snapshot should have what was written before it, and
+      // writes with older snap contexts must not race with newer ones
+      r = ictx->write_log->writeback();
+      if (r < 0)
+	return r;
+    }
+
     RWLock::RLocker l(ictx->md_lock);
     do {
       r = add_snap(ictx, snap_name);
@@ -503,6 +542,8 @@ namespace librbd {
 
     RWLock::RLocker l(ictx->md_lock);
     snap_t snap_id;
+    snap_t next_snap_id = CEPH_NOSNAP;
+    uint64_t num_objects;
 
     {
       // block for purposes of auto-destruction of l2 on early return
@@ -511,6 +552,14 @@ namespace librbd {
       if (snap_id == CEPH_NOSNAP)
 	return -ENOENT;
 
+      // the next snapshot, or the head, inherits its diff map
+      for (vector<snap_t>::const_iterator it = ictx->snaps.begin();
+	   it != ictx->snaps.end(); ++it) {
+	if (*it > snap_id && *it < next_snap_id)
+	  next_snap_id = *it;
+      }
+      num_objects = ictx->get_num_objects();
+
       parent_spec our_pspec;
       RWLock::RLocker l3(ictx->parent_lock);
       r = ictx->get_parent_spec(snap_id, &our_pspec);
@@ -528,6 +577,16 @@ namespace librbd {
       }
     }
 
+    if (ictx->features & RBD_FEATURE_FAST_DIFF) {
+      r = ObjectMap::merge_diff(ictx->md_ctx, ictx->id, snap_id, next_snap_id,
+				num_objects);
+      if (r < 0) {
+	lderr(ictx->cct) << "error merging snapshot's diff map: "
+			 << cpp_strerror(r) << dendl;
+	return r;
+      }
+    }
+
     r = rm_snap(ictx, snap_name);
     if (r < 0)
       return r;
@@ -537,6 +596,13 @@ namespace librbd {
     if (r < 0)
       return r;
 
+    if (ictx->features & RBD_FEATURE_OBJECT_MAP) {
+      r = ObjectMap::remove(ictx->md_ctx, ictx->id, snap_id);
+      if (r < 0)
+	lderr(ictx->cct) << "error removing snapshot's object map: "
+			 << cpp_strerror(r) << dendl;
+    }
+
     notify_change(ictx->md_ctx, ictx->header_oid, NULL, ictx);
 
     ictx->perfcounter->inc(l_librbd_snap_remove);
@@ -789,6 +855,15 @@ reprotect_and_return_err:
       }
     }
 
+    if (features & RBD_FEATURE_OBJECT_MAP) {
+      r = ObjectMap::create(io_ctx, id, features);
+      if (r < 0) {
+	lderr(cct) << "error creating object map: " << cpp_strerror(r)
+		   << dendl;
+	goto err_remove_header;
+      }
+    }
+
     ldout(cct, 2) << "done." << dendl;
     return 0;
 
@@ -842,6 +917,11 @@ reprotect_and_return_err:
       lderr(cct) << "librbd does not support requested features." << dendl;
       return -ENOSYS;
     }
+    if ((features & RBD_FEATURE_FAST_DIFF) &&
+	!(features & RBD_FEATURE_OBJECT_MAP)) {
+      lderr(cct) << "fast diff requires the object map feature" << dendl;
+      return -EINVAL;
+    }
 
     // make sure it doesn't already exist, in either format
     int r = detect_format(io_ctx, imgname, NULL, NULL);
@@ -1369,6 +1449,15 @@ reprotect_and_return_err:
       }
       close_image(ictx);
 
+      if (!old_format) {
+	r = ObjectMap::remove(io_ctx, id, CEPH_NOSNAP);
+	if (r < 0) {
+	  lderr(cct) << "error removing object map: " << cpp_strerror(r)
+		     << dendl;
+	  return r;
+	}
+      }
+
       ldout(cct, 2) << "removing header..." << dendl;
       r = io_ctx.remove(header_oid);
       if (r < 0 && r != -ENOENT) {
@@ -1432,6 +1521,7 @@ reprotect_and_return_err:
       ldout(cct, 2) << "shrinking image " << ictx->size << " -> " << size
 		    << dendl;
       trim_image(ictx, size, prog_ctx);
+      ictx->exclusive_lock.forget_objects();
     }
     ictx->size = size;
 
@@ -1473,8 +1563,16 @@ reprotect_and_return_err:
     if (r < 0)
       return r;
 
+    RWLock::RLocker owner_locker(ictx->owner_lock);
+    r = ictx->exclusive_lock.require_lock();
+    if (r < 0)
+      return r;
+    r = ictx->object_map.check_writable();
+    if (r < 0)
+      return r;
+
     RWLock::WLocker l(ictx->md_lock);
-    if (size < ictx->size && ictx->object_cacher) {
+    if (size < ictx->size && (ictx->object_cacher || ictx->write_log)) {
       // need to invalidate since we're deleting objects, and
       // ObjectCacher doesn't track non-existent objects
       ictx->invalidate_cache();
@@ -1625,6 +1723,34 @@ reprotect_and_return_err:
     return 0;
   }
 
+  /**
+   * Fill in the metadata of the snapshots get_refresh_info() didn't
+   * send, as we have them already.  Call with snap_lock held.
+   */
+  static void fill_known_snaps(ImageCtx *ictx, const vector<snapid_t> &ids,
+			       const vector<bool> &new_snaps,
+			       vector<string> *names, vector<uint64_t> *sizes,
+			       vector<uint64_t> *features,
+			       vector<parent_info> *parents)
+  {
+    map<snap_t, map<string, SnapInfo>::const_iterator> known;
+    for (map<string, SnapInfo>::const_iterator it =
+	   ictx->snaps_by_name.begin();
+	 it != ictx->snaps_by_name.end(); ++it)
+      known[it->second.id] = it;
+    for (size_t i = 0; i < ids.size(); ++i) {
+      if (new_snaps[i])
+	continue;
+      map<snap_t, map<string, SnapInfo>::const_iterator>::iterator k =
+	known.find(ids[i].val);
+      assert(k != known.end());
+      (*names)[i] = k->second->first;
+      (*sizes)[i] = k->second->second.size;
+      (*features)[i] = k->second->second.features;
+      (*parents)[i] = k->second->second.parent;
+    }
+  }
+
   int ictx_refresh(ImageCtx *ictx)
   {
     CephContext *cct = ictx->cct;
@@ -1638,6 +1764,7 @@ reprotect_and_return_err:
 
     ::SnapContext new_snapc;
     bool new_snap = false;
+    vector<uint64_t> new_snap_ids;
     vector<string> snap_names;
     vector<uint64_t> snap_sizes;
     vector<uint64_t> snap_features;
@@ -1684,7 +1811,41 @@ reprotect_and_return_err:
 	  ictx->size = ictx->header.image_size;
 	  ictx->object_prefix = ictx->header.block_name;
 	  ictx->init_layout();
-	} else {
+	} else if (ictx->refresh_info_supported) {
+	  // one op gets everything but what we have of our snapshots
+	  uint64_t incompatible_features;
+	  std::set<uint64_t> known_snaps(ictx->snaps.begin(), ictx->snaps.end());
+	  vector<bool> new_snaps;
+	  r = cls_client::get_refresh_info(&ictx->md_ctx, ictx->header_oid,
+					   known_snaps, &ictx->size,
+					   &ictx->features,
+					   &incompatible_features,
+					   &ictx->lockers,
+					   &ictx->exclusive_locked,
+					   &ictx->lock_tag, &new_snapc,
+					   &ictx->parent_md, &new_snaps,
+					   &snap_names, &snap_sizes,
+					   &snap_features, &snap_parents,
+					   &snap_protection);
+	  if (r == -EOPNOTSUPP || r == -EIO) {
+	    ldout(cct, 10) << "OSDs can't get refresh info in one call" << dendl;
+	    ictx->refresh_info_supported = false;
+	  } else if (r < 0) {
+	    lderr(cct) << "Error reading mutable metadata: " << cpp_strerror(r)
+		       << dendl;
+	    return r;
+	  } else {
+	    uint64_t unsupported = incompatible_features & ~RBD_FEATURES_ALL;
+	    if (unsupported) {
+	      lderr(ictx->cct) << "Image uses unsupported features: "
+			       << unsupported << dendl;
+	      return -ENOSYS;
+	    }
+	    fill_known_snaps(ictx, new_snapc.snaps, new_snaps, &snap_names,
+			     &snap_sizes, &snap_features, &snap_parents);
+	  }
+	}
+	if (!ictx->old_format && !ictx->refresh_info_supported) {
 	  do {
 	    uint64_t incompatible_features;
 	    r = cls_client::get_mutable_metadata(&ictx->md_ctx, ictx->header_oid,
@@ -1732,6 +1893,7 @@ reprotect_and_return_err:
 	    find(ictx->snaps.begin(), ictx->snaps.end(), new_snapc.snaps[i].val);
 	  if (it == ictx->snaps.end()) {
 	    new_snap = true;
+	    new_snap_ids.push_back(new_snapc.snaps[i].val);
 	    ldout(cct, 20) << "new snapshot id=" << new_snapc.snaps[i].val
 			   << " name=" << snap_names[i]
 			   << " size=" << snap_sizes[i]
@@ -1773,6 +1935,14 @@ reprotect_and_return_err:
       }
 
       ictx->data_ctx.selfmanaged_snap_set_write_ctx(ictx->snapc.seq, ictx->snaps);
+
+      // notices if our lock was broken
+      ictx->exclusive_lock.refresh();
+      ictx->object_map.refresh();
+
+      // our writes from now on come after any new snapshots
+      sort(new_snap_ids.begin(), new_snap_ids.end());
+      ictx->object_map.snapshot(new_snap_ids);
     } // release snap_lock
 
     if (new_snap) {
@@ -1797,6 +1967,14 @@ reprotect_and_return_err:
     if (r < 0)
       return r;
 
+    RWLock::RLocker owner_locker(ictx->owner_lock);
+    r = ictx->exclusive_lock.require_lock();
+    if (r < 0)
+      return r;
+    r = ictx->object_map.check_writable();
+    if (r < 0)
+      return r;
+
     RWLock::WLocker l(ictx->md_lock);
     snap_t snap_id;
     uint64_t new_size;
@@ -1831,12 +2009,26 @@ reprotect_and_return_err:
       return r;
     }
 
+    // any object may be brought back, or changed
+    r = ictx->object_map.update(0, ictx->get_num_objects(), true);
+    if (r < 0)
+      return r;
+    r = ictx->object_map.mark_changed(0, ictx->get_num_objects());
+    if (r < 0)
+      return r;
+
     r = rollback_image(ictx, snap_id, prog_ctx);
+    // objects that did not exist in the snapshot were removed
+    ictx->exclusive_lock.forget_objects();
     if (r < 0) {
       lderr(cct) << "Error rolling back image: " << cpp_strerror(-r) << dendl;
       return r;
     }
 
+    r = ictx->object_map.rollback(snap_id);
+    if (r < 0)
+      return r;
+
     notify_change(ictx->md_ctx, ictx->header_oid, NULL, ictx);
 
     ictx->perfcounter->inc(l_librbd_snap_rollback);
@@ -1864,6 +2056,9 @@ reprotect_and_return_err:
     return ret;
   }
 
+  static int copy_data(ImageCtx *src, ImageCtx *dest, bool sparse,
+		       ProgressContext &prog_ctx);
+
   int copy(ImageCtx *src, IoCtx& dest_md_ctx, const char *destname,
 	   ProgressContext &prog_ctx)
   {
@@ -1894,7 +2089,7 @@ reprotect_and_return_err:
       return r;
     }
 
-    r = copy(src, dest, prog_ctx);
+    r = copy_data(src, dest, true, prog_ctx);
     close_image(dest);
     return r;
   }
@@ -1915,8 +2110,9 @@ reprotect_and_return_err:
   class C_CopyRead : public Context {
   public:
     C_CopyRead(SimpleThrottle *throttle, ImageCtx *dest, uint64_t offset,
-	       bufferlist *bl)
-      : m_throttle(throttle), m_dest(dest), m_offset(offset), m_bl(bl) {
+	       bufferlist *bl, bool sparse)
+      : m_throttle(throttle), m_dest(dest), m_offset(offset), m_bl(bl),
+	m_sparse(sparse) {
       m_throttle->start_op();
     }
     virtual void finish(int r) {
@@ -1928,9 +2124,15 @@ reprotect_and_return_err:
 	return;
       }
       assert(m_bl->length() == (size_t)r);
+      if (m_sparse && m_bl->is_zero()) {
+	// the destination reads as zeros already
+	delete m_bl;
+	m_throttle->end_op(0);
+	return;
+      }
       Context *ctx = new C_CopyWrite(m_throttle, m_bl);
       AioCompletion *comp = aio_create_completion_internal(ctx, rbd_ctx_cb);
-      r = aio_write(m_dest, m_offset, m_bl->length(), m_bl->c_str(), comp);
+      r = aio_write(m_dest, m_offset, m_bl->length(), *m_bl, comp);
       if (r < 0) {
 	ctx->complete(r);
 	comp->release();
@@ -1943,9 +2145,21 @@ reprotect_and_return_err:
     ImageCtx *m_dest;
     uint64_t m_offset;
     bufferlist *m_bl;
+    bool m_sparse;	///< skip writing zeros
   };
 
   int copy(ImageCtx *src, ImageCtx *dest, ProgressContext &prog_ctx)
+  {
+    return copy_data(src, dest, false, prog_ctx);
+  }
+
+  /**
+   * Copy an image's data a stripe period at a time, with
+   * rbd_concurrent_management_ops reads and writes in flight.  A new
+   * destination is left sparse where the source reads as zeros.
+   */
+  static int copy_data(ImageCtx *src, ImageCtx *dest, bool sparse,
+		       ProgressContext &prog_ctx)
   {
     src->md_lock.get_read();
     src->snap_lock.get_read();
@@ -1971,7 +2185,7 @@ reprotect_and_return_err:
     for (uint64_t offset = 0; offset < src_size; offset += period) {
       uint64_t len = min(period, src_size - offset);
       bufferlist *bl = new bufferlist();
-      Context *ctx = new C_CopyRead(&throttle, dest, offset, bl);
+      Context *ctx = new C_CopyRead(&throttle, dest, offset, bl, sparse);
       AioCompletion *comp = aio_create_completion_internal(ctx, rbd_ctx_cb);
       r = aio_read(src, offset, len, NULL, bl, comp);
       if (r < 0) {
@@ -2008,6 +2222,7 @@ reprotect_and_return_err:
     if (r < 0) {
       return r;
     }
+    ictx->object_map.refresh();
     refresh_parent(ictx);
     return 0;
   }
@@ -2025,6 +2240,8 @@ reprotect_and_return_err:
       RWLock::WLocker l(ictx->md_lock);
       ictx->flush_cache();
     }
+    if (ictx->write_log)
+      ictx->write_log->writeback();
     return _snap_set(ictx, snap_name);
   }
 
@@ -2054,9 +2271,42 @@ reprotect_and_return_err:
     if (r < 0)
       goto err_close;
 
+    if (ictx->exclusive_lock.is_required()) {
+      r = ictx->exclusive_lock.try_lock();
+      if (r < 0)
+	goto err_close;
+      // again, to see our own lock
+      ictx->md_lock.get_write();
+      r = ictx_refresh(ictx);
+      ictx->md_lock.put_write();
+      if (r < 0)
+	goto err_close;
+    }
+
     if ((r = _snap_set(ictx, ictx->snap_name.c_str())) < 0)
       goto err_close;
 
+    if (WriteLog::is_wanted(*ictx)) {
+      WriteLog *log = new WriteLog(*ictx);
+      r = log->init();
+      if (r == -EBUSY) {
+	ldout(ictx->cct, 1) << "the image's write log is in use by another "
+			    << "client; not caching writes locally" << dendl;
+	delete log;
+      } else if (r < 0) {
+	delete log;
+	goto err_close;
+      } else {
+	// the log caches writes in place of the ObjectCacher
+	if (ictx->object_cacher) {
+	  ictx->shutdown_cache();
+	  delete ictx->object_cacher;
+	  ictx->object_cacher = NULL;
+	}
+	ictx->write_log = log;
+      }
+    }
+
     return 0;
 
   err_close:
@@ -2067,6 +2317,15 @@ reprotect_and_return_err:
   void close_image(ImageCtx *ictx)
   {
     ldout(ictx->cct, 20) << "close_image " << ictx << dendl;
+    if (ictx->write_log) {
+      int r = ictx->write_log->shutdown();
+      if (r < 0)
+	lderr(ictx->cct) << "error writing back the write log; it will be "
+			 << "written back when the image is opened here again: "
+			 << cpp_strerror(r) << dendl;
+      delete ictx->write_log;
+      ictx->write_log = NULL;
+    }
     if (ictx->object_cacher)
       ictx->shutdown_cache(); // implicitly flushes
     else
@@ -2080,9 +2339,36 @@ reprotect_and_return_err:
     if (ictx->wctx)
       ictx->unregister_watch();
 
+    ictx->exclusive_lock.shutdown();
     delete ictx;
   }
 
+  /**
+   * Whether any of the parent's objects under these extents of it may
+   * exist, by its object map
+   */
+  static bool parent_may_exist(ImageCtx *ictx,
+			       const vector<pair<uint64_t,uint64_t> >& image_extents)
+  {
+    RWLock::RLocker l(ictx->parent_lock);
+    ImageCtx *parent = ictx->parent;
+    if (!parent || !parent->object_map.enabled())
+      return true;
+    for (vector<pair<uint64_t,uint64_t> >::const_iterator p =
+	   image_extents.begin(); p != image_extents.end(); ++p) {
+      vector<ObjectExtent> extents;
+      Striper::file_to_extents(ictx->cct, parent->format_string,
+			       &parent->layout, p->first, p->second, 0,
+			       extents);
+      for (vector<ObjectExtent>::iterator q = extents.begin();
+	   q != extents.end(); ++q) {
+	if (parent->object_map.object_may_exist(q->objectno))
+	  return true;
+      }
+    }
+    return false;
+  }
+
   // 'flatten' child image by copying all parent's blocks
   int flatten(ImageCtx *ictx, ProgressContext &prog_ctx)
   {
@@ -2099,6 +2385,11 @@ reprotect_and_return_err:
       return r;
     }
 
+    RWLock::RLocker owner_locker(ictx->owner_lock);
+    if ((r = ictx->exclusive_lock.require_lock()) < 0 ||
+	(r = ictx->object_map.check_writable()) < 0)
+      return r;
+
     uint64_t object_size;
     uint64_t period;
     uint64_t overlap;
@@ -2153,6 +2444,19 @@ reprotect_and_return_err:
       uint64_t object_overlap = ictx->prune_parent_extents(objectx, overlap);
       assert(object_overlap <= object_size);
 
+      // nothing to copy if the parent has none of it, or we have
+      // written to the object already
+      if (!parent_may_exist(ictx, objectx) ||
+	  ictx->exclusive_lock.object_known_to_exist(ono)) {
+	prog_ctx.update_progress(ono, overlap_objects);
+	continue;
+      }
+      if (!ictx->object_map.object_may_exist(ono)) {
+	r = ictx->object_map.update(ono, ono + 1, true);
+	if (r < 0)
+	  goto err;
+      }
+
       bufferlist bl;
       string oid = ictx->get_object_name(ono);
       Context *comp = new C_SimpleThrottle(&throttle);
@@ -2317,6 +2621,14 @@ reprotect_and_return_err:
     comp->release();
   }
 
+  /// a period being read by read_iterate
+  struct IterateRead {
+    uint64_t len;
+    bufferlist bl;
+    bool done;
+    int ret;
+  };
+
   int64_t read_iterate(ImageCtx *ictx, uint64_t off, uint64_t len,
 		       int (*cb)(uint64_t, size_t, const char *, void *),
 		       void *arg)
@@ -2338,44 +2650,68 @@ reprotect_and_return_err:
     int64_t total_read = 0;
     uint64_t period = ictx->get_stripe_period();
     uint64_t left = mylen;
+    // read several periods ahead of the callback, which still sees
+    // them in order
+    int max_reads = MAX(1, ictx->cct->_conf->rbd_concurrent_management_ops);
+    std::list<IterateRead*> reads;
+    Mutex mylock("librbd::read_iterate::mylock");
+    Cond cond;
 
     start_time = ceph_clock_now(ictx->cct);
-    while (left > 0) {
-      uint64_t period_off = off - (off % period);
-      uint64_t read_len = min(period_off + period - off, left);
-
-      bufferlist bl;
-
-      Mutex mylock("IoCtxImpl::write::mylock");
-      Cond cond;
-      bool done;
-      int ret;
-
-      Context *ctx = new C_SafeCond(&mylock, &cond, &done, &ret);
-      AioCompletion *c = aio_create_completion_internal(ctx, rbd_ctx_cb);
-      r = aio_read(ictx, off, read_len, NULL, &bl, c);
-      if (r < 0) {
-	c->release();
-	delete ctx;
-	return r;
+    while (r >= 0 && (left > 0 || !reads.empty())) {
+      while (left > 0 && (int)reads.size() < max_reads) {
+	uint64_t period_off = off - (off % period);
+	uint64_t read_len = min(period_off + period - off, left);
+
+	IterateRead *rd = new IterateRead;
+	rd->len = read_len;
+	rd->done = false;
+	rd->ret = 0;
+	Context *ctx = new C_SafeCond(&mylock, &cond, &rd->done, &rd->ret);
+	AioCompletion *c = aio_create_completion_internal(ctx, rbd_ctx_cb);
+	r = aio_read(ictx, off, read_len, NULL, &rd->bl, c);
+	if (r < 0) {
+	  c->release();
+	  delete ctx;
+	  delete rd;
+	  break;
+	}
+	reads.push_back(rd);
+	left -= read_len;
+	off += read_len;
       }
+      if (reads.empty())
+	break;
 
+      IterateRead *rd = reads.front();
       mylock.Lock();
-      while (!done)
+      while (!rd->done)
 	cond.Wait(mylock);
       mylock.Unlock();
+      reads.pop_front();
+
+      if (r >= 0 && rd->ret < 0)
+	r = rd->ret;
+      if (r >= 0) {
+	// a period of zeros is reported as a hole
+	const char *buf = rd->bl.is_zero() ? NULL : rd->bl.c_str();
+	r = cb(total_read, rd->ret, buf, arg);
+	total_read += rd->ret;
+      }
+      delete rd;
+    }
 
-      if (ret < 0)
-	return ret;
-
-      r = cb(total_read, ret, bl.c_str(), arg);
-      if (r < 0)
-	return r;
-
-      total_read += ret;
-      left -= ret;
-      off += ret;
+    // don't leave reads behind that use our lock
+    for (std::list<IterateRead*>::iterator it = reads.begin();
+	 it != reads.end(); ++it) {
+      mylock.Lock();
+      while (!(*it)->done)
+	cond.Wait(mylock);
+      mylock.Unlock();
+      delete *it;
     }
+    if (r < 0)
+      return r;
 
     elapsed = ceph_clock_now(ictx->cct) - start_time;
     ictx->perfcounter->tinc(l_librbd_rd_latency, elapsed);
@@ -2396,8 +2732,40 @@ reprotect_and_return_err:
   }
 
 
+  /**
+   * Load the union of the diff maps of the snapshots after from_snap_id
+   * up to end_snap_id, and of the head if that is the end; -ENOENT if
+   * one of them has none.
+   */
+  static int load_diff_maps(ImageCtx *ictx, const vector<snap_t>& snaps,
+			    snap_t from_snap_id, snap_t end_snap_id,
+			    vector<uint8_t> *diff_map)
+  {
+    vector<snap_t> ids;
+    for (vector<snap_t>::const_iterator it = snaps.begin();
+	 it != snaps.end(); ++it) {
+      if (*it > from_snap_id && *it <= end_snap_id)
+	ids.push_back(*it);
+    }
+    if (end_snap_id == CEPH_NOSNAP)
+      ids.push_back(CEPH_NOSNAP);
+
+    diff_map->clear();
+    for (vector<snap_t>::iterator it = ids.begin(); it != ids.end(); ++it) {
+      vector<uint8_t> m;
+      int r = ObjectMap::load_diff(ictx->md_ctx, ictx->id, *it, &m);
+      if (r < 0)
+	return r;
+      if (diff_map->size() < m.size())
+	diff_map->resize(m.size(), 0);
+      for (size_t i = 0; i < m.size(); ++i)
+	(*diff_map)[i] |= m[i];
+    }
+    return 0;
+  }
+
   int diff_iterate(ImageCtx *ictx, const char *fromsnapname,
-		   uint64_t off, uint64_t len,
+		   uint64_t off, uint64_t len, bool whole_object,
 		   int (*cb)(uint64_t, size_t, int, void *),
 		   void *arg)
   {
@@ -2430,6 +2798,7 @@ reprotect_and_return_err:
     }
     snap_t end_snap_id = ictx->snap_id;
     uint64_t end_size = ictx->get_image_size(end_snap_id);
+    vector<snap_t> snaps = ictx->snaps;
     ictx->snap_lock.put_read();
     ictx->md_lock.put_read();
     if (from_snap_id == CEPH_NOSNAP) {
@@ -2461,13 +2830,45 @@ reprotect_and_return_err:
       r = 0;
       if (ictx->parent && overlap > 0) {
 	ldout(ictx->cct, 10) << " first getting parent diff" << dendl;
-	r = diff_iterate(ictx->parent, NULL, 0, overlap, simple_diff_cb, &parent_diff);
+	r = diff_iterate(ictx->parent, NULL, 0, overlap, false,
+			 simple_diff_cb, &parent_diff);
       }
       ictx->parent_lock.put_read();
       if (r < 0)
 	return r;
     }
 
+    // objects absent from both ends by the object maps have no diff,
+    // and with fast diff, neither have those no diff map since the
+    // start has
+    bool use_end_map = false, use_from_map = false, use_diff_map = false;
+    vector<uint8_t> end_map, from_map, diff_map;
+    if (ictx->features & RBD_FEATURE_OBJECT_MAP) {
+      r = ObjectMap::load(ictx->md_ctx, ictx->id, end_snap_id, &end_map);
+      if (r < 0 && r != -ENOENT)
+	return r;
+      use_end_map = (r == 0);
+    }
+    if (use_end_map && from_snap_id != 0) {
+      r = ObjectMap::load(ictx->md_ctx, ictx->id, from_snap_id, &from_map);
+      if (r < 0 && r != -ENOENT)
+	return r;
+      use_from_map = (r == 0);
+    }
+    if ((ictx->features & RBD_FEATURE_FAST_DIFF) && from_snap_id != 0) {
+      r = load_diff_maps(ictx, snaps, from_snap_id, end_snap_id, &diff_map);
+      if (r < 0 && r != -ENOENT)
+	return r;
+      use_diff_map = (r == 0);
+    }
+    ldout(ictx->cct, 10) << "diff_iterate using"
+			 << (use_end_map ? " end map" : "")
+			 << (use_from_map ? " from map" : "")
+			 << (use_diff_map ? " diff map" : "") << dendl;
+    // with whole_object, changed objects can be reported from the maps
+    bool report_whole = whole_object &&
+      (use_diff_map || (from_snap_id == 0 && use_end_map));
+
     uint64_t period = ictx->get_stripe_period();
     uint64_t left = len;
 
@@ -2487,7 +2888,29 @@ reprotect_and_return_err:
 	ldout(ictx->cct, 20) << "diff_iterate object " << p->first << dendl;
 
 	librados::snap_set_t snap_set;
-	int r = head_ctx.list_snaps(p->first.name, &snap_set);
+	uint64_t objectno = p->second.front().objectno;
+	bool end_may_exist = !use_end_map ||
+	  ObjectMap::test(end_map, objectno);
+	int r;
+	if (!end_may_exist &&
+	    (from_snap_id == 0 ||
+	     (use_from_map && !ObjectMap::test(from_map, objectno)))) {
+	  r = -ENOENT;
+	} else if (use_diff_map && !ObjectMap::test(diff_map, objectno)) {
+	  continue;
+	} else if (report_whole) {
+	  for (vector<ObjectExtent>::iterator q = p->second.begin();
+	       q != p->second.end(); ++q) {
+	    for (vector<pair<uint64_t,uint64_t> >::iterator e =
+		   q->buffer_extents.begin();
+		 e != q->buffer_extents.end(); ++e) {
+	      cb(off + e->first, e->second, end_may_exist, arg);
+	    }
+	  }
+	  continue;
+	} else {
+	  r = head_ctx.list_snaps(p->first.name, &snap_set);
+	}
 	if (r == -ENOENT) {
 	  if (from_snap_id == 0 && !parent_diff.empty()) {
 	    // report parent diff instead
@@ -2620,9 +3043,13 @@ reprotect_and_return_err:
     if (r < 0)
       return r;
 
+    // buf outlives the write, as we wait for it
+    bufferlist bl;
+    bl.push_back(buffer::create_static(mylen, const_cast<char *>(buf)));
+
     Context *ctx = new C_SafeCond(&mylock, &cond, &done, &ret);
     AioCompletion *c = aio_create_completion_internal(ctx, rbd_ctx_cb);
-    r = aio_write(ictx, off, mylen, buf, c);
+    r = aio_write(ictx, off, mylen, bl, c);
     if (r < 0) {
       c->release();
       delete ctx;
@@ -2796,7 +3223,9 @@ reprotect_and_return_err:
     c->add_request();
     c->init_time(ictx, AIO_TYPE_FLUSH);
     C_AioWrite *req_comp = new C_AioWrite(cct, c);
-    if (ictx->object_cacher) {
+    if (ictx->write_log) {
+      ictx->write_log->flush(req_comp);
+    } else if (ictx->object_cacher) {
       ictx->flush_cache_aio(req_comp);
     } else {
       librados::AioCompletion *rados_completion =
@@ -2821,7 +3250,19 @@ reprotect_and_return_err:
       return r;
 
     ictx->user_flushed();
-    r = _flush(ictx);
+    if (ictx->write_log) {
+      // safe in the log is enough
+      Mutex mylock("librbd::flush::mylock");
+      Cond cond;
+      bool done = false;
+      ictx->write_log->flush(new C_SafeCond(&mylock, &cond, &done, &r));
+      mylock.Lock();
+      while (!done)
+	cond.Wait(mylock);
+      mylock.Unlock();
+    } else {
+      r = _flush(ictx);
+    }
     ictx->perfcounter->inc(l_librbd_flush);
     return r;
   }
@@ -2831,7 +3272,9 @@ reprotect_and_return_err:
     CephContext *cct = ictx->cct;
     int r;
     // flush any outstanding writes
-    if (ictx->object_cacher) {
+    if (ictx->write_log) {
+      r = ictx->write_log->writeback();
+    } else if (ictx->object_cacher) {
       r = ictx->flush_cache();
     } else {
       r = ictx->data_ctx.aio_flush();
@@ -2843,59 +3286,34 @@ reprotect_and_return_err:
     return r;
   }
 
-  int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf,
-		AioCompletion *c)
+  /**
+   * Send a write of the image to its objects, through the cache if
+   * there is one, as of snapc and the parent overlap of the head.
+   */
+  static int send_write(ImageCtx *ictx, vector<ObjectExtent> &extents,
+			const bufferlist &data, const ::SnapContext &snapc,
+			uint64_t overlap, AioCompletion *c)
   {
     CephContext *cct = ictx->cct;
-    ldout(cct, 20) << "aio_write " << ictx << " off = " << off << " len = "
-		   << len << " buf = " << (void*)buf << dendl;
-
-    if (!len)
-      return 0;
-
-    int r = ictx_check(ictx);
-    if (r < 0)
-      return r;
-
-    uint64_t mylen = len;
-    r = clip_io(ictx, off, &mylen);
-    if (r < 0)
-      return r;
-
-    ictx->snap_lock.get_read();
-    snapid_t snap_id = ictx->snap_id;
-    ::SnapContext snapc = ictx->snapc;
-    ictx->parent_lock.get_read();
-    uint64_t overlap = 0;
-    ictx->get_parent_overlap(ictx->snap_id, &overlap);
-    ictx->parent_lock.put_read();
-    ictx->snap_lock.put_read();
-
-    if (snap_id != CEPH_NOSNAP || ictx->read_only)
-      return -EROFS;
-
-    ldout(cct, 20) << "  parent overlap " << overlap << dendl;
-
-    // map
-    vector<ObjectExtent> extents;
-    Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout, off, mylen, 0, extents);
-
-    c->get();
-    c->init_time(ictx, AIO_TYPE_WRITE);
+    int r;
     for (vector<ObjectExtent>::iterator p = extents.begin(); p != extents.end(); ++p) {
       ldout(cct, 20) << " oid " << p->oid << " " << p->offset << "~" << p->length
 		     << " from " << p->buffer_extents << dendl;
 
-      // assemble extent
+      // assemble extent, referencing the data rather than copying it
       bufferlist bl;
       for (vector<pair<uint64_t,uint64_t> >::iterator q = p->buffer_extents.begin();
 	   q != p->buffer_extents.end();
 	   ++q) {
-	bl.append(buf + q->first, q->second);
+	bufferlist sub;
+	sub.substr_of(data, q->first, q->second);
+	bl.claim_append(sub);
       }
 
       C_AioWrite *req_comp = new C_AioWrite(cct, c);
       if (ictx->object_cacher) {
+	// the cache keeps the data after the write completes
+	bl.rebuild();
 	c->add_request();
 	ictx->write_to_cache(p->oid, bl, p->length, p->offset, req_comp);
       } else {
@@ -2908,42 +3326,73 @@ reprotect_and_return_err:
 
 	AioWrite *req = new AioWrite(ictx, p->oid.name, p->objectno, p->offset,
 				     objectx, object_overlap,
-				     bl, snapc, snap_id, req_comp);
+				     bl, snapc, CEPH_NOSNAP, req_comp);
 	c->add_request();
 	r = req->send();
 	if (r < 0)
-	  goto done;
+	  return r;
       }
     }
-  done:
-    c->finish_adding_requests(ictx->cct);
-    c->put();
+    return 0;
+  }
 
-    ictx->perfcounter->inc(l_librbd_aio_wr);
-    ictx->perfcounter->inc(l_librbd_aio_wr_bytes, mylen);
+  int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf,
+		AioCompletion *c)
+  {
+    // buf may be gone once we return; the cache and the write log are
+    // done with it by then, but writes sent to the objects are not
+    bufferlist bl;
+    if (ictx->object_cacher || ictx->write_log)
+      bl.push_back(buffer::create_static(len, const_cast<char *>(buf)));
+    else
+      bl.append(buf, len);
+    return aio_write(ictx, off, len, bl, c);
+  }
 
-    /* FIXME: cleanup all the allocated stuff */
-    return r;
+  int aio_writev(ImageCtx *ictx, uint64_t off, const struct iovec *iov,
+		 int iovcnt, AioCompletion *c)
+  {
+    if (iovcnt < 0)
+      return -EINVAL;
+    bufferlist bl;
+    for (int i = 0; i < iovcnt; ++i) {
+      if (iov[i].iov_len)
+	bl.push_back(buffer::create_static(iov[i].iov_len,
+					   (char *)iov[i].iov_base));
+    }
+    return aio_write(ictx, off, bl.length(), bl, c);
   }
 
-  int aio_discard(ImageCtx *ictx, uint64_t off, uint64_t len, AioCompletion *c)
+  int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const bufferlist &bl,
+		AioCompletion *c)
   {
     CephContext *cct = ictx->cct;
-    ldout(cct, 20) << "aio_discard " << ictx << " off = " << off << " len = "
+    ldout(cct, 20) << "aio_write " << ictx << " off = " << off << " len = "
 		   << len << dendl;
 
     if (!len)
       return 0;
+    if (bl.length() < len)
+      return -EINVAL;
 
     int r = ictx_check(ictx);
     if (r < 0)
       return r;
 
-    r = clip_io(ictx, off, &len);
+    RWLock::RLocker owner_locker(ictx->owner_lock);
+    r = ictx->exclusive_lock.require_lock();
     if (r < 0)
       return r;
 
-    // TODO: check for snap
+    uint64_t mylen = len;
+    r = clip_io(ictx, off, &mylen);
+    if (r < 0)
+      return r;
+
+    // map
+    vector<ObjectExtent> extents;
+    Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout, off, mylen, 0, extents);
+
     ictx->snap_lock.get_read();
     snapid_t snap_id = ictx->snap_id;
     ::SnapContext snapc = ictx->snapc;
@@ -2951,52 +3400,202 @@ reprotect_and_return_err:
     uint64_t overlap = 0;
     ictx->get_parent_overlap(ictx->snap_id, &overlap);
     ictx->parent_lock.put_read();
+    // under snap_lock, so that the maps are marked before any
+    // snapshot the write will come after is given them
+    if (snap_id == CEPH_NOSNAP && !ictx->read_only)
+      r = ictx->object_map.mark_may_exist(extents);
     ictx->snap_lock.put_read();
 
     if (snap_id != CEPH_NOSNAP || ictx->read_only)
       return -EROFS;
+    if (r < 0)
+      return r;
+
+    ldout(cct, 20) << "  parent overlap " << overlap << dendl;
+
+    c->get();
+    c->init_time(ictx, AIO_TYPE_WRITE);
+    if (ictx->write_log) {
+      c->add_request();
+      ictx->write_log->append(off, mylen, bl, snapc, new C_AioWrite(cct, c));
+    } else {
+      r = send_write(ictx, extents, bl, snapc, overlap, c);
+    }
+    c->finish_adding_requests(ictx->cct);
+    c->put();
+
+    ictx->perfcounter->inc(l_librbd_aio_wr);
+    ictx->perfcounter->inc(l_librbd_aio_wr_bytes, mylen);
+
+    /* FIXME: cleanup all the allocated stuff */
+    return r;
+  }
+
+  void aio_write_back(ImageCtx *ictx, uint64_t off, bufferlist &bl,
+		      const ::SnapContext &snapc, AioCompletion *c)
+  {
+    CephContext *cct = ictx->cct;
+    ldout(cct, 20) << "aio_write_back " << ictx << " off = " << off
+		   << " len = " << bl.length() << dendl;
 
-    // map
     vector<ObjectExtent> extents;
-    Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout, off, len, 0, extents);
+    Striper::file_to_extents(cct, ictx->format_string, &ictx->layout, off,
+			     bl.length(), 0, extents);
+    uint64_t overlap = 0;
+    {
+      RWLock::RLocker l(ictx->snap_lock);
+      RWLock::RLocker l2(ictx->parent_lock);
+      ictx->get_parent_overlap(CEPH_NOSNAP, &overlap);
+    }
 
     c->get();
-    c->init_time(ictx, AIO_TYPE_DISCARD);
+    c->init_time(ictx, AIO_TYPE_WRITE);
+    int r = send_write(ictx, extents, bl, snapc, overlap, c);
+    if (r < 0) {
+      c->add_request();
+      c->complete_request(cct, r);
+    }
+    c->finish_adding_requests(cct);
+    c->put();
+  }
+
+  /**
+   * Mark the objects a discard will change in the object map, which
+   * are those that may exist and those that must be created to hide
+   * the parent's data.  Call with snap_lock held.
+   */
+  static int mark_discarded(ImageCtx *ictx, const vector<ObjectExtent>& extents,
+			    uint64_t overlap)
+  {
+    int r = ictx->object_map.check_writable();
+    if (r < 0)
+      return r;
+
+    vector<ObjectExtent> created, changed;
+    for (vector<ObjectExtent>::const_iterator p = extents.begin();
+	 p != extents.end(); ++p) {
+      if (ictx->object_map.object_may_exist(p->objectno)) {
+	changed.push_back(*p);
+	continue;
+      }
+      vector<pair<uint64_t,uint64_t> > objectx;
+      if (overlap) {
+	Striper::extent_to_file(ictx->cct, &ictx->layout,
+				p->objectno, 0, ictx->layout.fl_object_size,
+				objectx);
+	ictx->prune_parent_extents(objectx, overlap);
+      }
+      if (!objectx.empty())
+	created.push_back(*p);
+    }
+    r = ictx->object_map.mark_may_exist(created);
+    if (r < 0)
+      return r;
+    return ictx->object_map.mark_changed(changed);
+  }
+
+  /**
+   * Send a discard of the image to its objects, as of snapc and the
+   * parent overlap of the head, if the discard may overlap the parent.
+   */
+  static int send_discard(ImageCtx *ictx, vector<ObjectExtent> &extents,
+			  const ::SnapContext &snapc, uint64_t overlap,
+			  AioCompletion *c)
+  {
+    CephContext *cct = ictx->cct;
     for (vector<ObjectExtent>::iterator p = extents.begin(); p != extents.end(); ++p) {
       ldout(cct, 20) << " oid " << p->oid << " " << p->offset << "~" << p->length
 		     << " from " << p->buffer_extents << dendl;
-      C_AioWrite *req_comp = new C_AioWrite(cct, c);
-      AbstractWrite *req;
-      c->add_request();
 
       // reverse map this object extent onto the parent
       vector<pair<uint64_t,uint64_t> > objectx;
       uint64_t object_overlap = 0;
-      if (off < overlap) {   // we might overlap...
+      if (overlap) {   // we might overlap...
 	Striper::extent_to_file(ictx->cct, &ictx->layout,
 			      p->objectno, 0, ictx->layout.fl_object_size,
 			      objectx);
 	object_overlap = ictx->prune_parent_extents(objectx, overlap);
       }
 
+      // nothing to discard
+      if (!ictx->object_map.object_may_exist(p->objectno))
+	continue;
+
+      C_AioWrite *req_comp = new C_AioWrite(cct, c);
+      AbstractWrite *req;
+      c->add_request();
+
       if (p->offset == 0 && p->length == ictx->layout.fl_object_size) {
 	req = new AioRemove(ictx, p->oid.name, p->objectno, objectx, object_overlap,
-			    snapc, snap_id, req_comp);
+			    snapc, CEPH_NOSNAP, req_comp);
       } else if (p->offset + p->length == ictx->layout.fl_object_size) {
 	req = new AioTruncate(ictx, p->oid.name, p->objectno, p->offset, objectx, object_overlap,
-			      snapc, snap_id, req_comp);
+			      snapc, CEPH_NOSNAP, req_comp);
       } else {
 	req = new AioZero(ictx, p->oid.name, p->objectno, p->offset, p->length,
 			  objectx, object_overlap,
-			  snapc, snap_id, req_comp);
+			  snapc, CEPH_NOSNAP, req_comp);
       }
 
-      r = req->send();
+      int r = req->send();
       if (r < 0)
-	goto done;
+	return r;
+    }
+    return 0;
+  }
+
+  int aio_discard(ImageCtx *ictx, uint64_t off, uint64_t len, AioCompletion *c)
+  {
+    CephContext *cct = ictx->cct;
+    ldout(cct, 20) << "aio_discard " << ictx << " off = " << off << " len = "
+		   << len << dendl;
+
+    if (!len)
+      return 0;
+
+    int r = ictx_check(ictx);
+    if (r < 0)
+      return r;
+
+    RWLock::RLocker owner_locker(ictx->owner_lock);
+    r = ictx->exclusive_lock.require_lock();
+    if (r < 0)
+      return r;
+
+    r = clip_io(ictx, off, &len);
+    if (r < 0)
+      return r;
+
+    // map
+    vector<ObjectExtent> extents;
+    Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout, off, len, 0, extents);
+
+    // TODO: check for snap
+    ictx->snap_lock.get_read();
+    snapid_t snap_id = ictx->snap_id;
+    ::SnapContext snapc = ictx->snapc;
+    ictx->parent_lock.get_read();
+    uint64_t overlap = 0;
+    ictx->get_parent_overlap(ictx->snap_id, &overlap);
+    ictx->parent_lock.put_read();
+    if (snap_id == CEPH_NOSNAP && !ictx->read_only)
+      r = mark_discarded(ictx, extents, off < overlap ? overlap : 0);
+    ictx->snap_lock.put_read();
+
+    if (snap_id != CEPH_NOSNAP || ictx->read_only)
+      return -EROFS;
+    if (r < 0)
+      return r;
+
+    c->get();
+    c->init_time(ictx, AIO_TYPE_DISCARD);
+    if (ictx->write_log) {
+      c->add_request();
+      ictx->write_log->append(off, len, bufferlist(), snapc,
+			      new C_AioWrite(cct, c));
+    } else {
+      r = send_discard(ictx, extents, snapc, off < overlap ? overlap : 0, c);
     }
-    r = 0;
-  done:
     if (ictx->object_cacher) {
       Mutex::Locker l(ictx->cache_lock);
       ictx->object_cacher->discard_set(ictx->object_set, extents);
@@ -3012,6 +3611,34 @@ reprotect_and_return_err:
     return r;
   }
 
+  void aio_discard_back(ImageCtx *ictx, uint64_t off, uint64_t len,
+			const ::SnapContext &snapc, AioCompletion *c)
+  {
+    CephContext *cct = ictx->cct;
+    ldout(cct, 20) << "aio_discard_back " << ictx << " off = " << off
+		   << " len = " << len << dendl;
+
+    vector<ObjectExtent> extents;
+    Striper::file_to_extents(cct, ictx->format_string, &ictx->layout, off,
+			     len, 0, extents);
+    uint64_t overlap = 0;
+    {
+      RWLock::RLocker l(ictx->snap_lock);
+      RWLock::RLocker l2(ictx->parent_lock);
+      ictx->get_parent_overlap(CEPH_NOSNAP, &overlap);
+    }
+
+    c->get();
+    c->init_time(ictx, AIO_TYPE_DISCARD);
+    int r = send_discard(ictx, extents, snapc, off < overlap ? overlap : 0, c);
+    if (r < 0) {
+      c->add_request();
+      c->complete_request(cct, r);
+    }
+    c->finish_adding_requests(cct);
+    c->put();
+  }
+
   void rbd_req_cb(completion_t cb, void *arg)
   {
     AioRequest *req = reinterpret_cast<AioRequest *>(arg);
@@ -3028,6 +3655,32 @@ reprotect_and_return_err:
     return aio_read(ictx, image_extents, buf, bl, c);
   }
 
+  int aio_readv(ImageCtx *ictx, uint64_t off, const struct iovec *iov,
+		int iovcnt, AioCompletion *c)
+  {
+    if (iovcnt < 0)
+      return -EINVAL;
+    uint64_t len = 0;
+    for (int i = 0; i < iovcnt; ++i)
+      len += iov[i].iov_len;
+    c->read_iov.assign(iov, iov + iovcnt);
+    vector<pair<uint64_t,uint64_t> > image_extents(1);
+    image_extents[0] = make_pair(off, len);
+    return aio_read(ictx, image_extents, NULL, NULL, c);
+  }
+
+  /// whether all of these extents of a read are covered by the write log
+  static bool extents_logged(const interval_set<uint64_t> &logged,
+			     const vector<pair<uint64_t,uint64_t> > &extents)
+  {
+    for (vector<pair<uint64_t,uint64_t> >::const_iterator p = extents.begin();
+	 p != extents.end(); ++p) {
+      if (!logged.contains(p->first, p->second))
+	return false;
+    }
+    return true;
+  }
+
   int aio_read(ImageCtx *ictx, const vector<pair<uint64_t,uint64_t> >& image_extents,
 	       char *buf, bufferlist *pbl, AioCompletion *c)
   {
@@ -3043,6 +3696,7 @@ reprotect_and_return_err:
 
     // map
     map<object_t,vector<ObjectExtent> > object_extents;
+    vector<pair<uint64_t,uint64_t> > clipped_extents;
 
     uint64_t buffer_ofs = 0;
     for (vector<pair<uint64_t,uint64_t> >::const_iterator p = image_extents.begin();
@@ -3052,6 +3706,7 @@ reprotect_and_return_err:
       r = clip_io(ictx, p->first, &len);
       if (r < 0)
 	return r;
+      clipped_extents.push_back(make_pair(p->first, len));
 
       Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout,
 			       p->first, len, 0, object_extents, buffer_ofs);
@@ -3060,9 +3715,33 @@ reprotect_and_return_err:
 
     int64_t ret;
 
-    c->read_buf = buf;
-    c->read_buf_len = buffer_ofs;
+    if (buf) {
+      struct iovec iov = { buf, buffer_ofs };
+      c->read_iov.assign(1, iov);
+    }
     c->read_bl = pbl;
+    // the cache has its own copy of what it reads
+    bool in_place = !c->read_iov.empty() && !ictx->object_cacher;
+
+    // the write log has the newest data of the head where it has any
+    interval_set<uint64_t> logged;
+    if (ictx->write_log && snap_id == CEPH_NOSNAP) {
+      uint64_t buffer_off = 0;
+      for (vector<pair<uint64_t,uint64_t> >::iterator p = clipped_extents.begin();
+	   p != clipped_extents.end(); ++p) {
+	map<uint64_t, bufferlist> data;
+	r = ictx->write_log->read(p->first, p->second, &data);
+	if (r < 0)
+	  return r;
+	for (map<uint64_t, bufferlist>::iterator q = data.begin();
+	     q != data.end(); ++q) {
+	  uint64_t off = buffer_off + q->first - p->first;
+	  logged.insert(off, q->second.length());
+	  c->read_overlay[off].claim(q->second);
+	}
+	buffer_off += p->second;
+      }
+    }
 
     c->get();
     c->init_time(ictx, AIO_TYPE_READ);
@@ -3071,15 +3750,32 @@ reprotect_and_return_err:
 	ldout(ictx->cct, 20) << " oid " << q->oid << " " << q->offset << "~" << q->length
 			     << " from " << q->buffer_extents << dendl;
 
+	if (!logged.empty() && extents_logged(logged, q->buffer_extents)) {
+	  bufferlist empty;
+	  c->lock.Lock();
+	  c->destriper.add_partial_result(ictx->cct, empty, q->buffer_extents);
+	  c->lock.Unlock();
+	  continue;
+	}
+
 	C_AioRead *req_comp = new C_AioRead(ictx->cct, c);
 	AioRead *req = new AioRead(ictx, q->oid.name, 
 				   q->objectno, q->offset, q->length,
 				   q->buffer_extents,
 				   snap_id, true, req_comp);
+	if (in_place && q->buffer_extents.size() == 1) {
+	  char *dest = c->get_read_dest(q->buffer_extents[0].first,
+					q->buffer_extents[0].second);
+	  if (dest)
+	    req->read_in_place(dest);
+	}
 	req_comp->set_req(req);
 	c->add_request();
 
-	if (ictx->object_cacher) {
+	if (!ictx->object_map.object_may_exist(q->objectno)) {
+	  // straight to the parent, if any, or zeros
+	  req->complete(-ENOENT);
+	} else if (ictx->object_cacher) {
 	  C_CacheRead *cache_comp = new C_CacheRead(req_comp, req);
 	  ictx->aio_read_from_cache(q->oid, &req->data(),
 				    q->length, q->offset,
@@ -3096,6 +3792,18 @@ reprotect_and_return_err:
       }
     }
     ret = buffer_ofs;
+
+    // read ahead behind the request, so that it goes out first
+    if (ictx->object_cacher) {
+      ictx->md_lock.get_read();
+      ictx->snap_lock.get_read();
+      uint64_t image_size = ictx->get_image_size(snap_id);
+      ictx->snap_lock.put_read();
+      ictx->md_lock.put_read();
+      for (vector<pair<uint64_t,uint64_t> >::iterator p = clipped_extents.begin();
+	   p != clipped_extents.end(); ++p)
+	ictx->readahead_to_cache(p->first, p->second, image_size);
+    }
   done:
     c->finish_adding_requests(ictx->cct);
     c->put();
@@ -10,6 +10,7 @@
 #include <string>
 #include <vector>
 
+#include "common/snap_types.h"
 #include "include/buffer.h"
 #include "include/rbd/librbd.hpp"
 #include "include/rbd_types.h"
@@ -47,6 +48,11 @@ enum {
   l_librbd_notify,
   l_librbd_resize,
 
+  l_librbd_readahead,
+  l_librbd_readahead_bytes,
+  l_librbd_readahead_hit_bytes,
+  l_librbd_readahead_wasted_bytes,
+
   l_librbd_last,
 };
 
@@ -170,7 +176,7 @@ namespace librbd {
 		       int (*cb)(uint64_t, size_t, const char *, void *),
 		       void *arg);
   int diff_iterate(ImageCtx *ictx, const char *fromsnapname,
-		   uint64_t off, uint64_t len,
+		   uint64_t off, uint64_t len, bool whole_object,
 		   int (*cb)(uint64_t, size_t, int, void *),
 		   void *arg);
   ssize_t read(ImageCtx *ictx, uint64_t off, size_t len, char *buf);
@@ -180,11 +186,24 @@ namespace librbd {
   int discard(ImageCtx *ictx, uint64_t off, uint64_t len);
   int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf,
 		AioCompletion *c);
+  /// write len bytes of bl, which is referenced rather than copied
+  int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const bufferlist &bl,
+		AioCompletion *c);
+  /// write from buffers that must stay valid until c completes
+  int aio_writev(ImageCtx *ictx, uint64_t off, const struct iovec *iov,
+		 int iovcnt, AioCompletion *c);
   int aio_discard(ImageCtx *ictx, uint64_t off, uint64_t len, AioCompletion *c);
+  /// write back a write or discard from the write log, as of its snapc
+  void aio_write_back(ImageCtx *ictx, uint64_t off, bufferlist &bl,
+		      const ::SnapContext &snapc, AioCompletion *c);
+  void aio_discard_back(ImageCtx *ictx, uint64_t off, uint64_t len,
+			const ::SnapContext &snapc, AioCompletion *c);
   int aio_read(ImageCtx *ictx, uint64_t off, size_t len,
 	       char *buf, bufferlist *pbl, AioCompletion *c);
   int aio_read(ImageCtx *ictx, const vector<pair<uint64_t,uint64_t> >& image_extents,
 	       char *buf, bufferlist *pbl, AioCompletion *c);
+  int aio_readv(ImageCtx *ictx, uint64_t off, const struct iovec *iov,
+		int iovcnt, AioCompletion *c);
   int aio_flush(ImageCtx *ictx, AioCompletion *c);
   int flush(ImageCtx *ictx);
   int _flush(ImageCtx *ictx);
@@ -460,7 +460,17 @@ namespace librbd {
 			  void *arg)
   {
     ImageCtx *ictx = (ImageCtx *)ctx;
-    return librbd::diff_iterate(ictx, fromsnapname, ofs, len, cb, arg);
+    return librbd::diff_iterate(ictx, fromsnapname, ofs, len, false, cb, arg);
+  }
+
+  int Image::diff_iterate2(const char *fromsnapname,
+			   uint64_t ofs, uint64_t len, bool whole_object,
+			   int (*cb)(uint64_t, size_t, int, void *),
+			   void *arg)
+  {
+    ImageCtx *ictx = (ImageCtx *)ctx;
+    return librbd::diff_iterate(ictx, fromsnapname, ofs, len, whole_object,
+				cb, arg);
   }
 
   ssize_t Image::write(uint64_t ofs, size_t len, bufferlist& bl)
@@ -483,7 +493,7 @@ namespace librbd {
     ImageCtx *ictx = (ImageCtx *)ctx;
     if (bl.length() < len)
       return -EINVAL;
-    return librbd::aio_write(ictx, off, len, bl.c_str(),
+    return librbd::aio_write(ictx, off, len, bl,
 			     (librbd::AioCompletion *)c->pc);
   }
 
@@ -1065,7 +1075,19 @@ extern "C" int rbd_diff_iterate(rbd_image_t image,
 				void *arg)
 {
   librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
-  return librbd::diff_iterate(ictx, fromsnapname, ofs, len, cb, arg);
+  return librbd::diff_iterate(ictx, fromsnapname, ofs, len, false, cb, arg);
+}
+
+extern "C" int rbd_diff_iterate2(rbd_image_t image,
+				 const char *fromsnapname,
+				 uint64_t ofs, uint64_t len,
+				 uint8_t whole_object,
+				 int (*cb)(uint64_t, size_t, int, void *),
+				 void *arg)
+{
+  librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
+  return librbd::diff_iterate(ictx, fromsnapname, ofs, len, whole_object,
+			      cb, arg);
 }
 
 extern "C" ssize_t rbd_write(rbd_image_t image, uint64_t ofs, size_t len,
@@ -1100,6 +1122,15 @@ extern "C" int rbd_aio_write(rbd_image_t image, uint64_t off, size_t len,
 			   (librbd::AioCompletion *)comp->pc);
 }
 
+extern "C" int rbd_aio_writev(rbd_image_t image, const struct iovec *iov,
+			      int iovcnt, uint64_t off, rbd_completion_t c)
+{
+  librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
+  librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
+  return librbd::aio_writev(ictx, off, iov, iovcnt,
+			    (librbd::AioCompletion *)comp->pc);
+}
+
 extern "C" int rbd_aio_discard(rbd_image_t image, uint64_t off, uint64_t len,
 			       rbd_completion_t c)
 {
@@ -1117,6 +1148,15 @@ extern "C" int rbd_aio_read(rbd_image_t image, uint64_t off, size_t len,
 			  (librbd::AioCompletion *)comp->pc);
 }
 
+extern "C" int rbd_aio_readv(rbd_image_t image, const struct iovec *iov,
+			     int iovcnt, uint64_t off, rbd_completion_t c)
+{
+  librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
+  librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
+  return librbd::aio_readv(ictx, off, iov, iovcnt,
+			   (librbd::AioCompletion *)comp->pc);
+}
+
 extern "C" int rbd_flush(rbd_image_t image)
 {
   librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
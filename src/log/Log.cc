@@ -14,10 +14,13 @@
 #include "common/Clock.h"
 #include "include/assert.h"
 
+#include <algorithm>
+
 #define DEFAULT_MAX_NEW    100
 #define DEFAULT_MAX_RECENT 10000
 
-#define PREALLOC 1000000
+/// flush buffered log file output once it grows past this
+#define MAX_LOG_BUF 65536
 
 namespace ceph {
 namespace log {
@@ -29,10 +32,69 @@ static void log_on_exit(int r, void *p)
     l->flush();
 }
 
+/**
+ * the new entries of one thread
+ *
+ * Only the owning thread pushes, and only the flusher (holding
+ * m_flush_mutex) pops, so head and tail each have a single writer.
+ */
+struct Log::ThreadQueue {
+  Log *log;
+  std::vector<Entry*> slots;
+  unsigned mask;
+  volatile unsigned head;  ///< next slot to pop, advanced by the flusher
+  volatile unsigned tail;  ///< next slot to push, advanced by the owner
+  bool exited;             ///< the owner is gone; protected by m_queue_mutex
+  ThreadQueue *next;
+
+  ThreadQueue(Log *l, unsigned size)
+    : log(l), slots(size), mask(size - 1), head(0), tail(0),
+      exited(false), next(NULL) {}
+  ~ThreadQueue() {
+    Entry *e;
+    while ((e = pop()) != NULL)
+      delete e;
+  }
+
+  unsigned length() const {
+    return tail - head;
+  }
+
+  bool push(Entry *e) {
+    unsigned t = tail;
+    if (t - head > mask)
+      return false;
+    slots[t & mask] = e;
+    // the slot must be visible before the tail that covers it
+    __sync_synchronize();
+    tail = t + 1;
+    return true;
+  }
+
+  Entry *pop() {
+    unsigned h = head;
+    if (h == tail)
+      return NULL;
+    __sync_synchronize();
+    Entry *e = slots[h & mask];
+    // and read before the owner may reuse it
+    __sync_synchronize();
+    head = h + 1;
+    return e;
+  }
+};
+
+static bool entry_stamp_lt(const Entry *a, const Entry *b)
+{
+  return a->m_stamp < b->m_stamp;
+}
+
 Log::Log(SubsystemMap *s)
   : m_indirect_this(NULL),
     m_subs(s),
-    m_new(), m_recent(),
+    m_queues(NULL),
+    m_flusher_idle(0),
+    m_recent(DEFAULT_MAX_RECENT),
     m_fd(-1),
     m_syslog_log(-2), m_syslog_crash(-2),
     m_stderr_log(1), m_stderr_crash(-1),
@@ -54,10 +116,8 @@ Log::Log(SubsystemMap *s)
   ret = pthread_cond_init(&m_cond_flusher, NULL);
   assert(ret == 0);
 
-  // kludge for prealloc testing
-  if (false)
-    for (int i=0; i < PREALLOC; i++)
-      m_recent.enqueue(new Entry);
+  ret = pthread_key_create(&m_queue_key, thread_queue_exit);
+  assert(ret == 0);
 }
 
 Log::~Log()
@@ -70,6 +130,14 @@ Log::~Log()
   if (m_fd >= 0)
     TEMP_FAILURE_RETRY(::close(m_fd));
 
+  // no thread exit will look at its queue once the key is gone
+  pthread_key_delete(m_queue_key);
+  while (m_queues) {
+    ThreadQueue *q = m_queues;
+    m_queues = q->next;
+    delete q;
+  }
+
   pthread_mutex_destroy(&m_queue_mutex);
   pthread_mutex_destroy(&m_flush_mutex);
   pthread_cond_destroy(&m_cond_loggers);
@@ -93,12 +161,16 @@ void Log::set_flush_on_exit()
 
 void Log::set_max_new(int n)
 {
+  // threads that already have a queue keep its size
   m_max_new = n;
 }
 
 void Log::set_max_recent(int n)
 {
+  pthread_mutex_lock(&m_flush_mutex);
   m_max_recent = n;
+  m_recent.set_max(n);
+  pthread_mutex_unlock(&m_flush_mutex);
 }
 
 void Log::set_log_file(string fn)
@@ -108,6 +180,8 @@ void Log::set_log_file(string fn)
 
 void Log::reopen_log_file()
 {
+  pthread_mutex_lock(&m_flush_mutex);
+  _write_out();
   if (m_fd >= 0)
     TEMP_FAILURE_RETRY(::close(m_fd));
   if (m_log_file.length()) {
@@ -115,6 +189,7 @@ void Log::reopen_log_file()
   } else {
     m_fd = -1;
   }
+  pthread_mutex_unlock(&m_flush_mutex);
 }
 
 void Log::set_syslog_level(int log, int crash)
@@ -133,103 +208,183 @@ void Log::set_stderr_level(int log, int crash)
   pthread_mutex_unlock(&m_flush_mutex);
 }
 
-void Log::submit_entry(Entry *e)
+Log::ThreadQueue *Log::get_thread_queue()
 {
-  pthread_mutex_lock(&m_queue_mutex);
+  ThreadQueue *q = (ThreadQueue *)pthread_getspecific(m_queue_key);
+  if (!q) {
+    unsigned size = 16;
+    while (size < (unsigned)m_max_new)
+      size <<= 1;
+    q = new ThreadQueue(this, size);
+    pthread_setspecific(m_queue_key, q);
+    pthread_mutex_lock(&m_queue_mutex);
+    q->next = m_queues;
+    m_queues = q;
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
+  return q;
+}
 
-  // wait for flush to catch up
-  while (m_new.m_len > m_max_new)
-    pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+void Log::thread_queue_exit(void *p)
+{
+  // the flusher frees it once it is drained
+  ThreadQueue *q = (ThreadQueue *)p;
+  pthread_mutex_lock(&q->log->m_queue_mutex);
+  q->exited = true;
+  pthread_mutex_unlock(&q->log->m_queue_mutex);
+}
 
-  m_new.enqueue(e);
-  pthread_cond_signal(&m_cond_flusher);
-  pthread_mutex_unlock(&m_queue_mutex);
+void Log::submit_entry(Entry *e)
+{
+  ThreadQueue *q = get_thread_queue();
+  if (!q->push(e)) {
+    pthread_mutex_lock(&m_queue_mutex);
+
+    // wait for flush to catch up
+    while (!q->push(e)) {
+      if (m_stop || !is_started()) {
+	// nobody else is going to drain it
+	pthread_mutex_unlock(&m_queue_mutex);
+	flush();
+	pthread_mutex_lock(&m_queue_mutex);
+	continue;
+      }
+      pthread_cond_signal(&m_cond_flusher);
+      pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+    }
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
+
+  // pairs with the barrier in entry(): either the log thread sees
+  // this entry before it goes idle, or we see that it went idle
+  __sync_synchronize();
+  if (m_flusher_idle) {
+    pthread_mutex_lock(&m_queue_mutex);
+    pthread_cond_signal(&m_cond_flusher);
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
 }
 
 Entry *Log::create_entry(int level, int subsys)
 {
-  if (true) {
-    return new Entry(ceph_clock_now(NULL),
+  return new Entry(ceph_clock_now(NULL),
 		   pthread_self(),
 		   level, subsys);
-  } else {
-    // kludge for perf testing
-    Entry *e = m_recent.dequeue();
-    e->m_stamp = ceph_clock_now(NULL);
-    e->m_thread = pthread_self();
-    e->m_prio = level;
-    e->m_subsys = subsys;
-    return e;
-  }
 }
 
-void Log::flush()
+bool Log::_have_new()
+{
+  for (ThreadQueue *q = m_queues; q; q = q->next)
+    if (q->length())
+      return true;
+  return false;
+}
+
+void Log::_drain(vector<Entry*> *batch)
 {
-  pthread_mutex_lock(&m_flush_mutex);
   pthread_mutex_lock(&m_queue_mutex);
-  EntryQueue t;
-  t.swap(m_new);
+  ThreadQueue **pq = &m_queues;
+  while (*pq) {
+    ThreadQueue *q = *pq;
+    Entry *e;
+    while ((e = q->pop()) != NULL)
+      batch->push_back(e);
+    if (q->exited) {
+      *pq = q->next;
+      delete q;
+    } else {
+      pq = &q->next;
+    }
+  }
   pthread_cond_broadcast(&m_cond_loggers);
   pthread_mutex_unlock(&m_queue_mutex);
-  _flush(&t, &m_recent, false);
 
-  // trim
-  while (m_recent.m_len > m_max_recent) {
-    delete m_recent.dequeue();
-  }
+  // each queue is in order, interleave the threads
+  std::stable_sort(batch->begin(), batch->end(), entry_stamp_lt);
+}
 
+void Log::flush()
+{
+  pthread_mutex_lock(&m_flush_mutex);
+  vector<Entry*> batch;
+  _drain(&batch);
+  _flush(batch);
   pthread_mutex_unlock(&m_flush_mutex);
 }
 
-void Log::_flush(EntryQueue *t, EntryQueue *requeue, bool crash)
+void Log::_flush(vector<Entry*> &batch)
 {
-  Entry *e;
+  string msg;
+  for (vector<Entry*>::iterator p = batch.begin(); p != batch.end(); ++p) {
+    Entry *e = *p;
+    if (m_subs->get_log_level(e->m_subsys) >= e->m_prio) {
+      RecentEntries::Header h;
+      h.sec = e->m_stamp.sec();
+      h.nsec = e->m_stamp.nsec();
+      h.thread = (uint64_t)e->m_thread;
+      h.prio = e->m_prio;
+      h.subsys = e->m_subsys;
+      msg.resize(e->m_streambuf.size());
+      h.len = msg.size() ? e->m_streambuf.copy_out(&msg[0], msg.size()) : 0;
+      _write_entry(h, msg.data(), false, 0);
+    }
+    m_recent.add(e);
+    delete e;
+  }
+  _write_out();
+}
+
+void Log::_write_entry(const RecentEntries::Header &h, const char *msg,
+		       bool crash, int remaining)
+{
+  bool do_fd = m_fd >= 0;
+  bool do_syslog = m_syslog_crash >= h.prio;
+  bool do_stderr = m_stderr_crash >= h.prio;
+  if (!do_fd && !do_syslog && !do_stderr)
+    return;
+
   char buf[80];
-  while ((e = t->dequeue()) != NULL) {
-    unsigned sub = e->m_subsys;
-
-    bool should_log = crash || m_subs->get_log_level(sub) >= e->m_prio;
-    bool do_fd = m_fd >= 0 && should_log;
-    bool do_syslog = m_syslog_crash >= e->m_prio && should_log;
-    bool do_stderr = m_stderr_crash >= e->m_prio && should_log;
-
-    if (do_fd || do_syslog || do_stderr) {
-      int buflen = 0;
-
-      if (crash)
-	buflen += snprintf(buf, sizeof(buf), "%6d> ", -t->m_len);
-      buflen += e->m_stamp.sprintf(buf + buflen, sizeof(buf)-buflen);
-      buflen += snprintf(buf + buflen, sizeof(buf)-buflen, " %lx %2d ",
-			(unsigned long)e->m_thread, e->m_prio);
-
-      // FIXME: this is slow
-      string s = e->get_str();
-
-      if (do_fd) {
-	int r = safe_write(m_fd, buf, buflen);
-	if (r >= 0)
-	  r = safe_write(m_fd, s.data(), s.size());
-	if (r >= 0)
-	  r = write(m_fd, "\n", 1);
-	if (r < 0)
-	  cerr << "problem writing to " << m_log_file << ": " << cpp_strerror(r) << std::endl;
-      }
+  int buflen = 0;
+  if (crash)
+    buflen += snprintf(buf, sizeof(buf), "%6d> ", -remaining);
+  buflen += utime_t(h.sec, h.nsec).sprintf(buf + buflen, sizeof(buf)-buflen);
+  buflen += snprintf(buf + buflen, sizeof(buf)-buflen, " %lx %2d ",
+		     (unsigned long)h.thread, h.prio);
+
+  if (do_fd) {
+    m_out.append(buf, buflen);
+    m_out.append(msg, h.len);
+    m_out.push_back('\n');
+    if (m_out.size() >= MAX_LOG_BUF)
+      _write_out();
+  }
 
-      if (do_syslog) {
-	syslog(LOG_USER, "%s%s", buf, s.c_str());
-      }
+  if (do_syslog) {
+    syslog(LOG_USER, "%s%.*s", buf, (int)h.len, msg);
+  }
 
-      if (do_stderr) {
-	cerr << buf << s << std::endl;
-      }
-    }
+  if (do_stderr) {
+    cerr.write(buf, buflen);
+    cerr.write(msg, h.len);
+    cerr << std::endl;
+  }
+}
 
-    requeue->enqueue(e);
+void Log::_write_out()
+{
+  if (m_out.empty())
+    return;
+  if (m_fd >= 0) {
+    int r = safe_write(m_fd, m_out.data(), m_out.size());
+    if (r < 0)
+      cerr << "problem writing to " << m_log_file << ": " << cpp_strerror(r) << std::endl;
   }
+  m_out.clear();
 }
 
 void Log::_log_message(const char *s, bool crash)
 {
+  _write_out();
   if (m_fd >= 0) {
     int r = safe_write(m_fd, s, strlen(s));
     if (r >= 0)
@@ -250,15 +405,16 @@ void Log::dump_recent()
 {
   pthread_mutex_lock(&m_flush_mutex);
 
-  pthread_mutex_lock(&m_queue_mutex);
-  EntryQueue t;
-  t.swap(m_new);
-  pthread_mutex_unlock(&m_queue_mutex);
-  _flush(&t, &m_recent, false);
+  vector<Entry*> batch;
+  _drain(&batch);
+  _flush(batch);
 
-  EntryQueue old;
   _log_message("--- begin dump of recent events ---", true);
-  _flush(&m_recent, &old, true);  
+  RecentEntries::Header h;
+  string msg;
+  while (m_recent.pop(&h, &msg))
+    _write_entry(h, msg.data(), true, m_recent.size());
+  _write_out();
 
   char buf[4096];
   _log_message("--- logging levels ---", true);
@@ -309,7 +465,11 @@ void *Log::entry()
 {
   pthread_mutex_lock(&m_queue_mutex);
   while (!m_stop) {
-    if (!m_new.empty()) {
+    // submitters only signal us while we are idle; see submit_entry()
+    m_flusher_idle = 1;
+    __sync_synchronize();
+    if (_have_new()) {
+      m_flusher_idle = 0;
       pthread_mutex_unlock(&m_queue_mutex);
       flush();
       pthread_mutex_lock(&m_queue_mutex);
@@ -318,6 +478,7 @@ void *Log::entry()
 
     pthread_cond_wait(&m_cond_flusher, &m_queue_mutex);
   }
+  m_flusher_idle = 0;
   pthread_mutex_unlock(&m_queue_mutex);
   flush();
   return NULL;
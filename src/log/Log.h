@@ -8,26 +8,44 @@
 
 #include <pthread.h>
 
+#include <vector>
+
 #include "Entry.h"
-#include "EntryQueue.h"
+#include "RecentEntries.h"
 #include "SubsystemMap.h"
 
 namespace ceph {
 namespace log {
 
+/**
+ * asynchronous log
+ *
+ * Each thread that submits entries gets its own single producer,
+ * single consumer ring of new entries, so submitting one takes no
+ * lock: the thread only waits when its ring is full.  The log thread
+ * drains all rings in one pass, writes the batch out in stamp order
+ * and packs the entries into the recent entry ring, which is only
+ * decoded when dumped.
+ */
 class Log : private Thread
 {
+  struct ThreadQueue;
+
   Log **m_indirect_this;
 
   SubsystemMap *m_subs;
   
-  pthread_mutex_t m_queue_mutex;
-  pthread_mutex_t m_flush_mutex;
+  pthread_mutex_t m_queue_mutex;  ///< protects m_queues, waits on full rings
+  pthread_mutex_t m_flush_mutex;  ///< serializes the consumers
   pthread_cond_t m_cond_loggers;
   pthread_cond_t m_cond_flusher;
 
-  EntryQueue m_new;    ///< new entries
-  EntryQueue m_recent; ///< recent (less new) entries we've already written at low detail
+  pthread_key_t m_queue_key;      ///< the ThreadQueue of the calling thread
+  ThreadQueue *m_queues;          ///< all of them
+  volatile int m_flusher_idle;    ///< the log thread waits on m_cond_flusher
+
+  RecentEntries m_recent; ///< recent (less new) entries we've already written at low detail
+  std::string m_out;      ///< buffered log file output
 
   std::string m_log_file;
   int m_fd;
@@ -41,7 +59,15 @@ class Log : private Thread
 
   void *entry();
 
-  void _flush(EntryQueue *q, EntryQueue *requeue, bool crash);
+  ThreadQueue *get_thread_queue();
+  static void thread_queue_exit(void *q);
+  bool _have_new();
+  void _drain(std::vector<Entry*> *batch);
+
+  void _write_entry(const RecentEntries::Header &h, const char *msg,
+		    bool crash, int remaining);
+  void _write_out();
+  void _flush(std::vector<Entry*> &batch);
 
   void _log_message(const char *s, bool crash);
 
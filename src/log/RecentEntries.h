@@ -0,0 +1,158 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef __CEPH_LOG_RECENTENTRIES_H
+#define __CEPH_LOG_RECENTENTRIES_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Entry.h"
+
+/// bytes of ring we reserve per recent entry we are asked to keep
+#define CEPH_LOG_RECENT_BYTES_PER_ENTRY 128
+
+namespace ceph {
+namespace log {
+
+/**
+ * the recent entries, packed in a ring of bytes
+ *
+ * Keeping the last max_recent Entry objects around costs an
+ * allocation each, plus the overflow string of every long message.
+ * Instead each entry is copied into a fixed ring as a small binary
+ * header followed by the message bytes, and the oldest entries are
+ * dropped when we run out of either room or count.  They are only
+ * decoded again when dumped after a crash.
+ */
+class RecentEntries {
+public:
+  struct Header {
+    uint32_t sec, nsec;
+    uint64_t thread;
+    int16_t prio, subsys;
+    uint32_t len;       ///< message bytes following the header
+  };
+
+private:
+  std::vector<char> m_buf;
+  size_t m_head;        ///< offset of the oldest entry
+  size_t m_used;        ///< bytes used starting at m_head
+  int m_len, m_max;
+  std::vector<char> m_scratch;
+
+  size_t capacity() const {
+    return m_buf.size();
+  }
+
+  void read(size_t off, void *dst, size_t len) const {
+    size_t first = std::min(len, capacity() - off);
+    memcpy(dst, &m_buf[off], first);
+    if (first < len)
+      memcpy((char *)dst + first, &m_buf[0], len - first);
+  }
+
+  void write(size_t off, const void *src, size_t len) {
+    size_t first = std::min(len, capacity() - off);
+    memcpy(&m_buf[off], src, first);
+    if (first < len)
+      memcpy(&m_buf[0], (const char *)src + first, len - first);
+  }
+
+  void drop_oldest() {
+    Header h;
+    read(m_head, &h, sizeof(h));
+    size_t n = sizeof(h) + h.len;
+    m_head = (m_head + n) % capacity();
+    m_used -= n;
+    m_len--;
+  }
+
+  void append(const Header &h, const char *msg) {
+    size_t need = sizeof(h) + h.len;
+    while (m_len >= m_max || capacity() - m_used < need)
+      drop_oldest();
+    size_t tail = (m_head + m_used) % capacity();
+    write(tail, &h, sizeof(h));
+    write((tail + sizeof(h)) % capacity(), msg, h.len);
+    m_used += need;
+    m_len++;
+  }
+
+public:
+  explicit RecentEntries(int max)
+    : m_head(0), m_used(0), m_len(0), m_max(0) {
+    set_max(max);
+  }
+
+  int size() const {
+    return m_len;
+  }
+
+  bool empty() const {
+    return m_len == 0;
+  }
+
+  void clear() {
+    m_head = m_used = 0;
+    m_len = 0;
+  }
+
+  /// resize the ring, keeping as many of the newest entries as fit
+  void set_max(int max) {
+    if (max < 0)
+      max = 0;
+    RecentEntries old(*this);
+    m_max = max;
+    m_buf.resize(0);
+    m_buf.resize((size_t)max * CEPH_LOG_RECENT_BYTES_PER_ENTRY);
+    clear();
+    Header h;
+    std::string msg;
+    while (old.pop(&h, &msg))
+      add(h, msg.data());
+  }
+
+  void add(const Entry *e) {
+    if (!m_max)
+      return;
+    Header h;
+    h.sec = e->m_stamp.sec();
+    h.nsec = e->m_stamp.nsec();
+    h.thread = (uint64_t)e->m_thread;
+    h.prio = e->m_prio;
+    h.subsys = e->m_subsys;
+    size_t len = std::min(e->m_streambuf.size(), capacity() / 2);
+    m_scratch.resize(len);
+    h.len = len ? e->m_streambuf.copy_out(&m_scratch[0], len) : 0;
+    append(h, len ? &m_scratch[0] : "");
+  }
+
+  void add(Header h, const char *msg) {
+    if (!m_max)
+      return;
+    if (h.len > capacity() / 2)
+      h.len = capacity() / 2;
+    append(h, msg);
+  }
+
+  /// remove the oldest entry, return false if there is none
+  bool pop(Header *h, std::string *msg) {
+    if (!m_len)
+      return false;
+    read(m_head, h, sizeof(*h));
+    msg->resize(h->len);
+    if (h->len)
+      read((m_head + sizeof(*h)) % capacity(), &(*msg)[0], h->len);
+    drop_oldest();
+    return true;
+  }
+};
+
+}
+}
+
+#endif
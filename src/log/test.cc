@@ -3,6 +3,10 @@
 #include "log/Log.h"
 #include "common/Clock.h"
 #include "common/PrebufferedStreambuf.h"
+#include "log/RecentEntries.h"
+
+#include <fstream>
+#include <unistd.h>
 
 using namespace ceph::log;
 
@@ -187,3 +191,98 @@ TEST(Log, ManyGather)
   log.flush();
   log.stop();
 }
+
+struct LogThread : public Thread {
+  Log *log;
+  int n;
+  LogThread(Log *l, int n) : log(l), n(n) {}
+  void *entry() {
+    for (int i=0; i<n; i++) {
+      Entry *e = log->create_entry(1, 1);
+      ostream os(&e->m_streambuf);
+      os << "thread entry " << i;
+      log->submit_entry(e);
+    }
+    return NULL;
+  }
+};
+
+TEST(Log, ManyThreads)
+{
+  SubsystemMap subs;
+  subs.add(1, "foo", 20, 10);
+  Log log(&subs);
+  log.set_max_new(10);    // exercise the full ring path
+  log.start();
+  const char *fn = "/tmp/ceph_test_log_threads";
+  ::unlink(fn);
+  log.set_log_file(fn);
+  log.reopen_log_file();
+
+  vector<LogThread*> threads;
+  for (int i=0; i<8; i++) {
+    threads.push_back(new LogThread(&log, 1000));
+    threads.back()->create();
+  }
+  for (unsigned i=0; i<threads.size(); i++) {
+    threads[i]->join();
+    delete threads[i];
+  }
+  log.flush();
+  log.stop();
+
+  std::ifstream in(fn);
+  string line;
+  int lines = 0;
+  while (getline(in, line)) {
+    ASSERT_NE(string::npos, line.find("thread entry "));
+    lines++;
+  }
+  ASSERT_EQ(8000, lines);
+  ::unlink(fn);
+}
+
+TEST(RecentEntries, Trim)
+{
+  RecentEntries r(4);
+  for (int i=0; i<10; i++) {
+    Entry e(utime_t(i, 0), pthread_self(), 1, 1);
+    ostream os(&e.m_streambuf);
+    os << "entry " << i;
+    r.add(&e);
+  }
+  ASSERT_EQ(4, r.size());
+
+  RecentEntries::Header h;
+  string msg;
+  for (int i=6; i<10; i++) {
+    ASSERT_TRUE(r.pop(&h, &msg));
+    ASSERT_EQ((uint32_t)i, h.sec);
+    ostringstream expected;
+    expected << "entry " << i;
+    ASSERT_EQ(expected.str(), msg);
+  }
+  ASSERT_FALSE(r.pop(&h, &msg));
+}
+
+TEST(RecentEntries, Bytes)
+{
+  // long messages push out old entries before the count does
+  RecentEntries r(10);
+  string big(300, 'x');
+  for (int i=0; i<10; i++) {
+    Entry e(utime_t(i, 0), pthread_self(), 1, 1, big.c_str());
+    r.add(&e);
+  }
+  ASSERT_GT(10, r.size());
+  ASSERT_LT(0, r.size());
+
+  // shrinking keeps the newest
+  r.set_max(1);
+  ASSERT_EQ(1, r.size());
+  RecentEntries::Header h;
+  string msg;
+  ASSERT_TRUE(r.pop(&h, &msg));
+  ASSERT_EQ(9u, h.sec);
+  ASSERT_EQ(64u, msg.size());  // truncated to half the ring
+}
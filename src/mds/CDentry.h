@@ -186,6 +186,7 @@ public:
     versionlock(this, &versionlock_type) {
     g_num_dn++;
     g_num_dna++;
+    g_bytes_dn += sizeof(CDentry) + name.length();
   }
   CDentry(const string& n, __u32 h, inodeno_t ino, unsigned char dt,
 	  snapid_t f, snapid_t l) :
@@ -199,12 +200,14 @@ public:
     versionlock(this, &versionlock_type) {
     g_num_dn++;
     g_num_dna++;
+    g_bytes_dn += sizeof(CDentry) + name.length();
     linkage.remote_ino = ino;
     linkage.remote_d_type = dt;
   }
   ~CDentry() {
     g_num_dn--;
     g_num_dns++;
+    g_bytes_dn -= sizeof(CDentry) + name.length();
   }
 
 
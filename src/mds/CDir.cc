@@ -97,6 +97,7 @@ ostream& operator<<(ostream& out, CDir& dir)
   if (dir.state_test(CDir::STATE_FREEZINGDIR)) out << "|freezingdir";
   if (dir.state_test(CDir::STATE_EXPORTBOUND)) out << "|exportbound";
   if (dir.state_test(CDir::STATE_IMPORTBOUND)) out << "|importbound";
+  if (dir.state_test(CDir::STATE_OMAP)) out << "|omap";
 
   // fragstat
   out << " " << dir.fnode.fragstat;
@@ -165,6 +166,7 @@ CDir::CDir(CInode *in, frag_t fg, MDCache *mdcache, bool auth) :
 {
   g_num_dir++;
   g_num_dira++;
+  g_bytes_dir += sizeof(CDir);
 
   inode = in;
   frag = fg;
@@ -1342,11 +1344,27 @@ class C_Dir_Fetch : public Context {
   CDir *dir;
   string want_dn;
  public:
-  bufferlist bl;
+  bufferlist bl;                   // trivialmap
+  bufferlist hdrbl;                // or omap header and dentries
+  map<string, bufferlist> omap;
 
   C_Dir_Fetch(CDir *d, const string& w) : dir(d), want_dn(w) { }
   void finish(int result) {
-    dir->_fetched(bl, want_dn);
+    dir->_fetched(bl, hdrbl, omap, want_dn);
+  }
+};
+
+class C_Dir_FetchDentry : public Context {
+ protected:
+  CDir *dir;
+  string dname;
+ public:
+  bufferlist hdrbl;
+  map<string, bufferlist> omap;
+
+  C_Dir_FetchDentry(CDir *d, const string& n) : dir(d), dname(n) { }
+  void finish(int result) {
+    dir->_fetched_dentry(hdrbl, omap, dname);
   }
 };
 
@@ -1376,37 +1394,190 @@ void CDir::fetch(Context *c, const string& want_dn, bool ignore_authpinnability)
   
   // already fetching?
   if (state_test(CDir::STATE_FETCHING)) {
-    dout(7) << "already fetching; waiting" << dendl;
+    if (state_test(CDir::STATE_FETCHKEYS)) {
+      dout(7) << "fetching single dentries; will fetch the rest after that" << dendl;
+      state_set(CDir::STATE_FETCHWANTED);
+    } else
+      dout(7) << "already fetching; waiting" << dendl;
     return;
   }
 
   auth_pin(this);
   state_set(CDir::STATE_FETCHING);
+  _fetch(want_dn);
+}
 
+void CDir::_fetch(const string& want_dn)
+{
   if (cache->mds->logger) cache->mds->logger->inc(l_mds_dir_f);
 
-  // start by reading the first hunk of it
+  // read the trivialmap and the omap unless we know which of the two
+  // this dir uses; _fetched takes whichever has a header.
   C_Dir_Fetch *fin = new C_Dir_Fetch(this, want_dn);
   object_t oid = get_ondisk_object();
   object_locator_t oloc(cache->mds->mdsmap->get_metadata_pool());
   ObjectOperation rd;
-  rd.tmap_get(&fin->bl, NULL);
+  if (!state_test(STATE_OMAP))
+    rd.tmap_get(&fin->bl, NULL);
+  if (!state_test(STATE_TMAP)) {
+    rd.omap_get_header(&fin->hdrbl, NULL);
+    rd.omap_get_vals("", "", (uint64_t)-1, &fin->omap, NULL);
+  }
+  cache->mds->objecter->read(oid, oloc, rd, CEPH_NOSNAP, NULL, 0, fin);
+}
+
+/*
+ * Fetch just the head dentry dname, if the dir keeps its dentries in
+ * omap, and the whole dir otherwise.  The dir doesn't become complete
+ * from this, so waiters are expected to look dname up again; they'll
+ * find at least a null dentry.
+ */
+void CDir::fetch_dentry(Context *c, const string& dname)
+{
+  dout(10) << "fetch_dentry " << dname << " on " << *this << dendl;
+
+  assert(is_auth());
+  assert(!is_complete());
+
+  if (!g_conf->mds_dir_use_omap ||
+      state_test(STATE_TMAP) ||
+      state_test(STATE_REJOINUNDEF) ||
+      !can_auth_pin() ||
+      (state_test(STATE_FETCHING) && !state_test(STATE_FETCHKEYS))) {
+    fetch(c, dname);
+    return;
+  }
+
+  add_waiter(WAIT_COMPLETE, c);
+
+  if (state_test(STATE_FETCHING)) {
+    dout(7) << "already fetching single dentries; waiting" << dendl;
+    return;
+  }
+
+  auth_pin(this);
+  state_set(STATE_FETCHING|STATE_FETCHKEYS);
+
+  if (cache->mds->logger) cache->mds->logger->inc(l_mds_dir_f);
+
+  C_Dir_FetchDentry *fin = new C_Dir_FetchDentry(this, dname);
+  object_t oid = get_ondisk_object();
+  object_locator_t oloc(cache->mds->mdsmap->get_metadata_pool());
+  set<string> keys;
+  string key;
+  dentry_key_t(CEPH_NOSNAP, dname.c_str()).encode(key);
+  keys.insert(key);
+  ObjectOperation rd;
+  rd.omap_get_header(&fin->hdrbl, NULL);
+  rd.omap_get_vals_by_keys(keys, &fin->omap, NULL);
   cache->mds->objecter->read(oid, oloc, rd, CEPH_NOSNAP, NULL, 0, fin);
 }
 
-void CDir::_fetched(bufferlist &bl, const string& want_dn)
+void CDir::_fetched_dentry(bufferlist &hdrbl, map<string, bufferlist>& omap,
+			   const string& dname)
+{
+  dout(10) << "_fetched_dentry " << dname << " for " << *this << dendl;
+
+  assert(is_auth());
+  assert(!is_frozen());
+
+  state_clear(STATE_FETCHKEYS);
+
+  if (hdrbl.length() == 0) {
+    // a trivialmap, or no object at all; read the whole thing.
+    dout(10) << "_fetched_dentry no omap header, fetching the whole dir" << dendl;
+    state_clear(STATE_FETCHWANTED);
+    _fetch(dname);
+    return;
+  }
+  state_set(STATE_OMAP);
+
+  bufferlist::iterator hp = hdrbl.begin();
+  fnode_t got_fnode;
+  ::decode(got_fnode, hp);
+  _take_fnode(got_fnode);
+
+  for (map<string, bufferlist>::iterator p = omap.begin(); p != omap.end(); ++p) {
+    bool stale;
+    _load_dentry(p->first, p->second, dname, NULL, got_fnode.version, &stale);
+  }
+
+  if (!lookup(dname, CEPH_NOSNAP)) {
+    // not on disk, and we know it.
+    CDentry *dn = add_null_dentry(dname);
+    dout(12) << "_fetched_dentry  added null " << *dn << dendl;
+  }
+
+  if (state_test(STATE_FETCHWANTED)) {
+    // someone wants the whole dir; keep our auth_pin and the waiters.
+    state_clear(STATE_FETCHWANTED);
+    _fetch(dname);
+    return;
+  }
+
+  state_clear(STATE_FETCHING);
+  auth_unpin(this);
+
+  // kick waiters
+  finish_waiting(WAIT_COMPLETE, 0);
+}
+
+// take the loaded fnode?
+// only if we are a fresh CDir* with no prior state.
+void CDir::_take_fnode(const fnode_t& got_fnode)
+{
+  if (get_version() == 0) {
+    assert(!is_projected());
+    assert(!state_test(STATE_COMMITTING));
+    fnode = got_fnode;
+    projected_version = committing_version = committed_version = got_fnode.version;
+
+    if (state_test(STATE_REJOINUNDEF)) {
+      assert(cache->mds->is_rejoin());
+      state_clear(STATE_REJOINUNDEF);
+      cache->opened_undef_dirfrag(this);
+    }
+  }
+}
+
+void CDir::_fetched(bufferlist &bl, bufferlist &hdrbl, map<string, bufferlist>& omap,
+		    const string& want_dn)
 {
   LogClient &clog = cache->mds->clog;
-  dout(10) << "_fetched " << bl.length() 
-	   << " bytes for " << *this
+  dout(10) << "_fetched " << bl.length() << " tmap bytes, "
+	   << hdrbl.length() << " omap header bytes, " << omap.size() << " omap keys"
+	   << " for " << *this
 	   << " want_dn=" << want_dn
 	   << dendl;
   
   assert(is_auth());
   assert(!is_frozen());
 
-  // empty?!?
-  if (bl.length() == 0) {
+  if (hdrbl.length()) {
+    state_clear(STATE_TMAP);
+    state_set(STATE_OMAP);
+  } else if (bl.length()) {
+    // decode trivialmap.  past the header, its dentries are encoded
+    // like a map of key to value.
+    bufferlist::iterator p = bl.begin();
+    ::decode(hdrbl, p);
+    ::decode(omap, p);
+    if (!p.end()) {
+      clog.warn() << "dir " << dirfrag() << " has "
+	  << bl.length() - p.get_off() << " extra bytes\n";
+    }
+    state_clear(STATE_OMAP);
+    state_set(STATE_TMAP);
+  } else if (cache->mds->is_any_replay()) {
+    // a standby reading ahead; the active may not have written it yet,
+    // in which case the journal holds all of it.
+    dout(10) << "_fetched no object yet for " << *this << dendl;
+    state_clear(STATE_FETCHING);
+    auth_unpin(this);
+    finish_waiting(WAIT_COMPLETE, 0);
+    return;
+  } else {
+    // empty?!?
     dout(0) << "_fetched missing object for " << *this << dendl;
     clog.error() << "dir " << ino() << "." << dirfrag()
 	  << " object missing on disk; some files may be lost\n";
@@ -1423,38 +1594,15 @@ void CDir::_fetched(bufferlist &bl, const string& want_dn)
     return;
   }
 
-  // decode trivialmap.
-  int len = bl.length();
-  bufferlist::iterator p = bl.begin();
-  
-  bufferlist header;
-  ::decode(header, p);
-  bufferlist::iterator hp = header.begin();
+  bufferlist::iterator hp = hdrbl.begin();
   fnode_t got_fnode;
   ::decode(got_fnode, hp);
 
-  __u32 n;
-  ::decode(n, p);
-
   dout(10) << "_fetched version " << got_fnode.version
-	   << ", " << len << " bytes, " << n << " keys"
+	   << ", " << omap.size() << " keys"
 	   << dendl;
-  
 
-  // take the loaded fnode?
-  // only if we are a fresh CDir* with no prior state.
-  if (get_version() == 0) {
-    assert(!is_projected());
-    assert(!state_test(STATE_COMMITTING));
-    fnode = got_fnode;
-    projected_version = committing_version = committed_version = got_fnode.version;
-
-    if (state_test(STATE_REJOINUNDEF)) {
-      assert(cache->mds->is_rejoin());
-      state_clear(STATE_REJOINUNDEF);
-      cache->opened_undef_dirfrag(this);
-    }
-  }
+  _take_fnode(got_fnode);
 
   // purge stale snaps?
   //  * only if we have past_parents open!
@@ -1462,6 +1610,8 @@ void CDir::_fetched(bufferlist &bl, const string& want_dn)
   SnapRealm *realm = inode->find_snaprealm();
   if (!realm->have_past_parents_open()) {
     dout(10) << " no snap purge, one or more past parents NOT open" << dendl;
+  } else if (cache->mds->is_any_replay()) {
+    dout(10) << " no snap purge during replay" << dendl;
   } else if (fnode.snap_purged_thru < realm->get_last_destroyed()) {
     snaps = &realm->get_snaps();
     dout(10) << " snap_purged_thru " << fnode.snap_purged_thru
@@ -1471,215 +1621,12 @@ void CDir::_fetched(bufferlist &bl, const string& want_dn)
   }
   bool purged_any = false;
 
-  bool stray = inode->is_stray();
-
   //int num_new_inodes_loaded = 0;
-  loff_t baseoff = p.get_off();
-  for (unsigned i=0; i<n; i++) {
-    loff_t dn_offset = p.get_off() - baseoff;
-
-    // dname
-    string dname;
-    snapid_t first, last;
-    dentry_key_t::decode_helper(p, dname, last);
-    
-    bufferlist dndata;
-    ::decode(dndata, p);
-    bufferlist::iterator q = dndata.begin();
-    ::decode(first, q);
-
-    // marker
-    char type;
-    ::decode(type, q);
-
-    dout(24) << "_fetched pos " << dn_offset << " marker '" << type << "' dname '" << dname
-	     << " [" << first << "," << last << "]"
-	     << dendl;
-
-    bool stale = false;
-    if (snaps && last != CEPH_NOSNAP) {
-      set<snapid_t>::const_iterator p = snaps->lower_bound(first);
-      if (p == snaps->end() || *p > last) {
-	dout(10) << " skipping stale dentry on [" << first << "," << last << "]" << dendl;
-	stale = true;
-	purged_any = true;
-      }
-    }
-    
-    /*
-     * look for existing dentry for _last_ snap, because unlink +
-     * create may leave a "hole" (epochs during which the dentry
-     * doesn't exist) but for which no explicit negative dentry is in
-     * the cache.
-     */
-    CDentry *dn = 0;
-    if (!stale)
-      dn = lookup(dname, last);
-
-    if (type == 'L') {
-      // hard link
-      inodeno_t ino;
-      unsigned char d_type;
-      ::decode(ino, q);
-      ::decode(d_type, q);
-
-      if (stale)
-	continue;
-
-      if (dn) {
-        if (dn->get_linkage()->get_inode() == 0) {
-          dout(12) << "_fetched  had NEG dentry " << *dn << dendl;
-        } else {
-          dout(12) << "_fetched  had dentry " << *dn << dendl;
-        }
-      } else {
-	// (remote) link
-	dn = add_remote_dentry(dname, ino, d_type, first, last);
-	
-	// link to inode?
-	CInode *in = cache->get_inode(ino);   // we may or may not have it.
-	if (in) {
-	  dn->link_remote(dn->get_linkage(), in);
-	  dout(12) << "_fetched  got remote link " << ino << " which we have " << *in << dendl;
-	} else {
-	  dout(12) << "_fetched  got remote link " << ino << " (dont' have it)" << dendl;
-	}
-      }
-    } 
-    else if (type == 'I') {
-      // inode
-      
-      // parse out inode
-      inode_t inode;
-      string symlink;
-      fragtree_t fragtree;
-      map<string, bufferptr> xattrs;
-      bufferlist snapbl;
-      map<snapid_t,old_inode_t> old_inodes;
-      ::decode(inode, q);
-      if (inode.is_symlink())
-        ::decode(symlink, q);
-      ::decode(fragtree, q);
-      ::decode(xattrs, q);
-      ::decode(snapbl, q);
-      ::decode(old_inodes, q);
-      
-      if (stale)
-	continue;
-
-      bool undef_inode = false;
-      if (dn) {
-	CInode *in = dn->get_linkage()->get_inode();
-	if (in) {
-	  dout(12) << "_fetched  had dentry " << *dn << dendl;
-	  if (in->state_test(CInode::STATE_REJOINUNDEF)) {
-	    assert(cache->mds->is_rejoin());
-	    assert(in->vino() == vinodeno_t(inode.ino, last));
-	    in->state_clear(CInode::STATE_REJOINUNDEF);
-	    cache->opened_undef_inode(in);
-	    undef_inode = true;
-	  }
-	} else
-	  dout(12) << "_fetched  had NEG dentry " << *dn << dendl;
-      }
-
-      if (!dn || undef_inode) {
-	// add inode
-	CInode *in = cache->get_inode(inode.ino, last);
-	if (!in || undef_inode) {
-	  if (undef_inode && in)
-	    in->first = first;
-	  else
-	    in = new CInode(cache, true, first, last);
-	  
-	  in->inode = inode;
-	  // symlink?
-	  if (in->is_symlink()) 
-	    in->symlink = symlink;
-	  
-	  in->dirfragtree.swap(fragtree);
-	  in->xattrs.swap(xattrs);
-	  in->decode_snap_blob(snapbl);
-	  in->old_inodes.swap(old_inodes);
-	  if (snaps)
-	    in->purge_stale_snap_data(*snaps);
-
-	  if (undef_inode) {
-	    if (inode.anchored)
-	      dn->adjust_nested_anchors(1);
-	  } else {
-	    cache->add_inode( in ); // add
-	    dn = add_primary_dentry(dname, in, first, last); // link
-	  }
-	  dout(12) << "_fetched  got " << *dn << " " << *in << dendl;
-
-	  if (in->inode.is_dirty_rstat())
-	    in->mark_dirty_rstat();
-
-	  if (stray) {
-	    dn->state_set(CDentry::STATE_STRAY);
-	    if (in->inode.nlink == 0)
-	      in->state_set(CInode::STATE_ORPHAN);
-	  }
-
-	  //in->hack_accessed = false;
-	  //in->hack_load_stamp = ceph_clock_now(g_ceph_context);
-	  //num_new_inodes_loaded++;
-	} else {
-	  dout(0) << "_fetched  badness: got (but i already had) " << *in
-		  << " mode " << in->inode.mode
-		  << " mtime " << in->inode.mtime << dendl;
-	  string dirpath, inopath;
-	  this->inode->make_path_string(dirpath);
-	  in->make_path_string(inopath);
-	  clog.error() << "loaded dup inode " << inode.ino
-	    << " [" << first << "," << last << "] v" << inode.version
-	    << " at " << dirpath << "/" << dname
-	    << ", but inode " << in->vino() << " v" << in->inode.version
-	    << " already exists at " << inopath << "\n";
-	  continue;
-	}
-      }
-    } else {
-      dout(1) << "corrupt directory, i got tag char '" << type << "' val " << (int)(type)
-	      << " at offset " << p.get_off() << dendl;
-      assert(0);
-    }
-    
-    if (dn && want_dn.length() && want_dn == dname) {
-      dout(10) << " touching wanted dn " << *dn << dendl;
-      inode->mdcache->touch_dentry(dn);
-    }
-
-    /** clean underwater item?
-     * Underwater item is something that is dirty in our cache from
-     * journal replay, but was previously flushed to disk before the
-     * mds failed.
-     *
-     * We only do this is committed_version == 0. that implies either
-     * - this is a fetch after from a clean/empty CDir is created
-     *   (and has no effect, since the dn won't exist); or
-     * - this is a fetch after _recovery_, which is what we're worried 
-     *   about.  Items that are marked dirty from the journal should be
-     *   marked clean if they appear on disk.
-     */
-    if (committed_version == 0 &&     
-	dn &&
-	dn->get_version() <= got_fnode.version &&
-	dn->is_dirty()) {
-      dout(10) << "_fetched  had underwater dentry " << *dn << ", marking clean" << dendl;
-      dn->mark_clean();
-
-      if (dn->get_linkage()->is_primary()) {
-	assert(dn->get_linkage()->get_inode()->get_version() <= got_fnode.version);
-	dout(10) << "_fetched  had underwater inode " << *dn->get_linkage()->get_inode() << ", marking clean" << dendl;
-	dn->get_linkage()->get_inode()->mark_clean();
-      }
-    }
-  }
-  if (!p.end()) {
-    clog.warn() << "dir " << dirfrag() << " has "
-	<< bl.length() - p.get_off() << " extra bytes\n";
+  for (map<string, bufferlist>::iterator p = omap.begin(); p != omap.end(); ++p) {
+    bool stale;
+    _load_dentry(p->first, p->second, want_dn, snaps, got_fnode.version, &stale);
+    if (stale)
+      purged_any = true;
   }
 
   //cache->mds->logger->inc("newin", num_new_inodes_loaded);
@@ -1697,6 +1644,216 @@ void CDir::_fetched(bufferlist &bl, const string& want_dn)
   finish_waiting(WAIT_COMPLETE, 0);
 }
 
+/*
+ * Load the dentry stored under key into cache, unless we have it
+ * already.  Returns it, or NULL if it was a stale snap dentry (*stale is
+ * set) or couldn't be loaded.
+ */
+CDentry *CDir::_load_dentry(const string& key, bufferlist &bl, const string& want_dn,
+			    const set<snapid_t> *snaps, version_t fetched_version,
+			    bool *stale)
+{
+  LogClient &clog = cache->mds->clog;
+  bool stray = inode->is_stray();
+
+  // dname
+  string dname;
+  snapid_t first, last;
+  dentry_key_t::decode_helper(key, dname, last);
+
+  bufferlist::iterator q = bl.begin();
+  ::decode(first, q);
+
+  // marker
+  char type;
+  ::decode(type, q);
+
+  dout(24) << "_fetched marker '" << type << "' dname '" << dname
+	   << " [" << first << "," << last << "]"
+	   << dendl;
+
+  *stale = false;
+  if (snaps && last != CEPH_NOSNAP) {
+    set<snapid_t>::const_iterator p = snaps->lower_bound(first);
+    if (p == snaps->end() || *p > last) {
+      dout(10) << " skipping stale dentry on [" << first << "," << last << "]" << dendl;
+      *stale = true;
+    }
+  }
+
+  /*
+   * look for existing dentry for _last_ snap, because unlink +
+   * create may leave a "hole" (epochs during which the dentry
+   * doesn't exist) but for which no explicit negative dentry is in
+   * the cache.
+   */
+  CDentry *dn = 0;
+  if (!*stale)
+    dn = lookup(dname, last);
+
+  if (type == 'L') {
+    // hard link
+    inodeno_t ino;
+    unsigned char d_type;
+    ::decode(ino, q);
+    ::decode(d_type, q);
+
+    if (*stale)
+      return NULL;
+
+    if (dn) {
+      if (dn->get_linkage()->get_inode() == 0) {
+	dout(12) << "_fetched  had NEG dentry " << *dn << dendl;
+      } else {
+	dout(12) << "_fetched  had dentry " << *dn << dendl;
+      }
+    } else {
+      // (remote) link
+      dn = add_remote_dentry(dname, ino, d_type, first, last);
+
+      // link to inode?
+      CInode *in = cache->get_inode(ino);   // we may or may not have it.
+      if (in) {
+	dn->link_remote(dn->get_linkage(), in);
+	dout(12) << "_fetched  got remote link " << ino << " which we have " << *in << dendl;
+      } else {
+	dout(12) << "_fetched  got remote link " << ino << " (dont' have it)" << dendl;
+      }
+    }
+  } 
+  else if (type == 'I') {
+    // inode
+
+    // parse out inode
+    inode_t inode;
+    string symlink;
+    fragtree_t fragtree;
+    map<string, bufferptr> xattrs;
+    bufferlist snapbl;
+    map<snapid_t,old_inode_t> old_inodes;
+    ::decode(inode, q);
+    if (inode.is_symlink())
+      ::decode(symlink, q);
+    ::decode(fragtree, q);
+    ::decode(xattrs, q);
+    ::decode(snapbl, q);
+    ::decode(old_inodes, q);
+
+    if (*stale)
+      return NULL;
+
+    bool undef_inode = false;
+    if (dn) {
+      CInode *in = dn->get_linkage()->get_inode();
+      if (in) {
+	dout(12) << "_fetched  had dentry " << *dn << dendl;
+	if (in->state_test(CInode::STATE_REJOINUNDEF)) {
+	  assert(cache->mds->is_rejoin());
+	  assert(in->vino() == vinodeno_t(inode.ino, last));
+	  in->state_clear(CInode::STATE_REJOINUNDEF);
+	  cache->opened_undef_inode(in);
+	  undef_inode = true;
+	}
+      } else
+	dout(12) << "_fetched  had NEG dentry " << *dn << dendl;
+    }
+
+    if (!dn || undef_inode) {
+      // add inode
+      CInode *in = cache->get_inode(inode.ino, last);
+      if (!in || undef_inode) {
+	if (undef_inode && in)
+	  in->first = first;
+	else
+	  in = new CInode(cache, true, first, last);
+
+	in->inode = inode;
+	// symlink?
+	if (in->is_symlink()) 
+	  in->symlink = symlink;
+
+	in->dirfragtree.swap(fragtree);
+	in->xattrs.swap(xattrs);
+	in->decode_snap_blob(snapbl);
+	in->old_inodes.swap(old_inodes);
+	in->update_mem_usage();
+	if (snaps)
+	  in->purge_stale_snap_data(*snaps);
+
+	if (undef_inode) {
+	  if (inode.anchored)
+	    dn->adjust_nested_anchors(1);
+	} else {
+	  cache->add_inode( in ); // add
+	  dn = add_primary_dentry(dname, in, first, last); // link
+	}
+	dout(12) << "_fetched  got " << *dn << " " << *in << dendl;
+
+	if (in->inode.is_dirty_rstat())
+	  in->mark_dirty_rstat();
+
+	if (stray) {
+	  dn->state_set(CDentry::STATE_STRAY);
+	  if (in->inode.nlink == 0)
+	    in->state_set(CInode::STATE_ORPHAN);
+	}
+
+	//in->hack_accessed = false;
+	//in->hack_load_stamp = ceph_clock_now(g_ceph_context);
+	//num_new_inodes_loaded++;
+      } else {
+	dout(0) << "_fetched  badness: got (but i already had) " << *in
+		<< " mode " << in->inode.mode
+		<< " mtime " << in->inode.mtime << dendl;
+	string dirpath, inopath;
+	this->inode->make_path_string(dirpath);
+	in->make_path_string(inopath);
+	clog.error() << "loaded dup inode " << inode.ino
+	  << " [" << first << "," << last << "] v" << inode.version
+	  << " at " << dirpath << "/" << dname
+	  << ", but inode " << in->vino() << " v" << in->inode.version
+	  << " already exists at " << inopath << "\n";
+	return NULL;
+      }
+    }
+  } else {
+    dout(1) << "corrupt directory, i got tag char '" << type << "' val " << (int)(type)
+	    << " for key '" << key << "'" << dendl;
+    assert(0);
+  }
+
+  if (dn && want_dn.length() && want_dn == dname) {
+    dout(10) << " touching wanted dn " << *dn << dendl;
+    inode->mdcache->touch_dentry(dn);
+  }
+
+  /** clean underwater item?
+   * Underwater item is something that is dirty in our cache from
+   * journal replay, but was previously flushed to disk before the
+   * mds failed.
+   *
+   * We only do this is committed_version == 0. that implies either
+   * - this is a fetch after from a clean/empty CDir is created
+   *   (and has no effect, since the dn won't exist); or
+   * - this is a fetch after _recovery_, which is what we're worried 
+   *   about.  Items that are marked dirty from the journal should be
+   *   marked clean if they appear on disk.
+   */
+  if (committed_version == 0 &&     
+      dn &&
+      dn->get_version() <= fetched_version &&
+      dn->is_dirty()) {
+    dout(10) << "_fetched  had underwater dentry " << *dn << ", marking clean" << dendl;
+    dn->mark_clean();
+
+    if (dn->get_linkage()->is_primary()) {
+      assert(dn->get_linkage()->get_inode()->get_version() <= fetched_version);
+      dout(10) << "_fetched  had underwater inode " << *dn->get_linkage()->get_inode() << ", marking clean" << dendl;
+      dn->get_linkage()->get_inode()->mark_clean();
+    }
+  }
+  return dn;
+}
 
 
 // -----------------------
@@ -1876,14 +2033,18 @@ CDir::map_t::iterator CDir::_commit_partial(ObjectOperation& m,
 void CDir::_encode_dentry(CDentry *dn, bufferlist& bl,
 			  const set<snapid_t> *snaps)
 {
-  // clear dentry NEW flag, if any.  we can no longer silently drop it.
-  dn->clear_new();
-
   dn->key().encode(bl);
 
-  ceph_le32 plen = init_le32(0);
-  unsigned plen_off = bl.length();
-  ::encode(plen, bl);
+  bufferlist dnbl;
+  _encode_dentry_value(dn, dnbl, snaps);
+  ::encode(dnbl, bl);
+}
+
+void CDir::_encode_dentry_value(CDentry *dn, bufferlist& bl,
+				const set<snapid_t> *snaps)
+{
+  // clear dentry NEW flag, if any.  we can no longer silently drop it.
+  dn->clear_new();
 
   ::encode(dn->first, bl);
 
@@ -1924,12 +2085,102 @@ void CDir::_encode_dentry(CDentry *dn, bufferlist& bl,
       in->purge_stale_snap_data(*snaps);
     ::encode(in->old_inodes, bl);
   }
-  
-  plen = bl.length() - plen_off - sizeof(__u32);
+}
 
-  ceph_le32 eplen;
-  eplen = plen;
-  bl.copy_in(plen_off, sizeof(eplen), (char*)&eplen);
+static void _omap_flush(ObjectOperation& op, map<string, bufferlist>& to_set,
+			set<string>& to_remove)
+{
+  if (!to_remove.empty())
+    op.omap_rm_keys(to_remove);
+  if (!to_set.empty())
+    op.omap_set(to_set);
+  to_set.clear();
+  to_remove.clear();
+}
+
+/**
+ * Write out a dir that keeps its dentries in omap: only the dirty
+ * dentries, or if full all of them, replacing whatever the object held
+ * (a trivialmap, say) in a single write.  Partial updates are split at
+ * about max_dir_commit_size, with the fnode in the last write; see
+ * _commit for why that one goes last.  So are full writes of the result
+ * of a fragment, whose old objects stay around until it is committed.
+ */
+void CDir::_omap_commit(const set<snapid_t> *snaps, bool full)
+{
+  dout(10) << "_omap_commit" << (full ? " full" : "") << dendl;
+
+  unsigned max_write_size = cache->max_dir_commit_size;
+  unsigned write_size = 0;
+  list<ObjectOperation> ops;
+  ops.push_back(ObjectOperation());
+  if (full) {
+    ops.back().create(false);
+    ops.back().truncate(0);
+    ops.back().omap_clear();
+  }
+
+  map<string, bufferlist> to_set;
+  set<string> to_remove;
+
+  map_t::iterator p = items.begin();
+  while (p != items.end()) {
+    CDentry *dn = p->second;
+    ++p;
+
+    string key;
+    dn->key().encode(key);
+
+    if (snaps && dn->last != CEPH_NOSNAP &&
+	try_trim_snap_dentry(dn, *snaps)) {
+      if (!full)
+	to_remove.insert(key);
+      continue;
+    }
+
+    if (full) {
+      if (dn->get_linkage()->is_null())
+	continue;  // skip negative entries
+    } else if (!dn->is_dirty() &&
+	       (!dn->state_test(CDentry::STATE_FRAGMENTING) || dn->get_linkage()->is_null())) {
+      continue;  // skip clean dentries
+    }
+
+    if (dn->get_linkage()->is_null()) {
+      dout(10) << " rm " << dn->name << " " << *dn << dendl;
+      to_remove.insert(key);
+      write_size += key.length();
+    } else {
+      dout(10) << " set " << dn->name << " " << *dn << dendl;
+      bufferlist& bl = to_set[key];
+      _encode_dentry_value(dn, bl, snaps);
+      write_size += key.length() + bl.length();
+    }
+
+    if ((!full || state_test(STATE_FRAGMENTING)) &&
+	write_size >= max_write_size) {
+      _omap_flush(ops.back(), to_set, to_remove);
+      ops.push_back(ObjectOperation());
+      write_size = 0;
+    }
+  }
+  _omap_flush(ops.back(), to_set, to_remove);
+
+  bufferlist header;
+  ::encode(fnode, header);
+  ops.back().omap_set_header(header);
+
+  SnapContext snapc;
+  object_t oid = get_ondisk_object();
+  object_locator_t oloc(cache->mds->mdsmap->get_metadata_pool());
+
+  C_GatherBuilder gather(g_ceph_context, new C_Dir_Committed(this, get_version()));
+  for (list<ObjectOperation>::iterator q = ops.begin(); q != ops.end(); ++q) {
+    q->priority = CEPH_MSG_PRIO_LOW;  // set priority lower than journal!
+    cache->mds->objecter->mutate(oid, oloc, *q, snapc, ceph_clock_now(g_ceph_context), 0, NULL,
+				 gather.new_sub());
+  }
+  gather.activate();
 }
 
 
@@ -1962,8 +2213,19 @@ void CDir::_commit(version_t want)
     return;
   }
   
+  // moving the dir to omap takes a full rewrite, so all of it must be
+  // in cache.
+  bool omap = state_test(STATE_OMAP);
+  bool convert = !omap && g_conf->mds_dir_use_omap;
+  if (convert && !is_complete()) {
+    dout(7) << "commit converting to omap, fetching first" << dendl;
+    if (cache->mds->logger) cache->mds->logger->inc(l_mds_dir_ffc);
+    fetch(new C_Dir_RetryCommit(this, want));
+    return;
+  }
+
   // complete first?  (only if we're not using TMAPUP osd op)
-  if (!g_conf->mds_use_tmap && !is_complete()) {
+  if (!omap && !g_conf->mds_use_tmap && !is_complete()) {
     dout(7) << "commit not complete, fetching first" << dendl;
     if (cache->mds->logger) cache->mds->logger->inc(l_mds_dir_ffc);
     fetch(new C_Dir_RetryCommit(this, want));
@@ -1993,6 +2255,19 @@ void CDir::_commit(version_t want)
 	     << ", snap purge based on " << *snaps << dendl;
   }
 
+  if (omap || convert) {
+    bool full = convert || (is_complete() && state_test(CDir::STATE_FRAGMENTING));
+    if (full)
+      fnode.snap_purged_thru = realm->get_last_destroyed();
+    if (convert) {
+      dout(10) << "converting to omap" << dendl;
+      state_clear(STATE_TMAP);
+      state_set(STATE_OMAP);
+    }
+    _omap_commit(snaps, full);
+    return;
+  }
+
   ObjectOperation m;
   map_t::iterator committed_dn;
   unsigned max_write_size = cache->max_dir_commit_size;
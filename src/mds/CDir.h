@@ -107,6 +107,10 @@ public:
   static const unsigned STATE_STICKY =        (1<<15);  // sticky pin due to inode stickydirs
   static const unsigned STATE_DNPINNEDFRAG =  (1<<16);  // dir is refragmenting
   static const unsigned STATE_ASSIMRSTAT =    (1<<17);  // assimilating inode->frag rstats
+  static const unsigned STATE_TMAP =          (1<<18);  // on-disk object is a trivialmap
+  static const unsigned STATE_OMAP =          (1<<19);  // on-disk object keeps dentries in omap
+  static const unsigned STATE_FETCHKEYS =     (1<<20);  // fetching single dentries, not the whole dir
+  static const unsigned STATE_FETCHWANTED =   (1<<21);  // fetch the whole dir once FETCHKEYS is done
 
   // common states
   static const unsigned STATE_CLEAN =  0;
@@ -115,7 +119,7 @@ public:
   // these state bits are preserved by an import/export
   // ...except if the directory is hashed, in which case none of them are!
   static const unsigned MASK_STATE_EXPORTED = 
-  (STATE_COMPLETE|STATE_DIRTY);
+  (STATE_COMPLETE|STATE_DIRTY|STATE_TMAP|STATE_OMAP);
   static const unsigned MASK_STATE_IMPORT_KEPT = 
   (						  
    STATE_IMPORTING
@@ -289,6 +293,7 @@ protected:
     remove_bloom();
     g_num_dir--;
     g_num_dirs++;
+    g_bytes_dir -= sizeof(CDir);
   }
 
 
@@ -483,7 +488,18 @@ private:
   }
   void fetch(Context *c, bool ignore_authpinnability=false);
   void fetch(Context *c, const string& want_dn, bool ignore_authpinnability=false);
-  void _fetched(bufferlist &bl, const string& want_dn);
+  void fetch_dentry(Context *c, const string& dname);
+  void _fetched(bufferlist &bl, bufferlist &hdrbl, map<string, bufferlist>& omap,
+		const string& want_dn);
+  void _fetched_dentry(bufferlist &hdrbl, map<string, bufferlist>& omap,
+		       const string& dname);
+private:
+  void _fetch(const string& want_dn);
+  void _take_fnode(const fnode_t& got_fnode);
+  CDentry *_load_dentry(const string& key, bufferlist &bl, const string& want_dn,
+			const set<snapid_t> *snaps, version_t fetched_version,
+			bool *stale);
+public:
 
   // -- commit --
   map<version_t, list<Context*> > waiting_for_commit;
@@ -496,7 +512,9 @@ private:
   map_t::iterator _commit_partial(ObjectOperation& m, const set<snapid_t> *snaps,
                        unsigned max_write_size=-1,
                        map_t::iterator last_committed_dn=map_t::iterator());
+  void _omap_commit(const set<snapid_t> *snaps, bool full);
   void _encode_dentry(CDentry *dn, bufferlist& bl, const set<snapid_t> *snaps);
+  void _encode_dentry_value(CDentry *dn, bufferlist& bl, const set<snapid_t> *snaps);
   void _committed(version_t v);
   void wait_for_commit(Context *c, version_t v=0);
 
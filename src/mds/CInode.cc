@@ -325,6 +325,20 @@ inode_t *CInode::project_inode(map<string,bufferptr> *px)
   return projected_nodes.back()->inode;
 }
 
+/*
+ * account what the variable parts of the inode take up, roughly: the map
+ * nodes cost about as much as a few pointers each
+ */
+void CInode::update_mem_usage()
+{
+  long extra = symlink.length();
+  for (map<string,bufferptr>::iterator p = xattrs.begin(); p != xattrs.end(); ++p)
+    extra += 4 * sizeof(void*) + p->first.length() + p->second.length();
+  extra += old_inodes.size() * (4 * sizeof(void*) + sizeof(old_inode_t));
+  g_bytes_ino += extra - mem_extra;
+  mem_extra = extra;
+}
+
 void CInode::pop_and_dirty_projected_inode(LogSegment *ls) 
 {
   assert(!projected_nodes.empty());
@@ -342,6 +356,7 @@ void CInode::pop_and_dirty_projected_inode(LogSegment *ls)
   if (px) {
     xattrs = *px;
     delete px;
+    update_mem_usage();
   }
 
   if (projected_nodes.front()->snapnode)
@@ -1136,6 +1151,7 @@ void CInode::decode_store(bufferlist::iterator& bl) {
     }
   }
   DECODE_FINISH(bl);
+  update_mem_usage();
 }
 
 // ------------------
@@ -1519,6 +1535,7 @@ void CInode::decode_lock_state(int type, bufferlist& bl)
 
   case CEPH_LOCK_IXATTR:
     ::decode(xattrs, p);
+    update_mem_usage();
     break;
 
   case CEPH_LOCK_ISNAP:
@@ -3036,6 +3053,7 @@ void CInode::_decode_base(bufferlist::iterator& p)
   ::decode(xattrs, p);
   ::decode(old_inodes, p);
   decode_snap(p);
+  update_mem_usage();
 }
 
 void CInode::_encode_locks_full(bufferlist& bl)
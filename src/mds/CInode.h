@@ -194,6 +194,10 @@ public:
   map<snapid_t, old_inode_t> old_inodes;  // key = last, value.first = first
   set<snapid_t> dirty_old_rstats;
 
+  // bytes of the above accounted in g_bytes_ino, besides sizeof(CInode)
+  long mem_extra;
+  void update_mem_usage();
+
   bool is_multiversion() {
     return snaprealm ||  // other snaprealms will link to me
       inode.is_dir() ||  // links to me in other snaps
@@ -456,12 +460,15 @@ private:
   {
     g_num_ino++;
     g_num_inoa++;
+    g_bytes_ino += sizeof(CInode);
+    mem_extra = 0;
     state = 0;  
     if (auth) state_set(STATE_AUTH);
   };
   ~CInode() {
     g_num_ino--;
     g_num_inos++;
+    g_bytes_ino -= sizeof(CInode) + mem_extra;
     close_dirfrags();
     close_snaprealm();
   }
@@ -226,10 +226,12 @@ public:
     item_session_caps(this), item_snaprealm_caps(this) {
     g_num_cap++;
     g_num_capa++;
+    g_bytes_cap += sizeof(Capability);
   }
   ~Capability() {
     g_num_cap--;
     g_num_caps++;
+    g_bytes_cap -= sizeof(Capability);
   }
   
   ceph_seq_t get_mseq() { return mseq; }
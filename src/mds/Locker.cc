@@ -2311,6 +2311,11 @@ void Locker::handle_client_caps(MClientCaps *m)
     return;
   }
 
+  if (!m->batched.empty()) {
+    handle_client_caps_batch(m);
+    return;
+  }
+
   CInode *head_in = mdcache->get_inode(m->get_ino());
   if (!head_in) {
     dout(7) << "handle_client_caps on unknown ino " << m->get_ino() << ", dropping" << dendl;
@@ -2449,7 +2454,7 @@ void Locker::handle_client_caps(MClientCaps *m)
 	if (!in->filelock.is_stable() ||
 	    !in->authlock.is_stable() ||
 	    !in->xattrlock.is_stable())
-	  mds->mdlog->flush();
+	  flush_log_for_caps();
       }
 
       adjust_cap_wanted(cap, new_wanted, m->get_issue_seq());
@@ -2461,7 +2466,7 @@ void Locker::handle_client_caps(MClientCaps *m)
       eval(in, CEPH_CAP_LOCKS);
       
       if (cap->wanted() & ~cap->pending())
-	mds->mdlog->flush();
+	flush_log_for_caps();
     } else {
       // no update, ack now.
       if (ack)
@@ -2482,6 +2487,40 @@ void Locker::handle_client_caps(MClientCaps *m)
   m->put();
 }
 
+/*
+ * a client's dirty metadata flushes for many inodes, in one message.
+ * each is handled as if it came on its own, but their cap updates go
+ * out with a single log flush at the end instead of one each.
+ */
+void Locker::handle_client_caps_batch(MClientCaps *m)
+{
+  vector<MClientCaps*> more;
+  for (unsigned i = 0; i < m->batched.size(); i++)
+    more.push_back(m->get_batched(i));
+  m->batched.clear();
+  m->batched_tid.clear();
+  dout(7) << "handle_client_caps " << more.size() << " batched after " << *m << dendl;
+
+  assert(!cap_batching);
+  cap_batching = true;
+  cap_batch_log_flush = false;
+  handle_client_caps(m);
+  for (unsigned i = 0; i < more.size(); i++)
+    handle_client_caps(more[i]);
+  cap_batching = false;
+
+  if (cap_batch_log_flush)
+    mds->mdlog->flush();
+}
+
+void Locker::flush_log_for_caps()
+{
+  if (cap_batching)
+    cap_batch_log_flush = true;
+  else
+    mds->mdlog->flush();
+}
+
 class C_Locker_RetryRequestCapRelease : public Context {
   Locker *locker;
   client_t client;
@@ -2920,7 +2959,7 @@ bool Locker::_do_cap_update(CInode *in, Capability *cap,
       (!dirty && (!in->filelock.is_stable() || !in->authlock.is_stable() || !in->xattrlock.is_stable())) ||  // nothing dirty + unstable lock -> probably a revoke?
       (change_max && new_max) ||         // max INCREASE
       (cap && (cap->wanted() & ~cap->pending())))
-    mds->mdlog->flush();
+    flush_log_for_caps();
 
   return true;
 }
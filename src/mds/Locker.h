@@ -60,9 +60,13 @@ class Locker {
 private:
   MDS *mds;
   MDCache *mdcache;
+
+  // set while the caps messages of a client batch are handled
+  bool cap_batching, cap_batch_log_flush;
  
  public:
-  Locker(MDS *m, MDCache *c) : mds(m), mdcache(c) {}  
+  Locker(MDS *m, MDCache *c) :
+    mds(m), mdcache(c), cap_batching(false), cap_batch_log_flush(false) {}
 
   SimpleLock *get_lock(int lock_type, MDSCacheObjectInfo &info);
   
@@ -219,6 +223,8 @@ public:
  protected:
   void adjust_cap_wanted(Capability *cap, int wanted, int issue_seq);
   void handle_client_caps(class MClientCaps *m);
+  void handle_client_caps_batch(MClientCaps *m);
+  void flush_log_for_caps();
   void _update_cap_fields(CInode *in, int dirty, MClientCaps *m, inode_t *pi);
   void _do_snap_update(CInode *in, snapid_t snap, int dirty, snapid_t follows, client_t client, MClientCaps *m, MClientCaps *ack);
   void _do_null_snapflush(CInode *head_in, client_t client, snapid_t follows);
@@ -30,12 +30,15 @@
 
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <map>
 using std::map;
 using std::vector;
 
 #include "common/config.h"
+#include "common/admin_socket.h"
+#include "common/Formatter.h"
 
 #define dout_subsys ceph_subsys_mds
 #undef DOUT_COND
@@ -48,6 +51,50 @@ using std::vector;
 #define MIN_OFFLOAD 10   // point at which i stop trying, close enough
 
 
+class MDBalancer::AdminHook : public AdminSocketHook {
+  MDBalancer *balancer;
+public:
+  AdminHook(MDBalancer *b) : balancer(b) {}
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+	    bufferlist& out) {
+    if (format == "")
+      format = "json-pretty";
+    Formatter *f = new_formatter(format);
+    stringstream ss;
+    balancer->mds->mds_lock.Lock();
+    balancer->dump_plan(f);
+    balancer->mds->mds_lock.Unlock();
+    f->flush(ss);
+    delete f;
+    out.append(ss);
+    return true;
+  }
+};
+
+MDBalancer::MDBalancer(MDS *m) :
+  mds(m), asok_hook(NULL),
+  beat_epoch(0),
+  last_epoch_under(0), last_epoch_over(0), my_load(0.0), target_load(0.0)
+{
+  asok_hook = new AdminHook(this);
+  int r = g_ceph_context->get_admin_socket()->register_command(
+    "dump_balancer_plan", "dump_balancer_plan", asok_hook,
+    "show the subtrees the balancer would export, without exporting them");
+  if (r < 0) {
+    delete asok_hook;
+    asok_hook = NULL;
+  }
+}
+
+MDBalancer::~MDBalancer()
+{
+  if (asok_hook) {
+    g_ceph_context->get_admin_socket()->unregister_command("dump_balancer_plan");
+    delete asok_hook;
+  }
+}
+
+
 /* This function DOES put the passed message before returning */
 int MDBalancer::proc_message(Message *m)
 {
@@ -138,6 +185,9 @@ double mds_load_t::mds_load()
   case 2:
     return cpu_load_avg;
 
+  case 3:
+    return req_cost;
+
   }
   assert(0);
   return 0;
@@ -161,6 +211,7 @@ mds_load_t MDBalancer::get_load(utime_t now)
   }
 
   load.req_rate = mds->get_req_rate();
+  load.req_cost = req_cost.get(now, mds->mdcache->decayrate);
   load.queue_len = mds->messenger->get_dispatch_queue_len();
 
   ifstream cpu("/proc/loadavg");
@@ -210,6 +261,16 @@ void MDBalancer::send_heartbeat()
   }
   mds_import_map[ mds->get_nodeid() ] = import_map;
 
+  // forget the measured cost of subtrees that are no longer mine
+  map<dirfrag_t, DecayCounter>::iterator q = subtree_req_cost.begin();
+  while (q != subtree_req_cost.end()) {
+    CDir *dir = mds->mdcache->get_dirfrag(q->first);
+    if (!dir || !authsubs.count(dir))
+      subtree_req_cost.erase(q++);
+    else
+      ++q;
+  }
+
 
   dout(5) << "mds." << mds->get_nodeid() << " epoch " << beat_epoch << " load " << load << dendl;
   for (map<int, float>::iterator it = import_map.begin();
@@ -499,7 +560,8 @@ void MDBalancer::prep_rebalance(int beat)
     last_epoch_over = beat_epoch;
 
     // am i over long enough?
-    if (last_epoch_under && beat_epoch - last_epoch_under < 2) {
+    if (last_epoch_under &&
+	beat_epoch - last_epoch_under < g_conf->mds_bal_min_overload_epochs) {
       dout(5) << "  i am overloaded, but only for " << (beat_epoch - last_epoch_under) << " epochs" << dendl;
       return;
     }
@@ -608,8 +670,32 @@ void MDBalancer::try_rebalance()
     return;
   }
 
+  list<planned_export_t> plan;
+  plan_exports(plan);
+
+  for (list<planned_export_t>::iterator p = plan.begin(); p != plan.end(); ++p) {
+    dout(0) << "   - exporting (" << p->reason << ") "
+	    << p->dir->pop_auth_subtree
+	    << " " << p->pop
+	    << " to mds." << p->target
+	    << " " << *p->dir
+	    << dendl;
+    mds->mdcache->migrator->export_dir_nicely(p->dir, p->target);
+  }
+
+  dout(5) << "rebalance done" << dendl;
+  show_imports();
+}
+
+/*
+ * pick what to export to meet my_targets.  this only decides; the
+ * caller does the exporting (or, for dump_plan, just reports it).
+ */
+void MDBalancer::plan_exports(list<planned_export_t>& plan)
+{
+  trim_recent_imports(ceph_clock_now(g_ceph_context));
+
   // make a sorted list of my imports
-  map<double,CDir*>    import_pop_map;
   multimap<int,CDir*>  import_from_map;
   set<CDir*> fullauthsubs;
 
@@ -619,60 +705,44 @@ void MDBalancer::try_rebalance()
        ++it) {
     CDir *im = *it;
     if (im->get_inode()->is_stray()) continue;
+    if (is_import_held(im)) {
+      dout(15) << "  holding recent import " << *im << dendl;
+      continue;
+    }
 
     double pop = im->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate);
     if (g_conf->mds_bal_idle_threshold > 0 &&
 	pop < g_conf->mds_bal_idle_threshold &&
 	im->inode != mds->mdcache->get_root() &&
 	im->inode->authority().first != mds->get_nodeid()) {
-      dout(0) << " exporting idle (" << pop << ") import " << *im
-	      << " back to mds." << im->inode->authority().first
+      dout(5) << " idle (" << pop << ") import " << *im
+	      << ", back to mds." << im->inode->authority().first
 	      << dendl;
-      mds->mdcache->migrator->export_dir_nicely(im, im->inode->authority().first);
+      plan.push_back(planned_export_t(im, im->inode->authority().first, pop, "idle"));
       continue;
     }
 
-    import_pop_map[ pop ] = im;
     int from = im->inode->authority().first;
     dout(15) << "  map: i imported " << *im << " from " << from << dendl;
     import_from_map.insert(pair<int,CDir*>(from, im));
   }
 
 
-
   // do my exports!
   set<CDir*> already_exporting;
-  double total_sent = 0;
-  double total_goal = 0;
 
   for (map<int,double>::iterator it = my_targets.begin();
        it != my_targets.end();
        ++it) {
-
-      /*
-	double fac = 1.0;
-	if (false && total_goal > 0 && total_sent > 0) {
-	fac = total_goal / total_sent;
-	dout(0) << " total sent is " << total_sent << " / " << total_goal << " -> fac 1/ " << fac << dendl;
-	if (fac > 1.0) fac = 1.0;
-	}
-	fac = .9 - .4 * ((float)g_conf->num_mds / 128.0);  // hack magic fixme
-      */
-
     int target = (*it).first;
     double amount = (*it).second;
-    total_goal += amount;
 
     if (amount < MIN_OFFLOAD) continue;
     if (amount / target_load < .2) continue;
 
-    dout(5) << "want to send " << amount << " to mds." << target
-      //<< " .. " << (*it).second << " * " << load_fac
-	    << " -> " << amount
-	    << dendl;//" .. fudge is " << fudge << dendl;
+    dout(5) << "want to send " << amount << " to mds." << target << dendl;
     double have = 0;
 
-
     show_imports();
 
     // search imports from target
@@ -693,50 +763,20 @@ void MDBalancer::try_rebalance()
 	assert(dir->inode->authority().first == target);  // cuz that's how i put it in the map, dummy
 
 	if (pop <= amount-have) {
-	  dout(0) << "reexporting " << *dir
+	  dout(5) << "reexporting " << *dir
 		  << " pop " << pop
 		  << " back to mds." << target << dendl;
-	  mds->mdcache->migrator->export_dir_nicely(dir, target);
+	  plan.push_back(planned_export_t(dir, target, pop, "reexport"));
 	  have += pop;
 	  import_from_map.erase(plast);
-	  import_pop_map.erase(pop);
 	} else {
 	  dout(5) << "can't reexport " << *dir << ", too big " << pop << dendl;
 	}
 	if (amount-have < MIN_OFFLOAD) break;
       }
     }
-    if (amount-have < MIN_OFFLOAD) {
-      total_sent += have;
-      continue;
-    }
-
-    // any other imports
-    if (false)
-      for (map<double,CDir*>::iterator import = import_pop_map.begin();
-	   import != import_pop_map.end();
-	   import++) {
-	CDir *imp = (*import).second;
-	if (imp->inode->is_base() ||
-	    imp->inode->is_stray())
-	  continue;
-
-	double pop = (*import).first;
-	if (pop < amount-have || pop < MIN_REEXPORT) {
-	  dout(0) << "reexporting " << *imp
-		  << " pop " << pop
-		  << " back to mds." << imp->inode->authority()
-		  << dendl;
-	  have += pop;
-	  mds->mdcache->migrator->export_dir_nicely(imp, imp->inode->authority().first);
-	}
-	if (amount-have < MIN_OFFLOAD) break;
-      }
-    if (amount-have < MIN_OFFLOAD) {
-      //fudge = amount-have;
-      total_sent += have;
+    if (amount-have < MIN_OFFLOAD)
       continue;
-    }
 
     // okay, search for fragments of my workload
     set<CDir*> candidates;
@@ -748,29 +788,117 @@ void MDBalancer::try_rebalance()
 	 pot != candidates.end();
 	 ++pot) {
       if ((*pot)->get_inode()->is_stray()) continue;
+      if (is_import_held(*pot)) continue;
       find_exports(*pot, amount, exports, have, already_exporting);
       if (have > amount-MIN_OFFLOAD)
 	break;
     }
-    //fudge = amount - have;
-    total_sent += have;
-
-    for (list<CDir*>::iterator it = exports.begin(); it != exports.end(); ++it) {
-      dout(0) << "   - exporting "
-	       << (*it)->pop_auth_subtree
-	       << " "
-	       << (*it)->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate)
-	       << " to mds." << target
-	       << " " << **it
-	       << dendl;
-      mds->mdcache->migrator->export_dir_nicely(*it, target);
-    }
+
+    for (list<CDir*>::iterator it = exports.begin(); it != exports.end(); ++it)
+      plan.push_back(planned_export_t(*it, target,
+				      (*it)->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate),
+				      "load"));
   }
+}
 
-  dout(5) << "rebalance done" << dendl;
-  show_imports();
+void MDBalancer::trim_recent_imports(utime_t now)
+{
+  utime_t cutoff = now;
+  cutoff -= g_conf->mds_bal_import_hold;
+
+  map<dirfrag_t, utime_t>::iterator p = recent_imports.begin();
+  while (p != recent_imports.end()) {
+    if (p->second < cutoff)
+      recent_imports.erase(p++);
+    else
+      ++p;
+  }
+}
+
+bool MDBalancer::is_import_held(CDir *dir)
+{
+  return recent_imports.count(dir->dirfrag());
+}
+
+/*
+ * moving a subtree means freezing it, encoding and journaling its
+ * metadata on both ranks, and the clients' caps following it; guess
+ * that from how much lives under it.
+ */
+double MDBalancer::get_migration_cost(CDir *dir)
+{
+  return g_conf->mds_bal_migration_cost * (double)(1 + dir->fnode.rstat.rsize());
 }
 
+void MDBalancer::dump_plan(Formatter *f)
+{
+  utime_t now = ceph_clock_now(g_ceph_context);
+
+  f->open_object_section("balancer_plan");
+  f->dump_int("epoch", beat_epoch);
+  f->dump_int("last_epoch_under", last_epoch_under);
+  f->dump_int("last_epoch_over", last_epoch_over);
+  f->dump_float("my_load", my_load);
+  f->dump_float("target_load", target_load);
+  f->dump_float("request_cost", req_cost.get(now, mds->mdcache->decayrate));
+
+  f->open_array_section("loads");
+  for (map<int, float>::iterator p = mds_meta_load.begin(); p != mds_meta_load.end(); ++p) {
+    f->open_object_section("mds");
+    f->dump_int("rank", p->first);
+    f->dump_float("load", p->second);
+    f->close_section();
+  }
+  f->close_section();
+
+  f->open_array_section("targets");
+  for (map<int, double>::iterator p = my_targets.begin(); p != my_targets.end(); ++p) {
+    f->open_object_section("target");
+    f->dump_int("rank", p->first);
+    f->dump_float("amount", p->second);
+    f->close_section();
+  }
+  f->close_section();
+
+  set<CDir*> authsubs;
+  mds->mdcache->get_auth_subtrees(authsubs);
+  f->open_array_section("subtrees");
+  for (set<CDir*>::iterator p = authsubs.begin(); p != authsubs.end(); ++p) {
+    CDir *dir = *p;
+    f->open_object_section("subtree");
+    f->dump_stream("dirfrag") << dir->dirfrag();
+    f->dump_float("pop", dir->pop_auth_subtree.meta_load(now, mds->mdcache->decayrate));
+    map<dirfrag_t, DecayCounter>::iterator q = subtree_req_cost.find(dir->dirfrag());
+    f->dump_float("request_cost",
+		  q == subtree_req_cost.end() ? 0 : q->second.get(now, mds->mdcache->decayrate));
+    f->dump_float("migration_cost", get_migration_cost(dir));
+    map<dirfrag_t, utime_t>::iterator r = recent_imports.find(dir->dirfrag());
+    if (r != recent_imports.end())
+      f->dump_stream("imported") << r->second;
+    f->close_section();
+  }
+  f->close_section();
+
+  list<planned_export_t> plan;
+  if (!mds->is_active() || mds->mdsmap->is_degraded() || g_conf->mds_thrash_exports)
+    dout(10) << "dump_plan not balancing right now" << dendl;
+  else
+    plan_exports(plan);
+
+  f->open_array_section("exports");
+  for (list<planned_export_t>::iterator p = plan.begin(); p != plan.end(); ++p) {
+    f->open_object_section("export");
+    f->dump_stream("dirfrag") << p->dir->dirfrag();
+    f->dump_int("target", p->target);
+    f->dump_float("pop", p->pop);
+    f->dump_float("migration_cost", get_migration_cost(p->dir));
+    f->dump_string("reason", p->reason);
+    f->close_section();
+  }
+  f->close_section();
+
+  f->close_section();
+}
 
 /* returns true if all my_target MDS are in the MDSMap.
  */
@@ -868,6 +996,7 @@ void MDBalancer::find_exports(CDir *dir,
       if (already_exporting.count(subdir)) continue;
 
       if (subdir->is_frozen()) continue;  // can't export this right now!
+      if (is_import_held(subdir)) continue;
 
       // how popular?
       double pop = subdir->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate);
@@ -876,8 +1005,16 @@ void MDBalancer::find_exports(CDir *dir,
 
       if (pop < minchunk) continue;
 
+      // not worth what it costs to move?
+      bool worth = pop >= get_migration_cost(subdir);
+      if (!worth)
+	dout(15) << "   subdir migration cost " << get_migration_cost(subdir)
+		 << " exceeds pop " << pop << dendl;
+      if (!worth && pop <= need)
+	continue;
+
       // lucky find?
-      if (pop > needmin && pop < needmax) {
+      if (worth && pop > needmin && pop < needmax) {
 	exports.push_back(subdir);
 	already_exporting.insert(subdir);
 	have += pop;
@@ -1115,6 +1252,9 @@ void MDBalancer::subtract_export(CDir *dir, utime_t now)
 {
   dirfrag_load_vec_t subload = dir->pop_auth_subtree;
 
+  recent_imports.erase(dir->dirfrag());
+  subtree_req_cost.erase(dir->dirfrag());
+
   while (true) {
     dir = dir->inode->get_parent_dir();
     if (!dir) break;
@@ -1129,6 +1269,8 @@ void MDBalancer::add_import(CDir *dir, utime_t now)
 {
   dirfrag_load_vec_t subload = dir->pop_auth_subtree;
 
+  recent_imports[dir->dirfrag()] = now;
+
   while (true) {
     dir = dir->inode->get_parent_dir();
     if (!dir) break;
@@ -1143,6 +1285,27 @@ void MDBalancer::add_import(CDir *dir, utime_t now)
 
 
 
+/*
+ * account a finished request to my measured load, and to the subtree
+ * its inode lives in.  lat runs up to the safe reply, so updates pay
+ * for their journaling too.
+ */
+void MDBalancer::hit_request(utime_t now, CInode *in, utime_t lat)
+{
+  req_cost.hit(now, mds->mdcache->decayrate, (double)lat);
+
+  if (!in)
+    return;
+  CDir *dir = in->get_parent_dir();
+  if (!dir)
+    return;
+  dir = mds->mdcache->get_subtree_root(dir);
+  if (!dir->is_auth())
+    return;
+  subtree_req_cost[dir->dirfrag()].hit(now, mds->mdcache->decayrate, (double)lat);
+}
+
+
 void MDBalancer::show_imports(bool external)
 {
   mds->mdcache->show_subtrees();
@@ -36,7 +36,10 @@ class CDir;
 
 class MDBalancer {
  protected:
+  class AdminHook;
+
   MDS *mds;
+  AdminHook *asok_hook;
   int beat_epoch;
 
   int last_epoch_under;  
@@ -61,6 +64,30 @@ class MDBalancer {
   map<int,double> imported;
   map<int,double> exported;
 
+  // measured request cost (seconds spent per request, to the safe reply),
+  // for the whole rank and for each of my auth subtrees
+  DecayCounter req_cost;
+  map<dirfrag_t, DecayCounter> subtree_req_cost;
+
+  // subtrees we imported recently; held back from export for
+  // mds_bal_import_hold seconds so they don't ping-pong between ranks
+  map<dirfrag_t, utime_t> recent_imports;
+  void trim_recent_imports(utime_t now);
+  bool is_import_held(CDir *dir);
+
+  // estimated load of moving a subtree elsewhere
+  double get_migration_cost(CDir *dir);
+
+  struct planned_export_t {
+    CDir *dir;
+    int target;
+    double pop;
+    const char *reason;
+    planned_export_t(CDir *d, int t, double p, const char *r) :
+      dir(d), target(t), pop(p), reason(r) {}
+  };
+  void plan_exports(list<planned_export_t>& plan);
+
   map<int32_t, int> old_prev_targets;  // # iterations they _haven't_ been targets
   bool check_targets();
 
@@ -74,10 +101,8 @@ class MDBalancer {
   }
 
 public:
-  MDBalancer(MDS *m) : 
-    mds(m),
-    beat_epoch(0),
-    last_epoch_under(0), last_epoch_over(0), my_load(0.0), target_load(0.0) { }
+  MDBalancer(MDS *m);
+  ~MDBalancer();
   
   mds_load_t get_load(utime_t);
 
@@ -111,9 +136,12 @@ public:
   void hit_inode(utime_t now, class CInode *in, int type, int who=-1);
   void hit_dir(utime_t now, class CDir *dir, int type, int who=-1, double amount=1.0);
   void hit_recursive(utime_t now, class CDir *dir, int type, double amount, double rd_adj);
+  void hit_request(utime_t now, CInode *in, utime_t lat);
 
 
   void show_imports(bool external=false);
+  // what try_rebalance would export given the last epoch's targets
+  void dump_plan(Formatter *f);
 
   void queue_split(CDir *dir);
   void queue_merge(CDir *dir);
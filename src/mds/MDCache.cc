@@ -13,6 +13,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -124,6 +125,11 @@ long g_num_dirs = 0;
 long g_num_dns = 0;
 long g_num_caps = 0;
 
+long g_bytes_ino = 0;
+long g_bytes_dir = 0;
+long g_bytes_dn = 0;
+long g_bytes_cap = 0;
+
 set<int> SimpleLock::empty_gather_set;
 
 
@@ -142,6 +148,7 @@ MDCache::MDCache(MDS *m) :
 
   num_inodes_with_caps = 0;
   num_caps = 0;
+  num_strays_purging = 0;
 
   max_dir_commit_size = g_conf->mds_dir_max_commit_size ?
                         (g_conf->mds_dir_max_commit_size << 20) :
@@ -190,6 +197,10 @@ void MDCache::log_stat()
   mds->logger->set(l_mds_iptail, lru.lru_get_pintail());
   mds->logger->set(l_mds_icap, num_inodes_with_caps);
   mds->logger->set(l_mds_cap, num_caps);
+  mds->logger->set(l_mds_strays_purging, num_strays_purging);
+  mds->logger->set(l_mds_purge_ops, mds->filer->get_purge_ops());
+  mds->logger->set(l_mds_purge_objects_queued, mds->filer->get_purge_objects_queued());
+  mds->logger->set(l_mds_purge_objects, mds->filer->get_purge_objects_removed());
 }
 
 
@@ -1446,6 +1457,7 @@ CInode *MDCache::cow_inode(CInode *in, snapid_t last)
   oldin->inode = *in->get_previous_projected_inode();
   oldin->symlink = in->symlink;
   oldin->xattrs = *in->get_previous_projected_xattrs();
+  oldin->update_mem_usage();
 
   oldin->inode.trim_client_ranges(last);
 
@@ -1989,8 +2001,10 @@ void MDCache::predirty_journal_parents(Mutation *mut, EMetaBlob *blob,
       stop = true;
     }
 
-    // delay propagating until later?
-    if (!stop && !first &&
+    // delay propagating until later?  the parent of a busy dir is
+    // left to the scatter nudge, so a burst of creates journals its
+    // inode once rather than once per file.
+    if (!stop && (!first || g_conf->mds_dirstat_batch_parent) &&
 	g_conf->mds_dirstat_min_interval > 0) {
       if (pin->last_dirstat_prop.sec() > 0) {
 	double since_last_prop = mut->now - pin->last_dirstat_prop;
@@ -6012,7 +6026,28 @@ bool MDCache::trim(int max)
   // trim LRU
   if (max < 0) {
     max = g_conf->mds_cache_size;
-    if (!max) return false;
+    uint64_t limit = g_conf->mds_cache_memory_limit;
+    if (!max) {
+      if (!limit)
+	return false;
+      max = INT_MAX;
+    }
+
+    /*
+     * over the memory limit, aim for as many dentries as the limit
+     * holds at the current average size; what can't be expired stays
+     * either way, so this doesn't empty the lru chasing pinned bytes
+     */
+    uint64_t used = get_cache_mem_usage();
+    if (limit && used > limit) {
+      uint64_t fit = (uint64_t)((double)lru.lru_get_size() * limit / used);
+      if (fit < 1)
+	fit = 1;
+      if (fit < (uint64_t)max)
+	max = fit;
+      dout(7) << "trim cache uses " << used << " bytes > limit " << limit
+	      << ", max dentries " << max << dendl;
+    }
   }
   dout(7) << "trim max=" << max << "  cur=" << lru.lru_get_size() << dendl;
 
@@ -6818,7 +6853,13 @@ void MDCache::check_memory_usage()
       mds->server->recall_client_state(ratio);
   } else 
     */
-  if (num_inodes_with_caps > g_conf->mds_cache_size) {
+  uint64_t used = get_cache_mem_usage();
+  uint64_t limit = g_conf->mds_cache_memory_limit;
+  if (limit && used > limit) {
+    /* the clients' caps keep their inodes in the cache */
+    float ratio = (float)limit * .9 / (float)used;
+    mds->server->recall_client_state(ratio);
+  } else if (g_conf->mds_cache_size && num_inodes_with_caps > g_conf->mds_cache_size) {
     float ratio = (float)g_conf->mds_cache_size * .9 / (float)num_inodes_with_caps;
     if (ratio < 1.0)
       mds->server->recall_client_state(ratio);
@@ -7481,7 +7522,10 @@ int MDCache::path_traverse(MDRequest *mdr, Message *req, Context *fin,     // wh
 	// directory isn't complete; reload
         dout(7) << "traverse: incomplete dir contents for " << *cur << ", fetching" << dendl;
         touch_inode(cur);
-        curdir->fetch(_get_waiter(mdr, req, fin), path[depth]);
+        if (snapid == CEPH_NOSNAP)
+          curdir->fetch_dentry(_get_waiter(mdr, req, fin), path[depth]);
+        else
+          curdir->fetch(_get_waiter(mdr, req, fin), path[depth]);
 	if (mds->logger) mds->logger->inc(l_mds_tdirf);
         return 1;
       }
@@ -9318,6 +9362,7 @@ void MDCache::purge_stray(CDentry *dn)
   dn->state_set(CDentry::STATE_PURGING);
   dn->get(CDentry::PIN_PURGING);
   in->state_set(CInode::STATE_PURGING);
+  num_strays_purging++;
 
   if (dn->item_stray.is_on_list())
     dn->item_stray.remove_myself();
@@ -9497,6 +9542,8 @@ void MDCache::_purge_stray_logged(CDentry *dn, version_t pdv, LogSegment *ls)
   in->state_clear(CInode::STATE_ORPHAN);
   dn->state_clear(CDentry::STATE_PURGING);
   dn->put(CDentry::PIN_PURGING);
+  num_strays_purging--;
+  mds->logger->inc(l_mds_strays_purged);
 
   // drop inode
   if (in->is_dirty())
@@ -9520,6 +9567,7 @@ void MDCache::_purge_stray_logged_truncate(CDentry *dn, LogSegment *ls)
 
   dn->state_clear(CDentry::STATE_PURGING);
   dn->put(CDentry::PIN_PURGING);
+  num_strays_purging--;
 
   in->pop_and_dirty_projected_inode(ls);
 
@@ -10913,18 +10961,57 @@ bool MDCache::can_fragment(CInode *diri, list<CDir*>& dirs)
   return true;
 }
 
+class C_MDC_SplitDir : public Context {
+  MDCache *mdcache;
+  dirfrag_t dirfrag;
+  int bits;
+public:
+  C_MDC_SplitDir(MDCache *m, dirfrag_t df, int b) : mdcache(m), dirfrag(df), bits(b) {}
+  virtual void finish(int r) {
+    CDir *dir = mdcache->get_dirfrag(dirfrag);
+    if (dir && dir->is_auth())
+      mdcache->split_dir(dir, bits);
+  }
+};
+
+class C_MDC_MergeDir : public Context {
+  MDCache *mdcache;
+  inodeno_t ino;
+  frag_t frag;
+public:
+  C_MDC_MergeDir(MDCache *m, inodeno_t i, frag_t f) : mdcache(m), ino(i), frag(f) {}
+  virtual void finish(int r) {
+    CInode *diri = mdcache->get_inode(ino);
+    if (diri)
+      mdcache->merge_dir(diri, frag);
+  }
+};
+
 void MDCache::split_dir(CDir *dir, int bits)
 {
   dout(7) << "split_dir " << *dir << " bits " << bits << dendl;
   assert(dir->is_auth());
   CInode *diri = dir->inode;
 
+  if (dir->get_frag().bits() + bits > 24) {
+    dout(7) << "split_dir " << *dir << " is as split as it gets" << dendl;
+    return;
+  }
+
   list<CDir*> dirs;
   dirs.push_back(dir);
 
   if (!can_fragment(diri, dirs))
     return;
 
+  // read it in before freezing, so requests on it don't wait on the
+  // fetch as well.
+  if (!dir->is_complete()) {
+    dout(10) << " fetching " << *dir << " before freezing it" << dendl;
+    dir->fetch(new C_MDC_SplitDir(this, dir->dirfrag(), bits));
+    return;
+  }
+
   C_GatherBuilder gather(g_ceph_context, 
 	  new C_MDC_FragmentFrozen(this, dirs, dir->get_frag(), bits));
   fragment_freeze_dirs(dirs, gather);
@@ -10952,6 +11039,19 @@ void MDCache::merge_dir(CInode *diri, frag_t frag)
   if (!can_fragment(diri, dirs))
     return;
 
+  C_GatherBuilder fetch_gather(g_ceph_context);
+  for (list<CDir*>::iterator p = dirs.begin(); p != dirs.end(); ++p) {
+    if (!(*p)->is_complete()) {
+      dout(10) << " fetching " << **p << " before freezing it" << dendl;
+      (*p)->fetch(fetch_gather.new_sub());
+    }
+  }
+  if (fetch_gather.has_subs()) {
+    fetch_gather.set_finisher(new C_MDC_MergeDir(this, diri->ino(), frag));
+    fetch_gather.activate();
+    return;
+  }
+
   CDir *first = dirs.front();
   int bits = first->get_frag().bits() - frag.bits();
   dout(10) << " we are merginb by " << bits << " bits" << dendl;
@@ -106,6 +106,7 @@ public:
 
   int num_inodes_with_caps;
   int num_caps;
+  int num_strays_purging;  ///< waiting for their objects to be removed or the purge logged
 
   unsigned max_dir_commit_size;
 
@@ -554,6 +555,9 @@ public:
   
   // debug
   void log_stat();
+  uint64_t get_cache_mem_usage() {
+    return g_bytes_ino + g_bytes_dir + g_bytes_dn + g_bytes_cap;
+  }
 
   // root inode
   CInode *get_root() { return root; }
@@ -69,6 +69,14 @@ void MDLog::create_logger()
   plb.add_u64(l_mdl_rdpos, "rdpos");
   plb.add_u64(l_mdl_jlat, "jlat");
 
+  // events per journal write
+  plb.add_u64_avg(l_mdl_jflushev, "jflushev");
+  plb.add_u64_counter(l_mdl_jflush1, "jflush1");
+  plb.add_u64_counter(l_mdl_jflush4, "jflush4");
+  plb.add_u64_counter(l_mdl_jflush16, "jflush16");
+  plb.add_u64_counter(l_mdl_jflush64, "jflush64");
+  plb.add_u64_counter(l_mdl_jflushmore, "jflushmore");
+
   // logger
   logger = plb.create_perf_counters();
   g_ceph_context->get_perfcounters_collection()->add(logger);
@@ -86,6 +94,7 @@ void MDLog::init_journaler()
 			    &mds->timer);
   assert(journaler->is_readonly());
   journaler->set_write_error_handler(new C_MDL_WriteError(this));
+  journaler->set_flush_entries_logger_key(l_mdl_jflushev);
 }
 
 void MDLog::handle_journaler_write_error(int r)
@@ -645,3 +654,43 @@ void MDLog::standby_trim_segments()
   } else
     dout(20) << " removed no segments!" << dendl;
 }
+
+/*
+ * Read in the dirfrags the journal has touched, a few per replay pass,
+ * so that on takeover they are in cache instead of being read in as
+ * clients (and rejoin) come asking.
+ */
+void MDLog::standby_prefetch_dirfrags()
+{
+  int max = g_conf->mds_standby_prefetch_dirfrags;
+  if (max <= 0)
+    return;
+
+  MDCache *mdcache = mds->mdcache;
+  int fetching = 0;
+  for (map<uint64_t,LogSegment*>::iterator p = segments.begin();
+       p != segments.end() && fetching < max;
+       ++p) {
+    for (elist<CDir*>::iterator q = p->second->dirty_dirfrags.begin();
+	 !q.end() && fetching < max;
+	 ++q) {
+      CDir *dir = *q;
+      if (dir->is_complete() ||
+	  !dir->is_auth() ||
+	  dir->state_test(CDir::STATE_FETCHING))
+	continue;
+      if ((g_conf->mds_cache_size > 0 &&
+	   mdcache->lru.lru_get_size() >= (unsigned)g_conf->mds_cache_size) ||
+	  (g_conf->mds_cache_memory_limit > 0 &&
+	   mdcache->get_cache_mem_usage() >= g_conf->mds_cache_memory_limit)) {
+	dout(10) << "standby_prefetch_dirfrags cache is full" << dendl;
+	return;
+      }
+      dout(15) << "standby_prefetch_dirfrags fetching " << *dir << dendl;
+      dir->fetch(NULL);
+      fetching++;
+    }
+  }
+  if (fetching)
+    dout(10) << "standby_prefetch_dirfrags fetching " << fetching << " dirfrags" << dendl;
+}
@@ -34,6 +34,12 @@ enum {
   l_mdl_wrpos,
   l_mdl_rdpos,
   l_mdl_jlat,
+  l_mdl_jflushev,
+  l_mdl_jflush1,
+  l_mdl_jflush4,
+  l_mdl_jflush16,
+  l_mdl_jflush64,
+  l_mdl_jflushmore,
   l_mdl_last,
 };
 
@@ -244,6 +250,7 @@ public:
   void replay(Context *onfinish);
 
   void standby_trim_segments();
+  void standby_prefetch_dirfrags();
 };
 
 #endif
@@ -64,6 +64,7 @@
 
 #include "messages/MClientRequest.h"
 #include "messages/MClientRequestForward.h"
+#include "messages/MClientCaps.h"
 
 #include "messages/MMDSTableRequest.h"
 
@@ -120,7 +121,7 @@ MDS::MDS(const std::string &n, Messenger *m, MonClient *mc) :
   objecter = new Objecter(m->cct, messenger, monc, osdmap, mds_lock, timer);
   objecter->unset_honor_osdmap_full();
 
-  filer = new Filer(objecter);
+  filer = new Filer(objecter, &timer);
 
   mdcache = new MDCache(this);
   mdlog = new MDLog(this);
@@ -145,6 +146,7 @@ MDS::MDS(const std::string &n, Messenger *m, MonClient *mc) :
 
   // tick
   tick_event = 0;
+  cap_batch_flush = 0;
 
   req_rate = 0;
 
@@ -232,6 +234,13 @@ void MDS::create_logger()
     mds_plb.add_u64_counter(l_mds_iex, "iex");
     mds_plb.add_u64_counter(l_mds_icap, "icap");
     mds_plb.add_u64_counter(l_mds_cap, "cap");
+    mds_plb.add_u64_counter(l_mds_cap_batched, "cap_batched"); // grants/revokes/flush acks held for a batch
+
+    mds_plb.add_u64(l_mds_strays_purging, "strays_purging");
+    mds_plb.add_u64_counter(l_mds_strays_purged, "strays_purged");
+    mds_plb.add_u64(l_mds_purge_ops, "purge_ops");  // object removes in flight
+    mds_plb.add_u64(l_mds_purge_objects_queued, "purge_objects_queued");
+    mds_plb.add_u64_counter(l_mds_purge_objects, "purge_objects");
     
     mds_plb.add_u64_counter(l_mds_dis, "dis"); // FIXME: unused
 
@@ -275,6 +284,12 @@ void MDS::create_logger()
     mdm_plb.add_u64(l_mdm_heap, "heap");
     mdm_plb.add_u64(l_mdm_malloc, "malloc");
     mdm_plb.add_u64(l_mdm_buf, "buf");
+    mdm_plb.add_u64(l_mdm_ino_bytes, "ino_bytes");
+    mdm_plb.add_u64(l_mdm_dir_bytes, "dir_bytes");
+    mdm_plb.add_u64(l_mdm_dn_bytes, "dn_bytes");
+    mdm_plb.add_u64(l_mdm_cap_bytes, "cap_bytes");
+    mdm_plb.add_u64(l_mdm_cache_bytes, "cache_bytes");
+    mdm_plb.add_u64(l_mdm_cache_limit, "cache_limit");
     mlogger = mdm_plb.create_perf_counters();
     g_ceph_context->get_perfcounters_collection()->add(mlogger);
   }
@@ -408,6 +423,21 @@ void MDS::send_message_client_counted(Message *m, Connection *connection)
 
 void MDS::send_message_client_counted(Message *m, Session *session)
 {
+  if (m->get_type() == CEPH_MSG_CLIENT_CAPS &&
+      g_conf->mds_cap_batch_window > 0 &&
+      session->connection &&
+      session->connection->has_feature(CEPH_FEATURE_MDS_CAPS_BATCH)) {
+    int op = static_cast<MClientCaps*>(m)->get_op();
+    if (op == CEPH_CAP_OP_GRANT || op == CEPH_CAP_OP_REVOKE ||
+	op == CEPH_CAP_OP_FLUSH_ACK) {
+      batch_cap_message(static_cast<MClientCaps*>(m), session);
+      return;
+    }
+  }
+
+  // keep the client's view of the push order
+  flush_cap_batch(session);
+
   version_t seq = session->inc_push_seq();
   dout(10) << "send_message_client_counted " << session->info.inst.name << " seq "
 	   << seq << " " << *m << dendl;
@@ -421,6 +451,7 @@ void MDS::send_message_client_counted(Message *m, Session *session)
 void MDS::send_message_client(Message *m, Session *session)
 {
   dout(10) << "send_message_client " << session->info.inst << " " << *m << dendl;
+  flush_cap_batch(session);
  if (session->connection) {
     messenger->send_message(m, session->connection);
   } else {
@@ -428,6 +459,68 @@ void MDS::send_message_client(Message *m, Session *session)
   }
 }
 
+/*
+ * cap grants, revokes and flush acks to the same client are held for up to
+ * mds_cap_batch_window seconds and go out piggybacked on a single
+ * message.  each one still counts as a push to the client, which
+ * unpacks them in order.
+ */
+void MDS::batch_cap_message(MClientCaps *m, Session *session)
+{
+  version_t seq = session->inc_push_seq();
+  client_t client = session->get_client();
+  dout(10) << "batch_cap_message " << session->info.inst.name << " seq "
+	   << seq << " " << *m << dendl;
+  logger->inc(l_mds_cap_batched);
+
+  map<client_t, MClientCaps*>::iterator p = cap_batch.find(client);
+  if (p == cap_batch.end()) {
+    cap_batch[client] = m;
+  } else {
+    p->second->add_batched(m);
+    m->put();
+    if (p->second->batched.size() + 1 >= (unsigned)g_conf->mds_cap_batch_max) {
+      flush_cap_batch(session);
+      return;
+    }
+  }
+
+  if (!cap_batch_flush) {
+    cap_batch_flush = new C_MDS_FlushCapBatches(this);
+    timer.add_event_after(g_conf->mds_cap_batch_window, cap_batch_flush);
+  }
+}
+
+void MDS::flush_cap_batch(Session *session)
+{
+  map<client_t, MClientCaps*>::iterator p = cap_batch.find(session->get_client());
+  if (p == cap_batch.end())
+    return;
+  MClientCaps *m = p->second;
+  cap_batch.erase(p);
+  dout(10) << "flush_cap_batch " << session->info.inst.name << " " << *m << dendl;
+  if (session->connection)
+    messenger->send_message(m, session->connection);
+  else
+    session->preopen_out_queue.push_back(m);
+}
+
+void MDS::flush_cap_batches()
+{
+  while (!cap_batch.empty()) {
+    client_t client = cap_batch.begin()->first;
+    Session *session = sessionmap.get_session(entity_name_t::CLIENT(client.v));
+    if (session) {
+      flush_cap_batch(session);
+    } else {
+      dout(10) << "flush_cap_batches no session for client." << client
+	       << ", dropping " << *cap_batch.begin()->second << dendl;
+      cap_batch.begin()->second->put();
+      cap_batch.erase(cap_batch.begin());
+    }
+  }
+}
+
 int MDS::init(int wanted_state)
 {
   dout(10) << sizeof(MDSCacheObject) << "\tMDSCacheObject" << dendl;
@@ -577,6 +670,32 @@ void MDS::tick()
     mdcache->log_stat();
   }
 
+  // cache counts, once a tick rather than for every message
+  if (mlogger) {
+    mlogger->set(l_mdm_ino, g_num_ino);
+    mlogger->set(l_mdm_dir, g_num_dir);
+    mlogger->set(l_mdm_dn, g_num_dn);
+    mlogger->set(l_mdm_cap, g_num_cap);
+
+    mlogger->inc(l_mdm_inoa, g_num_inoa);  g_num_inoa = 0;
+    mlogger->inc(l_mdm_inos, g_num_inos);  g_num_inos = 0;
+    mlogger->inc(l_mdm_dira, g_num_dira);  g_num_dira = 0;
+    mlogger->inc(l_mdm_dirs, g_num_dirs);  g_num_dirs = 0;
+    mlogger->inc(l_mdm_dna, g_num_dna);  g_num_dna = 0;
+    mlogger->inc(l_mdm_dns, g_num_dns);  g_num_dns = 0;
+    mlogger->inc(l_mdm_capa, g_num_capa);  g_num_capa = 0;
+    mlogger->inc(l_mdm_caps, g_num_caps);  g_num_caps = 0;
+
+    mlogger->set(l_mdm_buf, buffer::get_total_alloc());
+
+    mlogger->set(l_mdm_ino_bytes, g_bytes_ino);
+    mlogger->set(l_mdm_dir_bytes, g_bytes_dir);
+    mlogger->set(l_mdm_dn_bytes, g_bytes_dn);
+    mlogger->set(l_mdm_cap_bytes, g_bytes_cap);
+    mlogger->set(l_mdm_cache_bytes, mdcache->get_cache_mem_usage());
+    mlogger->set(l_mdm_cache_limit, g_conf->mds_cache_memory_limit);
+  }
+
   // ...
   if (is_clientreplay() || is_active() || is_stopping()) {
     locker->scatter_tick();
@@ -1393,6 +1512,7 @@ void MDS::replay_done()
   }
 
   if (is_standby_replay()) {
+    mdlog->standby_prefetch_dirfrags();
     dout(10) << "setting replay timer" << dendl;
     timer.add_event_after(g_conf->mds_replay_interval,
                           new C_MDS_StandbyReplayRestart(this));
@@ -1632,6 +1752,11 @@ void MDS::suicide()
     timer.cancel_event(tick_event);
     tick_event = 0;
   }
+  if (cap_batch_flush) {
+    timer.cancel_event(cap_batch_flush);
+    cap_batch_flush = 0;
+  }
+  flush_cap_batches();
   timer.cancel_all_events();
   //timer.join();
   timer.shutdown();
@@ -2009,25 +2134,6 @@ bool MDS::_dispatch(Message *m)
   }
   */
 
-  if (mlogger) {
-    mlogger->set(l_mdm_ino, g_num_ino);
-    mlogger->set(l_mdm_dir, g_num_dir);
-    mlogger->set(l_mdm_dn, g_num_dn);
-    mlogger->set(l_mdm_cap, g_num_cap);
-
-    mlogger->inc(l_mdm_inoa, g_num_inoa);  g_num_inoa = 0;
-    mlogger->inc(l_mdm_inos, g_num_inos);  g_num_inos = 0;
-    mlogger->inc(l_mdm_dira, g_num_dira);  g_num_dira = 0;
-    mlogger->inc(l_mdm_dirs, g_num_dirs);  g_num_dirs = 0;
-    mlogger->inc(l_mdm_dna, g_num_dna);  g_num_dna = 0;
-    mlogger->inc(l_mdm_dns, g_num_dns);  g_num_dns = 0;
-    mlogger->inc(l_mdm_capa, g_num_capa);  g_num_capa = 0;
-    mlogger->inc(l_mdm_caps, g_num_caps);  g_num_caps = 0;
-
-    mlogger->set(l_mdm_buf, buffer::get_total_alloc());
-
-  }
-
   // shut down?
   if (is_stopping()) {
     mdlog->trim();
@@ -74,6 +74,12 @@ enum {
   l_mds_iexp,
   l_mds_im,
   l_mds_iim,
+  l_mds_cap_batched,
+  l_mds_strays_purging,
+  l_mds_strays_purged,
+  l_mds_purge_ops,
+  l_mds_purge_objects_queued,
+  l_mds_purge_objects,
   l_mds_last,
 };
 
@@ -100,6 +106,12 @@ enum {
   l_mdm_heap,
   l_mdm_malloc,
   l_mdm_buf,
+  l_mdm_ino_bytes,
+  l_mdm_dir_bytes,
+  l_mdm_dn_bytes,
+  l_mdm_cap_bytes,
+  l_mdm_cache_bytes,
+  l_mdm_cache_limit,
   l_mdm_last,
 };
 
@@ -127,6 +139,7 @@ class Messenger;
 class Message;
 
 class MClientRequest;
+class MClientCaps;
 class MClientReply;
 
 class MMDSBeacon;
@@ -303,6 +316,21 @@ class MDS : public Dispatcher {
   } *tick_event;
   void     reset_tick();
 
+  // -- cap grant/revoke batching --
+  map<client_t, MClientCaps*> cap_batch;
+  class C_MDS_FlushCapBatches : public Context {
+    MDS *mds;
+  public:
+    C_MDS_FlushCapBatches(MDS *m) : mds(m) {}
+    void finish(int r) {
+      mds->cap_batch_flush = 0;
+      mds->flush_cap_batches();
+    }
+  } *cap_batch_flush;
+  void batch_cap_message(MClientCaps *m, Session *session);
+  void flush_cap_batch(Session *session);
+  void flush_cap_batches();
+
   // -- client map --
   SessionMap   sessionmap;
   epoch_t      last_client_mdsmap_bcast;
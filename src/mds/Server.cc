@@ -55,6 +55,8 @@
 #include "include/filepath.h"
 #include "common/Timer.h"
 #include "common/perf_counters.h"
+#include "common/admin_socket.h"
+#include "common/Formatter.h"
 #include "include/compat.h"
 #include "osd/OSDMap.h"
 
@@ -71,6 +73,54 @@ using namespace std;
 #undef dout_prefix
 #define dout_prefix *_dout << "mds." << mds->get_nodeid() << ".server "
 
+class Server::AdminHook : public AdminSocketHook {
+  Server *server;
+public:
+  AdminHook(Server *s) : server(s) {}
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+	    bufferlist& out) {
+    if (format == "")
+      format = "json-pretty";
+    Formatter *f = new_formatter(format);
+    stringstream ss;
+    server->mds->mds_lock.Lock();
+    server->dump_sessions(f);
+    server->mds->mds_lock.Unlock();
+    f->flush(ss);
+    delete f;
+    out.append(ss);
+    return true;
+  }
+};
+
+Server::Server(MDS *m) :
+  mds(m),
+  mdcache(mds->mdcache), mdlog(mds->mdlog),
+  messenger(mds->messenger),
+  logger(0), asok_hook(NULL),
+  failed_reconnects(0),
+  terminating_sessions(false)
+{
+  asok_hook = new AdminHook(this);
+  int r = g_ceph_context->get_admin_socket()->register_command(
+    "dump_sessions", "dump_sessions", asok_hook,
+    "show client sessions with their request counts, caps and recalls");
+  if (r < 0) {
+    delete asok_hook;
+    asok_hook = NULL;
+  }
+}
+
+Server::~Server()
+{
+  if (asok_hook) {
+    g_ceph_context->get_admin_socket()->unregister_command("dump_sessions");
+    delete asok_hook;
+  }
+  g_ceph_context->get_perfcounters_collection()->remove(logger);
+  delete logger;
+}
+
 void Server::create_logger()
 {
   PerfCountersBuilder plb(g_ceph_context, "mds_server", l_mdss_first, l_mdss_last);
@@ -505,6 +555,7 @@ void Server::journal_close_session(Session *session, int state)
   both.swap(session->info.prealloc_inos);
   both.insert(session->pending_prealloc_inos);
   session->pending_prealloc_inos.clear();
+  session->delegated_inos.clear();
   if (both.size()) {
     mds->inotable->project_release_ids(both);
     piv = mds->inotable->get_projected_version();
@@ -707,17 +758,23 @@ void Server::recover_filelocks(CInode *in, bufferlist locks, int64_t client)
   }
 }
 
+/*
+ * shrink the caps clients hold to ratio of the total, taking them from
+ * the heaviest holders first: every session is let keep up to a common
+ * level, chosen so the sessions' caps, each cut to that level, add up
+ * to the target.  sessions under the level aren't asked for anything.
+ */
 void Server::recall_client_state(float ratio)
 {
-  int max_caps_per_client = (int)(g_conf->mds_cache_size * .8);
-  int min_caps_per_client = 100;
-
-  dout(10) << "recall_client_state " << ratio
-	   << ", caps per client " << min_caps_per_client << "-" << max_caps_per_client
-	   << dendl;
+  size_t max_caps_per_client = (size_t)(g_conf->mds_cache_size * .8);
+  size_t min_caps_per_client = 100;
+  utime_t now = ceph_clock_now(g_ceph_context);
 
   set<Session*> sessions;
   mds->sessionmap.get_client_session_set(sessions);
+
+  multimap<size_t,Session*> by_caps;
+  size_t total = 0;
   for (set<Session*>::const_iterator p = sessions.begin();
        p != sessions.end();
        ++p) {
@@ -725,22 +782,53 @@ void Server::recall_client_state(float ratio)
     if (!session->is_open() ||
 	!session->info.inst.name.is_client())
       continue;
+    session->check_recall(now, g_conf->mds_recall_state_timeout);
+    by_caps.insert(make_pair(session->caps.size(), session));
+    total += session->caps.size();
+  }
+
+  // find the level
+  double left = total * ratio;
+  size_t n = by_caps.size();
+  double level = max_caps_per_client;
+  for (multimap<size_t,Session*>::iterator p = by_caps.begin();
+       p != by_caps.end();
+       ++p, --n) {
+    double share = left / n;
+    if (p->first > share) {
+      level = MIN(share, level);
+      break;
+    }
+    left -= p->first;
+  }
+  if (level < min_caps_per_client)
+    level = min_caps_per_client;
+
+  dout(10) << "recall_client_state " << ratio << ", " << total << " caps over "
+	   << by_caps.size() << " sessions, recalling to " << (size_t)level
+	   << " per client" << dendl;
 
+  for (multimap<size_t,Session*>::reverse_iterator p = by_caps.rbegin();
+       p != by_caps.rend() && p->first > level;
+       ++p) {
+    Session *session = p->second;
     dout(10) << " session " << session->info.inst
 	     << " caps " << session->caps.size()
 	     << ", leases " << session->leases.size()
+	     << ", recalls " << session->recall_count
+	     << " (" << session->recall_ignored << " ignored)"
 	     << dendl;
-
-    if (session->caps.size() > min_caps_per_client) {	
-      int newlim = (int)(session->caps.size() * ratio);
-      if (newlim > max_caps_per_client)
-	newlim = max_caps_per_client;
-      MClientSession *m = new MClientSession(CEPH_SESSION_RECALL_STATE);
-      m->head.max_caps = newlim;
-      mds->send_message_client(m, session);
-    }
+    MClientSession *m = new MClientSession(CEPH_SESSION_RECALL_STATE);
+    m->head.max_caps = (size_t)level;
+    mds->send_message_client(m, session);
+    session->note_recall((size_t)level, now);
   }
- 
+}
+
+void Server::dump_sessions(Formatter *f)
+{
+  mds->sessionmap.dump_stats(f, ceph_clock_now(g_ceph_context),
+			     mdcache->decayrate);
 }
 
 
@@ -842,6 +930,8 @@ void Server::early_reply(MDRequest *mdr, CInode *tracei, CDentry *tracedn)
   }
 
   reply->set_extra_bl(mdr->reply_extra_bl);
+  if (mdr->session)
+    mds->flush_cap_batch(mdr->session);
   messenger->send_message(reply, req->get_connection());
 
   mdr->did_early_reply = true;
@@ -887,6 +977,12 @@ void Server::reply_request(MDRequest *mdr, MClientReply *reply, CInode *tracei,
   entity_inst_t client_inst = req->get_source_inst();
   int dentry_wanted = req->get_dentry_wanted();
 
+  if (!is_replay) {
+    utime_t now = ceph_clock_now(g_ceph_context);
+    mds->balancer->hit_request(now, mdr->in[0] ? mdr->in[0] : tracei,
+			       now - req->get_recv_stamp());
+  }
+
   if (!did_early_reply && !is_replay) {
 
     mds->logger->inc(l_mds_reply);
@@ -926,6 +1022,8 @@ void Server::reply_request(MDRequest *mdr, MClientReply *reply, CInode *tracei,
     }
 
     reply->set_mdsmap_epoch(mds->mdsmap->get_epoch());
+    if (session)
+      mds->flush_cap_batch(session);
     messenger->send_message(reply, client_con);
   }
   
@@ -1111,6 +1209,10 @@ void Server::handle_client_request(MClientRequest *req)
     }
   }
 
+  if (session && !req->is_replay())
+    session->hit_request(req->get_op(), ceph_clock_now(g_ceph_context),
+			 mdcache->decayrate);
+
   // trim completed_request list
   if (req->get_oldest_client_tid() > 0) {
     dout(15) << " oldest_client_tid=" << req->get_oldest_client_tid() << dendl;
@@ -1844,11 +1946,18 @@ CInode* Server::prepare_new_inode(MDRequest *mdr, CDir *dir, inodeno_t useino, u
   }
 
   if (useino && useino != in->inode.ino) {
-    dout(0) << "WARNING: client specified " << useino << " and i allocated " << in->inode.ino << dendl;
-    mds->clog.error() << mdr->client_request->get_source()
-       << " specified ino " << useino
-       << " but mds." << mds->whoami << " allocated " << in->inode.ino << "\n";
-    //assert(0); // just for now.
+    if (mdr->client_request->is_replay()) {
+      dout(0) << "WARNING: client specified " << useino << " and i allocated " << in->inode.ino << dendl;
+      mds->clog.error() << mdr->client_request->get_source()
+	 << " specified ino " << useino
+	 << " but mds." << mds->whoami << " allocated " << in->inode.ino << "\n";
+      //assert(0); // just for now.
+    } else {
+      // a delegated ino from another mds (we were forwarded the
+      // request), or from before we restarted
+      dout(10) << "prepare_new_inode client asked for " << useino
+	       << ", not delegated here, used " << in->inode.ino << dendl;
+    }
   }
     
   int got = g_conf->mds_client_prealloc_inos - mdr->session->get_num_projected_prealloc_inos();
@@ -2279,6 +2388,16 @@ void Server::handle_client_getattr(MDRequest *mdr, bool is_lookup)
   if ((mask & CEPH_CAP_FILE_SHARED) && (issued & CEPH_CAP_FILE_EXCL) == 0) rdlocks.insert(&ref->filelock);
   if ((mask & CEPH_CAP_XATTR_SHARED) && (issued & CEPH_CAP_XATTR_EXCL) == 0) rdlocks.insert(&ref->xattrlock);
 
+  // rstat propagation is deferred (mds_dirstat_min_interval); gather
+  // the dirfrags' pending rstat if it has been waiting too long.
+  if ((mask & CEPH_CAP_FILE_SHARED) && ref->is_dir() && ref->is_auth() &&
+      g_conf->mds_rstat_max_stale > 0 && ref->nestlock.is_dirty() &&
+      ceph_clock_now(g_ceph_context) - ref->nestlock.get_update_stamp() >= g_conf->mds_rstat_max_stale) {
+    dout(10) << " rstat dirty since " << ref->nestlock.get_update_stamp()
+	     << ", rdlocking " << ref->nestlock << dendl;
+    rdlocks.insert(&ref->nestlock);
+  }
+
   if (!mds->locker->acquire_locks(mdr, rdlocks, wrlocks, xlocks))
     return;
 
@@ -2704,6 +2823,14 @@ void Server::handle_client_openc(MDRequest *mdr)
     dout(10) << "adding ino to reply to indicate inode was created" << dendl;
     // add the file created flag onto the reply if create_flags features is supported
     ::encode(in->inode.ino, mdr->reply_extra_bl);
+
+    // and top up the inos the client may pick for its next creates
+    if (req->get_flags() & CEPH_MDS_FLAG_WANT_INOS) {
+      interval_set<inodeno_t> fresh;
+      mdr->session->delegate_inos(g_conf->mds_client_delegate_inos, fresh);
+      dout(10) << "delegating " << fresh << " to the client" << dendl;
+      ::encode(fresh, mdr->reply_extra_bl);
+    }
   }
 
   journal_and_reply(mdr, in, dn, le, fin);
@@ -2792,6 +2919,11 @@ void Server::handle_client_readdir(MDRequest *mdr)
   if (!max_bytes)
     max_bytes = 512 << 10;  // 512 KB?
 
+  // readdirplus: the client is going to stat what we send, so start
+  // making the entries' stat readable for it now, all at once, rather
+  // than one getattr at a time.
+  bool plus = req->is_readdirplus() && snapid == CEPH_NOSNAP;
+
   // start final blob
   bufferlist dirbl;
   dir->encode_dirstat(dirbl, mds->get_nodeid());
@@ -2879,6 +3011,9 @@ void Server::handle_client_readdir(MDRequest *mdr)
     ::encode(dn->name, dnbl);
     mds->locker->issue_client_lease(dn, client, dnbl, mdr->now, mdr->session);
 
+    if (plus && in->is_auth() && !in->is_frozen())
+      readdir_kick_stat_locks(in, client);
+
     // inode
     dout(12) << "including inode " << *in << dendl;
     int r = in->encode_inodestat(dnbl, mdr->session, realm, snapid, bytes_left - (int)dnbl.length());
@@ -2926,6 +3061,25 @@ void Server::handle_client_readdir(MDRequest *mdr)
   reply_request(mdr, reply, diri);
 }
 
+/*
+ * start moving the locks a stat needs toward a state the client can
+ * read them in, so the caps we hand out with the readdir cover them.
+ * we don't wait; anything not readable yet is readable by the time
+ * the getattr for it shows up.  dir filelocks are left alone, their
+ * dirstat would have to be gathered from the replicas.
+ */
+void Server::readdir_kick_stat_locks(CInode *in, client_t client)
+{
+  SimpleLock *locks[] = { &in->authlock, &in->linklock, &in->xattrlock, &in->filelock };
+  int n = in->is_dir() ? 3 : 4;
+  for (int i = 0; i < n; i++) {
+    if (locks[i]->is_stable() && !locks[i]->can_rdlock(client)) {
+      dout(20) << "readdir_kick_stat_locks " << *locks[i] << " on " << *in << dendl;
+      mds->locker->_rdlock_kick(locks[i], true);  // SYNC, not XSYN: we want shared caps out
+    }
+  }
+}
+
 
 
 // ===============================================================================
@@ -4075,6 +4229,7 @@ void Server::handle_client_symlink(MDRequest *mdr)
   dn->push_projected_linkage(newi);
 
   newi->symlink = req->get_path2();
+  newi->update_mem_usage();
   newi->inode.size = newi->symlink.length();
   newi->inode.rstat.rbytes = newi->inode.size;
   newi->inode.rstat.rfiles = 1;
@@ -37,29 +37,22 @@ enum {
 };
 
 class Server {
+  class AdminHook;
+
   MDS *mds;
   MDCache *mdcache;
   MDLog *mdlog;
   Messenger *messenger;
   PerfCounters *logger;
+  AdminHook *asok_hook;
 
 public:
   int failed_reconnects;
 
   bool terminating_sessions;
 
-  Server(MDS *m) : 
-    mds(m), 
-    mdcache(mds->mdcache), mdlog(mds->mdlog),
-    messenger(mds->messenger),
-    logger(0),
-    failed_reconnects(0),
-    terminating_sessions(false) {
-  }
-  ~Server() {
-    g_ceph_context->get_perfcounters_collection()->remove(logger);
-    delete logger;
-  }
+  Server(MDS *m);
+  ~Server();
 
   void create_logger();
 
@@ -91,6 +84,7 @@ public:
   void recover_filelocks(CInode *in, bufferlist locks, int64_t client);
 
   void recall_client_state(float ratio);
+  void dump_sessions(Formatter *f);
 
   // -- requests --
   void handle_client_request(MClientRequest *m);
@@ -143,6 +137,7 @@ public:
   void handle_client_lookup_ino(MDRequest *mdr);
   void _lookup_ino_2(MDRequest *mdr, int r);
   void handle_client_readdir(MDRequest *mdr);
+  void readdir_kick_stat_locks(CInode *in, client_t client);
   void handle_client_file_setlock(MDRequest *mdr);
   void handle_client_file_readlock(MDRequest *mdr);
 
@@ -235,6 +235,39 @@ void SessionMap::dump(Formatter *f) const
   f->close_section(); // Sessions
 }
 
+void Session::dump_stats(Formatter *f, utime_t now, const DecayRate& rate)
+{
+  f->dump_stream("name") << info.inst.name;
+  f->dump_stream("addr") << info.inst.addr;
+  f->dump_string("state", get_state_name());
+  f->dump_float("request_load", req_load.get(now, rate));
+  f->open_object_section("requests");
+  for (map<int,uint64_t>::iterator p = op_count.begin(); p != op_count.end(); ++p)
+    f->dump_unsigned(ceph_mds_op_name(p->first), p->second);
+  f->close_section();
+  f->dump_unsigned("caps", caps.size());
+  f->dump_unsigned("leases", leases.size());
+  f->dump_unsigned("recalls", recall_count);
+  f->dump_unsigned("recalls_ignored", recall_ignored);
+  f->dump_unsigned("recall_pending_limit", recall_limit);
+}
+
+void SessionMap::dump_stats(Formatter *f, utime_t now, const DecayRate& rate)
+{
+  f->open_array_section("sessions");
+  for (hash_map<entity_name_t,Session*>::iterator p = session_map.begin();
+       p != session_map.end();
+       ++p) {
+    if (!p->first.is_client())
+      continue;
+    p->second->check_recall(now, g_conf->mds_recall_state_timeout);
+    f->open_object_section("session");
+    p->second->dump_stats(f, now, rate);
+    f->close_section();
+  }
+  f->close_section();
+}
+
 void SessionMap::generate_test_instances(list<SessionMap*>& ls)
 {
   // pretty boring for now
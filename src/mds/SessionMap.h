@@ -92,6 +92,7 @@ public:
   elist<MDRequest*> requests;
 
   interval_set<inodeno_t> pending_prealloc_inos; // journaling prealloc, will be added to prealloc_inos
+  interval_set<inodeno_t> delegated_inos;  // prealloc_inos the client may name in its creates
 
   inodeno_t next_ino() {
     if (info.prealloc_inos.empty())
@@ -108,12 +109,35 @@ public:
 	ino = 0;
     }
     if (!ino) {
+      // delegations are carved off the top, see delegate_inos()
       ino = info.prealloc_inos.range_start();
       info.prealloc_inos.erase(ino);
     }
+    if (delegated_inos.contains(ino))
+      delegated_inos.erase(ino);
     info.used_inos.insert(ino, 1);
     return ino;
   }
+  /*
+   * hand the client up to max of our journaled prealloc_inos, from the
+   * top of the range so our own picks (from the bottom) stay clear of
+   * them.  returns the ones it hasn't been told about yet.
+   */
+  void delegate_inos(int max, interval_set<inodeno_t>& fresh) {
+    if (info.prealloc_inos.empty() || delegated_inos.size() >= max / 2)
+      return;
+    inodeno_t end = info.prealloc_inos.range_end();
+    inodeno_t start = info.prealloc_inos.range_start();
+    if (end - start > (uint64_t)max)
+      start = end - max;
+    interval_set<inodeno_t> window;
+    window.insert(start, end - start);
+    fresh.intersection_of(window, info.prealloc_inos);
+    interval_set<inodeno_t> already;
+    already.intersection_of(fresh, delegated_inos);
+    fresh.subtract(already);
+    delegated_inos.insert(fresh);
+  }
   int get_num_projected_prealloc_inos() {
     return info.prealloc_inos.size() + pending_prealloc_inos.size();
   }
@@ -163,6 +187,36 @@ public:
   // -- leases --
   uint32_t lease_seq;
 
+  // -- stats --
+  map<int,uint64_t> op_count;     ///< client requests by op, this session
+  DecayCounter req_load;          ///< decaying request count
+  uint64_t recall_count;          ///< RECALL_STATE messages sent
+  uint64_t recall_ignored;        ///< ... that didn't bring caps down in time
+  size_t recall_limit;            ///< caps we last asked it to get under, 0 if none pending
+  utime_t recall_stamp;
+
+  void hit_request(int op, utime_t now, const DecayRate& rate) {
+    ++op_count[op];
+    req_load.hit(now, rate);
+  }
+  void note_recall(size_t limit, utime_t now) {
+    ++recall_count;
+    recall_limit = limit;
+    recall_stamp = now;
+  }
+  /// settle an outstanding recall: honored, or ignored past timeout
+  void check_recall(utime_t now, double timeout) {
+    if (!recall_limit)
+      return;
+    if (caps.size() <= recall_limit) {
+      recall_limit = 0;
+    } else if (now - recall_stamp > timeout) {
+      ++recall_ignored;
+      recall_limit = 0;
+    }
+  }
+  void dump_stats(Formatter *f, utime_t now, const DecayRate& rate);
+
   // -- completed requests --
 private:
 
@@ -192,7 +246,8 @@ public:
     connection(NULL), item_session_list(this),
     requests(0),  // member_offset passed to front() manually
     cap_push_seq(0),
-    lease_seq(0) { }
+    lease_seq(0),
+    recall_count(0), recall_ignored(0), recall_limit(0) { }
   ~Session() {
     assert(!item_session_list.is_on_list());
     while (!preopen_out_queue.empty()) {
@@ -203,11 +258,17 @@ public:
 
   void clear() {
     pending_prealloc_inos.clear();
+    delegated_inos.clear();
     info.clear_meta();
 
     cap_push_seq = 0;
     last_cap_renew = utime_t();
 
+    op_count.clear();
+    req_load.reset(ceph_clock_now(g_ceph_context));
+    recall_count = recall_ignored = 0;
+    recall_limit = 0;
+
   }
 
 };
@@ -372,6 +433,7 @@ public:
   void encode(bufferlist& bl) const;
   void decode(bufferlist::iterator& blp);
   void dump(Formatter *f) const;
+  void dump_stats(Formatter *f, utime_t now, const DecayRate& rate);
   static void generate_test_instances(list<SessionMap*>& ls);
 
   object_t get_object_name();
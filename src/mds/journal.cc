@@ -545,6 +545,7 @@ void EMetaBlob::fullbit::update_inode(MDS *mds, CInode *in)
     in->symlink = symlink;
   }
   in->old_inodes = old_inodes;
+  in->update_mem_usage();
 }
 
 // EMetaBlob::remotebit
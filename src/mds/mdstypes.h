@@ -69,6 +69,8 @@ using namespace std;
 extern long g_num_ino, g_num_dir, g_num_dn, g_num_cap;
 extern long g_num_inoa, g_num_dira, g_num_dna, g_num_capa;
 extern long g_num_inos, g_num_dirs, g_num_dns, g_num_caps;
+/* approximate bytes held by each type of cache object */
+extern long g_bytes_ino, g_bytes_dir, g_bytes_dn, g_bytes_cap;
 
 
 // CAPS
@@ -538,43 +540,46 @@ struct dentry_key_t {
   // encode into something that can be decoded as a string.
   // name_ (head) or name_%x (!head)
   void encode(bufferlist& bl) const {
-    __u32 l = strlen(name) + 1;
+    string key;
+    encode(key);
+    ::encode(key, bl);
+  }
+  void encode(string& key) const {
     char b[20];
     if (snapid != CEPH_NOSNAP) {
       uint64_t val(snapid);
       snprintf(b, sizeof(b), "%" PRIx64, val);
-      l += strlen(b);
     } else {
       snprintf(b, sizeof(b), "%s", "head");
-      l += 4;
     }
-    ::encode(l, bl);
-    bl.append(name, strlen(name));
-    bl.append("_", 1);
-    bl.append(b);
+    key = name;
+    key.append("_");
+    key.append(b);
   }
   static void decode_helper(bufferlist::iterator& bl, string& nm, snapid_t& sn) {
     string foo;
     ::decode(foo, bl);
-
-    int i = foo.length()-1;
-    while (foo[i] != '_' && i)
+    decode_helper(foo, nm, sn);
+  }
+  static void decode_helper(const string& key, string& nm, snapid_t& sn) {
+    int i = key.length()-1;
+    while (key[i] != '_' && i)
       i--;
     assert(i);
-    if (i+5 == (int)foo.length() &&
-	foo[i+1] == 'h' &&
-	foo[i+2] == 'e' &&
-	foo[i+3] == 'a' &&
-	foo[i+4] == 'd') {
+    if (i+5 == (int)key.length() &&
+	key[i+1] == 'h' &&
+	key[i+2] == 'e' &&
+	key[i+3] == 'a' &&
+	key[i+4] == 'd') {
       // name_head
       sn = CEPH_NOSNAP;
     } else {
       // name_%x
       long long unsigned x = 0;
-      sscanf(foo.c_str() + i + 1, "%llx", &x);
+      sscanf(key.c_str() + i + 1, "%llx", &x);
       sn = x;
     }  
-    nm = string(foo.c_str(), i);
+    nm = string(key.c_str(), i);
   }
 };
 
@@ -963,14 +968,17 @@ struct mds_load_t {
 
   double cpu_load_avg;
 
+  double req_cost;  // measured request seconds, decayed like the pops
+
   mds_load_t(const utime_t &t) : 
     auth(t), all(t), req_rate(0), cache_hit_rate(0),
-    queue_len(0), cpu_load_avg(0)
+    queue_len(0), cpu_load_avg(0), req_cost(0)
   {}
   // mostly for the dencoder infrastructure
   mds_load_t() :
     auth(), all(),
-    req_rate(0), cache_hit_rate(0), queue_len(0), cpu_load_avg(0)
+    req_rate(0), cache_hit_rate(0), queue_len(0), cpu_load_avg(0),
+    req_cost(0)
   {}
   
   double mds_load();  // defiend in MDBalancer.cc
@@ -993,6 +1001,7 @@ inline ostream& operator<<( ostream& out, mds_load_t& load )
              << ", hr " << load.cache_hit_rate
              << ", qlen " << load.queue_len
 	     << ", cpu " << load.cpu_load_avg
+	     << ", cost " << load.req_cost
              << ">";
 }
 
@@ -21,7 +21,7 @@
 
 class MClientCaps : public Message {
 
-  static const int HEAD_VERSION = 2;   // added flock metadata
+  static const int HEAD_VERSION = 4;   // 2: added flock metadata; 3: batched; 4: batched tids
   static const int COMPAT_VERSION = 1;
 
  public:
@@ -30,6 +30,53 @@ class MClientCaps : public Message {
   bufferlist xattrbl;
   bufferlist flockbl;
 
+  struct batched_cap_t {
+    struct ceph_mds_caps head;
+    bufferlist snapbl;
+    bufferlist xattrbl;
+    bufferlist flockbl;
+
+    void encode(bufferlist &bl) const {
+      ::encode(head, bl);
+      ::encode(snapbl, bl);
+      ::encode(xattrbl, bl);
+      ::encode(flockbl, bl);
+    }
+    void decode(bufferlist::iterator &p) {
+      ::decode(head, p);
+      ::decode(snapbl, p);
+      ::decode(xattrbl, p);
+      ::decode(flockbl, p);
+    }
+  };
+  /// cap messages for other inodes of the same session, handled in
+  /// order after this one; only sent to CEPH_FEATURE_MDS_CAPS_BATCH peers
+  vector<batched_cap_t> batched;
+  vector<uint64_t> batched_tid;  ///< their flush tids, if any
+
+  void add_batched(MClientCaps *m) {
+    batched_tid.push_back(m->get_tid());
+    batched.push_back(batched_cap_t());
+    batched_cap_t &b = batched.back();
+    b.head = m->head;
+    b.snapbl.claim(m->snapbl);
+    b.xattrbl.claim(m->xattrbl);
+    b.flockbl.claim(m->flockbl);
+  }
+  /// a standalone message for batched[i], as if it came on its own
+  MClientCaps *get_batched(unsigned i) {
+    MClientCaps *m = new MClientCaps;
+    m->set_header(get_header());
+    m->set_connection(get_connection());
+    m->head = batched[i].head;
+    m->snapbl = batched[i].snapbl;
+    m->xattrbl = batched[i].xattrbl;
+    m->flockbl = batched[i].flockbl;
+    if (i < batched_tid.size())
+      m->set_tid(batched_tid[i]);
+    return m;
+  }
+
   int      get_caps() { return head.caps; }
   int      get_wanted() { return head.wanted; }
   int      get_dirty() { return head.dirty; }
@@ -135,6 +182,8 @@ public:
 
     if (head.xattr_version)
       out << " xattrs(v=" << head.xattr_version << " l=" << xattrbl.length() << ")";
+    if (!batched.empty())
+      out << " +" << batched.size() << " batched";
 
     out << ")";
   }
@@ -151,6 +200,10 @@ public:
     // conditionally decode flock metadata
     if (header.version >= 2)
       ::decode(flockbl, p);
+    if (header.version >= 3)
+      ::decode(batched, p);
+    if (header.version >= 4)
+      ::decode(batched_tid, p);
   }
   void encode_payload(uint64_t features) {
     head.snap_trace_len = snapbl.length();
@@ -163,10 +216,19 @@ public:
     // conditionally include flock metadata
     if (features & CEPH_FEATURE_FLOCK) {
       ::encode(flockbl, payload);
+      if (features & CEPH_FEATURE_MDS_CAPS_BATCH) {
+	::encode(batched, payload);
+	::encode(batched_tid, payload);
+      } else {
+	assert(batched.empty());
+	header.version = 2;
+      }
     } else {
+      assert(batched.empty());
       header.version = 1;  // old
     }
   }
 };
+WRITE_CLASS_ENCODER(MClientCaps::batched_cap_t)
 
 #endif
@@ -138,6 +138,7 @@ public:
   const filepath& get_filepath2() const { return path2; }
 
   int get_dentry_wanted() { return get_flags() & CEPH_MDS_FLAG_WANT_DENTRY; }
+  bool is_readdirplus() { return get_flags() & CEPH_MDS_FLAG_READDIRPLUS; }
 
   void decode_payload() {
     bufferlist::iterator p = payload.begin();
@@ -194,6 +195,8 @@ public:
       out << " RETRY=" << (int)head.num_retry;
     if (get_flags() & CEPH_MDS_FLAG_REPLAY)
       out << " REPLAY";
+    if (get_flags() & CEPH_MDS_FLAG_READDIRPLUS)
+      out << " PLUS";
     out << ")";
   }
 
@@ -17,7 +17,7 @@
 
 class MMonSync : public Message
 {
-  static const int HEAD_VERSION = 2;
+  static const int HEAD_VERSION = 3;
   static const int COMPAT_VERSION = 2;
 
 public:
@@ -59,16 +59,20 @@ public:
   pair<string,string> last_key;
   bufferlist chunk_bl;
   entity_inst_t reply_to;
+  /// get_chunk: the requester takes snappy chunks; chunk: chunk_bl is one
+  __u8 compressed;
 
   MMonSync()
-    : Message(MSG_MON_SYNC, HEAD_VERSION, COMPAT_VERSION)
+    : Message(MSG_MON_SYNC, HEAD_VERSION, COMPAT_VERSION),
+      compressed(0)
   { }
 
   MMonSync(uint32_t op, uint64_t c = 0)
     : Message(MSG_MON_SYNC, HEAD_VERSION, COMPAT_VERSION),
       op(op),
       cookie(c),
-      last_committed(0)
+      last_committed(0),
+      compressed(0)
   { }
 
   const char *get_type_name() const { return "mon_sync"; }
@@ -81,6 +85,8 @@ public:
       out << " lc " << last_committed;
     if (chunk_bl.length())
       out << " bl " << chunk_bl.length() << " bytes";
+    if (compressed)
+      out << " compressed";
     if (!last_key.first.empty() || !last_key.second.empty())
       out << " last_key " << last_key.first << "," << last_key.second;
     out << ")";
@@ -94,6 +100,7 @@ public:
     ::encode(last_key.second, payload);
     ::encode(chunk_bl, payload);
     ::encode(reply_to, payload);
+    ::encode(compressed, payload);
   }
 
   void decode_payload() {
@@ -105,6 +112,8 @@ public:
     ::decode(last_key.second, p);
     ::decode(chunk_bl, p);
     ::decode(reply_to, p);
+    if (header.version >= 3)
+      ::decode(compressed, p);
   }
 };
 
@@ -21,7 +21,7 @@
 
 class MOSDFailure : public PaxosServiceMessage {
 
-  static const int HEAD_VERSION = 3;
+  static const int HEAD_VERSION = 4;
 
  public:
   uuid_d fsid;
@@ -29,6 +29,8 @@ class MOSDFailure : public PaxosServiceMessage {
   __u8 is_failed;
   epoch_t       epoch;
   int32_t failed_for;  // known to be failed since at least this long
+  /// further failed osds and their failed_for, reported in the same message
+  vector<pair<entity_inst_t,int32_t> > more;
 
   MOSDFailure() : PaxosServiceMessage(MSG_OSD_FAILURE, 0, HEAD_VERSION) { }
   MOSDFailure(const uuid_d &fs, const entity_inst_t& f, int duration, epoch_t e)
@@ -56,6 +58,8 @@ public:
       ::decode(failed_for, p);
     else
       failed_for = 0;
+    if (header.version >= 4)
+      ::decode(more, p);
   }
   void encode_payload(uint64_t features) {
     paxos_encode();
@@ -64,14 +68,17 @@ public:
     ::encode(epoch, payload);
     ::encode(is_failed, payload);
     ::encode(failed_for, payload);
+    ::encode(more, payload);
   }
 
   const char *get_type_name() const { return "osd_failure"; }
   void print(ostream& out) const {
     out << "osd_failure("
 	<< (is_failed ? "failed " : "recovered ")
-	<< target_osd << " for " << failed_for << "sec e" << epoch
-	<< " v" << version << ")";
+	<< target_osd << " for " << failed_for << "sec";
+    if (!more.empty())
+      out << " and " << more.size() << " more";
+    out << " e" << epoch << " v" << version << ")";
   }
 };
 
@@ -19,6 +19,7 @@
 #include "msg/Message.h"
 #include "osd/osd_types.h"
 #include "include/ceph_features.h"
+#include "common/ObjectPool.h"
 
 /*
  * OSD op
@@ -32,7 +33,7 @@ class OSD;
 
 class MOSDOp : public Message {
 
-  static const int HEAD_VERSION = 4;
+  static const int HEAD_VERSION = 5;
   static const int COMPAT_VERSION = 3;
 
 private:
@@ -42,6 +43,7 @@ private:
   utime_t mtime;
   eversion_t reassert_version;
   int32_t retry_attempt;   // 0 is first attempt.  -1 if we don't know.
+  uint32_t qos_delta, qos_rho;  // dmclock; 0 if the client doesn't track them
 
   object_t oid;
   object_locator_t oloc;
@@ -90,6 +92,10 @@ public:
   
   utime_t get_mtime() { return mtime; }
 
+  // one is decoded for every client op
+  static ObjectPool alloc_pool;
+  OBJECT_POOL_ALLOCATOR(alloc_pool)
+
   MOSDOp()
     : Message(CEPH_MSG_OSD_OP, HEAD_VERSION, COMPAT_VERSION) { }
   MOSDOp(int inc, long tid,
@@ -98,6 +104,7 @@ public:
     : Message(CEPH_MSG_OSD_OP, HEAD_VERSION, COMPAT_VERSION),
       client_inc(inc),
       osdmap_epoch(_osdmap_epoch), flags(_flags), retry_attempt(-1),
+      qos_delta(0), qos_rho(0),
       oid(_oid), oloc(_oloc), pgid(_pgid) {
     set_tid(tid);
   }
@@ -174,6 +181,20 @@ public:
     return retry_attempt;
   }
 
+  /**
+   * dmclock scheduling hints
+   *
+   * @param delta ops of ours completed by any osd since the previous op
+   *              we sent to this one, this op included
+   * @param rho how many of them were served for our reservation
+   */
+  void set_qos_deltas(uint32_t delta, uint32_t rho) {
+    qos_delta = delta;
+    qos_rho = rho;
+  }
+  uint32_t get_qos_delta() const { return qos_delta; }
+  uint32_t get_qos_rho() const { return qos_rho; }
+
   // marshalling
   virtual void encode_payload(uint64_t features) {
 
@@ -251,6 +272,8 @@ struct ceph_osd_request_head {
       ::encode(snaps, payload);
 
       ::encode(retry_attempt, payload);
+      ::encode(qos_delta, payload);
+      ::encode(qos_rho, payload);
     }
   }
 
@@ -297,6 +320,7 @@ struct ceph_osd_request_head {
 				oid.name.length()));
 
       retry_attempt = -1;
+      qos_delta = qos_rho = 0;
     } else {
       // new decode 
       ::decode(client_inc, p);
@@ -332,6 +356,13 @@ struct ceph_osd_request_head {
 	::decode(retry_attempt, p);
       else
 	retry_attempt = -1;
+
+      if (header.version >= 5) {
+	::decode(qos_delta, p);
+	::decode(qos_rho, p);
+      } else {
+	qos_delta = qos_rho = 0;
+      }
     }
 
     OSDOp::split_osd_op_vector_in_data(ops, data);
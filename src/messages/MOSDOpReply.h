@@ -20,6 +20,7 @@
 
 #include "MOSDOp.h"
 #include "os/ObjectStore.h"
+#include "common/ObjectPool.h"
 
 /*
  * OSD op reply
@@ -122,6 +123,10 @@ public:
   */
 
 public:
+  // one or two are sent for every client op
+  static ObjectPool alloc_pool;
+  OBJECT_POOL_ALLOCATOR(alloc_pool)
+
   MOSDOpReply()
     : Message(CEPH_MSG_OSD_OPREPLY, HEAD_VERSION, COMPAT_VERSION) { }
   MOSDOpReply(MOSDOp *req, int r, epoch_t e, int acktype)
@@ -0,0 +1,69 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef MOSDPGSNAPTRIM_H
+#define MOSDPGSNAPTRIM_H
+
+#include "msg/Message.h"
+#include "osd/osd_types.h"
+
+/**
+ * a pass of the snap trimmer over a pg
+ *
+ * Never sent; the OSD queues it to itself so that snap trimming is
+ * scheduled, prioritized and throttled along with the client ops.
+ */
+class MOSDPGSnapTrim : public Message {
+  static const int HEAD_VERSION = 1;
+  static const int COMPAT_VERSION = 1;
+
+public:
+  pg_t pgid;
+  epoch_t map_epoch;
+  uint64_t cost;
+
+  MOSDPGSnapTrim() :
+    Message(MSG_OSD_PG_SNAPTRIM, HEAD_VERSION, COMPAT_VERSION),
+    map_epoch(0), cost(0)
+    {}
+  MOSDPGSnapTrim(int whoami, pg_t pgid, epoch_t e, uint64_t cost) :
+    Message(MSG_OSD_PG_SNAPTRIM, HEAD_VERSION, COMPAT_VERSION),
+    pgid(pgid), map_epoch(e), cost(cost) {
+    header.src = entity_name_t::OSD(whoami);
+  }
+
+  int get_cost() const {
+    return cost;
+  }
+
+  virtual void decode_payload() {
+    bufferlist::iterator p = payload.begin();
+    ::decode(pgid, p);
+    ::decode(map_epoch, p);
+    ::decode(cost, p);
+  }
+
+  virtual void encode_payload(uint64_t features) {
+    ::encode(pgid, payload);
+    ::encode(map_epoch, payload);
+    ::encode(cost, payload);
+  }
+
+  const char *get_type_name() const { return "MOSDPGSnapTrim"; }
+
+  void print(ostream& out) const {
+    out << "MOSDPGSnapTrim(" << pgid
+	<< " " << map_epoch << ")";
+  }
+};
+
+#endif
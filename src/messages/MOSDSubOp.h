@@ -25,7 +25,7 @@
 
 class MOSDSubOp : public Message {
 
-  static const int HEAD_VERSION = 8;
+  static const int HEAD_VERSION = 10;
   static const int COMPAT_VERSION = 1;
 
 public:
@@ -62,6 +62,7 @@ public:
 
   // piggybacked osd/og state
   eversion_t pg_trim_to;   // primary->replica: trim to here
+  eversion_t pg_committed_to;  // primary->replica: on disk on all of acting up to here
   osd_peer_stat_t peer_stat;
 
   map<string,bufferptr> attrset;
@@ -89,6 +90,48 @@ public:
   hobject_t new_temp_oid;      ///< new temp object that we must now start tracking
   hobject_t discard_temp_oid;  ///< previously used temp object that we can now stop tracking
 
+  /// a further replicated write shipped along with this one
+  struct batched_update_t {
+    osd_reqid_t reqid;
+    hobject_t poid;
+    tid_t rep_tid;
+    eversion_t version;
+    bufferlist opt;      ///< encoded transaction
+    bufferlist logbl;
+    hobject_t new_temp_oid;
+    hobject_t discard_temp_oid;
+
+    batched_update_t() : rep_tid(0) {}
+    void encode(bufferlist &bl) const {
+      ::encode(reqid, bl);
+      ::encode(poid, bl);
+      ::encode(rep_tid, bl);
+      ::encode(version, bl);
+      ::encode(opt, bl);
+      ::encode(logbl, bl);
+      ::encode(new_temp_oid, bl);
+      ::encode(discard_temp_oid, bl);
+    }
+    void decode(bufferlist::iterator &p) {
+      ::decode(reqid, p);
+      ::decode(poid, p);
+      ::decode(rep_tid, p);
+      ::decode(version, p);
+      ::decode(opt, p);
+      ::decode(logbl, p);
+      ::decode(new_temp_oid, p);
+      ::decode(discard_temp_oid, p);
+    }
+  };
+  /// applied in order after this one, in the same transaction; only
+  /// sent to peers with CEPH_FEATURE_OSD_REPOP_BATCH
+  vector<batched_update_t> batched;
+
+  /// version of the last update carried by this message
+  eversion_t get_last_version() const {
+    return batched.empty() ? version : batched.back().version;
+  }
+
   int get_cost() const {
     if (ops.size() == 1 && ops[0].op.op == CEPH_OSD_OP_PULL)
       return ops[0].op.extent.length;
@@ -158,6 +201,15 @@ public:
       ::decode(new_temp_oid, p);
       ::decode(discard_temp_oid, p);
     }
+    if (header.version >= 9) {
+      __u32 n;
+      ::decode(n, p);
+      batched.resize(n);
+      for (unsigned i = 0; i < n; i++)
+	batched[i].decode(p);
+    }
+    if (header.version >= 10)
+      ::decode(pg_committed_to, p);
   }
 
   virtual void encode_payload(uint64_t features) {
@@ -204,6 +256,11 @@ public:
     ::encode(omap_header, payload);
     ::encode(new_temp_oid, payload);
     ::encode(discard_temp_oid, payload);
+    __u32 n = batched.size();
+    ::encode(n, payload);
+    for (unsigned i = 0; i < n; i++)
+      batched[i].encode(payload);
+    ::encode(pg_committed_to, payload);
   }
 
   MOSDSubOp()
@@ -242,6 +299,8 @@ public:
       out << " complete";
     out << " v " << version
 	<< " snapset=" << snapset << " snapc=" << snapc;    
+    if (!batched.empty())
+      out << " +" << batched.size() << " batched to v " << get_last_version();
     if (!data_subset.empty()) out << " subset " << data_subset;
     out << ")";
   }
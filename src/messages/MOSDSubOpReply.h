@@ -30,6 +30,8 @@
  */
 
 class MOSDSubOpReply : public Message {
+  static const int HEAD_VERSION = 2;
+  static const int COMPAT_VERSION = 1;
 public:
   epoch_t map_epoch;
   
@@ -50,6 +52,9 @@ public:
 
   map<string,bufferptr> attrset;
 
+  /// rep_tids of the updates batched with the one we reply to
+  vector<tid_t> batched_tids;
+
   virtual void decode_payload() {
     bufferlist::iterator p = payload.begin();
     ::decode(map_epoch, p);
@@ -68,6 +73,8 @@ public:
     ::decode(last_complete_ondisk, p);
     ::decode(peer_stat, p);
     ::decode(attrset, p);
+    if (header.version >= 2)
+      ::decode(batched_tids, p);
 
     if (poid.pool == -1)
       poid.pool = pgid.pool();
@@ -87,6 +94,7 @@ public:
     ::encode(last_complete_ondisk, payload);
     ::encode(peer_stat, payload);
     ::encode(attrset, payload);
+    ::encode(batched_tids, payload);
   }
 
   epoch_t get_map_epoch() { return map_epoch; }
@@ -111,7 +119,7 @@ public:
 
 public:
   MOSDSubOpReply(MOSDSubOp *req, int result_, epoch_t e, int at) :
-    Message(MSG_OSD_SUBOPREPLY),
+    Message(MSG_OSD_SUBOPREPLY, HEAD_VERSION, COMPAT_VERSION),
     map_epoch(e),
     reqid(req->reqid),
     pgid(req->pgid),
@@ -121,8 +129,14 @@ public:
     result(result_) {
     memset(&peer_stat, 0, sizeof(peer_stat));
     set_tid(req->get_tid());
+    for (vector<MOSDSubOp::batched_update_t>::const_iterator p =
+	   req->batched.begin();
+	 p != req->batched.end();
+	 ++p)
+      batched_tids.push_back(p->rep_tid);
   }
-  MOSDSubOpReply() : Message(MSG_OSD_SUBOPREPLY) {}
+  MOSDSubOpReply()
+    : Message(MSG_OSD_SUBOPREPLY, HEAD_VERSION, COMPAT_VERSION) {}
 private:
   ~MOSDSubOpReply() {}
 
@@ -139,6 +153,8 @@ public:
       out << " onnvram";
     if (ack_type & CEPH_OSD_FLAG_ACK)
       out << " ack";
+    if (!batched_tids.empty())
+      out << " +" << batched_tids.size() << " batched";
     out << ", result = " << result;
     out << ")";
   }
@@ -257,8 +257,11 @@ bool MonClient::ms_dispatch(Message *m)
 
   Mutex::Locker lock(monc_lock);
 
-  // ignore any messages outside our current session
-  if (m->get_connection() != cur_con) {
+  // ignore any messages outside our current session, unless it is the
+  // first answer from one of the mons we are hunting
+  if (m->get_connection() != cur_con &&
+      !(m->get_type() == CEPH_MSG_AUTH_REPLY &&
+	_take_hunting_con(m->get_connection().get()))) {
     ldout(cct, 10) << "discarding stray monitor message " << *m << dendl;
     m->put();
     return true;
@@ -320,6 +323,15 @@ void MonClient::handle_monmap(MMonMap *m)
 
   _sub_got("monmap", monmap.get_epoch());
 
+  if (backup_con) {
+    string name;
+    if (!monmap.get_addr_name(backup_con->get_peer_addr(), name) ||
+	name != backup_mon) {
+      ldout(cct, 10) << "backup mon." << backup_mon << " went away" << dendl;
+      _close_backup_con();
+    }
+  }
+
   if (!monmap.get_addr_name(cur_con->get_peer_addr(), cur_mon)) {
     ldout(cct, 10) << "mon." << cur_mon << " went away" << dendl;
     _reopen_session();  // can't find the mon we were talking to (above)
@@ -416,6 +428,8 @@ void MonClient::shutdown()
 
   messenger->mark_down(cur_con);
   cur_con.reset(NULL);
+  _close_hunting_cons();
+  _close_backup_con();
 
   monc_lock.Unlock();
 }
@@ -464,6 +478,7 @@ void MonClient::handle_auth(MAuthReply *m)
 {
   bufferlist::iterator p = m->result_bl.begin();
   if (state == MC_STATE_NEGOTIATING) {
+    _close_hunting_cons();  // this mon answered first
     if (!auth || (int)m->protocol != auth->get_protocol()) {
       delete auth;
       auth = get_auth_client_handler(cct, m->protocol, rotating_secrets);
@@ -521,6 +536,8 @@ void MonClient::handle_auth(MAuthReply *m)
 	log_client->reset_session();
 	send_log();
       }
+
+      _open_backup_con();
     }
   
     _check_auth_tickets();
@@ -571,7 +588,11 @@ void MonClient::_reopen_session(int rank, string name)
   assert(monc_lock.is_locked());
   ldout(cct, 10) << "_reopen_session rank " << rank << " name " << name << dendl;
 
-  if (rank < 0 && name.length() == 0) {
+  string prev_mon = cur_mon;
+  bool any = rank < 0 && name.length() == 0;
+  if (any && backup_con && monmap.contains(backup_mon)) {
+    cur_mon = backup_mon;
+  } else if (any) {
     cur_mon = _pick_random_mon();
   } else if (name.length()) {
     cur_mon = name;
@@ -582,7 +603,15 @@ void MonClient::_reopen_session(int rank, string name)
   if (cur_con) {
     messenger->mark_down(cur_con);
   }
-  cur_con = messenger->get_connection(monmap.get_inst(cur_mon));
+  _close_hunting_cons();
+  if (backup_con && cur_mon == backup_mon) {
+    // already connected
+    cur_con = backup_con;
+    backup_con.reset(NULL);
+    backup_mon.clear();
+  } else {
+    cur_con = messenger->get_connection(monmap.get_inst(cur_mon));
+  }
 	
   ldout(cct, 10) << "picked mon." << cur_mon << " con " << cur_con
 		 << " addr " << cur_con->get_peer_addr()
@@ -603,7 +632,35 @@ void MonClient::_reopen_session(int rank, string name)
 
   // restart authentication handshake
   state = MC_STATE_NEGOTIATING;
+  _send_mon_message(_build_auth_hello(), true);
+
+  // while hunting, try a few more mons at the same time
+  if (hunting && any) {
+    int more = cct->_conf->mon_client_hunt_parallel - 1;
+    vector<string> others;
+    for (unsigned i = 0; i < monmap.size(); i++) {
+      string n = monmap.get_name(i);
+      if (n != cur_mon && n != prev_mon && n != backup_mon)
+	others.push_back(n);
+    }
+    while (more-- > 0 && !others.empty()) {
+      unsigned i = rng() % others.size();
+      ConnectionRef con = messenger->get_connection(monmap.get_inst(others[i]));
+      ldout(cct, 10) << "also trying mon." << others[i]
+		     << " addr " << con->get_peer_addr() << dendl;
+      messenger->send_message(_build_auth_hello(), con);
+      hunting_cons[others[i]] = con;
+      others[i] = others.back();
+      others.pop_back();
+    }
+  }
 
+  if (!sub_have.empty())
+    _renew_subs();
+}
+
+MAuth *MonClient::_build_auth_hello()
+{
   MAuth *m = new MAuth;
   m->protocol = 0;
   m->monmap_epoch = monmap.get_epoch();
@@ -612,10 +669,59 @@ void MonClient::_reopen_session(int rank, string name)
   ::encode(auth_supported->get_supported_set(), m->auth_payload);
   ::encode(entity_name, m->auth_payload);
   ::encode(global_id, m->auth_payload);
-  _send_mon_message(m, true);
+  return m;
+}
 
-  if (!sub_have.empty())
-    _renew_subs();
+bool MonClient::_take_hunting_con(Connection *con)
+{
+  assert(monc_lock.is_locked());
+  if (state != MC_STATE_NEGOTIATING)
+    return false;
+  for (map<string, ConnectionRef>::iterator p = hunting_cons.begin();
+       p != hunting_cons.end();
+       ++p) {
+    if (p->second != con)
+      continue;
+    ldout(cct, 10) << "mon." << p->first << " answered before mon." << cur_mon << dendl;
+    messenger->mark_down(cur_con);
+    cur_mon = p->first;
+    cur_con = p->second;
+    hunting_cons.erase(p);
+    return true;
+  }
+  return false;
+}
+
+void MonClient::_close_hunting_cons()
+{
+  assert(monc_lock.is_locked());
+  for (map<string, ConnectionRef>::iterator p = hunting_cons.begin();
+       p != hunting_cons.end();
+       ++p)
+    messenger->mark_down(p->second);
+  hunting_cons.clear();
+}
+
+void MonClient::_open_backup_con()
+{
+  assert(monc_lock.is_locked());
+  if (!cct->_conf->mon_client_backup_con || backup_con || monmap.size() < 2)
+    return;
+  backup_mon = _pick_random_mon();
+  backup_con = messenger->get_connection(monmap.get_inst(backup_mon));
+  ldout(cct, 10) << "backup mon." << backup_mon
+		 << " addr " << backup_con->get_peer_addr() << dendl;
+  messenger->send_keepalive(backup_con.get());
+}
+
+void MonClient::_close_backup_con()
+{
+  assert(monc_lock.is_locked());
+  if (backup_con) {
+    messenger->mark_down(backup_con);
+    backup_con.reset(NULL);
+  }
+  backup_mon.clear();
 }
 
 
@@ -624,6 +730,21 @@ bool MonClient::ms_handle_reset(Connection *con)
   Mutex::Locker lock(monc_lock);
 
   if (con->get_peer_type() == CEPH_ENTITY_TYPE_MON) {
+    if (con == backup_con) {
+      ldout(cct, 10) << "ms_handle_reset backup mon " << con->get_peer_addr() << dendl;
+      backup_con.reset(NULL);  // reopened on the next tick
+      backup_mon.clear();
+      return true;
+    }
+    for (map<string, ConnectionRef>::iterator p = hunting_cons.begin();
+	 p != hunting_cons.end();
+	 ++p) {
+      if (p->second == con) {
+	ldout(cct, 10) << "ms_handle_reset hunting mon." << p->first << dendl;
+	hunting_cons.erase(p);
+	return true;
+      }
+    }
     if (cur_mon.empty() || con != cur_con) {
       ldout(cct, 10) << "ms_handle_reset stray mon " << con->get_peer_addr() << dendl;
       return true;
@@ -672,6 +793,10 @@ void MonClient::tick()
    
     if (state == MC_STATE_HAVE_SESSION) {
       send_log();
+      if (backup_con)
+	messenger->send_keepalive(backup_con.get());
+      else
+	_open_backup_con();
     }
   }
 
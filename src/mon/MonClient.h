@@ -40,6 +40,7 @@ class MMonGetVersionReply;
 struct MMonSubscribeAck;
 class MMonCommandAck;
 class MCommandReply;
+struct MAuth;
 struct MAuthReply;
 class MAuthRotating;
 class MPing;
@@ -153,6 +154,21 @@ private:
   // monitor session
   bool hunting;
 
+  // while hunting we say hello to a few mons at once; cur_con is one of
+  // them, the others wait here, and whichever answers first is kept.
+  map<string, ConnectionRef> hunting_cons;
+
+  // an idle connection to another mon, kept open so the next hunt can
+  // start from a mon that is already connected.
+  string backup_mon;
+  ConnectionRef backup_con;
+
+  MAuth *_build_auth_hello();
+  bool _take_hunting_con(Connection *con);
+  void _close_hunting_cons();
+  void _open_backup_con();
+  void _close_backup_con();
+
   struct C_Tick : public Context {
     MonClient *monc;
     C_Tick(MonClient *m) : monc(m) {}
@@ -246,6 +262,12 @@ public:
     Mutex::Locker l(monc_lock);
     _sub_unwant(what);
   }
+
+  /// features of the monitor we are connected to, 0 if none
+  uint64_t get_mon_features() {
+    Mutex::Locker l(monc_lock);
+    return cur_con ? cur_con->get_features() : 0;
+  }
   
   KeyRing *keyring;
   RotatingKeyRing *rotating_secrets;
@@ -18,6 +18,7 @@
 #include <signal.h>
 #include <limits.h>
 #include <cstring>
+#include <snappy.h>
 
 #include "Monitor.h"
 #include "common/version.h"
@@ -44,6 +45,7 @@
 #include "messages/MMonPaxos.h"
 #include "messages/MRoute.h"
 #include "messages/MForward.h"
+#include "messages/MOSDFailure.h"
 
 #include "messages/MMonSubscribe.h"
 #include "messages/MMonSubscribeAck.h"
@@ -152,6 +154,8 @@ Monitor::Monitor(CephContext* cct_, string nm, MonitorDBStore *s,
   sync_full(false),
   sync_start_version(0),
   sync_timeout_event(NULL),
+  sync_chunks_inflight(0),
+  sync_pending_bytes(0),
   sync_last_committed_floor(0),
 
   timecheck_round(0),
@@ -218,6 +222,9 @@ Monitor::~Monitor()
 
 enum {
   l_mon_first = 456000,
+  l_mon_command,            // commands answered here
+  l_mon_command_lat,
+  l_mon_command_forwarded,  // commands passed on to the leader
   l_mon_last,
 };
 
@@ -260,7 +267,12 @@ void Monitor::do_admin_command(string command, cmdmap_t& cmdmap, string format,
     sync_force(f.get(), ss);
   } else if (command.find("add_bootstrap_peer_hint") == 0)
     _add_bootstrap_peer_hint(command, cmdmap, ss);
-  else
+  else if (command == "command_stats") {
+    if (!f)
+      f.reset(new_formatter("json-pretty"));
+    dump_command_stats(f.get());
+    f->flush(ss);
+  } else
     assert(0 == "bad AdminSocket command binding");
 }
 
@@ -353,7 +365,9 @@ int Monitor::preinit()
   assert(!logger);
   {
     PerfCountersBuilder pcb(g_ceph_context, "mon", l_mon_first, l_mon_last);
-    // ...
+    pcb.add_u64_counter(l_mon_command, "command");
+    pcb.add_time_avg(l_mon_command_lat, "command_lat");
+    pcb.add_u64_counter(l_mon_command_forwarded, "command_forwarded");
     logger = pcb.create_perf_counters();
     cct->get_perfcounters_collection()->add(logger);
   }
@@ -504,6 +518,11 @@ int Monitor::preinit()
 				     "add peer address as potential bootstrap"
 				     " peer for cluster bringup");
   assert(r == 0);
+  r = admin_socket->register_command("command_stats", "command_stats",
+				     admin_hook,
+				     "show count and latency of the commands"
+				     " answered by this monitor");
+  assert(r == 0);
   lock.Lock();
 
   lock.Unlock();
@@ -593,6 +612,7 @@ void Monitor::shutdown()
     admin_socket->unregister_command("quorum_status");
     admin_socket->unregister_command("sync_force");
     admin_socket->unregister_command("add_bootstrap_peer_hint");
+    admin_socket->unregister_command("command_stats");
     delete admin_hook;
     admin_hook = NULL;
   }
@@ -837,6 +857,9 @@ void Monitor::sync_reset_requester()
   sync_cookie = 0;
   sync_full = false;
   sync_start_version = 0;
+  sync_chunks_inflight = 0;
+  sync_pending_tx = MonitorDBStore::Transaction();
+  sync_pending_bytes = 0;
 }
 
 void Monitor::sync_reset_provider()
@@ -922,6 +945,8 @@ void Monitor::sync_finish(version_t last_committed)
 
   assert(g_conf->mon_sync_requester_kill_at != 7);
 
+  sync_apply_pending();
+
   if (sync_full) {
     // finalize the paxos commits
     MonitorDBStore::Transaction tx;
@@ -1099,6 +1124,16 @@ void Monitor::handle_sync_get_chunk(MMonSync *m)
 
   ::encode(tx, reply->chunk_bl);
 
+  if (m->compressed && reply->chunk_bl.length()) {
+    string out;
+    snappy::Compress(reply->chunk_bl.c_str(), reply->chunk_bl.length(), &out);
+    dout(20) << __func__ << " compressed " << reply->chunk_bl.length()
+	     << " -> " << out.length() << " bytes" << dendl;
+    reply->chunk_bl.clear();
+    reply->chunk_bl.append(out);
+    reply->compressed = 1;
+  }
+
   messenger->send_message(reply, m->get_connection());
 }
 
@@ -1126,15 +1161,43 @@ void Monitor::handle_sync_cookie(MMonSync *m)
 
 void Monitor::sync_get_next_chunk()
 {
-  dout(20) << __func__ << " cookie " << sync_cookie << " provider " << sync_provider << dendl;
-  if (g_conf->mon_inject_sync_get_chunk_delay > 0) {
-    dout(20) << __func__ << " injecting delay of " << g_conf->mon_inject_sync_get_chunk_delay << dendl;
-    usleep((long long)(g_conf->mon_inject_sync_get_chunk_delay * 1000000.0));
+  // keep a few requests queued at the provider, so it reads the next
+  // chunks off its snapshot while we apply this one.  the provider
+  // answers them in order; any it gets after the last chunk are answered
+  // with a no_cookie for a cookie we no longer hold, which we ignore.
+  unsigned window = 1 + MAX(0, g_conf->mon_sync_chunks_inflight);
+  while (sync_chunks_inflight < window) {
+    dout(20) << __func__ << " cookie " << sync_cookie << " provider " << sync_provider
+	     << " inflight " << sync_chunks_inflight << dendl;
+    if (g_conf->mon_inject_sync_get_chunk_delay > 0) {
+      dout(20) << __func__ << " injecting delay of " << g_conf->mon_inject_sync_get_chunk_delay << dendl;
+      usleep((long long)(g_conf->mon_inject_sync_get_chunk_delay * 1000000.0));
+    }
+    MMonSync *r = new MMonSync(MMonSync::OP_GET_CHUNK, sync_cookie);
+    r->compressed = g_conf->mon_sync_compress;
+    messenger->send_message(r, sync_provider);
+    ++sync_chunks_inflight;
+
+    assert(g_conf->mon_sync_requester_kill_at != 4);
   }
-  MMonSync *r = new MMonSync(MMonSync::OP_GET_CHUNK, sync_cookie);
-  messenger->send_message(r, sync_provider);
+}
+
+void Monitor::sync_apply_pending()
+{
+  if (sync_pending_tx.empty())
+    return;
+
+  dout(10) << __func__ << " " << sync_pending_bytes << " bytes" << dendl;
+
+  dout(30) << __func__ << " tx dump:\n";
+  JSONFormatter f(true);
+  sync_pending_tx.dump(&f);
+  f.flush(*_dout);
+  *_dout << dendl;
 
-  assert(g_conf->mon_sync_requester_kill_at != 4);
+  store->apply_transaction(sync_pending_tx);
+  sync_pending_tx = MonitorDBStore::Transaction();
+  sync_pending_bytes = 0;
 }
 
 void Monitor::handle_sync_chunk(MMonSync *m)
@@ -1153,16 +1216,31 @@ void Monitor::handle_sync_chunk(MMonSync *m)
   assert(state == STATE_SYNCHRONIZING);
   assert(g_conf->mon_sync_requester_kill_at != 5);
 
-  MonitorDBStore::Transaction tx;
-  tx.append_from_encoded(m->chunk_bl);
+  if (sync_chunks_inflight > 0)
+    --sync_chunks_inflight;
 
-  dout(30) << __func__ << " tx dump:\n";
-  JSONFormatter f(true);
-  tx.dump(&f);
-  f.flush(*_dout);
-  *_dout << dendl;
+  bufferlist chunk_bl;
+  if (m->compressed) {
+    string raw;
+    if (!snappy::Uncompress(m->chunk_bl.c_str(), m->chunk_bl.length(), &raw)) {
+      derr << __func__ << " failed to uncompress chunk from " << sync_provider
+	   << ", restarting sync" << dendl;
+      bootstrap();
+      return;
+    }
+    chunk_bl.append(raw);
+  } else {
+    chunk_bl.claim(m->chunk_bl);
+  }
 
-  store->apply_transaction(tx);
+  // a full sync starts from an empty store, and restarts from scratch if
+  // interrupted, so its chunks can be gathered and written in a few large
+  // transactions.
+  sync_pending_tx.append_from_encoded(chunk_bl);
+  sync_pending_bytes += chunk_bl.length();
+  if (!sync_full ||
+      sync_pending_bytes >= g_conf->mon_sync_apply_batch_bytes)
+    sync_apply_pending();
 
   assert(g_conf->mon_sync_requester_kill_at != 6);
 
@@ -1193,6 +1271,10 @@ void Monitor::handle_sync_chunk(MMonSync *m)
 void Monitor::handle_sync_no_cookie(MMonSync *m)
 {
   dout(10) << __func__ << dendl;
+  if (m->cookie && m->cookie != sync_cookie) {
+    dout(10) << __func__ << " stale cookie " << m->cookie << ", ignoring" << dendl;
+    return;
+  }
   bootstrap();
 }
 
@@ -2084,6 +2166,8 @@ void Monitor::handle_command(MMonCommand *m)
   } else if (prefix == "status" ||
 	     prefix == "health" ||
 	     prefix == "df") {
+    if (wait_for_readable_command(m))
+      return;
     string detail;
     cmd_getval(g_ceph_context, cmdmap, "detail", detail);
 
@@ -2134,6 +2218,8 @@ void Monitor::handle_command(MMonCommand *m)
     rs = "";
     r = 0;
   } else if (prefix == "report") {
+    if (wait_for_readable_command(m))
+      return;
 
     // this must be formatted, in its current form
     if (!f)
@@ -2238,6 +2324,21 @@ void Monitor::handle_command(MMonCommand *m)
     m->put();
 }
 
+/*
+ * the read-only commands answered by any mon, leader or peon, come out
+ * of our own copy of the maps; in quorum, serve them under a valid
+ * lease like the services' own read commands.
+ */
+bool Monitor::wait_for_readable_command(MMonCommand *m)
+{
+  if ((is_leader() || is_peon()) && !paxos->is_readable()) {
+    dout(10) << " waiting for paxos -> readable" << dendl;
+    paxos->wait_for_readable(new C_RetryMessage(this, m));
+    return true;
+  }
+  return false;
+}
+
 void Monitor::reply_command(MMonCommand *m, int rc, const string &rs, version_t version)
 {
   bufferlist rdata;
@@ -2250,9 +2351,45 @@ void Monitor::reply_command(MMonCommand *m, int rc, const string &rs, bufferlist
   reply->set_tid(m->get_tid());
   reply->set_data(rdata);
   send_reply(m, reply);
+  note_command_reply(m);
   m->put();
 }
 
+void Monitor::note_command_reply(MMonCommand *m)
+{
+  utime_t lat = ceph_clock_now(g_ceph_context);
+  lat -= m->get_recv_stamp();
+  logger->inc(l_mon_command);
+  logger->tinc(l_mon_command_lat, lat);
+
+  map<string, cmd_vartype> cmdmap;
+  stringstream ss;
+  string prefix;
+  if (!cmdmap_from_json(m->cmd, &cmdmap, ss) ||
+      !cmd_getval(g_ceph_context, cmdmap, "prefix", prefix))
+    prefix = "(unparsed)";
+  CommandStats& s = command_stats[prefix];
+  s.count++;
+  s.total += lat;
+  if (lat > s.max)
+    s.max = lat;
+}
+
+void Monitor::dump_command_stats(Formatter *f)
+{
+  f->open_object_section("command_stats");
+  for (map<string, CommandStats>::iterator p = command_stats.begin();
+       p != command_stats.end();
+       ++p) {
+    f->open_object_section(p->first.c_str());
+    f->dump_unsigned("count", p->second.count);
+    f->dump_float("avg_lat", (double)p->second.total / p->second.count);
+    f->dump_float("max_lat", (double)p->second.max);
+    f->close_section();
+  }
+  f->close_section();
+}
+
 
 // ------------------------
 // request/reply routing
@@ -2286,6 +2423,9 @@ void Monitor::forward_request_leader(PaxosServiceMessage *req)
     
     dout(10) << "forward_request " << rr->tid << " request " << *req << dendl;
 
+    if (req->get_type() == MSG_MON_COMMAND)
+      logger->inc(l_mon_command_forwarded);
+
     MForward *forward = new MForward(rr->tid, req, rr->session->caps);
     forward->set_priority(req->get_priority());
     messenger->send_message(forward, monmap->get_inst(mon));
@@ -2651,6 +2791,27 @@ bool Monitor::_ms_dispatch(Message *m)
   return ret;
 }
 
+/**
+ * an osd may report several failed peers in one message.  OSDMonitor
+ * tracks reports (and answers them) per target, so hand it one message
+ * for each, all from the same reporter and connection.
+ */
+void Monitor::split_osd_failure(MOSDFailure *m)
+{
+  while (!m->more.empty()) {
+    MOSDFailure *f = new MOSDFailure(m->fsid, m->more.back().first,
+				     m->more.back().second, m->get_epoch());
+    m->more.pop_back();
+    f->set_header(m->get_header());
+    f->set_connection(m->get_connection());
+    f->set_recv_stamp(m->get_recv_stamp());
+    f->version = m->version;
+    f->rx_election_epoch = m->rx_election_epoch;
+    dout(20) << __func__ << " " << *f << dendl;
+    paxos_service[PAXOS_OSDMAP]->dispatch(f);
+  }
+}
+
 bool Monitor::dispatch(MonSession *s, Message *m, const bool src_is_mon)
 {
   bool ret = true;
@@ -2694,8 +2855,11 @@ bool Monitor::dispatch(MonSession *s, Message *m, const bool src_is_mon)
       break;
 
     // OSDs
-    case MSG_OSD_MARK_ME_DOWN:
     case MSG_OSD_FAILURE:
+      split_osd_failure(static_cast<MOSDFailure*>(m));
+      paxos_service[PAXOS_OSDMAP]->dispatch((PaxosServiceMessage*)m);
+      break;
+    case MSG_OSD_MARK_ME_DOWN:
     case MSG_OSD_BOOT:
     case MSG_OSD_ALIVE:
     case MSG_OSD_PGTEMP:
@@ -102,6 +102,7 @@ struct MRoute;
 struct MForward;
 struct MTimeCheck;
 struct MMonHealth;
+class MOSDFailure;
 
 #define COMPAT_SET_LOC "feature_set"
 
@@ -253,6 +254,9 @@ private:
   bool sync_full;                ///< true if we are a full sync, false for recent catch-up
   version_t sync_start_version;  ///< last_committed at sync start
   Context *sync_timeout_event;   ///< timeout event
+  unsigned sync_chunks_inflight; ///< chunks requested but not received yet
+  MonitorDBStore::Transaction sync_pending_tx; ///< full sync chunks not applied yet
+  uint64_t sync_pending_bytes;   ///< size of the chunks in sync_pending_tx
 
   /**
    * floor for sync source
@@ -371,10 +375,16 @@ private:
   void sync_finish(version_t last_committed);
 
   /**
-   * request the next chunk from the provider
+   * request chunks from the provider, until mon_sync_chunks_inflight
+   * requests are outstanding
    */
   void sync_get_next_chunk();
 
+  /**
+   * apply the full sync chunks gathered in sync_pending_tx
+   */
+  void sync_apply_pending();
+
   /**
    * handle sync message
    *
@@ -608,6 +618,17 @@ public:
   void reply_command(MMonCommand *m, int rc, const string &rs, version_t version);
   void reply_command(MMonCommand *m, int rc, const string &rs, bufferlist& rdata, version_t version);
 
+  // commands answered by this mon, by prefix
+  struct CommandStats {
+    uint64_t count;
+    utime_t total, max;
+    CommandStats() : count(0) {}
+  };
+  map<string, CommandStats> command_stats;
+  void note_command_reply(MMonCommand *m);
+  bool wait_for_readable_command(MMonCommand *m);
+  void dump_command_stats(Formatter *f);
+
 
   void handle_probe(MMonProbe *m);
   /**
@@ -707,6 +728,7 @@ public:
   }
   // dissociate message handling from session and connection logic
   bool dispatch(MonSession *s, Message *m, const bool src_is_mon);
+  void split_osd_failure(MOSDFailure *m);
   //mon_caps is used for un-connected messages from monitors
   MonCap * mon_caps;
   bool ms_get_authorizer(int dest_type, AuthAuthorizer **authorizer, bool force_new);
@@ -26,10 +26,13 @@
 #include "include/assert.h"
 #include "common/Formatter.h"
 #include "common/errno.h"
+#include "common/safe_io.h"
 
 class MonitorDBStore
 {
-  boost::scoped_ptr<LevelDBStore> db;
+  boost::scoped_ptr<KeyValueDB> db;
+  string kv_type;   ///< KeyValueDB type of store.db
+  string path;      ///< mon data dir
   bool do_dump;
   int dump_fd;
 
@@ -487,19 +490,33 @@ class MonitorDBStore
   }
 
   int open(ostream &out) {
-    db->options.write_buffer_size = g_conf->mon_leveldb_write_buffer_size;
-    db->options.cache_size = g_conf->mon_leveldb_cache_size;
-    db->options.block_size = g_conf->mon_leveldb_block_size;
-    db->options.bloom_size = g_conf->mon_leveldb_bloom_size;
-    db->options.compression_enabled = g_conf->mon_leveldb_compression;
-    db->options.max_open_files = g_conf->mon_leveldb_max_open_files;
-    db->options.paranoid_checks = g_conf->mon_leveldb_paranoid;
-    db->options.log_file = g_conf->mon_leveldb_log;
+    if (kv_type == "leveldb") {
+      LevelDBStore *ldb = static_cast<LevelDBStore*>(db.get());
+      ldb->options.write_buffer_size = g_conf->mon_leveldb_write_buffer_size;
+      ldb->options.cache_size = g_conf->mon_leveldb_cache_size;
+      ldb->options.block_size = g_conf->mon_leveldb_block_size;
+      ldb->options.bloom_size = g_conf->mon_leveldb_bloom_size;
+      ldb->options.compression_enabled = g_conf->mon_leveldb_compression;
+      ldb->options.max_open_files = g_conf->mon_leveldb_max_open_files;
+      ldb->options.paranoid_checks = g_conf->mon_leveldb_paranoid;
+      ldb->options.log_file = g_conf->mon_leveldb_log;
+    }
+    db->set_column_families(g_conf->mon_rocksdb_column_families,
+			    g_conf->mon_rocksdb_column_family_options);
     return db->open(out);
   }
 
   int create_and_open(ostream &out) {
-    return db->create_and_open(out);
+    db->set_column_families(g_conf->mon_rocksdb_column_families,
+			    g_conf->mon_rocksdb_column_family_options);
+    int r = db->create_and_open(out);
+    if (r < 0 || path.empty())
+      return r;
+    r = safe_write_file(path.c_str(), "kv_backend",
+			kv_type.c_str(), kv_type.length());
+    if (r < 0)
+      out << "failed to write kv_backend: " << cpp_strerror(r) << std::endl;
+    return r;
   }
 
   void compact() {
@@ -514,23 +531,35 @@ class MonitorDBStore
     return db->get_estimated_size(extras);
   }
 
-  MonitorDBStore(const string& path) :
+  MonitorDBStore(const string& p) :
     db(0), do_dump(false), dump_fd(-1) {
     string::const_reverse_iterator rit;
     int pos = 0;
-    for (rit = path.rbegin(); rit != path.rend(); ++rit, ++pos) {
+    for (rit = p.rbegin(); rit != p.rend(); ++rit, ++pos) {
       if (*rit != '/')
 	break;
     }
+    path = p.substr(0, p.size() - pos);
     ostringstream os;
-    os << path.substr(0, path.size() - pos) << "/store.db";
+    os << path << "/store.db";
     string full_path = os.str();
 
-    LevelDBStore *db_ptr = new LevelDBStore(g_ceph_context, full_path);
+    // stores that predate kv_backend are leveldb
+    char buf[64];
+    int r = safe_read_file(path.c_str(), "kv_backend", buf, sizeof(buf));
+    if (r >= 0)
+      kv_type = string(buf, r);
+    else if (::access(full_path.c_str(), F_OK) == 0)
+      kv_type = "leveldb";
+    else
+      kv_type = g_conf->mon_keyvaluedb;
+
+    KeyValueDB *db_ptr = KeyValueDB::create(g_ceph_context, kv_type,
+					    full_path);
     if (!db_ptr) {
-      derr << __func__ << " error initializing level db back storage in "
-		<< full_path << dendl;
-      assert(0 != "MonitorDBStore: error initializing level db back storage");
+      derr << __func__ << " error initializing " << kv_type
+	   << " db back storage in " << full_path << dendl;
+      assert(0 != "MonitorDBStore: error initializing db back storage");
     }
     db.reset(db_ptr);
 
@@ -546,8 +575,8 @@ class MonitorDBStore
       }
     }
   }
-  MonitorDBStore(LevelDBStore *db_ptr) :
-    db(0), do_dump(false), dump_fd(-1) {
+  MonitorDBStore(KeyValueDB *db_ptr, const string &type) :
+    db(0), kv_type(type), do_dump(false), dump_fd(-1) {
     db.reset(db_ptr);
   }
   ~MonitorDBStore() {
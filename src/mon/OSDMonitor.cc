@@ -247,6 +247,11 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
     osd_epoch.erase(p++);
   }
 
+  // pgmon maps pgs against this map over and over; only pools whose
+  // placement the new epochs changed are recomputed
+  if (g_conf->mon_osdmap_precompute_pg_mappings)
+    osdmap.precompute_pg_mappings();
+
   if (mon->is_leader()) {
     // kick pgmon, make sure it's seen the latest map
     mon->pgmon()->check_osd_map(osdmap.epoch);
@@ -731,6 +736,15 @@ bool OSDMonitor::should_propose(double& delay)
     return true;
   }
 
+  // a round is already in flight: queue behind it now so the map change
+  // is merged into the very next round, instead of waiting out
+  // paxos_propose_interval after that round commits.
+  if (g_conf->paxos_batch_proposals && paxos->is_updating() &&
+      get_last_committed() > 1) {
+    delay = g_conf->paxos_min_wait;
+    return true;
+  }
+
   return PaxosService::should_propose(delay);
 }
 
@@ -966,7 +980,8 @@ void OSDMonitor::check_failures(utime_t now)
 
 bool OSDMonitor::check_failure(utime_t now, int target_osd, failure_info_t& fi)
 {
-  utime_t orig_grace(g_conf->osd_heartbeat_grace, 0);
+  utime_t orig_grace;
+  orig_grace.set_from_double(g_conf->osd_heartbeat_grace);
   utime_t max_failed_since = fi.get_failed_since();
   utime_t failed_for = now - max_failed_since;
 
@@ -1042,7 +1057,9 @@ bool OSDMonitor::prepare_failure(MOSDFailure *m)
 
   // calculate failure time
   utime_t now = ceph_clock_now(g_ceph_context);
-  utime_t failed_since = m->get_recv_stamp() - utime_t(m->failed_for ? m->failed_for : g_conf->osd_heartbeat_grace, 0);
+  utime_t failed_for;
+  failed_for.set_from_double(m->failed_for ? (double)m->failed_for : g_conf->osd_heartbeat_grace);
+  utime_t failed_since = m->get_recv_stamp() - failed_for;
   
   if (m->if_osd_failed()) {
     // add a report
@@ -2854,6 +2871,61 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
       return -EINVAL;
     }
     ss << " pool " << pool << " flag hashpspool";
+  } else if (var == "balance_reads") {
+    if (val == "true") {
+      p.flags |= pg_pool_t::FLAG_BALANCE_READS;
+      ss << "set";
+    } else if (val == "false") {
+      p.flags &= ~pg_pool_t::FLAG_BALANCE_READS;
+      ss << "unset";
+    } else {
+      ss << "expecting value true or false";
+      return -EINVAL;
+    }
+    ss << " pool " << pool << " flag balance_reads";
+  } else if (var == "hit_set_period" || var == "hit_set_count" ||
+	     var == "target_max_objects" || var == "target_max_bytes") {
+    if (interr.length()) {
+      ss << "error parsing integer value '" << val << "': " << interr;
+      return -EINVAL;
+    }
+    if (n < 0) {
+      ss << var << " must be >= 0";
+      return -EINVAL;
+    }
+    if (var == "hit_set_period")
+      p.hit_set_period = n;
+    else if (var == "hit_set_count")
+      p.hit_set_count = n;
+    else if (var == "target_max_objects")
+      p.target_max_objects = n;
+    else
+      p.target_max_bytes = n;
+    ss << "set pool " << pool << " " << var << " to " << n;
+  } else if (var == "hit_set_type") {
+    HitSet::impl_type_t t = HitSet::get_type_from_name(val);
+    if (t != HitSet::TYPE_BLOOM && t != HitSet::TYPE_EXPLICIT_HASH) {
+      ss << "unrecognized hit_set type '" << val
+	 << "', expecting bloom or explicit_hash";
+      return -EINVAL;
+    }
+    p.hit_set_type = t;
+    ss << "set pool " << pool << " hit_set_type to " << val;
+  } else if (var == "cache_target_dirty_ratio" ||
+	     var == "cache_target_full_ratio") {
+    if (floaterr.length()) {
+      ss << "error parsing floating point value '" << val << "': " << floaterr;
+      return -EINVAL;
+    }
+    if (f < 0 || f > 1.0) {
+      ss << var << " must be between 0 and 1";
+      return -EINVAL;
+    }
+    if (var == "cache_target_dirty_ratio")
+      p.cache_target_dirty_ratio_micro = (uint32_t)(f * 1000000);
+    else
+      p.cache_target_full_ratio_micro = (uint32_t)(f * 1000000);
+    ss << "set pool " << pool << " " << var << " to " << f;
   } else {
     ss << "unrecognized variable '" << var << "'";
     return -EINVAL;
@@ -316,6 +316,9 @@ void PGMap::register_nearfull_status(int osd, const osd_stat_t& s)
 void PGMap::calc_stats()
 {
   num_pg_by_state.clear();
+  pg_inactive.clear();
+  pg_unclean.clear();
+  pg_stale.clear();
   num_pg = 0;
   num_osd = 0;
   pg_pool_sum.clear();
@@ -386,6 +389,12 @@ void PGMap::stat_pg_add(const pg_t &pgid, const pg_stat_t &s)
 {
   num_pg++;
   num_pg_by_state[s.state]++;
+  if ((s.state & PG_STATE_ACTIVE) == 0)
+    pg_inactive.insert(pgid);
+  if ((s.state & PG_STATE_CLEAN) == 0)
+    pg_unclean.insert(pgid);
+  if (s.state & PG_STATE_STALE)
+    pg_stale.insert(pgid);
   pg_pool_sum[pgid.pool()].add(s);
   pg_sum.add(s);
   if (s.state & PG_STATE_CREATING) {
@@ -400,6 +409,12 @@ void PGMap::stat_pg_sub(const pg_t &pgid, const pg_stat_t &s)
   num_pg--;
   if (--num_pg_by_state[s.state] == 0)
     num_pg_by_state.erase(s.state);
+  if ((s.state & PG_STATE_ACTIVE) == 0)
+    pg_inactive.erase(pgid);
+  if ((s.state & PG_STATE_CLEAN) == 0)
+    pg_unclean.erase(pgid);
+  if (s.state & PG_STATE_STALE)
+    pg_stale.erase(pgid);
 
   pool_stat_t& ps = pg_pool_sum[pgid.pool()];
   ps.sub(s);
@@ -698,28 +713,40 @@ void PGMap::dump(ostream& ss) const
 void PGMap::get_stuck_stats(PGMap::StuckPG type, utime_t cutoff,
 			    hash_map<pg_t, pg_stat_t>& stuck_pgs) const
 {
-  for (hash_map<pg_t, pg_stat_t>::const_iterator i = pg_stat.begin();
-       i != pg_stat.end();
-       ++i) {
+  // only pgs in the matching state can be stuck in it, and those are
+  // few on a healthy cluster; don't walk all of pg_stat.
+  const set<pg_t> *candidates;
+  switch (type) {
+  case STUCK_INACTIVE:
+    candidates = &pg_inactive;
+    break;
+  case STUCK_UNCLEAN:
+    candidates = &pg_unclean;
+    break;
+  case STUCK_STALE:
+    candidates = &pg_stale;
+    break;
+  default:
+    assert(0 == "invalid type");
+  }
+
+  for (set<pg_t>::const_iterator p = candidates->begin();
+       p != candidates->end();
+       ++p) {
+    hash_map<pg_t, pg_stat_t>::const_iterator i = pg_stat.find(*p);
+    if (i == pg_stat.end())
+      continue;
     utime_t val;
     switch (type) {
     case STUCK_INACTIVE:
-      if (i->second.state & PG_STATE_ACTIVE)
-	continue;
       val = i->second.last_active;
       break;
     case STUCK_UNCLEAN:
-      if (i->second.state & PG_STATE_CLEAN)
-	continue;
       val = i->second.last_clean;
       break;
     case STUCK_STALE:
-      if ((i->second.state & PG_STATE_STALE) == 0)
-	continue;
       val = i->second.last_unstale;
       break;
-    default:
-      assert(0 == "invalid type");
     }
 
     if (val < cutoff) {
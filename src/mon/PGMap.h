@@ -101,6 +101,8 @@ public:
 
   // aggregate stats (soft state), generated by calc_stats()
   hash_map<int,int> num_pg_by_state;
+  // pgs that can be stuck, by how; get_stuck_stats() only looks at these
+  set<pg_t> pg_inactive, pg_unclean, pg_stale;
   int64_t num_pg, num_osd;
   hash_map<int,pool_stat_t> pg_pool_sum;
   pool_stat_t pg_sum;
@@ -413,27 +413,151 @@ void PGMonitor::read_pgmap_full()
   }
 }
 
+/*
+ * the dirty pg and osd lists of an incremental are kept around for
+ * mon_max_pgmap_epochs versions, and with most pgs reporting in every
+ * version they are most of what an incremental is.  sorted, as they
+ * are, they encode as deltas in a byte or two per entry instead of the
+ * 17 of a full pg_t.
+ */
+static void encode_varint(uint64_t v, bufferlist& bl)
+{
+  while (v >= 0x80) {
+    bl.append((char)(0x80 | (v & 0x7f)));
+    v >>= 7;
+  }
+  bl.append((char)v);
+}
+
+static uint64_t decode_varint(bufferlist::iterator& p)
+{
+  uint64_t v = 0;
+  int shift = 0;
+  __u8 b;
+  do {
+    ::decode(b, p);
+    v |= (uint64_t)(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  return v;
+}
+
+static bool can_encode_pgs_compact(const set<pg_t>& pgs)
+{
+  for (set<pg_t>::const_iterator p = pgs.begin(); p != pgs.end(); ++p)
+    if (p->preferred() >= 0)
+      return false;
+  return true;
+}
+
+// num pools, then for each: pool, num pgs, and their seeds as deltas
+static void encode_pgs_compact(const set<pg_t>& pgs, bufferlist& bl)
+{
+  set<uint64_t> pools;
+  for (set<pg_t>::const_iterator p = pgs.begin(); p != pgs.end(); ++p)
+    pools.insert(p->pool());
+  encode_varint(pools.size(), bl);
+
+  set<pg_t>::const_iterator p = pgs.begin();
+  while (p != pgs.end()) {
+    set<pg_t>::const_iterator end = p;
+    unsigned n = 0;
+    while (end != pgs.end() && end->pool() == p->pool()) {
+      ++end;
+      ++n;
+    }
+    encode_varint(p->pool(), bl);
+    encode_varint(n, bl);
+    uint32_t last = 0;
+    for (; p != end; ++p) {
+      encode_varint(p->ps() - last, bl);
+      last = p->ps();
+    }
+  }
+}
+
+static void decode_pgs_compact(bufferlist::iterator& p, vector<pg_t>& pgs)
+{
+  unsigned num_pools = decode_varint(p);
+  while (num_pools--) {
+    uint64_t pool = decode_varint(p);
+    unsigned n = decode_varint(p);
+    uint32_t ps = 0;
+    while (n--) {
+      ps += decode_varint(p);
+      pgs.push_back(pg_t(ps, pool, -1));
+    }
+  }
+}
+
+// osd ids as deltas
+static void encode_osds_compact(const set<int32_t>& osds, bufferlist& bl)
+{
+  encode_varint(osds.size(), bl);
+  int32_t last = 0;
+  for (set<int32_t>::const_iterator p = osds.begin(); p != osds.end(); ++p) {
+    encode_varint(*p - last, bl);
+    last = *p;
+  }
+}
+
+static void decode_osds_compact(bufferlist::iterator& p, vector<int32_t>& osds)
+{
+  unsigned n = decode_varint(p);
+  int32_t osd = 0;
+  while (n--) {
+    osd += decode_varint(p);
+    osds.push_back(osd);
+  }
+}
+
 void PGMonitor::apply_pgmap_delta(bufferlist& bl)
 {
   version_t v = pg_map.version + 1;
 
   utime_t inc_stamp;
   bufferlist dirty_pgs, dirty_osds;
+  __u8 compact = 0;
   {
     bufferlist::iterator p = bl.begin();
     ::decode(inc_stamp, p);
     ::decode(dirty_pgs, p);
     ::decode(dirty_osds, p);
+    if (!p.end())
+      ::decode(compact, p);
+  }
+
+  vector<pg_t> pgs;
+  vector<int32_t> osds;
+  {
+    bufferlist::iterator p = dirty_pgs.begin();
+    if (compact) {
+      decode_pgs_compact(p, pgs);
+    } else {
+      while (!p.end()) {
+	pg_t pgid;
+	::decode(pgid, p);
+	pgs.push_back(pgid);
+      }
+    }
+    p = dirty_osds.begin();
+    if (compact) {
+      decode_osds_compact(p, osds);
+    } else {
+      while (!p.end()) {
+	int32_t osd;
+	::decode(osd, p);
+	osds.push_back(osd);
+      }
+    }
   }
 
   pool_stat_t pg_sum_old = pg_map.pg_sum;
   hash_map<uint64_t, pool_stat_t> pg_pool_sum_old;
 
   // pgs
-  bufferlist::iterator p = dirty_pgs.begin();
-  while (!p.end()) {
-    pg_t pgid;
-    ::decode(pgid, p);
+  for (vector<pg_t>::iterator p = pgs.begin(); p != pgs.end(); ++p) {
+    pg_t pgid = *p;
     dout(20) << " refreshing pg " << pgid << dendl;
     bufferlist bl;
     int r = mon->store->get(pgmap_pg_prefix, stringify(pgid), bl);
@@ -449,10 +573,8 @@ void PGMonitor::apply_pgmap_delta(bufferlist& bl)
   }
 
   // osds
-  p = dirty_osds.begin();
-  while (!p.end()) {
-    int32_t osd;
-    ::decode(osd, p);
+  for (vector<int32_t>::iterator p = osds.begin(); p != osds.end(); ++p) {
+    int32_t osd = *p;
     dout(20) << " refreshing osd." << osd << dendl;
     bufferlist bl;
     int r = mon->store->get(pgmap_osd_prefix, stringify(osd), bl);
@@ -504,33 +626,30 @@ void PGMonitor::encode_pending(MonitorDBStore::Transaction *t)
     t->put(prefix, "nearfull_ratio", bl);
   }
 
-  bufferlist incbl;
-  ::encode(pending_inc.stamp, incbl);
+  set<pg_t> dirty_pgs;
   {
-    bufferlist dirty;
     string prefix = pgmap_pg_prefix;
     for (map<pg_t,pg_stat_t>::const_iterator p = pending_inc.pg_stat_updates.begin();
 	 p != pending_inc.pg_stat_updates.end();
 	 ++p) {
-      ::encode(p->first, dirty);
+      dirty_pgs.insert(p->first);
       bufferlist bl;
       ::encode(p->second, bl, features);
       t->put(prefix, stringify(p->first), bl);
     }
     for (set<pg_t>::const_iterator p = pending_inc.pg_remove.begin(); p != pending_inc.pg_remove.end(); ++p) {
-      ::encode(*p, dirty);
+      dirty_pgs.insert(*p);
       t->erase(prefix, stringify(*p));
     }
-    ::encode(dirty, incbl);
   }
+  set<int32_t> dirty_osds;
   {
-    bufferlist dirty;
     string prefix = pgmap_osd_prefix;
     for (map<int32_t,osd_stat_t>::const_iterator p =
 	   pending_inc.get_osd_stat_updates().begin();
 	 p != pending_inc.get_osd_stat_updates().end();
 	 ++p) {
-      ::encode(p->first, dirty);
+      dirty_osds.insert(p->first);
       bufferlist bl;
       ::encode(p->second, bl, features);
       t->put(prefix, stringify(p->first), bl);
@@ -539,17 +658,85 @@ void PGMonitor::encode_pending(MonitorDBStore::Transaction *t)
 	   pending_inc.get_osd_stat_rm().begin();
 	 p != pending_inc.get_osd_stat_rm().end();
 	 ++p) {
-      ::encode(*p, dirty);
+      dirty_osds.insert(*p);
       t->erase(prefix, stringify(*p));
     }
+  }
+
+  // the whole quorum has to be able to read the compact lists
+  bool compact = (features & CEPH_FEATURE_MON_PGMAP_COMPACT) &&
+    can_encode_pgs_compact(dirty_pgs) &&
+    (dirty_osds.empty() || *dirty_osds.begin() >= 0);
+
+  bufferlist incbl;
+  ::encode(pending_inc.stamp, incbl);
+  {
+    bufferlist dirty;
+    if (compact) {
+      encode_pgs_compact(dirty_pgs, dirty);
+    } else {
+      for (set<pg_t>::iterator p = dirty_pgs.begin(); p != dirty_pgs.end(); ++p)
+	::encode(*p, dirty);
+    }
     ::encode(dirty, incbl);
   }
+  {
+    bufferlist dirty;
+    if (compact) {
+      encode_osds_compact(dirty_osds, dirty);
+    } else {
+      for (set<int32_t>::iterator p = dirty_osds.begin(); p != dirty_osds.end(); ++p)
+	::encode(*p, dirty);
+    }
+    ::encode(dirty, incbl);
+  }
+  if (compact) {
+    __u8 v = 1;
+    ::encode(v, incbl);
+  }
 
   put_version(t, version, incbl);
 
   put_last_committed(t, version);
 }
 
+/*
+ * pending_inc holds nothing but osd/pg stat reports, i.e. nothing the
+ * osdmap, pg creation or the full checks are waiting on.
+ */
+bool PGMonitor::pending_is_stats_only() const
+{
+  return pending_inc.pg_remove.empty() &&
+    pending_inc.get_osd_stat_rm().empty() &&
+    pending_inc.osdmap_epoch == 0 &&
+    pending_inc.pg_scan == 0 &&
+    pending_inc.full_ratio <= 0 &&
+    pending_inc.nearfull_ratio <= 0;
+}
+
+/*
+ * stat reports are soft state and there are a lot of them: hold them
+ * for mon_pg_stats_propose_interval since the last pgmap, so that one
+ * proposal (and one store write per pg) covers many reports, and paxos
+ * stays free for the osdmap and friends in between.
+ */
+bool PGMonitor::should_propose(double& delay)
+{
+  if (!PaxosService::should_propose(delay))
+    return false;
+
+  double interval = g_conf->mon_pg_stats_propose_interval;
+  if (interval > 0 && get_last_committed() > 1 && pending_is_stats_only()) {
+    utime_t now = ceph_clock_now(g_ceph_context);
+    double wait = interval - (double)(now - pg_map.stamp);
+    if (wait > delay) {
+      dout(10) << "should_propose holding stats for " << wait << "s" << dendl;
+      delay = wait;
+    }
+  }
+  return true;
+}
+
 version_t PGMonitor::get_trim_to()
 {
   unsigned max = g_conf->mon_max_pgmap_epochs;
@@ -70,6 +70,8 @@ private:
   void update_logger();
 
   void encode_pending(MonitorDBStore::Transaction *t);
+  bool pending_is_stats_only() const;
+  bool should_propose(double &delay);
   void read_pgmap_meta();
   void read_pgmap_full();
   void apply_pgmap_delta(bufferlist& bl);
@@ -903,13 +903,17 @@ void Paxos::commit_proposal()
   assert(!proposals.empty());
   assert(is_updating());
 
-  C_Proposal *proposal = static_cast<C_Proposal*>(proposals.front());
-  assert(proposal->proposed);
-  dout(10) << __func__ << " proposal " << proposal << " took "
-	   << (ceph_clock_now(NULL) - proposal->proposal_time)
-	   << " to finish" << dendl;
-  proposals.pop_front();
-  proposal->complete(0);
+  // a round may carry several merged proposals; they all commit together
+  do {
+    C_Proposal *proposal = static_cast<C_Proposal*>(proposals.front());
+    assert(proposal->proposed);
+    dout(10) << __func__ << " proposal " << proposal << " took "
+	     << (ceph_clock_now(NULL) - proposal->proposal_time)
+	     << " to finish" << dendl;
+    proposals.pop_front();
+    proposal->complete(0);
+  } while (!proposals.empty() &&
+	   static_cast<C_Proposal*>(proposals.front())->proposed);
 }
 
 void Paxos::finish_round()
@@ -1328,16 +1332,37 @@ void Paxos::propose_queued()
   assert(!proposal->proposed);
 
   cancel_events();
+
+  // whatever the services queued while the last round was in flight goes
+  // out in this one, rather than one round per queued proposal.
+  bufferlist bl;
+  unsigned merged = 1;
+  if (g_conf->paxos_batch_proposals && proposals.size() > 1) {
+    MonitorDBStore::Transaction t;
+    merged = 0;
+    for (list<Context*>::iterator p = proposals.begin();
+	 p != proposals.end(); ++p) {
+      C_Proposal *q = static_cast<C_Proposal*>(*p);
+      assert(!q->proposed);
+      t.append_from_encoded(q->bl);
+      q->proposed = true;
+      ++merged;
+    }
+    t.encode(bl);
+  } else {
+    proposal->proposed = true;
+    bl = proposal->bl;
+  }
   dout(10) << __func__ << " " << (last_committed + 1)
-	  << " " << proposal->bl.length() << " bytes" << dendl;
-  proposal->proposed = true;
+	  << " " << bl.length() << " bytes, " << merged << " proposals"
+	  << dendl;
 
   dout(30) << __func__ << " ";
   list_proposals(*_dout);
   *_dout << dendl;
 
   state = STATE_UPDATING;
-  begin(proposal->bl);
+  begin(bl);
 }
 
 void Paxos::queue_proposal(bufferlist& bl, Context *onfinished)
@@ -55,14 +55,29 @@ int Accepter::bind(const entity_addr_t &bind_addr, const set<int>& avoid_ports)
     family = conf->ms_bind_ipv6 ? AF_INET6 : AF_INET;
   }
 
+  // an rdma address is only reachable over rdma
+  if (bind_addr.is_rdma()) {
+    transport = get_rdma_transport();
+    if (!transport) {
+      lderr(msgr->cct) << "accepter.bind " << bind_addr
+		       << " is an rdma address, and this build has no rdma support"
+		       << dendl;
+      transport = get_tcp_transport();
+      return -EOPNOTSUPP;
+    }
+  } else {
+    transport = get_tcp_transport();
+  }
+
   /* socket creation */
-  listen_sd = ::socket(family, SOCK_STREAM, 0);
+  listen_sd = transport->socket(family, SOCK_STREAM, 0);
   if (listen_sd < 0) {
     char buf[80];
-    lderr(msgr->cct) << "accepter.bind unable to create socket: "
-		     << strerror_r(errno, buf, sizeof(buf)) << dendl;
+    lderr(msgr->cct) << "accepter.bind unable to create " << transport->get_name()
+		     << " socket: " << strerror_r(errno, buf, sizeof(buf)) << dendl;
     return -errno;
   }
+  transport->init_socket(msgr->cct, listen_sd);
 
   // use whatever user specified (if anything)
   entity_addr_t listen_addr = bind_addr;
@@ -75,14 +90,14 @@ int Accepter::bind(const entity_addr_t &bind_addr, const set<int>& avoid_ports)
 
     // reuse addr+port when possible
     int on = 1;
-    rc = ::setsockopt(listen_sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    rc = transport->setsockopt(listen_sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
     if (rc < 0) {
       ldout(msgr->cct,0) << "accepter.bind unable to setsockopt: "
 			 << cpp_strerror(errno) << dendl;
       return -errno;
     }
 
-    rc = ::bind(listen_sd, (struct sockaddr *) &listen_addr.ss_addr(), listen_addr.addr_size());
+    rc = transport->bind(listen_sd, (struct sockaddr *) &listen_addr.ss_addr(), listen_addr.addr_size());
     if (rc < 0) {
       char buf[80];
       lderr(msgr->cct) << "accepter.bind unable to bind to " << listen_addr.ss_addr()
@@ -95,7 +110,7 @@ int Accepter::bind(const entity_addr_t &bind_addr, const set<int>& avoid_ports)
       if (avoid_ports.count(port))
 	continue;
       listen_addr.set_port(port);
-      rc = ::bind(listen_sd, (struct sockaddr *) &listen_addr.ss_addr(), listen_addr.addr_size());
+      rc = transport->bind(listen_sd, (struct sockaddr *) &listen_addr.ss_addr(), listen_addr.addr_size());
       if (rc == 0)
 	break;
     }
@@ -113,17 +128,18 @@ int Accepter::bind(const entity_addr_t &bind_addr, const set<int>& avoid_ports)
 
   // what port did we get?
   socklen_t llen = sizeof(listen_addr.ss_addr());
-  rc = getsockname(listen_sd, (sockaddr*)&listen_addr.ss_addr(), &llen);
+  rc = transport->getsockname(listen_sd, (sockaddr*)&listen_addr.ss_addr(), &llen);
   if (rc < 0) {
     rc = -errno;
     lderr(msgr->cct) << "accepter.bind failed getsockname: " << cpp_strerror(rc) << dendl;
     return rc;
   }
   
-  ldout(msgr->cct,10) << "accepter.bind bound to " << listen_addr << dendl;
+  ldout(msgr->cct,10) << "accepter.bind bound to " << listen_addr
+		      << " over " << transport->get_name() << dendl;
 
   // listen!
-  rc = ::listen(listen_sd, 128);
+  rc = transport->listen(listen_sd, 128);
   if (rc < 0) {
     rc = -errno;
     lderr(msgr->cct) << "accepter.bind unable to listen on " << listen_addr
@@ -195,14 +211,20 @@ void *Accepter::entry()
 
   char buf[80];
 
+  // shutting a listening rsocket down does not wake up its rpoll, so
+  // look at done every now and then
+  int timeout = transport == get_tcp_transport() ? -1 : 1000;
+
   struct pollfd pfd;
   pfd.fd = listen_sd;
   pfd.events = POLLIN | POLLERR | POLLNVAL | POLLHUP;
   while (!done) {
     ldout(msgr->cct,20) << "accepter calling poll" << dendl;
-    int r = poll(&pfd, 1, -1);
+    int r = transport->poll(&pfd, 1, timeout);
     if (r < 0)
       break;
+    if (r == 0)
+      continue;
     ldout(msgr->cct,20) << "accepter poll got " << r << dendl;
 
     if (pfd.revents & (POLLERR | POLLNVAL | POLLHUP))
@@ -214,12 +236,12 @@ void *Accepter::entry()
     // accept
     entity_addr_t addr;
     socklen_t slen = sizeof(addr.ss_addr());
-    int sd = ::accept(listen_sd, (sockaddr*)&addr.ss_addr(), &slen);
+    int sd = transport->accept(listen_sd, (sockaddr*)&addr.ss_addr(), &slen);
     if (sd >= 0) {
       errors = 0;
       ldout(msgr->cct,10) << "accepted incoming on sd " << sd << dendl;
       
-      msgr->add_accept_pipe(sd);
+      msgr->add_accept_pipe(sd, transport);
     } else {
       ldout(msgr->cct,0) << "accepter no incoming connection?  sd = " << sd
 	      << " errno " << errno << " " << strerror_r(errno, buf, sizeof(buf)) << dendl;
@@ -231,7 +253,7 @@ void *Accepter::entry()
   ldout(msgr->cct,20) << "accepter closing" << dendl;
   // don't close socket, in case we start up again?  blech.
   if (listen_sd >= 0) {
-    ::close(listen_sd);
+    transport->close(listen_sd);
     listen_sd = -1;
   }
   ldout(msgr->cct,10) << "accepter stopping" << dendl;
@@ -244,7 +266,7 @@ void Accepter::stop()
   ldout(msgr->cct,10) << "stop accepter" << dendl;
 
   if (listen_sd >= 0) {
-    ::shutdown(listen_sd, SHUT_RDWR);
+    transport->shutdown(listen_sd, SHUT_RDWR);
   }
 
   // wait for thread to stop before closing the socket, to avoid
@@ -252,7 +274,7 @@ void Accepter::stop()
   join();
 
   if (listen_sd >= 0) {
-    ::close(listen_sd);
+    transport->close(listen_sd);
     listen_sd = -1;
   }
   done = false;
@@ -16,6 +16,7 @@
 #define CEPH_MSG_ACCEPTER_H
 
 #include "msg/msg_types.h"
+#include "msg/Transport.h"
 #include "common/Thread.h"
 
 class SimpleMessenger;
@@ -28,10 +29,13 @@ class Accepter : public Thread {
   SimpleMessenger *msgr;
   bool done;
   int listen_sd;
+  Transport *transport;  ///< what listen_sd belongs to
   uint64_t nonce;
 
 public:
-  Accepter(SimpleMessenger *r, uint64_t n) : msgr(r), done(false), listen_sd(-1), nonce(n) {}
+  Accepter(SimpleMessenger *r, uint64_t n)
+    : msgr(r), done(false), listen_sd(-1), transport(get_tcp_transport()),
+      nonce(n) {}
     
   void *entry();
   void stop();
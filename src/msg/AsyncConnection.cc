@@ -0,0 +1,2018 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <limits.h>
+
+#include "include/Context.h"
+#include "common/errno.h"
+#include "common/debug.h"
+#include "common/config.h"
+#include "auth/Crypto.h"
+
+#include "AsyncMessenger.h"
+#include "AsyncConnection.h"
+
+// Constant to limit starting sequence number to 2^31.  Nothing special about it, just a big number.  PLR
+#define SEQ_MASK  0x7fffffff
+#define dout_subsys ceph_subsys_ms
+
+#undef dout_prefix
+#define dout_prefix _conn_prefix(_dout)
+ostream& AsyncConnection::_conn_prefix(std::ostream *_dout) {
+  return *_dout << "-- " << msgr->get_myinst().addr << " >> " << peer_addr << " conn(" << this
+		<< " sd=" << sd << " :" << port
+		<< " s=" << get_state_name(state)
+		<< " pgs=" << peer_global_seq
+		<< " cs=" << connect_seq
+		<< " l=" << policy.lossy
+		<< ").";
+}
+
+// persistent handlers registered with the EventCenter for our socket
+class C_handle_read : public EventCallback {
+  AsyncConnection *conn;
+ public:
+  C_handle_read(AsyncConnection *c) : conn(c) {}
+  void do_request(int fd) {
+    conn->process();
+  }
+};
+
+class C_handle_write : public EventCallback {
+  AsyncConnection *conn;
+ public:
+  C_handle_write(AsyncConnection *c) : conn(c) {}
+  void do_request(int fd) {
+    conn->handle_write();
+  }
+};
+
+// one-shot work queued on the EventCenter; each holds a reference so
+// the connection outlives anything still sitting in the event loop
+class C_conn_process : public Context {
+  AsyncConnection *conn;
+ public:
+  C_conn_process(AsyncConnection *c) : conn(c) {
+    conn->get();
+  }
+  ~C_conn_process() {
+    conn->put();
+  }
+  void finish(int r) {
+    conn->process();
+  }
+};
+
+class C_conn_write : public Context {
+  AsyncConnection *conn;
+ public:
+  C_conn_write(AsyncConnection *c) : conn(c) {
+    conn->get();
+  }
+  ~C_conn_write() {
+    conn->put();
+  }
+  void finish(int r) {
+    conn->handle_write();
+  }
+};
+
+class C_conn_retry_read : public Context {
+  AsyncConnection *conn;
+ public:
+  C_conn_retry_read(AsyncConnection *c) : conn(c) {
+    conn->get();
+  }
+  ~C_conn_retry_read() {
+    conn->put();
+  }
+  void finish(int r) {
+    conn->retry_read();
+  }
+};
+
+class C_conn_cleanup : public Context {
+  AsyncConnection *conn;
+ public:
+  C_conn_cleanup(AsyncConnection *c) : conn(c) {
+    conn->get();
+  }
+  ~C_conn_cleanup() {
+    conn->put();
+  }
+  void finish(int r) {
+    conn->cleanup_handler();
+  }
+};
+
+static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
+{
+  // create a buffer to read into that matches the data alignment
+  unsigned left = len;
+  if (off & ~CEPH_PAGE_MASK) {
+    // head
+    unsigned head = 0;
+    head = MIN(CEPH_PAGE_SIZE - (off & ~CEPH_PAGE_MASK), left);
+    bufferptr bp = buffer::create(head);
+    data.push_back(bp);
+    left -= head;
+  }
+  unsigned middle = left & CEPH_PAGE_MASK;
+  if (middle > 0) {
+    bufferptr bp = buffer::create_page_aligned(middle);
+    data.push_back(bp);
+    left -= middle;
+  }
+  if (left) {
+    bufferptr bp = buffer::create(left);
+    data.push_back(bp);
+  }
+}
+
+
+/**************************************
+ * AsyncConnection
+ */
+
+AsyncConnection::AsyncConnection(AsyncMessenger *m, EventCenter *c)
+  : msgr(m), center(c), connection_state(NULL),
+    lock("AsyncConnection::lock"), state(STATE_NONE), sd(-1), port(-1),
+    peer_type(-1), conn_id(m->dispatch_queue.get_id()),
+    in_q(&(m->dispatch_queue)),
+    keepalive(false), close_on_empty(false), write_scheduled(false),
+    replaced(false),
+    connect_seq(0), peer_global_seq(0), global_seq(0),
+    out_seq(0), in_seq(0), in_seq_acked(0),
+    got_bad_auth(false), authorizer(NULL), session_security(NULL),
+    recv_start(0), recv_end(0), state_offset(0),
+    cur_msg_size(0), msg_throttled_messages(false),
+    msg_throttled_bytes(false), msg_throttled_dispatch(false),
+    msg_left(0)
+{
+  connection_state = new Connection(msgr);
+  connection_state->pipe = get();
+  read_handler = new C_handle_read(this);
+  write_handler = new C_handle_write(this);
+  recv_buf = new char[RECV_BUF_SIZE];
+  state_buffer = new char[4096];
+  memset(&connect_msg, 0, sizeof(connect_msg));
+  memset(&connect_reply, 0, sizeof(connect_reply));
+  memset(&current_header, 0, sizeof(current_header));
+
+  if (randomize_out_seq()) {
+    lsubdout(msgr->cct,ms,15) << "AsyncConnection(): Could not get random bytes to set seq number for session reset; set seq number to " << out_seq << dendl;
+  }
+}
+
+AsyncConnection::~AsyncConnection()
+{
+  assert(out_q.empty());
+  assert(sent.empty());
+  assert(sd < 0);
+  delete authorizer;
+  delete session_security;
+  delete read_handler;
+  delete write_handler;
+  delete[] recv_buf;
+  delete[] state_buffer;
+}
+
+void AsyncConnection::set_socket_options()
+{
+  // disable Nagle algorithm?
+  if (msgr->cct->_conf->ms_tcp_nodelay) {
+    int flag = 1;
+    int r = ::setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
+    if (r < 0) {
+      r = -errno;
+      ldout(msgr->cct,0) << "couldn't set TCP_NODELAY: " << cpp_strerror(r) << dendl;
+    }
+  }
+  if (msgr->cct->_conf->ms_tcp_rcvbuf) {
+    int size = msgr->cct->_conf->ms_tcp_rcvbuf;
+    int r = ::setsockopt(sd, SOL_SOCKET, SO_RCVBUF, (void*)&size, sizeof(size));
+    if (r < 0)  {
+      r = -errno;
+      ldout(msgr->cct,0) << "couldn't set SO_RCVBUF to " << size << ": " << cpp_strerror(r) << dendl;
+    }
+  }
+}
+
+static int set_nonblock(int sd)
+{
+  int flags = ::fcntl(sd, F_GETFL);
+  if (flags < 0)
+    return -errno;
+  if (::fcntl(sd, F_SETFL, flags | O_NONBLOCK) < 0)
+    return -errno;
+  return 0;
+}
+
+/*
+ * read into the socket into p until we have needed bytes
+ *
+ * @return 0 once p holds needed bytes, > 0 if we have to wait for
+ * more input, < 0 on error
+ */
+int AsyncConnection::read_until(unsigned needed, char *p)
+{
+  assert(needed);
+  // serve what we can from the read-ahead buffer first
+  if (recv_end > recv_start) {
+    unsigned to_copy = MIN(recv_end - recv_start, needed - state_offset);
+    memcpy(p + state_offset, recv_buf + recv_start, to_copy);
+    recv_start += to_copy;
+    state_offset += to_copy;
+  }
+
+  while (state_offset < needed) {
+    unsigned left = needed - state_offset;
+    int r;
+    if (left < RECV_BUF_SIZE) {
+      // small read; over-read into the buffer
+      recv_start = recv_end = 0;
+      r = read_bulk(recv_buf, RECV_BUF_SIZE);
+      if (r < 0)
+	return r;
+      if (r == 0)
+	return left;
+      recv_end = r;
+      unsigned to_copy = MIN((unsigned)r, left);
+      memcpy(p + state_offset, recv_buf, to_copy);
+      recv_start = to_copy;
+      state_offset += to_copy;
+    } else {
+      r = read_bulk(p + state_offset, left);
+      if (r < 0)
+	return r;
+      if (r == 0)
+	return left;
+      state_offset += r;
+    }
+  }
+  state_offset = 0;
+  return 0;
+}
+
+/*
+ * @return bytes read, 0 if the socket has nothing for us right now,
+ * or -1 on error or EOF
+ */
+int AsyncConnection::read_bulk(char *buf, unsigned len)
+{
+  if (sd < 0)
+    return -1;
+  int nread = ::read(sd, buf, len);
+  if (nread < 0) {
+    if (errno == EAGAIN || errno == EINTR)
+      return 0;
+    ldout(msgr->cct, 1) << __func__ << " reading from fd=" << sd
+			<< " : " << cpp_strerror(errno) << dendl;
+    return -1;
+  } else if (nread == 0) {
+    ldout(msgr->cct, 1) << __func__ << " peer closed the connection" << dendl;
+    return -1;
+  }
+  return nread;
+}
+
+/*
+ * queue bl behind whatever is still pending and push as much as the
+ * socket takes.  arms the writable event while anything is left.
+ *
+ * @return bytes still pending, or < 0 on error
+ */
+int AsyncConnection::_try_send(bufferlist &bl)
+{
+  assert(lock.is_locked());
+  if (bl.length()) {
+    if (outcoming_bl.length())
+      outcoming_bl.claim_append(bl);
+    else
+      outcoming_bl.swap(bl);
+  }
+  if (sd < 0)
+    return -1;
+
+  while (outcoming_bl.length()) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    struct iovec msgvec[IOV_MAX];
+    unsigned size = 0;
+    list<bufferptr>::const_iterator pb = outcoming_bl.buffers().begin();
+    while (pb != outcoming_bl.buffers().end() && msg.msg_iovlen < IOV_MAX) {
+      if (pb->length()) {
+	msgvec[msg.msg_iovlen].iov_base = (void*)pb->c_str();
+	msgvec[msg.msg_iovlen].iov_len = pb->length();
+	msg.msg_iovlen++;
+	size += pb->length();
+      }
+      ++pb;
+    }
+    msg.msg_iov = msgvec;
+
+    int r = ::sendmsg(sd, &msg, MSG_NOSIGNAL);
+    if (r < 0) {
+      if (errno == EAGAIN || errno == EINTR)
+	break;
+      ldout(msgr->cct, 1) << __func__ << " sendmsg error: " << cpp_strerror(errno) << dendl;
+      return -1;
+    }
+    ldout(msgr->cct, 30) << __func__ << " sent " << r << " of " << size << dendl;
+    if ((unsigned)r == outcoming_bl.length()) {
+      outcoming_bl.clear();
+    } else {
+      outcoming_bl.splice(0, r);
+    }
+    if ((unsigned)r < size)
+      break;  // socket buffer is full
+  }
+
+  if (outcoming_bl.length())
+    center->create_file_event(sd, EVENT_WRITABLE, write_handler);
+  else
+    center->delete_file_event(sd, EVENT_WRITABLE);
+  return outcoming_bl.length();
+}
+
+void AsyncConnection::process()
+{
+  Mutex::Locker l(lock);
+  _process();
+}
+
+void AsyncConnection::_process()
+{
+  assert(lock.is_locked());
+  int r = 0;
+  do {
+    if (is_open())
+      r = _process_message();
+    else if (is_connecting() || is_accepting())
+      r = _process_connection();
+    else
+      break;  // standby, wait, closed
+  } while (r == 0);
+
+  if (r < 0) {
+    _fault();
+    return;
+  }
+
+  // ack whatever we just got
+  if (is_open() && in_seq > in_seq_acked)
+    _handle_write();
+}
+
+int AsyncConnection::_process_message()
+{
+  int r;
+
+  switch (state) {
+  case STATE_OPEN:
+    {
+      char tag = -1;
+      r = read_until(sizeof(tag), &tag);
+      if (r != 0)
+	return r;
+
+      if (tag == CEPH_MSGR_TAG_KEEPALIVE) {
+	ldout(msgr->cct,20) << "process got KEEPALIVE" << dendl;
+      } else if (tag == CEPH_MSGR_TAG_ACK) {
+	state = STATE_OPEN_TAG_ACK;
+      } else if (tag == CEPH_MSGR_TAG_MSG) {
+	recv_stamp = ceph_clock_now(msgr->cct);
+	state = STATE_OPEN_MESSAGE_HEADER;
+      } else if (tag == CEPH_MSGR_TAG_CLOSE) {
+	ldout(msgr->cct,20) << "process got CLOSE" << dendl;
+	_stop();
+	if (connection_state->clear_pipe(this))
+	  in_q->queue_reset(connection_state.get());
+      } else {
+	ldout(msgr->cct,0) << "process bad tag " << (int)tag << dendl;
+	return -1;
+      }
+      return 0;
+    }
+
+  case STATE_OPEN_TAG_ACK:
+    {
+      ceph_le64 seq;
+      r = read_until(sizeof(seq), state_buffer);
+      if (r != 0)
+	return r;
+      memcpy(&seq, state_buffer, sizeof(seq));
+      state = STATE_OPEN;
+      handle_ack(seq);
+      return 0;
+    }
+
+  case STATE_OPEN_MESSAGE_HEADER:
+    {
+      ceph_msg_header header;
+      __u32 header_crc;
+
+      if (connection_state->has_feature(CEPH_FEATURE_NOSRCADDR)) {
+	r = read_until(sizeof(header), state_buffer);
+	if (r != 0)
+	  return r;
+	memcpy(&header, state_buffer, sizeof(header));
+	header_crc = ceph_crc32c(0, (unsigned char *)&header, sizeof(header) - sizeof(header.crc));
+      } else {
+	ceph_msg_header_old oldheader;
+	r = read_until(sizeof(oldheader), state_buffer);
+	if (r != 0)
+	  return r;
+	memcpy(&oldheader, state_buffer, sizeof(oldheader));
+	// this is fugly
+	memcpy(&header, &oldheader, sizeof(header));
+	header.src = oldheader.src.name;
+	header.reserved = oldheader.reserved;
+	header.crc = oldheader.crc;
+	header_crc = ceph_crc32c(0, (unsigned char *)&oldheader, sizeof(oldheader) - sizeof(oldheader.crc));
+      }
+
+      ldout(msgr->cct,20) << "process got envelope type=" << header.type
+			  << " src " << entity_name_t(header.src)
+			  << " front=" << header.front_len
+			  << " data=" << header.data_len
+			  << " off " << header.data_off
+			  << dendl;
+
+      // verify header crc
+      if (header_crc != header.crc) {
+	ldout(msgr->cct,0) << "process got bad header crc " << header_crc << " != " << header.crc << dendl;
+	return -1;
+      }
+
+      current_header = header;
+      cur_msg_size = header.front_len + header.middle_len + header.data_len;
+      front.clear();
+      middle.clear();
+      data.clear();
+      data_buf.clear();
+      state = STATE_OPEN_MESSAGE_THROTTLE_MESSAGE;
+      return 0;
+    }
+
+  case STATE_OPEN_MESSAGE_THROTTLE_MESSAGE:
+    if (policy.throttler_messages && !msg_throttled_messages) {
+      ldout(msgr->cct,10) << "process wants " << 1 << " message from policy throttler "
+			  << policy.throttler_messages->get_current() << "/"
+			  << policy.throttler_messages->get_max() << dendl;
+      if (!policy.throttler_messages->get_or_fail()) {
+	ldout(msgr->cct,10) << "process message throttler is full, waiting" << dendl;
+	_wait_for_throttle();
+	return 1;
+      }
+      msg_throttled_messages = true;
+    }
+    state = STATE_OPEN_MESSAGE_THROTTLE_BYTES;
+    return 0;
+
+  case STATE_OPEN_MESSAGE_THROTTLE_BYTES:
+    if (cur_msg_size) {
+      if (policy.throttler_bytes && !msg_throttled_bytes) {
+	ldout(msgr->cct,10) << "process wants " << cur_msg_size << " bytes from policy throttler "
+			    << policy.throttler_bytes->get_current() << "/"
+			    << policy.throttler_bytes->get_max() << dendl;
+	if (!policy.throttler_bytes->get_or_fail(cur_msg_size)) {
+	  ldout(msgr->cct,10) << "process byte throttler is full, waiting" << dendl;
+	  _wait_for_throttle();
+	  return 1;
+	}
+	msg_throttled_bytes = true;
+      }
+
+      // throttle total bytes waiting for dispatch.  do this _after_ the
+      // policy throttle, as this one does not deadlock (unless dispatch
+      // blocks indefinitely, which it shouldn't).  in contrast, the
+      // policy throttle carries for the lifetime of the message.
+      if (!msg_throttled_dispatch) {
+	ldout(msgr->cct,10) << "process wants " << cur_msg_size << " from dispatch throttler "
+			    << msgr->dispatch_queue.dispatch_throttler.get_current() << "/"
+			    << msgr->dispatch_queue.dispatch_throttler.get_max() << dendl;
+	if (!msgr->dispatch_queue.dispatch_throttler.get_or_fail(cur_msg_size)) {
+	  ldout(msgr->cct,10) << "process dispatch throttler is full, waiting" << dendl;
+	  _wait_for_throttle();
+	  return 1;
+	}
+	msg_throttled_dispatch = true;
+      }
+    }
+    throttle_stamp = ceph_clock_now(msgr->cct);
+    state = STATE_OPEN_MESSAGE_READ_FRONT;
+    return 0;
+
+  case STATE_OPEN_MESSAGE_READ_FRONT:
+    if (current_header.front_len) {
+      if (!front.length())
+	front.push_back(buffer::create(current_header.front_len));
+      r = read_until(current_header.front_len, front.c_str());
+      if (r != 0)
+	return r;
+      ldout(msgr->cct,20) << "process got front " << front.length() << dendl;
+    }
+    state = STATE_OPEN_MESSAGE_READ_MIDDLE;
+    return 0;
+
+  case STATE_OPEN_MESSAGE_READ_MIDDLE:
+    if (current_header.middle_len) {
+      if (!middle.length())
+	middle.push_back(buffer::create(current_header.middle_len));
+      r = read_until(current_header.middle_len, middle.c_str());
+      if (r != 0)
+	return r;
+      ldout(msgr->cct,20) << "process got middle " << middle.length() << dendl;
+    }
+    state = STATE_OPEN_MESSAGE_READ_DATA_PREPARE;
+    return 0;
+
+  case STATE_OPEN_MESSAGE_READ_DATA_PREPARE:
+    {
+      unsigned data_len = le32_to_cpu(current_header.data_len);
+      unsigned data_off = le32_to_cpu(current_header.data_off);
+      if (data_len) {
+	// read straight into a posted rx buffer, if there is one
+	Mutex::Locker l(connection_state->lock);
+	map<tid_t,pair<bufferlist,int> >::iterator p =
+	  connection_state->rx_buffers.find(current_header.tid);
+	if (p != connection_state->rx_buffers.end()) {
+	  ldout(msgr->cct,10) << "process selecting rx buffer v " << p->second.second
+			      << " len " << p->second.first.length() << dendl;
+	  data_buf = p->second.first;
+	  // make sure it's big enough, keeping the rest of the data aligned
+	  // as it will be on disk
+	  if (data_buf.length() < data_len)
+	    alloc_aligned_buffer(data_buf, data_len - data_buf.length(),
+				 data_off + data_buf.length());
+	} else {
+	  ldout(msgr->cct,20) << "process allocating new rx buffer" << dendl;
+	  alloc_aligned_buffer(data_buf, data_len, data_off);
+	}
+	data_blp = data_buf.begin();
+      }
+      msg_left = data_len;
+      state = STATE_OPEN_MESSAGE_READ_DATA;
+      return 0;
+    }
+
+  case STATE_OPEN_MESSAGE_READ_DATA:
+    while (msg_left > 0) {
+      bufferptr bp = data_blp.get_current_ptr();
+      unsigned read = MIN(bp.length(), msg_left);
+      r = read_until(read, bp.c_str());
+      if (r != 0)
+	return r;
+      data_blp.advance(read);
+      data.append(bp, 0, read);
+      msg_left -= read;
+    }
+    state = STATE_OPEN_MESSAGE_READ_FOOTER_AND_DISPATCH;
+    return 0;
+
+  case STATE_OPEN_MESSAGE_READ_FOOTER_AND_DISPATCH:
+    {
+      ceph_msg_footer footer;
+      if (connection_state->has_feature(CEPH_FEATURE_MSG_AUTH)) {
+	r = read_until(sizeof(footer), state_buffer);
+	if (r != 0)
+	  return r;
+	memcpy(&footer, state_buffer, sizeof(footer));
+      } else {
+	ceph_msg_footer_old old_footer;
+	r = read_until(sizeof(old_footer), state_buffer);
+	if (r != 0)
+	  return r;
+	memcpy(&old_footer, state_buffer, sizeof(old_footer));
+	footer.front_crc = old_footer.front_crc;
+	footer.middle_crc = old_footer.middle_crc;
+	footer.data_crc = old_footer.data_crc;
+	footer.sig = 0;
+	footer.flags = old_footer.flags;
+      }
+      state = STATE_OPEN;
+
+      int aborted = (footer.flags & CEPH_MSG_FOOTER_COMPLETE) == 0;
+      ldout(msgr->cct,10) << "aborted = " << aborted << dendl;
+      if (aborted) {
+	ldout(msgr->cct,0) << "process got " << front.length() << " + " << middle.length() << " + " << data.length()
+			   << " byte message.. ABORTED" << dendl;
+	_release_message_throttle();
+	return 0;
+      }
+
+      ldout(msgr->cct,20) << "process got " << front.length() << " + " << middle.length()
+			  << " + " << data.length() << " byte message" << dendl;
+      Message *message = decode_message(msgr->cct, current_header, footer, front, middle, data);
+      front.clear();
+      middle.clear();
+      data.clear();
+      data_buf.clear();
+      if (!message)
+	return -1;
+
+      //
+      //  Check the signature if one should be present.  A zero return indicates success. PLR
+      //
+      if (session_security == NULL) {
+	ldout(msgr->cct, 10) << "No session security set" << dendl;
+      } else {
+	if (session_security->check_message_signature(message)) {
+	  ldout(msgr->cct, 0) << "Signature check failed" << dendl;
+	  message->put();
+	  return -1;
+	}
+      }
+
+      message->set_byte_throttler(policy.throttler_bytes);
+      message->set_message_throttler(policy.throttler_messages);
+
+      // store reservation size in message, so we don't get confused
+      // by messages entering the dispatch queue through other paths.
+      message->set_dispatch_throttle_size(cur_msg_size);
+
+      message->set_recv_stamp(recv_stamp);
+      message->set_throttle_stamp(throttle_stamp);
+      message->set_recv_complete_stamp(ceph_clock_now(msgr->cct));
+
+      // the message owns the reservations from here on
+      msg_throttled_messages = msg_throttled_bytes = msg_throttled_dispatch = false;
+
+      // check received seq#.  if it is old, drop the message.
+      // note that incoming messages may skip ahead.  this is convenient for the client
+      // side queueing because messages can't be renumbered, but the (kernel) client will
+      // occasionally pull a message out of the sent queue to send elsewhere.  in that case
+      // it doesn't matter if we "got" it or not.
+      if (message->get_seq() <= in_seq) {
+	ldout(msgr->cct,0) << "process got old message "
+			   << message->get_seq() << " <= " << in_seq << " " << message << " " << *message
+			   << ", discarding" << dendl;
+	msgr->dispatch_throttle_release(message->get_dispatch_throttle_size());
+	message->put();
+	if (connection_state->has_feature(CEPH_FEATURE_RECONNECT_SEQ) &&
+	    msgr->cct->_conf->ms_die_on_old_message)
+	  assert(0 == "old msgs despite reconnect_seq feature");
+	return 0;
+      }
+
+      message->set_connection(connection_state.get());
+
+      // note last received message.
+      in_seq = message->get_seq();
+      ldout(msgr->cct,10) << "process got message "
+			  << message->get_seq() << " " << message << " " << *message
+			  << dendl;
+      if (in_q->can_fast_dispatch(message)) {
+	// deliver from the event loop; the dispatcher may send on this
+	// connection, so don't hold our lock across it
+	lock.Unlock();
+	in_q->fast_dispatch(message);
+	lock.Lock();
+      } else {
+	in_q->enqueue(message, message->get_priority(), conn_id);
+      }
+      return 0;
+    }
+
+  default:
+    assert(0 == "bad state");
+  }
+  return -1;
+}
+
+void AsyncConnection::_wait_for_throttle()
+{
+  // with level-triggered epoll a pending socket would keep firing while
+  // we can't consume it, so park the read side until the retry timer
+  center->delete_file_event(sd, EVENT_READABLE);
+  utime_t t = ceph_clock_now(msgr->cct);
+  t += 0.001;
+  center->create_time_event(t, new C_conn_retry_read(this));
+}
+
+void AsyncConnection::retry_read()
+{
+  Mutex::Locker l(lock);
+  if (state == STATE_CLOSED || sd < 0)
+    return;
+  center->create_file_event(sd, EVENT_READABLE, read_handler);
+  _process();
+}
+
+int AsyncConnection::_connect()
+{
+  ldout(msgr->cct,10) << "_connect " << connect_seq << dendl;
+  assert(sd < 0);
+
+  global_seq = msgr->get_global_seq();
+
+  sd = ::socket(peer_addr.get_family(), SOCK_STREAM, 0);
+  if (sd < 0) {
+    lderr(msgr->cct) << "connect couldn't create socket " << cpp_strerror(errno) << dendl;
+    return -1;
+  }
+  int r = set_nonblock(sd);
+  if (r < 0) {
+    lderr(msgr->cct) << "connect couldn't set socket nonblocking " << cpp_strerror(r) << dendl;
+    return -1;
+  }
+  set_socket_options();
+
+  ldout(msgr->cct,10) << "connecting to " << peer_addr << dendl;
+  r = ::connect(sd, (sockaddr*)&peer_addr.addr, peer_addr.addr_size());
+  if (r < 0 && errno != EINPROGRESS) {
+    ldout(msgr->cct,2) << "connect error " << peer_addr
+		       << ", " << cpp_strerror(errno) << dendl;
+    return -1;
+  }
+
+  // the socket turns writable once the connect completes or fails
+  center->create_file_event(sd, EVENT_READABLE, read_handler);
+  center->create_file_event(sd, EVENT_WRITABLE, write_handler);
+  state = STATE_CONNECTING_WAIT_CONNECTED;
+  return 1;
+}
+
+int AsyncConnection::_process_connection()
+{
+  int r;
+
+  switch (state) {
+  case STATE_CONNECTING:
+    return _connect();
+
+  case STATE_CONNECTING_WAIT_CONNECTED:
+    // handle_write notices when the socket is connected
+    return 1;
+
+  case STATE_CONNECTING_WAIT_BANNER:
+    {
+      unsigned banner_len = strlen(CEPH_BANNER);
+      entity_addr_t paddr, peer_addr_for_me;
+      r = read_until(banner_len + sizeof(paddr) * 2, state_buffer);
+      if (r != 0)
+	return r;
+
+      if (memcmp(state_buffer, CEPH_BANNER, banner_len)) {
+	ldout(msgr->cct,0) << "connect protocol error (bad banner) on peer " << peer_addr << dendl;
+	return -1;
+      }
+
+      bufferlist addrbl;
+      addrbl.append(state_buffer + banner_len, sizeof(paddr) * 2);
+      bufferlist::iterator p = addrbl.begin();
+      ::decode(paddr, p);
+      ::decode(peer_addr_for_me, p);
+      port = peer_addr_for_me.get_port();
+
+      ldout(msgr->cct,20) << "connect read peer addr " << paddr << " on socket " << sd << dendl;
+      if (peer_addr != paddr) {
+	if (paddr.is_blank_ip() &&
+	    peer_addr.get_port() == paddr.get_port() &&
+	    peer_addr.get_nonce() == paddr.get_nonce()) {
+	  ldout(msgr->cct,0) << "connect claims to be "
+			     << paddr << " not " << peer_addr << " - presumably this is the same node!" << dendl;
+	} else {
+	  ldout(msgr->cct,0) << "connect claims to be "
+			     << paddr << " not " << peer_addr << " - wrong node!" << dendl;
+	  return -1;
+	}
+      }
+
+      ldout(msgr->cct,20) << "connect peer addr for me is " << peer_addr_for_me << dendl;
+
+      // learned_addr takes the msgr lock, which nests outside ours
+      lock.Unlock();
+      msgr->learned_addr(peer_addr_for_me);
+      lock.Lock();
+      if (state != STATE_CONNECTING_WAIT_BANNER)
+	return 0;
+
+      bufferlist myaddrbl;
+      ::encode(msgr->get_myaddr(), myaddrbl);
+      if (_try_send(myaddrbl) < 0) {
+	ldout(msgr->cct,2) << "connect couldn't write my addr" << dendl;
+	return -1;
+      }
+      ldout(msgr->cct,10) << "connect sent my addr " << msgr->get_myaddr() << dendl;
+      state = STATE_CONNECTING_SEND_CONNECT_MSG;
+      return 0;
+    }
+
+  case STATE_CONNECTING_SEND_CONNECT_MSG:
+    {
+      // the dispatcher may block or call back into the messenger while
+      // it builds the authorizer; don't hold our lock across it
+      bool force_new = got_bad_auth;
+      lock.Unlock();
+      AuthAuthorizer *a = msgr->get_authorizer(peer_type, force_new);
+      lock.Lock();
+      if (state != STATE_CONNECTING_SEND_CONNECT_MSG) {
+	delete a;
+	return 0;
+      }
+      delete authorizer;
+      authorizer = a;
+
+      ceph_msg_connect connect;
+      memset(&connect, 0, sizeof(connect));
+      connect.features = policy.features_supported;
+      connect.host_type = msgr->my_type;
+      connect.global_seq = global_seq;
+      connect.connect_seq = connect_seq;
+      connect.protocol_version = msgr->get_proto_version(peer_type, true);
+      connect.authorizer_protocol = authorizer ? authorizer->protocol : 0;
+      connect.authorizer_len = authorizer ? authorizer->bl.length() : 0;
+      if (authorizer)
+	ldout(msgr->cct,10) << "connect.authorizer_len=" << connect.authorizer_len
+			    << " protocol=" << connect.authorizer_protocol << dendl;
+      connect.flags = 0;
+      if (policy.lossy)
+	connect.flags |= CEPH_MSG_CONNECT_LOSSY;  // this is fyi, actually, server decides!
+      connect_msg = connect;
+
+      bufferlist bl;
+      bl.append((char*)&connect, sizeof(connect));
+      if (authorizer)
+	bl.append(authorizer->bl.c_str(), authorizer->bl.length());
+      ldout(msgr->cct,10) << "connect sending gseq=" << global_seq << " cseq=" << connect_seq
+			  << " proto=" << connect.protocol_version << dendl;
+      if (_try_send(bl) < 0) {
+	ldout(msgr->cct,2) << "connect couldn't send connect message" << dendl;
+	return -1;
+      }
+      state = STATE_CONNECTING_WAIT_CONNECT_REPLY;
+      return 0;
+    }
+
+  case STATE_CONNECTING_WAIT_CONNECT_REPLY:
+    r = read_until(sizeof(connect_reply), state_buffer);
+    if (r != 0)
+      return r;
+    memcpy(&connect_reply, state_buffer, sizeof(connect_reply));
+    // sanitize features
+    connect_reply.features = ceph_sanitize_features(connect_reply.features);
+
+    ldout(msgr->cct,20) << "connect got reply tag " << (int)connect_reply.tag
+			<< " connect_seq " << connect_reply.connect_seq
+			<< " global_seq " << connect_reply.global_seq
+			<< " proto " << connect_reply.protocol_version
+			<< " flags " << (int)connect_reply.flags
+			<< " features " << connect_reply.features
+			<< dendl;
+
+    authorizer_reply.clear();
+    if (connect_reply.authorizer_len) {
+      ldout(msgr->cct,10) << "reply.authorizer_len=" << connect_reply.authorizer_len << dendl;
+      state = STATE_CONNECTING_WAIT_CONNECT_REPLY_AUTH;
+      return 0;
+    }
+    return _handle_connect_reply();
+
+  case STATE_CONNECTING_WAIT_CONNECT_REPLY_AUTH:
+    if (!authorizer_reply.length())
+      authorizer_reply.push_back(buffer::create(connect_reply.authorizer_len));
+    r = read_until(connect_reply.authorizer_len, authorizer_reply.c_str());
+    if (r != 0)
+      return r;
+    return _handle_connect_reply();
+
+  case STATE_CONNECTING_WAIT_ACK_SEQ:
+    {
+      uint64_t newly_acked_seq = 0;
+      r = read_until(sizeof(newly_acked_seq), state_buffer);
+      if (r != 0)
+	return r;
+      memcpy(&newly_acked_seq, state_buffer, sizeof(newly_acked_seq));
+      ldout(msgr->cct,2) << " got newly_acked_seq " << newly_acked_seq
+			 << " vs out_seq " << out_seq << dendl;
+      while (newly_acked_seq > out_seq) {
+	Message *m = _get_next_outgoing();
+	assert(m);
+	ldout(msgr->cct,2) << " discarding previously sent " << m->get_seq()
+			   << " " << *m << dendl;
+	assert(m->get_seq() <= newly_acked_seq);
+	m->put();
+	++out_seq;
+      }
+
+      bufferlist bl;
+      bl.append((char*)&in_seq, sizeof(in_seq));
+      if (_try_send(bl) < 0) {
+	ldout(msgr->cct,2) << "connect write error on in_seq" << dendl;
+	return -1;
+      }
+      state = STATE_CONNECTING_READY;
+      return 0;
+    }
+
+  case STATE_CONNECTING_READY:
+    // hooray!
+    peer_global_seq = connect_reply.global_seq;
+    policy.lossy = connect_reply.flags & CEPH_MSG_CONNECT_LOSSY;
+    connect_seq++;
+    assert(connect_seq == connect_reply.connect_seq);
+    backoff = utime_t();
+    connection_state->set_features((uint64_t)connect_reply.features & (uint64_t)connect_msg.features);
+    ldout(msgr->cct,10) << "connect success " << connect_seq << ", lossy = " << policy.lossy
+			<< ", features " << connection_state->get_features() << dendl;
+
+    // If we have an authorizer, get a new AuthSessionHandler to deal with ongoing security of the
+    // connection.  PLR
+    delete session_security;
+    if (authorizer != NULL) {
+      session_security = get_auth_session_handler(msgr->cct, authorizer->protocol, authorizer->session_key,
+						  connection_state->get_features());
+    } else {
+      // We have no authorizer, so we shouldn't be applying security to messages in this connection.  PLR
+      session_security = NULL;
+    }
+    delete authorizer;
+    authorizer = NULL;
+    got_bad_auth = false;
+
+    in_q->queue_connect(connection_state.get());
+    state = STATE_OPEN;
+    // flush whatever queued up while we were connecting
+    _handle_write();
+    return 0;
+
+  case STATE_ACCEPTING:
+    {
+      r = set_nonblock(sd);
+      if (r < 0) {
+	ldout(msgr->cct,0) << "accept couldn't set socket nonblocking " << cpp_strerror(r) << dendl;
+	return -1;
+      }
+      center->create_file_event(sd, EVENT_READABLE, read_handler);
+      set_socket_options();
+
+      // announce myself, my addr and the peer's socket addr (they might
+      // not know their ip)
+      bufferlist bl;
+      bl.append(CEPH_BANNER, strlen(CEPH_BANNER));
+      ::encode(msgr->get_myaddr(), bl);
+      port = msgr->get_myaddr().get_port();
+
+      entity_addr_t socket_addr;
+      socklen_t len = sizeof(socket_addr.ss_addr());
+      r = ::getpeername(sd, (sockaddr*)&socket_addr.ss_addr(), &len);
+      if (r < 0) {
+	ldout(msgr->cct,0) << "accept failed to getpeername " << cpp_strerror(errno) << dendl;
+	return -1;
+      }
+      ::encode(socket_addr, bl);
+      ldout(msgr->cct,1) << "accept sd=" << sd << " " << socket_addr << dendl;
+
+      if (_try_send(bl) < 0) {
+	ldout(msgr->cct,10) << "accept couldn't write banner and addrs" << dendl;
+	return -1;
+      }
+      state = STATE_ACCEPTING_WAIT_BANNER_ADDR;
+      return 0;
+    }
+
+  case STATE_ACCEPTING_WAIT_BANNER_ADDR:
+    {
+      unsigned banner_len = strlen(CEPH_BANNER);
+      entity_addr_t paddr;
+      r = read_until(banner_len + sizeof(paddr), state_buffer);
+      if (r != 0)
+	return r;
+
+      if (memcmp(state_buffer, CEPH_BANNER, banner_len)) {
+	state_buffer[banner_len] = 0;
+	ldout(msgr->cct,1) << "accept peer sent bad banner '" << state_buffer
+			   << "' (should be '" << CEPH_BANNER << "')" << dendl;
+	return -1;
+      }
+
+      bufferlist addrbl;
+      addrbl.append(state_buffer + banner_len, sizeof(paddr));
+      bufferlist::iterator ti = addrbl.begin();
+      ::decode(paddr, ti);
+
+      ldout(msgr->cct,10) << "accept peer addr is " << paddr << dendl;
+      if (paddr.is_blank_ip()) {
+	// peer apparently doesn't know what ip they have; figure it out for them.
+	entity_addr_t socket_addr;
+	socklen_t len = sizeof(socket_addr.ss_addr());
+	if (::getpeername(sd, (sockaddr*)&socket_addr.ss_addr(), &len) < 0) {
+	  ldout(msgr->cct,0) << "accept failed to getpeername " << cpp_strerror(errno) << dendl;
+	  return -1;
+	}
+	int port = paddr.get_port();
+	paddr.addr = socket_addr.addr;
+	paddr.set_port(port);
+	ldout(msgr->cct,0) << "accept peer addr is really " << paddr
+			   << " (socket is " << socket_addr << ")" << dendl;
+      }
+      set_peer_addr(paddr);  // so that connection_state gets set up
+      state = STATE_ACCEPTING_WAIT_CONNECT_MSG;
+      return 0;
+    }
+
+  case STATE_ACCEPTING_WAIT_CONNECT_MSG:
+    r = read_until(sizeof(connect_msg), state_buffer);
+    if (r != 0)
+      return r;
+    memcpy(&connect_msg, state_buffer, sizeof(connect_msg));
+    // sanitize features
+    connect_msg.features = ceph_sanitize_features(connect_msg.features);
+
+    authorizer_buf.clear();
+    if (connect_msg.authorizer_len) {
+      state = STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH;
+      return 0;
+    }
+    return _handle_connect_msg();
+
+  case STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH:
+    if (!authorizer_buf.length())
+      authorizer_buf.push_back(buffer::create(connect_msg.authorizer_len));
+    r = read_until(connect_msg.authorizer_len, authorizer_buf.c_str());
+    if (r != 0)
+      return r;
+    return _handle_connect_msg();
+
+  case STATE_ACCEPTING_WAIT_SEQ:
+    {
+      uint64_t newly_acked_seq = 0;
+      r = read_until(sizeof(newly_acked_seq), state_buffer);
+      if (r != 0) {
+	if (r < 0)
+	  ldout(msgr->cct,2) << "accept read error on newly_acked_seq" << dendl;
+	return r;
+      }
+      memcpy(&newly_acked_seq, state_buffer, sizeof(newly_acked_seq));
+      discard_requeued_up_to(newly_acked_seq);
+      state = STATE_OPEN;
+      ldout(msgr->cct,20) << "accept done" << dendl;
+      _handle_write();
+      return 0;
+    }
+
+  default:
+    assert(0 == "bad state");
+  }
+  return -1;
+}
+
+int AsyncConnection::_handle_connect_reply()
+{
+  if (authorizer) {
+    bufferlist::iterator iter = authorizer_reply.begin();
+    if (!authorizer->verify_reply(iter)) {
+      ldout(msgr->cct,0) << "failed verifying authorize reply" << dendl;
+      return -1;
+    }
+  }
+
+  switch (connect_reply.tag) {
+  case CEPH_MSGR_TAG_FEATURES:
+    ldout(msgr->cct,0) << "connect protocol feature mismatch, my " << std::hex
+		       << connect_msg.features << " < peer " << connect_reply.features
+		       << " missing " << (connect_reply.features & ~policy.features_supported)
+		       << std::dec << dendl;
+    return -1;
+
+  case CEPH_MSGR_TAG_BADPROTOVER:
+    ldout(msgr->cct,0) << "connect protocol version mismatch, my " << connect_msg.protocol_version
+		       << " != " << connect_reply.protocol_version << dendl;
+    return -1;
+
+  case CEPH_MSGR_TAG_BADAUTHORIZER:
+    ldout(msgr->cct,0) << "connect got BADAUTHORIZER" << dendl;
+    if (got_bad_auth)
+      return -1;
+    got_bad_auth = true;  // try harder
+    state = STATE_CONNECTING_SEND_CONNECT_MSG;
+    return 0;
+
+  case CEPH_MSGR_TAG_RESETSESSION:
+    ldout(msgr->cct,0) << "connect got RESETSESSION" << dendl;
+    was_session_reset();
+    state = STATE_CONNECTING_SEND_CONNECT_MSG;
+    return 0;
+
+  case CEPH_MSGR_TAG_RETRY_GLOBAL:
+    global_seq = msgr->get_global_seq(connect_reply.global_seq);
+    ldout(msgr->cct,10) << "connect got RETRY_GLOBAL " << connect_reply.global_seq
+			<< " chose new " << global_seq << dendl;
+    state = STATE_CONNECTING_SEND_CONNECT_MSG;
+    return 0;
+
+  case CEPH_MSGR_TAG_RETRY_SESSION:
+    assert(connect_reply.connect_seq > connect_seq);
+    ldout(msgr->cct,10) << "connect got RETRY_SESSION " << connect_seq
+			<< " -> " << connect_reply.connect_seq << dendl;
+    connect_seq = connect_reply.connect_seq;
+    state = STATE_CONNECTING_SEND_CONNECT_MSG;
+    return 0;
+
+  case CEPH_MSGR_TAG_WAIT:
+    ldout(msgr->cct,3) << "connect got WAIT (connection race)" << dendl;
+    _close_socket();
+    state = STATE_WAIT;
+    return 0;
+
+  case CEPH_MSGR_TAG_READY:
+  case CEPH_MSGR_TAG_SEQ:
+    {
+      uint64_t feat_missing = policy.features_required & ~(uint64_t)connect_reply.features;
+      if (feat_missing) {
+	ldout(msgr->cct,1) << "missing required features " << std::hex << feat_missing << std::dec << dendl;
+	return -1;
+      }
+      if (connect_reply.tag == CEPH_MSGR_TAG_SEQ) {
+	ldout(msgr->cct,10) << "got CEPH_MSGR_TAG_SEQ, reading acked_seq and writing in_seq" << dendl;
+	state = STATE_CONNECTING_WAIT_ACK_SEQ;
+      } else {
+	state = STATE_CONNECTING_READY;
+      }
+      return 0;
+    }
+
+  default:
+    // protocol error
+    ldout(msgr->cct,0) << "connect got bad tag " << (int)connect_reply.tag << dendl;
+    return -1;
+  }
+}
+
+int AsyncConnection::_reply_accept(char tag, ceph_msg_connect_reply &reply)
+{
+  reply.tag = tag;
+  reply.features = ((uint64_t)connect_msg.features & policy.features_supported) | policy.features_required;
+  reply.authorizer_len = authorizer_reply.length();
+  bufferlist bl;
+  bl.append((char*)&reply, sizeof(reply));
+  if (reply.authorizer_len)
+    bl.append(authorizer_reply.c_str(), authorizer_reply.length());
+  // wait for the peer's next attempt
+  state = STATE_ACCEPTING_WAIT_CONNECT_MSG;
+  if (_try_send(bl) < 0)
+    return -1;
+  return 0;
+}
+
+int AsyncConnection::_handle_connect_msg()
+{
+  ceph_msg_connect_reply reply;
+  bool authorizer_valid;
+  uint64_t feat_missing;
+  CryptoKey session_key;
+  AsyncConnection *existing;
+  char reply_tag = 0;
+  uint64_t existing_seq = -1;
+  int cur_state = state;
+
+  ldout(msgr->cct,20) << "accept got peer connect_seq " << connect_msg.connect_seq
+		      << " global_seq " << connect_msg.global_seq
+		      << dendl;
+
+  memset(&reply, 0, sizeof(reply));
+  authorizer_reply.clear();
+
+  lock.Unlock();
+  msgr->lock.Lock();
+  lock.Lock();
+  if (msgr->dispatch_queue.stop || state != cur_state) {
+    msgr->lock.Unlock();
+    return -1;
+  }
+
+  // note peer's type, flags
+  set_peer_type(connect_msg.host_type);
+  policy = msgr->get_policy(connect_msg.host_type);
+  ldout(msgr->cct,10) << "accept of host_type " << connect_msg.host_type
+		      << ", policy.lossy=" << policy.lossy
+		      << " policy.server=" << policy.server
+		      << " policy.standby=" << policy.standby
+		      << " policy.resetcheck=" << policy.resetcheck
+		      << dendl;
+
+  reply.protocol_version = msgr->get_proto_version(peer_type, false);
+  msgr->lock.Unlock();
+
+  // mismatch?
+  ldout(msgr->cct,10) << "accept my proto " << reply.protocol_version
+		      << ", their proto " << connect_msg.protocol_version << dendl;
+  if (connect_msg.protocol_version != reply.protocol_version)
+    return _reply_accept(CEPH_MSGR_TAG_BADPROTOVER, reply);
+
+  // require signatures for cephx?
+  if (connect_msg.authorizer_protocol == CEPH_AUTH_CEPHX) {
+    if (peer_type == CEPH_ENTITY_TYPE_OSD ||
+	peer_type == CEPH_ENTITY_TYPE_MDS) {
+      if (msgr->cct->_conf->cephx_require_signatures ||
+	  msgr->cct->_conf->cephx_cluster_require_signatures) {
+	ldout(msgr->cct,10) << "using cephx, requiring MSG_AUTH feature bit for cluster" << dendl;
+	policy.features_required |= CEPH_FEATURE_MSG_AUTH;
+      }
+    } else {
+      if (msgr->cct->_conf->cephx_require_signatures ||
+	  msgr->cct->_conf->cephx_service_require_signatures) {
+	ldout(msgr->cct,10) << "using cephx, requiring MSG_AUTH feature bit for service" << dendl;
+	policy.features_required |= CEPH_FEATURE_MSG_AUTH;
+      }
+    }
+  }
+
+  feat_missing = policy.features_required & ~(uint64_t)connect_msg.features;
+  if (feat_missing) {
+    ldout(msgr->cct,1) << "peer missing required features " << std::hex << feat_missing << std::dec << dendl;
+    return _reply_accept(CEPH_MSGR_TAG_FEATURES, reply);
+  }
+
+  // Check the authorizer.  If not good, bail out.
+  lock.Unlock();
+  if (!msgr->verify_authorizer(connection_state.get(), peer_type, connect_msg.authorizer_protocol,
+			       authorizer_buf, authorizer_reply, authorizer_valid, session_key) ||
+      !authorizer_valid) {
+    ldout(msgr->cct,0) << "accept: got bad authorizer" << dendl;
+    lock.Lock();
+    if (state != cur_state)
+      return -1;
+    delete session_security;
+    session_security = NULL;
+    return _reply_accept(CEPH_MSGR_TAG_BADAUTHORIZER, reply);
+  }
+
+  // We've verified the authorizer for this connection, so set up the session security structure.  PLR
+  ldout(msgr->cct,10) << "accept:  setting up session_security." << dendl;
+
+  msgr->lock.Lock();
+  lock.Lock();
+  if (msgr->dispatch_queue.stop || state != cur_state) {
+    msgr->lock.Unlock();
+    return -1;
+  }
+
+  // existing?
+  existing = msgr->_lookup_conn(peer_addr);
+  if (existing) {
+    existing->lock.Lock(true);  // skip lockdep check (we are locking a second AsyncConnection here)
+
+    if (connect_msg.global_seq < existing->peer_global_seq) {
+      ldout(msgr->cct,10) << "accept existing " << existing << ".gseq " << existing->peer_global_seq
+			  << " > " << connect_msg.global_seq << ", RETRY_GLOBAL" << dendl;
+      reply.global_seq = existing->peer_global_seq;  // so we can send it below..
+      existing->lock.Unlock();
+      msgr->lock.Unlock();
+      return _reply_accept(CEPH_MSGR_TAG_RETRY_GLOBAL, reply);
+    } else {
+      ldout(msgr->cct,10) << "accept existing " << existing << ".gseq " << existing->peer_global_seq
+			  << " <= " << connect_msg.global_seq << ", looks ok" << dendl;
+    }
+
+    if (existing->policy.lossy) {
+      ldout(msgr->cct,0) << "accept replacing existing (lossy) channel (new one lossy="
+			 << policy.lossy << ")" << dendl;
+      existing->was_session_reset();
+      goto replace;
+    }
+
+    ldout(msgr->cct,0) << "accept connect_seq " << connect_msg.connect_seq
+		       << " vs existing " << existing->connect_seq
+		       << " state " << get_state_name(existing->state) << dendl;
+
+    if (connect_msg.connect_seq == 0 && existing->connect_seq > 0) {
+      ldout(msgr->cct,0) << "accept peer reset, then tried to connect to us, replacing" << dendl;
+      if (policy.resetcheck)
+	existing->was_session_reset(); // this resets out_queue, msg_ and connect_seq #'s
+      goto replace;
+    }
+
+    if (connect_msg.connect_seq < existing->connect_seq) {
+      // old attempt, or we sent READY but they didn't get it.
+      ldout(msgr->cct,10) << "accept existing " << existing << ".cseq " << existing->connect_seq
+			  << " > " << connect_msg.connect_seq << ", RETRY_SESSION" << dendl;
+      goto retry_session;
+    }
+
+    if (connect_msg.connect_seq == existing->connect_seq) {
+      // if the existing connection successfully opened, and/or
+      // subsequently went to standby, then the peer should bump
+      // their connect_seq and retry: this is not a connection race
+      // we need to resolve here.
+      if (existing->is_open() ||
+	  existing->state == STATE_STANDBY) {
+	ldout(msgr->cct,10) << "accept connection race, existing " << existing
+			    << ".cseq " << existing->connect_seq
+			    << " == " << connect_msg.connect_seq
+			    << ", OPEN|STANDBY, RETRY_SESSION" << dendl;
+	goto retry_session;
+      }
+
+      // connection race?
+      if (peer_addr < msgr->get_myaddr() ||
+	  existing->policy.server) {
+	// incoming wins
+	ldout(msgr->cct,10) << "accept connection race, existing " << existing << ".cseq " << existing->connect_seq
+			    << " == " << connect_msg.connect_seq << ", or we are server, replacing my attempt" << dendl;
+	if (!(existing->is_connecting() ||
+	      existing->state == STATE_WAIT))
+	  lderr(msgr->cct) << "accept race bad state, would replace, existing="
+			   << get_state_name(existing->state)
+			   << " " << existing << ".cseq=" << existing->connect_seq
+			   << " == " << connect_msg.connect_seq
+			   << dendl;
+	assert(existing->is_connecting() ||
+	       existing->state == STATE_WAIT);
+	goto replace;
+      } else {
+	// our existing outgoing wins
+	ldout(msgr->cct,10) << "accept connection race, existing " << existing << ".cseq " << existing->connect_seq
+			    << " == " << connect_msg.connect_seq << ", sending WAIT" << dendl;
+	assert(peer_addr > msgr->get_myaddr());
+	if (!existing->is_connecting())
+	  lderr(msgr->cct) << "accept race bad state, would send wait, existing="
+			   << get_state_name(existing->state)
+			   << " " << existing << ".cseq=" << existing->connect_seq
+			   << " == " << connect_msg.connect_seq
+			   << dendl;
+	assert(existing->is_connecting());
+	// make sure our outgoing connection will follow through
+	existing->_send_keepalive();
+	existing->lock.Unlock();
+	msgr->lock.Unlock();
+	return _reply_accept(CEPH_MSGR_TAG_WAIT, reply);
+      }
+    }
+
+    assert(connect_msg.connect_seq > existing->connect_seq);
+    assert(connect_msg.global_seq >= existing->peer_global_seq);
+    if (policy.resetcheck &&   // RESETSESSION only used by servers; peers do not reset each other
+	existing->connect_seq == 0) {
+      ldout(msgr->cct,0) << "accept we reset (peer sent cseq " << connect_msg.connect_seq
+			 << ", " << existing << ".cseq = " << existing->connect_seq
+			 << "), sending RESETSESSION" << dendl;
+      existing->lock.Unlock();
+      msgr->lock.Unlock();
+      return _reply_accept(CEPH_MSGR_TAG_RESETSESSION, reply);
+    }
+
+    // reconnect
+    ldout(msgr->cct,10) << "accept peer sent cseq " << connect_msg.connect_seq
+			<< " > " << existing->connect_seq << dendl;
+    goto replace;
+  } // existing
+  else if (policy.resetcheck && connect_msg.connect_seq > 0) {
+    // we reset, and they are opening a new session
+    ldout(msgr->cct,0) << "accept we reset (peer sent cseq " << connect_msg.connect_seq << "), sending RESETSESSION" << dendl;
+    msgr->lock.Unlock();
+    return _reply_accept(CEPH_MSGR_TAG_RESETSESSION, reply);
+  } else {
+    // new session
+    ldout(msgr->cct,10) << "accept new session" << dendl;
+    existing = NULL;
+    goto open;
+  }
+  assert(0);
+
+ retry_session:
+  assert(existing->lock.is_locked());
+  assert(lock.is_locked());
+  reply.connect_seq = existing->connect_seq + 1;
+  existing->lock.Unlock();
+  msgr->lock.Unlock();
+  return _reply_accept(CEPH_MSGR_TAG_RETRY_SESSION, reply);
+
+ replace:
+  assert(existing->lock.is_locked());
+  assert(lock.is_locked());
+  if (connect_msg.features & CEPH_FEATURE_RECONNECT_SEQ) {
+    reply_tag = CEPH_MSGR_TAG_SEQ;
+    existing_seq = existing->in_seq;
+  }
+  ldout(msgr->cct,10) << "accept replacing " << existing << dendl;
+  existing->_stop();
+  msgr->_unregister_conn(existing);
+  replaced = true;
+
+  if (existing->policy.lossy) {
+    // disconnect from the Connection
+    assert(existing->connection_state);
+    if (existing->connection_state->clear_pipe(existing))
+      in_q->queue_reset(existing->connection_state.get());
+  } else {
+    // queue a reset on the new connection, which we're dumping for the old
+    in_q->queue_reset(connection_state.get());
+
+    // drop my Connection, and take a ref to the existing one. do not
+    // clear existing->connection_state, its cleanup still dereferences it.
+    connection_state = existing->connection_state;
+
+    // make existing Connection reference us
+    connection_state->reset_pipe(this);
+
+    // steal incoming queue
+    uint64_t replaced_conn_id = conn_id;
+    conn_id = existing->conn_id;
+    existing->conn_id = replaced_conn_id;
+    in_seq = existing->in_seq;
+    in_seq_acked = in_seq;
+
+    // steal outgoing queue and out_seq
+    existing->requeue_sent();
+    out_seq = existing->out_seq;
+    ldout(msgr->cct,10) << "accept re-queuing on out_seq " << out_seq << " in_seq " << in_seq << dendl;
+    for (map<int, list<Message*> >::iterator p = existing->out_q.begin();
+	 p != existing->out_q.end();
+	 ++p)
+      out_q[p->first].splice(out_q[p->first].begin(), p->second);
+    existing->out_q.clear();
+  }
+  existing->lock.Unlock();
+
+ open:
+  connect_seq = connect_msg.connect_seq + 1;
+  peer_global_seq = connect_msg.global_seq;
+  ldout(msgr->cct,10) << "accept success, connect_seq = " << connect_seq << ", sending READY" << dendl;
+
+  // send READY reply
+  reply.tag = (reply_tag ? reply_tag : CEPH_MSGR_TAG_READY);
+  reply.features = policy.features_supported;
+  reply.global_seq = msgr->get_global_seq();
+  reply.connect_seq = connect_seq;
+  reply.flags = 0;
+  reply.authorizer_len = authorizer_reply.length();
+  if (policy.lossy)
+    reply.flags = reply.flags | CEPH_MSG_CONNECT_LOSSY;
+
+  connection_state->set_features((uint64_t)reply.features & (uint64_t)connect_msg.features);
+  ldout(msgr->cct,10) << "accept features " << connection_state->get_features() << dendl;
+
+  delete session_security;
+  session_security = get_auth_session_handler(msgr->cct, connect_msg.authorizer_protocol, session_key,
+					      connection_state->get_features());
+
+  // notify
+  in_q->queue_accept(connection_state.get());
+
+  // ok!
+  if (msgr->dispatch_queue.stop) {
+    msgr->lock.Unlock();
+    return -1;
+  }
+  msgr->_register_conn(this);
+  msgr->lock.Unlock();
+
+  bufferlist bl;
+  bl.append((char*)&reply, sizeof(reply));
+  if (reply.authorizer_len)
+    bl.append(authorizer_reply.c_str(), authorizer_reply.length());
+  if (reply_tag == CEPH_MSGR_TAG_SEQ)
+    bl.append((char*)&existing_seq, sizeof(existing_seq));
+
+  if (reply_tag == CEPH_MSGR_TAG_SEQ) {
+    state = STATE_ACCEPTING_WAIT_SEQ;
+  } else {
+    state = STATE_OPEN;
+    ldout(msgr->cct,20) << "accept done" << dendl;
+  }
+  if (_try_send(bl) < 0)
+    return -1;
+  if (state == STATE_OPEN)
+    _handle_write();
+  return 0;
+}
+
+void AsyncConnection::prepare_send_message(Message *m, bufferlist &bl)
+{
+  m->set_seq(++out_seq);
+  if (!policy.lossy || close_on_empty) {
+    // put on sent list
+    sent.push_back(m);
+    m->get();
+  }
+
+  // associate message with Connection (for benefit of encode_payload)
+  m->set_connection(connection_state.get());
+
+  uint64_t features = connection_state->get_features();
+  if (m->empty_payload())
+    ldout(msgr->cct,20) << "prepare_send_message encoding " << m->get_seq() << " features " << features
+			<< " " << m << " " << *m << dendl;
+  else
+    ldout(msgr->cct,20) << "prepare_send_message half-reencoding " << m->get_seq() << " features " << features
+			<< " " << m << " " << *m << dendl;
+
+  // encode and copy out of *m
+  m->encode(features, !msgr->cct->_conf->ms_nocrc);
+
+  ceph_msg_header& header = m->get_header();
+  ceph_msg_footer& footer = m->get_footer();
+
+  // Now that we have all the crcs calculated, handle the digital
+  // signature for the message, if the connection has session security
+  // set up.  PLR
+  if (session_security == NULL) {
+    ldout(msgr->cct, 20) << "prepare_send_message no session security" << dendl;
+  } else {
+    if (session_security->sign_message(m)) {
+      ldout(msgr->cct, 20) << "prepare_send_message failed to sign seq # " << header.seq
+			   << "): sig = " << footer.sig << dendl;
+    } else {
+      ldout(msgr->cct, 20) << "prepare_send_message signed seq # " << header.seq
+			   << "): sig = " << footer.sig << dendl;
+    }
+  }
+
+  bl.append((char)CEPH_MSGR_TAG_MSG);
+
+  if (connection_state->has_feature(CEPH_FEATURE_NOSRCADDR)) {
+    bl.append((char*)&header, sizeof(header));
+  } else {
+    ceph_msg_header_old oldheader;
+    memcpy(&oldheader, &header, sizeof(header));
+    oldheader.src.name = header.src;
+    oldheader.src.addr = connection_state->get_peer_addr();
+    oldheader.orig_src = oldheader.src;
+    oldheader.reserved = header.reserved;
+    oldheader.crc = ceph_crc32c(0, (unsigned char*)&oldheader,
+				sizeof(oldheader) - sizeof(oldheader.crc));
+    bl.append((char*)&oldheader, sizeof(oldheader));
+  }
+
+  // payload (front+middle+data); shared, not copied
+  bl.append(m->get_payload());
+  bl.append(m->get_middle());
+  bl.append(m->get_data());
+
+  // send footer; if receiver doesn't support signatures, use the old footer format
+  if (connection_state->has_feature(CEPH_FEATURE_MSG_AUTH)) {
+    bl.append((char*)&footer, sizeof(footer));
+  } else {
+    ceph_msg_footer_old old_footer;
+    old_footer.front_crc = footer.front_crc;
+    old_footer.middle_crc = footer.middle_crc;
+    old_footer.data_crc = footer.data_crc;
+    old_footer.flags = footer.flags;
+    bl.append((char*)&old_footer, sizeof(old_footer));
+  }
+
+  ldout(msgr->cct,20) << "prepare_send_message sending " << m->get_seq() << " " << m << dendl;
+  m->put();
+}
+
+void AsyncConnection::handle_write()
+{
+  Mutex::Locker l(lock);
+  write_scheduled = false;
+  _handle_write();
+}
+
+void AsyncConnection::_handle_write()
+{
+  assert(lock.is_locked());
+
+  switch (state) {
+  case STATE_CLOSED:
+  case STATE_WAIT:
+  case STATE_NONE:
+    return;
+
+  case STATE_STANDBY:
+    if (!policy.server && is_queued()) {
+      connect_seq++;
+      state = STATE_CONNECTING;
+      _process();
+    }
+    return;
+
+  case STATE_CONNECTING_WAIT_CONNECTED:
+    {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      if (::getsockopt(sd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+	err = errno;
+      if (err) {
+	ldout(msgr->cct,2) << "connect error " << peer_addr
+			   << ", " << cpp_strerror(err) << dendl;
+	_fault();
+	return;
+      }
+      // a stale writable event for a reused fd must not fool us
+      entity_addr_t a;
+      len = sizeof(a.ss_addr());
+      if (::getpeername(sd, (sockaddr*)&a.ss_addr(), &len) < 0)
+	return;
+
+      center->delete_file_event(sd, EVENT_WRITABLE);
+      ldout(msgr->cct,10) << "connected to " << peer_addr << dendl;
+      state = STATE_CONNECTING_WAIT_BANNER;
+      bufferlist bl;
+      bl.append(CEPH_BANNER, strlen(CEPH_BANNER));
+      if (_try_send(bl) < 0) {
+	ldout(msgr->cct,2) << "connect couldn't write my banner" << dendl;
+	_fault();
+	return;
+      }
+      _process();
+      return;
+    }
+
+  default:
+    break;
+  }
+
+  bufferlist bl;
+  if (is_open()) {
+    // keepalive?
+    if (keepalive) {
+      ldout(msgr->cct,10) << "write_keepalive" << dendl;
+      bl.append((char)CEPH_MSGR_TAG_KEEPALIVE);
+      keepalive = false;
+    }
+
+    // send ack?
+    if (in_seq > in_seq_acked) {
+      ldout(msgr->cct,10) << "write_ack " << in_seq << dendl;
+      ceph_le64 s;
+      s = in_seq;
+      bl.append((char)CEPH_MSGR_TAG_ACK);
+      bl.append((char*)&s, sizeof(s));
+      in_seq_acked = in_seq;
+    }
+
+    // grab outgoing messages
+    Message *m;
+    while ((m = _get_next_outgoing()) != NULL)
+      prepare_send_message(m, bl);
+  }
+
+  // handshake in progress: just flush what it queued
+  if (_try_send(bl) < 0) {
+    ldout(msgr->cct,1) << "handle_write error sending, faulting" << dendl;
+    _fault();
+    return;
+  }
+
+  if (is_open() && close_on_empty && !is_queued() && sent.empty()) {
+    ldout(msgr->cct,10) << "handle_write out and sent queues empty, closing" << dendl;
+    _stop();
+    if (connection_state->clear_pipe(this))
+      in_q->queue_reset(connection_state.get());
+  }
+}
+
+void AsyncConnection::connect(const entity_addr_t& addr, int type)
+{
+  Mutex::Locker l(lock);
+  set_peer_type(type);
+  set_peer_addr(addr);
+  policy = msgr->get_policy(type);
+  state = STATE_CONNECTING;
+  center->dispatch_event_external(new C_conn_process(this));
+}
+
+void AsyncConnection::accept(int incoming)
+{
+  Mutex::Locker l(lock);
+  assert(sd < 0);
+  sd = incoming;
+  state = STATE_ACCEPTING;
+  center->dispatch_event_external(new C_conn_process(this));
+}
+
+void AsyncConnection::_schedule_write()
+{
+  assert(lock.is_locked());
+  if (write_scheduled)
+    return;
+  write_scheduled = true;
+  center->dispatch_event_external(new C_conn_write(this));
+}
+
+void AsyncConnection::_send(Message *m)
+{
+  assert(lock.is_locked());
+  out_q[m->get_priority()].push_back(m);
+  _schedule_write();
+}
+
+void AsyncConnection::send_message(Message *m)
+{
+  Mutex::Locker l(lock);
+  if (state == STATE_CLOSED) {
+    ldout(msgr->cct,10) << "send_message " << *m << " on closed connection, dropping" << dendl;
+    m->put();
+    return;
+  }
+  _send(m);
+}
+
+void AsyncConnection::_send_keepalive()
+{
+  assert(lock.is_locked());
+  keepalive = true;
+  _schedule_write();
+}
+
+void AsyncConnection::send_keepalive()
+{
+  Mutex::Locker l(lock);
+  if (state != STATE_CLOSED)
+    _send_keepalive();
+}
+
+void AsyncConnection::mark_down(bool queue_reset)
+{
+  Mutex::Locker l(lock);
+  _stop();
+  if (connection_state->clear_pipe(this) && queue_reset)
+    in_q->queue_reset(connection_state.get());
+}
+
+void AsyncConnection::mark_down_on_empty()
+{
+  Mutex::Locker l(lock);
+  if (out_q.empty()) {
+    ldout(msgr->cct,1) << "mark_down_on_empty closing (queue is empty)" << dendl;
+    _stop();
+    if (connection_state->clear_pipe(this))
+      in_q->queue_reset(connection_state.get());
+  } else {
+    ldout(msgr->cct,1) << "mark_down_on_empty marking (queue is not empty)" << dendl;
+    close_on_empty = true;
+  }
+}
+
+void AsyncConnection::handle_ack(uint64_t seq)
+{
+  ldout(msgr->cct, 15) << "got ack seq " << seq << dendl;
+  // trim sent list
+  while (!sent.empty() &&
+	 sent.front()->get_seq() <= seq) {
+    Message *m = sent.front();
+    sent.pop_front();
+    ldout(msgr->cct, 10) << "got ack seq "
+			 << seq << " >= " << m->get_seq() << " on " << m << " " << *m << dendl;
+    m->put();
+  }
+
+  if (sent.empty() && close_on_empty && !is_queued()) {
+    ldout(msgr->cct, 10) << "got last ack, queue empty, closing" << dendl;
+    _stop();
+    if (connection_state->clear_pipe(this))
+      in_q->queue_reset(connection_state.get());
+  }
+}
+
+void AsyncConnection::_fault()
+{
+  const md_config_t *conf = msgr->cct->_conf;
+  assert(lock.is_locked());
+  assert(center->in_thread());
+
+  if (state == STATE_CLOSED) {
+    ldout(msgr->cct,10) << "fault already closed" << dendl;
+    return;
+  }
+  ldout(msgr->cct,2) << "fault" << dendl;
+
+  if (is_accepting() && !replaced && !is_queued()) {
+    ldout(msgr->cct,10) << "fault during accept, closing" << dendl;
+    _stop();
+    return;
+  }
+
+  // lossy channel?
+  if (policy.lossy && !is_connecting()) {
+    ldout(msgr->cct,10) << "fault on lossy channel, failing" << dendl;
+    _stop();
+    in_q->discard_queue(conn_id);
+    discard_out_queue();
+
+    // disconnect from Connection, and mark it failed.  future messages
+    // will be dropped.
+    if (connection_state->clear_pipe(this))
+      in_q->queue_reset(connection_state.get());
+    return;
+  }
+
+  _close_socket();
+
+  // requeue sent items
+  requeue_sent();
+
+  if (policy.standby && !is_queued()) {
+    ldout(msgr->cct,0) << "fault with nothing to send, going to standby" << dendl;
+    state = STATE_STANDBY;
+    return;
+  }
+
+  if (!is_connecting()) {
+    if (policy.server) {
+      ldout(msgr->cct,0) << "fault, server, going to standby" << dendl;
+      state = STATE_STANDBY;
+    } else {
+      ldout(msgr->cct,0) << "fault, initiating reconnect" << dendl;
+      connect_seq++;
+      state = STATE_CONNECTING;
+      center->dispatch_event_external(new C_conn_process(this));
+    }
+    backoff = utime_t();
+  } else {
+    state = STATE_CONNECTING;
+    if (backoff == utime_t()) {
+      ldout(msgr->cct,0) << "fault" << dendl;
+      backoff.set_from_double(conf->ms_initial_backoff);
+      center->dispatch_event_external(new C_conn_process(this));
+    } else {
+      ldout(msgr->cct,10) << "fault waiting " << backoff << dendl;
+      utime_t t = ceph_clock_now(msgr->cct);
+      t += backoff;
+      center->create_time_event(t, new C_conn_process(this));
+      backoff += backoff;
+      if (backoff > conf->ms_max_backoff)
+	backoff.set_from_double(conf->ms_max_backoff);
+    }
+  }
+}
+
+/*
+ * mark the connection closed; the socket itself is torn down by
+ * cleanup_handler in the owning thread, since only it may touch the
+ * EventCenter registrations.
+ */
+void AsyncConnection::_stop()
+{
+  assert(lock.is_locked());
+  if (state == STATE_CLOSED)
+    return;
+  ldout(msgr->cct,10) << "stop" << dendl;
+  state = STATE_CLOSED;
+  state_closed.set(1);
+  if (sd >= 0)
+    ::shutdown(sd, SHUT_RDWR);
+  center->dispatch_event_external(new C_conn_cleanup(this));
+}
+
+void AsyncConnection::_close_socket()
+{
+  assert(lock.is_locked());
+  if (sd >= 0) {
+    center->delete_file_event(sd, EVENT_READABLE | EVENT_WRITABLE);
+    ::close(sd);
+    sd = -1;
+  }
+  outcoming_bl.clear();
+  recv_start = recv_end = 0;
+  state_offset = 0;
+  _release_message_throttle();
+  front.clear();
+  middle.clear();
+  data.clear();
+  data_buf.clear();
+  authorizer_buf.clear();
+  authorizer_reply.clear();
+}
+
+void AsyncConnection::_release_message_throttle()
+{
+  // release bytes reserved for a message we didn't finish reading
+  if (msg_throttled_messages) {
+    ldout(msgr->cct,10) << "releasing " << 1 << " message to policy throttler "
+			<< policy.throttler_messages->get_current() << "/"
+			<< policy.throttler_messages->get_max() << dendl;
+    policy.throttler_messages->put();
+    msg_throttled_messages = false;
+  }
+  if (msg_throttled_bytes) {
+    ldout(msgr->cct,10) << "releasing " << cur_msg_size << " bytes to policy throttler "
+			<< policy.throttler_bytes->get_current() << "/"
+			<< policy.throttler_bytes->get_max() << dendl;
+    policy.throttler_bytes->put(cur_msg_size);
+    msg_throttled_bytes = false;
+  }
+  if (msg_throttled_dispatch) {
+    msgr->dispatch_throttle_release(cur_msg_size);
+    msg_throttled_dispatch = false;
+  }
+}
+
+void AsyncConnection::cleanup_handler()
+{
+  lock.Lock();
+  ldout(msgr->cct,10) << "cleanup_handler" << dendl;
+  assert(state == STATE_CLOSED);
+  _close_socket();
+  discard_out_queue();
+  // mark_down, mark_down_all, or fault() normally did this already, or
+  // accept() switched the Connection to a different AsyncConnection
+  if (connection_state->clear_pipe(this))
+    in_q->queue_reset(connection_state.get());
+  lock.Unlock();
+  msgr->reap_conn(this);
+}
+
+int AsyncConnection::randomize_out_seq()
+{
+  if (connection_state->get_features() & CEPH_FEATURE_MSG_AUTH) {
+    // Set out_seq to a random value, so CRC won't be predictable.   Don't bother checking seq_error
+    // here.  We'll check it on the call.  PLR
+    int seq_error = get_random_bytes((char *)&out_seq, sizeof(out_seq));
+    out_seq &= SEQ_MASK;
+    lsubdout(msgr->cct, ms, 10) << "randomize_out_seq " << out_seq << dendl;
+    return seq_error;
+  } else {
+    // previously, seq #'s always started at 0.
+    out_seq = 0;
+    return 0;
+  }
+}
+
+void AsyncConnection::was_session_reset()
+{
+  assert(lock.is_locked());
+
+  ldout(msgr->cct,10) << "was_session_reset" << dendl;
+  in_q->discard_queue(conn_id);
+  discard_out_queue();
+
+  in_q->queue_remote_reset(connection_state.get());
+
+  if (randomize_out_seq()) {
+    lsubdout(msgr->cct,ms,15) << "was_session_reset(): Could not get random bytes to set seq number for session reset; set seq number to " << out_seq << dendl;
+  }
+
+  in_seq = 0;
+  connect_seq = 0;
+}
+
+void AsyncConnection::requeue_sent()
+{
+  if (sent.empty())
+    return;
+
+  list<Message*>& rq = out_q[CEPH_MSG_PRIO_HIGHEST];
+  while (!sent.empty()) {
+    Message *m = sent.back();
+    sent.pop_back();
+    ldout(msgr->cct,10) << "requeue_sent " << *m << " for resend seq " << out_seq
+			<< " (" << m->get_seq() << ")" << dendl;
+    rq.push_front(m);
+    out_seq--;
+  }
+}
+
+void AsyncConnection::discard_requeued_up_to(uint64_t seq)
+{
+  ldout(msgr->cct, 10) << "discard_requeued_up_to " << seq << dendl;
+  if (out_q.count(CEPH_MSG_PRIO_HIGHEST) == 0)
+    return;
+  list<Message*>& rq = out_q[CEPH_MSG_PRIO_HIGHEST];
+  while (!rq.empty()) {
+    Message *m = rq.front();
+    if (m->get_seq() == 0 || m->get_seq() > seq)
+      break;
+    ldout(msgr->cct,10) << "discard_requeued_up_to " << *m << " for resend seq " << out_seq
+			<< " <= " << seq << ", discarding" << dendl;
+    m->put();
+    rq.pop_front();
+    out_seq++;
+  }
+  if (rq.empty())
+    out_q.erase(CEPH_MSG_PRIO_HIGHEST);
+}
+
+/*
+ * Tears down the message queues.
+ * Must hold lock prior to calling.
+ */
+void AsyncConnection::discard_out_queue()
+{
+  ldout(msgr->cct,10) << "discard_queue" << dendl;
+
+  for (list<Message*>::iterator p = sent.begin(); p != sent.end(); ++p) {
+    ldout(msgr->cct,20) << "  discard " << *p << dendl;
+    (*p)->put();
+  }
+  sent.clear();
+  for (map<int,list<Message*> >::iterator p = out_q.begin(); p != out_q.end(); ++p)
+    for (list<Message*>::iterator r = p->second.begin(); r != p->second.end(); ++r) {
+      ldout(msgr->cct,20) << "  discard " << *r << dendl;
+      (*r)->put();
+    }
+  out_q.clear();
+}
@@ -0,0 +1,283 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_ASYNCCONNECTION_H
+#define CEPH_MSG_ASYNCCONNECTION_H
+
+#include <list>
+#include <map>
+using namespace std;
+
+#include "common/Mutex.h"
+#include "common/RefCountedObj.h"
+#include "include/buffer.h"
+#include "include/atomic.h"
+#include "auth/AuthSessionHandler.h"
+
+#include "Messenger.h"
+#include "Event.h"
+
+class AsyncMessenger;
+class DispatchQueue;
+
+/**
+ * AsyncConnection
+ *
+ * The event-driven counterpart of Pipe.  It speaks exactly the same
+ * wire protocol, but instead of a reader and a writer thread blocking
+ * on the socket, every step of the handshake and of the message
+ * stream is a state that is advanced whenever the socket owned by the
+ * connection becomes readable or writable.  All socket I/O happens in
+ * the thread driving the connection's EventCenter; other threads only
+ * queue work (messages, keepalives, stop requests) under the
+ * connection lock and then kick the event loop.
+ */
+class AsyncConnection : public RefCountedObject {
+ public:
+  enum {
+    STATE_NONE,
+    STATE_OPEN,
+    STATE_OPEN_TAG_ACK,
+    STATE_OPEN_MESSAGE_HEADER,
+    STATE_OPEN_MESSAGE_THROTTLE_MESSAGE,
+    STATE_OPEN_MESSAGE_THROTTLE_BYTES,
+    STATE_OPEN_MESSAGE_READ_FRONT,
+    STATE_OPEN_MESSAGE_READ_MIDDLE,
+    STATE_OPEN_MESSAGE_READ_DATA_PREPARE,
+    STATE_OPEN_MESSAGE_READ_DATA,
+    STATE_OPEN_MESSAGE_READ_FOOTER_AND_DISPATCH,
+    STATE_STANDBY,
+    STATE_WAIT,       // lost a connection race; the peer will connect to us
+    STATE_CLOSED,
+
+    STATE_CONNECTING,
+    STATE_CONNECTING_WAIT_CONNECTED,
+    STATE_CONNECTING_WAIT_BANNER,
+    STATE_CONNECTING_SEND_CONNECT_MSG,
+    STATE_CONNECTING_WAIT_CONNECT_REPLY,
+    STATE_CONNECTING_WAIT_CONNECT_REPLY_AUTH,
+    STATE_CONNECTING_WAIT_ACK_SEQ,
+    STATE_CONNECTING_READY,
+
+    STATE_ACCEPTING,
+    STATE_ACCEPTING_WAIT_BANNER_ADDR,
+    STATE_ACCEPTING_WAIT_CONNECT_MSG,
+    STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH,
+    STATE_ACCEPTING_WAIT_SEQ,
+  };
+
+  static const char *get_state_name(int state) {
+    const char* const statenames[] = {"STATE_NONE",
+				      "STATE_OPEN",
+				      "STATE_OPEN_TAG_ACK",
+				      "STATE_OPEN_MESSAGE_HEADER",
+				      "STATE_OPEN_MESSAGE_THROTTLE_MESSAGE",
+				      "STATE_OPEN_MESSAGE_THROTTLE_BYTES",
+				      "STATE_OPEN_MESSAGE_READ_FRONT",
+				      "STATE_OPEN_MESSAGE_READ_MIDDLE",
+				      "STATE_OPEN_MESSAGE_READ_DATA_PREPARE",
+				      "STATE_OPEN_MESSAGE_READ_DATA",
+				      "STATE_OPEN_MESSAGE_READ_FOOTER_AND_DISPATCH",
+				      "STATE_STANDBY",
+				      "STATE_WAIT",
+				      "STATE_CLOSED",
+				      "STATE_CONNECTING",
+				      "STATE_CONNECTING_WAIT_CONNECTED",
+				      "STATE_CONNECTING_WAIT_BANNER",
+				      "STATE_CONNECTING_SEND_CONNECT_MSG",
+				      "STATE_CONNECTING_WAIT_CONNECT_REPLY",
+				      "STATE_CONNECTING_WAIT_CONNECT_REPLY_AUTH",
+				      "STATE_CONNECTING_WAIT_ACK_SEQ",
+				      "STATE_CONNECTING_READY",
+				      "STATE_ACCEPTING",
+				      "STATE_ACCEPTING_WAIT_BANNER_ADDR",
+				      "STATE_ACCEPTING_WAIT_CONNECT_MSG",
+				      "STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH",
+				      "STATE_ACCEPTING_WAIT_SEQ"};
+    return statenames[state];
+  }
+
+  AsyncConnection(AsyncMessenger *m, EventCenter *c);
+  ~AsyncConnection();
+
+  ostream& _conn_prefix(std::ostream *_dout);
+
+  AsyncMessenger *msgr;
+  EventCenter *center;
+  ConnectionRef connection_state;
+  Messenger::Policy policy;
+  atomic_t state_closed;  // non-zero iff state = STATE_CLOSED
+
+  /**
+   * @defgroup entry points, any thread
+   * @{
+   */
+  /// start an outgoing session; msgr lock held
+  void connect(const entity_addr_t& addr, int type);
+  /// take over an accepted socket; msgr lock held
+  void accept(int sd);
+  /// queue a message, eats the reference
+  void send_message(Message *m);
+  void send_keepalive();
+  /**
+   * tear the connection down
+   *
+   * @param queue_reset deliver ms_handle_reset for the Connection
+   */
+  void mark_down(bool queue_reset);
+  void mark_down_on_empty();
+  void mark_disposable() {
+    Mutex::Locker l(lock);
+    policy.lossy = true;
+  }
+  /** @} */
+
+  /**
+   * @defgroup event handlers, EventCenter thread only
+   * @{
+   */
+  void process();
+  void handle_write();
+  /// resume reading after a throttle was exhausted
+  void retry_read();
+  void cleanup_handler();
+  /** @} */
+
+  const entity_addr_t& get_peer_addr() const { return peer_addr; }
+  int get_state() const { return state; }
+
+ private:
+  friend class AsyncMessenger;
+
+  Mutex lock;
+  int state;
+  int sd;
+  int port;
+  int peer_type;
+  entity_addr_t peer_addr;
+  uint64_t conn_id;
+  DispatchQueue *in_q;
+
+  map<int, list<Message*> > out_q;  // priority queue for outbound msgs
+  list<Message*> sent;
+  bool keepalive;
+  bool close_on_empty;
+  bool write_scheduled;   // a handle_write is queued on the center
+  bool replaced;          // we took over an existing session in accept
+
+  __u32 connect_seq, peer_global_seq, global_seq;
+  uint64_t out_seq;
+  uint64_t in_seq, in_seq_acked;
+  utime_t backoff;
+  bool got_bad_auth;
+  AuthAuthorizer *authorizer;
+  AuthSessionHandler *session_security;
+
+  EventCallback *read_handler;
+  EventCallback *write_handler;
+
+  /// bytes queued for the socket whenever it can take them
+  bufferlist outcoming_bl;
+
+  /// small read-ahead buffer so single-byte tags don't cost a syscall
+  static const unsigned RECV_BUF_SIZE = 4096;
+  char *recv_buf;
+  unsigned recv_start, recv_end;
+  /// bytes of the current state's read already collected
+  unsigned state_offset;
+  char *state_buffer;  // scratch for the fixed size handshake reads
+
+  // the handshake in flight
+  ceph_msg_connect connect_msg;
+  ceph_msg_connect_reply connect_reply;
+  bufferlist authorizer_buf, authorizer_reply;
+
+  // the message being read
+  ceph_msg_header current_header;
+  utime_t recv_stamp, throttle_stamp;
+  uint64_t cur_msg_size;
+  bool msg_throttled_messages, msg_throttled_bytes, msg_throttled_dispatch;
+  bufferlist front, middle, data, data_buf;
+  bufferlist::iterator data_blp;
+  unsigned msg_left;
+
+  bool is_queued() { return !out_q.empty() || keepalive; }
+  bool is_connecting() const {
+    return state >= STATE_CONNECTING && state <= STATE_CONNECTING_READY;
+  }
+  bool is_accepting() const {
+    return state >= STATE_ACCEPTING && state <= STATE_ACCEPTING_WAIT_SEQ;
+  }
+  bool is_open() const {
+    return state >= STATE_OPEN &&
+      state <= STATE_OPEN_MESSAGE_READ_FOOTER_AND_DISPATCH;
+  }
+
+  void set_peer_addr(const entity_addr_t& a) {
+    if (&peer_addr != &a)
+      peer_addr = a;
+    connection_state->set_peer_addr(a);
+  }
+  void set_peer_type(int t) {
+    peer_type = t;
+    connection_state->set_peer_type(t);
+  }
+
+  void _send(Message *m);
+  void _send_keepalive();
+  void _schedule_write();
+  Message *_get_next_outgoing() {
+    assert(lock.is_locked());
+    Message *m = 0;
+    while (!m && !out_q.empty()) {
+      map<int, list<Message*> >::reverse_iterator p = out_q.rbegin();
+      if (!p->second.empty()) {
+	m = p->second.front();
+	p->second.pop_front();
+      }
+      if (p->second.empty())
+	out_q.erase(p->first);
+    }
+    return m;
+  }
+
+  void _process();
+  // state machine steps; return 0 when the state advanced, > 0 when
+  // more input is needed, < 0 on a fault
+  int _process_connection();
+  int _process_message();
+  int _connect();
+  int _handle_connect_reply();
+  int _handle_connect_msg();
+  int _reply_accept(char tag, ceph_msg_connect_reply &reply);
+  void _handle_write();
+  void _wait_for_throttle();
+
+  int read_until(unsigned needed, char *p);
+  int read_bulk(char *buf, unsigned len);
+  int _try_send(bufferlist &bl);
+  void prepare_send_message(Message *m, bufferlist &bl);
+  void set_socket_options();
+
+  void _fault();
+  void _stop();
+  void _close_socket();
+  void _release_message_throttle();
+  void handle_ack(uint64_t seq);
+  int randomize_out_seq();
+  void was_session_reset();
+  void requeue_sent();
+  void discard_requeued_up_to(uint64_t seq);
+  void discard_out_queue();
+};
+
+#endif
@@ -0,0 +1,368 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_ASYNCMESSENGER_H
+#define CEPH_MSG_ASYNCMESSENGER_H
+
+#include <pthread.h>
+
+#include "include/types.h"
+#include "include/xlist.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+using namespace std;
+#include <ext/hash_map>
+using namespace __gnu_cxx;
+
+#include "include/atomic.h"
+#include "include/assert.h"
+
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "common/Thread.h"
+
+#include "Messenger.h"
+#include "DispatchQueue.h"
+#include "Event.h"
+#include "AsyncConnection.h"
+
+class AsyncMessenger;
+
+/**
+ * A thread driving one EventCenter.  Every AsyncConnection is bound to
+ * one Worker for its whole life.
+ */
+class Worker : public Thread {
+  CephContext *cct;
+  bool done;
+
+ public:
+  EventCenter center;
+
+  Worker(CephContext *c) : cct(c), done(false), center(c) {}
+  void *entry();
+  void stop();
+};
+
+/**
+ * Listens on the bound address from inside a Worker's event loop and
+ * hands every accepted socket to the messenger.
+ */
+class Processor {
+  AsyncMessenger *msgr;
+  Worker *worker;
+  int listen_sd;
+  uint64_t nonce;
+  EventCallback *listen_handler;
+
+  friend class C_processor_listen;
+  friend class C_processor_stop;
+  Mutex lock;
+  Cond cond;
+  bool stopped;
+
+  void _start();
+  void _stop();
+
+ public:
+  Processor(AsyncMessenger *r, uint64_t n);
+  ~Processor();
+
+  int bind(const entity_addr_t &bind_addr, const set<int>& avoid_ports);
+  int rebind(const set<int>& avoid_port);
+  int start(Worker *w);
+  void stop();
+  void accept();
+};
+
+/*
+ * AsyncMessenger maintains a set of non-blocking connections; it may
+ * own a bind address, in which case it also manages the connections
+ * accepted there.
+ *
+ * Instead of a reader and writer thread per connection, a fixed pool
+ * of ms_async_op_threads Worker threads multiplexes all sockets with
+ * epoll.  Connection, Dispatcher and Policy semantics, and the wire
+ * protocol, are the same as for SimpleMessenger.
+ *
+ * Lock ordering:
+ *
+ *   AsyncMessenger::lock
+ *       AsyncConnection::lock
+ *           DispatchQueue::lock
+ */
+class AsyncMessenger : public Messenger {
+ public:
+  /**
+   * Initialize the AsyncMessenger!
+   *
+   * @param cct The CephContext to use
+   * @param name The name to assign ourselves
+   * _nonce A unique ID to use for this AsyncMessenger. It should not
+   * be a value that will be repeated if the daemon restarts.
+   */
+  AsyncMessenger(CephContext *cct, entity_name_t name,
+		 string mname, uint64_t _nonce);
+
+  virtual ~AsyncMessenger();
+
+  /** @defgroup Accessors
+   * @{
+   */
+  void set_addr_unknowns(entity_addr_t& addr);
+
+  int get_dispatch_queue_len() {
+    return dispatch_queue.get_queue_len();
+  }
+
+  double get_dispatch_queue_max_age(utime_t now) {
+    return dispatch_queue.get_max_age(now);
+  }
+  /** @} Accessors */
+
+  /**
+   * @defgroup Configuration functions
+   * @{
+   */
+  void set_cluster_protocol(int p) {
+    assert(!started && !did_bind);
+    cluster_protocol = p;
+  }
+
+  void set_default_policy(Policy p) {
+    Mutex::Locker l(policy_lock);
+    default_policy = p;
+  }
+
+  void set_policy(int type, Policy p) {
+    Mutex::Locker l(policy_lock);
+    policy_map[type] = p;
+  }
+
+  void set_policy_throttlers(int type, Throttle *byte_throttle, Throttle *msg_throttle) {
+    Mutex::Locker l(policy_lock);
+    if (policy_map.count(type)) {
+      policy_map[type].throttler_bytes = byte_throttle;
+      policy_map[type].throttler_messages = msg_throttle;
+    } else {
+      default_policy.throttler_bytes = byte_throttle;
+      default_policy.throttler_messages = msg_throttle;
+    }
+  }
+
+  int bind(const entity_addr_t& bind_addr);
+  int rebind(const set<int>& avoid_ports);
+
+  /** @} Configuration functions */
+
+  /**
+   * @defgroup Startup/Shutdown
+   * @{
+   */
+  virtual int start();
+  virtual void wait();
+  virtual int shutdown();
+
+  /** @} // Startup/Shutdown */
+
+  /**
+   * @defgroup Messaging
+   * @{
+   */
+  virtual int send_message(Message *m, const entity_inst_t& dest) {
+    return _send_message(m, dest, false);
+  }
+
+  virtual int send_message(Message *m, Connection *con) {
+    return _send_message(m, con, false);
+  }
+
+  virtual int lazy_send_message(Message *m, const entity_inst_t& dest) {
+    return _send_message(m, dest, true);
+  }
+
+  virtual int lazy_send_message(Message *m, Connection *con) {
+    return _send_message(m, con, true);
+  }
+  /** @} // Messaging */
+
+  /**
+   * @defgroup Connection Management
+   * @{
+   */
+  virtual ConnectionRef get_connection(const entity_inst_t& dest);
+  virtual ConnectionRef get_loopback_connection();
+  virtual int send_keepalive(const entity_inst_t& addr);
+  virtual int send_keepalive(Connection *con);
+  virtual void mark_down(const entity_addr_t& addr);
+  virtual void mark_down(Connection *con);
+  virtual void mark_down_on_empty(Connection *con);
+  virtual void mark_disposable(Connection *con);
+  virtual void mark_down_all();
+  /** @} // Connection Management */
+
+ protected:
+  /**
+   * Start up the DispatchQueue thread and the listener once we have
+   * somebody to dispatch to.
+   */
+  virtual void ready();
+
+ private:
+  Processor processor;
+  vector<Worker*> workers;
+  atomic_t worker_rr;
+
+  Worker *get_worker() {
+    return workers[worker_rr.inc() % workers.size()];
+  }
+
+  AsyncConnection *create_connect(const entity_addr_t& addr, int type);
+  int _send_message(Message *m, const entity_inst_t& dest, bool lazy);
+  int _send_message(Message *m, Connection *con, bool lazy);
+  void submit_message(Message *m, Connection *con,
+		      const entity_addr_t& addr, int dest_type, bool lazy);
+
+  /// the peer type of our endpoint
+  int my_type;
+  /// approximately unique ID set by the Constructor for use in entity_addr_t
+  uint64_t nonce;
+  /// overall lock used for AsyncMessenger data structures
+  Mutex lock;
+  /// true, specifying we haven't learned our addr; set false when we find it.
+  bool need_addr;
+  /// set to true if we bound to a specific address
+  bool did_bind;
+  /// counter for the global seq our connection protocol uses
+  __u32 global_seq;
+  /// lock to protect the global_seq
+  pthread_spinlock_t global_seq_lock;
+
+  /**
+   * hash map of addresses to connections
+   *
+   * NOTE: a connection with state CLOSED may still be in the map but
+   * is considered invalid and can be replaced by anyone holding the
+   * msgr lock
+   */
+  hash_map<entity_addr_t, AsyncConnection*> conns;
+  /// connections still in the accept handshake, not yet in conns
+  set<AsyncConnection*> accepting_conns;
+  /// every connection which has not been torn down by its worker yet
+  set<AsyncConnection*> all_conns;
+  /// signaled whenever a connection is torn down
+  Cond stop_cond;
+
+  /// internal cluster protocol version, if any, for talking to entities of the same type.
+  int cluster_protocol;
+
+  /// lock protecting policy
+  Mutex policy_lock;
+  /// the default Policy we use for connections
+  Policy default_policy;
+  /// map specifying different Policies for specific peer types
+  map<int, Policy> policy_map; // entity_name_t::type -> Policy
+
+  AsyncConnection *_lookup_conn(const entity_addr_t& k) {
+    assert(lock.is_locked());
+    hash_map<entity_addr_t, AsyncConnection*>::iterator p = conns.find(k);
+    if (p == conns.end())
+      return NULL;
+    if (p->second->state_closed.read())
+      return NULL;
+    return p->second;
+  }
+
+  friend class AsyncConnection;
+  friend class Processor;
+
+ public:
+  DispatchQueue dispatch_queue;
+
+  /// con used for sending messages to ourselves
+  ConnectionRef local_connection;
+
+  /**
+   * @defgroup AsyncMessenger internals
+   * @{
+   */
+  bool get_need_addr() const { return need_addr; }
+
+  /// register a new socket from the Processor
+  AsyncConnection *add_accept(int sd);
+
+  /// register an accepted connection once its handshake succeeded; lock held
+  void _register_conn(AsyncConnection *conn) {
+    assert(lock.is_locked());
+    assert(_lookup_conn(conn->get_peer_addr()) == NULL);
+    accepting_conns.erase(conn);
+    conns[conn->get_peer_addr()] = conn;
+  }
+  /// drop a connection from the lookup maps; lock held
+  void _unregister_conn(AsyncConnection *conn) {
+    assert(lock.is_locked());
+    hash_map<entity_addr_t, AsyncConnection*>::iterator p =
+      conns.find(conn->get_peer_addr());
+    if (p != conns.end() && p->second == conn)
+      conns.erase(p);
+    accepting_conns.erase(conn);
+  }
+  /// called by a connection's worker once it has closed its socket
+  void reap_conn(AsyncConnection *conn);
+
+  AuthAuthorizer *get_authorizer(int peer_type, bool force_new);
+  bool verify_authorizer(Connection *con, int peer_type, int protocol,
+			 bufferlist& auth, bufferlist& auth_reply,
+			 bool& isvalid, CryptoKey& session_key);
+  __u32 get_global_seq(__u32 old=0) {
+    pthread_spin_lock(&global_seq_lock);
+    if (old > global_seq)
+      global_seq = old;
+    __u32 ret = ++global_seq;
+    pthread_spin_unlock(&global_seq_lock);
+    return ret;
+  }
+  int get_proto_version(int peer_type, bool connect);
+  void init_local_connection();
+  void learned_addr(const entity_addr_t& peer_addr_for_me);
+  void unlearn_addr();
+
+  /// AsyncConnection can't decode compressed messages; never offer it
+  static Policy _strip_unsupported(Policy p) {
+    p.features_supported &= ~CEPH_FEATURE_MSG_COMPRESS;
+    p.compress = false;
+    return p;
+  }
+  Policy get_policy(int t) {
+    Mutex::Locker l(policy_lock);
+    if (policy_map.count(t))
+      return _strip_unsupported(policy_map[t]);
+    else
+      return _strip_unsupported(default_policy);
+  }
+  Policy get_default_policy() {
+    Mutex::Locker l(policy_lock);
+    return _strip_unsupported(default_policy);
+  }
+
+  void dispatch_throttle_release(uint64_t msize) {
+    dispatch_queue.dispatch_throttle_release(msize);
+  }
+  /**
+   * @} // AsyncMessenger Internals
+   */
+};
+
+#endif
@@ -13,8 +13,8 @@
  */
 
 #include "msg/Message.h"
+#include "msg/Messenger.h"
 #include "DispatchQueue.h"
-#include "SimpleMessenger.h"
 #include "common/ceph_context.h"
 
 #define dout_subsys ceph_subsys_ms
@@ -54,7 +54,7 @@ void DispatchQueue::enqueue(Message *m, int priority, uint64_t id)
 void DispatchQueue::local_delivery(Message *m, int priority)
 {
   Mutex::Locker l(lock);
-  m->set_connection(msgr->local_connection.get());
+  m->set_connection(msgr->get_loopback_connection().get());
   add_arrival(m);
   if (priority >= CEPH_MSG_PRIO_LOW) {
     mqueue.enqueue_strict(
@@ -66,6 +66,46 @@ void DispatchQueue::local_delivery(Message *m, int priority)
   cond.Signal();
 }
 
+uint64_t DispatchQueue::pre_dispatch(Message *m)
+{
+  ldout(cct,1) << "<== " << m->get_source_inst()
+	       << " " << m->get_seq()
+	       << " ==== " << *m
+	       << " ==== " << m->get_payload().length() << "+" << m->get_middle().length()
+	       << "+" << m->get_data().length()
+	       << " (" << m->get_footer().front_crc << " " << m->get_footer().middle_crc
+	       << " " << m->get_footer().data_crc << ")"
+	       << " " << m << " con " << m->get_connection()
+	       << dendl;
+  uint64_t msize = m->get_dispatch_throttle_size();
+  m->set_dispatch_throttle_size(0);  // clear it out, in case we requeue this message.
+  return msize;
+}
+
+void DispatchQueue::post_dispatch(Message *m, uint64_t msize)
+{
+  dispatch_throttle_release(msize);
+  ldout(cct,20) << "done calling dispatch on " << m << dendl;
+}
+
+bool DispatchQueue::can_fast_dispatch(Message *m) const
+{
+  return msgr->ms_can_fast_dispatch(m);
+}
+
+void DispatchQueue::fast_dispatch(Message *m)
+{
+  if (stop) {
+    ldout(cct,10) << " stop flag set, discarding " << m << " " << *m << dendl;
+    dispatch_throttle_release(m->get_dispatch_throttle_size());
+    m->put();
+    return;
+  }
+  uint64_t msize = pre_dispatch(m);
+  msgr->ms_fast_dispatch(m);
+  post_dispatch(m, msize);
+}
+
 /*
  * This function delivers incoming messages to the Messenger.
  * Pipes with messages are kept in queues; when beginning a message
@@ -108,23 +148,9 @@ void DispatchQueue::entry()
 	  ldout(cct,10) << " stop flag set, discarding " << m << " " << *m << dendl;
 	  m->put();
 	} else {
-	  uint64_t msize = m->get_dispatch_throttle_size();
-	  m->set_dispatch_throttle_size(0);  // clear it out, in case we requeue this message.
-
-	  ldout(cct,1) << "<== " << m->get_source_inst()
-		       << " " << m->get_seq()
-		       << " ==== " << *m
-		       << " ==== " << m->get_payload().length() << "+" << m->get_middle().length()
-		       << "+" << m->get_data().length()
-		       << " (" << m->get_footer().front_crc << " " << m->get_footer().middle_crc
-		       << " " << m->get_footer().data_crc << ")"
-		       << " " << m << " con " << m->get_connection()
-		       << dendl;
+	  uint64_t msize = pre_dispatch(m);
 	  msgr->ms_deliver_dispatch(m);
-
-	  msgr->dispatch_throttle_release(msize);
-
-	  ldout(cct,20) << "done calling dispatch on " << m << dendl;
+	  post_dispatch(m, msize);
 	}
       }
 
@@ -149,11 +175,21 @@ void DispatchQueue::discard_queue(uint64_t id) {
     assert(!(i->is_code())); // We don't discard id 0, ever!
     Message *m = i->get_message();
     remove_arrival(m);
-    msgr->dispatch_throttle_release(m->get_dispatch_throttle_size());
+    dispatch_throttle_release(m->get_dispatch_throttle_size());
     m->put();
   }
 }
 
+void DispatchQueue::dispatch_throttle_release(uint64_t msize)
+{
+  if (msize) {
+    ldout(cct,10) << __func__ << " " << msize << " to dispatch throttler "
+		  << dispatch_throttler.get_current() << "/"
+		  << dispatch_throttler.get_max() << dendl;
+    dispatch_throttler.put(msize);
+  }
+}
+
 void DispatchQueue::start()
 {
   assert(!stop);
@@ -23,21 +23,25 @@
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/Thread.h"
+#include "common/Throttle.h"
 #include "common/RefCountedObj.h"
 #include "common/PrioritizedQueue.h"
 
 class CephContext;
 class DispatchQueue;
 class Pipe;
-class SimpleMessenger;
+class Messenger;
 class Message;
 struct Connection;
 
 /**
- * The DispatchQueue contains all the Pipes which have Messages
+ * The DispatchQueue contains all the connections which have Messages
  * they want to be dispatched, carefully organized by Message priority
  * and permitted to deliver in a round-robin fashion.
- * See SimpleMessenger::dispatch_entry for details.
+ * See DispatchQueue::entry for details.
+ *
+ * It is shared by the Messenger implementations, and also owns the
+ * throttle limiting the bytes read off the wire but not yet dispatched.
  */
 class DispatchQueue {
   class QueueItem {
@@ -65,7 +69,7 @@ class DispatchQueue {
   };
     
   CephContext *cct;
-  SimpleMessenger *msgr;
+  Messenger *msgr;
   Mutex lock;
   Cond cond;
 
@@ -89,6 +93,10 @@ class DispatchQueue {
     marrival_map.erase(i);
   }
 
+  /// log m and take over its dispatch throttle reservation
+  uint64_t pre_dispatch(Message *m);
+  void post_dispatch(Message *m, uint64_t msize);
+
   uint64_t next_pipe_id;
     
   enum { D_CONNECT = 1, D_ACCEPT, D_BAD_REMOTE_RESET, D_BAD_RESET, D_NUM_CODES };
@@ -107,6 +115,9 @@ class DispatchQueue {
   } dispatch_thread;
 
   public:
+  /// Throttle preventing us from building up a big backlog waiting for dispatch
+  Throttle dispatch_throttler;
+
   bool stop;
   void local_delivery(Message *m, int priority);
 
@@ -158,7 +169,16 @@ class DispatchQueue {
     cond.Signal();
   }
 
+  void dispatch_throttle_release(uint64_t msize);
+
   void enqueue(Message *m, int priority, uint64_t id);
+  /**
+   * true if a Dispatcher wants m delivered from the calling (reader)
+   * thread rather than through the queue
+   */
+  bool can_fast_dispatch(Message *m) const;
+  /// deliver m right now, in the calling thread; eats the reference
+  void fast_dispatch(Message *m);
   void discard_queue(uint64_t id);
   uint64_t get_id() {
     Mutex::Locker l(lock);
@@ -169,13 +189,15 @@ class DispatchQueue {
   void wait();
   void shutdown();
 
-  DispatchQueue(CephContext *cct, SimpleMessenger *msgr)
+  DispatchQueue(CephContext *cct, Messenger *msgr, const string &name)
     : cct(cct), msgr(msgr),
       lock("SimpleMessenger::DispatchQeueu::lock"), 
       mqueue(cct->_conf->ms_pq_max_tokens_per_priority,
 	     cct->_conf->ms_pq_min_cost),
       next_pipe_id(1),
       dispatch_thread(this),
+      dispatch_throttler(cct, string("msgr_dispatch_throttler-") + name,
+			 cct->_conf->ms_dispatch_throttle_bytes),
       stop(false)
     {}
 };
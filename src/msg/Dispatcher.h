@@ -33,6 +33,38 @@ public:
   // how i receive messages
   virtual bool ms_dispatch(Message *m) = 0;
 
+  /**
+   * @defgroup Fast dispatch
+   * @{
+   */
+  /**
+   * Does this Dispatcher want any Message fast dispatched?  Checked
+   * once, when the Dispatcher is added to a Messenger.
+   */
+  virtual bool ms_can_fast_dispatch_any() const { return false; }
+  /**
+   * Should m be fast dispatched?
+   *
+   * Called from the thread that read m off the wire, so it must be
+   * cheap and must not block.
+   */
+  virtual bool ms_can_fast_dispatch(Message *m) const { return false; }
+  /**
+   * Deliver m from the thread that read it off the wire, bypassing the
+   * DispatchQueue and its thread.  Only called for Messages for which
+   * ms_can_fast_dispatch() returned true.
+   *
+   * Messages of one Connection are still delivered in order, but
+   * there is no ordering with respect to the queued messages and
+   * connection events of that Connection.  This runs without any
+   * messenger lock held, but implementations should not block for
+   * long since they hold up reading from the Connection.
+   *
+   * @param m The Message; you are given a reference to it.
+   */
+  virtual void ms_fast_dispatch(Message *m) { assert(0); }
+  /** @} */
+
   /**
    * This function will be called whenever a new Connection is made to the
    * Messenger.
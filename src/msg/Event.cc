@@ -0,0 +1,276 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Event.h"
+
+#include "common/ceph_context.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "include/assert.h"
+
+#define dout_subsys ceph_subsys_ms
+
+#undef dout_prefix
+#define dout_prefix *_dout << "EventCenter "
+
+/**
+ * drains the wakeup pipe; the actual work is picked up from
+ * external_events at the end of every loop iteration
+ */
+class C_handle_notify : public EventCallback {
+public:
+  void do_request(int fd) {
+    char c[256];
+    int r;
+    do {
+      r = ::read(fd, c, sizeof(c));
+    } while (r == (int)sizeof(c));
+  }
+};
+
+EventCenter::~EventCenter()
+{
+  // run nothing that is still queued; the owners are gone
+  for (list<Context*>::iterator p = external_events.begin();
+       p != external_events.end();
+       ++p)
+    delete *p;
+  external_events.clear();
+  for (multimap<utime_t, Context*>::iterator p = time_events.begin();
+       p != time_events.end();
+       ++p)
+    delete p->second;
+  time_events.clear();
+
+  if (notify_receive_fd >= 0)
+    ::close(notify_receive_fd);
+  if (notify_send_fd >= 0)
+    ::close(notify_send_fd);
+  delete notify_handler;
+  if (epfd >= 0)
+    ::close(epfd);
+  delete[] events;
+}
+
+int EventCenter::init(int n)
+{
+  assert(n > 0);
+  nevent = n;
+  events = new struct epoll_event[nevent];
+
+  epfd = ::epoll_create(1024); // size is only a hint
+  if (epfd < 0) {
+    int r = -errno;
+    lderr(cct) << __func__ << " unable to create epoll fd: "
+	       << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  int fds[2];
+  if (::pipe(fds) < 0) {
+    int r = -errno;
+    lderr(cct) << __func__ << " can't create notify pipe: "
+	       << cpp_strerror(r) << dendl;
+    return r;
+  }
+  notify_receive_fd = fds[0];
+  notify_send_fd = fds[1];
+  for (int i = 0; i < 2; i++) {
+    int flags = ::fcntl(fds[i], F_GETFL);
+    if (::fcntl(fds[i], F_SETFL, flags | O_NONBLOCK) < 0) {
+      int r = -errno;
+      lderr(cct) << __func__ << " can't set notify pipe nonblocking: "
+		 << cpp_strerror(r) << dendl;
+      return r;
+    }
+  }
+
+  notify_handler = new C_handle_notify;
+  return create_file_event(notify_receive_fd, EVENT_READABLE, notify_handler);
+}
+
+int EventCenter::create_file_event(int fd, int mask, EventCallback *cb)
+{
+  assert(fd >= 0);
+  FileEvent *event = _get_file_event(fd);
+  int old_mask = event->mask;
+  int new_mask = old_mask | mask;
+
+  if (new_mask != old_mask) {
+    struct epoll_event ee;
+    memset(&ee, 0, sizeof(ee));
+    ee.events = 0;
+    if (new_mask & EVENT_READABLE)
+      ee.events |= EPOLLIN;
+    if (new_mask & EVENT_WRITABLE)
+      ee.events |= EPOLLOUT;
+    ee.data.fd = fd;
+    int op = old_mask == EVENT_NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (::epoll_ctl(epfd, op, fd, &ee) < 0) {
+      int r = -errno;
+      lderr(cct) << __func__ << " epoll_ctl on fd " << fd << " failed: "
+		 << cpp_strerror(r) << dendl;
+      return r;
+    }
+  }
+
+  event->mask = new_mask;
+  if (mask & EVENT_READABLE)
+    event->read_cb = cb;
+  if (mask & EVENT_WRITABLE)
+    event->write_cb = cb;
+  ldout(cct, 20) << __func__ << " fd " << fd << " mask " << mask
+		 << " now " << new_mask << dendl;
+  return 0;
+}
+
+void EventCenter::delete_file_event(int fd, int mask)
+{
+  if (fd < 0 || (int)file_events.size() <= fd)
+    return;
+  FileEvent *event = &file_events[fd];
+  if ((event->mask & mask) == 0)
+    return;
+
+  int new_mask = event->mask & ~mask;
+  struct epoll_event ee;
+  memset(&ee, 0, sizeof(ee));
+  if (new_mask & EVENT_READABLE)
+    ee.events |= EPOLLIN;
+  if (new_mask & EVENT_WRITABLE)
+    ee.events |= EPOLLOUT;
+  ee.data.fd = fd;
+  int op = new_mask == EVENT_NONE ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+  if (::epoll_ctl(epfd, op, fd, &ee) < 0) {
+    ldout(cct, 10) << __func__ << " epoll_ctl on fd " << fd << " failed: "
+		   << cpp_strerror(errno) << dendl;
+  }
+
+  event->mask = new_mask;
+  if (mask & EVENT_READABLE)
+    event->read_cb = NULL;
+  if (mask & EVENT_WRITABLE)
+    event->write_cb = NULL;
+  ldout(cct, 20) << __func__ << " fd " << fd << " mask " << mask
+		 << " now " << new_mask << dendl;
+}
+
+void EventCenter::create_time_event(utime_t when, Context *c)
+{
+  assert(in_thread());
+  time_events.insert(make_pair(when, c));
+}
+
+int EventCenter::process_time_events()
+{
+  int processed = 0;
+  utime_t now = ceph_clock_now(cct);
+  while (!time_events.empty() && time_events.begin()->first <= now) {
+    Context *c = time_events.begin()->second;
+    time_events.erase(time_events.begin());
+    c->complete(0);
+    processed++;
+  }
+  return processed;
+}
+
+void EventCenter::process_external_events()
+{
+  list<Context*> ls;
+  {
+    Mutex::Locker l(external_lock);
+    ls.swap(external_events);
+  }
+  while (!ls.empty()) {
+    Context *c = ls.front();
+    ls.pop_front();
+    c->complete(0);
+  }
+}
+
+int EventCenter::process_events(int timeout_us)
+{
+  int timeout_ms = timeout_us / 1000;
+  {
+    Mutex::Locker l(external_lock);
+    if (!external_events.empty())
+      timeout_ms = 0;
+  }
+  if (timeout_ms && !time_events.empty()) {
+    utime_t now = ceph_clock_now(cct);
+    utime_t next = time_events.begin()->first;
+    if (next <= now) {
+      timeout_ms = 0;
+    } else {
+      next -= now;
+      int next_ms = next.sec() * 1000 + next.usec() / 1000 + 1;
+      if (next_ms < timeout_ms)
+	timeout_ms = next_ms;
+    }
+  }
+
+  int numevents = ::epoll_wait(epfd, events, nevent, timeout_ms);
+  if (numevents < 0) {
+    if (errno == EINTR)
+      numevents = 0;
+    else
+      return -errno;
+  }
+
+  for (int i = 0; i < numevents; i++) {
+    int fd = events[i].data.fd;
+    uint32_t what = events[i].events;
+    FileEvent *event = _get_file_event(fd);
+    // errors and hangups are reported through both callbacks; the
+    // subsequent read or write is where the error surfaces
+    bool rfired = false;
+    if (event->mask & EVENT_READABLE &&
+	what & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+      rfired = true;
+      event->read_cb->do_request(fd);
+    }
+    // the read callback may have deleted or changed the event
+    event = _get_file_event(fd);
+    if (event->mask & EVENT_WRITABLE &&
+	what & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+      if (!rfired || event->read_cb != event->write_cb)
+	event->write_cb->do_request(fd);
+    }
+  }
+
+  numevents += process_time_events();
+  process_external_events();
+  return numevents;
+}
+
+void EventCenter::dispatch_event_external(Context *c)
+{
+  external_lock.Lock();
+  external_events.push_back(c);
+  external_lock.Unlock();
+  if (!in_thread())
+    wakeup();
+}
+
+void EventCenter::wakeup()
+{
+  char buf[1] = { 'c' };
+  int r = ::write(notify_send_fd, buf, 1);
+  if (r < 0 && errno != EAGAIN) {
+    ldout(cct, 1) << __func__ << " write notify pipe failed: "
+		  << cpp_strerror(errno) << dendl;
+  }
+}
@@ -0,0 +1,133 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_EVENT_H
+#define CEPH_MSG_EVENT_H
+
+#include <sys/epoll.h>
+#include <pthread.h>
+
+#include <list>
+#include <map>
+#include <vector>
+using namespace std;
+
+#include "include/Context.h"
+#include "include/utime.h"
+#include "common/Mutex.h"
+
+class CephContext;
+
+#define EVENT_NONE 0
+#define EVENT_READABLE 1
+#define EVENT_WRITABLE 2
+
+/**
+ * A persistent callback fired by the EventCenter when a registered
+ * file descriptor becomes readable or writable.  Unlike a Context it
+ * is not deleted after it runs; the owner of the fd owns the callback
+ * and must delete the file event before destroying it.
+ */
+class EventCallback {
+public:
+  virtual void do_request(int fd) = 0;
+  virtual ~EventCallback() {}
+};
+
+/**
+ * EventCenter
+ *
+ * A small epoll(7) based event loop.  One EventCenter is driven by
+ * exactly one thread (the owner), which is the only thread that may
+ * register or remove file events and timers.  Any thread may hand work
+ * to the owner with dispatch_event_external(), which wakes the loop
+ * through a self-pipe.
+ */
+class EventCenter {
+  struct FileEvent {
+    int mask;
+    EventCallback *read_cb;
+    EventCallback *write_cb;
+    FileEvent() : mask(EVENT_NONE), read_cb(NULL), write_cb(NULL) {}
+  };
+
+  CephContext *cct;
+  int epfd;
+  int nevent;
+  struct epoll_event *events;
+
+  /// fd -> registered interest; indexed by fd, grown on demand
+  vector<FileEvent> file_events;
+
+  /// timers, ordered by expiry; only touched by the owner thread
+  multimap<utime_t, Context*> time_events;
+
+  /// work queued by other threads for the owner thread
+  Mutex external_lock;
+  list<Context*> external_events;
+
+  int notify_receive_fd;
+  int notify_send_fd;
+  EventCallback *notify_handler;
+
+  pthread_t owner;
+
+  FileEvent *_get_file_event(int fd) {
+    if ((int)file_events.size() <= fd)
+      file_events.resize(fd + 1);
+    return &file_events[fd];
+  }
+
+  int process_time_events();
+  void process_external_events();
+
+public:
+  EventCenter(CephContext *c)
+    : cct(c), epfd(-1), nevent(0), events(NULL),
+      external_lock("AsyncMessenger::EventCenter::external_lock"),
+      notify_receive_fd(-1), notify_send_fd(-1), notify_handler(NULL),
+      owner(0) {}
+  ~EventCenter();
+
+  /**
+   * set up the epoll instance and the wakeup pipe
+   *
+   * @param nevent max number of events returned by one epoll_wait
+   * @return 0 on success, -errno on failure
+   */
+  int init(int nevent);
+
+  /// record the calling thread as the one driving this center
+  void set_owner(pthread_t p) { owner = p; }
+  bool in_thread() const { return pthread_equal(pthread_self(), owner); }
+
+  // owner thread only
+  int create_file_event(int fd, int mask, EventCallback *cb);
+  void delete_file_event(int fd, int mask);
+  void create_time_event(utime_t when, Context *c);
+
+  /**
+   * wait for and process events
+   *
+   * @param timeout_us upper bound on how long to block
+   * @return number of events processed, or -errno
+   */
+  int process_events(int timeout_us);
+
+  /// queue a Context to run in the owner thread (any thread)
+  void dispatch_event_external(Context *c);
+
+  /// wake up the owner thread (any thread)
+  void wakeup();
+};
+
+#endif
@@ -236,6 +236,10 @@ void Message::dump(Formatter *f) const
   f->dump_string("summary", ss.str());
 }
 
+// messages decoded or sent for every op come from per thread free lists
+ObjectPool MOSDOp::alloc_pool("MOSDOp", sizeof(MOSDOp));
+ObjectPool MOSDOpReply::alloc_pool("MOSDOpReply", sizeof(MOSDOpReply));
+
 Message *decode_message(CephContext *cct, ceph_msg_header& header, ceph_msg_footer& footer,
 			bufferlist& front, bufferlist& middle, bufferlist& data)
 {
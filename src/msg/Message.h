@@ -106,6 +106,7 @@
 #define MSG_OSD_PG_PUSH        105
 #define MSG_OSD_PG_PULL        106
 #define MSG_OSD_PG_PUSH_REPLY  107
+#define MSG_OSD_PG_SNAPTRIM    108  // local only, never sent
 
 // *** MDS ***
 
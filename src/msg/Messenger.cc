@@ -3,11 +3,20 @@
 #include "Messenger.h"
 
 #include "SimpleMessenger.h"
+#ifdef __linux__
+#include "AsyncMessenger.h"
+#endif
+
+#include "common/config.h"
 
 Messenger *Messenger::create(CephContext *cct,
 			     entity_name_t name,
 			     string lname,
 			     uint64_t nonce)
 {
+#ifdef __linux__
+  if (cct->_conf->ms_type == "async")
+    return new AsyncMessenger(cct, name, lname, nonce);
+#endif
   return new SimpleMessenger(cct, name, lname, nonce);
 }
@@ -39,6 +39,7 @@ class Timer;
 class Messenger {
 private:
   list<Dispatcher*> dispatchers;
+  list<Dispatcher*> fast_dispatchers;
 
 protected:
   /// the "name" of the local daemon. eg client.99
@@ -81,20 +82,33 @@ public:
     uint64_t features_supported;
     /// Specify features any remotes must have to talk to this endpoint.
     uint64_t features_required;
+    /**
+     * If true, compress data payloads of at least ms_compress_min_size
+     * bytes when the remote supports CEPH_FEATURE_MSG_COMPRESS.
+     */
+    bool compress;
+    /**
+     * If true, peers whose address is an rdma one (see
+     * entity_addr_t::TYPE_RDMA) are reached over rdma.  Without it they
+     * cannot be reached at all.
+     */
+    bool rdma;
 
     Policy()
       : lossy(false), server(false), standby(false), resetcheck(true),
 	throttler_bytes(NULL),
 	throttler_messages(NULL),
 	features_supported(CEPH_FEATURES_SUPPORTED_DEFAULT),
-	features_required(0) {}
+	features_required(0),
+	compress(false), rdma(false) {}
   private:
     Policy(bool l, bool s, bool st, bool r, uint64_t sup, uint64_t req)
       : lossy(l), server(s), standby(st), resetcheck(r),
 	throttler_bytes(NULL),
 	throttler_messages(NULL),
 	features_supported(sup | CEPH_FEATURES_SUPPORTED_DEFAULT),
-	features_required(req) {}
+	features_required(req),
+	compress(false), rdma(false) {}
 
   public:
     static Policy stateful_server(uint64_t sup, uint64_t req) {
@@ -301,6 +315,8 @@ public:
   void add_dispatcher_head(Dispatcher *d) { 
     bool first = dispatchers.empty();
     dispatchers.push_front(d);
+    if (d->ms_can_fast_dispatch_any())
+      fast_dispatchers.push_front(d);
     if (first)
       ready();
   }
@@ -314,6 +330,8 @@ public:
   void add_dispatcher_tail(Dispatcher *d) { 
     bool first = dispatchers.empty();
     dispatchers.push_back(d);
+    if (d->ms_can_fast_dispatch_any())
+      fast_dispatchers.push_back(d);
     if (first)
       ready();
   }
@@ -571,6 +589,42 @@ protected:
    * @{
    */
 public:
+  /**
+   * Determine whether a message can be fast-dispatched. We will
+   * query each Dispatcher in sequence to determine if they are
+   * capable of handling a particular message via "fast dispatch".
+   *
+   * @param m The Message we are testing.
+   */
+  bool ms_can_fast_dispatch(Message *m) const {
+    for (list<Dispatcher*>::const_iterator p = fast_dispatchers.begin();
+	 p != fast_dispatchers.end();
+	 ++p) {
+      if ((*p)->ms_can_fast_dispatch(m))
+	return true;
+    }
+    return false;
+  }
+
+  /**
+   * Deliver a single Message via "fast dispatch".
+   *
+   * @param m The Message we are fast dispatching. We take ownership
+   * of one reference to it.
+   * If none of our Dispatchers can handle it, assert(0).
+   */
+  void ms_fast_dispatch(Message *m) {
+    m->set_dispatch_stamp(ceph_clock_now(cct));
+    for (list<Dispatcher*>::iterator p = fast_dispatchers.begin();
+	 p != fast_dispatchers.end();
+	 ++p) {
+      if ((*p)->ms_can_fast_dispatch(m)) {
+	(*p)->ms_fast_dispatch(m);
+	return;
+      }
+    }
+    assert(0);
+  }
   /**
    *  Deliver a single Message. Send it to each Dispatcher
    *  in sequence until one of them handles it.
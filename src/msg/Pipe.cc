@@ -24,6 +24,11 @@
 
 #include "common/debug.h"
 #include "common/errno.h"
+#include "common/mempool.h"
+#include "common/perf_counters.h"
+#include "include/trace.h"
+
+#include <snappy.h>
 
 // Below included to get encode_encrypt(); That probably should be in Crypto.h, instead
 
@@ -59,7 +64,7 @@ Pipe::Pipe(SimpleMessenger *r, int st, Connection *con)
     delay_thread(NULL),
     msgr(r),
     conn_id(r->dispatch_queue.get_id()),
-    sd(-1), port(0),
+    sd(-1), transport(get_tcp_transport()), port(0),
     peer_type(-1),
     pipe_lock("SimpleMessenger::Pipe::pipe_lock"),
     state(st),
@@ -71,7 +76,10 @@ Pipe::Pipe(SimpleMessenger *r, int st, Connection *con)
     keepalive(false),
     close_on_empty(false),
     connect_seq(0), peer_global_seq(0),
-    out_seq(0), in_seq(0), in_seq_acked(0) {
+    out_seq(0), in_seq(0), in_seq_acked(0),
+    recv_buf(NULL), recv_ofs(0), recv_len(0) {
+  recv_max_prefetch = msgr->cct->_conf->ms_tcp_prefetch_max_size;
+  recv_buf = new char[recv_max_prefetch];
   if (con) {
     connection_state = con;
     connection_state->reset_pipe(this);
@@ -96,6 +104,7 @@ Pipe::~Pipe()
   assert(sent.empty());
   delete session_security;
   delete delay_thread;
+  delete[] recv_buf;
 }
 
 void Pipe::handle_ack(uint64_t seq)
@@ -129,10 +138,21 @@ void Pipe::start_reader()
   reader_thread.create(msgr->cct->_conf->ms_rwthread_stack_bytes);
 }
 
+void Pipe::inject_internal_delay()
+{
+  double delay = msgr->pipe_conf.get()->ms_inject_internal_delays;
+  if (delay) {
+    ldout(msgr->cct, 10) << " sleep for " << delay << dendl;
+    utime_t t;
+    t.set_from_double(delay);
+    t.sleep();
+  }
+}
+
 void Pipe::maybe_start_delay_thread()
 {
   if (!delay_thread &&
-      msgr->cct->_conf->ms_inject_delay_type.find(ceph_entity_type_name(connection_state->peer_type)) != string::npos) {
+      msgr->pipe_conf.get()->ms_inject_delay_type.find(ceph_entity_type_name(connection_state->peer_type)) != string::npos) {
     lsubdout(msgr->cct, ms, 1) << "setting up a delay queue on Pipe " << this << dendl;
     delay_thread = new DelayedDelivery(this);
     delay_thread->create();
@@ -257,7 +277,7 @@ int Pipe::accept()
 
   // and peer's socket addr (they might not know their ip)
   len = sizeof(socket_addr.ss_addr());
-  r = ::getpeername(sd, (sockaddr*)&socket_addr.ss_addr(), &len);
+  r = transport->getpeername(sd, (sockaddr*)&socket_addr.ss_addr(), &len);
   if (r < 0) {
     char buf[80];
     ldout(msgr->cct,0) << "accept failed to getpeername " << errno << " " << strerror_r(errno, buf, sizeof(buf)) << dendl;
@@ -587,7 +607,7 @@ int Pipe::accept()
 
     // drop my Connection, and take a ref to the existing one. do not
     // clear existing->connection_state, since read_message and
-    // write_message both dereference it without pipe_lock.
+    // write_batch both dereference it without pipe_lock.
     connection_state = existing->connection_state;
 
     // make existing Connection reference us
@@ -691,12 +711,7 @@ int Pipe::accept()
  fail_registered:
   ldout(msgr->cct, 10) << "accept fault after register" << dendl;
 
-  if (msgr->cct->_conf->ms_inject_internal_delays) {
-    ldout(msgr->cct, 10) << " sleep for " << msgr->cct->_conf->ms_inject_internal_delays << dendl;
-    utime_t t;
-    t.set_from_double(msgr->cct->_conf->ms_inject_internal_delays);
-    t.sleep();
-  }
+  inject_internal_delay();
 
  fail_unlocked:
   pipe_lock.Lock();
@@ -722,12 +737,7 @@ int Pipe::accept()
  shutting_down_msgr_unlocked:
   assert(pipe_lock.is_locked());
 
-  if (msgr->cct->_conf->ms_inject_internal_delays) {
-    ldout(msgr->cct, 10) << " sleep for " << msgr->cct->_conf->ms_inject_internal_delays << dendl;
-    utime_t t;
-    t.set_from_double(msgr->cct->_conf->ms_inject_internal_delays);
-    t.sleep();
-  }
+  inject_internal_delay();
 
   state = STATE_CLOSED;
   state_closed.set(1);
@@ -740,7 +750,7 @@ void Pipe::set_socket_options()
   // disable Nagle algorithm?
   if (msgr->cct->_conf->ms_tcp_nodelay) {
     int flag = 1;
-    int r = ::setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
+    int r = transport->setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
     if (r < 0) {
       r = -errno;
       ldout(msgr->cct,0) << "couldn't set TCP_NODELAY: " << cpp_strerror(r) << dendl;
@@ -748,7 +758,7 @@ void Pipe::set_socket_options()
   }
   if (msgr->cct->_conf->ms_tcp_rcvbuf) {
     int size = msgr->cct->_conf->ms_tcp_rcvbuf;
-    int r = ::setsockopt(sd, SOL_SOCKET, SO_RCVBUF, (void*)&size, sizeof(size));
+    int r = transport->setsockopt(sd, SOL_SOCKET, SO_RCVBUF, (void*)&size, sizeof(size));
     if (r < 0)  {
       r = -errno;
       ldout(msgr->cct,0) << "couldn't set SO_RCVBUF to " << size << ": " << cpp_strerror(r) << dendl;
@@ -781,24 +791,44 @@ int Pipe::connect()
   entity_addr_t peer_addr_for_me, socket_addr;
   AuthAuthorizer *authorizer = NULL;
   bufferlist addrbl, myaddrbl;
-  const md_config_t *conf = msgr->cct->_conf;
 
   // close old socket.  this is safe because we stopped the reader thread above.
-  if (sd >= 0)
-    ::close(sd);
+  if (sd >= 0) {
+    transport->close(sd);
+    sd = -1;
+  }
+  recv_reset();
 
   char buf[80];
 
+  // the peer's address says how it can be reached, our policy whether
+  // we may go that way
+  if (peer_addr.is_rdma()) {
+    transport = policy.rdma ? get_rdma_transport() : NULL;
+    if (!transport) {
+      lderr(msgr->cct) << "connect " << peer_addr << " only takes rdma, and "
+		       << (policy.rdma ? "this build has no rdma support"
+			   : "the policy for its type does not allow rdma")
+		       << dendl;
+      transport = get_tcp_transport();
+      goto fail;
+    }
+  } else {
+    transport = get_tcp_transport();
+  }
+
   // create socket?
-  sd = ::socket(peer_addr.get_family(), SOCK_STREAM, 0);
+  sd = transport->socket(peer_addr.get_family(), SOCK_STREAM, 0);
   if (sd < 0) {
     lderr(msgr->cct) << "connect couldn't created socket " << strerror_r(errno, buf, sizeof(buf)) << dendl;
     goto fail;
   }
+  transport->init_socket(msgr->cct, sd);
 
   // connect!
-  ldout(msgr->cct,10) << "connecting to " << peer_addr << dendl;
-  rc = ::connect(sd, (sockaddr*)&peer_addr.addr, peer_addr.addr_size());
+  ldout(msgr->cct,10) << "connecting to " << peer_addr << " over "
+		      << transport->get_name() << dendl;
+  rc = transport->connect(sd, (sockaddr*)&peer_addr.addr, peer_addr.addr_size());
   if (rc < 0) {
     ldout(msgr->cct,2) << "connect error " << peer_addr
 	     << ", " << errno << ": " << strerror_r(errno, buf, sizeof(buf)) << dendl;
@@ -955,12 +985,7 @@ int Pipe::connect()
       }
     }
 
-    if (conf->ms_inject_internal_delays) {
-      ldout(msgr->cct, 10) << " sleep for " << msgr->cct->_conf->ms_inject_internal_delays << dendl;
-      utime_t t;
-      t.set_from_double(msgr->cct->_conf->ms_inject_internal_delays);
-      t.sleep();
-    }
+    inject_internal_delay();
 
     pipe_lock.Lock();
     if (state != STATE_CONNECTING) {
@@ -1094,12 +1119,7 @@ int Pipe::connect()
   }
 
  fail:
-  if (conf->ms_inject_internal_delays) {
-    ldout(msgr->cct, 10) << " sleep for " << msgr->cct->_conf->ms_inject_internal_delays << dendl;
-    utime_t t;
-    t.set_from_double(msgr->cct->_conf->ms_inject_internal_delays);
-    t.sleep();
-  }
+  inject_internal_delay();
 
   pipe_lock.Lock();
  fail_locked:
@@ -1120,7 +1140,9 @@ void Pipe::register_pipe()
   assert(msgr->lock.is_locked());
   Pipe *existing = msgr->_lookup_pipe(peer_addr);
   assert(existing == NULL);
+  msgr->rank_pipe_get_write();
   msgr->rank_pipe[peer_addr] = this;
+  msgr->rank_pipe_put_write();
 }
 
 void Pipe::unregister_pipe()
@@ -1129,7 +1151,9 @@ void Pipe::unregister_pipe()
   hash_map<entity_addr_t,Pipe*>::iterator p = msgr->rank_pipe.find(peer_addr);
   if (p != msgr->rank_pipe.end() && p->second == this) {
     ldout(msgr->cct,10) << "unregister_pipe" << dendl;
+    msgr->rank_pipe_get_write();
     msgr->rank_pipe.erase(p);
+    msgr->rank_pipe_put_write();
   } else {
     ldout(msgr->cct,10) << "unregister_pipe - not registered" << dendl;
     msgr->accepting_pipes.erase(this);  // somewhat overkill, but safe.
@@ -1241,12 +1265,7 @@ void Pipe::fault(bool onread)
     // rank_pipe entry is ignored by others.
     pipe_lock.Unlock();
 
-    if (conf->ms_inject_internal_delays) {
-      ldout(msgr->cct, 10) << " sleep for " << msgr->cct->_conf->ms_inject_internal_delays << dendl;
-      utime_t t;
-      t.set_from_double(msgr->cct->_conf->ms_inject_internal_delays);
-      t.sleep();
-    }
+    inject_internal_delay();
 
     msgr->lock.Lock();
     pipe_lock.Lock();
@@ -1406,10 +1425,18 @@ void Pipe::reader()
       continue;
     }
 
-    else if (tag == CEPH_MSGR_TAG_MSG) {
+    else if (tag == CEPH_MSGR_TAG_MSG ||
+	     tag == CEPH_MSGR_TAG_MSG_COMPRESSED) {
       ldout(msgr->cct,20) << "reader got MSG" << dendl;
       Message *m = 0;
-      int r = read_message(&m);
+      int r = -1;
+      if (tag == CEPH_MSGR_TAG_MSG) {
+	r = read_message(&m);
+      } else {
+	ceph_le32 clen;
+	if (tcp_read((char*)&clen, sizeof(clen)) >= 0)
+	  r = read_message(&m, clen);
+      }
 
       pipe_lock.Lock();
       
@@ -1438,7 +1465,7 @@ void Pipe::reader()
 	msgr->dispatch_throttle_release(m->get_dispatch_throttle_size());
 	m->put();
 	if (connection_state->has_feature(CEPH_FEATURE_RECONNECT_SEQ) &&
-	    msgr->cct->_conf->ms_die_on_old_message)
+	    msgr->pipe_conf.get()->ms_die_on_old_message)
 	  assert(0 == "old msgs despite reconnect_seq feature");
 	continue;
       }
@@ -1456,12 +1483,19 @@ void Pipe::reader()
 
       if (delay_thread) {
 	utime_t release;
-	if (rand() % 10000 < msgr->cct->_conf->ms_inject_delay_probability * 10000.0) {
+	PipeConfRef pc = msgr->pipe_conf.get();
+	if (rand() % 10000 < pc->ms_inject_delay_probability * 10000.0) {
 	  release = m->get_recv_stamp();
-	  release += msgr->cct->_conf->ms_inject_delay_max * (double)(rand() % 10000) / 10000.0;
+	  release += pc->ms_inject_delay_max * (double)(rand() % 10000) / 10000.0;
 	  lsubdout(msgr->cct, ms, 1) << "queue_received will delay until " << release << " on " << m << " " << *m << dendl;
 	}
 	delay_thread->queue(release, m);
+      } else if (in_q->can_fast_dispatch(m)) {
+	// deliver from this thread; the dispatcher may well send on
+	// this connection, so don't hold pipe_lock across it
+	pipe_lock.Unlock();
+	in_q->fast_dispatch(m);
+	pipe_lock.Lock();
       } else {
 	in_q->enqueue(m, m->get_priority(), conn_id);
       }
@@ -1527,7 +1561,7 @@ void Pipe::writer()
       state_closed.set(1);
       pipe_lock.Unlock();
       if (sd) {
-	int r = ::write(sd, &tag, 1);
+	int r = transport->send(sd, &tag, 1, MSG_NOSIGNAL);
 	// we can ignore r, actually; we don't care if this succeeds.
 	r++; r = 0; // placate gcc
       }
@@ -1538,94 +1572,63 @@ void Pipe::writer()
     if (state != STATE_CONNECTING && state != STATE_WAIT && state != STATE_STANDBY &&
 	(is_queued() || in_seq > in_seq_acked)) {
 
-      // keepalive?
-      if (keepalive) {
-	pipe_lock.Unlock();
-	int rc = write_keepalive();
-	pipe_lock.Lock();
-	if (rc < 0) {
-	  ldout(msgr->cct,2) << "writer couldn't write keepalive, " << strerror_r(errno, buf, sizeof(buf)) << dendl;
-	  fault();
- 	  continue;
-	}
-	keepalive = false;
+      // coalesce the keepalive, the ack and as many queued messages as
+      // fit in the batch budget into a single stream of iovecs
+      bufferlist bl;
+      list<Message*> batch;
+      bool send_keepalive = keepalive;
+      uint64_t send_seq = in_seq_acked;
+
+      if (send_keepalive) {
+	ldout(msgr->cct,10) << "writer queueing keepalive" << dendl;
+	char tag = CEPH_MSGR_TAG_KEEPALIVE;
+	bl.append(&tag, 1);
       }
 
-      // send ack?
       if (in_seq > in_seq_acked) {
-	uint64_t send_seq = in_seq;
-	pipe_lock.Unlock();
-	int rc = write_ack(send_seq);
-	pipe_lock.Lock();
-	if (rc < 0) {
-	  ldout(msgr->cct,2) << "writer couldn't write ack, " << strerror_r(errno, buf, sizeof(buf)) << dendl;
-	  fault();
- 	  continue;
-	}
-	in_seq_acked = send_seq;
+	send_seq = in_seq;
+	ldout(msgr->cct,10) << "writer queueing ack " << send_seq << dendl;
+	char tag = CEPH_MSGR_TAG_ACK;
+	ceph_le64 s;
+	s = send_seq;
+	bl.append(&tag, 1);
+	bl.append((char*)&s, sizeof(s));
       }
 
-      // grab outgoing message
-      Message *m = _get_next_outgoing();
-      if (m) {
-	m->set_seq(++out_seq);
-	if (!policy.lossy || close_on_empty) {
-	  // put on sent list
-	  sent.push_back(m); 
-	  m->get();
-	}
-
-	// associate message with Connection (for benefit of encode_payload)
-	m->set_connection(connection_state.get());
-
-	uint64_t features = connection_state->get_features();
-	if (m->empty_payload())
-	  ldout(msgr->cct,20) << "writer encoding " << m->get_seq() << " features " << features
-			      << " " << m << " " << *m << dendl;
-	else
-	  ldout(msgr->cct,20) << "writer half-reencoding " << m->get_seq() << " features " << features
-			      << " " << m << " " << *m << dendl;
-
-	// encode and copy out of *m
-	m->encode(features, !msgr->cct->_conf->ms_nocrc);
-
-	// prepare everything
-	ceph_msg_header& header = m->get_header();
-	ceph_msg_footer& footer = m->get_footer();
-
-	// Now that we have all the crcs calculated, handle the
-	// digital signature for the message, if the pipe has session
-	// security set up.  Some session security options do not
-	// actually calculate and check the signature, but they should
-	// handle the calls to sign_message and check_signature.  PLR
-	if (session_security == NULL) {
-	  ldout(msgr->cct, 20) << "writer no session security" << dendl;
-	} else {
-	  if (session_security->sign_message(m)) {
-	    ldout(msgr->cct, 20) << "writer failed to sign seq # " << header.seq
-				 << "): sig = " << footer.sig << dendl;
-	  } else {
-	    ldout(msgr->cct, 20) << "writer signed seq # " << header.seq
-				 << "): sig = " << footer.sig << dendl;
-	  }
-	}
-
-	bufferlist blist = m->get_payload();
-	blist.append(m->get_middle());
-	blist.append(m->get_data());
-
-	pipe_lock.Unlock();
+      PipeConfRef pc = msgr->pipe_conf.get();
+      uint64_t max_bytes = pc->ms_max_send_batch_bytes;
+      uint64_t max_iov = pc->ms_max_send_batch_iov;
+      while (batch.empty() ||
+	     (bl.length() < max_bytes && bl.buffers().size() < max_iov)) {
+	Message *m = _get_next_outgoing();
+	if (!m)
+	  break;
+	prepare_message(m, bl);
+	batch.push_back(m);
+      }
 
-        ldout(msgr->cct,20) << "writer sending " << m->get_seq() << " " << m << dendl;
-	int rc = write_message(header, footer, blist);
+      pipe_lock.Unlock();
+      ldout(msgr->cct,20) << "writer sending " << batch.size() << " messages, "
+			  << bl.length() << " bytes in " << bl.buffers().size()
+			  << " buffers" << dendl;
+      int rc = write_batch(bl);
+      pipe_lock.Lock();
 
-	pipe_lock.Lock();
-	if (rc < 0) {
-          ldout(msgr->cct,1) << "writer error sending " << m << ", "
-		  << errno << ": " << strerror_r(errno, buf, sizeof(buf)) << dendl;
-	  fault();
-        }
-	m->put();
+      if (rc < 0) {
+	ldout(msgr->cct,1) << "writer error sending " << batch.size() << " messages, "
+			   << errno << ": " << strerror_r(errno, buf, sizeof(buf)) << dendl;
+	fault();
+      } else {
+	msgr->logger->inc(l_msgr_send_batch_msgs, batch.size());
+	msgr->logger->inc(l_msgr_send_batch_bytes, bl.length());
+	if (send_keepalive)
+	  keepalive = false;
+	if (send_seq > in_seq_acked)
+	  in_seq_acked = send_seq;
+      }
+      while (!batch.empty()) {
+	batch.front()->put();
+	batch.pop_front();
       }
       continue;
     }
@@ -1684,7 +1687,7 @@ static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
   }
 }
 
-int Pipe::read_message(Message **pm)
+int Pipe::read_message(Message **pm, unsigned compressed_len)
 {
   int ret = -1;
   // envelope
@@ -1751,9 +1754,9 @@ int Pipe::read_message(Message **pm)
     // blocks indefinitely, which it shouldn't).  in contrast, the
     // policy throttle carries for the lifetime of the message.
     ldout(msgr->cct,10) << "reader wants " << message_size << " from dispatch throttler "
-	     << msgr->dispatch_throttler.get_current() << "/"
-	     << msgr->dispatch_throttler.get_max() << dendl;
-    msgr->dispatch_throttler.get(message_size);
+	     << msgr->dispatch_queue.dispatch_throttler.get_current() << "/"
+	     << msgr->dispatch_queue.dispatch_throttler.get_max() << dendl;
+    msgr->dispatch_queue.dispatch_throttler.get(message_size);
   }
 
   utime_t throttle_stamp = ceph_clock_now(msgr->cct);
@@ -1782,7 +1785,35 @@ int Pipe::read_message(Message **pm)
   // read data
   data_len = le32_to_cpu(header.data_len);
   data_off = le32_to_cpu(header.data_off);
-  if (data_len) {
+  if (compressed_len) {
+    // rx_buffers are not used for compressed data
+    bufferptr cbp = buffer::create(compressed_len);
+    if (tcp_read(cbp.c_str(), compressed_len) < 0)
+      goto out_dethrottle;
+    size_t raw_len = 0;
+    if (!snappy::GetUncompressedLength(cbp.c_str(), compressed_len, &raw_len) ||
+	raw_len != data_len) {
+      ldout(msgr->cct,0) << "reader got compressed data of " << raw_len
+			 << " bytes, header says " << data_len << dendl;
+      goto out_dethrottle;
+    }
+    bufferptr raw = buffer::create_page_aligned(data_len);
+    if (!snappy::RawUncompress(cbp.c_str(), compressed_len, raw.c_str())) {
+      ldout(msgr->cct,0) << "reader failed to decompress " << compressed_len
+			 << " bytes of data" << dendl;
+      goto out_dethrottle;
+    }
+    if (data_off & ~CEPH_PAGE_MASK) {
+      // keep the data aligned as it will be on disk
+      alloc_aligned_buffer(data, data_len, data_off);
+      data.copy_in(0, data_len, raw.c_str());
+    } else {
+      data.push_back(raw);
+    }
+    msgr->logger->inc(l_msgr_decompress_bytes, compressed_len);
+    ldout(msgr->cct,20) << "reader got compressed data " << compressed_len
+			<< " -> " << data_len << dendl;
+  } else if (data_len) {
     unsigned offset = 0;
     unsigned left = data_len;
 
@@ -1805,10 +1836,12 @@ int Pipe::read_message(Message **pm)
 		   << " len " << p->second.first.length() << dendl;
 	  rxbuf = p->second.first;
 	  rxbuf_version = p->second.second;
-	  // make sure it's big enough
+	  // make sure it's big enough, keeping the rest of the data aligned
+	  // as it will be on disk
 	  if (rxbuf.length() < data_len)
-	    rxbuf.push_back(buffer::create(data_len - rxbuf.length()));
-	  blp = p->second.first.begin();
+	    alloc_aligned_buffer(rxbuf, data_len - rxbuf.length(),
+				 data_off + rxbuf.length());
+	  blp = rxbuf.begin();
 	  blp.advance(offset);
 	}
       } else {
@@ -1862,11 +1895,16 @@ int Pipe::read_message(Message **pm)
 
   ldout(msgr->cct,20) << "reader got " << front.length() << " + " << middle.length() << " + " << data.length()
 	   << " byte message" << dendl;
+  front.reassign_to_mempool(mempool::mempool_buffer_msg);
+  middle.reassign_to_mempool(mempool::mempool_buffer_msg);
+  data.reassign_to_mempool(mempool::mempool_buffer_msg);
   message = decode_message(msgr->cct, header, footer, front, middle, data);
   if (!message) {
     ret = -EINVAL;
     goto out_dethrottle;
   }
+  CEPH_TRACE4(pipe_read_message, header.type, header.src.num, header.tid,
+	      front.length() + middle.length() + data.length());
 
   //
   //  Check the signature if one should be present.  A zero return indicates success. PLR
@@ -1929,7 +1967,8 @@ int Pipe::do_sendmsg(struct msghdr *msg, int len, bool more)
       assert(l == len);
     }
 
-    int r = ::sendmsg(sd, msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+    int r = transport->sendmsg(sd, msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+    msgr->logger->inc(l_msgr_sendmsg);
     if (r == 0) 
       ldout(msgr->cct,10) << "do_sendmsg hmm do_sendmsg got r==0!" << dendl;
     if (r < 0) { 
@@ -1967,75 +2006,91 @@ int Pipe::do_sendmsg(struct msghdr *msg, int len, bool more)
 }
 
 
-int Pipe::write_ack(uint64_t seq)
+void Pipe::prepare_message(Message *m, bufferlist& bl)
 {
-  ldout(msgr->cct,10) << "write_ack " << seq << dendl;
+  assert(pipe_lock.is_locked());
 
-  char c = CEPH_MSGR_TAG_ACK;
-  ceph_le64 s;
-  s = seq;
+  m->set_seq(++out_seq);
+  if (!policy.lossy || close_on_empty) {
+    // put on sent list
+    sent.push_back(m);
+    m->get();
+  }
 
-  struct msghdr msg;
-  memset(&msg, 0, sizeof(msg));
-  struct iovec msgvec[2];
-  msgvec[0].iov_base = &c;
-  msgvec[0].iov_len = 1;
-  msgvec[1].iov_base = &s;
-  msgvec[1].iov_len = sizeof(s);
-  msg.msg_iov = msgvec;
-  msg.msg_iovlen = 2;
-  
-  if (do_sendmsg(&msg, 1 + sizeof(s), true) < 0)
-    return -1;	
-  return 0;
-}
+  // associate message with Connection (for benefit of encode_payload)
+  m->set_connection(connection_state.get());
 
-int Pipe::write_keepalive()
-{
-  ldout(msgr->cct,10) << "write_keepalive" << dendl;
+  uint64_t features = connection_state->get_features();
+  if (m->empty_payload())
+    ldout(msgr->cct,20) << "writer encoding " << m->get_seq() << " features " << features
+			<< " " << m << " " << *m << dendl;
+  else
+    ldout(msgr->cct,20) << "writer half-reencoding " << m->get_seq() << " features " << features
+			<< " " << m << " " << *m << dendl;
 
-  char c = CEPH_MSGR_TAG_KEEPALIVE;
+  // encode and copy out of *m
+  m->encode(features, !msgr->pipe_conf.get()->ms_nocrc);
 
-  struct msghdr msg;
-  memset(&msg, 0, sizeof(msg));
-  struct iovec msgvec[2];
-  msgvec[0].iov_base = &c;
-  msgvec[0].iov_len = 1;
-  msg.msg_iov = msgvec;
-  msg.msg_iovlen = 1;
-  
-  if (do_sendmsg(&msg, 1) < 0)
-    return -1;	
-  return 0;
-}
+  // prepare everything
+  ceph_msg_header& header = m->get_header();
+  ceph_msg_footer& footer = m->get_footer();
 
+  // Now that we have all the crcs calculated, handle the
+  // digital signature for the message, if the pipe has session
+  // security set up.  Some session security options do not
+  // actually calculate and check the signature, but they should
+  // handle the calls to sign_message and check_signature.  PLR
+  if (session_security == NULL) {
+    ldout(msgr->cct, 20) << "writer no session security" << dendl;
+  } else {
+    if (session_security->sign_message(m)) {
+      ldout(msgr->cct, 20) << "writer failed to sign seq # " << header.seq
+			   << "): sig = " << footer.sig << dendl;
+    } else {
+      ldout(msgr->cct, 20) << "writer signed seq # " << header.seq
+			   << "): sig = " << footer.sig << dendl;
+    }
+  }
 
-int Pipe::write_message(ceph_msg_header& header, ceph_msg_footer& footer, bufferlist& blist)
-{
-  int ret;
+  // compress the data payload if the policy asks for it and it pays off
+  bufferlist compressed;
+  if (policy.compress &&
+      connection_state->has_feature(CEPH_FEATURE_MSG_COMPRESS) &&
+      m->get_data().length() >= msgr->pipe_conf.get()->ms_compress_min_size) {
+    bufferlist raw = m->get_data();  // rebuild a copy, not the message
+    size_t len = snappy::MaxCompressedLength(raw.length());
+    bufferptr bp = buffer::create(len);
+    snappy::RawCompress(raw.c_str(), raw.length(), bp.c_str(), &len);
+    msgr->logger->inc(l_msgr_compress_in_bytes, raw.length());
+    if (len < raw.length()) {
+      bp.set_length(len);
+      compressed.push_back(bp);
+      msgr->logger->inc(l_msgr_compress_out_bytes, len);
+      ldout(msgr->cct,20) << "writer compressed data " << raw.length()
+			  << " -> " << len << dendl;
+    } else {
+      msgr->logger->inc(l_msgr_compress_out_bytes, raw.length());
+      msgr->logger->inc(l_msgr_compress_skipped);
+    }
+  }
 
-  // set up msghdr and iovecs
-  struct msghdr msg;
-  memset(&msg, 0, sizeof(msg));
-  struct iovec *msgvec = new iovec[3 + blist.buffers().size()];  // conservative upper bound
-  msg.msg_iov = msgvec;
-  int msglen = 0;
-  
-  // send tag
-  char tag = CEPH_MSGR_TAG_MSG;
-  msgvec[msg.msg_iovlen].iov_base = &tag;
-  msgvec[msg.msg_iovlen].iov_len = 1;
-  msglen++;
-  msg.msg_iovlen++;
-
-  // send envelope
-  ceph_msg_header_old oldheader;
+  // tag
+  if (compressed.length()) {
+    char tag = CEPH_MSGR_TAG_MSG_COMPRESSED;
+    ceph_le32 clen;
+    clen = compressed.length();
+    bl.append(&tag, 1);
+    bl.append((char*)&clen, sizeof(clen));
+  } else {
+    char tag = CEPH_MSGR_TAG_MSG;
+    bl.append(&tag, 1);
+  }
+
+  // envelope
   if (connection_state->has_feature(CEPH_FEATURE_NOSRCADDR)) {
-    msgvec[msg.msg_iovlen].iov_base = (char*)&header;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(header);
-    msglen += sizeof(header);
-    msg.msg_iovlen++;
+    bl.append((char*)&header, sizeof(header));
   } else {
+    ceph_msg_header_old oldheader;
     memcpy(&oldheader, &header, sizeof(header));
     oldheader.src.name = header.src;
     oldheader.src.addr = connection_state->get_peer_addr();
@@ -2043,94 +2098,71 @@ int Pipe::write_message(ceph_msg_header& header, ceph_msg_footer& footer, buffer
     oldheader.reserved = header.reserved;
     oldheader.crc = ceph_crc32c(0, (unsigned char*)&oldheader,
 				sizeof(oldheader) - sizeof(oldheader.crc));
-    msgvec[msg.msg_iovlen].iov_base = (char*)&oldheader;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(oldheader);
-    msglen += sizeof(oldheader);
-    msg.msg_iovlen++;
+    bl.append((char*)&oldheader, sizeof(oldheader));
   }
 
-  // payload (front+data)
-  list<bufferptr>::const_iterator pb = blist.buffers().begin();
-  int b_off = 0;  // carry-over buffer offset, if any
-  int bl_pos = 0; // blist pos
-  int left = blist.length();
+  // payload (front+middle+data), by reference
+  bl.append(m->get_payload());
+  bl.append(m->get_middle());
+  if (compressed.length())
+    bl.claim_append(compressed);
+  else
+    bl.append(m->get_data());
 
-  while (left > 0) {
-    int donow = MIN(left, (int)pb->length()-b_off);
-    if (donow == 0) {
-      ldout(msgr->cct,0) << "donow = " << donow << " left " << left << " pb->length " << pb->length()
-	      << " b_off " << b_off << dendl;
-    }
-    assert(donow > 0);
-    ldout(msgr->cct,30) << " bl_pos " << bl_pos << " b_off " << b_off
-	     << " leftinchunk " << left
-	     << " buffer len " << pb->length()
-	     << " writing " << donow 
-	     << dendl;
-    
-    if (msg.msg_iovlen >= IOV_MAX-2) {
-      if (do_sendmsg(&msg, msglen, true))
-	goto fail;
-      
-      // and restart the iov
+  // footer; if receiver doesn't support signatures, use the old footer format
+  if (connection_state->has_feature(CEPH_FEATURE_MSG_AUTH)) {
+    bl.append((char*)&footer, sizeof(footer));
+  } else {
+    ceph_msg_footer_old old_footer;
+    old_footer.front_crc = footer.front_crc;
+    old_footer.middle_crc = footer.middle_crc;
+    old_footer.data_crc = footer.data_crc;
+    old_footer.flags = footer.flags;
+    bl.append((char*)&old_footer, sizeof(old_footer));
+  }
+}
+
+int Pipe::write_batch(bufferlist& bl)
+{
+  unsigned max_iov = MIN((unsigned)IOV_MAX, (unsigned)bl.buffers().size());
+  struct iovec *msgvec = new iovec[max_iov];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = msgvec;
+  int msglen = 0;
+  int left = bl.length();
+  int ret = 0;
+
+  for (list<bufferptr>::const_iterator pb = bl.buffers().begin();
+       pb != bl.buffers().end();
+       ++pb) {
+    if (pb->length() == 0)
+      continue;
+    if (msg.msg_iovlen == max_iov) {
+      // full; more is still to come
+      if (do_sendmsg(&msg, msglen, true)) {
+	ret = -1;
+	break;
+      }
       msg.msg_iov = msgvec;
       msg.msg_iovlen = 0;
       msglen = 0;
     }
-    
-    msgvec[msg.msg_iovlen].iov_base = (void*)(pb->c_str()+b_off);
-    msgvec[msg.msg_iovlen].iov_len = donow;
-    msglen += donow;
+    msgvec[msg.msg_iovlen].iov_base = (void*)pb->c_str();
+    msgvec[msg.msg_iovlen].iov_len = pb->length();
+    msglen += pb->length();
+    left -= pb->length();
     msg.msg_iovlen++;
-    
-    left -= donow;
-    assert(left >= 0);
-    b_off += donow;
-    bl_pos += donow;
-    if (left == 0)
-      break;
-    while (b_off == (int)pb->length()) {
-      ++pb;
-      b_off = 0;
-    }
   }
-  assert(left == 0);
+  assert(ret < 0 || left == 0);
 
-  // send footer; if receiver doesn't support signatures, use the old footer format
+  if (ret == 0 && msglen > 0 && do_sendmsg(&msg, msglen))
+    ret = -1;
 
-  ceph_msg_footer_old old_footer;
-  if (connection_state->has_feature(CEPH_FEATURE_MSG_AUTH)) {
-    msgvec[msg.msg_iovlen].iov_base = (void*)&footer;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(footer);
-    msglen += sizeof(footer);
-    msg.msg_iovlen++;
-  } else {
-    old_footer.front_crc = footer.front_crc;   
-    old_footer.middle_crc = footer.middle_crc;   
-    old_footer.data_crc = footer.data_crc;   
-    old_footer.flags = footer.flags;   
-    msgvec[msg.msg_iovlen].iov_base = (char*)&old_footer;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(old_footer);
-    msglen += sizeof(old_footer);
-    msg.msg_iovlen++;
-  }
-
-  // send
-  if (do_sendmsg(&msg, msglen))
-    goto fail;
-
-  ret = 0;
-
- out:
   delete[] msgvec;
   return ret;
-
- fail:
-  ret = -1;
-  goto out;
 }
 
-
 int Pipe::tcp_read(char *buf, int len)
 {
   if (sd < 0)
@@ -2138,10 +2170,11 @@ int Pipe::tcp_read(char *buf, int len)
 
   while (len > 0) {
 
-    if (msgr->cct->_conf->ms_inject_socket_failures && sd >= 0) {
-      if (rand() % msgr->cct->_conf->ms_inject_socket_failures == 0) {
+    uint64_t inject = msgr->pipe_conf.get()->ms_inject_socket_failures;
+    if (inject && sd >= 0) {
+      if (rand() % inject == 0) {
 	ldout(msgr->cct, 0) << "injecting socket failure" << dendl;
-	::shutdown(sd, SHUT_RDWR);
+	transport->shutdown(sd, SHUT_RDWR);
       }
     }
 
@@ -2164,6 +2197,8 @@ int Pipe::tcp_read_wait()
 {
   if (sd < 0)
     return -1;
+  if (has_pending_data())
+    return 0;
   struct pollfd pfd;
   short evmask;
   pfd.fd = sd;
@@ -2172,7 +2207,7 @@ int Pipe::tcp_read_wait()
   pfd.events |= POLLRDHUP;
 #endif
 
-  if (poll(&pfd, 1, msgr->timeout) <= 0)
+  if (transport->poll(&pfd, 1, msgr->timeout) <= 0)
     return -1;
 
   evmask = POLLERR | POLLHUP | POLLNVAL;
@@ -2188,18 +2223,18 @@ int Pipe::tcp_read_wait()
   return 0;
 }
 
-int Pipe::tcp_read_nonblocking(char *buf, int len)
+int Pipe::do_recv(char *buf, unsigned len)
 {
 again:
-  int got = ::recv( sd, buf, len, MSG_DONTWAIT );
+  int got = transport->recv(sd, buf, len, MSG_DONTWAIT);
   if (got < 0) {
-    if (errno == EAGAIN || errno == EINTR) {
+    if (errno == EINTR)
       goto again;
-    } else {
-      ldout(msgr->cct, 10) << "tcp_read_nonblocking socket " << sd << " returned "
-		     << got << " errno " << errno << " " << cpp_strerror(errno) << dendl;
-      return -1;
-    }
+    if (errno == EAGAIN)
+      return 0;
+    ldout(msgr->cct, 10) << "do_recv socket " << sd << " returned "
+			 << got << " errno " << errno << " " << cpp_strerror(errno) << dendl;
+    return -1;
   } else if (got == 0) {
     /* poll() said there was data, but we didn't read any - peer
      * sent a FIN.  Maybe POLLRDHUP signals this, but this is
@@ -2210,6 +2245,44 @@ again:
   return got;
 }
 
+int Pipe::tcp_read_nonblocking(char *buf, int len)
+{
+  int total = 0;
+
+  // drain the prefetch buffer first
+  if (has_pending_data()) {
+    unsigned n = MIN(recv_len - recv_ofs, (unsigned)len);
+    memcpy(buf, recv_buf + recv_ofs, n);
+    recv_ofs += n;
+    if ((int)n == len)
+      return n;
+    buf += n;
+    len -= n;
+    total = n;
+  }
+
+again:
+  int got;
+  if ((unsigned)len >= recv_max_prefetch) {
+    // big reads (i.e., the data payload) go straight into the
+    // caller's (page aligned) buffer
+    got = do_recv(buf, len);
+  } else {
+    got = do_recv(recv_buf, recv_max_prefetch);
+    if (got > 0) {
+      recv_len = got;
+      recv_ofs = MIN(got, len);
+      memcpy(buf, recv_buf, recv_ofs);
+      got = recv_ofs;
+    }
+  }
+  if (got < 0)
+    return total ? total : -1;
+  if (got == 0 && total == 0)
+    goto again;  // poll() said there was something to read
+  return total + got;
+}
+
 int Pipe::tcp_write(const char *buf, int len)
 {
   if (sd < 0)
@@ -2221,14 +2294,15 @@ int Pipe::tcp_write(const char *buf, int len)
   pfd.events |= POLLRDHUP;
 #endif
 
-  if (msgr->cct->_conf->ms_inject_socket_failures && sd >= 0) {
-    if (rand() % msgr->cct->_conf->ms_inject_socket_failures == 0) {
+  uint64_t inject = msgr->pipe_conf.get()->ms_inject_socket_failures;
+  if (inject && sd >= 0) {
+    if (rand() % inject == 0) {
       ldout(msgr->cct, 0) << "injecting socket failure" << dendl;
-      ::shutdown(sd, SHUT_RDWR);
+      transport->shutdown(sd, SHUT_RDWR);
     }
   }
 
-  if (poll(&pfd, 1, -1) < 0)
+  if (transport->poll(&pfd, 1, -1) < 0)
     return -1;
 
   if (!(pfd.revents & POLLOUT))
@@ -2237,7 +2311,7 @@ int Pipe::tcp_write(const char *buf, int len)
   //lgeneric_dout(cct, DBL) << "tcp_write writing " << len << dendl;
   assert(len > 0);
   while (len > 0) {
-    int did = ::send( sd, buf, len, MSG_NOSIGNAL );
+    int did = transport->send(sd, buf, len, MSG_NOSIGNAL);
     if (did < 0) {
       //lgeneric_dout(cct, 1) << "tcp_write error did = " << did << "  errno " << errno << " " << strerror(errno) << dendl;
       //lgeneric_derr(cct, 1) << "tcp_write error did = " << did << "  errno " << errno << " " << strerror(errno) << dendl;
@@ -17,6 +17,7 @@
 
 #include "msg_types.h"
 #include "Messenger.h"
+#include "Transport.h"
 #include "auth/AuthSessionHandler.h"
 
 
@@ -135,6 +136,7 @@ class DispatchQueue;
     }
 
     int sd;
+    Transport *transport;  ///< what sd belongs to
     int port;
     int peer_type;
     entity_addr_t peer_addr;
@@ -168,6 +170,16 @@ class DispatchQueue;
     __u32 connect_seq, peer_global_seq;
     uint64_t out_seq;
     uint64_t in_seq, in_seq_acked;
+
+    /// read-ahead for the small reads (tags, headers, front); reads of
+    /// at least recv_max_prefetch bytes bypass it and land in place
+    char *recv_buf;
+    unsigned recv_max_prefetch;
+    unsigned recv_ofs, recv_len;
+    bool has_pending_data() const { return recv_len > recv_ofs; }
+    void recv_reset() {
+      recv_ofs = recv_len = 0;
+    }
     
     void set_socket_options();
 
@@ -179,8 +191,26 @@ class DispatchQueue;
 
     int randomize_out_seq();
 
-    int read_message(Message **pm);
-    int write_message(ceph_msg_header& h, ceph_msg_footer& f, bufferlist& body);
+    /**
+     * Read a message following its tag.
+     *
+     * @param compressed_len if non-zero, the data payload arrives snappy
+     *                       compressed in this many bytes
+     */
+    int read_message(Message **pm, unsigned compressed_len=0);
+    /**
+     * Assign the next out_seq to m, encode and sign it, and append its
+     * tag, envelope, payload and footer to bl.  Needs pipe_lock; the
+     * message payload is referenced, not copied.
+     */
+    void prepare_message(Message *m, bufferlist& bl);
+    /**
+     * Write out everything in bl, IOV_MAX buffers per sendmsg.  Called
+     * without pipe_lock.
+     *
+     * @return 0, or -1 on failure (unrecoverable -- close the socket).
+     */
+    int write_batch(bufferlist& bl);
     /**
      * Write the given data (of length len) to the Pipe's socket. This function
      * will loop until all passed data has been written out.
@@ -193,8 +223,6 @@ class DispatchQueue;
      * @return 0, or -1 on failure (unrecoverable -- close the socket).
      */
     int do_sendmsg(struct msghdr *msg, int len, bool more=false);
-    int write_ack(uint64_t s);
-    int write_keepalive();
 
     void fault(bool reader=false);
 
@@ -202,6 +230,8 @@ class DispatchQueue;
 
     /* Clean up sent list */
     void handle_ack(uint64_t seq);
+    /// sleep for ms_inject_internal_delays, if set
+    void inject_internal_delay();
 
     public:
     Pipe(const Pipe& other);
@@ -270,7 +300,7 @@ class DispatchQueue;
 
     void shutdown_socket() {
       if (sd >= 0)
-        ::shutdown(sd, SHUT_RDWR);
+        transport->shutdown(sd, SHUT_RDWR);
     }
 
     /**
@@ -283,7 +313,8 @@ class DispatchQueue;
     int tcp_read(char *buf, int len);
 
     /**
-     * wait for bytes to become available on the socket
+     * wait for bytes to become available on the socket (or in the
+     * prefetch buffer)
      *
      * @return 0 for success, or -1 on error
      */
@@ -293,13 +324,17 @@ class DispatchQueue;
      * non-blocking read of available bytes on socket
      *
      * This is expected to be used after tcp_read_wait(), and will return
-     * an error if there is no data on the socket to consume.
+     * an error if there is no data on the socket to consume.  Short
+     * reads are served from (and refill) the prefetch buffer; long ones
+     * are received directly into buf.
      *
      * @param buf buffer to read into
      * @param len maximum number of bytes to read
      * @return bytes read, or -1 on error or when there is no data
      */
     int tcp_read_nonblocking(char *buf, int len);
+    /// @return bytes received, 0 if none are available, -1 on error or EOF
+    int do_recv(char *buf, unsigned len);
 
     /**
      * blocking write of bytes to socket
@@ -22,6 +22,7 @@
 #include "common/config.h"
 #include "common/Timer.h"
 #include "common/errno.h"
+#include "common/perf_counters.h"
 #include "auth/Crypto.h"
 
 #define dout_subsys ceph_subsys_ms
@@ -40,7 +41,9 @@ SimpleMessenger::SimpleMessenger(CephContext *cct, entity_name_t name,
 				 string mname, uint64_t _nonce)
   : Messenger(cct, name),
     accepter(this, _nonce),
-    dispatch_queue(cct, this),
+    dispatch_queue(cct, this, mname),
+    logger(NULL),
+    pipe_conf(cct->_conf),
     reaper_thread(this),
     my_type(name.type()),
     nonce(_nonce),
@@ -48,13 +51,24 @@ SimpleMessenger::SimpleMessenger(CephContext *cct, entity_name_t name,
     global_seq(0),
     cluster_protocol(0),
     policy_lock("SimpleMessenger::policy_lock"),
-    dispatch_throttler(cct, string("msgr_dispatch_throttler-") + mname, cct->_conf->ms_dispatch_throttle_bytes),
     reaper_started(false), reaper_stop(false),
     timeout(0),
     local_connection(new Connection(this))
 {
   pthread_spin_init(&global_seq_lock, PTHREAD_PROCESS_PRIVATE);
   init_local_connection();
+
+  PerfCountersBuilder b(cct, string("msgr-") + mname, l_msgr_first, l_msgr_last);
+  b.add_u64_avg(l_msgr_send_batch_msgs, "send_batch_msgs");
+  b.add_u64_avg(l_msgr_send_batch_bytes, "send_batch_bytes");
+  b.add_u64_counter(l_msgr_sendmsg, "sendmsg");
+  b.add_u64_counter(l_msgr_compress_in_bytes, "compress_in_bytes");
+  b.add_u64_counter(l_msgr_compress_out_bytes, "compress_out_bytes");
+  b.add_u64_counter(l_msgr_compress_skipped, "compress_skipped");
+  b.add_u64_counter(l_msgr_decompress_bytes, "decompress_bytes");
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+  cct->_conf->add_observer(this);
 }
 
 /**
@@ -66,6 +80,47 @@ SimpleMessenger::~SimpleMessenger()
   assert(!did_bind); // either we didn't bind or we shut down the Accepter
   assert(rank_pipe.empty()); // we don't have any running Pipes.
   assert(reaper_stop && !reaper_started); // the reaper thread is stopped
+  cct->_conf->remove_observer(this);
+  cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+}
+
+PipeConf::PipeConf(const md_config_t *conf)
+  : ms_inject_socket_failures(conf->ms_inject_socket_failures),
+    ms_inject_internal_delays(conf->ms_inject_internal_delays),
+    ms_inject_delay_type(conf->ms_inject_delay_type),
+    ms_inject_delay_max(conf->ms_inject_delay_max),
+    ms_inject_delay_probability(conf->ms_inject_delay_probability),
+    ms_die_on_old_message(conf->ms_die_on_old_message),
+    ms_max_send_batch_bytes(conf->ms_max_send_batch_bytes),
+    ms_max_send_batch_iov(conf->ms_max_send_batch_iov),
+    ms_nocrc(conf->ms_nocrc),
+    ms_compress_min_size(conf->ms_compress_min_size)
+{
+}
+
+const char** SimpleMessenger::get_tracked_conf_keys() const
+{
+  static const char* KEYS[] = {
+    "ms_inject_socket_failures",
+    "ms_inject_internal_delays",
+    "ms_inject_delay_type",
+    "ms_inject_delay_max",
+    "ms_inject_delay_probability",
+    "ms_die_on_old_message",
+    "ms_max_send_batch_bytes",
+    "ms_max_send_batch_iov",
+    "ms_nocrc",
+    "ms_compress_min_size",
+    NULL
+  };
+  return KEYS;
+}
+
+void SimpleMessenger::handle_conf_change(const struct md_config_t *conf,
+					 const std::set <std::string> &changed)
+{
+  pipe_conf.update(conf);
 }
 
 void SimpleMessenger::ready()
@@ -109,8 +164,17 @@ int SimpleMessenger::_send_message(Message *m, const entity_inst_t& dest,
     return -EINVAL;
   }
 
+  // the common case: an open pipe, found without taking lock
+  Pipe *pipe = _lookup_pipe_shared(dest.addr);
+  if (pipe) {
+    bool sent = _send_on_pipe(m, pipe);
+    pipe->put();
+    if (sent)
+      return 0;
+  }
+
   lock.Lock();
-  Pipe *pipe = _lookup_pipe(dest.addr);
+  pipe = _lookup_pipe(dest.addr);
   submit_message(m, (pipe ? pipe->connection_state.get() : NULL),
                  dest.addr, dest.name.type(), lazy);
   lock.Unlock();
@@ -130,12 +194,60 @@ int SimpleMessenger::_send_message(Message *m, Connection *con, bool lazy)
       << " " << m << " con " << con
       << dendl;
 
+  // an open pipe needs no lookup, and so no lock
+  Pipe *pipe = NULL;
+  if (con->try_get_pipe((RefCountedObject**)&pipe) && pipe) {
+    bool sent = _send_on_pipe(m, pipe);
+    pipe->put();
+    if (sent)
+      return 0;
+  }
+
   lock.Lock();
   submit_message(m, con, con->get_peer_addr(), con->get_peer_type(), lazy);
   lock.Unlock();
   return 0;
 }
 
+static __thread int t_rank_pipe_shard = -1;
+
+void SimpleMessenger::rank_pipe_get_write()
+{
+  assert(lock.is_locked());
+  for (unsigned i = 0; i < RANK_PIPE_SHARDS; ++i)
+    rank_pipe_shards[i].lock.get_write();
+}
+
+void SimpleMessenger::rank_pipe_put_write()
+{
+  for (unsigned i = RANK_PIPE_SHARDS; i > 0; --i)
+    rank_pipe_shards[i - 1].lock.put_write();
+}
+
+Pipe *SimpleMessenger::_lookup_pipe_shared(const entity_addr_t& k)
+{
+  // shards are per thread, not per messenger; any spread will do
+  if (t_rank_pipe_shard < 0)
+    t_rank_pipe_shard = rank_pipe_shard_next.inc() % RANK_PIPE_SHARDS;
+
+  RWLock::RLocker l(rank_pipe_shards[t_rank_pipe_shard].lock);
+  hash_map<entity_addr_t, Pipe*>::iterator p = rank_pipe.find(k);
+  if (p == rank_pipe.end() || p->second->state_closed.read())
+    return NULL;
+  return static_cast<Pipe*>(p->second->get());
+}
+
+bool SimpleMessenger::_send_on_pipe(Message *m, Pipe *pipe)
+{
+  Mutex::Locker l(pipe->pipe_lock);
+  if (pipe->state == Pipe::STATE_CLOSED)
+    return false;
+  ldout(cct,20) << "submit_message " << *m << " remote, " << pipe->peer_addr
+		<< ", have pipe." << dendl;
+  pipe->_send(m);
+  return true;
+}
+
 /**
  * If my_inst.addr doesn't have an IP set, this function
  * will fill it in from the passed addr. Otherwise it does nothing and returns.
@@ -188,12 +300,7 @@ int SimpleMessenger::get_proto_version(int peer_type, bool connect)
 
 void SimpleMessenger::dispatch_throttle_release(uint64_t msize)
 {
-  if (msize) {
-    ldout(cct,10) << "dispatch_throttle_release " << msize << " to dispatch throttler "
-	    << dispatch_throttler.get_current() << "/"
-	    << dispatch_throttler.get_max() << dendl;
-    dispatch_throttler.put(msize);
-  }
+  dispatch_queue.dispatch_throttle_release(msize);
 }
 
 void SimpleMessenger::reaper_entry()
@@ -235,7 +342,7 @@ void SimpleMessenger::reaper()
     pipes.erase(p);
     p->join();
     if (p->sd >= 0)
-      ::close(p->sd);
+      p->transport->close(p->sd);
     ldout(cct,10) << "reaper reaped pipe " << p << " " << p->get_peer_addr() << dendl;
     p->put();
     ldout(cct,10) << "reaper deleted pipe " << p << dendl;
@@ -303,11 +410,12 @@ int SimpleMessenger::start()
   return 0;
 }
 
-Pipe *SimpleMessenger::add_accept_pipe(int sd)
+Pipe *SimpleMessenger::add_accept_pipe(int sd, Transport *transport)
 {
   lock.Lock();
   Pipe *p = new Pipe(this, Pipe::STATE_ACCEPTING, NULL);
   p->sd = sd;
+  p->transport = transport;
   p->pipe_lock.Lock();
   p->start_reader();
   p->pipe_lock.Unlock();
@@ -365,6 +473,21 @@ bool SimpleMessenger::verify_authorizer(Connection *con, int peer_type,
 
 ConnectionRef SimpleMessenger::get_connection(const entity_inst_t& dest)
 {
+  // an open pipe to dest?  (there is none to ourselves)
+  Pipe *pipe = _lookup_pipe_shared(dest.addr);
+  if (pipe) {
+    ConnectionRef con;
+    pipe->pipe_lock.Lock();
+    if (pipe->state != Pipe::STATE_CLOSED)
+      con = pipe->connection_state;
+    pipe->pipe_lock.Unlock();
+    pipe->put();
+    if (con) {
+      ldout(cct, 10) << "get_connection " << dest << " existing " << pipe << dendl;
+      return con;
+    }
+  }
+
   Mutex::Locker l(lock);
   if (my_inst.addr == dest.addr) {
     // local
@@ -373,7 +496,7 @@ ConnectionRef SimpleMessenger::get_connection(const entity_inst_t& dest)
 
   // remote
   while (true) {
-    Pipe *pipe = _lookup_pipe(dest.addr);
+    pipe = _lookup_pipe(dest.addr);
     if (pipe) {
       ldout(cct, 10) << "get_connection " << dest << " existing " << pipe << dendl;
     } else {
@@ -577,7 +700,9 @@ void SimpleMessenger::mark_down_all()
     hash_map<entity_addr_t,Pipe*>::iterator it = rank_pipe.begin();
     Pipe *p = it->second;
     ldout(cct,5) << "mark_down_all " << it->first << " " << p << dendl;
+    rank_pipe_get_write();
     rank_pipe.erase(it);
+    rank_pipe_put_write();
     p->unregister_pipe();
     p->pipe_lock.Lock();
     p->stop();
@@ -26,10 +26,13 @@ using namespace std;
 using namespace __gnu_cxx;
 
 #include "common/Mutex.h"
+#include "common/RWLock.h"
 #include "include/atomic.h"
 #include "common/Cond.h"
 #include "common/Thread.h"
 #include "common/Throttle.h"
+#include "common/config_obs.h"
+#include "common/config_snapshot.h"
 
 #include "Messenger.h"
 #include "Message.h"
@@ -39,6 +42,20 @@ using namespace __gnu_cxx;
 #include "Pipe.h"
 #include "Accepter.h"
 
+class PerfCounters;
+
+enum {
+  l_msgr_first = 94000,
+  l_msgr_send_batch_msgs,     // messages per writer sendmsg batch
+  l_msgr_send_batch_bytes,    // bytes per writer sendmsg batch
+  l_msgr_sendmsg,             // sendmsg(2) calls issued by writers
+  l_msgr_compress_in_bytes,   // data payload bytes fed to the compressor
+  l_msgr_compress_out_bytes,  // ... and what they compressed to
+  l_msgr_compress_skipped,    // payloads sent raw because they didn't shrink
+  l_msgr_decompress_bytes,    // compressed data payload bytes received
+  l_msgr_last,
+};
+
 /*
  * This class handles transmission and reception of messages. Generally
  * speaking, there are several major components:
@@ -67,9 +84,35 @@ using namespace __gnu_cxx;
  *       Pipe::pipe_lock
  *           DispatchQueue::lock
  *               IncomingQueue::lock
+ *
+ *   SimpleMessenger::lock
+ *       SimpleMessenger::rank_pipe_shards (nothing is taken under them)
  */
 
-class SimpleMessenger : public Messenger {
+/**
+ * the ms_* options a Pipe reads while it runs
+ *
+ * Kept in a ConfigSnapshot so the reader and writer threads never look
+ * at md_config_t while injectargs is changing it.
+ */
+struct PipeConf {
+  uint64_t ms_inject_socket_failures;
+  double ms_inject_internal_delays;
+  string ms_inject_delay_type;
+  double ms_inject_delay_max;
+  double ms_inject_delay_probability;
+  bool ms_die_on_old_message;
+  uint64_t ms_max_send_batch_bytes;
+  uint64_t ms_max_send_batch_iov;
+  bool ms_nocrc;
+  uint64_t ms_compress_min_size;
+
+  PipeConf(const md_config_t *conf);
+};
+typedef ConfigSnapshot<PipeConf>::Ref PipeConfRef;
+
+class SimpleMessenger : public Messenger,
+			public md_config_obs_t {
   // First we have the public Messenger interface implementation...
 public:
   /**
@@ -202,6 +245,13 @@ private:
 public:
   Accepter accepter;
   DispatchQueue dispatch_queue;
+  PerfCounters *logger;
+  /// what the Pipes read instead of cct->_conf
+  ConfigSnapshot<PipeConf> pipe_conf;
+
+  virtual const char** get_tracked_conf_keys() const;
+  virtual void handle_conf_change(const struct md_config_t *conf,
+				  const std::set <std::string> &changed);
 
   friend class Accepter;
 
@@ -209,8 +259,9 @@ public:
    * Register a new pipe for accept
    *
    * @param sd socket
+   * @param transport what sd belongs to
    */
-  Pipe *add_accept_pipe(int sd);
+  Pipe *add_accept_pipe(int sd, Transport *transport);
 
 private:
 
@@ -317,6 +368,28 @@ private:
    * invalid and can be replaced by anyone holding the msgr lock
    */
   hash_map<entity_addr_t, Pipe*> rank_pipe;
+
+  /**
+   * read locks on rank_pipe for threads that don't hold lock
+   *
+   * Sending on an open pipe only needs to find it.  A sender takes the
+   * shard of its own thread for read, and whoever changes rank_pipe
+   * holds lock and takes every shard for write.  So senders share no
+   * lock with each other, and anyone holding lock may read rank_pipe
+   * without the shards, as before.
+   */
+  struct RankPipeShard {
+    RWLock lock;
+    char pad[64];  // keep the shards on separate cache lines
+    RankPipeShard() : lock("SimpleMessenger::rank_pipe_shard") {}
+  };
+  static const unsigned RANK_PIPE_SHARDS = 16;
+  RankPipeShard rank_pipe_shards[RANK_PIPE_SHARDS];
+  atomic_t rank_pipe_shard_next;  ///< hands threads their shard
+
+  /// take every rank_pipe shard for write, to change rank_pipe
+  void rank_pipe_get_write();
+  void rank_pipe_put_write();
   /**
    * list of pipes are in teh process of accepting
    *
@@ -338,9 +411,6 @@ private:
   /// map specifying different Policies for specific peer types
   map<int, Policy> policy_map; // entity_name_t::type -> Policy
 
-  /// Throttle preventing us from building up a big backlog waiting for dispatch
-  Throttle dispatch_throttler;
-
   bool reaper_started, reaper_stop;
   Cond reaper_cond;
 
@@ -359,6 +429,23 @@ private:
     return p->second;
   }
 
+  /**
+   * look up the open pipe to an addr without lock
+   *
+   * @return the pipe with a reference for the caller, or NULL
+   */
+  Pipe *_lookup_pipe_shared(const entity_addr_t& k);
+
+  /**
+   * queue m on pipe, unless pipe has closed meanwhile
+   *
+   * Needs neither lock nor the rank_pipe shards, only a reference to
+   * pipe.  On success m is consumed.
+   *
+   * @return true if m was queued
+   */
+  bool _send_on_pipe(Message *m, Pipe *pipe);
+
 public:
 
   int timeout;
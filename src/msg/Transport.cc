@@ -0,0 +1,181 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "acconfig.h"
+#include "msg/Transport.h"
+#include "common/config.h"
+#include "common/debug.h"
+#include "common/errno.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef HAVE_RSOCKET
+# include <rdma/rsocket.h>
+#endif
+
+#define dout_subsys ceph_subsys_ms
+
+class TCPTransport : public Transport {
+public:
+  const char *get_name() const { return "tcp"; }
+
+  int socket(int domain, int type, int protocol) {
+    return ::socket(domain, type, protocol);
+  }
+  void init_socket(CephContext *cct, int sd) {}
+  int bind(int sd, const struct sockaddr *addr, socklen_t len) {
+    return ::bind(sd, addr, len);
+  }
+  int listen(int sd, int backlog) {
+    return ::listen(sd, backlog);
+  }
+  int accept(int sd, struct sockaddr *addr, socklen_t *len) {
+    return ::accept(sd, addr, len);
+  }
+  int connect(int sd, const struct sockaddr *addr, socklen_t len) {
+    return ::connect(sd, addr, len);
+  }
+  int shutdown(int sd, int how) {
+    return ::shutdown(sd, how);
+  }
+  int close(int sd) {
+    return ::close(sd);
+  }
+  int setsockopt(int sd, int level, int name, const void *val, socklen_t len) {
+    return ::setsockopt(sd, level, name, val, len);
+  }
+  int getsockname(int sd, struct sockaddr *addr, socklen_t *len) {
+    return ::getsockname(sd, addr, len);
+  }
+  int getpeername(int sd, struct sockaddr *addr, socklen_t *len) {
+    return ::getpeername(sd, addr, len);
+  }
+  ssize_t recv(int sd, void *buf, size_t len, int flags) {
+    return ::recv(sd, buf, len, flags);
+  }
+  ssize_t send(int sd, const void *buf, size_t len, int flags) {
+    return ::send(sd, buf, len, flags);
+  }
+  ssize_t sendmsg(int sd, const struct msghdr *msg, int flags) {
+    return ::sendmsg(sd, msg, flags);
+  }
+  int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    return ::poll(fds, nfds, timeout);
+  }
+};
+
+Transport *get_tcp_transport()
+{
+  static TCPTransport tcp;
+  return &tcp;
+}
+
+#ifdef HAVE_RSOCKET
+
+/*
+ * rsockets keep a ring of registered memory per connection in each
+ * direction and move data with RDMA writes into the peer's ring, so
+ * there is no kernel stack on the data path and no per message
+ * registration.  The ring and queue sizes can only be set before the
+ * socket connects or listens (accepted sockets take the listener's).
+ */
+class RDMATransport : public Transport {
+  // rsockets never raise SIGPIPE and do not know MSG_MORE
+  static int send_flags(int flags) {
+    return flags & MSG_DONTWAIT;
+  }
+
+public:
+  const char *get_name() const { return "rdma"; }
+
+  int socket(int domain, int type, int protocol) {
+    return ::rsocket(domain, type, protocol);
+  }
+  void init_socket(CephContext *cct, int sd) {
+    const md_config_t *conf = cct->_conf;
+    if (conf->ms_rdma_buffer_size) {
+      int size = conf->ms_rdma_buffer_size;
+      if (::rsetsockopt(sd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) < 0 ||
+	  ::rsetsockopt(sd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0)
+	ldout(cct, 0) << "couldn't set rdma buffer size to " << size << ": "
+		      << cpp_strerror(errno) << dendl;
+    }
+    if (conf->ms_rdma_queue_size) {
+      uint32_t size = conf->ms_rdma_queue_size;
+      if (::rsetsockopt(sd, SOL_RDMA, RDMA_SQSIZE, &size, sizeof(size)) < 0 ||
+	  ::rsetsockopt(sd, SOL_RDMA, RDMA_RQSIZE, &size, sizeof(size)) < 0)
+	ldout(cct, 0) << "couldn't set rdma queue size to " << size << ": "
+		      << cpp_strerror(errno) << dendl;
+    }
+    if (conf->ms_rdma_inline_size) {
+      uint32_t size = conf->ms_rdma_inline_size;
+      if (::rsetsockopt(sd, SOL_RDMA, RDMA_INLINE, &size, sizeof(size)) < 0)
+	ldout(cct, 0) << "couldn't set rdma inline size to " << size << ": "
+		      << cpp_strerror(errno) << dendl;
+    }
+  }
+  int bind(int sd, const struct sockaddr *addr, socklen_t len) {
+    return ::rbind(sd, addr, len);
+  }
+  int listen(int sd, int backlog) {
+    return ::rlisten(sd, backlog);
+  }
+  int accept(int sd, struct sockaddr *addr, socklen_t *len) {
+    return ::raccept(sd, addr, len);
+  }
+  int connect(int sd, const struct sockaddr *addr, socklen_t len) {
+    return ::rconnect(sd, addr, len);
+  }
+  int shutdown(int sd, int how) {
+    return ::rshutdown(sd, how);
+  }
+  int close(int sd) {
+    return ::rclose(sd);
+  }
+  int setsockopt(int sd, int level, int name, const void *val, socklen_t len) {
+    return ::rsetsockopt(sd, level, name, val, len);
+  }
+  int getsockname(int sd, struct sockaddr *addr, socklen_t *len) {
+    return ::rgetsockname(sd, addr, len);
+  }
+  int getpeername(int sd, struct sockaddr *addr, socklen_t *len) {
+    return ::rgetpeername(sd, addr, len);
+  }
+  ssize_t recv(int sd, void *buf, size_t len, int flags) {
+    return ::rrecv(sd, buf, len, flags);
+  }
+  ssize_t send(int sd, const void *buf, size_t len, int flags) {
+    return ::rsend(sd, buf, len, send_flags(flags));
+  }
+  ssize_t sendmsg(int sd, const struct msghdr *msg, int flags) {
+    return ::rsendmsg(sd, msg, send_flags(flags));
+  }
+  int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    return ::rpoll(fds, nfds, timeout);
+  }
+};
+
+Transport *get_rdma_transport()
+{
+  static RDMATransport rdma;
+  return &rdma;
+}
+
+#else
+
+Transport *get_rdma_transport()
+{
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,61 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_TRANSPORT_H
+#define CEPH_MSG_TRANSPORT_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+
+class CephContext;
+
+/**
+ * The socket calls of the SimpleMessenger
+ *
+ * Pipes and the Accepter go through one of these for everything they
+ * do with a socket, so that some connections can run over something
+ * other than kernel TCP.  A descriptor only means something to the
+ * transport that handed it out.
+ */
+class Transport {
+public:
+  virtual ~Transport() {}
+
+  virtual const char *get_name() const = 0;
+
+  virtual int socket(int domain, int type, int protocol) = 0;
+  /// options that have to be set before a socket connects or listens
+  virtual void init_socket(CephContext *cct, int sd) = 0;
+  virtual int bind(int sd, const struct sockaddr *addr, socklen_t len) = 0;
+  virtual int listen(int sd, int backlog) = 0;
+  virtual int accept(int sd, struct sockaddr *addr, socklen_t *len) = 0;
+  virtual int connect(int sd, const struct sockaddr *addr, socklen_t len) = 0;
+  virtual int shutdown(int sd, int how) = 0;
+  virtual int close(int sd) = 0;
+  virtual int setsockopt(int sd, int level, int name,
+			 const void *val, socklen_t len) = 0;
+  virtual int getsockname(int sd, struct sockaddr *addr, socklen_t *len) = 0;
+  virtual int getpeername(int sd, struct sockaddr *addr, socklen_t *len) = 0;
+  virtual ssize_t recv(int sd, void *buf, size_t len, int flags) = 0;
+  virtual ssize_t send(int sd, const void *buf, size_t len, int flags) = 0;
+  virtual ssize_t sendmsg(int sd, const struct msghdr *msg, int flags) = 0;
+  virtual int poll(struct pollfd *fds, nfds_t nfds, int timeout) = 0;
+};
+
+/// the kernel's sockets
+extern Transport *get_tcp_transport();
+
+/// rsockets over RDMA verbs, or NULL if not built with --with-rdma
+extern Transport *get_rdma_transport();
+
+#endif
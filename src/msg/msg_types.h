@@ -176,6 +176,12 @@ static inline void decode(sockaddr_storage& a, bufferlist::iterator& bl) {
 }
 
 struct entity_addr_t {
+  /// how the address can be reached; only the messenger looks at this
+  enum {
+    TYPE_DEFAULT = 0,
+    TYPE_RDMA = 1,	///< rsockets, for osds on the cluster network
+  };
+
   __u32 type;
   __u32 nonce;
   union {
@@ -208,6 +214,8 @@ struct entity_addr_t {
 #endif
   }
 
+  bool is_rdma() const { return type == TYPE_RDMA; }
+
   __u32 get_nonce() const { return nonce; }
   void set_nonce(__u32 n) { nonce = n; }
 
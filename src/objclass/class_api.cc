@@ -430,6 +430,38 @@ int cls_cxx_map_get_vals(cls_method_context_t hctx, const string &start_obj,
   return vals->size();
 }
 
+int cls_cxx_map_get_vals(cls_method_context_t hctx, const string &start_obj,
+			 const string &filter_prefix, uint64_t max_to_get,
+			 uint64_t max_bytes, map<string, bufferlist> *vals,
+			 bool *more)
+{
+  ReplicatedPG::OpContext **pctx = (ReplicatedPG::OpContext **)hctx;
+  vector<OSDOp> ops(1);
+  OSDOp& op = ops[0];
+  int ret;
+
+  assert(max_bytes > 0);
+  ::encode(start_obj, op.indata);
+  ::encode(max_to_get, op.indata);
+  ::encode(filter_prefix, op.indata);
+  ::encode(max_bytes, op.indata);
+
+  op.op.op = CEPH_OSD_OP_OMAPGETVALS;
+
+  ret = (*pctx)->pg->do_osd_ops(*pctx, ops);
+  if (ret < 0)
+    return ret;
+
+  bufferlist::iterator iter = op.outdata.begin();
+  try {
+    ::decode(*vals, iter);
+    ::decode(*more, iter);
+  } catch (buffer::error& err) {
+    return -EIO;
+  }
+  return vals->size();
+}
+
 int cls_cxx_map_read_header(cls_method_context_t hctx, bufferlist *outbl)
 {
   ReplicatedPG::OpContext **pctx = (ReplicatedPG::OpContext **)hctx;
@@ -548,6 +580,102 @@ int cls_cxx_map_remove_key(cls_method_context_t hctx, const string &key)
   return (*pctx)->pg->do_osd_ops(*pctx, ops);
 }
 
+int cls_cxx_map_remove_keys(cls_method_context_t hctx, const set<string> &keys)
+{
+  ReplicatedPG::OpContext **pctx = (ReplicatedPG::OpContext **)hctx;
+  vector<OSDOp> ops(1);
+  OSDOp& op = ops[0];
+
+  if (keys.empty())
+    return 0;
+
+  ::encode(keys, op.indata);
+
+  op.op.op = CEPH_OSD_OP_OMAPRMKEYS;
+
+  return (*pctx)->pg->do_osd_ops(*pctx, ops);
+}
+
+int cls_cxx_map_remove_range(cls_method_context_t hctx,
+			     const string &key_begin, const string &key_end)
+{
+  ReplicatedPG::OpContext **pctx = (ReplicatedPG::OpContext **)hctx;
+  vector<OSDOp> ops(1);
+  OSDOp& op = ops[0];
+
+  ::encode(key_begin, op.indata);
+  ::encode(key_end, op.indata);
+
+  op.op.op = CEPH_OSD_OP_OMAPRMKEYRANGE;
+
+  return (*pctx)->pg->do_osd_ops(*pctx, ops);
+}
+
+int cls_cxx_map_get_vals_by_keys(cls_method_context_t hctx, const set<string> &keys,
+				 map<string, bufferlist> *vals)
+{
+  ReplicatedPG::OpContext **pctx = (ReplicatedPG::OpContext **)hctx;
+  vector<OSDOp> ops(1);
+  OSDOp& op = ops[0];
+  int ret;
+
+  vals->clear();
+  if (keys.empty())
+    return 0;
+
+  ::encode(keys, op.indata);
+
+  op.op.op = CEPH_OSD_OP_OMAPGETVALSBYKEYS;
+
+  ret = (*pctx)->pg->do_osd_ops(*pctx, ops);
+  if (ret < 0)
+    return ret;
+
+  bufferlist::iterator iter = op.outdata.begin();
+  try {
+    ::decode(*vals, iter);
+  } catch (buffer::error& err) {
+    return -EIO;
+  }
+  return vals->size();
+}
+
+cls_map_iterator::cls_map_iterator(cls_method_context_t hctx,
+				   const string &filter_prefix,
+				   uint64_t max_batch)
+  : hctx(hctx), filter_prefix(filter_prefix),
+    max_batch(max_batch ? max_batch : 1), more(false), r(0)
+{
+  cur = vals.end();
+}
+
+int cls_map_iterator::fetch(const string &start_after)
+{
+  vals.clear();
+  more = false;
+  int ret = cls_cxx_map_get_vals(hctx, start_after, filter_prefix, max_batch,
+				 (uint64_t)-1, &vals, &more);
+  cur = vals.begin();
+  r = ret < 0 ? ret : 0;
+  return r;
+}
+
+int cls_map_iterator::seek(const string &start_after)
+{
+  return fetch(start_after);
+}
+
+int cls_map_iterator::next()
+{
+  if (!valid())
+    return r;
+  string last = cur->first;
+  ++cur;
+  if (cur == vals.end() && more)
+    return fetch(last);
+  return 0;
+}
+
 int cls_gen_random_bytes(char *buf, int size)
 {
   return get_random_bytes(buf, size);
@@ -122,6 +122,17 @@ extern int cls_cxx_map_get_vals(cls_method_context_t hctx,
                                 const string &filter_prefix,
                                 uint64_t max_to_get,
                                 std::map<string, bufferlist> *vals);
+/**
+ * like cls_cxx_map_get_vals, but stop once the returned keys and
+ * values reach max_bytes; *more says whether matching keys remain
+ */
+extern int cls_cxx_map_get_vals(cls_method_context_t hctx,
+                                const string &start_after,
+                                const string &filter_prefix,
+                                uint64_t max_to_get,
+                                uint64_t max_bytes,
+                                std::map<string, bufferlist> *vals,
+                                bool *more);
 extern int cls_cxx_map_read_header(cls_method_context_t hctx, bufferlist *outbl);
 extern int cls_cxx_map_get_val(cls_method_context_t hctx,
                                const string &key, bufferlist *outbl);
@@ -131,8 +142,72 @@ extern int cls_cxx_map_set_vals(cls_method_context_t hctx,
                                 const std::map<string, bufferlist> *map);
 extern int cls_cxx_map_write_header(cls_method_context_t hctx, bufferlist *inbl);
 extern int cls_cxx_map_remove_key(cls_method_context_t hctx, const string &key);
+/**
+ * remove the keys in [key_begin, key_end) with a single op, however
+ * many there are
+ */
+extern int cls_cxx_map_remove_range(cls_method_context_t hctx,
+                                    const string &key_begin,
+                                    const string &key_end);
+/// remove all of keys in one go; keys that are not there are ignored
+extern int cls_cxx_map_remove_keys(cls_method_context_t hctx,
+                                   const std::set<string> &keys);
+/**
+ * read the values of several keys in one go; keys that are not there
+ * are left out of *vals rather than failing the call
+ */
+extern int cls_cxx_map_get_vals_by_keys(cls_method_context_t hctx,
+                                        const std::set<string> &keys,
+                                        std::map<string, bufferlist> *vals);
 extern int cls_cxx_map_update(cls_method_context_t hctx, bufferlist *inbl);
 
+/**
+ * walk the omap of the object in key order
+ *
+ * Values are read in batches of up to max_batch keys, each with a
+ * single internal op, so a class can scan a large omap without one op
+ * per key nor holding it all in memory.
+ *
+ *   cls_map_iterator it(hctx, prefix);
+ *   for (it.seek(start_after); it.valid(); it.next()) {
+ *     ... it.key(), it.value() ...
+ *   }
+ *   if (it.status() < 0) ...
+ */
+class cls_map_iterator {
+  cls_method_context_t hctx;
+  string filter_prefix;
+  uint64_t max_batch;
+  std::map<string, bufferlist> vals;
+  std::map<string, bufferlist>::iterator cur;
+  bool more;
+  int r;
+
+  int fetch(const string &start_after);
+
+public:
+  cls_map_iterator(cls_method_context_t hctx,
+                   const string &filter_prefix = string(),
+                   uint64_t max_batch = 1000);
+
+  /// position on the first key after start_after ("" for the first one)
+  int seek(const string &start_after);
+  bool valid() const {
+    return r >= 0 && cur != vals.end();
+  }
+  int next();
+  const string &key() const {
+    return cur->first;
+  }
+  bufferlist &value() {
+    return cur->second;
+  }
+  /// 0, or the error that ended the walk
+  int status() const {
+    return r;
+  }
+};
+
 /* utility functions */
 extern int cls_gen_random_bytes(char *buf, int size);
 extern int cls_gen_rand_base64(char *dest, int size); /* size should be the required string size + 1 */
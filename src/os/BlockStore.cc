@@ -0,0 +1,2229 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/vfs.h>
+
+#include "BlockStore.h"
+#include "LevelDBStore.h"
+
+#include "common/blkdev.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "common/Formatter.h"
+#include "common/safe_io.h"
+#include "include/encoding.h"
+#include "include/intarith.h"
+
+#define dout_subsys ceph_subsys_blockstore
+#undef dout_prefix
+#define dout_prefix *_dout << "blockstore(" << path << ") "
+
+/*
+ * leveldb layout
+ *
+ *   S  superblock: block_size, nid_max, sharded
+ *   F  free list:  %016llx device offset -> length
+ *   C  collection: coll name -> attrs
+ *   O  object:     <escaped coll>!<object key> -> blockstore_onode_t
+ *   M  omap:       %016llx omap id, then '-' for the header or
+ *                  '.' <key> for a key
+ *
+ * Object keys sort the same way ghobject_t does, so that collections
+ * can be listed in order straight out of leveldb.
+ */
+static const string PREFIX_SUPER = "S";
+static const string PREFIX_FREE = "F";
+static const string PREFIX_COLL = "C";
+static const string PREFIX_OBJ = "O";
+static const string PREFIX_OMAP = "M";
+
+// -------------------------------------------------------
+// encodings
+
+void blockstore_extent_t::encode(bufferlist& bl) const
+{
+  ::encode(offset, bl);
+  ::encode(length, bl);
+}
+
+void blockstore_extent_t::decode(bufferlist::iterator& p)
+{
+  ::decode(offset, p);
+  ::decode(length, p);
+}
+
+void blockstore_onode_t::encode(bufferlist& bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(oid, bl);
+  ::encode(size, bl);
+  ::encode(extents, bl);
+  ::encode(attrs, bl);
+  ::encode(omap_head, bl);
+  ENCODE_FINISH(bl);
+}
+
+void blockstore_onode_t::decode(bufferlist::iterator& p)
+{
+  DECODE_START(1, p);
+  ::decode(oid, p);
+  ::decode(size, p);
+  ::decode(extents, p);
+  ::decode(attrs, p);
+  ::decode(omap_head, p);
+  DECODE_FINISH(p);
+}
+
+// -------------------------------------------------------
+// keys
+
+/*
+ * Characters up to and including '#' are written as '#' and two hex
+ * digits, and the string is terminated with '!'.  That keeps the byte
+ * order of the escaped strings that of the originals, and no escaped
+ * string is a prefix of another.
+ */
+static void append_escaped(const string &in, string *out)
+{
+  char buf[4];
+  for (string::const_iterator i = in.begin(); i != in.end(); ++i) {
+    if ((unsigned char)*i <= '#') {
+      snprintf(buf, sizeof(buf), "#%02x", (unsigned)(unsigned char)*i);
+      out->append(buf);
+    } else {
+      out->push_back(*i);
+    }
+  }
+  out->push_back('!');
+}
+
+static string get_coll_prefix(coll_t cid)
+{
+  string key;
+  append_escaped(cid.to_str(), &key);
+  return key;
+}
+
+// in the order of ghobject_t's operator<
+static string get_object_key(coll_t cid, const ghobject_t &oid)
+{
+  string key = get_coll_prefix(cid);
+  if (oid.hobj.is_max()) {
+    key.push_back('1');
+    return key;
+  }
+  key.push_back('0');
+
+  char buf[80];
+  snprintf(buf, sizeof(buf), "%08llx",
+	   (unsigned long long)oid.hobj.get_filestore_key_u32());
+  key.append(buf);
+  append_escaped(oid.hobj.nspace, &key);
+  // bias the pool so that -1 sorts before 0
+  snprintf(buf, sizeof(buf), "%016llx",
+	   (unsigned long long)oid.hobj.pool + 0x8000000000000000ull);
+  key.append(buf);
+  append_escaped(oid.hobj.get_effective_key(), &key);
+  append_escaped(oid.hobj.oid.name, &key);
+  snprintf(buf, sizeof(buf), "%016llx%02x%016llx",
+	   (unsigned long long)oid.hobj.snap.val,
+	   (unsigned)oid.shard_id,
+	   (unsigned long long)oid.generation);
+  key.append(buf);
+  return key;
+}
+
+static string get_omap_prefix(uint64_t nid)
+{
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)nid);
+  return string(buf);
+}
+
+static string get_omap_header_key(uint64_t nid)
+{
+  return get_omap_prefix(nid) + '-';
+}
+
+static string get_omap_key(uint64_t nid, const string &key)
+{
+  return get_omap_prefix(nid) + '.' + key;
+}
+
+/// sorts after the header and every key of nid
+static string get_omap_tail_key(uint64_t nid)
+{
+  return get_omap_prefix(nid) + '~';
+}
+
+static string get_free_key(uint64_t offset)
+{
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)offset);
+  return string(buf);
+}
+
+// -------------------------------------------------------
+// omap iterator
+
+class BlockStore::OmapIteratorImpl : public ObjectMap::ObjectMapIteratorImpl {
+  KeyValueDB::Iterator it;
+  string prefix;  ///< <omap id>.
+public:
+  OmapIteratorImpl(KeyValueDB::Iterator it, uint64_t nid)
+    : it(it), prefix(get_omap_prefix(nid) + '.') {
+    seek_to_first();
+  }
+  int seek_to_first() {
+    return it->lower_bound(prefix);
+  }
+  int upper_bound(const string &after) {
+    return it->upper_bound(prefix + after);
+  }
+  int lower_bound(const string &to) {
+    return it->lower_bound(prefix + to);
+  }
+  bool valid() {
+    return it->valid() &&
+      it->key().compare(0, prefix.length(), prefix) == 0;
+  }
+  int next() {
+    return it->next();
+  }
+  string key() {
+    return it->key().substr(prefix.length());
+  }
+  bufferlist value() {
+    return it->value();
+  }
+  int status() {
+    return it->status();
+  }
+};
+
+// -------------------------------------------------------
+
+BlockStore::BlockStore(const string &path)
+  : path(path),
+    db(NULL),
+    block_size(0),
+    nid_max(0),
+    fsid_fd(-1),
+    block_fd(-1),
+    mounted(false),
+    lock("BlockStore::lock"),
+    finisher(g_ceph_context),
+    dev_size(0),
+    allow_sharded_objects(false),
+    free_bytes(0),
+    alloc_cursor(0)
+{
+}
+
+BlockStore::~BlockStore()
+{
+  assert(!mounted);
+  _close();
+}
+
+int BlockStore::_open_fsid(bool create)
+{
+  string fn = path + "/fsid";
+  int flags = O_RDWR;
+  if (create)
+    flags |= O_CREAT;
+  fsid_fd = ::open(fn.c_str(), flags, 0644);
+  if (fsid_fd < 0) {
+    int err = -errno;
+    derr << __func__ << " " << cpp_strerror(err) << dendl;
+    return err;
+  }
+  return 0;
+}
+
+int BlockStore::_lock_fsid()
+{
+  struct flock l;
+  memset(&l, 0, sizeof(l));
+  l.l_type = F_WRLCK;
+  l.l_whence = SEEK_SET;
+  l.l_start = 0;
+  l.l_len = 0;
+  int r = ::fcntl(fsid_fd, F_SETLK, &l);
+  if (r < 0) {
+    int err = errno;
+    derr << __func__ << " failed to lock " << path
+	 << "/fsid, is another ceph-osd still running? "
+	 << cpp_strerror(err) << dendl;
+    return -err;
+  }
+  return 0;
+}
+
+int BlockStore::_read_fsid(uuid_d *uuid)
+{
+  char fsid_str[40];
+  memset(fsid_str, 0, sizeof(fsid_str));
+  int ret = safe_pread(fsid_fd, fsid_str, sizeof(fsid_str), 0);
+  if (ret < 0)
+    return ret;
+  if (ret > 36)
+    fsid_str[36] = 0;
+  if (!uuid->parse(fsid_str))
+    return -EINVAL;
+  return 0;
+}
+
+int BlockStore::_write_fsid()
+{
+  int r = ::ftruncate(fsid_fd, 0);
+  if (r < 0)
+    return -errno;
+  char fsid_str[40];
+  fsid.print(fsid_str);
+  strcat(fsid_str, "\n");
+  r = safe_pwrite(fsid_fd, fsid_str, strlen(fsid_str), 0);
+  if (r < 0)
+    return r;
+  if (::fsync(fsid_fd) < 0)
+    return -errno;
+  return 0;
+}
+
+// data placement
+
+uint64_t BlockStore::_get_mkfs_block_size()
+{
+  return g_conf->blockstore_block_size;
+}
+
+int BlockStore::_open_data(bool create)
+{
+  string fn = path + "/block";
+  int flags = O_RDWR;
+  if (create)
+    flags |= O_CREAT;
+  block_fd = ::open(fn.c_str(), flags, 0644);
+  if (block_fd < 0) {
+    int err = -errno;
+    derr << __func__ << " open " << fn << ": " << cpp_strerror(err) << dendl;
+    return err;
+  }
+
+  struct stat st;
+  if (::fstat(block_fd, &st) < 0)
+    return -errno;
+  if (S_ISBLK(st.st_mode)) {
+    int64_t s;
+    int r = get_block_device_size(block_fd, &s);
+    if (r < 0) {
+      derr << __func__ << " can't get size of " << fn << ": "
+	   << cpp_strerror(r) << dendl;
+      return r;
+    }
+    dev_size = s;
+  } else {
+    if (create && st.st_size == 0) {
+      // no device set up; make do with a sparse file
+      dout(1) << __func__ << " creating " << fn << " of "
+	      << g_conf->blockstore_mkfs_size << " bytes" << dendl;
+      if (::ftruncate(block_fd, g_conf->blockstore_mkfs_size) < 0)
+	return -errno;
+      st.st_size = g_conf->blockstore_mkfs_size;
+    }
+    dev_size = st.st_size;
+  }
+  if (dev_size == 0) {
+    derr << __func__ << " " << fn << " is empty" << dendl;
+    return -EINVAL;
+  }
+  dout(10) << __func__ << " " << fn << " is " << dev_size << " bytes" << dendl;
+  return 0;
+}
+
+void BlockStore::_close_data()
+{
+  if (block_fd >= 0) {
+    TEMP_FAILURE_RETRY(::close(block_fd));
+    block_fd = -1;
+  }
+  free_map.clear();
+  free_bytes = 0;
+}
+
+void BlockStore::_mkfs_data(KeyValueDB::Transaction t)
+{
+  t->rmkeys_by_prefix(PREFIX_FREE);
+  bufferlist bl;
+  ::encode(dev_size - dev_size % block_size, bl);
+  t->set(PREFIX_FREE, get_free_key(0), bl);
+}
+
+int BlockStore::_load_data()
+{
+  free_map.clear();
+  free_bytes = 0;
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_FREE);
+  for (it->seek_to_first(); it->valid(); it->next()) {
+    uint64_t offset = strtoull(it->key().c_str(), NULL, 16);
+    bufferlist bl = it->value();
+    bufferlist::iterator p = bl.begin();
+    uint64_t length;
+    ::decode(length, p);
+    free_map[offset] = length;
+    free_bytes += length;
+  }
+  dout(10) << __func__ << " " << free_map.size() << " extents, "
+	   << free_bytes << " bytes free" << dendl;
+  return 0;
+}
+
+int BlockStore::_write_extents(TransContext *txc, const char *p,
+			       uint64_t length,
+			       vector<blockstore_extent_t> *out)
+{
+  int r = _allocate(txc, length, out);
+  if (r < 0)
+    return r;
+  uint64_t pos = 0;
+  for (vector<blockstore_extent_t>::iterator i = out->begin();
+       i != out->end();
+       ++i) {
+    r = safe_pwrite(block_fd, p + pos, i->length, i->offset);
+    if (r < 0) {
+      derr << __func__ << " pwrite " << i->offset << "~" << i->length
+	   << ": " << cpp_strerror(r) << dendl;
+      return r;
+    }
+    pos += i->length;
+  }
+  txc->data_written = true;
+  return 0;
+}
+
+int BlockStore::_read_extent(TransContext *txc, const blockstore_extent_t &e,
+			     uint64_t offset, uint64_t length, char *out)
+{
+  int r = safe_pread_exact(block_fd, out, length, e.offset + offset);
+  if (r < 0) {
+    derr << __func__ << " pread " << e.offset + offset << "~" << length
+	 << ": " << cpp_strerror(r) << dendl;
+    return r == -EDOM ? -EIO : r;
+  }
+  return 0;
+}
+
+void BlockStore::_release_extent(TransContext *txc,
+				 const blockstore_extent_t &e)
+{
+  // only reusable once the new block map is committed
+  txc->released.push_back(e);
+}
+
+int BlockStore::_commit_data(TransContext *txc)
+{
+  if (txc->data_written && ::fdatasync(block_fd) < 0) {
+    int r = -errno;
+    derr << __func__ << " fdatasync: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  for (vector<blockstore_extent_t>::iterator p = txc->released.begin();
+       p != txc->released.end();
+       ++p)
+    _release(txc, p->offset, p->length);
+  return 0;
+}
+
+
+int BlockStore::_open_db(bool create)
+{
+  string fn = path + "/db";
+  LevelDBStore *store = new LevelDBStore(g_ceph_context, fn);
+  store->options.write_buffer_size = g_conf->osd_leveldb_write_buffer_size;
+  store->options.cache_size = g_conf->osd_leveldb_cache_size;
+  store->options.block_size = g_conf->osd_leveldb_block_size;
+  store->options.bloom_size = g_conf->osd_leveldb_bloom_size;
+  store->options.compression_enabled = g_conf->osd_leveldb_compression;
+  store->options.paranoid_checks = g_conf->osd_leveldb_paranoid;
+  store->options.max_open_files = g_conf->osd_leveldb_max_open_files;
+  store->options.log_file = g_conf->osd_leveldb_log;
+
+  stringstream err;
+  int r = create ? store->create_and_open(err) : store->open(err);
+  if (r) {
+    derr << __func__ << " error opening " << fn << ": " << err.str() << dendl;
+    delete store;
+    return -EIO;
+  }
+  db = store;
+  return 0;
+}
+
+void BlockStore::_close()
+{
+  delete db;
+  db = NULL;
+  _close_data();
+  if (fsid_fd >= 0) {
+    TEMP_FAILURE_RETRY(::close(fsid_fd));
+    fsid_fd = -1;
+  }
+  coll_map.clear();
+}
+
+int BlockStore::_get_kv(const string &prefix, const string &key,
+			bufferlist *bl)
+{
+  set<string> keys;
+  keys.insert(key);
+  map<string, bufferlist> out;
+  int r = db->get(prefix, keys, &out);
+  if (r < 0)
+    return r;
+  map<string, bufferlist>::iterator p = out.find(key);
+  if (p == out.end())
+    return -ENOENT;
+  bl->claim(p->second);
+  return 0;
+}
+
+int BlockStore::_load_super()
+{
+  bufferlist bl;
+  int r = _get_kv(PREFIX_SUPER, "block_size", &bl);
+  if (r < 0) {
+    derr << __func__ << " no superblock" << dendl;
+    return -EINVAL;
+  }
+  bufferlist::iterator p = bl.begin();
+  ::decode(block_size, p);
+
+  bl.clear();
+  r = _get_kv(PREFIX_SUPER, "nid_max", &bl);
+  if (r < 0)
+    return r;
+  p = bl.begin();
+  ::decode(nid_max, p);
+
+  allow_sharded_objects = _get_kv(PREFIX_SUPER, "sharded", &bl) == 0;
+  dout(10) << __func__ << " block_size " << block_size
+	   << " nid_max " << nid_max << dendl;
+  return 0;
+}
+
+int BlockStore::_load_collections()
+{
+  coll_map.clear();
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_COLL);
+  for (it->seek_to_first(); it->valid(); it->next()) {
+    bufferlist bl = it->value();
+    bufferlist::iterator p = bl.begin();
+    ::decode(coll_map[coll_t(it->key())], p);
+  }
+  dout(10) << __func__ << " " << coll_map.size() << " collections" << dendl;
+  return 0;
+}
+
+bool BlockStore::test_mount_in_use()
+{
+  if (mounted)
+    return true;
+  int r = _open_fsid(false);
+  if (r < 0)
+    return false;  // nothing there yet
+  bool inuse = _lock_fsid() < 0;
+  _close();
+  return inuse;
+}
+
+int BlockStore::mkfs()
+{
+  dout(1) << __func__ << dendl;
+  uuid_d old_fsid;
+
+  uint64_t bs = _get_mkfs_block_size();
+  if (bs < 512 || (bs & (bs - 1))) {
+    derr << __func__ << " block size " << bs
+	 << " is not a power of two >= 512" << dendl;
+    return -EINVAL;
+  }
+
+  int r = _open_fsid(true);
+  if (r < 0)
+    return r;
+  r = _lock_fsid();
+  if (r < 0)
+    goto out;
+  if (_read_fsid(&old_fsid) < 0 || old_fsid.is_zero()) {
+    if (fsid.is_zero()) {
+      fsid.generate_random();
+      dout(1) << __func__ << " generated fsid " << fsid << dendl;
+    } else {
+      dout(1) << __func__ << " using provided fsid " << fsid << dendl;
+    }
+    r = _write_fsid();
+    if (r < 0)
+      goto out;
+  } else {
+    if (!fsid.is_zero() && fsid != old_fsid) {
+      derr << __func__ << " on-disk fsid " << old_fsid
+	   << " != provided " << fsid << dendl;
+      r = -EINVAL;
+      goto out;
+    }
+    fsid = old_fsid;
+    dout(1) << __func__ << " fsid is already set to " << fsid << dendl;
+  }
+
+  block_size = bs;
+  r = _open_data(true);
+  if (r < 0)
+    goto out;
+  r = _open_db(true);
+  if (r < 0)
+    goto out;
+
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkeys_by_prefix(PREFIX_SUPER);
+    t->rmkeys_by_prefix(PREFIX_COLL);
+    t->rmkeys_by_prefix(PREFIX_OBJ);
+    t->rmkeys_by_prefix(PREFIX_OMAP);
+
+    bufferlist bl;
+    ::encode(bs, bl);
+    t->set(PREFIX_SUPER, "block_size", bl);
+    bl.clear();
+    ::encode((uint64_t)0, bl);
+    t->set(PREFIX_SUPER, "nid_max", bl);
+
+    _mkfs_data(t);
+
+    r = db->submit_transaction_sync(t);
+  }
+
+ out:
+  _close();
+  return r;
+}
+
+int BlockStore::mount()
+{
+  dout(1) << __func__ << dendl;
+
+  int r = _open_fsid(false);
+  if (r < 0)
+    return r;
+  r = _lock_fsid();
+  if (r < 0)
+    goto out;
+  r = _read_fsid(&fsid);
+  if (r < 0)
+    goto out;
+  r = _open_data(false);
+  if (r < 0)
+    goto out;
+  r = _open_db(false);
+  if (r < 0)
+    goto out;
+  r = _load_super();
+  if (r < 0)
+    goto out;
+  r = _load_data();
+  if (r < 0)
+    goto out;
+  r = _load_collections();
+  if (r < 0)
+    goto out;
+
+  finisher.start();
+  mounted = true;
+  return 0;
+
+ out:
+  _close();
+  return r;
+}
+
+int BlockStore::umount()
+{
+  dout(1) << __func__ << dendl;
+  assert(mounted);
+  finisher.wait_for_empty();
+  finisher.stop();
+  _close();
+  mounted = false;
+  return 0;
+}
+
+void BlockStore::set_allow_sharded_objects()
+{
+  RWLock::WLocker l(lock);
+  if (allow_sharded_objects)
+    return;
+  KeyValueDB::Transaction t = db->get_transaction();
+  bufferlist bl;
+  t->set(PREFIX_SUPER, "sharded", bl);
+  int r = db->submit_transaction_sync(t);
+  assert(r == 0);
+  allow_sharded_objects = true;
+}
+
+bool BlockStore::get_allow_sharded_objects()
+{
+  return allow_sharded_objects;
+}
+
+int BlockStore::statfs(struct statfs *buf)
+{
+  RWLock::RLocker l(lock);
+  memset(buf, 0, sizeof(*buf));
+  buf->f_bsize = block_size;
+  buf->f_blocks = dev_size / block_size;
+  buf->f_bfree = free_bytes / block_size;
+  buf->f_bavail = buf->f_bfree;
+  return 0;
+}
+
+filestore_perf_stat_t BlockStore::get_cur_stats()
+{
+  RWLock::RLocker l(lock);
+  return cur_stats;
+}
+
+// -------------------------------------------------------
+// allocator
+
+int BlockStore::_allocate(TransContext *txc, uint64_t want,
+			  vector<blockstore_extent_t> *out)
+{
+  assert(want % block_size == 0);
+  if (want > free_bytes) {
+    derr << __func__ << " want " << want << " have " << free_bytes << dendl;
+    return -ENOSPC;
+  }
+  free_bytes -= want;
+
+  // next fit, so that a stream of writes ends up sequential on disk
+  while (want > 0) {
+    map<uint64_t, uint64_t>::iterator p = free_map.lower_bound(alloc_cursor);
+    if (p == free_map.end())
+      p = free_map.begin();
+    assert(p != free_map.end());
+    uint64_t offset = p->first;
+    uint64_t length = p->second;
+    uint64_t l = MIN(want, length);
+    out->push_back(blockstore_extent_t(offset, l));
+
+    free_map.erase(p);
+    txc->t->rmkey(PREFIX_FREE, get_free_key(offset));
+    if (l < length) {
+      free_map[offset + l] = length - l;
+      bufferlist bl;
+      ::encode(length - l, bl);
+      txc->t->set(PREFIX_FREE, get_free_key(offset + l), bl);
+    }
+    alloc_cursor = offset + l;
+    want -= l;
+  }
+  return 0;
+}
+
+void BlockStore::_release(TransContext *txc, uint64_t offset, uint64_t length)
+{
+  dout(30) << __func__ << " " << offset << "~" << length << dendl;
+  free_bytes += length;
+
+  map<uint64_t, uint64_t>::iterator p = free_map.lower_bound(offset);
+  assert(p == free_map.end() || p->first >= offset + length);
+  if (p != free_map.end() && p->first == offset + length) {
+    length += p->second;
+    txc->t->rmkey(PREFIX_FREE, get_free_key(p->first));
+    free_map.erase(p++);
+  }
+  if (p != free_map.begin()) {
+    --p;
+    assert(p->first + p->second <= offset);
+    if (p->first + p->second == offset) {
+      offset = p->first;
+      length += p->second;
+    }
+  }
+  free_map[offset] = length;
+  bufferlist bl;
+  ::encode(length, bl);
+  txc->t->set(PREFIX_FREE, get_free_key(offset), bl);
+}
+
+// -------------------------------------------------------
+// objects
+
+BlockStore::OnodeRef BlockStore::_load_onode(TransContext *txc,
+					     const string &key)
+{
+  if (txc) {
+    map<string, OnodeRef>::iterator p = txc->onodes.find(key);
+    if (p != txc->onodes.end())
+      return p->second;
+  }
+  OnodeRef o(new Onode(key));
+  bufferlist bl;
+  if (_get_kv(PREFIX_OBJ, key, &bl) == 0) {
+    bufferlist::iterator p = bl.begin();
+    ::decode(o->onode, p);
+    o->exists = true;
+  }
+  if (txc)
+    txc->onodes[key] = o;
+  return o;
+}
+
+BlockStore::OnodeRef BlockStore::_get_onode(TransContext *txc, coll_t cid,
+					    const ghobject_t &oid, bool create)
+{
+  if (!coll_map.count(cid))
+    return OnodeRef();
+  OnodeRef o = _load_onode(txc, get_object_key(cid, oid));
+  if (!o->exists) {
+    if (!create)
+      return OnodeRef();
+    o->onode = blockstore_onode_t();
+    o->onode.oid = oid;
+    o->exists = true;
+    o->dirty = true;
+  }
+  return o;
+}
+
+void BlockStore::_list_coll_keys(TransContext *txc, coll_t cid,
+				 set<string> *keys)
+{
+  string prefix = get_coll_prefix(cid);
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_OBJ);
+  for (it->lower_bound(prefix); it->valid(); it->next()) {
+    string key = it->key();
+    if (key.compare(0, prefix.length(), prefix) != 0)
+      break;
+    keys->insert(key);
+  }
+  if (!txc)
+    return;
+  for (map<string, OnodeRef>::iterator p = txc->onodes.lower_bound(prefix);
+       p != txc->onodes.end() &&
+	 p->first.compare(0, prefix.length(), prefix) == 0;
+       ++p) {
+    if (p->second->exists)
+      keys->insert(p->first);
+    else
+      keys->erase(p->first);
+  }
+}
+
+/// read whatever the block map says, holes as zeros, ignoring the size
+int BlockStore::_read_blocks(TransContext *txc, const blockstore_onode_t &on,
+			     uint64_t offset, uint64_t length, bufferlist &bl)
+{
+  bufferptr bp(length);
+  bp.zero();
+  map<uint64_t, blockstore_extent_t>::const_iterator p =
+    on.extents.upper_bound(offset);
+  if (p != on.extents.begin())
+    --p;
+  for (; p != on.extents.end() && p->first < offset + length; ++p) {
+    uint64_t lo = MAX(p->first, offset);
+    uint64_t hi = MIN(p->first + p->second.length, offset + length);
+    if (lo >= hi)
+      continue;
+    int r = _read_extent(txc, p->second, lo - p->first, hi - lo,
+			 bp.c_str() + (lo - offset));
+    if (r < 0)
+      return r;
+  }
+  bl.push_back(bp);
+  return 0;
+}
+
+bool BlockStore::_has_blocks(const blockstore_onode_t &on, uint64_t offset,
+			     uint64_t length)
+{
+  map<uint64_t, blockstore_extent_t>::const_iterator p =
+    on.extents.upper_bound(offset);
+  if (p != on.extents.begin()) {
+    --p;
+    if (p->first + p->second.length > offset)
+      return true;
+    ++p;
+  }
+  return p != on.extents.end() && p->first < offset + length;
+}
+
+/// unmap [offset, offset+length), which is block aligned
+void BlockStore::_punch(TransContext *txc, OnodeRef o, uint64_t offset,
+			uint64_t length)
+{
+  map<uint64_t, blockstore_extent_t> &m = o->onode.extents;
+  uint64_t end = offset + length;
+  map<uint64_t, blockstore_extent_t>::iterator p = m.upper_bound(offset);
+  if (p != m.begin())
+    --p;
+  while (p != m.end() && p->first < end) {
+    uint64_t lo = p->first;
+    blockstore_extent_t e = p->second;
+    uint64_t hi = lo + e.length;
+    if (hi <= offset) {
+      ++p;
+      continue;
+    }
+    m.erase(p++);
+    uint64_t a = MAX(lo, offset);
+    uint64_t b = MIN(hi, end);
+    if (lo < a)
+      m[lo] = blockstore_extent_t(e.offset, a - lo);
+    if (b < hi)
+      m[b] = blockstore_extent_t(e.offset + (b - lo), hi - b);
+    _release_extent(txc, blockstore_extent_t(e.offset + (a - lo), b - a));
+  }
+  o->dirty = true;
+}
+
+/**
+ * Write bl at offset into newly allocated blocks.  Partial blocks at
+ * either end are filled in from the old data, so the blocks past the
+ * end of an object always read as zeros.
+ */
+int BlockStore::_do_write(TransContext *txc, OnodeRef o, uint64_t offset,
+			  const bufferlist &bl)
+{
+  uint64_t length = bl.length();
+  if (length == 0)
+    return 0;
+  uint64_t start = offset - offset % block_size;
+  uint64_t end = ROUND_UP_TO(offset + length, block_size);
+
+  bufferlist data;
+  int r;
+  if (start < offset) {
+    r = _read_blocks(txc, o->onode, start, offset - start, data);
+    if (r < 0)
+      return r;
+  }
+  data.append(bl);
+  if (offset + length < end) {
+    r = _read_blocks(txc, o->onode, offset + length, end - offset - length, data);
+    if (r < 0)
+      return r;
+  }
+
+  vector<blockstore_extent_t> ext;
+  r = _write_extents(txc, data.c_str(), end - start, &ext);
+  if (r < 0)
+    return r;
+  _punch(txc, o, start, end - start);
+
+  uint64_t pos = start;
+  for (vector<blockstore_extent_t>::iterator i = ext.begin();
+       i != ext.end();
+       ++i) {
+    dout(20) << __func__ << " " << o->onode.oid << " " << pos << "~"
+	     << i->length << " -> " << i->offset << dendl;
+    o->onode.extents[pos] = *i;
+    pos += i->length;
+  }
+
+  if (offset + length > o->onode.size)
+    o->onode.size = offset + length;
+  o->dirty = true;
+  return 0;
+}
+
+int BlockStore::_do_zero(TransContext *txc, OnodeRef o, uint64_t offset,
+			 uint64_t length)
+{
+  uint64_t end = offset + length;
+  uint64_t a = ROUND_UP_TO(offset, block_size);  // first whole block
+  uint64_t b = end - end % block_size;            // end of the last one
+  int r = 0;
+
+  // partial blocks at either end are rewritten, whole ones unmapped
+  uint64_t head_end = MIN(a, end);
+  if (offset < head_end && _has_blocks(o->onode, offset, head_end - offset)) {
+    bufferptr bp(head_end - offset);
+    bp.zero();
+    bufferlist bl;
+    bl.push_back(bp);
+    r = _do_write(txc, o, offset, bl);
+    if (r < 0)
+      return r;
+  }
+  if (a < b)
+    _punch(txc, o, a, b - a);
+  uint64_t tail_start = MAX(b, head_end);
+  if (tail_start < end && _has_blocks(o->onode, tail_start, end - tail_start)) {
+    bufferptr bp(end - tail_start);
+    bp.zero();
+    bufferlist bl;
+    bl.push_back(bp);
+    r = _do_write(txc, o, tail_start, bl);
+    if (r < 0)
+      return r;
+  }
+
+  if (end > o->onode.size)
+    o->onode.size = end;
+  o->dirty = true;
+  return 0;
+}
+
+int BlockStore::_do_truncate(TransContext *txc, OnodeRef o, uint64_t size)
+{
+  if (size < o->onode.size) {
+    uint64_t keep = ROUND_UP_TO(size, block_size);
+    if (size < keep && _has_blocks(o->onode, size, keep - size)) {
+      // keep the tail of the last block zeroed
+      bufferptr bp(keep - size);
+      bp.zero();
+      bufferlist bl;
+      bl.push_back(bp);
+      int r = _do_write(txc, o, size, bl);
+      if (r < 0)
+	return r;
+    }
+    if (!o->onode.extents.empty()) {
+      map<uint64_t, blockstore_extent_t>::reverse_iterator p =
+	o->onode.extents.rbegin();
+      uint64_t mapped_end = p->first + p->second.length;
+      if (mapped_end > keep)
+	_punch(txc, o, keep, mapped_end - keep);
+    }
+  }
+  o->onode.size = size;
+  o->dirty = true;
+  return 0;
+}
+
+void BlockStore::_do_remove(TransContext *txc, OnodeRef o)
+{
+  for (map<uint64_t, blockstore_extent_t>::iterator p =
+	 o->onode.extents.begin();
+       p != o->onode.extents.end();
+       ++p)
+    _release_extent(txc, p->second);
+  _omap_clear_onode(txc, o);
+  o->onode = blockstore_onode_t();
+  o->exists = false;
+  o->dirty = true;
+}
+
+/// make n a copy of o; the data is copied, not shared
+int BlockStore::_copy_object(TransContext *txc, OnodeRef o, OnodeRef n)
+{
+  if (o == n)
+    return 0;
+  int r = _do_truncate(txc, n, 0);
+  if (r < 0)
+    return r;
+  if (o->onode.size) {
+    bufferlist bl;
+    r = _read_blocks(txc, o->onode, 0, o->onode.size, bl);
+    if (r < 0)
+      return r;
+    r = _do_write(txc, n, 0, bl);
+    if (r < 0)
+      return r;
+  }
+  n->onode.attrs = o->onode.attrs;
+
+  _omap_clear_onode(txc, n);
+  if (o->onode.omap_head) {
+    map<string, bufferlist> m;
+    _omap_scan(txc, get_omap_header_key(o->onode.omap_head),
+	       get_omap_tail_key(o->onode.omap_head), &m);
+    if (!m.empty()) {
+      _omap_open(txc, n);
+      string prefix = get_omap_prefix(n->onode.omap_head);
+      for (map<string, bufferlist>::iterator p = m.begin(); p != m.end(); ++p)
+	_omap_set(txc, prefix + p->first.substr(prefix.length()), p->second);
+    }
+  }
+  n->dirty = true;
+  return 0;
+}
+
+/// give o's metadata, data and omap to n, under a new name
+void BlockStore::_move_onode(TransContext *txc, OnodeRef o, OnodeRef n,
+			     const ghobject_t &newoid)
+{
+  if (o == n)
+    return;
+  n->onode = o->onode;
+  n->onode.oid = newoid;
+  n->exists = true;
+  n->dirty = true;
+  o->onode = blockstore_onode_t();
+  o->exists = false;
+  o->dirty = true;
+}
+
+// -------------------------------------------------------
+// omap
+
+void BlockStore::_omap_open(TransContext *txc, OnodeRef o)
+{
+  if (o->onode.omap_head)
+    return;
+  o->onode.omap_head = ++nid_max;
+  o->dirty = true;
+  txc->nid_dirty = true;
+}
+
+void BlockStore::_omap_set(TransContext *txc, const string &key,
+			   const bufferlist &bl)
+{
+  txc->t->set(PREFIX_OMAP, key, bl);
+  txc->omap[key] = make_pair(true, bl);
+}
+
+void BlockStore::_omap_rm(TransContext *txc, const string &key)
+{
+  txc->t->rmkey(PREFIX_OMAP, key);
+  txc->omap[key] = make_pair(false, bufferlist());
+}
+
+/// omap keys in [first, last), as of the changes txc has made so far
+void BlockStore::_omap_scan(TransContext *txc, const string &first,
+			    const string &last, map<string, bufferlist> *out)
+{
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_OMAP);
+  for (it->lower_bound(first); it->valid(); it->next()) {
+    string key = it->key();
+    if (key >= last)
+      break;
+    (*out)[key] = it->value();
+  }
+  if (!txc)
+    return;
+  for (map<string, pair<bool, bufferlist> >::iterator p =
+	 txc->omap.lower_bound(first);
+       p != txc->omap.end() && p->first < last;
+       ++p) {
+    if (p->second.first)
+      (*out)[p->first] = p->second.second;
+    else
+      out->erase(p->first);
+  }
+}
+
+void BlockStore::_omap_clear_onode(TransContext *txc, OnodeRef o)
+{
+  if (!o->onode.omap_head)
+    return;
+  map<string, bufferlist> m;
+  _omap_scan(txc, get_omap_header_key(o->onode.omap_head),
+	     get_omap_tail_key(o->onode.omap_head), &m);
+  for (map<string, bufferlist>::iterator p = m.begin(); p != m.end(); ++p)
+    _omap_rm(txc, p->first);
+  o->onode.omap_head = 0;
+  o->dirty = true;
+}
+
+// -------------------------------------------------------
+// transactions
+
+int BlockStore::queue_transactions(Sequencer *osr, list<Transaction*>& tls,
+				   TrackedOpRef op)
+{
+  Context *onreadable;
+  Context *ondisk;
+  Context *onreadable_sync;
+  ObjectStore::Transaction::collect_contexts(
+    tls, &onreadable, &ondisk, &onreadable_sync);
+
+  utime_t start = ceph_clock_now(g_ceph_context);
+  {
+    RWLock::WLocker l(lock);
+    assert(mounted);
+    TransContext txc(db->get_transaction());
+    for (list<Transaction*>::iterator p = tls.begin(); p != tls.end(); ++p)
+      _do_transaction(&txc, **p);
+    int r = _txc_commit(&txc);
+    if (r < 0) {
+      derr << __func__ << " commit failed: " << cpp_strerror(r) << dendl;
+      assert(0 == "unable to commit transaction");
+    }
+    utime_t lat = ceph_clock_now(g_ceph_context) - start;
+    cur_stats.filestore_apply_latency = (double)lat * 1000;
+    cur_stats.filestore_commit_latency = (double)lat * 1000;
+  }
+
+  if (onreadable_sync)
+    onreadable_sync->complete(0);
+  if (onreadable)
+    finisher.queue(onreadable);
+  if (ondisk)
+    finisher.queue(ondisk);
+  return 0;
+}
+
+int BlockStore::_txc_commit(TransContext *txc)
+{
+  // the data must be stable before the metadata points at it.  nothing
+  // allocates after this point, so freed blocks can't be reused before
+  // the batch that frees them is on disk.
+  int r = _commit_data(txc);
+  if (r < 0)
+    return r;
+
+  for (map<string, OnodeRef>::iterator p = txc->onodes.begin();
+       p != txc->onodes.end();
+       ++p) {
+    OnodeRef o = p->second;
+    if (!o->dirty)
+      continue;
+    if (o->exists) {
+      bufferlist bl;
+      ::encode(o->onode, bl);
+      txc->t->set(PREFIX_OBJ, o->key, bl);
+    } else {
+      txc->t->rmkey(PREFIX_OBJ, o->key);
+    }
+  }
+
+  if (txc->nid_dirty) {
+    bufferlist bl;
+    ::encode(nid_max, bl);
+    txc->t->set(PREFIX_SUPER, "nid_max", bl);
+  }
+
+  return db->submit_transaction_sync(txc->t);
+}
+
+void BlockStore::_do_transaction(TransContext *txc, Transaction& t)
+{
+  dout(10) << "_do_transaction on " << &t << dendl;
+
+  Transaction::iterator i = t.begin();
+  while (i.have_op()) {
+    int op = i.get_op();
+    int r = 0;
+
+    switch (op) {
+    case Transaction::OP_NOP:
+      break;
+    case Transaction::OP_TOUCH:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	r = _touch(txc, cid, oid);
+      }
+      break;
+
+    case Transaction::OP_WRITE:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	uint64_t off = i.get_length();
+	uint64_t len = i.get_length();
+	i.get_replica();
+	bufferlist bl;
+	i.get_bl(bl);
+	assert(len == bl.length());
+	r = _write(txc, cid, oid, off, bl);
+      }
+      break;
+
+    case Transaction::OP_ZERO:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	uint64_t off = i.get_length();
+	uint64_t len = i.get_length();
+	r = _zero(txc, cid, oid, off, len);
+      }
+      break;
+
+    case Transaction::OP_TRIMCACHE:
+      {
+	i.get_cid();
+	i.get_oid();
+	i.get_length();
+	i.get_length();
+	// deprecated, no-op
+      }
+      break;
+
+    case Transaction::OP_TRUNCATE:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	uint64_t off = i.get_length();
+	r = _truncate(txc, cid, oid, off);
+      }
+      break;
+
+    case Transaction::OP_REMOVE:
+    case Transaction::OP_COLL_REMOVE:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	r = _remove(txc, cid, oid);
+      }
+      break;
+
+    case Transaction::OP_SETATTR:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	string name = i.get_attrname();
+	bufferlist bl;
+	i.get_bl(bl);
+	map<string, bufferptr> to_set;
+	to_set[name] = bufferptr(bl.c_str(), bl.length());
+	r = _setattrs(txc, cid, oid, to_set);
+      }
+      break;
+
+    case Transaction::OP_SETATTRS:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	map<string, bufferptr> aset;
+	i.get_attrset(aset);
+	r = _setattrs(txc, cid, oid, aset);
+      }
+      break;
+
+    case Transaction::OP_RMATTR:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	string name = i.get_attrname();
+	r = _rmattr(txc, cid, oid, name);
+      }
+      break;
+
+    case Transaction::OP_RMATTRS:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	r = _rmattrs(txc, cid, oid);
+      }
+      break;
+
+    case Transaction::OP_CLONE:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	ghobject_t noid = i.get_oid();
+	r = _clone(txc, cid, oid, noid);
+      }
+      break;
+
+    case Transaction::OP_CLONERANGE:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	ghobject_t noid = i.get_oid();
+	uint64_t off = i.get_length();
+	uint64_t len = i.get_length();
+	r = _clone_range(txc, cid, oid, noid, off, len, off);
+      }
+      break;
+
+    case Transaction::OP_CLONERANGE2:
+      {
+	coll_t cid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	ghobject_t noid = i.get_oid();
+	uint64_t srcoff = i.get_length();
+	uint64_t len = i.get_length();
+	uint64_t dstoff = i.get_length();
+	r = _clone_range(txc, cid, oid, noid, srcoff, len, dstoff);
+      }
+      break;
+
+    case Transaction::OP_MKCOLL:
+      {
+	coll_t cid = i.get_cid();
+	r = _create_collection(txc, cid);
+      }
+      break;
+
+    case Transaction::OP_RMCOLL:
+      {
+	coll_t cid = i.get_cid();
+	r = _destroy_collection(txc, cid);
+      }
+      break;
+
+    case Transaction::OP_COLL_ADD:
+      {
+	coll_t ncid = i.get_cid();
+	coll_t ocid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	r = _collection_add(txc, ncid, ocid, oid);
+      }
+      break;
+
+    case Transaction::OP_COLL_MOVE:
+      {
+	// deprecated; newcid, oldcid, oid
+	coll_t ncid = i.get_cid();
+	coll_t ocid = i.get_cid();
+	ghobject_t oid = i.get_oid();
+	r = _collection_move_rename(txc, ocid, oid, ncid, oid);
+      }
+      break;
+
+    case Transaction::OP_COLL_MOVE_RENAME:
+      {
+	coll_t oldcid = i.get_cid();
+	ghobject_t oldoid = i.get_oid();
+	coll_t newcid = i.get_cid();
+	ghobject_t newoid = i.get_oid();
+	r = _collection_move_rename(txc, oldcid, oldoid, newcid, newoid);
+      }
+      break;
+
+    case Transaction::OP_COLL_SETATTR:
+      {
+	coll_t cid = i.get_cid();
+	string name = i.get_attrname();
+	bufferlist bl;
+	i.get_bl(bl);
+	r = _collection_setattr(txc, cid, name, bl);
+      }
+      break;
+
+    case Transaction::OP_COLL_RMATTR:
+      {
+	coll_t cid = i.get_cid();
+	string name = i.get_attrname();
+	r = _collection_rmattr(txc, cid, name);
+      }
+      break;
+
+    case Transaction::OP_STARTSYNC:
+      // every batch is synced before it completes
+      break;
+
+    case Transaction::OP_COLL_RENAME:
+      {
+	coll_t cid(i.get_cid());
+	coll_t ncid(i.get_cid());
+	r = _collection_rename(txc, cid, ncid);
+      }
+      break;
+
+    case Transaction::OP_OMAP_CLEAR:
+      {
+	coll_t cid(i.get_cid());
+	ghobject_t oid = i.get_oid();
+	r = _omap_clear(txc, cid, oid);
+      }
+      break;
+    case Transaction::OP_OMAP_SETKEYS:
+      {
+	coll_t cid(i.get_cid());
+	ghobject_t oid = i.get_oid();
+	map<string, bufferlist> aset;
+	i.get_attrset(aset);
+	r = _omap_setkeys(txc, cid, oid, aset);
+      }
+      break;
+    case Transaction::OP_OMAP_RMKEYS:
+      {
+	coll_t cid(i.get_cid());
+	ghobject_t oid = i.get_oid();
+	set<string> keys;
+	i.get_keyset(keys);
+	r = _omap_rmkeys(txc, cid, oid, keys);
+      }
+      break;
+    case Transaction::OP_OMAP_RMKEYRANGE:
+      {
+	coll_t cid(i.get_cid());
+	ghobject_t oid = i.get_oid();
+	string first, last;
+	first = i.get_key();
+	last = i.get_key();
+	r = _omap_rmkeyrange(txc, cid, oid, first, last);
+      }
+      break;
+    case Transaction::OP_OMAP_SETHEADER:
+      {
+	coll_t cid(i.get_cid());
+	ghobject_t oid = i.get_oid();
+	bufferlist bl;
+	i.get_bl(bl);
+	r = _omap_setheader(txc, cid, oid, bl);
+      }
+      break;
+    case Transaction::OP_SPLIT_COLLECTION:
+      {
+	coll_t cid(i.get_cid());
+	uint32_t bits(i.get_u32());
+	uint32_t rem(i.get_u32());
+	coll_t dest(i.get_cid());
+	if (!coll_map.count(dest))
+	  r = _create_collection(txc, dest);
+	if (r == 0)
+	  r = _split_collection(txc, cid, bits, rem, dest);
+      }
+      break;
+    case Transaction::OP_SPLIT_COLLECTION2:
+      {
+	coll_t cid(i.get_cid());
+	uint32_t bits(i.get_u32());
+	uint32_t rem(i.get_u32());
+	coll_t dest(i.get_cid());
+	r = _split_collection(txc, cid, bits, rem, dest);
+      }
+      break;
+
+    default:
+      derr << "bad op " << op << dendl;
+      assert(0);
+    }
+
+    if (r < 0) {
+      bool ok = false;
+
+      if (r == -ENOENT && !(op == Transaction::OP_CLONERANGE ||
+			    op == Transaction::OP_CLONE ||
+			    op == Transaction::OP_CLONERANGE2 ||
+			    op == Transaction::OP_COLL_ADD))
+	// -ENOENT is normally okay
+	ok = true;
+      if (r == -ENOENT && op == Transaction::OP_COLL_ADD &&
+	  i.tolerate_collection_add_enoent())
+	ok = true;
+      if (r == -ENODATA)
+	ok = true;
+
+      if (!ok) {
+	const char *msg = "unexpected error code";
+
+	if (r == -ENOENT && (op == Transaction::OP_CLONERANGE ||
+			     op == Transaction::OP_CLONE ||
+			     op == Transaction::OP_CLONERANGE2))
+	  msg = "ENOENT on clone suggests osd bug";
+
+	if (r == -ENOSPC)
+	  // changes already made to this batch can't be backed out
+	  msg = "ENOSPC handling not implemented";
+
+	if (r == -ENOTEMPTY)
+	  msg = "ENOTEMPTY suggests garbage data in osd data dir";
+
+	dout(0) << " error " << cpp_strerror(r) << " not handled on operation "
+		<< op << dendl;
+	dout(0) << msg << dendl;
+	dout(0) << " transaction dump:\n";
+	JSONFormatter f(true);
+	f.open_object_section("transaction");
+	t.dump(&f);
+	f.close_section();
+	f.flush(*_dout);
+	*_dout << dendl;
+	assert(0 == "unexpected error");
+      }
+    }
+  }
+}
+
+int BlockStore::_touch(TransContext *txc, coll_t cid, const ghobject_t &oid)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, true);
+  if (!o)
+    return -ENOENT;
+  o->dirty = true;
+  return 0;
+}
+
+int BlockStore::_write(TransContext *txc, coll_t cid, const ghobject_t &oid,
+		       uint64_t offset, const bufferlist &bl)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << " " << offset << "~"
+	   << bl.length() << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, true);
+  if (!o)
+    return -ENOENT;
+  o->dirty = true;
+  return _do_write(txc, o, offset, bl);
+}
+
+int BlockStore::_zero(TransContext *txc, coll_t cid, const ghobject_t &oid,
+		      uint64_t offset, uint64_t length)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << " " << offset << "~"
+	   << length << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  return _do_zero(txc, o, offset, length);
+}
+
+int BlockStore::_truncate(TransContext *txc, coll_t cid, const ghobject_t &oid,
+			  uint64_t size)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << " " << size << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  return _do_truncate(txc, o, size);
+}
+
+int BlockStore::_remove(TransContext *txc, coll_t cid, const ghobject_t &oid)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  _do_remove(txc, o);
+  return 0;
+}
+
+int BlockStore::_setattrs(TransContext *txc, coll_t cid, const ghobject_t &oid,
+			  map<string, bufferptr> &aset)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  for (map<string, bufferptr>::iterator p = aset.begin();
+       p != aset.end();
+       ++p) {
+    // take a copy rather than pin the transaction's buffer
+    o->onode.attrs[p->first] = bufferptr(p->second.c_str(),
+					 p->second.length());
+  }
+  o->dirty = true;
+  return 0;
+}
+
+int BlockStore::_rmattr(TransContext *txc, coll_t cid, const ghobject_t &oid,
+			const string &name)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << " " << name << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  if (!o->onode.attrs.erase(name))
+    return -ENODATA;
+  o->dirty = true;
+  return 0;
+}
+
+int BlockStore::_rmattrs(TransContext *txc, coll_t cid, const ghobject_t &oid)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  o->onode.attrs.clear();
+  o->dirty = true;
+  return 0;
+}
+
+int BlockStore::_clone(TransContext *txc, coll_t cid, const ghobject_t &oid,
+		       const ghobject_t &noid)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << " -> " << noid << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  OnodeRef n = _get_onode(txc, cid, noid, true);
+  if (!n)
+    return -ENOENT;
+  return _copy_object(txc, o, n);
+}
+
+int BlockStore::_clone_range(TransContext *txc, coll_t cid,
+			     const ghobject_t &oid, const ghobject_t &noid,
+			     uint64_t srcoff, uint64_t length, uint64_t dstoff)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << " -> " << noid
+	   << " " << srcoff << "~" << length << " to " << dstoff << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  OnodeRef n = _get_onode(txc, cid, noid, true);
+  if (!n)
+    return -ENOENT;
+  if (srcoff >= o->onode.size)
+    return 0;
+  if (srcoff + length > o->onode.size)
+    length = o->onode.size - srcoff;
+  bufferlist bl;
+  int r = _read_blocks(txc, o->onode, srcoff, length, bl);
+  if (r < 0)
+    return r;
+  return _do_write(txc, n, dstoff, bl);
+}
+
+int BlockStore::_omap_clear(TransContext *txc, coll_t cid,
+			    const ghobject_t &oid)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  _omap_clear_onode(txc, o);
+  return 0;
+}
+
+int BlockStore::_omap_setkeys(TransContext *txc, coll_t cid,
+			      const ghobject_t &oid,
+			      const map<string, bufferlist> &aset)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  _omap_open(txc, o);
+  for (map<string, bufferlist>::const_iterator p = aset.begin();
+       p != aset.end();
+       ++p)
+    _omap_set(txc, get_omap_key(o->onode.omap_head, p->first), p->second);
+  return 0;
+}
+
+int BlockStore::_omap_rmkeys(TransContext *txc, coll_t cid,
+			     const ghobject_t &oid, const set<string> &keys)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  if (!o->onode.omap_head)
+    return 0;
+  for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p)
+    _omap_rm(txc, get_omap_key(o->onode.omap_head, *p));
+  return 0;
+}
+
+int BlockStore::_omap_rmkeyrange(TransContext *txc, coll_t cid,
+				 const ghobject_t &oid,
+				 const string &first, const string &last)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << " [" << first << ", "
+	   << last << ")" << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  if (!o->onode.omap_head)
+    return 0;
+  map<string, bufferlist> m;
+  _omap_scan(txc, get_omap_key(o->onode.omap_head, first),
+	     get_omap_key(o->onode.omap_head, last), &m);
+  for (map<string, bufferlist>::iterator p = m.begin(); p != m.end(); ++p)
+    _omap_rm(txc, p->first);
+  return 0;
+}
+
+int BlockStore::_omap_setheader(TransContext *txc, coll_t cid,
+				const ghobject_t &oid, const bufferlist &bl)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << dendl;
+  OnodeRef o = _get_onode(txc, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  _omap_open(txc, o);
+  _omap_set(txc, get_omap_header_key(o->onode.omap_head), bl);
+  return 0;
+}
+
+void BlockStore::_write_coll(TransContext *txc, coll_t cid)
+{
+  bufferlist bl;
+  ::encode(coll_map[cid], bl);
+  txc->t->set(PREFIX_COLL, cid.to_str(), bl);
+}
+
+int BlockStore::_create_collection(TransContext *txc, coll_t cid)
+{
+  dout(15) << __func__ << " " << cid << dendl;
+  if (coll_map.count(cid))
+    return -EEXIST;
+  coll_map[cid];
+  _write_coll(txc, cid);
+  return 0;
+}
+
+int BlockStore::_destroy_collection(TransContext *txc, coll_t cid)
+{
+  dout(15) << __func__ << " " << cid << dendl;
+  if (!coll_map.count(cid))
+    return -ENOENT;
+  set<string> keys;
+  _list_coll_keys(txc, cid, &keys);
+  if (!keys.empty())
+    return -ENOTEMPTY;
+  coll_map.erase(cid);
+  txc->t->rmkey(PREFIX_COLL, cid.to_str());
+  return 0;
+}
+
+int BlockStore::_collection_add(TransContext *txc, coll_t cid, coll_t ocid,
+				const ghobject_t &oid)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << " from " << ocid << dendl;
+  OnodeRef o = _get_onode(txc, ocid, oid, false);
+  if (!o)
+    return -ENOENT;
+  if (_get_onode(txc, cid, oid, false))
+    return -EEXIST;
+  OnodeRef n = _get_onode(txc, cid, oid, true);
+  if (!n)
+    return -ENOENT;
+  return _copy_object(txc, o, n);
+}
+
+int BlockStore::_collection_move_rename(TransContext *txc, coll_t oldcid,
+					const ghobject_t &oldoid,
+					coll_t newcid,
+					const ghobject_t &newoid)
+{
+  dout(15) << __func__ << " " << oldcid << "/" << oldoid << " -> "
+	   << newcid << "/" << newoid << dendl;
+  OnodeRef o = _get_onode(txc, oldcid, oldoid, false);
+  if (!o)
+    return -ENOENT;
+  if (_get_onode(txc, newcid, newoid, false))
+    return -EEXIST;
+  OnodeRef n = _get_onode(txc, newcid, newoid, true);
+  if (!n)
+    return -ENOENT;
+  _move_onode(txc, o, n, newoid);
+  return 0;
+}
+
+int BlockStore::_collection_setattr(TransContext *txc, coll_t cid,
+				    const string &name, const bufferlist &bl)
+{
+  dout(15) << __func__ << " " << cid << " " << name << dendl;
+  map<coll_t, map<string, bufferptr> >::iterator p = coll_map.find(cid);
+  if (p == coll_map.end())
+    return -ENOENT;
+  bufferptr bp(bl.length());
+  bl.copy(0, bl.length(), bp.c_str());
+  p->second[name] = bp;
+  _write_coll(txc, cid);
+  return 0;
+}
+
+int BlockStore::_collection_rmattr(TransContext *txc, coll_t cid,
+				   const string &name)
+{
+  dout(15) << __func__ << " " << cid << " " << name << dendl;
+  map<coll_t, map<string, bufferptr> >::iterator p = coll_map.find(cid);
+  if (p == coll_map.end())
+    return -ENOENT;
+  if (!p->second.erase(name))
+    return -ENODATA;
+  _write_coll(txc, cid);
+  return 0;
+}
+
+int BlockStore::_collection_rename(TransContext *txc, coll_t cid, coll_t ncid)
+{
+  dout(15) << __func__ << " " << cid << " -> " << ncid << dendl;
+  if (!coll_map.count(cid))
+    return -ENOENT;
+  if (coll_map.count(ncid))
+    return -EEXIST;
+  coll_map[ncid] = coll_map[cid];
+  _write_coll(txc, ncid);
+
+  set<string> keys;
+  _list_coll_keys(txc, cid, &keys);
+  for (set<string>::iterator p = keys.begin(); p != keys.end(); ++p) {
+    OnodeRef o = _load_onode(txc, *p);
+    OnodeRef n = _get_onode(txc, ncid, o->onode.oid, true);
+    _move_onode(txc, o, n, o->onode.oid);
+  }
+
+  coll_map.erase(cid);
+  txc->t->rmkey(PREFIX_COLL, cid.to_str());
+  return 0;
+}
+
+int BlockStore::_split_collection(TransContext *txc, coll_t cid, uint32_t bits,
+				  uint32_t rem, coll_t dest)
+{
+  dout(15) << __func__ << " " << cid << " bits " << bits << " rem " << rem
+	   << " -> " << dest << dendl;
+  if (!coll_map.count(cid) || !coll_map.count(dest))
+    return -ENOENT;
+
+  set<string> keys;
+  _list_coll_keys(txc, cid, &keys);
+  for (set<string>::iterator p = keys.begin(); p != keys.end(); ++p) {
+    OnodeRef o = _load_onode(txc, *p);
+    if (!o->onode.oid.match(bits, rem))
+      continue;
+    OnodeRef n = _get_onode(txc, dest, o->onode.oid, true);
+    _move_onode(txc, o, n, o->onode.oid);
+  }
+  return 0;
+}
+
+// -------------------------------------------------------
+// reads
+
+bool BlockStore::exists(coll_t cid, const ghobject_t& oid)
+{
+  RWLock::RLocker l(lock);
+  return _get_onode(NULL, cid, oid, false) != NULL;
+}
+
+int BlockStore::stat(coll_t cid, const ghobject_t& oid, struct stat *st,
+		     bool allow_eio)
+{
+  RWLock::RLocker l(lock);
+  OnodeRef o = _get_onode(NULL, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  memset(st, 0, sizeof(*st));
+  st->st_size = o->onode.size;
+  st->st_blksize = block_size;
+  uint64_t allocated = 0;
+  for (map<uint64_t, blockstore_extent_t>::iterator p =
+	 o->onode.extents.begin();
+       p != o->onode.extents.end();
+       ++p)
+    allocated += p->second.length;
+  st->st_blocks = allocated / 512;
+  st->st_nlink = 1;
+  return 0;
+}
+
+int BlockStore::read(coll_t cid, const ghobject_t& oid, uint64_t offset,
+		     size_t len, bufferlist& bl, bool allow_eio)
+{
+  dout(15) << __func__ << " " << cid << "/" << oid << " " << offset << "~"
+	   << len << dendl;
+  RWLock::RLocker l(lock);
+  OnodeRef o = _get_onode(NULL, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  if (len == 0)
+    len = o->onode.size;
+  if (offset >= o->onode.size)
+    return 0;
+  if (offset + len > o->onode.size)
+    len = o->onode.size - offset;
+  int r = _read_blocks(NULL, o->onode, offset, len, bl);
+  if (r < 0) {
+    assert(allow_eio || r != -EIO);
+    return r;
+  }
+  return len;
+}
+
+int BlockStore::fiemap(coll_t cid, const ghobject_t& oid, uint64_t offset,
+		       size_t len, bufferlist& bl)
+{
+  RWLock::RLocker l(lock);
+  OnodeRef o = _get_onode(NULL, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  map<uint64_t, uint64_t> m;
+  uint64_t end = MIN(offset + len, o->onode.size);
+  map<uint64_t, blockstore_extent_t>::iterator p =
+    o->onode.extents.upper_bound(offset);
+  if (p != o->onode.extents.begin())
+    --p;
+  for (; p != o->onode.extents.end() && p->first < end; ++p) {
+    uint64_t lo = MAX(p->first, offset);
+    uint64_t hi = MIN(p->first + p->second.length, end);
+    if (lo >= hi)
+      continue;
+    if (!m.empty() && m.rbegin()->first + m.rbegin()->second == lo)
+      m.rbegin()->second += hi - lo;
+    else
+      m[lo] = hi - lo;
+  }
+  ::encode(m, bl);
+  return 0;
+}
+
+int BlockStore::getattr(coll_t cid, const ghobject_t& oid, const char *name,
+			bufferptr& value)
+{
+  RWLock::RLocker l(lock);
+  OnodeRef o = _get_onode(NULL, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  map<string, bufferptr>::iterator p = o->onode.attrs.find(name);
+  if (p == o->onode.attrs.end())
+    return -ENODATA;
+  value = p->second;
+  return 0;
+}
+
+int BlockStore::getattrs(coll_t cid, const ghobject_t& oid,
+			 map<string,bufferptr>& aset, bool user_only)
+{
+  RWLock::RLocker l(lock);
+  OnodeRef o = _get_onode(NULL, cid, oid, false);
+  if (!o)
+    return -ENOENT;
+  for (map<string, bufferptr>::iterator p = o->onode.attrs.begin();
+       p != o->onode.attrs.end();
+       ++p) {
+    if (user_only) {
+      if (p->first[0] != '_' || p->first == "_")
+	continue;
+      aset[p->first.substr(1)] = p->second;
+    } else {
+      aset[p->first] = p->second;
+    }
+  }
+  return 0;
+}
+
+int BlockStore::list_collections(vector<coll_t>& ls)
+{
+  RWLock::RLocker l(lock);
+  for (map<coll_t, map<string, bufferptr> >::iterator p = coll_map.begin();
+       p != coll_map.end();
+       ++p)
+    ls.push_back(p->first);
+  return 0;
+}
+
+bool BlockStore::collection_exists(coll_t c)
+{
+  RWLock::RLocker l(lock);
+  return coll_map.count(c);
+}
+
+int BlockStore::collection_getattr(coll_t cid, const char *name,
+				   void *value, size_t size)
+{
+  RWLock::RLocker l(lock);
+  map<coll_t, map<string, bufferptr> >::iterator p = coll_map.find(cid);
+  if (p == coll_map.end())
+    return -ENOENT;
+  map<string, bufferptr>::iterator q = p->second.find(name);
+  if (q == p->second.end())
+    return -ENODATA;
+  size_t len = MIN(size, q->second.length());
+  memcpy(value, q->second.c_str(), len);
+  return len;
+}
+
+int BlockStore::collection_getattr(coll_t cid, const char *name,
+				   bufferlist& bl)
+{
+  RWLock::RLocker l(lock);
+  map<coll_t, map<string, bufferptr> >::iterator p = coll_map.find(cid);
+  if (p == coll_map.end())
+    return -ENOENT;
+  map<string, bufferptr>::iterator q = p->second.find(name);
+  if (q == p->second.end())
+    return -ENODATA;
+  bl.push_back(q->second);
+  return bl.length();
+}
+
+int BlockStore::collection_getattrs(coll_t cid, map<string,bufferptr> &aset)
+{
+  RWLock::RLocker l(lock);
+  map<coll_t, map<string, bufferptr> >::iterator p = coll_map.find(cid);
+  if (p == coll_map.end())
+    return -ENOENT;
+  aset = p->second;
+  return 0;
+}
+
+bool BlockStore::collection_empty(coll_t c)
+{
+  vector<ghobject_t> ls;
+  collection_list_partial(c, ghobject_t(), 1, 1, 0, &ls, NULL);
+  return ls.empty();
+}
+
+int BlockStore::collection_list(coll_t c, vector<ghobject_t>& o)
+{
+  return collection_list_range(c, ghobject_t(), ghobject_t::get_max(), 0, &o);
+}
+
+int BlockStore::collection_list_partial(coll_t c, ghobject_t start,
+					int min, int max, snapid_t snap,
+					vector<ghobject_t> *ls,
+					ghobject_t *next)
+{
+  dout(15) << __func__ << " " << c << " start " << start << dendl;
+  RWLock::RLocker l(lock);
+  if (!coll_map.count(c))
+    return -ENOENT;
+  string prefix = get_coll_prefix(c);
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_OBJ);
+  it->lower_bound(get_object_key(c, start));
+  while (true) {
+    if (!it->valid() || it->key().compare(0, prefix.length(), prefix) != 0) {
+      if (next)
+	*next = ghobject_t::get_max();
+      break;
+    }
+    blockstore_onode_t on;
+    bufferlist bl = it->value();
+    bufferlist::iterator p = bl.begin();
+    ::decode(on, p);
+    if ((int)ls->size() >= max) {
+      if (next)
+	*next = on.oid;
+      break;
+    }
+    if (on.oid.hobj.snap >= snap)
+      ls->push_back(on.oid);
+    it->next();
+  }
+  return 0;
+}
+
+int BlockStore::collection_list_range(coll_t c, ghobject_t start,
+				      ghobject_t end, snapid_t seq,
+				      vector<ghobject_t> *ls)
+{
+  dout(15) << __func__ << " " << c << " [" << start << ", " << end << ")"
+	   << dendl;
+  RWLock::RLocker l(lock);
+  if (!coll_map.count(c))
+    return -ENOENT;
+  string last = get_object_key(c, end);
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_OBJ);
+  for (it->lower_bound(get_object_key(c, start)); it->valid(); it->next()) {
+    if (it->key() >= last)
+      break;
+    blockstore_onode_t on;
+    bufferlist bl = it->value();
+    bufferlist::iterator p = bl.begin();
+    ::decode(on, p);
+    if (on.oid.hobj.snap >= seq)
+      ls->push_back(on.oid);
+  }
+  return 0;
+}
+
+int BlockStore::omap_get(coll_t c, const ghobject_t &oid, bufferlist *header,
+			 map<string, bufferlist> *out)
+{
+  RWLock::RLocker l(lock);
+  OnodeRef o = _get_onode(NULL, c, oid, false);
+  if (!o)
+    return -ENOENT;
+  if (!o->onode.omap_head)
+    return 0;
+  uint64_t nid = o->onode.omap_head;
+  string head = get_omap_header_key(nid);
+  string prefix = get_omap_prefix(nid) + '.';
+  map<string, bufferlist> m;
+  _omap_scan(NULL, head, get_omap_tail_key(nid), &m);
+  for (map<string, bufferlist>::iterator p = m.begin(); p != m.end(); ++p) {
+    if (p->first == head)
+      header->claim_append(p->second);
+    else
+      (*out)[p->first.substr(prefix.length())].claim(p->second);
+  }
+  return 0;
+}
+
+int BlockStore::omap_get_header(coll_t c, const ghobject_t &oid,
+				bufferlist *header, bool allow_eio)
+{
+  RWLock::RLocker l(lock);
+  OnodeRef o = _get_onode(NULL, c, oid, false);
+  if (!o)
+    return -ENOENT;
+  if (!o->onode.omap_head)
+    return 0;
+  bufferlist bl;
+  if (_get_kv(PREFIX_OMAP, get_omap_header_key(o->onode.omap_head), &bl) == 0)
+    header->claim_append(bl);
+  return 0;
+}
+
+int BlockStore::omap_get_keys(coll_t c, const ghobject_t &oid,
+			      set<string> *keys)
+{
+  RWLock::RLocker l(lock);
+  OnodeRef o = _get_onode(NULL, c, oid, false);
+  if (!o)
+    return -ENOENT;
+  if (!o->onode.omap_head)
+    return 0;
+  string prefix = get_omap_prefix(o->onode.omap_head) + '.';
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_OMAP);
+  for (it->lower_bound(prefix); it->valid(); it->next()) {
+    string key = it->key();
+    if (key.compare(0, prefix.length(), prefix) != 0)
+      break;
+    keys->insert(key.substr(prefix.length()));
+  }
+  return 0;
+}
+
+int BlockStore::omap_get_values(coll_t c, const ghobject_t &oid,
+				const set<string> &keys,
+				map<string, bufferlist> *out)
+{
+  RWLock::RLocker l(lock);
+  OnodeRef o = _get_onode(NULL, c, oid, false);
+  if (!o)
+    return -ENOENT;
+  if (!o->onode.omap_head)
+    return 0;
+  string prefix = get_omap_prefix(o->onode.omap_head) + '.';
+  set<string> want;
+  for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p)
+    want.insert(prefix + *p);
+  map<string, bufferlist> got;
+  int r = db->get(PREFIX_OMAP, want, &got);
+  if (r < 0)
+    return r;
+  for (map<string, bufferlist>::iterator p = got.begin(); p != got.end(); ++p)
+    (*out)[p->first.substr(prefix.length())].claim(p->second);
+  return 0;
+}
+
+int BlockStore::omap_check_keys(coll_t c, const ghobject_t &oid,
+				const set<string> &keys, set<string> *out)
+{
+  map<string, bufferlist> got;
+  int r = omap_get_values(c, oid, keys, &got);
+  if (r < 0)
+    return r;
+  for (map<string, bufferlist>::iterator p = got.begin(); p != got.end(); ++p)
+    out->insert(p->first);
+  return 0;
+}
+
+ObjectMap::ObjectMapIterator BlockStore::get_omap_iterator(
+  coll_t c, const ghobject_t &oid)
+{
+  RWLock::RLocker l(lock);
+  OnodeRef o = _get_onode(NULL, c, oid, false);
+  if (!o)
+    return ObjectMap::ObjectMapIterator();
+  return ObjectMap::ObjectMapIterator(
+    new OmapIteratorImpl(db->get_iterator(PREFIX_OMAP), o->onode.omap_head));
+}
@@ -0,0 +1,310 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_BLOCKSTORE_H
+#define CEPH_BLOCKSTORE_H
+
+#include "include/types.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <tr1/memory>
+
+#include "common/Finisher.h"
+#include "common/RWLock.h"
+#include "ObjectStore.h"
+#include "KeyValueDB.h"
+
+/// a run of device blocks backing part of an object
+struct blockstore_extent_t {
+  uint64_t offset;   ///< byte offset on the device
+  uint64_t length;   ///< bytes
+
+  blockstore_extent_t(uint64_t o = 0, uint64_t l = 0) : offset(o), length(l) {}
+
+  void encode(bufferlist& bl) const;
+  void decode(bufferlist::iterator& bl);
+};
+WRITE_CLASS_ENCODER(blockstore_extent_t)
+
+/// everything BlockStore knows about one object, apart from its omap
+struct blockstore_onode_t {
+  ghobject_t oid;
+  uint64_t size;
+  map<uint64_t, blockstore_extent_t> extents;  ///< logical offset -> device
+  map<string, bufferptr> attrs;
+  uint64_t omap_head;  ///< omap id, 0 if the object has no omap
+
+  blockstore_onode_t() : size(0), omap_head(0) {}
+
+  void encode(bufferlist& bl) const;
+  void decode(bufferlist::iterator& bl);
+};
+WRITE_CLASS_ENCODER(blockstore_onode_t)
+
+/**
+ * An ObjectStore that manages a raw block device (or a file standing in
+ * for one) itself instead of going through a local file system.
+ *
+ * <path>/block is the data device and <path>/db a leveldb holding the
+ * superblock, the free list, the collections, the object metadata
+ * (size, block map, xattrs) and the omaps.  Object data is written
+ * copy-on-write in whole blocks: new blocks are allocated and written,
+ * the block device is synced, and then the new block map, the free
+ * list and all other metadata changes of the batch are committed in a
+ * single leveldb transaction.  The blocks that were overwritten go back
+ * to the free list in that same transaction.  There is no journal, so
+ * every byte is written to the device once.
+ *
+ * Transactions are applied and committed synchronously under one lock,
+ * so readers see either all or none of a batch; completions are
+ * delivered from a finisher.
+ */
+class BlockStore : public ObjectStore {
+protected:
+  /// in-memory state of an object while a batch works on it
+  struct Onode {
+    string key;
+    blockstore_onode_t onode;
+    bool exists;
+    bool dirty;
+    Onode(const string &k) : key(k), exists(false), dirty(false) {}
+  };
+  typedef std::tr1::shared_ptr<Onode> OnodeRef;
+
+  /// the pending changes of one queue_transactions() batch
+  struct TransContext {
+    KeyValueDB::Transaction t;
+    map<string, OnodeRef> onodes;   ///< objects this batch has looked at
+    /// omap keys this batch has set (true) or removed (false)
+    map<string, pair<bool, bufferlist> > omap;
+    vector<blockstore_extent_t> released;  ///< freed when the batch commits
+    /// data keys written by this batch, for stores keeping data in the db
+    map<string, bufferlist> data;
+    bool data_written;
+    bool nid_dirty;
+    TransContext(KeyValueDB::Transaction t)
+      : t(t), data_written(false), nid_dirty(false) {}
+  };
+
+  class OmapIteratorImpl;
+
+  string path;
+  KeyValueDB *db;
+  uint64_t block_size;
+  uint64_t nid_max;
+
+  int _get_kv(const string &prefix, const string &key, bufferlist *bl);
+
+  /**
+   * @defgroup data placement
+   *
+   * Where object data lives.  The block map of an object maps logical
+   * offsets to extents; what an extent's offset means is up to these.
+   * @{
+   */
+  /// block size for a new store
+  virtual uint64_t _get_mkfs_block_size();
+  virtual int _open_data(bool create);
+  virtual void _close_data();
+  /// wipe and set up the data area at mkfs
+  virtual void _mkfs_data(KeyValueDB::Transaction t);
+  /// load allocator state at mount
+  virtual int _load_data();
+  /// put length bytes (whole blocks) at p somewhere new
+  virtual int _write_extents(TransContext *txc, const char *p, uint64_t length,
+			     vector<blockstore_extent_t> *out);
+  /// read length bytes at offset into extent e
+  virtual int _read_extent(TransContext *txc, const blockstore_extent_t &e,
+			   uint64_t offset, uint64_t length, char *out);
+  /// e is no longer referenced once txc commits
+  virtual void _release_extent(TransContext *txc, const blockstore_extent_t &e);
+  /// make txc's data stable before its metadata is committed
+  virtual int _commit_data(TransContext *txc);
+  /** @} data placement */
+
+private:
+  int fsid_fd, block_fd;
+  uuid_d fsid;
+  bool mounted;
+
+  /// held for write while a batch is applied and committed
+  RWLock lock;
+  Finisher finisher;
+
+  uint64_t dev_size;
+  bool allow_sharded_objects;
+
+  map<coll_t, map<string, bufferptr> > coll_map;  ///< collection -> attrs
+
+  map<uint64_t, uint64_t> free_map;  ///< device offset -> length
+  uint64_t free_bytes;
+  uint64_t alloc_cursor;
+
+  filestore_perf_stat_t cur_stats;
+
+  int _open_fsid(bool create);
+  int _lock_fsid();
+  int _read_fsid(uuid_d *uuid);
+  int _write_fsid();
+  int _open_db(bool create);
+  void _close();
+  int _load_super();
+  int _load_collections();
+
+  // allocator
+  int _allocate(TransContext *txc, uint64_t want,
+		vector<blockstore_extent_t> *out);
+  void _release(TransContext *txc, uint64_t offset, uint64_t length);
+
+  // objects
+  OnodeRef _load_onode(TransContext *txc, const string &key);
+  OnodeRef _get_onode(TransContext *txc, coll_t cid, const ghobject_t &oid,
+		      bool create);
+  void _list_coll_keys(TransContext *txc, coll_t cid, set<string> *keys);
+  int _read_blocks(TransContext *txc, const blockstore_onode_t &on,
+		   uint64_t offset,
+		   uint64_t length, bufferlist &bl);
+  bool _has_blocks(const blockstore_onode_t &on, uint64_t offset,
+		   uint64_t length);
+  void _punch(TransContext *txc, OnodeRef o, uint64_t offset, uint64_t length);
+  int _do_write(TransContext *txc, OnodeRef o, uint64_t offset,
+		const bufferlist &bl);
+  int _do_zero(TransContext *txc, OnodeRef o, uint64_t offset,
+	       uint64_t length);
+  int _do_truncate(TransContext *txc, OnodeRef o, uint64_t size);
+  void _do_remove(TransContext *txc, OnodeRef o);
+  int _copy_object(TransContext *txc, OnodeRef o, OnodeRef n);
+  void _move_onode(TransContext *txc, OnodeRef o, OnodeRef n,
+		   const ghobject_t &newoid);
+
+  // omap
+  void _omap_open(TransContext *txc, OnodeRef o);
+  void _omap_set(TransContext *txc, const string &key, const bufferlist &bl);
+  void _omap_rm(TransContext *txc, const string &key);
+  void _omap_scan(TransContext *txc, const string &first, const string &last,
+		  map<string, bufferlist> *out);
+  void _omap_clear_onode(TransContext *txc, OnodeRef o);
+
+  // transactions
+  void _do_transaction(TransContext *txc, Transaction &t);
+  int _txc_commit(TransContext *txc);
+
+  int _touch(TransContext *txc, coll_t cid, const ghobject_t &oid);
+  int _write(TransContext *txc, coll_t cid, const ghobject_t &oid,
+	     uint64_t offset, const bufferlist &bl);
+  int _zero(TransContext *txc, coll_t cid, const ghobject_t &oid,
+	    uint64_t offset, uint64_t length);
+  int _truncate(TransContext *txc, coll_t cid, const ghobject_t &oid,
+		uint64_t size);
+  int _remove(TransContext *txc, coll_t cid, const ghobject_t &oid);
+  int _setattrs(TransContext *txc, coll_t cid, const ghobject_t &oid,
+		map<string, bufferptr> &aset);
+  int _rmattr(TransContext *txc, coll_t cid, const ghobject_t &oid,
+	      const string &name);
+  int _rmattrs(TransContext *txc, coll_t cid, const ghobject_t &oid);
+  int _clone(TransContext *txc, coll_t cid, const ghobject_t &oid,
+	     const ghobject_t &noid);
+  int _clone_range(TransContext *txc, coll_t cid, const ghobject_t &oid,
+		   const ghobject_t &noid, uint64_t srcoff, uint64_t length,
+		   uint64_t dstoff);
+  int _omap_clear(TransContext *txc, coll_t cid, const ghobject_t &oid);
+  int _omap_setkeys(TransContext *txc, coll_t cid, const ghobject_t &oid,
+		    const map<string, bufferlist> &aset);
+  int _omap_rmkeys(TransContext *txc, coll_t cid, const ghobject_t &oid,
+		   const set<string> &keys);
+  int _omap_rmkeyrange(TransContext *txc, coll_t cid, const ghobject_t &oid,
+		       const string &first, const string &last);
+  int _omap_setheader(TransContext *txc, coll_t cid, const ghobject_t &oid,
+		      const bufferlist &bl);
+
+  void _write_coll(TransContext *txc, coll_t cid);
+  int _create_collection(TransContext *txc, coll_t cid);
+  int _destroy_collection(TransContext *txc, coll_t cid);
+  int _collection_add(TransContext *txc, coll_t cid, coll_t ocid,
+		      const ghobject_t &oid);
+  int _collection_move_rename(TransContext *txc, coll_t oldcid,
+			      const ghobject_t &oldoid, coll_t newcid,
+			      const ghobject_t &newoid);
+  int _collection_setattr(TransContext *txc, coll_t cid, const string &name,
+			  const bufferlist &bl);
+  int _collection_rmattr(TransContext *txc, coll_t cid, const string &name);
+  int _collection_rename(TransContext *txc, coll_t cid, coll_t ncid);
+  int _split_collection(TransContext *txc, coll_t cid, uint32_t bits,
+			uint32_t rem, coll_t dest);
+
+public:
+  BlockStore(const string &path);
+  virtual ~BlockStore();
+
+  filestore_perf_stat_t get_cur_stats();
+
+  int update_version_stamp() { return 0; }
+  bool test_mount_in_use();
+  int mount();
+  int umount();
+  int get_max_object_name_length() { return 4096; }
+  int mkfs();
+  int mkjournal() { return 0; }
+  void set_allow_sharded_objects();
+  bool get_allow_sharded_objects();
+
+  int statfs(struct statfs *buf);
+
+  int queue_transactions(Sequencer *osr, list<Transaction*>& tls,
+			 TrackedOpRef op = TrackedOpRef());
+
+  bool exists(coll_t cid, const ghobject_t& oid);
+  int stat(coll_t cid, const ghobject_t& oid, struct stat *st,
+	   bool allow_eio = false);
+  int read(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len,
+	   bufferlist& bl, bool allow_eio = false);
+  int fiemap(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len,
+	     bufferlist& bl);
+  int getattr(coll_t cid, const ghobject_t& oid, const char *name,
+	      bufferptr& value);
+  int getattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr>& aset,
+	       bool user_only = false);
+
+  int list_collections(vector<coll_t>& ls);
+  bool collection_exists(coll_t c);
+  int collection_getattr(coll_t cid, const char *name,
+			 void *value, size_t size);
+  int collection_getattr(coll_t cid, const char *name, bufferlist& bl);
+  int collection_getattrs(coll_t cid, map<string,bufferptr> &aset);
+  bool collection_empty(coll_t c);
+  int collection_list(coll_t c, vector<ghobject_t>& o);
+  int collection_list_partial(coll_t c, ghobject_t start,
+			      int min, int max, snapid_t snap,
+			      vector<ghobject_t> *ls, ghobject_t *next);
+  int collection_list_range(coll_t c, ghobject_t start, ghobject_t end,
+			    snapid_t seq, vector<ghobject_t> *ls);
+
+  int omap_get(coll_t c, const ghobject_t &oid, bufferlist *header,
+	       map<string, bufferlist> *out);
+  int omap_get_header(coll_t c, const ghobject_t &oid, bufferlist *header,
+		      bool allow_eio = false);
+  int omap_get_keys(coll_t c, const ghobject_t &oid, set<string> *keys);
+  int omap_get_values(coll_t c, const ghobject_t &oid,
+		      const set<string> &keys, map<string, bufferlist> *out);
+  int omap_check_keys(coll_t c, const ghobject_t &oid,
+		      const set<string> &keys, set<string> *out);
+  ObjectMap::ObjectMapIterator get_omap_iterator(coll_t c,
+						 const ghobject_t &oid);
+
+  void set_fsid(uuid_d u) { fsid = u; }
+  uuid_d get_fsid() { return fsid; }
+};
+
+#endif
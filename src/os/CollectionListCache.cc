@@ -0,0 +1,109 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "CollectionListCache.h"
+
+void CollectionListCache::_drop(map<coll_t, Entry>::iterator p)
+{
+  num_objects -= p->second.objects.size();
+  lru.erase(p->second.lru_pos);
+  entries.erase(p);
+}
+
+void CollectionListCache::_trim(const coll_t *keep)
+{
+  list<coll_t>::iterator i = lru.end();
+  while (num_objects > max_objects && i != lru.begin()) {
+    --i;
+    if (keep && *i == *keep)
+      continue;
+    map<coll_t, Entry>::iterator p = entries.find(*i);
+    ++i;  // _drop erases the position i pointed at
+    _drop(p);
+  }
+  if (keep && num_objects > max_objects) {
+    map<coll_t, Entry>::iterator p = entries.find(*keep);
+    if (p != entries.end())
+      _drop(p);
+  }
+}
+
+void CollectionListCache::set_max(uint64_t max)
+{
+  Mutex::Locker l(lock);
+  max_objects = max;
+  _trim(NULL);
+}
+
+void CollectionListCache::fill(const coll_t &c, const vector<ghobject_t> &ls)
+{
+  Mutex::Locker l(lock);
+  map<coll_t, Entry>::iterator p = entries.find(c);
+  if (p != entries.end())
+    _drop(p);
+  if (!max_objects || ls.size() > max_objects)
+    return;
+  lru.push_front(c);
+  Entry &e = entries[c];
+  e.lru_pos = lru.begin();
+  e.objects.insert(ls.begin(), ls.end());
+  num_objects += e.objects.size();
+  _trim(&c);
+}
+
+bool CollectionListCache::list_partial(
+  const coll_t &c,
+  const ghobject_t &start,
+  int max_count,
+  snapid_t seq,
+  vector<ghobject_t> *ls,
+  ghobject_t *next)
+{
+  Mutex::Locker l(lock);
+  map<coll_t, Entry>::iterator p = entries.find(c);
+  if (p == entries.end())
+    return false;
+  lru.splice(lru.begin(), lru, p->second.lru_pos);
+  const set<ghobject_t> &objects = p->second.objects;
+  list_range(objects.lower_bound(start), objects.end(),
+	     max_count, seq, ls, next);
+  return true;
+}
+
+void CollectionListCache::add(const coll_t &c, const ghobject_t &oid)
+{
+  Mutex::Locker l(lock);
+  map<coll_t, Entry>::iterator p = entries.find(c);
+  if (p == entries.end())
+    return;
+  if (p->second.objects.insert(oid).second) {
+    ++num_objects;
+    _trim(&c);
+  }
+}
+
+void CollectionListCache::remove(const coll_t &c, const ghobject_t &oid)
+{
+  Mutex::Locker l(lock);
+  map<coll_t, Entry>::iterator p = entries.find(c);
+  if (p == entries.end())
+    return;
+  num_objects -= p->second.objects.erase(oid);
+}
+
+void CollectionListCache::clear(const coll_t &c)
+{
+  Mutex::Locker l(lock);
+  map<coll_t, Entry>::iterator p = entries.find(c);
+  if (p != entries.end())
+    _drop(p);
+}
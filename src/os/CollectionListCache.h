@@ -0,0 +1,110 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COLLECTIONLISTCACHE_H
+#define CEPH_COLLECTIONLISTCACHE_H
+
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+#include "common/hobject.h"
+#include "common/Mutex.h"
+#include "include/types.h"
+#include "osd/osd_types.h"
+
+/**
+ * CollectionListCache
+ *
+ * Sorted listings of whole collections, so that listing a range of a
+ * collection is a lookup in a set instead of a walk of its directories.
+ * A listing is filled from a full directory walk, then kept up to date
+ * by the collection's index as objects are created and removed, and
+ * dropped whenever objects move in some other way.
+ *
+ * At most max_objects objects are remembered over all collections;
+ * the least recently listed collections are dropped to make room, and
+ * a collection larger than that is not cached at all, and 0 disables
+ * the cache.  It is in memory only, so it starts empty at every mount.
+ */
+class CollectionListCache {
+  Mutex lock;
+  uint64_t max_objects;
+  uint64_t num_objects;
+
+  struct Entry {
+    set<ghobject_t> objects;
+    list<coll_t>::iterator lru_pos;
+  };
+  map<coll_t, Entry> entries;
+  list<coll_t> lru; ///< most recently listed first
+
+  void _drop(map<coll_t, Entry>::iterator p);
+  /// Drop collections until within max_objects, keep (if any) last
+  void _trim(const coll_t *keep);
+
+public:
+  CollectionListCache(uint64_t max)
+    : lock("CollectionListCache::lock"),
+      max_objects(max), num_objects(0) {}
+
+  void set_max(uint64_t max);
+
+  /// Remember ls as the full listing of c, if it fits
+  void fill(const coll_t &c, const vector<ghobject_t> &ls);
+
+  /**
+   * List c from start, like CollectionIndex::collection_list_partial
+   *
+   * @return false if c is not cached
+   */
+  bool list_partial(
+    const coll_t &c,
+    const ghobject_t &start,
+    int max_count,
+    snapid_t seq,
+    vector<ghobject_t> *ls,
+    ghobject_t *next);
+
+  /// oid was created in c
+  void add(const coll_t &c, const ghobject_t &oid);
+
+  /// oid was removed from c
+  void remove(const coll_t &c, const ghobject_t &oid);
+
+  /// Forget the listing of c
+  void clear(const coll_t &c);
+
+  /// Pick objects from a sorted range as collection_list_partial would
+  template <typename I>
+  static void list_range(
+    I begin, I end,
+    int max_count,
+    snapid_t seq,
+    vector<ghobject_t> *ls,
+    ghobject_t *next) {
+    for (I i = begin; i != end; ++i) {
+      if (max_count > 0 && ls->size() == (unsigned)max_count) {
+	if (next)
+	  *next = *i;
+	return;
+      }
+      if (i->hobj.snap < seq)
+	continue;
+      ls->push_back(*i);
+    }
+    if (next)
+      *next = ghobject_t(hobject_t::get_max());
+  }
+};
+
+#endif
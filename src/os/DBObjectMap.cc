@@ -18,6 +18,7 @@
 #include "common/debug.h"
 #include "common/config.h"
 #include "include/assert.h"
+#include "include/hash.h"
 
 #define dout_subsys ceph_subsys_filestore
 #undef dout_prefix
@@ -320,7 +321,8 @@ int DBObjectMap::DBObjectMapIteratorImpl::init()
 ObjectMap::ObjectMapIterator DBObjectMap::get_iterator(
   const ghobject_t &oid)
 {
-  Header header = lookup_map_header(oid);
+  MapHeaderLock hl(this, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header)
     return ObjectMapIterator(new EmptyIteratorImpl());
   return _get_iterator(header);
@@ -507,8 +509,9 @@ int DBObjectMap::set_keys(const ghobject_t &oid,
 			  const map<string, bufferlist> &set,
 			  const SequencerPosition *spos)
 {
+  MapHeaderLock hl(this, oid);
   KeyValueDB::Transaction t = db->get_transaction();
-  Header header = lookup_create_map_header(oid, t);
+  Header header = lookup_create_map_header(hl, oid, t);
   if (!header)
     return -EINVAL;
   if (check_spos(oid, header, spos))
@@ -523,8 +526,9 @@ int DBObjectMap::set_header(const ghobject_t &oid,
 			    const bufferlist &bl,
 			    const SequencerPosition *spos)
 {
+  MapHeaderLock hl(this, oid);
   KeyValueDB::Transaction t = db->get_transaction();
-  Header header = lookup_create_map_header(oid, t);
+  Header header = lookup_create_map_header(hl, oid, t);
   if (!header)
     return -EINVAL;
   if (check_spos(oid, header, spos))
@@ -544,7 +548,8 @@ void DBObjectMap::_set_header(Header header, const bufferlist &bl,
 int DBObjectMap::get_header(const ghobject_t &oid,
 			    bufferlist *bl)
 {
-  Header header = lookup_map_header(oid);
+  MapHeaderLock hl(this, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header) {
     return 0;
   }
@@ -575,16 +580,27 @@ int DBObjectMap::_get_header(Header header,
   return 0;
 }
 
+void DBObjectMap::compact_range(const ghobject_t &oid,
+				const string &first, const string &last)
+{
+  MapHeaderLock hl(this, oid);
+  Header header = lookup_map_header(hl, oid);
+  if (!header)
+    return;
+  db->compact_range_async(user_prefix(header), first, last);
+}
+
 int DBObjectMap::clear(const ghobject_t &oid,
 		       const SequencerPosition *spos)
 {
+  MapHeaderLock hl(this, oid);
   KeyValueDB::Transaction t = db->get_transaction();
-  Header header = lookup_map_header(oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header)
     return -ENOENT;
   if (check_spos(oid, header, spos))
     return 0;
-  remove_map_header(oid, header, t);
+  remove_map_header(hl, oid, header, t);
   assert(header->num_children > 0);
   header->num_children--;
   int r = _clear(header, t);
@@ -699,7 +715,8 @@ int DBObjectMap::rm_keys(const ghobject_t &oid,
 			 const set<string> &to_clear,
 			 const SequencerPosition *spos)
 {
-  Header header = lookup_map_header(oid);
+  MapHeaderLock hl(this, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header)
     return -ENOENT;
   KeyValueDB::Transaction t = db->get_transaction();
@@ -763,7 +780,7 @@ int DBObjectMap::rm_keys(const ghobject_t &oid,
     parent->num_children--;
     _clear(parent, t);
     header->parent = 0;
-    set_map_header(oid, *header, t);
+    set_map_header(hl, oid, *header, t);
     t->rmkeys_by_prefix(complete_prefix(header));
   }
   return db->submit_transaction(t);
@@ -773,7 +790,8 @@ int DBObjectMap::get(const ghobject_t &oid,
 		     bufferlist *_header,
 		     map<string, bufferlist> *out)
 {
-  Header header = lookup_map_header(oid);
+  MapHeaderLock hl(this, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header)
     return -ENOENT;
   _get_header(header, _header);
@@ -789,10 +807,11 @@ int DBObjectMap::get(const ghobject_t &oid,
 int DBObjectMap::get_keys(const ghobject_t &oid,
 			  set<string> *keys)
 {
-  Header header = lookup_map_header(oid);
+  MapHeaderLock hl(this, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header)
     return -ENOENT;
-  ObjectMapIterator iter = get_iterator(oid);
+  ObjectMapIterator iter = _get_iterator(header);
   for (; iter->valid(); iter->next()) {
     if (iter->status())
       return iter->status();
@@ -827,7 +846,8 @@ int DBObjectMap::get_values(const ghobject_t &oid,
 			    const set<string> &keys,
 			    map<string, bufferlist> *out)
 {
-  Header header = lookup_map_header(oid);
+  MapHeaderLock hl(this, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header)
     return -ENOENT;
   return scan(header, keys, 0, out);
@@ -837,7 +857,8 @@ int DBObjectMap::check_keys(const ghobject_t &oid,
 			    const set<string> &keys,
 			    set<string> *out)
 {
-  Header header = lookup_map_header(oid);
+  MapHeaderLock hl(this, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header)
     return -ENOENT;
   return scan(header, keys, out, 0);
@@ -847,7 +868,8 @@ int DBObjectMap::get_xattrs(const ghobject_t &oid,
 			    const set<string> &to_get,
 			    map<string, bufferlist> *out)
 {
-  Header header = lookup_map_header(oid);
+  MapHeaderLock hl(this, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header)
     return -ENOENT;
   return db->get(xattr_prefix(header), to_get, out);
@@ -856,7 +878,8 @@ int DBObjectMap::get_xattrs(const ghobject_t &oid,
 int DBObjectMap::get_all_xattrs(const ghobject_t &oid,
 				set<string> *out)
 {
-  Header header = lookup_map_header(oid);
+  MapHeaderLock hl(this, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header)
     return -ENOENT;
   KeyValueDB::Iterator iter = db->get_iterator(xattr_prefix(header));
@@ -871,8 +894,9 @@ int DBObjectMap::set_xattrs(const ghobject_t &oid,
 			    const map<string, bufferlist> &to_set,
 			    const SequencerPosition *spos)
 {
+  MapHeaderLock hl(this, oid);
   KeyValueDB::Transaction t = db->get_transaction();
-  Header header = lookup_create_map_header(oid, t);
+  Header header = lookup_create_map_header(hl, oid, t);
   if (!header)
     return -EINVAL;
   if (check_spos(oid, header, spos))
@@ -885,8 +909,9 @@ int DBObjectMap::remove_xattrs(const ghobject_t &oid,
 			       const set<string> &to_remove,
 			       const SequencerPosition *spos)
 {
+  MapHeaderLock hl(this, oid);
   KeyValueDB::Transaction t = db->get_transaction();
-  Header header = lookup_map_header(oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header)
     return -ENOENT;
   if (check_spos(oid, header, spos))
@@ -902,11 +927,17 @@ int DBObjectMap::clone(const ghobject_t &oid,
   if (oid == target)
     return 0;
 
+  // lock in a fixed order, or two clones between the same pair deadlock
+  MapHeaderLock hl1(this, std::min(oid, target));
+  MapHeaderLock hl2(this, std::max(oid, target));
+  MapHeaderLock &source_lock = (oid < target) ? hl1 : hl2;
+  MapHeaderLock &target_lock = (oid < target) ? hl2 : hl1;
+
   KeyValueDB::Transaction t = db->get_transaction();
   {
-    Header destination = lookup_map_header(target);
+    Header destination = lookup_map_header(target_lock, target);
     if (destination) {
-      remove_map_header(target, destination, t);
+      remove_map_header(target_lock, target, destination, t);
       if (check_spos(target, destination, spos))
 	return 0;
       destination->num_children--;
@@ -914,7 +945,7 @@ int DBObjectMap::clone(const ghobject_t &oid,
     }
   }
 
-  Header parent = lookup_map_header(oid);
+  Header parent = lookup_map_header(source_lock, oid);
   if (!parent)
     return db->submit_transaction(t);
 
@@ -925,8 +956,8 @@ int DBObjectMap::clone(const ghobject_t &oid,
 
   parent->num_children = 2;
   set_header(parent, t);
-  set_map_header(oid, *source, t);
-  set_map_header(target, *destination, t);
+  set_map_header(source_lock, oid, *source, t);
+  set_map_header(target_lock, target, *destination, t);
 
   map<string, bufferlist> to_set;
   KeyValueDB::Iterator xattr_iter = db->get_iterator(xattr_prefix(parent));
@@ -1051,17 +1082,61 @@ int DBObjectMap::sync(const ghobject_t *oid,
   write_state(t);
   if (oid) {
     assert(spos);
-    Header header = lookup_map_header(*oid);
+    MapHeaderLock hl(this, *oid);
+    Header header = lookup_map_header(hl, *oid);
     if (header) {
       dout(10) << "oid: " << *oid << " setting spos to "
 	       << *spos << dendl;
       header->spos = *spos;
-      set_map_header(*oid, *header, t);
+      set_map_header(hl, *oid, *header, t);
     }
   }
   return db->submit_transaction_sync(t);
 }
 
+DBObjectMap::DBObjectMap(KeyValueDB *db)
+  : db(db),
+    header_lock("DBOBjectMap")
+{
+  int num_shards = std::max(1, g_conf->filestore_omap_header_cache_shards);
+  size_t per_shard = std::max(1, g_conf->filestore_omap_header_cache_size /
+			      num_shards);
+  for (int i = 0; i < num_shards; ++i)
+    header_shards.push_back(new HeaderShard(per_shard));
+}
+
+DBObjectMap::~DBObjectMap()
+{
+  for (vector<HeaderShard*>::iterator i = header_shards.begin();
+       i != header_shards.end();
+       ++i)
+    delete *i;
+}
+
+DBObjectMap::HeaderShard *DBObjectMap::get_shard(const ghobject_t &oid)
+{
+  return header_shards[rjhash32(oid.hobj.hash) % header_shards.size()];
+}
+
+DBObjectMap::MapHeaderLock::MapHeaderLock(DBObjectMap *db,
+					  const ghobject_t &oid)
+  : db(db), oid(oid)
+{
+  HeaderShard *shard = db->get_shard(oid);
+  Mutex::Locker l(shard->lock);
+  while (shard->map_header_in_use.count(oid))
+    shard->cond.Wait(shard->lock);
+  shard->map_header_in_use.insert(oid);
+}
+
+DBObjectMap::MapHeaderLock::~MapHeaderLock()
+{
+  HeaderShard *shard = db->get_shard(oid);
+  Mutex::Locker l(shard->lock);
+  shard->map_header_in_use.erase(oid);
+  shard->cond.SignalAll();
+}
+
 int DBObjectMap::write_state(KeyValueDB::Transaction _t) {
   dout(20) << "dbobjectmap: seq is " << state.seq << dendl;
   KeyValueDB::Transaction t = _t ? _t : db->get_transaction();
@@ -1074,10 +1149,16 @@ int DBObjectMap::write_state(KeyValueDB::Transaction _t) {
 }
 
 
-DBObjectMap::Header DBObjectMap::_lookup_map_header(const ghobject_t &oid)
+DBObjectMap::Header DBObjectMap::lookup_map_header(
+  const MapHeaderLock &l,
+  const ghobject_t &oid)
 {
-  while (map_header_in_use.count(oid))
-    header_cond.Wait(header_lock);
+  assert(l.get_locked() == oid);
+
+  HeaderShard *shard = get_shard(oid);
+  Header ret(new _Header());
+  if (shard->cache.lookup(oid, ret.get()))
+    return ret;
 
   map<string, bufferlist> out;
   set<string> to_get;
@@ -1088,9 +1169,9 @@ DBObjectMap::Header DBObjectMap::_lookup_map_header(const ghobject_t &oid)
   if (out.empty())
     return Header();
   
-  Header ret(new _Header(), RemoveMapHeaderOnDelete(this, oid));
   bufferlist::iterator iter = out.begin()->second.begin();
   ret->decode(iter);
+  shard->cache.add(oid, *ret);
   return ret;
 }
 
@@ -1144,14 +1225,14 @@ DBObjectMap::Header DBObjectMap::lookup_parent(Header input)
 }
 
 DBObjectMap::Header DBObjectMap::lookup_create_map_header(
+  const MapHeaderLock &hl,
   const ghobject_t &oid,
   KeyValueDB::Transaction t)
 {
-  Mutex::Locker l(header_lock);
-  Header header = _lookup_map_header(oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header) {
-    header = _generate_new_header(oid, Header());
-    set_map_header(oid, *header, t);
+    header = generate_new_header(oid, Header());
+    set_map_header(hl, oid, *header, t);
   }
   return header;
 }
@@ -1176,26 +1257,32 @@ void DBObjectMap::set_header(Header header, KeyValueDB::Transaction t)
   t->set(sys_prefix(header), to_write);
 }
 
-void DBObjectMap::remove_map_header(const ghobject_t &oid,
+void DBObjectMap::remove_map_header(const MapHeaderLock &l,
+				    const ghobject_t &oid,
 				    Header header,
 				    KeyValueDB::Transaction t)
 {
+  assert(l.get_locked() == oid);
   dout(20) << "remove_map_header: removing " << header->seq
 	   << " oid " << oid << dendl;
   set<string> to_remove;
   to_remove.insert(map_header_key(oid));
   t->rmkeys(HOBJECT_TO_SEQ, to_remove);
+  get_shard(oid)->cache.clear(oid);
 }
 
-void DBObjectMap::set_map_header(const ghobject_t &oid, _Header header,
+void DBObjectMap::set_map_header(const MapHeaderLock &l,
+				 const ghobject_t &oid, _Header header,
 				 KeyValueDB::Transaction t)
 {
+  assert(l.get_locked() == oid);
   dout(20) << "set_map_header: setting " << header.seq
 	   << " oid " << oid << " parent seq "
 	   << header.parent << dendl;
   map<string, bufferlist> to_set;
   header.encode(to_set[map_header_key(oid)]);
   t->set(HOBJECT_TO_SEQ, to_set);
+  get_shard(oid)->cache.add(oid, header);
 }
 
 bool DBObjectMap::check_spos(const ghobject_t &oid,
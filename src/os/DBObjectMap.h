@@ -16,6 +16,7 @@
 #include "osd/osd_types.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
+#include "common/simple_cache.hpp"
 
 /**
  * DBObjectMap: Implements ObjectMap in terms of KeyValueDB
@@ -50,6 +51,11 @@
  * the complete set, we have to check the parent if we don't find it in the
  * key set.  During rm_keys, we copy keys from the parent and update the
  * complete set to reflect the change @see rm_keys.
+ *
+ * Operations on an object are serialized by a MapHeaderLock on its
+ * ghobject_t, and its leaf header is cached, decoded, so that most ops
+ * need not read HOBJECT_TO_SEQ.  Both are split by object hash into
+ * filestore_omap_header_cache_shards independently locked shards.
  */
 class DBObjectMap : public ObjectMap {
 public:
@@ -60,17 +66,14 @@ public:
    */
   Mutex header_lock;
   Cond header_cond;
-  Cond map_header_cond;
 
   /**
    * Set of headers currently in use
    */
   set<uint64_t> in_use;
-  set<ghobject_t> map_header_in_use;
 
-  DBObjectMap(KeyValueDB *db) : db(db),
-				header_lock("DBOBjectMap")
-    {}
+  DBObjectMap(KeyValueDB *db);
+  ~DBObjectMap();
 
   int set_keys(
     const ghobject_t &oid,
@@ -164,6 +167,10 @@ public:
   /// Ensure that all previous operations are durable
   int sync(const ghobject_t *oid=0, const SequencerPosition *spos=0);
 
+  /// Queue a compaction of the user keys of oid in [first, last)
+  void compact_range(const ghobject_t &oid,
+		     const string &first, const string &last);
+
   /// Util, list all objects, there must be no other concurrent access
   int list_objects(vector<ghobject_t> *objs ///< [out] objects
     );
@@ -277,6 +284,34 @@ private:
   /// Implicit lock on Header->seq
   typedef std::tr1::shared_ptr<_Header> Header;
 
+  /// Objects locked by a MapHeaderLock and cached leaf headers
+  struct HeaderShard {
+    Mutex lock;
+    Cond cond;
+    set<ghobject_t> map_header_in_use;
+    SimpleLRU<ghobject_t, _Header> cache;
+    HeaderShard(size_t size)
+      : lock("DBObjectMap::HeaderShard::lock"), cache(size) {}
+  };
+  vector<HeaderShard*> header_shards;
+
+  HeaderShard *get_shard(const ghobject_t &oid);
+
+  /**
+   * Exclusive lock on the leaf header of oid, held for the duration of
+   * an operation on it
+   */
+  class MapHeaderLock {
+    DBObjectMap *db;
+    ghobject_t oid;
+  public:
+    MapHeaderLock(DBObjectMap *db, const ghobject_t &oid);
+    ~MapHeaderLock();
+    const ghobject_t &get_locked() const {
+      return oid;
+    }
+  };
+
   string map_header_key(const ghobject_t &oid);
   string header_key(uint64_t seq);
   string complete_prefix(Header header);
@@ -369,12 +404,14 @@ private:
   void set_header(Header input, KeyValueDB::Transaction t);
 
   /// Remove leaf node corresponding to oid in c
-  void remove_map_header(const ghobject_t &oid,
+  void remove_map_header(const MapHeaderLock &l,
+			 const ghobject_t &oid,
 			 Header header,
 			 KeyValueDB::Transaction t);
 
   /// Set leaf node for c and oid to the value of header
-  void set_map_header(const ghobject_t &oid, _Header header,
+  void set_map_header(const MapHeaderLock &l,
+		      const ghobject_t &oid, _Header header,
 		      KeyValueDB::Transaction t);
 
   /// Set leaf node for c and oid to the value of header
@@ -383,7 +420,8 @@ private:
 		  const SequencerPosition *spos);
 
   /// Lookup or create header for c oid
-  Header lookup_create_map_header(const ghobject_t &oid,
+  Header lookup_create_map_header(const MapHeaderLock &l,
+				  const ghobject_t &oid,
 				  KeyValueDB::Transaction t);
 
   /**
@@ -397,12 +435,9 @@ private:
     return _generate_new_header(oid, parent);
   }
 
-  /// Lookup leaf header for c oid
-  Header _lookup_map_header(const ghobject_t &oid);
-  Header lookup_map_header(const ghobject_t &oid) {
-    Mutex::Locker l(header_lock);
-    return _lookup_map_header(oid);
-  }
+  /// Lookup leaf header for c oid, from the cache if possible
+  Header lookup_map_header(const MapHeaderLock &l,
+			   const ghobject_t &oid);
 
   /// Lookup header node for input
   Header lookup_parent(Header input);
@@ -441,24 +476,6 @@ private:
   void _set_header(Header header, const bufferlist &bl,
 		   KeyValueDB::Transaction t);
 
-  /** 
-   * Removes map header lock once Header is out of scope
-   * @see lookup_map_header
-   */
-  class RemoveMapHeaderOnDelete {
-  public:
-    DBObjectMap *db;
-    ghobject_t oid;
-    RemoveMapHeaderOnDelete(DBObjectMap *db, const ghobject_t &oid) :
-      db(db), oid(oid) {}
-    void operator() (_Header *header) {
-      Mutex::Locker l(db->header_lock);
-      db->map_header_in_use.erase(oid);
-      db->map_header_cond.Signal();
-      delete header;
-    }
-  };
-
   /** 
    * Removes header seq lock once Header is out of scope
    * @see lookup_parent
@@ -477,6 +494,7 @@ private:
     }
   };
   friend class RemoveOnDelete;
+  friend class MapHeaderLock;
 };
 WRITE_CLASS_ENCODER(DBObjectMap::_Header)
 WRITE_CLASS_ENCODER(DBObjectMap::State)
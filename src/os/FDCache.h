@@ -15,17 +15,26 @@
 #ifndef CEPH_FDCACHE_H
 #define CEPH_FDCACHE_H
 
+#include <map>
 #include <memory>
+#include <string>
 #include <errno.h>
 #include <cstdio>
 #include "common/hobject.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/shared_cache.hpp"
+#include "include/atomic.h"
+#include "include/buffer.h"
 #include "include/compat.h"
+#include "include/hash.h"
 
 /**
  * FD Cache
+ *
+ * Split into filestore_fd_cache_shards LRUs by object hash, each with
+ * its own lock and an equal share of filestore_fd_cache_size, so that
+ * lookups of different objects rarely contend.
  */
 class FDCache : public md_config_obs_t {
 public:
@@ -33,54 +42,206 @@ public:
    * FD
    *
    * Wrapper for an fd.  Destructor closes the fd.
+   *
+   * An FD that came from the cache also caches the object's inline
+   * xattrs, keyed as FileStore::_fgetattrs(fd, aset, false) returns
+   * them.  A reader that misses takes get_xattr_seq() before going to
+   * the file and hands what it read to fill_xattrs(), which drops it if
+   * a writer has called set_xattrs() or invalidate_xattrs() meanwhile.
+   * Every writer of the inline xattrs must call one of the two when it
+   * is done with the file.
    */
   class FD {
+    FDCache *cache;
+    Mutex xattr_lock;
+    uint64_t xattr_seq;
+    bool xattrs_valid;
+    std::map<std::string, bufferptr> xattrs;
+    uint64_t xattr_bytes;
+
+    void _drop_xattrs() {
+      xattrs.clear();
+      xattrs_valid = false;
+      if (xattr_bytes) {
+	cache->xattr_bytes.sub(xattr_bytes);
+	xattr_bytes = 0;
+      }
+    }
+    void _store_xattrs(const std::map<std::string, bufferptr> &aset) {
+      _drop_xattrs();
+      uint64_t bytes = 0;
+      for (std::map<std::string, bufferptr>::const_iterator p = aset.begin();
+	   p != aset.end();
+	   ++p)
+	bytes += p->first.length() + p->second.length();
+      if (cache->xattr_bytes.read() + bytes > cache->xattr_max)
+	return;
+      for (std::map<std::string, bufferptr>::const_iterator p = aset.begin();
+	   p != aset.end();
+	   ++p)
+	// copy, so we don't pin whatever larger buffer the value came from
+	xattrs[p->first] = bufferptr(p->second.c_str(), p->second.length());
+      xattr_bytes = bytes;
+      cache->xattr_bytes.add(bytes);
+      xattrs_valid = true;
+    }
+
   public:
     const int fd;
-    FD(int _fd) : fd(_fd) {
+    FD(int _fd, FDCache *c = NULL)
+      : cache(c),
+	xattr_lock("FDCache::FD::xattr_lock", false, false),
+	xattr_seq(0), xattrs_valid(false), xattr_bytes(0),
+	fd(_fd) {
       assert(_fd >= 0);
     }
     int operator*() const {
       return fd;
     }
     ~FD() {
+      if (cache) {
+	Mutex::Locker l(xattr_lock);
+	_drop_xattrs();
+      }
       TEMP_FAILURE_RETRY(::close(fd));
     }
+
+    /// add aset to out, as FileStore::_fgetattrs(fd, out, user_only) would
+    static void copy_xattrs(const std::map<std::string, bufferptr> &aset,
+			    std::map<std::string, bufferptr> *out,
+			    bool user_only) {
+      for (std::map<std::string, bufferptr>::const_iterator p = aset.begin();
+	   p != aset.end();
+	   ++p) {
+	if (!user_only)
+	  (*out)[p->first] = p->second;
+	else if (p->first.length() > 1 && p->first[0] == '_')
+	  (*out)[p->first.substr(1)] = p->second;
+      }
+    }
+
+    bool xattr_cache_enabled() const {
+      return cache && cache->xattr_max;
+    }
+    /// @return false if the xattrs aren't cached
+    bool lookup_xattrs(std::map<std::string, bufferptr> *out,
+		       bool user_only) {
+      Mutex::Locker l(xattr_lock);
+      if (!xattrs_valid)
+	return false;
+      copy_xattrs(xattrs, out, user_only);
+      return true;
+    }
+    /// @return false if the xattrs aren't cached, else set *r as _fgetattr
+    bool lookup_xattr(const std::string &name, bufferptr *bp, int *r) {
+      Mutex::Locker l(xattr_lock);
+      if (!xattrs_valid)
+	return false;
+      std::map<std::string, bufferptr>::iterator p = xattrs.find(name);
+      if (p == xattrs.end()) {
+	*r = -ENODATA;
+      } else {
+	*bp = p->second;
+	*r = p->second.length();
+      }
+      return true;
+    }
+    uint64_t get_xattr_seq() {
+      Mutex::Locker l(xattr_lock);
+      return xattr_seq;
+    }
+    /// cache aset, read from the file after get_xattr_seq() returned seq
+    void fill_xattrs(uint64_t seq,
+		     const std::map<std::string, bufferptr> &aset) {
+      if (!xattr_cache_enabled())
+	return;
+      Mutex::Locker l(xattr_lock);
+      if (seq != xattr_seq || xattrs_valid)
+	return;
+      _store_xattrs(aset);
+    }
+    /// a writer left the inline xattrs as aset
+    void set_xattrs(const std::map<std::string, bufferptr> &aset) {
+      if (!cache)
+	return;
+      Mutex::Locker l(xattr_lock);
+      ++xattr_seq;
+      if (cache->xattr_max)
+	_store_xattrs(aset);
+      else
+	_drop_xattrs();
+    }
+    void invalidate_xattrs() {
+      if (!cache)
+	return;
+      Mutex::Locker l(xattr_lock);
+      ++xattr_seq;
+      _drop_xattrs();
+    }
   };
 
 private:
-  SharedLRU<ghobject_t, FD> registry;
   CephContext *cct;
+  const unsigned num_shards;
+  SharedLRU<ghobject_t, FD> *registry;
+  atomic_t xattr_bytes;   ///< cached by all FDs
+  uint64_t xattr_max;
+
+  void set_size(int size) {
+    size_t per_shard = std::max(1, size / (int)num_shards);
+    for (unsigned i = 0; i < num_shards; ++i)
+      registry[i].set_size(per_shard);
+  }
 
 public:
-  FDCache(CephContext *cct) : cct(cct) {
+  FDCache(CephContext *cct)
+    : cct(cct),
+      num_shards(std::max(1, cct->_conf->filestore_fd_cache_shards)) {
     assert(cct);
+    registry = new SharedLRU<ghobject_t, FD>[num_shards];
+    set_size(cct->_conf->filestore_fd_cache_size);
+    xattr_max = cct->_conf->filestore_xattr_cache_size;
     cct->_conf->add_observer(this);
-    registry.set_size(cct->_conf->filestore_fd_cache_size);
   }
   ~FDCache() {
     cct->_conf->remove_observer(this);
+    delete[] registry;
   }
   typedef std::tr1::shared_ptr<FD> FDRef;
 
+  unsigned get_num_shards() const {
+    return num_shards;
+  }
+  /// the shard hoid lives in; callers may stripe their own locks by it
+  unsigned get_shard(const ghobject_t &hoid) const {
+    return rjhash32(hoid.hobj.hash) % num_shards;
+  }
+
   FDRef lookup(const ghobject_t &hoid) {
-    return registry.lookup(hoid);
+    return registry[get_shard(hoid)].lookup(hoid);
   }
 
   FDRef add(const ghobject_t &hoid, int fd) {
-    return registry.add(hoid, new FD(fd));
+    return registry[get_shard(hoid)].add(hoid, new FD(fd, this));
+  }
+
+  /// bytes of xattrs cached by all FDs
+  uint64_t get_xattr_bytes() {
+    return xattr_bytes.read();
   }
 
   /// clear cached fd for hoid, subsequent lookups will get an empty FD
   void clear(const ghobject_t &hoid) {
-    registry.clear(hoid);
-    assert(!registry.lookup(hoid));
+    unsigned s = get_shard(hoid);
+    registry[s].clear(hoid);
+    assert(!registry[s].lookup(hoid));
   }
 
   /// md_config_obs_t
   const char** get_tracked_conf_keys() const {
     static const char* KEYS[] = {
       "filestore_fd_cache_size",
+      "filestore_xattr_cache_size",
       NULL
     };
     return KEYS;
@@ -88,7 +249,11 @@ public:
   void handle_conf_change(const md_config_t *conf,
 			  const std::set<std::string> &changed) {
     if (changed.count("filestore_fd_cache_size")) {
-      registry.set_size(conf->filestore_fd_cache_size);
+      set_size(conf->filestore_fd_cache_size);
+    }
+    if (changed.count("filestore_xattr_cache_size")) {
+      // already cached xattrs go when their FDs do
+      xattr_max = conf->filestore_xattr_cache_size;
     }
   }
 
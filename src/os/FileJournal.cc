@@ -19,6 +19,7 @@
 #include "include/color.h"
 #include "common/perf_counters.h"
 #include "os/ObjectStore.h"
+#include "include/trace.h"
 
 #include "include/compat.h"
 
@@ -101,9 +102,16 @@ int FileJournal::_open(bool forwrite, bool create)
   if (ret)
     goto out_fd;
 
+  if (stripe_unit) {
+    ret = _open_stripe(flags, create);
+    if (ret)
+      goto out_fd;
+  }
+
 #ifdef HAVE_LIBAIO
   aio_ctx = 0;
-  ret = io_setup(128, &aio_ctx);
+  // a write may be split into an aio per device it touches
+  ret = io_setup(MAX(128, 4 * g_conf->journal_aio_depth), &aio_ctx);
   if (ret < 0) {
     ret = errno;
     derr << "FileJournal::_open: unable to setup io_context " << cpp_strerror(ret) << dendl;
@@ -118,15 +126,97 @@ int FileJournal::_open(bool forwrite, bool create)
 	  << ": " << max_size 
 	  << " bytes, block size " << block_size
 	  << " bytes, directio = " << directio
-	  << ", aio = " << aio
-	  << dendl;
+	  << ", aio = " << aio;
+  if (stripe_unit)
+    *_dout << ", striped with " << stripe_fn << " in "
+	   << stripe_unit << " byte units";
+  *_dout << dendl;
   return 0;
 
  out_fd:
-  TEMP_FAILURE_RETRY(::close(fd));
+  _close_fds();
   return ret;
 }
 
+int FileJournal::_open_stripe(int flags, bool create)
+{
+  int ret;
+  if (stripe_unit % block_size) {
+    derr << "FileJournal::_open_stripe: journal_stripe_unit " << stripe_unit
+	 << " is not a multiple of the block size " << block_size << dendl;
+    return -EINVAL;
+  }
+
+  if (stripe_fd >= 0)
+    TEMP_FAILURE_RETRY(::close(stripe_fd));
+  stripe_fd = TEMP_FAILURE_RETRY(::open(stripe_fn.c_str(), flags, 0644));
+  if (stripe_fd < 0) {
+    int err = errno;
+    derr << "FileJournal::_open_stripe: unable to open " << stripe_fn
+	 << ": " << cpp_strerror(err) << dendl;
+    return -err;
+  }
+
+  struct stat st;
+  ret = ::fstat(stripe_fd, &st);
+  if (ret < 0) {
+    int err = errno;
+    derr << "FileJournal::_open_stripe: unable to fstat " << stripe_fn
+	 << ": " << cpp_strerror(err) << dendl;
+    return -err;
+  }
+
+  int64_t size;
+  if (S_ISBLK(st.st_mode)) {
+    ret = get_block_device_size(stripe_fd, &size);
+    if (ret) {
+      derr << "FileJournal::_open_stripe: failed to read block device size of "
+	   << stripe_fn << dendl;
+      return -EIO;
+    }
+  } else {
+    size = st.st_size;
+    if (create && size < max_size) {
+      ret = ::ftruncate(stripe_fd, max_size);
+      if (ret < 0) {
+	int err = errno;
+	derr << "FileJournal::_open_stripe: unable to extend " << stripe_fn
+	     << " to " << max_size << " bytes: " << cpp_strerror(err) << dendl;
+	return -err;
+      }
+      ret = ::posix_fallocate(stripe_fd, 0, max_size);
+      if (ret) {
+	derr << "FileJournal::_open_stripe: unable to preallocate " << stripe_fn
+	     << " to " << max_size << " bytes: " << cpp_strerror(ret) << dendl;
+	return -ret;
+      }
+      size = max_size;
+    }
+  }
+
+  // even stripes go to fd, odd ones here: use as much of each as both have
+  int64_t per_dev = MIN(max_size, size);
+  per_dev -= per_dev % stripe_unit;
+  if (per_dev == 0) {
+    derr << "FileJournal::_open_stripe: " << fn << " and " << stripe_fn
+	 << " must each hold at least one " << stripe_unit << " byte stripe"
+	 << dendl;
+    return -EINVAL;
+  }
+  max_size = 2 * per_dev;
+  return 0;
+}
+
+void FileJournal::_close_fds()
+{
+  if (stripe_fd >= 0) {
+    TEMP_FAILURE_RETRY(::close(stripe_fd));
+    stripe_fd = -1;
+  }
+  TEMP_FAILURE_RETRY(::close(fd));
+  fd = -1;
+}
+
 int FileJournal::_open_block_device()
 {
   int64_t bdev_sz = 0;
@@ -364,8 +454,7 @@ int FileJournal::check()
   ret = 0;
 
  done:
-  TEMP_FAILURE_RETRY(::close(fd));
-  fd = -1;
+  _close_fds();
   return ret;
 }
 
@@ -395,6 +484,7 @@ int FileJournal::create()
 
   header.start = get_top();
   header.start_seq = 0;
+  header.stripe_unit = stripe_unit;
 
   print_header();
 
@@ -419,7 +509,13 @@ int FileJournal::create()
     goto close_fd;
   }
   memset(buf, 0, block_size);
-  if (TEMP_FAILURE_RETRY(::pwrite(fd, buf, block_size, get_top())) < 0) {
+  {
+    uint64_t len = block_size;
+    off64_t dev_pos;
+    int dev_fd = map_extent(get_top(), &len, &dev_pos);
+    ret = TEMP_FAILURE_RETRY(::pwrite(dev_fd, buf, len, dev_pos));
+  }
+  if (ret < 0) {
     ret = errno;
     derr << "FileJournal::create: error zeroing first " << block_size
 	 << " bytes " << cpp_strerror(ret) << dendl;
@@ -442,6 +538,10 @@ free_buf:
   free(buf);
   buf = 0;
 close_fd:
+  if (stripe_fd >= 0) {
+    TEMP_FAILURE_RETRY(::close(stripe_fd));
+    stripe_fd = -1;
+  }
   if (TEMP_FAILURE_RETRY(::close(fd)) < 0) {
     ret = errno;
     derr << "FileJournal::create: error closing fd: " << cpp_strerror(ret)
@@ -506,6 +606,12 @@ int FileJournal::open(uint64_t fs_op_seq)
     dout(2) << "open journal block size " << header.block_size << " != current " << block_size << dendl;
     return -EINVAL;
   }
+  if (header.stripe_unit != stripe_unit) {
+    derr << "FileJournal::open: journal stripe unit " << header.stripe_unit
+	 << " != configured " << stripe_unit
+	 << " (journal_stripe_path, journal_stripe_unit)" << dendl;
+    return -EINVAL;
+  }
   if (header.max_size % header.block_size) {
     dout(2) << "open journal max size " << header.max_size
 	    << " not a multiple of block size " << header.block_size << dendl;
@@ -565,8 +671,7 @@ void FileJournal::close()
   // close
   assert(writeq_empty());
   assert(fd >= 0);
-  TEMP_FAILURE_RETRY(::close(fd));
-  fd = -1;
+  _close_fds();
 }
 
 
@@ -656,6 +761,7 @@ void FileJournal::print_header()
   dout(10) << "header: block_size " << header.block_size
 	   << " alignment " << header.alignment
 	   << " max_size " << header.max_size
+	   << " stripe_unit " << header.stripe_unit
 	   << dendl;
   dout(10) << "header: start " << header.start << dendl;
   dout(10) << " write_pos " << write_pos << dendl;
@@ -846,6 +952,7 @@ void FileJournal::queue_completions_thru(uint64_t seq)
     if (next.seq > seq)
       break;
     completion_pop_front();
+    CEPH_TRACE1(filejournal_completion, next.seq);
     utime_t lat = now;
     lat -= next.start;
     dout(10) << "queue_completions_thru seq " << seq
@@ -854,6 +961,7 @@ void FileJournal::queue_completions_thru(uint64_t seq)
 	     << " lat " << lat << dendl;
     if (logger) {
       logger->tinc(l_os_j_lat, lat);
+      logger->hinc(l_os_j_lat_hist, lat);
     }
     if (next.finish)
       finisher->queue(next.finish);
@@ -950,16 +1058,25 @@ int FileJournal::write_bl(off64_t& pos, bufferlist& bl)
 {
   int ret;
 
-  off64_t spos = ::lseek64(fd, pos, SEEK_SET);
-  if (spos < 0) {
-    ret = -errno;
-    derr << "FileJournal::write_bl : lseek64 failed " << cpp_strerror(ret) << dendl;
-    return ret;
-  }
-  ret = bl.write_fd(fd);
-  if (ret) {
-    derr << "FileJournal::write_bl : write_fd failed: " << cpp_strerror(ret) << dendl;
-    return ret;
+  for (unsigned off = 0; off < bl.length(); ) {
+    uint64_t len = bl.length() - off;
+    off64_t dev_pos;
+    int dev_fd = map_extent(pos + off, &len, &dev_pos);
+    bufferlist piece;
+    piece.substr_of(bl, off, len);
+
+    off64_t spos = ::lseek64(dev_fd, dev_pos, SEEK_SET);
+    if (spos < 0) {
+      ret = -errno;
+      derr << "FileJournal::write_bl : lseek64 failed " << cpp_strerror(ret) << dendl;
+      return ret;
+    }
+    ret = piece.write_fd(dev_fd);
+    if (ret) {
+      derr << "FileJournal::write_bl : write_fd failed: " << cpp_strerror(ret) << dendl;
+      return ret;
+    }
+    off += len;
   }
   pos += bl.length();
   if (pos == header.max_size)
@@ -1068,8 +1185,12 @@ void FileJournal::do_write(bufferlist& bl)
      */
 #if defined(DARWIN) || defined(__FreeBSD__)
     ::fsync(fd);
+    if (stripe_fd >= 0)
+      ::fsync(stripe_fd);
 #else
     ::fdatasync(fd);
+    if (stripe_fd >= 0)
+      ::fdatasync(stripe_fd);
 #endif
   }
 
@@ -1135,9 +1256,10 @@ void FileJournal::write_thread_entry()
 #ifdef HAVE_LIBAIO
     if (aio) {
       Mutex::Locker locker(aio_lock);
-      // should we back off to limit aios in flight?  try to do this
-      // adaptively so that we submit larger aios once we have lots of
-      // them in flight.
+      // should we back off to limit aios in flight?  up to
+      // journal_aio_depth may be in flight no matter what; past that,
+      // try to do this adaptively so that we submit larger aios once we
+      // have lots of them in flight.
       //
       // NOTE: our condition here is based on aio_num (protected by
       // aio_lock) and throttle_bytes (part of the write queue).  when
@@ -1146,8 +1268,9 @@ void FileJournal::write_thread_entry()
       // but should be fine given that we will have plenty of aios in
       // flight if we hit this limit to ensure we keep the device
       // saturated.
-      while (aio_num > 0) {
-	int exp = MIN(aio_num * 2, 24);
+      int depth = MAX(g_conf->journal_aio_depth, 1);
+      while (aio_num >= depth) {
+	int exp = MIN((aio_num - depth + 1) * 2, 24);
 	long unsigned min_new = 1ull << exp;
 	long unsigned cur = throttle_bytes.get_current();
 	dout(20) << "write_thread_entry aio throttle: aio num " << aio_num << " bytes " << aio_bytes
@@ -1162,6 +1285,8 @@ void FileJournal::write_thread_entry()
 	dout(20) << "write_thread_entry woke up" << dendl;
       }
     }
+    if (aio)
+      batch_wait();
 #endif
 
     Mutex::Locker locker(write_lock);
@@ -1181,6 +1306,23 @@ void FileJournal::write_thread_entry()
     if (logger) {
       logger->inc(l_os_j_wr);
       logger->inc(l_os_j_wr_bytes, bl.length());
+      logger->inc(l_os_j_wr_entries, orig_ops);
+      if (bl.length() <= 4096)
+	logger->inc(l_os_j_wr_size_4k);
+      else if (bl.length() <= (64 << 10))
+	logger->inc(l_os_j_wr_size_64k);
+      else if (bl.length() <= (1 << 20))
+	logger->inc(l_os_j_wr_size_1m);
+      else
+	logger->inc(l_os_j_wr_size_large);
+      if (orig_ops <= 1)
+	logger->inc(l_os_j_wr_entries_1);
+      else if (orig_ops <= 4)
+	logger->inc(l_os_j_wr_entries_4);
+      else if (orig_ops <= 16)
+	logger->inc(l_os_j_wr_entries_16);
+      else
+	logger->inc(l_os_j_wr_entries_many);
     }
 
 #ifdef HAVE_LIBAIO
@@ -1198,6 +1340,47 @@ void FileJournal::write_thread_entry()
 }
 
 #ifdef HAVE_LIBAIO
+/**
+ * The device is still busy with earlier aios, so what is queued now
+ * would go out as a small write of its own.  Give the queue up to
+ * journal_batch_max_wait to fill a bigger one instead, unless
+ * journal_batch_min_bytes or journal_max_write_entries worth is
+ * already waiting.
+ */
+void FileJournal::batch_wait()
+{
+  double max_wait = g_conf->journal_batch_max_wait;
+  if (max_wait <= 0)
+    return;
+  {
+    Mutex::Locker locker(aio_lock);
+    if (aio_num == 0)
+      return;  // idle device; don't hold anything back
+  }
+
+  uint64_t min_bytes = g_conf->journal_batch_min_bytes;
+  unsigned max_entries = g_conf->journal_max_write_entries;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  utime_t until = start;
+  until += max_wait;
+
+  Mutex::Locker locker(writeq_lock);
+  while (!write_stop &&
+	 throttle_bytes.get_current() < min_bytes &&
+	 (!max_entries || writeq.size() < max_entries)) {
+    utime_t now = ceph_clock_now(g_ceph_context);
+    if (now >= until)
+      break;
+    writeq_cond.WaitInterval(g_ceph_context, writeq_lock, until - now);
+  }
+
+  utime_t waited = ceph_clock_now(g_ceph_context) - start;
+  dout(20) << "batch_wait waited " << waited << " for " << writeq.size()
+	   << " entries, " << throttle_bytes.get_current() << " bytes" << dendl;
+  if (logger)
+    logger->tinc(l_os_j_batch_wait, waited);
+}
+
 void FileJournal::do_aio_write(bufferlist& bl)
 {
 
@@ -1289,50 +1472,63 @@ int FileJournal::write_aio_bl(off64_t& pos, bufferlist& bl, uint64_t seq)
 
   dout(20) << "write_aio_bl " << pos << "~" << bl.length() << " seq " << seq << dendl;
   
+  // one aio per IOV_MAX buffers or per stripe, all submitted at once;
+  // they complete in aio_queue order, so only the last carries seq
+  vector<iocb*> piocbs;
   while (bl.length() > 0) {
     int max = MIN(bl.buffers().size(), IOV_MAX-1);
-    iovec *iov = new iovec[max];
     int n = 0;
-    unsigned len = 0;
+    uint64_t len = 0;
     for (std::list<buffer::ptr>::const_iterator p = bl.buffers().begin();
 	 n < max;
 	 ++p, ++n) {
       assert(p != bl.buffers().end());
-      iov[n].iov_base = (void *)p->c_str();
-      iov[n].iov_len = p->length();
       len += p->length();
     }
+    off64_t dev_pos;
+    int dev_fd = map_extent(pos, &len, &dev_pos);
 
     bufferlist tbl;
     bl.splice(0, len, &tbl);  // move bytes from bl -> tbl
 
+    iovec *iov = new iovec[tbl.buffers().size()];
+    n = 0;
+    for (std::list<buffer::ptr>::const_iterator p = tbl.buffers().begin();
+	 p != tbl.buffers().end();
+	 ++p, ++n) {
+      iov[n].iov_base = (void *)p->c_str();
+      iov[n].iov_len = p->length();
+    }
+
     aio_queue.push_back(aio_info(tbl, pos, bl.length() > 0 ? 0 : seq));
     aio_info& aio = aio_queue.back();
     aio.iov = iov;
 
-    io_prep_pwritev(&aio.iocb, fd, aio.iov, n, pos);
+    io_prep_pwritev(&aio.iocb, dev_fd, aio.iov, n, dev_pos);
 
     dout(20) << "write_aio_bl .. " << aio.off << "~" << aio.len
 	     << " in " << n << dendl;
 
     aio_num++;
     aio_bytes += aio.len;
+    piocbs.push_back(&aio.iocb);
+    pos += aio.len;
+  }
 
-    iocb *piocb = &aio.iocb;
-    int attempts = 10;
-    do {
-      int r = io_submit(aio_ctx, 1, &piocb);
-      if (r < 0) {
-	derr << "io_submit to " << aio.off << "~" << aio.len
-	     << " got " << cpp_strerror(r) << dendl;
-	if (r == -EAGAIN && attempts-- > 0) {
-	  usleep(500);
-	  continue;
-	}
-	assert(0 == "io_submit got unexpected error");
+  unsigned submitted = 0;
+  int attempts = 10;
+  while (submitted < piocbs.size()) {
+    int r = io_submit(aio_ctx, piocbs.size() - submitted, &piocbs[submitted]);
+    if (r < 0) {
+      derr << "io_submit of " << (piocbs.size() - submitted) << " aios got "
+	   << cpp_strerror(r) << dendl;
+      if (r == -EAGAIN && attempts-- > 0) {
+	usleep(500);
+	continue;
       }
-    } while (false);
-    pos += aio.len;
+      assert(0 == "io_submit got unexpected error");
+    }
+    submitted += r;
   }
   write_finish_cond.Signal();
   return 0;
@@ -1444,6 +1640,7 @@ void FileJournal::submit_entry(uint64_t seq, bufferlist& e, int alignment,
 	  << " len " << e.length()
 	  << " (" << oncommit << ")" << dendl;
   assert(e.length() > 0);
+  CEPH_TRACE2(filejournal_submit_entry, seq, e.length());
 
   dout(30) << "XXX throttle take " << e.length() << dendl;
   throttle_ops.take(1);
@@ -1627,19 +1824,25 @@ void FileJournal::wrap_read_bl(
     else
       len = olen;                         // rest
     
+    bufferptr bp = buffer::create(len);
+    for (int64_t done = 0; done < len; ) {
+      uint64_t dev_len = len - done;
+      off64_t dev_pos;
+      int dev_fd = map_extent(pos + done, &dev_len, &dev_pos);
 #ifdef DARWIN
-    int64_t actual = ::lseek(fd, pos, SEEK_SET);
+      int64_t actual = ::lseek(dev_fd, dev_pos, SEEK_SET);
 #else
-    int64_t actual = ::lseek64(fd, pos, SEEK_SET);
+      int64_t actual = ::lseek64(dev_fd, dev_pos, SEEK_SET);
 #endif
-    assert(actual == pos);
-    
-    bufferptr bp = buffer::create(len);
-    int r = safe_read_exact(fd, bp.c_str(), len);
-    if (r) {
-      derr << "FileJournal::wrap_read_bl: safe_read_exact " << pos << "~" << len << " returned "
-	   << r << dendl;
-      ceph_abort();
+      assert(actual == dev_pos);
+
+      int r = safe_read_exact(dev_fd, bp.c_str() + done, dev_len);
+      if (r) {
+	derr << "FileJournal::wrap_read_bl: safe_read_exact " << pos + done
+	     << "~" << dev_len << " returned " << r << dendl;
+	ceph_abort();
+      }
+      done += dev_len;
     }
     bl->push_back(bp);
     pos += len;
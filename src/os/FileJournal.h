@@ -32,6 +32,9 @@ using std::deque;
 /**
  * Implements journaling on top of block device or file.
  *
+ * With journal_stripe_path set, the journal is striped across that
+ * second device too, in journal_stripe_unit chunks.
+ *
  * Lock ordering is write_lock > aio_lock > finisher_lock
  */
 class FileJournal : public Journal {
@@ -126,9 +129,12 @@ public:
      */
     uint64_t start_seq;
 
+    /// journal is striped across a second device in units of this, if non-zero
+    uint32_t stripe_unit;
+
     header_t() :
       flags(0), block_size(0), alignment(0), max_size(0), start(0),
-      committed_up_to(0), start_seq(0) {}
+      committed_up_to(0), start_seq(0), stripe_unit(0) {}
 
     void clear() {
       start = block_size;
@@ -139,7 +145,7 @@ public:
     }
 
     void encode(bufferlist& bl) const {
-      __u32 v = 4;
+      __u32 v = 5;
       ::encode(v, bl);
       bufferlist em;
       {
@@ -151,6 +157,7 @@ public:
 	::encode(start, em);
 	::encode(committed_up_to, em);
 	::encode(start_seq, em);
+	::encode(stripe_unit, em);
       }
       ::encode(em, bl);
     }
@@ -171,6 +178,7 @@ public:
 	::decode(start, bl);
 	committed_up_to = 0;
 	start_seq = 0;
+	stripe_unit = 0;
 	return;
       }
       bufferlist em;
@@ -192,6 +200,11 @@ public:
 	::decode(start_seq, t);
       else
 	start_seq = 0;
+
+      if (v > 4)
+	::decode(stripe_unit, t);
+      else
+	stripe_unit = 0;
     }
   } header;
 
@@ -216,6 +229,8 @@ public:
 
 private:
   string fn;
+  string stripe_fn;     ///< second device, if striped
+  uint32_t stripe_unit; ///< 0 if not striped
 
   char *zero_buf;
 
@@ -274,6 +289,29 @@ private:
   } full_state;
 
   int fd;
+  int stripe_fd;
+
+  /**
+   * Find where journal offset pos lives.  Consecutive stripe_unit
+   * sized chunks of the journal alternate between fd and stripe_fd.
+   *
+   * @param [in] pos journal offset
+   * @param [in,out] len bytes wanted; trimmed to what is contiguous there
+   * @param [out] dev_pos offset on the device
+   * @return fd of the device
+   */
+  int map_extent(off64_t pos, uint64_t *len, off64_t *dev_pos) {
+    if (!stripe_unit) {
+      *dev_pos = pos;
+      return fd;
+    }
+    uint64_t stripe = pos / stripe_unit;
+    uint64_t off = pos % stripe_unit;
+    if (*len > stripe_unit - off)
+      *len = stripe_unit - off;
+    *dev_pos = (stripe / 2) * stripe_unit + off;
+    return (stripe & 1) ? stripe_fd : fd;
+  }
 
   // in journal
   deque<pair<uint64_t, off64_t> > journalq;  // track seq offsets, so we can trim later.
@@ -295,12 +333,15 @@ private:
   int _open_block_device();
   void _check_disk_write_cache() const;
   int _open_file(int64_t oldsize, blksize_t blksize, bool create);
+  int _open_stripe(int flags, bool create);
+  void _close_fds();
   void print_header();
   int read_header();
   bufferptr prepare_header();
   void start_writer();
   void stop_writer();
   void write_thread_entry();
+  void batch_wait();
 
   void queue_completions_thru(uint64_t seq);
 
@@ -360,6 +401,8 @@ private:
     completions_lock(
       "FileJournal::completions_lock", false, true, false, g_ceph_context),
     fn(f),
+    stripe_fn(g_conf->journal_stripe_path),
+    stripe_unit(stripe_fn.length() ? g_conf->journal_stripe_unit : 0),
     zero_buf(NULL),
     max_size(0), block_size(0),
     is_bdev(false), directio(dio), aio(ai), force_aio(faio),
@@ -374,6 +417,7 @@ private:
     journaled_since_start(0),
     full_state(FULL_NOTFULL),
     fd(-1),
+    stripe_fd(-1),
     writing_seq(0),
     throttle_ops(g_ceph_context, "filestore_ops"),
     throttle_bytes(g_ceph_context, "filestore_bytes"),
@@ -65,6 +65,7 @@
 #include "common/perf_counters.h"
 #include "common/sync_filesystem.h"
 #include "common/fd.h"
+#include "include/trace.h"
 #include "HashIndex.h"
 #include "DBObjectMap.h"
 #include "LevelDBStore.h"
@@ -100,6 +101,7 @@ static CompatSet get_fs_supported_compat_set() {
   CompatSet compat =  get_fs_initial_compat_set();
   //Any features here can be set in code, but not in initial superblock
   compat.incompat.insert(CEPH_FS_FEATURE_INCOMPAT_SHARDS);
+  compat.incompat.insert(CEPH_FS_FEATURE_INCOMPAT_OMAP_BACKEND);
   return compat;
 }
 
@@ -171,10 +173,11 @@ int FileStore::lfn_truncate(coll_t cid, const ghobject_t& oid, off_t length)
   int r = lfn_open(cid, oid, false, &fd, &path);
   if (r < 0)
     return r;
+  wbthrottle.mark_dirty(fd, oid, true);
   r = ::ftruncate(**fd, length);
   if (r < 0)
     r = -errno;
-  if (r >= 0 && m_filestore_sloppy_crc) {
+  if (r >= 0 && m_filestore_sloppy_crc.get()->enabled) {
     int rc = backend->_crc_update_truncate(**fd, length);
     assert(rc >= 0);
   }
@@ -216,11 +219,14 @@ int FileStore::lfn_open(coll_t cid,
   if (!(*index)) {
     r = get_index(cid, index);
   }
-  Mutex::Locker l(fdcache_lock);
-  if (!replaying)
+  Mutex::Locker l(get_fdcache_lock(oid));
+  if (!replaying) {
     *outfd = fdcache.lookup(oid);
-  if (*outfd) {
-    return 0;
+    if (*outfd) {
+      logger->inc(l_os_fd_cache_hit);
+      return 0;
+    }
+    logger->inc(l_os_fd_cache_miss);
   }
   IndexedPath path2;
   if (!path)
@@ -248,6 +254,7 @@ int FileStore::lfn_open(coll_t cid,
   fd = r;
 
   if (create && (!exist)) {
+    wbthrottle.mark_dirty_all();  // a new directory entry
     r = (*index)->created(oid, (*path)->path());
     if (r < 0) {
       TEMP_FAILURE_RETRY(::close(fd));
@@ -331,7 +338,7 @@ int FileStore::lfn_unlink(coll_t cid, const ghobject_t& o,
   int r = get_index(cid, &index);
   if (r < 0)
     return r;
-  Mutex::Locker l(fdcache_lock);
+  Mutex::Locker l(get_fdcache_lock(o));
   {
     IndexedPath path;
     int exist;
@@ -384,22 +391,23 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, const cha
   basedir_fd(-1), current_fd(-1),
   generic_backend(NULL), backend(NULL),
   index_manager(do_update),
-  ondisk_finisher(g_ceph_context),
+  ondisk_finisher(g_ceph_context, g_conf->filestore_ondisk_finisher_threads),
   lock("FileStore::lock"),
   force_sync(false), sync_epoch(0),
   sync_entry_timeo_lock("sync_entry_timeo_lock"),
   timer(g_ceph_context, sync_entry_timeo_lock),
   stop(false), sync_thread(this),
-  fdcache_lock("fdcache_lock"),
   fdcache(g_ceph_context),
   wbthrottle(g_ceph_context),
   default_osr("default"),
+  op_queue_seqs(0),
   op_queue_len(0), op_queue_bytes(0),
   op_throttle_lock("FileStore::op_throttle_lock"),
-  op_finisher(g_ceph_context),
+  op_finisher(g_ceph_context, g_conf->filestore_apply_finisher_threads),
   op_tp(g_ceph_context, "FileStore::op_tp", g_conf->filestore_op_threads, "filestore_op_threads"),
   op_wq(this, g_conf->filestore_op_thread_timeout,
-	g_conf->filestore_op_thread_suicide_timeout, &op_tp),
+	g_conf->filestore_op_thread_suicide_timeout, &op_tp,
+	g_conf->filestore_op_fair_queue),
   logger(NULL),
   read_error_lock("FileStore::read_error_lock"),
   m_filestore_commit_timeout(g_conf->filestore_commit_timeout),
@@ -423,8 +431,7 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, const cha
   m_filestore_queue_committing_max_bytes(g_conf->filestore_queue_committing_max_bytes),
   m_filestore_do_dump(false),
   m_filestore_dump_fmt(true),
-  m_filestore_sloppy_crc(g_conf->filestore_sloppy_crc),
-  m_filestore_sloppy_crc_block_size(g_conf->filestore_sloppy_crc_block_size),
+  m_filestore_sloppy_crc(g_conf),
   m_fs_type(FS_TYPE_NONE),
   m_filestore_max_inline_xattr_size(0),
   m_filestore_max_inline_xattrs(0)
@@ -453,6 +460,7 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, const cha
   plb.add_u64(l_os_jq_bytes, "journal_queue_bytes");
   plb.add_u64_counter(l_os_j_bytes, "journal_bytes");
   plb.add_time_avg(l_os_j_lat, "journal_latency");
+  plb.add_time_histogram(l_os_j_lat_hist, "journal_latency_histogram");
   plb.add_u64_counter(l_os_j_wr, "journal_wr");
   plb.add_u64_avg(l_os_j_wr_bytes, "journal_wr_bytes");
   plb.add_u64(l_os_oq_max_ops, "op_queue_max_ops");
@@ -469,6 +477,26 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, const cha
   plb.add_time_avg(l_os_commit_lat, "commitcycle_latency");
   plb.add_u64_counter(l_os_j_full, "journal_full");
   plb.add_time_avg(l_os_queue_lat, "queue_transaction_latency_avg");
+  plb.add_u64(l_os_oq_seqs, "op_queue_sequencers");
+  plb.add_u64_avg(l_os_oq_seq_depth, "op_queue_sequencer_depth");
+  plb.add_time_avg(l_os_oq_wait_lat, "op_queue_wait_latency");
+  plb.add_u64_counter(l_os_xattr_cache_hit, "xattr_cache_hit");
+  plb.add_u64_counter(l_os_xattr_cache_miss, "xattr_cache_miss");
+  plb.add_u64(l_os_xattr_cache_bytes, "xattr_cache_bytes");
+  plb.add_u64_counter(l_os_fd_cache_hit, "fd_cache_hit");
+  plb.add_u64_counter(l_os_fd_cache_miss, "fd_cache_miss");
+  plb.add_u64_avg(l_os_j_wr_entries, "journal_wr_entries");
+  plb.add_u64_counter(l_os_j_wr_size_4k, "journal_wr_size_le_4k");
+  plb.add_u64_counter(l_os_j_wr_size_64k, "journal_wr_size_le_64k");
+  plb.add_u64_counter(l_os_j_wr_size_1m, "journal_wr_size_le_1m");
+  plb.add_u64_counter(l_os_j_wr_size_large, "journal_wr_size_gt_1m");
+  plb.add_u64_counter(l_os_j_wr_entries_1, "journal_wr_entries_1");
+  plb.add_u64_counter(l_os_j_wr_entries_4, "journal_wr_entries_le_4");
+  plb.add_u64_counter(l_os_j_wr_entries_16, "journal_wr_entries_le_16");
+  plb.add_u64_counter(l_os_j_wr_entries_many, "journal_wr_entries_gt_16");
+  plb.add_time_avg(l_os_j_batch_wait, "journal_batch_wait");
+  plb.add_u64_counter(l_os_commit_targeted, "commitcycle_targeted");
+  plb.add_u64_avg(l_os_commit_targeted_objs, "commitcycle_targeted_objects");
 
   logger = plb.create_perf_counters();
 
@@ -479,10 +507,18 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, const cha
   backend = generic_backend;
 
   superblock.compat_features = get_fs_initial_compat_set();
+
+  for (unsigned i = 0; i < fdcache.get_num_shards(); ++i)
+    fdcache_lock.push_back(new Mutex("FileStore::fdcache_lock"));
 }
 
 FileStore::~FileStore()
 {
+  for (vector<Mutex*>::iterator p = fdcache_lock.begin();
+       p != fdcache_lock.end();
+       ++p)
+    delete *p;
+
   g_ceph_context->_conf->remove_observer(this);
   g_ceph_context->get_perfcounters_collection()->remove(logger);
 
@@ -624,6 +660,20 @@ int FileStore::mkfs()
     goto close_fsid_fd;
   }
 
+  // an existing omap keeps the backend it was created with
+  if (::access(omap_dir.c_str(), F_OK) < 0) {
+    superblock.omap_backend = g_conf->filestore_omap_backend;
+    if (superblock.omap_backend != "leveldb")
+      superblock.compat_features.incompat.insert(
+	CEPH_FS_FEATURE_INCOMPAT_OMAP_BACKEND);
+  } else {
+    ret = read_superblock();
+    if (ret < 0) {
+      derr << "mkfs: read_superblock() failed: "
+	   << cpp_strerror(ret) << dendl;
+      goto close_fsid_fd;
+    }
+  }
   ret = write_superblock();
   if (ret < 0) {
     derr << "mkfs: write_superblock() failed: "
@@ -693,18 +743,28 @@ int FileStore::mkfs()
   }
 
   {
-    leveldb::Options options;
-    options.create_if_missing = true;
-    leveldb::DB *db;
-    leveldb::Status status = leveldb::DB::Open(options, omap_dir, &db);
-    if (status.ok()) {
-      delete db;
-      dout(1) << "leveldb db exists/created" << dendl;
-    } else {
-      derr << "mkfs failed to create leveldb: " << status.ToString() << dendl;
+    KeyValueDB *omap_store = KeyValueDB::create(g_ceph_context,
+						superblock.omap_backend,
+						omap_dir);
+    if (!omap_store) {
+      derr << "mkfs: omap backend " << superblock.omap_backend
+	   << " is not supported" << dendl;
+      ret = -EINVAL;
+      goto close_fsid_fd;
+    }
+    omap_store->set_column_families(
+      g_conf->filestore_rocksdb_column_families,
+      g_conf->filestore_rocksdb_column_family_options);
+    stringstream err;
+    if (omap_store->create_and_open(err)) {
+      delete omap_store;
+      derr << "mkfs failed to create " << superblock.omap_backend << ": "
+	   << err.str() << dendl;
       ret = -1;
       goto close_fsid_fd;
     }
+    delete omap_store;
+    dout(1) << superblock.omap_backend << " db exists/created" << dendl;
   }
 
   // journal?
@@ -1294,21 +1354,36 @@ int FileStore::mount()
   }
 
   {
-    LevelDBStore *omap_store = new LevelDBStore(g_ceph_context, omap_dir);
+    KeyValueDB *omap_store = KeyValueDB::create(g_ceph_context,
+						superblock.omap_backend,
+						omap_dir);
+    if (!omap_store) {
+      derr << "mount: omap backend " << superblock.omap_backend
+	   << " is not supported" << dendl;
+      ret = -EINVAL;
+      goto close_current_fd;
+    }
 
-    omap_store->options.write_buffer_size = g_conf->osd_leveldb_write_buffer_size;
-    omap_store->options.cache_size = g_conf->osd_leveldb_cache_size;
-    omap_store->options.block_size = g_conf->osd_leveldb_block_size;
-    omap_store->options.bloom_size = g_conf->osd_leveldb_bloom_size;
-    omap_store->options.compression_enabled = g_conf->osd_leveldb_compression;
-    omap_store->options.paranoid_checks = g_conf->osd_leveldb_paranoid;
-    omap_store->options.max_open_files = g_conf->osd_leveldb_max_open_files;
-    omap_store->options.log_file = g_conf->osd_leveldb_log;
+    if (superblock.omap_backend == "leveldb") {
+      LevelDBStore *leveldb_store = static_cast<LevelDBStore*>(omap_store);
+      leveldb_store->options.write_buffer_size = g_conf->osd_leveldb_write_buffer_size;
+      leveldb_store->options.cache_size = g_conf->osd_leveldb_cache_size;
+      leveldb_store->options.block_size = g_conf->osd_leveldb_block_size;
+      leveldb_store->options.bloom_size = g_conf->osd_leveldb_bloom_size;
+      leveldb_store->options.compression_enabled = g_conf->osd_leveldb_compression;
+      leveldb_store->options.paranoid_checks = g_conf->osd_leveldb_paranoid;
+      leveldb_store->options.max_open_files = g_conf->osd_leveldb_max_open_files;
+      leveldb_store->options.log_file = g_conf->osd_leveldb_log;
+    }
+    omap_store->set_column_families(
+      g_conf->filestore_rocksdb_column_families,
+      g_conf->filestore_rocksdb_column_family_options);
 
     stringstream err;
     if (omap_store->create_and_open(err)) {
       delete omap_store;
-      derr << "Error initializing leveldb: " << err.str() << dendl;
+      derr << "Error initializing " << superblock.omap_backend << ": "
+	   << err.str() << dendl;
       ret = -1;
       goto close_current_fd;
     }
@@ -1393,6 +1468,11 @@ int FileStore::mount()
     }
   }
 
+  // whatever replay does is synced in full by the first commit
+  wbthrottle.set_track_dirty(
+    g_conf->filestore_sync_targeted && !backend->can_checkpoint(),
+    g_conf->filestore_sync_targeted_max_objects);
+
   sync_thread.create();
 
   ret = journal_replay(initial_op_seq);
@@ -1424,6 +1504,9 @@ int FileStore::mount()
 
   journal_start();
 
+  if (g_conf->filestore_split_async)
+    index_manager.start_split_thread();
+  op_tp.set_work_stealing(g_conf->filestore_op_thread_prefetch);
   op_tp.start();
   op_finisher.start();
   ondisk_finisher.start();
@@ -1460,6 +1543,7 @@ int FileStore::umount()
   lock.Unlock();
   sync_thread.join();
   op_tp.stop();
+  index_manager.stop_split_thread();
 
   journal_stop();
 
@@ -1551,10 +1635,12 @@ void FileStore::queue_op(OpSequencer *osr, Op *o)
   // so that regardless of which order the threads pick up the
   // sequencer, the op order will be preserved.
 
-  osr->queue(o);
+  o->queued = ceph_clock_now(g_ceph_context);
+  unsigned depth = osr->queue(o);
 
   logger->inc(l_os_ops);
   logger->inc(l_os_bytes, o->bytes);
+  logger->inc(l_os_oq_seq_depth, depth);
 
   dout(5) << "queue_op " << o << " seq " << o->op
 	  << " " << *osr
@@ -1627,7 +1713,9 @@ void FileStore::_do_op(OpSequencer *osr, ThreadPool::TPHandle &handle)
 
   osr->apply_lock.Lock();
   Op *o = osr->peek_queue();
+  logger->tinc(l_os_oq_wait_lat, ceph_clock_now(g_ceph_context) - o->queued);
   apply_manager.op_apply_start(o->op);
+  CEPH_TRACE1(filestore_do_op, o->op);
   dout(5) << "_do_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << " start" << dendl;
   int r = _do_transactions(o->tls, o->op, &handle);
   apply_manager.op_apply_finish(o->op);
@@ -1640,6 +1728,7 @@ void FileStore::_finish_op(OpSequencer *osr)
   Op *o = osr->dequeue();
   
   dout(10) << "_finish_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << dendl;
+  CEPH_TRACE1(filestore_finish_op, o->op);
   osr->apply_lock.Unlock();  // locked in _do_op
 
   // called with tp lock held
@@ -1652,7 +1741,7 @@ void FileStore::_finish_op(OpSequencer *osr)
   if (o->onreadable_sync) {
     o->onreadable_sync->complete(0);
   }
-  op_finisher.queue(o->onreadable);
+  op_finisher.queue(osr, o->onreadable);
   delete o;
 }
 
@@ -1703,6 +1792,8 @@ int FileStore::queue_transactions(Sequencer *posr, list<Transaction*> &tls,
     journal->throttle();
     uint64_t op_num = submit_manager.op_submit_start();
     o->op = op_num;
+    CEPH_TRACE2(filestore_queue_transactions,
+		osd_op ? osd_op->get_seq() : 0, op_num);
 
     if (m_filestore_do_dump)
       dump_transactions(o->tls, o->op, osr);
@@ -1731,6 +1822,8 @@ int FileStore::queue_transactions(Sequencer *posr, list<Transaction*> &tls,
 
   uint64_t op = submit_manager.op_submit_start();
   dout(5) << "queue_transactions (trailing journal) " << op << " " << tls << dendl;
+  CEPH_TRACE2(filestore_queue_transactions,
+	      osd_op ? osd_op->get_seq() : 0, op);
 
   if (m_filestore_do_dump)
     dump_transactions(tls, op, osr);
@@ -1749,7 +1842,7 @@ int FileStore::queue_transactions(Sequencer *posr, list<Transaction*> &tls,
   if (onreadable_sync) {
     onreadable_sync->complete(r);
   }
-  op_finisher.queue(onreadable, r);
+  op_finisher.queue(osr, onreadable, r);
 
   submit_manager.op_submit_finish(op);
   apply_manager.op_apply_finish(op);
@@ -1770,7 +1863,7 @@ void FileStore::_journaled_ahead(OpSequencer *osr, Op *o, Context *ondisk)
   // getting blocked behind an ondisk completion.
   if (ondisk) {
     dout(10) << " queueing ondisk " << ondisk << dendl;
-    ondisk_finisher.queue(ondisk);
+    ondisk_finisher.queue(osr, ondisk);
   }
 }
 
@@ -2055,6 +2148,34 @@ int FileStore::_check_replay_guard(int fd, const SequencerPosition& spos)
   }
 }
 
+void FileStore::_note_dirty_op(int op)
+{
+  switch (op) {
+  // these mark the object they change themselves, and the omap is
+  // synced on every commit
+  case Transaction::OP_NOP:
+  case Transaction::OP_TRIMCACHE:
+  case Transaction::OP_STARTSYNC:
+  case Transaction::OP_TOUCH:
+  case Transaction::OP_WRITE:
+  case Transaction::OP_ZERO:
+  case Transaction::OP_TRUNCATE:
+  case Transaction::OP_SETATTR:
+  case Transaction::OP_SETATTRS:
+  case Transaction::OP_RMATTR:
+  case Transaction::OP_RMATTRS:
+  case Transaction::OP_OMAP_CLEAR:
+  case Transaction::OP_OMAP_SETKEYS:
+  case Transaction::OP_OMAP_RMKEYS:
+  case Transaction::OP_OMAP_RMKEYRANGE:
+  case Transaction::OP_OMAP_SETHEADER:
+    break;
+  // the rest change directories, which only syncfs covers
+  default:
+    wbthrottle.mark_dirty_all();
+  }
+}
+
 unsigned FileStore::_do_transaction(
   Transaction& t, uint64_t op_seq, int trans_num,
   ThreadPool::TPHandle *handle)
@@ -2072,6 +2193,7 @@ unsigned FileStore::_do_transaction(
     int r = 0;
 
     _inject_failure();
+    _note_dirty_op(op);
 
     switch (op) {
     case Transaction::OP_NOP:
@@ -2537,12 +2659,17 @@ int FileStore::read(
   bptr.set_length(got);   // properly size the buffer
   bl.push_back(bptr);   // put it in the target bufferlist
 
-  if (m_filestore_sloppy_crc && (!replaying || backend->can_checkpoint())) {
+  if (m_filestore_sloppy_crc.get()->enabled && (!replaying || backend->can_checkpoint())) {
     ostringstream ss;
     int errors = backend->_crc_verify_read(**fd, offset, got, bl, &ss);
     if (errors > 0) {
       dout(0) << "FileStore::read " << cid << "/" << oid << " " << offset << "~"
 	      << got << " ... BAD CRC:\n" << ss.str() << dendl;
+      if (allow_eio) {
+	// let scrub report it rather than take the osd down
+	lfn_close(fd);
+	return -EIO;
+      }
       assert(0 == "bad crc on read");
     }
   }
@@ -2559,6 +2686,133 @@ int FileStore::read(
   }
 }
 
+int FileStore::readv(
+  coll_t cid,
+  const ghobject_t& oid,
+  const vector<pair<uint64_t, size_t> >& extents,
+  vector<bufferlist>& bls,
+  vector<int>& rs,
+  bool allow_eio)
+{
+#ifdef CEPH_HAVE_PREADV
+  bool simple = !m_filestore_sloppy_crc.get()->enabled;
+  for (unsigned i = 0; simple && i < extents.size(); ++i)
+    if (extents[i].second == 0)
+      simple = false;  // whole object; read() knows how
+  if (!simple)
+    return ObjectStore::readv(cid, oid, extents, bls, rs, allow_eio);
+
+  dout(15) << "readv " << cid << "/" << oid << " " << extents << dendl;
+
+  FDRef fd;
+  int r = lfn_open(cid, oid, false, &fd);
+  if (r < 0) {
+    dout(10) << "FileStore::readv(" << cid << "/" << oid << ") open error: "
+	     << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  bls.clear();
+  bls.resize(extents.size());
+  rs.resize(extents.size());
+
+  // visit the extents in offset order, so that neighbors can share a
+  // syscall
+  vector<pair<uint64_t, unsigned> > order;
+  order.reserve(extents.size());
+  for (unsigned i = 0; i < extents.size(); ++i)
+    order.push_back(make_pair(extents[i].first, i));
+  sort(order.begin(), order.end());
+
+  uint64_t max_gap = g_conf->filestore_readv_max_gap;
+  bufferptr gap_buf;
+  vector<bufferptr> bptrs(extents.size());
+  vector<struct iovec> iov;
+  vector<unsigned> run;
+  unsigned p = 0;
+  while (p < order.size()) {
+    // gather a run of extents that a single preadv can cover
+    run.clear();
+    iov.clear();
+    uint64_t start = extents[order[p].second].first;
+    uint64_t end = start;
+    while (p < order.size() && iov.size() + 2 <= (size_t)IOV_MAX) {
+      unsigned i = order[p].second;
+      uint64_t off = extents[i].first;
+      size_t len = extents[i].second;
+      if (!run.empty() && (off < end || off - end > max_gap))
+	break;
+      if (off > end) {
+	if (gap_buf.length() < off - end)
+	  gap_buf = buffer::create(max_gap);
+	struct iovec v = { gap_buf.c_str(), (size_t)(off - end) };
+	iov.push_back(v);
+      }
+      bptrs[i] = buffer::create(len);
+      struct iovec v = { bptrs[i].c_str(), len };
+      iov.push_back(v);
+      run.push_back(i);
+      end = off + len;
+      ++p;
+    }
+
+    ssize_t got = safe_preadv(**fd, &iov[0], iov.size(), start);
+    if (got < 0) {
+      dout(10) << "FileStore::readv(" << cid << "/" << oid << ") preadv error: "
+	       << cpp_strerror(got) << dendl;
+      assert(allow_eio || !m_filestore_fail_eio || got != -EIO);
+      for (unsigned j = 0; j < run.size(); ++j) {
+	bptrs[run[j]] = bufferptr();
+	rs[run[j]] = got;
+      }
+      continue;
+    }
+
+    // hand each extent the part of the file that existed
+    uint64_t eof = start + got;
+    for (unsigned j = 0; j < run.size(); ++j) {
+      unsigned i = run[j];
+      uint64_t off = extents[i].first;
+      size_t have = 0;
+      if (eof > off)
+	have = MIN(eof - off, (uint64_t)extents[i].second);
+      bptrs[i].set_length(have);
+      if (have)
+	bls[i].push_back(bptrs[i]);
+      bptrs[i] = bufferptr();
+      rs[i] = have;
+    }
+  }
+
+  lfn_close(fd);
+
+  if (g_conf->filestore_debug_inject_read_err &&
+      debug_data_eio(oid)) {
+    for (unsigned i = 0; i < rs.size(); ++i)
+      rs[i] = -EIO;
+  }
+  return 0;
+#else
+  return ObjectStore::readv(cid, oid, extents, bls, rs, allow_eio);
+#endif
+}
+
+int FileStore::get_crc_map(coll_t cid, const ghobject_t& oid,
+			   SloppyCRCMap *cm)
+{
+  if (!m_filestore_sloppy_crc.get()->enabled)
+    return -EOPNOTSUPP;
+  dout(15) << "get_crc_map " << cid << "/" << oid << dendl;
+  FDRef fd;
+  int r = lfn_open(cid, oid, false, &fd);
+  if (r < 0)
+    return r;
+  r = backend->_crc_load(**fd, cm);
+  lfn_close(fd);
+  dout(10) << "get_crc_map " << cid << "/" << oid << " = " << r << dendl;
+  return r;
+}
+
 int FileStore::fiemap(coll_t cid, const ghobject_t& oid,
                     uint64_t offset, size_t len,
                     bufferlist& bl)
@@ -2689,6 +2943,7 @@ int FileStore::_write(coll_t cid, const ghobject_t& oid,
 	    << cpp_strerror(r) << dendl;
     goto out;
   }
+  wbthrottle.mark_dirty(fd, oid, false);
     
   // seek
   actual = ::lseek64(**fd, offset, SEEK_SET);
@@ -2710,7 +2965,7 @@ int FileStore::_write(coll_t cid, const ghobject_t& oid,
   if (r == 0)
     r = bl.length();
 
-  if (r >= 0 && m_filestore_sloppy_crc) {
+  if (r >= 0 && m_filestore_sloppy_crc.get()->enabled) {
     int rc = backend->_crc_update_write(**fd, offset, len, bl);
     assert(rc >= 0);
   }
@@ -2739,17 +2994,35 @@ int FileStore::_zero(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t
   if (ret < 0) {
     goto out;
   }
+  wbthrottle.mark_dirty(fd, oid, false);
 
-  // first try fallocate
-  ret = fallocate(**fd, FALLOC_FL_PUNCH_HOLE, offset, len);
-  if (ret < 0)
-    ret = -errno;
-  lfn_close(fd);
+  {
+    struct stat st;
+    ret = ::fstat(**fd, &st);
+    if (ret < 0) {
+      ret = -errno;
+      lfn_close(fd);
+      goto out;
+    }
+
+    // a hole can only be punched without changing the size; zeros
+    // past the end extend the file, as writing them would
+    ret = fallocate(**fd, FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE,
+		    offset, len);
+    if (ret < 0) {
+      ret = -errno;
+    } else if (offset + len > (uint64_t)st.st_size) {
+      ret = ::ftruncate(**fd, offset + len);
+      if (ret < 0)
+	ret = -errno;
+    }
+  }
 
-  if (ret >= 0 && m_filestore_sloppy_crc) {
+  if (ret >= 0 && m_filestore_sloppy_crc.get()->enabled) {
     int rc = backend->_crc_update_zero(**fd, offset, len);
     assert(rc >= 0);
   }
+  lfn_close(fd);
 
   if (ret == 0)
     goto out;  // yay!
@@ -2814,7 +3087,7 @@ int FileStore::_clone(coll_t cid, const ghobject_t& oldoid, const ghobject_t& ne
 
   {
     map<string, bufferptr> aset;
-    r = _fgetattrs(**o, aset, false);
+    r = _fgetattrs_cached(o, aset, false);
     if (r < 0)
       goto out3;
 
@@ -2827,6 +3100,7 @@ int FileStore::_clone(coll_t cid, const ghobject_t& oldoid, const ghobject_t& ne
   _set_replay_guard(**n, spos, &newoid);
 
  out3:
+  n->invalidate_xattrs();
   lfn_close(n);
  out:
   lfn_close(o);
@@ -2904,7 +3178,7 @@ int FileStore::_do_copy_range(int from, int to, uint64_t srcoff, uint64_t len, u
       break;
     pos += r;
   }
-  if (r >= 0 && m_filestore_sloppy_crc) {
+  if (r >= 0 && m_filestore_sloppy_crc.get()->enabled) {
     int rc = backend->_crc_update_clone_range(from, to, srcoff, len, dstoff);
     assert(rc >= 0);
   }
@@ -3059,13 +3333,30 @@ void FileStore::sync_entry()
 	}
       } else
       {
+	// everything applied before cp is in here; take it while op_tp
+	// is still paused
+	map<ghobject_t, pair<bool, FDRef> > dirty;
+	bool targeted = wbthrottle.take_dirty(&dirty);
+
 	apply_manager.commit_started();
 	op_tp.unpause();
 
-	int err = backend->syncfs();
-	if (err < 0) {
-	  derr << "syncfs got " << cpp_strerror(err) << dendl;
-	  assert(0 == "syncfs returned error");
+	int err;
+	if (targeted) {
+	  dout(15) << "sync_entry syncing " << dirty.size() << " objects" << dendl;
+	  err = _sync_dirty(dirty);
+	  if (err < 0) {
+	    derr << "targeted sync got " << cpp_strerror(err) << dendl;
+	    assert(0 == "targeted sync returned error");
+	  }
+	  logger->inc(l_os_commit_targeted);
+	  logger->inc(l_os_commit_targeted_objs, dirty.size());
+	} else {
+	  err = backend->syncfs();
+	  if (err < 0) {
+	    derr << "syncfs got " << cpp_strerror(err) << dendl;
+	    assert(0 == "syncfs returned error");
+	  }
 	}
 
 	err = write_op_seq(op_fd, cp);
@@ -3133,6 +3424,60 @@ void FileStore::sync_entry()
   lock.Unlock();
 }
 
+namespace {
+/// syncs its share of the objects a targeted sync takes
+struct DirtySyncThread : public Thread {
+  vector<pair<bool, FDRef> > &objs;
+  atomic_t &next;
+  int err;
+  DirtySyncThread(vector<pair<bool, FDRef> > &o, atomic_t &n)
+    : objs(o), next(n), err(0) {}
+  void *entry() {
+    size_t i;
+    while ((i = next.inc() - 1) < objs.size()) {
+      int fd = **objs[i].second;
+      int r = objs[i].first ? ::fsync(fd) : ::fdatasync(fd);
+      if (r < 0 && !err)
+	err = -errno;
+    }
+    return 0;
+  }
+};
+}
+
+int FileStore::_sync_dirty(map<ghobject_t, pair<bool, FDRef> > &dirty)
+{
+  vector<pair<bool, FDRef> > objs;
+  objs.reserve(dirty.size());
+  for (map<ghobject_t, pair<bool, FDRef> >::iterator i = dirty.begin();
+       i != dirty.end();
+       ++i)
+    objs.push_back(i->second);
+
+  atomic_t next;
+  unsigned num = MIN(objs.size(),
+		     (size_t)MAX(g_conf->filestore_sync_targeted_threads, 1));
+  vector<DirtySyncThread*> threads;
+  for (unsigned i = 0; i < num; ++i) {
+    threads.push_back(new DirtySyncThread(objs, next));
+    threads.back()->create();
+  }
+  int r = 0;
+  for (vector<DirtySyncThread*>::iterator i = threads.begin();
+       i != threads.end();
+       ++i) {
+    (*i)->join();
+    if ((*i)->err && !r)
+      r = (*i)->err;
+    delete *i;
+  }
+  if (r < 0)
+    return r;
+
+  // the omap is in leveldb, which one synchronous write flushes
+  return object_map->sync();
+}
+
 void FileStore::_start_sync()
 {
   if (!journal) {  // don't do a big sync if the journal is on
@@ -3330,6 +3675,27 @@ int FileStore::_fgetattrs(int fd, map<string,bufferptr>& aset, bool user_only)
   return 0;
 }
 
+int FileStore::_fgetattrs_cached(FDRef fd, map<string,bufferptr>& aset,
+				 bool user_only)
+{
+  if (!fd->xattr_cache_enabled())
+    return _fgetattrs(**fd, aset, user_only);
+  if (fd->lookup_xattrs(&aset, user_only)) {
+    logger->inc(l_os_xattr_cache_hit);
+    return 0;
+  }
+  logger->inc(l_os_xattr_cache_miss);
+  uint64_t seq = fd->get_xattr_seq();
+  map<string,bufferptr> all;
+  int r = _fgetattrs(**fd, all, false);
+  if (r < 0)
+    return r;
+  fd->fill_xattrs(seq, all);
+  logger->set(l_os_xattr_cache_bytes, fdcache.get_xattr_bytes());
+  FDCache::FD::copy_xattrs(all, &aset, user_only);
+  return 0;
+}
+
 int FileStore::_fsetattrs(int fd, map<string, bufferptr> &aset)
 {
   for (map<string, bufferptr>::iterator p = aset.begin();
@@ -3399,9 +3765,28 @@ int FileStore::getattr(coll_t cid, const ghobject_t& oid, const char *name, buff
   if (r < 0) {
     goto out;
   }
-  char n[CHAIN_XATTR_MAX_NAME_LEN];
-  get_attrname(name, n, CHAIN_XATTR_MAX_NAME_LEN);
-  r = _fgetattr(**fd, n, bp);
+  if (fd->xattr_cache_enabled()) {
+    // fill the cache; the other attrs are usually wanted too
+    map<string,bufferptr> aset;
+    if (!fd->lookup_xattr(name, &bp, &r)) {
+      r = _fgetattrs_cached(fd, aset, false);
+      if (r == 0) {
+	map<string,bufferptr>::iterator p = aset.find(name);
+	if (p == aset.end()) {
+	  r = -ENODATA;
+	} else {
+	  bp = p->second;
+	  r = bp.length();
+	}
+      }
+    } else {
+      logger->inc(l_os_xattr_cache_hit);
+    }
+  } else {
+    char n[CHAIN_XATTR_MAX_NAME_LEN];
+    get_attrname(name, n, CHAIN_XATTR_MAX_NAME_LEN);
+    r = _fgetattr(**fd, n, bp);
+  }
   lfn_close(fd);
   if (r == -ENODATA) {
     map<string, bufferlist> got;
@@ -3448,7 +3833,7 @@ int FileStore::getattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr>
   if (r < 0) {
     goto out;
   }
-  r = _fgetattrs(**fd, aset, user_only);
+  r = _fgetattrs_cached(fd, aset, user_only);
   if (r < 0) {
     goto out;
   }
@@ -3511,7 +3896,8 @@ int FileStore::_setattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr
   if (r < 0) {
     goto out;
   }
-  r = _fgetattrs(**fd, inline_set, false);
+  wbthrottle.mark_dirty(fd, oid, true);
+  r = _fgetattrs_cached(fd, inline_set, false);
   assert(!m_filestore_fail_eio || r != -EIO);
   dout(15) << "setattrs " << cid << "/" << oid << dendl;
   r = 0;
@@ -3553,6 +3939,7 @@ int FileStore::_setattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr
   r = _fsetattrs(**fd, inline_to_set);
   if (r < 0)
     goto out_close;
+  fd->set_xattrs(inline_set);
 
   if (!omap_remove.empty()) {
     r = object_map->remove_xattrs(oid, omap_remove, &spos);
@@ -3574,6 +3961,8 @@ int FileStore::_setattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr
     }
   }
  out_close:
+  if (r < 0)
+    fd->invalidate_xattrs();
   lfn_close(fd);
  out:
   dout(10) << "setattrs " << cid << "/" << oid << " = " << r << dendl;
@@ -3590,9 +3979,11 @@ int FileStore::_rmattr(coll_t cid, const ghobject_t& oid, const char *name,
   if (r < 0) {
     goto out;
   }
+  wbthrottle.mark_dirty(fd, oid, true);
   char n[CHAIN_XATTR_MAX_NAME_LEN];
   get_attrname(name, n, CHAIN_XATTR_MAX_NAME_LEN);
   r = chain_fremovexattr(**fd, n);
+  fd->invalidate_xattrs();
   if (r == -ENODATA) {
     Index index;
     r = get_index(cid, &index);
@@ -3629,7 +4020,8 @@ int FileStore::_rmattrs(coll_t cid, const ghobject_t& oid,
   if (r < 0) {
     goto out;
   }
-  r = _fgetattrs(**fd, aset, false);
+  wbthrottle.mark_dirty(fd, oid, true);
+  r = _fgetattrs_cached(fd, aset, false);
   if (r >= 0) {
     for (map<string,bufferptr>::iterator p = aset.begin(); p != aset.end(); ++p) {
       char n[CHAIN_XATTR_MAX_NAME_LEN];
@@ -3639,6 +4031,10 @@ int FileStore::_rmattrs(coll_t cid, const ghobject_t& oid,
 	break;
     }
   }
+  if (r >= 0)
+    fd->set_xattrs(map<string,bufferptr>());
+  else
+    fd->invalidate_xattrs();
   lfn_close(fd);
 
   r = get_index(cid, &index);
@@ -3869,6 +4265,9 @@ int FileStore::_collection_rename(const coll_t &cid, const coll_t &ncid,
     return ret;
   }
 
+  index_manager.clear_list_cache(cid);
+  index_manager.clear_list_cache(ncid);
+
   if (ret >= 0) {
     int fd = ::open(new_coll, O_RDONLY);
     assert(fd >= 0);
@@ -4049,6 +4448,39 @@ int FileStore::collection_list_partial(coll_t c, ghobject_t start,
   return 0;
 }
 
+int FileStore::pre_split_collection(coll_t c, uint32_t bits, uint32_t match,
+				    uint64_t expected_objs)
+{
+  dout(10) << "pre_split_collection " << c << " bits " << bits
+	   << " match " << hex << match << dec
+	   << " expected_objs " << expected_objs << dendl;
+  Index index;
+  int r = get_index(c, &index);
+  if (r < 0)
+    return r;
+  HashIndex *hindex = dynamic_cast<HashIndex*>(index.get());
+  if (!hindex)
+    return -EOPNOTSUPP;
+  r = hindex->pre_split(bits, match, expected_objs);
+  assert(!m_filestore_fail_eio || r != -EIO);
+  return r;
+}
+
+int FileStore::prepare_split_collection(coll_t c, uint32_t bits)
+{
+  dout(15) << "prepare_split_collection " << c << " bits " << bits << dendl;
+  Index index;
+  int r = get_index(c, &index);
+  if (r < 0)
+    return r;
+  HashIndex *hindex = dynamic_cast<HashIndex*>(index.get());
+  if (!hindex)
+    return -EOPNOTSUPP;
+  r = hindex->prepare_split(bits);
+  assert(!m_filestore_fail_eio || r != -EIO);
+  return r;
+}
+
 int FileStore::collection_list(coll_t c, vector<ghobject_t>& ls)
 {  
   Index index;
@@ -4405,7 +4837,15 @@ int FileStore::_omap_rmkeyrange(coll_t cid, const ghobject_t &hoid,
       keys.insert(iter->key());
     }
   }
-  return _omap_rmkeys(cid, hoid, keys, spos);
+  int r = _omap_rmkeys(cid, hoid, keys, spos);
+  if (r < 0)
+    return r;
+  // the removals leave tombstones behind that reads of the range would
+  // otherwise skip over until leveldb gets to compacting them
+  if (g_conf->filestore_omap_rmkeyrange_compact_min &&
+      keys.size() >= (unsigned)g_conf->filestore_omap_rmkeyrange_compact_min)
+    object_map->compact_range(hoid, first, last);
+  return 0;
 }
 
 int FileStore::_omap_setheader(coll_t cid, const ghobject_t &hoid,
@@ -4606,8 +5046,7 @@ void FileStore::handle_conf_change(const struct md_config_t *conf,
     m_filestore_kill_at.set(conf->filestore_kill_at);
     m_filestore_fail_eio = conf->filestore_fail_eio;
     m_filestore_replica_fadvise = conf->filestore_replica_fadvise;
-    m_filestore_sloppy_crc = conf->filestore_sloppy_crc;
-    m_filestore_sloppy_crc_block_size = conf->filestore_sloppy_crc_block_size;
+    m_filestore_sloppy_crc.update(conf);
   }
   if (changed.count("filestore_commit_timeout")) {
     Mutex::Locker l(sync_entry_timeo_lock);
@@ -4706,15 +5145,20 @@ void FileStore::set_xattr_limits_via_conf()
 
 void FSSuperblock::encode(bufferlist &bl) const
 {
-  ENCODE_START(1, 1, bl);
+  ENCODE_START(2, 1, bl);
   compat_features.encode(bl);
+  ::encode(omap_backend, bl);
   ENCODE_FINISH(bl);
 }
 
 void FSSuperblock::decode(bufferlist::iterator &bl)
 {
-  DECODE_START(1, bl);
+  DECODE_START(2, bl);
   compat_features.decode(bl);
+  if (struct_v >= 2)
+    ::decode(omap_backend, bl);
+  else
+    omap_backend = "leveldb";
   DECODE_FINISH(bl);
 }
 
@@ -4723,6 +5167,7 @@ void FSSuperblock::dump(Formatter *f) const
   f->open_object_section("compat");
   compat_features.dump(f);
   f->close_section();
+  f->dump_string("omap_backend", omap_backend);
 }
 
 void FSSuperblock::generate_test_instances(list<FSSuperblock*>& o)
@@ -4736,4 +5181,6 @@ void FSSuperblock::generate_test_instances(list<FSSuperblock*>& o)
   z.compat_features = CompatSet(feature_compat, feature_ro_compat,
                                 feature_incompat);
   o.push_back(new FSSuperblock(z));
+  z.omap_backend = "rocksdb";
+  o.push_back(new FSSuperblock(z));
 }
@@ -36,6 +36,7 @@ using namespace __gnu_cxx;
 #include "common/WorkQueue.h"
 
 #include "common/Mutex.h"
+#include "common/config_snapshot.h"
 #include "HashIndex.h"
 #include "IndexManager.h"
 #include "ObjectMap.h"
@@ -47,6 +48,9 @@ using namespace __gnu_cxx;
 
 
 // from include/linux/falloc.h:
+#ifndef FALLOC_FL_KEEP_SIZE
+# define FALLOC_FL_KEEP_SIZE 0x1
+#endif
 #ifndef FALLOC_FL_PUNCH_HOLE
 # define FALLOC_FL_PUNCH_HOLE 0x2
 #endif
@@ -75,12 +79,14 @@ enum fs_types {
 class FileStoreBackend;
 
 #define CEPH_FS_FEATURE_INCOMPAT_SHARDS CompatSet::Feature(1, "sharded objects")
+#define CEPH_FS_FEATURE_INCOMPAT_OMAP_BACKEND CompatSet::Feature(2, "omap backend")
 
 class FSSuperblock {
 public:
   CompatSet compat_features;
+  string omap_backend;   ///< KeyValueDB type of current/omap
 
-  FSSuperblock() { }
+  FSSuperblock() : omap_backend("leveldb") { }
 
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &bl);
@@ -91,7 +97,8 @@ WRITE_CLASS_ENCODER(FSSuperblock)
 
 inline ostream& operator<<(ostream& out, const FSSuperblock& sb)
 {
-  return out << "sb(" << sb.compat_features << ")";
+  return out << "sb(" << sb.compat_features << " omap " << sb.omap_backend
+	     << ")";
 }
 
 class FileStore : public JournalingObjectStore,
@@ -143,7 +150,7 @@ private:
   // ObjectMap
   boost::scoped_ptr<ObjectMap> object_map;
   
-  Finisher ondisk_finisher;
+  ShardedFinisher ondisk_finisher;  ///< ordered per OpSequencer
 
   // helper fns
   int get_cdir(coll_t cid, char *s, int len);
@@ -166,6 +173,10 @@ private:
   list<Context*> sync_waiters;
   bool stop;
   void sync_entry();
+  /// sync just the objects changed since the last commit, in parallel
+  int _sync_dirty(map<ghobject_t, pair<bool, FDRef> > &dirty);
+  /// note what an op changes for the next targeted sync, before it runs
+  void _note_dirty_op(int op);
   struct SyncThread : public Thread {
     FileStore *fs;
     SyncThread(FileStore *f) : fs(f) {}
@@ -178,6 +189,7 @@ private:
   // -- op workqueue --
   struct Op {
     utime_t start;
+    utime_t queued;   ///< when it was handed to the op_wq
     uint64_t op;
     list<Transaction*> tls;
     Context *onreadable, *onreadable_sync;
@@ -187,11 +199,16 @@ private:
   class OpSequencer : public Sequencer_impl {
     Mutex qlock; // to protect q, for benefit of flush (peek/dequeue also protected by lock)
     list<Op*> q;
+    unsigned q_len;
     list<uint64_t> jq;
     Cond cond;
   public:
     Sequencer *parent;
     Mutex apply_lock;  // for apply mutual exclusion
+
+    // fair op_wq bookkeeping, protected by the op_tp lock
+    unsigned wq_pending;  ///< ops queued but not yet picked up by a worker
+    bool wq_active;       ///< in op_queue or being applied by a worker
     
     void queue_journal(uint64_t s) {
       Mutex::Locker l(qlock);
@@ -202,9 +219,11 @@ private:
       jq.pop_front();
       cond.Signal();
     }
-    void queue(Op *o) {
+    /// @return the number of ops now queued, o included
+    unsigned queue(Op *o) {
       Mutex::Locker l(qlock);
       q.push_back(o);
+      return ++q_len;
     }
     Op *peek_queue() {
       assert(apply_lock.is_locked());
@@ -215,6 +234,7 @@ private:
       Mutex::Locker l(qlock);
       Op *o = q.front();
       q.pop_front();
+      --q_len;
       cond.Signal();
       return o;
     }
@@ -241,8 +261,10 @@ private:
 
     OpSequencer()
       : qlock("FileStore::OpSequencer::qlock", false, false),
+	q_len(0),
 	parent(0),
-	apply_lock("FileStore::OpSequencer::apply_lock", false, false) {}
+	apply_lock("FileStore::OpSequencer::apply_lock", false, false),
+	wq_pending(0), wq_active(false) {}
     ~OpSequencer() {
       assert(q.empty());
     }
@@ -254,24 +276,51 @@ private:
 
   friend ostream& operator<<(ostream& out, const OpSequencer& s);
 
-  Mutex fdcache_lock;
   FDCache fdcache;
+  /// orders opening an object against unlinking it; striped like fdcache
+  vector<Mutex*> fdcache_lock;
+  Mutex &get_fdcache_lock(const ghobject_t &oid) {
+    return *fdcache_lock[fdcache.get_shard(oid)];
+  }
   WBThrottle wbthrottle;
 
   Sequencer default_osr;
   deque<OpSequencer*> op_queue;
+  unsigned op_queue_seqs;  ///< active sequencers, fair op_wq only
   uint64_t op_queue_len, op_queue_bytes;
   Cond op_throttle_cond;
   Mutex op_throttle_lock;
-  Finisher op_finisher;
+  ShardedFinisher op_finisher;  ///< ordered per OpSequencer
 
   ThreadPool op_tp;
+  /**
+   * By default a sequencer is queued once for every op, and a worker
+   * that picks it up while another is applying its previous op waits on
+   * apply_lock, so one busy sequencer can tie up every thread.  If fair,
+   * a sequencer is queued at most once: the worker that applied its op
+   * requeues it at the back if it has more, so workers only ever work
+   * on different sequencers and take turns among them op by op.
+   */
   struct OpWQ : public ThreadPool::WorkQueue<OpSequencer> {
     FileStore *store;
-    OpWQ(FileStore *fs, time_t timeout, time_t suicide_timeout, ThreadPool *tp)
-      : ThreadPool::WorkQueue<OpSequencer>("FileStore::OpWQ", timeout, suicide_timeout, tp), store(fs) {}
+    bool fair;
+    OpWQ(FileStore *fs, time_t timeout, time_t suicide_timeout, ThreadPool *tp,
+	 bool fair)
+      : ThreadPool::WorkQueue<OpSequencer>("FileStore::OpWQ", timeout, suicide_timeout, tp),
+	store(fs), fair(fair) {
+      // ops of a sequencer are applied in order under its apply_lock,
+      // whichever thread picks it up
+      set_prefetchable();
+    }
 
     bool _enqueue(OpSequencer *osr) {
+      if (fair) {
+	++osr->wq_pending;
+	if (osr->wq_active)
+	  return false;  // its worker will requeue it
+	osr->wq_active = true;
+	store->logger->set(l_os_oq_seqs, ++store->op_queue_seqs);
+      }
       store->op_queue.push_back(osr);
       return true;
     }
@@ -286,12 +335,23 @@ private:
 	return NULL;
       OpSequencer *osr = store->op_queue.front();
       store->op_queue.pop_front();
+      if (fair)
+	--osr->wq_pending;
       return osr;
     }
     void _process(OpSequencer *osr, ThreadPool::TPHandle &handle) {
       store->_do_op(osr, handle);
     }
     void _process_finish(OpSequencer *osr) {
+      // before _finish_op, which may let the sequencer go away
+      if (fair) {
+	if (osr->wq_pending) {
+	  store->op_queue.push_back(osr);
+	} else {
+	  osr->wq_active = false;
+	  store->logger->set(l_os_oq_seqs, --store->op_queue_seqs);
+	}
+      }
       store->_finish_op(osr);
     }
     void _clear() {
@@ -442,7 +502,15 @@ public:
     size_t len,
     bufferlist& bl,
     bool allow_eio = false);
+  int readv(
+    coll_t cid,
+    const ghobject_t& oid,
+    const vector<pair<uint64_t, size_t> >& extents,
+    vector<bufferlist>& bls,
+    vector<int>& rs,
+    bool allow_eio = false);
   int fiemap(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len, bufferlist& bl);
+  int get_crc_map(coll_t cid, const ghobject_t& oid, SloppyCRCMap *cm);
 
   int _touch(coll_t cid, const ghobject_t& oid);
   int _write(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len, const bufferlist& bl,
@@ -460,6 +528,8 @@ public:
 
   int _fgetattr(int fd, const char *name, bufferptr& bp);
   int _fgetattrs(int fd, map<string,bufferptr>& aset, bool user_only);
+  /// _fgetattrs, through the xattr cache of fd
+  int _fgetattrs_cached(FDRef fd, map<string,bufferptr>& aset, bool user_only);
   int _fsetattrs(int fd, map<string, bufferptr> &aset);
 
   void _start_sync();
@@ -526,6 +596,15 @@ public:
   int collection_list_range(coll_t c, ghobject_t start, ghobject_t end,
                             snapid_t seq, vector<ghobject_t> *ls);
 
+  /**
+   * Lay out the directories of empty collection c for expected_objs
+   * objects whose hashes all have the low bits set to match, so that
+   * it will not need to split as it fills.
+   */
+  int pre_split_collection(coll_t c, uint32_t bits, uint32_t match,
+			   uint64_t expected_objs);
+  int prepare_split_collection(coll_t c, uint32_t bits);
+
   // omap (see ObjectStore.h for documentation)
   int omap_get(coll_t c, const ghobject_t &oid, bufferlist *header,
 	       map<string, bufferlist> *out);
@@ -599,8 +678,15 @@ private:
   std::ofstream m_filestore_dump;
   JSONFormatter m_filestore_dump_fmt;
   atomic_t m_filestore_kill_at;
-  bool m_filestore_sloppy_crc;
-  int m_filestore_sloppy_crc_block_size;
+  /// read on the io paths without FileStore::lock
+  struct SloppyCRCConf {
+    bool enabled;
+    int block_size;
+    SloppyCRCConf(const md_config_t *conf)
+      : enabled(conf->filestore_sloppy_crc),
+	block_size(conf->filestore_sloppy_crc_block_size) {}
+  };
+  ConfigSnapshot<SloppyCRCConf> m_filestore_sloppy_crc;
   enum fs_types m_fs_type;
 
   //Determined xattr handling based on fs type
@@ -661,7 +747,10 @@ protected:
     return filestore->_do_copy_range(from, to, srcoff, len, dstoff);
   }
   int get_crc_block_size() {
-    return filestore->m_filestore_sloppy_crc_block_size;
+    return filestore->m_filestore_sloppy_crc.get()->block_size;
+  }
+  bool get_sloppy_crc() {
+    return filestore->m_filestore_sloppy_crc.get()->enabled;
   }
 public:
   FileStoreBackend(FileStore *fs) : filestore(fs) {}
@@ -687,6 +776,7 @@ public:
 				      loff_t srcoff, size_t len, loff_t dstoff) = 0;
   virtual int _crc_verify_read(int fd, loff_t off, size_t len, const bufferlist& bl,
 			       ostream *out) = 0;
+  virtual int _crc_load(int fd, SloppyCRCMap *cm) = 0;
 };
 
 #endif
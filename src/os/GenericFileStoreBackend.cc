@@ -25,6 +25,16 @@
 
 #if defined(__linux__)
 #include <linux/fs.h>
+#ifndef FICLONERANGE
+// same ioctl as BTRFS_IOC_CLONE_RANGE, hoisted to the vfs in 4.5
+struct file_clone_range {
+  __s64 src_fd;
+  __u64 src_offset;
+  __u64 src_length;
+  __u64 dest_offset;
+};
+#define FICLONERANGE _IOW(0x94, 13, struct file_clone_range)
+#endif
 #endif
 
 #include "include/compat.h"
@@ -57,7 +67,11 @@
 GenericFileStoreBackend::GenericFileStoreBackend(FileStore *fs):
   FileStoreBackend(fs),
   ioctl_fiemap(false),
+  seek_data_hole(false),
+  ioctl_reflink(false),
   m_filestore_fiemap(g_conf->filestore_fiemap),
+  m_filestore_seek_data_hole(g_conf->filestore_seek_data_hole),
+  m_filestore_reflink(g_conf->filestore_reflink),
   m_filestore_fsync_flushes_journal_data(g_conf->filestore_fsync_flushes_journal_data) {}
 
 int GenericFileStoreBackend::detect_features()
@@ -131,6 +145,42 @@ int GenericFileStoreBackend::detect_features()
     ioctl_fiemap = false;
   }
 
+  // the file starts with a hole; a working SEEK_DATA skips it
+#ifdef SEEK_DATA
+  if (m_filestore_seek_data_hole) {
+    off_t data = ::lseek(fd, 0, SEEK_DATA);
+    if (data == v[0]) {
+      dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is supported and appears to work" << dendl;
+      seek_data_hole = true;
+    } else if (data < 0) {
+      dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is NOT supported" << dendl;
+    } else {
+      dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is supported, but does not report holes" << dendl;
+    }
+  } else {
+    dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is disabled via 'filestore seek data hole' config option" << dendl;
+  }
+#else
+  dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is NOT supported" << dendl;
+#endif
+
+#if defined(__linux__)
+  if (m_filestore_reflink) {
+    struct file_clone_range clone_args;
+    memset(&clone_args, 0, sizeof(clone_args));
+    clone_args.src_fd = -1;
+    r = ::ioctl(fd, FICLONERANGE, &clone_args);
+    if (r < 0 && errno == EBADF) {
+      dout(0) << "detect_features: FICLONERANGE ioctl is supported" << dendl;
+      ioctl_reflink = true;
+    } else {
+      dout(0) << "detect_features: FICLONERANGE ioctl is NOT supported" << dendl;
+    }
+  } else {
+    dout(0) << "detect_features: FICLONERANGE ioctl is disabled via 'filestore reflink' config option" << dendl;
+  }
+#endif
+
   ::unlink(fn);
   TEMP_FAILURE_RETRY(::close(fd));
 
@@ -208,6 +258,142 @@ int GenericFileStoreBackend::syncfs()
   return ret;
 }
 
+int GenericFileStoreBackend::clone_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff)
+{
+  dout(20) << "clone_range: " << srcoff << "~" << len << " to " << dstoff << dendl;
+  if (ioctl_reflink) {
+    int r = _reflink_range(from, to, srcoff, len, dstoff);
+    if (r != -EOPNOTSUPP)
+      return r;
+  }
+  if (seek_data_hole || ioctl_fiemap)
+    return _sparse_copy_range(from, to, srcoff, len, dstoff);
+  return _copy_range(from, to, srcoff, len, dstoff);
+}
+
+int GenericFileStoreBackend::_reflink_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff)
+{
+#if defined(__linux__)
+  // offsets must be block aligned, and so must the length unless the
+  // range runs to the end of the source and past the end of the target
+  size_t blk_size = get_blksize();
+  if (!ALIGNED(srcoff, blk_size) || !ALIGNED(dstoff, blk_size))
+    return -EOPNOTSUPP;
+  if (!ALIGNED(len, blk_size)) {
+    struct stat from_stat, to_stat;
+    if (::fstat(from, &from_stat) < 0 || ::fstat(to, &to_stat) < 0)
+      return -errno;
+    if (srcoff + len != (uint64_t)from_stat.st_size ||
+	dstoff + len < (uint64_t)to_stat.st_size)
+      return -EOPNOTSUPP;
+  }
+
+  struct file_clone_range a;
+  a.src_fd = from;
+  a.src_offset = srcoff;
+  a.src_length = len;
+  a.dest_offset = dstoff;
+  if (::ioctl(to, FICLONERANGE, &a) < 0) {
+    int r = -errno;
+    dout(20) << "_reflink_range: FICLONERANGE failed with " << cpp_strerror(r)
+	     << ", copying instead" << dendl;
+    if (r == -EINVAL || r == -EXDEV || r == -EOPNOTSUPP || r == -ENOTTY)
+      return -EOPNOTSUPP;
+    return r;
+  }
+  if (get_sloppy_crc()) {
+    int rc = _crc_update_clone_range(from, to, srcoff, len, dstoff);
+    assert(rc >= 0);
+  }
+  dout(20) << "_reflink_range: cloned " << srcoff << "~" << len << " to " << dstoff << dendl;
+  return 0;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
+int GenericFileStoreBackend::_get_data_extents(int fd, uint64_t off, uint64_t len,
+					       map<uint64_t, uint64_t> *extents)
+{
+  uint64_t end = off + len;
+#ifdef SEEK_DATA
+  if (seek_data_hole) {
+    uint64_t pos = off;
+    while (pos < end) {
+      off_t data = ::lseek(fd, pos, SEEK_DATA);
+      if (data < 0) {
+	if (errno == ENXIO)
+	  break;  // nothing but hole up to eof
+	return -errno;
+      }
+      if ((uint64_t)data >= end)
+	break;
+      off_t hole = ::lseek(fd, data, SEEK_HOLE);
+      if (hole < 0)
+	return -errno;
+      uint64_t stop = MIN((uint64_t)hole, end);
+      (*extents)[data] = stop - data;
+      pos = stop;
+    }
+    return 0;
+  }
+#endif
+  if (!ioctl_fiemap)
+    return -EOPNOTSUPP;
+
+  struct fiemap *fiemap = NULL;
+  int r = do_fiemap(fd, off, len, &fiemap);
+  if (r < 0)
+    return r;
+  struct fiemap_extent *extent = &fiemap->fm_extents[0];
+  for (unsigned i = 0; i < fiemap->fm_mapped_extents; i++, extent++) {
+    uint64_t start = MAX(extent->fe_logical, off);
+    uint64_t stop = MIN(extent->fe_logical + extent->fe_length, end);
+    if (start < stop)
+      (*extents)[start] = stop - start;
+  }
+  free(fiemap);
+  return 0;
+}
+
+int GenericFileStoreBackend::_sparse_copy_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff)
+{
+  // holes may only be skipped if the target reads back zeros there,
+  // i.e. the range lies past its end; also leave short sources to the
+  // plain copy, which reports them
+  struct stat from_stat, to_stat;
+  if (::fstat(from, &from_stat) < 0 || ::fstat(to, &to_stat) < 0)
+    return -errno;
+  if (srcoff + len > (uint64_t)from_stat.st_size ||
+      dstoff < (uint64_t)to_stat.st_size)
+    return _copy_range(from, to, srcoff, len, dstoff);
+
+  map<uint64_t, uint64_t> extents;
+  int r = _get_data_extents(from, srcoff, len, &extents);
+  if (r < 0) {
+    dout(10) << "_sparse_copy_range: unable to map " << srcoff << "~" << len
+	     << ": " << cpp_strerror(r) << ", copying all of it" << dendl;
+    return _copy_range(from, to, srcoff, len, dstoff);
+  }
+
+  uint64_t copied = 0;
+  for (map<uint64_t, uint64_t>::iterator p = extents.begin();
+       p != extents.end();
+       ++p) {
+    r = _copy_range(from, to, p->first, p->second, dstoff + (p->first - srcoff));
+    if (r < 0)
+      return r;
+    copied += p->second;
+  }
+
+  // a trailing hole still has to make it into the size
+  if (::ftruncate(to, dstoff + len) < 0)
+    return -errno;
+  dout(20) << "_sparse_copy_range: " << srcoff << "~" << len << " to " << dstoff
+	   << " copied " << copied << " bytes in " << extents.size() << " extents" << dendl;
+  return 0;
+}
+
 int GenericFileStoreBackend::do_fiemap(int fd, off_t start, size_t len, struct fiemap **pfiemap)
 {
   struct fiemap *fiemap = NULL;
@@ -364,3 +550,9 @@ int GenericFileStoreBackend::_crc_verify_read(int fd, loff_t off, size_t len, co
     return r;
   return scm.read(off, len, bl, out);
 }
+
+int GenericFileStoreBackend::_crc_load(int fd, SloppyCRCMap *cm)
+{
+  cm->set_block_size(get_crc_block_size());
+  return _crc_load_or_init(fd, cm);
+}
@@ -22,7 +22,11 @@ class SloppyCRCMap;
 class GenericFileStoreBackend : public FileStoreBackend {
 private:
   bool ioctl_fiemap;
+  bool seek_data_hole;
+  bool ioctl_reflink;
   bool m_filestore_fiemap;
+  bool m_filestore_seek_data_hole;
+  bool m_filestore_reflink;
   bool m_filestore_fsync_flushes_journal_data;
 public:
   GenericFileStoreBackend(FileStore *fs);
@@ -39,9 +43,16 @@ public:
   virtual int syncfs();
   virtual bool has_fiemap() { return ioctl_fiemap; }
   virtual int do_fiemap(int fd, off_t start, size_t len, struct fiemap **pfiemap);
-  virtual int clone_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff) {
-    return _copy_range(from, to, srcoff, len, dstoff);
-  }
+  virtual int clone_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff);
+
+protected:
+  /// share extents with FICLONERANGE, -EOPNOTSUPP if the range can't be
+  int _reflink_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff);
+  /// copy only the data extents of the source, leaving holes as holes
+  int _sparse_copy_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff);
+  /// offset -> length of the data in [off, off+len)
+  int _get_data_extents(int fd, uint64_t off, uint64_t len,
+			map<uint64_t, uint64_t> *extents);
 
 private:
   int _crc_load_or_init(int fd, SloppyCRCMap *cm);
@@ -54,5 +65,6 @@ public:
 				      loff_t srcoff, size_t len, loff_t dstoff);
   virtual int _crc_verify_read(int fd, loff_t off, size_t len, const bufferlist& bl,
 			       ostream *out);
+  virtual int _crc_load(int fd, SloppyCRCMap *cm);
 };
 #endif
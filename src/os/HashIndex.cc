@@ -24,6 +24,7 @@
 
 const string HashIndex::SUBDIR_ATTR = "contents";
 const string HashIndex::IN_PROGRESS_OP_TAG = "in_progress_op";
+const string HashIndex::SPLIT_READY_ATTR = "split_ready_level";
 
 int HashIndex::cleanup() {
   bufferlist bl;
@@ -226,17 +227,28 @@ int HashIndex::_split(
   uint32_t bits,
   std::tr1::shared_ptr<CollectionIndex> dest) {
   assert(collection_version() == dest->collection_version());
+  if (list_cache) {
+    list_cache->clear(coll());
+    list_cache->clear(dest->coll());
+  }
   unsigned mkdirred = 0;
-  return col_split_level(
+  HashIndex *to = static_cast<HashIndex*>(dest.get());
+  int r = col_split_level(
     *this,
-    *static_cast<HashIndex*>(dest.get()),
+    *to,
     vector<string>(),
     bits,
     match,
     &mkdirred);
+  if (r < 0)
+    return r;
+  // the child keeps the layout it was handed
+  return to->set_ready_level(get_ready_level());
 }
 
 int HashIndex::_init() {
+  if (list_cache)
+    list_cache->clear(coll());
   subdir_info_s info;
   vector<string> path;
   return set_info(path, info);
@@ -246,6 +258,8 @@ int HashIndex::_init() {
 int HashIndex::_created(const vector<string> &path,
 			const ghobject_t &oid,
 			const string &mangled_name) {
+  if (list_cache)
+    list_cache->add(coll(), oid);
   subdir_info_s info;
   int r;
   r = get_info(path, &info);
@@ -257,6 +271,11 @@ int HashIndex::_created(const vector<string> &path,
     return r;
 
   if (must_split(info)) {
+    if (split_queue &&
+	info.objs <= split_threshold() * split_defer_max) {
+      split_queue->queue_split(coll(), get_base_path(), path);
+      return 0;
+    }
     int r = initiate_split(path, info);
     if (r < 0)
       return r;
@@ -266,6 +285,149 @@ int HashIndex::_created(const vector<string> &path,
   }
 }
 
+int HashIndex::split_queued(const vector<string> &path, uint64_t *moved) {
+  int exists = 0;
+  int r = path_exists(path, &exists);
+  if (r < 0 || !exists)
+    return r;
+  subdir_info_s info;
+  r = get_info(path, &info);
+  if (r < 0)
+    return r;
+  bool above_ready = info.hash_level < get_ready_level();
+  if (!must_split(info) && !above_ready)
+    return 0;
+  if (must_split(info)) {
+    *moved += info.objs;
+    r = initiate_split(path, info);
+    if (r < 0)
+      return r;
+    r = complete_split(path, info);
+    if (r < 0)
+      return r;
+  }
+
+  // a directory that grew well past the threshold may leave subdirs
+  // that are over it too, and above the ready level the sweep goes on
+  // down the tree
+  if (!split_queue)
+    return 0;
+  set<string> subdirs;
+  r = list_subdirs(path, &subdirs);
+  if (r < 0)
+    return r;
+  for (set<string>::iterator i = subdirs.begin(); i != subdirs.end(); ++i) {
+    vector<string> sub(path);
+    sub.push_back(*i);
+    subdir_info_s sub_info;
+    if (get_info(sub, &sub_info) == 0 &&
+	(must_split(sub_info) ||
+	 (sub_info.subdirs && sub_info.hash_level < get_ready_level())))
+      split_queue->queue_split(coll(), get_base_path(), sub);
+  }
+  return 0;
+}
+
+int HashIndex::prepare_split(uint32_t bits) {
+  if (!split_queue)
+    return -EOPNOTSUPP;
+  unsigned level = std::min((bits + 3) / 4, (unsigned)MAX_HASH_LEVEL);
+  int r = set_ready_level(level);
+  if (r < 0)
+    return r;
+  // (re)start the sweep; this also picks up one cut short by a restart
+  if (get_ready_level() > 0)
+    split_queue->queue_split(coll(), get_base_path(), vector<string>());
+  return 0;
+}
+
+unsigned HashIndex::get_ready_level() {
+  if (ready_level < 0) {
+    bufferlist bl;
+    int r = get_attr_path(vector<string>(), SPLIT_READY_ATTR, bl);
+    ready_level = 0;
+    if (r >= 0 && bl.length()) {
+      bufferlist::iterator p = bl.begin();
+      __u32 v;
+      ::decode(v, p);
+      ready_level = v;
+    }
+  }
+  return ready_level;
+}
+
+int HashIndex::set_ready_level(unsigned level) {
+  if (level <= get_ready_level())
+    return 0;
+  bufferlist bl;
+  ::encode((__u32)level, bl);
+  int r = add_attr_path(vector<string>(), SPLIT_READY_ATTR, bl);
+  if (r < 0)
+    return r;
+  ready_level = level;
+  return 0;
+}
+
+int HashIndex::pre_split(uint32_t bits, uint32_t match,
+			 uint64_t expected_objs) {
+  vector<string> path;
+  map<string, ghobject_t> objects;
+  int r = list_objects(path, 0, 0, &objects);
+  if (r < 0)
+    return r;
+  set<string> subdirs;
+  r = list_subdirs(path, &subdirs);
+  if (r < 0)
+    return r;
+  if (!objects.empty() || !subdirs.empty())
+    return -ENOTEMPTY;
+  return pre_split_level(path, bits, match, expected_objs);
+}
+
+int HashIndex::pre_split_level(const vector<string> &path, uint32_t bits,
+			       uint32_t match, uint64_t objs) {
+  unsigned level = path.size();
+  if (level >= (unsigned)MAX_HASH_LEVEL || objs <= split_threshold())
+    return 0;
+
+  // the values the hash nibble at this level can take, given bits/match
+  unsigned fixed = 0;
+  if (bits > 4 * level)
+    fixed = std::min(bits - 4 * level, 4u);
+  unsigned mask = (1 << fixed) - 1;
+  unsigned want = (match >> (4 * level)) & mask;
+  vector<unsigned> nibbles;
+  for (unsigned v = 0; v < 16; ++v)
+    if ((v & mask) == want)
+      nibbles.push_back(v);
+  uint64_t per_child = (objs + nibbles.size() - 1) / nibbles.size();
+
+  subdir_info_s info;
+  int r = get_info(path, &info);
+  if (r < 0)
+    return r;
+  for (vector<unsigned>::iterator i = nibbles.begin(); i != nibbles.end(); ++i) {
+    vector<string> child(path);
+    child.push_back(string(1, "0123456789ABCDEF"[*i]));
+    r = create_path(child);
+    if (r < 0 && r != -EEXIST)
+      return r;
+    subdir_info_s child_info;
+    child_info.hash_level = level + 1;
+    r = set_info(child, child_info);
+    if (r < 0)
+      return r;
+    r = pre_split_level(child, bits, match, per_child);
+    if (r < 0)
+      return r;
+  }
+  info.subdirs = nibbles.size();
+  r = set_info(path, info);
+  if (r < 0)
+    return r;
+  return fsync_dir(path);
+}
+
 int HashIndex::_remove(const vector<string> &path,
 		       const ghobject_t &oid,
 		       const string &mangled_name) {
@@ -273,6 +435,8 @@ int HashIndex::_remove(const vector<string> &path,
   r = remove_object(path, oid);
   if (r < 0)
     return r;
+  if (list_cache)
+    list_cache->remove(coll(), oid);
   subdir_info_s info;
   r = get_info(path, &info);
   if (r < 0)
@@ -317,8 +481,19 @@ int HashIndex::_lookup(const ghobject_t &oid,
 }
 
 int HashIndex::_collection_list(vector<ghobject_t> *ls) {
+  if (list_cache &&
+      list_cache->list_partial(coll(), ghobject_t(), 0, 0, ls, NULL))
+    return 0;
   vector<string> path;
-  return list_by_hash(path, 0, 0, 0, 0, ls);
+  if (!list_cache)
+    return list_by_hash(path, 0, 0, 0, 0, ls);
+  vector<ghobject_t> all;
+  int r = list_by_hash(path, 0, 0, 0, 0, &all);
+  if (r < 0)
+    return r;
+  list_cache->fill(coll(), all);
+  ls->insert(ls->end(), all.begin(), all.end());
+  return 0;
 }
 
 int HashIndex::_collection_list_partial(const ghobject_t &start,
@@ -333,10 +508,28 @@ int HashIndex::_collection_list_partial(const ghobject_t &start,
     next = &_next;
   *next = start;
   dout(20) << "_collection_list_partial " << start << " " << min_count << "-" << max_count << " ls.size " << ls->size() << dendl;
+  if (list_cache) {
+    if (list_cache->list_partial(coll(), start, max_count, seq, ls, next))
+      return 0;
+    if (start == ghobject_t()) {
+      // a listing from the start will most likely go on to the end:
+      // walk everything once and serve the rest from the cache
+      vector<ghobject_t> all;
+      int r = list_by_hash(path, 0, 0, 0, 0, &all);
+      if (r < 0)
+	return r;
+      list_cache->fill(coll(), all);
+      CollectionListCache::list_range(all.begin(), all.end(),
+				      max_count, seq, ls, next);
+      return 0;
+    }
+  }
   return list_by_hash(path, min_count, max_count, seq, next, ls);
 }
 
 int HashIndex::prep_delete() {
+  if (list_cache)
+    list_cache->clear(coll());
   return recursive_remove(vector<string>());
 }
 
@@ -417,15 +610,23 @@ int HashIndex::set_info(const vector<string> &path, const subdir_info_s &info) {
 }
 
 bool HashIndex::must_merge(const subdir_info_s &info) {
+  // merging would put objects back above the ready level
   return (info.hash_level > 0 &&
+	  info.hash_level > get_ready_level() &&
 	  info.objs < (unsigned)merge_threshold &&
 	  info.subdirs == 0);
 }
 
 bool HashIndex::must_split(const subdir_info_s &info) {
-  return (info.hash_level < (unsigned)MAX_HASH_LEVEL &&
-	  info.objs > ((unsigned)merge_threshold * 16 * split_multiplier));
-			    
+  if (info.hash_level >= (unsigned)MAX_HASH_LEVEL)
+    return false;
+  if (info.objs > ((unsigned)merge_threshold * 16 * split_multiplier))
+    return true;
+  // above the ready level any object is one too many, but only the
+  // split queue pushes those down
+  return (split_queue &&
+	  info.objs > 0 &&
+	  info.hash_level < get_ready_level());
 }
 
 int HashIndex::initiate_merge(const vector<string> &path, subdir_info_s info) {
@@ -619,9 +820,10 @@ int HashIndex::get_path_contents_by_hash(const vector<string> &path,
 					 const ghobject_t *next_object,
 					 const snapid_t *seq,
 					 set<string> *hash_prefixes,
-					 set<pair<string, ghobject_t> > *objects) {
+					 vector<pair<string, ghobject_t> > *objects) {
   set<string> subdirs;
   map<string, ghobject_t> rev_objects;
+  vector<ghobject_t> found;
   int r;
   string cur_prefix;
   for (vector<string>::const_iterator i = path.begin();
@@ -643,8 +845,13 @@ int HashIndex::get_path_contents_by_hash(const vector<string> &path,
     if (seq && i->second.hobj.snap < *seq)
       continue;
     hash_prefixes->insert(hash_prefix);
-    objects->insert(pair<string, ghobject_t>(hash_prefix, i->second));
+    found.push_back(i->second);
   }
+  // ghobject_t order is hash prefix order, so this sorts by both
+  sort_by_key(found);
+  objects->reserve(found.size());
+  for (vector<ghobject_t>::iterator i = found.begin(); i != found.end(); ++i)
+    objects->push_back(make_pair(get_path_str(*i), *i));
   r = list_subdirs(path, &subdirs);
   if (r < 0)
     return r;
@@ -673,7 +880,7 @@ int HashIndex::list_by_hash(const vector<string> &path,
   vector<string> next_path = path;
   next_path.push_back("");
   set<string> hash_prefixes;
-  set<pair<string, ghobject_t> > objects;
+  vector<pair<string, ghobject_t> > objects;
   int r = get_path_contents_by_hash(path,
 				    NULL,
 				    next,
@@ -686,8 +893,8 @@ int HashIndex::list_by_hash(const vector<string> &path,
   for (set<string>::iterator i = hash_prefixes.begin();
        i != hash_prefixes.end();
        ++i) {
-    set<pair<string, ghobject_t> >::iterator j = objects.lower_bound(
-      make_pair(*i, ghobject_t()));
+    vector<pair<string, ghobject_t> >::iterator j = lower_bound(
+      objects.begin(), objects.end(), make_pair(*i, ghobject_t()));
     if (j == objects.end() || j->first != *i) {
       if (min_count > 0 && out->size() > (unsigned)min_count) {
 	if (next)
@@ -18,6 +18,7 @@
 #include "include/buffer.h"
 #include "include/encoding.h"
 #include "LFNIndex.h"
+#include "CollectionListCache.h"
 
 
 /**
@@ -45,13 +46,38 @@
  * Subdirectories are created when the number of objects in a directory
  * exceed 32*merge_threshhold.  The number of objects in a directory 
  * is encoded as subdir_info_s in an xattr on the directory.
+ *
+ * With a SplitQueue set, a directory that reaches the split threshold
+ * is handed to the queue instead of being split by the write that took
+ * it there, and keeps taking objects until split_queued() gets to it.
+ * Only once it exceeds split_defer_max times the threshold is it split
+ * inline again.
+ *
+ * With a CollectionListCache set, the first listing from the start of
+ * the collection walks every directory and fills the cache, and later
+ * listings are served from it.  Creates and removes keep it current;
+ * anything else that moves objects in or out drops it.
  */
 class HashIndex : public LFNIndex {
+public:
+  /// Takes the directories whose split was deferred
+  class SplitQueue {
+  public:
+    virtual void queue_split(
+      coll_t c,			 ///< [in] Collection
+      const string &base_path,	 ///< [in] Path to the index root
+      const vector<string> &path ///< [in] Subdir to split
+      ) = 0;
+    virtual ~SplitQueue() {}
+  };
+
 private:
   /// Attribute name for storing subdir info @see subdir_info_s
   static const string SUBDIR_ATTR;
   /// Attribute name for storing in progress op tag
   static const string IN_PROGRESS_OP_TAG;
+  /// Attribute name for storing the level @see prepare_split
+  static const string SPLIT_READY_ATTR;
   /// Size (bits) in object hash
   static const int PATH_HASH_LEN = 32;
   /// Max length of hashed path
@@ -65,6 +91,13 @@ private:
   int merge_threshold;
   int split_multiplier;
 
+  SplitQueue *split_queue;  ///< NULL to split inline
+  int split_defer_max;
+
+  CollectionListCache *list_cache; ///< NULL to always walk directories
+
+  int ready_level; ///< -1 until read from the root @see get_ready_level
+
   /// Encodes current subdir state for determining when to split/merge.
   struct subdir_info_s {
     uint64_t objs;       ///< Objects in subdir.
@@ -140,7 +173,50 @@ public:
     double retry_probability=0) ///< [in] retry probability
     : LFNIndex(collection, base_path, index_version, retry_probability),
       merge_threshold(merge_at),
-      split_multiplier(split_multiple) {}
+      split_multiplier(split_multiple),
+      split_queue(NULL), split_defer_max(0), list_cache(NULL),
+      ready_level(-1) {}
+
+  /// Defer splits to q until a directory holds defer_max times the threshold
+  void set_split_queue(SplitQueue *q, int defer_max) {
+    split_queue = q;
+    split_defer_max = defer_max;
+  }
+
+  /// Serve listings from cache, filling it on the first full listing
+  void set_list_cache(CollectionListCache *cache) {
+    list_cache = cache;
+  }
+
+  /// Split a directory whose split was deferred, if it still needs it
+  int split_queued(
+    const vector<string> &path, ///< [in] Subdir to split
+    uint64_t *moved		///< [out] Objects moved are added here
+    ); /// @return Error Code, 0 on success
+
+  /**
+   * Create the subdirs an empty collection will need for expected_objs
+   * objects, all of which match (bits, match), so that it need not
+   * split while it fills up.
+   */
+  int pre_split(
+    uint32_t bits,	  ///< [in] Hash bits all objects share
+    uint32_t match,	  ///< [in] Value of those bits
+    uint64_t expected_objs ///< [in] Objects the collection will hold
+    ); /// @return Error Code, 0 on success, -ENOTEMPTY if not empty
+
+  /**
+   * Get the collection ready to be split to bits.
+   *
+   * From then on no directory above the hash level a split to bits
+   * goes down to keeps objects: the split queue pushes them down in
+   * the background, and directories at or above that level are not
+   * merged.  A later _split() to at most bits then only renames
+   * directories instead of moving objects one by one.
+   */
+  int prepare_split(
+    uint32_t bits	  ///< [in] Hash bits of the expected split
+    ); /// @return Error Code, 0 on success, -EOPNOTSUPP without a split queue
 
   /// @see CollectionIndex
   uint32_t collection_version() { return index_version; }
@@ -221,6 +297,27 @@ private:
     const subdir_info_s &info  	///< [in] Value to set
     ); /// @return Error Code, 0 on success
 
+  /// Give path the subdirs needed for objs objects, recursively
+  int pre_split_level(
+    const vector<string> &path, ///< [in] Subdir, already created
+    uint32_t bits,		///< [in] @see pre_split
+    uint32_t match,		///< [in] @see pre_split
+    uint64_t objs		///< [in] Objects expected under path
+    ); /// @return Error Code, 0 on success
+
+  /// Hash level objects are kept at or below, 0 if not prepared
+  unsigned get_ready_level();
+
+  /// Raise the ready level to level, if it is lower
+  int set_ready_level(
+    unsigned level ///< [in] New ready level
+    ); /// @return Error Code, 0 on success
+
+  /// Objects a directory may hold before it is split
+  uint64_t split_threshold() const {
+    return (unsigned)merge_threshold * 16 * split_multiplier;
+  }
+
   /// Encapsulates logic for when to split.
   bool must_merge(
     const subdir_info_s &info ///< [in] Info to check
@@ -322,7 +419,7 @@ private:
     const ghobject_t *next_object,          /// [in] list > *next_object
     const snapid_t *seq,                   /// [in] list >= *seq
     set<string> *hash_prefixes,            /// [out] prefixes in dir
-    set<pair<string, ghobject_t> > *objects /// [out] objects
+    vector<pair<string, ghobject_t> > *objects /// [out] objects, sorted
     );
 
   /// List objects in collection in ghobject_t order
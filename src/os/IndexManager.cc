@@ -25,6 +25,8 @@
 #include "common/Cond.h"
 #include "common/config.h"
 #include "common/debug.h"
+#include "common/Clock.h"
+#include "common/errno.h"
 #include "include/buffer.h"
 
 #include "IndexManager.h"
@@ -34,6 +36,12 @@
 
 #include "chain_xattr.h"
 
+#include "include/assert.h"
+
+#define dout_subsys ceph_subsys_filestore
+#undef dout_prefix
+#define dout_prefix *_dout << "filestore.index "
+
 static int set_version(const char *path, uint32_t version) {
   bufferlist bl;
   ::encode(version, bl);
@@ -73,6 +81,7 @@ int IndexManager::init_index(coll_t c, const char *path, uint32_t version) {
   int r = set_version(path, version);
   if (r < 0)
     return r;
+  list_cache.clear(c);
   HashIndex index(c, path, g_conf->filestore_merge_threshold,
 		  g_conf->filestore_split_multiple,
 		  version,
@@ -99,9 +108,16 @@ int IndexManager::build_index(coll_t c, const char *path, Index *index) {
     case CollectionIndex::HASH_INDEX_TAG_2: // fall through
     case CollectionIndex::HOBJECT_WITH_POOL: {
       // Must be a HashIndex
-      *index = Index(new HashIndex(c, path, g_conf->filestore_merge_threshold,
-				   g_conf->filestore_split_multiple, version), 
-		     RemoveOnDelete(c, this));
+      HashIndex *hindex = new HashIndex(c, path,
+					g_conf->filestore_merge_threshold,
+					g_conf->filestore_split_multiple,
+					version);
+      if (split_async)
+	hindex->set_split_queue(this, g_conf->filestore_split_defer_max);
+      // older layouts may not list in ghobject_t order
+      if (version == CollectionIndex::HOBJECT_WITH_POOL)
+	hindex->set_list_cache(&list_cache);
+      *index = Index(hindex, RemoveOnDelete(c, this));
       return 0;
     }
     default: assert(0);
@@ -109,15 +125,111 @@ int IndexManager::build_index(coll_t c, const char *path, Index *index) {
 
   } else {
     // No need to check
-    *index = Index(new HashIndex(c, path, g_conf->filestore_merge_threshold,
-				 g_conf->filestore_split_multiple,
-				 CollectionIndex::HOBJECT_WITH_POOL,
-				 g_conf->filestore_index_retry_probability),
-		   RemoveOnDelete(c, this));
+    HashIndex *hindex = new HashIndex(c, path,
+				      g_conf->filestore_merge_threshold,
+				      g_conf->filestore_split_multiple,
+				      CollectionIndex::HOBJECT_WITH_POOL,
+				      g_conf->filestore_index_retry_probability);
+    if (split_async)
+      hindex->set_split_queue(this, g_conf->filestore_split_defer_max);
+    hindex->set_list_cache(&list_cache);
+    *index = Index(hindex, RemoveOnDelete(c, this));
     return 0;
   }
 }
 
+void IndexManager::start_split_thread() {
+  {
+    Mutex::Locker l(split_lock);
+    assert(!split_async);
+    split_async = true;
+    split_stop = false;
+  }
+  split_thread.create();
+}
+
+void IndexManager::stop_split_thread() {
+  {
+    Mutex::Locker l(split_lock);
+    if (!split_async)
+      return;
+    split_stop = true;
+    split_cond.Signal();
+  }
+  split_thread.join();
+  Mutex::Locker l(split_lock);
+  split_async = false;
+  split_q.clear();
+  split_pending.clear();
+  split_paths.clear();
+}
+
+void IndexManager::queue_split(coll_t c, const string &base_path,
+			       const vector<string> &path) {
+  Mutex::Locker l(split_lock);
+  if (!split_async || split_stop)
+    return;
+  pair<coll_t, vector<string> > item(c, path);
+  if (!split_pending.insert(item).second)
+    return;
+  split_paths[c] = base_path;
+  split_q.push_back(item);
+  split_cond.Signal();
+}
+
+void IndexManager::split_entry() {
+  Mutex::Locker l(split_lock);
+  while (!split_stop) {
+    if (split_q.empty()) {
+      split_cond.Wait(split_lock);
+      continue;
+    }
+    pair<coll_t, vector<string> > item = split_q.front();
+    split_q.pop_front();
+    split_pending.erase(item);
+    string base = split_paths[item.first];
+    bool last = true;
+    for (deque<pair<coll_t, vector<string> > >::iterator i = split_q.begin();
+	 i != split_q.end();
+	 ++i) {
+      if (i->first == item.first) {
+	last = false;
+	break;
+      }
+    }
+    if (last)
+      split_paths.erase(item.first);
+
+    split_lock.Unlock();
+    uint64_t moved = 0;
+    int r;
+    {
+      Index index;
+      r = get_index(item.first, base.c_str(), &index);
+      if (r == 0) {
+	HashIndex *hindex = dynamic_cast<HashIndex*>(index.get());
+	if (hindex)
+	  r = hindex->split_queued(item.second, &moved);
+      }
+    }
+    split_lock.Lock();
+    if (r < 0)
+      dout(0) << "split of " << item.first << " " << item.second
+	      << " failed: " << cpp_strerror(r) << dendl;
+    else
+      dout(10) << "split " << item.first << " " << item.second
+	       << ", moved " << moved << " objects" << dendl;
+
+    // spread the cost: sleep as long as moving that many objects is
+    // allowed to take
+    if (moved && g_conf->filestore_split_rate > 0 && !split_stop) {
+      utime_t interval;
+      interval.set_from_double((double)moved / g_conf->filestore_split_rate);
+      split_cond.WaitInterval(g_ceph_context, split_lock, interval);
+    }
+  }
+}
+
 int IndexManager::get_index(coll_t c, const char *path, Index *index) {
   Mutex::Locker l(lock);
   while (1) {
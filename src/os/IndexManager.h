@@ -16,15 +16,19 @@
 
 #include <tr1/memory>
 #include <map>
+#include <set>
+#include <deque>
 
 #include "common/Mutex.h"
 #include "common/Cond.h"
+#include "common/Thread.h"
 #include "common/config.h"
 #include "common/debug.h"
 
 #include "CollectionIndex.h"
 #include "HashIndex.h"
 #include "FlatIndex.h"
+#include "CollectionListCache.h"
 
 
 /// Public type for Index
@@ -43,12 +47,41 @@ typedef std::tr1::shared_ptr<CollectionIndex> Index;
  * carry a reference to the parrent index.  Once all
  * shared_ptr<CollectionIndex> references have expired, the destructor
  * removes the weak_ptr from col_indices and wakes waiters.
+ *
+ * Once start_split_thread() has been called, HashIndex directory
+ * splits are deferred to a background thread, which takes the index
+ * like any other user and moves at most filestore_split_rate objects
+ * per second.
+ *
+ * HashIndexes share list_cache, so sorted listings of recently listed
+ * collections outlive the index they were built by.
  */
-class IndexManager {
+class IndexManager : public HashIndex::SplitQueue {
   Mutex lock; ///< Lock for Index Manager
   Cond cond;  ///< Cond for waiters on col_indices
   bool upgrade;
 
+  Mutex split_lock; ///< Protects the split_* members below
+  Cond split_cond;
+  bool split_async;
+  bool split_stop;
+  /// Deferred splits, in order, and the base path of each collection
+  deque<pair<coll_t, vector<string> > > split_q;
+  set<pair<coll_t, vector<string> > > split_pending; ///< Entries of split_q
+  map<coll_t, string> split_paths;
+
+  void split_entry();
+  struct SplitThread : public Thread {
+    IndexManager *manager;
+    SplitThread(IndexManager *m) : manager(m) {}
+    void *entry() {
+      manager->split_entry();
+      return 0;
+    }
+  } split_thread;
+
+  CollectionListCache list_cache;
+
   /// Currently in use CollectionIndices
   map<coll_t,std::tr1::weak_ptr<CollectionIndex> > col_indices;
 
@@ -86,7 +119,25 @@ class IndexManager {
 public:
   /// Constructor
   IndexManager(bool upgrade) : lock("IndexManager lock"),
-			       upgrade(upgrade) {}
+			       upgrade(upgrade),
+			       split_lock("IndexManager::split_lock"),
+			       split_async(false), split_stop(false),
+			       split_thread(this),
+			       list_cache(g_conf->filestore_list_cache_objects) {}
+
+  /// Defer splits of indexes built from now on to the split thread
+  void start_split_thread();
+  /// Stop the split thread; splits still queued are left for later writes
+  void stop_split_thread();
+
+  /// Forget the cached listing of c, whose objects moved behind our back
+  void clear_list_cache(coll_t c) {
+    list_cache.clear(c);
+  }
+
+  /// @see HashIndex::SplitQueue
+  void queue_split(coll_t c, const string &base_path,
+		   const vector<string> &path);
 
   /**
    * Reserve and return index for c
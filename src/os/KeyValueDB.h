@@ -11,6 +11,8 @@
 #include <boost/scoped_ptr.hpp>
 #include "ObjectMap.h"
 
+class CephContext;
+
 using std::string;
 /**
  * Defines virtual interface to be implemented by key value store
@@ -19,6 +21,48 @@ using std::string;
  */
 class KeyValueDB {
 public:
+  /**
+   * Create a store of the given type ("leveldb", or "rocksdb" if built
+   * with librocksdb) at dir.  Configure it, then open() or
+   * create_and_open() it.
+   *
+   * @return NULL if type is unknown or not built in
+   */
+  static KeyValueDB *create(CephContext *cct, const string &type,
+			    const string &dir);
+
+  /// Opens underlying db
+  virtual int open(ostream &out) = 0;
+  /// Creates underlying db if missing and opens it
+  virtual int create_and_open(ostream &out) = 0;
+  virtual void close() { }
+
+  /**
+   * Keep keys whose prefix matches one of the patterns in a separate
+   * column family, tuned on its own, on backends that have them.
+   * Others ignore this.  Call before opening.
+   *
+   * @param families space separated name:pattern pairs, in match order;
+   *                 patterns as in fnmatch(3)
+   * @param options space separated name:options pairs, options in the
+   *                backend's own syntax
+   */
+  virtual void set_column_families(const string &families,
+				   const string &options) { }
+
+  virtual void compact() { }
+  /// compact all keys with a given prefix
+  virtual void compact_prefix(const string &prefix) { }
+  virtual void compact_prefix_async(const string &prefix) {
+    compact_prefix(prefix);
+  }
+  virtual void compact_range(const string &prefix,
+			     const string &start, const string &end) { }
+  virtual void compact_range_async(const string &prefix,
+				   const string &start, const string &end) {
+    compact_range(prefix, start, end);
+  }
+
   class TransactionImpl {
   public:
     /// Set Keys
@@ -151,7 +195,7 @@ public:
 
   Iterator get_iterator(const string &prefix) {
     return std::tr1::shared_ptr<IteratorImpl>(
-      new IteratorImpl(prefix, get_iterator())
+      new IteratorImpl(prefix, _get_prefix_iterator(prefix))
     );
   }
 
@@ -161,7 +205,7 @@ public:
 
   Iterator get_snapshot_iterator(const string &prefix) {
     return std::tr1::shared_ptr<IteratorImpl>(
-      new IteratorImpl(prefix, get_snapshot_iterator())
+      new IteratorImpl(prefix, _get_prefix_snapshot_iterator(prefix))
     );
   }
 
@@ -172,6 +216,15 @@ public:
 protected:
   virtual WholeSpaceIterator _get_iterator() = 0;
   virtual WholeSpaceIterator _get_snapshot_iterator() = 0;
+
+  /// iterator that need only be valid within prefix
+  virtual WholeSpaceIterator _get_prefix_iterator(const string &prefix) {
+    return _get_iterator();
+  }
+  virtual WholeSpaceIterator _get_prefix_snapshot_iterator(
+    const string &prefix) {
+    return _get_snapshot_iterator();
+  }
 };
 
 #endif
@@ -0,0 +1,114 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/vfs.h>
+
+#include "KeyValueStore.h"
+
+#include "common/debug.h"
+#include "common/errno.h"
+#include "include/assert.h"
+
+#define dout_subsys ceph_subsys_keyvaluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "keyvaluestore(" << path << ") "
+
+/*
+ * On top of the BlockStore layout:
+ *
+ *   D  data chunk: %016llx chunk id -> chunk, trailing zeros trimmed
+ *
+ * Chunk ids come from the same counter as omap ids.
+ */
+static const string PREFIX_DATA = "D";
+
+static string get_chunk_key(uint64_t id)
+{
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)id);
+  return string(buf);
+}
+
+uint64_t KeyValueStore::_get_mkfs_block_size()
+{
+  return g_conf->keyvaluestore_chunk_size;
+}
+
+void KeyValueStore::_mkfs_data(KeyValueDB::Transaction t)
+{
+  t->rmkeys_by_prefix(PREFIX_DATA);
+}
+
+int KeyValueStore::_write_extents(TransContext *txc, const char *p,
+				  uint64_t length,
+				  vector<blockstore_extent_t> *out)
+{
+  assert(length % block_size == 0);
+  for (uint64_t pos = 0; pos < length; pos += block_size) {
+    const char *c = p + pos;
+    uint64_t len = block_size;
+    while (len > 0 && c[len - 1] == 0)
+      --len;
+    bufferlist bl;
+    bl.append(c, len);
+    uint64_t id = ++nid_max;
+    string key = get_chunk_key(id);
+    txc->t->set(PREFIX_DATA, key, bl);
+    txc->data[key] = bl;
+    out->push_back(blockstore_extent_t(id, block_size));
+  }
+  txc->nid_dirty = true;
+  return 0;
+}
+
+int KeyValueStore::_read_extent(TransContext *txc,
+				const blockstore_extent_t &e,
+				uint64_t offset, uint64_t length, char *out)
+{
+  string key = get_chunk_key(e.offset);
+  bufferlist bl;
+  map<string, bufferlist>::iterator p;
+  if (txc && (p = txc->data.find(key)) != txc->data.end()) {
+    bl = p->second;
+  } else {
+    int r = _get_kv(PREFIX_DATA, key, &bl);
+    if (r < 0) {
+      derr << __func__ << " chunk " << key << ": " << cpp_strerror(r) << dendl;
+      return r == -ENOENT ? -EIO : r;
+    }
+  }
+  // out is zeroed; only copy what was stored
+  if (offset < bl.length())
+    bl.copy(offset, std::min<uint64_t>(length, bl.length() - offset), out);
+  return 0;
+}
+
+void KeyValueStore::_release_extent(TransContext *txc,
+				    const blockstore_extent_t &e)
+{
+  // punches are block aligned and an extent is a single chunk, so a
+  // chunk is always released whole
+  assert(e.length == block_size);
+  string key = get_chunk_key(e.offset);
+  txc->t->rmkey(PREFIX_DATA, key);
+  txc->data.erase(key);
+}
+
+int KeyValueStore::statfs(struct statfs *buf)
+{
+  // all the space there is is that of the file system holding the db
+  if (::statfs(path.c_str(), buf) < 0)
+    return -errno;
+  return 0;
+}
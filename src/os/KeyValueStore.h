@@ -0,0 +1,50 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_KEYVALUESTORE_H
+#define CEPH_KEYVALUESTORE_H
+
+#include "BlockStore.h"
+
+/**
+ * An ObjectStore that keeps everything, object data included, in
+ * <path>/db.
+ *
+ * Metadata, xattrs and omaps are laid out exactly as in BlockStore.
+ * Data is cut into chunks of the store's block size, each stored under
+ * its own key; an extent in the block map of an object names one chunk
+ * rather than a device range.  Trailing zeros of a chunk are not stored,
+ * so small objects cost about their size.  A batch is one leveldb
+ * transaction, so there is nothing to sync separately and no per-object
+ * file or inode.
+ */
+class KeyValueStore : public BlockStore {
+protected:
+  uint64_t _get_mkfs_block_size();
+  int _open_data(bool create) { return 0; }
+  void _close_data() {}
+  void _mkfs_data(KeyValueDB::Transaction t);
+  int _load_data() { return 0; }
+  int _write_extents(TransContext *txc, const char *p, uint64_t length,
+		     vector<blockstore_extent_t> *out);
+  int _read_extent(TransContext *txc, const blockstore_extent_t &e,
+		   uint64_t offset, uint64_t length, char *out);
+  void _release_extent(TransContext *txc, const blockstore_extent_t &e);
+  int _commit_data(TransContext *txc) { return 0; }
+
+public:
+  KeyValueStore(const string &path) : BlockStore(path) {}
+
+  int statfs(struct statfs *buf);
+};
+
+#endif
@@ -129,6 +129,13 @@ public:
     const SequencerPosition *spos=0   ///< [in] Sequencer
     ) { return 0; }
 
+  /// Let the backend reclaim the space of removed keys of oid in [first, last)
+  virtual void compact_range(
+    const ghobject_t &oid,            ///< [in] object
+    const string &first,              ///< [in] first key in range
+    const string &last                ///< [in] first key past range
+    ) {}
+
   virtual bool check(std::ostream &out) { return true; }
 
   class ObjectMapIteratorImpl {
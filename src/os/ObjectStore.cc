@@ -16,6 +16,24 @@
 #include "ObjectStore.h"
 #include "common/Formatter.h"
 #include "FileStore.h"
+#include "BlockStore.h"
+#include "KeyValueStore.h"
+
+ObjectStore *ObjectStore::create(const string& type,
+				 const string& data,
+				 const string& journal)
+{
+  if (type == "filestore")
+    return new FileStore(data, journal);
+  if (type == "blockstore")
+    return new BlockStore(data);
+  if (type == "keyvaluestore")
+    return new KeyValueStore(data);
+  return NULL;
+}
+
+ObjectPool ObjectStore::Transaction::alloc_pool(
+  "ObjectStore::Transaction", sizeof(ObjectStore::Transaction));
 
 ostream& operator<<(ostream& out, const ObjectStore::Sequencer& s)
 {
@@ -498,6 +516,22 @@ void ObjectStore::Transaction::generate_test_instances(list<ObjectStore::Transac
   o.push_back(t);  
 }
 
+int ObjectStore::readv(
+  coll_t cid,
+  const ghobject_t& oid,
+  const vector<pair<uint64_t, size_t> >& extents,
+  vector<bufferlist>& bls,
+  vector<int>& rs,
+  bool allow_eio)
+{
+  bls.resize(extents.size());
+  rs.resize(extents.size());
+  for (unsigned i = 0; i < extents.size(); ++i)
+    rs[i] = read(cid, oid, extents[i].first, extents[i].second, bls[i],
+		 allow_eio);
+  return 0;
+}
+
 int ObjectStore::collection_list(coll_t c, vector<hobject_t>& o)
 {
   vector<ghobject_t> go;
@@ -539,3 +573,67 @@ int ObjectStore::collection_list_range(coll_t c, hobject_t start, hobject_t end,
   }
   return ret;
 }
+
+int ObjectStore::omap_get_values_range(
+  coll_t c, const ghobject_t &oid,
+  const string &start_after, const string &filter_prefix,
+  uint64_t max_entries, uint64_t max_bytes,
+  map<string, bufferlist> *out, bool *more)
+{
+  ObjectMap::ObjectMapIterator iter = get_omap_iterator(c, oid);
+  if (!iter)
+    return -ENOENT;
+  iter->upper_bound(start_after);
+  if (filter_prefix >= start_after)
+    iter->lower_bound(filter_prefix);
+
+  uint64_t bytes = 0;
+  map<string, bufferlist>::iterator hint = out->end();
+  for (; iter->valid(); iter->next()) {
+    string key = iter->key();
+    if (key.compare(0, filter_prefix.size(), filter_prefix) != 0)
+      break;
+    if (out->size() >= max_entries ||
+	(max_bytes && bytes >= max_bytes && !out->empty())) {
+      if (more)
+	*more = true;
+      return 0;
+    }
+    bufferlist value = iter->value();
+    bytes += key.length() + value.length();
+    // keys come in order, so each insert goes at the end
+    hint = out->insert(hint, make_pair(key, value));
+  }
+  if (more)
+    *more = false;
+  return 0;
+}
+
+int ObjectStore::omap_get_keys_range(
+  coll_t c, const ghobject_t &oid,
+  const string &start_after,
+  uint64_t max_entries, uint64_t max_bytes,
+  set<string> *out, bool *more)
+{
+  ObjectMap::ObjectMapIterator iter = get_omap_iterator(c, oid);
+  if (!iter)
+    return -ENOENT;
+  iter->upper_bound(start_after);
+
+  uint64_t bytes = 0;
+  set<string>::iterator hint = out->end();
+  for (; iter->valid(); iter->next()) {
+    if (out->size() >= max_entries ||
+	(max_bytes && bytes >= max_bytes && !out->empty())) {
+      if (more)
+	*more = true;
+      return 0;
+    }
+    string key = iter->key();
+    bytes += key.length();
+    hint = out->insert(hint, key);
+  }
+  if (more)
+    *more = false;
+  return 0;
+}
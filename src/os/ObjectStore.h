@@ -19,6 +19,7 @@
 #include "include/types.h"
 #include "osd/osd_types.h"
 #include "common/TrackedOp.h"
+#include "common/ObjectPool.h"
 #include "ObjectMap.h"
 
 #include <errno.h>
@@ -43,6 +44,7 @@ namespace ceph {
  */
 
 class Logger;
+class SloppyCRCMap;
 
 enum {
   l_os_first = 84000,
@@ -53,6 +55,7 @@ enum {
   l_os_jq_bytes,
   l_os_j_bytes,
   l_os_j_lat,
+  l_os_j_lat_hist,
   l_os_j_wr,
   l_os_j_wr_bytes,
   l_os_oq_max_ops,
@@ -68,6 +71,26 @@ enum {
   l_os_commit_lat,
   l_os_j_full,
   l_os_queue_lat,
+  l_os_oq_seqs,
+  l_os_oq_seq_depth,
+  l_os_oq_wait_lat,
+  l_os_xattr_cache_hit,
+  l_os_xattr_cache_miss,
+  l_os_xattr_cache_bytes,
+  l_os_fd_cache_hit,
+  l_os_fd_cache_miss,
+  l_os_j_wr_entries,
+  l_os_j_wr_size_4k,
+  l_os_j_wr_size_64k,
+  l_os_j_wr_size_1m,
+  l_os_j_wr_size_large,
+  l_os_j_wr_entries_1,
+  l_os_j_wr_entries_4,
+  l_os_j_wr_entries_16,
+  l_os_j_wr_entries_many,
+  l_os_j_batch_wait,
+  l_os_commit_targeted,
+  l_os_commit_targeted_objs,
   l_os_last,
 };
 
@@ -250,8 +273,15 @@ public:
       tbl.swap(other.tbl);
     }
 
+    /**
+     * Move other's ops and callbacks to the end of this transaction
+     *
+     * The encoded ops, data payloads included, are spliced over by
+     * reference; other is left empty.
+     */
     void append(Transaction& other) {
       ops += other.ops;
+      other.ops = 0;
       assert(pad_unused_bytes == 0);
       assert(other.pad_unused_bytes == 0);
       if (other.largest_data_len > largest_data_len) {
@@ -259,7 +289,9 @@ public:
 	largest_data_off = other.largest_data_off;
 	largest_data_off_in_tbl = tbl.length() + other.largest_data_off_in_tbl;
       }
-      tbl.append(other.tbl);
+      other.largest_data_len = other.largest_data_off = 0;
+      other.largest_data_off_in_tbl = 0;
+      tbl.claim_append(other.tbl);
       on_applied.splice(on_applied.end(), other.on_applied);
       on_commit.splice(on_commit.end(), other.on_commit);
       on_applied_sync.splice(on_applied_sync.end(), other.on_applied_sync);
@@ -697,6 +729,9 @@ public:
     }
 
     // etc.
+    static ObjectPool alloc_pool;
+    OBJECT_POOL_ALLOCATOR(alloc_pool)
+
     Transaction() :
       ops(0), pad_unused_bytes(0), largest_data_len(0), largest_data_off(0), largest_data_off_in_tbl(0),
       sobject_encoding(false), pool_override(-1), use_pool_override(false),
@@ -850,6 +885,18 @@ public:
   ObjectStore() : logger(NULL) {}
   virtual ~ObjectStore() {}
 
+  /**
+   * create a store of the given type
+   *
+   * @param type "filestore" or "blockstore"
+   * @param data path of the data directory
+   * @param journal path of the journal, if the store has one
+   * @returns the new store, or NULL if type is unknown
+   */
+  static ObjectStore *create(const string& type,
+			     const string& data,
+			     const string& journal);
+
   // mgmt
   virtual int version_stamp_is_valid(uint32_t *version) { return 1; }
   virtual int update_version_stamp() = 0;
@@ -894,8 +941,42 @@ public:
     bufferlist& bl,
     bool allow_eio = false) = 0;
 
+  /**
+   * read several extents of an object at once
+   *
+   * Does what a read() of each extent would, but lets the store find
+   * the object once and batch the io.  The default just calls read().
+   *
+   * @param extents offset and length of each extent
+   * @param bls [out] the data of each extent
+   * @param rs [out] what read() would have returned for each extent
+   * @returns 0, or the error that kept the object from being read at all
+   */
+  virtual int readv(
+    coll_t cid,
+    const ghobject_t& oid,
+    const vector<pair<uint64_t, size_t> >& extents,
+    vector<bufferlist>& bls,
+    vector<int>& rs,
+    bool allow_eio = false);
+
   virtual int fiemap(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len, bufferlist& bl) = 0;
 
+  /**
+   * get the crcs the store keeps of an object's blocks
+   *
+   * Only blocks written in whole since the store started tracking them
+   * are covered.
+   *
+   * @param cid collection
+   * @param oid object
+   * @param cm [out] the crcs
+   * @returns 0 on success, -EOPNOTSUPP if this store does not track them
+   */
+  virtual int get_crc_map(coll_t cid, const ghobject_t& oid, SloppyCRCMap *cm) {
+    return -EOPNOTSUPP;
+  }
+
   virtual int getattr(coll_t cid, const ghobject_t& oid, const char *name, bufferptr& value) = 0;
   int getattr(coll_t cid, const ghobject_t& oid, const char *name, bufferlist& value) {
     bufferptr bp;
@@ -931,6 +1012,21 @@ public:
   virtual bool collection_empty(coll_t c) = 0;
   virtual int collection_list(coll_t c, vector<ghobject_t>& o) = 0;
 
+  /**
+   * hint that c may be split to bits hash bits
+   *
+   * The store may lay its objects out in the background so that a
+   * later split_collection up to bits is cheap.  Not part of any
+   * transaction, and nothing but the cost of the split depends on it.
+   *
+   * @param c collection
+   * @param bits hash bits of the split to get ready for
+   * @return zero on success, or negative error
+   */
+  virtual int prepare_split_collection(coll_t c, uint32_t bits) {
+    return 0;
+  }
+
   /**
    * list partial contents of collection relative to a hash offset/position
    *
@@ -1002,6 +1098,40 @@ public:
     map<string, bufferlist> *out ///< [out] Returned keys and values
     ) = 0;
 
+  /**
+   * Get a range of omap keys and values in key order
+   *
+   * Starts after start_after, or at filter_prefix if that sorts later,
+   * and stops at the first key not starting with filter_prefix, after
+   * max_entries entries, or once the returned keys and values reach
+   * max_bytes.  At least one entry is returned if there is one, so
+   * callers always make progress.  Only the returned entries are
+   * copied out of the store.
+   *
+   * @return 0 on success, -ENOENT if there is no such object
+   */
+  virtual int omap_get_values_range(
+    coll_t c,                     ///< [in] Collection containing oid
+    const ghobject_t &oid,        ///< [in] Object containing omap
+    const string &start_after,    ///< [in] Return keys after this one
+    const string &filter_prefix,  ///< [in] Return only keys with this prefix
+    uint64_t max_entries,         ///< [in] Return at most this many entries
+    uint64_t max_bytes,           ///< [in] Byte budget, 0 for none
+    map<string, bufferlist> *out, ///< [out] Returned keys and values
+    bool *more                    ///< [out] Whether matching keys remain, may be NULL
+    );
+
+  /// Get a range of omap keys, @see omap_get_values_range
+  virtual int omap_get_keys_range(
+    coll_t c,                     ///< [in] Collection containing oid
+    const ghobject_t &oid,        ///< [in] Object containing omap
+    const string &start_after,    ///< [in] Return keys after this one
+    uint64_t max_entries,         ///< [in] Return at most this many keys
+    uint64_t max_bytes,           ///< [in] Byte budget, 0 for none
+    set<string> *out,             ///< [out] Returned keys
+    bool *more                    ///< [out] Whether keys remain, may be NULL
+    );
+
   /// Filters keys into out which are defined on oid
   virtual int omap_check_keys(
     coll_t c,                ///< [in] Collection containing oid
@@ -0,0 +1,698 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include "RocksDBStore.h"
+
+#include <algorithm>
+#include <set>
+#include <map>
+#include <string>
+#include <tr1/memory>
+#include <errno.h>
+#include <fnmatch.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "rocksdb/cache.h"
+#include "rocksdb/convenience.h"
+#include "rocksdb/env.h"
+#include "rocksdb/filter_policy.h"
+#include "rocksdb/table.h"
+using std::string;
+#include "common/perf_counters.h"
+#include "common/safe_io.h"
+#include "include/str_list.h"
+
+const string RocksDBStore::COLUMN_FAMILIES_FILE = "ceph_column_families";
+
+RocksDBStore::RocksDBStore(CephContext *c, const string &path) :
+  cct(c),
+  logger(NULL),
+  path(path),
+  db(NULL),
+  compact_queue_lock("RocksDBStore::compact_thread_lock"),
+  compact_queue_stop(false),
+  compact_thread(this),
+  options()
+{
+  options.write_buffer_size = cct->_conf->rocksdb_write_buffer_size;
+  options.cache_size = cct->_conf->rocksdb_cache_size;
+  options.block_size = cct->_conf->rocksdb_block_size;
+  options.bloom_size = cct->_conf->rocksdb_bloom_size;
+  options.compression_enabled = cct->_conf->rocksdb_compression;
+  options.max_open_files = cct->_conf->rocksdb_max_open_files;
+  options.max_background_compactions =
+    cct->_conf->rocksdb_max_background_compactions;
+  options.max_background_flushes = cct->_conf->rocksdb_max_background_flushes;
+  options.paranoid_checks = cct->_conf->rocksdb_paranoid;
+  options.log_file = cct->_conf->rocksdb_log;
+}
+
+int RocksDBStore::parse_pairs(const string &in,
+			      vector<pair<string, string> > *out)
+{
+  list<string> items;
+  get_str_list(in, " \t\n", items);
+  for (list<string>::iterator p = items.begin(); p != items.end(); ++p) {
+    size_t pos = p->find(':');
+    if (pos == 0 || pos == string::npos || pos + 1 == p->length())
+      return -EINVAL;
+    out->push_back(make_pair(p->substr(0, pos), p->substr(pos + 1)));
+  }
+  return 0;
+}
+
+int RocksDBStore::init(ostream &out, bool create_if_missing)
+{
+  rocksdb::Options rdoptions;
+
+  if (options.write_buffer_size)
+    rdoptions.write_buffer_size = options.write_buffer_size;
+  if (options.max_open_files)
+    rdoptions.max_open_files = options.max_open_files;
+  if (options.max_background_compactions) {
+    rdoptions.max_background_compactions = options.max_background_compactions;
+    rdoptions.env->SetBackgroundThreads(options.max_background_compactions,
+					rocksdb::Env::LOW);
+  }
+  if (options.max_background_flushes) {
+    rdoptions.max_background_flushes = options.max_background_flushes;
+    rdoptions.env->SetBackgroundThreads(options.max_background_flushes,
+					rocksdb::Env::HIGH);
+  }
+
+  rocksdb::BlockBasedTableOptions table_options;
+  if (options.cache_size)
+    table_options.block_cache = rocksdb::NewLRUCache(options.cache_size);
+  if (options.block_size)
+    table_options.block_size = options.block_size;
+  if (options.bloom_size)
+    table_options.filter_policy.reset(
+      rocksdb::NewBloomFilterPolicy(options.bloom_size));
+  rdoptions.table_factory.reset(
+    rocksdb::NewBlockBasedTableFactory(table_options));
+
+  if (options.compression_enabled)
+    rdoptions.compression = rocksdb::kSnappyCompression;
+  else
+    rdoptions.compression = rocksdb::kNoCompression;
+
+  rdoptions.error_if_exists = options.error_if_exists;
+  rdoptions.paranoid_checks = options.paranoid_checks;
+  rdoptions.create_if_missing = create_if_missing;
+  rdoptions.create_missing_column_families = create_if_missing;
+
+  if (options.log_file.length()) {
+    rocksdb::Env *env = rocksdb::Env::Default();
+    env->NewLogger(options.log_file, &rdoptions.info_log);
+  }
+
+  // the prefix to family mapping is whatever the store was created with
+  vector<string> existing;
+  rocksdb::Status status =
+    rocksdb::DB::ListColumnFamilies(rdoptions, path, &existing);
+  bool is_new = !status.ok();
+  string families;
+  char buf[4096];
+  int r = safe_read_file(path.c_str(), COLUMN_FAMILIES_FILE.c_str(),
+			 buf, sizeof(buf));
+  if (r >= 0) {
+    families = string(buf, r);
+    if (families != options.column_families)
+      lderr(cct) << __func__ << " keeping column families '" << families
+		 << "' this store was created with, not '"
+		 << options.column_families << "'" << dendl;
+  } else if (r != -ENOENT) {
+    out << "failed to read " << COLUMN_FAMILIES_FILE << ": "
+	<< cpp_strerror(r) << std::endl;
+    return r;
+  } else if (is_new && create_if_missing) {
+    // record the mapping before there is anything it applies to
+    families = options.column_families;
+    r = ::mkdir(path.c_str(), 0755);
+    if (r < 0 && errno != EEXIST) {
+      r = -errno;
+      out << "failed to create " << path << ": " << cpp_strerror(r)
+	  << std::endl;
+      return r;
+    }
+    r = safe_write_file(path.c_str(), COLUMN_FAMILIES_FILE.c_str(),
+			families.c_str(), families.length());
+    if (r < 0) {
+      out << "failed to write " << COLUMN_FAMILIES_FILE << ": "
+	  << cpp_strerror(r) << std::endl;
+      return r;
+    }
+  }
+  // else a store created without column families, or none at all
+
+  vector<pair<string, string> > patterns, cf_options;
+  if (parse_pairs(families, &patterns) < 0) {
+    out << "bad column families '" << families << "'" << std::endl;
+    return -EINVAL;
+  }
+  if (parse_pairs(options.column_family_options, &cf_options) < 0) {
+    out << "bad column family options '" << options.column_family_options
+	<< "'" << std::endl;
+    return -EINVAL;
+  }
+
+  cf_names.clear();
+  cf_patterns.clear();
+  cf_names.push_back(rocksdb::kDefaultColumnFamilyName);
+  for (vector<pair<string, string> >::iterator p = patterns.begin();
+       p != patterns.end();
+       ++p) {
+    unsigned i = find(cf_names.begin(), cf_names.end(), p->first) -
+      cf_names.begin();
+    if (i == cf_names.size())
+      cf_names.push_back(p->first);
+    cf_patterns.push_back(make_pair(p->second, i));
+  }
+  // every family in the store must be opened, mapped or not
+  for (vector<string>::iterator p = existing.begin();
+       p != existing.end();
+       ++p) {
+    if (find(cf_names.begin(), cf_names.end(), *p) == cf_names.end()) {
+      lderr(cct) << __func__ << " column family " << *p
+		 << " has no prefixes mapped to it" << dendl;
+      cf_names.push_back(*p);
+    }
+  }
+
+  vector<rocksdb::ColumnFamilyDescriptor> cfs;
+  for (vector<string>::iterator p = cf_names.begin();
+       p != cf_names.end();
+       ++p) {
+    rocksdb::ColumnFamilyOptions cfo(rdoptions);
+    for (vector<pair<string, string> >::iterator q = cf_options.begin();
+	 q != cf_options.end();
+	 ++q) {
+      if (q->first != *p)
+	continue;
+      rocksdb::ColumnFamilyOptions tuned;
+      rocksdb::Status s =
+	rocksdb::GetColumnFamilyOptionsFromString(cfo, q->second, &tuned);
+      if (!s.ok()) {
+	out << "bad options for column family " << *p << ": "
+	    << s.ToString() << std::endl;
+	return -EINVAL;
+      }
+      cfo = tuned;
+    }
+    cfs.push_back(rocksdb::ColumnFamilyDescriptor(*p, cfo));
+  }
+
+  status = rocksdb::DB::Open(rocksdb::DBOptions(rdoptions), path, cfs,
+			     &cf_handles, &db);
+  if (!status.ok()) {
+    out << status.ToString() << std::endl;
+    return -EINVAL;
+  }
+
+  PerfCountersBuilder plb(g_ceph_context, "rocksdb", l_rocksdb_first, l_rocksdb_last);
+  plb.add_u64_counter(l_rocksdb_gets, "rocksdb_get");
+  plb.add_u64_counter(l_rocksdb_txns, "rocksdb_transaction");
+  plb.add_u64_counter(l_rocksdb_compact, "rocksdb_compact");
+  plb.add_u64_counter(l_rocksdb_compact_range, "rocksdb_compact_range");
+  plb.add_u64_counter(l_rocksdb_compact_queue_merge, "rocksdb_compact_queue_merge");
+  plb.add_u64(l_rocksdb_compact_queue_len, "rocksdb_compact_queue_len");
+  logger = plb.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+  return 0;
+}
+
+RocksDBStore::~RocksDBStore()
+{
+  close();
+}
+
+void RocksDBStore::close()
+{
+  // stop compaction thread
+  compact_queue_lock.Lock();
+  if (compact_thread.is_started()) {
+    compact_queue_stop = true;
+    compact_queue_cond.Signal();
+    compact_queue_lock.Unlock();
+    compact_thread.join();
+  } else {
+    compact_queue_lock.Unlock();
+  }
+
+  if (logger) {
+    cct->get_perfcounters_collection()->remove(logger);
+    delete logger;
+    logger = NULL;
+  }
+
+  // the handles must go before the db
+  for (vector<rocksdb::ColumnFamilyHandle*>::iterator p = cf_handles.begin();
+       p != cf_handles.end();
+       ++p)
+    delete *p;
+  cf_handles.clear();
+  delete db;
+  db = NULL;
+}
+
+rocksdb::ColumnFamilyHandle *RocksDBStore::get_cf(const string &prefix)
+{
+  for (vector<pair<string, unsigned> >::iterator p = cf_patterns.begin();
+       p != cf_patterns.end();
+       ++p) {
+    if (fnmatch(p->first.c_str(), prefix.c_str(), 0) == 0)
+      return cf_handles[p->second];
+  }
+  return cf_handles[0];
+}
+
+int RocksDBStore::submit_transaction(KeyValueDB::Transaction t)
+{
+  RocksDBTransactionImpl * _t =
+    static_cast<RocksDBTransactionImpl *>(t.get());
+  rocksdb::Status s = db->Write(rocksdb::WriteOptions(), &(_t->bat));
+  logger->inc(l_rocksdb_txns);
+  return s.ok() ? 0 : -1;
+}
+
+int RocksDBStore::submit_transaction_sync(KeyValueDB::Transaction t)
+{
+  RocksDBTransactionImpl * _t =
+    static_cast<RocksDBTransactionImpl *>(t.get());
+  rocksdb::WriteOptions options;
+  options.sync = true;
+  rocksdb::Status s = db->Write(options, &(_t->bat));
+  logger->inc(l_rocksdb_txns);
+  return s.ok() ? 0 : -1;
+}
+
+void RocksDBStore::RocksDBTransactionImpl::set(
+  const string &prefix,
+  const string &k,
+  const bufferlist &to_set_bl)
+{
+  // the batch copies key and value
+  string key = combine_strings(prefix, k);
+  bufferlist bl = to_set_bl;
+  bat.Put(db->get_cf(prefix), rocksdb::Slice(key),
+	  rocksdb::Slice(bl.c_str(), bl.length()));
+}
+
+void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
+					         const string &k)
+{
+  string key = combine_strings(prefix, k);
+  bat.Delete(db->get_cf(prefix), rocksdb::Slice(key));
+}
+
+void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
+{
+  rocksdb::ColumnFamilyHandle *cf = db->get_cf(prefix);
+  KeyValueDB::Iterator it = db->get_iterator(prefix);
+  for (it->seek_to_first();
+       it->valid();
+       it->next()) {
+    string key = combine_strings(prefix, it->key());
+    bat.Delete(cf, rocksdb::Slice(key));
+  }
+}
+
+int RocksDBStore::get(
+    const string &prefix,
+    const std::set<string> &keys,
+    std::map<string, bufferlist> *out)
+{
+  // point lookups, so that bloom filters apply
+  rocksdb::ColumnFamilyHandle *cf = get_cf(prefix);
+  int r = 0;
+  for (std::set<string>::const_iterator i = keys.begin();
+       i != keys.end();
+       ++i) {
+    string value;
+    rocksdb::Status s = db->Get(rocksdb::ReadOptions(), cf,
+				rocksdb::Slice(combine_strings(prefix, *i)),
+				&value);
+    if (s.ok()) {
+      (*out)[*i].append(value);
+    } else if (!s.IsNotFound()) {
+      r = -EIO;
+      break;
+    }
+  }
+  logger->inc(l_rocksdb_gets);
+  return r;
+}
+
+string RocksDBStore::combine_strings(const string &prefix, const string &value)
+{
+  string out = prefix;
+  out.push_back(0);
+  out.append(value);
+  return out;
+}
+
+bufferlist RocksDBStore::to_bufferlist(rocksdb::Slice in)
+{
+  bufferlist bl;
+  bl.append(bufferptr(in.data(), in.size()));
+  return bl;
+}
+
+int RocksDBStore::split_key(rocksdb::Slice in, string *prefix, string *key)
+{
+  string in_prefix = in.ToString();
+  size_t prefix_len = in_prefix.find('\0');
+  if (prefix_len >= in_prefix.size())
+    return -EINVAL;
+
+  if (prefix)
+    *prefix = string(in_prefix, 0, prefix_len);
+  if (key)
+    *key= string(in_prefix, prefix_len + 1);
+  return 0;
+}
+
+void RocksDBStore::compact()
+{
+  logger->inc(l_rocksdb_compact);
+  for (vector<rocksdb::ColumnFamilyHandle*>::iterator p = cf_handles.begin();
+       p != cf_handles.end();
+       ++p)
+    db->CompactRange(*p, NULL, NULL);
+}
+
+void RocksDBStore::compact_range(const string& start, const string& end)
+{
+  rocksdb::Slice cstart(start);
+  rocksdb::Slice cend(end);
+  for (vector<rocksdb::ColumnFamilyHandle*>::iterator p = cf_handles.begin();
+       p != cf_handles.end();
+       ++p)
+    db->CompactRange(*p, &cstart, &cend);
+}
+
+void RocksDBStore::compact_thread_entry()
+{
+  compact_queue_lock.Lock();
+  while (!compact_queue_stop) {
+    while (!compact_queue.empty()) {
+      pair<string,string> range = compact_queue.front();
+      compact_queue.pop_front();
+      logger->set(l_rocksdb_compact_queue_len, compact_queue.size());
+      compact_queue_lock.Unlock();
+      logger->inc(l_rocksdb_compact_range);
+      compact_range(range.first, range.second);
+      compact_queue_lock.Lock();
+      continue;
+    }
+    compact_queue_cond.Wait(compact_queue_lock);
+  }
+  compact_queue_lock.Unlock();
+}
+
+void RocksDBStore::compact_range_async(const string& start, const string& end)
+{
+  Mutex::Locker l(compact_queue_lock);
+
+  // try to merge adjacent ranges, as LevelDBStore does
+  list< pair<string,string> >::iterator p = compact_queue.begin();
+  while (p != compact_queue.end()) {
+    if (p->first == start && p->second == end) {
+      // dup; no-op
+      return;
+    }
+    if (p->first <= end && p->first > start) {
+      // merge with existing range to the right
+      compact_queue.push_back(make_pair(start, p->second));
+      compact_queue.erase(p);
+      logger->inc(l_rocksdb_compact_queue_merge);
+      break;
+    }
+    if (p->second >= start && p->second < end) {
+      // merge with existing range to the left
+      compact_queue.push_back(make_pair(p->first, end));
+      compact_queue.erase(p);
+      logger->inc(l_rocksdb_compact_queue_merge);
+      break;
+    }
+    ++p;
+  }
+  if (p == compact_queue.end()) {
+    // no merge, new entry.
+    compact_queue.push_back(make_pair(start, end));
+    logger->set(l_rocksdb_compact_queue_len, compact_queue.size());
+  }
+  compact_queue_cond.Signal();
+  if (!compact_thread.is_started()) {
+    compact_thread.create();
+  }
+}
+
+uint64_t RocksDBStore::get_estimated_size(map<string,uint64_t> &extra)
+{
+  DIR *store_dir = opendir(path.c_str());
+  if (!store_dir) {
+    lderr(cct) << __func__ << " something happened opening the store: "
+	       << cpp_strerror(errno) << dendl;
+    return 0;
+  }
+
+  uint64_t total_size = 0;
+  uint64_t sst_size = 0;
+  uint64_t log_size = 0;
+  uint64_t misc_size = 0;
+
+  struct dirent *entry = NULL;
+  while ((entry = readdir(store_dir)) != NULL) {
+    string n(entry->d_name);
+
+    if (n == "." || n == "..")
+      continue;
+
+    string fpath = path + '/' + n;
+    struct stat s;
+    int err = stat(fpath.c_str(), &s);
+    if (err < 0)
+      err = -errno;
+    // files come and go under compaction; skip the ones we raced with
+    if (err == -ENOENT)
+      continue;
+    if (err < 0) {
+      lderr(cct) << __func__ << " error obtaining stats for " << fpath
+		 << ": " << cpp_strerror(err) << dendl;
+      break;
+    }
+
+    size_t pos = n.find_last_of('.');
+    if (pos == string::npos) {
+      misc_size += s.st_size;
+      continue;
+    }
+
+    string ext = n.substr(pos+1);
+    if (ext == "sst") {
+      sst_size += s.st_size;
+    } else if (ext == "log") {
+      log_size += s.st_size;
+    } else {
+      misc_size += s.st_size;
+    }
+  }
+  closedir(store_dir);
+
+  total_size = sst_size + log_size + misc_size;
+
+  extra["sst"] = sst_size;
+  extra["log"] = log_size;
+  extra["misc"] = misc_size;
+  extra["total"] = total_size;
+  return total_size;
+}
+
+KeyValueDB::WholeSpaceIterator RocksDBStore::_get_iterator()
+{
+  vector<rocksdb::Iterator*> iters;
+  db->NewIterators(rocksdb::ReadOptions(), cf_handles, &iters);
+  return std::tr1::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
+    new RocksDBWholeSpaceIteratorImpl(iters));
+}
+
+KeyValueDB::WholeSpaceIterator RocksDBStore::_get_snapshot_iterator()
+{
+  rocksdb::ReadOptions options;
+  options.snapshot = db->GetSnapshot();
+  vector<rocksdb::Iterator*> iters;
+  db->NewIterators(options, cf_handles, &iters);
+  return std::tr1::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
+    new RocksDBSnapshotIteratorImpl(db, options.snapshot, iters));
+}
+
+KeyValueDB::WholeSpaceIterator RocksDBStore::_get_prefix_iterator(
+  const string &prefix)
+{
+  vector<rocksdb::Iterator*> iters;
+  iters.push_back(db->NewIterator(rocksdb::ReadOptions(), get_cf(prefix)));
+  return std::tr1::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
+    new RocksDBWholeSpaceIteratorImpl(iters));
+}
+
+KeyValueDB::WholeSpaceIterator RocksDBStore::_get_prefix_snapshot_iterator(
+  const string &prefix)
+{
+  rocksdb::ReadOptions options;
+  options.snapshot = db->GetSnapshot();
+  vector<rocksdb::Iterator*> iters;
+  iters.push_back(db->NewIterator(options, get_cf(prefix)));
+  return std::tr1::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
+    new RocksDBSnapshotIteratorImpl(db, options.snapshot, iters));
+}
+
+void RocksDBStore::RocksDBWholeSpaceIteratorImpl::release_iters()
+{
+  for (vector<rocksdb::Iterator*>::iterator p = iters.begin();
+       p != iters.end();
+       ++p)
+    delete *p;
+  iters.clear();
+  cur = -1;
+}
+
+void RocksDBStore::RocksDBWholeSpaceIteratorImpl::find_smallest()
+{
+  forward = true;
+  cur = -1;
+  for (unsigned i = 0; i < iters.size(); ++i) {
+    if (!iters[i]->Valid())
+      continue;
+    if (cur < 0 || iters[i]->key().compare(iters[cur]->key()) < 0)
+      cur = i;
+  }
+}
+
+void RocksDBStore::RocksDBWholeSpaceIteratorImpl::find_largest()
+{
+  forward = false;
+  cur = -1;
+  for (unsigned i = 0; i < iters.size(); ++i) {
+    if (!iters[i]->Valid())
+      continue;
+    if (cur < 0 || iters[i]->key().compare(iters[cur]->key()) > 0)
+      cur = i;
+  }
+}
+
+int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first()
+{
+  for (unsigned i = 0; i < iters.size(); ++i)
+    iters[i]->SeekToFirst();
+  find_smallest();
+  return status();
+}
+
+int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first(
+  const string &prefix)
+{
+  rocksdb::Slice slice_prefix(prefix);
+  for (unsigned i = 0; i < iters.size(); ++i)
+    iters[i]->Seek(slice_prefix);
+  find_smallest();
+  return status();
+}
+
+int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last()
+{
+  for (unsigned i = 0; i < iters.size(); ++i)
+    iters[i]->SeekToLast();
+  find_largest();
+  return status();
+}
+
+int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last(
+  const string &prefix)
+{
+  string limit = past_prefix(prefix);
+  rocksdb::Slice slice_limit(limit);
+  for (unsigned i = 0; i < iters.size(); ++i) {
+    iters[i]->Seek(slice_limit);
+    if (!iters[i]->Valid())
+      iters[i]->SeekToLast();
+    else
+      iters[i]->Prev();
+  }
+  find_largest();
+  return status();
+}
+
+int RocksDBStore::RocksDBWholeSpaceIteratorImpl::upper_bound(
+  const string &prefix, const string &after)
+{
+  lower_bound(prefix, after);
+  if (valid()) {
+    pair<string,string> key = raw_key();
+    if (key.first == prefix && key.second == after)
+      next();
+  }
+  return status();
+}
+
+int RocksDBStore::RocksDBWholeSpaceIteratorImpl::lower_bound(
+  const string &prefix, const string &to)
+{
+  string bound = combine_strings(prefix, to);
+  rocksdb::Slice slice_bound(bound);
+  for (unsigned i = 0; i < iters.size(); ++i)
+    iters[i]->Seek(slice_bound);
+  find_smallest();
+  return status();
+}
+
+int RocksDBStore::RocksDBWholeSpaceIteratorImpl::next()
+{
+  if (!valid())
+    return status();
+  if (!forward) {
+    // the others sit before the current key; move them past it
+    string k = iters[cur]->key().ToString();
+    rocksdb::Slice slice_k(k);
+    for (unsigned i = 0; i < iters.size(); ++i) {
+      if ((int)i == cur)
+	continue;
+      iters[i]->Seek(slice_k);
+    }
+  }
+  iters[cur]->Next();
+  find_smallest();
+  return status();
+}
+
+int RocksDBStore::RocksDBWholeSpaceIteratorImpl::prev()
+{
+  if (!valid())
+    return status();
+  if (forward) {
+    // the others sit after the current key; move them before it
+    string k = iters[cur]->key().ToString();
+    rocksdb::Slice slice_k(k);
+    for (unsigned i = 0; i < iters.size(); ++i) {
+      if ((int)i == cur)
+	continue;
+      iters[i]->Seek(slice_k);
+      if (iters[i]->Valid())
+	iters[i]->Prev();
+      else
+	iters[i]->SeekToLast();
+    }
+  }
+  iters[cur]->Prev();
+  find_largest();
+  return status();
+}
+
+int RocksDBStore::RocksDBWholeSpaceIteratorImpl::status()
+{
+  for (unsigned i = 0; i < iters.size(); ++i) {
+    if (!iters[i]->status().ok())
+      return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,294 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef ROCKS_DB_STORE_H
+#define ROCKS_DB_STORE_H
+
+#include "include/types.h"
+#include "include/buffer.h"
+#include "KeyValueDB.h"
+#include <set>
+#include <map>
+#include <string>
+#include <vector>
+#include <tr1/memory>
+#include "rocksdb/db.h"
+#include "rocksdb/write_batch.h"
+#include "rocksdb/slice.h"
+
+#include <errno.h>
+#include "common/errno.h"
+#include "common/dout.h"
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "common/Thread.h"
+#include "include/assert.h"
+#include "common/Formatter.h"
+
+#include "common/ceph_context.h"
+
+class PerfCounters;
+
+enum {
+  l_rocksdb_first = 34400,
+  l_rocksdb_gets,
+  l_rocksdb_txns,
+  l_rocksdb_compact,
+  l_rocksdb_compact_range,
+  l_rocksdb_compact_queue_merge,
+  l_rocksdb_compact_queue_len,
+  l_rocksdb_last,
+};
+
+/**
+ * Uses RocksDB to implement the KeyValueDB interface
+ *
+ * Keys are laid out as in LevelDBStore, prefix + '\0' + key.  Prefixes
+ * matching a pattern given to set_column_families() live in that
+ * column family, the rest in the default one.  The mapping is fixed
+ * when the store is created: it is kept in COLUMN_FAMILIES_FILE in the
+ * store directory, and later configuration only changes the tuning of
+ * each family.  One transaction may span families and is still applied
+ * atomically.
+ */
+class RocksDBStore : public KeyValueDB {
+  CephContext *cct;
+  PerfCounters *logger;
+  string path;
+  rocksdb::DB *db;
+
+  /// column family handles, default first
+  vector<rocksdb::ColumnFamilyHandle*> cf_handles;
+  /// column family names, parallel to cf_handles
+  vector<string> cf_names;
+  /// (pattern, index into cf_handles), in match order
+  vector<pair<string, unsigned> > cf_patterns;
+
+  int init(ostream &out, bool create_if_missing);
+
+  /// parse name:value pairs, @return -EINVAL on a malformed one
+  static int parse_pairs(const string &in,
+			 vector<pair<string, string> > *out);
+
+  // manage async compactions
+  Mutex compact_queue_lock;
+  Cond compact_queue_cond;
+  list< pair<string,string> > compact_queue;
+  bool compact_queue_stop;
+  class CompactThread : public Thread {
+    RocksDBStore *db;
+  public:
+    CompactThread(RocksDBStore *d) : db(d) {}
+    void *entry() {
+      db->compact_thread_entry();
+      return NULL;
+    }
+    friend class RocksDBStore;
+  } compact_thread;
+
+  void compact_thread_entry();
+
+  /// compact [start, end) in every column family
+  void compact_range(const string& start, const string& end);
+  void compact_range_async(const string& start, const string& end);
+
+public:
+  static const string COLUMN_FAMILIES_FILE;
+
+  /// column family holding keys with this prefix
+  rocksdb::ColumnFamilyHandle *get_cf(const string &prefix);
+
+  /// compact the underlying rocksdb store
+  void compact();
+
+  /// compact rocksdb for all keys with a given prefix
+  void compact_prefix(const string& prefix) {
+    compact_range(prefix, past_prefix(prefix));
+  }
+  void compact_prefix_async(const string& prefix) {
+    compact_range_async(prefix, past_prefix(prefix));
+  }
+
+  void compact_range(const string& prefix, const string& start, const string& end) {
+    compact_range(combine_strings(prefix, start), combine_strings(prefix, end));
+  }
+  void compact_range_async(const string& prefix, const string& start, const string& end) {
+    compact_range_async(combine_strings(prefix, start), combine_strings(prefix, end));
+  }
+
+  /**
+   * options_t: Holds options which are minimally interpreted on
+   * initialization and then passed through to RocksDB.  The
+   * constructor fills them in from the rocksdb_* config options; set
+   * them after constructing the RocksDBStore, but before calling
+   * open() or create_and_open().
+   */
+  struct options_t {
+    uint64_t write_buffer_size; /// in-memory write buffer size
+    int max_open_files; /// maximum number of files RocksDB can open at once
+    uint64_t cache_size; /// size of the block cache, shared by all families
+    uint64_t block_size; /// user data per block
+    int bloom_size; /// number of bits per entry to put in a bloom filter
+    bool compression_enabled; /// whether to use libsnappy compression or not
+    int max_background_compactions; /// compaction threads
+    int max_background_flushes; /// memtable flush threads
+
+    bool error_if_exists;
+    bool paranoid_checks;
+
+    string log_file;
+
+    /// @see KeyValueDB::set_column_families
+    string column_families;
+    string column_family_options;
+
+    options_t() :
+      write_buffer_size(0), //< 0 means default
+      max_open_files(0), //< 0 means default
+      cache_size(0), //< 0 means default
+      block_size(0), //< 0 means default
+      bloom_size(0), //< 0 means no bloom filter (default)
+      compression_enabled(true), //< set to false for no compression
+      max_background_compactions(0), //< 0 means default
+      max_background_flushes(0), //< 0 means default
+      error_if_exists(false), //< set to true if you want to check nonexistence
+      paranoid_checks(false) //< set to true if you want paranoid checks
+    {}
+  } options;
+
+  RocksDBStore(CephContext *c, const string &path);
+
+  ~RocksDBStore();
+
+  /// Opens underlying db
+  int open(ostream &out) {
+    return init(out, false);
+  }
+  /// Creates underlying db if missing and opens it
+  int create_and_open(ostream &out) {
+    return init(out, true);
+  }
+
+  void close();
+
+  void set_column_families(const string &families, const string &cf_options) {
+    options.column_families = families;
+    options.column_family_options = cf_options;
+  }
+
+  class RocksDBTransactionImpl : public KeyValueDB::TransactionImpl {
+  public:
+    rocksdb::WriteBatch bat;
+    RocksDBStore *db;
+
+    RocksDBTransactionImpl(RocksDBStore *db) : db(db) {}
+    void set(
+      const string &prefix,
+      const string &k,
+      const bufferlist &bl);
+    void rmkey(
+      const string &prefix,
+      const string &k);
+    void rmkeys_by_prefix(
+      const string &prefix
+      );
+  };
+
+  KeyValueDB::Transaction get_transaction() {
+    return std::tr1::shared_ptr< RocksDBTransactionImpl >(
+      new RocksDBTransactionImpl(this));
+  }
+
+  int submit_transaction(KeyValueDB::Transaction t);
+  int submit_transaction_sync(KeyValueDB::Transaction t);
+  int get(
+    const string &prefix,
+    const std::set<string> &key,
+    std::map<string, bufferlist> *out
+    );
+
+  /**
+   * Iterates over the union of one iterator per column family.  Each
+   * key lives in exactly one family, so the current position is the
+   * smallest (going forward) or largest (going back) of their keys;
+   * changing direction repositions the others around it.
+   */
+  class RocksDBWholeSpaceIteratorImpl :
+    public KeyValueDB::WholeSpaceIteratorImpl {
+  protected:
+    vector<rocksdb::Iterator*> iters;
+    int cur;        ///< index into iters, -1 if past either end
+    bool forward;   ///< direction of the last move
+
+    void find_smallest();
+    void find_largest();
+    void release_iters();
+  public:
+    RocksDBWholeSpaceIteratorImpl(const vector<rocksdb::Iterator*> &i) :
+      iters(i), cur(-1), forward(true) { }
+    virtual ~RocksDBWholeSpaceIteratorImpl() {
+      release_iters();
+    }
+
+    int seek_to_first();
+    int seek_to_first(const string &prefix);
+    int seek_to_last();
+    int seek_to_last(const string &prefix);
+    int upper_bound(const string &prefix, const string &after);
+    int lower_bound(const string &prefix, const string &to);
+    bool valid() {
+      return cur >= 0;
+    }
+    int next();
+    int prev();
+    string key() {
+      string out_key;
+      split_key(iters[cur]->key(), 0, &out_key);
+      return out_key;
+    }
+    pair<string,string> raw_key() {
+      string prefix, key;
+      split_key(iters[cur]->key(), &prefix, &key);
+      return make_pair(prefix, key);
+    }
+    bufferlist value() {
+      return to_bufferlist(iters[cur]->value());
+    }
+    int status();
+  };
+
+  class RocksDBSnapshotIteratorImpl : public RocksDBWholeSpaceIteratorImpl {
+    rocksdb::DB *db;
+    const rocksdb::Snapshot *snapshot;
+  public:
+    RocksDBSnapshotIteratorImpl(rocksdb::DB *db, const rocksdb::Snapshot *s,
+				const vector<rocksdb::Iterator*> &i) :
+      RocksDBWholeSpaceIteratorImpl(i), db(db), snapshot(s) { }
+
+    ~RocksDBSnapshotIteratorImpl() {
+      assert(snapshot != NULL);
+      // the iterators must go before the snapshot they read
+      release_iters();
+      db->ReleaseSnapshot(snapshot);
+    }
+  };
+
+  /// Utility
+  static string combine_strings(const string &prefix, const string &value);
+  static int split_key(rocksdb::Slice in, string *prefix, string *key);
+  static bufferlist to_bufferlist(rocksdb::Slice in);
+  static string past_prefix(const string &prefix) {
+    string limit = prefix;
+    limit.push_back(1);
+    return limit;
+  }
+
+  virtual uint64_t get_estimated_size(map<string,uint64_t> &extra);
+
+protected:
+  WholeSpaceIterator _get_iterator();
+  WholeSpaceIterator _get_snapshot_iterator();
+  WholeSpaceIterator _get_prefix_iterator(const string &prefix);
+  WholeSpaceIterator _get_prefix_snapshot_iterator(const string &prefix);
+};
+
+#endif
@@ -5,6 +5,31 @@
 
 #include "os/WBThrottle.h"
 #include "common/perf_counters.h"
+#include "common/admin_socket.h"
+#include "common/Clock.h"
+#include "common/debug.h"
+
+#define dout_subsys ceph_subsys_filestore
+#undef dout_prefix
+#define dout_prefix *_dout << "wbthrottle "
+
+class WBThrottle::AdminHook : public AdminSocketHook {
+  WBThrottle *wbt;
+public:
+  AdminHook(WBThrottle *w) : wbt(w) {}
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+	    bufferlist& out) {
+    if (format == "")
+      format = "json-pretty";
+    Formatter *f = new_formatter(format);
+    stringstream ss;
+    wbt->dump(f);
+    f->flush(ss);
+    delete f;
+    out.append(ss);
+    return true;
+  }
+};
 
 WBThrottle::WBThrottle(CephContext *cct) :
   cur_ios(0), cur_size(0),
@@ -12,7 +37,13 @@ WBThrottle::WBThrottle(CephContext *cct) :
   logger(NULL),
   stopping(false),
   lock("WBThrottle::lock", false, true, false, cct),
-  fs(XFS)
+  adaptive(false), target_lag(0), max_scale(1),
+  size_scale(1), io_scale(1),
+  window_bytes(0), window_ios(0),
+  bytes_rate(0), ios_rate(0),
+  track_dirty(false), dirty_max(0), dirty_all(true),
+  fs(XFS),
+  asok_hook(NULL)
 {
   {
     Mutex::Locker l(lock);
@@ -28,10 +59,33 @@ WBThrottle::WBThrottle(CephContext *cct) :
   b.add_u64(l_wbthrottle_ios_wb, "ios_wb");
   b.add_u64(l_wbthrottle_inodes_dirtied, "inodes_dirtied");
   b.add_u64(l_wbthrottle_inodes_wb, "inodes_wb");
+  b.add_u64(l_wbthrottle_bytes_start_flusher, "bytes_start_flusher");
+  b.add_u64(l_wbthrottle_bytes_hard_limit, "bytes_hard_limit");
+  b.add_u64(l_wbthrottle_ios_start_flusher, "ios_start_flusher");
+  b.add_u64(l_wbthrottle_ios_hard_limit, "ios_hard_limit");
+  b.add_u64(l_wbthrottle_inodes_start_flusher, "inodes_start_flusher");
+  b.add_u64(l_wbthrottle_inodes_hard_limit, "inodes_hard_limit");
+  b.add_time_avg(l_wbthrottle_flush_lat, "flush_lat");
+  b.add_u64(l_wbthrottle_flush_bytes_rate, "flush_bytes_rate");
+  b.add_u64(l_wbthrottle_flush_ios_rate, "flush_ios_rate");
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
-  for (unsigned i = l_wbthrottle_first + 1; i != l_wbthrottle_last; ++i)
+  for (unsigned i = l_wbthrottle_first + 1; i != l_wbthrottle_bytes_start_flusher; ++i)
     logger->set(i, 0);
+  {
+    Mutex::Locker l(lock);
+    apply_limits();
+  }
+
+  // only the first throttle in the process gets the command
+  asok_hook = new AdminHook(this);
+  int r = cct->get_admin_socket()->register_command(
+    "dump_wbthrottle", "dump_wbthrottle", asok_hook,
+    "show writeback throttle limits, flush rates and usage");
+  if (r < 0) {
+    delete asok_hook;
+    asok_hook = NULL;
+  }
 
   cct->_conf->add_observer(this);
   create();
@@ -45,6 +99,10 @@ WBThrottle::~WBThrottle() {
     cond.Signal();
   }
   join();
+  if (asok_hook) {
+    cct->get_admin_socket()->unregister_command("dump_wbthrottle");
+    delete asok_hook;
+  }
   cct->get_perfcounters_collection()->remove(logger);
   delete logger;
   cct->_conf->remove_observer(this);
@@ -65,6 +123,9 @@ const char** WBThrottle::get_tracked_conf_keys() const
     "filestore_wbthrottle_xfs_ios_hard_limit",
     "filestore_wbthrottle_xfs_inodes_start_flusher",
     "filestore_wbthrottle_xfs_inodes_hard_limit",
+    "filestore_wbthrottle_adaptive",
+    "filestore_wbthrottle_target_lag",
+    "filestore_wbthrottle_adaptive_max_scale",
     NULL
   };
   return KEYS;
@@ -74,37 +135,112 @@ void WBThrottle::set_from_conf()
 {
   assert(lock.is_locked());
   if (fs == BTRFS) {
-    size_limits.first =
+    conf_size_limits.first =
       cct->_conf->filestore_wbthrottle_btrfs_bytes_start_flusher;
-    size_limits.second =
+    conf_size_limits.second =
       cct->_conf->filestore_wbthrottle_btrfs_bytes_hard_limit;
-    io_limits.first =
+    conf_io_limits.first =
       cct->_conf->filestore_wbthrottle_btrfs_ios_start_flusher;
-    io_limits.second =
+    conf_io_limits.second =
       cct->_conf->filestore_wbthrottle_btrfs_ios_hard_limit;
-    fd_limits.first =
+    conf_fd_limits.first =
       cct->_conf->filestore_wbthrottle_btrfs_inodes_start_flusher;
-    fd_limits.second =
+    conf_fd_limits.second =
       cct->_conf->filestore_wbthrottle_btrfs_inodes_hard_limit;
   } else if (fs == XFS) {
-    size_limits.first =
+    conf_size_limits.first =
       cct->_conf->filestore_wbthrottle_xfs_bytes_start_flusher;
-    size_limits.second =
+    conf_size_limits.second =
       cct->_conf->filestore_wbthrottle_xfs_bytes_hard_limit;
-    io_limits.first =
+    conf_io_limits.first =
       cct->_conf->filestore_wbthrottle_xfs_ios_start_flusher;
-    io_limits.second =
+    conf_io_limits.second =
       cct->_conf->filestore_wbthrottle_xfs_ios_hard_limit;
-    fd_limits.first =
+    conf_fd_limits.first =
       cct->_conf->filestore_wbthrottle_xfs_inodes_start_flusher;
-    fd_limits.second =
+    conf_fd_limits.second =
       cct->_conf->filestore_wbthrottle_xfs_inodes_hard_limit;
   } else {
     assert(0 == "invalid value for fs");
   }
+  adaptive = cct->_conf->filestore_wbthrottle_adaptive;
+  target_lag = cct->_conf->filestore_wbthrottle_target_lag;
+  max_scale = MAX(cct->_conf->filestore_wbthrottle_adaptive_max_scale, 1.0);
+  if (!adaptive)
+    size_scale = io_scale = 1;
+  apply_limits();
+}
+
+static uint64_t scale_limit(uint64_t limit, double scale)
+{
+  return MAX((uint64_t)(limit * scale), 1ull);
+}
+
+void WBThrottle::apply_limits()
+{
+  assert(lock.is_locked());
+  size_limits.first = scale_limit(conf_size_limits.first, size_scale);
+  size_limits.second = scale_limit(conf_size_limits.second, size_scale);
+  io_limits.first = scale_limit(conf_io_limits.first, io_scale);
+  io_limits.second = scale_limit(conf_io_limits.second, io_scale);
+  // open fds are bounded by the fd limit, so never go past the config
+  double fd_scale = MIN(io_scale, 1.0);
+  fd_limits.first = scale_limit(conf_fd_limits.first, fd_scale);
+  fd_limits.second = scale_limit(conf_fd_limits.second, fd_scale);
+  if (logger) {
+    logger->set(l_wbthrottle_bytes_start_flusher, size_limits.first);
+    logger->set(l_wbthrottle_bytes_hard_limit, size_limits.second);
+    logger->set(l_wbthrottle_ios_start_flusher, io_limits.first);
+    logger->set(l_wbthrottle_ios_hard_limit, io_limits.second);
+    logger->set(l_wbthrottle_inodes_start_flusher, fd_limits.first);
+    logger->set(l_wbthrottle_inodes_hard_limit, fd_limits.second);
+  }
   cond.Signal();
 }
 
+void WBThrottle::account_flush(utime_t lat, uint64_t bytes, uint64_t ios)
+{
+  assert(lock.is_locked());
+  logger->tinc(l_wbthrottle_flush_lat, lat);
+  utime_t now = ceph_clock_now(cct);
+  if (window_start == utime_t())
+    window_start = now;
+  window_busy += lat;
+  window_bytes += bytes;
+  window_ios += ios;
+  if (now - window_start < utime_t(1, 0))
+    return;
+
+  // throughput while flushing is what the device can take; idle time
+  // between flushes says nothing about it
+  double busy = (double)window_busy;
+  if (busy > 0) {
+    double b = window_bytes / busy;
+    double i = window_ios / busy;
+    bytes_rate = bytes_rate ? bytes_rate * .7 + b * .3 : b;
+    ios_rate = ios_rate ? ios_rate * .7 + i * .3 : i;
+    logger->set(l_wbthrottle_flush_bytes_rate, bytes_rate);
+    logger->set(l_wbthrottle_flush_ios_rate, ios_rate);
+  }
+  window_start = now;
+  window_busy = utime_t();
+  window_bytes = window_ios = 0;
+
+  if (!adaptive || target_lag <= 0)
+    return;
+  double min_scale = 1.0 / max_scale;
+  if (bytes_rate > 0 && conf_size_limits.second)
+    size_scale = MAX(min_scale, MIN(max_scale,
+      bytes_rate * target_lag / conf_size_limits.second));
+  if (ios_rate > 0 && conf_io_limits.second)
+    io_scale = MAX(min_scale, MIN(max_scale,
+      ios_rate * target_lag / conf_io_limits.second));
+  ldout(cct, 10) << "account_flush " << bytes_rate << " bytes/s " << ios_rate
+	   << " ios/s, scaling limits by " << size_scale << " (bytes) "
+	   << io_scale << " (ios)" << dendl;
+  apply_limits();
+}
+
 void WBThrottle::handle_conf_change(const md_config_t *conf,
 				    const std::set<std::string> &changed)
 {
@@ -147,12 +283,15 @@ void *WBThrottle::entry()
   while (get_next_should_flush(&wb)) {
     clearing = wb.get<0>();
     lock.Unlock();
+    utime_t start = ceph_clock_now(cct);
     ::fdatasync(**wb.get<1>());
 #ifdef HAVE_POSIX_FADVISE
     if (wb.get<2>().nocache)
       posix_fadvise(**wb.get<1>(), 0, 0, POSIX_FADV_DONTNEED);
 #endif
+    utime_t lat = ceph_clock_now(cct) - start;
     lock.Lock();
+    account_flush(lat, wb.get<2>().size, wb.get<2>().ios);
     clearing = ghobject_t();
     cur_ios -= wb.get<2>().ios;
     logger->dec(l_wbthrottle_ios_dirtied, wb.get<2>().ios);
@@ -212,6 +351,52 @@ void WBThrottle::clear()
   cond.Signal();
 }
 
+void WBThrottle::set_track_dirty(bool track, uint64_t max)
+{
+  Mutex::Locker l(lock);
+  track_dirty = track;
+  dirty_max = max;
+  dirty_all = true;
+  dirty.clear();
+}
+
+void WBThrottle::mark_dirty(FDRef fd, const ghobject_t &hoid, bool meta)
+{
+  Mutex::Locker l(lock);
+  if (!track_dirty || dirty_all)
+    return;
+  map<ghobject_t, pair<bool, FDRef> >::iterator i = dirty.find(hoid);
+  if (i != dirty.end()) {
+    if (meta)
+      i->second.first = true;
+  } else if (dirty.size() >= dirty_max) {
+    dirty_all = true;
+    dirty.clear();
+  } else {
+    dirty.insert(make_pair(hoid, make_pair(meta, fd)));
+  }
+}
+
+void WBThrottle::mark_dirty_all()
+{
+  Mutex::Locker l(lock);
+  if (!track_dirty)
+    return;
+  dirty_all = true;
+  dirty.clear();
+}
+
+bool WBThrottle::take_dirty(map<ghobject_t, pair<bool, FDRef> > *out)
+{
+  Mutex::Locker l(lock);
+  bool ret = track_dirty && !dirty_all;
+  if (ret)
+    out->swap(dirty);
+  dirty.clear();
+  dirty_all = false;
+  return ret;
+}
+
 void WBThrottle::clear_object(const ghobject_t &hoid)
 {
   Mutex::Locker l(lock);
@@ -239,3 +424,30 @@ void WBThrottle::throttle()
     cond.Wait(lock);
   }
 }
+
+void WBThrottle::dump(Formatter *f)
+{
+  Mutex::Locker l(lock);
+  f->open_object_section("wbthrottle");
+  f->dump_string("fs", fs == BTRFS ? "btrfs" : "xfs");
+  f->dump_bool("adaptive", adaptive);
+  f->dump_float("target_lag", target_lag);
+  f->dump_float("bytes_scale", size_scale);
+  f->dump_float("ios_scale", io_scale);
+  f->dump_float("flush_bytes_rate", bytes_rate);
+  f->dump_float("flush_ios_rate", ios_rate);
+  f->open_object_section("limits");
+  f->dump_unsigned("bytes_start_flusher", size_limits.first);
+  f->dump_unsigned("bytes_hard_limit", size_limits.second);
+  f->dump_unsigned("ios_start_flusher", io_limits.first);
+  f->dump_unsigned("ios_hard_limit", io_limits.second);
+  f->dump_unsigned("inodes_start_flusher", fd_limits.first);
+  f->dump_unsigned("inodes_hard_limit", fd_limits.second);
+  f->close_section();
+  f->open_object_section("current");
+  f->dump_unsigned("bytes", cur_size);
+  f->dump_unsigned("ios", cur_ios);
+  f->dump_unsigned("inodes", pending_wbs.size());
+  f->close_section();
+  f->close_section();
+}
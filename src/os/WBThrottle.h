@@ -25,6 +25,7 @@
 #include "FDCache.h"
 #include "common/Thread.h"
 #include "common/ceph_context.h"
+#include "include/utime.h"
 
 class PerfCounters;
 enum {
@@ -35,6 +36,15 @@ enum {
   l_wbthrottle_ios_wb,
   l_wbthrottle_inodes_dirtied,
   l_wbthrottle_inodes_wb,
+  l_wbthrottle_bytes_start_flusher,
+  l_wbthrottle_bytes_hard_limit,
+  l_wbthrottle_ios_start_flusher,
+  l_wbthrottle_ios_hard_limit,
+  l_wbthrottle_inodes_start_flusher,
+  l_wbthrottle_inodes_hard_limit,
+  l_wbthrottle_flush_lat,
+  l_wbthrottle_flush_bytes_rate,
+  l_wbthrottle_flush_ios_rate,
   l_wbthrottle_last
 };
 
@@ -42,6 +52,16 @@ enum {
  * WBThrottle
  *
  * Tracks, throttles, and flushes outstanding IO
+ *
+ * If set_track_dirty(true), it also remembers every object changed
+ * since the last take_dirty(), flushed or not, so that a commit can
+ * sync just those instead of the whole filesystem.
+ *
+ * With filestore_wbthrottle_adaptive, the configured limits are scaled
+ * by the flush throughput measured over each second, so that the
+ * backlog they allow stays about filestore_wbthrottle_target_lag
+ * seconds of writeback.  The limits in effect are in the perf counters
+ * and in the dump_wbthrottle admin socket command.
  */
 class WBThrottle : Thread, public md_config_obs_t {
   ghobject_t clearing;
@@ -59,6 +79,20 @@ class WBThrottle : Thread, public md_config_obs_t {
   /// Limits on unflushed objects
   pair<uint64_t, uint64_t> fd_limits;
 
+  /// Limits as configured, before adaptive scaling
+  pair<uint64_t, uint64_t> conf_size_limits, conf_io_limits, conf_fd_limits;
+
+  bool adaptive;
+  double target_lag;  ///< seconds of writeback the limits should allow
+  double max_scale;   ///< bound on scaling in either direction
+  double size_scale, io_scale;
+
+  /// flushes in the current measuring window
+  utime_t window_start, window_busy;
+  uint64_t window_bytes, window_ios;
+  /// flush throughput while flushing, averaged over windows
+  double bytes_rate, ios_rate;
+
   uint64_t cur_ios;  /// Currently unflushed IOs
   uint64_t cur_size; /// Currently unflushed bytes
 
@@ -116,6 +150,12 @@ class WBThrottle : Thread, public md_config_obs_t {
 
   map<ghobject_t, pair<PendingWB, FDRef> > pending_wbs;
 
+  /// Objects changed since the last take_dirty(); true if metadata changed
+  bool track_dirty;
+  uint64_t dirty_max; ///< past this many, just sync everything
+  bool dirty_all;
+  map<ghobject_t, pair<bool, FDRef> > dirty;
+
   /// get next flush to perform
   bool get_next_should_flush(
     boost::tuple<ghobject_t, FDRef, PendingWB> *next ///< [out] next to flush
@@ -130,6 +170,13 @@ private:
   FS fs;
 
   void set_from_conf();
+  /// set the limits from the configured ones and the scales
+  void apply_limits();
+  /// account one flush, adapting the limits at the end of a window
+  void account_flush(utime_t lat, uint64_t bytes, uint64_t ios);
+
+  class AdminHook;
+  AdminHook *asok_hook;
 public:
   WBThrottle(CephContext *cct);
   ~WBThrottle();
@@ -153,12 +200,38 @@ public:
   /// Clear all wb (probably due to sync)
   void clear();
 
+  /// Start or stop remembering up to max changed objects; starts out dirty_all
+  void set_track_dirty(bool track, uint64_t max);
+
+  /// oid, open on fd, changed; meta if more than its data did
+  void mark_dirty(
+    FDRef fd,              ///< [in] FDRef to oid
+    const ghobject_t &oid, ///< [in] object
+    bool meta              ///< [in] xattrs or size changed
+    );
+
+  /// Something changed that syncing the changed objects won't cover
+  void mark_dirty_all();
+
+  /**
+   * Take the objects changed since the last call.
+   *
+   * @param [out] out the objects, and whether their metadata changed
+   * @return false if syncing out is not enough and the caller must
+   * sync the whole filesystem; out is then left empty
+   */
+  bool take_dirty(
+    map<ghobject_t, pair<bool, FDRef> > *out);
+
   /// Clear object
   void clear_object(const ghobject_t &oid);
 
   /// Block until there is throttle available
   void throttle();
 
+  /// Dump limits, measured rates and current usage
+  void dump(Formatter *f);
+
   /// md_config_obs_t
   const char** get_tracked_conf_keys() const;
   void handle_conf_change(const md_config_t *conf,
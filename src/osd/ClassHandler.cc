@@ -13,6 +13,7 @@
 #endif
 
 #include "common/config.h"
+#include "common/perf_counters.h"
 
 #define dout_subsys ceph_subsys_osd
 #undef dout_prefix
@@ -70,6 +71,7 @@ int ClassHandler::open_all_classes()
 void ClassHandler::shutdown()
 {
   for (map<string, ClassData>::iterator p = classes.begin(); p != classes.end(); ++p) {
+    p->second.destroy_perf_counters();
     dlclose(p->second.handle);
   }
   classes.clear();
@@ -157,6 +159,7 @@ int ClassHandler::_load_class(ClassData *cls)
   
   dout(10) << "_load_class " << cls->name << " success" << dendl;
   cls->status = ClassData::CLASS_OPEN;
+  cls->create_perf_counters();
   return 0;
 }
 
@@ -231,6 +234,33 @@ int ClassHandler::ClassData::get_method_flags(const char *mname)
   return method->flags;
 }
 
+void ClassHandler::ClassData::create_perf_counters()
+{
+  if (logger || methods_map.empty())
+    return;
+  PerfCountersBuilder plb(handler->cct, string("cls_") + name,
+			  0, methods_map.size() + 1);
+  int idx = 1;
+  for (map<string, ClassMethod>::iterator p = methods_map.begin();
+       p != methods_map.end();
+       ++p, ++idx) {
+    counter_names.push_back(p->first);
+    p->second.perf_idx = idx;
+    plb.add_time_avg(idx, counter_names.back().c_str());
+  }
+  logger = plb.create_perf_counters();
+  handler->cct->get_perfcounters_collection()->add(logger);
+}
+
+void ClassHandler::ClassData::destroy_perf_counters()
+{
+  if (!logger)
+    return;
+  handler->cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+  logger = NULL;
+}
+
 void ClassHandler::ClassData::unregister_method(ClassHandler::ClassMethod *method)
 {
   /* no need for locking, called under the class_init mutex */
@@ -248,6 +278,9 @@ void ClassHandler::ClassMethod::unregister()
 int ClassHandler::ClassMethod::exec(cls_method_context_t ctx, bufferlist& indata, bufferlist& outdata)
 {
   int ret;
+  utime_t start;
+  if (perf_idx)
+    start = ceph_clock_now(cls->handler->cct);
   if (cxx_func) {
     // C++ call version
     ret = cxx_func(ctx, &indata, &outdata);
@@ -262,6 +295,8 @@ int ClassHandler::ClassMethod::exec(cls_method_context_t ctx, bufferlist& indata
       outdata.push_back(bp);
     }
   }
+  if (perf_idx)
+    cls->logger->tinc(perf_idx, ceph_clock_now(cls->handler->cct) - start);
   return ret;
 }
 
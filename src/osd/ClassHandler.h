@@ -9,6 +9,8 @@
 #include "common/Mutex.h"
 #include "common/ceph_context.h"
 
+class PerfCounters;
+
 
 class ClassHandler
 {
@@ -23,6 +25,7 @@ public:
     int flags;
     cls_method_call_t func;
     cls_method_cxx_call_t cxx_func;
+    int perf_idx;  ///< calls and latency in cls->logger, once the class is open
 
     int exec(cls_method_context_t ctx, bufferlist& indata, bufferlist& outdata);
     void unregister();
@@ -32,7 +35,7 @@ public:
       return flags;
     }
 
-    ClassMethod() : cls(0), flags(0), func(0), cxx_func(0) {}
+    ClassMethod() : cls(0), flags(0), func(0), cxx_func(0), perf_idx(0) {}
   };
 
   struct ClassData {
@@ -53,11 +56,17 @@ public:
     set<ClassData *> dependencies;         /* our dependencies */
     set<ClassData *> missing_dependencies; /* only missing dependencies */
 
+    PerfCounters *logger;       ///< cls_<name>: a time avg per method
+    list<string> counter_names; ///< outlive the methods they name
+
     ClassMethod *_get_method(const char *mname);
+    void create_perf_counters();
+    void destroy_perf_counters();
 
     ClassData() : status(CLASS_UNKNOWN), 
 		  handler(NULL),
-		  handle(NULL) {}
+		  handle(NULL),
+		  logger(NULL) {}
     ~ClassData() { }
 
     ClassMethod *register_method(const char *mname, int flags, cls_method_call_t func);
@@ -0,0 +1,144 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <algorithm>
+
+#include "ECUtil.h"
+
+using namespace std;
+
+void ECUtil::stripe_info_t::get_data_chunks(
+  uint64_t off, uint64_t len, set<int> *chunks) const
+{
+  if (len == 0)
+    return;
+  if (len >= stripe_width) {
+    for (unsigned i = 0; i < k; i++)
+      chunks->insert(i);
+    return;
+  }
+  uint64_t last = off + len - 1;
+  unsigned first_chunk = (off % stripe_width) / chunk_size;
+  unsigned last_chunk = (last % stripe_width) / chunk_size;
+  if (off / stripe_width == last / stripe_width) {
+    for (unsigned i = first_chunk; i <= last_chunk; i++)
+      chunks->insert(i);
+  } else {
+    // the tail of one stripe and the head of the next
+    for (unsigned i = first_chunk; i < k; i++)
+      chunks->insert(i);
+    for (unsigned i = 0; i <= last_chunk; i++)
+      chunks->insert(i);
+  }
+}
+
+int ECUtil::encode(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec,
+  const bufferlist &in,
+  const set<int> &want,
+  map<int, bufferlist> *out)
+{
+  uint64_t stripe_width = sinfo.get_stripe_width();
+  assert(in.length() % stripe_width == 0);
+
+  for (uint64_t off = 0; off < in.length(); off += stripe_width) {
+    bufferlist stripe;
+    stripe.substr_of(in, off, stripe_width);
+    map<int, bufferlist> encoded;
+    int r = ec->encode(want, stripe, &encoded);
+    if (r < 0)
+      return r;
+    for (set<int>::const_iterator i = want.begin(); i != want.end(); ++i) {
+      // a stripe must encode into chunks without padding
+      assert(encoded[*i].length() == sinfo.get_chunk_size());
+      (*out)[*i].claim_append(encoded[*i]);
+    }
+  }
+  return 0;
+}
+
+int ECUtil::plan_read(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec,
+  uint64_t off,
+  uint64_t len,
+  const map<int, int> &available,
+  set<int> *want,
+  set<int> *shards,
+  pair<uint64_t, uint64_t> *chunk_extent)
+{
+  pair<uint64_t, uint64_t> bounds = sinfo.offset_len_to_stripe_bounds(off, len);
+  *chunk_extent = make_pair(
+    sinfo.aligned_logical_offset_to_chunk_offset(bounds.first),
+    bounds.second / sinfo.get_data_chunk_count());
+
+  sinfo.get_data_chunks(off, len, want);
+  if (want->empty())
+    return 0;
+  return ec->minimum_to_decode_with_cost(*want, available, shards);
+}
+
+int ECUtil::decode_range(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec,
+  uint64_t off,
+  uint64_t len,
+  const set<int> &want,
+  const pair<uint64_t, uint64_t> &chunk_extent,
+  map<int, bufferlist> &from,
+  bufferlist *out)
+{
+  uint64_t chunk_size = sinfo.get_chunk_size();
+  unsigned k = sinfo.get_data_chunk_count();
+  if (len == 0)
+    return 0;
+
+  bool have_all = true;
+  for (set<int>::const_iterator i = want.begin(); i != want.end(); ++i)
+    if (!from.count(*i))
+      have_all = false;
+  for (map<int, bufferlist>::iterator i = from.begin(); i != from.end(); ++i)
+    if (i->second.length() < chunk_extent.second)
+      return -EIO;
+
+  for (uint64_t c = 0; c < chunk_extent.second; c += chunk_size) {
+    map<int, bufferlist> chunks;
+    for (map<int, bufferlist>::iterator i = from.begin(); i != from.end(); ++i)
+      chunks[i->first].substr_of(i->second, c, chunk_size);
+
+    map<int, bufferlist> decoded;
+    if (have_all) {
+      decoded.swap(chunks);
+    } else {
+      int r = ec->decode(want, chunks, &decoded);
+      if (r < 0)
+	return r;
+    }
+
+    // copy out the part of each data chunk that is in the range
+    uint64_t stripe_off =
+      sinfo.aligned_chunk_offset_to_logical_offset(chunk_extent.first + c);
+    for (unsigned j = 0; j < k; j++) {
+      uint64_t start = std::max(stripe_off + j * chunk_size, off);
+      uint64_t end = std::min(stripe_off + (j + 1) * chunk_size, off + len);
+      if (start >= end)
+	continue;
+      assert(want.count(j));
+      bufferlist part;
+      part.substr_of(decoded[j], start - stripe_off - j * chunk_size, end - start);
+      out->claim_append(part);
+    }
+  }
+  return 0;
+}
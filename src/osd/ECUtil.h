@@ -0,0 +1,140 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef ECUTIL_H
+#define ECUTIL_H
+
+#include <map>
+#include <set>
+
+#include "include/buffer.h"
+#include "include/assert.h"
+#include "ErasureCodeInterface.h"
+
+/**
+ * Striping of objects over the shards of an erasure coded pg
+ *
+ * An object is cut into stripes of stripe_width bytes.  Each stripe
+ * is cut into k data chunks of chunk_size bytes, and encoded into k+m
+ * chunks; shard i stores chunk i of every stripe, one after the other.
+ * A byte of the object therefore lives in one data chunk of one
+ * stripe, and a range of the object can be read from the shards
+ * holding the data chunks it covers, or from whichever shards the
+ * code needs to rebuild them, without touching the rest of the stripe.
+ */
+namespace ECUtil {
+
+class stripe_info_t {
+  const unsigned k;
+  const uint64_t stripe_width;
+  const uint64_t chunk_size;
+public:
+  stripe_info_t(unsigned k, uint64_t stripe_width)
+    : k(k), stripe_width(stripe_width), chunk_size(stripe_width / k) {
+    assert(k > 0);
+    assert(stripe_width % k == 0);
+  }
+  unsigned get_data_chunk_count() const {
+    return k;
+  }
+  uint64_t get_stripe_width() const {
+    return stripe_width;
+  }
+  uint64_t get_chunk_size() const {
+    return chunk_size;
+  }
+  uint64_t logical_to_prev_stripe_offset(uint64_t offset) const {
+    return offset - (offset % stripe_width);
+  }
+  uint64_t logical_to_next_stripe_offset(uint64_t offset) const {
+    return offset % stripe_width ?
+      offset - (offset % stripe_width) + stripe_width : offset;
+  }
+  uint64_t aligned_logical_offset_to_chunk_offset(uint64_t offset) const {
+    assert(offset % stripe_width == 0);
+    return offset / k;
+  }
+  uint64_t aligned_chunk_offset_to_logical_offset(uint64_t offset) const {
+    assert(offset % chunk_size == 0);
+    return offset * k;
+  }
+  /// the stripe aligned extent holding [off, off+len)
+  std::pair<uint64_t, uint64_t> offset_len_to_stripe_bounds(
+    uint64_t off, uint64_t len) const {
+    uint64_t start = logical_to_prev_stripe_offset(off);
+    return std::make_pair(start, logical_to_next_stripe_offset(off + len) - start);
+  }
+  /// the data chunks holding some of [off, off+len)
+  void get_data_chunks(uint64_t off, uint64_t len, std::set<int> *chunks) const;
+};
+
+/**
+ * encode the whole stripes in in
+ *
+ * The chunks of each stripe are appended to out[shard], for each
+ * shard in want.
+ *
+ * @return 0 on success or a negative errno
+ */
+int encode(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec,
+  const bufferlist &in,
+  const std::set<int> &want,
+  std::map<int, bufferlist> *out);
+
+/**
+ * choose the shards to read [off, off+len) from
+ *
+ * The data chunks covering the range are read where they are
+ * available; otherwise the code decides which shards to rebuild them
+ * from, preferring the cheapest.  The same chunk extent is read on
+ * every shard.
+ *
+ * @param [in] available cost of reading from each available shard
+ * @param [out] want data chunks covering the range
+ * @param [out] shards shards to read
+ * @param [out] chunk_extent offset and length to read on each shard
+ * @return 0 on success or a negative errno
+ */
+int plan_read(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec,
+  uint64_t off,
+  uint64_t len,
+  const std::map<int, int> &available,
+  std::set<int> *want,
+  std::set<int> *shards,
+  std::pair<uint64_t, uint64_t> *chunk_extent);
+
+/**
+ * rebuild [off, off+len) from the shards read for it
+ *
+ * @param [in] want data chunks covering the range, from plan_read
+ * @param [in] chunk_extent the extent read on each shard, from plan_read
+ * @param [in] from the chunk extent of each shard read
+ * @param [out] out the bytes of the range
+ * @return 0 on success or a negative errno
+ */
+int decode_range(
+  const stripe_info_t &sinfo,
+  ceph::ErasureCodeInterfaceRef &ec,
+  uint64_t off,
+  uint64_t len,
+  const std::set<int> &want,
+  const std::pair<uint64_t, uint64_t> &chunk_extent,
+  std::map<int, bufferlist> &from,
+  bufferlist *out);
+
+}
+
+#endif
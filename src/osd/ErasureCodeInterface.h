@@ -156,6 +156,31 @@ namespace ceph {
                                             const map<int, int> &available,
                                             set<int> *minimum) = 0;
 
+    /**
+     * Return the number of chunks **encode** creates.
+     *
+     * @return the chunk count
+     */
+    virtual unsigned get_chunk_count() = 0;
+
+    /**
+     * Return the number of chunks holding the input of **encode**.
+     * They are the first chunks, and the concatenation of their
+     * content starts with the input.
+     *
+     * @return the data chunk count
+     */
+    virtual unsigned get_data_chunk_count() = 0;
+
+    /**
+     * Return the size of the chunks **encode** cuts an input of
+     * **object_size** bytes into, padding included.
+     *
+     * @param [in] object_size length of the input of **encode**
+     * @return the chunk size
+     */
+    virtual unsigned get_chunk_size(unsigned object_size) = 0;
+
     /**
      * Encode the content of **in** and store the result in
      * **encoded**. All buffers pointed to by **encoded** have the
@@ -180,6 +205,12 @@ namespace ceph {
      * **in** after calling the encode method, it may have a side
      * effect on the content of **encoded**. 
      *
+     * If each buffer of **in** holds a whole number of chunks of
+     * **get_chunk_size(in.length())** bytes, the data chunks in
+     * **encoded** refer to them and only the coding chunks are
+     * allocated. Otherwise the data chunks that span buffers are
+     * copied.
+     *
      * The **encoded** map may contain pointers to buffers allocated
      * by the encode method. They will be freed when **encoded** is
      * freed. The allocation method is not specified.
@@ -69,29 +69,61 @@ int ErasureCodeJerasure::minimum_to_decode_with_cost(const set<int> &want_to_rea
        i != available.end();
        ++i)
     available_chunks.insert(i->first);
-  return minimum_to_decode(want_to_read, available_chunks, minimum);
+  if (includes(available_chunks.begin(), available_chunks.end(),
+	       want_to_read.begin(), want_to_read.end()) ||
+      available_chunks.size() < (unsigned)k)
+    return minimum_to_decode(want_to_read, available_chunks, minimum);
+
+  // any k chunks will do, read the cheapest ones
+  set<pair<int, int> > by_cost;
+  for (map<int, int>::const_iterator i = available.begin();
+       i != available.end();
+       ++i)
+    by_cost.insert(make_pair(i->second, i->first));
+  set<pair<int, int> >::iterator i;
+  unsigned j;
+  for (i = by_cost.begin(), j = 0; j < (unsigned)k; ++i, j++)
+    minimum->insert(i->second);
+  return 0;
+}
+
+unsigned ErasureCodeJerasure::get_chunk_size(unsigned object_size)
+{
+  unsigned alignment = get_alignment();
+  unsigned tail = object_size % alignment;
+  unsigned padded_length = object_size + ( tail ?  ( alignment - tail ) : 0 );
+  assert(padded_length % k == 0);
+  return padded_length / k;
 }
 
 int ErasureCodeJerasure::encode(const set<int> &want_to_encode,
                                 const bufferlist &in,
                                 map<int, bufferlist> *encoded)
 {
-  unsigned alignment = get_alignment();
-  unsigned tail = in.length() % alignment;
-  unsigned padded_length = in.length() + ( tail ?  ( alignment - tail ) : 0 );
+  unsigned blocksize = get_chunk_size(in.length());
   dout(10) << "encode adjusted buffer length from " << in.length()
-	   << " to " << padded_length << dendl;
-  assert(padded_length % k == 0);
-  unsigned blocksize = padded_length / k;
-  unsigned length = blocksize * ( k + m );
-  bufferlist out(in);
-  bufferptr pad(length - in.length());
-  pad.zero(0, padded_length - in.length());
-  out.push_back(pad);
+	   << " to " << blocksize * k << dendl;
   char *chunks[k + m];
-  for (int i = 0; i < k + m; i++) {
+  for (int i = 0; i < k; i++) {
+    bufferlist &chunk = (*encoded)[i];
+    unsigned offset = i * blocksize;
+    if (offset + blocksize <= in.length()) {
+      // refer to the input; c_str() only copies a chunk spanning buffers
+      chunk.substr_of(in, offset, blocksize);
+    } else {
+      bufferptr pad(buffer::create_page_aligned(blocksize));
+      unsigned tail = offset < in.length() ? in.length() - offset : 0;
+      if (tail)
+	in.copy(offset, tail, pad.c_str());
+      pad.zero(tail, blocksize - tail);
+      chunk.push_back(pad);
+    }
+    chunks[i] = chunk.c_str();
+  }
+  bufferptr coding(buffer::create_page_aligned(blocksize * m));
+  for (int i = k; i < k + m; i++) {
     bufferlist &chunk = (*encoded)[i];
-    chunk.substr_of(out, i * blocksize, blocksize);
+    chunk.push_back(bufferptr(coding, (i - k) * blocksize, blocksize));
     chunks[i] = chunk.c_str();
   }
   jerasure_encode(&chunks[0], &chunks[k], blocksize);
@@ -40,6 +40,16 @@ public:
                                           const map<int, int> &available,
                                           set<int> *minimum);
 
+  virtual unsigned get_chunk_count() {
+    return k + m;
+  }
+
+  virtual unsigned get_data_chunk_count() {
+    return k;
+  }
+
+  virtual unsigned get_chunk_size(unsigned object_size);
+
   virtual int encode(const set<int> &want_to_encode,
                      const bufferlist &in,
                      map<int, bufferlist> *encoded);
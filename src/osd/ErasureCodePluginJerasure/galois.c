@@ -51,6 +51,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 
 #include "galois.h"
+#include "galois_simd.h"
+#include "arch/probe.h"
+#include "arch/intel.h"
 
 #define NONE (10)
 #define TABLE (11)
@@ -162,6 +165,56 @@ NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
 
 static int *galois_split_w8[7] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL };
 
+/* for each multby, its products with 0x00..0x0f and with 0x00..0xf0,
+   for the vector w=8 region multiply */
+static unsigned char *galois_w08_nibble_tables = NULL;
+
+typedef int (*galois_w08_region_multiply_t)(const unsigned char *src,
+                                            unsigned char *dst, int nbytes,
+                                            const unsigned char *tables,
+                                            int add);
+typedef int (*galois_region_xor_t)(const char *r1, const char *r2, char *r3,
+                                   int nbytes);
+
+static int galois_w08_region_multiply_none(const unsigned char *src,
+                                           unsigned char *dst, int nbytes,
+                                           const unsigned char *tables,
+                                           int add)
+{
+  return 0;
+}
+
+static int galois_region_xor_none(const char *r1, const char *r2, char *r3,
+                                  int nbytes)
+{
+  return 0;
+}
+
+/* choose the widest vector version the cpu supports and is compiled in */
+static galois_w08_region_multiply_t galois_choose_w08_region_multiply(void)
+{
+  ceph_arch_probe();
+  if (ceph_arch_intel_avx2 && galois_avx2_exists())
+    return galois_w08_region_multiply_avx2;
+  if (ceph_arch_intel_ssse3 && galois_ssse3_exists())
+    return galois_w08_region_multiply_ssse3;
+  return galois_w08_region_multiply_none;
+}
+
+static galois_region_xor_t galois_choose_region_xor(void)
+{
+  ceph_arch_probe();
+  if (ceph_arch_intel_avx2 && galois_avx2_exists())
+    return galois_region_xor_avx2;
+  if (ceph_arch_intel_ssse3 && galois_ssse3_exists())
+    return galois_region_xor_ssse3;
+  return galois_region_xor_none;
+}
+
+/* effectively constant; racing to set them is harmless */
+static galois_w08_region_multiply_t galois_w08_region_multiply_vec;
+static galois_region_xor_t galois_region_xor_vec;
+
 int galois_create_log_tables(int w)
 {
   int j, b;
@@ -276,6 +329,19 @@ int galois_create_mult_tables(int w)
       j++;
     }
   }
+
+  if (w == 8 && galois_w08_nibble_tables == NULL) {
+    unsigned char *t = (unsigned char *) malloc(256 * 32);
+    if (t != NULL) {
+      for (x = 0; x < 256; x++) {
+        for (y = 0; y < 16; y++) {
+          t[x*32+y] = galois_mult_tables[8][x*nw[8]+y];
+          t[x*32+16+y] = galois_mult_tables[8][x*nw[8]+(y << 4)];
+        }
+      }
+      galois_w08_nibble_tables = t;
+    }
+  }
   return 0;
 }
 
@@ -458,8 +524,18 @@ void galois_w08_region_multiply(char *region,      /* Region to multiply */
     }
   }
   srow = multby * nw[8];
+
+  i = 0;
+  if (galois_w08_nibble_tables != NULL) {
+    if (galois_w08_region_multiply_vec == NULL)
+      galois_w08_region_multiply_vec = galois_choose_w08_region_multiply();
+    i = galois_w08_region_multiply_vec(ur1, ur2, nbytes,
+                                       galois_w08_nibble_tables + multby * 32,
+                                       r2 != NULL && add);
+  }
+
   if (r2 == NULL || !add) {
-    for (i = 0; i < nbytes; i++) {
+    for (; i < nbytes; i++) {
       prod = galois_mult_tables[8][srow+ur1[i]];
       ur2[i] = prod;
     }
@@ -467,7 +543,7 @@ void galois_w08_region_multiply(char *region,      /* Region to multiply */
     sol = sizeof(long);
     lp2 = &l;
     lp = (unsigned char *) lp2;
-    for (i = 0; i < nbytes; i += sol) {
+    for (; i < nbytes; i += sol) {
       cp = ur2+i;
       lp2 = (unsigned long *) cp;
       for (j = 0; j < sol; j++) {
@@ -750,12 +826,17 @@ void galois_region_xor(           char *r1,         /* Region 1 */
   long *l3;
   long *ltop;
   char *ctop;
+  int done;
+
+  if (galois_region_xor_vec == NULL)
+    galois_region_xor_vec = galois_choose_region_xor();
+  done = galois_region_xor_vec(r1, r2, r3, nbytes);
   
   ctop = r1 + nbytes;
   ltop = (long *) ctop;
-  l1 = (long *) r1;
-  l2 = (long *) r2;
-  l3 = (long *) r3;
+  l1 = (long *) (r1 + done);
+  l2 = (long *) (r2 + done);
+  l3 = (long *) (r3 + done);
  
   while (l1 < ltop) {
     *l3 = ((*l1)  ^ (*l2));
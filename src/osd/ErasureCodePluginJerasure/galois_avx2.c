@@ -0,0 +1,76 @@
+#include "acconfig.h"
+
+#include "galois_simd.h"
+
+#ifdef HAVE_INTEL_AVX2
+
+#include <immintrin.h>
+
+int galois_avx2_exists(void)
+{
+	return 1;
+}
+
+/* the shuffle works within each 128 bit lane, so both get the table */
+static inline __m256i load_table(const unsigned char *t)
+{
+	__m128i x = _mm_loadu_si128((const __m128i *)t);
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(x), x, 1);
+}
+
+int galois_w08_region_multiply_avx2(const unsigned char *src,
+				    unsigned char *dst, int nbytes,
+				    const unsigned char *tables, int add)
+{
+	const __m256i lo = load_table(tables);
+	const __m256i hi = load_table(tables + 16);
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	int i;
+
+	for (i = 0; i + 32 <= nbytes; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i l = _mm256_and_si256(x, mask);
+		__m256i h = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+		__m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, l),
+					     _mm256_shuffle_epi8(hi, h));
+		if (add)
+			p = _mm256_xor_si256(p, _mm256_loadu_si256((const __m256i *)(dst + i)));
+		_mm256_storeu_si256((__m256i *)(dst + i), p);
+	}
+	return i;
+}
+
+int galois_region_xor_avx2(const char *r1, const char *r2, char *r3,
+			   int nbytes)
+{
+	int i;
+
+	for (i = 0; i + 32 <= nbytes; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(r1 + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(r2 + i));
+		_mm256_storeu_si256((__m256i *)(r3 + i), _mm256_xor_si256(a, b));
+	}
+	return i;
+}
+
+#else
+
+int galois_avx2_exists(void)
+{
+	return 0;
+}
+
+int galois_w08_region_multiply_avx2(const unsigned char *src,
+				    unsigned char *dst, int nbytes,
+				    const unsigned char *tables, int add)
+{
+	return 0;
+}
+
+int galois_region_xor_avx2(const char *r1, const char *r2, char *r3,
+			   int nbytes)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef CEPH_ERASURE_CODE_GALOIS_SIMD_H
+#define CEPH_ERASURE_CODE_GALOIS_SIMD_H
+
+/*
+ * Vector versions of the w=8 region multiply and of the region xor.
+ *
+ * The multiply uses the split table method: the product of a byte by
+ * multby is the xor of the products of its low and high nibbles, each
+ * looked up with a byte shuffle in a 16 byte table.  tables points to
+ * the 16 low nibble products followed by the 16 high nibble products.
+ *
+ * Each returns how many of the nbytes it did (a multiple of its width,
+ * or 0 if it is not compiled in); the caller does the rest.
+ */
+
+extern int galois_ssse3_exists(void);
+extern int galois_w08_region_multiply_ssse3(const unsigned char *src,
+					    unsigned char *dst, int nbytes,
+					    const unsigned char *tables,
+					    int add);
+extern int galois_region_xor_ssse3(const char *r1, const char *r2, char *r3,
+				   int nbytes);
+
+extern int galois_avx2_exists(void);
+extern int galois_w08_region_multiply_avx2(const unsigned char *src,
+					   unsigned char *dst, int nbytes,
+					   const unsigned char *tables,
+					   int add);
+extern int galois_region_xor_avx2(const char *r1, const char *r2, char *r3,
+				  int nbytes);
+
+#endif
@@ -0,0 +1,69 @@
+#include "acconfig.h"
+
+#include "galois_simd.h"
+
+#ifdef HAVE_INTEL_SSSE3
+
+#include <tmmintrin.h>
+
+int galois_ssse3_exists(void)
+{
+	return 1;
+}
+
+int galois_w08_region_multiply_ssse3(const unsigned char *src,
+				     unsigned char *dst, int nbytes,
+				     const unsigned char *tables, int add)
+{
+	const __m128i lo = _mm_loadu_si128((const __m128i *)tables);
+	const __m128i hi = _mm_loadu_si128((const __m128i *)(tables + 16));
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	int i;
+
+	for (i = 0; i + 16 <= nbytes; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i l = _mm_and_si128(x, mask);
+		__m128i h = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+		__m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, l),
+					  _mm_shuffle_epi8(hi, h));
+		if (add)
+			p = _mm_xor_si128(p, _mm_loadu_si128((const __m128i *)(dst + i)));
+		_mm_storeu_si128((__m128i *)(dst + i), p);
+	}
+	return i;
+}
+
+int galois_region_xor_ssse3(const char *r1, const char *r2, char *r3,
+			    int nbytes)
+{
+	int i;
+
+	for (i = 0; i + 16 <= nbytes; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(r1 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(r2 + i));
+		_mm_storeu_si128((__m128i *)(r3 + i), _mm_xor_si128(a, b));
+	}
+	return i;
+}
+
+#else
+
+int galois_ssse3_exists(void)
+{
+	return 0;
+}
+
+int galois_w08_region_multiply_ssse3(const unsigned char *src,
+				     unsigned char *dst, int nbytes,
+				     const unsigned char *tables, int add)
+{
+	return 0;
+}
+
+int galois_region_xor_ssse3(const char *r1, const char *r2, char *r3,
+			    int nbytes)
+{
+	return 0;
+}
+
+#endif
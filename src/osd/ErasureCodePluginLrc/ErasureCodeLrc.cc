@@ -0,0 +1,281 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*- 
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ * 
+ */
+
+#include <errno.h>
+#include <algorithm>
+#include "common/debug.h"
+#include "ErasureCodeLrc.h"
+#include "osd/ErasureCodePluginJerasure/ErasureCodeJerasure.h"
+extern "C" {
+#include "osd/ErasureCodePluginJerasure/galois.h"
+}
+
+#define dout_subsys ceph_subsys_osd
+#undef dout_prefix
+#define dout_prefix _prefix(_dout)
+
+static ostream& _prefix(std::ostream* _dout)
+{
+  return *_dout << "ErasureCodeLrc: ";
+}
+
+void ErasureCodeLrc::init(const map<std::string,std::string> &parameters)
+{
+  k = ErasureCodeJerasure::to_int("erasure-code-k", parameters, DEFAULT_K);
+  m = ErasureCodeJerasure::to_int("erasure-code-m", parameters, DEFAULT_M);
+  l = ErasureCodeJerasure::to_int("erasure-code-l", parameters, DEFAULT_L);
+  if (l < 1 || l > k + m) {
+    derr << "l=" << l << " must be between 1 and k+m=" << k + m
+         << ", set to " << k + m << dendl;
+    l = k + m;
+  }
+  dout(10) << "k=" << k << " m=" << m << " l=" << l
+           << " groups=" << get_group_count() << dendl;
+
+  map<std::string,std::string> global_parameters(parameters);
+  ErasureCodeJerasureReedSolomonVandermonde *rs =
+    new ErasureCodeJerasureReedSolomonVandermonde();
+  rs->init(global_parameters);
+  global = ErasureCodeInterfaceRef(rs);
+}
+
+void ErasureCodeLrc::get_group_chunks(int group, set<int> *chunks) const
+{
+  for (int i = group * l; i < std::min((group + 1) * l, k + m); i++)
+    chunks->insert(i);
+  chunks->insert(k + m + group);
+}
+
+int ErasureCodeLrc::minimum(const set<int> &want_to_read,
+                            const map<int, int> &available,
+                            set<int> *minimum)
+{
+  set<int> available_chunks;
+  for (map<int, int>::const_iterator i = available.begin();
+       i != available.end();
+       ++i)
+    available_chunks.insert(i->first);
+
+  if (includes(available_chunks.begin(), available_chunks.end(),
+               want_to_read.begin(), want_to_read.end())) {
+    *minimum = want_to_read;
+    return 0;
+  }
+
+  // rebuild each missing chunk from the rest of its group
+  set<int> local;
+  bool all_local = true;
+  for (set<int>::const_iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i) {
+    if (available_chunks.count(*i)) {
+      local.insert(*i);
+      continue;
+    }
+    set<int> group;
+    get_group_chunks(get_group(*i), &group);
+    group.erase(*i);
+    if (!includes(available_chunks.begin(), available_chunks.end(),
+                  group.begin(), group.end())) {
+      all_local = false;
+      break;
+    }
+    local.insert(group.begin(), group.end());
+  }
+  if (all_local) {
+    dout(20) << "minimum_to_decode " << want_to_read << " from groups "
+             << local << dendl;
+    *minimum = local;
+    return 0;
+  }
+
+  // fall back to the global code; a local coding chunk is the xor of
+  // its group
+  set<int> want_global;
+  set<int> direct;
+  for (set<int>::const_iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i) {
+    if (*i < k + m) {
+      want_global.insert(*i);
+    } else if (available_chunks.count(*i)) {
+      direct.insert(*i);
+    } else {
+      set<int> group;
+      get_group_chunks(get_group(*i), &group);
+      group.erase(*i);
+      want_global.insert(group.begin(), group.end());
+    }
+  }
+  map<int, int> available_global;
+  for (map<int, int>::const_iterator i = available.begin();
+       i != available.end();
+       ++i)
+    if (i->first < k + m)
+      available_global.insert(*i);
+  int r = global->minimum_to_decode_with_cost(want_global, available_global,
+                                              minimum);
+  if (r < 0)
+    return r;
+  minimum->insert(direct.begin(), direct.end());
+  dout(20) << "minimum_to_decode " << want_to_read << " from global code "
+           << *minimum << dendl;
+  return 0;
+}
+
+int ErasureCodeLrc::minimum_to_decode(const set<int> &want_to_read,
+                                      const set<int> &available_chunks,
+                                      set<int> *minimum)
+{
+  map<int, int> available;
+  for (set<int>::const_iterator i = available_chunks.begin();
+       i != available_chunks.end();
+       ++i)
+    available[*i] = 0;
+  return this->minimum(want_to_read, available, minimum);
+}
+
+int ErasureCodeLrc::minimum_to_decode_with_cost(const set<int> &want_to_read,
+                                                const map<int, int> &available,
+                                                set<int> *minimum)
+{
+  return this->minimum(want_to_read, available, minimum);
+}
+
+void ErasureCodeLrc::xor_chunks(const map<int, bufferlist> &chunks,
+                                const set<int> &from,
+                                bufferlist *out)
+{
+  assert(!from.empty());
+  bufferlist first = chunks.find(*from.begin())->second;
+  bufferptr sum(first.c_str(), first.length());
+  for (set<int>::const_iterator i = ++from.begin(); i != from.end(); ++i) {
+    bufferlist chunk = chunks.find(*i)->second;
+    assert(chunk.length() == sum.length());
+    galois_region_xor(chunk.c_str(), sum.c_str(), sum.c_str(), sum.length());
+  }
+  out->clear();
+  out->push_back(sum);
+}
+
+int ErasureCodeLrc::encode(const set<int> &want_to_encode,
+                           const bufferlist &in,
+                           map<int, bufferlist> *encoded)
+{
+  set<int> want_global;
+  for (int i = 0; i < k + m; i++)
+    want_global.insert(i);
+  map<int, bufferlist> chunks;
+  int r = global->encode(want_global, in, &chunks);
+  if (r < 0)
+    return r;
+
+  for (int g = 0; g < get_group_count(); g++) {
+    if (!want_to_encode.count(k + m + g))
+      continue;
+    set<int> group;
+    get_group_chunks(g, &group);
+    group.erase(k + m + g);
+    xor_chunks(chunks, group, &chunks[k + m + g]);
+  }
+
+  for (set<int>::const_iterator i = want_to_encode.begin();
+       i != want_to_encode.end();
+       ++i)
+    if (chunks.count(*i))
+      (*encoded)[*i] = chunks[*i];
+  return 0;
+}
+
+int ErasureCodeLrc::decode(const set<int> &want_to_read,
+                           const map<int, bufferlist> &chunks,
+                           map<int, bufferlist> *decoded)
+{
+  map<int, bufferlist> have(chunks);
+
+  // repair the groups missing a single chunk, as long as we lack some
+  bool progress = true;
+  while (progress) {
+    progress = false;
+    bool complete = true;
+    for (set<int>::const_iterator i = want_to_read.begin();
+         i != want_to_read.end();
+         ++i)
+      if (!have.count(*i))
+        complete = false;
+    if (complete)
+      break;
+    for (int g = 0; g < get_group_count(); g++) {
+      set<int> group;
+      get_group_chunks(g, &group);
+      int lost = -1;
+      unsigned missing = 0;
+      for (set<int>::iterator i = group.begin(); i != group.end(); ++i)
+        if (!have.count(*i)) {
+          lost = *i;
+          missing++;
+        }
+      if (missing != 1)
+        continue;
+      group.erase(lost);
+      dout(20) << "decode " << lost << " from group " << g << dendl;
+      xor_chunks(have, group, &have[lost]);
+      progress = true;
+    }
+  }
+
+  bool complete = true;
+  for (set<int>::const_iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i)
+    if (!have.count(*i))
+      complete = false;
+
+  if (!complete) {
+    map<int, bufferlist> global_chunks;
+    set<int> want_global;
+    for (int i = 0; i < k + m; i++) {
+      want_global.insert(i);
+      if (have.count(i))
+        global_chunks[i] = have[i];
+    }
+    if (global_chunks.size() < (unsigned)k) {
+      derr << "decode " << want_to_read << " needs " << k
+           << " of the first " << k + m << " chunks, only have "
+           << global_chunks.size() << dendl;
+      return -EIO;
+    }
+    map<int, bufferlist> global_decoded;
+    int r = global->decode(want_global, global_chunks, &global_decoded);
+    if (r < 0)
+      return r;
+    for (map<int, bufferlist>::iterator i = global_decoded.begin();
+         i != global_decoded.end();
+         ++i)
+      if (!have.count(i->first))
+        have[i->first] = i->second;
+    for (int g = 0; g < get_group_count(); g++) {
+      if (have.count(k + m + g) || !want_to_read.count(k + m + g))
+        continue;
+      set<int> group;
+      get_group_chunks(g, &group);
+      group.erase(k + m + g);
+      xor_chunks(have, group, &have[k + m + g]);
+    }
+  }
+
+  for (set<int>::const_iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i)
+    (*decoded)[*i] = have[*i];
+  return 0;
+}
@@ -0,0 +1,95 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*- 
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ * 
+ */
+
+#ifndef CEPH_ERASURE_CODE_LRC_H
+#define CEPH_ERASURE_CODE_LRC_H
+
+#include "osd/ErasureCodeInterface.h"
+
+/**
+ * Locally repairable code
+ *
+ * The k data chunks are encoded with Reed-Solomon into m global coding
+ * chunks, as the jerasure reed_sol_van technique does.  The k+m chunks
+ * are then cut into groups of l consecutive chunks, and each group gets
+ * one more chunk, the xor of its members.  The chunks are numbered
+ *
+ *   0 .. k-1          data
+ *   k .. k+m-1        global coding
+ *   k+m .. k+m+g-1    local coding, one per group
+ *
+ * with g = ceil((k+m)/l) groups.  A single lost chunk is rebuilt from
+ * the l other chunks of its group rather than from k chunks; losses a
+ * group cannot repair on its own fall back to the Reed-Solomon decode.
+ */
+class ErasureCodeLrc : public ErasureCodeInterface {
+public:
+  static const int DEFAULT_K = 4;
+  static const int DEFAULT_M = 2;
+  static const int DEFAULT_L = 3;
+
+  int k;
+  int m;
+  int l;
+  ErasureCodeInterfaceRef global;
+
+  ErasureCodeLrc() : k(0), m(0), l(0) {}
+  virtual ~ErasureCodeLrc() {}
+
+  virtual int minimum_to_decode(const set<int> &want_to_read,
+                                const set<int> &available_chunks,
+                                set<int> *minimum);
+
+  virtual int minimum_to_decode_with_cost(const set<int> &want_to_read,
+                                          const map<int, int> &available,
+                                          set<int> *minimum);
+
+  virtual unsigned get_chunk_size(unsigned object_size) {
+    return global->get_chunk_size(object_size);
+  }
+
+  virtual int encode(const set<int> &want_to_encode,
+                     const bufferlist &in,
+                     map<int, bufferlist> *encoded);
+
+  virtual int decode(const set<int> &want_to_read,
+                     const map<int, bufferlist> &chunks,
+                     map<int, bufferlist> *decoded);
+
+  void init(const map<std::string,std::string> &parameters);
+
+  int get_group_count() const {
+    return (k + m + l - 1) / l;
+  }
+  virtual unsigned get_chunk_count() {
+    return k + m + get_group_count();
+  }
+  virtual unsigned get_data_chunk_count() {
+    return k;
+  }
+  /// the group chunk belongs to
+  int get_group(int chunk) const {
+    return chunk < k + m ? chunk / l : chunk - k - m;
+  }
+  /// the members of group, and its local coding chunk
+  void get_group_chunks(int group, set<int> *chunks) const;
+
+private:
+  int minimum(const set<int> &want_to_read,
+              const map<int, int> &available,
+              set<int> *minimum);
+  void xor_chunks(const map<int, bufferlist> &chunks,
+                  const set<int> &from,
+                  bufferlist *out);
+};
+
+#endif
@@ -0,0 +1,218 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "HitSet.h"
+
+// -- HitSet --
+
+HitSet::HitSet(impl_type_t type, unsigned target_size, double fpp)
+  : impl(NULL)
+{
+  reset(type, target_size, fpp);
+}
+
+void HitSet::reset(impl_type_t type, unsigned target_size, double fpp)
+{
+  delete impl;
+  switch (type) {
+  case TYPE_NONE:
+    impl = NULL;
+    break;
+  case TYPE_EXPLICIT_HASH:
+    impl = new ExplicitHashHitSet;
+    break;
+  case TYPE_BLOOM:
+    impl = new BloomHitSet(target_size ? target_size : 1, fpp);
+    break;
+  default:
+    assert(0 == "unknown HitSet type");
+  }
+}
+
+void HitSet::encode(bufferlist &bl) const
+{
+  ENCODE_START(1, 1, bl);
+  __u8 type = get_type();
+  ::encode(type, bl);
+  if (impl)
+    impl->encode(bl);
+  ENCODE_FINISH(bl);
+}
+
+void HitSet::decode(bufferlist::iterator &bl)
+{
+  DECODE_START(1, bl);
+  __u8 type;
+  ::decode(type, bl);
+  if (type != TYPE_NONE && type != TYPE_EXPLICIT_HASH && type != TYPE_BLOOM)
+    throw buffer::malformed_input("unknown HitSet type");
+  reset((impl_type_t)type, 1, .05);
+  if (impl)
+    impl->decode(bl);
+  DECODE_FINISH(bl);
+}
+
+void HitSet::dump(Formatter *f) const
+{
+  f->dump_string("type", get_type_name(get_type()));
+  if (impl)
+    impl->dump(f);
+}
+
+void HitSet::generate_test_instances(std::list<HitSet*>& o)
+{
+  o.push_back(new HitSet);
+  o.push_back(new HitSet(TYPE_EXPLICIT_HASH, 0, 0));
+  o.back()->insert(hobject_t(object_t("foo"), "", CEPH_NOSNAP, 1, 0, ""));
+  o.back()->insert(hobject_t(object_t("bar"), "", CEPH_NOSNAP, 2, 0, ""));
+  o.push_back(new HitSet(TYPE_BLOOM, 10, .1));
+  o.back()->insert(hobject_t(object_t("foo"), "", CEPH_NOSNAP, 1, 0, ""));
+}
+
+// -- HitSetHistory --
+
+void HitSetHistory::Interval::encode(bufferlist &bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(begin, bl);
+  ::encode(end, bl);
+  ::encode(*set, bl);
+  ENCODE_FINISH(bl);
+}
+
+void HitSetHistory::Interval::decode(bufferlist::iterator &bl)
+{
+  DECODE_START(1, bl);
+  ::decode(begin, bl);
+  ::decode(end, bl);
+  ::decode(*set, bl);
+  DECODE_FINISH(bl);
+}
+
+void HitSetHistory::Interval::dump(Formatter *f) const
+{
+  f->dump_stream("begin") << begin;
+  f->dump_stream("end") << end;
+  set->dump(f);
+}
+
+void HitSetHistory::set_params(HitSet::impl_type_t t, unsigned c,
+			       unsigned period_sec, unsigned ts, double f)
+{
+  if (ts == 0)
+    ts = 1;
+  if (t == type && c == count && utime_t(period_sec, 0) == period &&
+      ts == target_size && f == fpp)
+    return;
+  type = t;
+  count = c;
+  period = utime_t(period_sec, 0);
+  target_size = ts;
+  fpp = f;
+  clear();
+}
+
+void HitSetHistory::rotate(utime_t now)
+{
+  // intervals that ended more than count periods ago are gone, even
+  // if nothing was inserted (and so rotated) since
+  utime_t horizon = now;
+  for (unsigned i = 0; i < count; ++i)
+    horizon -= period;
+  while (!sets.empty() && sets.back().begin < horizon) {
+    sets.pop_back();
+    closed = true;
+  }
+
+  if (sets.empty() || now - sets.front().begin >= period) {
+    if (!sets.empty()) {
+      sets.front().end = now;
+      closed = true;
+    }
+    sets.push_front(Interval(now, new HitSet(type, target_size, fpp)));
+    while (sets.size() > count)
+      sets.pop_back();
+  }
+}
+
+void HitSetHistory::insert(const hobject_t& oid, utime_t now)
+{
+  if (!enabled())
+    return;
+  rotate(now);
+  sets.front().set->insert(oid);
+}
+
+unsigned HitSetHistory::temperature(const hobject_t& oid, utime_t now,
+				    unsigned last)
+{
+  if (!enabled())
+    return 0;
+  rotate(now);
+  unsigned t = 0, n = 0;
+  for (std::list<Interval>::iterator p = sets.begin();
+       p != sets.end() && (!last || n < last);
+       ++p, ++n)
+    if (p->set->contains(oid))
+      ++t;
+  return t;
+}
+
+bool HitSetHistory::in_current(const hobject_t& oid, utime_t now)
+{
+  if (!enabled())
+    return false;
+  rotate(now);
+  return sets.front().set->contains(oid);
+}
+
+void HitSetHistory::encode(bufferlist &bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(sets, bl);
+  ENCODE_FINISH(bl);
+}
+
+void HitSetHistory::decode(bufferlist::iterator &bl)
+{
+  std::list<Interval> ls;
+  DECODE_START(1, bl);
+  ::decode(ls, bl);
+  DECODE_FINISH(bl);
+
+  clear();
+  if (!enabled())
+    return;
+  for (std::list<Interval>::iterator p = ls.begin(); p != ls.end(); ++p) {
+    if (p->set->get_type() != type)
+      continue;
+    sets.push_back(*p);
+    if (sets.size() == count)
+      break;
+  }
+}
+
+void HitSetHistory::dump(Formatter *f) const
+{
+  f->dump_string("type", HitSet::get_type_name(type));
+  f->dump_unsigned("count", count);
+  f->dump_stream("period") << period;
+  f->open_array_section("intervals");
+  for (std::list<Interval>::const_iterator p = sets.begin();
+       p != sets.end();
+       ++p) {
+    f->open_object_section("interval");
+    p->dump(f);
+    f->close_section();
+  }
+  f->close_section();
+}
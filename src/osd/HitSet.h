@@ -0,0 +1,276 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_HITSET_H
+#define CEPH_OSD_HITSET_H
+
+#include <list>
+#include <set>
+#include <string>
+#include <tr1/memory>
+
+#include "include/encoding.h"
+#include "include/utime.h"
+#include "common/bloom_filter.hpp"
+#include "common/hobject.h"
+#include "common/Formatter.h"
+
+/**
+ * A set of objects accessed in some interval
+ *
+ * Only the object hash is kept.  The explicit hash set is exact (up
+ * to hash collisions) and grows with the number of objects; the bloom
+ * filter has a fixed size and may report objects it never saw.  Either
+ * way a false positive only makes an object look warmer than it is.
+ */
+class HitSet {
+public:
+  typedef enum {
+    TYPE_NONE = 0,
+    TYPE_EXPLICIT_HASH = 1,
+    TYPE_BLOOM = 2
+  } impl_type_t;
+
+  static const char *get_type_name(impl_type_t t) {
+    switch (t) {
+    case TYPE_NONE: return "none";
+    case TYPE_EXPLICIT_HASH: return "explicit_hash";
+    case TYPE_BLOOM: return "bloom";
+    default: return "???";
+    }
+  }
+  static impl_type_t get_type_from_name(const std::string& s) {
+    if (s == "none")
+      return TYPE_NONE;
+    if (s == "explicit_hash")
+      return TYPE_EXPLICIT_HASH;
+    if (s == "bloom")
+      return TYPE_BLOOM;
+    return (impl_type_t)-1;
+  }
+
+  class Impl {
+  public:
+    virtual impl_type_t get_type() const = 0;
+    virtual void insert(uint32_t hash) = 0;
+    virtual bool contains(uint32_t hash) const = 0;
+    virtual unsigned insert_count() const = 0;
+    virtual void encode(bufferlist &bl) const = 0;
+    virtual void decode(bufferlist::iterator &bl) = 0;
+    virtual void dump(Formatter *f) const = 0;
+    virtual ~Impl() {}
+  };
+
+  HitSet() : impl(NULL) {}
+  /// target_size and fpp only matter to the bloom filter
+  HitSet(impl_type_t type, unsigned target_size, double fpp);
+  ~HitSet() {
+    delete impl;
+  }
+
+  impl_type_t get_type() const {
+    return impl ? impl->get_type() : TYPE_NONE;
+  }
+  void insert(const hobject_t& oid) {
+    assert(impl);
+    impl->insert(oid.hash);
+  }
+  bool contains(const hobject_t& oid) const {
+    return impl && impl->contains(oid.hash);
+  }
+  unsigned insert_count() const {
+    return impl ? impl->insert_count() : 0;
+  }
+
+  void encode(bufferlist &bl) const;
+  void decode(bufferlist::iterator &bl);
+  void dump(Formatter *f) const;
+  static void generate_test_instances(std::list<HitSet*>& o);
+
+private:
+  Impl *impl;
+
+  void reset(impl_type_t type, unsigned target_size, double fpp);
+
+  HitSet(const HitSet& o);
+  const HitSet& operator=(const HitSet& o);
+};
+WRITE_CLASS_ENCODER(HitSet)
+
+class ExplicitHashHitSet : public HitSet::Impl {
+  uint64_t count;
+  std::set<uint32_t> hits;
+public:
+  ExplicitHashHitSet() : count(0) {}
+
+  HitSet::impl_type_t get_type() const {
+    return HitSet::TYPE_EXPLICIT_HASH;
+  }
+  void insert(uint32_t hash) {
+    hits.insert(hash);
+    ++count;
+  }
+  bool contains(uint32_t hash) const {
+    return hits.count(hash);
+  }
+  unsigned insert_count() const {
+    return count;
+  }
+  void encode(bufferlist &bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(count, bl);
+    ::encode(hits, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator &bl) {
+    DECODE_START(1, bl);
+    ::decode(count, bl);
+    ::decode(hits, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const {
+    f->dump_unsigned("insert_count", count);
+    f->dump_unsigned("unique_count", hits.size());
+  }
+};
+
+class BloomHitSet : public HitSet::Impl {
+  bloom_filter bloom;
+public:
+  BloomHitSet() : bloom(1, .05, 0) {}
+  BloomHitSet(unsigned target_size, double fpp)
+    : bloom(target_size, fpp, 0) {}
+
+  HitSet::impl_type_t get_type() const {
+    return HitSet::TYPE_BLOOM;
+  }
+  void insert(uint32_t hash) {
+    bloom.insert(hash);
+  }
+  bool contains(uint32_t hash) const {
+    return bloom.contains(hash);
+  }
+  unsigned insert_count() const {
+    return bloom.element_count();
+  }
+  void encode(bufferlist &bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(bloom, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator &bl) {
+    DECODE_START(1, bl);
+    ::decode(bloom, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const {
+    f->dump_unsigned("insert_count", bloom.element_count());
+    f->dump_unsigned("table_size", bloom.size());
+    f->dump_float("effective_fpp", bloom.effective_fpp());
+  }
+};
+
+/**
+ * The objects a PG of a cache pool has seen accessed lately.
+ *
+ * Every hit_set_period seconds a new HitSet is started, and the last
+ * hit_set_count of them are kept.  The temperature of an object is the
+ * number of those intervals it was accessed in: 0 for an object nobody
+ * touched for hit_set_count periods, hit_set_count for one used in
+ * each of them.
+ *
+ * The primary archives the history in an object of the PG whenever an
+ * interval closes (see archive_pending()), and picks it up again when
+ * it activates.
+ */
+class HitSetHistory {
+public:
+  struct Interval {
+    utime_t begin, end;		///< end is zero while it is the current one
+    std::tr1::shared_ptr<HitSet> set;
+
+    Interval() : set(new HitSet) {}
+    Interval(utime_t b, HitSet *s) : begin(b), set(s) {}
+
+    void encode(bufferlist &bl) const;
+    void decode(bufferlist::iterator &bl);
+    void dump(Formatter *f) const;
+  };
+
+private:
+  std::list<Interval> sets;	///< newest first
+
+  HitSet::impl_type_t type;
+  unsigned count;
+  utime_t period;
+  unsigned target_size;
+  double fpp;
+  bool closed;			///< an interval closed since archived()
+
+  void rotate(utime_t now);
+
+public:
+  HitSetHistory()
+    : type(HitSet::TYPE_BLOOM), count(0), target_size(1000), fpp(.05),
+      closed(false) {}
+
+  /// change the shape of the history; drops it if anything changed
+  void set_params(HitSet::impl_type_t type, unsigned count,
+		  unsigned period_sec, unsigned target_size, double fpp);
+
+  bool enabled() const {
+    return type != HitSet::TYPE_NONE && count > 0 && period > utime_t();
+  }
+  unsigned get_count() const {
+    return count;
+  }
+  /// number of intervals currently tracked
+  unsigned size() const {
+    return sets.size();
+  }
+
+  /// note an access to oid at now
+  void insert(const hobject_t& oid, utime_t now);
+
+  /**
+   * number of tracked intervals oid was accessed in
+   *
+   * @param last only look at the newest this many intervals, 0 for all
+   */
+  unsigned temperature(const hobject_t& oid, utime_t now, unsigned last = 0);
+
+  /// true if oid was accessed in the current interval
+  bool in_current(const hobject_t& oid, utime_t now);
+
+  /// true if an interval closed since the history was last archived
+  bool archive_pending() const {
+    return closed;
+  }
+  void archived() {
+    closed = false;
+  }
+
+  void clear() {
+    sets.clear();
+    closed = false;
+  }
+
+  /// encode the intervals, but not the parameters (those come from the pool)
+  void encode(bufferlist &bl) const;
+  /// replace the intervals with archived ones; sets of another type are dropped
+  void decode(bufferlist::iterator &bl);
+  void dump(Formatter *f) const;
+};
+WRITE_CLASS_ENCODER(HitSetHistory::Interval)
+WRITE_CLASS_ENCODER(HitSetHistory)
+
+#endif
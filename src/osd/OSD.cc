@@ -94,6 +94,7 @@
 #include "messages/MOSDPGPush.h"
 #include "messages/MOSDPGPushReply.h"
 #include "messages/MOSDPGPull.h"
+#include "messages/MOSDPGSnapTrim.h"
 
 #include "common/perf_counters.h"
 #include "common/Timer.h"
@@ -120,6 +121,7 @@
 
 #include "common/cmdparse.h"
 #include "include/str_list.h"
+#include "include/trace.h"
 
 #include "include/assert.h"
 #include "common/config.h"
@@ -173,16 +175,18 @@ OSDService::OSDService(OSD *osd) :
   logger(osd->logger),
   recoverystate_perf(osd->recoverystate_perf),
   monc(osd->monc),
-  op_wq(osd->op_wq),
+  op_wq(osd->op_shardedwq),
   peering_wq(osd->peering_wq),
   recovery_wq(osd->recovery_wq),
-  snap_trim_wq(osd->snap_trim_wq),
+  agent_wq(osd->agent_wq),
   scrub_wq(osd->scrub_wq),
   scrub_finalize_wq(osd->scrub_finalize_wq),
   rep_scrub_wq(osd->rep_scrub_wq),
   push_wq("push_wq", cct->_conf->osd_recovery_thread_timeout, &osd->recovery_tp),
   class_handler(osd->class_handler),
   publish_lock("OSDService::publish_lock"),
+  osdmap_seq(1),
+  osdmap_slots_lock("OSDService::osdmap_slots_lock"),
   pre_publish_lock("OSDService::pre_publish_lock"),
   sched_scrub_lock("OSDService::sched_scrub_lock"), scrubs_pending(0),
   scrubs_active(0),
@@ -194,6 +198,7 @@ OSDService::OSDService(OSD *osd) :
   objecter_dispatcher(this),
   watch_lock("OSD::watch_lock"),
   watch_timer(osd->client_messenger->cct, watch_lock),
+  notify_finisher(osd->client_messenger->cct),
   next_notif_id(0),
   backfill_request_lock("OSD::backfill_request_lock"),
   backfill_request_timer(cct, backfill_request_lock, false),
@@ -202,6 +207,11 @@ OSDService::OSDService(OSD *osd) :
   reserver_finisher(cct),
   local_reserver(&reserver_finisher, cct->_conf->osd_max_backfills),
   remote_reserver(&reserver_finisher, cct->_conf->osd_max_backfills),
+  recovery_budget(cct),
+  scrub_budget(cct, NULL, &md_config_t::osd_scrub_max_bytes_per_sec),
+  snap_trim_budget(cct, &md_config_t::osd_snap_trim_max_objects_per_sec, NULL),
+  agent_budget(cct, &md_config_t::osd_agent_max_ops_per_sec, NULL),
+  obc_cache(cct->_conf->osd_obc_cache_max_bytes, osd->logger),
   pg_temp_lock("OSDService::pg_temp_lock"),
   map_cache_lock("OSDService::map_lock"),
   map_cache(cct->_conf->osd_map_cache_size),
@@ -217,11 +227,78 @@ OSDService::OSDService(OSD *osd) :
 #ifdef PG_DEBUG_REFS
   , pgid_lock("OSDService::pgid_lock")
 #endif
-{}
+{
+  int r = pthread_key_create(&osdmap_slot_key, osdmap_slot_release);
+  assert(r == 0);
+}
 
 OSDService::~OSDService()
 {
   delete objecter;
+  pthread_key_delete(osdmap_slot_key);
+  for (set<OSDMapSlot*>::iterator p = osdmap_slots.begin();
+       p != osdmap_slots.end();
+       ++p) {
+    pthread_spin_destroy(&(*p)->lock);
+    delete *p;
+  }
+}
+
+void OSDService::osdmap_slot_release(void *p)
+{
+  OSDMapSlot *slot = static_cast<OSDMapSlot*>(p);
+  {
+    Mutex::Locker l(slot->service->osdmap_slots_lock);
+    slot->service->osdmap_slots.erase(slot);
+  }
+  pthread_spin_destroy(&slot->lock);
+  delete slot;
+}
+
+OSDService::OSDMapSlot *OSDService::get_osdmap_slot()
+{
+  OSDMapSlot *slot =
+    static_cast<OSDMapSlot*>(pthread_getspecific(osdmap_slot_key));
+  if (!slot) {
+    slot = new OSDMapSlot;
+    slot->service = this;
+    pthread_spin_init(&slot->lock, PTHREAD_PROCESS_PRIVATE);
+    slot->seq = 0;
+    {
+      Mutex::Locker l(osdmap_slots_lock);
+      osdmap_slots.insert(slot);
+    }
+    pthread_setspecific(osdmap_slot_key, slot);
+  }
+  return slot;
+}
+
+OSDMapRef OSDService::get_osdmap()
+{
+  OSDMapSlot *slot = get_osdmap_slot();
+  pthread_spin_lock(&slot->lock);
+  if (slot->seq != osdmap_seq.read()) {
+    Mutex::Locker l(publish_lock);
+    slot->map = osdmap;
+    slot->seq = osdmap_seq.read();
+  }
+  OSDMapRef ret = slot->map;
+  pthread_spin_unlock(&slot->lock);
+  return ret;
+}
+
+/// drop the references other threads still hold to old maps
+void OSDService::clear_osdmap_slots()
+{
+  Mutex::Locker l(osdmap_slots_lock);
+  for (set<OSDMapSlot*>::iterator p = osdmap_slots.begin();
+       p != osdmap_slots.end();
+       ++p) {
+    pthread_spin_lock(&(*p)->lock);
+    (*p)->map = OSDMapRef();
+    (*p)->seq = 0;
+    pthread_spin_unlock(&(*p)->lock);
+  }
 }
 
 void OSDService::_start_split(pg_t parent, const set<pg_t> &children)
@@ -407,6 +484,7 @@ void OSDService::shutdown()
     Mutex::Locker l(watch_lock);
     watch_timer.shutdown();
   }
+  notify_finisher.stop();
 
   {
     Mutex::Locker l(objecter_lock);
@@ -420,7 +498,8 @@ void OSDService::shutdown()
     Mutex::Locker l(backfill_request_lock);
     backfill_request_timer.shutdown();
   }
-  osdmap = OSDMapRef();
+  publish_map(OSDMapRef());
+  clear_osdmap_slots();
   next_osdmap = OSDMapRef();
 }
 
@@ -437,6 +516,7 @@ void OSDService::init()
     objecter->unset_honor_cache_redirects();
   }
   watch_timer.init();
+  notify_finisher.start();
 }
 
 ObjectStore *OSD::create_object_store(CephContext *cct, const std::string &dev, const std::string &jdev)
@@ -449,7 +529,7 @@ ObjectStore *OSD::create_object_store(CephContext *cct, const std::string &dev,
     return new FileStore(dev, jdev);
 
   if (S_ISDIR(st.st_mode))
-    return new FileStore(dev, jdev);
+    return ObjectStore::create(cct->_conf->osd_objectstore, dev, jdev);
   else
     return 0;
 }
@@ -867,6 +947,10 @@ OSD::OSD(CephContext *cct_, int id, Messenger *internal_messenger, Messenger *ex
   osd_compat(get_osd_compat_set()),
   state(STATE_INITIALIZING), boot_epoch(0), up_epoch(0), bind_epoch(0),
   op_tp(cct, "OSD::op_tp", cct->_conf->osd_op_threads, "osd_op_threads"),
+  peering_tp(cct, "OSD::peering_tp", cct->_conf->osd_peering_threads,
+	     "osd_peering_threads"),
+  osd_op_tp(cct, "OSD::osd_op_tp",
+    cct->_conf->osd_op_num_threads_per_shard * cct->_conf->osd_op_num_shards),
   recovery_tp(cct, "OSD::recovery_tp", cct->_conf->osd_recovery_threads, "osd_recovery_threads"),
   disk_tp(cct, "OSD::disk_tp", cct->_conf->osd_disk_threads, "osd_disk_threads"),
   command_tp(cct, "OSD::command_tp", 1),
@@ -880,10 +964,12 @@ OSD::OSD(CephContext *cct_, int id, Messenger *internal_messenger, Messenger *ex
   heartbeat_dispatcher(this),
   stat_lock("OSD::stat_lock"),
   finished_lock("OSD::finished_lock"),
-  op_tracker(cct),
+  op_tracker(cct, cct->_conf->osd_num_op_tracker_shard),
   test_ops_hook(NULL),
-  op_wq(this, cct->_conf->osd_op_thread_timeout, &op_tp),
-  peering_wq(this, cct->_conf->osd_op_thread_timeout, &op_tp),
+  op_shardedwq(cct->_conf->osd_op_num_shards, this,
+    cct->_conf->osd_op_thread_timeout, cct->_conf->osd_op_thread_timeout * 10,
+    &osd_op_tp),
+  peering_wq(this, cct->_conf->osd_op_thread_timeout, &peering_tp),
   map_lock("OSD::map_lock"),
   peer_map_epoch_lock("OSD::peer_map_epoch_lock"),
   debug_drop_pg_create_probability(cct->_conf->osd_debug_drop_pg_create_probability),
@@ -898,7 +984,7 @@ OSD::OSD(CephContext *cct_, int id, Messenger *internal_messenger, Messenger *ex
   recovery_ops_active(0),
   recovery_wq(this, cct->_conf->osd_recovery_thread_timeout, &recovery_tp),
   replay_queue_lock("OSD::replay_queue_lock"),
-  snap_trim_wq(this, cct->_conf->osd_snap_trim_thread_timeout, &disk_tp),
+  agent_wq(this, cct->_conf->osd_agent_thread_timeout, &disk_tp),
   scrub_wq(this, cct->_conf->osd_scrub_thread_timeout, &disk_tp),
   scrub_finalize_wq(cct->_conf->osd_scrub_finalize_thread_timeout, &op_tp),
   rep_scrub_wq(this, cct->_conf->osd_scrub_thread_timeout, &disk_tp),
@@ -985,7 +1071,7 @@ bool OSD::asok_command(string command, cmdmap_t& cmdmap, string format,
     op_tracker.dump_historic_ops(f);
   } else if (command == "dump_op_pq_state") {
     f->open_object_section("pq");
-    op_wq.dump(f);
+    op_shardedwq.dump(f);
     f->close_section();
   } else if (command == "dump_blacklist") {
     list<pair<entity_addr_t,utime_t> > bl;
@@ -1209,6 +1295,8 @@ int OSD::init()
   monc->set_log_client(&clog);
 
   op_tp.start();
+  peering_tp.start();
+  osd_op_tp.start();
   recovery_tp.start();
   disk_tp.start();
   command_tp.start();
@@ -1373,10 +1461,14 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(l_osd_op_r,      "op_r");        // client reads
   osd_plb.add_u64_counter(l_osd_op_r_outb, "op_r_out_bytes");   // client read out bytes
   osd_plb.add_time_avg(l_osd_op_r_lat,  "op_r_latency");    // client read latency
+  osd_plb.add_time_size_histogram(l_osd_op_r_lat_outb_hist,
+				  "op_r_latency_out_bytes_histogram"); // by read size
   osd_plb.add_u64_counter(l_osd_op_w,      "op_w");        // client writes
   osd_plb.add_u64_counter(l_osd_op_w_inb,  "op_w_in_bytes");    // client write in bytes
   osd_plb.add_time_avg(l_osd_op_w_rlat, "op_w_rlat");   // client write readable/applied latency
   osd_plb.add_time_avg(l_osd_op_w_lat,  "op_w_latency");    // client write latency
+  osd_plb.add_time_size_histogram(l_osd_op_w_lat_inb_hist,
+				  "op_w_latency_in_bytes_histogram"); // by write size
   osd_plb.add_u64_counter(l_osd_op_rw,     "op_rw");       // client rmw
   osd_plb.add_u64_counter(l_osd_op_rw_inb, "op_rw_in_bytes");   // client rmw in bytes
   osd_plb.add_u64_counter(l_osd_op_rw_outb,"op_rw_out_bytes");  // client rmw out bytes
@@ -1390,6 +1482,8 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(l_osd_sop_w,     "subop_w");          // replicated (client) writes
   osd_plb.add_u64_counter(l_osd_sop_w_inb, "subop_w_in_bytes");      // replicated write in bytes
   osd_plb.add_time_avg(l_osd_sop_w_lat, "subop_w_latency");      // replicated write latency
+  osd_plb.add_u64_counter(l_osd_sop_w_batch, "subop_w_batch");  // batched replicated write messages sent
+  osd_plb.add_u64_counter(l_osd_sop_w_batch_ops, "subop_w_batch_ops");  // writes shipped in them
   osd_plb.add_u64_counter(l_osd_sop_pull,     "subop_pull");       // pull request
   osd_plb.add_time_avg(l_osd_sop_pull_lat, "subop_pull_latency");
   osd_plb.add_u64_counter(l_osd_sop_push,     "subop_push");       // push (write)
@@ -1399,6 +1493,7 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(l_osd_pull,      "pull");       // pull requests sent
   osd_plb.add_u64_counter(l_osd_push,      "push");       // push messages
   osd_plb.add_u64_counter(l_osd_push_outb, "push_out_bytes");  // pushed bytes
+  osd_plb.add_u64_counter(l_osd_push_delta, "push_delta");  // pushes of only the changed extents
 
   osd_plb.add_u64_counter(l_osd_push_in,    "push_in");        // inbound push messages
   osd_plb.add_u64_counter(l_osd_push_inb,   "push_in_bytes");  // inbound pushed bytes
@@ -1424,6 +1519,29 @@ void OSD::create_logger()
   osd_plb.add_u64(l_osd_stat_bytes_used, "stat_bytes_used");
   osd_plb.add_u64(l_osd_stat_bytes_avail, "stat_bytes_avail");
 
+  osd_plb.add_u64_counter(l_osd_obc_cache_hit, "obc_cache_hit");
+  osd_plb.add_u64_counter(l_osd_obc_cache_miss, "obc_cache_miss"); // decoded from xattrs
+  osd_plb.add_u64_counter(l_osd_obc_cache_evict, "obc_cache_evict");
+  osd_plb.add_u64(l_osd_obc_cache_bytes, "obc_cache_bytes");
+
+  osd_plb.add_u64(l_osd_pg_log_bytes, "pg_log_bytes");  // pg log entries in memory
+
+  osd_plb.add_u64_counter(l_osd_object_pool_hit, "object_pool_hit");   // ops, replies, transactions... reused
+  osd_plb.add_u64_counter(l_osd_object_pool_miss, "object_pool_miss"); // ... allocated from the heap
+  osd_plb.add_u64(l_osd_object_pool_bytes, "object_pool_bytes");       // free pooled objects
+
+  osd_plb.add_u64_counter(l_osd_agent_flush, "agent_flush");  // dirty objects written back to the base pool
+  osd_plb.add_u64_counter(l_osd_agent_evict, "agent_evict");  // clean objects dropped from the cache
+  osd_plb.add_u64(l_osd_agent_ops, "agent_ops");              // flushes and evictions in flight
+
+  osd_plb.add_u64_counter(l_osd_tier_proxy_read, "tier_proxy_read");  // cache misses read from the base pool
+  osd_plb.add_u64_counter(l_osd_tier_promote, "tier_promote");        // objects copied up from the base pool
+
+  osd_plb.add_u64_counter(l_osd_notify, "notify");                // notifies started
+  osd_plb.add_u64_counter(l_osd_notify_sent, "notify_sent");      // ... messages sent to watchers for them
+  osd_plb.add_u64_counter(l_osd_notify_timeout, "notify_timeout"); // ... given up on waiting for acks
+  osd_plb.add_time_avg(l_osd_notify_lat, "notify_latency");       // ... start to completion
+
   logger = osd_plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -1480,6 +1598,8 @@ void OSD::suicide(int exitcode)
 
   derr << " pausing thread pools" << dendl;
   op_tp.pause();
+  peering_tp.pause();
+  osd_op_tp.pause();
   disk_tp.pause();
   recovery_tp.pause();
   command_tp.pause();
@@ -1528,7 +1648,7 @@ int OSD::shutdown()
   }
   
   // finish ops
-  op_wq.drain(); // should already be empty except for lagard PGs
+  op_shardedwq.drain(); // should already be empty except for lagard PGs
   {
     Mutex::Locker l(finished_lock);
     finished.clear(); // zap waiters (bleh, this is messy)
@@ -1569,6 +1689,14 @@ int OSD::shutdown()
   op_tp.stop();
   dout(10) << "op tp stopped" << dendl;
 
+  peering_tp.drain();
+  peering_tp.stop();
+  dout(10) << "peering tp stopped" << dendl;
+
+  osd_op_tp.drain();
+  osd_op_tp.stop();
+  dout(10) << "osd op tp stopped" << dendl;
+
   command_tp.drain();
   command_tp.stop();
   dout(10) << "command tp stopped" << dendl;
@@ -1922,6 +2050,21 @@ PG *OSD::_lookup_lock_pg_with_map_lock_held(pg_t pgid)
   return pg;
 }
 
+struct C_ReadPGState : public GenContext<ThreadPool::TPHandle&> {
+  ObjectStore *store;
+  PG *pg;
+  bufferlist bl;
+  C_ReadPGState(ObjectStore *store, PG *pg, bufferlist& b)
+    : store(store), pg(pg) {
+    bl.claim(b);
+  }
+  void finish(ThreadPool::TPHandle &handle) {
+    pg->lock();
+    pg->read_state(store, bl);
+    pg->unlock();
+  }
+};
+
 void OSD::load_pgs()
 {
   assert(osd_lock.is_locked());
@@ -1965,7 +2108,11 @@ void OSD::load_pgs()
     dout(10) << "load_pgs ignoring unrecognized " << *it << dendl;
   }
 
-  bool has_upgraded = false;
+  // open the pgs first, then read their state (info, log, missing)
+  // from the store in parallel: that is what takes the time on a big
+  // osd, and the pgs are independent of each other.
+  list<pair<PG*, interval_set<snapid_t> > > loaded;
+  list<C_ReadPGState*> to_read;
   for (map<pg_t, interval_set<snapid_t> >::iterator i = pgs.begin();
        i != pgs.end();
        ++i) {
@@ -1994,9 +2141,44 @@ void OSD::load_pgs()
     epoch_t map_epoch = PG::peek_map_epoch(store, coll_t(pgid), service.infos_oid, &bl);
 
     PG *pg = _open_lock_pg(map_epoch == 0 ? osdmap : service.get_map(map_epoch), pgid);
+    pg->unlock();
+    loaded.push_back(make_pair(pg, i->second));
+    to_read.push_back(new C_ReadPGState(store, pg, bl));
+  }
+
+  // read pg state, log
+  int threads = cct->_conf->osd_load_pgs_threads;
+  if (threads > (int)to_read.size())
+    threads = to_read.size();
+  dout(10) << __func__ << " reading state of " << to_read.size() << " pgs with "
+	   << threads << " threads" << dendl;
+  if (threads > 1) {
+    ThreadPool load_tp(cct, "OSD::load_tp", threads);
+    GenContextWQ load_wq("OSD::load_wq", cct->_conf->osd_op_thread_timeout,
+			 &load_tp);
+    load_tp.start();
+    for (list<C_ReadPGState*>::iterator p = to_read.begin();
+	 p != to_read.end();
+	 ++p)
+      load_wq.queue(*p);
+    load_tp.drain();
+    load_tp.stop();
+  } else {
+    ThreadPool::TPHandle handle(cct, NULL, 0, 0);
+    for (list<C_ReadPGState*>::iterator p = to_read.begin();
+	 p != to_read.end();
+	 ++p)
+      (*p)->complete(handle);
+  }
+  to_read.clear();
 
-    // read pg state, log
-    pg->read_state(store, bl);
+  bool has_upgraded = false;
+  for (list<pair<PG*, interval_set<snapid_t> > >::iterator i = loaded.begin();
+       i != loaded.end();
+       ++i) {
+    PG *pg = i->first;
+    pg_t pgid = pg->info.pgid;
+    pg->lock();
 
     if (pg->must_upgrade()) {
       if (!has_upgraded) {
@@ -2899,7 +3081,11 @@ void OSD::heartbeat_entry()
   while (!heartbeat_stop) {
     heartbeat();
 
-    double wait = .5 + ((float)(rand() % 10)/10.0) * (float)cct->_conf->osd_heartbeat_interval;
+    double wait;
+    if (cct->_conf->osd_heartbeat_interval < 1.0)
+      wait = cct->_conf->osd_heartbeat_interval;  // sub-second detection
+    else
+      wait = .5 + ((float)(rand() % 10)/10.0) * (float)cct->_conf->osd_heartbeat_interval;
     utime_t w;
     w.set_from_double(wait);
     dout(30) << "heartbeat_entry sleeping for " << wait << dendl;
@@ -2998,6 +3184,12 @@ void OSD::heartbeat()
   dout(30) << "heartbeat check" << dendl;
   heartbeat_check();
 
+  // report failures now rather than at the next mon report; with a
+  // sub-second heartbeat interval and grace this is what makes
+  // detection fast.
+  if (is_active())
+    _send_failures(service.get_osdmap());
+
   logger->set(l_osd_hb_to, heartbeat_peers.size());
   logger->set(l_osd_hb_from, 0);
   
@@ -3132,6 +3324,22 @@ void OSD::tick()
 
   check_ops_in_flight();
 
+  uint64_t client_ops;
+  double client_latency = op_tracker.take_client_latency(&client_ops);
+  service.recovery_budget.update(client_latency, client_ops);
+  service.scrub_budget.update(client_latency, client_ops);
+  service.snap_trim_budget.update(client_latency, client_ops);
+  service.agent_budget.update(client_latency, client_ops);
+
+  logger->set(l_osd_pg_log_bytes, service.pg_log_bytes.read());
+  logger->set(l_osd_agent_ops, service.agent_ops.read());
+
+  ObjectPool::stats_t pool_stats;
+  ObjectPool::get_total_stats(&pool_stats);
+  logger->set(l_osd_object_pool_hit, pool_stats.hits);
+  logger->set(l_osd_object_pool_miss, pool_stats.misses);
+  logger->set(l_osd_object_pool_bytes, pool_stats.cached_bytes);
+
   tick_timer.add_event_after(1.0, new C_Tick(this));
 }
 
@@ -3281,6 +3489,7 @@ void TestOpsSocketHook::test_ops(OSDService *service, ObjectStore *store,
 // =========================================
 bool remove_dir(
   CephContext *cct,
+  OSDService *service,
   ObjectStore *store, SnapMapper *mapper,
   OSDriver *osdriver,
   ObjectStore::Sequencer *osr,
@@ -3310,12 +3519,15 @@ bool remove_dir(
 	assert(0);
       }
       t->remove(coll, *i);
-      if (num >= cct->_conf->osd_target_transaction_size) {
+      if (num >= cct->_conf->osd_remove_transaction_size) {
 	C_SaferCond waiter;
 	store->queue_transaction(osr, t, &waiter);
 	bool cont = dstate->pause_clearing();
 	handle.suspend_tp_timeout();
 	waiter.wait();
+	// the removes are background work like recovery; don't queue the
+	// next batch before the budget allows for this one
+	service->wait_for_remove_budget(handle, num);
 	handle.reset_tp_timeout();
 	if (cont)
 	  cont = dstate->resume_clearing();
@@ -3360,7 +3572,7 @@ void OSD::RemoveWQ::_process(
        i != colls_to_remove.end();
        ++i) {
     bool cont = remove_dir(
-      pg->cct, store, &mapper, &driver, pg->osr.get(), *i, item.second,
+      pg->cct, pg->osd, store, &mapper, &driver, pg->osr.get(), *i, item.second,
       handle);
     if (!cont)
       return;
@@ -3651,6 +3863,31 @@ pair<ConnectionRef,ConnectionRef> OSDService::get_con_osd_hb(int peer, epoch_t f
   return ret;
 }
 
+void OSDService::wait_for_budget(RecoveryBudget &budget,
+				 ThreadPool::TPHandle &handle,
+				 uint64_t nops)
+{
+  utime_t next;
+  utime_t now = ceph_clock_now(cct);
+  while (!budget.available(now, &next) && !is_stopping()) {
+    utime_t wait(1, 0);
+    if (next > now && next - now < wait)
+      wait = next - now;
+    handle.reset_tp_timeout();
+    wait.sleep();
+    now = ceph_clock_now(cct);
+  }
+  budget.charge(nops, 0);
+}
+
+bool OSDService::agent_can_start()
+{
+  if ((int)agent_ops.read() >= cct->_conf->osd_agent_max_ops)
+    return false;
+  utime_t next;
+  return agent_budget.available(ceph_clock_now(cct), &next);
+}
+
 void OSDService::queue_want_pg_temp(pg_t pgid, vector<int>& want)
 {
   Mutex::Locker l(pg_temp_lock);
@@ -3671,21 +3908,36 @@ void OSDService::send_pg_temp()
 void OSD::send_failures()
 {
   assert(osd_lock.is_locked());
-  bool locked = false;
-  if (!failure_queue.empty()) {
-    heartbeat_lock.Lock();
-    locked = true;
-  }
+  Mutex::Locker l(heartbeat_lock);
+  _send_failures(osdmap);
+}
+
+void OSD::_send_failures(OSDMapRef curmap)
+{
+  assert(heartbeat_lock.is_locked());
+  if (failure_queue.empty())
+    return;
+
+  // a mon that understands it takes all of our reports in one message
+  bool batch = monc->get_mon_features() & CEPH_FEATURE_OSD_FAILURE_BATCH;
   utime_t now = ceph_clock_now(cct);
+  MOSDFailure *m = NULL;
   while (!failure_queue.empty()) {
     int osd = failure_queue.begin()->first;
     int failed_for = (int)(double)(now - failure_queue.begin()->second);
-    entity_inst_t i = osdmap->get_inst(osd);
-    monc->send_mon_message(new MOSDFailure(monc->get_fsid(), i, failed_for, osdmap->get_epoch()));
+    entity_inst_t i = curmap->get_inst(osd);
+    if (m && batch) {
+      m->more.push_back(make_pair(i, failed_for));
+    } else {
+      if (m)
+	monc->send_mon_message(m);
+      m = new MOSDFailure(monc->get_fsid(), i, failed_for, curmap->get_epoch());
+    }
     failure_pending[osd] = i;
     failure_queue.erase(osd);
   }
-  if (locked) heartbeat_lock.Unlock();
+  dout(10) << __func__ << " " << *m << dendl;
+  monc->send_mon_message(m);
 }
 
 void OSD::send_still_alive(epoch_t epoch, const entity_inst_t &i)
@@ -3893,6 +4145,12 @@ COMMAND("pg " \
 	"name=offset,type=CephString,req=false",
 	"list missing objects on this pg, perhaps starting at an offset given in JSON",
 	"osd", "r", "cli")
+COMMAND("pg " \
+	"name=pgid,type=CephPgid " \
+	"name=cmd,type=CephChoices,strings=hit_set_query " \
+	"name=object,type=CephString,req=false",
+	"show the hit sets of this cache pg, and how often an object was in them",
+	"osd", "r", "cli")
 
 // new form: tell <pgid> <cmd> for both cli and rest 
 
@@ -3906,6 +4164,10 @@ COMMAND("list_missing " \
 	"name=offset,type=CephString,req=false",
 	"list missing objects on this pg, perhaps starting at an offset given in JSON",
 	"osd", "r", "cli,rest")
+COMMAND("hit_set_query " \
+	"name=object,type=CephString,req=false",
+	"show the hit sets of this cache pg, and how often an object was in them",
+	"osd", "r", "cli,rest")
 
 // tell <osd.n> commands.  Validation of osd.n must be special-cased in client
 
@@ -4039,7 +4301,8 @@ void OSD::do_command(Connection *con, tid_t tid, vector<string>& cmd, bufferlist
 	   (cmd_getval(cct, cmdmap, "pgid", pgidstr) &&
 	     (prefix == "query" ||
 	      prefix == "mark_unfound_lost" ||
-	      prefix == "list_missing")
+	      prefix == "list_missing" ||
+	      prefix == "hit_set_query")
 	   )) {
     pg_t pgid;
 
@@ -4419,6 +4682,45 @@ bool OSDService::ObjecterDispatcher::ms_get_authorizer(int dest_type,
 }
 
 
+/*
+ * client and replica ops come straight from the messenger's reader,
+ * skipping the DispatchQueue thread.  they still need osd_lock to be
+ * routed to their PG against the current map.
+ */
+void OSD::ms_fast_dispatch(Message *m)
+{
+  osd_lock.Lock();
+  if (is_stopping()) {
+    osd_lock.Unlock();
+    m->put();
+    return;
+  }
+
+  while (dispatch_running) {
+    dout(10) << "ms_fast_dispatch waiting for other dispatch thread to complete" << dendl;
+    dispatch_cond.Wait(osd_lock);
+  }
+  dispatch_running = true;
+
+  // ops woken up by a new map must go ahead of this one
+  do_waiters();
+
+  OpRequestRef op = op_tracker.create_request<OpRequest>(m);
+  op->mark_event("waiting_for_osdmap");
+  if (!osdmap) {
+    dout(7) << "no OSDMap, not booted" << dendl;
+    waiting_for_osdmap.push_back(op);
+  } else {
+    dispatch_op(op);
+  }
+  do_waiters();
+
+  dispatch_running = false;
+  dispatch_cond.Signal();
+
+  osd_lock.Unlock();
+}
+
 bool OSD::ms_dispatch(Message *m)
 {
   if (m->get_type() == MSG_OSD_MARK_ME_DOWN) {
@@ -5076,6 +5378,8 @@ void OSD::handle_osd_map(MOSDMap *m)
       bufferlist& bl = p->second;
       
       o->decode(bl);
+      if (cct->_conf->osd_map_precompute_pg_mappings)
+	o->precompute_pg_mappings();
       pinned_maps.push_back(add_map(o));
 
       hobject_t fulloid = get_osdmap_pobject_name(e);
@@ -5094,10 +5398,10 @@ void OSD::handle_osd_map(MOSDMap *m)
 
       OSDMap *o = new OSDMap;
       if (e > 1) {
-	bufferlist obl;
+	// start from a copy sharing the previous epoch's members;
+	// apply_incremental only copies the ones it changes
 	OSDMapRef prev = get_map(e - 1);
-	prev->encode(obl);
-	o->decode(obl);
+	*o = *prev;
       }
 
       OSDMap::Incremental inc;
@@ -5107,6 +5411,8 @@ void OSD::handle_osd_map(MOSDMap *m)
 	derr << "ERROR: bad fsid?  i have " << osdmap->get_fsid() << " and inc has " << inc.fsid << dendl;
 	assert(0 == "bad fsid");
       }
+      if (cct->_conf->osd_map_precompute_pg_mappings)
+	o->precompute_pg_mappings();
 
       pinned_maps.push_back(add_map(o));
 
@@ -5631,15 +5937,65 @@ bool OSDService::get_inc_map_bl(epoch_t e, bufferlist& bl)
   return found;
 }
 
+/**
+ * Consecutive full maps mostly encode the same bytes at the same
+ * offsets.  Share the pages of bl that match the cached previous epoch
+ * with it, and copy the rest into buffers of their own, so that the
+ * cache holds each unchanged page once rather than once per epoch.
+ */
+void OSDService::_dedup_map_bl(epoch_t e, bufferlist& bl)
+{
+  const unsigned chunk = CEPH_PAGE_SIZE;
+  if (!cct->_conf->osd_map_dedup_bl || e == 0 ||
+      bl.length() < 16 * chunk)
+    return;
+  bufferlist prev;
+  if (!map_bl_cache.lookup(e - 1, &prev))
+    return;
+
+  bufferlist out;
+  unsigned shared = 0;
+  bufferlist::iterator p = bl.begin();
+  const list<bufferptr> &theirs = prev.buffers();
+  list<bufferptr>::const_iterator q = theirs.begin();
+  unsigned qoff = 0;  // offset of off into *q
+  for (unsigned off = 0; off < bl.length(); ) {
+    unsigned len = MIN(chunk, bl.length() - off);
+    bufferptr mine;
+    p.copy(len, mine);
+    while (q != theirs.end() && qoff >= q->length()) {
+      qoff -= q->length();
+      ++q;
+    }
+    if (q != theirs.end() && qoff + len <= q->length() &&
+	memcmp(mine.c_str(), q->c_str() + qoff, len) == 0) {
+      out.append(bufferptr(*q, qoff, len));
+      shared += len;
+    } else {
+      out.append(mine);
+    }
+    qoff += len;
+    off += len;
+  }
+  dout(20) << __func__ << " " << e << " shares " << shared << " of "
+	   << bl.length() << " bytes with " << (e - 1) << dendl;
+  if (shared)
+    bl.swap(out);
+}
+
 void OSDService::_add_map_bl(epoch_t e, bufferlist& bl)
 {
   dout(10) << "add_map_bl " << e << " " << bl.length() << " bytes" << dendl;
-  map_bl_cache.add(e, bl);
+  bufferlist cached(bl);
+  _dedup_map_bl(e, cached);
+  cached.reassign_to_mempool(mempool::mempool_osdmap_bl);
+  map_bl_cache.add(e, cached);
 }
 
 void OSDService::_add_map_inc_bl(epoch_t e, bufferlist& bl)
 {
   dout(10) << "add_map_inc_bl " << e << " " << bl.length() << " bytes" << dendl;
+  bl.reassign_to_mempool(mempool::mempool_osdmap_bl);
   map_bl_inc_cache.add(e, bl);
 }
 
@@ -5652,7 +6008,9 @@ void OSDService::pin_map_inc_bl(epoch_t e, bufferlist &bl)
 void OSDService::pin_map_bl(epoch_t e, bufferlist &bl)
 {
   Mutex::Locker l(map_cache_lock);
-  map_bl_cache.pin(e, bl);
+  bufferlist cached(bl);
+  _dedup_map_bl(e, cached);
+  map_bl_cache.pin(e, cached);
 }
 
 void OSDService::clear_map_bl_cache_pins(epoch_t e)
@@ -5679,25 +6037,53 @@ OSDMapRef OSDService::_add_map(OSDMap *o)
 
 OSDMapRef OSDService::try_get_map(epoch_t epoch)
 {
-  Mutex::Locker l(map_cache_lock);
-  OSDMapRef retval = map_cache.lookup(epoch);
-  if (retval) {
-    dout(30) << "get_map " << epoch << " -cached" << dendl;
-    return retval;
+  // most callers want the map we just published
+  OSDMapRef cur = get_osdmap();
+  if (cur && cur->get_epoch() == epoch)
+    return cur;
+
+  {
+    Mutex::Locker l(map_cache_lock);
+    OSDMapRef retval = map_cache.lookup(epoch);
+    if (retval) {
+      dout(30) << "get_map " << epoch << " -cached" << dendl;
+      return retval;
+    }
   }
 
+  // read and decode without map_cache_lock: after a big map change
+  // every peering thread walks its pgs through the same epochs, and
+  // they should not queue up behind one decode
   OSDMap *map = new OSDMap;
   if (epoch > 0) {
     dout(20) << "get_map " << epoch << " - loading and decoding " << map << dendl;
     bufferlist bl;
-    if (!_get_map_bl(epoch, bl)) {
-      delete map;
-      return OSDMapRef();
+    bool found;
+    {
+      Mutex::Locker l(map_cache_lock);
+      found = map_bl_cache.lookup(epoch, &bl);
+    }
+    if (!found) {
+      found = store->read(
+	coll_t::META_COLL, OSD::get_osdmap_pobject_name(epoch), 0, 0, bl) >= 0;
+      if (!found) {
+	delete map;
+	return OSDMapRef();
+      }
+      add_map_bl(epoch, bl);
     }
     map->decode(bl);
   } else {
     dout(20) << "get_map " << epoch << " - return initial " << map << dendl;
   }
+
+  Mutex::Locker l(map_cache_lock);
+  OSDMapRef retval = map_cache.lookup(epoch);
+  if (retval) {
+    // somebody else beat us to it
+    delete map;
+    return retval;
+  }
   return _add_map(map);
 }
 
@@ -6727,6 +7113,11 @@ bool OSD::_recover_now()
     dout(15) << "_recover_now defer until " << defer_recovery_until << dendl;
     return false;
   }
+  utime_t next;
+  if (!service.recovery_budget.available(ceph_clock_now(cct), &next)) {
+    dout(15) << "_recover_now out of budget until " << next << dendl;
+    return false;
+  }
 
   return true;
 }
@@ -6768,6 +7159,7 @@ void OSD::do_recovery(PG *pg, ThreadPool::TPHandle &handle)
     int started;
     bool more = pg->start_recovery_ops(max, &rctx, handle, &started);
     dout(10) << "do_recovery started " << started << "/" << max << " on " << *pg << dendl;
+    service.recovery_budget.charge(started, 0);
 
     /*
      * if we couldn't start any recovery ops and things are still
@@ -7083,83 +7475,215 @@ void OSD::enqueue_op(PG *pg, OpRequestRef op)
 	   << " cost " << op->get_req()->get_cost()
 	   << " latency " << latency
 	   << " " << *(op->get_req()) << dendl;
+  CEPH_TRACE3(osd_enqueue_op, op->get_seq(),
+	      op->get_req()->get_source().num(), op->get_req()->get_tid());
   pg->queue_op(op);
 }
 
-void OSD::OpWQ::_enqueue(pair<PGRef, OpRequestRef> item)
+void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
+{
+  uint32_t shard_index = thread_index % num_shards;
+
+  ShardData *sdata = shard_list[shard_index];
+  assert(NULL != sdata);
+  sdata->sdata_op_ordering_lock.Lock();
+  utime_t now = ceph_clock_now(osd->cct);
+  utime_t next, recovery_next;
+  _release_waiting(sdata, now, &recovery_next);
+  if (!sdata->pqueue->can_dequeue(now, &next)) {
+    // nothing queued, or only ops held back by the scheduler or the
+    // recovery and snap trim budgets; wait no longer than until the first is due
+    utime_t wait(2, 0);
+    if (!next.is_zero() && next > now && next - now < wait)
+      wait = next - now;
+    if (!recovery_next.is_zero() && recovery_next > now &&
+	recovery_next - now < wait)
+      wait = recovery_next - now;
+    // take sdata_lock before dropping the ordering lock so that an
+    // enqueue racing with us cannot signal before we are waiting
+    sdata->sdata_lock.Lock();
+    sdata->sdata_op_ordering_lock.Unlock();
+    osd->cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
+    sdata->sdata_cond.WaitInterval(osd->cct, sdata->sdata_lock, wait);
+    sdata->sdata_lock.Unlock();
+    sdata->sdata_op_ordering_lock.Lock();
+    now = ceph_clock_now(osd->cct);
+    _release_waiting(sdata, now, NULL);
+    if (!sdata->pqueue->can_dequeue(now, NULL)) {
+      sdata->sdata_op_ordering_lock.Unlock();
+      return;
+    }
+  }
+  pair<PGRef, OpRequestRef> item = sdata->pqueue->dequeue();
+  sdata->pg_for_processing[&*(item.first)].push_back(item.second);
+  sdata->sdata_op_ordering_lock.Unlock();
+  osd->logger->dec(l_osd_opq);
+  ThreadPool::TPHandle tp_handle(osd->cct, hb, timeout_interval,
+				 suicide_interval);
+
+  (item.first)->lock_suspend_timeout(tp_handle);
+
+  OpRequestRef op;
+  {
+    Mutex::Locker l(sdata->sdata_op_ordering_lock);
+    if (!sdata->pg_for_processing.count(&*(item.first))) {
+      (item.first)->unlock();
+      return;
+    }
+    assert(sdata->pg_for_processing[&*(item.first)].size());
+    op = sdata->pg_for_processing[&*(item.first)].front();
+    sdata->pg_for_processing[&*(item.first)].pop_front();
+    if (!(sdata->pg_for_processing[&*(item.first)].size()))
+      sdata->pg_for_processing.erase(&*(item.first));
+  }
+
+  osd->dequeue_op(item.first, op, tp_handle);
+  (item.first)->unlock();
+}
+
+mClockClientInfo OSD::ShardedOpWQ::mclock_client_info(
+  const entity_inst_t &inst, void *arg)
 {
-  unsigned priority = item.second->get_req()->get_priority();
-  unsigned cost = item.second->get_req()->get_cost();
+  ShardedOpWQ *wq = static_cast<ShardedOpWQ*>(arg);
+  md_config_t *conf = wq->osd->cct->_conf;
+  // ops are spread over the shards by pg, so each shard enforces its
+  // part of the configured per-osd rates
+  double shards = wq->num_shards;
+  if (inst.name.is_osd())
+    return mClockClientInfo(conf->osd_op_queue_mclock_osd_res / shards,
+			    conf->osd_op_queue_mclock_osd_wgt,
+			    conf->osd_op_queue_mclock_osd_lim / shards);
+  return mClockClientInfo(conf->osd_op_queue_mclock_client_res / shards,
+			  conf->osd_op_queue_mclock_client_wgt,
+			  conf->osd_op_queue_mclock_client_lim / shards);
+}
+
+bool OSD::ShardedOpWQ::is_recovery_op(Message *m)
+{
+  switch (m->get_type()) {
+  case MSG_OSD_PG_PUSH:
+  case MSG_OSD_PG_PULL:
+  case MSG_OSD_PG_SCAN:
+  case MSG_OSD_PG_BACKFILL:
+    return true;
+  case MSG_OSD_SUBOP: {
+    MOSDSubOp *op = static_cast<MOSDSubOp*>(m);
+    return op->ops.size() >= 1 &&
+      (op->ops[0].op.op == CEPH_OSD_OP_PUSH ||
+       op->ops[0].op.op == CEPH_OSD_OP_PULL);
+  }
+  default:
+    return false;
+  }
+}
+
+/**
+ * move waiting ops into the op queue as far as their budget allows
+ *
+ * @param next set to when more may be let in, if any are left waiting
+ */
+void OSD::ShardedOpWQ::_release(ShardData *sdata,
+				list<pair<PGRef, OpRequestRef> > &waiting,
+				RecoveryBudget &budget, utime_t now,
+				utime_t *next)
+{
+  assert(sdata->sdata_op_ordering_lock.is_locked());
+  while (!waiting.empty()) {
+    pair<PGRef, OpRequestRef> item = waiting.front();
+    if (!budget.get(item.second->get_req()->get_cost(), now, next))
+      return;
+    waiting.pop_front();
+    _enqueue_normal(sdata, item);
+  }
+}
+
+/// release recovery ops and snap trim passes; next is the earlier due time
+void OSD::ShardedOpWQ::_release_waiting(ShardData *sdata, utime_t now,
+					utime_t *next)
+{
+  utime_t snap_trim_next;
+  _release(sdata, sdata->recovery_waiting, osd->service.recovery_budget,
+	   now, next);
+  _release(sdata, sdata->snap_trim_waiting, osd->service.snap_trim_budget,
+	   now, next ? &snap_trim_next : NULL);
+  if (next && !snap_trim_next.is_zero() &&
+      (next->is_zero() || snap_trim_next < *next))
+    *next = snap_trim_next;
+}
+
+void OSD::ShardedOpWQ::_enqueue(pair<PGRef, OpRequestRef> item)
+{
+  ShardData *sdata = get_shard(&*(item.first));
+  assert(NULL != sdata);
+  sdata->sdata_op_ordering_lock.Lock();
+  if (is_recovery_op(item.second->get_req()) &&
+      osd->service.recovery_budget.is_limited())
+    sdata->recovery_waiting.push_back(item);
+  else if (item.second->get_req()->get_type() == MSG_OSD_PG_SNAPTRIM &&
+	   osd->service.snap_trim_budget.is_limited())
+    sdata->snap_trim_waiting.push_back(item);
+  else
+    _enqueue_normal(sdata, item);
+  sdata->sdata_op_ordering_lock.Unlock();
+  osd->logger->inc(l_osd_opq);
+
+  sdata->sdata_lock.Lock();
+  sdata->sdata_cond.SignalOne();
+  sdata->sdata_lock.Unlock();
+}
+
+void OSD::ShardedOpWQ::_enqueue_normal(ShardData *sdata,
+				       pair<PGRef, OpRequestRef> item)
+{
+  assert(sdata->sdata_op_ordering_lock.is_locked());
+  Message *m = item.second->get_req();
+  unsigned priority = m->get_priority();
+  unsigned cost = m->get_cost();
+  unsigned delta = 0, rho = 0;
+  if (m->get_type() == CEPH_MSG_OSD_OP) {
+    MOSDOp *op = static_cast<MOSDOp*>(m);
+    delta = op->get_qos_delta();
+    rho = op->get_qos_rho();
+  }
   if (priority >= CEPH_MSG_PRIO_LOW)
-    pqueue.enqueue_strict(
-      item.second->get_req()->get_source_inst(),
-      priority, item);
+    sdata->pqueue->enqueue_strict(m->get_source_inst(), priority, item);
+  else if (delta)
+    sdata->pqueue->enqueue_distributed(m->get_source_inst(), priority, cost,
+				       item, delta, rho);
   else
-    pqueue.enqueue(item.second->get_req()->get_source_inst(),
-      priority, cost, item);
-  osd->logger->set(l_osd_opq, pqueue.length());
+    sdata->pqueue->enqueue(m->get_source_inst(), priority, cost, item);
 }
 
-void OSD::OpWQ::_enqueue_front(pair<PGRef, OpRequestRef> item)
+void OSD::ShardedOpWQ::_enqueue_front(pair<PGRef, OpRequestRef> item)
 {
-  {
-    Mutex::Locker l(qlock);
-    if (pg_for_processing.count(&*(item.first))) {
-      pg_for_processing[&*(item.first)].push_front(item.second);
-      item.second = pg_for_processing[&*(item.first)].back();
-      pg_for_processing[&*(item.first)].pop_back();
-    }
+  ShardData *sdata = get_shard(&*(item.first));
+  assert(NULL != sdata);
+  sdata->sdata_op_ordering_lock.Lock();
+  if (sdata->pg_for_processing.count(&*(item.first))) {
+    sdata->pg_for_processing[&*(item.first)].push_front(item.second);
+    item.second = sdata->pg_for_processing[&*(item.first)].back();
+    sdata->pg_for_processing[&*(item.first)].pop_back();
   }
   unsigned priority = item.second->get_req()->get_priority();
   unsigned cost = item.second->get_req()->get_cost();
   if (priority >= CEPH_MSG_PRIO_LOW)
-    pqueue.enqueue_strict_front(
+    sdata->pqueue->enqueue_strict_front(
       item.second->get_req()->get_source_inst(),
       priority, item);
   else
-    pqueue.enqueue_front(item.second->get_req()->get_source_inst(),
+    sdata->pqueue->enqueue_front(item.second->get_req()->get_source_inst(),
       priority, cost, item);
-  osd->logger->set(l_osd_opq, pqueue.length());
-}
+  sdata->sdata_op_ordering_lock.Unlock();
+  osd->logger->inc(l_osd_opq);
 
-PGRef OSD::OpWQ::_dequeue()
-{
-  assert(!pqueue.empty());
-  PGRef pg;
-  {
-    Mutex::Locker l(qlock);
-    pair<PGRef, OpRequestRef> ret = pqueue.dequeue();
-    pg = ret.first;
-    pg_for_processing[&*pg].push_back(ret.second);
-  }
-  osd->logger->set(l_osd_opq, pqueue.length());
-  return pg;
+  sdata->sdata_lock.Lock();
+  sdata->sdata_cond.SignalOne();
+  sdata->sdata_lock.Unlock();
 }
 
-void OSD::OpWQ::_process(PGRef pg, ThreadPool::TPHandle &handle)
-{
-  pg->lock_suspend_timeout(handle);
-  OpRequestRef op;
-  {
-    Mutex::Locker l(qlock);
-    if (!pg_for_processing.count(&*pg)) {
-      pg->unlock();
-      return;
-    }
-    assert(pg_for_processing[&*pg].size());
-    op = pg_for_processing[&*pg].front();
-    pg_for_processing[&*pg].pop_front();
-    if (!(pg_for_processing[&*pg].size()))
-      pg_for_processing.erase(&*pg);
-  }
-  osd->dequeue_op(pg, op, handle);
-  pg->unlock();
-}
-
-
 void OSDService::dequeue_pg(PG *pg, list<OpRequestRef> *dequeued)
 {
-  osd->op_wq.dequeue(pg, dequeued);
+  osd->op_shardedwq.dequeue(pg, dequeued);
 }
 
 /*
@@ -7178,6 +7702,7 @@ void OSD::dequeue_op(
   if (pg->deleting)
     return;
 
+  CEPH_TRACE1(osd_dequeue_op, op->get_seq());
   op->mark_reached_pg();
 
   pg->do_request(op, handle);
@@ -7192,6 +7717,15 @@ void OSDService::queue_for_peering(PG *pg)
   peering_wq.queue(pg);
 }
 
+OpRequestRef OSDService::new_snap_trim_op(pg_t pgid, epoch_t e)
+{
+  MOSDPGSnapTrim *m = new MOSDPGSnapTrim(whoami, pgid, e,
+					 cct->_conf->osd_snap_trim_cost);
+  m->set_priority(cct->_conf->osd_snap_trim_priority);
+  m->set_recv_stamp(ceph_clock_now(cct));
+  return osd->op_tracker.create_request<OpRequest>(m);
+}
+
 struct C_CompleteSplits : public Context {
   OSD *osd;
   set<boost::intrusive_ptr<PG> > pgs;
@@ -7309,6 +7843,7 @@ int OSD::init_op_flags(OpRequestRef op)
 
   // client flags have no bearing on whether an op is a read, write, etc.
   op->rmw_flags = 0;
+  op->cls_methods.clear();
 
   // set bits based on op codes, called methods.
   for (iter = m->ops.begin(); iter != m->ops.end(); ++iter) {
@@ -7344,14 +7879,13 @@ int OSD::init_op_flags(OpRequestRef op)
 	    r = -EIO;
 	  return r;
 	}
-	int flags = cls->get_method_flags(mname.c_str());
-	if (flags < 0) {
-	  if (flags == -ENOENT)
-	    r = -EOPNOTSUPP;
-	  else
-	    r = flags;
-	  return r;
-	}
+	ClassHandler::ClassMethod *method = cls->get_method(mname.c_str());
+	if (!method)
+	  return -EOPNOTSUPP;
+	int flags = method->get_flags();
+	// so that the pg can call it without looking it up again
+	op->cls_methods.resize(m->ops.size());
+	op->cls_methods[iter - m->ops.begin()] = method;
 	is_read = flags & CLS_METHOD_RD;
 	is_write = flags & CLS_METHOD_WR;
 
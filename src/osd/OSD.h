@@ -54,6 +54,9 @@ using namespace __gnu_cxx;
 #include "common/simple_cache.hpp"
 #include "common/sharedptr_registry.hpp"
 #include "common/PrioritizedQueue.h"
+#include "common/mClockPriorityQueue.h"
+#include "RecoveryBudget.h"
+#include "ObjectContextCache.h"
 
 #define CEPH_OSD_PROTOCOL    10 /* cluster internal */
 
@@ -69,10 +72,12 @@ enum {
   l_osd_op_r,
   l_osd_op_r_outb,
   l_osd_op_r_lat,
+  l_osd_op_r_lat_outb_hist,
   l_osd_op_w,
   l_osd_op_w_inb,
   l_osd_op_w_rlat,
   l_osd_op_w_lat,
+  l_osd_op_w_lat_inb_hist,
   l_osd_op_rw,
   l_osd_op_rw_inb,
   l_osd_op_rw_outb,
@@ -85,6 +90,8 @@ enum {
   l_osd_sop_w,
   l_osd_sop_w_inb,
   l_osd_sop_w_lat,
+  l_osd_sop_w_batch,
+  l_osd_sop_w_batch_ops,
   l_osd_sop_pull,
   l_osd_sop_pull_lat,
   l_osd_sop_push,
@@ -94,6 +101,7 @@ enum {
   l_osd_pull,
   l_osd_push,
   l_osd_push_outb,
+  l_osd_push_delta,
 
   l_osd_push_in,
   l_osd_push_inb,
@@ -119,6 +127,29 @@ enum {
   l_osd_stat_bytes_used,
   l_osd_stat_bytes_avail,
 
+  l_osd_obc_cache_hit,
+  l_osd_obc_cache_miss,
+  l_osd_obc_cache_evict,
+  l_osd_obc_cache_bytes,
+
+  l_osd_pg_log_bytes,
+
+  l_osd_object_pool_hit,
+  l_osd_object_pool_miss,
+  l_osd_object_pool_bytes,
+
+  l_osd_agent_flush,
+  l_osd_agent_evict,
+  l_osd_agent_ops,
+
+  l_osd_tier_proxy_read,
+  l_osd_tier_promote,
+
+  l_osd_notify,
+  l_osd_notify_sent,
+  l_osd_notify_timeout,
+  l_osd_notify_lat,
+
   l_osd_last,
 };
 
@@ -300,10 +331,10 @@ public:
   PerfCounters *&logger;
   PerfCounters *&recoverystate_perf;
   MonClient   *&monc;
-  ThreadPool::WorkQueueVal<pair<PGRef, OpRequestRef>, PGRef> &op_wq;
+  ShardedThreadPool::ShardedWQ<pair<PGRef, OpRequestRef> > &op_wq;
   ThreadPool::BatchWorkQueue<PG> &peering_wq;
   ThreadPool::WorkQueue<PG> &recovery_wq;
-  ThreadPool::WorkQueue<PG> &snap_trim_wq;
+  ThreadPool::WorkQueue<PG> &agent_wq;
   ThreadPool::WorkQueue<PG> &scrub_wq;
   ThreadPool::WorkQueue<PG> &scrub_finalize_wq;
   ThreadPool::WorkQueue<MOSDRepScrub> &rep_scrub_wq;
@@ -326,14 +357,34 @@ public:
 
   int get_nodeid() const { return whoami; }
 
+  /*
+   * osdmap is read far more often than it is published, so every
+   * thread keeps its own reference to the current map, tagged with
+   * the osdmap_seq it was taken at.  A reader only compares that tag
+   * with osdmap_seq and takes publish_lock when a new map was
+   * published since; a thread that has not asked for a while may pin
+   * one old map until it does.
+   */
+  struct OSDMapSlot {
+    OSDService *service;
+    pthread_spinlock_t lock;  ///< only contended by shutdown
+    unsigned seq;
+    OSDMapRef map;
+  };
   OSDMapRef osdmap;
-  OSDMapRef get_osdmap() {
-    Mutex::Locker l(publish_lock);
-    return osdmap;
-  }
+  atomic_t osdmap_seq;  ///< bumped on every publish_map, under publish_lock
+  pthread_key_t osdmap_slot_key;
+  Mutex osdmap_slots_lock;
+  set<OSDMapSlot*> osdmap_slots;
+  static void osdmap_slot_release(void *p);
+  OSDMapSlot *get_osdmap_slot();
+  void clear_osdmap_slots();
+
+  OSDMapRef get_osdmap();
   void publish_map(OSDMapRef map) {
     Mutex::Locker l(publish_lock);
     osdmap = map;
+    osdmap_seq.inc();
   }
 
   /*
@@ -446,6 +497,7 @@ public:
   // -- Watch --
   Mutex watch_lock;
   SafeTimer watch_timer;
+  Finisher notify_finisher;  ///< sends notifies out to the watchers
   uint64_t next_notif_id;
   uint64_t get_next_id(epoch_t cur_epoch) {
     Mutex::Locker l(watch_lock);
@@ -478,6 +530,53 @@ public:
   AsyncReserver<pg_t> local_reserver;
   AsyncReserver<pg_t> remote_reserver;
 
+  // -- recovery, backfill and scrub budget --
+  RecoveryBudget recovery_budget;
+  /// scrub reads only, on top of recovery_budget
+  RecoveryBudget scrub_budget;
+private:
+  void wait_for_budget(RecoveryBudget &budget, ThreadPool::TPHandle &handle,
+		       uint64_t nops = 1);
+public:
+  /// block until the budget lets a unit of background work through
+  void wait_for_recovery_budget(ThreadPool::TPHandle &handle) {
+    wait_for_budget(recovery_budget, handle);
+  }
+  /// block until both budgets let another scrub chunk through
+  void wait_for_scrub_budget(ThreadPool::TPHandle &handle) {
+    wait_for_budget(scrub_budget, handle);
+    wait_for_budget(recovery_budget, handle);
+  }
+  /// block until the recovery budget lets pg removal go on, then
+  /// charge it the objects just removed
+  void wait_for_remove_budget(ThreadPool::TPHandle &handle, uint64_t objects) {
+    wait_for_budget(recovery_budget, handle, objects);
+  }
+
+  // -- snap trimming --
+  RecoveryBudget snap_trim_budget;  ///< objects trimmed
+
+  // -- cache tier agent --
+  RecoveryBudget agent_budget;
+  atomic_t agent_ops;  ///< flushes in flight
+  /// true if the agent may start another flush or eviction now
+  bool agent_can_start();
+  /// note a flush going out
+  void agent_start_op() {
+    agent_ops.inc();
+    agent_budget.charge(1, 0);
+  }
+  void agent_finish_op() {
+    agent_ops.dec();
+    agent_wq.wake();
+  }
+
+  /// memory held by the logs of all our pgs
+  atomic_t pg_log_bytes;
+
+  // -- object contexts of all pgs --
+  ObjectContextCache obc_cache;
+
   // -- pg_temp --
   Mutex pg_temp_lock;
   map<pg_t, vector<int> > pg_temp_wanted;
@@ -490,8 +589,10 @@ public:
 
   void queue_for_peering(PG *pg);
   bool queue_for_recovery(PG *pg);
-  bool queue_for_snap_trim(PG *pg) {
-    return snap_trim_wq.queue(pg);
+  /// a pass of the snap trimmer over pgid, for the pg to queue
+  OpRequestRef new_snap_trim_op(pg_t pgid, epoch_t e);
+  bool queue_for_agent(PG *pg) {
+    return agent_wq.queue(pg);
   }
   bool queue_for_scrub(PG *pg) {
     return scrub_wq.queue(pg);
@@ -526,6 +627,7 @@ public:
     return _get_map_bl(e, bl);
   }
   bool _get_map_bl(epoch_t e, bufferlist& bl);
+  void _dedup_map_bl(epoch_t e, bufferlist& bl);
 
   void add_map_inc_bl(epoch_t e, bufferlist& bl) {
     Mutex::Locker l(map_cache_lock);
@@ -801,6 +903,8 @@ public:
 private:
 
   ThreadPool op_tp;
+  ThreadPool peering_tp;
+  ShardedThreadPool osd_op_tp;
   ThreadPool recovery_tp;
   ThreadPool disk_tp;
   ThreadPool command_tp;
@@ -948,64 +1052,172 @@ private:
 
   // -- op queue --
 
-  struct OpWQ: public ThreadPool::WorkQueueVal<pair<PGRef, OpRequestRef>,
-					       PGRef > {
-    Mutex qlock;
-    map<PG*, list<OpRequestRef> > pg_for_processing;
+  class ShardedOpWQ: public ShardedThreadPool::ShardedWQ<
+    pair<PGRef, OpRequestRef> > {
+
+    typedef OpQueue<pair<PGRef, OpRequestRef>, entity_inst_t> OpShardQueue;
+
+    struct ShardData {
+      Mutex sdata_lock;
+      Cond sdata_cond;
+      Mutex sdata_op_ordering_lock;
+      map<PG*, list<OpRequestRef> > pg_for_processing;
+      OpShardQueue *pqueue;
+      /// recovery ops waiting for the recovery budget to let them in
+      list<pair<PGRef, OpRequestRef> > recovery_waiting;
+      /// snap trim passes waiting for the snap trim budget
+      list<pair<PGRef, OpRequestRef> > snap_trim_waiting;
+      ShardData(string lock_name, string ordering_lock,
+		OpShardQueue *q)
+	: sdata_lock(lock_name.c_str()),
+	  sdata_op_ordering_lock(ordering_lock.c_str()),
+	  pqueue(q) {}
+      ~ShardData() {
+	delete pqueue;
+      }
+    };
+
+    vector<ShardData*> shard_list;
     OSD *osd;
-    PrioritizedQueue<pair<PGRef, OpRequestRef>, entity_inst_t > pqueue;
-    OpWQ(OSD *o, time_t ti, ThreadPool *tp)
-      : ThreadPool::WorkQueueVal<pair<PGRef, OpRequestRef>, PGRef >(
-	"OSD::OpWQ", ti, ti*10, tp),
-	qlock("OpWQ::qlock"),
-	osd(o),
-	pqueue(o->cct->_conf->osd_op_pq_max_tokens_per_priority,
-	       o->cct->_conf->osd_op_pq_min_cost)
-    {}
+    uint32_t num_shards;
 
-    void dump(Formatter *f) {
-      Mutex::Locker l(qlock);
-      pqueue.dump(f);
+    ShardData *get_shard(PG *pg) {
+      assert(pg != NULL);
+      return shard_list[pg->get_pgid().ps() % num_shards];
     }
 
-    void _enqueue_front(pair<PGRef, OpRequestRef> item);
+  public:
+    ShardedOpWQ(uint32_t pnum_shards, OSD *o, time_t ti, time_t si,
+		ShardedThreadPool *tp)
+      : ShardedThreadPool::ShardedWQ<pair<PGRef, OpRequestRef> >(ti, si, tp),
+	osd(o), num_shards(pnum_shards) {
+      for (uint32_t i = 0; i < num_shards; i++) {
+	char lock_name[32] = {0};
+	snprintf(lock_name, sizeof(lock_name), "%s.%d", "OSD:ShardedOpWQ:", i);
+	char order_lock[32] = {0};
+	snprintf(order_lock, sizeof(order_lock), "%s.%d",
+		 "OSD:ShardedOpWQ:order:", i);
+	OpShardQueue *q;
+	if (osd->cct->_conf->osd_op_queue == "mclock")
+	  q = new mClockQueue<pair<PGRef, OpRequestRef>, entity_inst_t>(
+	    osd->cct, &mclock_client_info, this);
+	else
+	  q = new PrioritizedQueue<pair<PGRef, OpRequestRef>, entity_inst_t>(
+	    osd->cct->_conf->osd_op_pq_max_tokens_per_priority,
+	    osd->cct->_conf->osd_op_pq_min_cost);
+	ShardData *one_shard = new ShardData(lock_name, order_lock, q);
+	shard_list.push_back(one_shard);
+      }
+    }
+
+    /// the mclock share of a client or peer osd in one shard
+    static mClockClientInfo mclock_client_info(const entity_inst_t &inst,
+					       void *arg);
+
+    ~ShardedOpWQ() {
+      while (!shard_list.empty()) {
+	delete shard_list.back();
+	shard_list.pop_back();
+      }
+    }
+
+    static bool is_recovery_op(Message *m);
+    void _enqueue_normal(ShardData *sdata, pair<PGRef, OpRequestRef> item);
+    void _release(ShardData *sdata, list<pair<PGRef, OpRequestRef> > &waiting,
+		  RecoveryBudget &budget, utime_t now, utime_t *next);
+    void _release_waiting(ShardData *sdata, utime_t now, utime_t *next);
+
+    void _process(uint32_t thread_index, heartbeat_handle_d *hb);
     void _enqueue(pair<PGRef, OpRequestRef> item);
-    PGRef _dequeue();
+    void _enqueue_front(pair<PGRef, OpRequestRef> item);
 
-    struct Pred {
+    void return_waiting_threads() {
+      for (uint32_t i = 0; i < num_shards; i++) {
+	ShardData *sdata = shard_list[i];
+	assert(NULL != sdata);
+	sdata->sdata_lock.Lock();
+	sdata->sdata_cond.SignalAll();
+	sdata->sdata_lock.Unlock();
+      }
+    }
+
+    void dump(Formatter *f) {
+      f->open_array_section("shards");
+      for (uint32_t i = 0; i < num_shards; i++) {
+	ShardData *sdata = shard_list[i];
+	assert(NULL != sdata);
+	f->open_object_section("shard");
+	f->dump_unsigned("shard", i);
+	sdata->sdata_op_ordering_lock.Lock();
+	f->dump_unsigned("pgs_in_progress", sdata->pg_for_processing.size());
+	f->dump_unsigned("recovery_waiting", sdata->recovery_waiting.size());
+	f->dump_unsigned("snap_trim_waiting", sdata->snap_trim_waiting.size());
+	sdata->pqueue->dump(f);
+	sdata->sdata_op_ordering_lock.Unlock();
+	f->close_section();
+      }
+      f->close_section();
+    }
+
+    struct Pred : public OpShardQueue::Filter {
       PG *pg;
       Pred(PG *pg) : pg(pg) {}
       bool operator()(const pair<PGRef, OpRequestRef> &op) {
 	return op.first == pg;
       }
     };
+
+    static void _remove_waiting(list<pair<PGRef, OpRequestRef> > &waiting,
+				Pred &pred,
+				list<pair<PGRef, OpRequestRef> > *out) {
+      for (list<pair<PGRef, OpRequestRef> >::iterator i = waiting.begin();
+	   i != waiting.end();
+	   ) {
+	if (pred(*i)) {
+	  out->push_back(*i);
+	  waiting.erase(i++);
+	} else {
+	  ++i;
+	}
+      }
+    }
+
     void dequeue(PG *pg, list<OpRequestRef> *dequeued = 0) {
-      lock();
+      ShardData *sdata = get_shard(pg);
+      assert(sdata != NULL);
+      Mutex::Locker l(sdata->sdata_op_ordering_lock);
+      Pred pred(pg);
+      list<pair<PGRef, OpRequestRef> > _dequeued;
+      _remove_waiting(sdata->recovery_waiting, pred, &_dequeued);
+      _remove_waiting(sdata->snap_trim_waiting, pred, &_dequeued);
       if (!dequeued) {
-	pqueue.remove_by_filter(Pred(pg));
-	pg_for_processing.erase(pg);
+	sdata->pqueue->remove_by_filter(pred);
+	sdata->pg_for_processing.erase(pg);
       } else {
-	list<pair<PGRef, OpRequestRef> > _dequeued;
-	pqueue.remove_by_filter(Pred(pg), &_dequeued);
+	sdata->pqueue->remove_by_filter(pred, &_dequeued);
 	for (list<pair<PGRef, OpRequestRef> >::iterator i = _dequeued.begin();
 	     i != _dequeued.end();
 	     ++i) {
 	  dequeued->push_back(i->second);
 	}
-	if (pg_for_processing.count(pg)) {
+	if (sdata->pg_for_processing.count(pg)) {
 	  dequeued->splice(
 	    dequeued->begin(),
-	    pg_for_processing[pg]);
-	  pg_for_processing.erase(pg);
+	    sdata->pg_for_processing[pg]);
+	  sdata->pg_for_processing.erase(pg);
 	}
       }
-      unlock();
     }
-    bool _empty() {
-      return pqueue.empty();
+
+    bool is_shard_empty(uint32_t thread_index) {
+      uint32_t shard_index = thread_index % num_shards;
+      ShardData *sdata = shard_list[shard_index];
+      assert(NULL != sdata);
+      Mutex::Locker l(sdata->sdata_op_ordering_lock);
+      return sdata->pqueue->empty() && sdata->recovery_waiting.empty() &&
+	sdata->snap_trim_waiting.empty();
     }
-    void _process(PGRef pg, ThreadPool::TPHandle &handle);
-  } op_wq;
+  } op_shardedwq;
 
   void enqueue_op(PG *pg, OpRequestRef op);
   void dequeue_op(
@@ -1273,6 +1485,7 @@ protected:
 
 
   void send_failures();
+  void _send_failures(OSDMapRef curmap);
   void send_still_alive(epoch_t epoch, const entity_inst_t &i);
 
   // -- pg stats --
@@ -1468,43 +1681,45 @@ protected:
   void check_replay_queue();
 
 
-  // -- snap trimming --
-  xlist<PG*> snap_trim_queue;
-  
-  struct SnapTrimWQ : public ThreadPool::WorkQueue<PG> {
+  // -- cache tier agent --
+  xlist<PG*> agent_queue;
+
+  struct AgentWQ : public ThreadPool::WorkQueue<PG> {
     OSD *osd;
-    SnapTrimWQ(OSD *o, time_t ti, ThreadPool *tp)
-      : ThreadPool::WorkQueue<PG>("OSD::SnapTrimWQ", ti, 0, tp), osd(o) {}
+    AgentWQ(OSD *o, time_t ti, ThreadPool *tp)
+      : ThreadPool::WorkQueue<PG>("OSD::AgentWQ", ti, 0, tp), osd(o) {}
 
     bool _empty() {
-      return osd->snap_trim_queue.empty();
+      return osd->agent_queue.empty();
     }
     bool _enqueue(PG *pg) {
-      if (pg->snap_trim_item.is_on_list())
+      if (pg->agent_item.is_on_list())
 	return false;
-      pg->get("SnapTrimWQ");
-      osd->snap_trim_queue.push_back(&pg->snap_trim_item);
+      pg->get("AgentWQ");
+      osd->agent_queue.push_back(&pg->agent_item);
       return true;
     }
     void _dequeue(PG *pg) {
-      if (pg->snap_trim_item.remove_myself())
-	pg->put("SnapTrimWQ");
+      if (pg->agent_item.remove_myself())
+	pg->put("AgentWQ");
     }
     PG *_dequeue() {
-      if (osd->snap_trim_queue.empty())
+      // pgs wait here, not in the tp thread, while the agent is at its
+      // limits; agent_finish_op() wakes us up
+      if (osd->agent_queue.empty() || !osd->service.agent_can_start())
 	return NULL;
-      PG *pg = osd->snap_trim_queue.front();
-      osd->snap_trim_queue.pop_front();
+      PG *pg = osd->agent_queue.front();
+      osd->agent_queue.pop_front();
       return pg;
     }
-    void _process(PG *pg) {
-      pg->snap_trimmer();
-      pg->put("SnapTrimWQ");
+    void _process(PG *pg, ThreadPool::TPHandle &handle) {
+      pg->agent_work(handle);
+      pg->put("AgentWQ");
     }
     void _clear() {
-      osd->snap_trim_queue.clear();
+      osd->agent_queue.clear();
     }
-  } snap_trim_wq;
+  } agent_wq;
 
 
   // -- scrubbing --
@@ -1545,6 +1760,7 @@ protected:
     void _process(
       PG *pg,
       ThreadPool::TPHandle &handle) {
+      osd->service.wait_for_scrub_budget(handle);
       pg->scrub(handle);
       pg->put("ScrubWQ");
     }
@@ -1631,6 +1847,7 @@ protected:
     void _process(
       MOSDRepScrub *msg,
       ThreadPool::TPHandle &handle) {
+      osd->service.wait_for_scrub_budget(handle);
       osd->osd_lock.Lock();
       if (osd->is_stopping()) {
 	osd->osd_lock.Unlock();
@@ -1695,6 +1912,17 @@ protected:
   }
 
  private:
+  bool ms_can_fast_dispatch_any() const { return true; }
+  bool ms_can_fast_dispatch(Message *m) const {
+    switch (m->get_type()) {
+    case CEPH_MSG_OSD_OP:
+    case MSG_OSD_SUBOP:
+      return true;
+    default:
+      return false;
+    }
+  }
+  void ms_fast_dispatch(Message *m);
   bool ms_dispatch(Message *m);
   bool ms_get_authorizer(int dest_type, AuthAuthorizer **authorizer, bool force_new);
   bool ms_verify_authorizer(Connection *con, int peer_type,
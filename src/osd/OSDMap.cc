@@ -640,14 +640,21 @@ void OSDMap::set_max_osd(int m)
 {
   int o = max_osd;
   max_osd = m;
-  osd_state.resize(m);
-  osd_weight.resize(m);
+  pg_mappings.clear();
+  cow(osd_state);
+  cow(osd_weight);
+  cow(osd_info);
+  cow(osd_xinfo);
+  cow(osd_addrs);
+  cow(osd_uuid);
+  osd_state->resize(m);
+  osd_weight->resize(m);
   for (; o<max_osd; o++) {
-    osd_state[o] = 0;
-    osd_weight[o] = CEPH_OSD_OUT;
+    (*osd_state)[o] = 0;
+    (*osd_weight)[o] = CEPH_OSD_OUT;
   }
-  osd_info.resize(m);
-  osd_xinfo.resize(m);
+  osd_info->resize(m);
+  osd_xinfo->resize(m);
   osd_addrs->client_addr.resize(m);
   osd_addrs->cluster_addr.resize(m);
   osd_addrs->hb_back_addr.resize(m);
@@ -661,7 +668,7 @@ int OSDMap::calc_num_osds()
 {
   num_osd = 0;
   for (int i=0; i<max_osd; i++)
-    if (osd_state[i] & CEPH_OSD_EXISTS)
+    if ((*osd_state)[i] & CEPH_OSD_EXISTS)
       num_osd++;
   return num_osd;
 }
@@ -677,8 +684,8 @@ int OSDMap::get_num_up_osds() const
 {
   int n = 0;
   for (int i=0; i<max_osd; i++)
-    if ((osd_state[i] & CEPH_OSD_EXISTS) &&
-	(osd_state[i] & CEPH_OSD_UP)) n++;
+    if (((*osd_state)[i] & CEPH_OSD_EXISTS) &&
+	((*osd_state)[i] & CEPH_OSD_UP)) n++;
   return n;
 }
 
@@ -686,7 +693,7 @@ int OSDMap::get_num_in_osds() const
 {
   int n = 0;
   for (int i=0; i<max_osd; i++)
-    if ((osd_state[i] & CEPH_OSD_EXISTS) &&
+    if (((*osd_state)[i] & CEPH_OSD_EXISTS) &&
 	get_weight(i) != CEPH_OSD_OUT) n++;
   return n;
 }
@@ -751,24 +758,47 @@ uint64_t OSDMap::get_features(uint64_t *pmask) const
     features |= CEPH_FEATURE_CRUSH_TUNABLES;
   if (crush->has_nondefault_tunables2())
     features |= CEPH_FEATURE_CRUSH_TUNABLES2;
+  if (crush->has_v4_buckets())
+    features |= CEPH_FEATURE_CRUSH_V4;
   mask |= CEPH_FEATURES_CRUSH;
 
   for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin(); p != pools.end(); ++p) {
     if (p->second.flags & pg_pool_t::FLAG_HASHPSPOOL) {
       features |= CEPH_FEATURE_OSDHASHPSPOOL;
     }
+    if (p->second.flags & pg_pool_t::FLAG_BALANCE_READS) {
+      features |= CEPH_FEATURE_OSD_BALANCE_READS;
+    }
     if (!p->second.tiers.empty() ||
 	p->second.is_tier()) {
       features |= CEPH_FEATURE_OSD_CACHEPOOL;
     }
   }
   mask |= CEPH_FEATURE_OSDHASHPSPOOL;
+  mask |= CEPH_FEATURE_OSD_BALANCE_READS;
 
   if (pmask)
     *pmask = mask;
   return features;
 }
 
+static bool osd_info_equal(const osd_info_t& a, const osd_info_t& b)
+{
+  return a.last_clean_begin == b.last_clean_begin &&
+    a.last_clean_end == b.last_clean_end &&
+    a.up_from == b.up_from &&
+    a.up_thru == b.up_thru &&
+    a.down_at == b.down_at &&
+    a.lost_at == b.lost_at;
+}
+
+static bool osd_xinfo_equal(const osd_xinfo_t& a, const osd_xinfo_t& b)
+{
+  return a.down_stamp == b.down_stamp &&
+    a.laggy_probability == b.laggy_probability &&
+    a.laggy_interval == b.laggy_interval;
+}
+
 void OSDMap::dedup(const OSDMap *o, OSDMap *n)
 {
   if (o->epoch == n->epoch)
@@ -824,6 +854,20 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
   if (o->osd_uuid->size() == n->osd_uuid->size() &&
       *o->osd_uuid == *n->osd_uuid)
     n->osd_uuid = o->osd_uuid;
+
+  // and the rest of the per-osd state?
+  if (*o->osd_state == *n->osd_state)
+    n->osd_state = o->osd_state;
+  if (*o->osd_weight == *n->osd_weight)
+    n->osd_weight = o->osd_weight;
+  if (o->osd_info->size() == n->osd_info->size() &&
+      equal(o->osd_info->begin(), o->osd_info->end(), n->osd_info->begin(),
+	    osd_info_equal))
+    n->osd_info = o->osd_info;
+  if (o->osd_xinfo->size() == n->osd_xinfo->size() &&
+      equal(o->osd_xinfo->begin(), o->osd_xinfo->end(), n->osd_xinfo->begin(),
+	    osd_xinfo_equal))
+    n->osd_xinfo = o->osd_xinfo;
 }
 
 int OSDMap::apply_incremental(const Incremental &inc)
@@ -846,6 +890,8 @@ int OSDMap::apply_incremental(const Incremental &inc)
   }
 
   // nope, incremental.
+  _invalidate_pg_mappings(inc);
+
   if (inc.new_flags >= 0)
     flags = inc.new_flags;
 
@@ -877,6 +923,24 @@ int OSDMap::apply_incremental(const Incremental &inc)
     name_pool[p->second] = p->first;
   }
 
+  // only the members this incremental touches get copied away from
+  // the previous epoch's
+  if (!inc.new_weight.empty() || !inc.new_state.empty() ||
+      !inc.new_up_client.empty())
+    cow(osd_state);
+  if (!inc.new_state.empty() || !inc.new_up_client.empty() ||
+      !inc.new_up_thru.empty() || !inc.new_last_clean_interval.empty() ||
+      !inc.new_lost.empty())
+    cow(osd_info);
+  if (!inc.new_state.empty() || !inc.new_xinfo.empty())
+    cow(osd_xinfo);
+  if (!inc.new_state.empty() || !inc.new_uuid.empty())
+    cow(osd_uuid);
+  if (!inc.new_up_client.empty() || !inc.new_up_cluster.empty())
+    cow(osd_addrs);
+  if (!inc.new_pg_temp.empty())
+    cow(pg_temp);
+
   for (map<int32_t,uint32_t>::const_iterator i = inc.new_weight.begin();
        i != inc.new_weight.end();
        ++i) {
@@ -884,7 +948,7 @@ int OSDMap::apply_incremental(const Incremental &inc)
 
     // if we are marking in, clear the AUTOOUT and NEW bits.
     if (i->second)
-      osd_state[i->first] &= ~(CEPH_OSD_AUTOOUT | CEPH_OSD_NEW);
+      (*osd_state)[i->first] &= ~(CEPH_OSD_AUTOOUT | CEPH_OSD_NEW);
   }
 
   // up/down
@@ -892,20 +956,20 @@ int OSDMap::apply_incremental(const Incremental &inc)
        i != inc.new_state.end();
        ++i) {
     int s = i->second ? i->second : CEPH_OSD_UP;
-    if ((osd_state[i->first] & CEPH_OSD_UP) &&
+    if (((*osd_state)[i->first] & CEPH_OSD_UP) &&
 	(s & CEPH_OSD_UP)) {
-      osd_info[i->first].down_at = epoch;
-      osd_xinfo[i->first].down_stamp = modified;
+      (*osd_info)[i->first].down_at = epoch;
+      (*osd_xinfo)[i->first].down_stamp = modified;
     }
-    if ((osd_state[i->first] & CEPH_OSD_EXISTS) &&
+    if (((*osd_state)[i->first] & CEPH_OSD_EXISTS) &&
 	(s & CEPH_OSD_EXISTS))
       (*osd_uuid)[i->first] = uuid_d();
-    osd_state[i->first] ^= s;
+    (*osd_state)[i->first] ^= s;
   }
   for (map<int32_t,entity_addr_t>::const_iterator i = inc.new_up_client.begin();
        i != inc.new_up_client.end();
        ++i) {
-    osd_state[i->first] |= CEPH_OSD_EXISTS | CEPH_OSD_UP;
+    (*osd_state)[i->first] |= CEPH_OSD_EXISTS | CEPH_OSD_UP;
     osd_addrs->client_addr[i->first].reset(new entity_addr_t(i->second));
     if (inc.new_hb_back_up.empty())
       osd_addrs->hb_back_addr[i->first].reset(new entity_addr_t(i->second)); //this is a backward-compatibility hack
@@ -918,7 +982,7 @@ int OSDMap::apply_incremental(const Incremental &inc)
     else
       osd_addrs->hb_front_addr[i->first].reset();
 
-    osd_info[i->first].up_from = epoch;
+    (*osd_info)[i->first].up_from = epoch;
   }
   for (map<int32_t,entity_addr_t>::const_iterator i = inc.new_up_cluster.begin();
        i != inc.new_up_cluster.end();
@@ -929,19 +993,19 @@ int OSDMap::apply_incremental(const Incremental &inc)
   for (map<int32_t,epoch_t>::const_iterator i = inc.new_up_thru.begin();
        i != inc.new_up_thru.end();
        ++i)
-    osd_info[i->first].up_thru = i->second;
+    (*osd_info)[i->first].up_thru = i->second;
   for (map<int32_t,pair<epoch_t,epoch_t> >::const_iterator i = inc.new_last_clean_interval.begin();
        i != inc.new_last_clean_interval.end();
        ++i) {
-    osd_info[i->first].last_clean_begin = i->second.first;
-    osd_info[i->first].last_clean_end = i->second.second;
+    (*osd_info)[i->first].last_clean_begin = i->second.first;
+    (*osd_info)[i->first].last_clean_end = i->second.second;
   }
   for (map<int32_t,epoch_t>::const_iterator p = inc.new_lost.begin(); p != inc.new_lost.end(); ++p)
-    osd_info[p->first].lost_at = p->second;
+    (*osd_info)[p->first].lost_at = p->second;
 
   // xinfo
   for (map<int32_t,osd_xinfo_t>::const_iterator p = inc.new_xinfo.begin(); p != inc.new_xinfo.end(); ++p)
-    osd_xinfo[p->first] = p->second;
+    (*osd_xinfo)[p->first] = p->second;
 
   // uuid
   for (map<int32_t,uuid_d>::const_iterator p = inc.new_uuid.begin(); p != inc.new_uuid.end(); ++p) 
@@ -1045,7 +1109,92 @@ void OSDMap::_remove_nonexistent_osds(vector<int>& osds) const
     osds.resize(osds.size() - removed);
 }
 
+static bool same_placement(const pg_pool_t& a, const pg_pool_t& b)
+{
+  return a.get_type() == b.get_type() &&
+    a.get_size() == b.get_size() &&
+    a.get_crush_ruleset() == b.get_crush_ruleset() &&
+    a.get_pgp_num() == b.get_pgp_num() &&
+    (a.flags & pg_pool_t::FLAG_HASHPSPOOL) ==
+      (b.flags & pg_pool_t::FLAG_HASHPSPOOL);
+}
+
+void OSDMap::_invalidate_pg_mappings(const Incremental& inc)
+{
+  if (pg_mappings.empty())
+    return;
+
+  // anything crush itself sees: the map, weights, which osds exist
+  bool all = inc.crush.length() || inc.new_max_osd >= 0 ||
+    !inc.new_weight.empty();
+  for (map<int32_t,uint8_t>::const_iterator p = inc.new_state.begin();
+       !all && p != inc.new_state.end();
+       ++p)
+    if (p->second & CEPH_OSD_EXISTS)
+      all = true;
+  for (map<int32_t,entity_addr_t>::const_iterator p = inc.new_up_client.begin();
+       !all && p != inc.new_up_client.end();
+       ++p)
+    if (!exists(p->first))
+      all = true;
+  if (all) {
+    pg_mappings.clear();
+    return;
+  }
+
+  // or how a pool places its pgs
+  for (set<int64_t>::const_iterator p = inc.old_pools.begin();
+       p != inc.old_pools.end();
+       ++p)
+    pg_mappings.erase(*p);
+  for (map<int64_t,pg_pool_t>::const_iterator p = inc.new_pools.begin();
+       p != inc.new_pools.end();
+       ++p) {
+    map<int64_t,pg_pool_t>::const_iterator q = pools.find(p->first);
+    if (q == pools.end() || !same_placement(q->second, p->second))
+      pg_mappings.erase(p->first);
+  }
+}
+
+void OSDMap::precompute_pg_mappings()
+{
+  for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin();
+       p != pools.end();
+       ++p) {
+    if (pg_mappings.count(p->first))
+      continue;
+    const pg_pool_t& pool = p->second;
+    pool_mappings_t *m = new pool_mappings_t(pool.get_pgp_num());
+    int ruleno = crush->find_rule(pool.get_crush_ruleset(), pool.get_type(),
+				  pool.get_size());
+    if (ruleno >= 0) {
+      // same as _crush_pg_to_osds() for each pg, in one pass over crush
+      vector<int> pps(pool.get_pgp_num());
+      for (unsigned ps = 0; ps < pool.get_pgp_num(); ++ps)
+	pps[ps] = pool.raw_pg_to_pps(pg_t(ps, p->first, -1));
+      crush->do_rule_batch(ruleno, pps, *m, pool.get_size(), *osd_weight);
+      for (unsigned ps = 0; ps < pool.get_pgp_num(); ++ps)
+	_remove_nonexistent_osds((*m)[ps]);
+    }
+    pg_mappings[p->first].reset(m);
+  }
+}
+
 int OSDMap::_pg_to_osds(const pg_pool_t& pool, pg_t pg, vector<int>& osds) const
+{
+  map<int64_t, std::tr1::shared_ptr<const pool_mappings_t> >::const_iterator p =
+    pg_mappings.find(pg.pool());
+  if (p != pg_mappings.end()) {
+    unsigned ps = ceph_stable_mod(pg.ps(), pool.get_pgp_num(), pool.get_pgp_num_mask());
+    if (ps < p->second->size()) {
+      osds = (*p->second)[ps];
+      return osds.size();
+    }
+  }
+  return _crush_pg_to_osds(pool, pg, osds);
+}
+
+int OSDMap::_crush_pg_to_osds(const pg_pool_t& pool, pg_t pg, vector<int>& osds) const
 {
   // map to osds[]
   ps_t pps = pool.raw_pg_to_pps(pg);  // placement ps
@@ -1054,7 +1203,7 @@ int OSDMap::_pg_to_osds(const pg_pool_t& pool, pg_t pg, vector<int>& osds) const
   // what crush rule?
   int ruleno = crush->find_rule(pool.get_crush_ruleset(), pool.get_type(), size);
   if (ruleno >= 0)
-    crush->do_rule(ruleno, pps, osds, size, osd_weight);
+    crush->do_rule(ruleno, pps, osds, size, *osd_weight);
 
   _remove_nonexistent_osds(osds);
 
@@ -1108,6 +1257,19 @@ int OSDMap::pg_to_acting_osds(pg_t pg, vector<int>& acting) const
   return acting.size();
 }
 
+int OSDMap::pg_to_raw_acting_osds(pg_t pg, vector<int>& raw, vector<int>& acting) const
+{
+  raw.clear();
+  acting.clear();
+  const pg_pool_t *pool = get_pg_pool(pg.pool());
+  if (!pool)
+    return 0;
+  _pg_to_osds(*pool, pg, raw);
+  if (!_raw_to_temp_osds(*pool, pg, raw, acting))
+    _raw_to_up_osds(pg, raw, acting);
+  return acting.size();
+}
+
 void OSDMap::pg_to_raw_up(pg_t pg, vector<int>& up) const
 {
   const pg_pool_t *pool = get_pg_pool(pg.pool());
@@ -1187,8 +1349,8 @@ void OSDMap::encode_client_old(bufferlist& bl) const
   ::encode(flags, bl);
 
   ::encode(max_osd, bl);
-  ::encode(osd_state, bl);
-  ::encode(osd_weight, bl);
+  ::encode(*osd_state, bl);
+  ::encode(*osd_weight, bl);
   ::encode(osd_addrs->client_addr, bl);
 
   // for ::encode(pg_temp, bl);
@@ -1231,8 +1393,8 @@ void OSDMap::encode(bufferlist& bl, uint64_t features) const
   ::encode(flags, bl);
 
   ::encode(max_osd, bl);
-  ::encode(osd_state, bl);
-  ::encode(osd_weight, bl);
+  ::encode(*osd_state, bl);
+  ::encode(*osd_weight, bl);
   ::encode(osd_addrs->client_addr, bl);
 
   ::encode(*pg_temp, bl);
@@ -1246,13 +1408,13 @@ void OSDMap::encode(bufferlist& bl, uint64_t features) const
   __u16 ev = 10;
   ::encode(ev, bl);
   ::encode(osd_addrs->hb_back_addr, bl);
-  ::encode(osd_info, bl);
+  ::encode(*osd_info, bl);
   ::encode(blacklist, bl);
   ::encode(osd_addrs->cluster_addr, bl);
   ::encode(cluster_snapshot_epoch, bl);
   ::encode(cluster_snapshot, bl);
   ::encode(*osd_uuid, bl);
-  ::encode(osd_xinfo, bl);
+  ::encode(*osd_xinfo, bl);
   ::encode(osd_addrs->hb_front_addr, bl);
 }
 
@@ -1268,6 +1430,17 @@ void OSDMap::decode(bufferlist::iterator& p)
   __u16 v;
   ::decode(v, p);
 
+  // decode into members of our own, not ones we share with other maps
+  pg_mappings.clear();
+  osd_state.reset(new vector<uint8_t>);
+  osd_addrs.reset(new addrs_s);
+  osd_weight.reset(new vector<__u32>);
+  osd_info.reset(new vector<osd_info_t>);
+  pg_temp.reset(new map<pg_t,vector<int> >);
+  osd_uuid.reset(new vector<uuid_d>);
+  osd_xinfo.reset(new vector<osd_xinfo_t>);
+  crush.reset(new CrushWrapper);
+
   // base
   ::decode(fsid, p);
   ::decode(epoch, p);
@@ -1312,8 +1485,8 @@ void OSDMap::decode(bufferlist::iterator& p)
   ::decode(flags, p);
 
   ::decode(max_osd, p);
-  ::decode(osd_state, p);
-  ::decode(osd_weight, p);
+  ::decode(*osd_state, p);
+  ::decode(*osd_weight, p);
   ::decode(osd_addrs->client_addr, p);
   if (v <= 5) {
     pg_temp->clear();
@@ -1338,7 +1511,7 @@ void OSDMap::decode(bufferlist::iterator& p)
   if (v >= 5)
     ::decode(ev, p);
   ::decode(osd_addrs->hb_back_addr, p);
-  ::decode(osd_info, p);
+  ::decode(*osd_info, p);
   if (v < 5)
     ::decode(pool_name, p);
 
@@ -1359,9 +1532,9 @@ void OSDMap::decode(bufferlist::iterator& p)
     osd_uuid->resize(max_osd);
   }
   if (ev >= 9)
-    ::decode(osd_xinfo, p);
+    ::decode(*osd_xinfo, p);
   else
-    osd_xinfo.resize(max_osd);
+    osd_xinfo->resize(max_osd);
 
   if (ev >= 10)
     ::decode(osd_addrs->hb_front_addr, p);
@@ -1442,7 +1615,7 @@ void OSDMap::dump(Formatter *f) const
     if (exists(i)) {
       f->open_object_section("xinfo");
       f->dump_int("osd", i);
-      osd_xinfo[i].dump(f);
+      (*osd_xinfo)[i].dump(f);
       f->close_section();
     }
   }
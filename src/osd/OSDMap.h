@@ -27,6 +27,7 @@
 #include "msg/Message.h"
 #include "common/Mutex.h"
 #include "common/Clock.h"
+#include "common/mempool.h"
 
 #include "include/ceph_features.h"
 
@@ -183,7 +184,11 @@ private:
 
   int num_osd;         // not saved
   int32_t max_osd;
-  vector<uint8_t> osd_state;
+
+  // the per-osd vectors and other large members are shared between maps
+  // copied from one another, and only copied (by cow()) when a map
+  // changes them, so consecutive epochs cost about the size of their delta.
+  std::tr1::shared_ptr< vector<uint8_t> > osd_state;
 
   struct addrs_s {
     vector<std::tr1::shared_ptr<entity_addr_t> > client_addr;
@@ -194,8 +199,8 @@ private:
   };
   std::tr1::shared_ptr<addrs_s> osd_addrs;
 
-  vector<__u32>   osd_weight;   // 16.16 fixed point, 0x10000 = "in", 0 = "out"
-  vector<osd_info_t> osd_info;
+  std::tr1::shared_ptr< vector<__u32> > osd_weight;   // 16.16 fixed point, 0x10000 = "in", 0 = "out"
+  std::tr1::shared_ptr< vector<osd_info_t> > osd_info;
   std::tr1::shared_ptr< map<pg_t,vector<int> > > pg_temp;  // temp pg mapping (e.g. while we rebuild)
 
   map<int64_t,pg_pool_t> pools;
@@ -203,7 +208,7 @@ private:
   map<string,int64_t> name_pool;
 
   std::tr1::shared_ptr< vector<uuid_d> > osd_uuid;
-  vector<osd_xinfo_t> osd_xinfo;
+  std::tr1::shared_ptr< vector<osd_xinfo_t> > osd_xinfo;
 
   hash_map<entity_addr_t,utime_t> blacklist;
 
@@ -219,13 +224,19 @@ private:
   friend class MDS;
 
  public:
+  MEMPOOL_CLASS_HELPERS(mempool_osdmap)
+
   OSDMap() : epoch(0), 
 	     pool_max(-1),
 	     flags(0),
 	     num_osd(0), max_osd(0),
+	     osd_state(new vector<uint8_t>),
 	     osd_addrs(new addrs_s),
+	     osd_weight(new vector<__u32>),
+	     osd_info(new vector<osd_info_t>),
 	     pg_temp(new map<pg_t,vector<int> >),
 	     osd_uuid(new vector<uuid_d>),
+	     osd_xinfo(new vector<osd_xinfo_t>),
 	     cluster_snapshot_epoch(0),
 	     new_blacklist_entries(false),
 	     crush(new CrushWrapper) {
@@ -277,30 +288,36 @@ private:
 
   int get_state(int o) const {
     assert(o < max_osd);
-    return osd_state[o];
+    return (*osd_state)[o];
   }
   int get_state(int o, set<string>& st) const {
     assert(o < max_osd);
-    unsigned t = osd_state[o];
+    unsigned t = (*osd_state)[o];
     calc_state_set(t, st);
-    return osd_state[o];
+    return (*osd_state)[o];
   }
   void set_state(int o, unsigned s) {
     assert(o < max_osd);
-    osd_state[o] = s;
+    cow(osd_state);
+    (*osd_state)[o] = s;
+    pg_mappings.clear();
   }
   void set_weightf(int o, float w) {
     set_weight(o, (int)((float)CEPH_OSD_IN * w));
   }
   void set_weight(int o, unsigned w) {
     assert(o < max_osd);
-    osd_weight[o] = w;
-    if (w)
-      osd_state[o] |= CEPH_OSD_EXISTS;
+    cow(osd_weight);
+    (*osd_weight)[o] = w;
+    pg_mappings.clear();
+    if (w) {
+      cow(osd_state);
+      (*osd_state)[o] |= CEPH_OSD_EXISTS;
+    }
   }
   unsigned get_weight(int o) const {
     assert(o < max_osd);
-    return osd_weight[o];
+    return (*osd_weight)[o];
   }
   float get_weightf(int o) const {
     return (float)get_weight(o) / (float)CEPH_OSD_IN;
@@ -309,11 +326,11 @@ private:
 
   bool exists(int osd) const {
     //assert(osd >= 0);
-    return osd >= 0 && osd < max_osd && (osd_state[osd] & CEPH_OSD_EXISTS);
+    return osd >= 0 && osd < max_osd && ((*osd_state)[osd] & CEPH_OSD_EXISTS);
   }
 
   bool is_up(int osd) const {
-    return exists(osd) && (osd_state[osd] & CEPH_OSD_UP);
+    return exists(osd) && ((*osd_state)[osd] & CEPH_OSD_UP);
   }
 
   bool is_down(int osd) const {
@@ -386,24 +403,24 @@ private:
 
   const epoch_t& get_up_from(int osd) const {
     assert(exists(osd));
-    return osd_info[osd].up_from;
+    return (*osd_info)[osd].up_from;
   }
   const epoch_t& get_up_thru(int osd) const {
     assert(exists(osd));
-    return osd_info[osd].up_thru;
+    return (*osd_info)[osd].up_thru;
   }
   const epoch_t& get_down_at(int osd) const {
     assert(exists(osd));
-    return osd_info[osd].down_at;
+    return (*osd_info)[osd].down_at;
   }
   const osd_info_t& get_info(int osd) const {
     assert(osd < max_osd);
-    return osd_info[osd];
+    return (*osd_info)[osd];
   }
 
   const osd_xinfo_t& get_xinfo(int osd) const {
     assert(osd < max_osd);
-    return osd_xinfo[osd];
+    return (*osd_xinfo)[osd];
   }
   
   int get_any_up_osd() const {
@@ -450,6 +467,15 @@ private:
   /// try to re-use/reference addrs in oldmap from newmap
   static void dedup(const OSDMap *oldmap, OSDMap *newmap);
 
+private:
+  /// get a private copy of a member we share with other maps, to change it
+  template <class T>
+  static void cow(std::tr1::shared_ptr<T>& p) {
+    if (!p.unique())
+      p.reset(new T(*p));
+  }
+public:
+
   // serialize, unserialize
 private:
   void encode_client_old(bufferlist& bl) const;
@@ -487,9 +513,18 @@ public:
   }
 
 private:
-  /// pg -> (raw osd list)
+  /// crush mappings of all of a pool's pgs, by pgp_num-folded ps
+  typedef vector< vector<int> > pool_mappings_t;
+  /// pool -> its precomputed mappings; shared with maps copied from us
+  map<int64_t, std::tr1::shared_ptr<const pool_mappings_t> > pg_mappings;
+
+  /// pg -> (raw osd list), from pg_mappings if we have them
   int _pg_to_osds(const pg_pool_t& pool, pg_t pg, vector<int>& osds) const;
+  /// pg -> (raw osd list), running crush
+  int _crush_pg_to_osds(const pg_pool_t& pool, pg_t pg, vector<int>& osds) const;
   void _remove_nonexistent_osds(vector<int>& osds) const;
+  /// drop the precomputed mappings apply_incremental(inc) would make stale
+  void _invalidate_pg_mappings(const Incremental& inc);
 
   /// pg -> (up osd list)
   void _raw_to_up_osds(pg_t pg, vector<int>& raw, vector<int>& up) const;
@@ -497,8 +532,21 @@ private:
   bool _raw_to_temp_osds(const pg_pool_t& pool, pg_t pg, vector<int>& raw, vector<int>& temp) const;
 
 public:
+  /**
+   * run crush for every pg of the pools we have no mappings for yet, so
+   * that the pg_to_*() calls below are table lookups.  the mappings stay
+   * valid across incrementals that only change osd up/down state or
+   * pg_temp, and are shared with maps copied from this one.
+   */
+  void precompute_pg_mappings();
+  bool have_pg_mappings(int64_t pool) const {
+    return pg_mappings.count(pool);
+  }
+
   int pg_to_osds(pg_t pg, vector<int>& raw) const;
   int pg_to_acting_osds(pg_t pg, vector<int>& acting) const;
+  /// acting, plus the raw crush mapping it came from (down osds included)
+  int pg_to_raw_acting_osds(pg_t pg, vector<int>& raw, vector<int>& acting) const;
   void pg_to_raw_up(pg_t pg, vector<int>& up) const;
   void pg_to_up_acting_osds(pg_t pg, vector<int>& up, vector<int>& acting) const;
 
@@ -0,0 +1,129 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "ObjectContextCache.h"
+#include "OSD.h"
+
+#include "common/mempool.h"
+#include "common/perf_counters.h"
+
+uint64_t ObjectContextCache::estimate_bytes(const ObjectContextRef &obc)
+{
+  const object_info_t &oi = obc->obs.oi;
+  return sizeof(ObjectContext) + sizeof(Entry) +
+    oi.soid.oid.name.length() + oi.soid.get_key().length() +
+    oi.soid.nspace.length() +
+    oi.watchers.size() * (sizeof(watch_info_t) + sizeof(entity_name_t));
+}
+
+void ObjectContextCache::_remove(std::list<Entry>::iterator p)
+{
+  assert(lock.is_locked());
+  std::map<ReplicatedPG*,
+	   std::map<hobject_t, std::list<Entry>::iterator> >::iterator i =
+    index.find(p->pg);
+  assert(i != index.end());
+  i->second.erase(p->obc->obs.oi.soid);
+  if (i->second.empty())
+    index.erase(i);
+  bytes -= p->bytes;
+  mempool::get_pool(mempool::mempool_osd_obc).adjust_count(
+    -1, -(int64_t)p->bytes);
+  lru.erase(p);
+}
+
+void ObjectContextCache::_trim(ReplicatedPG *pg,
+			       std::list<ObjectContextRef> *out)
+{
+  assert(lock.is_locked());
+  while (bytes > max_bytes && !lru.empty()) {
+    std::list<Entry>::iterator p = lru.end();
+    --p;
+    if (p->pg == pg)
+      out->push_back(p->obc);
+    else
+      evicted[p->pg].push_back(p->obc);
+    _remove(p);
+    if (logger)
+      logger->inc(l_osd_obc_cache_evict);
+  }
+}
+
+void ObjectContextCache::touch(ReplicatedPG *pg, const ObjectContextRef &obc,
+			       std::list<ObjectContextRef> *out)
+{
+  Mutex::Locker l(lock);
+  std::map<hobject_t, std::list<Entry>::iterator> &pgi = index[pg];
+  std::map<hobject_t, std::list<Entry>::iterator>::iterator i =
+    pgi.find(obc->obs.oi.soid);
+  if (i != pgi.end()) {
+    if (i->second->obc == obc) {
+      lru.splice(lru.begin(), lru, i->second);
+      return;
+    }
+    // a new incarnation of the object; forget the old one
+    out->push_back(i->second->obc);
+    _remove(i->second);
+  }
+  Entry e(pg, obc, estimate_bytes(obc));
+  lru.push_front(e);
+  index[pg][obc->obs.oi.soid] = lru.begin();
+  bytes += e.bytes;
+  mempool::get_pool(mempool::mempool_osd_obc).adjust_count(1, e.bytes);
+  _trim(pg, out);
+  if (logger)
+    logger->set(l_osd_obc_cache_bytes, bytes);
+}
+
+void ObjectContextCache::take_evicted(ReplicatedPG *pg,
+				      std::list<ObjectContextRef> *out)
+{
+  Mutex::Locker l(lock);
+  std::map<ReplicatedPG*, std::list<ObjectContextRef> >::iterator i =
+    evicted.find(pg);
+  if (i == evicted.end())
+    return;
+  out->splice(out->end(), i->second);
+  evicted.erase(i);
+}
+
+void ObjectContextCache::clear(ReplicatedPG *pg,
+			       std::list<ObjectContextRef> *out)
+{
+  Mutex::Locker l(lock);
+  std::map<ReplicatedPG*,
+	   std::map<hobject_t, std::list<Entry>::iterator> >::iterator i =
+    index.find(pg);
+  if (i != index.end()) {
+    std::map<hobject_t, std::list<Entry>::iterator> pgi;
+    pgi.swap(i->second);
+    index.erase(i);
+    for (std::map<hobject_t, std::list<Entry>::iterator>::iterator j =
+	   pgi.begin();
+	 j != pgi.end();
+	 ++j) {
+      out->push_back(j->second->obc);
+      bytes -= j->second->bytes;
+      mempool::get_pool(mempool::mempool_osd_obc).adjust_count(
+	-1, -(int64_t)j->second->bytes);
+      lru.erase(j->second);
+    }
+  }
+  std::map<ReplicatedPG*, std::list<ObjectContextRef> >::iterator e =
+    evicted.find(pg);
+  if (e != evicted.end()) {
+    out->splice(out->end(), e->second);
+    evicted.erase(e);
+  }
+  if (logger)
+    logger->set(l_osd_obc_cache_bytes, bytes);
+}
@@ -0,0 +1,85 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_OBJECTCONTEXTCACHE_H
+#define CEPH_OSD_OBJECTCONTEXTCACHE_H
+
+#include <list>
+#include <map>
+
+#include "common/Mutex.h"
+#include "osd_types.h"
+
+class PerfCounters;
+class ReplicatedPG;
+
+/**
+ * Keeps the most recently used object contexts of all PGs on an OSD
+ * alive, up to osd_obc_cache_max_bytes.
+ *
+ * A PG's object_contexts registry only finds an obc while something
+ * holds a reference to it; otherwise object_info_t and the SnapSet are
+ * decoded from xattrs again.  This holds those references.
+ *
+ * Dropping the last reference to an obc runs its PG's destructor
+ * callback, which needs that PG's lock.  So an obc is only released
+ * right away when its own PG made room.  Obcs of other PGs are set
+ * aside instead, and their PG releases them in take_evicted() the next
+ * time it uses the cache.
+ */
+class ObjectContextCache {
+  struct Entry {
+    ReplicatedPG *pg;
+    ObjectContextRef obc;
+    uint64_t bytes;
+    Entry(ReplicatedPG *pg, ObjectContextRef obc, uint64_t bytes)
+      : pg(pg), obc(obc), bytes(bytes) {}
+  };
+
+  Mutex lock;
+  uint64_t max_bytes, bytes;
+  PerfCounters *&logger;
+  std::list<Entry> lru;  ///< most recently used first
+  std::map<ReplicatedPG*,
+	   std::map<hobject_t, std::list<Entry>::iterator> > index;
+  /// references to drop under the owning PG's lock
+  std::map<ReplicatedPG*, std::list<ObjectContextRef> > evicted;
+
+  static uint64_t estimate_bytes(const ObjectContextRef &obc);
+  void _remove(std::list<Entry>::iterator p);
+  void _trim(ReplicatedPG *pg, std::list<ObjectContextRef> *out);
+
+public:
+  ObjectContextCache(uint64_t max_bytes, PerfCounters *&logger)
+    : lock("ObjectContextCache::lock"), max_bytes(max_bytes), bytes(0),
+      logger(logger) {}
+  ~ObjectContextCache() {
+    assert(lru.empty());
+  }
+
+  /**
+   * mark @obc of @pg most recently used, adding it if needed
+   *
+   * Anything made room for is appended to @out, to be dropped by the
+   * caller once the cache lock is gone.  The pg lock must be held.
+   */
+  void touch(ReplicatedPG *pg, const ObjectContextRef &obc,
+	     std::list<ObjectContextRef> *out);
+
+  /// take the obcs of @pg evicted on behalf of other PGs
+  void take_evicted(ReplicatedPG *pg, std::list<ObjectContextRef> *out);
+
+  /// forget everything of @pg, e.g. on an interval change
+  void clear(ReplicatedPG *pg, std::list<ObjectContextRef> *out);
+};
+
+#endif
@@ -13,6 +13,7 @@
 #include "osd/osd_types.h"
 
 
+ObjectPool OpRequest::alloc_pool("OpRequest", sizeof(OpRequest));
 
 OpRequest::OpRequest(Message *req, OpTracker *tracker) :
   TrackedOp(req, tracker),
@@ -38,12 +39,13 @@ void OpRequest::_dump(utime_t now, Formatter *f) const
   }
   {
     f->open_array_section("events");
-    for (list<pair<utime_t, string> >::const_iterator i = events.begin();
+    Spinlock::Locker l(lock);
+    for (vector<Event>::const_iterator i = events.begin();
 	 i != events.end();
 	 ++i) {
       f->open_object_section("event");
-      f->dump_stream("time") << i->first;
-      f->dump_string("event", i->second);
+      f->dump_stream("time") << i->stamp;
+      f->dump_string("event", i->str());
       f->close_section();
     }
     f->close_section();
@@ -23,6 +23,8 @@
 #include "msg/Message.h"
 #include <tr1/memory>
 #include "common/TrackedOp.h"
+#include "common/ObjectPool.h"
+#include "osd/ClassHandler.h"
 
 /**
  * osd request identifier
@@ -70,6 +72,14 @@ struct OpRequest : public TrackedOp {
   void set_class_write();
   void set_pg_op();
 
+  /// the methods of the op's CALLs, by op index, as init_op_flags() found
+  /// them; NULL for the other ops
+  vector<ClassHandler::ClassMethod*> cls_methods;
+
+  ClassHandler::ClassMethod *get_cls_method(unsigned i) const {
+    return i < cls_methods.size() ? cls_methods[i] : NULL;
+  }
+
   void _dump(utime_t now, Formatter *f) const;
 
 private:
@@ -86,6 +96,9 @@ private:
   OpRequest(Message *req, OpTracker *tracker);
 
 public:
+  static ObjectPool alloc_pool;
+  OBJECT_POOL_ALLOCATOR(alloc_pool)
+
   bool been_queued_for_pg() { return hit_flag_points & flag_queued_for_pg; }
   bool been_reached_pg() { return hit_flag_points & flag_reached_pg; }
   bool been_delayed() { return hit_flag_points & flag_delayed; }
@@ -114,17 +127,17 @@ public:
 
   void mark_queued_for_pg() {
     mark_event("queued_for_pg");
-    current = "queued for pg";
+    current.clear();
     hit_flag_points |= flag_queued_for_pg;
     latest_flag_point = flag_queued_for_pg;
   }
   void mark_reached_pg() {
     mark_event("reached_pg");
-    current = "reached pg";
+    current.clear();
     hit_flag_points |= flag_reached_pg;
     latest_flag_point = flag_reached_pg;
   }
-  void mark_delayed(string s) {
+  void mark_delayed(const string &s) {
     mark_event(s);
     current = s;
     hit_flag_points |= flag_delayed;
@@ -132,11 +145,11 @@ public:
   }
   void mark_started() {
     mark_event("started");
-    current = "started";
+    current.clear();
     hit_flag_points |= flag_started;
     latest_flag_point = flag_started;
   }
-  void mark_sub_op_sent(string s) {
+  void mark_sub_op_sent(const string &s) {
     mark_event(s);
     current = s;
     hit_flag_points |= flag_sub_op_sent;
@@ -144,7 +157,7 @@ public:
   }
   void mark_commit_sent() {
     mark_event("commit_sent");
-    current = "commit sent";
+    current.clear();
     hit_flag_points |= flag_commit_sent;
     latest_flag_point = flag_commit_sent;
   }
@@ -33,10 +33,16 @@
 #include "messages/MOSDPGPush.h"
 #include "messages/MOSDPGPushReply.h"
 #include "messages/MOSDPGPull.h"
+#include "messages/MOSDPGSnapTrim.h"
 
 #include "messages/MOSDSubOp.h"
 #include "messages/MOSDSubOpReply.h"
 #include "common/BackTrace.h"
+#include "common/SloppyCRCMap.h"
+
+extern "C" {
+#include "crush/hash.h"
+}
 
 #include <sstream>
 
@@ -160,9 +166,11 @@ PG::PG(OSDService *o, OSDMapRef curmap,
   info(p),
   info_struct_v(0),
   coll(p), pg_log(cct), log_oid(loid), biginfo_oid(ioid),
-  recovery_item(this), scrub_item(this), scrub_finalize_item(this), snap_trim_item(this), stat_queue_item(this),
+  snap_trim_queued(false),
+  recovery_item(this), scrub_item(this), scrub_finalize_item(this), agent_item(this), stat_queue_item(this),
   recovery_ops_active(0),
   waiting_on_backfill(0),
+  peer_backfill_prefetching(false),
   role(0),
   state(0),
   send_notify(false),
@@ -183,6 +191,7 @@ PG::PG(OSDService *o, OSDMapRef curmap,
 #ifdef PG_DEBUG_REFS
   osd->add_pgid(p, this);
 #endif
+  pg_log.set_bytes_total(&osd->pg_log_bytes);
 }
 
 PG::~PG()
@@ -754,7 +763,8 @@ void PG::clear_primary_state()
   scrub_after_recovery = false;
 
   osd->recovery_wq.dequeue(this);
-  osd->snap_trim_wq.dequeue(this);
+  snap_trim_queued = false;  // a pass still queued gets discarded
+  osd->agent_wq.dequeue(this);
 }
 
 /**
@@ -1136,6 +1146,17 @@ void PG::activate(ObjectStore::Transaction& t,
   state_set(PG_STATE_ACTIVE);
   state_clear(PG_STATE_DOWN);
 
+  // let the store get ready for the next pg_num increase in the
+  // background, so that the split then blocks us for less time
+  if (cct->_conf->osd_split_prepare_bits > 0) {
+    unsigned bits = info.pgid.get_split_bits(pool.info.get_pg_num()) +
+      cct->_conf->osd_split_prepare_bits;
+    int r = osd->store->prepare_split_collection(coll, bits);
+    if (r < 0 && r != -EOPNOTSUPP && r != -ENOENT)
+      dout(10) << "activate prepare_split_collection " << bits << " bits: "
+	       << cpp_strerror(r) << dendl;
+  }
+
   send_notify = false;
 
   info.last_epoch_started = query_epoch;
@@ -1495,10 +1516,13 @@ void PG::all_activated_and_committed()
 
 void PG::queue_snap_trim()
 {
-  if (osd->queue_for_snap_trim(this))
-    dout(10) << "queue_snap_trim -- queuing" << dendl;
-  else
-    dout(10) << "queue_snap_trim -- already trimming" << dendl;
+  if (snap_trim_queued) {
+    dout(10) << "queue_snap_trim -- already queued" << dendl;
+    return;
+  }
+  dout(10) << "queue_snap_trim -- queuing" << dendl;
+  snap_trim_queued = true;
+  queue_op(osd->new_snap_trim_op(info.pgid, get_osdmap()->get_epoch()));
 }
 
 bool PG::queue_scrub()
@@ -1509,6 +1533,8 @@ bool PG::queue_scrub()
   }
   scrubber.must_scrub = false;
   state_set(PG_STATE_SCRUBBING);
+  // a pass somebody asked for starts over; a scheduled one may resume
+  scrubber.deep_resumable = !scrubber.must_deep_scrub && !scrubber.must_repair;
   if (scrubber.must_deep_scrub) {
     state_set(PG_STATE_DEEP_SCRUB);
     scrubber.must_deep_scrub = false;
@@ -1749,6 +1775,7 @@ void PG::clear_recovery_state()
   backfill_info.clear();
   peer_backfill_info.clear();
   waiting_on_backfill = false;
+  peer_backfill_prefetching = false;
   _clear_recovery_state();  // pg impl specific hook
 }
 
@@ -2554,6 +2581,36 @@ void PG::requeue_ops(list<OpRequestRef> &ls)
  *     osd->scrubber.active++
  */
 
+/*
+ * When the next deep scrub is due.
+ *
+ * Left alone, pgs created together deep scrub together forever after.
+ * With osd_deep_scrub_spread each pg instead gets a fixed slot in the
+ * interval, derived from its id, and is due at the first slot at least
+ * half an interval after its last deep scrub.  The gap between two deep
+ * scrubs stays between half and one and a half intervals, and is the
+ * whole interval once the pg has settled in its slot.
+ */
+utime_t PG::deep_scrub_due() const
+{
+  double interval = cct->_conf->osd_deep_scrub_interval;
+  utime_t last = info.history.last_deep_scrub_stamp;
+  if (!cct->_conf->osd_deep_scrub_spread || interval <= 0) {
+    last += interval;
+    return last;
+  }
+  uint32_t h = crush_hash32_2(CRUSH_HASH_RJENKINS1,
+			      info.pgid.ps(), info.pgid.pool());
+  double slot = interval * ((double)h / 4294967296.0);
+  double l = (double)last;
+  double due = floor((l - slot) / interval) * interval + slot + interval;
+  if (due - l < interval / 2)
+    due += interval;
+  utime_t ret;
+  ret.set_from_double(due);
+  return ret;
+}
+
 // returns true if a scrub has been newly kicked off
 bool PG::sched_scrub()
 {
@@ -2562,8 +2619,9 @@ bool PG::sched_scrub()
     return false;
   }
 
-  bool time_for_deep = (ceph_clock_now(cct) >
-    info.history.last_deep_scrub_stamp + cct->_conf->osd_deep_scrub_interval);
+  // an interrupted deep scrub carries on with the next scrub
+  bool time_for_deep = info.history.has_deep_scrub_resume() ||
+    ceph_clock_now(cct) > deep_scrub_due();
  
   //NODEEP_SCRUB so ignore time initiated deep-scrub
   if (osd->osd->get_osdmap()->test_flag(CEPH_OSDMAP_NODEEP_SCRUB))
@@ -2687,12 +2745,82 @@ void PG::sub_op_scrub_map(OpRequestRef op)
 /* 
  * pg lock may or may not be held
  */
-void PG::_scan_list(
+/*
+ * Take the data digest of an object from the block crcs the store kept
+ * when it was written, reading only the blocks it has no crc for.  The
+ * result is the same digest a full read gives, so replicas doing either
+ * compare fine.
+ *
+ * Stored crcs say nothing about what has happened to the disk since,
+ * so every so often one block that was not read is read back and
+ * checked against its crc.
+ *
+ * @return bytes read, or -errno; -EOPNOTSUPP if the store keeps no crcs
+ */
+int PG::_scan_crc_digest(
+  const hobject_t &poid, uint64_t size, uint32_t *digest,
+  ThreadPool::TPHandle &handle)
+{
+  SloppyCRCMap cm;
+  int r = osd->store->get_crc_map(coll, poid, &cm);
+  if (r < 0)
+    return r;
+  uint64_t bs = cm.get_block_size();
+  uint64_t stride = cct->_conf->osd_deep_scrub_stride;
+  uint32_t crc = 0;
+  uint64_t pos = 0, read = 0, known = 0;
+  while (pos < size) {
+    if (pos + bs <= size && cm.extend_crc32c(pos, &crc)) {
+      pos += bs;
+      ++known;
+      continue;
+    }
+    // read up to the next block we have a crc for
+    uint64_t len = bs ? bs - pos % bs : stride;
+    while (bs && pos + len < size && len < stride && !cm.has_crc(pos + len))
+      len += bs;
+    len = MIN(len, size - pos);
+    bufferlist bl;
+    r = osd->store->read(coll, poid, pos, len, bl, true);
+    if (r < 0)
+      return r;
+    if (r == 0)
+      break;
+    handle.reset_tp_timeout();
+    crc = bl.crc32c(crc);
+    pos += bl.length();
+    read += bl.length();
+  }
+  *digest = crc;
+  dout(25) << __func__ << " " << poid << " " << known << " blocks from crcs, "
+	   << read << " bytes read" << dendl;
+
+  if (known && (double)rand() / RAND_MAX <
+      cct->_conf->osd_deep_scrub_crc_verify_ratio) {
+    uint64_t off = (rand() % (size / bs)) * bs;
+    if (cm.has_crc(off)) {
+      bufferlist bl;
+      r = osd->store->read(coll, poid, off, bs, bl, true);
+      if (r < 0)
+	return r;
+      ostringstream ss;
+      if (cm.read(off, bs, bl, &ss)) {
+	derr << __func__ << " " << poid << " bad crc: " << ss.str() << dendl;
+	return -EIO;
+      }
+      read += bl.length();
+    }
+  }
+  return read;
+}
+
+uint64_t PG::_scan_list(
   ScrubMap &map, vector<hobject_t> &ls, bool deep,
   ThreadPool::TPHandle &handle)
 {
   dout(10) << "_scan_list scanning " << ls.size() << " objects"
            << (deep ? " deeply" : "") << dendl;
+  uint64_t bytes_read = 0;
   int i = 0;
   for (vector<hobject_t>::iterator p = ls.begin(); 
        p != ls.end(); 
@@ -2712,22 +2840,30 @@ void PG::_scan_list(
       if (deep) {
         bufferhash h, oh;
         bufferlist bl, hdrbl;
-        int r;
-        __u64 pos = 0;
-        while ( (r = osd->store->read(coll, poid, pos,
-                                       cct->_conf->osd_deep_scrub_stride, bl,
-		                      true)) > 0) {
-	  handle.reset_tp_timeout();
-          h << bl;
-          pos += bl.length();
-          bl.clear();
-        }
+        int r = -EOPNOTSUPP;
+	if (cct->_conf->osd_deep_scrub_crc_map) {
+	  r = _scan_crc_digest(poid, o.size, &o.digest, handle);
+	  if (r >= 0)
+	    bytes_read += r;
+	}
+	if (r < 0 && r != -EIO) {
+	  __u64 pos = 0;
+	  while ( (r = osd->store->read(coll, poid, pos,
+					cct->_conf->osd_deep_scrub_stride, bl,
+					true)) > 0) {
+	    handle.reset_tp_timeout();
+	    h << bl;
+	    pos += bl.length();
+	    bl.clear();
+	  }
+	  bytes_read += pos;
+	  o.digest = h.digest();
+	}
 	if (r == -EIO) {
 	  dout(25) << "_scan_list  " << poid << " got "
 		   << r << " on read, read_error" << dendl;
 	  o.read_error = true;
 	}
-        o.digest = h.digest();
         o.digest_present = true;
 
         bl.clear();
@@ -2787,6 +2923,7 @@ void PG::_scan_list(
       assert(0);
     }
   }
+  return bytes_read;
 }
 
 // send scrub v2-compatible messages (classic scrub)
@@ -3051,11 +3188,15 @@ int PG::build_scrub_map_chunk(
     return ret;
   }
 
-  _scan_list(map, ls, deep, handle);
+  // only a deep scrub reads the data
+  uint64_t bytes = _scan_list(map, ls, deep, handle);
   _scan_snaps(map);
 
   // pg attrs
   osd->store->collection_getattrs(coll, map.attrs);
+
+  osd->recovery_budget.charge(0, bytes);
+  osd->scrub_budget.charge(0, bytes);
   dout(10) << __func__ << " done." << dendl;
 
   return 0;
@@ -3547,6 +3688,20 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	}
 
         scrubber.start = hobject_t();
+	scrubber.deep_start = ceph_clock_now(cct);
+	scrubber.deep_checkpoint = scrubber.deep_start;
+	if (!scrubber.deep || info.stats.stats_invalid)
+	  scrubber.deep_resumable = false;
+	if (scrubber.deep_resumable && info.history.has_deep_scrub_resume()) {
+	  dout(10) << "scrub resuming deep scrub started "
+		   << info.history.deep_scrub_resume_stamp
+		   << " at " << info.history.deep_scrub_resume << dendl;
+	  scrubber.deep_resumed = true;
+	  scrubber.start = info.history.deep_scrub_resume;
+	  scrubber.deep_start = info.history.deep_scrub_resume_stamp;
+	  scrubber.shallow_errors = info.history.deep_scrub_resume_shallow_errors;
+	  scrubber.deep_errors = info.history.deep_scrub_resume_deep_errors;
+	}
         scrubber.state = PG::Scrubber::NEW_CHUNK;
 
         break;
@@ -3690,6 +3845,8 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
         if (scrubber.end < hobject_t::get_max()) {
           // schedule another leg of the scrub
           scrubber.start = scrubber.end;
+	  if (scrubber.deep_resumable)
+	    scrub_checkpoint();
 
           scrubber.state = PG::Scrubber::NEW_CHUNK;
           osd->scrub_wq.queue(this);
@@ -3713,6 +3870,35 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
   }
 }
 
+/*
+ * Persist how far a scheduled deep scrub got every
+ * osd_deep_scrub_checkpoint_interval, so that it picks up from there
+ * after a restart or a change of interval.  Peers learn about it with
+ * the rest of the history when they next peer.
+ */
+void PG::scrub_checkpoint()
+{
+  assert(_lock.is_locked());
+  utime_t now = ceph_clock_now(cct);
+  if ((double)(now - scrubber.deep_checkpoint) <
+      cct->_conf->osd_deep_scrub_checkpoint_interval)
+    return;
+  scrubber.deep_checkpoint = now;
+
+  dout(10) << __func__ << " deep scrub started " << scrubber.deep_start
+	   << " done up to " << scrubber.start << dendl;
+  info.history.deep_scrub_resume = scrubber.start;
+  info.history.deep_scrub_resume_stamp = scrubber.deep_start;
+  info.history.deep_scrub_resume_shallow_errors = scrubber.shallow_errors;
+  info.history.deep_scrub_resume_deep_errors = scrubber.deep_errors;
+
+  ObjectStore::Transaction *t = new ObjectStore::Transaction;
+  dirty_info = true;
+  write_if_dirty(*t);
+  int tr = osd->store->queue_transaction(osr.get(), t);
+  assert(tr == 0);
+}
+
 void PG::scrub_clear_state()
 {
   assert(_lock.is_locked());
@@ -4160,7 +4346,10 @@ void PG::scrub_finish()
   info.history.last_scrub_stamp = now;
   if (scrubber.deep) {
     info.history.last_deep_scrub = info.last_update;
-    info.history.last_deep_scrub_stamp = now;
+    // a resumed pass only vouches for the objects since it first started
+    info.history.last_deep_scrub_stamp =
+      scrubber.deep_resumed ? scrubber.deep_start : now;
+    info.history.clear_deep_scrub_resume();
   }
   // Since we don't know which errors were fixed, we can only clear them
   // when every one has been fixed.
@@ -4830,6 +5019,9 @@ bool PG::can_discard_request(OpRequestRef op)
 
   case MSG_OSD_PG_BACKFILL:
     return can_discard_backfill(op);
+
+  case MSG_OSD_PG_SNAPTRIM:
+    return can_discard_replica_op<MOSDPGSnapTrim, MSG_OSD_PG_SNAPTRIM>(op);
   }
   return true;
 }
@@ -4886,6 +5078,11 @@ bool PG::op_must_wait_for_map(OSDMapRef curmap, OpRequestRef op)
     return !have_same_or_newer_map(
       curmap,
       static_cast<MOSDPGPushReply*>(op->get_req())->map_epoch);
+
+  case MSG_OSD_PG_SNAPTRIM:
+    return !have_same_or_newer_map(
+      curmap,
+      static_cast<MOSDPGSnapTrim*>(op->get_req())->map_epoch);
   }
   assert(0);
   return false;
@@ -308,12 +308,14 @@ public:
   map<epoch_t,pg_interval_t> past_intervals;
 
   interval_set<snapid_t> snap_trimq;
+  bool snap_trim_queued;  ///< a snap trim pass is in the op queue
 
   /* You should not use these items without taking their respective queue locks
    * (if they have one) */
-  xlist<PG*>::item recovery_item, scrub_item, scrub_finalize_item, snap_trim_item, stat_queue_item;
+  xlist<PG*>::item recovery_item, scrub_item, scrub_finalize_item, agent_item, stat_queue_item;
   int recovery_ops_active;
   bool waiting_on_backfill;
+  bool peer_backfill_prefetching;  ///< scan past peer_backfill_info.end in flight
 #ifdef DEBUG_RECOVERY_OIDS
   set<hobject_t> recovering_oids;
 #endif
@@ -702,7 +704,7 @@ public:
       must_scrub(false), must_deep_scrub(false), must_repair(false),
       classic(false),
       finalizing(false), is_chunky(false), state(INACTIVE),
-      deep(false)
+      deep(false), deep_resumable(false), deep_resumed(false)
     {
     }
 
@@ -759,6 +761,10 @@ public:
 
     // deep scrub
     bool deep;
+    bool deep_resumable;     ///< persist progress so the pass can resume
+    bool deep_resumed;       ///< picked up where an earlier pass stopped
+    utime_t deep_start;      ///< when this pass first started
+    utime_t deep_checkpoint; ///< when progress was last persisted
 
     list<Context*> callbacks;
     void add_callback(Context *context) {
@@ -834,6 +840,10 @@ public:
       deep_errors = 0;
       fixed = 0;
       deep = false;
+      deep_resumable = false;
+      deep_resumed = false;
+      deep_start = utime_t();
+      deep_checkpoint = utime_t();
       run_callbacks();
       inconsistent.clear();
       missing.clear();
@@ -872,9 +882,13 @@ public:
   void scrub_process_inconsistent();
   void scrub_finalize();
   void scrub_finish();
+  void scrub_checkpoint();
   void scrub_clear_state();
   bool scrub_gather_replica_maps();
-  void _scan_list(
+  int _scan_crc_digest(
+    const hobject_t &poid, uint64_t size, uint32_t *digest,
+    ThreadPool::TPHandle &handle);
+  uint64_t _scan_list(
     ScrubMap &map, vector<hobject_t> &ls, bool deep,
     ThreadPool::TPHandle &handle);
   void _scan_snaps(ScrubMap &map);
@@ -906,6 +920,7 @@ public:
   void scrub_reserve_replicas();
   void scrub_unreserve_replicas();
   bool scrub_all_replicas_reserved() const;
+  utime_t deep_scrub_due() const;
   bool sched_scrub();
   void reg_next_scrub();
   void unreg_next_scrub();
@@ -1827,6 +1842,7 @@ public:
   ) = 0;
   virtual void do_backfill(OpRequestRef op) = 0;
   virtual void snap_trimmer() = 0;
+  virtual void agent_work(ThreadPool::TPHandle &handle) = 0;
 
   virtual int do_command(cmdmap_t cmdmap, ostream& ss,
 			 bufferlist& idata, bufferlist& odata) = 0;
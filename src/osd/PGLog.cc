@@ -76,6 +76,7 @@ void PGLog::IndexedLog::trim(eversion_t s, set<eversion_t> *trimmed)
     if (trimmed)
       trimmed->insert(e.version);
     unindex(e);         // remove from index,
+    account(-(int64_t)entry_bytes(e), -1);
     log.pop_front();    // from log
   }
 
@@ -420,6 +421,7 @@ void PGLog::merge_log(ObjectStore::Transaction& t,
       if (to->version > log.tail)
 	break;
       log.index(*to);
+      log.account(PGLog::IndexedLog::entry_bytes(*to), 1);
       dout(15) << *to << dendl;
     }
       
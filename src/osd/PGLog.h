@@ -22,6 +22,8 @@
 #include "osd_types.h"
 #include "os/ObjectStore.h"
 #include "common/ceph_context.h"
+#include "include/atomic.h"
+#include "common/mempool.h"
 #include <list>
 using namespace std;
 
@@ -53,8 +55,48 @@ struct PGLog {
     list<pg_log_entry_t>::iterator complete_to;  // not inclusive of referenced item
     version_t last_requested;           // last object requested by primary
 
+    uint64_t bytes;         ///< approximate memory held by the entries
+    uint64_t items;         ///< entries accounted in bytes
+    atomic_t *bytes_total;  ///< shared account to keep bytes in, if any
+
     /****/
-    IndexedLog() : last_requested(0) {}
+    IndexedLog() : last_requested(0), bytes(0), items(0), bytes_total(NULL) {}
+    ~IndexedLog() {
+      account(-(int64_t)bytes, -(int64_t)items);
+    }
+
+    static uint64_t entry_bytes(const pg_log_entry_t &e) {
+      return sizeof(e) + 2 * sizeof(void*) +  // list node
+	e.soid.oid.name.length() + e.soid.get_key().length() +
+	e.soid.nspace.length() + e.snaps.length() +
+	e.dirty_extents.num_intervals() *   // map nodes
+	(2 * sizeof(uint64_t) + 4 * sizeof(void*));
+    }
+    void account(int64_t delta, int64_t nitems) {
+      bytes += delta;
+      items += nitems;
+      if (bytes_total)
+	bytes_total->add(delta);
+      mempool::get_pool(mempool::mempool_osd_pglog).adjust_count(nitems, delta);
+    }
+    void set_bytes_total(atomic_t *t) {
+      if (bytes_total)
+	bytes_total->sub(bytes);
+      bytes_total = t;
+      if (bytes_total)
+	bytes_total->add(bytes);
+    }
+
+    /**
+     * let @e share the name strings of the entry already indexed for
+     * the same object, so a hot object costs its name only once where
+     * std::string is reference counted
+     */
+    void intern(pg_log_entry_t &e) {
+      hash_map<hobject_t,pg_log_entry_t*>::iterator p = objects.find(e.soid);
+      if (p != objects.end() && p->second != &e)
+	e.soid = p->second->soid;
+    }
 
     void claim_log(const pg_log_t& o) {
       log = o.log;
@@ -71,6 +113,7 @@ struct PGLog {
     void zero() {
       unindex();
       pg_log_t::clear();
+      account(-(int64_t)bytes, -(int64_t)items);
       reset_recovery_pointers();
     }
     void reset_recovery_pointers() {
@@ -94,15 +137,20 @@ struct PGLog {
     void index() {
       objects.clear();
       caller_ops.clear();
+      int64_t b = 0, n = 0;
       for (list<pg_log_entry_t>::iterator i = log.begin();
            i != log.end();
            ++i) {
+	intern(*i);
+	b += entry_bytes(*i);
+	n++;
         objects[i->soid] = &(*i);
 	if (i->reqid_is_indexed()) {
 	  //assert(caller_ops.count(i->reqid) == 0);  // divergent merge_log indexes new before unindexing old
 	  caller_ops[i->reqid] = &(*i);
 	}
       }
+      account(b - (int64_t)bytes, n - (int64_t)items);
     }
 
     void index(pg_log_entry_t& e) {
@@ -135,6 +183,8 @@ struct PGLog {
       assert(e.version > head);
       assert(head.version == 0 || e.version.version > head.version);
       head = e.version;
+      intern(log.back());
+      account(entry_bytes(log.back()), 1);
 
       // to our index
       objects[e.soid] = &(log.back());
@@ -291,6 +341,10 @@ public:
 
   void unindex() { log.unindex(); }
 
+  /// keep the memory held by the log in @t as well
+  void set_bytes_total(atomic_t *t) { log.set_bytes_total(t); }
+  uint64_t get_log_bytes() const { return log.bytes; }
+
   void add(pg_log_entry_t& e) {
     mark_writeout_from(e.version);
     log.add(e);
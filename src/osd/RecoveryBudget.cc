@@ -0,0 +1,149 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "RecoveryBudget.h"
+
+#include "common/Clock.h"
+#include "common/ceph_context.h"
+#include "common/config.h"
+#include "common/debug.h"
+#include "include/intarith.h"
+
+#define dout_subsys ceph_subsys_osd
+#undef dout_prefix
+#define dout_prefix *_dout << "recovery_budget "
+
+RecoveryBudget::RecoveryBudget(CephContext *cct,
+			       rate_option_t ops_option,
+			       rate_option_t bytes_option)
+  : cct(cct), ops_option(ops_option), bytes_option(bytes_option),
+    lock("RecoveryBudget::lock"),
+    fraction(1.0), ops(0), bytes(0)
+{
+}
+
+double RecoveryBudget::max_ops() const
+{
+  return ops_option ? cct->_conf->*ops_option : 0;
+}
+
+double RecoveryBudget::max_bytes() const
+{
+  return bytes_option ? cct->_conf->*bytes_option : 0;
+}
+
+bool RecoveryBudget::is_limited() const
+{
+  return max_ops() > 0 || max_bytes() > 0;
+}
+
+void RecoveryBudget::_refill(utime_t now)
+{
+  assert(lock.is_locked());
+  double ops_rate = max_ops() * fraction;
+  double bytes_rate = max_bytes() * fraction;
+  if (last.is_zero() || now < last) {
+    last = now;
+    ops = ops_rate;
+    bytes = bytes_rate;
+    return;
+  }
+  double elapsed = now - last;
+  last = now;
+  ops = MIN(ops + elapsed * ops_rate, ops_rate);
+  bytes = MIN(bytes + elapsed * bytes_rate, bytes_rate);
+}
+
+bool RecoveryBudget::_available(utime_t now, utime_t *next)
+{
+  assert(lock.is_locked());
+  _refill(now);
+  double ops_rate = max_ops() * fraction;
+  double bytes_rate = max_bytes() * fraction;
+  bool ops_ok = ops_rate <= 0 || ops > 0;
+  bool bytes_ok = bytes_rate <= 0 || bytes >= 0;
+  if (ops_ok && bytes_ok)
+    return true;
+  double wait = 0;
+  if (!ops_ok)
+    wait = MAX(wait, (1 - ops) / ops_rate);
+  if (!bytes_ok)
+    wait = MAX(wait, -bytes / bytes_rate);
+  if (next) {
+    *next = now;
+    *next += MAX(wait, 0.001);
+  }
+  return false;
+}
+
+bool RecoveryBudget::available(utime_t now, utime_t *next)
+{
+  if (!is_limited())
+    return true;
+  Mutex::Locker l(lock);
+  return _available(now, next);
+}
+
+bool RecoveryBudget::get(uint64_t len, utime_t now, utime_t *next)
+{
+  if (!is_limited())
+    return true;
+  Mutex::Locker l(lock);
+  if (!_available(now, next))
+    return false;
+  if (max_ops() > 0)
+    ops -= 1;
+  if (max_bytes() > 0)
+    bytes -= len;
+  return true;
+}
+
+void RecoveryBudget::charge(uint64_t nops, uint64_t len)
+{
+  if (!is_limited())
+    return;
+  Mutex::Locker l(lock);
+  if (max_ops() > 0)
+    ops -= nops;
+  if (max_bytes() > 0)
+    bytes -= len;
+}
+
+void RecoveryBudget::update(double latency, uint64_t nops)
+{
+  double target = cct->_conf->osd_recovery_budget_target_latency;
+  double min_fraction = cct->_conf->osd_recovery_budget_min_fraction;
+  Mutex::Locker l(lock);
+  double old = fraction;
+  if (target <= 0) {
+    fraction = 1.0;
+  } else if (nops && latency > target) {
+    fraction = MAX(fraction / 2, min_fraction);
+  } else {
+    fraction = MIN(fraction + 0.1, 1.0);
+  }
+  if (fraction != old)
+    ldout(cct, 10) << "update client latency " << latency << " over " << nops
+		   << " ops, share " << old << " -> " << fraction << dendl;
+}
+
+void RecoveryBudget::dump(Formatter *f)
+{
+  Mutex::Locker l(lock);
+  f->dump_float("fraction", fraction);
+  f->dump_float("ops_per_sec",
+		max_ops() * fraction);
+  f->dump_float("bytes_per_sec",
+		max_bytes() * fraction);
+  f->dump_float("ops_available", ops);
+  f->dump_float("bytes_available", bytes);
+}
@@ -0,0 +1,99 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_RECOVERYBUDGET_H
+#define CEPH_OSD_RECOVERYBUDGET_H
+
+#include "common/Mutex.h"
+#include "common/Formatter.h"
+#include "include/utime.h"
+#include "common/config.h"
+
+class CephContext;
+
+/**
+ * Shared rate limit for recovery, backfill and scrub on one OSD.
+ *
+ * There is a token bucket for ops and one for bytes.  Each is filled
+ * at its current rate and holds at most one second's worth.  Work may
+ * take more than is left, since its size is often only known once it
+ * is done.  That debt is then paid back before anything else gets
+ * through.
+ *
+ * The current rates move between osd_recovery_budget_min_fraction of
+ * osd_recovery_max_{ops,bytes}_per_sec and the full rates.  update()
+ * is fed the latency of client ops from the OpTracker.  While that
+ * latency is above osd_recovery_budget_target_latency the share is
+ * halved on every update; otherwise it grows back by a tenth.
+ *
+ * Which options hold the full rates can be chosen at construction, so
+ * the same mechanism also caps scrub reads on their own.
+ */
+class RecoveryBudget {
+public:
+  typedef const double md_config_t::*rate_option_t;
+
+private:
+  CephContext *cct;
+  rate_option_t ops_option, bytes_option;  ///< NULL for no limit
+  Mutex lock;
+  double fraction;   ///< share of the configured rates we grant now
+  double ops, bytes; ///< tokens; negative while in debt
+  utime_t last;      ///< when the buckets were last filled
+
+  double max_ops() const;
+  double max_bytes() const;
+  void _refill(utime_t now);
+  bool _available(utime_t now, utime_t *next);
+
+public:
+  RecoveryBudget(
+    CephContext *cct,
+    rate_option_t ops_option = &md_config_t::osd_recovery_max_ops_per_sec,
+    rate_option_t bytes_option = &md_config_t::osd_recovery_max_bytes_per_sec);
+
+  /// false if no rate is configured and get() always succeeds
+  bool is_limited() const;
+
+  /**
+   * whether get() would succeed, without taking anything
+   *
+   * @param now the current time
+   * @param next set to when to retry if the budget is used up
+   */
+  bool available(utime_t now, utime_t *next);
+
+  /**
+   * take one op of @bytes from the budget
+   *
+   * @param now the current time
+   * @param next set to when to retry if the budget is used up
+   * @return true if the op may go ahead
+   */
+  bool get(uint64_t bytes, utime_t now, utime_t *next);
+
+  /// account for work that went ahead regardless
+  void charge(uint64_t nops, uint64_t bytes);
+
+  /**
+   * adapt the rates to how client ops fare
+   *
+   * @param latency the mean client op latency in seconds since the
+   *                last update
+   * @param nops the number of client ops it was measured over
+   */
+  void update(double latency, uint64_t nops);
+
+  void dump(Formatter *f);
+};
+
+#endif
@@ -178,6 +178,9 @@ private:
     ObjectRecoveryInfo recovery_info;
     ObjectContextRef obc;
     object_stat_sum_t stat;
+    unsigned in_flight;  ///< chunks sent but not acked yet
+
+    PushInfo() : in_flight(0) {}
 
     void dump(Formatter *f) const {
       {
@@ -249,7 +252,7 @@ private:
   void do_pull(OpRequestRef op);
   void do_push_reply(OpRequestRef op);
 
-  bool handle_push_reply(int peer, PushReplyOp &op, PushOp *reply);
+  void handle_push_reply(int peer, PushReplyOp &op, vector<PushOp> *replies);
   void handle_pull(int peer, PullOp &op, PushOp *reply);
   bool handle_pull_response(
     int from, PushOp &op, PullOp *response,
@@ -290,6 +293,13 @@ private:
 			map<string, bufferptr> &attrs,
 			map<string, bufferlist> &omap_entries,
 			ObjectStore::Transaction *t);
+  void submit_push_delta(ObjectRecoveryInfo &recovery_info,
+			 const interval_set<uint64_t> &intervals_included,
+			 bufferlist data_included,
+			 bufferlist omap_header,
+			 map<string, bufferptr> &attrs,
+			 map<string, bufferlist> &omap_entries,
+			 ObjectStore::Transaction *t);
   void submit_push_complete(ObjectRecoveryInfo &recovery_info,
 			    ObjectStore::Transaction *t);
 
@@ -317,7 +327,11 @@ private:
 		 eversion_t version,
 		 interval_set<uint64_t> &data_subset,
 		 map<hobject_t, interval_set<uint64_t> >& clone_subsets,
-		 PushOp *op);
+		 PushOp *op,
+		 eversion_t delta_from = eversion_t());
+  bool calc_delta_subset(ObjectContextRef obc, const hobject_t& head, int peer,
+			 eversion_t *delta_from,
+			 interval_set<uint64_t> *data_subset);
   void calc_head_subsets(ObjectContextRef obc, SnapSet& snapset, const hobject_t& head,
 			 const pg_missing_t& missing,
 			 const hobject_t &last_backfill,
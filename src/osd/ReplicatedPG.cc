@@ -42,6 +42,7 @@
 #include "messages/MOSDPGPush.h"
 #include "messages/MOSDPGPull.h"
 #include "messages/MOSDPGPushReply.h"
+#include "messages/MOSDPGSnapTrim.h"
 
 #include "Watch.h"
 
@@ -49,6 +50,7 @@
 
 #include "common/config.h"
 #include "include/compat.h"
+#include "include/trace.h"
 #include "common/cmdparse.h"
 
 #include "mon/MonClient.h"
@@ -73,6 +75,11 @@ static ostream& _prefix(std::ostream *_dout, T *pg) {
 
 #include <errno.h>
 
+ObjectPool ReplicatedPG::OpContext::alloc_pool(
+  "ReplicatedPG::OpContext", sizeof(ReplicatedPG::OpContext));
+ObjectPool ReplicatedPG::RepGather::alloc_pool(
+  "ReplicatedPG::RepGather", sizeof(ReplicatedPG::RepGather));
+
 PGLSFilter::PGLSFilter()
 {
 }
@@ -571,7 +578,42 @@ int ReplicatedPG::do_command(cmdmap_t cmdmap, ostream& ss,
     f->close_section();
     f->flush(odata);
     return 0;
-  };
+  }
+  else if (command == "hit_set_query") {
+    if (!is_primary()) {
+      ss << "not primary";
+      return -EROFS;
+    }
+    string name;
+    hobject_t oid;
+    if (cmd_getval(cct, cmdmap, "object", name)) {
+      pg_t raw;
+      get_osdmap()->object_locator_to_pg(object_t(name),
+					 object_locator_t(info.pgid.pool()),
+					 raw);
+      if (get_osdmap()->raw_pg_to_pg(raw) != info.pgid) {
+	ss << "object " << name << " is in pg "
+	   << get_osdmap()->raw_pg_to_pg(raw);
+	return -EINVAL;
+      }
+      oid = hobject_t(object_t(name), "", CEPH_NOSNAP, raw.ps(),
+		      info.pgid.pool(), "");
+    }
+    utime_t now = ceph_clock_now(cct);
+    hit_set_setup();
+    f->open_object_section("hit_set");
+    if (name.length()) {
+      f->open_object_section("object");
+      f->dump_string("name", name);
+      f->dump_unsigned("temperature", hit_set.temperature(oid, now));
+      f->dump_bool("in_current", hit_set.in_current(oid, now));
+      f->close_section();
+    }
+    hit_set.dump(f.get());
+    f->close_section();
+    f->flush(odata);
+    return 0;
+  }
 
   ss << "unknown pg command " << prefix;
   return -EINVAL;
@@ -822,7 +864,12 @@ ReplicatedPG::ReplicatedPG(OSDService *o, OSDMapRef curmap,
   PG(o, curmap, _pool, p, oid, ioid),
   pgbackend(new ReplicatedBackend(this, coll_t(p), o)),
   snapset_contexts_lock("ReplicatedPG::snapset_contexts"),
+  agent_flush_mode(false),
+  agent_evict_mode(AGENT_EVICT_NONE),
+  agent_queued(false),
+  agent_cycle_started(false),
   temp_seq(0),
+  repop_batch_flush(NULL),
   snap_trimmer_machine(this)
 { 
   snap_trimmer_machine.initiate();
@@ -897,6 +944,11 @@ void ReplicatedPG::do_request(
     do_backfill(op);
     break;
 
+  case MSG_OSD_PG_SNAPTRIM:
+    snap_trim_queued = false;
+    snap_trimmer();
+    break;
+
   default:
     assert(0 == "bad message type in do_request");
   }
@@ -909,6 +961,7 @@ void ReplicatedPG::do_request(
  */
 void ReplicatedPG::do_op(OpRequestRef op)
 {
+  CEPH_TRACE1(pg_do_op, op->get_seq());
   MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
   assert(m->get_header().type == CEPH_MSG_OSD_OP);
   if (op->includes_pg_op()) {
@@ -932,6 +985,12 @@ void ReplicatedPG::do_op(OpRequestRef op)
 		 CEPH_NOSNAP, m->get_pg().ps(),
 		 info.pgid.pool(), m->get_object_locator().nspace);
 
+  if (!is_primary() && !can_serve_replica_read(op, head)) {
+    // the client will resend to the primary
+    dout(10) << "do_op can't serve " << head << " as a replica" << dendl;
+    osd->reply_op_error(op, -EAGAIN);
+    return;
+  }
 
   if (write_ordered && scrubber.write_blocked_by_scrub(head)) {
     dout(20) << __func__ << ": waiting for scrub" << dendl;
@@ -1002,7 +1061,18 @@ void ReplicatedPG::do_op(OpRequestRef op)
     }
   }
 
-  if (maybe_handle_cache(op, obc, r))
+  if (pool.info.cache_mode != pg_pool_t::CACHEMODE_NONE &&
+      is_primary() && !m->get_source().is_osd()) {
+    // misses count too, so a policy can tell what is worth promoting
+    utime_t now = ceph_clock_now(cct);
+    hit_set_setup();
+    hit_set.insert(head, now);
+    if (hit_set.archive_pending())
+      hit_set_persist();
+    agent_maybe_queue(now);
+  }
+
+  if (maybe_handle_cache(op, obc, r, head))
     return;
 
   if (r) {
@@ -1187,10 +1257,21 @@ void ReplicatedPG::do_op(OpRequestRef op)
 }
 
 bool ReplicatedPG::maybe_handle_cache(OpRequestRef op, ObjectContextRef obc,
-                                      int r)
+                                      int r, const hobject_t& head)
 {
   if (obc.get() && obc->is_blocked()) {
-    // we're already doing something with this object
+    // we're already doing something with this object.  if that is
+    // copying it up, the base tier can still answer reads meanwhile
+    if (!obc->obs.exists && is_promoting(head) &&
+	cct->_conf->osd_tier_proxy_reads && can_proxy_read(op)) {
+      do_proxy_read(op, head);
+      return true;
+    }
+    return false;
+  }
+  if (obc.get() && !r && op->get_req()->get_source().is_osd()) {
+    // the base pool's osds copy from us to flush; serve them what we
+    // have, whatever the mode
     return false;
   }
   switch(pool.info.cache_mode) {
@@ -1198,10 +1279,11 @@ bool ReplicatedPG::maybe_handle_cache(OpRequestRef op, ObjectContextRef obc,
     return false;
     break;
   case pg_pool_t::CACHEMODE_WRITEBACK:
-    if (obc.get()) {
+    if (obc.get() && (obc->obs.exists || op->may_write())) {
       return false;
     } else {
-      do_cache_redirect(op, obc);
+      if (!maybe_proxy_read(op, head))
+	do_cache_redirect(op, obc);
       return true;
     }
     break;
@@ -1210,10 +1292,11 @@ bool ReplicatedPG::maybe_handle_cache(OpRequestRef op, ObjectContextRef obc,
     return true;
     break;
   case pg_pool_t::CACHEMODE_READONLY:
-    if (obc.get() && !r) {
+    if (obc.get() && !r && (obc->obs.exists || op->may_write())) {
       return false;
     } else {
-      do_cache_redirect(op, obc);
+      if (!maybe_proxy_read(op, head))
+	do_cache_redirect(op, obc);
       return true;
     }
     break;
@@ -1223,6 +1306,15 @@ bool ReplicatedPG::maybe_handle_cache(OpRequestRef op, ObjectContextRef obc,
   return false;
 }
 
+bool ReplicatedPG::maybe_proxy_read(OpRequestRef op, const hobject_t& head)
+{
+  if (!cct->_conf->osd_tier_proxy_reads || !can_proxy_read(op))
+    return false;
+  do_proxy_read(op, head);
+  maybe_promote(head);
+  return true;
+}
+
 void ReplicatedPG::do_cache_redirect(OpRequestRef op, ObjectContextRef obc)
 {
   MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
@@ -1497,11 +1589,13 @@ void ReplicatedPG::log_op_stats(OpContext *ctx)
     osd->logger->inc(l_osd_op_r);
     osd->logger->inc(l_osd_op_r_outb, outb);
     osd->logger->tinc(l_osd_op_r_lat, latency);
+    osd->logger->hinc(l_osd_op_r_lat_outb_hist, latency, outb);
   } else if (op->may_write()) {
     osd->logger->inc(l_osd_op_w);
     osd->logger->inc(l_osd_op_w_inb, inb);
     osd->logger->tinc(l_osd_op_w_rlat, rlatency);
     osd->logger->tinc(l_osd_op_w_lat, latency);
+    osd->logger->hinc(l_osd_op_w_lat_inb_hist, latency, inb);
   } else
     assert(0);
 
@@ -1617,28 +1711,46 @@ void ReplicatedPG::do_scan(
       int from = m->get_source().num();
       assert(from == get_backfill_target());
       BackfillInterval& bi = peer_backfill_info;
-      bi.begin = m->begin;
-      bi.end = m->end;
+      map<hobject_t, eversion_t> objects;
       bufferlist::iterator p = m->get_data().begin();
-      ::decode(bi.objects, p);
+      ::decode(objects, p);
 
       // handle hobject_t encoding change
-      if (bi.objects.size() && bi.objects.begin()->first.pool == -1) {
+      if (objects.size() && objects.begin()->first.pool == -1) {
 	map<hobject_t, eversion_t> tmp;
-	tmp.swap(bi.objects);
+	tmp.swap(objects);
 	for (map<hobject_t, eversion_t>::iterator i = tmp.begin();
 	     i != tmp.end();
 	     ++i) {
 	  hobject_t first(i->first);
 	  if (first.pool == -1)
 	    first.pool = info.pgid.pool();
-	  bi.objects[first] = i->second;
+	  objects[first] = i->second;
 	}
       }
 
-      assert(waiting_on_backfill);
+      if (peer_backfill_prefetching) {
+	// the interval after the one we are working on; we may have
+	// restarted from last_backfill since we asked for it
+	peer_backfill_prefetching = false;
+	if (m->begin == bi.end) {
+	  dout(10) << " prefetched peer interval " << m->begin << "-" << m->end
+		   << " " << objects.size() << " objects" << dendl;
+	  bi.objects.insert(objects.begin(), objects.end());
+	  bi.end = m->end;
+	  bi.trim();
+	} else {
+	  dout(10) << " dropping prefetched peer interval " << m->begin
+		   << ", now at " << bi.end << dendl;
+	}
+      } else {
+	assert(waiting_on_backfill);
+	bi.begin = m->begin;
+	bi.end = m->end;
+	bi.objects.swap(objects);
+      }
       waiting_on_backfill = false;
-      finish_recovery_op(bi.begin);
+      finish_recovery_op(m->begin);
     }
     break;
   }
@@ -1767,15 +1879,12 @@ void ReplicatedBackend::do_push_reply(OpRequestRef op)
   assert(m->get_header().type == MSG_OSD_PG_PUSH_REPLY);
   int from = m->get_source().num();
 
-  vector<PushOp> replies(1);
+  vector<PushOp> replies;
   for (vector<PushReplyOp>::iterator i = m->replies.begin();
        i != m->replies.end();
        ++i) {
-    bool more = handle_push_reply(from, *i, &(replies.back()));
-    if (more)
-      replies.push_back(PushOp());
+    handle_push_reply(from, *i, &replies);
   }
-  replies.erase(replies.end() - 1);
 
   map<int, vector<PushOp> > _replies;
   _replies[from].swap(replies);
@@ -2039,18 +2148,11 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
 
 void ReplicatedPG::snap_trimmer()
 {
-  lock();
-  if (deleting) {
-    unlock();
-    return;
-  }
   dout(10) << "snap_trimmer entry" << dendl;
   if (is_primary()) {
-    entity_inst_t nobody;
     if (scrubber.active) {
       dout(10) << " scrubbing, will requeue snap_trimmer after" << dendl;
       scrubber.queue_snap_trim = true;
-      unlock();
       return;
     }
 
@@ -2071,8 +2173,6 @@ void ReplicatedPG::snap_trimmer()
     dout(10) << "snap_trimmer requeue" << dendl;
     queue_snap_trim();
   }
-  unlock();
-  return;
 }
 
 int ReplicatedPG::do_xattr_cmp_u64(int op, __u64 v1, bufferlist& xattr)
@@ -2422,6 +2522,9 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 
   bool first_read = true;
 
+  // results of READs fetched ahead of time along with an earlier READ
+  map<OSDOp*, pair<int, bufferlist> > read_ahead;
+
   ObjectStore::Transaction& t = ctx->op_t;
 
   dout(10) << "do_osd_op " << soid << " " << ops << dendl;
@@ -2487,7 +2590,37 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
       {
 	// read into a buffer
 	bufferlist bl;
-	int r = osd->store->read(coll, soid, op.extent.offset, op.extent.length, bl);
+	int r;
+	map<OSDOp*, pair<int, bufferlist> >::iterator ra = read_ahead.find(&osd_op);
+	if (ra == read_ahead.end()) {
+	  // fetch a run of READs with one store call, so the store can
+	  // open the object once and batch the io
+	  vector<OSDOp>::iterator q = p;
+	  vector<pair<uint64_t, size_t> > extents;
+	  for (; q != ops.end() && q->op.op == CEPH_OSD_OP_READ; ++q)
+	    extents.push_back(make_pair((uint64_t)q->op.extent.offset,
+					(size_t)q->op.extent.length));
+	  vector<bufferlist> bls;
+	  vector<int> rs;
+	  if (extents.size() > 1 &&
+	      osd->store->readv(coll, soid, extents, bls, rs) == 0) {
+	    dout(20) << " readv " << extents.size() << " extents" << dendl;
+	    q = p;
+	    for (unsigned i = 0; i < extents.size(); ++i, ++q) {
+	      pair<int, bufferlist>& res = read_ahead[&*q];
+	      res.first = rs[i];
+	      res.second.claim(bls[i]);
+	    }
+	    ra = read_ahead.find(&osd_op);
+	  }
+	}
+	if (ra != read_ahead.end()) {
+	  r = ra->second.first;
+	  bl.claim(ra->second.second);
+	  read_ahead.erase(ra);
+	} else {
+	  r = osd->store->read(coll, soid, op.extent.offset, op.extent.length, bl);
+	}
 	if (first_read) {
 	  first_read = false;
 	  ctx->data_off = op.extent.offset;
@@ -2639,18 +2772,25 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	  break;
 	}
 
-	ClassHandler::ClassData *cls;
-	result = osd->class_handler->open_class(cname, &cls);
-	assert(result == 0);   // init_op_flags() already verified this works.
-
-	ClassHandler::ClassMethod *method = cls->get_method(mname.c_str());
+	// init_op_flags() looked the client's methods up already
+	ClassHandler::ClassMethod *method = NULL;
+	if (ctx->op && &ops == &ctx->ops)
+	  method = ctx->op->get_cls_method(p - ops.begin());
 	if (!method) {
-	  dout(10) << "call method " << cname << "." << mname << " does not exist" << dendl;
-	  result = -EOPNOTSUPP;
-	  break;
+	  ClassHandler::ClassData *cls;
+	  result = osd->class_handler->open_class(cname, &cls);
+	  assert(result == 0);   // init_op_flags() already verified this works.
+
+	  method = cls->get_method(mname.c_str());
+	  if (!method) {
+	    dout(10) << "call method " << cname << "." << mname << " does not exist" << dendl;
+	    result = -EOPNOTSUPP;
+	    break;
+	  }
 	}
 
-	int flags = method->get_flags();
+	// set once, when the class was loaded, so no need for the lock
+	int flags = method->flags;
 	if (flags & CLS_METHOD_WR)
 	  ctx->user_modify = true;
 
@@ -3035,6 +3175,9 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	    t.truncate(coll, soid, op.extent.truncate_size);
 	    oi.truncate_seq = op.extent.truncate_seq;
 	    oi.truncate_size = op.extent.truncate_size;
+	    if (op.extent.truncate_size < oi.size)
+	      add_dirty_extent(ctx, op.extent.truncate_size,
+			       oi.size - op.extent.truncate_size);
 	    if (op.extent.truncate_size != oi.size) {
 	      ctx->delta_stats.num_bytes -= oi.size;
 	      ctx->delta_stats.num_bytes += op.extent.truncate_size;
@@ -3051,6 +3194,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	if (result < 0)
 	  break;
 	t.write(coll, soid, op.extent.offset, op.extent.length, osd_op.indata);
+	add_dirty_extent(ctx, op.extent.offset, op.extent.length);
 	write_update_size_and_usage(ctx->delta_stats, oi, ssc->snapset, ctx->modified_ranges,
 				    op.extent.offset, op.extent.length, true);
 	if (!obs.exists) {
@@ -3081,6 +3225,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	if (oi.size > 0)
 	  ch.insert(0, oi.size);
 	ctx->modified_ranges.union_of(ch);
+	add_dirty_extent(ctx, 0, MAX(oi.size, op.extent.offset + op.extent.length));
 	if (op.extent.length + op.extent.offset != oi.size) {
 	  ctx->delta_stats.num_bytes -= oi.size;
 	  oi.size = op.extent.length + op.extent.offset;
@@ -3103,11 +3248,15 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	if (result < 0)
 	  break;
 	assert(op.extent.length);
-	if (obs.exists) {
-	  t.zero(coll, soid, op.extent.offset, op.extent.length);
+	if (obs.exists && op.extent.offset < oi.size) {
+	  // zero doesn't change the size, and past it there is nothing
+	  // to zero; the store punches a hole rather than writing zeros
+	  uint64_t len = MIN(op.extent.length, oi.size - op.extent.offset);
+	  t.zero(coll, soid, op.extent.offset, len);
 	  interval_set<uint64_t> ch;
-	  ch.insert(op.extent.offset, op.extent.length);
+	  ch.insert(op.extent.offset, len);
 	  ctx->modified_ranges.union_of(ch);
+	  add_dirty_extent(ctx, op.extent.offset, len);
 	  ctx->delta_stats.num_wr++;
 	} else {
 	  // no-op
@@ -3185,6 +3334,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	  interval_set<uint64_t> trim;
 	  trim.insert(op.extent.offset, oi.size-op.extent.offset);
 	  ctx->modified_ranges.union_of(trim);
+	  add_dirty_extent(ctx, op.extent.offset, oi.size-op.extent.offset);
 	}
 	if (op.extent.offset != oi.size) {
 	  ctx->delta_stats.num_bytes -= oi.size;
@@ -3225,7 +3375,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	t.clone_range(coll, src_obc->obs.oi.soid,
 		      obs.oi.soid, op.clonerange.src_offset,
 		      op.clonerange.length, op.clonerange.offset);
-		      
+	add_dirty_extent(ctx, op.clonerange.offset, op.clonerange.length);
 
 	write_update_size_and_usage(ctx->delta_stats, oi, ssc->snapset, ctx->modified_ranges,
 				    op.clonerange.offset, op.clonerange.length, false);
@@ -3413,29 +3563,26 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
       {
 	string start_after;
 	uint64_t max_return;
+	uint64_t max_bytes = 0;
 	try {
 	  ::decode(start_after, bp);
 	  ::decode(max_return, bp);
+	  // optional byte budget; if given, a 'more' flag follows the reply
+	  if (!bp.end())
+	    ::decode(max_bytes, bp);
 	}
 	catch (buffer::error& e) {
 	  result = -EINVAL;
 	  goto fail;
 	}
 	set<string> out_set;
-
-	{
-	  ObjectMap::ObjectMapIterator iter = osd->store->get_omap_iterator(
-	    coll, soid
-	    );
-	  assert(iter);
-	  iter->upper_bound(start_after);
-	  for (uint64_t i = 0;
-	       i < max_return && iter->valid();
-	       ++i, iter->next()) {
-	    out_set.insert(iter->key());
-	  }
-	}
+	bool more = false;
+	int r = osd->store->omap_get_keys_range(
+	  coll, soid, start_after, max_return, max_bytes, &out_set, &more);
+	assert(r == 0);
 	::encode(out_set, osd_op.outdata);
+	if (max_bytes)
+	  ::encode(more, osd_op.outdata);
 	ctx->delta_stats.num_rd_kb += SHIFT_ROUND_UP(osd_op.outdata.length(), 10);
 	ctx->delta_stats.num_rd++;
       }
@@ -3447,36 +3594,31 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	string start_after;
 	uint64_t max_return;
 	string filter_prefix;
+	uint64_t max_bytes = 0;
 	try {
 	  ::decode(start_after, bp);
 	  ::decode(max_return, bp);
 	  ::decode(filter_prefix, bp);
+	  // optional byte budget; if given, a 'more' flag follows the reply
+	  if (!bp.end())
+	    ::decode(max_bytes, bp);
 	}
 	catch (buffer::error& e) {
 	  result = -EINVAL;
 	  goto fail;
 	}
 	map<string, bufferlist> out_set;
-
-	{
-	  ObjectMap::ObjectMapIterator iter = osd->store->get_omap_iterator(
-	    coll, soid
-	    );
-          if (!iter) {
-            result = -ENOENT;
-            goto fail;
-          }
-	  iter->upper_bound(start_after);
-	  if (filter_prefix >= start_after) iter->lower_bound(filter_prefix);
-	  for (uint64_t i = 0;
-	       i < max_return && iter->valid() &&
-		 iter->key().substr(0, filter_prefix.size()) == filter_prefix;
-	       ++i, iter->next()) {
-	    dout(20) << "Found key " << iter->key() << dendl;
-	    out_set.insert(make_pair(iter->key(), iter->value()));
-	  }
-	}
+	bool more = false;
+	result = osd->store->omap_get_values_range(
+	  coll, soid, start_after, filter_prefix, max_return, max_bytes,
+	  &out_set, &more);
+	if (result < 0)
+	  goto fail;
+	dout(20) << "found " << out_set.size() << " keys"
+		 << (more ? ", more remain" : "") << dendl;
 	::encode(out_set, osd_op.outdata);
+	if (max_bytes)
+	  ::encode(more, osd_op.outdata);
 	ctx->delta_stats.num_rd_kb += SHIFT_ROUND_UP(osd_op.outdata.length(), 10);
 	ctx->delta_stats.num_rd++;
       }
@@ -3651,6 +3793,30 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
       }
       break;
 
+    case CEPH_OSD_OP_OMAPRMKEYRANGE:
+      ++ctx->num_write;
+      {
+	if (!obs.exists) {
+	  result = -ENOENT;
+	  break;
+	}
+	string first, last;
+	try {
+	  ::decode(first, bp);
+	  ::decode(last, bp);
+	}
+	catch (buffer::error& e) {
+	  result = -EINVAL;
+	  goto fail;
+	}
+	if (first >= last)
+	  break;
+	t.touch(coll, soid);
+	t.omap_rmkeyrange(coll, soid, first, last);
+	ctx->delta_stats.num_wr++;
+      }
+      break;
+
     case CEPH_OSD_OP_COPY_GET_CLASSIC:
       ++ctx->num_read;
       result = fill_in_copy_get(bp, osd_op, oi, true);
@@ -3759,6 +3925,8 @@ inline int ReplicatedPG::_delete_head(OpContext *ctx)
     return -ENOENT;
   
   t.remove(coll, soid);
+  // a recreated object shares nothing with what a replica may still have
+  ctx->dirty_extents_known = false;
 
   if (oi.size > 0) {
     interval_set<uint64_t> ch;
@@ -3788,6 +3956,7 @@ int ReplicatedPG::_rollback_to(OpContext *ctx, ceph_osd_op& op)
   snapid_t cloneid = 0;
 
   dout(10) << "_rollback_to " << soid << " snapid " << snapid << dendl;
+  ctx->dirty_extents_known = false;
 
   ObjectContextRef rollback_to;
   int ret = find_object_context(
@@ -4022,8 +4191,19 @@ void ReplicatedPG::add_interval_usage(interval_set<uint64_t>& s, object_stat_sum
   }
 }
 
+void ReplicatedPG::add_dirty_extent(OpContext *ctx, uint64_t offset, uint64_t length)
+{
+  if (!length)
+    return;
+  interval_set<uint64_t> ch;
+  ch.insert(offset, length);
+  ctx->dirty_extents.union_of(ch);
+}
+
 void ReplicatedPG::do_osd_op_effects(OpContext *ctx)
 {
+  if (!ctx->op)
+    return;  // internal ops watch and notify nobody
   ConnectionRef conn(ctx->op->get_req()->get_connection());
   boost::intrusive_ptr<OSD::Session> session(
     (OSD::Session *)conn->get_priv());
@@ -4134,13 +4314,6 @@ hobject_t ReplicatedPG::generate_temp_object()
 int ReplicatedPG::prepare_transaction(OpContext *ctx)
 {
   assert(!ctx->ops.empty());
-  
-  const hobject_t& soid = ctx->obs->oi.soid;
-
-  // we'll need this to log
-  eversion_t old_version = ctx->obs->oi.version;
-
-  bool head_existed = ctx->obs->exists;
 
   // valid snap context?
   if (!ctx->snapc.is_valid()) {
@@ -4163,10 +4336,26 @@ int ReplicatedPG::prepare_transaction(OpContext *ctx)
     return result;
   }
 
+  finish_ctx(ctx);
+  return result;
+}
+
+void ReplicatedPG::finish_ctx(OpContext *ctx)
+{
+  const hobject_t& soid = ctx->obs->oi.soid;
+
+  // we'll need this to log
+  eversion_t old_version = ctx->obs->oi.version;
+
+  bool head_existed = ctx->obs->exists;
 
   // clone, if necessary
   make_writeable(ctx);
 
+  bool was_dirty = head_existed && ctx->obs->oi.is_dirty();
+  bool is_dirty = ctx->new_obs.exists && ctx->new_obs.oi.is_dirty();
+  ctx->delta_stats.num_objects_dirty += (int)is_dirty - (int)was_dirty;
+
   // snapset
   bufferlist bss;
   ::encode(ctx->new_snapset, bss);
@@ -4254,6 +4443,10 @@ int ReplicatedPG::prepare_transaction(OpContext *ctx)
     logopcode = pg_log_entry_t::DELETE;
   ctx->log.push_back(pg_log_entry_t(logopcode, soid, ctx->at_version, old_version,
 				ctx->user_at_version, ctx->reqid, ctx->mtime));
+  if (logopcode == pg_log_entry_t::MODIFY && ctx->dirty_extents_known) {
+    ctx->log.back().dirty_extents_known = true;
+    ctx->log.back().dirty_extents.swap(ctx->dirty_extents);
+  }
 
   // apply new object state.
   ctx->obc->obs = ctx->new_obs;
@@ -4274,8 +4467,6 @@ int ReplicatedPG::prepare_transaction(OpContext *ctx)
     if (soid < scrubber.start)
       scrub_cstat.add(ctx->delta_stats, ctx->obc->obs.oi.category);
   }
-
-  return result;
 }
 
 // ========================================================================
@@ -4559,6 +4750,7 @@ int ReplicatedPG::finish_copyfrom(OpContext *ctx)
   }
   ctx->op_t.swap(cb->results.get<3>());
   ctx->op_t.append(cb->results.get<3>());
+  ctx->dirty_extents_known = false;
 
   interval_set<uint64_t> ch;
   if (obs.oi.size > 0)
@@ -4610,126 +4802,747 @@ void ReplicatedPG::cancel_copy_ops(bool requeue)
 
 
 // ========================================================================
-// rep op gather
+// proxied reads and promotion
 
-class C_OSD_OpApplied : public Context {
-public:
+struct C_ProxyRead : public Context {
   ReplicatedPGRef pg;
-  ReplicatedPG::RepGather *repop;
-
-  C_OSD_OpApplied(ReplicatedPG *p, ReplicatedPG::RepGather *rg) :
-    pg(p), repop(rg) {
-    repop->get();
-  }
+  epoch_t last_peering_reset;
+  tid_t tid;
+  ReplicatedPG::ProxyReadOpRef prdop;  ///< owns the buffers the objecter fills
+  C_ProxyRead(ReplicatedPG *p, epoch_t lpr,
+	      const ReplicatedPG::ProxyReadOpRef& prd)
+    : pg(p), last_peering_reset(lpr), tid(0), prdop(prd)
+  {}
   void finish(int r) {
-    pg->op_applied(repop);
+    pg->lock();
+    if (last_peering_reset == pg->get_last_peering_reset()) {
+      pg->finish_proxy_read(tid, r);
+    }
+    pg->unlock();
   }
 };
 
-class C_OSD_OpCommit : public Context {
-public:
-  ReplicatedPGRef pg;
-  ReplicatedPG::RepGather *repop;
-
-  C_OSD_OpCommit(ReplicatedPG *p, ReplicatedPG::RepGather *rg) :
-    pg(p), repop(rg) {
-    repop->get();
-  }
-  void finish(int r) {
-    pg->op_commit(repop);
+bool ReplicatedPG::can_proxy_read(OpRequestRef op)
+{
+  MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
+  if (!is_primary() ||
+      !op->may_read() || op->may_write() || op->includes_pg_op() ||
+      m->get_snapid() != CEPH_NOSNAP ||
+      m->get_source().is_osd())
+    return false;
+  for (vector<OSDOp>::iterator p = m->ops.begin(); p != m->ops.end(); ++p) {
+    if (ceph_osd_op_type_multi(p->op.op))
+      return false;  // the source objects are looked up here
+    switch (p->op.op) {
+    case CEPH_OSD_OP_NOTIFY:
+    case CEPH_OSD_OP_NOTIFY_ACK:
+    case CEPH_OSD_OP_LIST_WATCHERS:
+      return false;  // watchers are registered with the cache tier
+    case CEPH_OSD_OP_ISDIRTY:
+      return false;  // a question about our copy
+    }
   }
-};
+  return true;
+}
 
-void ReplicatedPG::apply_repop(RepGather *repop)
+void ReplicatedPG::do_proxy_read(OpRequestRef op, const hobject_t& head)
 {
-  dout(10) << "apply_repop  applying update on " << *repop << dendl;
-  assert(!repop->applying);
-  assert(!repop->applied);
-
-  repop->applying = true;
-
-  repop->tls.push_back(&repop->ctx->local_t);
-  repop->tls.push_back(&repop->ctx->op_t);
+  MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
+  object_locator_t oloc(m->get_object_locator());
+  oloc.pool = pool.info.tier_of;
+  unsigned num_ops = m->ops.size();
+  ProxyReadOpRef prdop(new ProxyReadOp(op, head, num_ops));
+
+  ObjectOperation obj_op;
+  obj_op.ops = m->ops;
+  obj_op.out_bl.resize(num_ops);
+  obj_op.out_handler.resize(num_ops);
+  obj_op.out_rval.resize(num_ops);
+  for (unsigned i = 0; i < num_ops; ++i) {
+    obj_op.out_bl[i] = &prdop->outdata[i];
+    obj_op.out_rval[i] = &prdop->rval[i];
+  }
+
+  C_ProxyRead *fin = new C_ProxyRead(this, get_last_peering_reset(), prdop);
+  osd->objecter_lock.Lock();
+  tid_t tid = osd->objecter->read(head.oid, oloc, obj_op, CEPH_NOSNAP,
+				  NULL, 0,
+				  new C_OnFinisher(fin,
+						   &osd->objecter_finisher),
+				  &prdop->user_version);
+  fin->tid = tid;
+  prdop->objecter_tid = tid;
+  osd->objecter_lock.Unlock();
+  proxyread_ops[tid] = prdop;
 
-  repop->obc->ondisk_write_lock();
-  if (repop->ctx->clone_obc)
-    repop->ctx->clone_obc->ondisk_write_lock();
+  dout(10) << __func__ << " " << head << " tid " << tid << " to pool "
+	   << pool.info.tier_of << " for " << *m << dendl;
+  op->mark_started();
+  osd->logger->inc(l_osd_tier_proxy_read);
+}
 
-  bool unlock_snapset_obc = false;
-  if (repop->ctx->snapset_obc && repop->ctx->snapset_obc->obs.oi.soid !=
-      repop->obc->obs.oi.soid) {
-    repop->ctx->snapset_obc->ondisk_write_lock();
-    unlock_snapset_obc = true;
+void ReplicatedPG::finish_proxy_read(tid_t tid, int r)
+{
+  map<tid_t, ProxyReadOpRef>::iterator p = proxyread_ops.find(tid);
+  if (p == proxyread_ops.end()) {
+    dout(10) << __func__ << " tid " << tid << " dne" << dendl;
+    return;
   }
+  ProxyReadOpRef prdop = p->second;
+  proxyread_ops.erase(p);
+  dout(10) << __func__ << " " << prdop->soid << " tid " << tid
+	   << " " << cpp_strerror(r) << dendl;
 
-  Context *oncommit = new C_OSD_OpCommit(this, repop);
-  Context *onapplied = new C_OSD_OpApplied(this, repop);
-  Context *onapplied_sync = new C_OSD_OndiskWriteUnlock(
-    repop->obc,
-    repop->ctx->clone_obc,
-    unlock_snapset_obc ? repop->ctx->snapset_obc : ObjectContextRef());
-  int r = osd->store->queue_transactions(osr.get(), repop->tls, onapplied, oncommit, onapplied_sync, repop->ctx->op);
-  if (r) {
-    derr << "apply_repop  queue_transactions returned " << r << " on " << *repop << dendl;
-    assert(0);
-  }
+  // answer as if we had done the reads ourselves
+  OpRequestRef op = prdop->op;
+  MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
+  for (unsigned i = 0; i < m->ops.size() && i < prdop->rval.size(); ++i) {
+    m->ops[i].rval = prdop->rval[i];
+    m->ops[i].outdata.claim(prdop->outdata[i]);
+  }
+  MOSDOpReply *reply = new MOSDOpReply(m, r, get_osdmap()->get_epoch(), 0);
+  reply->claim_op_out_data(m->ops);
+  if (r >= 0)
+    reply->set_reply_versions(eversion_t(), prdop->user_version);
+  else
+    reply->set_enoent_reply_versions(eversion_t(), prdop->user_version);
+  reply->add_flags(CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK);
+  osd->send_message_osd_client(reply, m->get_connection());
 }
 
-void ReplicatedPG::op_applied(RepGather *repop)
+void ReplicatedPG::cancel_proxy_read_ops(bool requeue)
 {
-  lock();
-  dout(10) << "op_applied " << *repop << dendl;
-  if (repop->ctx->op)
-    repop->ctx->op->mark_event("op_applied");
-  
-  repop->applying = false;
-  repop->applied = true;
-
-  // (logical) local ack.
-  int whoami = osd->get_nodeid();
-
-  if (!repop->aborted) {
-    assert(repop->waitfor_ack.count(whoami) ||
-	   repop->waitfor_disk.count(whoami) == 0);  // commit before ondisk
-    repop->waitfor_ack.erase(whoami);
-
-    if (repop->v != eversion_t()) {
-      assert(info.last_update >= repop->v);
-      assert(last_update_applied < repop->v);
-      last_update_applied = repop->v;
+  dout(10) << __func__ << dendl;
+  // requeue_op() pushes to the front, so go newest first
+  for (map<tid_t, ProxyReadOpRef>::reverse_iterator p = proxyread_ops.rbegin();
+       p != proxyread_ops.rend();
+       ++p) {
+    {
+      Mutex::Locker l(osd->objecter_lock);
+      osd->objecter->op_cancel(p->first);
     }
+    if (requeue)
+      requeue_op(p->second->op);
+  }
+  proxyread_ops.clear();
+}
 
-    // chunky scrub
-    if (scrubber.active && scrubber.is_chunky) {
-      if (last_update_applied == scrubber.subset_last_update) {
-        osd->scrub_wq.queue(this);
-      }
+bool ReplicatedPG::is_promoting(const hobject_t& head)
+{
+  map<hobject_t,CopyOpRef>::iterator p = copy_ops.find(head);
+  return p != copy_ops.end() &&
+    dynamic_cast<PromoteCallback*>(p->second->cb) != NULL;
+}
 
-    // classic scrub
-    } else if (last_update_applied == info.last_update && scrubber.block_writes) {
-      dout(10) << "requeueing scrub for cleanup" << dendl;
-      scrubber.finalizing = true;
-      scrub_gather_replica_maps();
-      ++scrubber.waiting_on;
-      scrubber.waiting_on_whom.insert(osd->whoami);
-      osd->scrub_wq.queue(this);
+void ReplicatedPG::maybe_promote(const hobject_t& head)
+{
+  if (copy_ops.count(head))
+    return;
+  // without a hit set history we can't tell, so everything is warm
+  unsigned min_temp = cct->_conf->osd_tier_promote_min_temperature;
+  if (hit_set.enabled() && min_temp) {
+    unsigned temp = hit_set.temperature(head, ceph_clock_now(cct));
+    if (temp < min_temp) {
+      dout(20) << __func__ << " " << head << " temperature " << temp
+	       << " < " << min_temp << dendl;
+      return;
     }
   }
+  if (pool.info.get_flags() & pg_pool_t::FLAG_FULL) {
+    dout(20) << __func__ << " " << head << " pool is full" << dendl;
+    return;
+  }
+  if (is_missing_object(head) || is_degraded_object(head) ||
+      scrubber.write_blocked_by_scrub(head)) {
+    dout(20) << __func__ << " " << head << " is degraded or scrubbed" << dendl;
+    return;
+  }
+  ObjectContextRef obc = get_object_context(head, true);
+  if (!obc || obc->obs.exists || obc->is_blocked()) {
+    dout(20) << __func__ << " " << head << " is in use" << dendl;
+    return;
+  }
 
-  if (!repop->aborted)
-    eval_repop(repop);
-
-  repop->put();
-  unlock();
+  dout(10) << __func__ << " " << head << " from pool " << pool.info.tier_of
+	   << dendl;
+  object_locator_t oloc(head);
+  oloc.pool = pool.info.tier_of;
+  hobject_t temp_target = generate_temp_object();
+  start_copy(new PromoteCallback(this, obc, temp_target), obc, head, oloc,
+	     0, temp_target);
 }
 
-void ReplicatedPG::op_commit(RepGather *repop)
+void ReplicatedPG::finish_promote(CopyResults& results, ObjectContextRef obc,
+				  const hobject_t& temp_obj)
 {
-  lock();
-  if (repop->ctx->op)
-    repop->ctx->op->mark_event("op_commit");
+  const hobject_t& soid = obc->obs.oi.soid;
+  int r = results.get<0>();
+  dout(10) << __func__ << " " << soid << " " << cpp_strerror(r) << dendl;
+  if (r < 0) {
+    // cancelled, or the base tier couldn't give it to us; the next
+    // miss will try again
+    return;
+  }
 
-  if (repop->aborted) {
+  map<hobject_t,CopyOpRef>::iterator p = copy_ops.find(soid);
+  assert(p != copy_ops.end());
+  CopyOpRef cop = p->second;
+
+  if (obc->obs.exists || scrubber.write_blocked_by_scrub(soid) ||
+      !obc->rwstate.get_write_lock()) {
+    dout(10) << __func__ << " " << soid << " changed or in use, dropping"
+	     << dendl;
+    return;
+  }
+
+  vector<OSDOp> ops;
+  tid_t rep_tid = osd->get_tid();
+  osd_reqid_t reqid(osd->get_cluster_msgr_name(), 0, rep_tid);
+  OpContext *ctx = new OpContext(OpRequestRef(), reqid, ops,
+				 &obc->obs, obc->ssc, this);
+  ctx->obc = obc;
+  ctx->undirty = true;  // the base tier has it already
+  ctx->lock_to_release = OpContext::W_LOCK;
+  ctx->mtime = cop->mtime;
+  ctx->at_version = pg_log.get_head();
+  ctx->at_version.epoch = get_osdmap()->get_epoch();
+  ctx->at_version.version++;
+  // the object keeps the version the clients know it by
+  ctx->user_at_version = cop->user_version;
+
+  ctx->op_t.swap(results.get<3>());
+  if (results.get<2>())
+    ctx->discard_temp_oid = temp_obj;
+  ctx->dirty_extents_known = false;
+
+  ctx->new_obs.exists = true;
+  ctx->new_obs.oi.size = results.get<1>();
+  ctx->new_obs.oi.user_version = cop->user_version;
+  ctx->new_obs.oi.category = cop->category;
+  ctx->new_snapset.head_exists = true;
+  ctx->delta_stats.num_objects++;
+  ctx->delta_stats.num_bytes += ctx->new_obs.oi.size;
+
+  finish_ctx(ctx);
+
+  calc_trim_to();
+  append_log(ctx->log, pg_trim_to, ctx->local_t);
+
+  RepGather *repop = new_repop(ctx, obc, rep_tid);
+  issue_repop(repop, ctx->mtime);
+  eval_repop(repop);
+  repop->put();
+  osd->logger->inc(l_osd_tier_promote);
+}
+
+
+// ========================================================================
+// cache tier agent
+
+struct C_AgentFlush : public Context {
+  ReplicatedPGRef pg;
+  hobject_t oid;
+  epoch_t last_peering_reset;
+  tid_t tid;
+  C_AgentFlush(ReplicatedPG *p, hobject_t o, epoch_t lpr)
+    : pg(p), oid(o), last_peering_reset(lpr), tid(0)
+  {}
+  void finish(int r) {
+    pg->lock();
+    if (last_peering_reset == pg->get_last_peering_reset()) {
+      pg->agent_finish_flush(oid, tid, r);
+    }
+    pg->unlock();
+  }
+};
+
+void ReplicatedPG::hit_set_setup()
+{
+  hit_set.set_params(pool.info.hit_set_type,
+		     pool.info.hit_set_count, pool.info.hit_set_period,
+		     cct->_conf->osd_hit_set_target_size,
+		     cct->_conf->osd_hit_set_fpp);
+}
+
+hobject_t ReplicatedPG::get_hit_set_archive_object()
+{
+  ostringstream ss;
+  ss << "hit_set_" << info.pgid << "_archive";
+  return hobject_t(object_t(ss.str()), "", CEPH_NOSNAP, info.pgid.ps(),
+		   info.pgid.pool(), cct->_conf->osd_hit_set_namespace);
+}
+
+void ReplicatedPG::hit_set_persist()
+{
+  hobject_t oid = get_hit_set_archive_object();
+  if (is_missing_object(oid) || is_degraded_object(oid) ||
+      scrubber.write_blocked_by_scrub(oid)) {
+    // try again when the next interval closes
+    dout(20) << __func__ << " " << oid << " is degraded or scrubbed" << dendl;
+    return;
+  }
+  ObjectContextRef obc = get_object_context(oid, true);
+  if (!obc || obc->is_blocked() || !obc->rwstate.get_write_lock()) {
+    dout(20) << __func__ << " " << oid << " is in use" << dendl;
+    return;
+  }
+
+  bufferlist bl;
+  ::encode(hit_set, bl);
+  dout(10) << __func__ << " " << hit_set.size() << " intervals, "
+	   << bl.length() << " bytes to " << oid << dendl;
+  vector<OSDOp> ops(1);
+  ops[0].op.op = CEPH_OSD_OP_WRITEFULL;
+  ops[0].op.extent.offset = 0;
+  ops[0].op.extent.length = bl.length();
+  ops[0].indata = bl;
+  // never dirty, so the agent has nothing to flush
+  simple_op_submit(obc, ops, true);
+  hit_set.archived();
+}
+
+void ReplicatedPG::hit_set_load()
+{
+  hit_set_setup();
+  if (!hit_set.enabled())
+    return;
+  hobject_t oid = get_hit_set_archive_object();
+  if (is_missing_object(oid)) {
+    dout(10) << __func__ << " " << oid << " is missing, starting over"
+	     << dendl;
+    return;
+  }
+  bufferlist bl;
+  int r = osd->store->read(coll, oid, 0, 0, bl);
+  if (r < 0) {
+    dout(10) << __func__ << " no archive: " << cpp_strerror(r) << dendl;
+    return;
+  }
+  try {
+    bufferlist::iterator p = bl.begin();
+    ::decode(hit_set, p);
+  } catch (buffer::error& e) {
+    derr << __func__ << " failed to decode " << oid << ": " << e.what()
+	 << dendl;
+    hit_set.clear();
+    return;
+  }
+  dout(10) << __func__ << " " << hit_set.size() << " intervals from " << oid
+	   << dendl;
+}
+
+bool ReplicatedPG::agent_choose_mode()
+{
+  bool flush = false;
+  agent_evict_mode_t evict = AGENT_EVICT_NONE;
+  const object_stat_sum_t& sum = info.stats.stats.sum;
+
+  if (!pool.info.is_tier()) {
+    // not a cache
+  } else if (pool.info.cache_mode == pg_pool_t::CACHEMODE_INVALIDATE_FORWARD) {
+    flush = sum.num_objects_dirty > 0;
+    evict = AGENT_EVICT_ALL;
+  } else if (pool.info.cache_mode != pg_pool_t::CACHEMODE_NONE) {
+    // how full and how dirty we are against our share of the pool's
+    // targets, in millionths
+    unsigned pg_num = pool.info.get_pg_num();
+    uint64_t objects = MAX(sum.num_objects, 0);
+    uint64_t dirty = MAX(sum.num_objects_dirty, 0);
+    uint64_t bytes = MAX(sum.num_bytes, 0);
+    uint64_t full_micro = 0, dirty_micro = 0;
+    if (pool.info.target_max_objects) {
+      uint64_t target = MAX(pool.info.target_max_objects / pg_num, 1ull);
+      full_micro = objects * 1000000 / target;
+      dirty_micro = dirty * 1000000 / target;
+    }
+    if (pool.info.target_max_bytes && objects) {
+      uint64_t target = MAX(pool.info.target_max_bytes / pg_num, 1ull);
+      uint64_t avg = bytes / objects;
+      full_micro = MAX(full_micro, bytes * 1000000 / target);
+      dirty_micro = MAX(dirty_micro, dirty * avg * 1000000 / target);
+    }
+
+    if (full_micro > 1000000)
+      evict = AGENT_EVICT_FULL;
+    else if (full_micro > pool.info.cache_target_full_ratio_micro)
+      evict = AGENT_EVICT_COLD;
+    // dirty objects can't be evicted, so flush them when we are full too
+    flush = dirty_micro > pool.info.cache_target_dirty_ratio_micro ||
+      (evict != AGENT_EVICT_NONE && sum.num_objects_dirty > 0);
+  }
+
+  if (flush != agent_flush_mode || evict != agent_evict_mode) {
+    dout(10) << __func__ << " flush " << agent_flush_mode << " -> " << flush
+	     << ", evict " << agent_evict_mode << " -> " << evict << dendl;
+    agent_flush_mode = flush;
+    agent_evict_mode = evict;
+  }
+  return agent_flush_mode || agent_evict_mode != AGENT_EVICT_NONE;
+}
+
+void ReplicatedPG::agent_maybe_queue(utime_t now)
+{
+  if (agent_queued || now < agent_idle_until || !agent_choose_mode())
+    return;
+  dout(20) << __func__ << dendl;
+  agent_queued = true;
+  osd->queue_for_agent(this);
+}
+
+void ReplicatedPG::agent_work(ThreadPool::TPHandle &handle)
+{
+  lock_suspend_timeout(handle);
+  agent_queued = false;
+  if (deleting || !is_primary() || !is_active() || !agent_choose_mode()) {
+    dout(20) << __func__ << " nothing to do" << dendl;
+    unlock();
+    return;
+  }
+
+  int batch = cct->_conf->osd_agent_scan_batch;
+  vector<hobject_t> ls;
+  hobject_t next;
+  int r = pgbackend->objects_list_partial(agent_cursor, batch, batch, 0,
+					  &ls, &next);
+  assert(r >= 0);
+  dout(10) << __func__ << " flush " << agent_flush_mode
+	   << " evict " << agent_evict_mode
+	   << ", " << ls.size() << " objects from " << agent_cursor << dendl;
+
+  utime_t now = ceph_clock_now(cct);
+  hit_set_setup();
+  vector<hobject_t>::iterator p;
+  for (p = ls.begin(); p != ls.end(); ++p) {
+    if (!osd->agent_can_start()) {
+      dout(20) << __func__ << " osd agent at its limit" << dendl;
+      break;
+    }
+    if (!p->is_head() ||
+	p->get_namespace() == cct->_conf->osd_hit_set_namespace)
+      continue;
+    ObjectContextRef obc = get_object_context(*p, false);
+    if (!obc || !obc->obs.exists || !agent_can_modify(obc))
+      continue;
+    if (agent_maybe_flush(obc, now) || agent_maybe_evict(obc, now))
+      agent_cycle_started = true;
+  }
+
+  if (p != ls.end()) {
+    agent_cursor = *p;
+  } else if (next.is_max()) {
+    dout(10) << __func__ << " finished a pass over the pg" << dendl;
+    agent_cursor = hobject_t();
+    if (!agent_cycle_started) {
+      // everything is hot, dirty and busy or in the way; give it time
+      agent_idle_until = now;
+      agent_idle_until += cct->_conf->osd_agent_delay_time;
+    }
+    agent_cycle_started = false;
+  } else {
+    agent_cursor = next;
+  }
+
+  agent_maybe_queue(now);
+  unlock();
+}
+
+bool ReplicatedPG::agent_can_modify(ObjectContextRef obc)
+{
+  const hobject_t& soid = obc->obs.oi.soid;
+  if (flush_ops.count(soid)) {
+    dout(20) << __func__ << " " << soid << " is being flushed" << dendl;
+    return false;
+  }
+  if (is_missing_object(soid) || is_degraded_object(soid) ||
+      scrubber.write_blocked_by_scrub(soid)) {
+    dout(20) << __func__ << " " << soid << " is degraded or scrubbed" << dendl;
+    return false;
+  }
+  if (obc->is_blocked() || !obc->watchers.empty() ||
+      !obc->obs.oi.watchers.empty()) {
+    dout(20) << __func__ << " " << soid << " is blocked or watched" << dendl;
+    return false;
+  }
+  if (!obc->ssc || !obc->ssc->snapset.clones.empty()) {
+    // the clones would have to go with it
+    dout(20) << __func__ << " " << soid << " has clones" << dendl;
+    return false;
+  }
+  return true;
+}
+
+bool ReplicatedPG::agent_maybe_flush(ObjectContextRef obc, utime_t now)
+{
+  const hobject_t& soid = obc->obs.oi.soid;
+  if (!agent_flush_mode || !obc->obs.oi.is_dirty())
+    return false;
+  if (agent_evict_mode < AGENT_EVICT_FULL && hit_set.in_current(soid, now)) {
+    // likely to be written again soon
+    dout(20) << __func__ << " " << soid << " is hot, skipping" << dendl;
+    return false;
+  }
+
+  dout(10) << __func__ << " flushing " << soid << " v" << obc->obs.oi.version
+	   << dendl;
+  object_locator_t oloc(soid);
+  object_locator_t base_oloc(oloc);
+  base_oloc.pool = pool.info.tier_of;
+  ObjectOperation o;
+  o.copy_from(soid.oid, CEPH_NOSNAP, oloc, obc->obs.oi.user_version);
+
+  C_AgentFlush *fin = new C_AgentFlush(this, soid, get_last_peering_reset());
+  osd->objecter_lock.Lock();
+  tid_t tid = osd->objecter->mutate(soid.oid, base_oloc, o, SnapContext(),
+				    now, 0, NULL,
+				    new C_OnFinisher(fin,
+						     &osd->objecter_finisher));
+  fin->tid = tid;
+  osd->objecter_lock.Unlock();
+
+  FlushOp& fop = flush_ops[soid];
+  fop.obc = obc;
+  fop.version = obc->obs.oi.version;
+  fop.objecter_tid = tid;
+  osd->agent_start_op();
+  return true;
+}
+
+bool ReplicatedPG::agent_maybe_evict(ObjectContextRef obc, utime_t now)
+{
+  const hobject_t& soid = obc->obs.oi.soid;
+  if (agent_evict_mode == AGENT_EVICT_NONE || obc->obs.oi.is_dirty())
+    return false;
+  if (agent_evict_mode == AGENT_EVICT_COLD &&
+      hit_set.temperature(soid, now) > 0) {
+    dout(20) << __func__ << " " << soid << " is warm, skipping" << dendl;
+    return false;
+  }
+  if (agent_evict_mode == AGENT_EVICT_FULL && hit_set.in_current(soid, now)) {
+    dout(20) << __func__ << " " << soid << " is hot, skipping" << dendl;
+    return false;
+  }
+  if (!obc->rwstate.get_write_lock()) {
+    dout(20) << __func__ << " " << soid << " is in use, skipping" << dendl;
+    return false;
+  }
+
+  dout(10) << __func__ << " evicting " << soid << dendl;
+  agent_simple_op(obc, CEPH_OSD_OP_DELETE);
+  osd->agent_budget.charge(1, 0);
+  osd->logger->inc(l_osd_agent_evict);
+  return true;
+}
+
+void ReplicatedPG::agent_finish_flush(hobject_t oid, tid_t tid, int r)
+{
+  map<hobject_t,FlushOp>::iterator p = flush_ops.find(oid);
+  if (p == flush_ops.end() || p->second.objecter_tid != tid) {
+    dout(10) << __func__ << " " << oid << " tid " << tid
+	     << " no longer in flight" << dendl;
+    return;
+  }
+  ObjectContextRef obc = p->second.obc;
+  eversion_t version = p->second.version;
+  flush_ops.erase(p);
+  osd->agent_finish_op();
+
+  if (r < 0) {
+    dout(10) << __func__ << " " << oid << " flush failed: "
+	     << cpp_strerror(r) << dendl;
+  } else if (!obc->obs.exists || obc->obs.oi.version != version) {
+    dout(10) << __func__ << " " << oid << " changed since v" << version
+	     << ", still dirty" << dendl;
+  } else if (!agent_can_modify(obc) || !obc->rwstate.get_write_lock()) {
+    // it stays dirty and gets flushed again later
+    dout(10) << __func__ << " " << oid << " busy, not marking clean" << dendl;
+  } else {
+    dout(10) << __func__ << " " << oid << " v" << version << " is clean"
+	     << dendl;
+    agent_simple_op(obc, CEPH_OSD_OP_UNDIRTY);
+    osd->logger->inc(l_osd_agent_flush);
+  }
+  agent_maybe_queue(ceph_clock_now(cct));
+}
+
+void ReplicatedPG::agent_simple_op(ObjectContextRef obc, int opcode)
+{
+  vector<OSDOp> ops(1);
+  ops[0].op.op = opcode;
+  simple_op_submit(obc, ops, false);
+}
+
+void ReplicatedPG::simple_op_submit(ObjectContextRef obc, vector<OSDOp>& ops,
+				    bool undirty)
+{
+  tid_t rep_tid = osd->get_tid();
+  osd_reqid_t reqid(osd->get_cluster_msgr_name(), 0, rep_tid);
+  OpContext *ctx = new OpContext(OpRequestRef(), reqid, ops,
+				 &obc->obs, obc->ssc, this);
+  ctx->obc = obc;
+  ctx->undirty = undirty;
+  ctx->lock_to_release = OpContext::W_LOCK;
+  ctx->mtime = ceph_clock_now(cct);
+  ctx->at_version = pg_log.get_head();
+  ctx->at_version.epoch = get_osdmap()->get_epoch();
+  ctx->at_version.version++;
+  ctx->user_at_version = obc->obs.oi.user_version;
+
+  int r = prepare_transaction(ctx);
+  assert(r == 0);
+
+  calc_trim_to();
+  append_log(ctx->log, pg_trim_to, ctx->local_t);
+
+  RepGather *repop = new_repop(ctx, obc, rep_tid);
+  issue_repop(repop, ctx->mtime);
+  eval_repop(repop);
+  repop->put();
+}
+
+void ReplicatedPG::agent_clear()
+{
+  for (map<hobject_t,FlushOp>::iterator p = flush_ops.begin();
+       p != flush_ops.end();
+       flush_ops.erase(p++)) {
+    dout(10) << __func__ << " cancelling flush of " << p->first << dendl;
+    {
+      Mutex::Locker l(osd->objecter_lock);
+      osd->objecter->op_cancel(p->second.objecter_tid);
+    }
+    osd->agent_finish_op();
+  }
+  osd->agent_wq.dequeue(this);
+  agent_queued = false;
+  agent_flush_mode = false;
+  agent_evict_mode = AGENT_EVICT_NONE;
+  agent_cursor = hobject_t();
+  agent_cycle_started = false;
+  agent_idle_until = utime_t();
+  hit_set.clear();
+}
+
+
+// ========================================================================
+// rep op gather
+
+class C_OSD_OpApplied : public Context {
+public:
+  ReplicatedPGRef pg;
+  ReplicatedPG::RepGather *repop;
+
+  C_OSD_OpApplied(ReplicatedPG *p, ReplicatedPG::RepGather *rg) :
+    pg(p), repop(rg) {
+    repop->get();
+  }
+  void finish(int r) {
+    pg->op_applied(repop);
+  }
+};
+
+class C_OSD_OpCommit : public Context {
+public:
+  ReplicatedPGRef pg;
+  ReplicatedPG::RepGather *repop;
+
+  C_OSD_OpCommit(ReplicatedPG *p, ReplicatedPG::RepGather *rg) :
+    pg(p), repop(rg) {
+    repop->get();
+  }
+  void finish(int r) {
+    pg->op_commit(repop);
+  }
+};
+
+void ReplicatedPG::apply_repop(RepGather *repop)
+{
+  dout(10) << "apply_repop  applying update on " << *repop << dendl;
+  assert(!repop->applying);
+  assert(!repop->applied);
+
+  repop->applying = true;
+
+  repop->tls.push_back(&repop->ctx->local_t);
+  repop->tls.push_back(&repop->ctx->op_t);
+
+  repop->obc->ondisk_write_lock();
+  if (repop->ctx->clone_obc)
+    repop->ctx->clone_obc->ondisk_write_lock();
+
+  bool unlock_snapset_obc = false;
+  if (repop->ctx->snapset_obc && repop->ctx->snapset_obc->obs.oi.soid !=
+      repop->obc->obs.oi.soid) {
+    repop->ctx->snapset_obc->ondisk_write_lock();
+    unlock_snapset_obc = true;
+  }
+
+  Context *oncommit = new C_OSD_OpCommit(this, repop);
+  Context *onapplied = new C_OSD_OpApplied(this, repop);
+  Context *onapplied_sync = new C_OSD_OndiskWriteUnlock(
+    repop->obc,
+    repop->ctx->clone_obc,
+    unlock_snapset_obc ? repop->ctx->snapset_obc : ObjectContextRef());
+  int r = osd->store->queue_transactions(osr.get(), repop->tls, onapplied, oncommit, onapplied_sync, repop->ctx->op);
+  if (r) {
+    derr << "apply_repop  queue_transactions returned " << r << " on " << *repop << dendl;
+    assert(0);
+  }
+}
+
+void ReplicatedPG::op_applied(RepGather *repop)
+{
+  lock();
+  dout(10) << "op_applied " << *repop << dendl;
+  if (repop->ctx->op)
+    repop->ctx->op->mark_event("op_applied");
+  
+  repop->applying = false;
+  repop->applied = true;
+
+  // (logical) local ack.
+  int whoami = osd->get_nodeid();
+
+  if (!repop->aborted) {
+    assert(repop->waitfor_ack.count(whoami) ||
+	   repop->waitfor_disk.count(whoami) == 0);  // commit before ondisk
+    repop->waitfor_ack.erase(whoami);
+
+    if (repop->v != eversion_t()) {
+      assert(info.last_update >= repop->v);
+      assert(last_update_applied < repop->v);
+      last_update_applied = repop->v;
+    }
+
+    // chunky scrub
+    if (scrubber.active && scrubber.is_chunky) {
+      if (last_update_applied == scrubber.subset_last_update) {
+        osd->scrub_wq.queue(this);
+      }
+
+    // classic scrub
+    } else if (last_update_applied == info.last_update && scrubber.block_writes) {
+      dout(10) << "requeueing scrub for cleanup" << dendl;
+      scrubber.finalizing = true;
+      scrub_gather_replica_maps();
+      ++scrubber.waiting_on;
+      scrubber.waiting_on_whom.insert(osd->whoami);
+      osd->scrub_wq.queue(this);
+    }
+  }
+
+  if (!repop->aborted)
+    eval_repop(repop);
+
+  repop->put();
+  unlock();
+}
+
+void ReplicatedPG::op_commit(RepGather *repop)
+{
+  lock();
+  if (repop->ctx->op)
+    repop->ctx->op->mark_event("op_commit");
+
+  if (repop->aborted) {
     dout(10) << "op_commit " << *repop << " -- aborted" << dendl;
   } else if (repop->waitfor_disk.count(osd->get_nodeid()) == 0) {
     dout(10) << "op_commit " << *repop << " -- already marked ondisk" << dendl;
@@ -4823,10 +5636,10 @@ void ReplicatedPG::eval_repop(RepGather *repop)
 	}
 	reply->add_flags(CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK);
 	dout(10) << " sending commit on " << *repop << " " << reply << dendl;
-	assert(entity_name_t::TYPE_OSD != m->get_connection()->peer_type);
 	osd->send_message_osd_client(reply, m->get_connection());
 	repop->sent_disk = true;
 	repop->ctx->op->mark_commit_sent();
+	CEPH_TRACE1(pg_commit_sent, repop->ctx->op->get_seq());
       }
     }
 
@@ -4861,7 +5674,6 @@ void ReplicatedPG::eval_repop(RepGather *repop)
 	}
 	reply->add_flags(CEPH_OSD_FLAG_ACK);
 	dout(10) << " sending ack on " << *repop << " " << reply << dendl;
-        assert(entity_name_t::TYPE_OSD != m->get_connection()->peer_type);
 	osd->send_message_osd_client(reply, m->get_connection());
 	repop->sent_ack = true;
       }
@@ -4900,6 +5712,26 @@ void ReplicatedPG::eval_repop(RepGather *repop)
   }
 }
 
+class C_FlushRepopBatch : public Context {
+  ReplicatedPGRef pg;
+public:
+  C_FlushRepopBatch(ReplicatedPG *pg) : pg(pg) {}
+  void finish(int) { assert(0); /* not used */ }
+  void complete(int) {
+    // called by watch_timer with watch_lock held
+    OSDService *osd = pg->osd;
+    osd->watch_lock.Unlock();
+    pg->lock();
+    if (pg->repop_batch_flush == this) {
+      pg->repop_batch_flush = NULL;
+      pg->flush_repop_batch();
+    }
+    pg->unlock();
+    delete this;
+    osd->watch_lock.Lock();
+  }
+};
+
 void ReplicatedPG::issue_repop(RepGather *repop, utime_t now)
 {
   OpContext *ctx = repop->ctx;
@@ -4908,6 +5740,8 @@ void ReplicatedPG::issue_repop(RepGather *repop, utime_t now)
   dout(7) << "issue_repop rep_tid " << repop->rep_tid
           << " o " << soid
           << dendl;
+  CEPH_TRACE2(pg_issue_repop, ctx->op ? ctx->op->get_seq() : 0,
+	      repop->rep_tid);
 
   repop->v = ctx->at_version;
 
@@ -4923,6 +5757,20 @@ void ReplicatedPG::issue_repop(RepGather *repop, utime_t now)
     ss << "waiting for subops from " << vector<int>(actingbackfill.begin() + 1, actingbackfill.end());
     ctx->op->mark_sub_op_sent(ss.str());
   }
+
+  bool batch = can_batch_repop(repop);
+  if (!batch) {
+    // whatever is still held goes out first
+    flush_repop_batch();
+  }
+
+  // encode once; every replica gets the same buffers
+  bufferlist opt_bl, log_bl;
+  if (!batch && actingbackfill.size() > 1) {
+    ::encode(ctx->op_t, opt_bl);
+    ::encode(ctx->log, log_bl);
+  }
+
   for (unsigned i=1; i<actingbackfill.size(); i++) {
     int peer = actingbackfill[i];
     pg_info_t &pinfo = peer_info[peer];
@@ -4930,51 +5778,144 @@ void ReplicatedPG::issue_repop(RepGather *repop, utime_t now)
     repop->waitfor_ack.insert(peer);
     repop->waitfor_disk.insert(peer);
 
-    // forward the write/update/whatever
-    MOSDSubOp *wr = new MOSDSubOp(repop->ctx->reqid, info.pgid, soid,
-				  false, acks_wanted,
-				  get_osdmap()->get_epoch(),
-				  repop->rep_tid, repop->ctx->at_version);
-    if (ctx->op &&
-	((static_cast<MOSDOp *>(ctx->op->get_req()))->get_flags() & CEPH_OSD_FLAG_PARALLELEXEC)) {
-      // replicate original op for parallel execution on replica
-      assert(0 == "broken implementation, do not use");
-    }
-
-    int backfill_target = get_backfill_target();
-    // ship resulting transaction, log entries, and pg_stats
-    if (peer == backfill_target && soid > last_backfill_started &&
-        // only skip normal (not temp pool=-1) objects
-	soid.pool == (int64_t)info.pgid.pool()) {
-      dout(10) << "issue_repop shipping empty opt to osd." << peer
-	       <<", object beyond last_backfill_started"
-	       << last_backfill_started << ", last_backfill is "
-	       << pinfo.last_backfill << dendl;
-      ObjectStore::Transaction t;
-      ::encode(t, wr->get_data());
-    } else {
-      ::encode(repop->ctx->op_t, wr->get_data());
-    }
+    if (!batch) {
+      // forward the write/update/whatever
+      MOSDSubOp *wr = new MOSDSubOp(repop->ctx->reqid, info.pgid, soid,
+				    false, acks_wanted,
+				    get_osdmap()->get_epoch(),
+				    repop->rep_tid, repop->ctx->at_version);
+      if (ctx->op &&
+	  ((static_cast<MOSDOp *>(ctx->op->get_req()))->get_flags() & CEPH_OSD_FLAG_PARALLELEXEC)) {
+	// replicate original op for parallel execution on replica
+	assert(0 == "broken implementation, do not use");
+      }
 
-    ::encode(repop->ctx->log, wr->logbl);
+      int backfill_target = get_backfill_target();
+      // ship resulting transaction, log entries, and pg_stats
+      if (peer == backfill_target && soid > last_backfill_started &&
+	  // only skip normal (not temp pool=-1) objects
+	  soid.pool == (int64_t)info.pgid.pool()) {
+	dout(10) << "issue_repop shipping empty opt to osd." << peer
+		 <<", object beyond last_backfill_started"
+		 << last_backfill_started << ", last_backfill is "
+		 << pinfo.last_backfill << dendl;
+	ObjectStore::Transaction t;
+	::encode(t, wr->get_data());
+      } else {
+	wr->get_data() = opt_bl;
+      }
 
-    if (backfill_target >= 0 && backfill_target == peer)
-      wr->pg_stats = pinfo.stats;  // reflects backfill progress
-    else
-      wr->pg_stats = info.stats;
-    
-    wr->pg_trim_to = pg_trim_to;
+      wr->logbl = log_bl;
 
-    wr->new_temp_oid = repop->ctx->new_temp_oid;
-    wr->discard_temp_oid = repop->ctx->discard_temp_oid;
+      if (backfill_target >= 0 && backfill_target == peer)
+	wr->pg_stats = pinfo.stats;  // reflects backfill progress
+      else
+	wr->pg_stats = info.stats;
+
+      wr->pg_trim_to = pg_trim_to;
+      wr->pg_committed_to = min_last_complete_ondisk;
 
-    osd->send_message_osd_cluster(peer, wr, get_osdmap()->get_epoch());
+      wr->new_temp_oid = repop->ctx->new_temp_oid;
+      wr->discard_temp_oid = repop->ctx->discard_temp_oid;
+
+      osd->send_message_osd_cluster(peer, wr, get_osdmap()->get_epoch());
+    }
 
     // keep peer_info up to date
     if (pinfo.last_complete == pinfo.last_update)
       pinfo.last_update = ctx->at_version;
     pinfo.last_update = ctx->at_version;
   }
+
+  if (batch) {
+    // encode now; ctx->op_t is handed to the local store meanwhile
+    repop_batch.push_back(MOSDSubOp::batched_update_t());
+    MOSDSubOp::batched_update_t &u = repop_batch.back();
+    u.reqid = ctx->reqid;
+    u.poid = soid;
+    u.rep_tid = repop->rep_tid;
+    u.version = ctx->at_version;
+    ::encode(ctx->op_t, u.opt);
+    ::encode(ctx->log, u.logbl);
+    u.new_temp_oid = ctx->new_temp_oid;
+    u.discard_temp_oid = ctx->discard_temp_oid;
+    dout(15) << "issue_repop holding rep_tid " << repop->rep_tid
+	     << ", " << repop_batch.size() << " in batch" << dendl;
+
+    if ((int)repop_batch.size() >= cct->_conf->osd_repop_batch_max) {
+      flush_repop_batch();
+    } else if (!repop_batch_flush) {
+      Mutex::Locker l(osd->watch_lock);
+      repop_batch_flush = new C_FlushRepopBatch(this);
+      osd->watch_timer.add_event_after(cct->_conf->osd_repop_batch_window,
+				       repop_batch_flush);
+    }
+  }
+}
+
+bool ReplicatedPG::can_batch_repop(RepGather *repop)
+{
+  if (cct->_conf->osd_repop_batch_window <= 0 ||
+      cct->_conf->osd_repop_batch_max <= 1)
+    return false;
+  if (actingbackfill.size() < 2)
+    return false;
+  // no pushes or backfill to order the writes against
+  if (!is_clean() || actingbackfill.size() != acting.size())
+    return false;
+  for (unsigned i=1; i<actingbackfill.size(); i++) {
+    ConnectionRef con = osd->get_con_osd_cluster(actingbackfill[i],
+						 get_osdmap()->get_epoch());
+    if (!con || !(con->get_features() & CEPH_FEATURE_OSD_REPOP_BATCH))
+      return false;
+  }
+  return true;
+}
+
+MOSDSubOp *ReplicatedPG::new_repop_subop(const MOSDSubOp::batched_update_t &u)
+{
+  MOSDSubOp *wr = new MOSDSubOp(u.reqid, info.pgid, u.poid,
+				false, CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK,
+				get_osdmap()->get_epoch(),
+				u.rep_tid, u.version);
+  wr->get_data() = u.opt;
+  wr->logbl = u.logbl;
+  wr->new_temp_oid = u.new_temp_oid;
+  wr->discard_temp_oid = u.discard_temp_oid;
+  return wr;
+}
+
+void ReplicatedPG::flush_repop_batch()
+{
+  cancel_repop_batch();
+  if (repop_batch.empty())
+    return;
+
+  dout(10) << "flush_repop_batch " << repop_batch.size() << " writes through "
+	   << repop_batch.back().version << dendl;
+  for (unsigned i=1; i<actingbackfill.size(); i++) {
+    MOSDSubOp *wr = new_repop_subop(repop_batch.front());
+    wr->batched.assign(repop_batch.begin() + 1, repop_batch.end());
+    wr->pg_stats = info.stats;
+    wr->pg_trim_to = pg_trim_to;
+    wr->pg_committed_to = min_last_complete_ondisk;
+    osd->send_message_osd_cluster(actingbackfill[i], wr,
+				  get_osdmap()->get_epoch());
+  }
+  osd->logger->inc(l_osd_sop_w_batch);
+  osd->logger->inc(l_osd_sop_w_batch_ops, repop_batch.size());
+  repop_batch.clear();
+}
+
+void ReplicatedPG::cancel_repop_batch()
+{
+  if (!repop_batch_flush)
+    return;
+  Mutex::Locker l(osd->watch_lock);
+  // if the timer already fired, the callback is waiting for our lock
+  // and finds itself replaced
+  osd->watch_timer.cancel_event(repop_batch_flush);
+  repop_batch_flush = NULL;
 }
 
 ReplicatedPG::RepGather *ReplicatedPG::new_repop(OpContext *ctx, ObjectContextRef obc,
@@ -5232,9 +6173,21 @@ ObjectContextRef ReplicatedPG::create_object_context(const object_info_t& oi,
     register_snapset_context(ssc);
   dout(10) << "create_object_context " << (void*)obc.get() << " " << oi.soid << " " << dendl;
   populate_obc_watchers(obc);
+  cache_object_context(obc);
   return obc;
 }
 
+void ReplicatedPG::cache_object_context(ObjectContextRef obc)
+{
+  // only an active primary may keep obcs around; see on_flushed()
+  if (!is_primary() || !is_active())
+    return;
+  list<ObjectContextRef> drop;
+  osd->obc_cache.take_evicted(this, &drop);
+  osd->obc_cache.touch(this, obc, &drop);
+  // ... and the last references go here, under our lock
+}
+
 ObjectContextRef ReplicatedPG::get_object_context(const hobject_t& soid,
 						  bool can_create,
 						  map<string, bufferptr> *attrs)
@@ -5248,7 +6201,9 @@ ObjectContextRef ReplicatedPG::get_object_context(const hobject_t& soid,
   ObjectContextRef obc = object_contexts.lookup(soid);
   if (obc) {
     dout(10) << "get_object_context " << obc << " " << soid << dendl;
+    osd->logger->inc(l_osd_obc_cache_hit);
   } else {
+    osd->logger->inc(l_osd_obc_cache_miss);
     // check disk
     bufferlist bv;
     if (attrs) {
@@ -5287,11 +6242,16 @@ ObjectContextRef ReplicatedPG::get_object_context(const hobject_t& soid,
     populate_obc_watchers(obc);
     dout(10) << "get_object_context " << obc << " " << soid << " 0 -> 1 read " << obc->obs.oi << dendl;
   }
+  cache_object_context(obc);
   return obc;
 }
 
 void ReplicatedPG::context_registry_on_change()
 {
+  {
+    list<ObjectContextRef> drop;
+    osd->obc_cache.clear(this, &drop);
+  }
   pair<hobject_t, ObjectContextRef> i;
   while (object_contexts.get_next(i.first, &i)) {
     ObjectContextRef obc(i.second);
@@ -5557,6 +6517,44 @@ void ReplicatedPG::put_snapset_context(SnapSetContext *ssc)
 
 // sub op modify
 
+/**
+ * A replica may serve a read if it has the pg in full and the object
+ * has no writes that might not be on disk everywhere yet: the client
+ * must not see a write that may still be lost with the primary, nor
+ * miss one it has already been told about.
+ */
+bool ReplicatedPG::can_serve_replica_read(OpRequestRef op, const hobject_t& head)
+{
+  MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
+  if (op->may_write() || (m->get_flags() & CEPH_OSD_FLAG_RWORDERED))
+    return false;
+  for (vector<OSDOp>::iterator p = m->ops.begin(); p != m->ops.end(); ++p) {
+    // watchers live on the primary
+    if (p->op.op == CEPH_OSD_OP_WATCH ||
+	p->op.op == CEPH_OSD_OP_NOTIFY ||
+	p->op.op == CEPH_OSD_OP_NOTIFY_ACK)
+      return false;
+  }
+
+  if (!is_active() || is_replay())
+    return false;
+  if (info.last_complete != info.last_update ||
+      info.last_backfill != hobject_t::get_max() ||
+      pg_log.get_missing().num_missing())
+    return false;
+
+  hobject_t snapdir = head;
+  snapdir.snap = CEPH_SNAPDIR;
+  const hash_map<hobject_t,pg_log_entry_t*> &objects = pg_log.get_log().objects;
+  hash_map<hobject_t,pg_log_entry_t*>::const_iterator p = objects.find(head);
+  if (p != objects.end() && p->second->version > replica_committed_to)
+    return false;
+  p = objects.find(snapdir);
+  if (p != objects.end() && p->second->version > replica_committed_to)
+    return false;
+  return true;
+}
+
 void ReplicatedPG::sub_op_modify(OpRequestRef op)
 {
   MOSDSubOp *m = static_cast<MOSDSubOp*>(op->get_req());
@@ -5622,6 +6620,13 @@ void ReplicatedPG::sub_op_modify(OpRequestRef op)
       rm->opt.set_tolerate_collection_add_enoent();
     p = m->logbl.begin();
     ::decode(log, p);
+    if (!m->batched.empty()) {
+      // the first of a batch; take the rest along in the same
+      // transactions
+      if (!rm->opt.empty())
+	update_snap_map(log, rm->localt);
+      sub_op_modify_batched(m, rm, log);
+    }
     if (m->hobject_incorrect_pool) {
       for (vector<pg_log_entry_t>::iterator i = log.begin();
 	  i != log.end();
@@ -5634,7 +6639,9 @@ void ReplicatedPG::sub_op_modify(OpRequestRef op)
     rm->opt.set_replica();
 
     info.stats = m->pg_stats;
-    if (!rm->opt.empty()) {
+    if (m->pg_committed_to > replica_committed_to)
+      replica_committed_to = m->pg_committed_to;
+    if (m->batched.empty() && !rm->opt.empty()) {
       // If the opt is non-empty, we infer we are before
       // last_backfill (according to the primary, not our
       // not-quite-accurate value), and should update the
@@ -5645,8 +6652,13 @@ void ReplicatedPG::sub_op_modify(OpRequestRef op)
 
     rm->tls.push_back(&rm->localt);
     rm->tls.push_back(&rm->opt);
-    
     rm->bytes_written = rm->opt.get_encoded_bytes();
+    for (list<ObjectStore::Transaction>::iterator i = rm->batched_opt.begin();
+	 i != rm->batched_opt.end();
+	 ++i) {
+      rm->tls.push_back(&*i);
+      rm->bytes_written += i->get_encoded_bytes();
+    }
 
   } else {
     // just trim the log
@@ -5670,6 +6682,41 @@ void ReplicatedPG::sub_op_modify(OpRequestRef op)
   // op is cleaned up by oncommit/onapply when both are executed
 }
 
+void ReplicatedPG::sub_op_modify_batched(MOSDSubOp *m, RepModify *rm,
+					 vector<pg_log_entry_t> &log)
+{
+  for (vector<MOSDSubOp::batched_update_t>::iterator u = m->batched.begin();
+       u != m->batched.end();
+       ++u) {
+    dout(10) << "sub_op_modify batched " << u->poid << " v " << u->version
+	     << dendl;
+    assert(!pg_log.get_missing().is_missing(u->poid));
+    if (u->new_temp_oid != hobject_t()) {
+      dout(20) << __func__ << " start tracking temp " << u->new_temp_oid << dendl;
+      pgbackend->add_temp_obj(u->new_temp_oid);
+      get_temp_coll(&rm->localt);
+    }
+    if (u->discard_temp_oid != hobject_t()) {
+      dout(20) << __func__ << " stop tracking temp " << u->discard_temp_oid << dendl;
+      pgbackend->clear_temp_obj(u->discard_temp_oid);
+    }
+
+    rm->batched_opt.push_back(ObjectStore::Transaction());
+    ObjectStore::Transaction &t = rm->batched_opt.back();
+    bufferlist::iterator p = u->opt.begin();
+    ::decode(t, p);
+    t.set_replica();
+
+    vector<pg_log_entry_t> ulog;
+    p = u->logbl.begin();
+    ::decode(ulog, p);
+    // batches only come from clean pgs, so every write goes to disk now
+    if (!t.empty())
+      update_snap_map(ulog, rm->localt);
+    log.insert(log.end(), ulog.begin(), ulog.end());
+  }
+}
+
 void ReplicatedPG::sub_op_modify_applied(RepModify *rm)
 {
   lock();
@@ -5689,12 +6736,13 @@ void ReplicatedPG::sub_op_modify_applied(RepModify *rm)
     }
     
     if (m->version != eversion_t()) {
-      assert(info.last_update >= m->version);
+      assert(info.last_update >= m->get_last_version());
       assert(last_update_applied < m->version);
-      last_update_applied = m->version;
+      last_update_applied = m->get_last_version();
     }
     if (scrubber.active_rep_scrub) {
-      if (last_update_applied == scrubber.active_rep_scrub->scrub_to) {
+      // >=: a batch may take us past scrub_to in one step
+      if (last_update_applied >= scrubber.active_rep_scrub->scrub_to) {
 	osd->rep_scrub_wq.queue(scrubber.active_rep_scrub);
 	scrubber.active_rep_scrub = 0;
       }
@@ -5767,6 +6815,15 @@ void ReplicatedPG::sub_op_modify_reply(OpRequestRef op)
 	      fromosd, 
 	      r->get_last_complete_ondisk());
   }
+  for (vector<tid_t>::iterator p = r->batched_tids.begin();
+       p != r->batched_tids.end();
+       ++p) {
+    if (repop_map.count(*p))
+      repop_ack(repop_map[*p],
+		r->get_result(), r->ack_type,
+		fromosd,
+		r->get_last_complete_ondisk());
+  }
 }
 
 
@@ -5780,6 +6837,71 @@ void ReplicatedPG::sub_op_modify_reply(OpRequestRef op)
 
 // ===========================================================
 
+/**
+ * If peer still has an older version of head and every log entry
+ * since then recorded the extents it dirtied, fill in the union of
+ * those extents and the version the peer has.
+ *
+ * The result is applied to the peer's copy in place, so we only offer
+ * it if it fits in a single push; otherwise the peer would have to
+ * stage it in the temp collection, and then it may as well get the
+ * whole object.
+ */
+bool ReplicatedBackend::calc_delta_subset(
+  ObjectContextRef obc, const hobject_t& head, int peer,
+  eversion_t *delta_from,
+  interval_set<uint64_t> *data_subset)
+{
+  if (!cct->_conf->osd_recovery_delta)
+    return false;
+
+  map<int, pg_missing_t>::const_iterator pm =
+    get_parent()->get_peer_missing().find(peer);
+  assert(pm != get_parent()->get_peer_missing().end());
+  map<hobject_t, pg_missing_t::item>::const_iterator item =
+    pm->second.missing.find(head);
+  if (item == pm->second.missing.end() ||
+      item->second.have == eversion_t())
+    return false;
+  eversion_t have = item->second.have;
+
+  ConnectionRef con = osd->get_con_osd_cluster(
+    peer, get_osdmap()->get_epoch());
+  if (!con || !(con->get_features() & CEPH_FEATURE_OSD_DELTA_RECOVERY))
+    return false;
+
+  // walk back to the version the peer has, making sure the chain of
+  // entries for head is unbroken
+  const list<pg_log_entry_t> &log = get_parent()->get_log().get_log().log;
+  interval_set<uint64_t> dirty;
+  eversion_t prior;
+  for (list<pg_log_entry_t>::const_reverse_iterator p = log.rbegin();
+       p != log.rend() && p->version > have;
+       ++p) {
+    if (p->soid != head)
+      continue;
+    if (!p->is_modify() || !p->dirty_extents_known)
+      return false;
+    dirty.union_of(p->dirty_extents);
+    prior = p->prior_version;
+  }
+  if (prior != have)
+    return false;
+
+  interval_set<uint64_t> object;
+  if (obc->obs.oi.size)
+    object.insert(0, obc->obs.oi.size);
+  dirty.intersection_of(object);
+  if (dirty.size() > cct->_conf->osd_recovery_max_chunk)
+    return false;
+
+  dout(10) << __func__ << ": " << head << " from " << have
+	   << " to " << obc->obs.oi.version << " dirty " << dirty << dendl;
+  *delta_from = have;
+  data_subset->swap(dirty);
+  return true;
+}
+
 void ReplicatedBackend::calc_head_subsets(
   ObjectContextRef obc, SnapSet& snapset, const hobject_t& head,
   const pg_missing_t& missing,
@@ -6158,6 +7280,24 @@ void ReplicatedBackend::prep_push_to_replica(
     SnapSetContext *ssc = obc->ssc;
     assert(ssc);
     dout(15) << "push_to_replica snapset is " << ssc->snapset << dendl;
+
+    // if the log knows everything the replica missed, send just that
+    eversion_t delta_from;
+    if (calc_delta_subset(obc, soid, peer, &delta_from, &data_subset)) {
+      prep_push(obc, soid, peer, oi.version, data_subset, clone_subsets, pop,
+		delta_from);
+      // a delta is applied in place, so it has to go in one piece
+      if (pop->after_progress.data_complete &&
+	  pop->after_progress.omap_complete) {
+	osd->logger->inc(l_osd_push_delta);
+	return;
+      }
+      dout(10) << __func__ << ": " << soid << " delta from " << delta_from
+	       << " does not fit in one push, pushing the whole object" << dendl;
+      pushing[soid].erase(peer);
+      *pop = PushOp();
+      data_subset.clear();
+    }
     calc_head_subsets(
       obc,
       ssc->snapset, soid, get_parent()->get_peer_missing().find(peer)->second,
@@ -6188,7 +7328,8 @@ void ReplicatedBackend::prep_push(
   eversion_t version,
   interval_set<uint64_t> &data_subset,
   map<hobject_t, interval_set<uint64_t> >& clone_subsets,
-  PushOp *pop)
+  PushOp *pop,
+  eversion_t delta_from)
 {
   get_parent()->begin_peer_recover(peer, soid);
   // take note.
@@ -6200,6 +7341,7 @@ void ReplicatedBackend::prep_push(
   pi.recovery_info.soid = soid;
   pi.recovery_info.oi = obc->obs.oi;
   pi.recovery_info.version = version;
+  pi.recovery_info.delta_from = delta_from;
   pi.recovery_progress.first = true;
   pi.recovery_progress.data_recovered_to = 0;
   pi.recovery_progress.data_complete = 0;
@@ -6213,6 +7355,7 @@ void ReplicatedBackend::prep_push(
 			&(pi.stat));
   assert(r == 0);
   pi.recovery_progress = new_progress;
+  pi.in_flight = 1;
 }
 
 int ReplicatedBackend::send_pull_legacy(int prio, int peer,
@@ -6258,6 +7401,13 @@ void ReplicatedBackend::submit_push_data(
   map<string, bufferlist> &omap_entries,
   ObjectStore::Transaction *t)
 {
+  if (recovery_info.delta_from != eversion_t()) {
+    assert(first && complete);
+    submit_push_delta(recovery_info, intervals_included, data_included,
+		      omap_header, attrs, omap_entries, t);
+    return;
+  }
+
   coll_t target_coll;
   if (first && complete) {
     target_coll = coll;
@@ -6303,6 +7453,47 @@ void ReplicatedBackend::submit_push_data(
   }
 }
 
+/**
+ * Apply a push that only carries what changed since delta_from to our
+ * copy at that version.
+ */
+void ReplicatedBackend::submit_push_delta(
+  ObjectRecoveryInfo &recovery_info,
+  const interval_set<uint64_t> &intervals_included,
+  bufferlist data_included,
+  bufferlist omap_header,
+  map<string, bufferptr> &attrs,
+  map<string, bufferlist> &omap_entries,
+  ObjectStore::Transaction *t)
+{
+  const hobject_t &soid = recovery_info.soid;
+  bufferlist bv;
+  int r = osd->store->getattr(coll, soid, OI_ATTR, bv);
+  assert(r >= 0);
+  object_info_t oi(bv);
+  dout(10) << __func__ << ": " << soid << " " << oi.version
+	   << " -> " << recovery_info.version
+	   << " dirty " << intervals_included << dendl;
+  assert(oi.version == recovery_info.delta_from);
+
+  uint64_t off = 0;
+  for (interval_set<uint64_t>::const_iterator p = intervals_included.begin();
+       p != intervals_included.end();
+       ++p) {
+    bufferlist bit;
+    bit.substr_of(data_included, off, p.get_len());
+    t->write(coll, soid, p.get_start(), p.get_len(), bit);
+    off += p.get_len();
+  }
+  t->truncate(coll, soid, recovery_info.size);
+
+  t->omap_clear(coll, soid);
+  t->omap_setheader(coll, soid, omap_header);
+  t->omap_setkeys(coll, soid, omap_entries);
+  t->rmattrs(coll, soid);
+  t->setattrs(coll, soid, attrs);
+}
+
 void ReplicatedBackend::submit_push_complete(ObjectRecoveryInfo &recovery_info,
 					     ObjectStore::Transaction *t)
 {
@@ -6657,6 +7848,7 @@ int ReplicatedBackend::build_push_op(const ObjectRecoveryInfo &recovery_info,
 
   osd->logger->inc(l_osd_push);
   osd->logger->inc(l_osd_push_outb, out_op->data.length());
+  osd->recovery_budget.charge(0, out_op->data.length());
   
   // send
   out_op->version = recovery_info.version;
@@ -6711,39 +7903,61 @@ void ReplicatedBackend::sub_op_push_reply(OpRequestRef op)
   
   PushReplyOp rop;
   rop.soid = soid;
-  PushOp pop;
-  bool more = handle_push_reply(peer, rop, &pop);
-  if (more)
-    send_push_op_legacy(op->get_req()->get_priority(), peer, pop);
+  vector<PushOp> replies;
+  handle_push_reply(peer, rop, &replies);
+  for (vector<PushOp>::iterator i = replies.begin();
+       i != replies.end();
+       ++i)
+    send_push_op_legacy(op->get_req()->get_priority(), peer, *i);
 }
 
-bool ReplicatedBackend::handle_push_reply(int peer, PushReplyOp &op, PushOp *reply)
+/**
+ * A chunk of soid was applied by peer.  Queue up to
+ * osd_recovery_push_window chunks after it in replies, or finish the
+ * push once the last one is acked.  The peer applies the chunks of an
+ * object in the order we send them, so there is no need to wait for
+ * each before sending the next.
+ */
+void ReplicatedBackend::handle_push_reply(int peer, PushReplyOp &op,
+					  vector<PushOp> *replies)
 {
   const hobject_t &soid = op.soid;
   if (pushing.count(soid) == 0) {
     dout(10) << "huh, i wasn't pushing " << soid << " to osd." << peer
 	     << ", or anybody else"
 	     << dendl;
-    return false;
+    return;
   } else if (pushing[soid].count(peer) == 0) {
     dout(10) << "huh, i wasn't pushing " << soid << " to osd." << peer
 	     << dendl;
-    return false;
+    return;
   } else {
     PushInfo *pi = &pushing[soid][peer];
+    if (pi->in_flight)
+      --pi->in_flight;
 
     if (!pi->recovery_progress.data_complete) {
-      dout(10) << " pushing more from, "
-	       << pi->recovery_progress.data_recovered_to
-	       << " of " << pi->recovery_info.copy_subset << dendl;
-      ObjectRecoveryProgress new_progress;
-      int r = build_push_op(
-	pi->recovery_info,
-	pi->recovery_progress, &new_progress, reply,
-	&(pi->stat));
-      assert(r == 0);
-      pi->recovery_progress = new_progress;
-      return true;
+      unsigned window = MAX(1, cct->_conf->osd_recovery_push_window);
+      while (!pi->recovery_progress.data_complete &&
+	     pi->in_flight < window) {
+	dout(10) << " pushing more from, "
+		 << pi->recovery_progress.data_recovered_to
+		 << " of " << pi->recovery_info.copy_subset << dendl;
+	replies->push_back(PushOp());
+	ObjectRecoveryProgress new_progress;
+	int r = build_push_op(
+	  pi->recovery_info,
+	  pi->recovery_progress, &new_progress, &replies->back(),
+	  &(pi->stat));
+	assert(r == 0);
+	pi->recovery_progress = new_progress;
+	++pi->in_flight;
+      }
+      return;
+    } else if (pi->in_flight) {
+      dout(10) << " pushed " << soid << " to osd." << peer << ", waiting for "
+	       << pi->in_flight << " more acks" << dendl;
+      return;
     } else {
       // done!
       get_parent()->on_peer_recover(
@@ -6760,7 +7974,7 @@ bool ReplicatedBackend::handle_push_reply(int peer, PushReplyOp &op, PushOp *rep
 	dout(10) << "pushed " << soid << ", still waiting for push ack from " 
 		 << pushing[soid].size() << " others" << dendl;
       }
-      return false;
+      return;
     }
   }
 }
@@ -7286,6 +8500,10 @@ void ReplicatedPG::apply_and_flush_repops(bool requeue)
 {
   list<OpRequestRef> rq;
 
+  // the replicas learn about held writes through peering instead
+  cancel_repop_batch();
+  repop_batch.clear();
+
   // apply all repops
   while (!repop_queue.empty()) {
     RepGather *repop = repop_queue.front();
@@ -7360,7 +8578,6 @@ void ReplicatedPG::on_shutdown()
   osd->recovery_wq.dequeue(this);
   osd->scrub_wq.dequeue(this);
   osd->scrub_finalize_wq.dequeue(this);
-  osd->snap_trim_wq.dequeue(this);
   osd->pg_stat_queue_dequeue(this);
   osd->dequeue_pg(this, 0);
   osd->peering_wq.dequeue(this);
@@ -7370,6 +8587,8 @@ void ReplicatedPG::on_shutdown()
 
   unreg_next_scrub();
   cancel_copy_ops(false);
+  cancel_proxy_read_ops(false);
+  agent_clear();
   apply_and_flush_repops(false);
   context_registry_on_change();
 
@@ -7384,6 +8603,9 @@ void ReplicatedPG::on_shutdown()
 // For now only care about a single backfill at a time
 void ReplicatedPG::on_activate()
 {
+  if (is_primary() && pool.info.cache_mode != pg_pool_t::CACHEMODE_NONE)
+    hit_set_load();
+
   int backfill_target = get_backfill_target();
   if (backfill_target == -1)
     return;
@@ -7404,8 +8626,11 @@ void ReplicatedPG::on_change(ObjectStore::Transaction *t)
   scrub_clear_state();
 
   context_registry_on_change();
+  replica_committed_to = eversion_t();
 
   cancel_copy_ops(is_primary());
+  cancel_proxy_read_ops(is_primary());
+  agent_clear();
 
   // requeue object waiters
   if (is_primary()) {
@@ -7564,6 +8789,9 @@ bool ReplicatedPG::start_recovery_ops(
   bool work_in_progress = false;
   assert(is_primary());
 
+  // pushes must not overtake writes we still hold
+  flush_repop_batch();
+
   if (!state_test(PG_STATE_RECOVERING) &&
       !state_test(PG_STATE_BACKFILL)) {
     /* TODO: I think this case is broken and will make do_recovery()
@@ -7600,7 +8828,8 @@ bool ReplicatedPG::start_recovery_ops(
 
   bool deferred_backfill = false;
   int backfill_target = get_backfill_target();
-  if (recovering.empty() &&
+  // objects backfill is still pushing don't hold up the next ones
+  if (recovering.size() == backfills_in_flight.size() &&
       state_test(PG_STATE_BACKFILL) &&
       backfill_target >= 0 && started < max &&
       missing.num_missing() == 0 &&
@@ -8066,6 +9295,13 @@ int ReplicatedPG::recover_backfill(
 
     if (pbi.begin <= backfill_info.begin &&
 	!pbi.extends_to_end() && pbi.empty()) {
+      if (peer_backfill_prefetching) {
+	dout(10) << " waiting for prefetched interval from peer osd."
+		 << backfill_target << " at " << pbi.end << dendl;
+	waiting_on_backfill = true;
+	*work_started = true;
+	break;
+      }
       dout(10) << " scanning peer osd." << backfill_target << " from " << pbi.end << dendl;
       epoch_t e = get_osdmap()->get_epoch();
       MOSDPGScan *m = new MOSDPGScan(MOSDPGScan::OP_SCAN_GET_DIGEST, e, e, info.pgid,
@@ -8153,6 +9389,23 @@ int ReplicatedPG::recover_backfill(
   }
   backfill_pos = MIN(backfill_info.begin, pbi.begin);
 
+  // ask for the peer's next interval now so that it is (probably)
+  // here by the time the pushes for this one are done
+  if (cct->_conf->osd_backfill_scan_prefetch &&
+      ops < max &&
+      !waiting_on_backfill && !peer_backfill_prefetching &&
+      !pbi.empty() && !pbi.extends_to_end()) {
+    dout(10) << " prefetching peer osd." << backfill_target << " from "
+	     << pbi.end << dendl;
+    epoch_t e = get_osdmap()->get_epoch();
+    MOSDPGScan *m = new MOSDPGScan(MOSDPGScan::OP_SCAN_GET_DIGEST, e, e, info.pgid,
+				   pbi.end, hobject_t());
+    osd->send_message_osd_cluster(backfill_target, m, get_osdmap()->get_epoch());
+    peer_backfill_prefetching = true;
+    start_recovery_op(pbi.end);
+    ops++;
+  }
+
   for (set<hobject_t>::iterator i = add_to_stat.begin();
        i != add_to_stat.end();
        ++i) {
@@ -8359,8 +9612,10 @@ void ReplicatedPG::scan_range(
   for (vector<hobject_t>::iterator p = ls.begin(); p != ls.end(); ++p) {
     handle.reset_tp_timeout();
     ObjectContextRef obc;
-    if (is_primary())
-      obc = object_contexts.lookup(*p);
+    // on the primary, load the obcs right away: recover_backfill is
+    // about to need them for the pushes
+    if (is_primary() && !pg_log.get_missing().is_missing(*p))
+      obc = get_object_context(*p, false);
     if (obc) {
       bi->objects[*p] = obc->obs.oi.version;
       dout(20) << "  " << *p << " " << obc->obs.oi.version << dendl;
@@ -8513,6 +9768,8 @@ void ReplicatedPG::_scrub(ScrubMap& scrubmap)
     dout(20) << mode << "  " << soid << " " << oi << dendl;
 
     stat.num_bytes += p->second.size;
+    if (soid.snap == CEPH_NOSNAP && oi.is_dirty())
+      stat.num_objects_dirty++;
 
     //bufferlist data;
     //osd->store->read(c, poid, 0, 0, data);
@@ -8578,6 +9835,12 @@ void ReplicatedPG::_scrub_finish()
   bool deep_scrub = state_test(PG_STATE_DEEP_SCRUB);
   const char *mode = (repair ? "repair": (deep_scrub ? "deep-scrub" : "scrub"));
 
+  if (scrubber.deep_resumed) {
+    // only saw the objects since it was resumed
+    dout(10) << mode << " resumed, not checking stats" << dendl;
+    return;
+  }
+
   if (info.stats.stats_invalid) {
     info.stats.stats = scrub_cstat;
     info.stats.stats_invalid = false;
@@ -8589,6 +9852,17 @@ void ReplicatedPG::_scrub_finish()
 	   << scrub_cstat.sum.num_bytes << "/" << info.stats.stats.sum.num_bytes << " bytes."
 	   << dendl;
 
+  if (scrub_cstat.sum.num_objects_dirty !=
+      info.stats.stats.sum.num_objects_dirty) {
+    // stats from before dirty heads were counted; nothing is wrong
+    dout(10) << mode << " correcting dirty objects "
+	     << info.stats.stats.sum.num_objects_dirty << " -> "
+	     << scrub_cstat.sum.num_objects_dirty << dendl;
+    info.stats.stats.sum.num_objects_dirty =
+      scrub_cstat.sum.num_objects_dirty;
+    publish_stats_to_osd();
+  }
+
   if (scrub_cstat.sum.num_objects != info.stats.stats.sum.num_objects ||
       scrub_cstat.sum.num_object_clones != info.stats.stats.sum.num_object_clones ||
       scrub_cstat.sum.num_bytes != info.stats.stats.sum.num_bytes) {
@@ -8683,6 +9957,8 @@ ReplicatedPG::TrimmingObjects::TrimmingObjects(my_context ctx)
     NamedState(context< SnapTrimmer >().pg->cct, "Trimming/TrimmingObjects")
 {
   context< SnapTrimmer >().log_enter(state_name);
+  // the last repop of each batch requeues us once it completes
+  context< SnapTrimmer >().requeue = false;
 }
 
 void ReplicatedPG::TrimmingObjects::exit()
@@ -8706,8 +9982,24 @@ boost::statechart::result ReplicatedPG::TrimmingObjects::react(const SnapTrim&)
 
   dout(10) << "TrimmingObjects: trimming snap " << snap_to_trim << dendl;
 
-  // Get next
-  int r = pg->snap_mapper.get_next_object_to_trim(snap_to_trim, &pos);
+  // one batch in flight at a time
+  for (set<RepGather *>::iterator i = repops.begin();
+       i != repops.end();
+       repops.erase(i++)) {
+    if (!(*i)->applied || !(*i)->waitfor_ack.empty()) {
+      dout(10) << "TrimmingObjects: waiting on rep_tid " << (*i)->rep_tid
+	       << dendl;
+      return discard_event();
+    }
+    (*i)->put();
+  }
+
+  // Get next batch
+  vector<hobject_t> to_trim;
+  int r = pg->snap_mapper.get_next_objects_to_trim(
+    snap_to_trim,
+    MAX(pg->cct->_conf->osd_snap_trim_batch, 1),
+    &to_trim);
   if (r != 0 && r != -ENOENT) {
     derr << __func__ << ": get_next returned " << cpp_strerror(r) << dendl;
     assert(0);
@@ -8718,16 +10010,28 @@ boost::statechart::result ReplicatedPG::TrimmingObjects::react(const SnapTrim&)
     return transit< WaitingOnReplicas >();
   }
 
-  dout(10) << "TrimmingObjects react trimming " << pos << dendl;
-  RepGather *repop = pg->trim_object(pos);
-  assert(repop);
-  repop->queue_snap_trimmer = true;
+  // the repops of a batch go to the replicas together when repop
+  // batching is on, and each replica applies them as one transaction
+  RepGather *repop = NULL;
+  for (vector<hobject_t>::iterator p = to_trim.begin();
+       p != to_trim.end();
+       ++p) {
+    dout(10) << "TrimmingObjects react trimming " << *p << dendl;
+    repop = pg->trim_object(*p);
+    assert(repop);
+    if (p + 1 == to_trim.end())
+      repop->queue_snap_trimmer = true;
+
+    pg->append_log(repop->ctx->log, eversion_t(), repop->ctx->local_t);
+    pg->issue_repop(repop, repop->ctx->mtime);
+    pg->eval_repop(repop);
 
-  pg->append_log(repop->ctx->log, eversion_t(), repop->ctx->local_t);
-  pg->issue_repop(repop, repop->ctx->mtime);
-  pg->eval_repop(repop);
+    repops.insert(repop);
+  }
+  pg->flush_repop_batch();
 
-  repops.insert(repop);
+  // the op queue let one object in already
+  pg->osd->snap_trim_budget.charge(to_trim.size() - 1, 0);
   return discard_event();
 }
 /* WaitingOnReplicasObjects */
@@ -22,6 +22,7 @@
 
 #include "include/assert.h" 
 #include "common/cmdparse.h"
+#include "common/ObjectPool.h"
 
 #include "PG.h"
 #include "OSD.h"
@@ -36,6 +37,7 @@
 
 #include "PGBackend.h"
 #include "ReplicatedBackend.h"
+#include "HitSet.h"
 
 class MOSDSubOpReply;
 
@@ -199,6 +201,42 @@ public:
   };
   friend class CopyFromCallback;
 
+  /// finishes the background copy of an object up from the base tier
+  class PromoteCallback: public CopyCallback {
+    ReplicatedPG *pg;
+    ObjectContextRef obc;
+    hobject_t temp_obj;
+  public:
+    PromoteCallback(ReplicatedPG *pg_, ObjectContextRef obc_,
+		    const hobject_t& temp_obj_) :
+      pg(pg_), obc(obc_), temp_obj(temp_obj_) {}
+    ~PromoteCallback() {}
+
+    virtual void finish(CopyResults& results) {
+      pg->finish_promote(results, obc, temp_obj);
+    }
+  };
+  friend class PromoteCallback;
+
+  /*
+   * a read of an object the cache tier doesn't have, sent on to the
+   * base tier on the client's behalf
+   */
+  struct ProxyReadOp {
+    OpRequestRef op;
+    hobject_t soid;
+    tid_t objecter_tid;
+    vector<bufferlist> outdata;  ///< per op, filled in by the objecter
+    vector<int> rval;            ///< per op, filled in by the objecter
+    version_t user_version;
+
+    ProxyReadOp(OpRequestRef _op, const hobject_t& oid, unsigned num_ops)
+      : op(_op), soid(oid), objecter_tid(0),
+	outdata(num_ops), rval(num_ops, 0), user_version(0)
+    {}
+  };
+  typedef boost::shared_ptr<ProxyReadOp> ProxyReadOpRef;
+
   boost::scoped_ptr<PGBackend> pgbackend;
   PGBackend *get_pgbackend() {
     return pgbackend.get();
@@ -361,6 +399,8 @@ public:
     vector<pg_log_entry_t> log;
 
     interval_set<uint64_t> modified_ranges;
+    interval_set<uint64_t> dirty_extents;  ///< data changed, for the log entry
+    bool dirty_extents_known;              ///< false if we lost track
     ObjectContextRef obc;
     map<hobject_t,ObjectContextRef> src_obc;
     ObjectContextRef clone_obc;    // if we created a clone
@@ -385,6 +425,9 @@ public:
     OpContext(const OpContext& other);
     const OpContext& operator=(const OpContext& other);
 
+    static ObjectPool alloc_pool;
+    OBJECT_POOL_ALLOCATOR(alloc_pool)
+
     OpContext(OpRequestRef _op, osd_reqid_t _reqid, vector<OSDOp>& _ops,
 	      ObjectState *_obs, SnapSetContext *_ssc,
 	      ReplicatedPG *_pg) :
@@ -393,6 +436,7 @@ public:
       modify(false), user_modify(false), undirty(false),
       bytes_written(0), bytes_read(0), user_at_version(0),
       current_osd_subop_num(0),
+      dirty_extents_known(true),
       data_off(0), reply(NULL), pg(_pg),
       num_read(0),
       num_write(0),
@@ -451,6 +495,9 @@ public:
 
     list<ObjectStore::Transaction*> tls;
     bool queue_snap_trimmer;
+
+    static ObjectPool alloc_pool;
+    OBJECT_POOL_ALLOCATOR(alloc_pool)
     
     RepGather(OpContext *c, ObjectContextRef pi, tid_t rt, 
 	      eversion_t lc) :
@@ -563,6 +610,20 @@ protected:
   void op_commit(RepGather *repop);
   void eval_repop(RepGather*);
   void issue_repop(RepGather *repop, utime_t now);
+  MOSDSubOp *new_repop_subop(const MOSDSubOp::batched_update_t &u);
+
+  /**
+   * Writes of a clean PG may be shipped to all replicas together, in
+   * one MOSDSubOp and one replica transaction, for up to
+   * osd_repop_batch_window seconds or osd_repop_batch_max writes.
+   */
+  vector<MOSDSubOp::batched_update_t> repop_batch;
+  Context *repop_batch_flush;  ///< timer event; set under osd->watch_lock
+  bool can_batch_repop(RepGather *repop);
+  void flush_repop_batch();
+  void cancel_repop_batch();
+  friend class C_FlushRepopBatch;
+
   RepGather *new_repop(OpContext *ctx, ObjectContextRef obc, tid_t rep_tid);
   void remove_repop(RepGather *repop);
   void repop_ack(RepGather *repop,
@@ -622,6 +683,9 @@ protected:
     map<string, bufferptr> *attrs = 0
     );
 
+  /// pin @obc in the osd-wide obc cache while we are an active primary
+  void cache_object_context(ObjectContextRef obc);
+
   void context_registry_on_change();
   void object_context_destructor_callback(ObjectContext *obc);
   struct C_PG_ObjectContext : public Context {
@@ -684,6 +748,7 @@ protected:
   void dump_recovery_info(Formatter *f) const {
     f->dump_int("backfill_target", get_backfill_target());
     f->dump_int("waiting_on_backfill", waiting_on_backfill);
+    f->dump_int("peer_backfill_prefetching", peer_backfill_prefetching);
     f->dump_stream("last_backfill_started") << last_backfill_started;
     {
       f->open_object_section("backfill_info");
@@ -752,11 +817,17 @@ protected:
 				   SnapSet& ss, interval_set<uint64_t>& modified,
 				   uint64_t offset, uint64_t length, bool count_bytes);
   void add_interval_usage(interval_set<uint64_t>& s, object_stat_sum_t& st);
+  void add_dirty_extent(OpContext *ctx, uint64_t offset, uint64_t length);
 
-  inline bool maybe_handle_cache(OpRequestRef op, ObjectContextRef obc, int r);
+  inline bool maybe_handle_cache(OpRequestRef op, ObjectContextRef obc, int r,
+				 const hobject_t& head);
   void do_cache_redirect(OpRequestRef op, ObjectContextRef obc);
+  /// serve a cache miss from the base tier, if we can; true if we did
+  bool maybe_proxy_read(OpRequestRef op, const hobject_t& head);
 
   int prepare_transaction(OpContext *ctx);
+  /// clone, log and apply the new object state of a modifying ctx
+  void finish_ctx(OpContext *ctx);
   
   // pg on-disk content
   void check_local();
@@ -815,6 +886,7 @@ protected:
     uint64_t bytes_written;
 
     ObjectStore::Transaction opt, localt;
+    list<ObjectStore::Transaction> batched_opt;
     list<ObjectStore::Transaction*> tls;
     
     RepModify() : pg(NULL), ctx(NULL), applied(false), committed(false), ackerosd(-1),
@@ -889,7 +961,13 @@ protected:
 
   void sub_op_remove(OpRequestRef op);
 
+  /// on a replica: writes up to here are on disk on all of acting
+  eversion_t replica_committed_to;
+  bool can_serve_replica_read(OpRequestRef op, const hobject_t& head);
+
   void sub_op_modify(OpRequestRef op);
+  void sub_op_modify_batched(MOSDSubOp *m, RepModify *rm,
+			     vector<pg_log_entry_t> &log);
   void sub_op_modify_applied(RepModify *rm);
   void sub_op_modify_commit(RepModify *rm);
 
@@ -928,6 +1006,70 @@ protected:
 
   friend struct C_Copyfrom;
 
+  // -- proxied reads and promotion --
+  map<tid_t, ProxyReadOpRef> proxyread_ops;  ///< reads the base tier serves for us
+
+  /// true if op only reads the head, so the base tier can answer it
+  bool can_proxy_read(OpRequestRef op);
+  void do_proxy_read(OpRequestRef op, const hobject_t& head);
+  void finish_proxy_read(tid_t tid, int r);
+  void cancel_proxy_read_ops(bool requeue);
+  /// true if head is being copied up from the base tier
+  bool is_promoting(const hobject_t& head);
+  /// copy head up from the base tier in the background, if it is warm
+  void maybe_promote(const hobject_t& head);
+  void finish_promote(CopyResults& results, ObjectContextRef obc,
+		      const hobject_t& temp_obj);
+
+  friend struct C_ProxyRead;
+
+  // -- cache tier agent --
+  struct FlushOp {
+    ObjectContextRef obc;
+    eversion_t version;   ///< the version we are writing back
+    tid_t objecter_tid;
+    FlushOp() : objecter_tid(0) {}
+  };
+  map<hobject_t, FlushOp> flush_ops;  ///< flushes to the base pool in flight
+
+  enum agent_evict_mode_t {
+    AGENT_EVICT_NONE,  ///< below the full ratio
+    AGENT_EVICT_COLD,  ///< above it: objects not hit in any tracked interval
+    AGENT_EVICT_FULL,  ///< above the target: all but the current interval's
+    AGENT_EVICT_ALL    ///< draining the cache for invalidate+forward
+  };
+  bool agent_flush_mode;       ///< write back dirty objects
+  agent_evict_mode_t agent_evict_mode;
+  bool agent_queued;           ///< on the osd's agent queue
+  hobject_t agent_cursor;      ///< where the next pass over the pg starts
+  bool agent_cycle_started;    ///< a pass since the cursor wrapped did something
+  utime_t agent_idle_until;    ///< don't queue ourselves before this
+  HitSetHistory hit_set;       ///< objects accessed lately
+
+  void hit_set_setup();
+  /// the object of this pg the hit set history is archived in
+  hobject_t get_hit_set_archive_object();
+  /// write the hit set history to the archive object
+  void hit_set_persist();
+  /// pick up the archived hit set history, if there is one
+  void hit_set_load();
+  /// set the agent modes from our stats; true if there is work to do
+  bool agent_choose_mode();
+  /// queue the agent if it has work and isn't queued or resting
+  void agent_maybe_queue(utime_t now);
+  void agent_work(ThreadPool::TPHandle &handle);
+  bool agent_maybe_flush(ObjectContextRef obc, utime_t now);
+  bool agent_maybe_evict(ObjectContextRef obc, utime_t now);
+  bool agent_can_modify(ObjectContextRef obc);
+  void agent_finish_flush(hobject_t oid, tid_t tid, int r);
+  /// run a single internal UNDIRTY or DELETE on obc, which we hold write locked
+  void agent_simple_op(ObjectContextRef obc, int opcode);
+  /// run internal ops on obc, which we hold write locked, and replicate them
+  void simple_op_submit(ObjectContextRef obc, vector<OSDOp>& ops, bool undirty);
+  void agent_clear();
+
+  friend struct C_AgentFlush;
+
   // -- scrub --
   virtual void _scrub(ScrubMap& map);
   virtual void _scrub_clear_state();
@@ -1023,7 +1165,6 @@ private:
       boost::statechart::custom_reaction< SnapTrim >,
       boost::statechart::transition< Reset, NotTrimming >
       > reactions;
-    hobject_t pos;
     TrimmingObjects(my_context ctx);
     void exit();
     boost::statechart::result react(const SnapTrim&);
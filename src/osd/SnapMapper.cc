@@ -233,33 +233,51 @@ int SnapMapper::get_next_object_to_trim(
   snapid_t snap,
   hobject_t *hoid)
 {
+  vector<hobject_t> out;
+  int r = get_next_objects_to_trim(snap, 1, &out);
+  if (r == 0 && hoid)
+    *hoid = out.front();
+  return r;
+}
+
+int SnapMapper::get_next_objects_to_trim(
+  snapid_t snap,
+  unsigned max,
+  vector<hobject_t> *out)
+{
+  assert(out);
+  assert(max > 0);
+  out->clear();
   for (set<string>::iterator i = prefixes.begin();
-       i != prefixes.end();
+       i != prefixes.end() && out->size() < max;
        ++i) {
-    string list_after(get_prefix(snap) + *i);
-
-    pair<string, bufferlist> next;
-    int r = backend.get_next(list_after, &next);
-    if (r < 0) {
-      break; // Done
+    string prefix(get_prefix(snap) + *i);
+    // carry on from the last key rather than the start of the prefix,
+    // so keys already returned are not walked again
+    string list_after(prefix);
+    while (out->size() < max) {
+      pair<string, bufferlist> next;
+      int r = backend.get_next(list_after, &next);
+      if (r < 0) {
+	break; // Done
+      }
+
+      if (next.first.substr(0, prefix.size()) !=
+	  prefix) {
+	break; // Done with this prefix
+      }
+
+      assert(is_mapping(next.first));
+
+      pair<snapid_t, hobject_t> next_decoded(from_raw(next));
+      assert(next_decoded.first == snap);
+      assert(check(next_decoded.second));
+
+      out->push_back(next_decoded.second);
+      list_after = next.first;
     }
-
-    if (next.first.substr(0, list_after.size()) !=
-	list_after) {
-      continue; // Done with this prefix
-    }
-
-    assert(is_mapping(next.first));
-
-    pair<snapid_t, hobject_t> next_decoded(from_raw(next));
-    assert(next_decoded.first == snap);
-    assert(check(next_decoded.second));
-
-    if (hoid)
-      *hoid = next_decoded.second;
-    return 0;
   }
-  return -ENOENT;
+  return out->empty() ? -ENOENT : 0;
 }
 
 
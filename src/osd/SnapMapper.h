@@ -17,6 +17,7 @@
 
 #include <string>
 #include <set>
+#include <vector>
 #include <utility>
 #include <string.h>
 
@@ -198,6 +199,13 @@ public:
     hobject_t *hoid             ///< [out] next hoid to trim
     );  ///< @return error, -ENOENT if no more objects
 
+  /// Returns up to max objects with snap as a snap
+  int get_next_objects_to_trim(
+    snapid_t snap,              ///< [in] snap to check
+    unsigned max,               ///< [in] most objects to return
+    vector<hobject_t> *out      ///< [out] next hoids to trim
+    );  ///< @return error, -ENOENT if no more objects
+
   /// Remove mapping for oid
   int remove_oid(
     const hobject_t &oid,    ///< [in] oid to remove
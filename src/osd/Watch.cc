@@ -87,6 +87,15 @@ public:
   }
 };
 
+class NotifySendCB : public Context {
+  NotifyRef notif;
+public:
+  NotifySendCB(NotifyRef notif) : notif(notif) {}
+  void finish(int) {
+    notif->send_pending();
+  }
+};
+
 void Notify::do_timeout()
 {
   assert(lock.is_locked_by_me());
@@ -97,6 +106,7 @@ void Notify::do_timeout()
     return;
   }
 
+  osd->logger->inc(l_osd_notify_timeout);
   in_progress_watchers = 0; // we give up TODO: we should return an error code
   maybe_complete_notify();
   assert(complete);
@@ -150,6 +160,36 @@ void Notify::start_watcher(WatchRef watch)
   watchers.insert(watch);
 }
 
+void Notify::queue_send(ConnectionRef con, uint64_t watch_cookie)
+{
+  Mutex::Locker l(lock);
+  pending_sends.push_back(make_pair(con, watch_cookie));
+}
+
+void Notify::send_pending()
+{
+  list<pair<ConnectionRef, uint64_t> > sends;
+  {
+    Mutex::Locker l(lock);
+    if (is_discarded())
+      return;
+    sends.swap(pending_sends);
+  }
+  // one connection's notifies go out back to back, so that its pipe
+  // writes them together
+  sends.sort();
+  dout(10) << "send_pending to " << sends.size() << " watchers" << dendl;
+  for (list<pair<ConnectionRef, uint64_t> >::iterator i = sends.begin();
+       i != sends.end();
+       ++i) {
+    MWatchNotify *notify_msg = new MWatchNotify(
+      i->second, version, notify_id,
+      WATCH_NOTIFY, payload);
+    osd->send_message_osd_client(notify_msg, i->first);
+  }
+  osd->logger->inc(l_osd_notify_sent, sends.size());
+}
+
 void Notify::complete_watcher(WatchRef watch)
 {
   Mutex::Locker l(lock);
@@ -173,6 +213,8 @@ void Notify::maybe_complete_notify()
     osd->send_message_osd_client(reply, client.get());
     unregister_cb();
     complete = true;
+    osd->logger->tinc(l_osd_notify_lat,
+		      ceph_clock_now(g_ceph_context) - start);
   }
 }
 
@@ -187,9 +229,15 @@ void Notify::discard()
 void Notify::init()
 {
   Mutex::Locker l(lock);
+  start = ceph_clock_now(g_ceph_context);
+  osd->logger->inc(l_osd_notify);
   register_cb();
   maybe_complete_notify();
   assert(in_progress_watchers == watchers.size());
+  if (!pending_sends.empty()) {
+    // the fan-out is O(watchers); don't do it under the pg lock
+    osd->notify_finisher.queue(new NotifySendCB(self.lock()));
+  }
 }
 
 #define dout_subsys ceph_subsys_osd
@@ -388,7 +436,7 @@ void Watch::start_notify(NotifyRef notif)
   in_progress_notifies[notif->notify_id] = notif;
   notif->start_watcher(self.lock());
   if (connected())
-    send_notify(notif);
+    notif->queue_send(conn, cookie);
 }
 
 void Watch::cancel_notify(NotifyRef notif)
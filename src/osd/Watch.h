@@ -47,11 +47,14 @@ struct CancelableContext;
 /**
  * Notify tracks the progress of a particular notify
  *
- * References are held by Watch and the timeout callback.
+ * References are held by Watch, the timeout callback and, until it has
+ * sent the notify out, the fan-out callback.
  */
 class NotifyTimeoutCB;
+class NotifySendCB;
 class Notify {
   friend class NotifyTimeoutCB;
+  friend class NotifySendCB;
   friend class Watch;
   WNotifyRef self;
   ConnectionRef client;
@@ -59,6 +62,9 @@ class Notify {
   bool complete;
   bool discarded;
   set<WatchRef> watchers;
+  /// connected watchers (connection, cookie) init() has yet to send to
+  list<pair<ConnectionRef, uint64_t> > pending_sends;
+  utime_t start;                ///< when init() was called
 
   bufferlist payload;
   uint32_t timeout;
@@ -82,6 +88,9 @@ class Notify {
   /// Called on Notify timeout
   void do_timeout();
 
+  /// Sends the notify to pending_sends; runs on the osd's notify_finisher
+  void send_pending();
+
   Notify(
     ConnectionRef client,
     unsigned num_watchers,
@@ -118,7 +127,7 @@ public:
     uint64_t version,
     OSDService *osd);
 
-  /// Call after creation to initialize
+  /// Call after creation to initialize, queues the fan-out
   void init();
 
   /// Called once per watcher prior to init()
@@ -126,6 +135,12 @@ public:
     WatchRef watcher ///< [in] watcher to complete
     );
 
+  /// Called prior to init() for each watcher connected at the time
+  void queue_send(
+    ConnectionRef con,    ///< [in] connection of the watcher
+    uint64_t watch_cookie ///< [in] cookie of the watch
+    );
+
   /// Called once per NotifyAck
   void complete_watcher(
     WatchRef watcher ///< [in] watcher to complete
@@ -175,7 +190,7 @@ class Watch {
   /// Unregisters the timeout callback
   void unregister_cb();
 
-  /// send a Notify message when connected for notif
+  /// send a Notify message when (re)connected for notif
   void send_notify(NotifyRef notif);
 
   /// Cleans up state on discard or remove (including Connection state, obc)
@@ -225,7 +240,7 @@ public:
   /// Called on unwatch
   void remove();
 
-  /// Adds notif as in-progress notify
+  /// Adds notif as in-progress notify, to be sent by notif->init()
   void start_notify(
     NotifyRef notif ///< [in] Reference to new in-progress notify
     );
@@ -28,6 +28,7 @@
 #include "common/snap_types.h"
 #include "common/Formatter.h"
 #include "common/hobject.h"
+#include "HitSet.h"
 #include "Watch.h"
 #include "OpRequest.h"
 
@@ -703,12 +704,14 @@ struct pg_pool_t {
   enum {
     FLAG_HASHPSPOOL = 1, // hash pg seed and pool together (instead of adding)
     FLAG_FULL       = 2, // pool is full
+    FLAG_BALANCE_READS = 4, // clients may read from any replica of a clean pg
   };
 
   static const char *get_flag_name(int f) {
     switch (f) {
     case FLAG_HASHPSPOOL: return "hashpspool";
     case FLAG_FULL: return "full";
+    case FLAG_BALANCE_READS: return "balance_reads";
     default: return "???";
     }
   }
@@ -800,6 +803,15 @@ public:
   int64_t write_tier;      ///< pool/tier for objecter to direct writes to
   cache_mode_t cache_mode;  ///< cache pool mode
 
+  uint64_t target_max_bytes;   ///< tiering: target max pool size
+  uint64_t target_max_objects; ///< tiering: target max pool object count
+
+  uint32_t cache_target_dirty_ratio_micro; ///< cache: fraction of target to leave dirty
+  uint32_t cache_target_full_ratio_micro;  ///< cache: fraction of target to fill before we evict in earnest
+
+  uint32_t hit_set_period;  ///< cache: seconds covered by each hit set
+  uint32_t hit_set_count;   ///< cache: number of hit sets to keep, 0 for none
+  HitSet::impl_type_t hit_set_type; ///< cache: how hit sets track objects
 
   bool is_tier() const { return tier_of >= 0; }
   void clear_tier() { tier_of = -1; }
@@ -819,7 +831,12 @@ public:
       quota_max_bytes(0), quota_max_objects(0),
       pg_num_mask(0), pgp_num_mask(0),
       tier_of(-1), read_tier(-1), write_tier(-1),
-      cache_mode(CACHEMODE_NONE)
+      cache_mode(CACHEMODE_NONE),
+      target_max_bytes(0), target_max_objects(0),
+      cache_target_dirty_ratio_micro(400000),
+      cache_target_full_ratio_micro(800000),
+      hit_set_period(0), hit_set_count(0),
+      hit_set_type(HitSet::TYPE_BLOOM)
   { }
 
   void dump(Formatter *f) const;
@@ -947,6 +964,7 @@ struct object_stat_sum_t {
   int64_t num_objects_recovered;
   int64_t num_bytes_recovered;
   int64_t num_keys_recovered;
+  int64_t num_objects_dirty;  // heads with the dirty flag
 
   object_stat_sum_t()
     : num_bytes(0),
@@ -957,7 +975,8 @@ struct object_stat_sum_t {
       num_deep_scrub_errors(0),
       num_objects_recovered(0),
       num_bytes_recovered(0),
-      num_keys_recovered(0)
+      num_keys_recovered(0),
+      num_objects_dirty(0)
   {}
 
   void floor(int64_t f) {
@@ -979,6 +998,7 @@ struct object_stat_sum_t {
     FLOOR(num_objects_recovered);
     FLOOR(num_bytes_recovered);
     FLOOR(num_keys_recovered);
+    FLOOR(num_objects_dirty);
 #undef FLOOR
   }
 
@@ -1231,10 +1251,27 @@ struct pg_history_t {
   utime_t last_deep_scrub_stamp;
   utime_t last_clean_scrub_stamp;
 
+  /// a scheduled deep scrub got this far before it was interrupted
+  hobject_t deep_scrub_resume;
+  utime_t deep_scrub_resume_stamp;  ///< when that pass started, 0 if none
+  uint32_t deep_scrub_resume_shallow_errors;  ///< found by it so far
+  uint32_t deep_scrub_resume_deep_errors;
+
   pg_history_t()
     : epoch_created(0),
       last_epoch_started(0), last_epoch_clean(0), last_epoch_split(0),
-      same_up_since(0), same_interval_since(0), same_primary_since(0) {}
+      same_up_since(0), same_interval_since(0), same_primary_since(0),
+      deep_scrub_resume_shallow_errors(0), deep_scrub_resume_deep_errors(0) {}
+
+  bool has_deep_scrub_resume() const {
+    return deep_scrub_resume_stamp != utime_t();
+  }
+  void clear_deep_scrub_resume() {
+    deep_scrub_resume = hobject_t();
+    deep_scrub_resume_stamp = utime_t();
+    deep_scrub_resume_shallow_errors = 0;
+    deep_scrub_resume_deep_errors = 0;
+  }
   
   bool merge(const pg_history_t &other) {
     // Here, we only update the fields which cannot be calculated from the OSDmap.
@@ -1275,6 +1312,23 @@ struct pg_history_t {
       last_clean_scrub_stamp = other.last_clean_scrub_stamp;
       modified = true;
     }
+    // the newest pass wins; on the same pass, whoever got further
+    if (other.deep_scrub_resume_stamp > deep_scrub_resume_stamp ||
+	(other.has_deep_scrub_resume() &&
+	 other.deep_scrub_resume_stamp == deep_scrub_resume_stamp &&
+	 deep_scrub_resume < other.deep_scrub_resume)) {
+      deep_scrub_resume = other.deep_scrub_resume;
+      deep_scrub_resume_stamp = other.deep_scrub_resume_stamp;
+      deep_scrub_resume_shallow_errors = other.deep_scrub_resume_shallow_errors;
+      deep_scrub_resume_deep_errors = other.deep_scrub_resume_deep_errors;
+      modified = true;
+    }
+    // a pass that finished since supersedes it
+    if (has_deep_scrub_resume() &&
+	deep_scrub_resume_stamp <= last_deep_scrub_stamp) {
+      clear_deep_scrub_resume();
+      modified = true;
+    }
     return modified;
   }
 
@@ -1532,11 +1586,17 @@ struct pg_log_entry_t {
   bool invalid_hash; // only when decoding sobject_t based entries
   bool invalid_pool; // only when decoding pool-less hobject based entries
 
+  /// byte ranges of the object this MODIFY wrote, zeroed or truncated away
+  interval_set<uint64_t> dirty_extents;
+  /// false if the op changed the object in ways dirty_extents can't express
+  bool dirty_extents_known;
+
   uint64_t offset;   // [soft state] my offset on disk
       
   pg_log_entry_t()
     : op(0), user_version(0),
-      invalid_hash(false), invalid_pool(false), offset(0) {}
+      invalid_hash(false), invalid_pool(false),
+      dirty_extents_known(false), offset(0) {}
   pg_log_entry_t(int _op, const hobject_t& _soid, 
 		 const eversion_t& v, const eversion_t& pv,
 		 version_t uv,
@@ -1544,7 +1604,7 @@ struct pg_log_entry_t {
     : op(_op), soid(_soid), version(v),
       prior_version(pv), user_version(uv),
       reqid(rid), mtime(mt), invalid_hash(false), invalid_pool(false),
-      offset(0) {}
+      dirty_extents_known(false), offset(0) {}
       
   bool is_clone() const { return op == CLONE; }
   bool is_modify() const { return op == MODIFY; }
@@ -2413,6 +2473,12 @@ struct ObjectRecoveryInfo {
   SnapSet ss;
   interval_set<uint64_t> copy_subset;
   map<hobject_t, interval_set<uint64_t> > clone_subset;
+  /**
+   * if set, copy_subset only holds what changed since the target's
+   * copy at this version, and the push is applied to that copy in
+   * place instead of replacing it
+   */
+  eversion_t delta_from;
 
   ObjectRecoveryInfo() : size(0) { }
 
@@ -26,6 +26,7 @@
 #include "include/Context.h"
 
 #include "common/config.h"
+#include "common/Timer.h"
 
 #define dout_subsys ceph_subsys_filer
 #undef dout_prefix
@@ -194,16 +195,20 @@ void Filer::_probed(Probe *probe, const object_t& oid, uint64_t size, utime_t mt
     // keep probing!
     ldout(cct, 10) << "_probed probing further" << dendl;
 
+    // twice as many periods at once each round, up to
+    // filer_max_probe_periods, so that big files take few rounds
     uint64_t period = (uint64_t)probe->layout.fl_stripe_count * (uint64_t)probe->layout.fl_object_size;
+    unsigned max_periods = MAX(1, cct->_conf->filer_max_probe_periods);
+    probe->periods = MIN(probe->periods * 2, max_periods);
     if (probe->fwd) {
       probe->probing_off += probe->probing_len;
       assert(probe->probing_off % period == 0);
-      probe->probing_len = period;
+      probe->probing_len = period * probe->periods;
     } else {
-      // previous period.
+      // previous periods.
       assert(probe->probing_off % period == 0);
-      probe->probing_len = period;
-      probe->probing_off -= period;
+      probe->probing_len = period * MIN(probe->periods, probe->probing_off / period);
+      probe->probing_off -= probe->probing_len;
     }
     _probe(probe);
     return;
@@ -243,15 +248,6 @@ int Filer::purge_range(inodeno_t ino,
 {
   assert(num_obj > 0);
 
-  // single object?  easy!
-  if (num_obj == 1) {
-    object_t oid = file_object_t(ino, first_obj);
-    object_locator_t oloc = objecter->osdmap->file_to_object_locator(*layout);
-    objecter->remove(oid, oloc, snapc, mtime, flags, NULL, oncommit);
-    return 0;
-  }
-
-  // lots!  let's do this in pieces.
   PurgeRange *pr = new PurgeRange;
   pr->ino = ino;
   pr->layout = *layout;
@@ -263,33 +259,63 @@ int Filer::purge_range(inodeno_t ino,
   pr->oncommit = oncommit;
   pr->uncommitted = 0;
 
-  _do_purge_range(pr, 0);
+  ldout(cct, 10) << "purge_range " << pr->ino << " objects " << pr->first << "~" << pr->num
+		 << ", " << purge_objects_queued << " objects queued before it" << dendl;
+
+  purge_queue.push_back(pr);
+  purge_objects_queued += num_obj;
+  _issue_purges();
   return 0;
 }
 
-struct C_PurgeRange : public Context {
+class Filer::C_PurgeRange : public Context {
   Filer *filer;
   PurgeRange *pr;
+public:
   C_PurgeRange(Filer *f, PurgeRange *p) : filer(f), pr(p) {}
   void finish(int r) {
-    filer->_do_purge_range(pr, 1);
+    filer->_purged(pr, r);
   }
 };
 
-void Filer::_do_purge_range(PurgeRange *pr, int fin)
-{
-  pr->uncommitted -= fin;
-  ldout(cct, 10) << "_do_purge_range " << pr->ino << " objects " << pr->first << "~" << pr->num
-	   << " uncommitted " << pr->uncommitted << dendl;
+class Filer::C_PurgeRetry : public Context {
+  Filer *filer;
+public:
+  C_PurgeRetry(Filer *f) : filer(f) {}
+  void finish(int r) {
+    filer->purge_retry = NULL;
+    filer->_issue_purges();
+  }
+};
 
-  if (pr->num == 0 && pr->uncommitted == 0) {
-    pr->oncommit->complete(0);
-    delete pr;
-    return;
+void Filer::_issue_purges()
+{
+  int max_ops = MAX(1, cct->_conf->filer_max_purge_ops);
+  double rate = timer ? cct->_conf->filer_max_purge_ops_per_sec : 0;
+
+  if (rate > 0) {
+    // allow a window's worth of burst, no more
+    utime_t now = ceph_clock_now(cct);
+    if (purge_stamp == utime_t())
+      purge_tokens = max_ops;
+    else
+      purge_tokens += (double)(now - purge_stamp) * rate;
+    purge_tokens = MIN(purge_tokens, (double)max_ops);
+    purge_stamp = now;
   }
 
-  int max = 10 - pr->uncommitted;
-  while (pr->num > 0 && max > 0) {
+  while (!purge_queue.empty() && purge_ops < max_ops) {
+    if (rate > 0 && purge_tokens < 1.0) {
+      if (!purge_retry) {
+	double wait = (1.0 - purge_tokens) / rate;
+	ldout(cct, 20) << "_issue_purges rate limited, waiting " << wait << "s" << dendl;
+	purge_retry = new C_PurgeRetry(this);
+	timer->add_event_after(wait, purge_retry);
+      }
+      break;
+    }
+
+    PurgeRange *pr = purge_queue.front();
     object_t oid = file_object_t(pr->ino, pr->first);
     object_locator_t oloc = objecter->osdmap->file_to_object_locator(pr->layout);
     objecter->remove(oid, oloc, pr->snapc, pr->mtime, pr->flags,
@@ -297,8 +323,32 @@ void Filer::_do_purge_range(PurgeRange *pr, int fin)
     pr->uncommitted++;
     pr->first++;
     pr->num--;
-    max--;
+    purge_ops++;
+    purge_objects_queued--;
+    if (rate > 0)
+      purge_tokens -= 1.0;
+    if (pr->num == 0)
+      purge_queue.pop_front();
   }
+
+  ldout(cct, 20) << "_issue_purges " << purge_ops << " in flight, "
+		 << purge_objects_queued << " objects queued in "
+		 << purge_queue.size() << " ranges" << dendl;
 }
 
+void Filer::_purged(PurgeRange *pr, int r)
+{
+  assert(purge_ops > 0);
+  purge_ops--;
+  purge_objects_removed++;
+  pr->uncommitted--;
+  ldout(cct, 10) << "_purged " << pr->ino << " objects " << pr->first << "~" << pr->num
+	   << " uncommitted " << pr->uncommitted << dendl;
+
+  if (pr->num == 0 && pr->uncommitted == 0) {
+    pr->oncommit->complete(0);
+    delete pr;
+  }
 
+  _issue_purges();
+}
@@ -35,6 +35,8 @@
 class Context;
 class Messenger;
 class OSDMap;
+class SafeTimer;
+struct PurgeRange;
 
 
 
@@ -69,13 +71,14 @@ class Filer {
 
     int err;
     bool found_size;
+    unsigned periods;  ///< probed at once next round
 
     Probe(inodeno_t i, ceph_file_layout &l, snapid_t sn,
 	  uint64_t f, uint64_t *e, utime_t *m, int fl, bool fw, Context *c) : 
       ino(i), layout(l), snapid(sn),
       psize(e), pmtime(m), flags(fl), fwd(fw), onfinish(c),
       probing_off(f), probing_len(0),
-      err(0), found_size(false) {}
+      err(0), found_size(false), periods(1) {}
   };
   
   class C_Probe;
@@ -83,11 +86,36 @@ class Filer {
   void _probe(Probe *p);
   void _probed(Probe *p, const object_t& oid, uint64_t size, utime_t mtime);
 
+  // purges.  all ranges share one window of removes in flight, and
+  // are served in the order they came in.
+  SafeTimer *timer;                ///< for the purge rate; may be NULL
+  list<PurgeRange*> purge_queue;   ///< ranges with objects left to remove
+  int purge_ops;                   ///< removes in flight
+  uint64_t purge_objects_queued;   ///< objects not yet removed
+  uint64_t purge_objects_removed;  ///< ever
+  double purge_tokens;             ///< removes the rate allows right now
+  utime_t purge_stamp;             ///< when purge_tokens was last topped up
+  Context *purge_retry;            ///< timer event, while rate limited
+
+  class C_PurgeRange;
+  class C_PurgeRetry;
+
+  void _issue_purges();
+  void _purged(PurgeRange *pr, int r);
+
  public:
   Filer(const Filer& other);
   const Filer operator=(const Filer& other);
 
-  Filer(Objecter *o) : cct(o->cct), objecter(o) {}
+  /**
+   * @param t timer to pace purges with filer_max_purge_ops_per_sec;
+   *          it must be locked by the objecter's client_lock.  Without
+   *          one purges are not rate limited.
+   */
+  Filer(Objecter *o, SafeTimer *t = NULL) :
+    cct(o->cct), objecter(o), timer(t),
+    purge_ops(0), purge_objects_queued(0), purge_objects_removed(0),
+    purge_tokens(0), purge_retry(NULL) {}
   ~Filer() {}
 
   bool is_active() {
@@ -259,7 +287,14 @@ class Filer {
                 flags, false,
                 onack, oncommit);
   }
-  // purge range of ino.### objects
+  /**
+   * purge range of ino.### objects
+   *
+   * At most filer_max_purge_ops removes are in flight at once over
+   * all ranges being purged, and at most filer_max_purge_ops_per_sec
+   * are sent a second, so that deleting a huge file neither floods
+   * the osds nor takes forever.
+   */
   int purge_range(inodeno_t ino,
 		  ceph_file_layout *layout,
 		  const SnapContext& snapc,
@@ -267,7 +302,10 @@ class Filer {
 		  utime_t mtime,
 		  int flags,
 		  Context *oncommit);
-  void _do_purge_range(struct PurgeRange *pr, int fin);
+
+  int get_purge_ops() const { return purge_ops; }
+  uint64_t get_purge_objects_queued() const { return purge_objects_queued; }
+  uint64_t get_purge_objects_removed() const { return purge_objects_removed; }
 
   /*
    * probe 
@@ -60,10 +60,27 @@ void Journaler::set_layout(ceph_file_layout *l)
 
   // prefetch intelligently.
   // (watch out, this is big if you use big objects or weird striping)
+  uint64_t period = get_layout_period();
   uint64_t periods = cct->_conf->journaler_prefetch_periods;
   if (periods < 2)
     periods = 2;  // we need at least 2 periods to make progress.
-  fetch_len = layout.fl_stripe_count * layout.fl_object_size * periods;
+  fetch_len = period * periods;
+
+  // read in chunks, so that several reads are in flight at once and the
+  // front of the window can be replayed before the rest of it arrives.
+  // keep them dividing the period so they don't straddle objects.
+  fetch_chunk = period;
+  uint64_t max_chunk = cct->_conf->journaler_prefetch_chunk;
+  while (max_chunk && fetch_chunk > max_chunk && fetch_chunk % 2 == 0 &&
+	 fetch_chunk / 2 >= layout.fl_stripe_unit)
+    fetch_chunk /= 2;
+
+  // ...and cap what we hold (buffered or in flight) at the memory budget
+  uint64_t budget = cct->_conf->journaler_prefetch_max_bytes;
+  if (budget && fetch_len > budget)
+    fetch_len = MAX(budget - budget % fetch_chunk, 2 * fetch_chunk);
+  ldout(cct, 10) << "set_layout fetch_len " << fetch_len
+		 << " in chunks of " << fetch_chunk << dendl;
 }
 
 
@@ -426,6 +443,14 @@ void Journaler::_finish_flush(int r, uint64_t start, utime_t stamp)
     finish_contexts(cct, waitfor_safe.begin()->second);
     waitfor_safe.erase(waitfor_safe.begin());
   }
+
+  // whatever piled up behind that write can go now
+  if (pending_safe.empty() && delay_flush_event) {
+    ldout(cct, 20) << "_finish_flush flushing delayed entries" << dendl;
+    timer->cancel_event(delay_flush_event);
+    delay_flush_event = 0;
+    _do_flush();
+  }
 }
 
 
@@ -463,6 +488,7 @@ uint64_t Journaler::append_entry(bufferlist& bl)
   ::encode(s, write_buf);
   write_buf.claim_append(bl);
   write_pos += sizeof(s) + s;
+  write_buf_entries++;
 
   // flush previous object?
   uint64_t su = get_layout_period();
@@ -525,6 +551,21 @@ void Journaler::_do_flush(unsigned amount)
   Context *onsafe = new C_Flush(this, flush_pos, now);  // on COMMIT
   pending_safe.insert(flush_pos);
 
+  if (logger && logger_key_flush_entries >= 0 && write_buf_entries) {
+    int key = logger_key_flush_entries + 1;
+    if (write_buf_entries > 1)
+      key++;
+    if (write_buf_entries > 4)
+      key++;
+    if (write_buf_entries > 16)
+      key++;
+    if (write_buf_entries > 64)
+      key++;
+    logger->inc(logger_key_flush_entries, write_buf_entries);
+    logger->inc(key);
+  }
+  write_buf_entries = 0;
+
   bufferlist write_bl;
 
   // adjust pointers
@@ -583,21 +624,23 @@ void Journaler::flush(Context *onsafe)
       onsafe->complete(0);
     }
   } else {
-    if (1) {
-      // maybe buffer
-      if (write_buf.length() < cct->_conf->journaler_batch_max) {
-	// delay!  schedule an event.
+    // group commit: while a write is in flight, let entries pile up
+    // behind it, until it is safe (see _finish_flush), for at most
+    // journaler_batch_interval or until there are journaler_batch_max
+    // bytes of them.  with nothing in flight, waiting gains nothing.
+    if (!pending_safe.empty() &&
+	write_buf.length() < cct->_conf->journaler_batch_max) {
+      if (!delay_flush_event) {
 	ldout(cct, 20) << "flush delaying flush" << dendl;
-	if (delay_flush_event)
-	  timer->cancel_event(delay_flush_event);
 	delay_flush_event = new C_DelayFlush(this);
-	timer->add_event_after(cct->_conf->journaler_batch_interval, delay_flush_event);	
-      } else {
-	ldout(cct, 20) << "flush not delaying flush" << dendl;
-	_do_flush();
+	timer->add_event_after(cct->_conf->journaler_batch_interval, delay_flush_event);
       }
     } else {
-      // always flush
+      ldout(cct, 20) << "flush not delaying flush" << dendl;
+      if (delay_flush_event) {
+	timer->cancel_event(delay_flush_event);
+	delay_flush_event = 0;
+      }
       _do_flush();
     }
     wait_for_flush(onsafe);
@@ -720,6 +763,8 @@ public:
 
 void Journaler::_finish_read(int r, uint64_t offset, bufferlist& bl)
 {
+  assert(reads_in_flight > 0);
+  --reads_in_flight;
   if (r < 0) {
     ldout(cct, 0) << "_finish_read got error " << r << dendl;
     error = r;
@@ -732,7 +777,8 @@ void Journaler::_finish_read(int r, uint64_t offset, bufferlist& bl)
   }
   assert(r>=0);
 
-  ldout(cct, 10) << "_finish_read got " << offset << "~" << bl.length() << dendl;
+  ldout(cct, 10) << "_finish_read got " << offset << "~" << bl.length()
+		 << ", " << reads_in_flight << " reads still in flight" << dendl;
   prefetch_buf[offset].swap(bl);
 
   _assimilate_prefetch();
@@ -807,19 +853,21 @@ void Journaler::_issue_read(uint64_t len)
 	   << ", read pointers " << read_pos << "/" << received_pos << "/" << (requested_pos+len)
 	   << dendl;
   
-  // step by period (object).  _don't_ do a single big filer.read()
-  // here because it will wait for all object reads to complete before
-  // giving us back any data.  this way we can process whatever bits
-  // come in that are contiguous.
-  uint64_t period = get_layout_period();
+  // step by chunk (at most a period, or object).  _don't_ do a single
+  // big filer.read() here because it will wait for all object reads to
+  // complete before giving us back any data.  this way the reads
+  // proceed in parallel and we can process whatever bits come in that
+  // are contiguous.
+  uint64_t chunk = fetch_chunk ? fetch_chunk : get_layout_period();
   while (len > 0) {
-    uint64_t e = requested_pos + period;
-    e -= e % period;
+    uint64_t e = requested_pos + chunk;
+    e -= e % chunk;
     uint64_t l = e - requested_pos;
     if (l > len)
       l = len;
     C_Read *c = new C_Read(this, requested_pos);
     filer.read(ino, &layout, CEPH_NOSNAP, requested_pos, l, &c->bl, 0, c);
+    ++reads_in_flight;
     requested_pos += l;
     len -= l;
   }
@@ -840,10 +888,10 @@ void Journaler::_prefetch()
 
   uint64_t raw_target = read_pos + pf;
 
-  // read full log segments, so increase if necessary
-  uint64_t period = get_layout_period();
-  uint64_t remainder = raw_target % period;
-  uint64_t adjustment = remainder ? period - remainder : 0;
+  // read whole chunks, so increase if necessary
+  uint64_t chunk = fetch_chunk ? fetch_chunk : get_layout_period();
+  uint64_t remainder = raw_target % chunk;
+  uint64_t adjustment = remainder ? chunk - remainder : 0;
   uint64_t target = raw_target + adjustment;
 
   // don't read past the log tail
@@ -114,6 +114,7 @@ private:
 
   PerfCounters *logger;
   int logger_key_lat;
+  int logger_key_flush_entries;   // -1 for none
 
   SafeTimer *timer;
 
@@ -173,6 +174,7 @@ private:
   uint64_t flush_pos;       // where we will flush. if write_pos>flush_pos, we're buffering writes.
   uint64_t safe_pos;        // what has been committed safely to disk.
   bufferlist write_buf;  // write buffer.  flush_pos + write_buf.length() == write_pos.
+  unsigned write_buf_entries;  // entries appended since the last write went out
 
   bool waiting_for_zero;
   interval_set<uint64_t> pending_zero;  // non-contig bits we've zeroed
@@ -194,6 +196,8 @@ private:
 
   uint64_t fetch_len;     // how much to read at a time
   uint64_t temp_fetch_len;
+  uint64_t fetch_chunk;   // size of each read we issue; divides the period
+  int reads_in_flight;
 
   // for wait_for_readable()
   Context    *on_readable;
@@ -245,12 +249,13 @@ public:
     cct(obj->cct), last_written(mag), last_committed(mag),
     ino(ino_), pg_pool(pool), readonly(true), magic(mag),
     objecter(obj), filer(objecter), logger(l), logger_key_lat(lkey),
+    logger_key_flush_entries(-1),
     timer(tim), delay_flush_event(0),
     state(STATE_UNDEF), error(0),
     prezeroing_pos(0), prezero_pos(0), write_pos(0), flush_pos(0), safe_pos(0),
-    waiting_for_zero(false),
+    write_buf_entries(0), waiting_for_zero(false),
     read_pos(0), requested_pos(0), received_pos(0),
-    fetch_len(0), temp_fetch_len(0),
+    fetch_len(0), temp_fetch_len(0), fetch_chunk(0), reads_in_flight(0),
     on_readable(0), on_write_error(NULL),
     expire_pos(0), trimming_pos(0), trimmed_pos(0) 
   {
@@ -268,10 +273,12 @@ public:
     write_pos = 0;
     flush_pos = 0;
     safe_pos = 0;
+    write_buf_entries = 0;
     read_pos = 0;
     requested_pos = 0;
     received_pos = 0;
     fetch_len = 0;
+    fetch_chunk = 0;
     assert(!on_readable);
     expire_pos = 0;
     trimming_pos = 0;
@@ -353,6 +360,15 @@ public:
     on_write_error = c;
   }
 
+  /**
+   * Count the entries each journal write carries: the average under
+   * key, and how many writes carried 1, 2-4, 5-16, 17-64 and more
+   * entries under the five keys after it.
+   */
+  void set_flush_entries_logger_key(int key) {
+    logger_key_flush_entries = key;
+  }
+
   // trim
   void set_expire_pos(int64_t ep) { expire_pos = ep; }
   void set_trimmed_pos(int64_t p) { trimming_pos = trimmed_pos = p; }
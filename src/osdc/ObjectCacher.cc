@@ -12,6 +12,8 @@
 #include "include/assert.h"
 
 #define MAX_FLUSH_UNDER_LOCK 20  ///< max bh's we start writeback on while holding the lock
+#define MAX_WRITE_EXTENTS 16     ///< max dirty bh's of an object written in one op
+#define MAX_FLUSHER_WRITES 32    ///< max background writes the flusher keeps in flight
 
 /*** ObjectCacher::BufferHead ***/
 
@@ -328,6 +330,14 @@ ObjectCacher::BufferHead *ObjectCacher::Object::map_write(OSDWrite *wr)
     loff_t left = ex_it->length;
 
     map<loff_t, BufferHead*>::iterator p = data_lower_bound(ex_it->offset);
+    if (!final && p != data.end() && p->second->is_dirty() &&
+	p->first <= cur && p->second->end() >= cur + left) {
+      // overwrite of dirty data: write into that bh as it is rather
+      // than splitting it up only to merge it back together.
+      final = p->second;
+      ldout(oc->cct, 10) << "map_write within dirty " << *final << dendl;
+      continue;
+    }
     while (left > 0) {
       loff_t max = left;
 
@@ -508,7 +518,7 @@ ObjectCacher::ObjectCacher(CephContext *cct_, string name, WritebackHandler& wb,
     block_writes_upfront(block_writes_upfront),
     flush_set_callback(flush_callback), flush_set_callback_arg(flush_callback_arg),
     last_read_tid(0),
-    flusher_stop(false), flusher_thread(this), finisher(cct),
+    flusher_stop(false), flusher_writes(0), flusher_thread(this), finisher(cct),
     stat_clean(0), stat_zero(0), stat_dirty(0), stat_rx(0), stat_tx(0), stat_missing(0),
     stat_error(0), stat_dirty_waiting(0), reads_outstanding(0)
 {
@@ -529,7 +539,6 @@ ObjectCacher::~ObjectCacher()
   assert(bh_lru_rest.lru_get_size() == 0);
   assert(bh_lru_dirty.lru_get_size() == 0);
   assert(ob_lru.lru_get_size() == 0);
-  assert(dirty_bh.empty());
 }
 
 void ObjectCacher::perf_start()
@@ -799,7 +808,7 @@ void ObjectCacher::bh_read_finish(int64_t poolid, sobject_t oid, tid_t tid,
 }
 
 
-void ObjectCacher::bh_write(BufferHead *bh)
+void ObjectCacher::bh_write(BufferHead *bh, bool background)
 {
   assert(lock.is_locked());
   ldout(cct, 7) << "bh_write " << *bh << dendl;
@@ -809,6 +818,10 @@ void ObjectCacher::bh_write(BufferHead *bh)
   // finishers
   C_WriteCommit *oncommit = new C_WriteCommit(this, bh->ob->oloc.pool,
                                               bh->ob->get_soid(), bh->start(), bh->length());
+  if (background) {
+    oncommit->background = true;
+    ++flusher_writes;
+  }
   // go
   tid_t tid = writeback_handler.write(bh->ob->get_oid(), bh->ob->get_oloc(),
 				      bh->start(), bh->length(),
@@ -829,17 +842,120 @@ void ObjectCacher::bh_write(BufferHead *bh)
   mark_tx(bh);
 }
 
-void ObjectCacher::bh_write_commit(int64_t poolid, sobject_t oid, loff_t start,
-				   uint64_t length, tid_t tid, int r)
+/*
+ * Write several dirty bh's of one object in a single op.  They share
+ * the tid, so they are committed (or redirtied) together.
+ */
+void ObjectCacher::bh_write_scattered(list<BufferHead*>& blist, bool background)
+{
+  assert(lock.is_locked());
+  assert(!blist.empty());
+  Object *ob = blist.front()->ob;
+  const SnapContext& snapc = blist.front()->snapc;
+  ob->get();
+
+  C_WriteCommit *oncommit = new C_WriteCommit(this, ob->oloc.pool,
+					      ob->get_soid());
+  if (background) {
+    oncommit->background = true;
+    ++flusher_writes;
+  }
+  vector<pair<uint64_t, bufferlist> > extents;
+  utime_t last_write;
+  for (list<BufferHead*>::iterator p = blist.begin(); p != blist.end(); ++p) {
+    BufferHead *bh = *p;
+    ldout(cct, 7) << "bh_write_scattered " << *bh << dendl;
+    assert(bh->ob == ob);
+    assert(bh->snapc.seq == snapc.seq);
+    oncommit->ranges.push_back(make_pair(bh->start(), bh->length()));
+    extents.push_back(make_pair((uint64_t)bh->start(), bh->bl));
+    if (bh->last_write > last_write)
+      last_write = bh->last_write;
+  }
+
+  tid_t tid = writeback_handler.write_extents(ob->get_oid(), ob->get_oloc(),
+					      extents, snapc, last_write,
+					      ob->truncate_size, ob->truncate_seq,
+					      oncommit);
+  ldout(cct, 20) << " tid " << tid << " on " << ob->get_oid()
+		 << " with " << blist.size() << " extents" << dendl;
+
+  oncommit->tid = tid;
+  ob->last_write_tid = tid;
+  for (list<BufferHead*>::iterator p = blist.begin(); p != blist.end(); ++p) {
+    BufferHead *bh = *p;
+    bh->last_write_tid = tid;
+    if (perfcounter) {
+      perfcounter->inc(l_objectcacher_data_flushed, bh->length());
+    }
+    mark_tx(bh);
+  }
+}
+
+/*
+ * Write bh along with the object's other dirty bh's that are due by
+ * cutoff and carry the same snap context, in offset order.  Returns the
+ * bytes written.
+ */
+loff_t ObjectCacher::bh_write_adjacencies(BufferHead *bh, utime_t cutoff,
+					  bool background)
+{
+  assert(lock.is_locked());
+  Object *ob = bh->ob;
+  list<BufferHead*> blist;
+  blist.push_back(bh);
+  loff_t did = bh->length();
+
+  if (writeback_handler.can_write_extents()) {
+    map<loff_t, BufferHead*>::iterator it = ob->data.find(bh->start());
+    assert(it != ob->data.end() && it->second == bh);
+    for (map<loff_t, BufferHead*>::iterator p = it;
+	 ++p != ob->data.end() && blist.size() < MAX_WRITE_EXTENTS; ) {
+      BufferHead *obh = p->second;
+      if (obh->is_dirty() && obh->last_write <= cutoff &&
+	  obh->snapc.seq == bh->snapc.seq &&
+	  obh->snapc.snaps == bh->snapc.snaps) {
+	blist.push_back(obh);
+	did += obh->length();
+      }
+    }
+    for (map<loff_t, BufferHead*>::iterator p = it;
+	 p != ob->data.begin() && blist.size() < MAX_WRITE_EXTENTS; ) {
+      BufferHead *obh = (--p)->second;
+      if (obh->is_dirty() && obh->last_write <= cutoff &&
+	  obh->snapc.seq == bh->snapc.seq &&
+	  obh->snapc.snaps == bh->snapc.snaps) {
+	blist.push_front(obh);
+	did += obh->length();
+      }
+    }
+  }
+
+  if (blist.size() == 1)
+    bh_write(bh, background);
+  else
+    bh_write_scattered(blist, background);
+  return did;
+}
+
+void ObjectCacher::bh_write_commit(int64_t poolid, sobject_t oid,
+				   vector<pair<loff_t, uint64_t> >& ranges,
+				   tid_t tid, bool background, int r)
 {
   assert(lock.is_locked());
   ldout(cct, 7) << "bh_write_commit " 
 		<< oid 
 		<< " tid " << tid
-		<< " " << start << "~" << length
+		<< " " << ranges
 		<< " returned " << r
 		<< dendl;
 
+  if (background) {
+    assert(flusher_writes > 0);
+    if (flusher_writes-- == MAX_FLUSHER_WRITES)
+      flusher_cond.Signal();
+  }
+
   if (objects[poolid].count(oid) == 0) {
     ldout(cct, 7) << "bh_write_commit no object cache" << dendl;
   } else {
@@ -850,6 +966,8 @@ void ObjectCacher::bh_write_commit(int64_t poolid, sobject_t oid, loff_t start,
       ldout(cct, 10) << "bh_write_commit marking exists on " << *ob << dendl;
       ob->exists = true;
 
+      loff_t start = ranges.front().first;
+      uint64_t length = ranges.back().first + ranges.back().second - start;
       if (writeback_handler.may_copy_on_write(ob->get_oid(), start, length, ob->get_snap())) {
 	ldout(cct, 10) << "bh_write_commit may copy on write, clearing complete on " << *ob << dendl;
 	ob->complete = false;
@@ -857,42 +975,48 @@ void ObjectCacher::bh_write_commit(int64_t poolid, sobject_t oid, loff_t start,
     }
 
     // apply to bh's!
-    for (map<loff_t, BufferHead*>::iterator p = ob->data_lower_bound(start);
-         p != ob->data.end();
-         ++p) {
-      BufferHead *bh = p->second;
-      
-      if (bh->start() > start+(loff_t)length)
-	break;
+    for (vector<pair<loff_t, uint64_t> >::iterator q = ranges.begin();
+	 q != ranges.end();
+	 ++q) {
+      loff_t start = q->first;
+      uint64_t length = q->second;
+      for (map<loff_t, BufferHead*>::iterator p = ob->data_lower_bound(start);
+	   p != ob->data.end();
+	   ++p) {
+	BufferHead *bh = p->second;
 
-      if (bh->start() < start &&
-          bh->end() > start+(loff_t)length) {
-        ldout(cct, 20) << "bh_write_commit skipping " << *bh << dendl;
-        continue;
-      }
-      
-      // make sure bh is tx
-      if (!bh->is_tx()) {
-        ldout(cct, 10) << "bh_write_commit skipping non-tx " << *bh << dendl;
-        continue;
-      }
-      
-      // make sure bh tid matches
-      if (bh->last_write_tid != tid) {
-        assert(bh->last_write_tid > tid);
-        ldout(cct, 10) << "bh_write_commit newer tid on " << *bh << dendl;
-        continue;
-      }
+	if (bh->start() > start+(loff_t)length)
+	  break;
 
-      if (r >= 0) {
-	// ok!  mark bh clean and error-free
-	mark_clean(bh);
-	ldout(cct, 10) << "bh_write_commit clean " << *bh << dendl;
-      } else {
-	mark_dirty(bh);
-	ldout(cct, 10) << "bh_write_commit marking dirty again due to error "
-		       << *bh << " r = " << r << " " << cpp_strerror(-r)
-		       << dendl;
+	if (bh->start() < start &&
+	    bh->end() > start+(loff_t)length) {
+	  ldout(cct, 20) << "bh_write_commit skipping " << *bh << dendl;
+	  continue;
+	}
+
+	// make sure bh is tx
+	if (!bh->is_tx()) {
+	  ldout(cct, 10) << "bh_write_commit skipping non-tx " << *bh << dendl;
+	  continue;
+	}
+
+	// make sure bh tid matches
+	if (bh->last_write_tid != tid) {
+	  assert(bh->last_write_tid > tid);
+	  ldout(cct, 10) << "bh_write_commit newer tid on " << *bh << dendl;
+	  continue;
+	}
+
+	if (r >= 0) {
+	  // ok!  mark bh clean and error-free
+	  mark_clean(bh);
+	  ldout(cct, 10) << "bh_write_commit clean " << *bh << dendl;
+	} else {
+	  mark_dirty(bh);
+	  ldout(cct, 10) << "bh_write_commit marking dirty again due to error "
+			 << *bh << " r = " << r << " " << cpp_strerror(-r)
+			 << dendl;
+	}
       }
     }
 
@@ -935,13 +1059,13 @@ void ObjectCacher::flush(loff_t amount)
    * can call lru_dirty.lru_get_next_expire() again.
    */
   loff_t did = 0;
-  while (amount == 0 || did < amount) {
+  while ((amount == 0 || did < amount) &&
+	 flusher_writes < MAX_FLUSHER_WRITES) {
     BufferHead *bh = static_cast<BufferHead*>(bh_lru_dirty.lru_get_next_expire());
     if (!bh) break;
     if (bh->last_write > cutoff) break;
 
-    did += bh->length();
-    bh_write(bh);
+    did += bh_write_adjacencies(bh, cutoff, true);
   }    
 }
 
@@ -1284,14 +1408,15 @@ int ObjectCacher::writex(OSDWrite *wr, ObjectSet *oset, Mutex& wait_on_lock,
     BufferHead *bh = o->map_write(wr);
     bh->snapc = wr->snapc;
     
-    bytes_written += bh->length();
+    bytes_written += ex_it->length;
     if (bh->is_tx()) {
-      bytes_written_in_flush += bh->length();
+      bytes_written_in_flush += ex_it->length;
     }
 
     // adjust buffer pointers (ie "copy" data into my cache)
     // this is over a single ObjectExtent, so we know that
-    //  - there is one contiguous bh
+    //  - there is one contiguous bh, which may extend past the write
+    //    on either side if it was already dirty
     //  - the buffer frags need not be (and almost certainly aren't)
     // note: i assume striping is monotonic... no jumps backwards, ever!
     loff_t opos = ex_it->offset;
@@ -1299,19 +1424,25 @@ int ObjectCacher::writex(OSDWrite *wr, ObjectSet *oset, Mutex& wait_on_lock,
          f_it != ex_it->buffer_extents.end();
          ++f_it) {
       ldout(cct, 10) << "writex writing " << f_it->first << "~" << f_it->second << " into " << *bh << " at " << opos << dendl;
-      uint64_t bhoff = bh->start() - opos;
-      assert(f_it->second <= bh->length() - bhoff);
+      uint64_t bhoff = opos - bh->start();
+      assert(bhoff + f_it->second <= (uint64_t)bh->length());
 
       // get the frag we're mapping in
       bufferlist frag; 
       frag.substr_of(wr->bl, 
                      f_it->first, f_it->second);
 
-      // keep anything left of bhoff
+      // keep anything left of bhoff, and right of the frag
       bufferlist newbl;
       if (bhoff)
 	newbl.substr_of(bh->bl, 0, bhoff);
       newbl.claim_append(frag);
+      uint64_t rest = bhoff + f_it->second;
+      if (rest < bh->bl.length()) {
+	bufferlist tail;
+	tail.substr_of(bh->bl, rest, bh->bl.length() - rest);
+	newbl.claim_append(tail);
+      }
       bh->bl.swap(newbl);
 
       opos += f_it->second;
@@ -1453,9 +1584,10 @@ void ObjectCacher::flusher_entry()
       int max = MAX_FLUSH_UNDER_LOCK;
       while ((bh = static_cast<BufferHead*>(bh_lru_dirty.lru_get_next_expire())) != 0 &&
 	     bh->last_write < cutoff &&
+	     flusher_writes < MAX_FLUSHER_WRITES &&
 	     --max > 0) {
 	ldout(cct, 10) << "flusher flushing aged dirty bh " << *bh << dendl;
-	bh_write(bh);
+	bh_write_adjacencies(bh, cutoff, true);
       }
     }
     if (flusher_stop)
@@ -1507,23 +1639,7 @@ bool ObjectCacher::set_is_cached(ObjectSet *oset)
 bool ObjectCacher::set_is_dirty_or_committing(ObjectSet *oset)
 {
   assert(lock.is_locked());
-  if (oset->objects.empty())
-    return false;
-  
-  for (xlist<Object*>::iterator i = oset->objects.begin();
-       !i.end(); ++i) {
-    Object *ob = *i;
-    
-    for (map<loff_t,BufferHead*>::iterator p = ob->data.begin();
-         p != ob->data.end();
-         ++p) {
-      BufferHead *bh = p->second;
-      if (bh->is_dirty() || bh->is_tx()) 
-        return true;
-    }
-  }  
-  
-  return false;
+  return oset->dirty_or_tx > 0;
 }
 
 
@@ -1546,6 +1662,8 @@ bool ObjectCacher::flush(Object *ob, loff_t offset, loff_t length)
   assert(lock.is_locked());
   bool clean = true;
   ldout(cct, 10) << "flush " << *ob << " " << offset << "~" << length << dendl;
+  if (!ob->dirty_or_tx)
+    return true;
   for (map<loff_t,BufferHead*>::iterator p = ob->data_lower_bound(offset); p != ob->data.end(); ++p) {
     BufferHead *bh = p->second;
     ldout(cct, 20) << "flush  " << *bh << dendl;
@@ -1980,12 +2098,10 @@ void ObjectCacher::bh_set_state(BufferHead *bh, int s)
   if (s == BufferHead::STATE_DIRTY && bh->get_state() != BufferHead::STATE_DIRTY) {
     bh_lru_rest.lru_remove(bh);
     bh_lru_dirty.lru_insert_top(bh);
-    dirty_bh.insert(bh);
   }
   if (s != BufferHead::STATE_DIRTY && bh->get_state() == BufferHead::STATE_DIRTY) {
     bh_lru_dirty.lru_remove(bh);
     bh_lru_rest.lru_insert_top(bh);
-    dirty_bh.erase(bh);
   }
   if (s != BufferHead::STATE_ERROR && bh->get_state() == BufferHead::STATE_ERROR) {
     bh->error = 0;
@@ -2004,7 +2120,6 @@ void ObjectCacher::bh_add(Object *ob, BufferHead *bh)
   ob->add_bh(bh);
   if (bh->is_dirty()) {
     bh_lru_dirty.lru_insert_top(bh);
-    dirty_bh.insert(bh);
   } else {
     bh_lru_rest.lru_insert_top(bh);
   }
@@ -2018,7 +2133,6 @@ void ObjectCacher::bh_remove(Object *ob, BufferHead *bh)
   ob->remove_bh(bh);
   if (bh->is_dirty()) {
     bh_lru_dirty.lru_remove(bh);
-    dirty_bh.erase(bh);
   } else {
     bh_lru_rest.lru_remove(bh);
   }
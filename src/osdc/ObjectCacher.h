@@ -261,12 +261,13 @@ class ObjectCacher {
     void add_bh(BufferHead *bh) {
       if (data.empty())
 	get();
-      assert(data.count(bh->start()) == 0);
-      data[bh->start()] = bh;
+      bool inserted = data.insert(make_pair(bh->start(), bh)).second;
+      assert(inserted);
     }
     void remove_bh(BufferHead *bh) {
-      assert(data.count(bh->start()));
-      data.erase(bh->start());
+      map<loff_t, BufferHead*>::iterator p = data.find(bh->start());
+      assert(p != data.end());
+      data.erase(p);
       if (data.empty())
 	put();
     }
@@ -343,12 +344,12 @@ class ObjectCacher {
 
   tid_t last_read_tid;
 
-  set<BufferHead*>    dirty_bh;
   LRU   bh_lru_dirty, bh_lru_rest;
   LRU   ob_lru;
 
   Cond flusher_cond;
   bool flusher_stop;
+  int flusher_writes;   ///< background writes not yet committed
   void flusher_entry();
   class FlusherThread : public Thread {
     ObjectCacher *oc;
@@ -432,7 +433,9 @@ class ObjectCacher {
 
   // io
   void bh_read(BufferHead *bh);
-  void bh_write(BufferHead *bh);
+  void bh_write(BufferHead *bh, bool background=false);
+  void bh_write_scattered(list<BufferHead*>& blist, bool background);
+  loff_t bh_write_adjacencies(BufferHead *bh, utime_t cutoff, bool background);
 
   void trim(loff_t max_bytes=-1, loff_t max_objects=-1);
   void flush(loff_t amount=0);
@@ -463,8 +466,9 @@ class ObjectCacher {
 		      loff_t offset, uint64_t length,
 		      bufferlist &bl, int r,
 		      bool trust_enoent);
-  void bh_write_commit(int64_t poolid, sobject_t oid, loff_t offset,
-		       uint64_t length, tid_t t, int r);
+  void bh_write_commit(int64_t poolid, sobject_t oid,
+		       vector<pair<loff_t, uint64_t> >& ranges,
+		       tid_t t, bool background, int r);
 
   class C_ReadFinish : public Context {
     ObjectCacher *oc;
@@ -502,14 +506,18 @@ class ObjectCacher {
     ObjectCacher *oc;
     int64_t poolid;
     sobject_t oid;
-    loff_t start;
-    uint64_t length;
   public:
+    vector<pair<loff_t, uint64_t> > ranges;
     tid_t tid;
+    bool background;   ///< counted in flusher_writes
     C_WriteCommit(ObjectCacher *c, int64_t _poolid, sobject_t o, loff_t s, uint64_t l) :
-      oc(c), poolid(_poolid), oid(o), start(s), length(l), tid(0) {}
+      oc(c), poolid(_poolid), oid(o), tid(0), background(false) {
+      ranges.push_back(make_pair(s, l));
+    }
+    C_WriteCommit(ObjectCacher *c, int64_t _poolid, sobject_t o) :
+      oc(c), poolid(_poolid), oid(o), tid(0), background(false) {}
     void finish(int r) {
-      oc->bh_write_commit(poolid, oid, start, length, tid, r);
+      oc->bh_write_commit(poolid, oid, ranges, tid, background, r);
     }
   };
 
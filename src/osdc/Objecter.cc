@@ -123,6 +123,10 @@ enum {
   l_osdc_osd_session_open,
   l_osdc_osd_session_close,
   l_osdc_osd_laggy,
+
+  l_osdc_completion_queue_len,
+  l_osdc_completion_lat,
+  l_osdc_op_lat_hist,
   l_osdc_last,
 };
 
@@ -207,6 +211,10 @@ void Objecter::init_unlocked()
     pcb.add_u64_counter(l_osdc_osd_session_close, "osd_session_close");
     pcb.add_u64(l_osdc_osd_laggy, "osd_laggy");
 
+    pcb.add_u64(l_osdc_completion_queue_len, "completion_queue_len");
+    pcb.add_time_avg(l_osdc_completion_lat, "completion_lat");  // reply to callback
+    pcb.add_time_histogram(l_osdc_op_lat_hist, "op_latency_histogram");  // last send to last reply
+
     logger = pcb.create_perf_counters();
     cct->get_perfcounters_collection()->add(logger);
   }
@@ -226,6 +234,7 @@ void Objecter::init_unlocked()
 void Objecter::init_locked()
 {
   assert(client_lock.is_locked());
+  RWLock::WLocker wl(rwlock);
   assert(!initialized);
 
   schedule_tick();
@@ -238,6 +247,7 @@ void Objecter::init_locked()
 void Objecter::shutdown_locked() 
 {
   assert(client_lock.is_locked());
+  rwlock.get_write();
   assert(initialized);
   initialized = false;
 
@@ -246,6 +256,7 @@ void Objecter::shutdown_locked()
     p = osd_sessions.begin();
     close_session(p->second);
   }
+  rwlock.put_write();
 
   if (tick_event) {
     timer.cancel_event(tick_event);
@@ -255,6 +266,15 @@ void Objecter::shutdown_locked()
 
 void Objecter::shutdown_unlocked()
 {
+  // we are no longer initialized, so nothing more gets queued
+  for (vector<Finisher*>::iterator p = completion_finishers.begin();
+       p != completion_finishers.end();
+       ++p) {
+    (*p)->stop();
+    delete *p;
+  }
+  completion_finishers.clear();
+
   if (m_request_state_hook) {
     AdminSocket* admin_socket = cct->get_admin_socket();
     admin_socket->unregister_command("objecter_requests");
@@ -269,8 +289,51 @@ void Objecter::shutdown_unlocked()
   }
 }
 
+void Objecter::set_completion_threads(int n)
+{
+  assert(!initialized);
+  assert(completion_finishers.empty());
+  for (int i = 0; i < n; ++i) {
+    Finisher *f = new Finisher(cct);
+    f->start();
+    completion_finishers.push_back(f);
+  }
+}
+
+void Objecter::C_QueuedCompletion::finish(int r)
+{
+  objecter->num_queued_completions.dec();
+  objecter->logger->set(l_osdc_completion_queue_len,
+			objecter->num_queued_completions.read());
+  objecter->logger->tinc(l_osdc_completion_lat,
+			 ceph_clock_now(objecter->cct) - queued);
+  con->complete(r);
+}
+
+void Objecter::queue_completion(unsigned shard, Context *c, int r)
+{
+  if (completion_finishers.empty()) {
+    c->complete(r);
+    return;
+  }
+  num_queued_completions.inc();
+  logger->set(l_osdc_completion_queue_len, num_queued_completions.read());
+  Finisher *f = completion_finishers[shard % completion_finishers.size()];
+  f->queue(new C_QueuedCompletion(this, c, ceph_clock_now(cct)), r);
+}
+
+void Objecter::put_write_and_finish()
+{
+  list<pair<Context*, int> > ls;
+  ls.swap(deferred_finish);
+  rwlock.put_write();
+  for (list<pair<Context*, int> >::iterator p = ls.begin(); p != ls.end(); ++p)
+    p->first->complete(p->second);
+}
+
 void Objecter::send_linger(LingerOp *info)
 {
+  // rwlock is held for write
   ldout(cct, 15) << "send_linger " << info->linger_id << dendl;
   vector<OSDOp> opv = info->ops; // need to pass a copy to ops
   Context *onack = (!info->registered && info->on_reg_ack) ? new C_Linger_Ack(this, info) : NULL;
@@ -285,19 +348,17 @@ void Objecter::send_linger(LingerOp *info)
   // do not resend this; we will send a new op to reregister
   o->should_resend = false;
 
-  if (info->session) {
-    int r = recalc_op_target(o);
-    if (r == RECALC_OP_TARGET_POOL_DNE) {
-      _send_linger_map_check(info);
-    }
+  // (not recalc_op_target(): o can't go into a session before it has a tid)
+  if (info->session && !osdmap->have_pg_pool(info->oloc.pool)) {
+    _send_linger_map_check(info);
   }
 
   if (info->register_tid) {
     // repeat send.  cancel old registeration op, if any.
-    if (ops.count(info->register_tid)) {
-      Op *o = ops[info->register_tid];
-      op_cancel_map_check(o);
-      cancel_linger_op(o);
+    Op *old = _find_op(info->register_tid);
+    if (old) {
+      op_cancel_map_check(old);
+      cancel_linger_op(old);
     }
     info->register_tid = _op_submit(o);
   } else {
@@ -305,10 +366,13 @@ void Objecter::send_linger(LingerOp *info)
     // populate info->pgid and info->acting so we
     // don't resend the linger op on the next osdmap update
     recalc_linger_op_target(info);
-    info->register_tid = op_submit(o);
+    // replies need rwlock to return budget, so we can't wait for it
+    take_op_budget(o, false);
+    info->register_tid = _op_submit(o);
   }
 
-  OSDSession *s = o->session;
+  // nothing can complete o while we hold rwlock for write
+  OSDSession *s = o->session->osd >= 0 ? o->session : NULL;
   if (info->session != s) {
     info->session_item.remove_myself();
     info->session = s;
@@ -322,26 +386,37 @@ void Objecter::send_linger(LingerOp *info)
 void Objecter::_linger_ack(LingerOp *info, int r) 
 {
   ldout(cct, 10) << "_linger_ack " << info->linger_id << dendl;
-  if (info->on_reg_ack) {
-    info->on_reg_ack->complete(r);
-    info->on_reg_ack = NULL;
-  }
+  rwlock.get_write();
+  Context *onack = info->on_reg_ack;
+  info->on_reg_ack = NULL;
+  rwlock.put_write();
+  if (onack)
+    onack->complete(r);
 }
 
 void Objecter::_linger_commit(LingerOp *info, int r) 
 {
   ldout(cct, 10) << "_linger_commit " << info->linger_id << dendl;
-  if (info->on_reg_commit) {
-    info->on_reg_commit->complete(r);
-    info->on_reg_commit = NULL;
-  }
+  rwlock.get_write();
+  Context *oncommit = info->on_reg_commit;
+  info->on_reg_commit = NULL;
 
   // only tell the user the first time we do this
   info->registered = true;
   info->pobjver = NULL;
+  rwlock.put_write();
+
+  if (oncommit)
+    oncommit->complete(r);
 }
 
 void Objecter::unregister_linger(uint64_t linger_id)
+{
+  RWLock::WLocker wl(rwlock);
+  _unregister_linger(linger_id);
+}
+
+void Objecter::_unregister_linger(uint64_t linger_id)
 {
   map<uint64_t, LingerOp*>::iterator iter = linger_ops.find(linger_id);
   if (iter != linger_ops.end()) {
@@ -375,6 +450,7 @@ tid_t Objecter::linger_mutate(const object_t& oid, const object_locator_t& oloc,
   info->on_reg_ack = onack;
   info->on_reg_commit = oncommit;
 
+  RWLock::WLocker wl(rwlock);
   info->linger_id = ++max_linger_id;
   linger_ops[info->linger_id] = info;
 
@@ -404,6 +480,7 @@ tid_t Objecter::linger_read(const object_t& oid, const object_locator_t& oloc,
   info->pobjver = objver;
   info->on_reg_commit = onfinish;
 
+  RWLock::WLocker wl(rwlock);
   info->linger_id = ++max_linger_id;
   linger_ops[info->linger_id] = info;
 
@@ -447,7 +524,46 @@ void Objecter::dispatch(Message *m)
   }
 }
 
+void Objecter::MapChanges::note(const OSDMap::Incremental& inc)
+{
+  if (inc.fullmap.length() || inc.crush.length() ||
+      inc.new_max_osd >= 0 || !inc.new_weight.empty()) {
+    // crush may place any pg anywhere now
+    all = true;
+    return;
+  }
+  for (map<int64_t,pg_pool_t>::const_iterator p = inc.new_pools.begin();
+       p != inc.new_pools.end(); ++p)
+    pools.insert(p->first);
+  pools.insert(inc.old_pools.begin(), inc.old_pools.end());
+  for (map<pg_t,vector<int32_t> >::const_iterator p = inc.new_pg_temp.begin();
+       p != inc.new_pg_temp.end(); ++p)
+    pools.insert(p->first.pool());
+  for (map<int32_t,entity_addr_t>::const_iterator p = inc.new_up_client.begin();
+       p != inc.new_up_client.end(); ++p)
+    osds.insert(p->first);
+  for (map<int32_t,uint8_t>::const_iterator p = inc.new_state.begin();
+       p != inc.new_state.end(); ++p)
+    osds.insert(p->first);
+}
+
+bool Objecter::MapChanges::affects(int64_t pool, const vector<int>& raw,
+				   const vector<int>& acting) const
+{
+  if (all || acting.empty() || pools.count(pool))
+    return true;
+  // an osd coming up joins acting from raw; one going down leaves both
+  for (vector<int>::const_iterator p = raw.begin(); p != raw.end(); ++p)
+    if (osds.count(*p))
+      return true;
+  for (vector<int>::const_iterator p = acting.begin(); p != acting.end(); ++p)
+    if (osds.count(*p))
+      return true;
+  return false;
+}
+
 void Objecter::scan_requests(bool skipped_map,
+			     const MapChanges& changes,
 			     map<tid_t, Op*>& need_resend,
 			     list<LingerOp*>& need_resend_linger,
 			     map<tid_t, CommandOp*>& need_resend_command)
@@ -457,6 +573,8 @@ void Objecter::scan_requests(bool skipped_map,
   while (lp != linger_ops.end()) {
     LingerOp *op = lp->second;
     ++lp;   // check_linger_pool_dne() may touch linger_ops; prevent iterator invalidation
+    if (!skipped_map && !changes.affects(op->pgid.pool(), op->raw, op->acting))
+      continue;
     ldout(cct, 10) << " checking linger op " << op->linger_id << dendl;
     int r = recalc_linger_op_target(op);
     switch (r) {
@@ -476,10 +594,14 @@ void Objecter::scan_requests(bool skipped_map,
   }
 
   // check for changed request mappings
-  map<tid_t,Op*>::iterator p = ops.begin();
-  while (p != ops.end()) {
+  map<tid_t,Op*> ops;
+  _get_all_ops(ops);
+  unsigned checked = 0;
+  for (map<tid_t,Op*>::iterator p = ops.begin(); p != ops.end(); ++p) {
     Op *op = p->second;
-    ++p;   // check_op_pool_dne() may touch ops; prevent iterator invalidation
+    if (!skipped_map && !changes.affects(op->pgid.pool(), op->raw, op->acting))
+      continue;
+    ++checked;
     ldout(cct, 10) << " checking op " << op->tid << dendl;
     int r = recalc_op_target(op);
     switch (r) {
@@ -497,6 +619,8 @@ void Objecter::scan_requests(bool skipped_map,
       break;
     }
   }
+  ldout(cct, 10) << "scan_requests checked " << checked << " of " << ops.size()
+		 << " ops" << dendl;
 
   // commands
   map<tid_t,CommandOp*>::iterator cp = command_ops.begin();
@@ -527,11 +651,13 @@ void Objecter::scan_requests(bool skipped_map,
 void Objecter::handle_osd_map(MOSDMap *m)
 {
   assert(client_lock.is_locked());
+  rwlock.get_write();
   assert(initialized);
   assert(osdmap); 
 
   if (m->fsid != monc->get_fsid()) {
     ldout(cct, 0) << "handle_osd_map fsid " << m->fsid << " != " << monc->get_fsid() << dendl;
+    rwlock.put_write();
     m->put();
     return;
   }
@@ -556,7 +682,9 @@ void Objecter::handle_osd_map(MOSDMap *m)
 
     if (osdmap->get_epoch()) {
       bool skipped_map = false;
-      // we want incrementals
+      epoch_t first = osdmap->get_epoch();
+      MapChanges changes;
+      // we want incrementals.  apply them all, then retarget once.
       for (epoch_t e = osdmap->get_epoch() + 1;
 	   e <= m->get_last();
 	   e++) {
@@ -566,11 +694,13 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	  ldout(cct, 3) << "handle_osd_map decoding incremental epoch " << e << dendl;
 	  OSDMap::Incremental inc(m->incremental_maps[e]);
 	  osdmap->apply_incremental(inc);
+	  changes.note(inc);
 	  logger->inc(l_osdc_map_inc);
 	}
 	else if (m->maps.count(e)) {
 	  ldout(cct, 3) << "handle_osd_map decoding full epoch " << e << dendl;
 	  osdmap->decode(m->maps[e]);
+	  changes.all = true;
 	  logger->inc(l_osdc_map_full);
 	}
 	else {
@@ -585,11 +715,15 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	  skipped_map = true;
 	  continue;
 	}
+	assert(e == osdmap->get_epoch());
+      }
+
+      if (osdmap->get_epoch() > first) {
 	logger->set(l_osdc_map_epoch, osdmap->get_epoch());
-	
-	scan_requests(skipped_map, need_resend, need_resend_linger, need_resend_command);
 
-	// osd addr changes?
+	// osd addr changes?  close these first, so that the scan
+	// retargets what was on them.  an osd that restarted within the
+	// batch has a new addr, so its ops still get resent.
 	for (map<int,OSDSession*>::iterator p = osd_sessions.begin();
 	     p != osd_sessions.end(); ) {
 	  OSDSession *s = p->second;
@@ -602,16 +736,19 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	  }
 	}
 
-	assert(e == osdmap->get_epoch());
+	scan_requests(skipped_map, changes,
+		      need_resend, need_resend_linger, need_resend_command);
       }
-      
     } else {
       // first map.  we want the full thing.
       if (m->maps.count(m->get_last())) {
 	ldout(cct, 3) << "handle_osd_map decoding full epoch " << m->get_last() << dendl;
 	osdmap->decode(m->maps[m->get_last()]);
 
-	scan_requests(false, need_resend, need_resend_linger, need_resend_command);
+	MapChanges changes;
+	changes.all = true;
+	scan_requests(false, changes,
+		      need_resend, need_resend_linger, need_resend_command);
       } else {
 	ldout(cct, 3) << "handle_osd_map hmm, i want a full map, requesting" << dendl;
 	monc->sub_want("osdmap", 0, CEPH_SUBSCRIBE_ONETIME);
@@ -630,6 +767,8 @@ void Objecter::handle_osd_map(MOSDMap *m)
   // unpause requests?
   if ((was_pauserd && !pauserd) ||
       (was_pausewr && !pausewr)) {
+    map<tid_t,Op*> ops;
+    _get_all_ops(ops);
     for (map<tid_t,Op*>::iterator p = ops.begin();
 	 p != ops.end();
 	 ++p) {
@@ -654,8 +793,9 @@ void Objecter::handle_osd_map(MOSDMap *m)
   for (map<tid_t, Op*>::iterator p = need_resend.begin(); p != need_resend.end(); ++p) {
     Op *op = p->second;
     if (op->should_resend) {
-      if (op->session) {
+      if (op->session->osd >= 0) {
 	logger->inc(l_osdc_op_resend);
+	Mutex::Locker l(op->session->lock);
 	send_op(op);
       }
     } else {
@@ -676,7 +816,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
     }
   }
 
-  dump_active();
+  _dump_active();
   
   // finish any Contexts that were waiting on a map update
   map<epoch_t,list< pair< Context*, int > > >::iterator p =
@@ -686,7 +826,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
     //go through the list and call the onfinish methods
     for (list<pair<Context*, int> >::iterator i = p->second.begin();
 	 i != p->second.end(); ++i) {
-      i->first->complete(i->second);
+      defer_finish(i->first, i->second);
     }
     waiting_for_map.erase(p++);
   }
@@ -697,6 +837,8 @@ void Objecter::handle_osd_map(MOSDMap *m)
 
   if (!waiting_for_map.empty())
     maybe_request_map();
+
+  put_write_and_finish();
 }
 
 // op pool check
@@ -710,16 +852,21 @@ void Objecter::C_Op_Map_Latest::finish(int r)
 						<< " latest " << latest << dendl;
 
   Mutex::Locker l(objecter->client_lock);
+  objecter->rwlock.get_write();
 
+  objecter->check_latest_map_lock.Lock();
   map<tid_t, Op*>::iterator iter =
     objecter->check_latest_map_ops.find(tid);
   if (iter == objecter->check_latest_map_ops.end()) {
+    objecter->check_latest_map_lock.Unlock();
+    objecter->rwlock.put_write();
     lgeneric_subdout(objecter->cct, objecter, 10) << "op_map_latest op " << tid << " not found" << dendl;
     return;
   }
 
   Op *op = iter->second;
   objecter->check_latest_map_ops.erase(iter);
+  objecter->check_latest_map_lock.Unlock();
 
   lgeneric_subdout(objecter->cct, objecter, 20) << "op_map_latest op " << op << dendl;
 
@@ -727,6 +874,7 @@ void Objecter::C_Op_Map_Latest::finish(int r)
     op->map_dne_bound = latest;
 
   objecter->check_op_pool_dne(op);
+  objecter->put_write_and_finish();
 }
 
 void Objecter::check_op_pool_dne(Op *op)
@@ -742,14 +890,18 @@ void Objecter::check_op_pool_dne(Op *op)
 		     << " concluding pool " << op->pgid.pool() << " dne"
 		     << dendl;
       if (op->onack) {
-	op->onack->complete(-ENOENT);
+	defer_finish(op->onack, -ENOENT);
+	op->onack = NULL;
+	num_unacked.dec();
       }
       if (op->oncommit) {
-	op->oncommit->complete(-ENOENT);
+	defer_finish(op->oncommit, -ENOENT);
+	op->oncommit = NULL;
+	num_uncommitted.dec();
       }
-      op->session_item.remove_myself();
-      ops.erase(op->tid);
-      delete op;
+      OSDSession *s = op->session;
+      Mutex::Locker l(s->lock);
+      finish_op(op);
     }
   } else {
     _send_op_map_check(op);
@@ -758,10 +910,13 @@ void Objecter::check_op_pool_dne(Op *op)
 
 void Objecter::_send_op_map_check(Op *op)
 {
-  assert(client_lock.is_locked());
   // ask the monitor
-  if (check_latest_map_ops.count(op->tid) == 0) {
+  check_latest_map_lock.Lock();
+  bool send = check_latest_map_ops.count(op->tid) == 0;
+  if (send)
     check_latest_map_ops[op->tid] = op;
+  check_latest_map_lock.Unlock();
+  if (send) {
     C_Op_Map_Latest *c = new C_Op_Map_Latest(this, op->tid);
     monc->get_version("osdmap", &c->latest, NULL, c);
   }
@@ -769,7 +924,7 @@ void Objecter::_send_op_map_check(Op *op)
 
 void Objecter::op_cancel_map_check(Op *op)
 {
-  assert(client_lock.is_locked());
+  Mutex::Locker l(check_latest_map_lock);
   map<tid_t, Op*>::iterator iter =
     check_latest_map_ops.find(op->tid);
   if (iter != check_latest_map_ops.end()) {
@@ -787,10 +942,12 @@ void Objecter::C_Linger_Map_Latest::finish(int r)
   }
 
   Mutex::Locker l(objecter->client_lock);
+  objecter->rwlock.get_write();
 
   map<uint64_t, LingerOp*>::iterator iter =
     objecter->check_latest_map_lingers.find(linger_id);
   if (iter == objecter->check_latest_map_lingers.end()) {
+    objecter->rwlock.put_write();
     return;
   }
 
@@ -802,6 +959,7 @@ void Objecter::C_Linger_Map_Latest::finish(int r)
     op->map_dne_bound = latest;
 
   objecter->check_linger_pool_dne(op);
+  objecter->put_write_and_finish();
 }
 
 void Objecter::check_linger_pool_dne(LingerOp *op)
@@ -813,12 +971,14 @@ void Objecter::check_linger_pool_dne(LingerOp *op)
   if (op->map_dne_bound > 0) {
     if (osdmap->get_epoch() >= op->map_dne_bound) {
       if (op->on_reg_ack) {
-	op->on_reg_ack->complete(-ENOENT);
+	defer_finish(op->on_reg_ack, -ENOENT);
+	op->on_reg_ack = NULL;
       }
       if (op->on_reg_commit) {
-	op->on_reg_commit->complete(-ENOENT);
+	defer_finish(op->on_reg_commit, -ENOENT);
+	op->on_reg_commit = NULL;
       }
-      unregister_linger(op->linger_id);
+      _unregister_linger(op->linger_id);
     }
   } else {
     _send_linger_map_check(op);
@@ -857,10 +1017,12 @@ void Objecter::C_Command_Map_Latest::finish(int r)
   }
 
   Mutex::Locker l(objecter->client_lock);
+  objecter->rwlock.get_write();
 
   map<uint64_t, CommandOp*>::iterator iter =
     objecter->check_latest_map_commands.find(tid);
   if (iter == objecter->check_latest_map_commands.end()) {
+    objecter->rwlock.put_write();
     return;
   }
 
@@ -872,6 +1034,7 @@ void Objecter::C_Command_Map_Latest::finish(int r)
     c->map_dne_bound = latest;
 
   objecter->check_command_map_dne(c);
+  objecter->put_write_and_finish();
 }
 
 void Objecter::check_command_map_dne(CommandOp *c)
@@ -913,8 +1076,14 @@ void Objecter::command_cancel_map_check(CommandOp *c)
 
 
 
+/*
+ * Sessions are opened with rwlock held for read or write, but only
+ * closed with it held for write, so readers may keep using a session
+ * they got after dropping sessions_lock.
+ */
 Objecter::OSDSession *Objecter::get_session(int osd)
 {
+  Mutex::Locker l(sessions_lock);
   map<int,OSDSession*>::iterator p = osd_sessions.find(osd);
   if (p != osd_sessions.end())
     return p->second;
@@ -926,6 +1095,15 @@ Objecter::OSDSession *Objecter::get_session(int osd)
   return s;
 }
 
+Objecter::OSDSession *Objecter::lookup_session(int osd)
+{
+  Mutex::Locker l(sessions_lock);
+  map<int,OSDSession*>::iterator p = osd_sessions.find(osd);
+  if (p == osd_sessions.end())
+    return NULL;
+  return p->second;
+}
+
 void Objecter::reopen_session(OSDSession *s)
 {
   entity_inst_t inst = osdmap->get_inst(s->osd);
@@ -946,24 +1124,56 @@ void Objecter::close_session(OSDSession *s)
     messenger->mark_down(s->con);
     logger->inc(l_osdc_osd_session_close);
   }
-  s->ops.clear();
-  s->linger_ops.clear();
-  s->command_ops.clear();
-  osd_sessions.erase(s->osd);
-  delete s;
 
+  // whatever was on it waits for the next map to find a target; forget
+  // the old one so that it is resent even if it maps the same
+  s->lock.Lock();
+  homeless_session->lock.Lock();
+  while (!s->ops.empty()) {
+    Op *op = s->ops.begin()->second;
+    _session_op_remove(s, op);
+    op->acting.clear();
+    _session_op_assign(homeless_session, op);
+  }
+  homeless_session->lock.Unlock();
+  s->lock.Unlock();
+  for (xlist<LingerOp*>::iterator i = s->linger_ops.begin(); !i.end(); ) {
+    LingerOp *op = *i;
+    ++i;
+    op->session_item.remove_myself();
+    op->session = NULL;
+    op->acting.clear();
+  }
+  for (xlist<CommandOp*>::iterator i = s->command_ops.begin(); !i.end(); ) {
+    CommandOp *c = *i;
+    ++i;
+    c->session_item.remove_myself();
+    c->session = NULL;
+    num_homeless_ops.inc();
+  }
+
+  sessions_lock.Lock();
+  osd_sessions.erase(s->osd);
   logger->set(l_osdc_osd_sessions, osd_sessions.size());
+  sessions_lock.Unlock();
+  delete s;
 }
 
 void Objecter::wait_for_osd_map()
 {
-  if (osdmap->get_epoch()) return;
+  rwlock.get_write();
+  if (osdmap->get_epoch()) {
+    rwlock.put_write();
+    return;
+  }
   Mutex lock("");
   Cond cond;
   bool done;
-  lock.Lock();
   C_SafeCond *context = new C_SafeCond(&lock, &cond, &done, NULL);
   waiting_for_map[0].push_back(pair<Context*, int>(context, 0));
+  rwlock.put_write();
+
+  lock.Lock();
   while (!done)
     cond.Wait(lock);
   lock.Unlock();
@@ -985,6 +1195,12 @@ void Objecter::maybe_request_map()
 }
 
 void Objecter::wait_for_new_map(Context *c, epoch_t epoch, int err)
+{
+  RWLock::WLocker wl(rwlock);
+  _wait_for_new_map(c, epoch, err);
+}
+
+void Objecter::_wait_for_new_map(Context *c, epoch_t epoch, int err)
 {
   waiting_for_map[epoch].push_back(pair<Context *, int>(c, err));
   maybe_request_map();
@@ -992,13 +1208,17 @@ void Objecter::wait_for_new_map(Context *c, epoch_t epoch, int err)
 
 void Objecter::kick_requests(OSDSession *session)
 {
+  // rwlock is held for write
   ldout(cct, 10) << "kick_requests for osd." << session->osd << dendl;
 
   // resend ops
+  map<tid_t,Op*> ops;
+  session->lock.Lock();
+  ops = session->ops;
+  session->lock.Unlock();
   map<tid_t,Op*> resend;  // resend in tid order
-  for (xlist<Op*>::iterator p = session->ops.begin(); !p.end();) {
-    Op *op = *p;
-    ++p;
+  for (map<tid_t,Op*>::iterator p = ops.begin(); p != ops.end(); ++p) {
+    Op *op = p->second;
     logger->inc(l_osdc_op_resend);
     if (op->should_resend) {
       resend[op->tid] = op;
@@ -1006,10 +1226,12 @@ void Objecter::kick_requests(OSDSession *session)
       cancel_linger_op(op);
     }
   }
+  session->lock.Lock();
   while (!resend.empty()) {
     send_op(resend.begin()->second);
     resend.erase(resend.begin());
   }
+  session->lock.Unlock();
 
   // resend lingers
   map<uint64_t, LingerOp*> lresend;  // resend in order
@@ -1051,6 +1273,8 @@ void Objecter::tick()
   assert(tick_event);
   tick_event = NULL;
 
+  rwlock.get_read();
+
   set<OSDSession*> toping;
 
   // look for laggy requests
@@ -1058,16 +1282,24 @@ void Objecter::tick()
   cutoff -= cct->_conf->objecter_timeout;  // timeout
 
   unsigned laggy_ops = 0;
-  for (map<tid_t,Op*>::iterator p = ops.begin();
-       p != ops.end();
-       ++p) {
-    Op *op = p->second;
-    if (op->session && op->stamp < cutoff) {
-      ldout(cct, 2) << " tid " << p->first << " on osd." << op->session->osd << " is laggy" << dendl;
-      toping.insert(op->session);
-      ++laggy_ops;
+  sessions_lock.Lock();
+  for (map<int,OSDSession*>::iterator i = osd_sessions.begin();
+       i != osd_sessions.end();
+       ++i) {
+    OSDSession *s = i->second;
+    Mutex::Locker l(s->lock);
+    for (map<tid_t,Op*>::iterator p = s->ops.begin();
+	 p != s->ops.end();
+	 ++p) {
+      Op *op = p->second;
+      if (op->stamp < cutoff) {
+	ldout(cct, 2) << " tid " << p->first << " on osd." << s->osd << " is laggy" << dendl;
+	toping.insert(s);
+	++laggy_ops;
+      }
     }
   }
+  sessions_lock.Unlock();
   for (map<uint64_t,LingerOp*>::iterator p = linger_ops.begin();
        p != linger_ops.end();
        ++p) {
@@ -1093,7 +1325,7 @@ void Objecter::tick()
   logger->set(l_osdc_op_laggy, laggy_ops);
   logger->set(l_osdc_osd_laggy, toping.size());
 
-  if (num_homeless_ops || !toping.empty())
+  if (num_homeless_ops.read() || !toping.empty())
     maybe_request_map();
 
   if (!toping.empty()) {
@@ -1105,6 +1337,8 @@ void Objecter::tick()
       messenger->send_message(new MPing, (*i)->con);
     }
   }
+
+  rwlock.put_read();
     
   // reschedule
   schedule_tick();
@@ -1112,7 +1346,7 @@ void Objecter::tick()
 
 void Objecter::resend_mon_ops()
 {
-  assert(client_lock.is_locked());
+  RWLock::WLocker wl(rwlock);
   ldout(cct, 10) << "resend_mon_ops" << dendl;
 
   for (map<tid_t,PoolStatOp*>::iterator p = poolstat_ops.begin(); p!=poolstat_ops.end(); ++p) {
@@ -1130,10 +1364,15 @@ void Objecter::resend_mon_ops()
     logger->inc(l_osdc_poolop_resend);
   }
 
+  check_latest_map_lock.Lock();
+  list<tid_t> check_ops;
   for (map<tid_t, Op*>::iterator p = check_latest_map_ops.begin();
        p != check_latest_map_ops.end();
-       ++p) {
-    C_Op_Map_Latest *c = new C_Op_Map_Latest(this, p->second->tid);
+       ++p)
+    check_ops.push_back(p->first);
+  check_latest_map_lock.Unlock();
+  for (list<tid_t>::iterator p = check_ops.begin(); p != check_ops.end(); ++p) {
+    C_Op_Map_Latest *c = new C_Op_Map_Latest(this, *p);
     monc->get_version("osdmap", &c->latest, NULL, c);
   }
 
@@ -1158,46 +1397,71 @@ void Objecter::resend_mon_ops()
 
 tid_t Objecter::op_submit(Op *op)
 {
-  assert(client_lock.is_locked());
-  assert(initialized);
-
   assert(op->ops.size() == op->out_bl.size());
   assert(op->ops.size() == op->out_rval.size());
   assert(op->ops.size() == op->out_handler.size());
 
-  // throttle.  before we look at any state, because
-  // take_op_budget() may drop our lock while it blocks.
+  // throttle.  before we take any of our locks, because
+  // take_op_budget() may block (dropping client_lock) for a while.
   take_op_budget(op);
 
+  RWLock::RLocker rl(rwlock);
+  assert(initialized);
   return _op_submit(op);
 }
 
+void Objecter::op_submit_batch(const vector<Op*>& ops)
+{
+  vector<Op*>::const_iterator p = ops.begin();
+  while (p != ops.end()) {
+    // this may block, so do it without rwlock
+    take_op_budget(*p);
+
+    RWLock::RLocker rl(rwlock);
+    assert(initialized);
+    do {
+      Op *op = *p++;
+      assert(op->ops.size() == op->out_bl.size());
+      assert(op->ops.size() == op->out_rval.size());
+      assert(op->ops.size() == op->out_handler.size());
+      _op_submit(op);
+    } while (p != ops.end() && try_take_op_budget(*p));
+  }
+}
+
+/*
+ * With rwlock held for read or write.  Once the op is sent a reply may
+ * complete and free it, so don't look at it after that.
+ */
 tid_t Objecter::_op_submit(Op *op)
 {
   // pick tid
-  tid_t mytid = ++last_tid;
+  tid_t mytid = last_tid.inc();
   op->tid = mytid;
   assert(client_inc >= 0);
 
   // pick target
-  num_homeless_ops++;  // initially; recalc_op_target() will decrement if it finds a target
   int r = recalc_op_target(op);
   bool check_for_latest_map = (r == RECALC_OP_TARGET_POOL_DNE);
+  if (!op->session) {
+    Mutex::Locker l(homeless_session->lock);
+    _session_op_assign(homeless_session, op);
+  }
 
   // add to gather set(s)
   if (op->onack) {
-    ++num_unacked;
+    num_unacked.inc();
   } else {
     ldout(cct, 20) << " note: not requesting ack" << dendl;
   }
   if (op->oncommit) {
-    ++num_uncommitted;
+    num_uncommitted.inc();
   } else {
     ldout(cct, 20) << " note: not requesting commit" << dendl;
   }
-  ops[op->tid] = op;
+  num_in_flight.inc();
 
-  logger->set(l_osdc_op_active, ops.size());
+  logger->set(l_osdc_op_active, num_in_flight.read());
 
   logger->inc(l_osdc_op);
   if ((op->flags & (CEPH_OSD_FLAG_READ|CEPH_OSD_FLAG_WRITE)) == (CEPH_OSD_FLAG_READ|CEPH_OSD_FLAG_WRITE))
@@ -1246,67 +1510,112 @@ tid_t Objecter::_op_submit(Op *op)
   ldout(cct, 10) << "op_submit oid " << op->base_oid
            << " " << op->base_oloc << " " << op->target_oloc
 	   << " " << op->ops << " tid " << op->tid
-           << " osd." << (op->session ? op->session->osd : -1)
+           << " osd." << op->session->osd
            << dendl;
 
   assert(op->flags & (CEPH_OSD_FLAG_READ|CEPH_OSD_FLAG_WRITE));
 
+  if (check_for_latest_map) {
+    _send_op_map_check(op);
+  }
+
+  bool need_map = false;
+  OSDSession *s = op->session;
+  s->lock.Lock();
   if ((op->flags & CEPH_OSD_FLAG_WRITE) &&
       osdmap->test_flag(CEPH_OSDMAP_PAUSEWR)) {
-    ldout(cct, 10) << " paused modify " << op << " tid " << last_tid << dendl;
+    ldout(cct, 10) << " paused modify " << op << " tid " << mytid << dendl;
     op->paused = true;
-    maybe_request_map();
+    need_map = true;
   } else if ((op->flags & CEPH_OSD_FLAG_READ) &&
 	     osdmap->test_flag(CEPH_OSDMAP_PAUSERD)) {
-    ldout(cct, 10) << " paused read " << op << " tid " << last_tid << dendl;
+    ldout(cct, 10) << " paused read " << op << " tid " << mytid << dendl;
     op->paused = true;
-    maybe_request_map();
+    need_map = true;
   } else if ((op->flags & CEPH_OSD_FLAG_WRITE) &&
 	     osdmap->test_flag(CEPH_OSDMAP_FULL)) {
-    ldout(cct, 0) << " FULL, paused modify " << op << " tid " << last_tid << dendl;
+    ldout(cct, 0) << " FULL, paused modify " << op << " tid " << mytid << dendl;
     op->paused = true;
-    maybe_request_map();
-  } else if (op->session) {
+    need_map = true;
+  } else if (s->osd >= 0) {
     send_op(op);
   } else {
-    maybe_request_map();
+    need_map = true;
   }
+  s->lock.Unlock();
 
-  if (check_for_latest_map) {
-    _send_op_map_check(op);
-  }
+  if (need_map)
+    maybe_request_map();
 
-  ldout(cct, 5) << num_unacked << " unacked, " << num_uncommitted << " uncommitted" << dendl;
+  ldout(cct, 5) << num_unacked.read() << " unacked, " << num_uncommitted.read() << " uncommitted" << dendl;
   
-  return op->tid;
+  return mytid;
 }
 
 int Objecter::op_cancel(tid_t tid)
 {
-  assert(client_lock.is_locked());
+  rwlock.get_write();
   assert(initialized);
 
-  map<tid_t, Op*>::iterator p = ops.find(tid);
-  if (p == ops.end()) {
+  Op *op = _find_op(tid);
+  if (!op) {
     ldout(cct, 10) << __func__ << " tid " << tid << " dne" << dendl;
+    rwlock.put_write();
     return -ENOENT;
   }
 
   ldout(cct, 10) << __func__ << " tid " << tid << dendl;
-  Op *op = p->second;
   if (op->onack) {
-    op->onack->complete(-ECANCELED);
+    defer_finish(op->onack, -ECANCELED);
     op->onack = NULL;
+    num_unacked.dec();
   }
   if (op->oncommit) {
-    op->oncommit->complete(-ECANCELED);
+    defer_finish(op->oncommit, -ECANCELED);
     op->oncommit = NULL;
+    num_uncommitted.dec();
   }
   op_cancel_map_check(op);
+  OSDSession *s = op->session;
+  s->lock.Lock();
   finish_op(op);
+  s->lock.Unlock();
+  put_write_and_finish();
   return 0;
 }
 
+void Objecter::note_read_latency(int osd, utime_t lat)
+{
+  Mutex::Locker l(read_latency_lock);
+  map<int,double>::iterator p = osd_read_latency.find(osd);
+  if (p == osd_read_latency.end())
+    osd_read_latency[osd] = (double)lat;
+  else
+    p->second = .9 * p->second + .1 * (double)lat;
+}
+
+/**
+ * Pick between two random members of acting the one that has been
+ * answering reads faster.  Comparing two rather than taking the best
+ * keeps every client from piling onto the same osd, and osds we have
+ * not heard from yet count as fast so that they get measured.
+ */
+int Objecter::choose_read_target(const vector<int>& acting)
+{
+  if (acting.size() < 2)
+    return acting[0];
+  unsigned a = rand() % acting.size();
+  unsigned b = rand() % (acting.size() - 1);
+  if (b >= a)
+    ++b;
+  Mutex::Locker l(read_latency_lock);
+  map<int,double>::iterator pa = osd_read_latency.find(acting[a]);
+  map<int,double>::iterator pb = osd_read_latency.find(acting[b]);
+  double la = pa == osd_read_latency.end() ? 0 : pa->second;
+  double lb = pb == osd_read_latency.end() ? 0 : pb->second;
+  return la <= lb ? acting[a] : acting[b];
+}
+
 bool Objecter::is_pg_changed(vector<int>& o, vector<int>& n, bool any_change)
 {
   if (o.empty() && n.empty())
@@ -1320,6 +1629,10 @@ bool Objecter::is_pg_changed(vector<int>& o, vector<int>& n, bool any_change)
   return false;      // same primary (tho replicas may have changed)
 }
 
+/*
+ * With rwlock held for read or write, and no session lock.  Moves op to
+ * the session of its new target, or the homeless one, if it changed.
+ */
 int Objecter::recalc_op_target(Op *op)
 {
   vector<int> acting;
@@ -1358,7 +1671,7 @@ int Objecter::recalc_op_target(Op *op)
     if (ret == -ENOENT)
       return RECALC_OP_TARGET_POOL_DNE;
   }
-  osdmap->pg_to_acting_osds(pgid, acting);
+  osdmap->pg_to_raw_acting_osds(pgid, op->raw, acting);
 
   if (op->pgid != pgid || is_pg_changed(op->acting, acting, op->used_replica)) {
     op->pgid = pgid;
@@ -1366,17 +1679,21 @@ int Objecter::recalc_op_target(Op *op)
     ldout(cct, 10) << "recalc_op_target tid " << op->tid
 	     << " pgid " << pgid << " acting " << acting << dendl;
 
-    OSDSession *s = NULL;
+    OSDSession *s = homeless_session;
     op->used_replica = false;
     if (!acting.empty()) {
       int osd;
       bool read = is_read && !is_write;
-      if (read && (op->flags & CEPH_OSD_FLAG_BALANCE_READS)) {
-	int p = rand() % acting.size();
-	if (p)
+      const pg_pool_t *pi = osdmap->get_pg_pool(pgid.pool());
+      bool balance = (op->flags & CEPH_OSD_FLAG_BALANCE_READS) ||
+	(pi && (pi->get_flags() & pg_pool_t::FLAG_BALANCE_READS));
+      if (read && op->replica_refused) {
+	osd = acting[0];
+      } else if (read && balance) {
+	osd = choose_read_target(acting);
+	if (osd != acting[0])
 	  op->used_replica = true;
-	osd = acting[p];
-	ldout(cct, 10) << " chose random osd." << osd << " of " << acting << dendl;
+	ldout(cct, 10) << " chose osd." << osd << " of " << acting << dendl;
       } else if (read && (op->flags & CEPH_OSD_FLAG_LOCALIZE_READS)) {
 	// look for a local replica
 	int i;
@@ -1398,14 +1715,12 @@ int Objecter::recalc_op_target(Op *op)
     }
 
     if (op->session != s) {
-      if (!op->session)
-	num_homeless_ops--;
-      op->session_item.remove_myself();
-      op->session = s;
-      if (s)
-	s->ops.push_back(&op->session_item);
-      else
-	num_homeless_ops++;
+      if (op->session) {
+	Mutex::Locker l(op->session->lock);
+	_session_op_remove(op->session, op);
+      }
+      Mutex::Locker l(s->lock);
+      _session_op_assign(s, op);
     }
     return RECALC_OP_TARGET_NEED_RESEND;
   }
@@ -1420,7 +1735,7 @@ bool Objecter::recalc_linger_op_target(LingerOp *linger_op)
   if (ret == -ENOENT) {
     return RECALC_OP_TARGET_POOL_DNE;
   }
-  osdmap->pg_to_acting_osds(pgid, acting);
+  osdmap->pg_to_raw_acting_osds(pgid, linger_op->raw, acting);
 
   if (pgid != linger_op->pgid || is_pg_changed(linger_op->acting, acting, true)) {
     linger_op->pgid = pgid;
@@ -1442,32 +1757,102 @@ bool Objecter::recalc_linger_op_target(LingerOp *linger_op)
 
 void Objecter::cancel_linger_op(Op *op)
 {
+  // rwlock is held for write
   ldout(cct, 15) << "cancel_op " << op->tid << dendl;
 
   assert(!op->should_resend);
-  delete op->onack;
-  delete op->oncommit;
+  if (op->onack) {
+    delete op->onack;
+    num_unacked.dec();
+  }
+  if (op->oncommit) {
+    delete op->oncommit;
+    num_uncommitted.dec();
+  }
 
+  OSDSession *s = op->session;
+  Mutex::Locker l(s->lock);
   finish_op(op);
 }
 
+void Objecter::_session_op_assign(OSDSession *s, Op *op)
+{
+  // s->lock is held
+  assert(op->session == NULL);
+  op->session = s;
+  s->ops[op->tid] = op;
+  if (s == homeless_session)
+    num_homeless_ops.inc();
+}
+
+void Objecter::_session_op_remove(OSDSession *s, Op *op)
+{
+  // s->lock is held
+  assert(op->session == s);
+  s->ops.erase(op->tid);
+  if (s == homeless_session)
+    num_homeless_ops.dec();
+  op->session = NULL;
+}
+
+/// with rwlock held; takes each session lock in turn
+Objecter::Op *Objecter::_find_op(tid_t tid)
+{
+  {
+    Mutex::Locker l(sessions_lock);
+    for (map<int,OSDSession*>::iterator p = osd_sessions.begin();
+	 p != osd_sessions.end();
+	 ++p) {
+      Mutex::Locker sl(p->second->lock);
+      map<tid_t,Op*>::iterator q = p->second->ops.find(tid);
+      if (q != p->second->ops.end())
+	return q->second;
+    }
+  }
+  Mutex::Locker l(homeless_session->lock);
+  map<tid_t,Op*>::iterator q = homeless_session->ops.find(tid);
+  if (q != homeless_session->ops.end())
+    return q->second;
+  return NULL;
+}
+
+/// with rwlock held; takes each session lock in turn
+void Objecter::_get_all_ops(map<tid_t,Op*>& all)
+{
+  {
+    Mutex::Locker l(sessions_lock);
+    for (map<int,OSDSession*>::iterator p = osd_sessions.begin();
+	 p != osd_sessions.end();
+	 ++p) {
+      Mutex::Locker sl(p->second->lock);
+      all.insert(p->second->ops.begin(), p->second->ops.end());
+    }
+  }
+  Mutex::Locker l(homeless_session->lock);
+  all.insert(homeless_session->ops.begin(), homeless_session->ops.end());
+}
+
 void Objecter::finish_op(Op *op)
 {
+  // op->session->lock is held
   ldout(cct, 15) << "finish_op " << op->tid << dendl;
 
-  op->session_item.remove_myself();
+  _session_op_remove(op->session, op);
   if (op->budgeted)
     put_op_budget(op);
 
-  ops.erase(op->tid);
-  logger->set(l_osdc_op_active, ops.size());
+  num_in_flight.dec();
+  logger->set(l_osdc_op_active, num_in_flight.read());
+  check_latest_map_lock.Lock();
   assert(check_latest_map_ops.find(op->tid) == check_latest_map_ops.end());
+  check_latest_map_lock.Unlock();
 
   delete op;
 }
 
 void Objecter::send_op(Op *op)
 {
+  // op->session->lock is held
   ldout(cct, 15) << "send_op " << op->tid << " to osd." << op->session->osd << dendl;
 
   int flags = op->flags;
@@ -1514,6 +1899,15 @@ void Objecter::send_op(Op *op)
   else
     m->set_priority(cct->_conf->osd_client_op_priority);
 
+  if (cct->_conf->objecter_qos_deltas) {
+    // we don't learn which ops were served for our reservation, so
+    // count them all; reservations then cover what we get in total
+    uint64_t elsewhere = num_completed.read() - op->session->num_completed;
+    uint32_t delta = 1 + (elsewhere - op->session->completed_elsewhere);
+    op->session->completed_elsewhere = elsewhere;
+    m->set_qos_deltas(delta, delta);
+  }
+
   logger->inc(l_osdc_op_send);
   logger->inc(l_osdc_op_send_bytes, m->get_data().length());
 
@@ -1544,41 +1938,63 @@ void Objecter::throttle_op(Op *op, int op_budget)
 {
   if (!op_budget)
     op_budget = calc_op_budget(op);
+  // callers that don't hold client_lock have nothing to drop
+  bool locked = client_lock.is_locked_by_me();
   if (!op_throttle_bytes.get_or_fail(op_budget)) { //couldn't take right now
-    client_lock.Unlock();
+    if (locked)
+      client_lock.Unlock();
     op_throttle_bytes.get(op_budget);
-    client_lock.Lock();
+    if (locked)
+      client_lock.Lock();
   }
   if (!op_throttle_ops.get_or_fail(1)) { //couldn't take right now
-    client_lock.Unlock();
+    if (locked)
+      client_lock.Unlock();
     op_throttle_ops.get(1);
-    client_lock.Lock();
+    if (locked)
+      client_lock.Lock();
   }
 }
 
 void Objecter::unregister_op(Op *op)
 {
+  // op->session->lock is held
   if (op->onack)
-    num_unacked--;
+    num_unacked.dec();
   if (op->oncommit)
-    num_uncommitted--;
-  ops.erase(op->tid);
+    num_uncommitted.dec();
+  num_in_flight.dec();
+  _session_op_remove(op->session, op);
 }
 
 /* This function DOES put the passed message before returning */
 void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 {
-  assert(client_lock.is_locked());
-  assert(initialized);
   ldout(cct, 10) << "in handle_osd_op_reply" << dendl;
 
   // get pio
   tid_t tid = m->get_tid();
 
-  if (ops.count(tid) == 0) {
+  rwlock.get_read();
+  if (!initialized) {
+    rwlock.put_read();
+    m->put();
+    return;
+  }
+
+  OSDSession *s = NULL;
+  if (m->get_source().is_osd())
+    s = lookup_session(m->get_source().num());
+  if (s)
+    s->lock.Lock();
+  map<tid_t,Op*>::iterator iter;
+  if (!s || (iter = s->ops.find(tid)) == s->ops.end()) {
     ldout(cct, 7) << "handle_osd_op_reply " << tid
 	    << (m->is_ondisk() ? " ondisk":(m->is_onnvram() ? " onnvram":" ack"))
 	    << " ... stray" << dendl;
+    if (s)
+      s->lock.Unlock();
+    rwlock.put_read();
     m->put();
     return;
   }
@@ -1589,14 +2005,16 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 		<< " in " << m->get_pg()
 		<< " attempt " << m->get_retry_attempt()
 		<< dendl;
-  Op *op = ops[tid];
+  Op *op = iter->second;
 
   if (m->get_retry_attempt() >= 0) {
     if (m->get_retry_attempt() != (op->attempts - 1)) {
       ldout(cct, 7) << " ignoring reply from attempt " << m->get_retry_attempt()
 		    << " from " << m->get_source_inst()
 		    << "; last attempt " << (op->attempts - 1) << " sent to "
-		    << op->session->con->get_peer_addr() << dendl;
+		    << s->con->get_peer_addr() << dendl;
+      s->lock.Unlock();
+      rwlock.put_read();
       m->put();
       return;
     }
@@ -1614,20 +2032,34 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
   if (m->is_redirect_reply()) {
     ldout(cct, 5) << " got redirect reply; redirecting" << dendl;
     unregister_op(op);
+    s->lock.Unlock();
     m->get_redirect().combine_with_locator(op->target_oloc, op->target_oid.name);
-    op_submit(op);
+    op->acting.clear();
+    _op_submit(op);
+    rwlock.put_read();
     m->put();
     return;
   }
 
   if (rc == -EAGAIN) {
     ldout(cct, 7) << " got -EAGAIN, resubmitting" << dendl;
+    if (op->used_replica) {
+      // the replica can't serve it (yet); use the primary instead
+      op->replica_refused = true;
+    }
+    // forget the target so that it is recalculated
+    op->acting.clear();
     unregister_op(op);
-    op_submit(op);
+    s->lock.Unlock();
+    _op_submit(op);
+    rwlock.put_read();
     m->put();
     return;
   }
 
+  if ((op->flags & CEPH_OSD_FLAG_READ) && !(op->flags & CEPH_OSD_FLAG_WRITE))
+    note_read_latency(s->osd, ceph_clock_now(cct) - op->stamp);
+
   if (op->objver)
     *op->objver = m->get_user_version();
   if (op->reply_epoch)
@@ -1642,6 +2074,8 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 		  << " != request ops " << op->ops
 		  << " from " << m->get_source_inst() << dendl;
 
+  // the handlers run once we have dropped our locks
+  list<pair<Context*, int> > handlers;
   vector<bufferlist*>::iterator pb = op->out_bl.begin();
   vector<int*>::iterator pr = op->out_rval.begin();
   vector<Context*>::iterator ph = op->out_handler.begin();
@@ -1661,25 +2095,28 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
       **pr = p->rval;
     if (*ph) {
       ldout(cct, 10) << " op " << i << " handler " << *ph << dendl;
-      (*ph)->complete(p->rval);
+      handlers.push_back(make_pair(*ph, p->rval));
       *ph = NULL;
     }
   }
 
+  // callbacks for an object go to the same completion thread
+  unsigned shard = op->pgid.ps();
+
   // ack|commit -> ack
   if (op->onack) {
     ldout(cct, 15) << "handle_osd_op_reply ack" << dendl;
     op->replay_version = m->get_replay_version();
     onack = op->onack;
     op->onack = 0;  // only do callback once
-    num_unacked--;
+    num_unacked.dec();
     logger->inc(l_osdc_op_ack);
   }
   if (op->oncommit && (m->is_ondisk() || rc)) {
     ldout(cct, 15) << "handle_osd_op_reply safe" << dendl;
     oncommit = op->oncommit;
     op->oncommit = 0;
-    num_uncommitted--;
+    num_uncommitted.dec();
     logger->inc(l_osdc_op_commit);
   }
 
@@ -1694,17 +2131,27 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
   // done with this tid?
   if (!op->onack && !op->oncommit) {
     ldout(cct, 15) << "handle_osd_op_reply completed tid " << tid << dendl;
+    logger->hinc(l_osdc_op_lat_hist, ceph_clock_now(cct) - op->stamp);
+    num_completed.inc();
+    ++s->num_completed;
     finish_op(op);
   }
   
-  ldout(cct, 5) << num_unacked << " unacked, " << num_uncommitted << " uncommitted" << dendl;
+  ldout(cct, 5) << num_unacked.read() << " unacked, " << num_uncommitted.read() << " uncommitted" << dendl;
+
+  s->lock.Unlock();
+  rwlock.put_read();
 
   // do callbacks
+  for (list<pair<Context*, int> >::iterator i = handlers.begin();
+       i != handlers.end();
+       ++i)
+    queue_completion(shard, i->first, i->second);
   if (onack) {
-    onack->complete(rc);
+    queue_completion(shard, onack, rc);
   }
   if (oncommit) {
-    oncommit->complete(rc);
+    queue_completion(shard, oncommit, rc);
   }
 
   m->put();
@@ -1727,22 +2174,23 @@ void Objecter::list_objects(ListContext *list_context, Context *onfinish) {
     return;
   }
 
+  rwlock.get_read();
   const pg_pool_t *pool = osdmap->get_pg_pool(list_context->pool_id);
   int pg_num = pool->get_pg_num();
+  rwlock.put_read();
 
   if (list_context->starting_pg_num == 0) {     // there can't be zero pgs!
-    list_context->starting_pg_num = pg_num;
-    ldout(cct, 20) << pg_num << " placement groups" << dendl;
+    list_context->reset_range(pg_num);
+    ldout(cct, 20) << pg_num << " placement groups, listing "
+		   << list_context->current_pg << "~" << list_context->end_pg
+		   << dendl;
   }
   if (list_context->starting_pg_num != pg_num) {
     // start reading from the beginning; the pgs have changed
     ldout(cct, 10) << "The placement groups have changed, restarting with " << pg_num << dendl;
-    list_context->current_pg = 0;
-    list_context->cookie = collection_list_handle_t();
-    list_context->current_pg_epoch = 0;
-    list_context->starting_pg_num = pg_num;
+    list_context->reset_range(pg_num);
   }
-  if (list_context->current_pg == pg_num){ //this context got all the way through
+  if (list_context->current_pg >= list_context->end_pg) { //this context got all the way through
     onfinish->complete(0);
     return;
   }
@@ -1819,7 +2267,7 @@ void Objecter::_list_reply(ListContext *list_context, int r, bufferlist *bl,
   ++list_context->current_pg;
   list_context->current_pg_epoch = 0;
   ldout(cct, 20) << "emptied current pg, moving on to next one:" << list_context->current_pg << dendl;
-  if (list_context->current_pg < list_context->starting_pg_num){ // we have more pgs to go through
+  if (list_context->current_pg < list_context->end_pg) { // we have more pgs to go through
     list_context->cookie = collection_list_handle_t();
     delete bl;
     list_objects(list_context, final_finish);
@@ -1839,6 +2287,7 @@ void Objecter::_list_reply(ListContext *list_context, int r, bufferlist *bl,
 
 int Objecter::create_pool_snap(int64_t pool, string& snap_name, Context *onfinish)
 {
+  RWLock::WLocker wl(rwlock);
   ldout(cct, 10) << "create_pool_snap; pool: " << pool << "; snap: " << snap_name << dendl;
 
   const pg_pool_t *p = osdmap->get_pg_pool(pool);
@@ -1850,7 +2299,7 @@ int Objecter::create_pool_snap(int64_t pool, string& snap_name, Context *onfinis
   PoolOp *op = new PoolOp;
   if (!op)
     return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   op->name = snap_name;
   op->onfinish = onfinish;
@@ -1879,10 +2328,11 @@ struct C_SelfmanagedSnap : public Context {
 int Objecter::allocate_selfmanaged_snap(int64_t pool, snapid_t *psnapid,
 					Context *onfinish)
 {
+  RWLock::WLocker wl(rwlock);
   ldout(cct, 10) << "allocate_selfmanaged_snap; pool: " << pool << dendl;
   PoolOp *op = new PoolOp;
   if (!op) return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   C_SelfmanagedSnap *fin = new C_SelfmanagedSnap(psnapid, onfinish);
   op->onfinish = fin;
@@ -1896,6 +2346,7 @@ int Objecter::allocate_selfmanaged_snap(int64_t pool, snapid_t *psnapid,
 
 int Objecter::delete_pool_snap(int64_t pool, string& snap_name, Context *onfinish)
 {
+  RWLock::WLocker wl(rwlock);
   ldout(cct, 10) << "delete_pool_snap; pool: " << pool << "; snap: " << snap_name << dendl;
 
   const pg_pool_t *p = osdmap->get_pg_pool(pool);
@@ -1907,7 +2358,7 @@ int Objecter::delete_pool_snap(int64_t pool, string& snap_name, Context *onfinis
   PoolOp *op = new PoolOp;
   if (!op)
     return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   op->name = snap_name;
   op->onfinish = onfinish;
@@ -1921,11 +2372,12 @@ int Objecter::delete_pool_snap(int64_t pool, string& snap_name, Context *onfinis
 
 int Objecter::delete_selfmanaged_snap(int64_t pool, snapid_t snap,
 				      Context *onfinish) {
+  RWLock::WLocker wl(rwlock);
   ldout(cct, 10) << "delete_selfmanaged_snap; pool: " << pool << "; snap: " 
 	   << snap << dendl;
   PoolOp *op = new PoolOp;
   if (!op) return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   op->onfinish = onfinish;
   op->pool_op = POOL_OP_DELETE_UNMANAGED_SNAP;
@@ -1940,6 +2392,7 @@ int Objecter::delete_selfmanaged_snap(int64_t pool, snapid_t snap,
 int Objecter::create_pool(string& name, Context *onfinish, uint64_t auid,
 			  int crush_rule)
 {
+  RWLock::WLocker wl(rwlock);
   ldout(cct, 10) << "create_pool name=" << name << dendl;
 
   if (osdmap->lookup_pg_pool_name(name.c_str()) >= 0)
@@ -1948,7 +2401,7 @@ int Objecter::create_pool(string& name, Context *onfinish, uint64_t auid,
   PoolOp *op = new PoolOp;
   if (!op)
     return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = 0;
   op->name = name;
   op->onfinish = onfinish;
@@ -1964,6 +2417,7 @@ int Objecter::create_pool(string& name, Context *onfinish, uint64_t auid,
 
 int Objecter::delete_pool(int64_t pool, Context *onfinish)
 {
+  RWLock::WLocker wl(rwlock);
   ldout(cct, 10) << "delete_pool " << pool << dendl;
 
   if (!osdmap->have_pg_pool(pool))
@@ -1971,7 +2425,7 @@ int Objecter::delete_pool(int64_t pool, Context *onfinish)
 
   PoolOp *op = new PoolOp;
   if (!op) return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   op->name = "delete";
   op->onfinish = onfinish;
@@ -1991,10 +2445,11 @@ int Objecter::delete_pool(int64_t pool, Context *onfinish)
  */
 int Objecter::change_pool_auid(int64_t pool, Context *onfinish, uint64_t auid)
 {
+  RWLock::WLocker wl(rwlock);
   ldout(cct, 10) << "change_pool_auid " << pool << " to " << auid << dendl;
   PoolOp *op = new PoolOp;
   if (!op) return -ENOMEM;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pool = pool;
   op->name = "change_pool_auid";
   op->onfinish = onfinish;
@@ -2031,7 +2486,7 @@ void Objecter::pool_op_submit(PoolOp *op)
  */
 void Objecter::handle_pool_op_reply(MPoolOpReply *m)
 {
-  assert(client_lock.is_locked());
+  rwlock.get_write();
   assert(initialized);
   ldout(cct, 10) << "handle_pool_op_reply " << *m << dendl;
   tid_t tid = m->get_tid();
@@ -2044,10 +2499,10 @@ void Objecter::handle_pool_op_reply(MPoolOpReply *m)
       last_seen_osdmap_version = m->version;
     if (osdmap->get_epoch() < m->epoch) {
       ldout(cct, 20) << "waiting for client to reach epoch " << m->epoch << " before calling back" << dendl;
-      wait_for_new_map(op->onfinish, m->epoch, m->replyCode);
+      _wait_for_new_map(op->onfinish, m->epoch, m->replyCode);
     }
     else {
-      op->onfinish->complete(m->replyCode);
+      defer_finish(op->onfinish, m->replyCode);
     }
     op->onfinish = NULL;
     delete op;
@@ -2059,6 +2514,7 @@ void Objecter::handle_pool_op_reply(MPoolOpReply *m)
     ldout(cct, 10) << "unknown request " << tid << dendl;
   }
   ldout(cct, 10) << "done" << dendl;
+  put_write_and_finish();
   m->put();
 }
 
@@ -2068,10 +2524,11 @@ void Objecter::handle_pool_op_reply(MPoolOpReply *m)
 void Objecter::get_pool_stats(list<string>& pools, map<string,pool_stat_t> *result,
 			      Context *onfinish)
 {
+  RWLock::WLocker wl(rwlock);
   ldout(cct, 10) << "get_pool_stats " << pools << dendl;
 
   PoolStatOp *op = new PoolStatOp;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->pools = pools;
   op->pool_stats = result;
   op->onfinish = onfinish;
@@ -2093,7 +2550,7 @@ void Objecter::poolstat_submit(PoolStatOp *op)
 
 void Objecter::handle_get_pool_stats_reply(MGetPoolStatsReply *m)
 {
-  assert(client_lock.is_locked());
+  rwlock.get_write();
   assert(initialized);
   ldout(cct, 10) << "handle_get_pool_stats_reply " << *m << dendl;
   tid_t tid = m->get_tid();
@@ -2104,7 +2561,7 @@ void Objecter::handle_get_pool_stats_reply(MGetPoolStatsReply *m)
     *op->pool_stats = m->pool_stats;
     if (m->version > last_seen_pgmap_version)
       last_seen_pgmap_version = m->version;
-    op->onfinish->complete(0);
+    defer_finish(op->onfinish, 0);
     poolstat_ops.erase(tid);
     delete op;
 
@@ -2114,16 +2571,18 @@ void Objecter::handle_get_pool_stats_reply(MGetPoolStatsReply *m)
     ldout(cct, 10) << "unknown request " << tid << dendl;
   } 
   ldout(cct, 10) << "done" << dendl;
+  put_write_and_finish();
   m->put();
 }
 
 
 void Objecter::get_fs_stats(ceph_statfs& result, Context *onfinish)
 {
+  RWLock::WLocker wl(rwlock);
   ldout(cct, 10) << "get_fs_stats" << dendl;
 
   StatfsOp *op = new StatfsOp;
-  op->tid = ++last_tid;
+  op->tid = last_tid.inc();
   op->stats = &result;
   op->onfinish = onfinish;
   statfs_ops[op->tid] = op;
@@ -2144,7 +2603,7 @@ void Objecter::fs_stats_submit(StatfsOp *op)
 
 void Objecter::handle_fs_stats_reply(MStatfsReply *m)
 {
-  assert(client_lock.is_locked());
+  rwlock.get_write();
   assert(initialized);
   ldout(cct, 10) << "handle_fs_stats_reply " << *m << dendl;
   tid_t tid = m->get_tid();
@@ -2155,7 +2614,7 @@ void Objecter::handle_fs_stats_reply(MStatfsReply *m)
     *(op->stats) = m->h.st;
     if (m->h.version > last_seen_pgmap_version)
       last_seen_pgmap_version = m->h.version;
-    op->onfinish->complete(0);
+    defer_finish(op->onfinish, 0);
     statfs_ops.erase(tid);
     delete op;
 
@@ -2165,6 +2624,7 @@ void Objecter::handle_fs_stats_reply(MStatfsReply *m)
     ldout(cct, 10) << "unknown request " << tid << dendl;
   }
   ldout(cct, 10) << "done" << dendl;
+  put_write_and_finish();
   m->put();
 }
 
@@ -2212,7 +2672,7 @@ void Objecter::ms_handle_connect(Connection *con)
 void Objecter::ms_handle_reset(Connection *con)
 {
   if (con->get_peer_type() == CEPH_ENTITY_TYPE_OSD) {
-    //
+    RWLock::WLocker wl(rwlock);
     int osd = osdmap->identify_osd(con->get_peer_addr());
     if (osd >= 0) {
       ldout(cct, 1) << "ms_handle_reset on osd." << osd << dendl;
@@ -2240,17 +2700,25 @@ void Objecter::ms_handle_remote_reset(Connection *con)
 
 void Objecter::dump_active()
 {
-  ldout(cct, 20) << "dump_active .. " << num_homeless_ops << " homeless" << dendl;
+  RWLock::RLocker rl(rwlock);
+  _dump_active();
+}
+
+void Objecter::_dump_active()
+{
+  ldout(cct, 20) << "dump_active .. " << num_homeless_ops.read() << " homeless" << dendl;
+  map<tid_t,Op*> ops;
+  _get_all_ops(ops);
   for (map<tid_t,Op*>::iterator p = ops.begin(); p != ops.end(); ++p) {
     Op *op = p->second;
-    ldout(cct, 20) << op->tid << "\t" << op->pgid << "\tosd." << (op->session ? op->session->osd : -1)
+    ldout(cct, 20) << op->tid << "\t" << op->pgid << "\tosd." << op->session->osd
 	    << "\t" << op->base_oid << "\t" << op->ops << dendl;
   }
 }
 
-void Objecter::dump_requests(Formatter *fmt) const
+void Objecter::dump_requests(Formatter *fmt)
 {
-  assert(client_lock.is_locked());
+  RWLock::RLocker rl(rwlock);
 
   fmt->open_object_section("requests");
   dump_ops(fmt);
@@ -2264,6 +2732,9 @@ void Objecter::dump_requests(Formatter *fmt) const
 
 void Objecter::dump_ops(Formatter *fmt) const
 {
+  // only ever asked for once in a while, so just copy them out
+  map<tid_t,Op*> ops;
+  const_cast<Objecter*>(this)->_get_all_ops(ops);
   fmt->open_array_section("ops");
   for (map<tid_t,Op*>::const_iterator p = ops.begin();
        p != ops.end();
@@ -2272,7 +2743,7 @@ void Objecter::dump_ops(Formatter *fmt) const
     fmt->open_object_section("op");
     fmt->dump_unsigned("tid", op->tid);
     fmt->dump_stream("pg") << op->pgid;
-    fmt->dump_int("osd", op->session ? op->session->osd : -1);
+    fmt->dump_int("osd", op->session->osd);
     fmt->dump_stream("last_sent") << op->stamp;
     fmt->dump_int("attempts", op->attempts);
     fmt->dump_stream("object_id") << op->base_oid;
@@ -2407,9 +2878,7 @@ bool Objecter::RequestStateHook::call(std::string command, cmdmap_t& cmdmap,
 				      std::string format, bufferlist& out)
 {
   Formatter *f = new_formatter(format);
-  m_objecter->client_lock.Lock();
   m_objecter->dump_requests(f);
-  m_objecter->client_lock.Unlock();
   f->flush(out);
   delete f;
   return true;
@@ -2439,9 +2908,11 @@ void Objecter::blacklist_self(bool set)
 
 void Objecter::handle_command_reply(MCommandReply *m)
 {
+  rwlock.get_write();
   map<tid_t,CommandOp*>::iterator p = command_ops.find(m->get_tid());
   if (p == command_ops.end()) {
     ldout(cct, 10) << "handle_command_reply tid " << m->get_tid() << " not found" << dendl;
+    rwlock.put_write();
     m->put();
     return;
   }
@@ -2451,22 +2922,25 @@ void Objecter::handle_command_reply(MCommandReply *m)
       m->get_connection() != c->session->con) {
     ldout(cct, 10) << "handle_command_reply tid " << m->get_tid() << " got reply from wrong connection "
 		   << m->get_connection() << " " << m->get_source_inst() << dendl;
+    rwlock.put_write();
     m->put();
     return;
   }
   if (c->poutbl)
     c->poutbl->claim(m->get_data());
   _finish_command(c, m->r, m->rs);
+  put_write_and_finish();
   m->put();
 }
 
 int Objecter::_submit_command(CommandOp *c, tid_t *ptid)
 {
-  tid_t tid = ++last_tid;
+  RWLock::WLocker wl(rwlock);
+  tid_t tid = last_tid.inc();
   ldout(cct, 10) << "_submit_command " << tid << " " << c->cmd << dendl;
   c->tid = tid;
   command_ops[tid] = c;
-  num_homeless_ops++;
+  num_homeless_ops.inc();
   (void)recalc_command_target(c);
 
   if (c->session)
@@ -2512,12 +2986,12 @@ int Objecter::recalc_command_target(CommandOp *c)
     ldout(cct, 10) << "recalc_command_target " << c->tid << " now " << c->session << dendl;
     if (s) {
       if (!c->session)
-	num_homeless_ops--;
+	num_homeless_ops.dec();
       c->session = s;
       s->command_ops.push_back(&c->session_item);
     } else {
       c->session = NULL;
-      num_homeless_ops++;
+      num_homeless_ops.inc();
     }
     return RECALC_OP_TARGET_NEED_RESEND;
   }
@@ -2545,7 +3019,7 @@ void Objecter::_finish_command(CommandOp *c, int r, string rs)
   if (c->prs)
     *c->prs = rs;
   if (c->onfinish)
-    c->onfinish->complete(r);
+    defer_finish(c->onfinish, r);
   command_ops.erase(c->tid);
   c->put();
 
@@ -16,6 +16,7 @@
 #define CEPH_OBJECTER_H
 
 #include "include/types.h"
+#include "include/atomic.h"
 #include "include/buffer.h"
 #include "include/xlist.h"
 
@@ -23,6 +24,8 @@
 #include "messages/MOSDOp.h"
 
 #include "common/admin_socket.h"
+#include "common/Finisher.h"
+#include "common/RWLock.h"
 #include "common/Timer.h"
 #include "include/rados/rados_types.h"
 #include "include/rados/rados_types.hpp"
@@ -794,6 +797,22 @@ struct ObjectOperation {
 // ----------------
 
 
+/**
+ * Locking
+ *
+ * The objecter does not rely on its owner's lock.  rwlock protects the
+ * osdmap and everything that is not an Op: sessions, lingers, commands,
+ * pool and stat ops and the map waiters.  Submitting an op or handling
+ * its reply only reads that state, so those take rwlock for read plus
+ * the lock of the one OSDSession the op is on, which guards the
+ * session's op map and the op itself.  Anything that retargets or
+ * cancels ops takes rwlock for write.
+ *
+ * The order is owner's lock -> rwlock -> OSDSession::lock, and no
+ * completion is run with rwlock or a session lock held.  The owner's
+ * lock is still taken for the timer and for the monitor map checks,
+ * so owners that dispatch map messages under it keep their semantics.
+ */
 class Objecter {
  public:  
   Messenger *messenger;
@@ -804,11 +823,12 @@ class Objecter {
   bool initialized;
  
  private:
-  tid_t last_tid;
+  atomic_t last_tid;
   int client_inc;
   uint64_t max_linger_id;
-  int num_unacked;
-  int num_uncommitted;
+  atomic_t num_unacked;
+  atomic_t num_uncommitted;
+  atomic_t num_completed;  // ops completed by any osd, for the qos deltas
   int global_op_flags; // flags which are applied to each IO op
   bool keep_balanced_budget;
   bool honor_osdmap_full;
@@ -822,6 +842,28 @@ class Objecter {
   Mutex &client_lock;
   SafeTimer &timer;
 
+  RWLock rwlock;
+
+  /// completions queued under rwlock, run by put_write_and_finish()
+  list<pair<Context*, int> > deferred_finish;
+
+  /// threads to run op callbacks on, by object; empty runs them inline
+  vector<Finisher*> completion_finishers;
+  atomic_t num_queued_completions;
+  struct C_QueuedCompletion : public Context {
+    Objecter *objecter;
+    Context *con;
+    utime_t queued;
+    C_QueuedCompletion(Objecter *o, Context *c, utime_t q)
+      : objecter(o), con(c), queued(q) {}
+    void finish(int r);
+  };
+  void queue_completion(unsigned shard, Context *c, int r);
+  void defer_finish(Context *c, int r) {
+    deferred_finish.push_back(make_pair(c, r));
+  }
+  void put_write_and_finish();
+
   PerfCounters *logger;
   
   class C_Tick : public Context {
@@ -852,8 +894,7 @@ public:
   struct OSDSession;
 
   struct Op {
-    OSDSession *session;
-    xlist<Op*>::item session_item;
+    OSDSession *session;  ///< the session whose ops map holds us, if any
     int incarnation;
     
     object_t base_oid;
@@ -862,8 +903,10 @@ public:
     object_locator_t target_oloc;
 
     pg_t pgid;
+    vector<int> raw;     ///< crush mapping of pgid, down osds included
     vector<int> acting;
     bool used_replica;
+    bool replica_refused;  ///< a replica sent this read back; use the primary
 
     ConnectionRef con;  // for rx buffer only
 
@@ -902,9 +945,9 @@ public:
 
     Op(const object_t& o, const object_locator_t& ol, vector<OSDOp>& op,
        int f, Context *ac, Context *co, version_t *ov) :
-      session(NULL), session_item(this), incarnation(0),
+      session(NULL), incarnation(0),
       base_oid(o), base_oloc(ol),
-      used_replica(false), con(NULL),
+      used_replica(false), replica_refused(false), con(NULL),
       snapid(CEPH_NOSNAP),
       outbl(NULL),
       flags(f), priority(0), onack(ac), oncommit(co),
@@ -1002,6 +1045,10 @@ public:
     int starting_pg_num;
     bool at_end;
 
+    // list only pgs [end_pg * part / num_parts, end_pg * (part+1) / num_parts)
+    unsigned part, num_parts;
+    int end_pg;
+
     int64_t pool_id;
     int pool_snap_seq;
     int max_entries;
@@ -1013,8 +1060,54 @@ public:
     bufferlist extra_info;
 
     ListContext() : current_pg(0), current_pg_epoch(0), starting_pg_num(0),
-		    at_end(false), pool_id(0),
+		    at_end(false), part(0), num_parts(1), end_pg(0), pool_id(0),
 		    pool_snap_seq(0), max_entries(0) {}
+
+    /// (re)start at the first pg of our part of pg_num pgs
+    void reset_range(int pg_num) {
+      starting_pg_num = pg_num;
+      current_pg = (uint64_t)pg_num * part / num_parts;
+      end_pg = (uint64_t)pg_num * (part + 1) / num_parts;
+      cookie = collection_list_handle_t();
+      current_pg_epoch = 0;
+    }
+
+    /**
+     * Where this listing is, including entries fetched but not yet
+     * consumed, so that it can be picked up later or by another
+     * process.  The first entry of list is taken to be the one last
+     * handed out.
+     */
+    void encode_cursor(bufferlist& bl) const {
+      ENCODE_START(1, 1, bl);
+      ::encode(pool_id, bl);
+      ::encode(nspace, bl);
+      ::encode(part, bl);
+      ::encode(num_parts, bl);
+      ::encode(starting_pg_num, bl);
+      ::encode(current_pg, bl);
+      ::encode(end_pg, bl);
+      ::encode(cookie, bl);
+      ::encode(current_pg_epoch, bl);
+      ::encode(at_end, bl);
+      ::encode(list, bl);
+      ENCODE_FINISH(bl);
+    }
+    void decode_cursor(bufferlist::iterator& p) {
+      DECODE_START(1, p);
+      ::decode(pool_id, p);
+      ::decode(nspace, p);
+      ::decode(part, p);
+      ::decode(num_parts, p);
+      ::decode(starting_pg_num, p);
+      ::decode(current_pg, p);
+      ::decode(end_pg, p);
+      ::decode(cookie, p);
+      ::decode(current_pg_epoch, p);
+      ::decode(at_end, p);
+      ::decode(list, p);
+      DECODE_FINISH(p);
+    }
   };
 
   struct C_List : public Context {
@@ -1109,6 +1202,7 @@ public:
     object_locator_t oloc;
 
     pg_t pgid;
+    vector<int> raw;
     vector<int> acting;
 
     snapid_t snap;
@@ -1184,22 +1278,37 @@ public:
 
   // -- osd sessions --
   struct OSDSession {
-    xlist<Op*> ops;
-    xlist<LingerOp*> linger_ops;
-    xlist<CommandOp*> command_ops;
+    Mutex lock;                  // ops, and the Ops in it
+    map<tid_t,Op*> ops;
+    xlist<LingerOp*> linger_ops;   // under rwlock
+    xlist<CommandOp*> command_ops; // under rwlock
     int osd;
     int incarnation;
     ConnectionRef con;
+    uint64_t num_completed;      // ops completed by this osd
+    uint64_t completed_elsewhere; // ... by others, as of the last op sent
 
-    OSDSession(int o) : osd(o), incarnation(0), con(NULL) {}
+    OSDSession(int o) : lock("OSDSession::lock"),
+			osd(o), incarnation(0), con(NULL),
+			num_completed(0), completed_elsewhere(0) {}
   };
   map<int,OSDSession*> osd_sessions;
+  /// protects osd_sessions, so that sessions can be opened under rwlock for read
+  Mutex sessions_lock;
+  /// ops with no osd to go to, waiting for a map
+  OSDSession *homeless_session;
+
+  /// moving average of the read latency seen from each osd, in seconds
+  map<int,double> osd_read_latency;
+  Mutex read_latency_lock;
+  void note_read_latency(int osd, utime_t lat);
+  int choose_read_target(const vector<int>& acting);
 
 
  private:
-  // pending ops
-  map<tid_t,Op*>            ops;
-  int                       num_homeless_ops;
+  // pending ops; the ops themselves are in their OSDSessions
+  atomic_t                  num_in_flight;
+  atomic_t                  num_homeless_ops;
   map<uint64_t, LingerOp*>  linger_ops;
   map<tid_t,PoolStatOp*>    poolstat_ops;
   map<tid_t,StatfsOp*>      statfs_ops;
@@ -1209,14 +1318,19 @@ public:
   // ops waiting for an osdmap with a new pool or confirmation that
   // the pool does not exist (may be expanded to other uses later)
   map<uint64_t, LingerOp*>  check_latest_map_lingers;
-  map<tid_t, Op*>           check_latest_map_ops;
+  map<tid_t, Op*>           check_latest_map_ops;  // under check_latest_map_lock
   map<tid_t, CommandOp*>    check_latest_map_commands;
+  Mutex check_latest_map_lock;
 
   map<epoch_t,list< pair<Context*, int> > > waiting_for_map;
 
   void send_op(Op *op);
   void cancel_linger_op(Op *op);
   void finish_op(Op *op);
+  void _session_op_assign(OSDSession *s, Op *op);
+  void _session_op_remove(OSDSession *s, Op *op);
+  Op *_find_op(tid_t tid);
+  void _get_all_ops(map<tid_t,Op*>& all);
   bool is_pg_changed(vector<int>& a, vector<int>& b, bool any_change=false);
   enum recalc_op_target_result {
     RECALC_OP_TARGET_NO_ACTION = 0,
@@ -1236,6 +1350,7 @@ public:
   void _send_op_map_check(Op *op);
   void op_cancel_map_check(Op *op);
   void check_linger_pool_dne(LingerOp *op);
+  void _unregister_linger(uint64_t linger_id);
   void _send_linger_map_check(LingerOp *op);
   void linger_cancel_map_check(LingerOp *op);
   void check_command_map_dne(CommandOp *op);
@@ -1245,6 +1360,7 @@ public:
   void kick_requests(OSDSession *session);
 
   OSDSession *get_session(int osd);
+  OSDSession *lookup_session(int osd);
   void reopen_session(OSDSession *session);
   void close_session(OSDSession *session);
   
@@ -1257,18 +1373,34 @@ public:
    * handle a budget for in-flight ops
    * budget is taken whenever an op goes into the ops map
    * and returned whenever an op is removed from the map
-   * If throttle_op needs to throttle it will unlock client_lock.
+   * If throttle_op needs to throttle it will unlock client_lock,
+   * if the caller holds it.
    */
   int calc_op_budget(Op *op);
   void throttle_op(Op *op, int op_size=0);
-  void take_op_budget(Op *op) {
+  void take_op_budget(Op *op, bool may_block=true) {
     int op_budget = calc_op_budget(op);
-    if (keep_balanced_budget) {
+    if (keep_balanced_budget && may_block) {
       throttle_op(op, op_budget);
     } else {
       op_throttle_bytes.take(op_budget);
       op_throttle_ops.take(1);
     }
+  }
+  /// take_op_budget(), unless that would block
+  bool try_take_op_budget(Op *op) {
+    if (!keep_balanced_budget) {
+      take_op_budget(op, false);
+      return true;
+    }
+    int op_budget = calc_op_budget(op);
+    if (!op_throttle_bytes.get_or_fail(op_budget))
+      return false;
+    if (!op_throttle_ops.get_or_fail(1)) {
+      op_throttle_bytes.put(op_budget);
+      return false;
+    }
+    return true;
     op->budgeted = true;
   }
   void put_op_budget(Op *op) {
@@ -1285,16 +1417,22 @@ public:
     messenger(m), monc(mc), osdmap(om), cct(cct_),
     initialized(false),
     last_tid(0), client_inc(-1), max_linger_id(0),
-    num_unacked(0), num_uncommitted(0),
+    num_unacked(0), num_uncommitted(0), num_completed(0),
     global_op_flags(0),
     keep_balanced_budget(false), honor_osdmap_full(true),
     honor_cache_redirects(true),
     last_seen_osdmap_version(0),
     last_seen_pgmap_version(0),
     client_lock(l), timer(t),
+    rwlock("Objecter::rwlock"),
     logger(NULL), tick_event(NULL),
     m_request_state_hook(NULL),
+    sessions_lock("Objecter::sessions_lock"),
+    homeless_session(new OSDSession(-1)),
+    read_latency_lock("Objecter::read_latency_lock"),
+    num_in_flight(0),
     num_homeless_ops(0),
+    check_latest_map_lock("Objecter::check_latest_map_lock"),
     op_throttle_bytes(cct, "objecter_bytes", cct->_conf->objecter_inflight_op_bytes),
     op_throttle_ops(cct, "objecter_ops", cct->_conf->objecter_inflight_ops)
   { }
@@ -1302,6 +1440,7 @@ public:
     assert(!tick_event);
     assert(!m_request_state_hook);
     assert(!logger);
+    delete homeless_session;
   }
 
   void init_unlocked();
@@ -1312,7 +1451,7 @@ public:
   /**
    * Tell the objecter to throttle outgoing ops according to its
    * budget (in _conf). If you do this, ops can block, in
-   * which case it will unlock client_lock and sleep until
+   * which case it will unlock client_lock (if held) and sleep until
    * incoming messages reduce the used budget low enough for
    * the ops to continue going; then it will lock client_lock again.
    */
@@ -1325,7 +1464,34 @@ public:
   void set_honor_cache_redirects() { honor_cache_redirects = true; }
   void unset_honor_cache_redirects() { honor_cache_redirects = false; }
 
+  /**
+   * Run op callbacks on n threads of our own instead of the thread
+   * that dispatched the reply.  The op's object picks the thread, so
+   * callbacks for one object still run in order.  Only for owners whose
+   * callbacks don't expect their lock to be held; call before
+   * init_locked().
+   */
+  void set_completion_threads(int n);
+  int get_completion_threads() const { return completion_finishers.size(); }
+
+  /**
+   * What a run of incrementals changed that can move a pg: an op whose
+   * pools and mapped osds are all untouched keeps its target, so
+   * scan_requests() need not recalculate it.
+   */
+  struct MapChanges {
+    bool all;             ///< anything may have moved
+    set<int64_t> pools;   ///< pools created, removed, changed or re-pg_temped
+    set<int> osds;        ///< osds whose state or address changed
+    MapChanges() : all(false) {}
+    void note(const OSDMap::Incremental& inc);
+    bool affects(int64_t pool, const vector<int>& raw,
+		 const vector<int>& acting) const;
+  };
+
+  /// with rwlock held for write
   void scan_requests(bool skipped_map,
+		     const MapChanges& changes,
 		     map<tid_t, Op*>& need_resend,
 		     list<LingerOp*>& need_resend_linger,
 		     map<tid_t, CommandOp*>& need_resend_command);
@@ -1346,14 +1512,17 @@ private:
   // public interface
  public:
   bool is_active() {
-    return !(ops.empty() && linger_ops.empty() && poolstat_ops.empty() && statfs_ops.empty());
+    RWLock::RLocker l(rwlock);
+    return !(num_in_flight.read() == 0 && linger_ops.empty() &&
+	     poolstat_ops.empty() && statfs_ops.empty());
   }
 
   /**
    * Output in-flight requests
    */
   void dump_active();
-  void dump_requests(Formatter *fmt) const;
+  void _dump_active();
+  void dump_requests(Formatter *fmt);
   void dump_ops(Formatter *fmt) const;
   void dump_linger_ops(Formatter *fmt) const;
   void dump_command_ops(Formatter *fmt) const;
@@ -1365,6 +1534,7 @@ private:
   void set_client_incarnation(int inc) { client_inc = inc; }
 
   void wait_for_new_map(Context *c, epoch_t epoch, int err=0);
+  void _wait_for_new_map(Context *c, epoch_t epoch, int err=0);
 
   /** Get the current set of global op flags */
   int get_global_op_flags() { return global_op_flags; }
@@ -1401,21 +1571,36 @@ private:
     return _submit_command(c, ptid);
   }
 
+  /**
+   * Submit ops built with prepare_mutate_op()/prepare_read_op() in
+   * order, taking our locks once for as many of them as the throttle
+   * lets through without waiting, rather than once each.
+   */
+  void op_submit_batch(const vector<Op*>& ops);
+
   // mid-level helpers
-  tid_t mutate(const object_t& oid, const object_locator_t& oloc, 
-	       ObjectOperation& op,
-	       const SnapContext& snapc, utime_t mtime, int flags,
-	       Context *onack, Context *oncommit, version_t *objver = NULL) {
+  Op *prepare_mutate_op(const object_t& oid, const object_locator_t& oloc,
+			ObjectOperation& op,
+			const SnapContext& snapc, utime_t mtime, int flags,
+			Context *onack, Context *oncommit,
+			version_t *objver = NULL) {
     Op *o = new Op(oid, oloc, op.ops, flags | global_op_flags | CEPH_OSD_FLAG_WRITE, onack, oncommit, objver);
     o->priority = op.priority;
     o->mtime = mtime;
     o->snapc = snapc;
-    return op_submit(o);
+    return o;
   }
-  tid_t read(const object_t& oid, const object_locator_t& oloc,
-	     ObjectOperation& op,
-	     snapid_t snapid, bufferlist *pbl, int flags,
-	     Context *onack, version_t *objver = NULL) {
+  tid_t mutate(const object_t& oid, const object_locator_t& oloc, 
+	       ObjectOperation& op,
+	       const SnapContext& snapc, utime_t mtime, int flags,
+	       Context *onack, Context *oncommit, version_t *objver = NULL) {
+    return op_submit(prepare_mutate_op(oid, oloc, op, snapc, mtime, flags,
+				       onack, oncommit, objver));
+  }
+  Op *prepare_read_op(const object_t& oid, const object_locator_t& oloc,
+		      ObjectOperation& op,
+		      snapid_t snapid, bufferlist *pbl, int flags,
+		      Context *onack, version_t *objver = NULL) {
     Op *o = new Op(oid, oloc, op.ops, flags | global_op_flags | CEPH_OSD_FLAG_READ, onack, NULL, objver);
     o->priority = op.priority;
     o->snapid = snapid;
@@ -1423,7 +1608,14 @@ private:
     o->out_bl.swap(op.out_bl);
     o->out_handler.swap(op.out_handler);
     o->out_rval.swap(op.out_rval);
-    return op_submit(o);
+    return o;
+  }
+  tid_t read(const object_t& oid, const object_locator_t& oloc,
+	     ObjectOperation& op,
+	     snapid_t snapid, bufferlist *pbl, int flags,
+	     Context *onack, version_t *objver = NULL) {
+    return op_submit(prepare_read_op(oid, oloc, op, snapid, pbl, flags,
+				     onack, objver));
   }
   tid_t linger_mutate(const object_t& oid, const object_locator_t& oloc,
 		      ObjectOperation& op,
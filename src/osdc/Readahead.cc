@@ -0,0 +1,135 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "Readahead.h"
+
+Readahead::Readahead()
+  : lock("Readahead::lock"),
+    tick(0),
+    min_bytes(0), max_bytes(0), cur_max(0),
+    max_streams(1),
+    align_large(0), align_small(0)
+{
+}
+
+void Readahead::_drop(unsigned i)
+{
+  Stream &s = streams[i];
+  if (s.ra_end > s.ra_begin) {
+    stats.wasted += s.ra_end - s.ra_begin;
+    cur_max = MAX(min_bytes, cur_max / 2);
+  }
+  streams.erase(streams.begin() + i);
+}
+
+void Readahead::_align(uint64_t start, uint64_t *end)
+{
+  uint64_t e = *end;
+  if (align_large && e - start >= 2 * align_large)
+    e -= e % align_large;
+  else if (align_small && e / align_small != start / align_small)
+    e -= e % align_small;
+  if (e > start)
+    *end = e;
+}
+
+void Readahead::set_limits(uint64_t min, uint64_t max, unsigned nstreams)
+{
+  Mutex::Locker l(lock);
+  if (max != max_bytes)
+    cur_max = max;
+  max_bytes = max;
+  min_bytes = MIN(min, max);
+  max_streams = MAX(nstreams, 1u);
+  while (streams.size() > max_streams)
+    _drop(0);
+}
+
+void Readahead::set_alignments(uint64_t large, uint64_t small)
+{
+  Mutex::Locker l(lock);
+  align_large = large;
+  align_small = small;
+}
+
+Readahead::extent_t Readahead::update(uint64_t off, uint64_t len,
+				      uint64_t limit)
+{
+  Mutex::Locker l(lock);
+  ++tick;
+  if (!max_bytes)
+    return extent_t(0, 0);
+  uint64_t end = off + len;
+
+  // continuing a stream, or skipping ahead within its readahead?
+  unsigned i;
+  for (i = 0; i < streams.size(); ++i) {
+    if (off == streams[i].next ||
+	(off > streams[i].next && off < streams[i].ra_end))
+      break;
+  }
+  if (i == streams.size()) {
+    if (streams.size() >= max_streams) {
+      unsigned oldest = 0;
+      for (unsigned j = 1; j < streams.size(); ++j)
+	if (streams[j].last_used < streams[oldest].last_used)
+	  oldest = j;
+      _drop(oldest);
+    }
+    streams.push_back(Stream(end, tick));
+    return extent_t(0, 0);
+  }
+
+  Stream &s = streams[i];
+  s.last_used = tick;
+  if (s.ra_end > s.ra_begin) {
+    uint64_t b = MAX(off, s.ra_begin);
+    uint64_t e = MIN(end, s.ra_end);
+    if (e > b)
+      stats.hit += e - b;
+    if (end >= s.ra_end && s.window >= cur_max)
+      cur_max = MIN(max_bytes, cur_max * 2);  // all used; allow more
+    s.ra_begin = MIN(MAX(s.ra_begin, end), s.ra_end);
+  }
+  s.next = end;
+  if (s.ra_end < s.next)
+    s.ra_begin = s.ra_end = s.next;
+  if (s.window)
+    s.window = MIN(s.window * 2, cur_max);
+  else
+    s.window = MIN(MAX(min_bytes, 2 * len), cur_max);
+
+  // top up once half of the window ahead has been read
+  uint64_t want = MIN(s.next + s.window, limit);
+  if (want <= s.ra_end || s.ra_end - s.next > s.window / 2)
+    return extent_t(0, 0);
+  uint64_t start = s.ra_end;
+  if (want < limit)
+    _align(start, &want);
+  s.ra_end = want;
+  stats.issued += want - start;
+  return extent_t(start, want - start);
+}
+
+void Readahead::reset()
+{
+  Mutex::Locker l(lock);
+  streams.clear();
+}
+
+Readahead::stats_t Readahead::take_stats()
+{
+  Mutex::Locker l(lock);
+  stats_t r = stats;
+  stats = stats_t();
+  return r;
+}
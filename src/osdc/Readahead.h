@@ -0,0 +1,100 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSDC_READAHEAD_H
+#define CEPH_OSDC_READAHEAD_H
+
+#include <vector>
+#include "include/types.h"
+#include "common/Mutex.h"
+
+/**
+ * Readahead
+ *
+ * Spots sequential streams in the reads of one file or image, and says
+ * what to read ahead of them into the cache.  Several streams are
+ * followed at once, so that e.g. two guests reading different parts of
+ * one image, or a backup racing a scan, each get readahead.
+ *
+ * A stream's window starts at min_bytes once it has seen two reads in
+ * a row, and doubles with each further read up to the current cap.  The
+ * cap itself starts at max_bytes and adapts: readahead that was never
+ * read before its stream was replaced halves it, and a window read to
+ * its end doubles it back.  Readahead that would be wasted is thus cut
+ * short, though reads already sent are left to finish.
+ */
+class Readahead {
+public:
+  typedef pair<uint64_t, uint64_t> extent_t;
+
+  struct stats_t {
+    uint64_t issued;  ///< bytes read ahead
+    uint64_t hit;     ///< bytes of readahead read afterwards
+    uint64_t wasted;  ///< bytes of readahead dropped unread
+    stats_t() : issued(0), hit(0), wasted(0) {}
+  };
+
+private:
+  struct Stream {
+    uint64_t next;      ///< where a sequential read would start
+    uint64_t window;    ///< readahead size; 0 until sequential
+    uint64_t ra_begin;  ///< readahead not yet read: ra_begin~ra_end
+    uint64_t ra_end;
+    uint64_t last_used;
+    Stream(uint64_t n, uint64_t t)
+      : next(n), window(0), ra_begin(n), ra_end(n), last_used(t) {}
+  };
+
+  Mutex lock;
+  vector<Stream> streams;
+  uint64_t tick;
+  uint64_t min_bytes, max_bytes, cur_max;
+  unsigned max_streams;
+  uint64_t align_large, align_small;
+  stats_t stats;
+
+  void _drop(unsigned i);
+  void _align(uint64_t start, uint64_t *end);
+
+public:
+  Readahead();
+
+  /**
+   * @param min first window size
+   * @param max largest window; 0 disables readahead
+   * @param nstreams streams to follow at once
+   */
+  void set_limits(uint64_t min, uint64_t max, unsigned nstreams);
+
+  /**
+   * Round the end of readahead down to a multiple of large once the
+   * window spans two of those, else to one of small when it crosses
+   * one; e.g. the layout period and stripe unit.  0 to leave as is.
+   */
+  void set_alignments(uint64_t large, uint64_t small);
+
+  /**
+   * Note a read of off~len, and get what to read ahead of it
+   *
+   * @param limit end of the file or image; nothing past it is read
+   * @return extent to read ahead, with length 0 if none
+   */
+  extent_t update(uint64_t off, uint64_t len, uint64_t limit);
+
+  /// Forget all streams, e.g. when the cache was dropped
+  void reset();
+
+  /// Counts since the last call
+  stats_t take_stats();
+};
+
+#endif
@@ -26,12 +26,70 @@
 #define dout_prefix *_dout << "striper "
 
 
+/*
+ * Object names are almost always a fixed prefix and a zero padded hex
+ * object number ("<prefix>%0<width>llx"); render those directly rather
+ * than going through snprintf for every extent.
+ */
+class ObjectNamer {
+  const char *format;
+  size_t prefix_len;
+  int width;      ///< -1 if the format is not of the simple kind
+
+public:
+  explicit ObjectNamer(const char *f) : format(f), prefix_len(0), width(-1) {
+    const char *pct = strchr(f, '%');
+    if (!pct || strchr(pct + 1, '%'))
+      return;
+    const char *p = pct + 1;
+    if (*p != '0')
+      return;
+    int w = 0;
+    for (++p; *p >= '0' && *p <= '9'; ++p)
+      w = w * 10 + (*p - '0');
+    if (strcmp(p, "llx") != 0 || w < 1 || w > 16)
+      return;
+    prefix_len = pct - f;
+    width = w;
+  }
+
+  object_t name(uint64_t objectno) const {
+    if (width < 0) {
+      char buf[strlen(format) + 32];
+      snprintf(buf, sizeof(buf), format, (long long unsigned)objectno);
+      return object_t(buf);
+    }
+    static const char hex[] = "0123456789abcdef";
+    char digits[16];
+    int n = 0;
+    do {
+      digits[n++] = hex[objectno & 0xf];
+      objectno >>= 4;
+    } while (objectno);
+    string s;
+    s.reserve(prefix_len + MAX(n, width));
+    s.append(format, prefix_len);
+    if (n < width)
+      s.append(width - n, '0');
+    while (n > 0)
+      s.push_back(digits[--n]);
+    return object_t(s);
+  }
+};
+
+
 void Striper::file_to_extents(CephContext *cct, const char *object_format,
 			    ceph_file_layout *layout,
 			    uint64_t offset, uint64_t len, uint64_t trunc_size,
 			    vector<ObjectExtent>& extents,
 			    uint64_t buffer_offset)
 {
+  if (layout->fl_stripe_count == 1) {
+    unstriped_to_extents(cct, object_format, layout, offset, len, trunc_size,
+			 extents, buffer_offset);
+    return;
+  }
+
   map<object_t,vector<ObjectExtent> > object_extents;
   file_to_extents(cct, object_format, layout, offset, len, trunc_size,
 		  object_extents, buffer_offset);
@@ -63,6 +121,7 @@ void Striper::file_to_extents(CephContext *cct, const char *object_format,
   ldout(cct, 20) << " su " << su << " sc " << stripe_count << " os " << object_size
 		 << " stripes_per_object " << stripes_per_object << dendl;
 
+  ObjectNamer namer(object_format);
   uint64_t cur = offset;
   uint64_t left = len;
   while (left > 0) {
@@ -74,9 +133,7 @@ void Striper::file_to_extents(CephContext *cct, const char *object_format,
     uint64_t objectno = objectsetno * stripe_count + stripepos;  // object id
 
     // find oid, extent
-    char buf[strlen(object_format) + 32];
-    snprintf(buf, sizeof(buf), object_format, (long long unsigned)objectno);
-    object_t oid = buf;
+    object_t oid = namer.name(objectno);
 
     // map range into object
     uint64_t block_start = (stripeno % stripes_per_object) * su;
@@ -128,6 +185,54 @@ void Striper::file_to_extents(CephContext *cct, const char *object_format,
   }
 }
 
+/*
+ * With a single stripe each object holds one contiguous piece of the
+ * file, so the extents come out one per object in object order (which
+ * for zero padded names is also the order the general case sorts them
+ * into).  Build them in place, without the per-object map.
+ */
+void Striper::unstriped_to_extents(CephContext *cct, const char *object_format,
+				   ceph_file_layout *layout,
+				   uint64_t offset, uint64_t len,
+				   uint64_t trunc_size,
+				   vector<ObjectExtent>& extents,
+				   uint64_t buffer_offset)
+{
+  ldout(cct, 10) << "file_to_extents " << offset << "~" << len
+		 << " format " << object_format
+		 << dendl;
+  assert(len > 0);
+
+  __u32 su = layout->fl_stripe_unit;
+  assert(layout->fl_object_size >= su);
+  uint64_t period = (uint64_t)(layout->fl_object_size / su) * su;
+  ObjectNamer namer(object_format);
+  object_locator_t oloc = OSDMap::file_to_object_locator(*layout);
+
+  uint64_t first = offset / period;
+  uint64_t last = (offset + len - 1) / period;
+  extents.reserve(extents.size() + last - first + 1);
+
+  uint64_t cur = offset;
+  uint64_t left = len;
+  for (uint64_t objectno = first; objectno <= last; ++objectno) {
+    uint64_t x_offset = cur - objectno * period;
+    uint64_t x_len = MIN(left, period - x_offset);
+
+    extents.push_back(ObjectExtent(namer.name(objectno), objectno,
+				   x_offset, x_len,
+				   object_truncate_size(cct, layout, objectno,
+							trunc_size)));
+    ObjectExtent& ex = extents.back();
+    ex.oloc = oloc;
+    ex.buffer_extents.push_back(make_pair(cur - offset + buffer_offset, x_len));
+    ldout(cct, 20) << " added new " << ex << dendl;
+
+    left -= x_len;
+    cur += x_len;
+  }
+}
+
 void Striper::assimilate_extents(map<object_t,vector<ObjectExtent> >& object_extents,
 				 vector<ObjectExtent>& extents)
 {
@@ -51,6 +51,14 @@ class CephContext;
       file_to_extents(cct, buf, layout, offset, len, trunc_size, extents);
     }
 
+    /// file_to_extents for a layout with a stripe_count of 1
+    static void unstriped_to_extents(CephContext *cct, const char *object_format,
+				     ceph_file_layout *layout,
+				     uint64_t offset, uint64_t len,
+				     uint64_t trunc_size,
+				     vector<ObjectExtent>& extents,
+				     uint64_t buffer_offset=0);
+
     static void assimilate_extents(map<object_t,vector<ObjectExtent> >& object_extents,
 				   vector<ObjectExtent>& extents);
 
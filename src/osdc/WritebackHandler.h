@@ -32,6 +32,22 @@ class WritebackHandler {
 		      uint64_t off, uint64_t len, const SnapContext& snapc,
 		      const bufferlist &bl, utime_t mtime, uint64_t trunc_size,
 		      __u32 trunc_seq, Context *oncommit) = 0;
+  /**
+   * write several extents of one object with a single op
+   *
+   * They are applied and committed together, under one tid.  Only
+   * called if can_write_extents().
+   *
+   * @param extents (offset, data) pairs, sorted and not overlapping
+   */
+  virtual bool can_write_extents() { return false; }
+  virtual tid_t write_extents(const object_t& oid, const object_locator_t& oloc,
+			      const vector<pair<uint64_t, bufferlist> >& extents,
+			      const SnapContext& snapc, utime_t mtime,
+			      uint64_t trunc_size, __u32 trunc_seq,
+			      Context *oncommit) {
+    assert(0 == "this WritebackHandler does not support write_extents");
+  }
   virtual tid_t lock(const object_t& oid, const object_locator_t& oloc, int op,
 		     int flags, Context *onack, Context *oncommit) {
     assert(0 == "this WritebackHandler does not support the lock operation");
@@ -179,6 +179,23 @@ def run_in_thread(target, args, timeout=0):
         t.retval = -errno.EINTR
     return t.retval
 
+def c_buffer(buf):
+    """
+    A ctypes array over the memory of a writable buffer, without copying
+
+    :param buf: where the data should go
+    :type buf: bytearray, mmap, writable memoryview or ctypes array
+
+    :raises: :class:`TypeError`
+    """
+    size = getattr(buf, 'nbytes', None)
+    if size is None:
+        size = len(buf)
+    try:
+        return (c_char * size).from_buffer(buf)
+    except TypeError:
+        raise TypeError('buffer must be writable, e.g. a bytearray')
+
 class Rados(object):
     """librados python wrapper"""
     def require_state(self, *args):
@@ -829,8 +846,11 @@ class Completion(object):
         self.oncomplete = oncomplete
         self.onsafe = onsafe
         self.ioctx = ioctx
+        # whatever librados writes into or reads from until the
+        # operation is done
+        self.buf = None
 
-    def wait_for_safe(self):
+    def is_safe(self):
         """
         Is an asynchronous operation safe?
 
@@ -838,19 +858,37 @@ class Completion(object):
 
         :returns: whether the operation is safe
         """
-        return run_in_thread(self.ioctx.librados.rados_aio_is_safe,
-                             (self.rados_comp,))
+        return self.ioctx.librados.rados_aio_is_safe(self.rados_comp)
 
-    def wait_for_complete(self):
+    def is_complete(self):
         """
         Has an asynchronous operation completed?
 
-        This does not imply that the safe callback has finished.
+        This does not imply that the complete callback has finished.
 
-        :returns:  whether the operation is completed
+        :returns: whether the operation is completed
         """
-        return run_in_thread(self.ioctx.librados.rados_aio_is_complete,
-                             (self.rados_comp,))
+        return self.ioctx.librados.rados_aio_is_complete(self.rados_comp)
+
+    # these never waited; kept for existing callers
+    wait_for_safe = is_safe
+    wait_for_complete = is_complete
+
+    def wait_for_safe_and_cb(self):
+        """
+        Block until an asynchronous operation is safe and its safe
+        callback has returned
+        """
+        run_in_thread(self.ioctx.librados.rados_aio_wait_for_safe_and_cb,
+                      (self.rados_comp,))
+
+    def wait_for_complete_and_cb(self):
+        """
+        Block until an asynchronous operation is complete and its
+        complete callback has returned
+        """
+        run_in_thread(self.ioctx.librados.rados_aio_wait_for_complete_and_cb,
+                      (self.rados_comp,))
 
     def get_return_value(self):
         """
@@ -861,8 +899,7 @@ class Completion(object):
 
         :returns: int - return value of the operation
         """
-        return run_in_thread(self.ioctx.librados.rados_aio_get_return_value,
-                             (self.rados_comp,))
+        return self.ioctx.librados.rados_aio_get_return_value(self.rados_comp)
 
     def __del__(self):
         """ 
@@ -871,8 +908,95 @@ class Completion(object):
         Call this when you no longer need the completion. It may not be
         freed immediately if the operation is not acked and committed.
         """
-        run_in_thread(self.ioctx.librados.rados_aio_release,
-                      (self.rados_comp,))
+        self.ioctx.librados.rados_aio_release(self.rados_comp)
+
+class CompletionSet(object):
+    """
+    A set of completions to wait on together
+
+    This is how to keep a number of operations in flight from one
+    thread: add the completion of each operation started, and start
+    the next one each time :func:`wait_for_any` returns one.  The set
+    also works with select() and poll() (see :func:`fileno`), and
+    :func:`poll` collects whatever has completed without blocking.
+    """
+    def __init__(self, librados):
+        self.librados = librados
+        self.set = c_void_p()
+        self.completions = {}
+        ret = self.librados.rados_aio_create_completion_set(byref(self.set))
+        if ret < 0:
+            raise make_ex(ret, "error creating a completion set")
+
+    def __len__(self):
+        return len(self.completions)
+
+    def add(self, completion):
+        """
+        Add the completion of an operation to the set
+
+        :param completion: from one of the Ioctx.aio_* methods
+        :type completion: :class:`Completion`
+        """
+        self.completions[completion.rados_comp.value] = completion
+        self.librados.rados_aio_completion_set_add(self.set,
+                                                   completion.rados_comp)
+
+    def wait_for_any(self):
+        """
+        Block until any completion in the set is complete, and remove it
+
+        :returns: :class:`Completion` - the completion, or None if the
+            set is empty
+        """
+        comp = c_void_p()
+        ret = run_in_thread(self.librados.rados_aio_completion_set_wait_for_any,
+                            (self.set, byref(comp)))
+        if ret == -errno.ENOENT:
+            return None
+        if ret < 0:
+            raise make_ex(ret, "error waiting on a completion set")
+        return self.completions.pop(comp.value)
+
+    def poll(self, max_completions=64):
+        """
+        Remove the completions that are complete, without blocking
+
+        :param max_completions: at most this many
+        :type max_completions: int
+
+        :returns: list - the :class:`Completion` objects, in the order
+            they completed
+        """
+        comps = (c_void_p * max_completions)()
+        n = self.librados.rados_aio_completion_set_poll(self.set, comps,
+                                                        c_size_t(max_completions))
+        return [self.completions.pop(comps[i]) for i in range(n)]
+
+    def fileno(self):
+        """
+        A file descriptor that polls readable while there are completed
+        completions for :func:`poll` to return
+
+        Do not read from or close it.
+        """
+        ret = self.librados.rados_aio_completion_set_get_fd(self.set)
+        if ret < 0:
+            raise make_ex(ret, "error getting the fd of a completion set")
+        return ret
+
+    def wait_for_all(self):
+        """
+        Block until every completion in the set is complete, and empty it
+        """
+        run_in_thread(self.librados.rados_aio_completion_set_wait_for_all,
+                      (self.set,))
+        self.completions.clear()
+
+    def __del__(self):
+        if self.set:
+            self.librados.rados_aio_completion_set_release(self.set)
+            self.set = c_void_p()
 
 class Ioctx(object):
     """rados.Ioctx object"""
@@ -942,9 +1066,9 @@ class Ioctx(object):
             complete_cb = self.__aio_complete_cb_c
         if onsafe:
             safe_cb = self.__aio_safe_cb_c
-        ret = run_in_thread(self.librados.rados_aio_create_completion,
-                            (c_void_p(0), complete_cb, safe_cb,
-                            byref(completion)))
+        ret = self.librados.rados_aio_create_completion(c_void_p(0),
+                                                        complete_cb, safe_cb,
+                                                        byref(completion))
         if ret < 0:
             raise make_ex(ret, "error getting a completion")
         with self.lock:
@@ -979,10 +1103,9 @@ class Ioctx(object):
         :returns: completion object 
         """
         completion = self.__get_completion(oncomplete, onsafe)
-        ret = run_in_thread(self.librados.rados_aio_write,
-                            (self.io, c_char_p(object_name),
-                            completion.rados_comp, c_char_p(to_write),
-                            c_size_t(len(to_write)), c_uint64(offset)))
+        ret = self.librados.rados_aio_write(self.io, c_char_p(object_name),
+                                            completion.rados_comp, c_char_p(to_write),
+                                            c_size_t(len(to_write)), c_uint64(offset))
         if ret < 0:
             raise make_ex(ret, "error writing object %s" % object_name)
         return completion
@@ -1011,10 +1134,9 @@ class Ioctx(object):
         :returns: completion object 
         """
         completion = self.__get_completion(oncomplete, onsafe)
-        ret = run_in_thread(self.librados.rados_aio_write_full,
-                            (self.io, c_char_p(object_name),
-                            completion.rados_comp, c_char_p(to_write),
-                            c_size_t(len(to_write))))
+        ret = self.librados.rados_aio_write_full(self.io, c_char_p(object_name),
+                                                 completion.rados_comp, c_char_p(to_write),
+                                                 c_size_t(len(to_write)))
         if ret < 0:
             raise make_ex(ret, "error writing object %s" % object_name)
         return completion
@@ -1042,10 +1164,9 @@ class Ioctx(object):
         :returns: completion object 
         """
         completion = self.__get_completion(oncomplete, onsafe)
-        ret = run_in_thread(self.librados.rados_aio_append,
-                            (self.io, c_char_p(object_name),
-                            completion.rados_comp, c_char_p(to_append),
-                            c_size_t(len(to_append))))
+        ret = self.librados.rados_aio_append(self.io, c_char_p(object_name),
+                                             completion.rados_comp, c_char_p(to_append),
+                                             c_size_t(len(to_append)))
         if ret < 0:
             raise make_ex(ret, "error appending to object %s" % object_name)
         return completion
@@ -1069,6 +1190,9 @@ class Ioctx(object):
 
         oncomplete(completion, data_read)
 
+        data_read is None if the read failed; the completion's return
+        value has the error.
+
         :param object_name: name of the object to read from
         :type object_name: str
         :param length: the number of bytes to read
@@ -1083,16 +1207,83 @@ class Ioctx(object):
         """
         buf = create_string_buffer(length)
         def oncomplete_(completion):
-            return oncomplete(completion, buf.value)
+            ret = completion.get_return_value()
+            data = ctypes.string_at(buf, ret) if ret >= 0 else None
+            return oncomplete(completion, data)
         completion = self.__get_completion(oncomplete_, None)
-        ret = run_in_thread(self.librados.rados_aio_read,
-                            (self.io, c_char_p(object_name),
-                            completion.rados_comp, buf, c_size_t(length),
-                            c_uint64(offset)))
+        completion.buf = buf
+        ret = self.librados.rados_aio_read(self.io, c_char_p(object_name),
+                                           completion.rados_comp, buf,
+                                           c_size_t(length), c_uint64(offset))
         if ret < 0:
             raise make_ex(ret, "error reading %s" % object_name)
         return completion
 
+    def aio_read_into(self, object_name, buf, offset=0, oncomplete=None):
+        """
+        Asychronously read data from an object into a buffer
+
+        Reads up to len(buf) bytes straight into buf, without copying.
+        buf must not be resized or freed until the read is complete.
+        The completion's return value is the number of bytes read, or
+        a negative error code.
+
+        :param object_name: name of the object to read from
+        :type object_name: str
+        :param buf: where to read to
+        :type buf: bytearray, mmap, writable memoryview or ctypes array
+        :param offset: byte offset in the object to begin reading from
+        :type offset: int
+        :param oncomplete: what to do when the read is complete,
+            called with the completion
+        :type oncomplete: completion
+
+        :raises: :class:`Error`
+        :returns: completion object
+        """
+        c_buf = c_buffer(buf)
+        completion = self.__get_completion(oncomplete, None)
+        completion.buf = (buf, c_buf)
+        ret = self.librados.rados_aio_read(self.io, c_char_p(object_name),
+                                           completion.rados_comp, c_buf,
+                                           c_size_t(len(c_buf)),
+                                           c_uint64(offset))
+        if ret < 0:
+            raise make_ex(ret, "error reading %s" % object_name)
+        return completion
+
+    def aio_remove(self, object_name, oncomplete=None, onsafe=None):
+        """
+        Asychronously remove an object
+
+        :param object_name: name of the object to remove
+        :type object_name: str
+        :param oncomplete: what to do when the remove is safe and complete in memory
+            on all replicas
+        :type oncomplete: completion
+        :param onsafe:  what to do when the remove is safe and complete on storage
+            on all replicas
+        :type onsafe: completion
+
+        :raises: :class:`Error`
+        :returns: completion object
+        """
+        completion = self.__get_completion(oncomplete, onsafe)
+        ret = self.librados.rados_aio_remove(self.io, c_char_p(object_name),
+                                             completion.rados_comp)
+        if ret < 0:
+            raise make_ex(ret, "error removing %s" % object_name)
+        return completion
+
+    def create_completion_set(self):
+        """
+        Create an empty :class:`CompletionSet` to wait on the completions
+        of several operations at once
+
+        :returns: :class:`CompletionSet`
+        """
+        return CompletionSet(self.librados)
+
     def require_ioctx_open(self):
         """
         Checks if the rados.Ioctx object state is 'open'
@@ -1255,6 +1446,34 @@ written." % (self.name, ret, length))
             raise make_ex(ret, "Ioctx.read(%s): failed to read %s" % (self.name, key))
         return ctypes.string_at(ret_buf, ret)
 
+    def read_into(self, key, buf, offset=0):
+        """
+        Read data from an object synchronously into a buffer
+
+        Reads up to len(buf) bytes straight into buf, without copying.
+
+        :param key: name of the object
+        :type key: str
+        :param buf: where to read to
+        :type buf: bytearray, mmap, writable memoryview or ctypes array
+        :param offset: byte offset in the object to begin reading at
+        :type offset: int
+
+        :raises: :class:`TypeError`
+        :raises: :class:`Error`
+        :returns: int - the number of bytes read
+        """
+        self.require_ioctx_open()
+        if not isinstance(key, str):
+            raise TypeError('key must be a string')
+        c_buf = c_buffer(buf)
+        ret = run_in_thread(self.librados.rados_read,
+                            (self.io, c_char_p(key), c_buf,
+                            c_size_t(len(c_buf)), c_uint64(offset)))
+        if ret < 0:
+            raise make_ex(ret, "Ioctx.read(%s): failed to read %s" % (self.name, key))
+        return ret
+
     def get_stats(self):
         """
         Get pool usage statistics
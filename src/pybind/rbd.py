@@ -1,8 +1,9 @@
 """
 This module is a thin wrapper around librbd.
 
-It currently provides all the synchronous methods of librbd that do
-not use callbacks.
+It provides the synchronous methods of librbd, and asynchronous
+reads, writes, discards and flushes of images with completion
+callbacks (see :class:`Completion`).
 
 Error codes from librbd are turned into exceptions that subclass
 :class:`Error`. Almost all methods may raise :class:`Error`
@@ -19,8 +20,10 @@ from ctypes import CDLL, c_char, c_char_p, c_size_t, c_void_p, c_int, \
     create_string_buffer, byref, Structure, c_uint64, c_int64, c_uint8, \
     CFUNCTYPE
 from ctypes.util import find_library
+from rados import c_buffer
 import ctypes
 import errno
+import threading
 
 ANONYMOUS_AUID = 0xffffffffffffffff
 ADMIN_AUID = 0
@@ -343,6 +346,11 @@ class Image(object):
         self.librbd = load_librbd()
         self.image = c_void_p()
         self.name = name
+        # completions of operations in flight, by their rbd_completion_t
+        self.pending = {}
+        self.lock = threading.Lock()
+        RBD_CB = CFUNCTYPE(None, c_void_p, c_void_p)
+        self.__aio_cb_c = RBD_CB(self.__aio_cb)
         if not isinstance(name, str):
             raise TypeError('name must be a string')
         if snapshot is not None and not isinstance(snapshot, str):
@@ -639,6 +647,169 @@ class Image(object):
             raise make_ex(ret, 'error reading %s %ld~%ld' % (self.image, offset, length))
         return ctypes.string_at(ret_buf, ret)
 
+    def __aio_cb(self, rbd_comp, _):
+        """
+        Callback from librbd when an asynchronous operation is complete
+        """
+        with self.lock:
+            completion = self.pending.pop(rbd_comp)
+        if completion.oncomplete:
+            completion.oncomplete(completion)
+
+    def __get_completion(self, oncomplete):
+        """
+        Create the completion for an asynchronous operation
+
+        It stays in self.pending, and so does whatever buffer it
+        holds, until librbd is done with the operation.
+        """
+        completion = Completion(self, oncomplete)
+        ret = self.librbd.rbd_aio_create_completion(c_void_p(0),
+                                                    self.__aio_cb_c,
+                                                    byref(completion.rbd_comp))
+        if ret < 0:
+            raise make_ex(ret, 'error creating a completion')
+        with self.lock:
+            self.pending[completion.rbd_comp.value] = completion
+        return completion
+
+    def __aio_submitted(self, completion, ret, msg):
+        """
+        Forget the completion of an operation that could not be started
+        """
+        if ret < 0:
+            with self.lock:
+                del self.pending[completion.rbd_comp.value]
+            raise make_ex(ret, msg)
+        return completion
+
+    def aio_read(self, offset, length, oncomplete):
+        """
+        Asynchronously read data from the image
+
+        oncomplete is called with the completion and the data read, or
+        None if the read failed; the completion's return value has the
+        error then.
+
+        oncomplete(completion, data_read)
+
+        :param offset: the offset to start reading at
+        :type offset: int
+        :param length: how many bytes to read
+        :type length: int
+        :param oncomplete: what to do when the read is complete
+        :type oncomplete: completion
+        :returns: :class:`Completion` - the completion object
+        :raises: :class:`Error`
+        """
+        buf = create_string_buffer(length)
+        def oncomplete_(completion):
+            ret = completion.get_return_value()
+            data = ctypes.string_at(buf, ret) if ret >= 0 else None
+            return oncomplete(completion, data)
+        completion = self.__get_completion(oncomplete_)
+        completion.buf = buf
+        ret = self.librbd.rbd_aio_read(self.image, c_uint64(offset),
+                                       c_size_t(length), buf,
+                                       completion.rbd_comp)
+        return self.__aio_submitted(completion, ret,
+                                    'error reading %s %ld~%ld' %
+                                    (self.name, offset, length))
+
+    def aio_read_into(self, offset, buf, oncomplete=None):
+        """
+        Asynchronously read data from the image into a buffer
+
+        Reads len(buf) bytes straight into buf, without copying. buf
+        must not be resized or freed until the read is complete. The
+        completion's return value is the number of bytes read, or a
+        negative error code.
+
+        :param offset: the offset to start reading at
+        :type offset: int
+        :param buf: where to read to
+        :type buf: bytearray, mmap, writable memoryview or ctypes array
+        :param oncomplete: what to do when the read is complete, called
+            with the completion
+        :type oncomplete: completion
+        :returns: :class:`Completion` - the completion object
+        :raises: :class:`TypeError`, :class:`Error`
+        """
+        c_buf = c_buffer(buf)
+        completion = self.__get_completion(oncomplete)
+        completion.buf = (buf, c_buf)
+        ret = self.librbd.rbd_aio_read(self.image, c_uint64(offset),
+                                       c_size_t(len(c_buf)), c_buf,
+                                       completion.rbd_comp)
+        return self.__aio_submitted(completion, ret,
+                                    'error reading %s %ld~%ld' %
+                                    (self.name, offset, len(c_buf)))
+
+    def aio_write(self, data, offset, oncomplete=None):
+        """
+        Asynchronously write data to the image
+
+        The completion's return value is the number of bytes written,
+        or a negative error code.
+
+        :param data: the data to be written
+        :type data: str
+        :param offset: where to start writing data
+        :type offset: int
+        :param oncomplete: what to do when the write is complete, called
+            with the completion
+        :type oncomplete: completion
+        :returns: :class:`Completion` - the completion object
+        :raises: :class:`TypeError`, :class:`Error`
+        """
+        if not isinstance(data, str):
+            raise TypeError('data must be a string')
+        completion = self.__get_completion(oncomplete)
+        completion.buf = data
+        ret = self.librbd.rbd_aio_write(self.image, c_uint64(offset),
+                                        c_size_t(len(data)), c_char_p(data),
+                                        completion.rbd_comp)
+        return self.__aio_submitted(completion, ret,
+                                    'error writing to %s' % (self.name,))
+
+    def aio_discard(self, offset, length, oncomplete=None):
+        """
+        Asynchronously trim the range from the image. It will be
+        logically filled with zeroes.
+
+        :param offset: the offset to start trimming at
+        :type offset: int
+        :param length: how many bytes to trim
+        :type length: int
+        :param oncomplete: what to do when the discard is complete,
+            called with the completion
+        :type oncomplete: completion
+        :returns: :class:`Completion` - the completion object
+        :raises: :class:`Error`
+        """
+        completion = self.__get_completion(oncomplete)
+        ret = self.librbd.rbd_aio_discard(self.image, c_uint64(offset),
+                                          c_uint64(length),
+                                          completion.rbd_comp)
+        return self.__aio_submitted(completion, ret,
+                                    'error discarding region %d~%d' %
+                                    (offset, length))
+
+    def aio_flush(self, oncomplete=None):
+        """
+        Asynchronously flush the writes started so far, if caching is
+        enabled
+
+        :param oncomplete: what to do when the flush is complete, called
+            with the completion
+        :type oncomplete: completion
+        :returns: :class:`Completion` - the completion object
+        :raises: :class:`Error`
+        """
+        completion = self.__get_completion(oncomplete)
+        ret = self.librbd.rbd_aio_flush(self.image, completion.rbd_comp)
+        return self.__aio_submitted(completion, ret, 'error flushing image')
+
     def diff_iterate(self, offset, length, from_snapshot, iterate_cb):
         """
         Iterate over the changed extents of an image.
@@ -897,6 +1068,48 @@ written." % (self.name, ret, length))
         if ret < 0:
             raise make_ex(ret, 'error unlocking image')
 
+class Completion(object):
+    """
+    An asynchronous operation on an :class:`Image`
+
+    Close the image only once its operations are complete.
+    """
+    def __init__(self, image, oncomplete):
+        self.image = image
+        self.oncomplete = oncomplete
+        self.rbd_comp = c_void_p()
+        # whatever librbd writes into or reads from until the
+        # operation is done
+        self.buf = None
+
+    def is_complete(self):
+        """
+        Has the operation completed?
+
+        :returns: bool - whether the operation is complete
+        """
+        return self.image.librbd.rbd_aio_is_complete(self.rbd_comp) == 1
+
+    def wait_for_complete(self):
+        """
+        Block until the operation is complete and its callback has
+        returned
+        """
+        self.image.librbd.rbd_aio_wait_for_complete(self.rbd_comp)
+
+    def get_return_value(self):
+        """
+        Get the return value of the operation, once it is complete
+
+        :returns: int - the bytes read or written, 0, or a negative
+            error code
+        """
+        return self.image.librbd.rbd_aio_get_return_value(self.rbd_comp)
+
+    def __del__(self):
+        if self.rbd_comp:
+            self.image.librbd.rbd_aio_release(self.rbd_comp)
+
 class DiffIterateCB(object):
     def __init__(self, cb):
         self.cb = cb
@@ -68,6 +68,7 @@ static string dir_info_oid = RBD_INFO;
 bool udevadm_settle = true;
 bool progress = true;
 bool resize_allow_shrink = false;
+bool whole_object = false;
 bool read_only = false;
 
 #define dout_subsys ceph_subsys_rbd
@@ -144,6 +145,15 @@ void usage()
 "  --image-format <format-number>     format to use when creating an image\n"
 "                                     format 1 is the original format (default)\n"
 "                                     format 2 supports cloning\n"
+"  --object-map                       keep a map of which objects exist, when\n"
+"                                     creating a format 2 image or a clone\n"
+"  --fast-diff                        also keep maps of which objects changed\n"
+"                                     between snapshots (implies --object-map)\n"
+"  --exclusive-lock                   let only one client at a time write to a\n"
+"                                     format 2 image or a clone, handing over\n"
+"                                     the lock when another wants to write\n"
+"  --whole-object                     diff and export-diff may report changes\n"
+"                                     as whole objects, if that is faster\n"
 "  --id <username>                    rados user (without 'client.'prefix) to\n"
 "                                     authenticate as\n"
 "  --keyfile <path>                   file containing secret key for use with cephx\n"
@@ -163,6 +173,12 @@ static string feature_str(uint64_t feature)
     return "layering";
   case RBD_FEATURE_STRIPINGV2:
     return "striping";
+  case RBD_FEATURE_OBJECT_MAP:
+    return "object-map";
+  case RBD_FEATURE_FAST_DIFF:
+    return "fast-diff";
+  case RBD_FEATURE_EXCLUSIVE_LOCK:
+    return "exclusive-lock";
   default:
     return "";
   }
@@ -172,7 +188,7 @@ static string features_str(uint64_t features)
 {
   string s = "";
 
-  for (uint64_t feature = 1; feature <= RBD_FEATURE_STRIPINGV2;
+  for (uint64_t feature = 1; feature <= RBD_FEATURE_EXCLUSIVE_LOCK;
        feature <<= 1) {
     if (feature & features) {
       if (s.size())
@@ -186,7 +202,7 @@ static string features_str(uint64_t features)
 static void format_features(Formatter *f, uint64_t features)
 {
   f->open_array_section("features");
-  for (uint64_t feature = 1; feature <= RBD_FEATURE_STRIPINGV2;
+  for (uint64_t feature = 1; feature <= RBD_FEATURE_EXCLUSIVE_LOCK;
        feature <<= 1) {
     f->dump_string("feature", feature_str(feature));
   }
@@ -196,8 +212,11 @@ static void format_features(Formatter *f, uint64_t features)
 struct MyProgressContext : public librbd::ProgressContext {
   const char *operation;
   int last_pc;
+  bool bytes;		// progress is in bytes, so show the rate too
+  utime_t start;
 
-  MyProgressContext(const char *o) : operation(o), last_pc(0) {
+  MyProgressContext(const char *o, bool b = false)
+    : operation(o), last_pc(0), bytes(b), start(ceph_clock_now(NULL)) {
   }
 
   int update_progress(uint64_t offset, uint64_t total) {
@@ -207,6 +226,9 @@ struct MyProgressContext : public librbd::ProgressContext {
 	cerr << "\r" << operation << ": "
 	  //	   << offset << " / " << total << " "
 	     << pc << "% complete...";
+	double elapsed = ceph_clock_now(NULL) - start;
+	if (bytes && elapsed > 0)
+	  cerr << " " << prettybyte_t(offset / elapsed) << "/s    ";
 	cerr.flush();
 	last_pc = pc;
       }
@@ -955,7 +977,7 @@ struct ExportContext {
     image(i),
     fd(f),
     totalsize(t),
-    pc("Exporting image")
+    pc("Exporting image", true)
   {}
 };
 
@@ -1132,7 +1154,8 @@ static int do_export_diff(librbd::Image& image, const char *fromsnapname,
   }
 
   ExportContext ec(&image, fd, info.size);
-  r = image.diff_iterate(fromsnapname, 0, info.size, export_diff_cb, (void *)&ec);
+  r = image.diff_iterate2(fromsnapname, 0, info.size, whole_object,
+			  export_diff_cb, (void *)&ec);
   if (r < 0)
     goto out;
 
@@ -1197,7 +1220,8 @@ static int do_diff(librbd::Image& image, const char *fromsnapname,
     om.t->define_column("Type", TextTable::LEFT, TextTable::LEFT);
   }
 
-  r = image.diff_iterate(fromsnapname, 0, info.size, diff_cb, &om);
+  r = image.diff_iterate2(fromsnapname, 0, info.size, whole_object,
+			  diff_cb, &om);
   if (f) {
     f->close_section();
     f->flush(cout);
@@ -1265,13 +1289,25 @@ done_img:
   update_snap_name(*new_img, snap);
 }
 
+static int wait_for_write(std::list<librbd::RBD::AioCompletion*> &writes)
+{
+  librbd::RBD::AioCompletion *comp = writes.front();
+  writes.pop_front();
+  comp->wait_for_complete();
+  int r = comp->get_return_value();
+  comp->release();
+  if (r < 0)
+    cerr << "rbd: error writing to image: " << cpp_strerror(r) << std::endl;
+  return r;
+}
+
 static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
 		     const char *imgname, int *order, const char *path,
 		     int format, uint64_t features, uint64_t size)
 {
   int fd, r;
   struct stat stat_buf;
-  MyProgressContext pc("Importing image");
+  MyProgressContext pc("Importing image", true);
 
   assert(imgname);
 
@@ -1287,6 +1323,9 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
   ssize_t readlen;		// amount received from one read
   size_t blklen = 0;		// amount accumulated from reads to fill blk
   librbd::Image image;
+  // writes in flight, oldest first
+  std::list<librbd::RBD::AioCompletion*> writes;
+  size_t max_writes = MAX(1, g_conf->rbd_concurrent_management_ops);
 
   bool from_stdin = !strcmp(path, "-");
   if (from_stdin) {
@@ -1360,12 +1399,21 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     // write as much as we got; perhaps less than imgblklen
     // but skip writing zeros to create sparse images
     if (!bl.is_zero()) {
-      r = image.write(image_pos, blklen, bl);
+      if (writes.size() >= max_writes) {
+	r = wait_for_write(writes);
+	if (r < 0)
+	  goto done;
+      }
+      librbd::RBD::AioCompletion *comp =
+	new librbd::RBD::AioCompletion(NULL, NULL);
+      r = image.aio_write(image_pos, blklen, bl, comp);
       if (r < 0) {
+	comp->release();
 	cerr << "rbd: error writing to image position " << image_pos
 	     << std::endl;
 	goto done;
       }
+      writes.push_back(comp);
     }
     // done with whole block, whether written or not
     image_pos += blklen;
@@ -1375,6 +1423,11 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     blklen = 0;
     reqlen = imgblklen;
   }
+  while (!writes.empty()) {
+    r = wait_for_write(writes);
+    if (r < 0)
+      goto done;
+  }
   if (from_stdin) {
     r = image.resize(image_pos);
     if (r < 0) {
@@ -1386,6 +1439,8 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
   r = 0;
 
  done:
+  while (!writes.empty())
+    wait_for_write(writes);
   if (!from_stdin) {
     if (r < 0)
       pc.fail();
@@ -1572,7 +1627,7 @@ static int do_import_diff(librbd::Image &image, const char *path)
 static int do_copy(librbd::Image &src, librados::IoCtx& dest_pp,
 		   const char *destname)
 {
-  MyProgressContext pc("Image copy");
+  MyProgressContext pc("Image copy", true);
   int r = src.copy_with_progress(dest_pp, destname, pc);
   if (r < 0){
     pc.fail();
@@ -2213,6 +2268,14 @@ int main(int argc, const char **argv)
       progress = false;
     } else if (ceph_argparse_flag(args, i , "--allow-shrink", (char *)NULL)) {
       resize_allow_shrink = true;
+    } else if (ceph_argparse_flag(args, i, "--object-map", (char *)NULL)) {
+      features |= RBD_FEATURE_OBJECT_MAP;
+    } else if (ceph_argparse_flag(args, i, "--fast-diff", (char *)NULL)) {
+      features |= RBD_FEATURE_OBJECT_MAP | RBD_FEATURE_FAST_DIFF;
+    } else if (ceph_argparse_flag(args, i, "--exclusive-lock", (char *)NULL)) {
+      features |= RBD_FEATURE_EXCLUSIVE_LOCK;
+    } else if (ceph_argparse_flag(args, i, "--whole-object", (char *)NULL)) {
+      whole_object = true;
     } else if (ceph_argparse_witharg(args, i, &val, "--format", (char *) NULL)) {
       std::string err;
       long long ret = strict_strtoll(val.c_str(), 10, &err);
@@ -2361,6 +2424,27 @@ if (!set_conf_param(v, p1, p2, p3)) { \
     }
   }
 
+  if (features & (RBD_FEATURE_OBJECT_MAP | RBD_FEATURE_EXCLUSIVE_LOCK)) {
+    if (opt_cmd != OPT_IMPORT && opt_cmd != OPT_CREATE &&
+	opt_cmd != OPT_CLONE) {
+      cerr << "rbd: --object-map, --fast-diff and --exclusive-lock can only "
+	   << "be used when creating, importing or cloning an image"
+	   << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (opt_cmd != OPT_CLONE && format != 2) {
+      cerr << "rbd: --object-map, --fast-diff and --exclusive-lock require "
+	   << "--image-format 2" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (whole_object && opt_cmd != OPT_DIFF && opt_cmd != OPT_EXPORT_DIFF) {
+    cerr << "rbd: only the diff and export-diff commands use --whole-object"
+	 << std::endl;
+    return EXIT_FAILURE;
+  }
+
   if (opt_cmd == OPT_EXPORT && !imgname) {
     cerr << "rbd: image name was not specified" << std::endl;
     return EXIT_FAILURE;
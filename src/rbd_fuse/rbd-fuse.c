@@ -26,6 +26,8 @@ rados_t cluster;
 rados_ioctx_t ioctx;
 
 static pthread_mutex_t readdir_lock;
+// protects opentbl[], and the size of open images when resizing
+static pthread_mutex_t opentbl_lock;
 
 struct rbd_stat {
 	u_char valid;
@@ -51,6 +53,12 @@ struct rbd_openimage {
 #define MAX_RBD_IMAGES		128
 struct rbd_openimage opentbl[MAX_RBD_IMAGES];
 
+// largest read or write fuse passes down in one request
+#define RBDFS_MAX_IO		(4 << 20)
+#define RBDFS_MAX_IO_STR	"4194304"
+// aio requests in flight per read or write
+#define RBDFS_MAX_AIO		64
+
 struct rbd_options rbd_options = {"/etc/ceph/ceph.conf", "rbd"};
 
 #define rbdsize(fd)	opentbl[fd].rbd_stat.rbd_info.size
@@ -145,6 +153,12 @@ open_rbd_image(const char *image_name)
 	if (im == NULL)
 		return -1;
 
+	/*
+	 * Images stay open once opened, so all threads share one handle
+	 * per image and its cache, and open() costs nothing after the
+	 * first time.
+	 */
+	pthread_mutex_lock(&opentbl_lock);
 	/* find in opentbl[] entry if already open */
 	if ((fd = find_openrbd(image_name)) != -1) {
 		rbd = &opentbl[fd];
@@ -155,21 +169,25 @@ open_rbd_image(const char *image_name)
 			if (opentbl[i].image == NULL) {
 				fd = i;
 				rbd = &opentbl[fd];
-				rbd->image_name = strdup(image_name);
 				break;
 			}
 		}
-		if (i == MAX_RBD_IMAGES)
+		if (i == MAX_RBD_IMAGES) {
+			pthread_mutex_unlock(&opentbl_lock);
 			return -1;
-		int ret = rbd_open(ioctx, rbd->image_name, &(rbd->image), NULL);
+		}
+		int ret = rbd_open(ioctx, image_name, &(rbd->image), NULL);
 		if (ret < 0) {
+			pthread_mutex_unlock(&opentbl_lock);
 			simple_err("open_rbd_image: can't open: ", ret);
 			return ret;
 		}
+		rbd->image_name = strdup(image_name);
 	}
 	rbd_stat(rbd->image, &(rbd->rbd_stat.rbd_info),
 		 sizeof(rbd_image_info_t));
 	rbd->rbd_stat.valid = 1;
+	pthread_mutex_unlock(&opentbl_lock);
 	return fd;
 }
 
@@ -279,71 +297,135 @@ static int rbdfs_open(const char *path, struct fuse_file_info *fi)
 	return 0;
 }
 
+/*
+ * Read or write size bytes at offset in pieces of at most one object,
+ * with up to RBDFS_MAX_AIO of them in flight at once, rather than one
+ * synchronous request at a time.
+ *
+ * Returns the bytes transferred, or -errno if nothing was.
+ */
+static ssize_t rbdfs_aio(struct rbd_openimage *rbd, int write, char *buf,
+			 size_t size, off_t offset)
+{
+	rbd_completion_t comps[RBDFS_MAX_AIO];
+	size_t lens[RBDFS_MAX_AIO];
+	uint64_t obj_size = rbd->rbd_stat.rbd_info.obj_size;
+	ssize_t done = 0;
+	int err = 0, eof = 0;
+
+	if (obj_size == 0)
+		obj_size = 1 << 22;
+
+	while (size > 0 && !err && !eof) {
+		int n, i, r;
+
+		for (n = 0; n < RBDFS_MAX_AIO && size > 0; n++) {
+			size_t len = obj_size - offset % obj_size;
+			if (len > size)
+				len = size;
+
+			r = rbd_aio_create_completion(NULL, NULL, &comps[n]);
+			if (r < 0) {
+				err = r;
+				break;
+			}
+			if (write)
+				r = rbd_aio_write(rbd->image, offset, len, buf,
+						  comps[n]);
+			else
+				r = rbd_aio_read(rbd->image, offset, len, buf,
+						 comps[n]);
+			if (r < 0) {
+				rbd_aio_release(comps[n]);
+				err = r;
+				break;
+			}
+			lens[n] = len;
+			buf += len;
+			size -= len;
+			offset += len;
+		}
+
+		// count what was transferred up to the first short piece
+		for (i = 0; i < n; i++) {
+			ssize_t ret;
+
+			rbd_aio_wait_for_complete(comps[i]);
+			ret = rbd_aio_get_return_value(comps[i]);
+			rbd_aio_release(comps[i]);
+			if (err || eof)
+				continue;
+			if (ret < 0) {
+				err = ret;
+			} else {
+				// reads report the bytes read, writes 0
+				if (write)
+					ret = lens[i];
+				done += ret;
+				if ((size_t)ret < lens[i])
+					eof = 1;
+			}
+		}
+	}
+
+	if (done == 0 && err)
+		return err;
+	return done;
+}
+
 static int rbdfs_read(const char *path, char *buf, size_t size,
 			off_t offset, struct fuse_file_info *fi)
 {
-	size_t numread;
 	struct rbd_openimage *rbd;
+	uint64_t image_size;
+	int r;
 
 	if (!gotrados)
 		return -ENXIO;
 
 	rbd = &opentbl[fi->fh];
-	numread = 0;
-	while (size > 0) {
-		ssize_t ret;
 
-		ret = rbd_read(rbd->image, offset, size, buf);
-
-		if (ret <= 0)
-			break;
-		buf += ret;
-		size -= ret;
-		offset += ret;
-		numread += ret;
-	}
+	// librbd refuses reads that start past the end of the image
+	r = rbd_get_size(rbd->image, &image_size);
+	if (r < 0)
+		return r;
+	if ((uint64_t)offset >= image_size)
+		return 0;
+	if (offset + size > image_size)
+		size = image_size - offset;
 
-	return numread;
+	return rbdfs_aio(rbd, 0, buf, size, offset);
 }
 
 static int rbdfs_write(const char *path, const char *buf, size_t size,
 			 off_t offset, struct fuse_file_info *fi)
 {
-	size_t numwritten;
 	struct rbd_openimage *rbd;
 
 	if (!gotrados)
 		return -ENXIO;
 
 	rbd = &opentbl[fi->fh];
-	numwritten = 0;
-	while (size > 0) {
-		ssize_t ret;
 
+	if (offset + size > rbdsize(fi->fh)) {
+		int r = 0;
+
+		// concurrent writes past the end only ever grow the image
+		pthread_mutex_lock(&opentbl_lock);
 		if (offset + size > rbdsize(fi->fh)) {
-			int r;
 			fprintf(stderr, "rbdfs_write resizing %s to 0x%"PRIxMAX"\n",
 				path, offset+size);
 			r = rbd_resize(rbd->image, offset+size);
-			if (r < 0)
-				return r;
-
-			r = rbd_stat(rbd->image, &(rbd->rbd_stat.rbd_info),
-				 sizeof(rbd_image_info_t));
-			if (r < 0)
-				return r;
+			if (r >= 0)
+				r = rbd_stat(rbd->image, &(rbd->rbd_stat.rbd_info),
+					     sizeof(rbd_image_info_t));
 		}
-		ret = rbd_write(rbd->image, offset, size, buf);
-
-		if (ret < 0)
-			break;
-		buf += ret;
-		size -= ret;
-		offset += ret;
-		numwritten += ret;
+		pthread_mutex_unlock(&opentbl_lock);
+		if (r < 0)
+			return r;
 	}
 
-	return numwritten;
+	return rbdfs_aio(rbd, 1, (char *)buf, size, offset);
 }
 
 static void rbdfs_statfs_image_cb(void *num, const char *image)
@@ -465,6 +547,9 @@ rbdfs_init(struct fuse_conn_info *conn)
 #if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 8)
 	conn->want |= FUSE_CAP_BIG_WRITES;
 #endif
+	// libfuse and the kernel cap these at what they support
+	conn->max_write = RBDFS_MAX_IO;
+	conn->max_readahead = RBDFS_MAX_IO;
 	gotrados = 1;
 
 	// init's return value shows up in fuse_context.private_data,
@@ -494,14 +579,19 @@ rbdfs_utime(const char *path, struct utimbuf *utime)
 int
 rbdfs_unlink(const char *path)
 {
-	int fd = find_openrbd(path);
+	int fd;
+
+	pthread_mutex_lock(&opentbl_lock);
+	fd = find_openrbd(path+1);
 	if (fd != -1) {
 		struct rbd_openimage *rbd = &opentbl[fd];
 		rbd_close(rbd->image);
 		rbd->image = 0;
 		free(rbd->image_name);
+		rbd->image_name = NULL;
 		rbd->rbd_stat.valid = 0;
 	}
+	pthread_mutex_unlock(&opentbl_lock);
 	return rbd_remove(ioctx, path+1);
 }
 
@@ -518,12 +608,12 @@ rbdfs_truncate(const char *path, off_t size)
 
 	rbd = &opentbl[fd];
 	fprintf(stderr, "truncate %s to %"PRIdMAX" (0x%"PRIxMAX")\n", path, size, size);
+	pthread_mutex_lock(&opentbl_lock);
 	r = rbd_resize(rbd->image, size);
-	if (r < 0)
-		return r;
-
-	r = rbd_stat(rbd->image, &(rbd->rbd_stat.rbd_info),
-		 sizeof(rbd_image_info_t));
+	if (r >= 0)
+		r = rbd_stat(rbd->image, &(rbd->rbd_stat.rbd_info),
+			     sizeof(rbd_image_info_t));
+	pthread_mutex_unlock(&opentbl_lock);
 	if (r < 0)
 		return r;
 	return 0;
@@ -661,6 +751,10 @@ static void usage(const char *progname)
 "    -V   --version         print version\n"
 "    -c   --configfile      ceph configuration file [/etc/ceph/ceph.conf]\n"
 "    -p   --poolname        rados pool name [rbd]\n"
+"\n"
+"Requests are served by several threads unless fuse's -s is given.\n"
+"Use -o direct_io to bypass the page cache, so that reads reach\n"
+"rbd-fuse whole instead of in readahead sized pieces.\n"
 "\n", progname);
 }
 
@@ -747,6 +841,10 @@ int main(int argc, char *argv[])
 	}
 
 	pthread_mutex_init(&readdir_lock, NULL);
+	pthread_mutex_init(&opentbl_lock, NULL);
+
+	// let fuse hand large reads down in one request
+	fuse_opt_add_arg(&args, "-omax_read=" RBDFS_MAX_IO_STR);
 
 	return fuse_main(args.argc, args.argv, &rbdfs_oper, NULL);
 }
@@ -144,6 +144,10 @@ void _usage()
   cerr << "                             subuser keys\n";
   cerr << "   --purge-objects           remove a bucket's objects before deleting it\n";
   cerr << "                             (NOTE: required to delete a non-empty bucket)\n";
+  cerr << "   --marker=<marker>         bucket rm: start removing objects after this one,\n";
+  cerr << "                             to resume an interrupted --purge-objects\n";
+  cerr << "   --rgw-admin-max-concurrent-ops=<n>\n";
+  cerr << "                             objects bucket rm and user rm remove at once\n";
   cerr << "   --show-log-entries=<flag> enable/disable dump of log entries on log show\n";
   cerr << "   --show-log-sum=<flag>     enable/disable dump of log summation on log show\n";
   cerr << "   --skip-zero-entries       log show only dumps entries that don't have zero value\n";
@@ -1299,6 +1303,7 @@ int main(int argc, char **argv)
   bucket_op.set_object(object);
   bucket_op.set_check_objects(check_objects);
   bucket_op.set_delete_children(delete_child_objects);
+  bucket_op.set_marker(marker);
 
   // required to gather errors from operations
   std::string err_msg;
@@ -1834,7 +1839,11 @@ next:
   }
 
   if (opt_cmd == OPT_BUCKET_RM) {
-    RGWBucketAdminOp::remove_bucket(store, bucket_op);
+    int ret = RGWBucketAdminOp::remove_bucket(store, bucket_op);
+    if (ret < 0) {
+      cerr << "ERROR: could not remove bucket: " << cpp_strerror(-ret) << std::endl;
+      return -ret;
+    }
   }
 
   if (opt_cmd == OPT_GC_LIST) {
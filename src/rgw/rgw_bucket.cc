@@ -5,6 +5,9 @@
 
 #include "common/errno.h"
 #include "common/ceph_json.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
 #include "rgw_rados.h"
 #include "rgw_acl.h"
 #include "rgw_acl_s3.h"
@@ -298,13 +301,169 @@ int rgw_remove_object(RGWRados *store, rgw_bucket& bucket, std::string& object)
   return ret;
 }
 
-int rgw_remove_bucket(RGWRados *store, rgw_bucket& bucket, bool delete_children)
+/*
+ * Removes the objects of a bucket with several threads, so that purging
+ * a big bucket is not one synchronous delete after another.
+ */
+class RGWBucketObjRemover {
+  class Worker : public Thread {
+    RGWBucketObjRemover *remover;
+  public:
+    Worker(RGWBucketObjRemover *r) : remover(r) {}
+    void *entry() {
+      remover->worker_entry();
+      return NULL;
+    }
+  };
+
+  RGWRados *store;
+  rgw_bucket bucket;
+  vector<Worker *> workers;
+
+  Mutex lock;
+  Cond cond;
+  list<string> queue;
+  int in_flight;
+  int error;
+  bool stopping;
+  uint64_t removed;
+
+  void worker_entry() {
+    Mutex::Locker l(lock);
+    while (true) {
+      while (!stopping && queue.empty())
+        cond.Wait(lock);
+      if (stopping)
+        break;
+      string name = queue.front();
+      queue.pop_front();
+      ++in_flight;
+
+      lock.Unlock();
+      int r = rgw_remove_object(store, bucket, name);
+      lock.Lock();
+
+      --in_flight;
+      if (r < 0 && r != -ENOENT) {
+        lderr(store->ctx()) << "ERROR: could not remove object " << name
+                            << " from bucket " << bucket.name << ": "
+                            << cpp_strerror(-r) << dendl;
+        if (!error)
+          error = r;
+        queue.clear();
+      } else {
+        ++removed;
+      }
+      cond.SignalAll();
+    }
+  }
+
+public:
+  RGWBucketObjRemover(RGWRados *_store, rgw_bucket& _bucket, int num_workers)
+    : store(_store), bucket(_bucket),
+      lock("RGWBucketObjRemover::lock"),
+      in_flight(0), error(0), stopping(false), removed(0) {
+    for (int i = 0; i < num_workers; ++i) {
+      Worker *w = new Worker(this);
+      w->create();
+      workers.push_back(w);
+    }
+  }
+
+  ~RGWBucketObjRemover() {
+    lock.Lock();
+    stopping = true;
+    cond.SignalAll();
+    lock.Unlock();
+    for (vector<Worker *>::iterator i = workers.begin(); i != workers.end(); ++i) {
+      (*i)->join();
+      delete *i;
+    }
+  }
+
+  void queue_objs(vector<RGWObjEnt>& objs) {
+    Mutex::Locker l(lock);
+    for (vector<RGWObjEnt>::iterator i = objs.begin(); i != objs.end(); ++i)
+      queue.push_back(i->name);
+    cond.SignalAll();
+  }
+
+  /// wait for everything queued to be removed; @return first error
+  int wait() {
+    Mutex::Locker l(lock);
+    while (!queue.empty() || in_flight)
+      cond.Wait(lock);
+    return error;
+  }
+
+  uint64_t get_removed() {
+    Mutex::Locker l(lock);
+    return removed;
+  }
+};
+
+static int rgw_remove_bucket_objs(RGWRados *store, rgw_bucket& bucket, string *marker)
 {
-  int ret;
-  map<RGWObjCategory, RGWBucketStats> stats;
+  CephContext *cct = store->ctx();
   std::vector<RGWObjEnt> objs;
-  std::string prefix, delim, marker, ns;
+  std::string prefix, delim, ns;
   map<string, bool> common_prefixes;
+  string cur_marker = marker ? *marker : string();
+  int max_list = 1000;
+  uint64_t progress_every = max(1, cct->_conf->rgw_admin_progress_every);
+  uint64_t last_progress = 0;
+
+  RGWBucketObjRemover remover(store, bucket,
+                              max(1, cct->_conf->rgw_admin_max_concurrent_ops));
+
+  /*
+   * A batch is listed while the previous one is still being removed.
+   * The marker only moves past a batch once all of it is gone, so it
+   * is always safe to restart from.
+   */
+  string next_marker = cur_marker;
+  int ret = store->list_objects(bucket, max_list, prefix, delim, next_marker,
+                                objs, common_prefixes,
+                                false, ns, true, NULL, NULL);
+  while (ret >= 0 && !objs.empty()) {
+    string batch_end = objs.back().name;
+    remover.queue_objs(objs);
+    objs.clear();
+
+    next_marker = batch_end;
+    ret = store->list_objects(bucket, max_list, prefix, delim, next_marker,
+                              objs, common_prefixes,
+                              false, ns, true, NULL, NULL);
+    int r = remover.wait();
+    if (r < 0) {
+      ret = r;
+      break;
+    }
+    cur_marker = batch_end;
+
+    uint64_t removed = remover.get_removed();
+    if (removed - last_progress >= progress_every) {
+      ldout(cct, 0) << "bucket " << bucket.name << ": removed " << removed
+                    << " objects, marker " << cur_marker << dendl;
+      last_progress = removed;
+    }
+  }
+
+  if (ret < 0) {
+    lderr(cct) << "ERROR: removing objects of bucket " << bucket.name
+               << " stopped after " << remover.get_removed()
+               << " objects; restart from marker '" << cur_marker << "'" << dendl;
+  }
+  if (marker)
+    *marker = cur_marker;
+  return ret;
+}
+
+int rgw_remove_bucket(RGWRados *store, rgw_bucket& bucket, bool delete_children,
+                      string *marker)
+{
+  int ret;
+  map<RGWObjCategory, RGWBucketStats> stats;
   rgw_obj obj;
   RGWBucketInfo info;
   bufferlist bl;
@@ -322,28 +481,9 @@ int rgw_remove_bucket(RGWRados *store, rgw_bucket& bucket, bool delete_children)
     return ret;
 
   if (delete_children) {
-    int max = 1000;
-    ret = store->list_objects(bucket, max, prefix, delim, marker,
-            objs, common_prefixes,
-            false, ns, true, NULL, NULL);
-
+    ret = rgw_remove_bucket_objs(store, bucket, marker);
     if (ret < 0)
       return ret;
-
-    while (!objs.empty()) {
-      std::vector<RGWObjEnt>::iterator it = objs.begin();
-      for (it = objs.begin(); it != objs.end(); ++it) {
-        ret = rgw_remove_object(store, bucket, (*it).name);
-        if (ret < 0)
-          return ret;
-      }
-      objs.clear();
-
-      ret = store->list_objects(bucket, max, prefix, delim, marker, objs, common_prefixes,
-                                false, ns, true, NULL, NULL);
-      if (ret < 0)
-        return ret;
-    }
   }
 
   RGWObjVersionTracker objv_tracker;
@@ -504,10 +644,12 @@ int RGWBucket::remove(RGWBucketAdminOpState& op_state, std::string *err_msg)
 {
   bool delete_children = op_state.will_delete_children();
   rgw_bucket bucket = op_state.get_bucket();
+  string marker = op_state.get_marker();
 
-  int ret = rgw_remove_bucket(store, bucket, delete_children);
+  int ret = rgw_remove_bucket(store, bucket, delete_children, &marker);
   if (ret < 0) {
-    set_err_msg(err_msg, "unable to remove bucket" + cpp_strerror(-ret));
+    set_err_msg(err_msg, "unable to remove bucket" + cpp_strerror(-ret) +
+                (marker.empty() ? string() : ", restart with --marker=" + marker));
     return ret;
   }
 
@@ -829,12 +971,14 @@ int RGWBucketAdminOp::check_index(RGWRados *store, RGWBucketAdminOpState& op_sta
   dump_mulipart_index_results(objs_to_unlink, formatter);
   flusher.flush();
 
-  ret = bucket.check_object_index(op_state, result);
-  if (ret < 0)
-    return ret;
+  if (op_state.will_check_objects()) {
+    ret = bucket.check_object_index(op_state, result);
+    if (ret < 0)
+      return ret;
 
-  dump_bucket_index(result,  formatter);
-  flusher.flush();
+    dump_bucket_index(result,  formatter);
+    flusher.flush();
+  }
 
   ret = bucket.check_index(op_state, existing_stats, calculated_stats);
   if (ret < 0)
@@ -1610,7 +1754,7 @@ public:
 
     objv_tracker = bci.info.objv_tracker;
 
-    ret = store->init_bucket_index(bci.info.bucket);
+    ret = store->init_bucket_index(bci.info.bucket, bci.info.num_shards);
     if (ret < 0)
       return ret;
 
@@ -103,7 +103,15 @@ extern int rgw_link_bucket(RGWRados *store, string user_id, rgw_bucket& bucket,
 extern int rgw_unlink_bucket(RGWRados *store, string user_id, const string& bucket_name, bool update_entrypoint = true);
 
 extern int rgw_remove_object(RGWRados *store, rgw_bucket& bucket, std::string& object);
-extern int rgw_remove_bucket(RGWRados *store, rgw_bucket& bucket, bool delete_children);
+/**
+ * Remove a bucket, and with delete_children its objects first.
+ *
+ * Objects are removed rgw_admin_max_concurrent_ops at a time.  If marker
+ * is given, objects are listed after *marker; on failure it is set to a
+ * marker to restart from, with everything up to it removed.
+ */
+extern int rgw_remove_bucket(RGWRados *store, rgw_bucket& bucket, bool delete_children,
+                             string *marker = NULL);
 
 extern int rgw_bucket_set_attrs(RGWRados *store, rgw_bucket& obj,
                                 map<string, bufferlist>& attrs,
@@ -125,6 +133,7 @@ struct RGWBucketAdminOpState {
   bool fix_index;
   bool delete_child_objects;
   bool bucket_stored;
+  std::string marker;
 
   rgw_bucket bucket;
 
@@ -143,11 +152,15 @@ struct RGWBucketAdminOpState {
   void set_object(std::string& object_str) {
     object_name = object_str;
   }
+  void set_marker(std::string& marker_str) {
+    marker = marker_str;
+  }
 
   std::string& get_user_id() { return uid; };
   std::string& get_user_display_name() { return display_name; };
   std::string& get_bucket_name() { return bucket_name; };
   std::string& get_object_name() { return object_name; };
+  std::string& get_marker() { return marker; };
 
   rgw_bucket& get_bucket() { return bucket; };
   void set_bucket(rgw_bucket& _bucket) {
@@ -2,32 +2,131 @@
 
 #include <errno.h>
 
+#include "common/admin_socket.h"
+#include "common/Clock.h"
+#include "common/Formatter.h"
+#include "include/ceph_hash.h"
+
 #define dout_subsys ceph_subsys_rgw
 
 using namespace std;
 
+class ObjectCache::AdminHook : public AdminSocketHook {
+  ObjectCache *cache;
+public:
+  AdminHook(ObjectCache *c) : cache(c) {}
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+	    bufferlist& out) {
+    if (format == "")
+      format = "json-pretty";
+    Formatter *f = new_formatter(format);
+    stringstream ss;
+    cache->dump(f);
+    f->flush(ss);
+    delete f;
+    out.append(ss);
+    return true;
+  }
+};
+
+/* what an entry costs, roughly */
+static size_t entry_size(const string& name, const ObjectCacheInfo& info)
+{
+  size_t size = sizeof(ObjectCacheEntry) + name.size() * 2; /* in the map and the lru */
+  size += info.data.length();
+  for (map<string, bufferlist>::const_iterator iter = info.xattrs.begin(); iter != info.xattrs.end(); ++iter) {
+    size += iter->first.size() + iter->second.length();
+  }
+  return size;
+}
+
+ObjectCache::~ObjectCache()
+{
+  if (asok_hook) {
+    cct->get_admin_socket()->unregister_command("dump_rgw_cache");
+    delete asok_hook;
+  }
+  for (vector<Shard *>::iterator iter = shards.begin(); iter != shards.end(); ++iter) {
+    delete *iter;
+  }
+}
+
+void ObjectCache::set_ctx(CephContext *_cct)
+{
+  cct = _cct;
+
+  int num_shards = max(1, (int)cct->_conf->rgw_cache_shards);
+  for (int i = 0; i < num_shards; i++) {
+    shards.push_back(new Shard);
+  }
+  max_entries = max(1, (int)cct->_conf->rgw_cache_lru_size / num_shards);
+  max_bytes = cct->_conf->rgw_cache_max_bytes / num_shards;
+
+  // only the first cache in the process gets the command
+  asok_hook = new AdminHook(this);
+  int r = cct->get_admin_socket()->register_command(
+    "dump_rgw_cache", "dump_rgw_cache", asok_hook,
+    "show rgw metadata cache usage and hit rates");
+  if (r < 0) {
+    delete asok_hook;
+    asok_hook = NULL;
+  }
+}
+
+ObjectCache::Shard *ObjectCache::get_shard(const string& name)
+{
+  if (shards.empty())
+    return NULL;
+  uint32_t hash = ceph_str_hash_linux(name.c_str(), name.size());
+  return shards[hash % shards.size()];
+}
+
 int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask)
 {
-  Mutex::Locker l(lock);
+  Shard *shard = get_shard(name);
+  if (!shard)
+    return -ENOENT;
+
+  Mutex::Locker l(shard->lock);
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  map<string, ObjectCacheEntry>::iterator iter = shard->cache_map.find(name);
+  if (iter == shard->cache_map.end()) {
     ldout(cct, 10) << "cache get: name=" << name << " : miss" << dendl;
+    shard->misses++;
     if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
     return -ENOENT;
   }
 
-  touch_lru(name, iter->second.lru_iter);
-
   ObjectCacheInfo& src = iter->second.info;
+  if (src.status < 0) {
+    /* the object was missing; that holds for any mask */
+    if (ceph_clock_now(cct) > iter->second.expires) {
+      ldout(cct, 10) << "cache get: name=" << name << " : negative entry expired" << dendl;
+      remove_entry(shard, iter);
+      shard->misses++;
+      if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+      return -ENOENT;
+    }
+    touch_lru(shard, name, iter->second.lru_iter);
+    ldout(cct, 10) << "cache get: name=" << name << " : negative hit" << dendl;
+    info = src;
+    shard->negative_hits++;
+    if(perfcounter) perfcounter->inc(l_rgw_cache_hit);
+    return 0;
+  }
+
+  touch_lru(shard, name, iter->second.lru_iter);
+
   if ((src.flags & mask) != mask) {
     ldout(cct, 10) << "cache get: name=" << name << " : type miss (requested=" << mask << ", cached=" << src.flags << ")" << dendl;
+    shard->misses++;
     if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
     return -ENOENT;
   }
   ldout(cct, 10) << "cache get: name=" << name << " : hit" << dendl;
 
   info = src;
+  shard->hits++;
   if(perfcounter) perfcounter->inc(l_rgw_cache_hit);
 
   return 0;
@@ -35,20 +134,25 @@ int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask)
 
 void ObjectCache::put(string& name, ObjectCacheInfo& info)
 {
-  Mutex::Locker l(lock);
+  Shard *shard = get_shard(name);
+  if (!shard)
+    return;
+
+  Mutex::Locker l(shard->lock);
 
   ldout(cct, 10) << "cache put: name=" << name << dendl;
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  map<string, ObjectCacheEntry>::iterator iter = shard->cache_map.find(name);
+  if (iter == shard->cache_map.end()) {
+    if (info.status < 0 && cct->_conf->rgw_cache_negative_ttl <= 0)
+      return;
     ObjectCacheEntry entry;
-    entry.lru_iter = lru.end();
-    cache_map.insert(pair<string, ObjectCacheEntry>(name, entry));
-    iter = cache_map.find(name);
+    entry.lru_iter = shard->lru.end();
+    iter = shard->cache_map.insert(pair<string, ObjectCacheEntry>(name, entry)).first;
   }
   ObjectCacheEntry& entry = iter->second;
   ObjectCacheInfo& target = entry.info;
 
-  touch_lru(name, entry.lru_iter);
+  touch_lru(shard, name, entry.lru_iter);
 
   target.status = info.status;
 
@@ -56,96 +160,159 @@ void ObjectCache::put(string& name, ObjectCacheInfo& info)
     target.flags = 0;
     target.xattrs.clear();
     target.data.clear();
-    return;
-  }
-
-  target.flags |= info.flags;
+    entry.expires = ceph_clock_now(cct);
+    entry.expires += cct->_conf->rgw_cache_negative_ttl;
+  } else {
+    target.flags |= info.flags;
 
-  if (info.flags & CACHE_FLAG_META)
-    target.meta = info.meta;
-  else if (!(info.flags & CACHE_FLAG_MODIFY_XATTRS))
-    target.flags &= ~CACHE_FLAG_META; // non-meta change should reset meta
+    if (info.flags & CACHE_FLAG_META)
+      target.meta = info.meta;
+    else if (!(info.flags & CACHE_FLAG_MODIFY_XATTRS))
+      target.flags &= ~CACHE_FLAG_META; // non-meta change should reset meta
 
-  if (info.flags & CACHE_FLAG_XATTRS) {
-    target.xattrs = info.xattrs;
-    map<string, bufferlist>::iterator iter;
-    for (iter = target.xattrs.begin(); iter != target.xattrs.end(); ++iter) {
-      ldout(cct, 10) << "updating xattr: name=" << iter->first << " bl.length()=" << iter->second.length() << dendl;
-    }
-  } else if (info.flags & CACHE_FLAG_MODIFY_XATTRS) {
-    map<string, bufferlist>::iterator iter;
-    for (iter = info.rm_xattrs.begin(); iter != info.rm_xattrs.end(); ++iter) {
-      ldout(cct, 10) << "removing xattr: name=" << iter->first << dendl;
-      target.xattrs.erase(iter->first);
-    }
-    for (iter = info.xattrs.begin(); iter != info.xattrs.end(); ++iter) {
-      ldout(cct, 10) << "appending xattr: name=" << iter->first << " bl.length()=" << iter->second.length() << dendl;
-      target.xattrs[iter->first] = iter->second;
+    if (info.flags & CACHE_FLAG_XATTRS) {
+      target.xattrs = info.xattrs;
+      map<string, bufferlist>::iterator iter;
+      for (iter = target.xattrs.begin(); iter != target.xattrs.end(); ++iter) {
+        ldout(cct, 10) << "updating xattr: name=" << iter->first << " bl.length()=" << iter->second.length() << dendl;
+      }
+    } else if (info.flags & CACHE_FLAG_MODIFY_XATTRS) {
+      map<string, bufferlist>::iterator iter;
+      for (iter = info.rm_xattrs.begin(); iter != info.rm_xattrs.end(); ++iter) {
+        ldout(cct, 10) << "removing xattr: name=" << iter->first << dendl;
+        target.xattrs.erase(iter->first);
+      }
+      for (iter = info.xattrs.begin(); iter != info.xattrs.end(); ++iter) {
+        ldout(cct, 10) << "appending xattr: name=" << iter->first << " bl.length()=" << iter->second.length() << dendl;
+        target.xattrs[iter->first] = iter->second;
+      }
     }
+
+    if (info.flags & CACHE_FLAG_DATA)
+      target.data = info.data;
+
+    if (info.flags & CACHE_FLAG_OBJV)
+      target.version = info.version;
   }
 
-  if (info.flags & CACHE_FLAG_DATA)
-    target.data = info.data;
+  shard->bytes -= entry.size;
+  entry.size = entry_size(name, target);
+  shard->bytes += entry.size;
+
+  if (entry.size > max_bytes) {
+    ldout(cct, 10) << "not caching " << name << ": too large (" << entry.size << " bytes)" << dendl;
+    remove_entry(shard, iter);
+    return;
+  }
 
-  if (info.flags & CACHE_FLAG_OBJV)
-    target.version = info.version;
+  trim(shard, name);
 }
 
 void ObjectCache::remove(string& name)
 {
-  Mutex::Locker l(lock);
+  Shard *shard = get_shard(name);
+  if (!shard)
+    return;
+
+  Mutex::Locker l(shard->lock);
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end())
+  map<string, ObjectCacheEntry>::iterator iter = shard->cache_map.find(name);
+  if (iter == shard->cache_map.end())
     return;
 
   ldout(cct, 10) << "removing " << name << " from cache" << dendl;
 
-  remove_lru(name, iter->second.lru_iter);
-  cache_map.erase(iter);
+  remove_entry(shard, iter);
+}
+
+void ObjectCache::remove_entry(Shard *shard, map<string, ObjectCacheEntry>::iterator iter)
+{
+  remove_lru(shard, iter->second.lru_iter);
+  shard->bytes -= iter->second.size;
+  shard->cache_map.erase(iter);
 }
 
-void ObjectCache::touch_lru(string& name, std::list<string>::iterator& lru_iter)
+void ObjectCache::trim(Shard *shard, const string& keep)
 {
-  while (lru_size > (size_t)cct->_conf->rgw_cache_lru_size) {
-    list<string>::iterator iter = lru.begin();
-    if ((*iter).compare(name) == 0) {
+  while ((shard->lru_size > max_entries || shard->bytes > max_bytes) &&
+         !shard->lru.empty()) {
+    list<string>::iterator iter = shard->lru.begin();
+    if ((*iter).compare(keep) == 0) {
       /*
        * if the entry we're touching happens to be at the lru end, don't remove it,
        * lru shrinking can wait for next time
        */
       break;
     }
-    map<string, ObjectCacheEntry>::iterator map_iter = cache_map.find(*iter);
+    map<string, ObjectCacheEntry>::iterator map_iter = shard->cache_map.find(*iter);
     ldout(cct, 10) << "removing entry: name=" << *iter << " from cache LRU" << dendl;
-    if (map_iter != cache_map.end())
-      cache_map.erase(map_iter);
-    lru.pop_front();
-    lru_size--;
+    if (map_iter != shard->cache_map.end()) {
+      shard->bytes -= map_iter->second.size;
+      shard->cache_map.erase(map_iter);
+    }
+    shard->lru.pop_front();
+    shard->lru_size--;
+    shard->evictions++;
   }
+}
 
-  if (lru_iter == lru.end()) {
-    lru.push_back(name);
-    lru_size++;
+void ObjectCache::touch_lru(Shard *shard, string& name, std::list<string>::iterator& lru_iter)
+{
+  if (lru_iter == shard->lru.end()) {
+    shard->lru.push_back(name);
+    shard->lru_size++;
     lru_iter--;
     ldout(cct, 10) << "adding " << name << " to cache LRU end" << dendl;
   } else {
     ldout(cct, 10) << "moving " << name << " to cache LRU end" << dendl;
-    lru.erase(lru_iter);
-    lru.push_back(name);
-    lru_iter = lru.end();
-    --lru_iter;
+    shard->lru.splice(shard->lru.end(), shard->lru, lru_iter);
   }
 }
 
-void ObjectCache::remove_lru(string& name, std::list<string>::iterator& lru_iter)
+void ObjectCache::remove_lru(Shard *shard, std::list<string>::iterator& lru_iter)
 {
-  if (lru_iter == lru.end())
+  if (lru_iter == shard->lru.end())
     return;
 
-  lru.erase(lru_iter);
-  lru_size--;
-  lru_iter = lru.end();
+  shard->lru.erase(lru_iter);
+  shard->lru_size--;
+  lru_iter = shard->lru.end();
 }
 
+void ObjectCache::dump(Formatter *f)
+{
+  uint64_t entries = 0, bytes = 0, hits = 0, misses = 0, negative_hits = 0, evictions = 0;
 
+  f->open_object_section("rgw_cache");
+  f->dump_unsigned("max_entries_per_shard", max_entries);
+  f->dump_unsigned("max_bytes_per_shard", max_bytes);
+  f->open_array_section("shards");
+  for (vector<Shard *>::iterator iter = shards.begin(); iter != shards.end(); ++iter) {
+    Shard *shard = *iter;
+    Mutex::Locker l(shard->lock);
+    f->open_object_section("shard");
+    f->dump_unsigned("entries", shard->lru_size);
+    f->dump_unsigned("bytes", shard->bytes);
+    f->dump_unsigned("hits", shard->hits);
+    f->dump_unsigned("negative_hits", shard->negative_hits);
+    f->dump_unsigned("misses", shard->misses);
+    f->dump_unsigned("evictions", shard->evictions);
+    f->close_section();
+    entries += shard->lru_size;
+    bytes += shard->bytes;
+    hits += shard->hits;
+    negative_hits += shard->negative_hits;
+    misses += shard->misses;
+    evictions += shard->evictions;
+  }
+  f->close_section();
+  f->open_object_section("total");
+  f->dump_unsigned("entries", entries);
+  f->dump_unsigned("bytes", bytes);
+  f->dump_unsigned("hits", hits);
+  f->dump_unsigned("negative_hits", negative_hits);
+  f->dump_unsigned("misses", misses);
+  f->dump_unsigned("evictions", evictions);
+  f->close_section();
+  f->close_section();
+}
@@ -126,23 +126,52 @@ WRITE_CLASS_ENCODER(RGWCacheNotifyInfo)
 struct ObjectCacheEntry {
   ObjectCacheInfo info;
   std::list<string>::iterator lru_iter;
+  size_t size;      /* charged to the shard's byte budget */
+  utime_t expires;  /* of a negative entry */
+
+  ObjectCacheEntry() : size(0) {}
 };
 
+/*
+ * Cached objects are spread over rgw_cache_shards shards by name, each
+ * with its own lock, LRU and share of the rgw_cache_lru_size entry and
+ * rgw_cache_max_bytes byte limits.  Objects found to be missing are
+ * cached too, for up to rgw_cache_negative_ttl seconds.
+ */
 class ObjectCache {
-  std::map<string, ObjectCacheEntry> cache_map;
-  std::list<string> lru;
-  unsigned long lru_size;
-  Mutex lock;
+  struct Shard {
+    Mutex lock;
+    std::map<string, ObjectCacheEntry> cache_map;
+    std::list<string> lru;
+    unsigned long lru_size;
+    uint64_t bytes;
+    uint64_t hits, misses, negative_hits, evictions;
+
+    Shard() : lock("ObjectCache::Shard::lock"), lru_size(0), bytes(0),
+              hits(0), misses(0), negative_hits(0), evictions(0) {}
+  };
+
+  class AdminHook;
+
+  std::vector<Shard *> shards;
+  unsigned long max_entries;  /* per shard */
+  uint64_t max_bytes;         /* per shard */
   CephContext *cct;
+  AdminHook *asok_hook;
 
-  void touch_lru(string& name, std::list<string>::iterator& lru_iter);
-  void remove_lru(string& name, std::list<string>::iterator& lru_iter);
+  Shard *get_shard(const string& name);
+  void touch_lru(Shard *shard, string& name, std::list<string>::iterator& lru_iter);
+  void remove_lru(Shard *shard, std::list<string>::iterator& lru_iter);
+  void remove_entry(Shard *shard, std::map<string, ObjectCacheEntry>::iterator iter);
+  void trim(Shard *shard, const string& keep);
 public:
-  ObjectCache() : lru_size(0), lock("ObjectCache"), cct(NULL) { }
+  ObjectCache() : max_entries(0), max_bytes(0), cct(NULL), asok_hook(NULL) { }
+  ~ObjectCache();
   int get(std::string& name, ObjectCacheInfo& bl, uint32_t mask);
   void put(std::string& name, ObjectCacheInfo& bl);
   void remove(std::string& name);
-  void set_ctx(CephContext *_cct) { cct = _cct; }
+  void set_ctx(CephContext *_cct);
+  void dump(Formatter *f);
 };
 
 template <class T>
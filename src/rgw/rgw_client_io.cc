@@ -44,6 +44,27 @@ int RGWClientIO::write(const char *buf, int len)
   return 0;
 }
 
+int RGWClientIO::write(bufferlist& bl, off_t ofs, off_t len)
+{
+  const list<bufferptr>& buffers = bl.buffers();
+  for (list<bufferptr>::const_iterator iter = buffers.begin();
+       iter != buffers.end() && len > 0; ++iter) {
+    off_t bp_len = iter->length();
+    if (ofs >= bp_len) {
+      ofs -= bp_len;
+      continue;
+    }
+    off_t write_len = min(bp_len - ofs, len);
+    int ret = write(iter->c_str() + ofs, write_len);
+    if (ret < 0)
+      return ret;
+    len -= write_len;
+    ofs = 0;
+  }
+
+  return 0;
+}
+
 
 int RGWClientIO::read(char *buf, int max, int *actual)
 {
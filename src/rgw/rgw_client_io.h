@@ -21,11 +21,16 @@ public:
 
   int print(const char *format, ...);
   int write(const char *buf, int len);
+  /* send a range of bl buffer by buffer, without flattening it */
+  int write(bufferlist& bl, off_t ofs, off_t len);
   virtual void flush() = 0;
   int read(char *buf, int max, int *actual);
 
   virtual const char **envp() = 0;
 
+  /* the response is complete; called once, last */
+  virtual void complete_request() {}
+
   void set_account(bool _account) {
     account = _account;
   }
@@ -46,6 +46,17 @@ int rgw_perf_start(CephContext *cct)
   plb.add_u64_counter(l_rgw_keystone_token_cache_hit, "keystone_token_cache_hit");
   plb.add_u64_counter(l_rgw_keystone_token_cache_miss, "keystone_token_cache_miss");
 
+  plb.add_u64_counter(l_rgw_user_key_cache_hit, "user_key_cache_hit");
+  plb.add_u64_counter(l_rgw_user_key_cache_miss, "user_key_cache_miss");
+
+  plb.add_u64_counter(l_rgw_gc_objs_removed, "gc_objs_removed");
+  plb.add_u64_counter(l_rgw_gc_chains_removed, "gc_chains_removed");
+  plb.add_u64_counter(l_rgw_gc_failed, "gc_failed");
+  plb.add_u64(l_rgw_gc_backlog, "gc_backlog");
+
+  plb.add_time_avg(l_rgw_index_prepare_lat, "index_prepare_lat");
+  plb.add_time_avg(l_rgw_index_complete_lat, "index_complete_lat");
+
   perfcounter = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(perfcounter);
   return 0;
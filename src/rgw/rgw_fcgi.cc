@@ -29,3 +29,8 @@ const char **RGWFCGX::envp()
 {
   return (const char **)fcgx->envp;
 }
+
+void RGWFCGX::complete_request()
+{
+  FCGX_Finish_r(fcgx);
+}
@@ -18,6 +18,7 @@ public:
   RGWFCGX(FCGX_Request *_fcgx) : fcgx(_fcgx) {}
   void flush();
   const char **envp();
+  void complete_request();
 };
 
 
@@ -7,7 +7,9 @@
 #include "cls/lock/cls_lock_client.h"
 #include "auth/Crypto.h"
 
+#include <deque>
 #include <list>
+#include <set>
 
 #define dout_subsys ceph_subsys_rgw
 
@@ -23,6 +25,7 @@ void RGWGC::initialize(CephContext *_cct, RGWRados *_store) {
 
   max_objs = cct->_conf->rgw_gc_max_objs;
   obj_names = new string[max_objs];
+  shard_backlog.resize(max_objs);
 
   for (int i = 0; i < max_objs; i++) {
     obj_names[i] = gc_oid_prefix;
@@ -121,11 +124,140 @@ int RGWGC::list(int *index, string& marker, uint32_t max, std::list<cls_rgw_gc_o
   return 0;
 }
 
+/*
+ * The removals of a shard in flight.  The tag of an entry is removed
+ * from the shard once all the objects of its chain are gone.
+ */
+class RGWGCIOManager {
+  CephContext *cct;
+  RGWGC *gc;
+  int index;
+  size_t max_aio;
+
+  struct IO {
+    librados::AioCompletion *c;
+    string tag;
+    string oid;
+  };
+  deque<IO> ios;
+
+  struct ChainState {
+    int pending;
+    bool failed;
+    ChainState() : pending(0), failed(false) {}
+  };
+  map<string, ChainState> chains;
+  std::list<string> remove_tags;
+
+  void chain_done(const string& tag, bool failed) {
+    if (failed) {
+      if (perfcounter) perfcounter->inc(l_rgw_gc_failed);
+      return;
+    }
+    if (perfcounter) perfcounter->inc(l_rgw_gc_chains_removed);
+    remove_tags.push_back(tag);
+#define MAX_REMOVE_CHUNK 16
+    if (remove_tags.size() > MAX_REMOVE_CHUNK)
+      flush_remove_tags();
+  }
+
+  void handle_next_io() {
+    IO& io = ios.front();
+    io.c->wait_for_safe();
+    int ret = io.c->get_return_value();
+    io.c->release();
+
+    if (ret == -ENOENT)
+      ret = 0;
+    if (ret < 0) {
+      ldout(cct, 0) << "failed to remove " << io.oid << ": ret=" << ret << dendl;
+    } else if (perfcounter) {
+      perfcounter->inc(l_rgw_gc_objs_removed);
+    }
+
+    map<string, ChainState>::iterator iter = chains.find(io.tag);
+    assert(iter != chains.end());
+    ChainState& state = iter->second;
+    if (ret < 0)
+      state.failed = true;
+    if (--state.pending == 0) {
+      chain_done(io.tag, state.failed);
+      chains.erase(iter);
+    }
+    ios.pop_front();
+  }
+
+public:
+  uint64_t num_removed;
+
+  RGWGCIOManager(CephContext *_cct, RGWGC *_gc, int _index)
+    : cct(_cct), gc(_gc), index(_index), num_removed(0) {
+    max_aio = max(1, (int)cct->_conf->rgw_gc_max_concurrent_io);
+  }
+  ~RGWGCIOManager() {
+    drain();
+  }
+
+  /* the chain is started; its objects follow with schedule_io() */
+  void start_chain(const string& tag) {
+    chains[tag].pending++;
+  }
+
+  void schedule_io(IoCtx& ctx, const string& oid, const string& tag) {
+    while (ios.size() >= max_aio)
+      handle_next_io();
+
+    ObjectWriteOperation op;
+    cls_refcount_put(op, tag, true);
+
+    IO io;
+    io.c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    io.tag = tag;
+    io.oid = oid;
+    int ret = ctx.aio_operate(oid, io.c, &op);
+    if (ret < 0) {
+      ldout(cct, 0) << "failed to send removal of " << oid << ": ret=" << ret << dendl;
+      io.c->release();
+      chains[tag].failed = true;
+      return;
+    }
+    chains[tag].pending++;
+    ios.push_back(io);
+  }
+
+  void end_chain(const string& tag) {
+    map<string, ChainState>::iterator iter = chains.find(tag);
+    assert(iter != chains.end());
+    ChainState& state = iter->second;
+    if (--state.pending == 0) {
+      chain_done(tag, state.failed);
+      chains.erase(iter);
+    }
+  }
+
+  void flush_remove_tags() {
+    if (remove_tags.empty())
+      return;
+    int ret = gc->remove(index, remove_tags);
+    if (ret < 0) {
+      ldout(cct, 0) << "failed to remove tags on gc shard " << index << ": ret=" << ret << dendl;
+    } else {
+      num_removed += remove_tags.size();
+    }
+    remove_tags.clear();
+  }
+
+  void drain() {
+    while (!ios.empty())
+      handle_next_io();
+    flush_remove_tags();
+  }
+};
+
 int RGWGC::process(int index, int max_secs)
 {
   rados::cls::lock::Lock l(gc_index_lock_name);
   utime_t end = ceph_clock_now(g_ceph_context);
-  std::list<string> remove_tags;
 
   /* max_secs should be greater than zero. We don't want a zero max_secs
    * to be translated as no timeout, since we'd then need to break the
@@ -146,100 +278,163 @@ int RGWGC::process(int index, int max_secs)
   if (ret < 0)
     return ret;
 
+  RGWGCIOManager io_manager(cct, this, index);
+  map<string, IoCtx> pool_ctxs;
+  set<string> seen;
+  bool drained = false;
+
+  /*
+   * tags are removed off the shard as their chains are done, so each
+   * listing starts over; those still in flight are skipped
+   */
   string marker;
-  bool truncated;
-  IoCtx *ctx = NULL;
+  bool truncated = false;
   do {
     int max = 100;
     std::list<cls_rgw_gc_obj_info> entries;
     ret = cls_rgw_gc_list(store->gc_pool_ctx, obj_names[index], marker, max, entries, &truncated);
     if (ret == -ENOENT) {
       ret = 0;
-      goto done;
+      truncated = false;
+      break;
     }
     if (ret < 0)
-      goto done;
+      break;
 
-    string last_pool;
-    ctx = new IoCtx;
+    int num_new = 0;
     std::list<cls_rgw_gc_obj_info>::iterator iter;
     for (iter = entries.begin(); iter != entries.end(); ++iter) {
-      bool remove_tag;
       cls_rgw_gc_obj_info& info = *iter;
       std::list<cls_rgw_obj>::iterator liter;
       cls_rgw_obj_chain& chain = info.chain;
 
       utime_t now = ceph_clock_now(g_ceph_context);
-      if (now >= end)
+      if (now >= end || going_down())
         goto done;
 
-      remove_tag = true;
+      if (!seen.insert(info.tag).second)
+        continue;
+      num_new++;
+
+      io_manager.start_chain(info.tag);
       for (liter = chain.objs.begin(); liter != chain.objs.end(); ++liter) {
         cls_rgw_obj& obj = *liter;
 
-        if (obj.pool != last_pool) {
-          delete ctx;
-          ctx = new IoCtx;
-	  ret = store->rados->ioctx_create(obj.pool.c_str(), *ctx);
+        map<string, IoCtx>::iterator piter = pool_ctxs.find(obj.pool);
+        if (piter == pool_ctxs.end()) {
+          IoCtx ctx;
+	  ret = store->rados->ioctx_create(obj.pool.c_str(), ctx);
 	  if (ret < 0) {
 	    dout(0) << "ERROR: failed to create ioctx pool=" << obj.pool << dendl;
 	    continue;
 	  }
-          last_pool = obj.pool;
-        }
-
-        ctx->locator_set_key(obj.key);
-	dout(0) << "gc::process: removing " << obj.pool << ":" << obj.oid << dendl;
-	ObjectWriteOperation op;
-	cls_refcount_put(op, info.tag, true);
-        ret = ctx->operate(obj.oid, &op);
-	if (ret == -ENOENT)
-	  ret = 0;
-        if (ret < 0) {
-          remove_tag = false;
-          dout(0) << "failed to remove " << obj.pool << ":" << obj.oid << "@" << obj.key << dendl;
+          piter = pool_ctxs.insert(pair<string, IoCtx>(obj.pool, ctx)).first;
         }
 
-        if (going_down()) // leave early, even if tag isn't removed, it's ok
-          goto done;
-      }
-      if (remove_tag) {
-        remove_tags.push_back(info.tag);
-#define MAX_REMOVE_CHUNK 16
-        if (remove_tags.size() > MAX_REMOVE_CHUNK) {
-          remove(index, remove_tags);
-          remove_tags.clear();
-        }
+        IoCtx& ctx = piter->second;
+        ctx.locator_set_key(obj.key);
+	dout(5) << "gc::process: removing " << obj.pool << ":" << obj.oid << dendl;
+        io_manager.schedule_io(ctx, obj.oid, info.tag);
       }
+      io_manager.end_chain(info.tag);
+    }
+
+    if (num_new) {
+      drained = false;
+    } else if (!drained) {
+      /* let the chains in flight finish, so that their tags go away */
+      io_manager.drain();
+      drained = true;
+      truncated = true;
+    } else {
+      /* what is left failed */
+      break;
     }
   } while (truncated);
 
 done:
-  if (!remove_tags.empty())
-    remove(index, remove_tags);
+  io_manager.drain();
   l.unlock(&store->gc_pool_ctx, obj_names[index]);
-  delete ctx;
-  return 0;
+
+  /* what was due and is left; a lower bound if we ran out of time */
+  uint64_t left = seen.size() - io_manager.num_removed;
+  if (truncated)
+    left++;
+  update_backlog(index, left);
+
+  return (ret < 0 && ret != -ENOENT ? ret : 0);
+}
+
+void RGWGC::update_backlog(int index, uint64_t left)
+{
+  Mutex::Locker l(backlog_lock);
+  backlog_total -= shard_backlog[index];
+  shard_backlog[index] = left;
+  backlog_total += left;
+  if (perfcounter)
+    perfcounter->set(l_rgw_gc_backlog, backlog_total);
 }
 
+/*
+ * Processes shards taken in turn off a shared cursor, so that a few
+ * of them can go on at once.
+ */
+class RGWGC::ShardProcessor : public Thread {
+  RGWGC *gc;
+  atomic_t *cursor;
+  int start;
+  int max_secs;
+public:
+  int ret;
+
+  ShardProcessor(RGWGC *_gc, atomic_t *_cursor, int _start, int _max_secs)
+    : gc(_gc), cursor(_cursor), start(_start), max_secs(_max_secs), ret(0) {}
+
+  void *entry() {
+    while (!gc->going_down()) {
+      int i = (int)cursor->inc() - 1;
+      if (i >= gc->max_objs)
+        break;
+      int r = gc->process((i + start) % gc->max_objs, max_secs);
+      if (r < 0 && ret == 0)
+        ret = r;
+    }
+    return NULL;
+  }
+};
+
 int RGWGC::process()
 {
-  int max_objs = cct->_conf->rgw_gc_max_objs;
+  if (max_objs <= 0)
+    return 0;
+
   int max_secs = cct->_conf->rgw_gc_processor_max_time;
+  int num_threads = min(max_objs, max(1, (int)cct->_conf->rgw_gc_max_concurrent_shards));
 
   unsigned start;
   int ret = get_random_bytes((char *)&start, sizeof(start));
   if (ret < 0)
     return ret;
+  start %= max_objs;
+
+  atomic_t cursor;
+  vector<ShardProcessor *> threads;
+  for (int i = 0; i < num_threads; i++) {
+    ShardProcessor *t = new ShardProcessor(this, &cursor, start, max_secs);
+    t->create();
+    threads.push_back(t);
+  }
 
-  for (int i = 0; i < max_objs; i++) {
-    int index = (i + start) % max_objs;
-    ret = process(index, max_secs);
-    if (ret < 0)
-      return ret;
+  ret = 0;
+  for (vector<ShardProcessor *>::iterator iter = threads.begin(); iter != threads.end(); ++iter) {
+    ShardProcessor *t = *iter;
+    t->join();
+    if (t->ret < 0 && ret == 0)
+      ret = t->ret;
+    delete t;
   }
 
-  return 0;
+  return ret;
 }
 
 bool RGWGC::going_down()
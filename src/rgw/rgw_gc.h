@@ -19,7 +19,15 @@ class RGWGC {
   string *obj_names;
   atomic_t down_flag;
 
+  Mutex backlog_lock;
+  vector<uint64_t> shard_backlog;
+  uint64_t backlog_total;
+
   int tag_index(const string& tag);
+  void update_backlog(int index, uint64_t left);
+
+  class ShardProcessor;
+  friend class ShardProcessor;
 
   class GCWorker : public Thread {
     CephContext *cct;
@@ -35,7 +43,8 @@ class RGWGC {
 
   GCWorker *worker;
 public:
-  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL), worker(NULL) {}
+  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL),
+            backlog_lock("RGWGC::backlog_lock"), backlog_total(0), worker(NULL) {}
   ~RGWGC() {
     stop_processor();
     finalize();
@@ -0,0 +1,937 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "common/ceph_context.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "common/debug.h"
+#include "common/errno.h"
+
+#include "rgw_http_server.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+#define RGW_HTTP_BACKLOG 1024
+#define RGW_HTTP_MAX_HEADER_LEN (64 * 1024)
+#define RGW_HTTP_MAX_LINE_LEN 4096
+#define RGW_HTTP_READ_SIZE (64 * 1024)
+#define RGW_HTTP_MAX_DRAIN (1024 * 1024)  /* of an unread request body, before giving up on the connection */
+
+static const char *bad_request_response =
+  "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+static int set_nonblocking(int fd)
+{
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    return -errno;
+  return 0;
+}
+
+/* the end of the first blank line, or 0; lines may end with a bare newline */
+static size_t find_blank_line(const string& s)
+{
+  size_t pos = 0;
+  while ((pos = s.find('\n', pos)) != string::npos) {
+    ++pos;
+    if (pos < s.size() && s[pos] == '\n')
+      return pos + 1;
+    if (pos + 1 < s.size() && s[pos] == '\r' && s[pos + 1] == '\n')
+      return pos + 2;
+  }
+  return 0;
+}
+
+static void split_lines(const string& s, vector<string>& lines)
+{
+  size_t pos = 0;
+  while (pos < s.size()) {
+    size_t end = s.find('\n', pos);
+    if (end == string::npos)
+      end = s.size();
+    size_t len = end - pos;
+    if (len && s[end - 1] == '\r')
+      --len;
+    lines.push_back(s.substr(pos, len));
+    pos = end + 1;
+  }
+}
+
+static string trim(const string& s)
+{
+  size_t start = s.find_first_not_of(" \t");
+  if (start == string::npos)
+    return string();
+  size_t end = s.find_last_not_of(" \t");
+  return s.substr(start, end - start + 1);
+}
+
+static bool has_token(const string& value, const char *token)
+{
+  size_t pos = 0;
+  while (pos <= value.size()) {
+    size_t end = value.find(',', pos);
+    if (end == string::npos)
+      end = value.size();
+    if (strcasecmp(trim(value.substr(pos, end - pos)).c_str(), token) == 0)
+      return true;
+    pos = end + 1;
+  }
+  return false;
+}
+
+static const char *http_status_name(int code)
+{
+  switch (code) {
+  case 100: return "Continue";
+  case 200: return "OK";
+  case 201: return "Created";
+  case 202: return "Accepted";
+  case 204: return "No Content";
+  case 206: return "Partial Content";
+  case 301: return "Moved Permanently";
+  case 304: return "Not Modified";
+  case 307: return "Temporary Redirect";
+  case 400: return "Bad Request";
+  case 401: return "Unauthorized";
+  case 403: return "Forbidden";
+  case 404: return "Not Found";
+  case 405: return "Method Not Allowed";
+  case 409: return "Conflict";
+  case 411: return "Length Required";
+  case 412: return "Precondition Failed";
+  case 413: return "Request Entity Too Large";
+  case 416: return "Requested Range Not Satisfiable";
+  case 422: return "Unprocessable Entity";
+  case 500: return "Internal Server Error";
+  case 501: return "Not Implemented";
+  case 503: return "Service Unavailable";
+  }
+  return "Unknown";
+}
+
+size_t RGWHTTPConnection::find_header_end()
+{
+  /* empty lines before a request are allowed */
+  size_t start = inbuf.find_first_not_of("\r\n");
+  if (start == string::npos) {
+    inbuf.clear();
+    return 0;
+  }
+  if (start)
+    inbuf.erase(0, start);
+
+  return find_blank_line(inbuf);
+}
+
+int RGWHTTPConnection::parse_request(size_t header_end, const string& server_port)
+{
+  string head = inbuf.substr(0, header_end);
+  inbuf.erase(0, header_end);
+
+  method.clear();
+  keepalive = false;
+  expect_continue = false;
+  chunked_body = false;
+  body_left = 0;
+  body_done = true;
+  env.clear();
+  envp.clear();
+
+  vector<string> lines;
+  split_lines(head, lines);
+  if (lines.empty())
+    return -EINVAL;
+
+  /* request line: method, uri and version */
+  string& request_line = lines[0];
+  size_t sp1 = request_line.find(' ');
+  if (sp1 == string::npos)
+    return -EINVAL;
+  size_t sp2 = request_line.find(' ', sp1 + 1);
+  if (sp2 == string::npos)
+    return -EINVAL;
+  method = request_line.substr(0, sp1);
+  string uri = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+  string version = trim(request_line.substr(sp2 + 1));
+  if (method.empty() || uri.empty() ||
+      version.size() != 8 || version.compare(0, 7, "HTTP/1.") != 0 ||
+      version[7] < '0' || version[7] > '9')
+    return -EINVAL;
+  minor_version = version[7] - '0';
+
+  /* headers, with repeated ones joined */
+  vector<pair<string, string> > headers;
+  for (size_t i = 1; i < lines.size(); i++) {
+    string& line = lines[i];
+    if (line.empty())
+      continue;
+    if (line[0] == ' ' || line[0] == '\t') {
+      if (headers.empty())
+        return -EINVAL;
+      headers.back().second.append(" ");
+      headers.back().second.append(trim(line));
+      continue;
+    }
+    size_t colon = line.find(':');
+    if (colon == string::npos || colon == 0)
+      return -EINVAL;
+    headers.push_back(make_pair(line.substr(0, colon), trim(line.substr(colon + 1))));
+  }
+
+  map<string, string> env_map;
+  string content_length, transfer_encoding, connection, expect;
+  for (vector<pair<string, string> >::iterator iter = headers.begin(); iter != headers.end(); ++iter) {
+    string name = iter->first;
+    for (size_t i = 0; i < name.size(); i++) {
+      name[i] = (name[i] == '-' ? '_' : toupper(name[i]));
+    }
+    if (name == "CONTENT_LENGTH")
+      content_length = iter->second;
+    else if (name == "TRANSFER_ENCODING")
+      transfer_encoding = iter->second;
+    else if (name == "CONNECTION")
+      connection = iter->second;
+    else if (name == "EXPECT")
+      expect = iter->second;
+
+    if (name != "CONTENT_TYPE" && name != "CONTENT_LENGTH")
+      name = "HTTP_" + name;
+    string& val = env_map[name];
+    if (!val.empty())
+      val.append(",");
+    val.append(iter->second);
+  }
+
+  keepalive = (minor_version >= 1);
+  if (has_token(connection, "close"))
+    keepalive = false;
+  else if (has_token(connection, "keep-alive"))
+    keepalive = true;
+
+  expect_continue = (minor_version >= 1 && strcasecmp(expect.c_str(), "100-continue") == 0);
+
+  if (!transfer_encoding.empty()) {
+    if (!has_token(transfer_encoding, "chunked"))
+      return -EINVAL;
+    chunked_body = true;
+    body_done = false;
+    env_map["HTTP_TRANSFER_ENCODING"] = "chunked";
+    /* the chunks say how long the body is */
+    env_map.erase("CONTENT_LENGTH");
+  } else if (!content_length.empty()) {
+    char *end;
+    body_left = strtoull(content_length.c_str(), &end, 10);
+    if (*end || content_length[0] == '-')
+      return -EINVAL;
+    body_done = (body_left == 0);
+  }
+
+  /* the uri may be absolute */
+  if (uri[0] != '/') {
+    size_t scheme = uri.find("://");
+    if (scheme == string::npos)
+      return -EINVAL;
+    size_t path = uri.find('/', scheme + 3);
+    uri = (path == string::npos ? "/" : uri.substr(path));
+  }
+  string script_uri = uri, query;
+  size_t q = uri.find('?');
+  if (q != string::npos) {
+    script_uri = uri.substr(0, q);
+    query = uri.substr(q + 1);
+  }
+
+  env_map["REQUEST_METHOD"] = method;
+  env_map["REQUEST_URI"] = uri;
+  env_map["SCRIPT_URI"] = script_uri;
+  env_map["QUERY_STRING"] = query;
+  env_map["SERVER_PROTOCOL"] = version;
+  env_map["SERVER_PORT"] = server_port;
+  env_map["REMOTE_ADDR"] = remote_addr;
+
+  for (map<string, string>::iterator iter = env_map.begin(); iter != env_map.end(); ++iter) {
+    env.push_back(iter->first + "=" + iter->second);
+  }
+  for (vector<string>::iterator iter = env.begin(); iter != env.end(); ++iter) {
+    envp.push_back(iter->c_str());
+  }
+  envp.push_back(NULL);
+
+  return 0;
+}
+
+
+RGWHTTPServer::RGWHTTPServer(CephContext *_cct)
+  : cct(_cct), listen_fd(-1), lock("RGWHTTPServer::lock"),
+    stopping(false), num_conns(0)
+{
+  wake_fds[0] = wake_fds[1] = -1;
+}
+
+RGWHTTPServer::~RGWHTTPServer()
+{
+  if (is_started()) {
+    shutdown();
+    join();
+  }
+
+  /* nobody takes or gives back connections any more */
+  while (!ready.empty()) {
+    close_connection(ready.front());
+    ready.pop_front();
+  }
+  while (!returned.empty()) {
+    close_connection(returned.front());
+    returned.pop_front();
+  }
+
+  if (listen_fd >= 0)
+    ::close(listen_fd);
+  if (wake_fds[0] >= 0) {
+    ::close(wake_fds[0]);
+    ::close(wake_fds[1]);
+  }
+}
+
+int RGWHTTPServer::bind_and_listen(const string& host, const string& _port)
+{
+  port = _port;
+
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  int r = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &res);
+  if (r != 0) {
+    lderr(cct) << "ERROR: could not resolve " << host << ":" << port << ": " << gai_strerror(r) << dendl;
+    return -EINVAL;
+  }
+
+  int err = -EINVAL;
+  for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+    int fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      err = -errno;
+      continue;
+    }
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (::bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 ||
+        ::listen(fd, RGW_HTTP_BACKLOG) < 0) {
+      err = -errno;
+      ::close(fd);
+      continue;
+    }
+    listen_fd = fd;
+    break;
+  }
+  freeaddrinfo(res);
+
+  if (listen_fd < 0) {
+    lderr(cct) << "ERROR: could not listen on " << host << ":" << port << ": " << cpp_strerror(err) << dendl;
+    return err;
+  }
+
+  if (::pipe(wake_fds) < 0) {
+    err = -errno;
+    lderr(cct) << "ERROR: pipe() failed: " << cpp_strerror(err) << dendl;
+    return err;
+  }
+  if ((err = set_nonblocking(listen_fd)) < 0 ||
+      (err = set_nonblocking(wake_fds[0])) < 0 ||
+      (err = set_nonblocking(wake_fds[1])) < 0)
+    return err;
+
+  return 0;
+}
+
+void RGWHTTPServer::start()
+{
+  create();
+}
+
+void RGWHTTPServer::shutdown()
+{
+  lock.Lock();
+  stopping = true;
+  cond.SignalAll();
+  lock.Unlock();
+  wake();
+}
+
+void RGWHTTPServer::wake()
+{
+  char c = 0;
+  int r = ::write(wake_fds[1], &c, 1);
+  (void)r;  /* if the pipe is full the loop will wake up anyway */
+}
+
+RGWHTTPConnection *RGWHTTPServer::get_request()
+{
+  Mutex::Locker l(lock);
+  while (ready.empty() && !stopping)
+    cond.Wait(lock);
+  if (stopping)
+    return NULL;
+
+  RGWHTTPConnection *conn = ready.front();
+  ready.pop_front();
+  return conn;
+}
+
+int RGWHTTPServer::take_request(RGWHTTPConnection *conn)
+{
+  size_t end = conn->find_header_end();
+  if (!end) {
+    if (conn->inbuf.size() <= RGW_HTTP_MAX_HEADER_LEN)
+      return 0;
+  } else if (end <= RGW_HTTP_MAX_HEADER_LEN &&
+             conn->parse_request(end, port) == 0) {
+    ldout(cct, 20) << "RGWHTTPServer: request on fd=" << conn->fd << dendl;
+    return 1;
+  }
+
+  ldout(cct, 10) << "RGWHTTPServer: bad request from " << conn->remote_addr << dendl;
+  int r = ::send(conn->fd, bad_request_response, strlen(bad_request_response), MSG_NOSIGNAL | MSG_DONTWAIT);
+  (void)r;
+  return -1;
+}
+
+void RGWHTTPServer::queue_request(RGWHTTPConnection *conn)
+{
+  Mutex::Locker l(lock);
+  ready.push_back(conn);
+  cond.Signal();
+}
+
+void RGWHTTPServer::put_connection(RGWHTTPConnection *conn, bool keepalive)
+{
+  if (keepalive) {
+    lock.Lock();
+    bool stop = stopping;
+    lock.Unlock();
+
+    conn->last_active = ceph_clock_now(cct);
+    int r = (stop ? -1 : take_request(conn));
+    if (r > 0) {
+      /* pipelined; the next request was read along with this one */
+      queue_request(conn);
+      return;
+    }
+    if (r == 0) {
+      lock.Lock();
+      returned.push_back(conn);
+      lock.Unlock();
+      wake();
+      return;
+    }
+  }
+
+  close_connection(conn);
+  wake();
+}
+
+void RGWHTTPServer::close_connection(RGWHTTPConnection *conn)
+{
+  ldout(cct, 20) << "RGWHTTPServer: closing fd=" << conn->fd << dendl;
+  ::close(conn->fd);
+  delete conn;
+
+  Mutex::Locker l(lock);
+  --num_conns;
+}
+
+void RGWHTTPServer::do_accept()
+{
+  while (true) {
+    lock.Lock();
+    bool full = (num_conns >= cct->_conf->rgw_http_max_connections);
+    lock.Unlock();
+    if (full)
+      return;
+
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    int fd = ::accept(listen_fd, (struct sockaddr *)&ss, &len);
+    if (fd < 0) {
+      int err = errno;
+      if (err == EINTR)
+        continue;
+      if (err != EAGAIN && err != EWOULDBLOCK)
+        lderr(cct) << "ERROR: accept() failed: " << cpp_strerror(err) << dendl;
+      return;
+    }
+
+    set_nonblocking(fd);
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    char host[NI_MAXHOST];
+    if (getnameinfo((struct sockaddr *)&ss, len, host, sizeof(host), NULL, 0, NI_NUMERICHOST) != 0)
+      host[0] = '\0';
+
+    RGWHTTPConnection *conn = new RGWHTTPConnection(fd, host);
+    conn->last_active = ceph_clock_now(cct);
+    polled[fd] = conn;
+    ldout(cct, 20) << "RGWHTTPServer: accepted fd=" << fd << " from " << host << dendl;
+
+    lock.Lock();
+    ++num_conns;
+    lock.Unlock();
+  }
+}
+
+void RGWHTTPServer::do_read(RGWHTTPConnection *conn)
+{
+  char buf[RGW_HTTP_READ_SIZE];
+  while (true) {
+    ssize_t r = ::recv(conn->fd, buf, sizeof(buf), 0);
+    if (r > 0) {
+      conn->inbuf.append(buf, r);
+      if ((size_t)r < sizeof(buf) || conn->inbuf.size() > RGW_HTTP_MAX_HEADER_LEN)
+        break;
+      continue;
+    }
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+
+    /* closed by the client, or broken */
+    polled.erase(conn->fd);
+    close_connection(conn);
+    return;
+  }
+
+  conn->last_active = ceph_clock_now(cct);
+  int r = take_request(conn);
+  if (r < 0) {
+    polled.erase(conn->fd);
+    close_connection(conn);
+  } else if (r > 0) {
+    /* a worker has it from now on */
+    polled.erase(conn->fd);
+    queue_request(conn);
+  }
+}
+
+void *RGWHTTPServer::entry()
+{
+  ldout(cct, 10) << "RGWHTTPServer: listening on port " << port << dendl;
+
+  vector<struct pollfd> fds;
+  vector<RGWHTTPConnection *> conns;
+  while (true) {
+    lock.Lock();
+    if (stopping) {
+      lock.Unlock();
+      break;
+    }
+    while (!returned.empty()) {
+      RGWHTTPConnection *conn = returned.front();
+      returned.pop_front();
+      polled[conn->fd] = conn;
+    }
+    bool accepting = (num_conns < cct->_conf->rgw_http_max_connections);
+    lock.Unlock();
+
+    fds.clear();
+    conns.clear();
+    struct pollfd pfd;
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.events = POLLIN;
+    pfd.fd = wake_fds[0];
+    fds.push_back(pfd);
+    pfd.fd = listen_fd;
+    if (accepting)
+      fds.push_back(pfd);
+    for (map<int, RGWHTTPConnection *>::iterator iter = polled.begin(); iter != polled.end(); ++iter) {
+      pfd.fd = iter->first;
+      fds.push_back(pfd);
+      conns.push_back(iter->second);
+    }
+
+    /* wake up now and then to drop idle connections */
+    int r = ::poll(&fds[0], fds.size(), 1000);
+    if (r < 0) {
+      int err = errno;
+      if (err == EINTR)
+        continue;
+      lderr(cct) << "ERROR: poll() failed: " << cpp_strerror(err) << dendl;
+      break;
+    }
+
+    if (fds[0].revents) {
+      char buf[128];
+      while (::read(wake_fds[0], buf, sizeof(buf)) > 0)
+        ;
+    }
+    int first_conn = (accepting ? 2 : 1);
+    if (accepting && fds[1].revents)
+      do_accept();
+    for (size_t i = first_conn; i < fds.size(); i++) {
+      if (fds[i].revents)
+        do_read(conns[i - first_conn]);
+    }
+
+    utime_t timeout;
+    timeout.set_from_double(cct->_conf->rgw_http_keepalive_timeout);
+    utime_t now = ceph_clock_now(cct);
+    map<int, RGWHTTPConnection *>::iterator iter = polled.begin();
+    while (iter != polled.end()) {
+      RGWHTTPConnection *conn = iter->second;
+      if (now - conn->last_active > timeout) {
+        polled.erase(iter++);
+        close_connection(conn);
+      } else {
+        ++iter;
+      }
+    }
+  }
+
+  while (!polled.empty()) {
+    close_connection(polled.begin()->second);
+    polled.erase(polled.begin());
+  }
+
+  ldout(cct, 10) << "RGWHTTPServer: stopped" << dendl;
+  return NULL;
+}
+
+
+RGWHTTPClientIO::RGWHTTPClientIO(CephContext *_cct, RGWHTTPServer *_server, RGWHTTPConnection *_conn)
+  : server(_server), conn(_conn), cct(_cct), failed(false), continue_sent(false),
+    headers_sent(false), send_body(true), chunked(false), has_content_length(false),
+    content_length(0), body_sent(0)
+{
+}
+
+/* wait for a socket of a request that is taking long to be usable */
+static int wait_fd(CephContext *cct, int fd, short events)
+{
+  struct pollfd pfd;
+  memset(&pfd, 0, sizeof(pfd));
+  pfd.fd = fd;
+  pfd.events = events;
+  int r;
+  do {
+    r = ::poll(&pfd, 1, cct->_conf->rgw_http_keepalive_timeout * 1000);
+  } while (r < 0 && errno == EINTR);
+  if (r < 0)
+    return -errno;
+  if (r == 0)
+    return -ETIMEDOUT;
+  return 0;
+}
+
+int RGWHTTPClientIO::send_all(const char *buf, size_t len)
+{
+  if (failed)
+    return -EIO;
+
+  while (len > 0) {
+    ssize_t r = ::send(conn->fd, buf, len, MSG_NOSIGNAL);
+    if (r < 0) {
+      int err = errno;
+      if (err == EINTR)
+        continue;
+      if (err == EAGAIN || err == EWOULDBLOCK)
+        err = -wait_fd(cct, conn->fd, POLLOUT);
+      if (err) {
+        ldout(cct, 10) << "RGWHTTPClientIO: send failed: " << cpp_strerror(err) << dendl;
+        failed = true;
+        return -err;
+      }
+      continue;
+    }
+    buf += r;
+    len -= r;
+  }
+  return 0;
+}
+
+int RGWHTTPClientIO::recv_some(char *buf, size_t len)
+{
+  if (failed)
+    return -EIO;
+
+  while (true) {
+    ssize_t r = ::recv(conn->fd, buf, len, 0);
+    if (r > 0)
+      return r;
+    int err = (r == 0 ? ECONNRESET : errno);
+    if (err == EINTR)
+      continue;
+    if (err == EAGAIN || err == EWOULDBLOCK)
+      err = -wait_fd(cct, conn->fd, POLLIN);
+    if (err) {
+      ldout(cct, 10) << "RGWHTTPClientIO: recv failed: " << cpp_strerror(err) << dendl;
+      failed = true;
+      return -err;
+    }
+  }
+}
+
+int RGWHTTPClientIO::read_chunk_header()
+{
+  /* the chunk size line, and after the last chunk the trailers */
+  bool last = false;
+  while (true) {
+    size_t pos = conn->inbuf.find('\n');
+    if (pos == string::npos) {
+      if (conn->inbuf.size() > RGW_HTTP_MAX_LINE_LEN)
+        return -EINVAL;
+      char buf[RGW_HTTP_MAX_LINE_LEN];
+      int r = recv_some(buf, sizeof(buf));
+      if (r < 0)
+        return r;
+      conn->inbuf.append(buf, r);
+      continue;
+    }
+    string line = conn->inbuf.substr(0, pos);
+    conn->inbuf.erase(0, pos + 1);
+    if (!line.empty() && line[line.size() - 1] == '\r')
+      line.resize(line.size() - 1);
+
+    if (last) {
+      if (line.empty()) {
+        conn->body_done = true;
+        return 0;
+      }
+      continue;
+    }
+    if (line.empty())
+      continue;  /* the end of the previous chunk */
+
+    char *end;
+    uint64_t size = strtoull(line.c_str(), &end, 16);
+    if (end == line.c_str() || (*end && *end != ';' && *end != ' '))
+      return -EINVAL;
+    if (!size) {
+      last = true;
+      continue;
+    }
+    conn->body_left = size;
+    return 0;
+  }
+}
+
+int RGWHTTPClientIO::read_data(char *buf, int max)
+{
+  if (failed)
+    return -EIO;
+
+  if (conn->expect_continue && !continue_sent && !headers_sent) {
+    static const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+    int r = send_all(cont, strlen(cont));
+    if (r < 0)
+      return r;
+    continue_sent = true;
+  }
+
+  int total = 0;
+  while (total < max && !conn->body_done) {
+    if (conn->chunked_body && !conn->body_left) {
+      int r = read_chunk_header();
+      if (r < 0) {
+        failed = true;
+        return r;
+      }
+      continue;
+    }
+
+    size_t len = max - total;
+    if (len > conn->body_left)
+      len = conn->body_left;
+    if (!conn->inbuf.empty()) {
+      if (len > conn->inbuf.size())
+        len = conn->inbuf.size();
+      memcpy(buf + total, conn->inbuf.data(), len);
+      conn->inbuf.erase(0, len);
+    } else {
+      /* straight into the caller's buffer */
+      int r = recv_some(buf + total, len);
+      if (r < 0)
+        return r;
+      len = r;
+    }
+    total += len;
+    conn->body_left -= len;
+    if (!conn->body_left && !conn->chunked_body)
+      conn->body_done = true;
+  }
+
+  return total;
+}
+
+int RGWHTTPClientIO::send_headers(const string& headers)
+{
+  vector<string> lines;
+  split_lines(headers, lines);
+
+  int code = 200;
+  string out;
+  for (vector<string>::iterator iter = lines.begin(); iter != lines.end(); ++iter) {
+    string& line = *iter;
+    size_t colon = line.find(':');
+    if (colon == string::npos)
+      continue;
+    string name = line.substr(0, colon);
+    string value = trim(line.substr(colon + 1));
+    if (strcasecmp(name.c_str(), "Status") == 0) {
+      code = atoi(value.c_str());
+      continue;
+    }
+    if (strcasecmp(name.c_str(), "Connection") == 0 ||
+        strcasecmp(name.c_str(), "Transfer-Encoding") == 0)
+      continue;
+    if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+      has_content_length = true;
+      content_length = strtoull(value.c_str(), NULL, 10);
+    }
+    out.append(name);
+    out.append(": ");
+    out.append(value);
+    out.append("\r\n");
+  }
+
+  send_body = !(conn->method == "HEAD" || code == 204 || code == 304 || code < 200);
+  if (send_body && !has_content_length) {
+    if (conn->minor_version >= 1)
+      chunked = true;
+    else
+      conn->keepalive = false;  /* the end of the body is where the connection ends */
+  }
+  /* the client may still be sending a body we said we did not want */
+  if (conn->expect_continue && !continue_sent && !conn->body_done)
+    conn->keepalive = false;
+
+  char status[64];
+  snprintf(status, sizeof(status), "HTTP/1.1 %d %s\r\n", code, http_status_name(code));
+  out.insert(0, status);
+  if (chunked)
+    out.append("Transfer-Encoding: chunked\r\n");
+  if (!conn->keepalive)
+    out.append("Connection: close\r\n");
+  else if (conn->minor_version == 0)
+    out.append("Connection: Keep-Alive\r\n");
+  out.append("\r\n");
+
+  headers_sent = true;
+  return send_all(out.c_str(), out.size());
+}
+
+int RGWHTTPClientIO::send_body_data(const char *buf, size_t len)
+{
+  if (!send_body || !len)
+    return 0;
+
+  body_sent += len;
+  if (!chunked)
+    return send_all(buf, len);
+
+  char hdr[32];
+  snprintf(hdr, sizeof(hdr), "%zx\r\n", len);
+  string chunk(hdr);
+  chunk.append(buf, len);
+  chunk.append("\r\n");
+  return send_all(chunk.c_str(), chunk.size());
+}
+
+int RGWHTTPClientIO::write_data(const char *buf, int len)
+{
+  if (failed)
+    return -EIO;
+
+  if (headers_sent) {
+    int r = send_body_data(buf, len);
+    return (r < 0 ? r : len);
+  }
+
+  header_buf.append(buf, len);
+  size_t end = find_blank_line(header_buf);
+  if (!end)
+    return len;
+
+  string headers = header_buf.substr(0, end);
+  string rest = header_buf.substr(end);
+  header_buf.clear();
+  int r = send_headers(headers);
+  if (r >= 0)
+    r = send_body_data(rest.c_str(), rest.size());
+  return (r < 0 ? r : len);
+}
+
+void RGWHTTPClientIO::flush()
+{
+  /* a lone "Status: 100" asks the client to go on with the body */
+  if (headers_sent || header_buf.empty())
+    return;
+
+  vector<string> lines;
+  split_lines(header_buf, lines);
+  if (lines.size() != 1 || strncasecmp(lines[0].c_str(), "Status:", 7) != 0 ||
+      atoi(lines[0].c_str() + 7) != 100)
+    return;
+
+  header_buf.clear();
+  if (conn->expect_continue && !continue_sent) {
+    static const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+    if (send_all(cont, strlen(cont)) == 0)
+      continue_sent = true;
+  }
+}
+
+const char **RGWHTTPClientIO::envp()
+{
+  return &conn->envp[0];
+}
+
+void RGWHTTPClientIO::drain_body()
+{
+  char buf[RGW_HTTP_READ_SIZE];
+  int drained = 0;
+  while (!conn->body_done && !failed && drained < RGW_HTTP_MAX_DRAIN) {
+    int r = read_data(buf, sizeof(buf));
+    if (r <= 0)
+      break;
+    drained += r;
+  }
+}
+
+void RGWHTTPClientIO::complete_request()
+{
+  if (!headers_sent && !failed) {
+    /* headers that were not ended, or no response at all */
+    string headers = header_buf;
+    header_buf.clear();
+    if (headers.empty() || find_blank_line(headers + "\r\n") == 0)
+      headers = "Status: 500\r\nContent-Length: 0\r\n";
+    send_headers(headers + "\r\n");
+  }
+  if (chunked && !failed)
+    send_all("0\r\n\r\n", 5);
+  if (send_body && has_content_length && body_sent != content_length)
+    conn->keepalive = false;
+
+  if (conn->keepalive && !failed && !conn->body_done &&
+      (continue_sent || !conn->expect_continue))
+    drain_body();
+
+  bool keepalive = (conn->keepalive && !failed && conn->body_done);
+  server->put_connection(conn, keepalive);
+  conn = NULL;
+}
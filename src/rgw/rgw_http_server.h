@@ -0,0 +1,139 @@
+#ifndef CEPH_RGW_HTTP_SERVER_H
+#define CEPH_RGW_HTTP_SERVER_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "include/utime.h"
+
+#include "rgw_client_io.h"
+
+class CephContext;
+class RGWHTTPServer;
+
+/*
+ * A client connection of the embedded HTTP front end.  While it waits
+ * for a request it belongs to the server's event loop; once the headers
+ * of a request are in, it is handed to a single worker, which reads the
+ * body and writes the response through an RGWHTTPClientIO and then
+ * gives it back.  Bytes of pipelined requests read along with a request
+ * stay in inbuf for the next one.
+ */
+struct RGWHTTPConnection {
+  int fd;
+  string remote_addr;
+  string inbuf;
+  utime_t last_active;
+
+  /* the request being handled */
+  string method;
+  int minor_version;      /* of HTTP/1.x */
+  bool keepalive;
+  bool expect_continue;
+  bool chunked_body;
+  uint64_t body_left;     /* of the body, or of the current chunk if chunked */
+  bool body_done;
+  vector<string> env;
+  vector<const char *> envp;
+
+  RGWHTTPConnection(int _fd, const string& _remote_addr)
+    : fd(_fd), remote_addr(_remote_addr), minor_version(1), keepalive(false),
+      expect_continue(false), chunked_body(false), body_left(0), body_done(true) {}
+
+  /* the end of the headers of the next request in inbuf, or 0 */
+  size_t find_header_end();
+  /* take the headers of the next request off inbuf; -EINVAL if bad */
+  int parse_request(size_t header_end, const string& server_port);
+};
+
+/*
+ * Serves HTTP/1.1 directly, in place of FastCGI behind a web server.
+ *
+ * A single thread polls the listening socket and all idle connections,
+ * so keep-alive connections cost no worker while they wait.  Requests
+ * whose headers are in are queued, and get_request() hands them out to
+ * the bounded pool of workers in order.
+ */
+class RGWHTTPServer : public Thread {
+  CephContext *cct;
+  string port;
+  int listen_fd;
+  int wake_fds[2];
+
+  Mutex lock;
+  Cond cond;
+  bool stopping;
+  int num_conns;
+  list<RGWHTTPConnection *> returned;   /* by workers, to be polled again */
+  list<RGWHTTPConnection *> ready;      /* with a request to handle */
+
+  /* only touched by the event loop */
+  map<int, RGWHTTPConnection *> polled;
+
+  void *entry();
+  void wake();
+  void do_accept();
+  void do_read(RGWHTTPConnection *conn);
+  /* 1 if a request is ready, 0 if more is needed, -1 if it was bad */
+  int take_request(RGWHTTPConnection *conn);
+  void queue_request(RGWHTTPConnection *conn);
+  void close_connection(RGWHTTPConnection *conn);
+
+public:
+  RGWHTTPServer(CephContext *_cct);
+  ~RGWHTTPServer();
+
+  int bind_and_listen(const string& host, const string& _port);
+  void start();
+  void shutdown();
+
+  /* wait for the next request; NULL once shutting down */
+  RGWHTTPConnection *get_request();
+  /* give a connection back after its request was handled */
+  void put_connection(RGWHTTPConnection *conn, bool keepalive);
+};
+
+/*
+ * The response is written CGI style, a "Status:" line among the
+ * headers; it is turned into an HTTP status line here, and framed
+ * with chunked transfer encoding if it has no Content-Length so the
+ * connection can be kept alive.
+ */
+class RGWHTTPClientIO : public RGWClientIO {
+  RGWHTTPServer *server;
+  RGWHTTPConnection *conn;
+  CephContext *cct;
+  bool failed;
+  bool continue_sent;
+  bool headers_sent;
+  string header_buf;
+  bool send_body;
+  bool chunked;
+  bool has_content_length;
+  uint64_t content_length;
+  uint64_t body_sent;
+
+  int send_all(const char *buf, size_t len);
+  int recv_some(char *buf, size_t len);
+  int send_headers(const string& headers);
+  int send_body_data(const char *buf, size_t len);
+  int read_chunk_header();
+  void drain_body();
+
+protected:
+  int write_data(const char *buf, int len);
+  int read_data(char *buf, int max);
+
+public:
+  RGWHTTPClientIO(CephContext *_cct, RGWHTTPServer *_server, RGWHTTPConnection *_conn);
+  void flush();
+  const char **envp();
+  void complete_request();
+};
+
+#endif
@@ -55,7 +55,7 @@ bool RGWKeystoneTokenCache::find(const string& token_id, KeystoneToken& token)
   if (entry.token.expired()) {
     tokens.erase(iter);
     lock.Unlock();
-    if (perfcounter) perfcounter->inc(l_rgw_keystone_token_cache_hit);
+    if (perfcounter) perfcounter->inc(l_rgw_keystone_token_cache_miss);
     return false;
   }
   token = entry.token;
@@ -3,6 +3,9 @@
 #include "common/utf8.h"
 #include "common/OutputDataSocket.h"
 #include "common/Formatter.h"
+#include "include/atomic.h"
+
+#include <pthread.h>
 
 #include "rgw_log.h"
 #include "rgw_acl.h"
@@ -77,16 +80,30 @@ string render_log_object_name(const string& format,
   return o;
 }
 
-/* usage logger */
+/*
+ * usage logger
+ *
+ * Each thread adds to an accumulator of its own, so requests don't
+ * contend on a single map; they are merged when flushed.
+ */
 class UsageLogger {
+  struct Accumulator {
+    Mutex lock;
+    map<rgw_user_bucket, RGWUsageBatch> usage_map;
+    utime_t round_timestamp;
+    bool thread_exited;
+
+    Accumulator() : lock("UsageLogger::Accumulator"), thread_exited(false) {}
+  };
+
   CephContext *cct;
   RGWRados *store;
-  map<rgw_user_bucket, RGWUsageBatch> usage_map;
-  Mutex lock;
-  int32_t num_entries;
+  pthread_key_t acc_key;
+  Mutex acc_lock;
+  list<Accumulator *> accumulators;
+  atomic_t num_entries;
   Mutex timer_lock;
   SafeTimer timer;
-  utime_t round_timestamp;
 
   class C_UsageLogTimeout : public Context {
     UsageLogger *logger;
@@ -101,14 +118,32 @@ class UsageLogger {
   void set_timer() {
     timer.add_event_after(cct->_conf->rgw_usage_log_tick_interval, new C_UsageLogTimeout(this));
   }
+
+  static void thread_exited(void *arg) {
+    Accumulator *acc = (Accumulator *)arg;
+    Mutex::Locker l(acc->lock);
+    acc->thread_exited = true;
+  }
+
+  Accumulator *get_accumulator() {
+    Accumulator *acc = (Accumulator *)pthread_getspecific(acc_key);
+    if (acc)
+      return acc;
+
+    acc = new Accumulator;
+    acc->round_timestamp = ceph_clock_now(cct).round_to_hour();
+    pthread_setspecific(acc_key, acc);
+    Mutex::Locker l(acc_lock);
+    accumulators.push_back(acc);
+    return acc;
+  }
 public:
 
-  UsageLogger(CephContext *_cct, RGWRados *_store) : cct(_cct), store(_store), lock("UsageLogger"), num_entries(0), timer_lock("UsageLogger::timer_lock"), timer(cct, timer_lock) {
+  UsageLogger(CephContext *_cct, RGWRados *_store) : cct(_cct), store(_store), acc_lock("UsageLogger::acc_lock"), timer_lock("UsageLogger::timer_lock"), timer(cct, timer_lock) {
+    pthread_key_create(&acc_key, thread_exited);
     timer.init();
     Mutex::Locker l(timer_lock);
     set_timer();
-    utime_t ts = ceph_clock_now(cct);
-    recalc_round_timestamp(ts);
   }
 
   ~UsageLogger() {
@@ -116,24 +151,26 @@ public:
     flush();
     timer.cancel_all_events();
     timer.shutdown();
-  }
-
-  void recalc_round_timestamp(utime_t& ts) {
-    round_timestamp = ts.round_to_hour();
+    pthread_key_delete(acc_key);
+    for (list<Accumulator *>::iterator iter = accumulators.begin(); iter != accumulators.end(); ++iter) {
+      delete *iter;
+    }
   }
 
   void insert(utime_t& timestamp, rgw_usage_log_entry& entry) {
-    lock.Lock();
-    if (timestamp.sec() > round_timestamp + 3600)
-      recalc_round_timestamp(timestamp);
-    entry.epoch = round_timestamp.sec();
+    Accumulator *acc = get_accumulator();
     bool account;
+    acc->lock.Lock();
+    if (timestamp.sec() > acc->round_timestamp + 3600)
+      acc->round_timestamp = timestamp.round_to_hour();
+    entry.epoch = acc->round_timestamp.sec();
     rgw_user_bucket ub(entry.owner, entry.bucket);
-    usage_map[ub].insert(round_timestamp, entry, &account);
+    acc->usage_map[ub].insert(acc->round_timestamp, entry, &account);
+    acc->lock.Unlock();
+
+    bool need_flush = false;
     if (account)
-      num_entries++;
-    bool need_flush = (num_entries > cct->_conf->rgw_usage_log_flush_threshold);
-    lock.Unlock();
+      need_flush = ((int)num_entries.inc() > cct->_conf->rgw_usage_log_flush_threshold);
     if (need_flush) {
       Mutex::Locker l(timer_lock);
       flush();
@@ -142,10 +179,40 @@ public:
 
   void flush() {
     map<rgw_user_bucket, RGWUsageBatch> old_map;
-    lock.Lock();
-    old_map.swap(usage_map);
-    num_entries = 0;
-    lock.Unlock();
+    num_entries.set(0);
+
+    acc_lock.Lock();
+    list<Accumulator *>::iterator iter = accumulators.begin();
+    while (iter != accumulators.end()) {
+      Accumulator *acc = *iter;
+      map<rgw_user_bucket, RGWUsageBatch> acc_map;
+      acc->lock.Lock();
+      acc_map.swap(acc->usage_map);
+      bool exited = acc->thread_exited;
+      acc->lock.Unlock();
+
+      if (old_map.empty()) {
+        old_map.swap(acc_map);
+      } else {
+        map<rgw_user_bucket, RGWUsageBatch>::iterator miter;
+        for (miter = acc_map.begin(); miter != acc_map.end(); ++miter) {
+          RGWUsageBatch& batch = old_map[miter->first];
+          map<utime_t, rgw_usage_log_entry>::iterator biter;
+          for (biter = miter->second.m.begin(); biter != miter->second.m.end(); ++biter) {
+            bool account;
+            batch.insert((utime_t&)biter->first, biter->second, &account);
+          }
+        }
+      }
+
+      if (exited) {
+        delete acc;
+        accumulators.erase(iter++);
+      } else {
+        ++iter;
+      }
+    }
+    acc_lock.Unlock();
 
     store->log_usage(old_map);
   }
@@ -233,27 +300,83 @@ void OpsLogSocket::init_connection(bufferlist& bl)
   bl.append("[");
 }
 
-OpsLogSocket::OpsLogSocket(CephContext *cct, uint64_t _backlog) : OutputDataSocket(cct, _backlog), lock("OpsLogSocket")
+OpsLogSocket::OpsLogSocket(CephContext *cct, uint64_t _backlog)
+  : OutputDataSocket(cct, _backlog), queue_lock("OpsLogSocket::queue_lock"),
+    queue_size(0), stopping(false), format_thread(this)
 {
   formatter = new JSONFormatter;
   delim.append(",\n");
+  format_thread.create();
 }
 
 OpsLogSocket::~OpsLogSocket()
 {
+  queue_lock.Lock();
+  stopping = true;
+  queue_cond.Signal();
+  queue_lock.Unlock();
+  format_thread.join();
+
   delete formatter;
 }
 
+void *OpsLogSocket::FormatThread::entry()
+{
+  Mutex::Locker l(olog->queue_lock);
+  while (true) {
+    if (olog->queue.empty()) {
+      if (olog->stopping)
+        break;
+      olog->queue_cond.Wait(olog->queue_lock);
+      continue;
+    }
+    list<bufferlist> entries;
+    entries.swap(olog->queue);
+    olog->queue_size = 0;
+
+    olog->queue_lock.Unlock();
+    olog->format_entries(entries);
+    olog->queue_lock.Lock();
+  }
+  return NULL;
+}
+
+void OpsLogSocket::format_entries(list<bufferlist>& entries)
+{
+  for (list<bufferlist>::iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+    rgw_log_entry entry;
+    try {
+      bufferlist::iterator biter = iter->begin();
+      ::decode(entry, biter);
+    } catch (buffer::error& err) {
+      ldout(m_cct, 0) << "ERROR: failed to decode ops log entry" << dendl;
+      continue;
+    }
+
+    bufferlist bl;
+    rgw_format_ops_log_entry(entry, formatter);
+    formatter_to_bl(bl);
+    append_output(bl);
+  }
+}
+
 void OpsLogSocket::log(struct rgw_log_entry& entry)
 {
   bufferlist bl;
+  ::encode(entry, bl);
+  log(bl);
+}
 
-  lock.Lock();
-  rgw_format_ops_log_entry(entry, formatter);
-  formatter_to_bl(bl);
-  lock.Unlock();
-
-  append_output(bl);
+void OpsLogSocket::log(bufferlist& bl)
+{
+  Mutex::Locker l(queue_lock);
+  if (queue_size + bl.length() > data_max_backlog) {
+    ldout(m_cct, 20) << "dropping ops log entry, max backlog reached" << dendl;
+    return;
+  }
+  queue.push_back(bl);
+  queue_size += bl.length();
+  queue_cond.Signal();
 }
 
 int rgw_log_op(RGWRados *store, struct req_state *s, const string& op_name, OpsLogSocket *olog)
@@ -355,7 +478,7 @@ int rgw_log_op(RGWRados *store, struct req_state *s, const string& op_name, OpsL
   }
 
   if (olog) {
-    olog->log(entry);
+    olog->log(bl);
   }
 done:
   if (ret < 0)
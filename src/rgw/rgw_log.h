@@ -5,6 +5,7 @@
 #include "include/utime.h"
 #include "common/Formatter.h"
 #include "common/OutputDataSocket.h"
+#include "common/Thread.h"
 
 class RGWRados;
 
@@ -117,11 +118,29 @@ struct rgw_intent_log_entry {
 };
 WRITE_CLASS_ENCODER(rgw_intent_log_entry)
 
+/*
+ * Entries are handed over encoded, and turned into JSON for the socket
+ * by a thread of their own, off the request path.
+ */
 class OpsLogSocket : public OutputDataSocket {
   Formatter *formatter;
-  Mutex lock;
+
+  class FormatThread : public Thread {
+    OpsLogSocket *olog;
+  public:
+    FormatThread(OpsLogSocket *_olog) : olog(_olog) {}
+    void *entry();
+  };
+
+  Mutex queue_lock;
+  Cond queue_cond;
+  list<bufferlist> queue;
+  uint64_t queue_size;
+  bool stopping;
+  FormatThread format_thread;
 
   void formatter_to_bl(bufferlist& bl);
+  void format_entries(list<bufferlist>& entries);
 
 protected:
   void init_connection(bufferlist& bl);
@@ -131,6 +150,8 @@ public:
   ~OpsLogSocket();
 
   void log(struct rgw_log_entry& entry);
+  /* an rgw_log_entry, encoded */
+  void log(bufferlist& bl);
 };
 
 int rgw_log_op(RGWRados *store, struct req_state *s, const string& op_name, OpsLogSocket *olog);
@@ -18,6 +18,7 @@
 #endif
 
 #include "rgw_fcgi.h"
+#include "rgw_http_server.h"
 
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
@@ -49,6 +50,7 @@
 #include "rgw_swift_auth.h"
 #include "rgw_swift.h"
 #include "rgw_log.h"
+#include "rgw_op_tracker.h"
 #include "rgw_tools.h"
 #include "rgw_resolve.h"
 
@@ -77,13 +79,15 @@ static RGWProcess *pprocess = NULL;
 struct RGWRequest
 {
   FCGX_Request fcgx;
+  RGWHTTPConnection *http_conn;
   uint64_t id;
   struct req_state *s;
   string req_str;
   RGWOp *op;
   utime_t ts;
+  RGWOpTimes times;
 
-  RGWRequest() : id(0), s(NULL), op(NULL) {
+  RGWRequest() : http_conn(NULL), id(0), s(NULL), op(NULL) {
   }
 
   ~RGWRequest() {
@@ -121,6 +125,10 @@ struct RGWRequest
     utime_t t = ceph_clock_now(g_ceph_context) - ts;
     dout(2) << "req " << id << ":" << t << ":" << s->dialect << ":" << req_str << ":" << (op ? op->name() : "") << ":" << msg << dendl;
   }
+
+  void enter_stage(int stage) {
+    times.enter(stage, ceph_clock_now(g_ceph_context));
+  }
 };
 
 class RGWProcess {
@@ -131,6 +139,8 @@ class RGWProcess {
   Throttle req_throttle;
   RGWREST *rest;
   int sock_fd;
+  RGWHTTPServer *http_server;
+  RGWOpTracker op_tracker;
 
   struct RGWWQ : public ThreadPool::WorkQueue<RGWRequest> {
     RGWProcess *process;
@@ -188,14 +198,20 @@ public:
   RGWProcess(CephContext *cct, RGWRados *rgwstore, OpsLogSocket *_olog, int num_threads, RGWREST *_rest)
     : store(rgwstore), olog(_olog), m_tp(cct, "RGWProcess::m_tp", num_threads),
       req_throttle(cct, "rgw_ops", num_threads * 2),
-      rest(_rest), sock_fd(-1),
+      rest(_rest), sock_fd(-1), http_server(NULL), op_tracker(cct),
       req_wq(this, g_conf->rgw_op_thread_timeout,
 	     g_conf->rgw_op_thread_suicide_timeout, &m_tp),
       max_req_id(0) {}
+  ~RGWProcess() {
+    delete http_server;
+  }
   void run();
+  void run_http();
   void handle_request(RGWRequest *req);
 
   void close_fd() {
+    if (http_server)
+      http_server->shutdown();
     if (sock_fd >= 0)
       close(sock_fd);
   }
@@ -203,6 +219,11 @@ public:
 
 void RGWProcess::run()
 {
+  if (g_conf->rgw_frontend == "http") {
+    run_http();
+    return;
+  }
+
   sock_fd = 0;
   if (!g_conf->rgw_socket_path.empty()) {
     string path_str = g_conf->rgw_socket_path;
@@ -254,6 +275,42 @@ void RGWProcess::run()
       break;
     }
 
+    req->times.begin(ceph_clock_now(g_ceph_context));
+    req_wq.queue(req);
+  }
+
+  m_tp.drain();
+  m_tp.stop();
+}
+
+void RGWProcess::run_http()
+{
+  if (g_conf->rgw_port.empty()) {
+    dout(0) << "ERROR: 'rgw port' must be set for the http frontend" << dendl;
+    return;
+  }
+  http_server = new RGWHTTPServer(g_ceph_context);
+  int r = http_server->bind_and_listen(g_conf->rgw_host, g_conf->rgw_port);
+  if (r < 0) {
+    dout(0) << "ERROR: could not start http frontend: " << cpp_strerror(r) << dendl;
+    return;
+  }
+
+  m_tp.start();
+  http_server->start();
+
+  for (;;) {
+    req_throttle.get(1);
+    RGWHTTPConnection *conn = http_server->get_request();
+    if (!conn) {
+      req_throttle.put(1);
+      break;
+    }
+    RGWRequest *req = new RGWRequest;
+    req->id = ++max_req_id;
+    req->http_conn = conn;
+    dout(10) << "allocated request req=" << hex << req << dec << dendl;
+    req->times.begin(ceph_clock_now(g_ceph_context));
     req_wq.queue(req);
   }
 
@@ -297,17 +354,21 @@ static int call_log_intent(RGWRados *store, void *ctx, rgw_obj& obj, RGWIntentEv
 
 void RGWProcess::handle_request(RGWRequest *req)
 {
-  FCGX_Request *fcgx = &req->fcgx;
   int ret;
   RGWEnv rgw_env;
-  RGWFCGX client_io(fcgx);
+  RGWClientIO *client_io;
+  if (req->http_conn)
+    client_io = new RGWHTTPClientIO(g_ceph_context, http_server, req->http_conn);
+  else
+    client_io = new RGWFCGX(&req->fcgx);
 
   req->log_init();
+  req->enter_stage(RGW_OP_STAGE_AUTH);
 
   dout(1) << "====== starting new request req=" << hex << req << dec << " =====" << dendl;
   perfcounter->inc(l_rgw_req);
 
-  rgw_env.init(g_ceph_context, fcgx->envp);
+  rgw_env.init(g_ceph_context, (char **)client_io->envp());
 
   struct req_state *s = req->init_state(g_ceph_context, &rgw_env);
   s->obj_ctx = store->create_context(s);
@@ -321,7 +382,7 @@ void RGWProcess::handle_request(RGWRequest *req)
   int init_error = 0;
   bool should_log = false;
   RGWRESTMgr *mgr;
-  RGWHandler *handler = rest->get_handler(store, s, &client_io, &mgr, &init_error);
+  RGWHandler *handler = rest->get_handler(store, s, client_io, &mgr, &init_error);
   if (init_error != 0) {
     abort_early(s, NULL, init_error);
     goto done;
@@ -351,6 +412,7 @@ void RGWProcess::handle_request(RGWRequest *req)
     goto done;
   }
   req->log(s, "reading permissions");
+  req->enter_stage(RGW_OP_STAGE_PERMISSIONS);
   ret = handler->read_permissions(op);
   if (ret < 0) {
     abort_early(s, op, ret);
@@ -358,6 +420,7 @@ void RGWProcess::handle_request(RGWRequest *req)
   }
 
   req->log(s, "init op");
+  req->enter_stage(RGW_OP_STAGE_INIT);
   ret = op->init_processing();
   if (ret < 0) {
     abort_early(s, op, ret);
@@ -393,9 +456,12 @@ void RGWProcess::handle_request(RGWRequest *req)
     dump_continue(s);
 
   req->log(s, "executing");
+  req->enter_stage(RGW_OP_STAGE_EXECUTE);
   op->execute();
+  req->enter_stage(RGW_OP_STAGE_COMPLETE);
   op->complete();
 done:
+  req->enter_stage(RGW_OP_STAGE_LOG);
   if (should_log) {
     rgw_log_op(store, s, (op ? op->name() : "unknown"), olog);
   }
@@ -404,11 +470,17 @@ done:
 
   req->log_format(s, "http status=%d", http_ret);
 
+  string op_name = (op ? op->name() : "unknown");
+
   if (handler)
     handler->put_op(op);
   rest->put_handler(handler);
   store->destroy_context(s->obj_ctx);
-  FCGX_Finish_r(fcgx);
+  client_io->complete_request();
+  delete client_io;
+
+  req->times.finish(ceph_clock_now(g_ceph_context));
+  op_tracker.finish(req->id, op_name, req->req_str, s->user.user_id, http_ret, req->times);
 
   dout(1) << "====== req done req=" << hex << req << dec << " http_status=" << http_ret << " ======" << dendl;
   delete req;
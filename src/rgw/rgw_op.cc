@@ -5,6 +5,9 @@
 #include <sstream>
 
 #include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
 #include "common/armor.h"
 #include "common/mime.h"
 #include "common/utf8.h"
@@ -1371,6 +1374,101 @@ void RGWPutObj::dispose_processor(RGWPutObjProcessor *processor)
   delete processor;
 }
 
+/*
+ * Computes the MD5 of the data of an upload.  The first chunk is hashed
+ * in place; once there is more, a thread of its own takes over, so
+ * hashing goes on while the request thread reads and writes.  The
+ * data it holds on to is bounded by rgw_put_obj_max_window_size.
+ */
+class RGWPutObjHasher : public Thread {
+  CephContext *cct;
+  MD5 hash;
+  Mutex lock;
+  Cond cond;
+  list<bufferlist> queue;
+  uint64_t queued;
+  bool hashed_first;
+  bool started;
+  bool done;
+
+  void *entry() {
+    Mutex::Locker l(lock);
+    while (true) {
+      if (queue.empty()) {
+        if (done)
+          break;
+        cond.Wait(lock);
+        continue;
+      }
+      bufferlist bl;
+      bl.claim(queue.front());
+      queue.pop_front();
+
+      lock.Unlock();
+      hash_bl(bl);
+      lock.Lock();
+
+      queued -= bl.length();
+      cond.Signal();
+    }
+    return NULL;
+  }
+
+  void hash_bl(bufferlist& bl) {
+    for (list<bufferptr>::const_iterator iter = bl.buffers().begin();
+         iter != bl.buffers().end(); ++iter) {
+      hash.Update((const byte *)iter->c_str(), iter->length());
+    }
+  }
+
+public:
+  RGWPutObjHasher(CephContext *_cct)
+    : cct(_cct), lock("RGWPutObjHasher::lock"), queued(0), hashed_first(false),
+      started(false), done(false) {}
+  ~RGWPutObjHasher() {
+    if (started) {
+      lock.Lock();
+      done = true;
+      cond.Signal();
+      lock.Unlock();
+      join();
+    }
+  }
+
+  void update(bufferlist& data) {
+    if (!started) {
+      if (!hashed_first) {
+        /* a small object may never need the thread */
+        hash_bl(data);
+        hashed_first = true;
+        return;
+      }
+      started = true;
+      create();
+    }
+
+    uint64_t max_queued = cct->_conf->rgw_put_obj_max_window_size;
+    Mutex::Locker l(lock);
+    while (queued && queued + data.length() > max_queued)
+      cond.Wait(lock);
+    queue.push_back(data);
+    queued += data.length();
+    cond.Signal();
+  }
+
+  void final(unsigned char *m) {
+    if (started) {
+      lock.Lock();
+      done = true;
+      cond.Signal();
+      lock.Unlock();
+      join();
+      started = false;
+    }
+    hash.Final(m);
+  }
+};
+
 void RGWPutObj::execute()
 {
   RGWPutObjProcessor *processor = NULL;
@@ -1378,7 +1476,7 @@ void RGWPutObj::execute()
   char supplied_md5[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
   char calc_md5[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
   unsigned char m[CEPH_CRYPTO_MD5_DIGESTSIZE];
-  MD5 hash;
+  RGWPutObjHasher hasher(s->cct);
   bufferlist bl, aclbl;
   map<string, bufferlist> attrs;
   int len;
@@ -1439,14 +1537,12 @@ void RGWPutObj::execute()
       break;
 
     void *handle;
-    const unsigned char *data_ptr = (const unsigned char *)data.c_str();
+    hasher.update(data);
 
     ret = processor->handle_data(data, ofs, &handle);
     if (ret < 0)
       goto done;
 
-    hash.Update(data_ptr, len);
-
     ret = processor->throttle_data(handle);
     if (ret < 0)
       goto done;
@@ -1466,7 +1562,7 @@ void RGWPutObj::execute()
     goto done;
   }
 
-  hash.Final(m);
+  hasher.final(m);
 
   buf_to_hex(m, CEPH_CRYPTO_MD5_DIGESTSIZE, calc_md5);
 
@@ -1532,7 +1628,7 @@ void RGWPostObj::execute()
   RGWPutObjProcessor *processor = NULL;
   char calc_md5[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
   unsigned char m[CEPH_CRYPTO_MD5_DIGESTSIZE];
-  MD5 hash;
+  RGWPutObjHasher hasher(s->cct);
   bufferlist bl, aclbl;
   int len = 0;
 
@@ -1569,14 +1665,12 @@ void RGWPostObj::execute()
        break;
 
      void *handle;
-     const unsigned char *data_ptr = (const unsigned char *)data.c_str();
+     hasher.update(data);
 
      ret = processor->handle_data(data, ofs, &handle);
      if (ret < 0)
        goto done;
 
-     hash.Update(data_ptr, len);
-
      ret = processor->throttle_data(handle);
      if (ret < 0)
        goto done;
@@ -1596,7 +1690,7 @@ void RGWPostObj::execute()
 
   s->obj_size = ofs;
 
-  hash.Final(m);
+  hasher.final(m);
   buf_to_hex(m, CEPH_CRYPTO_MD5_DIGESTSIZE, calc_md5);
 
   policy.encode(aclbl);
@@ -2252,25 +2346,96 @@ int RGWCompleteMultipart::verify_permission()
   return 0;
 }
 
+#define RGW_MULTIPART_PARTS_BATCH 1000
+
+/*
+ * Checks the parts of an upload being completed against the request as
+ * their info comes in, and builds the object's manifest from them.
+ */
+class RGWCompleteMultipart_CB : public RGWOmapBatchCB {
+  struct req_state *s;
+  RGWMPObj& mp;
+  vector<set<string> >& batches;
+  map<int, string>::iterator iter;
+  map<uint32_t, string>::iterator kiter;
+
+public:
+  MD5 hash;
+  RGWObjManifest manifest;
+  list<string> remove_objs; /* objects to be removed from index listing */
+  off_t ofs;
+
+  RGWCompleteMultipart_CB(struct req_state *_s, RGWMPObj& _mp, vector<set<string> >& _batches,
+                          map<int, string>& parts, map<uint32_t, string>& part_keys)
+    : s(_s), mp(_mp), batches(_batches), iter(parts.begin()), kiter(part_keys.begin()),
+      ofs(0) {}
+
+  int handle_batch(int batch, map<string, bufferlist>& vals) {
+    for (size_t i = 0; i < batches[batch].size(); ++i, ++iter, ++kiter) {
+      map<string, bufferlist>::iterator viter = vals.find(kiter->second);
+      if (viter == vals.end()) {
+        ldout(s->cct, 0) << "NOTICE: part " << kiter->first << " is gone" << dendl;
+        return -ERR_INVALID_PART;
+      }
+
+      RGWUploadPartInfo obj_part;
+      bufferlist::iterator bli = viter->second.begin();
+      try {
+        ::decode(obj_part, bli);
+      } catch (buffer::error& err) {
+        ldout(s->cct, 0) << "ERROR: could not part info, caught buffer::error" << dendl;
+        return -EIO;
+      }
+
+      string part_etag = rgw_string_unquote(iter->second);
+      if (part_etag.compare(obj_part.etag) != 0) {
+        ldout(s->cct, 0) << "NOTICE: etag mismatch: part: " << iter->first << " etag: " << iter->second << dendl;
+        return -ERR_INVALID_PART;
+      }
+
+      char etag[CEPH_CRYPTO_MD5_DIGESTSIZE];
+      hex_to_buf(obj_part.etag.c_str(), etag, CEPH_CRYPTO_MD5_DIGESTSIZE);
+      hash.Update((const byte *)etag, sizeof(etag));
+
+      string oid = mp.get_part(obj_part.num);
+      rgw_obj src_obj;
+      src_obj.init_ns(s->bucket, oid, mp_ns);
+
+      if (obj_part.manifest.empty()) {
+        RGWObjManifestPart& part = manifest.objs[ofs];
+
+        part.loc = src_obj;
+        part.loc_ofs = 0;
+        part.size = obj_part.size;
+      } else {
+        manifest.append(obj_part.manifest);
+      }
+
+      remove_objs.push_back(src_obj.object);
+
+      ofs += obj_part.size;
+    }
+    return 0;
+  }
+};
+
 void RGWCompleteMultipart::execute()
 {
   RGWMultiCompleteUpload *parts;
   map<int, string>::iterator iter;
   RGWMultiXMLParser parser;
   string meta_oid;
-  map<uint32_t, RGWUploadPartInfo> obj_parts;
-  map<uint32_t, RGWUploadPartInfo>::iterator obj_iter;
-  RGWAccessControlPolicy policy(s->cct);
+  set<string> keys;
+  map<uint32_t, string> part_keys;
+  map<uint32_t, string>::iterator kiter;
+  vector<set<string> > batches;
   map<string, bufferlist> attrs;
-  off_t ofs = 0;
-  MD5 hash;
   char final_etag[CEPH_CRYPTO_MD5_DIGESTSIZE];
   char final_etag_str[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 16];
   bufferlist etag_bl;
   rgw_obj meta_obj;
   rgw_obj target_obj;
   RGWMPObj mp;
-  RGWObjManifest manifest;
 
   ret = get_params();
   if (ret < 0)
@@ -2297,45 +2462,47 @@ void RGWCompleteMultipart::execute()
     return;
   }
 
-  // ensure that each part if of the minimum size
-  for (obj_iter = obj_parts.begin(); obj_iter != obj_parts.end(); ++obj_iter) {
-    if ((obj_iter->second).size < min_part_size) {
-      ret = -ERR_TOO_SMALL;
-      return;
-    }
-  }
-
   mp.init(s->object_str, upload_id);
   meta_oid = mp.get_meta();
+  meta_obj.init_ns(s->bucket, meta_oid, mp_ns);
 
-  ret = get_multiparts_info(store, s, meta_oid, obj_parts, policy, attrs);
+  ret = get_obj_attrs(store, s, meta_obj, attrs, NULL, NULL);
+  if (ret >= 0)
+    ret = store->omap_get_keys(meta_obj, keys);
   if (ret == -ENOENT)
     ret = -ERR_NO_SUCH_UPLOAD;
-  if (parts->parts.size() != obj_parts.size())
-    ret = -ERR_INVALID_PART;
   if (ret < 0)
     return;
 
-  for (iter = parts->parts.begin(), obj_iter = obj_parts.begin();
-       iter != parts->parts.end() && obj_iter != obj_parts.end();
-       ++iter, ++obj_iter) {
-    char etag[CEPH_CRYPTO_MD5_DIGESTSIZE];
-    if (iter->first != (int)obj_iter->first) {
-      ldout(s->cct, 0) << "NOTICE: parts num mismatch: next requested: " << iter->first << " next uploaded: " << obj_iter->first << dendl;
-      ret = -ERR_INVALID_PART;
-      return;
-    }
-    string part_etag = rgw_string_unquote(iter->second);
-    if (part_etag.compare(obj_iter->second.etag) != 0) {
-      ldout(s->cct, 0) << "NOTICE: etag mismatch: part: " << iter->first << " etag: " << iter->second << dendl;
+  for (set<string>::iterator siter = keys.begin(); siter != keys.end(); ++siter) {
+    if (siter->compare(0, 5, "part.") == 0)
+      part_keys[atoi(siter->c_str() + 5)] = *siter;
+  }
+  if (parts->parts.size() != part_keys.size()) {
+    ret = -ERR_INVALID_PART;
+    return;
+  }
+
+  for (iter = parts->parts.begin(), kiter = part_keys.begin();
+       iter != parts->parts.end() && kiter != part_keys.end();
+       ++iter, ++kiter) {
+    if (iter->first != (int)kiter->first) {
+      ldout(s->cct, 0) << "NOTICE: parts num mismatch: next requested: " << iter->first << " next uploaded: " << kiter->first << dendl;
       ret = -ERR_INVALID_PART;
       return;
     }
-
-    hex_to_buf(obj_iter->second.etag.c_str(), etag, CEPH_CRYPTO_MD5_DIGESTSIZE);
-    hash.Update((const byte *)etag, sizeof(etag));
+    if (batches.empty() || batches.back().size() >= RGW_MULTIPART_PARTS_BATCH)
+      batches.push_back(set<string>());
+    batches.back().insert(kiter->second);
   }
-  hash.Final((byte *)final_etag);
+
+  /* the info of the parts, with the manifest built as it comes in */
+  RGWCompleteMultipart_CB cb(s, mp, batches, parts->parts, part_keys);
+  ret = store->omap_get_vals_by_keys(meta_obj, batches, &cb);
+  if (ret < 0)
+    return;
+
+  cb.hash.Final((byte *)final_etag);
 
   buf_to_hex((unsigned char *)final_etag, sizeof(final_etag), final_etag_str);
   snprintf(&final_etag_str[CEPH_CRYPTO_MD5_DIGESTSIZE * 2],  sizeof(final_etag_str) - CEPH_CRYPTO_MD5_DIGESTSIZE * 2,
@@ -2348,28 +2515,9 @@ void RGWCompleteMultipart::execute()
 
   target_obj.init(s->bucket, s->object_str);
 
-  list<string> remove_objs; /* objects to be removed from index listing */
-  
-  for (obj_iter = obj_parts.begin(); obj_iter != obj_parts.end(); ++obj_iter) {
-    RGWUploadPartInfo& obj_part = obj_iter->second;
-    string oid = mp.get_part(obj_iter->second.num);
-    rgw_obj src_obj;
-    src_obj.init_ns(s->bucket, oid, mp_ns);
-
-    if (obj_part.manifest.empty()) {
-      RGWObjManifestPart& part = manifest.objs[ofs];
-
-      part.loc = src_obj;
-      part.loc_ofs = 0;
-      part.size = obj_iter->second.size;
-    } else {
-      manifest.append(obj_part.manifest);
-    }
-
-    remove_objs.push_back(src_obj.object);
-
-    ofs += obj_part.size;
-  }
+  RGWObjManifest& manifest = cb.manifest;
+  list<string>& remove_objs = cb.remove_objs;
+  off_t ofs = cb.ofs;
 
   manifest.obj_size = ofs;
 
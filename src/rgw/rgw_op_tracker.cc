@@ -0,0 +1,198 @@
+#include "rgw_op_tracker.h"
+
+#include <sstream>
+
+#include "common/admin_socket.h"
+#include "common/ceph_context.h"
+#include "common/config.h"
+#include "common/debug.h"
+#include "common/Formatter.h"
+#include "common/perf_counters.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+using namespace std;
+
+static const char *stage_names[RGW_OP_STAGE_MAX] = {
+  "queued",
+  "auth",
+  "permissions",
+  "init",
+  "execute",
+  "complete",
+  "log",
+};
+
+static const char *stage_lat_names[RGW_OP_STAGE_MAX] = {
+  "queued_lat",
+  "auth_lat",
+  "permissions_lat",
+  "init_lat",
+  "execute_lat",
+  "complete_lat",
+  "log_lat",
+};
+
+class RGWOpTracker::AdminHook : public AdminSocketHook {
+  RGWOpTracker *tracker;
+public:
+  AdminHook(RGWOpTracker *t) : tracker(t) {}
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+	    bufferlist& out) {
+    if (format == "")
+      format = "json-pretty";
+    Formatter *f = new_formatter(format);
+    stringstream ss;
+    tracker->dump_historic(f);
+    f->flush(ss);
+    delete f;
+    out.append(ss);
+    return true;
+  }
+};
+
+RGWOpTracker::RGWOpTracker(CephContext *_cct)
+  : cct(_cct), lock("RGWOpTracker::lock"), asok_hook(NULL)
+{
+  asok_hook = new AdminHook(this);
+  int r = cct->get_admin_socket()->register_command(
+    "dump_historic_ops", "dump_historic_ops", asok_hook,
+    "show the slowest recent requests, and where their time went");
+  if (r < 0) {
+    delete asok_hook;
+    asok_hook = NULL;
+  }
+}
+
+RGWOpTracker::~RGWOpTracker()
+{
+  if (asok_hook) {
+    cct->get_admin_socket()->unregister_command("dump_historic_ops");
+    delete asok_hook;
+  }
+  for (map<string, PerfCounters *>::iterator iter = loggers.begin(); iter != loggers.end(); ++iter) {
+    cct->get_perfcounters_collection()->remove(iter->second);
+    delete iter->second;
+  }
+}
+
+/* the op types are a handful, their loggers are made as they show up */
+PerfCounters *RGWOpTracker::get_logger(const string& op)
+{
+  map<string, PerfCounters *>::iterator iter = loggers.find(op);
+  if (iter != loggers.end())
+    return iter->second;
+
+  PerfCountersBuilder plb(cct, "rgw_op_" + op, l_rgw_op_first, l_rgw_op_last);
+  plb.add_u64_counter(l_rgw_op_reqs, "reqs");
+  plb.add_u64_counter(l_rgw_op_failed, "failed");
+  plb.add_time_avg(l_rgw_op_lat, "lat");
+  for (int i = 0; i < RGW_OP_STAGE_MAX; i++) {
+    plb.add_time_avg(l_rgw_op_stage_lat + i, stage_lat_names[i]);
+  }
+  plb.add_u64_counter(l_rgw_op_lat_10ms, "lat_lt_10ms");
+  plb.add_u64_counter(l_rgw_op_lat_100ms, "lat_lt_100ms");
+  plb.add_u64_counter(l_rgw_op_lat_1s, "lat_lt_1s");
+  plb.add_u64_counter(l_rgw_op_lat_10s, "lat_lt_10s");
+  plb.add_u64_counter(l_rgw_op_lat_inf, "lat_ge_10s");
+
+  PerfCounters *logger = plb.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+  loggers[op] = logger;
+  return logger;
+}
+
+void RGWOpTracker::trim_history(utime_t now)
+{
+  utime_t oldest = now;
+  oldest -= cct->_conf->rgw_op_history_duration;
+
+  multimap<utime_t, Record>::iterator iter = slowest.begin();
+  while (iter != slowest.end()) {
+    if (iter->second.times.stage_start < oldest)
+      slowest.erase(iter++);
+    else
+      ++iter;
+  }
+}
+
+void RGWOpTracker::finish(uint64_t id, const string& op, const string& req,
+                          const string& user, int http_status, RGWOpTimes& times)
+{
+  utime_t lat = times.total();
+
+  Mutex::Locker l(lock);
+
+  PerfCounters *logger = get_logger(op);
+  logger->inc(l_rgw_op_reqs);
+  if (http_status >= 500)
+    logger->inc(l_rgw_op_failed);
+  logger->tinc(l_rgw_op_lat, lat);
+  for (int i = 0; i < RGW_OP_STAGE_MAX; i++) {
+    logger->tinc(l_rgw_op_stage_lat + i, times.stage_lat[i]);
+  }
+
+  double secs = (double)lat;
+  if (secs < 0.01)
+    logger->inc(l_rgw_op_lat_10ms);
+  else if (secs < 0.1)
+    logger->inc(l_rgw_op_lat_100ms);
+  else if (secs < 1)
+    logger->inc(l_rgw_op_lat_1s);
+  else if (secs < 10)
+    logger->inc(l_rgw_op_lat_10s);
+  else
+    logger->inc(l_rgw_op_lat_inf);
+
+  size_t max = cct->_conf->rgw_op_history_size;
+  if (!max)
+    return;
+
+  trim_history(times.stage_start);
+
+  if (slowest.size() >= max) {
+    if (lat <= slowest.begin()->first)
+      return;
+    slowest.erase(slowest.begin());
+  }
+
+  Record& rec = slowest.insert(pair<utime_t, Record>(lat, Record()))->second;
+  rec.id = id;
+  rec.op = op;
+  rec.req = req;
+  rec.user = user;
+  rec.http_status = http_status;
+  rec.times = times;
+}
+
+void RGWOpTracker::dump_historic(Formatter *f)
+{
+  Mutex::Locker l(lock);
+
+  trim_history(ceph_clock_now(cct));
+
+  f->open_object_section("historic_ops");
+  f->dump_unsigned("size", cct->_conf->rgw_op_history_size);
+  f->dump_unsigned("duration", cct->_conf->rgw_op_history_duration);
+  f->open_array_section("ops");
+  multimap<utime_t, Record>::reverse_iterator iter;
+  for (iter = slowest.rbegin(); iter != slowest.rend(); ++iter) {
+    Record& rec = iter->second;
+    f->open_object_section("op");
+    f->dump_unsigned("id", rec.id);
+    f->dump_string("op", rec.op);
+    f->dump_string("request", rec.req);
+    f->dump_string("user", rec.user);
+    f->dump_int("http_status", rec.http_status);
+    f->dump_stream("initiated_at") << rec.times.start;
+    f->dump_float("duration", (double)iter->first);
+    f->open_object_section("stages");
+    for (int i = 0; i < RGW_OP_STAGE_MAX; i++) {
+      f->dump_float(stage_names[i], (double)rec.times.stage_lat[i]);
+    }
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section();
+  f->close_section();
+}
@@ -0,0 +1,105 @@
+#ifndef CEPH_RGW_OP_TRACKER_H
+#define CEPH_RGW_OP_TRACKER_H
+
+#include <map>
+#include <string>
+
+#include "common/Formatter.h"
+#include "common/Mutex.h"
+#include "include/utime.h"
+
+class CephContext;
+class PerfCounters;
+
+/* the stages a request goes through in RGWProcess::handle_request() */
+enum {
+  RGW_OP_STAGE_QUEUED = 0,    /* waiting for a worker thread */
+  RGW_OP_STAGE_AUTH,          /* getting the handler and op, authorizing */
+  RGW_OP_STAGE_PERMISSIONS,   /* bucket and object info, acls */
+  RGW_OP_STAGE_INIT,          /* op init and verification */
+  RGW_OP_STAGE_EXECUTE,       /* the op itself: index prepare, data, index complete */
+  RGW_OP_STAGE_COMPLETE,      /* sending the response */
+  RGW_OP_STAGE_LOG,           /* ops and usage logging */
+  RGW_OP_STAGE_MAX,
+};
+
+/* per op type counters, in the rgw_op_<op name> loggers */
+enum {
+  l_rgw_op_first = 15500,
+  l_rgw_op_reqs,
+  l_rgw_op_failed,
+  l_rgw_op_lat,
+  l_rgw_op_stage_lat,
+  l_rgw_op_stage_lat_last = l_rgw_op_stage_lat + RGW_OP_STAGE_MAX - 1,
+  l_rgw_op_lat_10ms,          /* requests that took less than 10ms */
+  l_rgw_op_lat_100ms,
+  l_rgw_op_lat_1s,
+  l_rgw_op_lat_10s,
+  l_rgw_op_lat_inf,           /* 10s or more */
+  l_rgw_op_last,
+};
+
+/* where the time of a request went */
+struct RGWOpTimes {
+  utime_t start;
+  utime_t stage_start;
+  int stage;
+  utime_t stage_lat[RGW_OP_STAGE_MAX];
+
+  RGWOpTimes() : stage(-1) {}
+
+  void begin(utime_t now) {
+    start = stage_start = now;
+    stage = RGW_OP_STAGE_QUEUED;
+  }
+  void enter(int new_stage, utime_t now) {
+    if (stage >= 0)
+      stage_lat[stage] += now - stage_start;
+    stage = new_stage;
+    stage_start = now;
+  }
+  void finish(utime_t now) {
+    enter(-1, now);
+  }
+  utime_t total() const {
+    return stage_start - start;
+  }
+};
+
+/*
+ * Accounts finished requests to the counters of their op type, and keeps
+ * the rgw_op_history_size slowest of those that finished within the last
+ * rgw_op_history_duration seconds, shown by the dump_historic_ops admin
+ * socket command.
+ */
+class RGWOpTracker {
+  struct Record {
+    uint64_t id;
+    std::string op;
+    std::string req;
+    std::string user;
+    int http_status;
+    RGWOpTimes times;
+  };
+
+  class AdminHook;
+
+  CephContext *cct;
+  Mutex lock;
+  std::map<std::string, PerfCounters *> loggers;
+  std::multimap<utime_t, Record> slowest;   /* by duration */
+  AdminHook *asok_hook;
+
+  PerfCounters *get_logger(const std::string& op);
+  void trim_history(utime_t now);
+
+public:
+  RGWOpTracker(CephContext *_cct);
+  ~RGWOpTracker();
+
+  void finish(uint64_t id, const std::string& op, const std::string& req,
+              const std::string& user, int http_status, RGWOpTimes& times);
+  void dump_historic(Formatter *f);
+};
+
+#endif
@@ -16,6 +16,8 @@
 #include "include/utime.h"
 #include "common/lru_map.h"
 #include "common/RefCountedObj.h"
+#include "common/Mutex.h"
+#include "common/Cond.h"
 
 #include "rgw_common.h"
 #include "rgw_rados.h"
@@ -30,15 +32,32 @@ struct RGWQuotaBucketStats {
   utime_t async_refresh_time;
 };
 
+/* a read of the stats of a bucket that others wait for, not to do their own */
+struct RGWQuotaStatsFetch {
+  int refs;
+  bool done;
+  int ret;
+  RGWBucketStats stats;
+
+  RGWQuotaStatsFetch() : refs(1), done(false), ret(0) {}
+};
+
 class RGWBucketStatsCache {
   RGWRados *store;
   lru_map<rgw_bucket, RGWQuotaBucketStats> stats_map;
   RefCountedWaitObject *async_refcount;
 
+  Mutex fetch_lock;
+  Cond fetch_cond;
+  map<rgw_bucket, RGWQuotaStatsFetch *> fetches;
+
   int fetch_bucket_totals(rgw_bucket& bucket, RGWBucketStats& stats);
+  int fetch_bucket_totals_shared(rgw_bucket& bucket, RGWBucketStats& stats,
+                                 RGWQuotaBucketStats *cached, RGWQuotaInfo& quota);
 
 public:
-  RGWBucketStatsCache(RGWRados *_store) : store(_store), stats_map(store->ctx()->_conf->rgw_bucket_quota_cache_size) {
+  RGWBucketStatsCache(RGWRados *_store) : store(_store), stats_map(store->ctx()->_conf->rgw_bucket_quota_cache_size),
+                                          fetch_lock("RGWBucketStatsCache::fetch_lock") {
     async_refcount = new RefCountedWaitObject;
   }
   ~RGWBucketStatsCache() {
@@ -223,7 +242,8 @@ void RGWBucketStatsCache::set_stats(rgw_bucket& bucket, RGWQuotaBucketStats& qs,
 int RGWBucketStatsCache::get_bucket_stats(rgw_bucket& bucket, RGWBucketStats& stats, RGWQuotaInfo& quota) {
   RGWQuotaBucketStats qs;
   utime_t now = ceph_clock_now(store->ctx());
-  if (stats_map.find(bucket, qs)) {
+  bool found = stats_map.find(bucket, qs);
+  if (found) {
     if (qs.async_refresh_time.sec() > 0 && now >= qs.async_refresh_time) {
       int r = async_refresh(bucket, qs);
       if (r < 0) {
@@ -239,13 +259,66 @@ int RGWBucketStatsCache::get_bucket_stats(rgw_bucket& bucket, RGWBucketStats& st
     }
   }
 
-  int ret = fetch_bucket_totals(bucket, stats);
-  if (ret < 0 && ret != -ENOENT)
+  return fetch_bucket_totals_shared(bucket, stats, (found ? &qs : NULL), quota);
+}
+
+/*
+ * Only one thread reads the stats of a bucket at a time; the others
+ * wait for what it gets, or, if the stats they have are no more than
+ * rgw_bucket_quota_stale_grace past their expiration, go on with them.
+ */
+int RGWBucketStatsCache::fetch_bucket_totals_shared(rgw_bucket& bucket, RGWBucketStats& stats,
+                                                    RGWQuotaBucketStats *cached, RGWQuotaInfo& quota)
+{
+  fetch_lock.Lock();
+  map<rgw_bucket, RGWQuotaStatsFetch *>::iterator iter = fetches.find(bucket);
+  if (iter != fetches.end()) {
+    RGWQuotaStatsFetch *fetch = iter->second;
+    if (cached && can_use_cached_stats(quota, cached->stats)) {
+      utime_t stale_limit = cached->expiration;
+      stale_limit += store->ctx()->_conf->rgw_bucket_quota_stale_grace;
+      if (ceph_clock_now(store->ctx()) < stale_limit) {
+        fetch_lock.Unlock();
+        ldout(store->ctx(), 20) << "quota: using stale stats for bucket=" << bucket << " while they are read" << dendl;
+        stats = cached->stats;
+        return 0;
+      }
+    }
+
+    fetch->refs++;
+    while (!fetch->done)
+      fetch_cond.Wait(fetch_lock);
+    int ret = fetch->ret;
+    stats = fetch->stats;
+    if (--fetch->refs == 0)
+      delete fetch;
+    fetch_lock.Unlock();
     return ret;
+  }
 
-  set_stats(bucket, qs, stats);
+  RGWQuotaStatsFetch *fetch = new RGWQuotaStatsFetch;
+  fetches[bucket] = fetch;
+  fetch_lock.Unlock();
 
-  return 0;
+  int ret = fetch_bucket_totals(bucket, stats);
+  if (ret == -ENOENT)
+    ret = 0;
+  if (ret == 0) {
+    RGWQuotaBucketStats qs;
+    set_stats(bucket, qs, stats);
+  }
+
+  fetch_lock.Lock();
+  fetches.erase(bucket);
+  fetch->ret = ret;
+  fetch->stats = stats;
+  fetch->done = true;
+  fetch_cond.SignalAll();
+  if (--fetch->refs == 0)
+    delete fetch;
+  fetch_lock.Unlock();
+
+  return ret;
 }
 
 
@@ -16,6 +16,7 @@
 #include "rgw_bucket.h"
 
 #include "cls/rgw/cls_rgw_types.h"
+#include "cls/rgw/cls_rgw_ops.h"
 #include "cls/rgw/cls_rgw_client.h"
 #include "cls/refcount/cls_refcount_client.h"
 #include "cls/version/cls_version_client.h"
@@ -26,6 +27,7 @@
 #include "rgw_tools.h"
 
 #include "common/Clock.h"
+#include "include/ceph_hash.h"
 
 #include "include/rados/librados.hpp"
 using namespace librados;
@@ -607,6 +609,8 @@ int RGWPutObjProcessor_Aio::handle_obj_data(rgw_obj& obj, bufferlist& bl, off_t
   if ((uint64_t)abs_ofs + bl.length() > obj_len)
     obj_len = abs_ofs + bl.length();
 
+  last_write_size = bl.length();
+
   // For the first call pass -1 as the offset to
   // do a write_full.
   int r = store->aio_put_obj_data(NULL, obj,
@@ -622,6 +626,7 @@ struct put_obj_aio_info RGWPutObjProcessor_Aio::pop_pending()
   struct put_obj_aio_info info;
   info = pending.front();
   pending.pop_front();
+  pending_size -= info.size;
   return info;
 }
 
@@ -657,21 +662,18 @@ int RGWPutObjProcessor_Aio::throttle_data(void *handle)
   if (handle) {
     struct put_obj_aio_info info;
     info.handle = handle;
+    info.size = last_write_size;
     pending.push_back(info);
+    pending_size += info.size;
   }
-  size_t orig_size = pending.size();
   while (pending_has_completed()) {
     int r = wait_pending_front();
     if (r < 0)
       return r;
   }
 
-  /* resize window in case messages are draining too fast */
-  if (orig_size - pending.size() >= max_chunks) {
-    max_chunks++;
-  }
-
-  if (pending.size() > max_chunks) {
+  uint64_t max_size = store->ctx()->_conf->rgw_put_obj_max_window_size;
+  while (pending.size() > 1 && pending_size > max_size) {
     int r = wait_pending_front();
     if (r < 0)
       return r;
@@ -863,8 +865,252 @@ void RGWRadosCtx::set_prefetch_data(rgw_obj& obj) {
   }
 }
 
+/*
+ * Sends the completions of index operations.  They are not waited for,
+ * and while one is in flight to an index object the next ones to it
+ * are queued, and then sent together in one call.
+ */
+class RGWIndexCompleter {
+  struct Shard {
+    librados::IoCtx io_ctx;
+    string oid;
+    list<rgw_cls_obj_complete_op> queued;
+    set<string> queued_names;
+    int in_flight;
+
+    Shard() : in_flight(0) {}
+  };
+
+  struct Batch {
+    RGWIndexCompleter *completer;
+    string key;
+    list<rgw_cls_obj_complete_op> ops;
+    bool multi;
+    utime_t sent;
+  };
+
+  CephContext *cct;
+  Mutex lock;
+  Cond cond;
+  map<string, Shard> shards;
+  int num_in_flight;
+  bool multi_supported;
+
+  static void complete_cb(librados::completion_t c, void *arg) {
+    Batch *batch = (Batch *)arg;
+    batch->completer->handle_complete(batch, rados_aio_get_return_value(c));
+  }
+
+  void send(const string& key, Shard& shard, list<rgw_cls_obj_complete_op>& ops) {
+    if (ops.size() > 1 && !multi_supported) {
+      while (!ops.empty()) {
+        list<rgw_cls_obj_complete_op> single;
+        single.splice(single.end(), ops, ops.begin());
+        send(key, shard, single);
+      }
+      return;
+    }
+
+    Batch *batch = new Batch;
+    batch->completer = this;
+    batch->key = key;
+    batch->ops.swap(ops);
+    batch->multi = (batch->ops.size() > 1);
+    batch->sent = ceph_clock_now(cct);
+
+    ObjectWriteOperation o;
+    if (batch->multi) {
+      cls_rgw_bucket_complete_ops(o, batch->ops);
+    } else {
+      rgw_cls_obj_complete_op& op = batch->ops.front();
+      cls_rgw_bucket_complete_op(o, op.op, op.tag, op.ver, op.name, op.meta, &op.remove_objs, op.log_op);
+    }
+
+    librados::AioCompletion *c = librados::Rados::aio_create_completion(batch, NULL, complete_cb);
+    int r = shard.io_ctx.aio_operate(shard.oid, c, &o);
+    c->release();
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: failed to send index completion to " << shard.oid << ": r=" << r << dendl;
+      delete batch;
+      return;
+    }
+    shard.in_flight++;
+    num_in_flight++;
+  }
+
+  void send_queued(const string& key, Shard& shard) {
+    shard.queued_names.clear();
+    list<rgw_cls_obj_complete_op> ops;
+    ops.swap(shard.queued);
+    send(key, shard, ops);
+  }
+
+  void handle_complete(Batch *batch, int r) {
+    if (perfcounter)
+      perfcounter->tinc(l_rgw_index_complete_lat, ceph_clock_now(cct) - batch->sent);
+
+    Mutex::Locker l(lock);
+    map<string, Shard>::iterator iter = shards.find(batch->key);
+    assert(iter != shards.end());
+    Shard& shard = iter->second;
+    shard.in_flight--;
+    num_in_flight--;
+
+    if (r == -EOPNOTSUPP && batch->multi) {
+      /* the osd does not know of batches yet */
+      if (multi_supported)
+        ldout(cct, 1) << "index objects do not take batched completions; sending them one by one" << dendl;
+      multi_supported = false;
+      send(batch->key, shard, batch->ops);
+    } else if (r < 0) {
+      ldout(cct, 0) << "ERROR: index completion on " << shard.oid << " returned " << r << dendl;
+    }
+    delete batch;
+
+    if (!shard.in_flight) {
+      if (!shard.queued.empty())
+        send_queued(iter->first, shard);
+      else
+        shards.erase(iter);
+    }
+    cond.Signal();
+  }
+
+public:
+  RGWIndexCompleter(CephContext *_cct)
+    : cct(_cct), lock("RGWIndexCompleter::lock"), num_in_flight(0),
+      multi_supported(true) {}
+  ~RGWIndexCompleter() {
+    drain();
+  }
+
+  void queue(librados::IoCtx& io_ctx, const string& oid, rgw_cls_obj_complete_op& op) {
+    Mutex::Locker l(lock);
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld:", (long long)io_ctx.get_id());
+    string key = buf + oid;
+
+    Shard& shard = shards[key];
+    if (shard.oid.empty()) {
+      shard.io_ctx = io_ctx;
+      shard.oid = oid;
+    }
+
+    /* a batch may not complete an entry twice */
+    if (shard.queued_names.count(op.name))
+      send_queued(key, shard);
+
+    shard.queued.push_back(op);
+    shard.queued_names.insert(op.name);
+
+    size_t max_batch = max(1, (int)cct->_conf->rgw_bucket_index_max_complete_batch);
+    if (!shard.in_flight || shard.queued.size() >= max_batch)
+      send_queued(key, shard);
+
+    if (!shard.in_flight && shard.queued.empty())
+      shards.erase(key);
+  }
+
+  /* wait for what was queued to be sent and applied */
+  void drain() {
+    Mutex::Locker l(lock);
+    while (num_in_flight)
+      cond.Wait(lock);
+  }
+};
+
+/*
+ * Appends to the metadata and data logs.  Entries for a log shard that
+ * come in while an append to it is in flight wait for it, and then go
+ * out together in one op; the first of them waits another
+ * rgw_log_batch_window_ms before sending, for more to join.
+ */
+class RGWTimeLogBatcher {
+  struct Batch {
+    list<cls_log_entry> entries;
+    int refs;
+    bool done;
+    int ret;
+
+    Batch() : refs(0), done(false), ret(0) {}
+  };
+
+  struct Shard {
+    bool flushing;
+    Batch *next;
+
+    Shard() : flushing(false), next(NULL) {}
+  };
+
+  RGWRados *store;
+  CephContext *cct;
+  Mutex lock;
+  Cond cond;
+  map<string, Shard> shards;
+
+  void put_batch(Batch *batch) {
+    if (--batch->refs == 0)
+      delete batch;
+  }
+
+public:
+  RGWTimeLogBatcher(RGWRados *_store)
+    : store(_store), cct(_store->ctx()), lock("RGWTimeLogBatcher::lock") {}
+
+  int add(const string& oid, cls_log_entry& entry) {
+    Mutex::Locker l(lock);
+    Shard *shard = &shards[oid];
+    Batch *batch = shard->next;
+    if (batch) {
+      /* someone is sending it */
+      batch->entries.push_back(entry);
+      batch->refs++;
+      while (!batch->done)
+        cond.Wait(lock);
+      int ret = batch->ret;
+      put_batch(batch);
+      return ret;
+    }
+
+    batch = new Batch;
+    batch->entries.push_back(entry);
+    batch->refs++;
+    shard->next = batch;
+
+    int window_ms = cct->_conf->rgw_log_batch_window_ms;
+    if (window_ms > 0)
+      cond.WaitInterval(cct, lock, utime_t(window_ms / 1000, (window_ms % 1000) * 1000000));
+    while (shard->flushing) {
+      cond.Wait(lock);
+      shard = &shards[oid];
+    }
+    shard->flushing = true;
+    shard->next = NULL;
+
+    lock.Unlock();
+    ldout(cct, 20) << "appending " << batch->entries.size() << " entries to log " << oid << dendl;
+    int ret = store->time_log_add(oid, batch->entries);
+    lock.Lock();
+
+    shard = &shards[oid];
+    shard->flushing = false;
+    if (!shard->next)
+      shards.erase(oid);
+    batch->ret = ret;
+    batch->done = true;
+    cond.SignalAll();
+    put_batch(batch);
+    return ret;
+  }
+};
+
 void RGWRados::finalize()
 {
+  delete time_log_batcher;
+  time_log_batcher = NULL;
+  delete index_completer;
+  index_completer = NULL;
   if (need_watch_notify()) {
     finalize_watch();
   }
@@ -924,6 +1170,9 @@ int RGWRados::init_complete()
 {
   int ret;
 
+  index_completer = new RGWIndexCompleter(cct);
+  time_log_batcher = new RGWTimeLogBatcher(this);
+
   ret = region.init(cct, this);
   if (ret < 0)
     return ret;
@@ -1212,6 +1461,40 @@ int RGWRados::open_bucket_data_ctx(rgw_bucket& bucket, librados::IoCtx& data_ctx
   return 0;
 }
 
+/*
+ * The index of a bucket is .dir.<marker>, or with num_shards shards
+ * .dir.<marker>.0 to .dir.<marker>.<num_shards - 1>, each entry kept in
+ * the shard its name hashes to.  Shard -1 is the one object of an
+ * unsharded index.
+ */
+static void get_bucket_index_objects(const string& bucket_oid_base, uint32_t num_shards,
+                                     map<int, string>& bucket_objs)
+{
+  bucket_objs.clear();
+  if (!num_shards) {
+    bucket_objs[-1] = bucket_oid_base;
+    return;
+  }
+  for (uint32_t i = 0; i < num_shards; i++) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), ".%u", i);
+    bucket_objs[i] = bucket_oid_base + buf;
+  }
+}
+
+static void get_bucket_index_object(const string& bucket_oid_base, uint32_t num_shards,
+                                    const string& obj_key, string& bucket_obj)
+{
+  if (!num_shards) {
+    bucket_obj = bucket_oid_base;
+    return;
+  }
+  uint32_t shard = ceph_str_hash_linux(obj_key.c_str(), obj_key.size()) % num_shards;
+  char buf[16];
+  snprintf(buf, sizeof(buf), ".%u", shard);
+  bucket_obj = bucket_oid_base + buf;
+}
+
 int RGWRados::open_bucket_index_ctx(rgw_bucket& bucket, librados::IoCtx& index_ctx)
 {
   int r = open_bucket_pool_ctx(bucket.name, bucket.index_pool, index_ctx);
@@ -1496,25 +1779,59 @@ next:
 
 int RGWRados::trim_usage(string& user, uint64_t start_epoch, uint64_t end_epoch)
 {
+  librados::IoCtx io_ctx;
+  int r = rados->ioctx_create(zone.usage_log_pool.name.c_str(), io_ctx);
+  if (r < 0)
+    return r;
+
   uint32_t index = 0;
   string hash, first_hash;
   usage_log_hash(cct, user, first_hash, index);
 
   hash = first_hash;
 
+  /* trim the shards in parallel, a window at a time */
+  unsigned max_aio = max(1, cct->_conf->rgw_admin_max_concurrent_ops);
+  list<librados::AioCompletion *> completions;
+  int ret = 0;
   do {
-    int ret =  cls_obj_usage_log_trim(hash, user, start_epoch, end_epoch);
-    if (ret == -ENOENT)
-      goto next;
+    if (completions.size() >= max_aio) {
+      librados::AioCompletion *c = completions.front();
+      completions.pop_front();
+      c->wait_for_safe();
+      r = c->get_return_value();
+      c->release();
+      if (r < 0 && r != -ENOENT && ret >= 0)
+        ret = r;
+      if (ret < 0)
+        break;
+    }
 
-    if (ret < 0)
-      return ret;
+    librados::ObjectWriteOperation op;
+    cls_rgw_usage_log_trim(op, user, start_epoch, end_epoch);
+    librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    r = io_ctx.aio_operate(hash, c, &op);
+    if (r < 0) {
+      c->release();
+      ret = r;
+      break;
+    }
+    completions.push_back(c);
 
-next:
     usage_log_hash(cct, user, hash, ++index);
   } while (hash != first_hash);
 
-  return 0;
+  list<librados::AioCompletion *>::iterator citer;
+  for (citer = completions.begin(); citer != completions.end(); ++citer) {
+    librados::AioCompletion *c = *citer;
+    c->wait_for_safe();
+    r = c->get_return_value();
+    c->release();
+    if (r < 0 && r != -ENOENT && ret >= 0)
+      ret = r;
+  }
+
+  return ret;
 }
 
 void RGWRados::shard_name(const string& prefix, unsigned max_shards, const string& key, string& name)
@@ -1541,6 +1858,12 @@ void RGWRados::time_log_prepare_entry(cls_log_entry& entry, const utime_t& ut, s
 
 int RGWRados::time_log_add(const string& oid, const utime_t& ut, const string& section, const string& key, bufferlist& bl)
 {
+  if (time_log_batcher) {
+    cls_log_entry entry;
+    cls_log_add_prepare_entry(entry, ut, section, key, bl);
+    return time_log_batcher->add(oid, entry);
+  }
+
   librados::IoCtx io_ctx;
 
   const char *log_pool = zone.log_pool.name.c_str();
@@ -1757,13 +2080,31 @@ int RGWRados::list_objects(rgw_bucket& bucket, int max, string& prefix, string&
   prefix_obj.set_obj(prefix);
   string cur_prefix = prefix_obj.object;
 
+  /*
+   * let the index collapse the common prefixes, unless a filter has to
+   * see every name, or the names' namespace marks could be mistaken for
+   * the delimiter
+   */
+  bool index_delim = (!delim.empty() && enforce_ns && !filter &&
+                      !(cur_prefix.empty() && delim[0] == '_'));
+
   do {
     std::map<string, RGWObjEnt> ent_map;
+    set<string> index_prefixes;
     int r = cls_bucket_list(bucket, cur_marker, cur_prefix, max - count, ent_map,
-                            &truncated, &cur_marker);
+                            &truncated, &cur_marker, NULL,
+                            delim, (index_delim ? &index_prefixes : NULL));
     if (r < 0)
       return r;
 
+    set<string>::iterator piter;
+    for (piter = index_prefixes.begin(); piter != index_prefixes.end(); ++piter) {
+      string obj = *piter;
+      if (!rgw_obj::translate_raw_obj_to_obj_in_ns(obj, ns))
+        continue;
+      common_prefixes[obj] = true;
+    }
+
     std::map<string, RGWObjEnt>::iterator eiter;
     for (eiter = ent_map.begin(); eiter != ent_map.end(); ++eiter) {
       string obj = eiter->first;
@@ -1839,7 +2180,7 @@ int RGWRados::create_pool(rgw_bucket& bucket)
   return 0;
 }
 
-int RGWRados::init_bucket_index(rgw_bucket& bucket)
+int RGWRados::init_bucket_index(rgw_bucket& bucket, uint32_t num_shards)
 {
   librados::IoCtx index_ctx; // context for new bucket
 
@@ -1850,11 +2191,37 @@ int RGWRados::init_bucket_index(rgw_bucket& bucket)
   string dir_oid =  dir_oid_prefix;
   dir_oid.append(bucket.marker);
 
-  librados::ObjectWriteOperation op;
-  op.create(true);
-  r = cls_rgw_init_index(index_ctx, op, dir_oid);
-  if (r < 0 && r != -EEXIST)
-    return r;
+  map<int, string> bucket_objs;
+  get_bucket_index_objects(dir_oid, num_shards, bucket_objs);
+
+  /* create the shards in parallel */
+  list<librados::AioCompletion *> completions;
+  map<int, string>::iterator iter;
+  for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+    librados::ObjectWriteOperation op;
+    op.create(true);
+    cls_rgw_bucket_init(op);
+    librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    r = index_ctx.aio_operate(iter->second, c, &op);
+    if (r < 0) {
+      c->release();
+      break;
+    }
+    completions.push_back(c);
+  }
+
+  int ret = r;
+  list<librados::AioCompletion *>::iterator citer;
+  for (citer = completions.begin(); citer != completions.end(); ++citer) {
+    librados::AioCompletion *c = *citer;
+    c->wait_for_safe();
+    r = c->get_return_value();
+    c->release();
+    if (r < 0 && r != -EEXIST && ret >= 0)
+      ret = r;
+  }
+  if (ret < 0 && ret != -EEXIST)
+    return ret;
 
   return 0;
 }
@@ -1907,7 +2274,10 @@ int RGWRados::create_bucket(RGWUserInfo& owner, rgw_bucket& bucket,
     string dir_oid =  dir_oid_prefix;
     dir_oid.append(bucket.marker);
 
-    r = init_bucket_index(bucket);
+    int max_shards = cct->_conf->rgw_bucket_index_max_shards;
+    uint32_t num_shards = (max_shards > 0 ? max_shards : 0);
+
+    r = init_bucket_index(bucket, num_shards);
     if (r < 0)
       return r;
 
@@ -1923,6 +2293,7 @@ int RGWRados::create_bucket(RGWUserInfo& owner, rgw_bucket& bucket,
     info.owner = owner.user_id;
     info.region = region_name;
     info.placement_rule = selected_placement_rule;
+    info.num_shards = num_shards;
     if (!creation_time)
       time(&info.creation_time);
     else
@@ -1954,7 +2325,12 @@ int RGWRados::create_bucket(RGWUserInfo& owner, rgw_bucket& bucket,
         if (r < 0)
           return r;
 
-        index_ctx.remove(dir_oid);
+        map<int, string> bucket_objs;
+        get_bucket_index_objects(dir_oid, num_shards, bucket_objs);
+        map<int, string>::iterator iter;
+        for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+          index_ctx.remove(iter->second);
+        }
       }
       /* ret == -ENOENT here */
     }
@@ -2809,21 +3185,45 @@ set_err_state:
   }
 
   if (!copy_itself) {
-    for (; miter != astate->manifest.objs.end(); ++miter) {
-      RGWObjManifestPart& part = miter->second;
-      ObjectWriteOperation op;
-      manifest.objs[miter->first] = part;
-      cls_refcount_get(op, tag, true);
-
-      get_obj_bucket_and_oid_key(part.loc, bucket, oid, key);
-      io_ctx.locator_set_key(key);
-
-      ret = io_ctx.operate(oid, &op);
-      if (ret < 0)
-        goto done_ret;
+    /* take the references on the tail a window at a time */
+    size_t max_aio = max(1, (int)cct->_conf->rgw_copy_obj_max_aio);
+    list<pair<rgw_obj, librados::AioCompletion *> > pending;
+    for (; miter != astate->manifest.objs.end() || !pending.empty(); ) {
+      if (ret >= 0 && miter != astate->manifest.objs.end() && pending.size() < max_aio) {
+        RGWObjManifestPart& part = miter->second;
+        ObjectWriteOperation op;
+        manifest.objs[miter->first] = part;
+        cls_refcount_get(op, tag, true);
+
+        get_obj_bucket_and_oid_key(part.loc, bucket, oid, key);
+        io_ctx.locator_set_key(key);
+
+        librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+        int r = io_ctx.aio_operate(oid, c, &op);
+        if (r < 0) {
+          c->release();
+          ret = r;
+        } else {
+          pending.push_back(make_pair(part.loc, c));
+        }
+        ++miter;
+        continue;
+      }
+      if (pending.empty())
+        break;
 
-      ref_objs.push_back(part.loc);
+      librados::AioCompletion *c = pending.front().second;
+      c->wait_for_safe();
+      int r = c->get_return_value();
+      c->release();
+      if (r >= 0)
+        ref_objs.push_back(pending.front().first);
+      else if (ret >= 0)
+        ret = r;
+      pending.pop_front();
     }
+    if (ret < 0)
+      goto done_ret;
     manifest.obj_size = total_len;
 
     pmanifest = &manifest;
@@ -2849,6 +3249,8 @@ set_err_state:
   ep.ptag = &tag;
 
   ret = put_obj_meta(ctx, dest_obj, end + 1, src_attrs, category, PUT_OBJ_CREATE, ep);
+  if (ret < 0)
+    goto done_ret;
 
   if (mtime)
     obj_stat(ctx, dest_obj, NULL, mtime, NULL, NULL, NULL, NULL);
@@ -2965,8 +3367,8 @@ done_err:
 int RGWRados::delete_bucket(rgw_bucket& bucket, RGWObjVersionTracker& objv_tracker)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
@@ -3094,7 +3496,8 @@ int RGWRados::complete_atomic_overwrite(RGWRadosCtx *rctx, RGWObjState *state, r
   return ret;
 }
 
-int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx, string& bucket_oid)
+int RGWRados::open_bucket_index_base(rgw_bucket& bucket, librados::IoCtx& index_ctx,
+                                     string& bucket_oid_base, uint32_t *num_shards)
 {
   if (bucket_is_system(bucket))
     return -EINVAL;
@@ -3108,12 +3511,124 @@ int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx,
     return -EIO;
   }
 
-  bucket_oid = dir_oid_prefix;
-  bucket_oid.append(bucket.marker);
+  bucket_oid_base = dir_oid_prefix;
+  bucket_oid_base.append(bucket.marker);
+
+  /* the bucket instance info is cached, so this is usually cheap */
+  RGWBucketInfo info;
+  string oid;
+  get_bucket_meta_oid(bucket, oid);
+  r = get_bucket_instance_from_oid(NULL, oid, info, NULL, NULL);
+  if (r == -ENOENT) {
+    /* buckets from before bucket instances were never sharded */
+    *num_shards = 0;
+    return 0;
+  }
+  if (r < 0) {
+    ldout(cct, 0) << "ERROR: could not read bucket instance info of " << bucket << ": r=" << r << dendl;
+    return r;
+  }
+  *num_shards = info.num_shards;
 
   return 0;
 }
 
+int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx,
+                                map<int, string>& bucket_objs)
+{
+  string bucket_oid_base;
+  uint32_t num_shards;
+  int r = open_bucket_index_base(bucket, index_ctx, bucket_oid_base, &num_shards);
+  if (r < 0)
+    return r;
+
+  get_bucket_index_objects(bucket_oid_base, num_shards, bucket_objs);
+  return 0;
+}
+
+int RGWRados::open_bucket_index_shard(rgw_bucket& bucket, librados::IoCtx& index_ctx,
+                                      const string& obj_key, string& bucket_obj)
+{
+  string bucket_oid_base;
+  uint32_t num_shards;
+  int r = open_bucket_index_base(bucket, index_ctx, bucket_oid_base, &num_shards);
+  if (r < 0)
+    return r;
+
+  get_bucket_index_object(bucket_oid_base, num_shards, obj_key, bucket_obj);
+  return 0;
+}
+
+/* add the stats and versions of a shard's header to those of the bucket */
+static void accumulate_raw_stats(rgw_bucket_dir_header& header, rgw_bucket_dir_header& total)
+{
+  total.ver += header.ver;
+  total.master_ver += header.master_ver;
+
+  map<uint8_t, struct rgw_bucket_category_stats>::iterator iter = header.stats.begin();
+  for (; iter != header.stats.end(); ++iter) {
+    struct rgw_bucket_category_stats& dest = total.stats[iter->first];
+    struct rgw_bucket_category_stats& s = iter->second;
+    dest.total_size += s.total_size;
+    dest.total_size_rounded += s.total_size_rounded;
+    dest.num_entries += s.num_entries;
+  }
+}
+
+/*
+ * The bucket index log of a sharded bucket is kept per shard, so a
+ * marker into it is the list of the shards' markers, as
+ * <shard>#<marker>,<shard>#<marker>...; shards that are not in it are
+ * read from the start.  Markers of unsharded buckets are those of the
+ * one index object.
+ */
+static void parse_bi_log_marker(const string& marker, map<int, string>& bucket_objs,
+                                map<int, string>& markers)
+{
+  markers.clear();
+  if (bucket_objs.begin()->first < 0) {
+    markers[-1] = marker;
+    return;
+  }
+
+  size_t pos = 0;
+  while (pos < marker.size()) {
+    size_t end = marker.find(',', pos);
+    if (end == string::npos)
+      end = marker.size();
+    string s = marker.substr(pos, end - pos);
+    pos = end + 1;
+
+    size_t sep = s.find('#');
+    if (sep == string::npos)
+      continue;
+    int shard = atoi(s.substr(0, sep).c_str());
+    if (bucket_objs.find(shard) != bucket_objs.end())
+      markers[shard] = s.substr(sep + 1);
+  }
+}
+
+static void encode_bi_log_marker(map<int, string>& markers, string& marker)
+{
+  map<int, string>::iterator iter = markers.begin();
+  if (iter != markers.end() && iter->first < 0) {
+    marker = iter->second;
+    return;
+  }
+
+  marker.clear();
+  for (; iter != markers.end(); ++iter) {
+    if (iter->second.empty())
+      continue;
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d#", iter->first);
+    if (!marker.empty())
+      marker.append(",");
+    marker.append(buf);
+    marker.append(iter->second);
+  }
+}
+
 static void translate_raw_stats(rgw_bucket_dir_header& header, map<RGWObjCategory, RGWBucketStats>& stats)
 {
   map<uint8_t, struct rgw_bucket_category_stats>::iterator iter = header.stats.begin();
@@ -3133,18 +3648,27 @@ int RGWRados::bucket_check_index(rgw_bucket& bucket,
 				 map<RGWObjCategory, RGWBucketStats> *calculated_stats)
 {
   librados::IoCtx index_ctx;
-  string oid;
+  map<int, string> bucket_objs;
 
-  int ret = open_bucket_index(bucket, index_ctx, oid);
+  int ret = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (ret < 0)
     return ret;
 
   rgw_bucket_dir_header existing_header;
   rgw_bucket_dir_header calculated_header;
 
-  ret = cls_rgw_bucket_check_index_op(index_ctx, oid, &existing_header, &calculated_header);
-  if (ret < 0)
-    return ret;
+  map<int, string>::iterator iter;
+  for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+    rgw_bucket_dir_header existing_shard_header;
+    rgw_bucket_dir_header calculated_shard_header;
+    ret = cls_rgw_bucket_check_index_op(index_ctx, iter->second,
+                                        &existing_shard_header, &calculated_shard_header);
+    if (ret < 0)
+      return ret;
+
+    accumulate_raw_stats(existing_shard_header, existing_header);
+    accumulate_raw_stats(calculated_shard_header, calculated_header);
+  }
 
   translate_raw_stats(existing_header, *existing_stats);
   translate_raw_stats(calculated_header, *calculated_stats);
@@ -3155,13 +3679,20 @@ int RGWRados::bucket_check_index(rgw_bucket& bucket,
 int RGWRados::bucket_rebuild_index(rgw_bucket& bucket)
 {
   librados::IoCtx index_ctx;
-  string oid;
+  map<int, string> bucket_objs;
 
-  int ret = open_bucket_index(bucket, index_ctx, oid);
+  int ret = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (ret < 0)
     return ret;
 
-  return cls_rgw_bucket_rebuild_index_op(index_ctx, oid);
+  map<int, string>::iterator iter;
+  for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+    ret = cls_rgw_bucket_rebuild_index_op(index_ctx, iter->second);
+    if (ret < 0)
+      return ret;
+  }
+
+  return 0;
 }
 
 
@@ -4121,179 +4652,164 @@ done_ret:
   return r;
 }
 
-struct get_obj_data;
-
-struct get_obj_aio_data {
-  struct get_obj_data *op_data;
-  off_t ofs;
-  off_t len;
-};
-
 struct get_obj_io {
   off_t len;
   bufferlist bl;
+  librados::AioCompletion *c; /* NULL if the data was at hand already */
 };
 
-static void _get_obj_aio_completion_cb(completion_t cb, void *arg);
-
-struct get_obj_data : public RefCountedObject {
+/*
+ * The reads of a get_obj_iterate().  Reads of the following stripes are
+ * kept in flight while the data that has come in is handed to the
+ * client in order, all from the calling thread.  The window, the bytes
+ * read or being read but not handed out yet, starts at
+ * rgw_get_obj_window_size; it grows up to rgw_get_obj_max_window_size
+ * while the client takes the data faster than it comes in, and shrinks
+ * back while data waits for the client.
+ */
+struct get_obj_data {
   CephContext *cct;
   RGWRados *rados;
   void *ctx;
   IoCtx io_ctx;
+  RGWGetDataCB *client_cb;
   map<off_t, get_obj_io> io_map;
-  map<off_t, librados::AioCompletion *> completion_map;
+  uint64_t pending;
+  uint64_t window;
+  uint64_t min_window;
+  uint64_t max_window;
   uint64_t total_read;
-  Mutex lock;
-  Mutex data_lock;
-  list<get_obj_aio_data> aio_data;
-  RGWGetDataCB *client_cb;
-  atomic_t cancelled;
-  atomic_t err_code;
-  Throttle throttle;
 
   get_obj_data(CephContext *_cct)
-    : cct(_cct),
-      rados(NULL), ctx(NULL),
-      total_read(0), lock("get_obj_data"), data_lock("get_obj_data::data_lock"),
-      client_cb(NULL),
-      throttle(cct, "get_obj_data", cct->_conf->rgw_get_obj_window_size, false) {}
-  virtual ~get_obj_data() { } 
-  void set_cancelled(int r) {
-    cancelled.set(1);
-    err_code.set(r);
+    : cct(_cct), rados(NULL), ctx(NULL), client_cb(NULL), pending(0),
+      total_read(0) {
+    min_window = cct->_conf->rgw_get_obj_window_size;
+    max_window = max(min_window, (uint64_t)cct->_conf->rgw_get_obj_max_window_size);
+    window = min_window;
   }
-
-  bool is_cancelled() {
-    return cancelled.read() == 1;
+  ~get_obj_data() {
+    cancel_all_io();
   }
 
-  int get_err_code() {
-    return err_code.read();
-  }
-
-  int wait_next_io(bool *done) {
-    lock.Lock();
-    map<off_t, librados::AioCompletion *>::iterator iter = completion_map.begin();
-    if (iter == completion_map.end()) {
-      *done = true;
-      lock.Unlock();
-      return 0;
-    }
-    off_t cur_ofs = iter->first;
-    librados::AioCompletion *c = iter->second;
-    lock.Unlock();
-
-    c->wait_for_complete_and_cb();
-    int r = c->get_return_value();
-    c->release();
-
-    lock.Lock();
-    completion_map.erase(cur_ofs);
-
-    if (completion_map.empty()) {
-      *done = true;
-    }
-    lock.Unlock();
-    
-    return r;
+  void add_data(off_t ofs, bufferlist& bl, off_t bl_ofs, off_t len) {
+    get_obj_io& io = io_map[ofs];
+    io.len = len;
+    io.bl.substr_of(bl, bl_ofs, len);
+    io.c = NULL;
+    pending += len;
   }
 
   void add_io(off_t ofs, off_t len, bufferlist **pbl, AioCompletion **pc) {
-    Mutex::Locker l(lock);
-
     get_obj_io& io = io_map[ofs];
-    *pbl = &io.bl;
-
-    struct get_obj_aio_data aio;
-    aio.ofs = ofs;
-    aio.len = len;
-    aio.op_data = this;
-
-    aio_data.push_back(aio);
-
-    struct get_obj_aio_data *paio_data =  &aio_data.back(); /* last element */
-
-    librados::AioCompletion *c = librados::Rados::aio_create_completion((void *)paio_data, _get_obj_aio_completion_cb, NULL);
-    completion_map[ofs] = c;
+    io.len = len;
+    io.c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    pending += len;
 
-    *pc = c;
-
-    /* we have a reference per IO, plus one reference for the calling function.
-     * reference is dropped for each callback, plus when we're done iterating
-     * over the parts */
-    get();
+    *pbl = &io.bl;
+    *pc = io.c;
   }
 
   void cancel_io(off_t ofs) {
     ldout(cct, 20) << "get_obj_data::cancel_io() ofs=" << ofs << dendl;
-    lock.Lock();
-    map<off_t, AioCompletion *>::iterator iter = completion_map.find(ofs);
-    if (iter != completion_map.end()) {
-      AioCompletion *c = iter->second;
-      c->release();
-      completion_map.erase(ofs);
-      io_map.erase(ofs);
-    }
-    lock.Unlock();
-
-    /* we don't drop a reference here -- e.g., not calling d->put(), because we still
-     * need IoCtx to live, as io callback may still be called
-     */
+    map<off_t, get_obj_io>::iterator iter = io_map.find(ofs);
+    if (iter == io_map.end())
+      return;
+    if (iter->second.c)
+      iter->second.c->release();
+    pending -= iter->second.len;
+    io_map.erase(iter);
   }
 
   void cancel_all_io() {
+    if (io_map.empty())
+      return;
     ldout(cct, 20) << "get_obj_data::cancel_all_io()" << dendl;
-    Mutex::Locker l(lock);
-    for (map<off_t, librados::AioCompletion *>::iterator iter = completion_map.begin();
-         iter != completion_map.end(); ++iter) {
-      librados::AioCompletion  *c = iter->second;
-      c->release();
+    /* the reads still write into the buffers */
+    for (map<off_t, get_obj_io>::iterator iter = io_map.begin(); iter != io_map.end(); ++iter) {
+      librados::AioCompletion *c = iter->second.c;
+      if (c) {
+        c->wait_for_complete();
+        c->release();
+      }
     }
+    io_map.clear();
+    pending = 0;
   }
 
-  int get_complete_ios(off_t ofs, list<bufferlist>& bl_list) {
-    Mutex::Locker l(lock);
-
-    map<off_t, get_obj_io>::iterator liter = io_map.begin();
+  bool head_ready() {
+    map<off_t, get_obj_io>::iterator iter = io_map.begin();
+    return iter != io_map.end() && (!iter->second.c || iter->second.c->is_complete());
+  }
 
-    if (liter == io_map.end() ||
-        liter->first != ofs) {
-      return 0;
+  /* wait for the first read, and hand it to the client */
+  int handle_head() {
+    map<off_t, get_obj_io>::iterator iter = io_map.begin();
+    get_obj_io& io = iter->second;
+    if (io.c) {
+      io.c->wait_for_complete();
+      int r = io.c->get_return_value();
+      io.c->release();
+      io.c = NULL;
+      if (r < 0) {
+        ldout(cct, 20) << "get_obj_data: read at ofs=" << iter->first << " returned " << r << dendl;
+        pending -= io.len;
+        io_map.erase(iter);
+        return r;
+      }
     }
 
-    map<off_t, librados::AioCompletion *>::iterator aiter;
-    aiter = completion_map.find(ofs);
-    if (aiter == completion_map.end()) {
-    /* completion map does not hold this io, it was cancelled */
+    bufferlist bl;
+    bl.claim(io.bl);
+    pending -= io.len;
+    io_map.erase(iter);
+
+    total_read += bl.length();
+    if (!bl.length())
       return 0;
+    return client_cb->handle_data(bl, 0, bl.length());
+  }
+
+  /* hand out what came in, in order, without waiting */
+  int handle_ready() {
+    while (head_ready()) {
+      int r = handle_head();
+      if (r < 0)
+        return r;
     }
+    return 0;
+  }
 
-    AioCompletion *completion = aiter->second;
-    int r = completion->get_return_value();
+  /* make room in the window for a read of len */
+  int throttle(uint64_t len) {
+    if (head_ready() && window > min_window) {
+      /* data is waiting for the client; no point in reading further ahead */
+      window = max(window / 2, min_window);
+      ldout(cct, 20) << "get_obj_data: window shrunk to " << window << dendl;
+    }
+    int r = handle_ready();
     if (r < 0)
       return r;
 
-    for (; aiter != completion_map.end(); ++aiter) {
-      completion = aiter->second;
-      if (!completion->is_complete()) {
-        /* reached a request that is not yet complete, stop */
-        break;
+    while (!io_map.empty() && pending + len > window) {
+      if (!head_ready() && window < max_window) {
+        /* the client has taken everything and waits for the reads */
+        window = min(window * 2, max_window);
+        ldout(cct, 20) << "get_obj_data: window grown to " << window << dendl;
+        continue;
       }
-
-      r = completion->get_return_value();
-      if (r < 0) {
-        set_cancelled(r); /* mark it as cancelled, so that we don't continue processing next operations */
+      r = handle_head();
+      if (r < 0)
         return r;
-      }
-
-      total_read += r;
-
-      map<off_t, get_obj_io>::iterator old_liter = liter++;
-      bl_list.push_back(old_liter->second.bl);
-      io_map.erase(old_liter);
     }
+    return 0;
+  }
 
+  int drain() {
+    while (!io_map.empty()) {
+      int r = handle_head();
+      if (r < 0)
+        return r;
+    }
     return 0;
   }
 };
@@ -4305,55 +4821,6 @@ static int _get_obj_iterate_cb(rgw_obj& obj, off_t obj_ofs, off_t read_ofs, off_
   return d->rados->get_obj_iterate_cb(d->ctx, astate, obj, obj_ofs, read_ofs, len, is_head_obj, arg);
 }
 
-static void _get_obj_aio_completion_cb(completion_t cb, void *arg)
-{
-  struct get_obj_aio_data *aio_data = (struct get_obj_aio_data *)arg;
-  struct get_obj_data *d = aio_data->op_data;
-
-  d->rados->get_obj_aio_completion_cb(cb, arg);
-}
-
-
-void RGWRados::get_obj_aio_completion_cb(completion_t c, void *arg)
-{
-  struct get_obj_aio_data *aio_data = (struct get_obj_aio_data *)arg;
-  struct get_obj_data *d = aio_data->op_data;
-  off_t ofs = aio_data->ofs;
-  off_t len = aio_data->len;
-
-  list<bufferlist> bl_list;
-  list<bufferlist>::iterator iter;
-  int r;
-
-  ldout(cct, 20) << "get_obj_aio_completion_cb: io completion ofs=" << ofs << " len=" << len << dendl;
-  d->throttle.put(len);
-
-  if (d->is_cancelled())
-    goto done;
-
-  d->data_lock.Lock();
-
-  r = d->get_complete_ios(ofs, bl_list);
-  if (r < 0) {
-    goto done_unlock;
-  }
-
-  for (iter = bl_list.begin(); iter != bl_list.end(); ++iter) {
-    bufferlist& bl = *iter;
-    int r = d->client_cb->handle_data(bl, 0, bl.length());
-    if (r < 0) {
-      d->set_cancelled(r);
-      break;
-    }
-  }
-
-done_unlock:
-  d->data_lock.Unlock();
-done:
-  d->put();
-  return;
-}
-
 int RGWRados::get_obj_iterate_cb(void *ctx, RGWObjState *astate,
 		         rgw_obj& obj,
 			 off_t obj_ofs,
@@ -4380,16 +4847,10 @@ int RGWRados::get_obj_iterate_cb(void *ctx, RGWObjState *astate,
         obj_ofs < astate->data.length()) {
       unsigned chunk_len = min((uint64_t)astate->data.length() - obj_ofs, (uint64_t)len);
 
-      d->data_lock.Lock();
-      r = d->client_cb->handle_data(astate->data, obj_ofs, chunk_len);
-      d->data_lock.Unlock();
-      if (r < 0)
-        return r;
+      /* handed out along with the reads that follow, so that the first
+       * of them is in flight while the client takes this */
+      d->add_data(obj_ofs, astate->data, obj_ofs, chunk_len);
 
-      d->lock.Lock();
-      d->total_read += chunk_len;
-      d->lock.Unlock();
-	
       len -= chunk_len;
       read_ofs += chunk_len;
       obj_ofs += chunk_len;
@@ -4400,14 +4861,10 @@ int RGWRados::get_obj_iterate_cb(void *ctx, RGWObjState *astate,
 
   get_obj_bucket_and_oid_key(obj, bucket, oid, key);
 
-  d->throttle.get(len);
-  if (d->is_cancelled()) {
-    return d->get_err_code();
-  }
+  r = d->throttle(len);
+  if (r < 0)
+    return r;
 
-  /* add io after we check that we're not cancelled, otherwise we're going to have trouble
-   * cleaning up
-   */
   d->add_io(obj_ofs, len, &pbl, &c);
 
   ldout(cct, 20) << "rados->get_obj_iterate_cb oid=" << oid << " obj-ofs=" << obj_ofs << " read_ofs=" << read_ofs << " len=" << len << dendl;
@@ -4417,51 +4874,37 @@ int RGWRados::get_obj_iterate_cb(void *ctx, RGWObjState *astate,
   io_ctx.locator_set_key(key);
 
   r = io_ctx.aio_operate(oid, c, &op, NULL);
-  ldout(cct, 20) << "rados->aio_operate r=" << r << " bl.length=" << pbl->length() << dendl;
-  if (r < 0)
-    goto done_err;
-
-  return 0;
-
-done_err:
-  ldout(cct, 20) << "cancelling io r=" << r << " obj_ofs=" << obj_ofs << dendl;
-  d->set_cancelled(r);
-  d->cancel_io(obj_ofs);
+  ldout(cct, 20) << "rados->aio_operate r=" << r << dendl;
+  if (r < 0) {
+    ldout(cct, 20) << "cancelling io r=" << r << " obj_ofs=" << obj_ofs << dendl;
+    d->cancel_io(obj_ofs);
+    return r;
+  }
 
-  return r;
+  return d->handle_ready();
 }
 
 int RGWRados::get_obj_iterate(void *ctx, void **handle, rgw_obj& obj,
                               off_t ofs, off_t end,
 			      RGWGetDataCB *cb)
 {
-  struct get_obj_data *data = new get_obj_data(cct);
-  bool done = false;
+  struct get_obj_data data(cct);
 
   GetObjState *state = *(GetObjState **)handle;
 
-  data->rados = this;
-  data->ctx = ctx;
-  data->io_ctx.dup(state->io_ctx);
-  data->client_cb = cb;
+  data.rados = this;
+  data.ctx = ctx;
+  data.io_ctx.dup(state->io_ctx);
+  data.client_cb = cb;
 
-  int r = iterate_obj(ctx, obj, ofs, end, cct->_conf->rgw_get_obj_max_req_size, _get_obj_iterate_cb, (void *)data);
+  int r = iterate_obj(ctx, obj, ofs, end, cct->_conf->rgw_get_obj_max_req_size, _get_obj_iterate_cb, (void *)&data);
+  if (r >= 0)
+    r = data.drain();
   if (r < 0) {
-    data->cancel_all_io();
-    goto done;
-  }
-
-  while (!done) {
-    r = data->wait_next_io(&done);
-    if (r < 0) {
-      dout(10) << "get_obj_iterate() r=" << r << ", canceling all io" << dendl;
-      data->cancel_all_io();
-      break;
-    }
+    dout(10) << "get_obj_iterate() r=" << r << ", canceling all io" << dendl;
+    data.cancel_all_io();
   }
 
-done:
-  data->put();
   return r;
 }
 
@@ -4917,6 +5360,82 @@ int RGWRados::omap_get_all(rgw_obj& obj, bufferlist& header, std::map<string, bu
   return omap_get_vals(obj, header, start_after, (uint64_t)-1, m);
 }
 
+int RGWRados::omap_get_keys(rgw_obj& obj, std::set<string>& keys)
+{
+  librados::IoCtx io_ctx;
+  rgw_bucket bucket;
+  std::string oid, key;
+  get_obj_bucket_and_oid_key(obj, bucket, oid, key);
+  int r = open_bucket_data_ctx(bucket, io_ctx);
+  if (r < 0)
+    return r;
+
+  io_ctx.locator_set_key(key);
+
+  return io_ctx.omap_get_keys(oid, string(), (uint64_t)-1, &keys);
+}
+
+struct omap_batch_read {
+  map<string, bufferlist> vals;
+  int r;
+  librados::AioCompletion *c;
+};
+
+int RGWRados::omap_get_vals_by_keys(rgw_obj& obj, vector<set<string> >& batches, RGWOmapBatchCB *cb)
+{
+  librados::IoCtx io_ctx;
+  rgw_bucket bucket;
+  std::string oid, key;
+  get_obj_bucket_and_oid_key(obj, bucket, oid, key);
+  int r = open_bucket_data_ctx(bucket, io_ctx);
+  if (r < 0)
+    return r;
+
+  io_ctx.locator_set_key(key);
+
+  size_t max_aio = max(1, (int)cct->_conf->rgw_omap_get_max_aio);
+  list<omap_batch_read> reads;
+  size_t next = 0, done = 0;
+  int ret = 0;
+  while (done < batches.size()) {
+    while (ret >= 0 && next < batches.size() && reads.size() < max_aio) {
+      reads.push_back(omap_batch_read());
+      omap_batch_read& rd = reads.back();
+      rd.r = 0;
+      rd.c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+      librados::ObjectReadOperation op;
+      op.omap_get_vals_by_keys(batches[next], &rd.vals, &rd.r);
+      r = io_ctx.aio_operate(oid, rd.c, &op, NULL);
+      if (r < 0) {
+        rd.c->release();
+        reads.pop_back();
+        ret = r;
+        break;
+      }
+      ++next;
+    }
+    if (reads.empty())
+      break;
+
+    omap_batch_read& rd = reads.front();
+    rd.c->wait_for_complete();
+    r = rd.c->get_return_value();
+    rd.c->release();
+    if (r >= 0)
+      r = rd.r;
+    if (r >= 0 && ret >= 0)
+      r = cb->handle_batch(done, rd.vals);
+    if (r < 0 && ret >= 0) {
+      ldout(cct, 0) << "ERROR: omap_get_vals_by_keys() oid=" << oid << " batch=" << done << " returned " << r << dendl;
+      ret = r;
+    }
+    reads.pop_front();
+    ++done;
+  }
+
+  return ret;
+}
+
 int RGWRados::omap_set(rgw_obj& obj, std::string& key, bufferlist& bl)
 {
   rgw_bucket bucket;
@@ -5131,19 +5650,51 @@ int RGWRados::list_bi_log_entries(rgw_bucket& bucket, string& marker, uint32_t m
   result.clear();
 
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  std::list<rgw_bi_log_entry> entries;
-  int ret = cls_rgw_bi_log_list(index_ctx, oid, marker, max - result.size(), entries, truncated);
-  if (ret < 0)
-    return ret;
+  map<int, string> markers;
+  parse_bi_log_marker(marker, bucket_objs, markers);
+
+  *truncated = false;
+  map<int, std::list<rgw_bi_log_entry> > shard_entries;
+  map<int, string>::iterator iter;
+  for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+    bool shard_truncated;
+    int ret = cls_rgw_bi_log_list(index_ctx, iter->second, markers[iter->first], max,
+                                  shard_entries[iter->first], &shard_truncated);
+    if (ret < 0)
+      return ret;
+    if (shard_truncated)
+      *truncated = true;
+  }
 
-  std::list<rgw_bi_log_entry>::iterator iter;
-  for (iter = entries.begin(); iter != entries.end(); ++iter) {
-    result.push_back(*iter);
+  /*
+   * take the shards' entries in turn so a busy shard does not hold back
+   * the others; each entry's id is the marker of the log up to it
+   */
+  bool found = true;
+  while (found && result.size() < max) {
+    found = false;
+    map<int, std::list<rgw_bi_log_entry> >::iterator siter;
+    for (siter = shard_entries.begin(); siter != shard_entries.end() && result.size() < max; ++siter) {
+      if (siter->second.empty())
+        continue;
+      found = true;
+      rgw_bi_log_entry& entry = siter->second.front();
+      markers[siter->first] = entry.id;
+      encode_bi_log_marker(markers, entry.id);
+      result.push_back(entry);
+      siter->second.pop_front();
+    }
+  }
+
+  map<int, std::list<rgw_bi_log_entry> >::iterator siter;
+  for (siter = shard_entries.begin(); siter != shard_entries.end(); ++siter) {
+    if (!siter->second.empty())
+      *truncated = true;
   }
 
   return 0;
@@ -5152,14 +5703,26 @@ int RGWRados::list_bi_log_entries(rgw_bucket& bucket, string& marker, uint32_t m
 int RGWRados::trim_bi_log_entries(rgw_bucket& bucket, string& start_marker, string& end_marker)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  int ret = cls_rgw_bi_log_trim(index_ctx, oid, start_marker, end_marker);
-  if (ret < 0)
-    return ret;
+  map<int, string> start_markers, end_markers;
+  parse_bi_log_marker(start_marker, bucket_objs, start_markers);
+  parse_bi_log_marker(end_marker, bucket_objs, end_markers);
+
+  bool sharded = (bucket_objs.begin()->first >= 0);
+  map<int, string>::iterator iter;
+  for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+    string& shard_end_marker = end_markers[iter->first];
+    /* nothing of a shard missing from the end marker was read */
+    if (sharded && shard_end_marker.empty())
+      continue;
+    int ret = cls_rgw_bi_log_trim(index_ctx, iter->second, start_markers[iter->first], shard_end_marker);
+    if (ret < 0)
+      return ret;
+  }
 
   return 0;
 }
@@ -5192,27 +5755,22 @@ int RGWRados::process_gc()
   return gc->process();
 }
 
-int RGWRados::cls_rgw_init_index(librados::IoCtx& index_ctx, librados::ObjectWriteOperation& op, string& oid)
-{
-  bufferlist in;
-  cls_rgw_bucket_init(op);
-  int r = index_ctx.operate(oid, &op);
-  return r;
-}
-
 int RGWRados::cls_obj_prepare_op(rgw_bucket& bucket, RGWModifyOp op, string& tag,
                                  string& name, string& locator)
 {
   librados::IoCtx index_ctx;
   string oid;
 
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  int r = open_bucket_index_shard(bucket, index_ctx, name, oid);
   if (r < 0)
     return r;
 
+  utime_t start = ceph_clock_now(cct);
   ObjectWriteOperation o;
   cls_rgw_bucket_prepare_op(o, op, tag, name, locator, zone_public_config.log_data);
   r = index_ctx.operate(oid, &o);
+  if (perfcounter)
+    perfcounter->tinc(l_rgw_index_prepare_lat, ceph_clock_now(cct) - start);
   return r;
 }
 
@@ -5224,29 +5782,29 @@ int RGWRados::cls_obj_complete_op(rgw_bucket& bucket, RGWModifyOp op, string& ta
   librados::IoCtx index_ctx;
   string oid;
 
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  int r = open_bucket_index_shard(bucket, index_ctx, ent.name, oid);
   if (r < 0)
     return r;
 
-  ObjectWriteOperation o;
-  rgw_bucket_dir_entry_meta dir_meta;
-  dir_meta.size = ent.size;
-  dir_meta.mtime = utime_t(ent.mtime, 0);
-  dir_meta.etag = ent.etag;
-  dir_meta.owner = ent.owner;
-  dir_meta.owner_display_name = ent.owner_display_name;
-  dir_meta.content_type = ent.content_type;
-  dir_meta.category = category;
-
-  rgw_bucket_entry_ver ver;
-  ver.pool = pool;
-  ver.epoch = epoch;
-  cls_rgw_bucket_complete_op(o, op, tag, ver, ent.name, dir_meta, remove_objs, zone_public_config.log_data);
-
-  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
-  r = index_ctx.aio_operate(oid, c, &o);
-  c->release();
-  return r;
+  rgw_cls_obj_complete_op call;
+  call.op = op;
+  call.tag = tag;
+  call.name = ent.name;
+  call.ver.pool = pool;
+  call.ver.epoch = epoch;
+  call.meta.size = ent.size;
+  call.meta.mtime = utime_t(ent.mtime, 0);
+  call.meta.etag = ent.etag;
+  call.meta.owner = ent.owner;
+  call.meta.owner_display_name = ent.owner_display_name;
+  call.meta.content_type = ent.content_type;
+  call.meta.category = category;
+  call.log_op = zone_public_config.log_data;
+  if (remove_objs)
+    call.remove_objs = *remove_objs;
+
+  index_completer->queue(index_ctx, oid, call);
+  return 0;
 }
 
 int RGWRados::cls_obj_complete_add(rgw_bucket& bucket, string& tag,
@@ -5276,43 +5834,133 @@ int RGWRados::cls_obj_complete_cancel(rgw_bucket& bucket, string& tag, string& n
 int RGWRados::cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeout)
 {
   librados::IoCtx index_ctx;
-  string oid;
+  map<int, string> bucket_objs;
 
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  ObjectWriteOperation o;
-  cls_rgw_bucket_set_tag_timeout(o, timeout);
+  map<int, string>::iterator iter;
+  for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+    ObjectWriteOperation o;
+    cls_rgw_bucket_set_tag_timeout(o, timeout);
 
-  r = index_ctx.operate(oid, &o);
+    r = index_ctx.operate(iter->second, &o);
+    if (r < 0)
+      return r;
+  }
 
-  return r;
+  return 0;
 }
 
+/*
+ * With a delimiter (and common_prefixes to put them in), the index
+ * objects collapse the names that have it past the prefix into their
+ * common prefix; each of those counts as one of num.
+ */
 int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
 		              uint32_t num, map<string, RGWObjEnt>& m,
 			      bool *is_truncated, string *last_entry,
-			      bool (*force_check_filter)(const string&  name))
+			      bool (*force_check_filter)(const string&  name),
+                              const string& delim, set<string> *common_prefixes)
 {
   ldout(cct, 10) << "cls_bucket_list " << bucket << " start " << start << " num " << num << dendl;
 
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  struct rgw_bucket_dir dir;
-  r = cls_rgw_list_op(index_ctx, oid, start, prefix, num, &dir, is_truncated);
+  /* list the shards in parallel */
+  map<int, struct rgw_cls_list_ret> list_results;
+  map<int, int> list_rvals;
+  map<int, librados::AioCompletion *> completions;
+  map<int, string>::iterator iter;
+  for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+    librados::ObjectReadOperation op;
+    cls_rgw_bucket_list_op(op, start, prefix, num, &list_results[iter->first],
+                           &list_rvals[iter->first], (common_prefixes ? delim : string()));
+    librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    r = index_ctx.aio_operate(iter->second, c, &op, NULL);
+    if (r < 0) {
+      c->release();
+      break;
+    }
+    completions[iter->first] = c;
+  }
+  map<int, librados::AioCompletion *>::iterator citer;
+  for (citer = completions.begin(); citer != completions.end(); ++citer) {
+    librados::AioCompletion *c = citer->second;
+    c->wait_for_complete();
+    int ret = c->get_return_value();
+    c->release();
+    if (ret >= 0)
+      ret = list_rvals[citer->first];
+    if (ret < 0 && r >= 0)
+      r = ret;
+  }
   if (r < 0)
     return r;
 
-  map<string, struct rgw_bucket_dir_entry>::iterator miter;
-  bufferlist updates;
-  for (miter = dir.m.begin(); miter != dir.m.end(); ++miter) {
+  /*
+   * merge the shards' entries and common prefixes in order, up to num of
+   * them; a common prefix is found in the shards' listings as NULL
+   */
+  map<int, map<string, struct rgw_bucket_dir_entry *> > shard_lists;
+  map<int, struct rgw_cls_list_ret>::iterator liter;
+  for (liter = list_results.begin(); liter != list_results.end(); ++liter) {
+    map<string, struct rgw_bucket_dir_entry *>& l = shard_lists[liter->first];
+    map<string, struct rgw_bucket_dir_entry>::iterator diter;
+    for (diter = liter->second.dir.m.begin(); diter != liter->second.dir.m.end(); ++diter) {
+      l[diter->first] = &diter->second;
+    }
+    list<string>::iterator piter;
+    for (piter = liter->second.common_prefixes.begin(); piter != liter->second.common_prefixes.end(); ++piter) {
+      l[*piter] = NULL;
+    }
+  }
+  map<int, map<string, struct rgw_bucket_dir_entry *>::iterator> cur;
+  map<int, map<string, struct rgw_bucket_dir_entry *> >::iterator siter;
+  for (siter = shard_lists.begin(); siter != shard_lists.end(); ++siter) {
+    cur[siter->first] = siter->second.begin();
+  }
+
+  map<int, bufferlist> updates;
+  uint32_t count = 0;
+  while (count < num) {
+    int shard = -1;
+    map<string, struct rgw_bucket_dir_entry *>::iterator miter;
+    bool found = false;
+    for (siter = shard_lists.begin(); siter != shard_lists.end(); ++siter) {
+      map<string, struct rgw_bucket_dir_entry *>::iterator& shard_iter = cur[siter->first];
+      if (shard_iter == siter->second.end())
+        continue;
+      if (!found || shard_iter->first < miter->first) {
+        shard = siter->first;
+        miter = shard_iter;
+        found = true;
+      }
+    }
+    if (!found)
+      break;
+    ++cur[shard];
+    ++count;
+    *last_entry = miter->first;
+
+    if (!miter->second) {
+      /* the same prefix may come from several shards */
+      for (siter = shard_lists.begin(); siter != shard_lists.end(); ++siter) {
+        map<string, struct rgw_bucket_dir_entry *>::iterator& shard_iter = cur[siter->first];
+        if (shard_iter != siter->second.end() && shard_iter->first == miter->first)
+          ++shard_iter;
+      }
+      common_prefixes->insert(miter->first);
+      continue;
+    }
+
     RGWObjEnt e;
-    rgw_bucket_dir_entry& dirent = miter->second;
+    rgw_bucket_dir_entry& dirent = *miter->second;
 
     // fill it in with initial values; we may correct later
     e.name = dirent.name;
@@ -5337,7 +5985,7 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
        * and if the tags are old we need to do cleanup as well. */
       librados::IoCtx sub_ctx;
       sub_ctx.dup(index_ctx);
-      r = check_disk_state(sub_ctx, bucket, dirent, e, updates);
+      r = check_disk_state(sub_ctx, bucket, dirent, e, updates[shard]);
       if (r < 0) {
         if (r == -ENOENT)
           continue;
@@ -5349,16 +5997,22 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
     ldout(cct, 10) << "RGWRados::cls_bucket_list: got " << e.name << dendl;
   }
 
-  if (dir.m.size()) {
-    *last_entry = dir.m.rbegin()->first;
+  /* there is more if a shard has more than we took */
+  *is_truncated = false;
+  for (liter = list_results.begin(); liter != list_results.end(); ++liter) {
+    if (liter->second.is_truncated || cur[liter->first] != shard_lists[liter->first].end())
+      *is_truncated = true;
   }
 
-  if (updates.length()) {
+  map<int, bufferlist>::iterator uiter;
+  for (uiter = updates.begin(); uiter != updates.end(); ++uiter) {
+    if (!uiter->second.length())
+      continue;
     ObjectWriteOperation o;
-    cls_rgw_suggest_changes(o, updates);
+    cls_rgw_suggest_changes(o, uiter->second);
     // we don't care if we lose suggested updates, send them off blindly
     AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
-    r = index_ctx.aio_operate(oid, c, &o);
+    r = index_ctx.aio_operate(bucket_objs[uiter->first], c, &o);
     c->release();
   }
   return m.size();
@@ -5426,13 +6080,15 @@ int RGWRados::cls_obj_usage_log_trim(string& oid, string& user, uint64_t start_e
 int RGWRados::remove_objs_from_index(rgw_bucket& bucket, list<string>& oid_list)
 {
   librados::IoCtx index_ctx;
-  string dir_oid;
+  string bucket_oid_base;
+  uint32_t num_shards;
 
-  int r = open_bucket_index(bucket, index_ctx, dir_oid);
+  int r = open_bucket_index_base(bucket, index_ctx, bucket_oid_base, &num_shards);
   if (r < 0)
     return r;
 
-  bufferlist updates;
+  /* each entry is removed from the shard it is in */
+  map<string, bufferlist> updates;
 
   list<string>::iterator iter;
 
@@ -5442,15 +6098,22 @@ int RGWRados::remove_objs_from_index(rgw_bucket& bucket, list<string>& oid_list)
     rgw_bucket_dir_entry entry;
     entry.ver.epoch = (uint64_t)-1; // ULLONG_MAX, needed to that objclass doesn't skip out request
     entry.name = oid;
-    updates.append(CEPH_RGW_REMOVE);
-    ::encode(entry, updates);
+    string dir_oid;
+    get_bucket_index_object(bucket_oid_base, num_shards, oid, dir_oid);
+    bufferlist& bl = updates[dir_oid];
+    bl.append(CEPH_RGW_REMOVE);
+    ::encode(entry, bl);
   }
 
-  bufferlist out;
-
-  r = index_ctx.exec(dir_oid, "rgw", "dir_suggest_changes", updates, out);
+  map<string, bufferlist>::iterator uiter;
+  for (uiter = updates.begin(); uiter != updates.end(); ++uiter) {
+    bufferlist out;
+    r = index_ctx.exec(uiter->first, "rgw", "dir_suggest_changes", uiter->second, out);
+    if (r < 0)
+      return r;
+  }
 
-  return r;
+  return 0;
 }
 
 int RGWRados::check_disk_state(librados::IoCtx io_ctx,
@@ -5559,29 +6222,133 @@ int RGWRados::check_disk_state(librados::IoCtx io_ctx,
 int RGWRados::cls_bucket_head(rgw_bucket& bucket, struct rgw_bucket_dir_header& header)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  r = cls_rgw_get_dir_header(index_ctx, oid, &header);
+  header = rgw_bucket_dir_header();
+
+  /* read the shards' headers in parallel; no entries are listed */
+  map<int, struct rgw_cls_list_ret> list_results;
+  map<int, int> list_rvals;
+  map<int, librados::AioCompletion *> completions;
+  map<int, string>::iterator iter;
+  for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+    librados::ObjectReadOperation op;
+    cls_rgw_bucket_list_op(op, string(), string(), 0, &list_results[iter->first],
+                           &list_rvals[iter->first]);
+    librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    r = index_ctx.aio_operate(iter->second, c, &op, NULL);
+    if (r < 0) {
+      c->release();
+      break;
+    }
+    completions[iter->first] = c;
+  }
+  map<int, librados::AioCompletion *>::iterator citer;
+  for (citer = completions.begin(); citer != completions.end(); ++citer) {
+    librados::AioCompletion *c = citer->second;
+    c->wait_for_complete();
+    int ret = c->get_return_value();
+    c->release();
+    if (ret >= 0)
+      ret = list_rvals[citer->first];
+    if (ret < 0 && r >= 0)
+      r = ret;
+  }
   if (r < 0)
     return r;
 
+  map<int, string> max_markers;
+  map<int, struct rgw_cls_list_ret>::iterator liter;
+  for (liter = list_results.begin(); liter != list_results.end(); ++liter) {
+    rgw_bucket_dir_header& shard_header = liter->second.dir.header;
+    accumulate_raw_stats(shard_header, header);
+    header.tag_timeout = shard_header.tag_timeout;
+    max_markers[liter->first] = shard_header.max_marker;
+  }
+  encode_bi_log_marker(max_markers, header.max_marker);
+
   return 0;
 }
 
+/* adds up the headers of a bucket's index shards as they come in */
+class RGWGetDirHeaderShards_CB : public RGWGetDirHeader_CB {
+  Mutex lock;
+  RGWGetDirHeader_CB *ctx;
+  int pending;
+  int ret;
+  rgw_bucket_dir_header header;
+  map<int, string> max_markers;
+
+public:
+  RGWGetDirHeaderShards_CB(RGWGetDirHeader_CB *_ctx, int num_shards)
+    : lock("RGWGetDirHeaderShards_CB::lock"), ctx(_ctx), pending(num_shards), ret(0) {}
+
+  void handle_shard_response(int shard, int r, rgw_bucket_dir_header& shard_header) {
+    lock.Lock();
+    if (r < 0) {
+      if (ret >= 0)
+        ret = r;
+    } else {
+      accumulate_raw_stats(shard_header, header);
+      header.tag_timeout = shard_header.tag_timeout;
+      max_markers[shard] = shard_header.max_marker;
+    }
+    bool done = (--pending == 0);
+    lock.Unlock();
+
+    if (done) {
+      encode_bi_log_marker(max_markers, header.max_marker);
+      ctx->handle_response(ret, header);
+      ctx->put();
+    }
+  }
+
+  void handle_response(int r, rgw_bucket_dir_header& shard_header) {
+    assert(0 == "handled per shard");
+  }
+};
+
+class RGWGetDirHeaderShard_CB : public RGWGetDirHeader_CB {
+  RGWGetDirHeaderShards_CB *shards_ctx;
+  int shard;
+public:
+  RGWGetDirHeaderShard_CB(RGWGetDirHeaderShards_CB *_ctx, int _shard)
+    : shards_ctx(_ctx), shard(_shard) {
+    shards_ctx->get();
+  }
+  ~RGWGetDirHeaderShard_CB() {
+    shards_ctx->put();
+  }
+  void handle_response(int r, rgw_bucket_dir_header& header) {
+    shards_ctx->handle_shard_response(shard, r, header);
+  }
+};
+
 int RGWRados::cls_bucket_head_async(rgw_bucket& bucket, RGWGetDirHeader_CB *ctx)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  r = cls_rgw_get_dir_header_async(index_ctx, oid, ctx);
-  if (r < 0)
-    return r;
+  /* from here on ctx gets its response, and its reference is dropped, once all shards answered */
+  RGWGetDirHeaderShards_CB *shards_ctx = new RGWGetDirHeaderShards_CB(ctx, bucket_objs.size());
+  map<int, string>::iterator iter;
+  for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+    RGWGetDirHeaderShard_CB *shard_ctx = new RGWGetDirHeaderShard_CB(shards_ctx, iter->first);
+    shard_ctx->get();
+    r = cls_rgw_get_dir_header_async(index_ctx, iter->second, shard_ctx);
+    if (r < 0) {
+      rgw_bucket_dir_header header;
+      shard_ctx->handle_response(r, header);
+    }
+    shard_ctx->put();
+  }
+  shards_ctx->put();
 
   return 0;
 }
@@ -5740,19 +6507,21 @@ int RGWRados::process_intent_log(rgw_bucket& bucket, string& oid,
         break;
       } else {
         librados::IoCtx index_ctx;
-        string oid;
-        int r = open_bucket_index(entry.obj.bucket, index_ctx, oid);
+        map<int, string> bucket_objs;
+        int r = open_bucket_index(entry.obj.bucket, index_ctx, bucket_objs);
         if (r < 0)
           return r;
-        ObjectWriteOperation op;
-        op.remove();
-        oid.append(entry.obj.bucket.marker);
-        librados::AioCompletion *completion = rados->aio_create_completion(NULL, NULL, NULL);
-        r = index_ctx.aio_operate(oid, completion, &op);
-        completion->release();
-        if (r < 0 && r != -ENOENT) {
-          cerr << "failed to remove bucket: " << entry.obj.bucket << std::endl;
-          complete = false;
+        map<int, string>::iterator iter;
+        for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+          ObjectWriteOperation op;
+          op.remove();
+          librados::AioCompletion *completion = rados->aio_create_completion(NULL, NULL, NULL);
+          r = index_ctx.aio_operate(iter->second, completion, &op);
+          completion->release();
+          if (r < 0 && r != -ENOENT) {
+            cerr << "failed to remove bucket: " << entry.obj.bucket << std::endl;
+            complete = false;
+          }
         }
       }
       break;
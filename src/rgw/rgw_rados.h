@@ -77,6 +77,13 @@ public:
   }
 };
 
+class RGWOmapBatchCB {
+public:
+  virtual ~RGWOmapBatchCB() {}
+  /* the values of the keys of batch that exist */
+  virtual int handle_batch(int batch, map<string, bufferlist>& vals) = 0;
+};
+
 class RGWAccessListFilter {
 public:
   virtual ~RGWAccessListFilter() {}
@@ -228,12 +235,20 @@ public:
 
 struct put_obj_aio_info {
   void *handle;
+  uint64_t size;
 };
 
+/*
+ * Writes go out as they come, to whichever stripe they belong to, as
+ * long as what is in flight fits in rgw_put_obj_max_window_size;
+ * throttle_data() holds the caller, and so the reading off the client,
+ * beyond that.
+ */
 class RGWPutObjProcessor_Aio : public RGWPutObjProcessor
 {
   list<struct put_obj_aio_info> pending;
-  size_t max_chunks;
+  uint64_t pending_size;
+  uint64_t last_write_size;
 
   struct put_obj_aio_info pop_pending();
   int wait_pending_front();
@@ -248,7 +263,7 @@ protected:
 public:
   int throttle_data(void *handle);
 
-  RGWPutObjProcessor_Aio() : max_chunks(RGW_MAX_PENDING_CHUNKS), obj_len(0) {}
+  RGWPutObjProcessor_Aio() : pending_size(0), last_write_size(0), obj_len(0) {}
   virtual ~RGWPutObjProcessor_Aio() {
     drain_pending();
   }
@@ -788,6 +803,9 @@ public:
 class RGWGetDirHeader_CB;
 
 
+class RGWIndexCompleter;
+class RGWTimeLogBatcher;
+
 class RGWRados
 {
   friend class RGWGC;
@@ -801,7 +819,14 @@ class RGWRados
   int open_bucket_pool_ctx(const string& bucket_name, const string& pool, librados::IoCtx&  io_ctx);
   int open_bucket_index_ctx(rgw_bucket& bucket, librados::IoCtx&  index_ctx);
   int open_bucket_data_ctx(rgw_bucket& bucket, librados::IoCtx&  io_ctx);
-  int open_bucket_index(rgw_bucket& bucket, librados::IoCtx&  index_ctx, string& bucket_oid);
+  int open_bucket_index_base(rgw_bucket& bucket, librados::IoCtx&  index_ctx,
+                             string& bucket_oid_base, uint32_t *num_shards);
+  /* all the objects of a bucket's index, by shard */
+  int open_bucket_index(rgw_bucket& bucket, librados::IoCtx&  index_ctx,
+                        map<int, string>& bucket_objs);
+  /* the object of a bucket's index that has the entry of obj_key */
+  int open_bucket_index_shard(rgw_bucket& bucket, librados::IoCtx&  index_ctx,
+                              const string& obj_key, string& bucket_obj);
 
   struct GetObjState {
     librados::IoCtx io_ctx;
@@ -902,7 +927,8 @@ public:
                pools_initialized(false),
                quota_handler(NULL),
                rest_master_conn(NULL),
-               meta_mgr(NULL), data_log(NULL) {}
+               meta_mgr(NULL), data_log(NULL), index_completer(NULL),
+               time_log_batcher(NULL) {}
 
   void set_context(CephContext *_cct) {
     cct = _cct;
@@ -927,6 +953,8 @@ public:
   RGWMetadataManager *meta_mgr;
 
   RGWDataChangesLog *data_log;
+  RGWIndexCompleter *index_completer;
+  RGWTimeLogBatcher *time_log_batcher;
 
   virtual ~RGWRados() {
     if (rados) {
@@ -1006,7 +1034,7 @@ public:
    * create a bucket with name bucket and the given list of attrs
    * returns 0 on success, -ERR# otherwise.
    */
-  virtual int init_bucket_index(rgw_bucket& bucket);
+  virtual int init_bucket_index(rgw_bucket& bucket, uint32_t num_shards);
   int select_bucket_placement(RGWUserInfo& user_info, const string& region_name, const std::string& rule,
                               const std::string& bucket_name, rgw_bucket& bucket, string *pselected_rule);
   int select_legacy_bucket_placement(const string& bucket_name, rgw_bucket& bucket);
@@ -1268,8 +1296,6 @@ public:
                          off_t obj_ofs, off_t read_ofs, off_t len,
                          bool is_head_obj, void *arg);
 
-  void get_obj_aio_completion_cb(librados::completion_t cb, void *arg);
-
   /**
    * a simple object read without keeping state
    */
@@ -1282,6 +1308,10 @@ public:
   virtual bool supports_omap() { return true; }
   int omap_get_vals(rgw_obj& obj, bufferlist& header, const std::string& marker, uint64_t count, std::map<string, bufferlist>& m);
   virtual int omap_get_all(rgw_obj& obj, bufferlist& header, std::map<string, bufferlist>& m);
+  int omap_get_keys(rgw_obj& obj, std::set<string>& keys);
+  /* fetch the values of batches of keys, several batches at once, handing
+   * them to cb in order as they come in */
+  int omap_get_vals_by_keys(rgw_obj& obj, vector<set<string> >& batches, RGWOmapBatchCB *cb);
   virtual int omap_set(rgw_obj& obj, std::string& key, bufferlist& bl);
   virtual int omap_set(rgw_obj& obj, map<std::string, bufferlist>& m);
   virtual int omap_del(rgw_obj& obj, const std::string& key);
@@ -1340,7 +1370,6 @@ public:
   virtual int put_linked_bucket_info(RGWBucketInfo& info, bool exclusive, time_t mtime, obj_version *pep_objv,
                                      map<string, bufferlist> *pattrs, bool create_entry_point);
 
-  int cls_rgw_init_index(librados::IoCtx& io_ctx, librados::ObjectWriteOperation& op, string& oid);
   int cls_obj_prepare_op(rgw_bucket& bucket, RGWModifyOp op, string& tag,
                          string& name, string& locator);
   int cls_obj_complete_op(rgw_bucket& bucket, RGWModifyOp op, string& tag, int64_t pool, uint64_t epoch,
@@ -1351,7 +1380,8 @@ public:
   int cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeout);
   int cls_bucket_list(rgw_bucket& bucket, string start, string prefix, uint32_t num,
                       map<string, RGWObjEnt>& m, bool *is_truncated,
-                      string *last_entry, bool (*force_check_filter)(const string&  name) = NULL);
+                      string *last_entry, bool (*force_check_filter)(const string&  name) = NULL,
+                      const string& delim = string(), set<string> *common_prefixes = NULL);
   int cls_bucket_head(rgw_bucket& bucket, struct rgw_bucket_dir_header& header);
   int cls_bucket_head_async(rgw_bucket& bucket, RGWGetDirHeader_CB *ctx);
   int prepare_update_index(RGWObjState *state, rgw_bucket& bucket,
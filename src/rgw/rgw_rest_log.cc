@@ -20,7 +20,8 @@
 #include "rgw_client_io.h"
 #include "common/errno.h"
 
-#define LOG_CLASS_LIST_MAX_ENTRIES (1000)
+/* what a single call to the log objects returns at most */
+#define LOG_CLASS_LIST_MAX_ENTRIES (10000)
 #define dout_subsys ceph_subsys_rgw
 
 static int parse_date_str(string& in, utime_t& out) {
@@ -79,15 +80,11 @@ void RGWOp_MDLog_List::execute() {
 
   meta_log->init_list_entries(shard_id, ut_st, ut_et, marker, &handle);
 
-  do {
-    http_ret = meta_log->list_entries(handle, max_entries, entries,
-				      &last_marker, &truncated);
-    if (http_ret < 0) 
-      break;
-
-    if (!max_entries_str.empty()) 
-      max_entries -= entries.size();
-  } while (truncated && (max_entries > 0));
+  /* one page; the caller goes on from last_marker if it is truncated */
+  if (max_entries > LOG_CLASS_LIST_MAX_ENTRIES)
+    max_entries = LOG_CLASS_LIST_MAX_ENTRIES;
+  http_ret = meta_log->list_entries(handle, max_entries, entries,
+				    &last_marker, &truncated);
 
   meta_log->complete_list_entries(handle);
 }
@@ -477,18 +474,15 @@ void RGWOp_DATALog_List::execute() {
     }
   } 
   
-  do {
-    // Note that last_marker is updated to be the marker of the last
-    // entry listed
-    http_ret = store->data_log->list_entries(shard_id, ut_st, ut_et, 
-					     max_entries, entries, marker,
-					     &last_marker, &truncated);
-    if (http_ret < 0) 
-      break;
-
-    if (!max_entries_str.empty()) 
-      max_entries -= entries.size();
-  } while (truncated && (max_entries > 0));
+  /*
+   * one page; last_marker is the marker of the last entry listed, and the
+   * caller goes on from it if it is truncated
+   */
+  if (max_entries > LOG_CLASS_LIST_MAX_ENTRIES)
+    max_entries = LOG_CLASS_LIST_MAX_ENTRIES;
+  http_ret = store->data_log->list_entries(shard_id, ut_st, ut_et,
+					   max_entries, entries, marker,
+					   &last_marker, &truncated);
 }
 
 void RGWOp_DATALog_List::send_response() {
@@ -6,6 +6,8 @@
 #include "common/errno.h"
 #include "common/Formatter.h"
 #include "common/ceph_json.h"
+#include "common/Clock.h"
+#include "common/Mutex.h"
 #include "rgw_rados.h"
 #include "rgw_acl.h"
 
@@ -25,6 +27,104 @@ using namespace std;
 
 static RGWMetadataHandler *user_meta_handler = NULL;
 
+/*
+ * Users looked up by access key, as every authenticated S3 request does.
+ * Entries live for rgw_user_key_cache_ttl seconds; changes made through
+ * this gateway drop them right away, changes made elsewhere are seen once
+ * the entry expires.
+ */
+class RGWUserKeyCache {
+  struct user_entry {
+    RGWUserInfo info;
+    utime_t expires;
+    list<string>::iterator lru_iter;
+  };
+
+  Mutex lock;
+  map<string, user_entry> entries;
+  list<string> entries_lru;
+
+public:
+  RGWUserKeyCache() : lock("RGWUserKeyCache") {}
+
+  bool find(CephContext *cct, const string& access_key, RGWUserInfo& info);
+  void add(CephContext *cct, const string& access_key, RGWUserInfo& info);
+  void invalidate(CephContext *cct, const string& access_key);
+  void invalidate_user(CephContext *cct, RGWUserInfo& info);
+};
+
+bool RGWUserKeyCache::find(CephContext *cct, const string& access_key, RGWUserInfo& info)
+{
+  Mutex::Locker l(lock);
+  map<string, user_entry>::iterator iter = entries.find(access_key);
+  if (iter == entries.end()) {
+    if (perfcounter) perfcounter->inc(l_rgw_user_key_cache_miss);
+    return false;
+  }
+
+  user_entry& entry = iter->second;
+  if (ceph_clock_now(cct) > entry.expires) {
+    entries_lru.erase(entry.lru_iter);
+    entries.erase(iter);
+    if (perfcounter) perfcounter->inc(l_rgw_user_key_cache_miss);
+    return false;
+  }
+
+  entries_lru.splice(entries_lru.begin(), entries_lru, entry.lru_iter);
+  info = entry.info;
+  if (perfcounter) perfcounter->inc(l_rgw_user_key_cache_hit);
+
+  return true;
+}
+
+void RGWUserKeyCache::add(CephContext *cct, const string& access_key, RGWUserInfo& info)
+{
+  size_t max = cct->_conf->rgw_user_key_cache_size;
+  if (!max)
+    return;
+
+  Mutex::Locker l(lock);
+  map<string, user_entry>::iterator iter = entries.find(access_key);
+  if (iter == entries.end()) {
+    entries_lru.push_front(access_key);
+    iter = entries.insert(pair<string, user_entry>(access_key, user_entry())).first;
+  } else {
+    entries_lru.splice(entries_lru.begin(), entries_lru, iter->second.lru_iter);
+  }
+  user_entry& entry = iter->second;
+  entry.info = info;
+  entry.expires = ceph_clock_now(cct);
+  entry.expires += cct->_conf->rgw_user_key_cache_ttl;
+  entry.lru_iter = entries_lru.begin();
+
+  while (entries_lru.size() > max) {
+    entries.erase(entries_lru.back());
+    entries_lru.pop_back();
+  }
+}
+
+void RGWUserKeyCache::invalidate(CephContext *cct, const string& access_key)
+{
+  Mutex::Locker l(lock);
+  map<string, user_entry>::iterator iter = entries.find(access_key);
+  if (iter == entries.end())
+    return;
+
+  ldout(cct, 20) << "invalidating cached user for access key " << access_key << dendl;
+  entries_lru.erase(iter->second.lru_iter);
+  entries.erase(iter);
+}
+
+void RGWUserKeyCache::invalidate_user(CephContext *cct, RGWUserInfo& info)
+{
+  map<string, RGWAccessKey>::iterator iter;
+  for (iter = info.access_keys.begin(); iter != info.access_keys.end(); ++iter) {
+    invalidate(cct, iter->first);
+  }
+}
+
+static RGWUserKeyCache *user_key_cache = NULL;
+
 
 /**
  * Get the anonymous (ie, unauthenticated) user info.
@@ -108,6 +208,14 @@ int rgw_store_user_info(RGWRados *store, RGWUserInfo& info, RGWUserInfo *old_inf
   ::encode(info, data_bl);
 
   ret = store->meta_mgr->put_entry(user_meta_handler, info.user_id, data_bl, exclusive, &ot, mtime);
+
+  if (user_key_cache) {
+    /* keys that were dropped as well as the ones that remain, their user changed */
+    if (old_info)
+      user_key_cache->invalidate_user(store->ctx(), *old_info);
+    user_key_cache->invalidate_user(store->ctx(), info);
+  }
+
   if (ret < 0)
     return ret;
 
@@ -233,11 +341,28 @@ extern int rgw_get_user_info_by_swift(RGWRados *store, string& swift_name, RGWUs
 extern int rgw_get_user_info_by_access_key(RGWRados *store, string& access_key, RGWUserInfo& info,
                                            RGWObjVersionTracker *objv_tracker, time_t *pmtime)
 {
-  return rgw_get_user_info_from_index(store, access_key, store->zone.user_keys_pool, info, objv_tracker, pmtime);
+  /* callers that want the version or mtime are about to modify the user */
+  bool use_cache = (user_key_cache && !objv_tracker && !pmtime &&
+                    store->ctx()->_conf->rgw_user_key_cache_ttl > 0);
+  if (use_cache && user_key_cache->find(store->ctx(), access_key, info))
+    return 0;
+
+  int ret = rgw_get_user_info_from_index(store, access_key, store->zone.user_keys_pool, info, objv_tracker, pmtime);
+  if (ret < 0)
+    return ret;
+
+  /* the index may lag behind the user; only cache keys the user really has */
+  if (use_cache && info.access_keys.count(access_key))
+    user_key_cache->add(store->ctx(), access_key, info);
+
+  return 0;
 }
 
 int rgw_remove_key_index(RGWRados *store, RGWAccessKey& access_key)
 {
+  if (user_key_cache)
+    user_key_cache->invalidate(store->ctx(), access_key.id);
+
   rgw_obj obj(store->zone.user_keys_pool, access_key.id);
   int ret = store->delete_obj(NULL, obj);
   return ret;
@@ -2396,4 +2521,6 @@ void rgw_user_init(RGWMetadataManager *mm)
 {
   user_meta_handler = new RGWUserMetadataHandler;
   mm->register_handler(user_meta_handler);
+
+  user_key_cache = new RGWUserKeyCache;
 }
@@ -0,0 +1,125 @@
+#!/usr/bin/env python
+
+"""
+Read the perf counter stream of a daemon (perf_stream_path, see
+doc/dev/perf_counters.rst) and print one line of JSON per sample with
+the counters that changed, as rates per second unless --totals.
+"""
+
+import argparse
+import json
+import socket
+import struct
+import sys
+
+FRAME_SCHEMA = 1
+FRAME_SAMPLE = 2
+
+PERFCOUNTER_TIME = 0x1
+PERFCOUNTER_LONGRUNAVG = 0x4
+PERFCOUNTER_COUNTER = 0x8
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description='print the perf counter stream of a ceph daemon')
+    parser.add_argument(
+        'path',
+        help='the daemon\'s perf_stream_path',
+        )
+    parser.add_argument(
+        '--totals',
+        action='store_true',
+        default=False,
+        help='print the values instead of the rates of counters',
+        )
+    return parser.parse_args()
+
+
+def read_exact(sock, n):
+    buf = b''
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise EOFError()
+        buf += chunk
+    return buf
+
+
+def frames(sock):
+    while True:
+        (length,) = struct.unpack('<I', read_exact(sock, 4))
+        body = read_exact(sock, length)
+        yield ord(body[0:1]), body[1:]
+
+
+def parse_schema(body):
+    (n,) = struct.unpack_from('<I', body, 0)
+    off = 4
+    names, types = [], []
+    for _ in range(n):
+        (l,) = struct.unpack_from('<I', body, off)
+        off += 4
+        names.append(body[off:off + l].decode())
+        off += l
+        types.append(ord(body[off:off + 1]))
+        off += 1
+    return names, types
+
+
+def parse_sample(body):
+    sec, nsec, key, n = struct.unpack_from('<IIBI', body, 0)
+    off = 13
+    changes = []
+    for _ in range(n):
+        changes.append(struct.unpack_from('<IQ', body, off))
+        off += 12
+    return sec + nsec / 1e9, key, changes
+
+
+def main():
+    ctx = parse_args()
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(ctx.path)
+
+    names, types, values = [], [], []
+    last_stamp = None
+    try:
+        for ftype, body in frames(sock):
+            if ftype == FRAME_SCHEMA:
+                names, types = parse_schema(body)
+                values = [0] * (2 * len(names))
+                continue
+            if ftype != FRAME_SAMPLE:
+                continue
+            stamp, key, changes = parse_sample(body)
+            if key:
+                values = [0] * (2 * len(names))
+            for i, v in changes:
+                values[i] = (values[i] + v) & 0xffffffffffffffff
+            elapsed = stamp - last_stamp if last_stamp else 0
+            last_stamp = stamp
+            out = {}
+            for i, v in changes:
+                c = i // 2
+                t = types[c]
+                if t & PERFCOUNTER_LONGRUNAVG:
+                    count = values[2 * c + 1]
+                    total = values[2 * c]
+                    if t & PERFCOUNTER_TIME:
+                        total /= 1e9
+                    out[names[c]] = {'avgcount': count, 'sum': total}
+                elif (t & PERFCOUNTER_COUNTER and not ctx.totals and
+                      not key and elapsed > 0):
+                    out[names[c]] = v / elapsed
+                else:
+                    out[names[c]] = values[2 * c]
+            print(json.dumps({'stamp': stamp, 'key': bool(key),
+                              'counters': out}, sort_keys=True))
+            sys.stdout.flush()
+    except (EOFError, KeyboardInterrupt):
+        pass
+
+
+if __name__ == '__main__':
+    main()
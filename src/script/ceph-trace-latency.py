@@ -0,0 +1,149 @@
+#!/usr/bin/env python
+
+"""
+Break the latency of OSD ops down by stage, from a trace of the ceph
+USDT probes (see doc/dev/tracing.rst).  Reads the output of
+
+  perf script -F comm,pid,tid,time,event,trace
+
+and joins the probes of each op by the OpRequest seq and the FileStore
+op seq they carry.
+"""
+
+import argparse
+import re
+import sys
+
+LINE_RE = re.compile(
+    r'^\s*\S+\s+(?P<pid>\d+)(?:/\d+)?\s+(?:\[\d+\]\s+)?'
+    r'(?P<time>\d+\.\d+):\s+(?:sdt_)?ceph:(?P<probe>\w+):(?P<rest>.*)$')
+ARG_RE = re.compile(r'arg(\d+)=(\S+)')
+
+# name, from event, to event
+STAGES = [
+    ('messenger', 'recv', 'enqueue'),
+    ('op_queue', 'enqueue', 'dequeue'),
+    ('pg', 'dequeue', 'issue_repop'),
+    ('prepare', 'issue_repop', 'fs_queue'),
+    ('journal', 'journal_submit', 'journal_done'),
+    ('apply_queue', 'fs_queue', 'apply_start'),
+    ('apply', 'apply_start', 'apply_done'),
+    ('commit_reply', 'journal_done', 'commit_sent'),
+    ('total', 'recv', 'commit_sent'),
+]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description='per stage latency of osd ops from a ceph usdt trace')
+    parser.add_argument(
+        'input',
+        nargs='?',
+        type=argparse.FileType('r'),
+        default=sys.stdin,
+        help='perf script output (default: stdin)',
+        )
+    parser.add_argument(
+        '--ops',
+        action='store_true',
+        default=False,
+        help='print the stages of each op as well',
+        )
+    return parser.parse_args()
+
+
+def arg(args, n):
+    v = args[n]
+    return int(v, 16) if v.startswith('0x') else int(v)
+
+
+def parse(f):
+    ops = {}        # (pid, op seq) -> {event: time}
+    by_tid = {}     # (pid, src, tid) -> time the message was read
+    by_fsop = {}    # (pid, fs op) -> op events
+
+    def op(pid, seq):
+        return ops.setdefault((pid, seq), {})
+
+    def fsop(pid, seq):
+        # ops not from an OpRequest (seq 0) are tracked on their own
+        return by_fsop.setdefault((pid, seq), {})
+
+    for line in f:
+        m = LINE_RE.match(line)
+        if not m:
+            continue
+        pid = int(m.group('pid'))
+        t = float(m.group('time'))
+        probe = m.group('probe')
+        args = dict((int(k), v) for k, v in ARG_RE.findall(m.group('rest')))
+        try:
+            if probe == 'pipe_read_message':
+                by_tid[(pid, arg(args, 2), arg(args, 3))] = t
+            elif probe == 'osd_enqueue_op':
+                e = op(pid, arg(args, 1))
+                e['enqueue'] = t
+                recv = by_tid.pop((pid, arg(args, 2), arg(args, 3)), None)
+                if recv is not None:
+                    e['recv'] = recv
+            elif probe == 'osd_dequeue_op':
+                op(pid, arg(args, 1)).setdefault('dequeue', t)
+            elif probe == 'pg_do_op':
+                op(pid, arg(args, 1)).setdefault('do_op', t)
+            elif probe == 'pg_issue_repop':
+                if arg(args, 1):
+                    op(pid, arg(args, 1)).setdefault('issue_repop', t)
+            elif probe == 'pg_commit_sent':
+                op(pid, arg(args, 1))['commit_sent'] = t
+            elif probe == 'filestore_queue_transactions':
+                seq = arg(args, 1)
+                e = op(pid, seq) if seq else {}
+                e.setdefault('fs_queue', t)
+                by_fsop[(pid, arg(args, 2))] = e
+            elif probe == 'filejournal_submit_entry':
+                fsop(pid, arg(args, 1)).setdefault('journal_submit', t)
+            elif probe == 'filejournal_completion':
+                fsop(pid, arg(args, 1)).setdefault('journal_done', t)
+            elif probe == 'filestore_do_op':
+                fsop(pid, arg(args, 1)).setdefault('apply_start', t)
+            elif probe == 'filestore_finish_op':
+                fsop(pid, arg(args, 1)).setdefault('apply_done', t)
+        except (KeyError, ValueError):
+            continue
+    return ops
+
+
+def percentile(sorted_values, p):
+    i = int(round(p * (len(sorted_values) - 1)))
+    return sorted_values[i]
+
+
+def main():
+    ctx = parse_args()
+    ops = parse(ctx.input)
+
+    lats = dict((name, []) for name, _, _ in STAGES)
+    for (pid, seq), e in sorted(ops.items()):
+        row = []
+        for name, start, end in STAGES:
+            if start in e and end in e and e[end] >= e[start]:
+                lat = (e[end] - e[start]) * 1000.0
+                lats[name].append(lat)
+                row.append('%s=%.3f' % (name, lat))
+        if ctx.ops and row:
+            print('%d %d %s' % (pid, seq, ' '.join(row)))
+
+    print('%-14s %8s %10s %10s %10s %10s' %
+          ('stage', 'count', 'avg ms', 'p50 ms', 'p99 ms', 'max ms'))
+    for name, _, _ in STAGES:
+        v = sorted(lats[name])
+        if not v:
+            print('%-14s %8d' % (name, 0))
+            continue
+        print('%-14s %8d %10.3f %10.3f %10.3f %10.3f' %
+              (name, len(v), sum(v) / len(v), percentile(v, 0.5),
+               percentile(v, 0.99), v[-1]))
+
+
+if __name__ == '__main__':
+    main()
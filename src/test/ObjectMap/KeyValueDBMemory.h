@@ -19,6 +19,13 @@ public:
   KeyValueDBMemory(KeyValueDBMemory *db) : db(db->db) { }
   virtual ~KeyValueDBMemory() { }
 
+  virtual int open(ostream &out) {
+    return 0;
+  }
+  virtual int create_and_open(ostream &out) {
+    return 0;
+  }
+
   int get(
     const string &prefix,
     const std::set<string> &key,
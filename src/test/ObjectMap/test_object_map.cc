@@ -710,6 +710,35 @@ TEST_F(ObjectMapTest, OddEvenClone) {
   db->clear(hoid2);
 }
 
+TEST_F(ObjectMapTest, CloneOntoCachedHeader) {
+  ghobject_t hoid(hobject_t(sobject_t("foo", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("foo2", CEPH_NOSNAP)));
+
+  tester.set_key(hoid, "foo", "bar");
+  tester.set_key(hoid2, "foo2", "bar2");
+  string result;
+  ASSERT_EQ(1, tester.get_key(hoid, "foo", &result));
+  ASSERT_EQ(1, tester.get_key(hoid2, "foo2", &result));
+
+  // both headers are cached; the clone must replace hoid2's
+  db->clone(hoid, hoid2);
+  ASSERT_EQ(0, tester.get_key(hoid2, "foo2", &result));
+  ASSERT_EQ(1, tester.get_key(hoid2, "foo", &result));
+  ASSERT_EQ("bar", result);
+
+  db->clone(hoid2, hoid);
+  tester.remove_key(hoid2, "foo");
+  ASSERT_EQ(0, tester.get_key(hoid2, "foo", &result));
+  ASSERT_EQ(1, tester.get_key(hoid, "foo", &result));
+  ASSERT_EQ("bar", result);
+
+  db->clear(hoid);
+  map<string, bufferlist> got;
+  bufferlist header;
+  ASSERT_EQ(-ENOENT, db->get(hoid, &header, &got));
+  db->clear(hoid2);
+}
+
 TEST_F(ObjectMapTest, RandomTest) {
   tester.def_init();
   for (unsigned i = 0; i < 5000; ++i) {
@@ -6,6 +6,9 @@
 #include <tr1/memory>
 #include "common/Mutex.h"
 #include "common/Cond.h"
+#include "common/Clock.h"
+#include <errno.h>
+#include <sstream>
 
 template<typename T>
 struct C_Holder : public Context {
@@ -148,18 +151,26 @@ void Bencher::run_bench()
 {
   time_t end = time(0) + max_duration;
   uint64_t ops = 0;
+  utime_t start = ceph_clock_now(NULL);
 
   bufferlist bl;
 
-  while ((!max_duration || time(0) < end) && (!max_ops || ops < max_ops)) {
+  while ((!max_duration || time(0) < end) && (!max_ops || ops < max_ops) &&
+	 !op_dist->done()) {
     start_op();
-    uint64_t seq = stat_collector->next_seq();
     boost::tuple<std::string, uint64_t, uint64_t, OpType> next =
       (*op_dist)();
+    uint64_t seq = stat_collector->next_seq();
     string obj_name = next.get<0>();
     uint64_t offset = next.get<1>();
     uint64_t length = next.get<2>();
     OpType op_type = next.get<3>();
+    if (trace_out) {
+      *trace_out << (double)(ceph_clock_now(NULL) - start) << " "
+		 << (op_type == WRITE ? "write" : "read") << " "
+		 << obj_name << " " << offset << " " << length << "\n";
+    }
+    ++ops;
     switch (op_type) {
       case WRITE: {
 	std::tr1::shared_ptr<OnDelete> on_delete(
@@ -168,10 +179,12 @@ void Bencher::run_bench()
 	while (bl.length() < length) {
 	  bl.append(rand());
 	}
+	bufferlist write_bl;
+	write_bl.substr_of(bl, 0, length);
 	backend->write(
 	  obj_name,
 	  offset,
-	  bl,
+	  write_bl,
 	  new OnWriteApplied(
 	    this, seq, on_delete),
 	  new OnWriteCommit(
@@ -198,4 +211,88 @@ void Bencher::run_bench()
     }
   }
   drain_ops();
+  if (trace_out)
+    trace_out->flush();
+}
+
+int ReplayLoad::open(const string &path)
+{
+  in.open(path.c_str());
+  if (!in.is_open())
+    return -errno;
+  read_next();
+  return 0;
+}
+
+void ReplayLoad::read_next()
+{
+  string line;
+  have_next = false;
+  while (getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream ss(line);
+    string type, obj;
+    uint64_t offset, length;
+    if (!(ss >> next_time >> type >> obj >> offset >> length) ||
+	(type != "read" && type != "write") || !length) {
+      ++bad_lines;
+      continue;
+    }
+
+    map<string, string>::iterator i = mapping.find(obj);
+    if (i == mapping.end())
+      i = mapping.insert(
+	make_pair(obj, objects[mapping.size() % objects.size()])).first;
+
+    if (size && offset + length > size) {
+      offset %= size;
+      if (offset + length > size)
+	length = size - offset;
+    }
+    next = boost::make_tuple(
+      i->second, offset, length,
+      type == "write" ? Bencher::WRITE : Bencher::READ);
+    have_next = true;
+    return;
+  }
+}
+
+boost::tuple<string, uint64_t, uint64_t, Bencher::OpType>
+ReplayLoad::operator()()
+{
+  assert(have_next);
+  utime_t now = ceph_clock_now(NULL);
+  if (!started) {
+    // the trace starts with its first op
+    start = now;
+    start -= next_time;
+    started = true;
+  }
+  utime_t due = start;
+  due += next_time;
+  if (due > now) {
+    (due - now).sleep();
+  } else {
+    double lag = now - due;
+    if (lag > .001)
+      ++late_ops;
+    if (lag > max_lag)
+      max_lag = lag;
+  }
+  ++ops;
+
+  boost::tuple<string, uint64_t, uint64_t, Bencher::OpType> ret = next;
+  read_next();
+  return ret;
+}
+
+void ReplayLoad::print_summary(std::ostream *out)
+{
+  *out << "Replayed " << ops << " ops on " << mapping.size()
+       << " objects, " << late_ops << " more than 1ms late, max lag "
+       << max_lag << "s";
+  if (bad_lines)
+    *out << ", skipped " << bad_lines << " bad lines";
+  *out << std::endl;
 }
@@ -4,6 +4,8 @@
 #define BENCHERH
 
 #include <utility>
+#include <fstream>
+#include <map>
 #include "distribution.h"
 #include "stat_collector.h"
 #include "backend.h"
@@ -11,6 +13,7 @@
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/Thread.h"
+#include "include/utime.h"
 
 class OnWriteApplied;
 class OnWriteCommit;
@@ -32,6 +35,7 @@ private:
   const uint64_t max_in_flight;
   const uint64_t max_duration;
   const uint64_t max_ops;
+  std::ostream *trace_out;
 
   Mutex lock;
   Cond open_ops_cond;
@@ -53,6 +57,7 @@ public:
     max_in_flight(max_in_flight),
     max_duration(max_duration),
     max_ops(max_ops),
+    trace_out(0),
     lock("Bencher::lock"),
     open_ops(0)
   {}
@@ -69,6 +74,7 @@ public:
     max_in_flight(max_in_flight),
     max_duration(max_duration),
     max_ops(max_ops),
+    trace_out(0),
     lock("Bencher::lock"),
     open_ops(0)
   {}
@@ -90,6 +96,7 @@ public:
     max_in_flight(max_in_flight),
     max_duration(max_duration),
     max_ops(max_ops),
+    trace_out(0),
     lock("Bencher::lock"),
     open_ops(0)
   {}
@@ -100,6 +107,11 @@ public:
     std::ostream *out
     );
 
+  /// write the ops issued to out, in the format ReplayLoad reads
+  void record_trace(std::ostream *out) {
+    trace_out = out;
+  }
+
   void run_bench();
   void *entry() {
     run_bench();
@@ -144,4 +156,56 @@ public:
     return ret;
   }
 };
+
+/**
+ * Replays a trace recorded with Bencher::record_trace(), or converted
+ * from a client log by rbd_log_to_trace.py.  Each line is
+ *
+ *   <seconds since start> <read|write> <object> <offset> <length>
+ *
+ * and each op is handed out once it is due, so the trace keeps its
+ * timing as long as the in flight limit of the bencher allows.  The
+ * objects of the trace are mapped onto those of the bench in the
+ * order they first show up, and ops that run past the end of an
+ * object are wrapped into it.
+ */
+class ReplayLoad :
+  public Distribution<
+  boost::tuple<string, uint64_t, uint64_t, Bencher::OpType> > {
+  std::ifstream in;
+  vector<string> objects;
+  uint64_t size;
+  map<string, string> mapping;
+
+  bool have_next;
+  double next_time;
+  boost::tuple<string, uint64_t, uint64_t, Bencher::OpType> next;
+
+  bool started;
+  utime_t start;
+  uint64_t ops;
+  uint64_t late_ops;
+  double max_lag;
+  uint64_t bad_lines;
+
+  void read_next();
+  ReplayLoad(const ReplayLoad &other);
+public:
+  ReplayLoad(const set<string> &_objects, uint64_t size)
+    : objects(_objects.begin(), _objects.end()), size(size),
+      have_next(false), next_time(0), started(false),
+      ops(0), late_ops(0), max_lag(0), bad_lines(0) {}
+
+  /// -errno if the trace can't be read
+  int open(const string &path);
+
+  boost::tuple<string, uint64_t, uint64_t, Bencher::OpType>
+  operator()();
+  bool done() {
+    return !have_next;
+  }
+
+  /// how closely the timing of the trace was kept
+  void print_summary(std::ostream *out);
+};
 #endif
@@ -2,6 +2,7 @@
 
 #include "detailed_stat_collector.h"
 #include <sys/time.h>
+#include <algorithm>
 #include <utility>
 #include <boost/tuple/tuple.hpp>
 
@@ -46,6 +47,26 @@ void DetailedStatCollector::Aggregator::add(const Op &op)
   total_size += op.size;
   recent_latency += op.latency;
   total_latency += op.latency;
+  latencies.push_back(op.latency);
+}
+
+static double percentile(const vector<double> &sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  return sorted[(size_t)(p * (sorted.size() - 1) + .5)];
+}
+
+void DetailedStatCollector::Aggregator::dump_summary(Formatter *f)
+{
+  sort(latencies.begin(), latencies.end());
+  f->dump_unsigned("ops", total_ops);
+  f->dump_unsigned("bytes", total_size);
+  f->dump_float("avg_latency", total_ops ? total_latency / total_ops : 0);
+  f->dump_float("p50_latency", percentile(latencies, .5));
+  f->dump_float("p99_latency", percentile(latencies, .99));
+  f->dump_float("p999_latency", percentile(latencies, .999));
+  f->dump_float("max_latency", latencies.empty() ? 0 : latencies.back());
 }
 
 void DetailedStatCollector::Aggregator::dump(Formatter *f)
@@ -105,6 +126,24 @@ uint64_t DetailedStatCollector::next_seq()
   return cur_seq++;
 }
 
+void DetailedStatCollector::dump_summary()
+{
+  Mutex::Locker l(lock);
+  if (!summary_out)
+    return;
+  f->open_object_section("summary");
+  for (map<string, Aggregator>::iterator i = aggregators.begin();
+       i != aggregators.end();
+       ++i) {
+    f->open_object_section(i->first.c_str());
+    i->second.dump_summary(f.get());
+    f->close_section();
+  }
+  f->close_section();
+  f->flush(*summary_out);
+  *summary_out << std::endl;
+}
+
 void DetailedStatCollector::start_write(uint64_t seq, uint64_t length)
 {
   Mutex::Locker l(lock);
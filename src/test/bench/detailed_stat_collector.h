@@ -48,11 +48,14 @@ private:
     uint64_t recent_ops;
     uint64_t total_ops;
     bool started;
+    vector<double> latencies;
   public:
     Aggregator();
 
     void add(const Op &op);
     void dump(Formatter *f);
+    /// latency distribution over the whole run
+    void dump_summary(Formatter *f);
   };
   const double bin_size;
   boost::scoped_ptr<Formatter> f;
@@ -91,6 +94,9 @@ public:
   void write_committed(uint64_t seq);
   void read_complete(uint64_t seq);
 
+  /// print the latency distribution of each op type to summary_out
+  void dump_summary();
+
 };
 
 #endif
@@ -19,6 +19,8 @@ template <typename T>
 class Distribution {
 public:
   virtual T operator()() = 0;
+  /// true once there is nothing left to draw; most never run out
+  virtual bool done() { return false; }
   virtual ~Distribution() {}
 };
 
@@ -0,0 +1,461 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+
+/*
+ * Messenger throughput and latency.  A server echoes whatever the
+ * clients send; each client opens --connections connections to it,
+ * keeps --in-flight messages outstanding on each and measures the
+ * round trips.  The backend is whatever ms_type says, and the
+ * ms_inject_* options work as usual, so the cost of reconnecting
+ * shows up in the latency tail and the reset counts.
+ *
+ *   ceph_msgrbench --mode server --addr 10.0.0.1:6900
+ *   ceph_msgrbench --mode client --addr 10.0.0.1:6900 --ms-type async
+ */
+
+#include <boost/program_options/option.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "common/Clock.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "msg/Messenger.h"
+#include "messages/MPing.h"
+#include "messages/MOSDOp.h"
+#include "messages/MOSDOpReply.h"
+
+namespace po = boost::program_options;
+using namespace std;
+
+static double cpu_seconds()
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0 +
+    ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+}
+
+/// the value below which fraction p of v lies; sorts v
+static double percentile(vector<double> &v, double p)
+{
+  if (v.empty())
+    return 0;
+  sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1) + .5)];
+}
+
+class BenchServer : public Dispatcher {
+  Messenger *msgr;
+  bool fast;
+public:
+  Mutex lock;
+  uint64_t msgs;
+  uint64_t bytes;
+  uint64_t resets;
+
+  BenchServer(CephContext *cct, Messenger *msgr, bool fast)
+    : Dispatcher(cct), msgr(msgr), fast(fast), lock("BenchServer::lock"),
+      msgs(0), bytes(0), resets(0) {}
+
+  void handle(Message *m) {
+    Message *reply;
+    if (m->get_type() == CEPH_MSG_OSD_OP) {
+      reply = new MOSDOpReply(static_cast<MOSDOp*>(m), 0, 1,
+			      CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK);
+    } else {
+      reply = new MPing;
+      reply->set_tid(m->get_tid());
+    }
+    {
+      Mutex::Locker l(lock);
+      ++msgs;
+      bytes += m->get_payload().length() + m->get_middle().length() +
+	m->get_data().length();
+    }
+    msgr->send_message(reply, m->get_connection().get());
+    m->put();
+  }
+
+  bool ms_can_fast_dispatch_any() const { return fast; }
+  bool ms_can_fast_dispatch(Message *m) const {
+    return m->get_type() == CEPH_MSG_OSD_OP || m->get_type() == CEPH_MSG_PING;
+  }
+  void ms_fast_dispatch(Message *m) {
+    handle(m);
+  }
+  bool ms_dispatch(Message *m) {
+    if (m->get_type() != CEPH_MSG_OSD_OP && m->get_type() != CEPH_MSG_PING)
+      return false;
+    handle(m);
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) {
+    Mutex::Locker l(lock);
+    ++resets;
+    return true;
+  }
+  void ms_handle_remote_reset(Connection *con) {
+    Mutex::Locker l(lock);
+    ++resets;
+  }
+};
+
+/// one connection to the server, with its own messenger
+class BenchClient : public Dispatcher {
+  Messenger *msgr;
+  ConnectionRef con;
+  bool osd_op;
+  unsigned depth;
+  bool fast;
+  bufferptr payload;
+
+  uint64_t next_tid;
+  map<uint64_t, utime_t> in_flight;
+  bool stopping;
+
+public:
+  Mutex lock;
+  Cond cond;
+  uint64_t received;
+  uint64_t connects;
+  uint64_t resets;
+  vector<double> latencies;
+  vector<double> interval_latencies;
+
+  BenchClient(CephContext *cct, Messenger *msgr, bool osd_op,
+	      unsigned size, unsigned depth, bool fast)
+    : Dispatcher(cct), msgr(msgr), osd_op(osd_op), depth(depth), fast(fast),
+      payload(buffer::create(size)), next_tid(1), stopping(false),
+      lock("BenchClient::lock"), received(0), connects(0), resets(0) {
+    payload.zero();
+  }
+
+  void send_one() {
+    assert(lock.is_locked());
+    uint64_t tid = next_tid++;
+    bufferlist bl;
+    if (payload.length())
+      bl.append(payload);
+    Message *m;
+    if (osd_op) {
+      object_t oid("msgr_bench");
+      object_locator_t oloc(0);
+      MOSDOp *op = new MOSDOp(0, tid, oid, oloc, pg_t(), 1,
+			      CEPH_OSD_FLAG_WRITE | CEPH_OSD_FLAG_ONDISK);
+      op->write(0, bl.length(), bl);
+      m = op;
+    } else {
+      m = new MPing;
+      m->set_tid(tid);
+      m->set_data(bl);
+    }
+    in_flight[tid] = ceph_clock_now(NULL);
+    msgr->send_message(m, con.get());
+  }
+
+  void start(const entity_inst_t &server) {
+    con = msgr->get_connection(server);
+    Mutex::Locker l(lock);
+    for (unsigned i = 0; i < depth; ++i)
+      send_one();
+  }
+
+  /// stop sending; returns the number of messages still unanswered
+  uint64_t stop(double timeout) {
+    Mutex::Locker l(lock);
+    stopping = true;
+    utime_t until = ceph_clock_now(NULL);
+    until += timeout;
+    while (!in_flight.empty() && ceph_clock_now(NULL) < until)
+      cond.WaitUntil(lock, until);
+    return in_flight.size();
+  }
+
+  void handle(Message *m) {
+    utime_t now = ceph_clock_now(NULL);
+    Mutex::Locker l(lock);
+    map<uint64_t, utime_t>::iterator p = in_flight.find(m->get_tid());
+    if (p != in_flight.end()) {
+      double lat = now - p->second;
+      latencies.push_back(lat);
+      interval_latencies.push_back(lat);
+      in_flight.erase(p);
+      ++received;
+      if (!stopping)
+	send_one();
+      else if (in_flight.empty())
+	cond.Signal();
+    }
+    m->put();
+  }
+
+  bool ms_can_fast_dispatch_any() const { return fast; }
+  bool ms_can_fast_dispatch(Message *m) const {
+    return m->get_type() == CEPH_MSG_OSD_OPREPLY ||
+      m->get_type() == CEPH_MSG_PING;
+  }
+  void ms_fast_dispatch(Message *m) {
+    handle(m);
+  }
+  bool ms_dispatch(Message *m) {
+    if (m->get_type() != CEPH_MSG_OSD_OPREPLY &&
+	m->get_type() != CEPH_MSG_PING)
+      return false;
+    handle(m);
+    return true;
+  }
+  void ms_handle_connect(Connection *c) {
+    Mutex::Locker l(lock);
+    ++connects;
+  }
+  bool ms_handle_reset(Connection *c) {
+    Mutex::Locker l(lock);
+    ++resets;
+    return true;
+  }
+  void ms_handle_remote_reset(Connection *c) {
+    Mutex::Locker l(lock);
+    ++resets;
+  }
+};
+
+static int run_server(const entity_addr_t &addr, bool fast, unsigned duration)
+{
+  Messenger *msgr = Messenger::create(g_ceph_context, entity_name_t::OSD(0),
+				     "server", getpid());
+  // keep the replies of a client that reconnects
+  msgr->set_default_policy(Messenger::Policy::stateful_server(0, 0));
+  int r = msgr->bind(addr);
+  if (r < 0) {
+    cerr << "bind to " << addr << " failed: " << r << std::endl;
+    return r;
+  }
+  BenchServer server(g_ceph_context, msgr, fast);
+  msgr->add_dispatcher_head(&server);
+  msgr->start();
+  cout << "serving on " << msgr->get_myaddr() << std::endl;
+
+  uint64_t last_msgs = 0, last_bytes = 0;
+  double last_cpu = cpu_seconds();
+  for (unsigned sec = 1; !duration || sec <= duration; ++sec) {
+    sleep(1);
+    uint64_t msgs, bytes, resets;
+    {
+      Mutex::Locker l(server.lock);
+      msgs = server.msgs;
+      bytes = server.bytes;
+      resets = server.resets;
+    }
+    double cpu = cpu_seconds();
+    uint64_t n = msgs - last_msgs;
+    cout << sec << " msgs/s " << n
+	 << " MB/s " << (double)(bytes - last_bytes) / (1024*1024)
+	 << " cpu us/msg " << (n ? (cpu - last_cpu) * 1000000 / n : 0)
+	 << " resets " << resets << std::endl;
+    last_msgs = msgs;
+    last_bytes = bytes;
+    last_cpu = cpu;
+  }
+
+  msgr->shutdown();
+  msgr->wait();
+  delete msgr;
+  return 0;
+}
+
+static int run_client(const entity_addr_t &addr, unsigned connections,
+		      unsigned depth, unsigned size, bool osd_op, bool fast,
+		      unsigned duration)
+{
+  entity_inst_t server(entity_name_t::OSD(0), addr);
+  vector<Messenger*> msgrs;
+  vector<BenchClient*> clients;
+  for (unsigned i = 0; i < connections; ++i) {
+    Messenger *msgr = Messenger::create(g_ceph_context,
+				       entity_name_t::CLIENT(-1), "client",
+				       getpid() * 1000 + i);
+    // resend what a connection fault lost
+    msgr->set_default_policy(Messenger::Policy::lossless_client(0, 0));
+    BenchClient *client = new BenchClient(g_ceph_context, msgr, osd_op,
+					  size, depth, fast);
+    msgr->add_dispatcher_head(client);
+    msgr->start();
+    msgrs.push_back(msgr);
+    clients.push_back(client);
+  }
+
+  double cpu_start = cpu_seconds();
+  utime_t start = ceph_clock_now(NULL);
+  for (unsigned i = 0; i < connections; ++i)
+    clients[i]->start(server);
+
+  uint64_t last_received = 0;
+  for (unsigned sec = 1; sec <= duration; ++sec) {
+    sleep(1);
+    uint64_t received = 0;
+    vector<double> lat;
+    for (unsigned i = 0; i < connections; ++i) {
+      Mutex::Locker l(clients[i]->lock);
+      received += clients[i]->received;
+      lat.insert(lat.end(), clients[i]->interval_latencies.begin(),
+		 clients[i]->interval_latencies.end());
+      clients[i]->interval_latencies.clear();
+    }
+    uint64_t n = received - last_received;
+    cout << sec << " msgs/s " << n
+	 << " MB/s " << (double)n * size / (1024*1024)
+	 << " p50 " << percentile(lat, .5)
+	 << " p99 " << percentile(lat, .99) << std::endl;
+    last_received = received;
+  }
+
+  uint64_t lost = 0;
+  for (unsigned i = 0; i < connections; ++i)
+    lost += clients[i]->stop(30);
+  double runtime = ceph_clock_now(NULL) - start;
+  double cpu = cpu_seconds() - cpu_start;
+
+  uint64_t received = 0, reconnects = 0, resets = 0;
+  vector<double> lat;
+  for (unsigned i = 0; i < connections; ++i) {
+    Mutex::Locker l(clients[i]->lock);
+    received += clients[i]->received;
+    if (clients[i]->connects > 1)
+      reconnects += clients[i]->connects - 1;
+    resets += clients[i]->resets;
+    lat.insert(lat.end(), clients[i]->latencies.begin(),
+	       clients[i]->latencies.end());
+  }
+  double total = 0;
+  for (vector<double>::iterator p = lat.begin(); p != lat.end(); ++p)
+    total += *p;
+
+  cout << "backend:          " << g_conf->ms_type << std::endl
+       << "connections:      " << connections << std::endl
+       << "in flight:        " << depth << " per connection" << std::endl
+       << "message:          " << (osd_op ? "osd_op" : "ping")
+       << ", " << size << " bytes" << std::endl
+       << "messages:         " << received << std::endl
+       << "msgs/sec:         " << received / runtime << std::endl
+       << "MB/sec:           " << (double)received * size / runtime / (1024*1024)
+       << std::endl
+       << "cpu us/msg:       " << (received ? cpu * 1000000 / received : 0)
+       << std::endl
+       << "avg latency:      " << (lat.empty() ? 0 : total / lat.size())
+       << std::endl
+       << "p50 latency:      " << percentile(lat, .5) << std::endl
+       << "p99 latency:      " << percentile(lat, .99) << std::endl
+       << "p99.9 latency:    " << percentile(lat, .999) << std::endl
+       << "max latency:      " << (lat.empty() ? 0 : lat.back()) << std::endl
+       << "reconnects:       " << reconnects << std::endl
+       << "resets:           " << resets << std::endl
+       << "unanswered:       " << lost << std::endl;
+
+  for (unsigned i = 0; i < connections; ++i) {
+    msgrs[i]->shutdown();
+    msgrs[i]->wait();
+    delete msgrs[i];
+    delete clients[i];
+  }
+  return lost ? -ETIMEDOUT : 0;
+}
+
+int main(int argc, char **argv)
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", "produce help message")
+    ("mode", po::value<string>()->default_value("client"),
+     "server or client")
+    ("addr", po::value<string>(),
+     "address the server listens on, mandatory")
+    ("connections", po::value<unsigned>()->default_value(1),
+     "connections the client opens")
+    ("in-flight", po::value<unsigned>()->default_value(16),
+     "messages outstanding on each connection")
+    ("msg-size", po::value<unsigned>()->default_value(4096),
+     "data bytes in each message")
+    ("msg-type", po::value<string>()->default_value("ping"),
+     "ping, or osd_op for an osd write op and its reply")
+    ("duration", po::value<unsigned>()->default_value(10),
+     "seconds to run; 0 runs a server until it is killed")
+    ("fast-dispatch", po::value<bool>()->default_value(false),
+     "handle messages from the thread that read them")
+    ;
+
+  po::variables_map vm;
+  po::parsed_options parsed =
+    po::command_line_parser(argc, argv).options(desc).allow_unregistered().run();
+  po::store(
+    parsed,
+    vm);
+  po::notify(vm);
+
+  vector<const char *> ceph_options, def_args;
+  vector<string> ceph_option_strings = po::collect_unrecognized(
+    parsed.options, po::include_positional);
+  ceph_options.reserve(ceph_option_strings.size());
+  for (vector<string>::iterator i = ceph_option_strings.begin();
+       i != ceph_option_strings.end();
+       ++i) {
+    ceph_options.push_back(i->c_str());
+  }
+
+  global_init(
+    &def_args, ceph_options, CEPH_ENTITY_TYPE_CLIENT,
+    CODE_ENVIRONMENT_UTILITY,
+    CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  if (vm.count("help")) {
+    cout << desc << std::endl;
+    return 1;
+  }
+
+  if (!vm.count("addr")) {
+    cout << "Must provide addr" << std::endl
+	 << desc << std::endl;
+    return 1;
+  }
+  entity_addr_t addr;
+  if (!addr.parse(vm["addr"].as<string>().c_str())) {
+    cout << "bad address " << vm["addr"].as<string>() << std::endl;
+    return 1;
+  }
+
+  string type = vm["msg-type"].as<string>();
+  if (type != "ping" && type != "osd_op") {
+    cout << "unknown message type " << type << std::endl;
+    return 1;
+  }
+
+  int r;
+  if (vm["mode"].as<string>() == "server") {
+    r = run_server(addr, vm["fast-dispatch"].as<bool>(),
+		   vm["duration"].as<unsigned>());
+  } else if (vm["mode"].as<string>() == "client") {
+    r = run_client(addr,
+		   vm["connections"].as<unsigned>(),
+		   vm["in-flight"].as<unsigned>(),
+		   vm["msg-size"].as<unsigned>(),
+		   type == "osd_op",
+		   vm["fast-dispatch"].as<bool>(),
+		   vm["duration"].as<unsigned>());
+  } else {
+    cout << "mode must be server or client" << std::endl;
+    return 1;
+  }
+  return r < 0 ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+#!/usr/bin/env python
+
+"""
+Turn the log of a librbd client run with 'debug rbd = 20' into a trace
+the smalliobench tools can replay with --replay-trace.  Each image the
+client had open becomes an object image<N> of the trace, in the order
+they were first used; the benchmark maps them onto its own objects.
+"""
+
+import argparse
+import datetime
+import re
+import sys
+
+LINE_RE = re.compile(
+    r'^(?P<date>\d{4}-\d\d-\d\d \d\d:\d\d:\d\d\.\d+)\s+\S+\s+\d+\s+librbd: '
+    r'(?P<op>aio_write|aio_read) (?P<ictx>0x[0-9a-f]+) (?P<rest>.*)$')
+WRITE_RE = re.compile(r'off = (\d+) len = (\d+)')
+READ_RE = re.compile(r'\[([0-9,]*)\]')
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description='smalliobench trace from a librbd debug log')
+    parser.add_argument(
+        'input',
+        nargs='?',
+        type=argparse.FileType('r'),
+        default=sys.stdin,
+        help='client log (default: stdin)',
+        )
+    return parser.parse_args()
+
+
+def parse_time(s):
+    return datetime.datetime.strptime(s, '%Y-%m-%d %H:%M:%S.%f')
+
+
+def main():
+    ctx = parse_args()
+    images = {}
+    start = None
+    for line in ctx.input:
+        m = LINE_RE.match(line)
+        if not m:
+            continue
+        t = parse_time(m.group('date'))
+        if start is None:
+            start = t
+        offset = (t - start).total_seconds()
+        image = images.setdefault(m.group('ictx'), 'image%d' % len(images))
+        rest = m.group('rest')
+        if m.group('op') == 'aio_write':
+            w = WRITE_RE.search(rest)
+            if not w:
+                continue
+            extents = [(int(w.group(1)), int(w.group(2)))]
+            op = 'write'
+        else:
+            r = READ_RE.search(rest)
+            if not r or not r.group(1):
+                continue
+            v = [int(x) for x in r.group(1).split(',')]
+            extents = zip(v[0::2], v[1::2])
+            op = 'read'
+        for off, length in extents:
+            if length:
+                print('%.6f %s %s %d %d' % (offset, op, image, off, length))
+
+
+if __name__ == '__main__':
+    main()
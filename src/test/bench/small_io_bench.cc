@@ -62,6 +62,10 @@ int main(int argc, char **argv)
      "use sequential access pattern")
     ("disable-detailed-ops", po::value<bool>()->default_value(false),
      "don't dump per op stats")
+    ("replay-trace", po::value<string>()->default_value(""),
+     "replay the ops of a trace file, keeping their timing")
+    ("record-trace", po::value<string>()->default_value(""),
+     "record the ops issued to a trace file")
     ;
 
   po::variables_map vm;
@@ -153,7 +157,17 @@ int main(int argc, char **argv)
 
   Distribution<
     boost::tuple<string, uint64_t, uint64_t, Bencher::OpType> > *gen = 0;
-  if (vm["sequential"].as<bool>()) {
+  ReplayLoad *replay = 0;
+  if (vm["replay-trace"].as<string>().size()) {
+    std::cout << "Replaying " << vm["replay-trace"].as<string>() << std::endl;
+    replay = new ReplayLoad(objects, vm["object-size"].as<unsigned>());
+    int r = replay->open(vm["replay-trace"].as<string>());
+    if (r < 0) {
+      cerr << "error opening trace r=" << r << std::endl;
+      return -r;
+    }
+    gen = replay;
+  } else if (vm["sequential"].as<bool>()) {
     std::cout << "Using Sequential generator" << std::endl;
     gen = new SequentialLoad(
       objects,
@@ -185,6 +199,12 @@ int main(int argc, char **argv)
     vm["duration"].as<unsigned>(),
     vm["max-ops"].as<unsigned>());
 
+  ofstream trace_file;
+  if (vm["record-trace"].as<string>().size()) {
+    trace_file.open(vm["record-trace"].as<string>().c_str());
+    bencher.record_trace(&trace_file);
+  }
+
   if (!vm["do-not-init"].as<bool>()) {
     bencher.init(objects, vm["object-size"].as<unsigned>(), &std::cout);
     cout << "Created objects..." << std::endl;
@@ -194,6 +214,8 @@ int main(int argc, char **argv)
 
   if (!vm["init-only"].as<bool>()) {
     bencher.run_bench();
+    if (replay)
+      replay->print_summary(&cout);
   } else {
     cout << "init-only" << std::endl;
   }
@@ -12,6 +12,9 @@
 #include <sstream>
 #include <stdlib.h>
 #include <fstream>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
 
 #include "common/Formatter.h"
 
@@ -20,7 +23,7 @@
 #include "detailed_stat_collector.h"
 #include "distribution.h"
 #include "global/global_init.h"
-#include "os/FileStore.h"
+#include "os/ObjectStore.h"
 #include "testfilestore_backend.h"
 #include "common/perf_counters.h"
 
@@ -41,6 +44,39 @@ struct MorePrinting : public DetailedStatCollector::AdditionalPrinting {
   }
 };
 
+/// sectors written to dev since boot, from sysfs
+static int get_sectors_written(dev_t dev, uint64_t *sectors)
+{
+  char fn[80];
+  snprintf(fn, sizeof(fn), "/sys/dev/block/%u:%u/stat",
+	   major(dev), minor(dev));
+  ifstream f(fn);
+  if (!f.is_open())
+    return -ENOENT;
+  // reads, merged, sectors, ms, then the same for writes
+  uint64_t v[7];
+  for (unsigned i = 0; i < 7; ++i)
+    f >> v[i];
+  if (!f)
+    return -EINVAL;
+  *sectors = v[6];
+  return 0;
+}
+
+static void get_devices(const vector<string> &paths, map<dev_t, string> *devs)
+{
+  for (vector<string>::const_iterator i = paths.begin();
+       i != paths.end();
+       ++i) {
+    struct stat st;
+    if (::stat(i->c_str(), &st) < 0)
+      continue;
+    dev_t dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+    if (!devs->count(dev))
+      (*devs)[dev] = *i;
+  }
+}
+
 int main(int argc, char **argv)
 {
   po::options_description desc("Allowed options");
@@ -63,7 +99,7 @@ int main(int argc, char **argv)
     ("seed", po::value<unsigned>(),
      "seed")
     ("num-colls", po::value<unsigned>()->default_value(20),
-     "number of collections")
+     "number of collections, or pgs with osd-transactions")
     ("op-dump-file", po::value<string>()->default_value(""),
      "set file for dumping op details, omit for stderr")
     ("filestore-path", po::value<string>(),
@@ -74,10 +110,20 @@ int main(int argc, char **argv)
      "align offset by")
     ("write-infos", po::value<bool>()->default_value(false),
       "write info objects with main writes")
+    ("osd-transactions", po::value<bool>()->default_value(false),
+     "write object info, snapset, pg log and pg info with each write, like the osd")
+    ("pg-log-length", po::value<unsigned>()->default_value(3000),
+     "pg log entries kept per pg with osd-transactions")
+    ("store-type", po::value<string>()->default_value("filestore"),
+     "objectstore backend: filestore or blockstore")
     ("sequential", po::value<bool>()->default_value(false),
      "do sequential writes like rbd")
     ("disable-detailed-ops", po::value<bool>()->default_value(false),
      "don't dump per op stats")
+    ("replay-trace", po::value<string>()->default_value(""),
+     "replay the ops of a trace file in each writer, keeping their timing")
+    ("record-trace", po::value<string>()->default_value(""),
+     "record the ops issued to a trace file, suffixed with the writer if there are several")
     ("num-writers", po::value<unsigned>()->default_value(1),
      "num write threads")
     ;
@@ -126,8 +172,15 @@ int main(int argc, char **argv)
   ops.insert(make_pair(vm["write-ratio"].as<double>(), Bencher::WRITE));
   ops.insert(make_pair(1-vm["write-ratio"].as<double>(), Bencher::READ));
 
-  FileStore fs(vm["filestore-path"].as<string>(),
-	       vm["journal-path"].as<string>());
+  boost::scoped_ptr<ObjectStore> store(
+    ObjectStore::create(vm["store-type"].as<string>(),
+			vm["filestore-path"].as<string>(),
+			vm["journal-path"].as<string>()));
+  if (!store) {
+    cout << "unknown store type " << vm["store-type"].as<string>() << std::endl;
+    return 1;
+  }
+  ObjectStore &fs = *store;
 
   if (fs.mkfs() < 0) {
     cout << "mkfs failed" << std::endl;
@@ -150,7 +203,7 @@ int main(int argc, char **argv)
     detailed_ops = &cerr;
   }
 
-  std::tr1::shared_ptr<StatCollector> col(
+  std::tr1::shared_ptr<DetailedStatCollector> col(
     new DetailedStatCollector(
       1, new JSONFormatter, detailed_ops, &cout,
       new MorePrinting(g_ceph_context)));
@@ -177,6 +230,9 @@ int main(int argc, char **argv)
 
   vector<std::tr1::shared_ptr<Bencher> > benchers(
     vm["num-writers"].as<unsigned>());
+  vector<ReplayLoad*> replays;
+  vector<TestFileStoreBackend*> backends;
+  vector<std::tr1::shared_ptr<ofstream> > trace_files;
   for (vector<std::tr1::shared_ptr<Bencher> >::iterator i = benchers.begin();
        i != benchers.end();
        ++i) {
@@ -190,7 +246,18 @@ int main(int argc, char **argv)
     }
     Distribution<
       boost::tuple<string, uint64_t, uint64_t, Bencher::OpType> > *gen = 0;
-    if (vm["sequential"].as<bool>()) {
+    if (vm["replay-trace"].as<string>().size()) {
+      std::cout << "Replaying " << vm["replay-trace"].as<string>() << std::endl;
+      ReplayLoad *replay = new ReplayLoad(
+	objects, vm["object-size"].as<unsigned>());
+      int r = replay->open(vm["replay-trace"].as<string>());
+      if (r < 0) {
+	cerr << "error opening trace r=" << r << std::endl;
+	return -r;
+      }
+      replays.push_back(replay);
+      gen = replay;
+    } else if (vm["sequential"].as<bool>()) {
       std::cout << "Using Sequential generator" << std::endl;
       gen = new SequentialLoad(
 	objects,
@@ -214,19 +281,46 @@ int main(int argc, char **argv)
 	);
     }
 
+    TestFileStoreBackend *backend = new TestFileStoreBackend(
+      &fs, vm["write-infos"].as<bool>(),
+      vm["osd-transactions"].as<bool>(),
+      vm["pg-log-length"].as<unsigned>());
+    backends.push_back(backend);
     Bencher *bencher = new Bencher(
       gen,
       col,
-      new TestFileStoreBackend(&fs, vm["write-infos"].as<bool>()),
+      backend,
       vm["num-concurrent-ops"].as<unsigned>(),
       vm["duration"].as<unsigned>(),
       vm["max-ops"].as<unsigned>());
 
+    if (vm["record-trace"].as<string>().size()) {
+      stringstream path;
+      path << vm["record-trace"].as<string>();
+      if (benchers.size() > 1)
+	path << "." << (i - benchers.begin());
+      std::tr1::shared_ptr<ofstream> trace_file(
+	new ofstream(path.str().c_str()));
+      trace_files.push_back(trace_file);
+      bencher->record_trace(trace_file.get());
+    }
+
     bencher->init(objects, vm["object-size"].as<unsigned>(), &std::cout);
     cout << "Created objects..." << std::endl;
     (*i).reset(bencher);
   }
 
+  // what the devices under the store write while the benchers run,
+  // against what the benchers asked for
+  map<dev_t, string> devs;
+  vector<string> paths;
+  paths.push_back(vm["filestore-path"].as<string>());
+  paths.push_back(vm["journal-path"].as<string>());
+  get_devices(paths, &devs);
+  map<dev_t, uint64_t> sectors_before;
+  for (map<dev_t, string>::iterator i = devs.begin(); i != devs.end(); ++i)
+    get_sectors_written(i->first, &sectors_before[i->first]);
+
   for (vector<std::tr1::shared_ptr<Bencher> >::iterator i = benchers.begin();
        i != benchers.end();
        ++i) {
@@ -237,8 +331,48 @@ int main(int argc, char **argv)
        ++i) {
     (*i)->join();
   }
+  for (vector<ReplayLoad*>::iterator i = replays.begin();
+       i != replays.end();
+       ++i) {
+    (*i)->print_summary(&cout);
+  }
+
+  col->dump_summary();
 
+  // unmounting syncs, so everything the run wrote has hit the devices
   fs.umount();
+
+  uint64_t client_bytes = 0;
+  for (vector<TestFileStoreBackend*>::iterator i = backends.begin();
+       i != backends.end();
+       ++i) {
+    client_bytes += (*i)->get_bytes_written();
+  }
+  uint64_t device_bytes = 0;
+  JSONFormatter f;
+  f.open_object_section("write_amplification");
+  f.dump_unsigned("client_bytes", client_bytes);
+  f.open_array_section("devices");
+  for (map<dev_t, string>::iterator i = devs.begin(); i != devs.end(); ++i) {
+    uint64_t sectors;
+    if (get_sectors_written(i->first, &sectors) < 0)
+      continue;
+    uint64_t bytes = (sectors - sectors_before[i->first]) * 512;
+    device_bytes += bytes;
+    f.open_object_section("device");
+    f.dump_string("path", i->second);
+    f.dump_stream("device") << major(i->first) << ":" << minor(i->first);
+    f.dump_unsigned("bytes", bytes);
+    f.close_section();
+  }
+  f.close_section();
+  f.dump_unsigned("device_bytes", device_bytes);
+  f.dump_float("amplification",
+	       client_bytes ? (double)device_bytes / client_bytes : 0);
+  f.close_section();
+  f.flush(cout);
+  cout << std::endl;
+
   if (vm["op-dump-file"].as<string>().size()) {
     myfile.close();
   }
@@ -0,0 +1,98 @@
+#!/usr/bin/env python
+
+"""
+Compare the per op dumps (--op-dump-file) of two smalliobench runs,
+say of the same trace replayed against two releases.  Prints the op
+count, throughput and latency percentiles of each op type in both, and
+exits non-zero if the 99th percentile latency of any of them got worse
+by more than --threshold percent.
+"""
+
+import argparse
+import gzip
+import json
+import sys
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description='compare the op dumps of two smalliobench runs')
+    parser.add_argument('base', help='op dump of the baseline run')
+    parser.add_argument('new', help='op dump of the run to check')
+    parser.add_argument(
+        '--threshold',
+        type=float,
+        default=10.0,
+        help='p99 latency increase, in percent, that fails (default: 10)',
+        )
+    return parser.parse_args()
+
+
+def read_ops(filename):
+    openfn = gzip.open if filename.endswith('.gz') else open
+    ops = {}
+    with openfn(filename) as fh:
+        for line in fh:
+            try:
+                op = json.loads(line)
+            except ValueError:
+                continue
+            if 'type' not in op or 'latency' not in op:
+                continue
+            ops.setdefault(op['type'], []).append(op)
+    return ops
+
+
+def percentile(sorted_values, p):
+    i = int(round(p * (len(sorted_values) - 1)))
+    return sorted_values[i]
+
+
+def summarize(ops):
+    lat = sorted(float(o['latency']) for o in ops)
+    starts = [float(o['start']) for o in ops]
+    ends = [float(o['start']) + float(o['latency']) for o in ops]
+    span = max(ends) - min(starts)
+    size = sum(int(o['size']) for o in ops)
+    return {
+        'count': len(ops),
+        'iops': len(ops) / span if span > 0 else 0,
+        'mbps': size / span / (1 << 20) if span > 0 else 0,
+        'avg': sum(lat) / len(lat),
+        'p50': percentile(lat, .5),
+        'p99': percentile(lat, .99),
+        'p999': percentile(lat, .999),
+    }
+
+
+def change(a, b):
+    if not a:
+        return '     -'
+    return '%+6.1f%%' % ((b - a) * 100.0 / a)
+
+
+def main():
+    ctx = parse_args()
+    base = read_ops(ctx.base)
+    new = read_ops(ctx.new)
+
+    fields = ['count', 'iops', 'mbps', 'avg', 'p50', 'p99', 'p999']
+    failed = False
+    for t in sorted(set(base) | set(new)):
+        if t not in base or t not in new:
+            print('%s: only in %s' % (t, ctx.base if t in base else ctx.new))
+            continue
+        b = summarize(base[t])
+        n = summarize(new[t])
+        print(t)
+        print('  %-6s %14s %14s %8s' % ('', 'base', 'new', 'change'))
+        for f in fields:
+            print('  %-6s %14.6f %14.6f %8s' % (f, b[f], n[f], change(b[f], n[f])))
+        if b['p99'] and (n['p99'] - b['p99']) * 100.0 / b['p99'] > ctx.threshold:
+            print('  p99 latency regressed by more than %.1f%%' % ctx.threshold)
+            failed = True
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,88 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Time Striper::file_to_extents for small I/Os at random offsets, the
+ * way librbd and the client map every read and write.
+ */
+
+#include <stdlib.h>
+#include <iostream>
+#include <sstream>
+
+#include "common/ceph_argparse.h"
+#include "common/Clock.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "osdc/Striper.h"
+
+int main(int argc, const char **argv)
+{
+  std::vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  long long num_ops = 1000000;
+  long long op_size = 4096;
+  long long object_size = 4 << 20;
+  long long stripe_unit = 0;
+  long long stripe_count = 1;
+  long long size = 1ll << 40;
+  std::ostringstream err;
+  std::vector<const char*>::iterator i;
+  for (i = args.begin(); i != args.end();) {
+    if (ceph_argparse_withlonglong(args, i, &num_ops, &err, "--ops", (char*)NULL) ||
+	ceph_argparse_withlonglong(args, i, &op_size, &err, "--op-size", (char*)NULL) ||
+	ceph_argparse_withlonglong(args, i, &object_size, &err, "--object-size", (char*)NULL) ||
+	ceph_argparse_withlonglong(args, i, &stripe_unit, &err, "--stripe-unit", (char*)NULL) ||
+	ceph_argparse_withlonglong(args, i, &stripe_count, &err, "--stripe-count", (char*)NULL) ||
+	ceph_argparse_withlonglong(args, i, &size, &err, "--size", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else {
+      cerr << "unknown option " << *i << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (op_size <= 0 || size <= op_size) {
+    cerr << argv[0] << ": need 0 < op size < size" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  ceph_file_layout l;
+  memset(&l, 0, sizeof(l));
+  l.fl_object_size = object_size;
+  l.fl_stripe_unit = stripe_unit ? stripe_unit : object_size;
+  l.fl_stripe_count = stripe_count;
+
+  uint64_t blocks = (size - op_size) / op_size;
+  uint64_t num_extents = 0;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (long long n = 0; n < num_ops; ++n) {
+    vector<ObjectExtent> extents;
+    uint64_t off = (uint64_t)(random() % blocks) * op_size;
+    Striper::file_to_extents(g_ceph_context, "rbd_data.1234.%016llx", &l,
+			     off, op_size, 0, extents);
+    num_extents += extents.size();
+  }
+  utime_t elapsed = ceph_clock_now(g_ceph_context) - start;
+
+  cout << num_ops << " ops, " << num_extents << " extents in "
+       << elapsed << " s: " << (double)num_extents / (double)elapsed
+       << " extents/s, " << (double)elapsed / num_ops * 1000000000.0
+       << " ns/op" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -17,12 +17,57 @@ struct C_DeleteTransWrapper : public Context {
 };
 
 TestFileStoreBackend::TestFileStoreBackend(
-  ObjectStore *os, bool write_infos)
-  : os(os), finisher(g_ceph_context), write_infos(write_infos)
+  ObjectStore *os, bool write_infos, bool osd_transactions,
+  uint64_t log_length)
+  : os(os), finisher(g_ceph_context), write_infos(write_infos),
+    osd_transactions(osd_transactions), log_length(log_length),
+    infos_created(false), bytes_written(0)
 {
+  // about what object_info_t, SnapSet, pg_log_entry_t and pg_info_t
+  // encode to
+  object_info.append(string(250, 'o'));
+  snapset.append(string(31, 's'));
+  log_entry.append(string(150, 'l'));
+  pg_info.append(string(700, 'i'));
   finisher.start();
 }
 
+void TestFileStoreBackend::add_osd_ops(
+  ObjectStore::Transaction *t, const string &coll_str,
+  coll_t c, const hobject_t &h)
+{
+  t->setattr(c, h, "_", object_info);
+  t->setattr(c, h, "snapset", snapset);
+
+  uint64_t v = ++pg_versions[coll_str];
+  coll_t meta("meta");
+  hobject_t log_oid(sobject_t(string("pglog_") + coll_str, 0));
+  if (v == 1)
+    t->touch(meta, log_oid);
+  map<string, bufferlist> keys;
+  char key[40];
+  snprintf(key, sizeof(key), "%010u.%020llu", 1, (unsigned long long)v);
+  keys[key] = log_entry;
+  t->omap_setkeys(meta, log_oid, keys);
+  if (log_length && v > log_length) {
+    set<string> trimmed;
+    snprintf(key, sizeof(key), "%010u.%020llu", 1,
+	     (unsigned long long)(v - log_length));
+    trimmed.insert(key);
+    t->omap_rmkeys(meta, log_oid, trimmed);
+  }
+
+  hobject_t infos_oid(sobject_t("infos", 0));
+  if (!infos_created) {
+    t->touch(meta, infos_oid);
+    infos_created = true;
+  }
+  map<string, bufferlist> info;
+  info[coll_str + "_info"] = pg_info;
+  ::encode((uint32_t)1, info[coll_str + "_epoch"]);
+  t->omap_setkeys(meta, infos_oid, info);
+}
+
 void TestFileStoreBackend::write(
   const string &oid,
   uint64_t offset,
@@ -44,6 +89,10 @@ void TestFileStoreBackend::write(
   coll_t c(coll_str);
   hobject_t h(sobject_t(oid.substr(sep+1), 0));
   t->write(c, h, offset, bl.length(), bl);
+  bytes_written += bl.length();
+
+  if (osd_transactions)
+    add_osd_ops(t, coll_str, c, h);
 
   if (write_infos) {
     bufferlist bl2;
@@ -14,8 +14,27 @@ class TestFileStoreBackend : public Backend {
   map<string, ObjectStore::Sequencer> osrs;
   const bool write_infos;
 
+  /**
+   * Build the transactions the OSD would for a client write: the data
+   * along with the object info and snapset attrs, a pg log entry in
+   * the omap of the pg's log object (trimmed to log_length entries)
+   * and the pg info in the omap of the infos object.
+   */
+  const bool osd_transactions;
+  const uint64_t log_length;
+  map<string, uint64_t> pg_versions;
+  bufferlist object_info, snapset, log_entry, pg_info;
+  bool infos_created;
+
+  uint64_t bytes_written;
+
+  void add_osd_ops(ObjectStore::Transaction *t, const string &coll_str,
+		   coll_t c, const hobject_t &h);
+
 public:
-  TestFileStoreBackend(ObjectStore *os, bool write_infos);
+  TestFileStoreBackend(ObjectStore *os, bool write_infos,
+		       bool osd_transactions = false,
+		       uint64_t log_length = 0);
   ~TestFileStoreBackend() {
     finisher.stop();
   }
@@ -32,6 +51,11 @@ public:
     uint64_t length,
     bufferlist *bl,
     Context *on_complete);
+
+  /// client data written so far, not counting what the store adds
+  uint64_t get_bytes_written() {
+    return bytes_written;
+  }
 };
 
 #endif
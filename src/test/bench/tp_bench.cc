@@ -100,7 +100,9 @@ class PassAlong : public ThreadPool::WorkQueue<unsigned> {
   bool _empty() { return q.empty(); }
 public:
   PassAlong(ThreadPool *tp, Queueable *next) :
-    ThreadPool::WorkQueue<unsigned>("TestQueue", 100, 100, tp), next(next) {}
+    ThreadPool::WorkQueue<unsigned>("TestQueue", 100, 100, tp), next(next) {
+    set_prefetchable();
+  }
 };
 
 int main(int argc, char **argv)
@@ -115,7 +117,10 @@ int main(int argc, char **argv)
     ("num-items", po::value<unsigned>()->default_value(3000000),
      "num items")
     ("layers", po::value<string>()->default_value(""),
-     "layer desc")
+     "layer desc: q for a thread pool, s for a work stealing thread pool, "
+     "f for a finisher")
+    ("prefetch", po::value<unsigned>()->default_value(8),
+     "items a work stealing thread dequeues at once")
     ;
 
   po::variables_map vm;
@@ -163,10 +168,12 @@ int main(int argc, char **argv)
        i != layers.rend(); ++i) {
     stringstream ss;
     ss << "Test " << num;
-    if (*i == 'q') {
+    if (*i == 'q' || *i == 's') {
       ThreadPool *tp =
 	new ThreadPool(
 	  g_ceph_context, ss.str(), vm["num-threads"].as<unsigned>(), 0);
+      if (*i == 's')
+	tp->set_work_stealing(vm["prefetch"].as<unsigned>());
       wqs.push_back(
 	new WQWrapper(
 	  new PassAlong(tp, wqs.back()),
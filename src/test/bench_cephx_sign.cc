@@ -0,0 +1,104 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Time the cephx message signature: the per message encode_encrypt()
+ * the session handler used to do, against sign_message() and
+ * check_message_signature() with the session key set up once.
+ */
+
+#include "include/types.h"
+#include "include/ceph_features.h"
+#include "auth/Crypto.h"
+#include "auth/AuthSessionHandler.h"
+#include "auth/cephx/CephxProtocol.h"
+#include "arch/intel.h"
+#include "common/Clock.h"
+#include "common/config.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "messages/MPing.h"
+
+static void report(const char *what, int num, utime_t start)
+{
+  utime_t dur = ceph_clock_now(g_ceph_context) - start;
+  cout << what << ": " << dur << " s, "
+       << (dur * 1000000000.0 / num) << " ns per message" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  int num = 1000000;
+  if (!args.empty())
+    num = atoi(args[0]);
+
+  CryptoKey key;
+  key.create(g_ceph_context, CEPH_CRYPTO_AES);
+  std::string error;
+  CryptoKeyHandler *kh = key.get_key_handler(g_ceph_context, error);
+  cout << num << " messages, session key "
+       << (kh ? (ceph_arch_intel_aesni ? "set up once, aes-ni" : "set up once")
+	   : "set up per message")
+       << std::endl;
+  delete kh;
+
+  MPing *m = new MPing;
+  ceph_msg_footer& footer = m->get_footer();
+  footer.front_crc = 0x12345678;
+  footer.middle_crc = 0;
+  footer.data_crc = 0x9abcdef0;
+
+  // what sign_message() used to do
+  utime_t start = ceph_clock_now(g_ceph_context);
+  uint64_t sig = 0;
+  for (int i = 0; i < num; i++) {
+    m->get_header().crc = i;
+    bufferlist bl, enc;
+    ::encode(m->get_header().crc, bl);
+    ::encode(footer.front_crc, bl);
+    ::encode(footer.middle_crc, bl);
+    ::encode(footer.data_crc, bl);
+    if (encode_encrypt(g_ceph_context, bl, key, enc, error)) {
+      cerr << "encode_encrypt failed: " << error << std::endl;
+      return 1;
+    }
+    bufferlist::iterator p = enc.begin();
+    p.advance(4);
+    ::decode(sig, p);
+  }
+  report("encode_encrypt", num, start);
+
+  AuthSessionHandler *h = get_auth_session_handler(g_ceph_context,
+						   CEPH_AUTH_CEPHX, key,
+						   CEPH_FEATURE_MSG_AUTH);
+  start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < num; i++) {
+    m->get_header().crc = i;
+    h->sign_message(m);
+  }
+  report("sign_message", num, start);
+  if (footer.sig != sig) {
+    cerr << "signatures differ: " << footer.sig << " != " << sig << std::endl;
+    return 1;
+  }
+
+  start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < num; i++) {
+    if (h->check_message_signature(m) < 0) {
+      cerr << "check_message_signature failed" << std::endl;
+      return 1;
+    }
+  }
+  report("check_message_signature", num, start);
+
+  delete h;
+  m->put();
+  return 0;
+}
@@ -0,0 +1,110 @@
+#!/bin/bash -x
+
+#
+# Time how long a vstart cluster takes to get every pg active again
+# after a large map change: a batch of osds goes down at once and
+# comes back.  Run it with different 'osd peering threads' settings
+# to compare, e.g.
+#
+#   ./test/bench_peering.sh run 8 1024 4
+#
+
+# Includes
+source "`dirname $0`/test_common.sh"
+
+# Functions
+setup() {
+        export CEPH_NUM_OSD=$1
+        vstart_config=$2
+
+        ./stop.sh
+        ./vstart.sh -d -n -o "$vstart_config" || die "vstart failed"
+}
+
+# wait until "pg stat" reports nothing but active+clean pgs
+wait_active() {
+        total_time=$1
+        t=0
+        while [ $t -lt $total_time ]; do
+                stat=`./ceph -c ./ceph.conf pg stat`
+                echo "$stat" | grep -q -E '[0-9]+ pgs: [0-9]+ active\+clean;' \
+                        && return 0
+                sleep 1
+                t=$(($t+1))
+        done
+        return 1
+}
+
+now_ms() {
+        echo $((`date +%s%N` / 1000000))
+}
+
+dump_peering_latency() {
+        osd=0
+        while [ $osd -lt $CEPH_NUM_OSD ]; do
+                echo -n "osd.$osd peering_latency: "
+                ./ceph -c ./ceph.conf daemon osd.$osd perf dump | \
+                        perl -ne 'print "$1\n" if /"peering_latency":\s*(\{[^}]*\})/'
+                osd=$((osd+1))
+        done
+}
+
+bench_peering_impl() {
+        num_osds=$1
+        num_pgs=$2
+        num_down=$3
+
+        ./ceph -c ./ceph.conf osd pool create bench $num_pgs $num_pgs \
+                || die "pool create failed"
+        wait_active 600 || die "pool never went active"
+
+        # take a batch of osds down at once
+        start=`now_ms`
+        osd=0
+        while [ $osd -lt $num_down ]; do
+                ./ceph -c ./ceph.conf osd down $osd
+                stop_osd $osd
+                osd=$((osd+1))
+        done
+        poll_cmd "./ceph -c ./ceph.conf osd stat" "$(($num_osds-$num_down)) up" 1 120
+        [ $? -eq 1 ] || die "osds weren't marked down"
+        wait_active 600 || die "pgs did not go active after osds went down"
+        down_ms=$((`now_ms`-$start))
+
+        # and bring them all back
+        start=`now_ms`
+        osd=0
+        while [ $osd -lt $num_down ]; do
+                restart_osd $osd
+                osd=$((osd+1))
+        done
+        poll_cmd "./ceph -c ./ceph.conf osd stat" "$num_osds up" 1 120
+        [ $? -eq 1 ] || die "osds didn't come back up"
+        wait_active 600 || die "pgs did not go active after osds came back"
+        up_ms=$((`now_ms`-$start))
+
+        set +x
+        echo "osds=$num_osds pgs=$num_pgs changed=$num_down"
+        echo "time to active after down: ${down_ms}ms"
+        echo "time to active after up:   ${up_ms}ms"
+        dump_peering_latency
+}
+
+bench_peering() {
+        num_osds=${1:-6}
+        num_pgs=${2:-512}
+        num_down=${3:-2}
+        peering_threads=${4:-4}
+
+        setup $num_osds "osd peering threads = $peering_threads
+        osd pool default size = 3
+        mon osd down out interval = 0"
+
+        bench_peering_impl $num_osds $num_pgs $num_down
+}
+
+run() {
+        bench_peering $@ || die "benchmark failed"
+}
+
+$@
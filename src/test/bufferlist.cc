@@ -27,6 +27,15 @@
 #include "include/buffer.h"
 #include "include/utime.h"
 #include "include/encoding.h"
+#include "include/crc32c.h"
+#include "arch/probe.h"
+#include "arch/intel.h"
+#include "arch/neon.h"
+#include "common/sctp_crc32.h"
+#include "common/crc32c_intel_baseline.h"
+#include "common/crc32c_intel_fast.h"
+#include "common/crc32c_intel_pclmul.h"
+#include "common/crc32c_aarch64.h"
 #include "common/environment.h"
 #include "common/Clock.h"
 #include "common/safe_io.h"
@@ -1624,6 +1633,99 @@ TEST(BufferList, append) {
   }
 }
 
+TEST(BufferList, append_small) {
+  // small appends share an append buffer, one segment per list
+  bufferlist bl;
+  for (unsigned i = 0; i < 100; i++)
+    ::encode((uint32_t)i, bl);
+  EXPECT_EQ(400u, bl.length());
+  EXPECT_EQ(1u, bl.buffers().size());
+  EXPECT_TRUE(bl.is_page_aligned());
+
+  // a second list gets its own
+  bufferlist other;
+  ::encode((uint32_t)7, other);
+  ::encode((uint32_t)8, bl);
+  EXPECT_EQ(1u, bl.buffers().size());
+  EXPECT_NE(bl.buffers().front().get_raw(), other.buffers().front().get_raw());
+
+  bufferlist::iterator p = bl.begin();
+  for (unsigned i = 0; i < 100; i++) {
+    uint32_t v;
+    ::decode(v, p);
+    EXPECT_EQ(i, v);
+  }
+  uint32_t v;
+  ::decode(v, p);
+  EXPECT_EQ(8u, v);
+  EXPECT_THROW(::decode(v, p), buffer::end_of_buffer);
+
+  // the whole append buffer, then more
+  bufferlist big;
+  std::string s(CEPH_PAGE_SIZE / 3, 'X');
+  for (unsigned i = 0; i < 6; i++)
+    big.append(s.c_str(), s.size());
+  EXPECT_EQ(6 * s.size(), big.length());
+  EXPECT_EQ(std::string(6 * s.size(), 'X'), std::string(big.c_str(), big.length()));
+}
+
+TEST(BufferList, encode_bytes) {
+  std::vector<__u8> v;
+  for (unsigned i = 0; i < 1000; i++)
+    v.push_back(i);
+  __u8 a[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+  bufferlist bl;
+  ::encode(v, bl);
+  encode_array_nohead(a, 10, bl);
+  EXPECT_EQ(4u + 1000u + 10u, bl.length());
+
+  std::vector<__u8> w;
+  __u8 b[10];
+  bufferlist::iterator p = bl.begin();
+  ::decode(w, p);
+  decode_array_nohead(b, 10, p);
+  EXPECT_EQ(v, w);
+  EXPECT_EQ(0, memcmp(a, b, sizeof(a)));
+}
+
+TEST(BufferList, encode_small_perf) {
+  // encoding a few small fields into a fresh list is what every
+  // message and transaction does
+  int count = 1000000;
+  utime_t start = ceph_clock_now(NULL);
+  for (int i = 0; i < count; i++) {
+    bufferlist bl;
+    ::encode((uint8_t)1, bl);
+    ::encode((uint32_t)i, bl);
+    ::encode((uint64_t)i, bl);
+    ::encode(std::string("rbd_data.1234"), bl);
+    ::encode((uint64_t)i, bl);
+    ::encode((uint32_t)i, bl);
+  }
+  utime_t end = ceph_clock_now(NULL);
+  std::cout << "encode 6 fields into a new list: "
+	    << (double)(end - start) * 1000000000.0 / count << " ns" << std::endl;
+
+  bufferlist bl;
+  start = ceph_clock_now(NULL);
+  for (int i = 0; i < count; i++)
+    ::encode((uint64_t)i, bl);
+  end = ceph_clock_now(NULL);
+  std::cout << "encode a uint64_t: "
+	    << (double)(end - start) * 1000000000.0 / count << " ns" << std::endl;
+
+  bufferlist::iterator p = bl.begin();
+  start = ceph_clock_now(NULL);
+  for (int i = 0; i < count; i++) {
+    uint64_t v;
+    ::decode(v, p);
+    ASSERT_EQ((uint64_t)i, v);
+  }
+  end = ceph_clock_now(NULL);
+  std::cout << "decode a uint64_t: "
+	    << (double)(end - start) * 1000000000.0 / count << " ns" << std::endl;
+}
+
 TEST(BufferList, append_zero) {
   bufferlist bl;
   bl.append('A');
@@ -1845,6 +1947,87 @@ TEST(BufferList, crc32c_append) {
   ASSERT_EQ(bl1.crc32c(0), bl2.crc32c(0));
 }
 
+TEST(BufferList, crc32c_subrange) {
+  // a ptr over part of a raw whose crc is already known reuses the
+  // cached pieces instead of reading all of the data again
+  unsigned len = 1 << 20;
+  bufferptr a(len);
+  for (unsigned i = 0; i < len; i++)
+    a.c_str()[i] = rand();
+  bufferlist whole;
+  whole.push_back(a);
+  whole.crc32c(0);
+
+  buffer::track_cached_crc(true);
+  int base_adjusted = buffer::get_cached_crc_adjusted();
+  unsigned off = 1000, sublen = 700000;
+  bufferlist sub;
+  sub.substr_of(whole, off, sublen);
+  EXPECT_EQ(ceph_crc32c(5, (unsigned char*)a.c_str() + off, sublen),
+	    sub.crc32c(5));
+  // [64k, 640k) are whole cached pieces
+  EXPECT_EQ(9 + base_adjusted, buffer::get_cached_crc_adjusted());
+
+  // and from the middle of a longer list
+  bufferlist bl;
+  bl.append("header", 6);
+  bl.append(sub);
+  bl.append("footer", 6);
+  uint32_t expected = ceph_crc32c(0, (unsigned char*)"header", 6);
+  expected = ceph_crc32c(expected, (unsigned char*)a.c_str() + off, sublen);
+  expected = ceph_crc32c(expected, (unsigned char*)"footer", 6);
+  EXPECT_EQ(expected, bl.crc32c(0));
+}
+
+TEST(BufferList, crc32c_impl_perf) {
+  ceph_arch_probe();
+  struct {
+    const char *name;
+    ceph_crc32c_func_t func;
+    bool usable;
+  } impls[] = {
+    { "sctp", ceph_crc32c_sctp, true },
+    { "intel_baseline", ceph_crc32c_intel_baseline, true },
+    { "intel_fast", ceph_crc32c_intel_fast,
+      ceph_arch_intel_sse42 && ceph_crc32c_intel_fast_exists() },
+    { "intel_pclmul", ceph_crc32c_intel_pclmul,
+      ceph_arch_intel_sse42 && ceph_arch_intel_pclmul &&
+      ceph_crc32c_intel_pclmul_exists() },
+    { "aarch64", ceph_crc32c_aarch64,
+      ceph_arch_aarch64_crc32 && ceph_crc32c_aarch64_exists() },
+  };
+
+  unsigned len = 4 << 20;  // a typical large write
+  int count = 64;
+  bufferptr a(len);
+  for (unsigned i = 0; i < len; i++)
+    a.c_str()[i] = i ^ 73;
+  bufferlist bl;
+  bl.push_back(a);
+
+  ceph_crc32c_func_t saved = ceph_crc32c_func;
+  uint32_t expected = 0;
+  for (unsigned i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+    if (!impls[i].usable)
+      continue;
+    ceph_crc32c_func = impls[i].func;
+    uint32_t r = 0;
+    utime_t start = ceph_clock_now(NULL);
+    for (int j = 0; j < count; j++) {
+      char c = j;
+      a.copy_in(0, 1, &c);  // drop the cached crc
+      r = bl.crc32c(0);
+    }
+    utime_t end = ceph_clock_now(NULL);
+    float rate = (float)len * count / (float)(1024*1024*1024) / (float)(end - start);
+    std::cout << impls[i].name << " = " << rate << " GB/sec" << std::endl;
+    if (i == 0)
+      expected = r;
+    EXPECT_EQ(expected, r) << impls[i].name;
+  }
+  ceph_crc32c_func = saved;
+}
+
 TEST(BufferList, crc32c_append_perf) {
   int len = 256 * 1024 * 1024;
   bufferptr a(len);
@@ -6,7 +6,7 @@
                            specify output for for (de)compilation
      --build --num_osds N layer1 ...
                            build a new map, where each 'layer' is
-                             'name (uniform|straw|list|tree) size'
+                             'name (uniform|straw|straw2|list|tree) size'
      -i mapfn --test       test a range of inputs on the map
         [--min-x x] [--max-x x] [--x x]
         [--min-rule r] [--max-rule r] [--rule r]
@@ -17,6 +17,9 @@
         [--simulate]       simulate placements using a random
                            number generator in place of the CRUSH
                            algorithm
+        [--benchmark]      time the mappings and report mappings/sec
+                           instead
+        [--threads n]      map with n threads (default: one per cpu)
      -i mapfn --add-item id weight name [--loc type name ...]
                            insert an item into the hierarchy at the
                            given location
@@ -35,6 +38,12 @@
      --show-statistics     show chi squared statistics
      --show-bad-mappings   show bad mappings
      --show-choose-tries   show choose tries histogram
+     --show-distribution   show how evenly copies and primaries spread
+                           over the devices and failure domains
+        [--failure-domain type]
+                           bucket type to summarize by (default: host)
+        [--format json|json-pretty]
+                           dump the distribution to stdout instead
      --set-choose-local-tries N
                            set choose local retries before re-descent
      --set-choose-local-fallback-tries N
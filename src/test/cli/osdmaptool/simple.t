@@ -5,4 +5,16 @@
      --import-crush <file>   replace osdmap's crush map with <file>
      --test-map-pg <pgid>    map a pgid to osds
      --test-map-object <objectname> [--pool <poolid>] map an object to osds
+     --test-map-pgs          map all pgs, show how many land on each osd
+        [--failure-domain <type>] also show the balance over buckets of type (default host)
+        [--format json|json-pretty] dump the distribution instead
+     --compare <file>        show which pgs would move with the osdmap in <file>
+     --compare-crush <file>  show which pgs would move with the crush map in <file>
+        [--pgmap <file>]     with pg sizes from <file> (ceph pg getmap), count bytes
+        [--dump-remapped]    list each pg that moves
+        [--threads <n>]      map with n threads (default: one per cpu)
+     --reweight-by-pg        adjust osd weights to even out pg counts
+        [--deviation <pct>]  stop when every osd is within pct of its share (default 5)
+        [--max-change <w>]   change each weight by at most w per round (default .05)
+        [--max-rounds <n>]   give up after n rounds (default 10)
   [1]
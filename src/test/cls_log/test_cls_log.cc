@@ -332,3 +332,48 @@ TEST(cls_rgw, test_log_trim)
   }
   delete rop;
 }
+
+TEST(cls_rgw, test_log_trim_range)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  /* create pool */
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  string oid = "obj";
+  ASSERT_EQ(0, ioctx.create(oid, true));
+
+  /* more entries than a trim used to remove in one go */
+  utime_t start_time = ceph_clock_now(g_ceph_context);
+  generate_log(ioctx, oid, 1500, start_time, true);
+
+  utime_t zero_time;
+  utime_t to_time = get_time(start_time, 1500, true);
+  string start_marker, end_marker;
+
+  /* one op removes the whole range, the next finds nothing left */
+  librados::ObjectWriteOperation *op = new_op();
+  cls_log_trim(*op, zero_time, to_time, start_marker, end_marker);
+  ASSERT_EQ(0, ioctx.operate(oid, op));
+  delete op;
+
+  op = new_op();
+  cls_log_trim(*op, zero_time, to_time, start_marker, end_marker);
+  ASSERT_EQ(-ENODATA, ioctx.operate(oid, op));
+  delete op;
+
+  librados::ObjectReadOperation *rop = new_rop();
+  list<cls_log_entry> entries;
+  bool truncated;
+  string marker;
+  cls_log_list(*rop, start_time, to_time, marker, 0, entries, &marker, &truncated);
+
+  bufferlist obl;
+  ASSERT_EQ(0, ioctx.operate(oid, rop, &obl));
+  ASSERT_EQ(0, (int)entries.size());
+  ASSERT_EQ(0, (int)truncated);
+  delete rop;
+}
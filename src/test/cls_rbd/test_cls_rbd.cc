@@ -31,11 +31,14 @@ using ::librbd::cls_client::remove_child;
 using ::librbd::cls_client::get_children;
 using ::librbd::cls_client::get_snapcontext;
 using ::librbd::cls_client::snapshot_list;
+using ::librbd::cls_client::get_refresh_info;
+using ::librbd::cls_client::snapshot_list_range;
 using ::librbd::cls_client::copyup;
 using ::librbd::cls_client::get_id;
 using ::librbd::cls_client::set_id;
 using ::librbd::cls_client::dir_get_id;
 using ::librbd::cls_client::dir_get_name;
+using ::librbd::cls_client::dir_get_names;
 using ::librbd::cls_client::dir_list;
 using ::librbd::cls_client::dir_add_image;
 using ::librbd::cls_client::dir_remove_image;
@@ -47,6 +50,8 @@ using ::librbd::cls_client::set_protection_status;
 using ::librbd::cls_client::get_stripe_unit_count;
 using ::librbd::cls_client::set_stripe_unit_count;
 using ::librbd::cls_client::old_snapshot_add;
+using ::librbd::cls_client::object_map_update;
+using ::librbd::cls_client::object_map_merge;
 
 static char *random_buf(size_t len)
 {
@@ -256,6 +261,16 @@ TEST(cls_rbd, directory_methods)
   ASSERT_EQ(0, dir_get_id(&ioctx, oid, imgname2, &id));
   ASSERT_EQ(valid_id2, id);
 
+  set<string> ids;
+  map<string, string> names;
+  ids.insert(valid_id);
+  ids.insert(valid_id2);
+  ids.insert("6");
+  ASSERT_EQ(0, dir_get_names(&ioctx, oid, ids, &names));
+  ASSERT_EQ(2u, names.size());
+  ASSERT_EQ(imgname, names[valid_id]);
+  ASSERT_EQ(imgname2, names[valid_id2]);
+
   ASSERT_EQ(-ESTALE, dir_rename_image(&ioctx, oid, imgname, imgname2, valid_id2));
   ASSERT_EQ(-ESTALE, dir_remove_image(&ioctx, oid, imgname, valid_id2));
   ASSERT_EQ(-EEXIST, dir_rename_image(&ioctx, oid, imgname, imgname2, valid_id));
@@ -854,6 +869,148 @@ TEST(cls_rbd, snapshots)
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
 }
 
+TEST(cls_rbd, get_refresh_info)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  ASSERT_EQ(0, create_image(&ioctx, "foo", 10, 22, RBD_FEATURE_LAYERING,
+			    "foo"));
+  ASSERT_EQ(0, snapshot_add(&ioctx, "foo", 1, "snap1"));
+  ASSERT_EQ(0, set_size(&ioctx, "foo", 20));
+  ASSERT_EQ(0, snapshot_add(&ioctx, "foo", 2, "snap2"));
+  ASSERT_EQ(0, set_protection_status(&ioctx, "foo", 1,
+				     RBD_PROTECTION_STATUS_PROTECTED));
+  ASSERT_EQ(0, set_size(&ioctx, "foo", 30));
+
+  uint64_t size, features, incompatible;
+  map<rados::cls::lock::locker_id_t, rados::cls::lock::locker_info_t> lockers;
+  bool exclusive;
+  string tag;
+  SnapContext snapc;
+  parent_info parent;
+  vector<bool> new_snaps;
+  vector<string> names;
+  vector<uint64_t> sizes, snap_features;
+  vector<parent_info> parents;
+  vector<uint8_t> protection;
+
+  set<uint64_t> known;
+  ASSERT_EQ(0, get_refresh_info(&ioctx, "foo", known, &size, &features,
+				&incompatible, &lockers, &exclusive, &tag,
+				&snapc, &parent, &new_snaps, &names, &sizes,
+				&snap_features, &parents, &protection));
+  ASSERT_EQ(30u, size);
+  ASSERT_EQ((uint64_t)RBD_FEATURE_LAYERING, features);
+  ASSERT_EQ(0u, lockers.size());
+  ASSERT_EQ(2u, snapc.seq);
+  ASSERT_EQ(2u, snapc.snaps.size());
+  ASSERT_EQ(2u, snapc.snaps[0]);
+  ASSERT_EQ(1u, snapc.snaps[1]);
+  ASSERT_EQ(-1, parent.spec.pool_id);
+  ASSERT_TRUE(new_snaps[0]);
+  ASSERT_TRUE(new_snaps[1]);
+  ASSERT_EQ("snap2", names[0]);
+  ASSERT_EQ("snap1", names[1]);
+  ASSERT_EQ(20u, sizes[0]);
+  ASSERT_EQ(10u, sizes[1]);
+  ASSERT_EQ(RBD_PROTECTION_STATUS_UNPROTECTED, protection[0]);
+  ASSERT_EQ(RBD_PROTECTION_STATUS_PROTECTED, protection[1]);
+
+  // known snapshots only get their protection status
+  known.insert(1);
+  ASSERT_EQ(0, set_protection_status(&ioctx, "foo", 1,
+				     RBD_PROTECTION_STATUS_UNPROTECTED));
+  ASSERT_EQ(0, get_refresh_info(&ioctx, "foo", known, &size, &features,
+				&incompatible, &lockers, &exclusive, &tag,
+				&snapc, &parent, &new_snaps, &names, &sizes,
+				&snap_features, &parents, &protection));
+  ASSERT_EQ(2u, snapc.snaps.size());
+  ASSERT_TRUE(new_snaps[0]);
+  ASSERT_FALSE(new_snaps[1]);
+  ASSERT_EQ("snap2", names[0]);
+  ASSERT_EQ("", names[1]);
+  ASSERT_EQ(RBD_PROTECTION_STATUS_UNPROTECTED, protection[1]);
+
+  ASSERT_EQ(-ENOENT, get_refresh_info(&ioctx, "bar", known, &size, &features,
+				      &incompatible, &lockers, &exclusive,
+				      &tag, &snapc, &parent, &new_snaps,
+				      &names, &sizes, &snap_features,
+				      &parents, &protection));
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+TEST(cls_rbd, snapshot_list_range)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  vector<snapid_t> ids;
+  vector<string> names;
+  vector<uint64_t> sizes, features;
+  vector<parent_info> parents;
+  vector<uint8_t> protection;
+  bool more;
+
+  ASSERT_EQ(-ENOENT, snapshot_list_range(&ioctx, "foo", 0, 10, &ids, &names,
+					 &sizes, &features, &parents,
+					 &protection, &more));
+
+  ASSERT_EQ(0, create_image(&ioctx, "foo", 10, 22, 0, "foo"));
+  ASSERT_EQ(0, snapshot_list_range(&ioctx, "foo", 0, 10, &ids, &names,
+				   &sizes, &features, &parents,
+				   &protection, &more));
+  ASSERT_EQ(0u, ids.size());
+  ASSERT_FALSE(more);
+
+  for (uint64_t i = 1; i <= 100; ++i) {
+    ostringstream name;
+    name << "snap" << i;
+    ASSERT_EQ(0, set_size(&ioctx, "foo", i * 10));
+    ASSERT_EQ(0, snapshot_add(&ioctx, "foo", i, name.str()));
+  }
+
+  // pages of 30 cover them all, in order of id
+  uint64_t next = 1;
+  snapid_t start_after = 0;
+  do {
+    ASSERT_EQ(0, snapshot_list_range(&ioctx, "foo", start_after, 30, &ids,
+				     &names, &sizes, &features, &parents,
+				     &protection, &more));
+    ASSERT_FALSE(ids.empty());
+    ASSERT_GE(30u, ids.size());
+    for (size_t i = 0; i < ids.size(); ++i, ++next) {
+      ostringstream name;
+      name << "snap" << next;
+      ASSERT_EQ(next, ids[i].val);
+      ASSERT_EQ(name.str(), names[i]);
+      ASSERT_EQ(next * 10, sizes[i]);
+      ASSERT_EQ(RBD_PROTECTION_STATUS_UNPROTECTED, protection[i]);
+    }
+    start_after = ids.back();
+  } while (more);
+  ASSERT_EQ(101u, next);
+
+  ASSERT_EQ(0, snapshot_list_range(&ioctx, "foo", 100, 30, &ids, &names,
+				   &sizes, &features, &parents,
+				   &protection, &more));
+  ASSERT_EQ(0u, ids.size());
+  ASSERT_FALSE(more);
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
 TEST(cls_rbd, snapid_race)
 {
   librados::Rados rados;
@@ -917,3 +1074,81 @@ TEST(cls_rbd, stripingv2)
   ioctx.close();
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
 }
+
+TEST(cls_rbd, object_map_update)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  string oid = "rbd_object_map.foo";
+  ASSERT_EQ(-ENOENT, object_map_update(&ioctx, oid, 0, 1, true));
+  ASSERT_EQ(0, ioctx.create(oid, true));
+
+  // clearing past the end changes nothing
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 0, 64, false));
+  bufferlist bl;
+  ASSERT_EQ(0, ioctx.read(oid, bl, 0, 0));
+
+  // setting extends the map, with zeros
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 3, 10, true));
+  bl.clear();
+  ASSERT_EQ(2, ioctx.read(oid, bl, 0, 0));
+  ASSERT_EQ(0xf8, (unsigned char)bl[0]);
+  ASSERT_EQ(0x03, (unsigned char)bl[1]);
+
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 20, 21, true));
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 4, 9, false));
+  bl.clear();
+  ASSERT_EQ(3, ioctx.read(oid, bl, 0, 0));
+  ASSERT_EQ(0x08, (unsigned char)bl[0]);
+  ASSERT_EQ(0x02, (unsigned char)bl[1]);
+  ASSERT_EQ(0x10, (unsigned char)bl[2]);
+
+  ASSERT_EQ(-EINVAL, object_map_update(&ioctx, oid, 2, 1, true));
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+TEST(cls_rbd, object_map_merge)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  string oid = "rbd_diff_map.foo";
+  bufferlist bits;
+  bits.append((char)0x81);
+  ASSERT_EQ(-ENOENT, object_map_merge(&ioctx, oid, bits));
+  ASSERT_EQ(0, ioctx.create(oid, true));
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 1, 2, true));
+
+  // ors into what is there, extending the map
+  bits.append((char)0x00);
+  bits.append((char)0x04);
+  ASSERT_EQ(0, object_map_merge(&ioctx, oid, bits));
+  bufferlist bl;
+  ASSERT_EQ(3, ioctx.read(oid, bl, 0, 0));
+  ASSERT_EQ(0x83, (unsigned char)bl[0]);
+  ASSERT_EQ(0x00, (unsigned char)bl[1]);
+  ASSERT_EQ(0x04, (unsigned char)bl[2]);
+
+  // a shorter map leaves the rest alone
+  bits.clear();
+  bits.append((char)0x10);
+  ASSERT_EQ(0, object_map_merge(&ioctx, oid, bits));
+  bl.clear();
+  ASSERT_EQ(3, ioctx.read(oid, bl, 0, 0));
+  ASSERT_EQ(0x93, (unsigned char)bl[0]);
+  ASSERT_EQ(0x04, (unsigned char)bl[2]);
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
@@ -2,6 +2,7 @@
 // vim: ts=8 sw=2 smarttab
 
 #include "include/types.h"
+#include "cls/rgw/cls_rgw_ops.h"
 #include "cls/rgw/cls_rgw_client.h"
 
 #include "gtest/gtest.h"
@@ -379,6 +380,212 @@ static bool cmp_objs(cls_rgw_obj& obj1, cls_rgw_obj& obj2)
 }
 
 
+TEST(cls_rgw, index_list_shards)
+{
+  /* entries spread over the shards of an index, listed in parallel */
+#define NUM_SHARDS 4
+  OpMgr mgr;
+  string shard_oids[NUM_SHARDS];
+  for (int i = 0; i < NUM_SHARDS; i++) {
+    shard_oids[i] = str_int("bucket_shard", i);
+    ObjectWriteOperation *op = mgr.write_op();
+    cls_rgw_bucket_init(*op);
+    ASSERT_EQ(0, ioctx.operate(shard_oids[i], op));
+  }
+
+  for (int i = 0; i < NUM_OBJS; i++) {
+    string obj = str_int("obj", i);
+    string tag = str_int("tag", i);
+    string loc = str_int("loc", i);
+    string& oid = shard_oids[i % NUM_SHARDS];
+    index_prepare(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, obj, loc);
+    rgw_bucket_dir_entry_meta meta;
+    meta.category = 0;
+    meta.size = 1024;
+    index_complete(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, 1, obj, meta);
+  }
+
+  string start = str_int("obj", 0);
+  rgw_cls_list_ret results[NUM_SHARDS];
+  int rvals[NUM_SHARDS];
+  AioCompletion *completions[NUM_SHARDS];
+  for (int i = 0; i < NUM_SHARDS; i++) {
+    ObjectReadOperation *op = mgr.read_op();
+    cls_rgw_bucket_list_op(*op, start, "", 2, &results[i], &rvals[i]);
+    completions[i] = librados::Rados::aio_create_completion();
+    ASSERT_EQ(0, ioctx.aio_operate(shard_oids[i], completions[i], op, NULL));
+  }
+
+  set<string> listed;
+  size_t total = 0;
+  for (int i = 0; i < NUM_SHARDS; i++) {
+    completions[i]->wait_for_complete();
+    ASSERT_EQ(0, completions[i]->get_return_value());
+    completions[i]->release();
+    ASSERT_EQ(0, rvals[i]);
+
+    /* obj-0 is the start, so it is not listed again */
+    int expected = (NUM_OBJS - 1 - i + NUM_SHARDS) / NUM_SHARDS - (i == 0 ? 1 : 0);
+    ASSERT_EQ(min(expected, 2), (int)results[i].dir.m.size());
+    ASSERT_EQ(expected > 2, results[i].is_truncated);
+    total += results[i].dir.m.size();
+
+    map<string, rgw_bucket_dir_entry>::iterator iter;
+    for (iter = results[i].dir.m.begin(); iter != results[i].dir.m.end(); ++iter) {
+      ASSERT_LT(start, iter->first);
+      listed.insert(iter->first);
+    }
+  }
+  ASSERT_EQ(total, listed.size());
+}
+
+TEST(cls_rgw, index_complete_batch)
+{
+  string bucket_oid = str_int("bucket_batch", 0);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  uint64_t obj_size = 1024;
+
+  list<rgw_cls_obj_complete_op> ops;
+  for (int i = 0; i < NUM_OBJS; i++) {
+    string obj = str_int("obj", i);
+    string tag = str_int("tag", i);
+    string loc = str_int("loc", i);
+
+    index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+
+    rgw_cls_obj_complete_op call;
+    call.op = CLS_RGW_OP_ADD;
+    call.tag = tag;
+    call.name = obj;
+    call.ver.pool = ioctx.get_id();
+    call.ver.epoch = 1;
+    call.meta.category = 0;
+    call.meta.size = obj_size;
+    call.log_op = true;
+    ops.push_back(call);
+  }
+
+  test_stats(ioctx, bucket_oid, 0, 0, 0);
+
+  /* all of them in a single call */
+  op = mgr.write_op();
+  cls_rgw_bucket_complete_ops(*op, ops);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  test_stats(ioctx, bucket_oid, 0, NUM_OBJS, obj_size * NUM_OBJS);
+}
+
+static void list_delim(OpMgr& mgr, string& oid, const string& start, uint32_t num,
+                       rgw_cls_list_ret *result)
+{
+  int rval;
+  ObjectReadOperation *op = mgr.read_op();
+  cls_rgw_bucket_list_op(*op, start, "", num, result, &rval, "/");
+  bufferlist bl;
+  ASSERT_EQ(0, ioctx.operate(oid, op, &bl));
+  ASSERT_EQ(0, rval);
+}
+
+TEST(cls_rgw, index_list_delimiter)
+{
+  string bucket_oid = str_int("bucket_delim", 0);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  const char *names[] = { "a", "b", "dir1/x", "dir1/y", "dir1/z/w", "dir2/v" };
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    string obj = names[i];
+    string tag = str_int("tag", i);
+    string loc = str_int("loc", i);
+    index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+    rgw_bucket_dir_entry_meta meta;
+    meta.category = 0;
+    meta.size = 1024;
+    index_complete(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, 1, obj, meta);
+  }
+
+  rgw_cls_list_ret result;
+  list_delim(mgr, bucket_oid, "", 100, &result);
+  ASSERT_EQ(2, (int)result.dir.m.size());
+  ASSERT_EQ(1, (int)result.dir.m.count("a"));
+  ASSERT_EQ(1, (int)result.dir.m.count("b"));
+  ASSERT_EQ(2, (int)result.common_prefixes.size());
+  ASSERT_EQ("dir1/", result.common_prefixes.front());
+  ASSERT_EQ("dir2/", result.common_prefixes.back());
+  ASSERT_FALSE(result.is_truncated);
+
+  /* a common prefix counts as an entry, and a start within one skips it */
+  rgw_cls_list_ret first;
+  list_delim(mgr, bucket_oid, "", 3, &first);
+  ASSERT_EQ(2, (int)first.dir.m.size());
+  ASSERT_EQ(1, (int)first.common_prefixes.size());
+  ASSERT_EQ("dir1/", first.common_prefixes.front());
+  ASSERT_TRUE(first.is_truncated);
+
+  rgw_cls_list_ret next;
+  list_delim(mgr, bucket_oid, "dir1/", 3, &next);
+  ASSERT_EQ(0, (int)next.dir.m.size());
+  ASSERT_EQ(1, (int)next.common_prefixes.size());
+  ASSERT_EQ("dir2/", next.common_prefixes.front());
+  ASSERT_FALSE(next.is_truncated);
+}
+
+TEST(cls_rgw, index_header_only)
+{
+  string bucket_oid = str_int("bucket_header", 0);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  rgw_bucket_dir_header header;
+  ASSERT_EQ(0, cls_rgw_get_dir_header(ioctx, bucket_oid, &header));
+  uint64_t ver = header.ver;
+
+  /* a prepare that isn't logged leaves the header alone */
+  string obj = "obj";
+  string tag = "tag";
+  string loc = "loc";
+  op = mgr.write_op();
+  cls_rgw_bucket_prepare_op(*op, CLS_RGW_OP_ADD, tag, obj, loc, false);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  ASSERT_EQ(0, cls_rgw_get_dir_header(ioctx, bucket_oid, &header));
+  ASSERT_EQ(ver, header.ver);
+
+  rgw_bucket_dir_entry_meta meta;
+  meta.category = 0;
+  meta.size = 1024;
+  index_complete(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, 1, obj, meta);
+
+  ASSERT_EQ(0, cls_rgw_get_dir_header(ioctx, bucket_oid, &header));
+  ASSERT_GT(header.ver, ver);
+  test_stats(ioctx, bucket_oid, 0, 1, 1024);
+
+  /* asking for no entries gets the header and nothing else */
+  rgw_cls_list_ret result;
+  int rval;
+  ObjectReadOperation *rop = mgr.read_op();
+  cls_rgw_bucket_list_op(*rop, string(), string(), 0, &result, &rval);
+  bufferlist obl;
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, rop, &obl));
+  ASSERT_EQ(0, rval);
+  ASSERT_EQ(0, (int)result.dir.m.size());
+  ASSERT_EQ(1, (int)result.dir.header.stats[0].num_entries);
+}
+
 TEST(cls_rgw, gc_set)
 {
   /* add chains */
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <signal.h>
+#include <errno.h>
 #include "common/Mutex.h"
 #include "common/Thread.h"
 #include "common/Throttle.h"
@@ -240,6 +241,73 @@ TEST_F(ThrottleTest, destructor) {
   }
 }
 
+struct C_SetRet : public Context {
+  int *ret;
+  C_SetRet(int *r) : ret(r) {}
+  void finish(int r) {
+    *ret = r;
+  }
+};
+
+TEST_F(ThrottleTest, get_async) {
+  int64_t throttle_max = 10;
+  int r = 1;
+  {
+    Throttle throttle(g_ceph_context, "throttle", throttle_max);
+
+    ASSERT_TRUE(throttle.get_async(5, new C_SetRet(&r)));
+    ASSERT_EQ(1, r);
+    ASSERT_EQ(5, throttle.get_current());
+
+    ASSERT_FALSE(throttle.get_async(7, new C_SetRet(&r)));
+    ASSERT_EQ(1, r);
+    ASSERT_EQ(1u, throttle.get_waiters());
+    ASSERT_FALSE(throttle.get_or_fail(1));
+
+    // the put hands the count over to the waiting context
+    ASSERT_EQ(0, throttle.put(5));
+    ASSERT_EQ(0, r);
+    ASSERT_EQ(7, throttle.get_current());
+    ASSERT_EQ(0u, throttle.get_waiters());
+
+    r = 1;
+    ASSERT_FALSE(throttle.get_async(5, new C_SetRet(&r)));
+  }
+  // destroyed with a waiter
+  ASSERT_EQ(-ECANCELED, r);
+}
+
+TEST_F(ThrottleTest, fifo) {
+  int64_t throttle_max = 10;
+  Throttle throttle(g_ceph_context, "throttle", throttle_max);
+
+  ASSERT_FALSE(throttle.get(throttle_max));
+
+  Thread_get t(throttle, throttle_max);
+  t.create();
+  while (throttle.get_waiters() < 1)
+    usleep(1000);
+
+  Thread_get u(throttle, 1);
+  u.create();
+  while (throttle.get_waiters() < 2)
+    usleep(1000);
+
+  // room for u but not for t: u must stay behind t
+  throttle.put(throttle_max / 2);
+  usleep(10000);
+  ASSERT_EQ(2u, throttle.get_waiters());
+  ASSERT_EQ(throttle_max / 2, throttle.get_current());
+
+  throttle.put(throttle_max / 2);
+  t.join();
+  u.join();
+  ASSERT_TRUE(t.waited);
+  ASSERT_TRUE(u.waited);
+  ASSERT_EQ(0, throttle.get_current());
+  ASSERT_EQ(0u, throttle.get_waiters());
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -0,0 +1,122 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <string>
+
+#include "common/config.h"
+#include "common/config_obs.h"
+#include "common/config_snapshot.h"
+#include "common/Thread.h"
+#include "include/atomic.h"
+#include "gtest/gtest.h"
+
+struct TestConf {
+  uint64_t batch_bytes;
+  uint64_t batch_iov;
+  std::string delay_type;
+  TestConf(const md_config_t *conf)
+    : batch_bytes(conf->ms_max_send_batch_bytes),
+      batch_iov(conf->ms_max_send_batch_iov),
+      delay_type(conf->ms_inject_delay_type) {}
+};
+
+class TestObserver : public md_config_obs_t {
+public:
+  ConfigSnapshot<TestConf> snap;
+  TestObserver(const md_config_t *conf) : snap(conf) {}
+  const char** get_tracked_conf_keys() const {
+    static const char* KEYS[] = {
+      "ms_max_send_batch_bytes",
+      "ms_max_send_batch_iov",
+      "ms_inject_delay_type",
+      NULL
+    };
+    return KEYS;
+  }
+  void handle_conf_change(const md_config_t *conf,
+			  const std::set<std::string> &changed) {
+    snap.update(conf);
+  }
+};
+
+TEST(ConfigSnapshot, Update)
+{
+  md_config_t conf;
+  TestObserver obs(&conf);
+  conf.add_observer(&obs);
+  EXPECT_EQ(1u, obs.snap.get_version());
+  ConfigSnapshot<TestConf>::Ref old = obs.snap.get();
+  EXPECT_EQ(conf.ms_max_send_batch_bytes, old->batch_bytes);
+
+  conf.set_val_or_die("ms_max_send_batch_bytes", "1234");
+  conf.set_val_or_die("ms_inject_delay_type", "osd");
+  conf.apply_changes(NULL);
+  EXPECT_EQ(2u, obs.snap.get_version());
+  ConfigSnapshot<TestConf>::Ref cur = obs.snap.get();
+  EXPECT_EQ(1234u, cur->batch_bytes);
+  EXPECT_EQ("osd", cur->delay_type);
+
+  // whoever held the old version still sees it, unchanged
+  EXPECT_NE(1234u, old->batch_bytes);
+  EXPECT_EQ("", old->delay_type);
+
+  conf.remove_observer(&obs);
+}
+
+class Reader : public Thread {
+public:
+  ConfigSnapshot<TestConf> *snap;
+  atomic_t *stop;
+  bool torn;
+  Reader(ConfigSnapshot<TestConf> *s, atomic_t *st)
+    : snap(s), stop(st), torn(false) {}
+  void *entry() {
+    while (!stop->read()) {
+      ConfigSnapshot<TestConf>::Ref r = snap->get();
+      // the writer always sets the two together
+      if (r->batch_bytes != r->batch_iov * 10)
+	torn = true;
+    }
+    return 0;
+  }
+};
+
+TEST(ConfigSnapshot, Consistent)
+{
+  md_config_t conf;
+  conf.set_val_or_die("ms_max_send_batch_bytes", "10");
+  conf.set_val_or_die("ms_max_send_batch_iov", "1");
+  conf.apply_changes(NULL);
+  TestObserver obs(&conf);
+  conf.add_observer(&obs);
+
+  atomic_t stop(0);
+  Reader a(&obs.snap, &stop), b(&obs.snap, &stop);
+  a.create();
+  b.create();
+  for (int i = 2; i < 1000; ++i) {
+    char bytes[32], iov[32];
+    snprintf(bytes, sizeof(bytes), "%d", i * 10);
+    snprintf(iov, sizeof(iov), "%d", i);
+    conf.set_val_or_die("ms_max_send_batch_bytes", bytes);
+    conf.set_val_or_die("ms_max_send_batch_iov", iov);
+    conf.apply_changes(NULL);
+  }
+  stop.set(1);
+  a.join();
+  b.join();
+  EXPECT_FALSE(a.torn);
+  EXPECT_FALSE(b.torn);
+  EXPECT_EQ(999u * 10, obs.snap.get()->batch_bytes);
+
+  conf.remove_observer(&obs);
+}
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <string.h>
+#include <vector>
 
 #include "include/types.h"
 #include "include/crc32c.h"
@@ -11,8 +12,13 @@
 
 #include "gtest/gtest.h"
 
+#include "arch/probe.h"
+#include "arch/intel.h"
+#include "arch/neon.h"
 #include "common/sctp_crc32.h"
 #include "common/crc32c_intel_baseline.h"
+#include "common/crc32c_intel_pclmul.h"
+#include "common/crc32c_aarch64.h"
 
 TEST(Crc32c, Small) {
   const char *a = "foo bar baz";
@@ -80,7 +86,60 @@ TEST(Crc32c, Performance) {
     std::cout << "intel baseline = " << rate << " MB/sec" << std::endl;
     ASSERT_EQ(261108528u, val);
   }
+  if (ceph_arch_intel_sse42 && ceph_arch_intel_pclmul &&
+      ceph_crc32c_intel_pclmul_exists()) {
+    utime_t start = ceph_clock_now(NULL);
+    unsigned val = ceph_crc32c_intel_pclmul(0, (unsigned char *)a, len);
+    utime_t end = ceph_clock_now(NULL);
+    float rate = (float)len / (float)(1024*1024) / (float)(end - start);
+    std::cout << "intel pclmul = " << rate << " MB/sec" << std::endl;
+    ASSERT_EQ(261108528u, val);
+  }
+  if (ceph_arch_aarch64_crc32 && ceph_crc32c_aarch64_exists()) {
+    utime_t start = ceph_clock_now(NULL);
+    unsigned val = ceph_crc32c_aarch64(0, (unsigned char *)a, len);
+    utime_t end = ceph_clock_now(NULL);
+    float rate = (float)len / (float)(1024*1024) / (float)(end - start);
+    std::cout << "aarch64 = " << rate << " MB/sec" << std::endl;
+    ASSERT_EQ(261108528u, val);
+  }
+
+}
+
+TEST(Crc32c, Implementations) {
+  ceph_arch_probe();
+  std::vector<ceph_crc32c_func_t> funcs;
+  funcs.push_back(ceph_crc32c_intel_baseline);
+  if (ceph_arch_intel_sse42 && ceph_arch_intel_pclmul &&
+      ceph_crc32c_intel_pclmul_exists())
+    funcs.push_back(ceph_crc32c_intel_pclmul);
+  if (ceph_arch_aarch64_crc32 && ceph_crc32c_aarch64_exists())
+    funcs.push_back(ceph_crc32c_aarch64);
 
+  // cover every tail and alignment around the 3-way block sizes
+  int max = 4 * 3 * 1024 + 64;
+  unsigned char *b = (unsigned char *)malloc(max + 16);
+  for (int i = 0; i < max + 16; i++)
+    b[i] = rand();
+  for (int len = 0; len < max; len += (len < 1024 ? 1 : 61)) {
+    for (int off = 0; off < 8; off++) {
+      uint32_t expected = ceph_crc32c_sctp(len, b + off, len);
+      for (unsigned f = 0; f < funcs.size(); f++)
+	ASSERT_EQ(expected, funcs[f](len, b + off, len)) << "len " << len << " off " << off;
+    }
+  }
+  free(b);
+}
+
+TEST(Crc32c, Zeros) {
+  unsigned char *b = (unsigned char *)calloc(1, 70000);
+  for (unsigned len = 0; len < 70000; len = len * 3 + 1) {
+    for (uint32_t crc = 0; crc < 3; crc++) {
+      uint32_t v = 0xffffffff - crc;
+      ASSERT_EQ(ceph_crc32c_sctp(v, b, len), ceph_crc32c_zeros(v, len));
+    }
+  }
+  free(b);
 }
 
 
@@ -0,0 +1,141 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "common/Clock.h"
+#include "common/mClockPriorityQueue.h"
+#include "gtest/gtest.h"
+
+// client k gets reservation info[k][0], weight info[k][1], limit info[k][2]
+static double info[4][3] = {
+  { 0, 1, 0 },
+  { 0, 3, 0 },
+  { 1000, 1, 0 },
+  { 0, 1, 1 },
+};
+
+static mClockClientInfo client_info(const int &k, void *arg)
+{
+  return mClockClientInfo(info[k][0], info[k][1], info[k][2]);
+}
+
+typedef mClockQueue<int, int> Queue;
+
+TEST(mClockQueue, Weights) {
+  Queue q(NULL, client_info);
+  for (int i = 0; i < 40; i++) {
+    q.enqueue(0, 0, 0, 0);
+    q.enqueue(1, 0, 0, 1);
+  }
+  EXPECT_EQ(80u, q.length());
+  int served[2] = { 0, 0 };
+  for (int i = 0; i < 40; i++)
+    served[q.dequeue()]++;
+  EXPECT_NEAR(30, served[1], 1);
+  EXPECT_NEAR(10, served[0], 1);
+}
+
+TEST(mClockQueue, Strict) {
+  Queue q(NULL, client_info);
+  q.enqueue(0, 0, 0, 0);
+  q.enqueue_strict(1, 10, 1);
+  q.enqueue_strict(1, 20, 2);
+  EXPECT_EQ(2, q.dequeue());
+  EXPECT_EQ(1, q.dequeue());
+  EXPECT_EQ(0, q.dequeue());
+  EXPECT_TRUE(q.empty());
+}
+
+TEST(mClockQueue, Reservation) {
+  Queue q(NULL, client_info);
+  info[1][1] = 1000;
+  for (int i = 0; i < 10; i++) {
+    q.enqueue(1, 0, 0, 1);
+    q.enqueue(2, 0, 0, 2);
+  }
+  info[1][1] = 3;
+  // the reservation of 2 has made all of its ops due by then, which
+  // puts them ahead of the much heavier weighted 1
+  utime_t later = ceph_clock_now(NULL);
+  later += 1.0;
+  for (int i = 0; i < 10; i++)
+    EXPECT_EQ(2, q.dequeue(later));
+  for (int i = 0; i < 10; i++)
+    EXPECT_EQ(1, q.dequeue(later));
+}
+
+TEST(mClockQueue, Limit) {
+  Queue q(NULL, client_info);
+  for (int i = 0; i < 5; i++)
+    q.enqueue(3, 0, 0, 3);
+  utime_t now = ceph_clock_now(NULL);
+  utime_t next;
+  ASSERT_TRUE(q.can_dequeue(now, &next));
+  EXPECT_EQ(3, q.dequeue(now));
+  // the next one is a second away at 1 op/sec
+  now = ceph_clock_now(NULL);
+  EXPECT_FALSE(q.can_dequeue(now, &next));
+  EXPECT_GT(next, now);
+  EXPECT_LE((double)next, (double)now + 1.0);
+  EXPECT_EQ(4u, q.length());
+
+  // others are not held back by it
+  q.enqueue(0, 0, 0, 0);
+  now = ceph_clock_now(NULL);
+  EXPECT_TRUE(q.can_dequeue(now, &next));
+  EXPECT_EQ(0, q.dequeue(now));
+
+  utime_t later = now;
+  later += 1.5;
+  EXPECT_TRUE(q.can_dequeue(later, &next));
+  EXPECT_EQ(3, q.dequeue(later));
+}
+
+TEST(mClockQueue, Distributed) {
+  Queue q(NULL, client_info);
+  // 1 weighs three times as much as 0 but had two ops done elsewhere
+  // for each one sent here, so both are due the same share here
+  for (int i = 0; i < 40; i++) {
+    q.enqueue_distributed(0, 0, 0, 0, 1, 1);
+    q.enqueue_distributed(1, 0, 0, 1, 3, 1);
+  }
+  int served[2] = { 0, 0 };
+  for (int i = 0; i < 40; i++)
+    served[q.dequeue()]++;
+  EXPECT_NEAR(20, served[0], 1);
+  EXPECT_NEAR(20, served[1], 1);
+}
+
+struct IsOdd : public OpQueue<int, int>::Filter {
+  bool operator()(const int &i) {
+    return i % 2;
+  }
+};
+
+TEST(mClockQueue, Remove) {
+  Queue q(NULL, client_info);
+  for (int i = 0; i < 10; i++)
+    q.enqueue(i % 2, 0, 0, i);
+  q.enqueue_strict(1, 10, 11);
+  q.enqueue_strict(0, 10, 12);
+
+  IsOdd odd;
+  list<int> removed;
+  q.remove_by_filter(odd, &removed);
+  EXPECT_EQ(6u, removed.size());
+  EXPECT_EQ(6u, q.length());
+
+  removed.clear();
+  q.remove_by_class(0, &removed);
+  EXPECT_EQ(6u, removed.size());
+  EXPECT_TRUE(q.empty());
+}
@@ -0,0 +1,95 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <list>
+#include <map>
+#include <sstream>
+
+#include "common/mempool.h"
+#include "common/Formatter.h"
+#include "include/buffer.h"
+#include "gtest/gtest.h"
+
+using namespace mempool;
+
+struct Tagged {
+  char data[100];
+  MEMPOOL_CLASS_HELPERS(mempool_osd_obc)
+};
+
+TEST(Mempool, ClassHelpers)
+{
+  pool_t &p = get_pool(mempool_osd_obc);
+  int64_t bytes = p.allocated_bytes(), items = p.allocated_items();
+  Tagged *t = new Tagged;
+  EXPECT_EQ(bytes + (int64_t)sizeof(Tagged), p.allocated_bytes());
+  EXPECT_EQ(items + 1, p.allocated_items());
+  delete t;
+  EXPECT_EQ(bytes, p.allocated_bytes());
+  EXPECT_EQ(items, p.allocated_items());
+}
+
+TEST(Mempool, Allocator)
+{
+  pool_t &p = get_pool(mempool_osd_pglog);
+  int64_t bytes = p.allocated_bytes(), items = p.allocated_items();
+  {
+    std::list<int, pool_allocator<mempool_osd_pglog, int> > l;
+    for (int i = 0; i < 100; i++)
+      l.push_back(i);
+    EXPECT_EQ(items + 100, p.allocated_items());
+    EXPECT_LT(bytes + 100 * (int64_t)sizeof(int), p.allocated_bytes());
+
+    std::map<int, int, std::less<int>,
+	     pool_allocator<mempool_osd_pglog, std::pair<const int, int> > > m;
+    m[1] = 2;
+    EXPECT_EQ(items + 101, p.allocated_items());
+  }
+  EXPECT_EQ(bytes, p.allocated_bytes());
+  EXPECT_EQ(items, p.allocated_items());
+}
+
+TEST(Mempool, Buffer)
+{
+  pool_t &anon = get_pool(mempool_buffer_anon);
+  pool_t &msg = get_pool(mempool_buffer_msg);
+  int64_t anon_bytes = anon.allocated_bytes();
+  int64_t msg_bytes = msg.allocated_bytes();
+  {
+    bufferlist bl;
+    bl.append(buffer::create(10000));
+    bl.append(buffer::create(20000));
+    EXPECT_EQ(anon_bytes + 30000, anon.allocated_bytes());
+
+    bl.reassign_to_mempool(mempool_buffer_msg);
+    EXPECT_EQ(anon_bytes, anon.allocated_bytes());
+    EXPECT_EQ(msg_bytes + 30000, msg.allocated_bytes());
+
+    // reassigning to the same pool changes nothing
+    bl.reassign_to_mempool(mempool_buffer_msg);
+    EXPECT_EQ(msg_bytes + 30000, msg.allocated_bytes());
+  }
+  EXPECT_EQ(anon_bytes, anon.allocated_bytes());
+  EXPECT_EQ(msg_bytes, msg.allocated_bytes());
+}
+
+TEST(Mempool, Dump)
+{
+  JSONFormatter f;
+  dump(&f);
+  std::ostringstream ss;
+  f.flush(ss);
+  for (int i = 0; i < num_pools; i++)
+    EXPECT_NE(std::string::npos,
+	      ss.str().find(get_pool_name((pool_index_t)i)));
+  EXPECT_NE(std::string::npos, ss.str().find("total"));
+}
@@ -0,0 +1,99 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <vector>
+
+#include "common/Thread.h"
+#include "common/ObjectPool.h"
+#include "gtest/gtest.h"
+
+struct Pooled {
+  char data[100];
+  static ObjectPool alloc_pool;
+  OBJECT_POOL_ALLOCATOR(alloc_pool)
+  virtual ~Pooled() {}
+};
+ObjectPool Pooled::alloc_pool("Pooled", sizeof(Pooled));
+
+struct Derived : public Pooled {
+  char more[100];
+};
+
+static ObjectPool::stats_t get_stats()
+{
+  ObjectPool::stats_t s;
+  Pooled::alloc_pool.get_stats(&s);
+  return s;
+}
+
+TEST(ObjectPool, Reuse)
+{
+  ObjectPool::stats_t before = get_stats();
+  Pooled *a = new Pooled;
+  delete a;
+  Pooled *b = new Pooled;
+  EXPECT_EQ(a, b);
+  delete b;
+
+  ObjectPool::stats_t after = get_stats();
+  EXPECT_EQ(before.misses + 1, after.misses);
+  EXPECT_EQ(before.hits + 1, after.hits);
+  EXPECT_EQ(sizeof(Pooled), after.cached_bytes);
+}
+
+TEST(ObjectPool, Derived)
+{
+  // other sizes bypass the pool
+  ObjectPool::stats_t before = get_stats();
+  Pooled *d = new Derived;
+  delete d;
+  ObjectPool::stats_t after = get_stats();
+  EXPECT_EQ(before.hits, after.hits);
+  EXPECT_EQ(before.misses, after.misses);
+  EXPECT_EQ(before.cached_bytes, after.cached_bytes);
+}
+
+struct Churn : public Thread {
+  std::vector<Pooled*> *in, *out;
+  Churn(std::vector<Pooled*> *i, std::vector<Pooled*> *o) : in(i), out(o) {}
+  void *entry() {
+    // free what another thread allocated, allocate for the next one
+    for (unsigned i = 0; i < in->size(); i++)
+      delete (*in)[i];
+    for (unsigned i = 0; i < 1000; i++)
+      out->push_back(new Pooled);
+    return NULL;
+  }
+};
+
+TEST(ObjectPool, Threads)
+{
+  std::vector<Pooled*> v[5];
+  for (unsigned i = 0; i < 1000; i++)
+    v[0].push_back(new Pooled);
+  for (unsigned i = 0; i < 4; i++) {
+    Churn t(&v[i], &v[i + 1]);
+    t.create();
+    t.join();
+  }
+  for (unsigned i = 0; i < v[4].size(); i++)
+    delete v[4][i];
+
+  // exited threads gave their lists back
+  ObjectPool::stats_t s = get_stats();
+  EXPECT_LT(0u, s.hits);
+  EXPECT_GE(1024u * sizeof(Pooled) + 64 * sizeof(Pooled), s.cached_bytes);
+
+  ObjectPool::stats_t total;
+  ObjectPool::get_total_stats(&total);
+  EXPECT_LE(s.hits, total.hits);
+}
@@ -0,0 +1,77 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <vector>
+
+#include "common/Finisher.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "gtest/gtest.h"
+
+struct Key {
+  Mutex lock;
+  std::vector<int> done;
+  Key() : lock("Key::lock") {}
+};
+
+struct C_Record : public Context {
+  Key *key;
+  int seq;
+  C_Record(Key *k, int s) : key(k), seq(s) {}
+  void finish(int r) {
+    Mutex::Locker l(key->lock);
+    key->done.push_back(seq + r);
+  }
+};
+
+TEST(ShardedFinisher, OrderedPerKey)
+{
+  ShardedFinisher f(g_ceph_context, 4);
+  ASSERT_EQ(4u, f.get_num_shards());
+  f.start();
+
+  Key keys[10];
+  for (int i = 0; i < 1000; i++)
+    for (int k = 0; k < 10; k++)
+      f.queue(&keys[k], new C_Record(&keys[k], i), k % 2 ? 1000 : 0);
+  f.wait_for_empty();
+
+  for (int k = 0; k < 10; k++) {
+    ASSERT_EQ(1000u, keys[k].done.size());
+    for (int i = 0; i < 1000; i++)
+      ASSERT_EQ(i + (k % 2 ? 1000 : 0), keys[k].done[i]);
+  }
+  f.stop();
+}
+
+TEST(ShardedFinisher, SameKeySameShard)
+{
+  ShardedFinisher f(g_ceph_context, 8);
+  Key a, b;
+  ASSERT_EQ(f.get_shard(&a), f.get_shard(&a));
+  ShardedFinisher one(g_ceph_context, 0);
+  ASSERT_EQ(1u, one.get_num_shards());
+  ASSERT_EQ(one.get_shard(&a), one.get_shard(&b));
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -111,3 +111,43 @@ TEST(SloppyCRCMap, clone_range) {
   ASSERT_EQ(0, dst.read(0, 8, a, &cout));
   ASSERT_EQ(0, dst.read(8, 4, a, &cout));
 }
+
+TEST(SloppyCRCMap, extend_crc32c) {
+  SloppyCRCMap scm(4);
+
+  bufferlist a;
+  a.append("The quick brown fox jumped over a fence whose color I forget.");
+  scm.write(0, a.length(), a);
+  scm.zero(32, 8);
+  bufferlist z;
+  z.append_zero(8);
+  bufferlist data;
+  data.substr_of(a, 0, 32);
+  data.claim_append(z);
+  bufferlist tail;
+  tail.substr_of(a, 40, a.length() - 40);
+  data.claim_append(tail);
+
+  // tracked blocks come from the map, the rest from the data
+  uint32_t crc = 0;
+  uint64_t pos = 0;
+  int used = 0;
+  while (pos < data.length()) {
+    if (pos + 4 <= data.length() && scm.extend_crc32c(pos, &crc)) {
+      pos += 4;
+      ++used;
+      continue;
+    }
+    bufferlist t;
+    t.substr_of(data, pos, MIN(4, data.length() - pos));
+    crc = t.crc32c(crc);
+    pos += t.length();
+  }
+  ASSERT_EQ(15, used);
+  ASSERT_EQ(data.crc32c(0), crc);
+
+  ASSERT_FALSE(scm.has_crc(2));
+  ASSERT_FALSE(scm.extend_crc32c(2, &crc));
+  ASSERT_FALSE(scm.has_crc(60));
+  ASSERT_TRUE(scm.has_crc(32));
+}
@@ -3,7 +3,12 @@
 
 #include "include/types.h"
 #include "auth/Crypto.h"
+#include "auth/AuthSessionHandler.h"
+#include "auth/cephx/CephxProtocol.h"
+#include "include/ceph_features.h"
+#include "messages/MPing.h"
 #include "common/ceph_crypto.h"
+#include "common/Clock.h"
 
 #include "test/unit.h"
 
@@ -146,3 +151,77 @@ TEST(AES, Loop) {
   err = memcmp(plaintext_s, orig_plaintext_s, sizeof(orig_plaintext_s));
   ASSERT_EQ(0, err);
 }
+
+TEST(AES, KeyHandler) {
+  char secret_s[16];
+  ASSERT_EQ(0, get_random_bytes(secret_s, sizeof(secret_s)));
+  bufferptr secret(secret_s, sizeof(secret_s));
+  CryptoKey key(CEPH_CRYPTO_AES, ceph_clock_now(g_ceph_context), secret);
+
+  std::string error;
+  CryptoKeyHandler *kh = key.get_key_handler(g_ceph_context, error);
+  ASSERT_EQ(error, "");
+  ASSERT_TRUE(kh != NULL);
+
+  for (int i=0; i<100; i++) {
+    unsigned char block[16];
+    ASSERT_EQ(0, get_random_bytes((char *)block, sizeof(block)));
+
+    // the first block of cbc is the block xor the iv, encrypted
+    bufferlist plaintext;
+    plaintext.append((char *)block, sizeof(block));
+    bufferlist cipher;
+    key.encrypt(g_ceph_context, plaintext, cipher, error);
+    ASSERT_EQ(error, "");
+
+    for (unsigned j=0; j<sizeof(block); j++)
+      block[j] ^= CEPH_AES_IV[j];
+    unsigned char out[16];
+    ASSERT_EQ(0, kh->encrypt_block(block, out, error));
+    ASSERT_EQ(0, memcmp(out, cipher.c_str(), sizeof(out)));
+  }
+  delete kh;
+
+  // other secret lengths have no fast path
+  char long_s[32];
+  bufferptr long_secret(long_s, sizeof(long_s));
+  CryptoKey long_key(CEPH_CRYPTO_AES, ceph_clock_now(g_ceph_context), long_secret);
+  ASSERT_TRUE(long_key.get_key_handler(g_ceph_context, error) == NULL);
+}
+
+TEST(CephxSessionHandler, Signature) {
+  CryptoKey key;
+  ASSERT_EQ(0, key.create(g_ceph_context, CEPH_CRYPTO_AES));
+  AuthSessionHandler *h = get_auth_session_handler(g_ceph_context,
+						   CEPH_AUTH_CEPHX, key,
+						   CEPH_FEATURE_MSG_AUTH);
+  MPing *m = new MPing;
+  ceph_msg_footer& footer = m->get_footer();
+  for (int i=0; i<100; i++) {
+    m->get_header().crc = get_random(0, 0xffffffff);
+    footer.front_crc = get_random(0, 0xffffffff);
+    footer.middle_crc = get_random(0, 0xffffffff);
+    footer.data_crc = get_random(0, 0xffffffff);
+    ASSERT_EQ(0, h->sign_message(m));
+
+    // what the signature was before the session key was kept set up
+    bufferlist bl, enc;
+    ::encode(m->get_header().crc, bl);
+    ::encode(footer.front_crc, bl);
+    ::encode(footer.middle_crc, bl);
+    ::encode(footer.data_crc, bl);
+    std::string error;
+    ASSERT_EQ(0, encode_encrypt(g_ceph_context, bl, key, enc, error));
+    bufferlist::iterator p = enc.begin();
+    p.advance(4);
+    uint64_t sig;
+    ::decode(sig, p);
+    ASSERT_EQ(sig, (uint64_t)footer.sig);
+
+    ASSERT_EQ(0, h->check_message_signature(m));
+    footer.sig = sig + 1;
+    ASSERT_EQ(SESSION_SIGNATURE_FAILURE, h->check_message_signature(m));
+  }
+  m->put();
+  delete h;
+}
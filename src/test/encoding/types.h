@@ -39,6 +39,9 @@ TYPE(CrushWrapper)
 #include "include/histogram.h"
 TYPE(pow2_hist_t)
 
+#include "osd/HitSet.h"
+TYPE(HitSet)
+
 #include "osd/osd_types.h"
 TYPE(osd_reqid_t)
 TYPE(object_locator_t)
@@ -221,6 +224,7 @@ TYPE(rgw_bucket_entry_ver)
 #include "cls/rgw/cls_rgw_ops.h"
 TYPE(rgw_cls_obj_prepare_op)
 TYPE(rgw_cls_obj_complete_op)
+TYPE(rgw_cls_obj_complete_ops)
 TYPE(rgw_cls_list_op)
 TYPE(rgw_cls_list_ret)
 TYPE(cls_rgw_gc_defer_entry_op)
@@ -40,7 +40,9 @@ public:
   StoreTest() : store(0) {}
   virtual void SetUp() {
     ::mkdir("store_test_temp_dir", 0777);
-    ObjectStore *store_ = new FileStore(string("store_test_temp_dir"), string("store_test_temp_journal"));
+    ObjectStore *store_ = ObjectStore::create(g_conf->osd_objectstore,
+					      string("store_test_temp_dir"),
+					      string("store_test_temp_journal"));
     store.reset(store_);
     store->mkfs();
     store->mount();
@@ -574,6 +576,123 @@ TEST_F(StoreTest, HashCollisionTest) {
   store->apply_transaction(t);
 }
 
+TEST_F(StoreTest, SparseCloneTest) {
+  coll_t cid("sparse");
+  ghobject_t hoid(hobject_t(sobject_t("sparse_src", CEPH_NOSNAP)));
+  ghobject_t clone(hobject_t(sobject_t("sparse_clone", CEPH_NOSNAP)));
+  ghobject_t range(hobject_t(sobject_t("sparse_range", CEPH_NOSNAP)));
+  int r;
+  bufferlist data;
+  data.append(string(65536, 'x'));
+  {
+    // data at both ends of a 4MB object, a hole in between
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    t.write(cid, hoid, 0, data.length(), data);
+    t.write(cid, hoid, 3 << 20, data.length(), data);
+    t.truncate(cid, hoid, 4 << 20);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.clone(cid, hoid, clone);
+    t.touch(cid, range);
+    t.clone_range(cid, hoid, range, 4096, (3 << 20) + 4096, 8192);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    struct stat st;
+    r = store->stat(cid, clone, &st);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(4 << 20, st.st_size);
+    bufferlist src, dst;
+    r = store->read(cid, hoid, 0, 4 << 20, src);
+    ASSERT_EQ(4 << 20, r);
+    r = store->read(cid, clone, 0, 4 << 20, dst);
+    ASSERT_EQ(4 << 20, r);
+    ASSERT_TRUE(src.contents_equal(dst));
+
+    r = store->stat(cid, range, &st);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(8192 + (3 << 20) + 4096, st.st_size);
+    bufferlist expect, got;
+    expect.substr_of(src, 4096, (3 << 20) + 4096);
+    r = store->read(cid, range, 8192, (3 << 20) + 4096, got);
+    ASSERT_EQ((3 << 20) + 4096, r);
+    ASSERT_TRUE(expect.contents_equal(got));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove(cid, clone);
+    t.remove(cid, range);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_F(StoreTest, ReadvTest) {
+  coll_t cid("readv");
+  ghobject_t hoid(hobject_t(sobject_t("readv_obj", CEPH_NOSNAP)));
+  int r;
+  bufferlist data;
+  for (int i = 0; i < 100000; ++i)
+    data.append((char)('a' + i % 26));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    t.write(cid, hoid, 0, data.length(), data);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    // out of order, overlapping, touching, far apart, past eof
+    vector<pair<uint64_t, size_t> > extents;
+    extents.push_back(make_pair(50000, 1000));
+    extents.push_back(make_pair(0, 100));
+    extents.push_back(make_pair(100, 50));
+    extents.push_back(make_pair(120, 500));
+    extents.push_back(make_pair(99500, 1000));
+    extents.push_back(make_pair(200000, 10));
+    extents.push_back(make_pair(10, 0));
+    vector<bufferlist> bls;
+    vector<int> rs;
+    r = store->readv(cid, hoid, extents, bls, rs);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(extents.size(), bls.size());
+    ASSERT_EQ(extents.size(), rs.size());
+    for (unsigned i = 0; i < extents.size(); ++i) {
+      bufferlist expect;
+      int len = store->read(cid, hoid, extents[i].first, extents[i].second,
+			    expect);
+      ASSERT_EQ(len, rs[i]);
+      ASSERT_TRUE(expect.contents_equal(bls[i]));
+    }
+    ASSERT_EQ(500, rs[4]);
+    ASSERT_EQ(0, rs[5]);
+  }
+  {
+    ghobject_t missing(hobject_t(sobject_t("readv_missing", CEPH_NOSNAP)));
+    vector<pair<uint64_t, size_t> > extents;
+    extents.push_back(make_pair(0, 100));
+    extents.push_back(make_pair(200, 100));
+    vector<bufferlist> bls;
+    vector<int> rs;
+    r = store->readv(cid, missing, extents, bls, rs);
+    ASSERT_TRUE(r == 0 ? rs[0] == -ENOENT && rs[1] == -ENOENT : r == -ENOENT);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_F(StoreTest, OMapTest) {
   coll_t cid("blah");
   ghobject_t hoid(hobject_t("tesomap", "", CEPH_NOSNAP, 0, 0, ""));
@@ -670,6 +789,80 @@ TEST_F(StoreTest, OMapTest) {
   store->apply_transaction(t);
 }
 
+TEST_F(StoreTest, OMapRangeTest) {
+  coll_t cid("blah");
+  ghobject_t hoid(hobject_t("tesomaprange", "", CEPH_NOSNAP, 0, 0, ""));
+  int r;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    t.touch(cid, hoid);
+    map<string, bufferlist> to_add;
+    for (int i = 0; i < 10; i++) {
+      char buf[20];
+      snprintf(buf, sizeof(buf), "%d", i);
+      to_add["a_" + string(buf)].append("0123456789");
+      to_add["b_" + string(buf)].append("0123456789");
+    }
+    t.omap_setkeys(cid, hoid, to_add);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+
+  {
+    // prefix filter stops at the end of the prefix
+    map<string, bufferlist> out;
+    bool more = false;
+    r = store->omap_get_values_range(cid, hoid, "", "a_", 100, 0, &out, &more);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(10u, out.size());
+    ASSERT_EQ("a_0", out.begin()->first);
+    ASSERT_EQ("a_9", out.rbegin()->first);
+    ASSERT_FALSE(more);
+  }
+  {
+    // start after a key within the prefix
+    map<string, bufferlist> out;
+    bool more = false;
+    r = store->omap_get_values_range(cid, hoid, "b_4", "b_", 3, 0, &out, &more);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(3u, out.size());
+    ASSERT_EQ("b_5", out.begin()->first);
+    ASSERT_EQ("b_7", out.rbegin()->first);
+    ASSERT_TRUE(more);
+  }
+  {
+    // each entry is 13 bytes, so the budget is reached after 3
+    map<string, bufferlist> out;
+    bool more = false;
+    r = store->omap_get_values_range(cid, hoid, "", "", 100, 30, &out, &more);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(3u, out.size());
+    ASSERT_TRUE(more);
+
+    // a budget smaller than one entry still returns one
+    out.clear();
+    r = store->omap_get_values_range(cid, hoid, "", "", 100, 1, &out, &more);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(1u, out.size());
+    ASSERT_TRUE(more);
+  }
+  {
+    set<string> out;
+    bool more = true;
+    r = store->omap_get_keys_range(cid, hoid, "a_9", 100, 0, &out, &more);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(10u, out.size());
+    ASSERT_EQ("b_0", *out.begin());
+    ASSERT_FALSE(more);
+  }
+
+  ObjectStore::Transaction t;
+  t.remove(cid, hoid);
+  t.remove_collection(cid);
+  store->apply_transaction(t);
+}
+
 TEST_F(StoreTest, XattrTest) {
   coll_t cid("blah");
   ghobject_t hoid(hobject_t("tesomap", "", CEPH_NOSNAP, 0, 0, ""));
@@ -748,6 +941,28 @@ TEST_F(StoreTest, XattrTest) {
   bufferlist bl2;
   bl2.push_back(bp);
   ASSERT_TRUE(bl2 == attrs["attr3"]);
+
+  // reads after an overwrite or removal must not see what was cached
+  bufferlist other;
+  other.append("0123456789");
+  {
+    ObjectStore::Transaction t;
+    t.setattr(cid, hoid, "attr1", other);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist bl3;
+  r = store->getattr(cid, hoid, "attr1", bl3);
+  ASSERT_LE(0, r);
+  ASSERT_TRUE(bl3 == other);
+  {
+    ObjectStore::Transaction t;
+    t.rmattr(cid, hoid, "attr1");
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  r = store->getattr(cid, hoid, "attr1", bp);
+  ASSERT_EQ(r, -ENODATA);
 }
 
 void colsplittest(
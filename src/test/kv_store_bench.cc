@@ -82,8 +82,10 @@ int KvStoreBench::setup(int argc, const char** argv) {
       << "   --valsize <number>                            number of characters per value (default " << val_size << ")\n"
       << "   -t <number>                                   number of operations in flight concurrently\n"
       << "                                                 (default " << max_ops_in_flight << ")\n"
+      << "   --concurrency <n>[,<n>...]                    run the operations once with each of these numbers of\n"
+      << "                                                 operations in flight and report ops/sec for each\n"
       << "   --clients <number>                            tells this instance how many total clients are. Note that\n"
-      << "                                                 changing this does not change the number of clients."
+      << "                                                 changing this does not change the number of clients.\n"
       << "   -d <insert> <update> <delete> <read>          percent (1-100) of operations that should be of each type\n"
       << "                                                 (default 25 25 25 25)\n"
       << "   -r <number>                                   random seed to use (default time(0))\n"
@@ -115,6 +117,15 @@ int KvStoreBench::setup(int argc, const char** argv) {
 	cache_refresh = 100 / atoi(args[i+1]);
       } else if (strcmp(args[i], "-t") == 0) {
 	max_ops_in_flight = atoi(args[i+1]);
+      } else if (strcmp(args[i], "--concurrency") == 0) {
+	concurrency.clear();
+	stringstream ss(args[i+1]);
+	string n;
+	while (getline(ss, n, ',')) {
+	  if (atoi(n.c_str()) > 0) {
+	    concurrency.push_back(atoi(n.c_str()));
+	  }
+	}
       } else if (strcmp(args[i], "--clients") == 0) {
 	clients = atoi(args[i+1]);
       } else if (strcmp(args[i], "-d") == 0) {
@@ -351,6 +362,17 @@ int KvStoreBench::test_teuthology_aio(next_gen_t distr,
 
   cout << "done waiting. Starting random operations..." << std::endl;
 
+  err = run_aio_ops(distr, probs);
+
+  print_time_data();
+  return err;
+}
+
+int KvStoreBench::run_aio_ops(next_gen_t distr,
+    const map<int, char> &probs)
+{
+  int err = 0;
+  utime_t start = ceph_clock_now(g_ceph_context);
   Mutex::Locker l(ops_in_flight_lock);
   for (int i = 0; i < ops; i++) {
     assert(ops_in_flight <= max_ops_in_flight);
@@ -429,6 +451,40 @@ int KvStoreBench::test_teuthology_aio(next_gen_t distr,
     op_avail.Wait(ops_in_flight_lock);
   }
 
+  double elapsed = ceph_clock_now(g_ceph_context) - start;
+  data_lock.Lock();
+  data.ops_per_sec[max_ops_in_flight] = elapsed > 0 ? ops / elapsed : 0;
+  data_lock.Unlock();
+  cout << max_ops_in_flight << " ops in flight: " << ops << " ops in "
+      << elapsed << " s" << std::endl;
+  return err;
+}
+
+int KvStoreBench::test_concurrency(next_gen_t distr,
+    const map<int, char> &probs)
+{
+  int err = 0;
+  cout << "inserting initial entries..." << std::endl;
+  err = test_random_insertions();
+  if (err < 0) {
+    return err;
+  }
+  cout << "finished inserting initial entries. Waiting 10 seconds for everyone"
+      << " to catch up..." << std::endl;
+
+  sleep(10);
+
+  for (vector<int>::iterator it = concurrency.begin();
+      it != concurrency.end(); ++it) {
+    max_ops_in_flight = *it;
+    cout << "starting random operations with " << max_ops_in_flight
+	<< " in flight..." << std::endl;
+    err = run_aio_ops(distr, probs);
+    if (err < 0) {
+      break;
+    }
+  }
+
   print_time_data();
   return err;
 }
@@ -532,13 +588,23 @@ void KvStoreBench::print_time_data() {
   cout << std::endl;
   cout << "throughput:" << std::endl;
   data.throughput_jf.flush(cout);
+  if (!data.ops_per_sec.empty()) {
+    cout << std::endl;
+    cout << "ops/sec by ops in flight:" << std::endl;
+    for (map<int, double>::iterator it = data.ops_per_sec.begin();
+	it != data.ops_per_sec.end(); ++it) {
+      cout << "\t" << it->first << "\t" << it->second << std::endl;
+    }
+  }
   cout << "\n========================================================"
        << std::endl;
 }
 
 int KvStoreBench::teuthology_tests() {
   int err = 0;
-  if (max_ops_in_flight > 1) {
+  if (!concurrency.empty()) {
+    err = test_concurrency(&KvStoreBench::rand_distr, probs);
+  } else if (max_ops_in_flight > 1) {
     test_teuthology_aio(&KvStoreBench::rand_distr, probs);
   } else {
     err = test_teuthology_sync(&KvStoreBench::rand_distr, probs);
@@ -37,6 +37,9 @@ struct kv_bench_data {
   JSONFormatter throughput_jf;
 
   JSONFormatter latency_jf;
+
+  //ops in flight -> operations per second over the whole run at that level
+  map<int, double> ops_per_sec;
 };
 
 class KvStoreBench;
@@ -101,6 +104,8 @@ protected:
   int key_size;//number of characters in keys to write
   int val_size;//number of characters in values to write
   int max_ops_in_flight;
+  vector<int> concurrency;//if not empty, the aio test is run once with each
+			  //of these as max_ops_in_flight
   bool clear_first;//if true, remove all objects in pool before starting tests
 
   //variables passed to KeyValueStructure
@@ -133,6 +138,8 @@ protected:
    * Throughput data is {'char representing the operation type':time the op
    * completed to the nearest second}
    * Latency is {'char representing the operation type':time taken by the op}
+   * followed by the operations per second for each number of ops in flight
+   * that was run.
    */
   void print_time_data();
 
@@ -165,6 +172,19 @@ public:
    */
   int test_teuthology_aio(next_gen_t distr, const map<int, char> &probs);
 
+  /**
+   * does ops randomly chosen operations asynchronously, with
+   * max_ops_in_flight operations at a time, and records the throughput
+   * in data.ops_per_sec.
+   */
+  int run_aio_ops(next_gen_t distr, const map<int, char> &probs);
+
+  /**
+   * calls test_random_insertions, then runs run_aio_ops once for each
+   * number of ops in flight in concurrency.
+   */
+  int test_concurrency(next_gen_t distr, const map<int, char> &probs);
+
   /**
    * calls test_random_insertions, then does ops randomly chosen operations
    * synchronously.
@@ -21,6 +21,7 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <sys/xattr.h>
+#include <pthread.h>
 
 TEST(LibCephFS, OpenEmptyComponent) {
 
@@ -1119,3 +1120,170 @@ TEST(LibCephFS, GetOsdAddr) {
 
   ceph_shutdown(cmount);
 }
+
+TEST(LibCephFS, PreadvPwritev) {
+  struct ceph_mount_info *cmount;
+  ASSERT_EQ(ceph_create(&cmount, NULL), 0);
+  ASSERT_EQ(0, ceph_conf_parse_env(cmount, NULL));
+  ASSERT_EQ(ceph_conf_read_file(cmount, NULL), 0);
+  ASSERT_EQ(ceph_mount(cmount, NULL), 0);
+
+  char testf[256];
+  sprintf(testf, "test_preadv%d", getpid());
+  int fd = ceph_open(cmount, testf, O_CREAT|O_TRUNC|O_RDWR, 0644);
+  ASSERT_GT(fd, 0);
+
+  char a[] = "hello ", b[] = "vectored ", c[] = "world";
+  struct iovec wv[3] = { { a, 6 }, { b, 9 }, { c, 5 } };
+  ASSERT_EQ(20, ceph_pwritev(cmount, fd, wv, 3, 0));
+
+  char x[4], y[32];
+  memset(y, 0, sizeof(y));
+  struct iovec rv[2] = { { x, sizeof(x) }, { y, sizeof(y) } };
+  ASSERT_EQ(20, ceph_preadv(cmount, fd, rv, 2, 0));
+  ASSERT_EQ(0, memcmp(x, "hell", 4));
+  ASSERT_STREQ("o vectored world", y);
+
+  ASSERT_EQ(-EBADF, ceph_preadv(cmount, -1, rv, 2, 0));
+
+  ceph_close(cmount, fd);
+  ceph_shutdown(cmount);
+}
+
+struct aio_waiter {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int done;
+  int result;
+  aio_waiter() : done(0), result(0) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+  static void cb(int r, void *arg) {
+    aio_waiter *w = (aio_waiter *)arg;
+    pthread_mutex_lock(&w->lock);
+    w->result = r;
+    w->done = 1;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+  }
+  int wait() {
+    pthread_mutex_lock(&lock);
+    while (!done)
+      pthread_cond_wait(&cond, &lock);
+    done = 0;
+    pthread_mutex_unlock(&lock);
+    return result;
+  }
+};
+
+TEST(LibCephFS, AioReadWrite) {
+  struct ceph_mount_info *cmount;
+  ASSERT_EQ(ceph_create(&cmount, NULL), 0);
+  ASSERT_EQ(0, ceph_conf_parse_env(cmount, NULL));
+  ASSERT_EQ(ceph_conf_read_file(cmount, NULL), 0);
+  ASSERT_EQ(ceph_mount(cmount, NULL), 0);
+
+  char testf[256];
+  sprintf(testf, "test_aio%d", getpid());
+  int fd = ceph_open(cmount, testf, O_CREAT|O_TRUNC|O_RDWR, 0644);
+  ASSERT_GT(fd, 0);
+
+  aio_waiter w;
+  const char *out = "some asynchronous bytes";
+  int len = strlen(out);
+  ASSERT_EQ(0, ceph_aio_write(cmount, fd, out, len, 0, aio_waiter::cb, &w));
+  ASSERT_EQ(len, w.wait());
+
+  char in[64];
+  memset(in, 0, sizeof(in));
+  ASSERT_EQ(0, ceph_aio_read(cmount, fd, in, sizeof(in), 0, aio_waiter::cb, &w));
+  ASSERT_EQ(len, w.wait());
+  ASSERT_STREQ(out, in);
+
+  // past eof
+  ASSERT_EQ(0, ceph_aio_read(cmount, fd, in, sizeof(in), 1000, aio_waiter::cb, &w));
+  ASSERT_EQ(0, w.wait());
+
+  ASSERT_EQ(-EINVAL, ceph_aio_read(cmount, fd, in, sizeof(in), -1, aio_waiter::cb, &w));
+  ASSERT_EQ(-EBADF, ceph_aio_write(cmount, -1, out, len, 0, aio_waiter::cb, &w));
+
+  ceph_close(cmount, fd);
+  ceph_shutdown(cmount);
+}
+
+TEST(LibCephFS, NegativeDentry) {
+  struct ceph_mount_info *cmount;
+  ASSERT_EQ(ceph_create(&cmount, NULL), 0);
+  ASSERT_EQ(0, ceph_conf_parse_env(cmount, NULL));
+  ASSERT_EQ(ceph_conf_read_file(cmount, NULL), 0);
+  ASSERT_EQ(ceph_mount(cmount, NULL), 0);
+
+  char dir[256], path[256];
+  sprintf(dir, "test_negdn%d", getpid());
+  sprintf(path, "%s/f", dir);
+  ASSERT_EQ(0, ceph_mkdir(cmount, dir, 0755));
+
+  // the second miss may come from a cached null dentry; either way the
+  // file must show up once it is created
+  struct stat st;
+  ASSERT_EQ(-ENOENT, ceph_stat(cmount, path, &st));
+  ASSERT_EQ(-ENOENT, ceph_stat(cmount, path, &st));
+  int fd = ceph_open(cmount, path, O_CREAT|O_RDWR, 0644);
+  ASSERT_GT(fd, 0);
+  ceph_close(cmount, fd);
+  ASSERT_EQ(0, ceph_stat(cmount, path, &st));
+
+  ASSERT_EQ(0, ceph_unlink(cmount, path));
+  ASSERT_EQ(-ENOENT, ceph_stat(cmount, path, &st));
+  ASSERT_EQ(0, ceph_rmdir(cmount, dir));
+  ceph_shutdown(cmount);
+}
+
+TEST(LibCephFS, LazyIO) {
+  struct ceph_mount_info *ca, *cb;
+  ASSERT_EQ(ceph_create(&ca, NULL), 0);
+  ASSERT_EQ(0, ceph_conf_parse_env(ca, NULL));
+  ASSERT_EQ(ceph_conf_read_file(ca, NULL), 0);
+  ASSERT_EQ(ceph_mount(ca, NULL), 0);
+  ASSERT_EQ(ceph_create(&cb, NULL), 0);
+  ASSERT_EQ(0, ceph_conf_parse_env(cb, NULL));
+  ASSERT_EQ(ceph_conf_read_file(cb, NULL), 0);
+  ASSERT_EQ(ceph_mount(cb, NULL), 0);
+
+  char testf[256];
+  sprintf(testf, "test_lazyio%d", getpid());
+  int fda = ceph_open(ca, testf, O_CREAT|O_TRUNC|O_RDWR, 0644);
+  ASSERT_GT(fda, 0);
+  int fdb = ceph_open(cb, testf, O_RDWR, 0644);
+  ASSERT_GT(fdb, 0);
+  ASSERT_EQ(0, ceph_lazyio(ca, fda, 1));
+  ASSERT_EQ(0, ceph_lazyio(cb, fdb, 1));
+
+  // each writes its own half, then both sync up
+  char a[64], b[64];
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+  ASSERT_EQ((int)sizeof(a), ceph_write(ca, fda, a, sizeof(a), 0));
+  ASSERT_EQ((int)sizeof(b), ceph_write(cb, fdb, b, sizeof(b), sizeof(a)));
+  ASSERT_EQ(0, ceph_lazyio_propagate(ca, fda, 0, 0));
+  ASSERT_EQ(0, ceph_lazyio_propagate(cb, fdb, 0, 0));
+  ASSERT_EQ(0, ceph_lazyio_synchronize(ca, fda, 0, 0));
+  ASSERT_EQ(0, ceph_lazyio_synchronize(cb, fdb, 0, 0));
+
+  char buf[128];
+  ASSERT_EQ((int)sizeof(buf), ceph_read(ca, fda, buf, sizeof(buf), 0));
+  ASSERT_EQ(0, memcmp(buf, a, sizeof(a)));
+  ASSERT_EQ(0, memcmp(buf + sizeof(a), b, sizeof(b)));
+  ASSERT_EQ((int)sizeof(buf), ceph_read(cb, fdb, buf, sizeof(buf), 0));
+  ASSERT_EQ(0, memcmp(buf, a, sizeof(a)));
+  ASSERT_EQ(0, memcmp(buf + sizeof(a), b, sizeof(b)));
+
+  ASSERT_EQ(0, ceph_lazyio(ca, fda, 0));
+  ASSERT_EQ(-EBADF, ceph_lazyio(ca, 1234, 1));
+  ceph_close(ca, fda);
+  ceph_close(cb, fdb);
+  ceph_unlink(ca, testf);
+  ceph_shutdown(ca);
+  ceph_shutdown(cb);
+}
@@ -5,6 +5,7 @@
 
 #include "gtest/gtest.h"
 #include <errno.h>
+#include <poll.h>
 #include <semaphore.h>
 #include <sstream>
 #include <string>
@@ -1288,3 +1289,181 @@ TEST(LibRadosAio, OmapPP) {
 
   ioctx.remove("test_obj");
 }
+
+TEST(LibRadosAio, Batch) {
+  AioTestData test_data;
+  ASSERT_EQ("", test_data.init());
+  const size_t num = 16;
+  char names[num][16];
+  const char *oids[num];
+  char wbufs[num][128], rbufs[num][128];
+  const char *wptrs[num];
+  char *rptrs[num];
+  size_t lens[num];
+  uint64_t offs[num];
+  rados_completion_t wc[num], rc[num];
+  for (size_t i = 0; i < num; ++i) {
+    snprintf(names[i], sizeof(names[i]), "foo%d", (int)i);
+    oids[i] = names[i];
+    memset(wbufs[i], 'a' + i, sizeof(wbufs[i]));
+    memset(rbufs[i], 0, sizeof(rbufs[i]));
+    wptrs[i] = wbufs[i];
+    rptrs[i] = rbufs[i];
+    lens[i] = sizeof(wbufs[i]);
+    offs[i] = 0;
+    ASSERT_EQ(0, rados_aio_create_completion(NULL, NULL, NULL, &wc[i]));
+    ASSERT_EQ(0, rados_aio_create_completion(NULL, NULL, NULL, &rc[i]));
+  }
+
+  rados_completion_set_t set;
+  ASSERT_EQ(0, rados_aio_create_completion_set(&set));
+  for (size_t i = 0; i < num; ++i)
+    rados_aio_completion_set_add(set, wc[i]);
+  ASSERT_EQ(num, rados_aio_completion_set_size(set));
+  ASSERT_EQ(0, rados_aio_write_batch(test_data.m_ioctx, num, oids, wc,
+				     wptrs, lens, offs));
+  {
+    TestAlarm alarm;
+    rados_aio_completion_set_wait_for_all(set);
+  }
+  ASSERT_EQ(0u, rados_aio_completion_set_size(set));
+  for (size_t i = 0; i < num; ++i)
+    ASSERT_EQ(0, rados_aio_get_return_value(wc[i]));
+
+  // the reads come back one at a time, each exactly once
+  for (size_t i = 0; i < num; ++i)
+    rados_aio_completion_set_add(set, rc[i]);
+  ASSERT_EQ(0, rados_aio_read_batch(test_data.m_ioctx, num, oids, rc,
+				    rptrs, lens, offs));
+  std::set<rados_completion_t> got;
+  {
+    TestAlarm alarm;
+    rados_completion_t c;
+    while (rados_aio_completion_set_wait_for_any(set, &c) == 0) {
+      ASSERT_TRUE(got.insert(c).second);
+      ASSERT_EQ((int)sizeof(rbufs[0]), rados_aio_get_return_value(c));
+    }
+  }
+  ASSERT_EQ(num, got.size());
+  for (size_t i = 0; i < num; ++i)
+    ASSERT_EQ(0, memcmp(wbufs[i], rbufs[i], sizeof(wbufs[i])));
+
+  rados_aio_completion_set_release(set);
+  for (size_t i = 0; i < num; ++i) {
+    rados_aio_release(wc[i]);
+    rados_aio_release(rc[i]);
+  }
+}
+
+TEST(LibRadosAio, BatchPP) {
+  AioTestDataPP test_data;
+  ASSERT_EQ("", test_data.init());
+  const size_t num = 16;
+  std::string oids[num];
+  ObjectWriteOperation wops[num];
+  ObjectReadOperation rops[num];
+  ObjectWriteOperation *pwops[num];
+  ObjectReadOperation *props[num];
+  bufferlist rbls[num];
+  bufferlist *prbls[num];
+  AioCompletion *wc[num], *rc[num];
+  AioCompletionSet *set = test_data.m_cluster.aio_create_completion_set();
+  for (size_t i = 0; i < num; ++i) {
+    ostringstream oss;
+    oss << "foo" << i;
+    oids[i] = oss.str();
+    bufferlist bl;
+    bl.append(oids[i]);
+    wops[i].write_full(bl);
+    pwops[i] = &wops[i];
+    rops[i].read(0, 0, NULL, NULL);
+    props[i] = &rops[i];
+    prbls[i] = &rbls[i];
+    wc[i] = test_data.m_cluster.aio_create_completion();
+    rc[i] = test_data.m_cluster.aio_create_completion();
+    set->add(wc[i]);
+  }
+
+  ASSERT_EQ(0, test_data.m_ioctx.aio_operate_batch(num, oids, wc, pwops));
+  {
+    TestAlarm alarm;
+    set->wait_for_all();
+  }
+  ASSERT_EQ(0u, set->size());
+  for (size_t i = 0; i < num; ++i) {
+    ASSERT_EQ(0, wc[i]->get_return_value());
+    set->add(rc[i]);
+  }
+
+  ASSERT_EQ(0, test_data.m_ioctx.aio_operate_batch(num, oids, rc, props,
+						    prbls));
+  size_t n = 0;
+  {
+    TestAlarm alarm;
+    while (set->wait_for_any())
+      ++n;
+  }
+  ASSERT_EQ(num, n);
+  ASSERT_TRUE(set->wait_for_any() == NULL);
+  for (size_t i = 0; i < num; ++i) {
+    ASSERT_EQ(oids[i], std::string(rbls[i].c_str(), rbls[i].length()));
+    wc[i]->release();
+    rc[i]->release();
+  }
+  set->release();
+}
+
+TEST(LibRadosAio, CompletionQueue) {
+  AioTestData test_data;
+  ASSERT_EQ("", test_data.init());
+  const size_t num = 32;
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  ASSERT_EQ(0, rados_write(test_data.m_ioctx, "foo", buf, sizeof(buf), 0));
+
+  rados_completion_set_t set;
+  ASSERT_EQ(0, rados_aio_create_completion_set(&set));
+  int fd = rados_aio_completion_set_get_fd(set);
+  ASSERT_LE(0, fd);
+  rados_completion_t cs[num];
+  ASSERT_EQ(0u, rados_aio_completion_set_poll(set, cs, num));
+
+  char bufs[num][128];
+  for (size_t i = 0; i < num; ++i) {
+    rados_completion_t c;
+    ASSERT_EQ(0, rados_aio_create_completion(NULL, NULL, NULL, &c));
+    rados_aio_completion_set_add(set, c);
+    ASSERT_EQ(0, rados_aio_read(test_data.m_ioctx, "foo", c,
+				bufs[i], sizeof(bufs[i]), 0));
+  }
+
+  // harvest in batches as the fd says they are ready
+  size_t got = 0;
+  {
+    TestAlarm alarm;
+    while (got < num) {
+      struct pollfd pfd;
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+      ASSERT_EQ(1, poll(&pfd, 1, -1));
+      size_t n = rados_aio_completion_set_poll(set, cs, num);
+      ASSERT_LT(0u, n);
+      for (size_t i = 0; i < n; ++i) {
+	ASSERT_EQ((int)sizeof(buf), rados_aio_get_return_value(cs[i]));
+	rados_aio_release(cs[i]);
+      }
+      got += n;
+    }
+  }
+  ASSERT_EQ(num, got);
+  ASSERT_EQ(0u, rados_aio_completion_set_size(set));
+  for (size_t i = 0; i < num; ++i)
+    ASSERT_EQ(0, memcmp(buf, bufs[i], sizeof(buf)));
+
+  // nothing left, so the fd is no longer readable
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  ASSERT_EQ(0, poll(&pfd, 1, 0));
+  rados_aio_completion_set_release(set);
+}
@@ -6,6 +6,7 @@
 #include "gtest/gtest.h"
 #include <errno.h>
 #include <string>
+#include <vector>
 
 using namespace librados;
 
@@ -191,3 +192,124 @@ TEST(LibRadosList, ListObjectsPPNS) {
   ioctx.close();
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, cluster));
 }
+
+TEST(LibRadosList, ListObjectsParts) {
+  char buf[128];
+  rados_t cluster;
+  rados_ioctx_t ioctx;
+  std::string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool(pool_name, &cluster));
+  rados_ioctx_create(cluster, pool_name.c_str(), &ioctx);
+  memset(buf, 0xcc, sizeof(buf));
+  std::vector<std::string> all;
+  for (int i = 0; i < 50; ++i) {
+    char name[20];
+    snprintf(name, sizeof(name), "obj%d", i);
+    ASSERT_EQ((int)sizeof(buf), rados_write(ioctx, name, buf, sizeof(buf), 0));
+  }
+  rados_list_ctx_t ctx;
+  const char *entry;
+  ASSERT_EQ(0, rados_objects_list_open(ioctx, &ctx));
+  while (rados_objects_list_next(ctx, &entry, NULL) != -ENOENT)
+    all.push_back(entry);
+  rados_objects_list_close(ctx);
+  ASSERT_EQ(50u, all.size());
+
+  ASSERT_EQ(-EINVAL, rados_objects_list_open_part(ioctx, 3, 3, &ctx));
+
+  // the parts, in turn, are the whole listing in the same order
+  std::vector<std::string> parts;
+  for (unsigned p = 0; p < 3; ++p) {
+    ASSERT_EQ(0, rados_objects_list_open_part(ioctx, p, 3, &ctx));
+    while (rados_objects_list_next(ctx, &entry, NULL) != -ENOENT)
+      parts.push_back(entry);
+    rados_objects_list_close(ctx);
+  }
+  ASSERT_EQ(all, parts);
+
+  rados_ioctx_destroy(ioctx);
+  ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
+}
+
+TEST(LibRadosList, ListObjectsCursor) {
+  char buf[128];
+  rados_t cluster;
+  rados_ioctx_t ioctx;
+  std::string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool(pool_name, &cluster));
+  rados_ioctx_create(cluster, pool_name.c_str(), &ioctx);
+  memset(buf, 0xcc, sizeof(buf));
+  for (int i = 0; i < 20; ++i) {
+    char name[20];
+    snprintf(name, sizeof(name), "obj%d", i);
+    ASSERT_EQ((int)sizeof(buf), rados_write(ioctx, name, buf, sizeof(buf), 0));
+  }
+  rados_list_ctx_t ctx;
+  const char *entry;
+  std::vector<std::string> all;
+  ASSERT_EQ(0, rados_objects_list_open(ioctx, &ctx));
+  while (rados_objects_list_next(ctx, &entry, NULL) != -ENOENT)
+    all.push_back(entry);
+  rados_objects_list_close(ctx);
+
+  // take a cursor halfway, and pick up from it on a new handle
+  std::vector<std::string> got;
+  ASSERT_EQ(0, rados_objects_list_open(ioctx, &ctx));
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_EQ(0, rados_objects_list_next(ctx, &entry, NULL));
+    got.push_back(entry);
+  }
+  size_t len = 0;
+  ASSERT_EQ(-ERANGE, rados_objects_list_get_cursor(ctx, NULL, &len));
+  std::vector<char> cursor(len);
+  ASSERT_EQ(0, rados_objects_list_get_cursor(ctx, &cursor[0], &len));
+  rados_objects_list_close(ctx);
+
+  ASSERT_EQ(-EINVAL, rados_objects_list_open_cursor(ioctx, "junk", 4, &ctx));
+  ASSERT_EQ(0, rados_objects_list_open_cursor(ioctx, &cursor[0], len, &ctx));
+  while (rados_objects_list_next(ctx, &entry, NULL) != -ENOENT)
+    got.push_back(entry);
+  rados_objects_list_close(ctx);
+  ASSERT_EQ(all, got);
+
+  rados_ioctx_destroy(ioctx);
+  ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
+}
+
+TEST(LibRadosList, ListObjectsCursorPP) {
+  std::string pool_name = get_temp_pool_name();
+  Rados cluster;
+  ASSERT_EQ("", create_one_pool_pp(pool_name, cluster));
+  IoCtx ioctx;
+  cluster.ioctx_create(pool_name.c_str(), ioctx);
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl1;
+  bl1.append(buf, sizeof(buf));
+  for (int i = 0; i < 20; ++i) {
+    char name[20];
+    snprintf(name, sizeof(name), "obj%d", i);
+    ASSERT_EQ((int)sizeof(buf), ioctx.write(name, bl1, sizeof(buf), 0));
+  }
+  std::set<std::string> all, got;
+  for (ObjectIterator i = ioctx.objects_begin(); i != ioctx.objects_end(); ++i)
+    all.insert(i->first);
+
+  for (unsigned p = 0; p < 4; ++p) {
+    ObjectIterator iter(ioctx.objects_begin(p, 4));
+    if (iter == ioctx.objects_end())
+      continue;
+    got.insert(iter->first);
+    bufferlist cursor;
+    iter.get_cursor(&cursor);
+    for (ObjectIterator i = ioctx.objects_begin(cursor);
+	 i != ioctx.objects_end(); ++i) {
+      ASSERT_TRUE(got.count(i->first) == 0);
+      got.insert(i->first);
+    }
+  }
+  ASSERT_EQ(all, got);
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, cluster));
+}
@@ -371,6 +371,56 @@ TEST(LibRadosMisc, Operate2PP) {
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, cluster));
 }
 
+TEST(LibRadosMisc, ZeroPP) {
+  Rados cluster;
+  std::string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool_pp(pool_name, cluster));
+  IoCtx ioctx;
+  cluster.ioctx_create(pool_name.c_str(), ioctx);
+
+  bufferlist bl;
+  bl.append(std::string(8192, 'a'));
+  ASSERT_EQ(0, ioctx.write_full("foo", bl));
+
+  // within the object, and through its end, which it doesn't extend
+  {
+    ObjectWriteOperation o;
+    o.zero(1000, 2000);
+    ASSERT_EQ(0, ioctx.operate("foo", &o));
+  }
+  {
+    ObjectWriteOperation o;
+    o.zero(6000, 100000);
+    ASSERT_EQ(0, ioctx.operate("foo", &o));
+  }
+  {
+    ObjectWriteOperation o;
+    o.zero(100000, 1000);
+    ASSERT_EQ(0, ioctx.operate("foo", &o));
+  }
+  uint64_t size;
+  time_t mtime;
+  ASSERT_EQ(0, ioctx.stat("foo", &size, &mtime));
+  ASSERT_EQ(8192u, size);
+
+  bufferlist got;
+  ASSERT_EQ(8192, ioctx.read("foo", got, 100000, 0));
+  std::string expected = std::string(1000, 'a') + std::string(2000, '\0') +
+    std::string(3000, 'a') + std::string(2192, '\0');
+  ASSERT_EQ(expected, std::string(got.c_str(), got.length()));
+
+  // zeroing a missing object doesn't create it
+  {
+    ObjectWriteOperation o;
+    o.zero(0, 1000);
+    ASSERT_EQ(0, ioctx.operate("bar", &o));
+  }
+  ASSERT_EQ(-ENOENT, ioctx.stat("bar", &size, &mtime));
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, cluster));
+}
+
 TEST(LibRadosMisc, BigObjectPP) {
   Rados cluster;
   std::string pool_name = get_temp_pool_name();
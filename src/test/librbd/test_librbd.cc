@@ -24,6 +24,7 @@
 
 #include "gtest/gtest.h"
 
+#include <dirent.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -752,6 +753,107 @@ TEST(LibRBD, TestIO)
   ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
 }
 
+TEST(LibRBD, TestIOV)
+{
+  rados_t cluster;
+  rados_ioctx_t ioctx;
+  string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool(pool_name, &cluster));
+  rados_ioctx_create(cluster, pool_name.c_str(), &ioctx);
+
+  rbd_image_t image;
+  int order = 16;
+  const char *name = "testimg";
+  uint64_t size = 1 << 20;
+
+  ASSERT_EQ(0, create_image(ioctx, name, size, &order));
+  ASSERT_EQ(0, rbd_open(ioctx, name, &image, NULL));
+
+  // spans several objects, in pieces that do not line up with them
+  const size_t len = 200000;
+  const uint64_t off = 1000;
+  char *data = new char[len];
+  for (size_t i = 0; i < len; ++i)
+    data[i] = (char) (rand() % (126 - 33) + 33);
+
+  struct iovec wv[3];
+  wv[0].iov_base = data;
+  wv[0].iov_len = 100;
+  wv[1].iov_base = data + 100;
+  wv[1].iov_len = 70000;
+  wv[2].iov_base = data + 70100;
+  wv[2].iov_len = len - 70100;
+
+  rbd_completion_t comp;
+  rbd_aio_create_completion(NULL, NULL, &comp);
+  ASSERT_EQ(0, rbd_aio_writev(image, wv, 3, off, comp));
+  ASSERT_EQ(0, rbd_aio_wait_for_complete(comp));
+  ASSERT_EQ((ssize_t)len, rbd_aio_get_return_value(comp));
+  rbd_aio_release(comp);
+
+  // read back, into pieces laid out differently, one of them empty
+  char *out = new char[len];
+  memset(out, 0, len);
+  struct iovec rv[4];
+  rv[0].iov_base = out;
+  rv[0].iov_len = 65536 - off;
+  rv[1].iov_base = out + rv[0].iov_len;
+  rv[1].iov_len = 0;
+  rv[2].iov_base = out + rv[0].iov_len;
+  rv[2].iov_len = 100000;
+  rv[3].iov_base = out + rv[0].iov_len + 100000;
+  rv[3].iov_len = len - rv[0].iov_len - 100000;
+  rbd_aio_create_completion(NULL, NULL, &comp);
+  ASSERT_EQ(0, rbd_aio_readv(image, rv, 4, off, comp));
+  ASSERT_EQ(0, rbd_aio_wait_for_complete(comp));
+  ASSERT_EQ((ssize_t)len, rbd_aio_get_return_value(comp));
+  rbd_aio_release(comp);
+  ASSERT_EQ(0, memcmp(data, out, len));
+
+  // and into one buffer
+  memset(out, 0, len);
+  rbd_aio_create_completion(NULL, NULL, &comp);
+  ASSERT_EQ(0, rbd_aio_read(image, off, len, out, comp));
+  ASSERT_EQ(0, rbd_aio_wait_for_complete(comp));
+  ASSERT_EQ((ssize_t)len, rbd_aio_get_return_value(comp));
+  rbd_aio_release(comp);
+  ASSERT_EQ(0, memcmp(data, out, len));
+
+  // holes and objects that were never written read as zeros, and
+  // reads through the end stop there
+  char zeros[1000];
+  memset(zeros, 0, sizeof(zeros));
+  memset(out, 1, len);
+  rv[0].iov_base = out;
+  rv[0].iov_len = 1000;
+  rv[1].iov_base = out + 1000;
+  rv[1].iov_len = 1000;
+  rbd_aio_create_completion(NULL, NULL, &comp);
+  ASSERT_EQ(0, rbd_aio_readv(image, rv, 2, 0, comp));
+  ASSERT_EQ(0, rbd_aio_wait_for_complete(comp));
+  ASSERT_EQ(2000, rbd_aio_get_return_value(comp));
+  rbd_aio_release(comp);
+  ASSERT_EQ(0, memcmp(zeros, out, 1000));
+  ASSERT_EQ(0, memcmp(data, out + 1000, 1000));
+
+  memset(out, 1, len);
+  rbd_aio_create_completion(NULL, NULL, &comp);
+  ASSERT_EQ(0, rbd_aio_readv(image, rv, 2, size - 1500, comp));
+  ASSERT_EQ(0, rbd_aio_wait_for_complete(comp));
+  ASSERT_EQ(1500, rbd_aio_get_return_value(comp));
+  rbd_aio_release(comp);
+  ASSERT_EQ(0, memcmp(zeros, out, 1000));
+  ASSERT_EQ(0, memcmp(zeros, out + 1000, 500));
+  ASSERT_EQ(1, out[1500]);
+
+  delete[] data;
+  delete[] out;
+  ASSERT_EQ(0, rbd_close(image));
+
+  rados_ioctx_destroy(ioctx);
+  ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
+}
+
 TEST(LibRBD, TestEmptyDiscard)
 {
   rados_t cluster;
@@ -1705,6 +1807,82 @@ TEST(LibRBD, DiffIterateDiscard)
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
 }
 
+struct read_extent {
+  read_extent(uint64_t offset, size_t length, bool hole) :
+    offset(offset), length(length), hole(hole) {}
+  uint64_t offset;
+  size_t length;
+  bool hole;
+};
+
+int read_iterate_cb(uint64_t off, size_t len, const char *buf, void *arg)
+{
+  vector<read_extent> *extents = static_cast<vector<read_extent> *>(arg);
+  extents->push_back(read_extent(off, len, buf == NULL));
+  if (buf)
+    for (size_t i = 0; i < len; ++i)
+      if (buf[i] != (char)(off / len + 1))
+	return -EIO;
+  return 0;
+}
+
+TEST(LibRBD, ReadIterateAndCopySparse)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  {
+    librbd::RBD rbd;
+    librbd::Image image;
+    int order = 16;
+    const char *name = "testimg";
+    uint64_t obj = 1 << order;
+    uint64_t size = 40 * obj;
+
+    ASSERT_EQ(0, create_image_pp(rbd, ioctx, name, size, &order));
+    ASSERT_EQ(0, rbd.open(ioctx, image, name, NULL));
+
+    // more objects than are read at once, every fifth one written
+    for (uint64_t i = 0; i < 40; i += 5) {
+      bufferlist bl;
+      bl.append(std::string(obj, (char)(i + 1)));
+      ASSERT_EQ((ssize_t)obj, image.write(i * obj, obj, bl));
+    }
+
+    vector<read_extent> extents;
+    ASSERT_EQ(0, image.read_iterate2(0, size, read_iterate_cb,
+				     (void *)&extents));
+    ASSERT_EQ(40u, extents.size());
+    for (uint64_t i = 0; i < 40; ++i) {
+      ASSERT_EQ(i * obj, extents[i].offset);
+      ASSERT_EQ(obj, extents[i].length);
+      ASSERT_EQ(i % 5 != 0, extents[i].hole);
+    }
+
+    // the copy has only the objects with data
+    ASSERT_EQ(0, image.copy(ioctx, "copy"));
+    librbd::Image copy;
+    ASSERT_EQ(0, rbd.open(ioctx, copy, "copy", NULL));
+    vector<diff_extent> diff;
+    ASSERT_EQ(0, copy.diff_iterate(NULL, 0, size, vector_iterate_cb,
+				   (void *)&diff));
+    ASSERT_EQ(8u, diff.size());
+    for (uint64_t i = 0; i < 8; ++i)
+      ASSERT_EQ(diff_extent(i * 5 * obj, obj, true), diff[i]);
+
+    extents.clear();
+    ASSERT_EQ(0, copy.read_iterate2(0, size, read_iterate_cb,
+				    (void *)&extents));
+    ASSERT_EQ(40u, extents.size());
+  }
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
 TEST(LibRBD, DiffIterateStress)
 {
   librados::Rados rados;
@@ -1775,6 +1953,422 @@ TEST(LibRBD, DiffIterateStress)
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
 }
 
+TEST(LibRBD, ObjectMapPP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  {
+    librbd::RBD rbd;
+    const char *name = "testimg";
+    int order = 16;
+    uint64_t obj = 1 << order;
+    uint64_t size = 16 * obj;
+
+    ASSERT_EQ(0, rbd.create2(ioctx, name, size,
+			     RBD_FEATURE_LAYERING | RBD_FEATURE_OBJECT_MAP,
+			     &order));
+
+    bufferlist bl;
+    bl.append(string(4096, '1'));
+    {
+      librbd::Image image;
+      ASSERT_EQ(0, rbd.open(ioctx, image, name, NULL));
+      uint64_t features;
+      ASSERT_EQ(0, image.features(&features));
+      ASSERT_TRUE(features & RBD_FEATURE_OBJECT_MAP);
+
+      // only the first writer may change the image
+      {
+	librbd::Image other;
+	ASSERT_EQ(0, rbd.open(ioctx, other, name, NULL));
+	ASSERT_EQ(-EROFS, other.write(0, bl.length(), bl));
+	ASSERT_EQ(-EROFS, other.resize(obj));
+      }
+
+      ASSERT_EQ((ssize_t)bl.length(), image.write(3 * obj + 10, bl.length(), bl));
+      ASSERT_EQ((ssize_t)bl.length(), image.write(9 * obj, bl.length(), bl));
+      ASSERT_EQ(0, image.snap_create("one"));
+
+      bufferlist read_bl;
+      ASSERT_EQ((ssize_t)obj, image.read(2 * obj, obj, read_bl));
+      ASSERT_TRUE(read_bl.is_zero());
+      read_bl.clear();
+      ASSERT_EQ((ssize_t)bl.length(),
+		image.read(3 * obj + 10, bl.length(), read_bl));
+      ASSERT_TRUE(bl.contents_equal(read_bl));
+
+      ASSERT_EQ((int)obj, image.discard(5 * obj, obj));
+      ASSERT_EQ((ssize_t)bl.length(), image.write(12 * obj, bl.length(), bl));
+
+      // only the object written since the snapshot differs
+      vector<diff_extent> diff;
+      ASSERT_EQ(0, image.diff_iterate("one", 0, size, vector_iterate_cb,
+				      (void *)&diff));
+      ASSERT_EQ(1u, diff.size());
+      ASSERT_EQ(diff_extent(12 * obj, bl.length(), true), diff[0]);
+
+      ASSERT_EQ(0, image.resize(4 * obj));
+      ASSERT_EQ(0, image.resize(size));
+      read_bl.clear();
+      ASSERT_EQ((ssize_t)bl.length(), image.read(9 * obj, bl.length(), read_bl));
+      ASSERT_TRUE(read_bl.is_zero());
+
+      ASSERT_EQ(0, image.snap_set("one"));
+      read_bl.clear();
+      ASSERT_EQ((ssize_t)bl.length(), image.read(9 * obj, bl.length(), read_bl));
+      ASSERT_TRUE(bl.contents_equal(read_bl));
+      ASSERT_EQ(0, image.snap_set(NULL));
+
+      ASSERT_EQ(0, image.snap_remove("one"));
+    }
+    ASSERT_EQ(0, rbd.remove(ioctx, name));
+  }
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+TEST(LibRBD, FastDiffPP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  {
+    librbd::RBD rbd;
+    const char *name = "testimg";
+    int order = 16;
+    uint64_t obj = 1 << order;
+    uint64_t size = 16 * obj;
+
+    ASSERT_EQ(-EINVAL, rbd.create2(ioctx, name, size,
+				   RBD_FEATURE_LAYERING | RBD_FEATURE_FAST_DIFF,
+				   &order));
+    ASSERT_EQ(0, rbd.create2(ioctx, name, size,
+			     RBD_FEATURE_LAYERING | RBD_FEATURE_OBJECT_MAP |
+			     RBD_FEATURE_FAST_DIFF, &order));
+
+    bufferlist bl;
+    bl.append(string(4096, '1'));
+    librbd::Image image;
+    ASSERT_EQ(0, rbd.open(ioctx, image, name, NULL));
+    ASSERT_EQ((ssize_t)bl.length(), image.write(1 * obj, bl.length(), bl));
+    ASSERT_EQ((ssize_t)bl.length(), image.write(5 * obj, bl.length(), bl));
+    ASSERT_EQ(0, image.snap_create("one"));
+    ASSERT_EQ((ssize_t)bl.length(), image.write(9 * obj, bl.length(), bl));
+    ASSERT_EQ(0, image.snap_create("two"));
+    ASSERT_EQ((ssize_t)bl.length(), image.write(12 * obj, bl.length(), bl));
+
+    vector<diff_extent> diff;
+    ASSERT_EQ(0, image.diff_iterate2(NULL, 0, size, true, vector_iterate_cb,
+				     (void *)&diff));
+    ASSERT_EQ(4u, diff.size());
+    ASSERT_EQ(diff_extent(1 * obj, obj, true), diff[0]);
+    ASSERT_EQ(diff_extent(12 * obj, obj, true), diff[3]);
+
+    // whole objects changed since each snapshot
+    diff.clear();
+    ASSERT_EQ(0, image.diff_iterate2("one", 0, size, true, vector_iterate_cb,
+				     (void *)&diff));
+    ASSERT_EQ(2u, diff.size());
+    ASSERT_EQ(diff_extent(9 * obj, obj, true), diff[0]);
+    ASSERT_EQ(diff_extent(12 * obj, obj, true), diff[1]);
+
+    // exact extents, from the objects that changed
+    diff.clear();
+    ASSERT_EQ(0, image.diff_iterate2("two", 0, size, false, vector_iterate_cb,
+				     (void *)&diff));
+    ASSERT_EQ(1u, diff.size());
+    ASSERT_EQ(diff_extent(12 * obj, bl.length(), true), diff[0]);
+
+    // between snapshots
+    ASSERT_EQ(0, image.snap_set("two"));
+    diff.clear();
+    ASSERT_EQ(0, image.diff_iterate2("one", 0, size, true, vector_iterate_cb,
+				     (void *)&diff));
+    ASSERT_EQ(1u, diff.size());
+    ASSERT_EQ(diff_extent(9 * obj, obj, true), diff[0]);
+    ASSERT_EQ(0, image.snap_set(NULL));
+
+    // removing a snapshot keeps what changed before it
+    ASSERT_EQ(0, image.snap_remove("two"));
+    ASSERT_EQ(0, image.discard(1 * obj, obj));
+    diff.clear();
+    ASSERT_EQ(0, image.diff_iterate2("one", 0, size, true, vector_iterate_cb,
+				     (void *)&diff));
+    ASSERT_EQ(3u, diff.size());
+    ASSERT_EQ(diff_extent(1 * obj, obj, true), diff[0]);
+    ASSERT_EQ(diff_extent(9 * obj, obj, true), diff[1]);
+    ASSERT_EQ(diff_extent(12 * obj, obj, true), diff[2]);
+
+    ASSERT_EQ(0, image.snap_remove("one"));
+  }
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+TEST(LibRBD, ExclusiveLockPP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  {
+    librbd::RBD rbd;
+    int order = 16;
+    uint64_t obj = 1 << order;
+    uint64_t size = 16 * obj;
+    uint64_t features = RBD_FEATURE_LAYERING | RBD_FEATURE_OBJECT_MAP |
+      RBD_FEATURE_EXCLUSIVE_LOCK;
+    ASSERT_EQ(0, rbd.create2(ioctx, "parent", size, features, &order));
+
+    bufferlist bl1, bl2;
+    bl1.append(string(4096, '1'));
+    bl2.append(string(4096, '2'));
+    bufferlist read_bl;
+    std::list<librbd::locker_t> lockers;
+    bool exclusive;
+    string tag;
+    {
+      librbd::Image image, other;
+      ASSERT_EQ(0, rbd.open(ioctx, image, "parent", NULL));
+      ASSERT_EQ(0, rbd.open(ioctx, other, "parent", NULL));
+
+      // the lock moves to whoever writes
+      ASSERT_EQ((ssize_t)bl1.length(), image.write(3 * obj, bl1.length(), bl1));
+      ASSERT_EQ((ssize_t)bl2.length(), other.write(5 * obj, bl2.length(), bl2));
+      ASSERT_EQ(0, other.list_lockers(&lockers, &exclusive, &tag));
+      ASSERT_EQ(1u, lockers.size());
+      ASSERT_TRUE(exclusive);
+      ASSERT_EQ(0, other.resize(size + obj));
+      ASSERT_EQ((ssize_t)bl2.length(), image.write(3 * obj, bl2.length(), bl2));
+
+      // each sees the other's writes, and the object map stays right
+      ASSERT_EQ((ssize_t)bl2.length(), image.read(5 * obj, bl2.length(), read_bl));
+      ASSERT_TRUE(bl2.contents_equal(read_bl));
+      read_bl.clear();
+      ASSERT_EQ((ssize_t)bl2.length(), other.read(3 * obj, bl2.length(), read_bl));
+      ASSERT_TRUE(bl2.contents_equal(read_bl));
+      read_bl.clear();
+      librbd::image_info_t info;
+      ASSERT_EQ(0, image.stat(info, sizeof(info)));
+      ASSERT_EQ(size + obj, info.size);
+
+      ASSERT_EQ(0, image.snap_create("snap"));
+      ASSERT_EQ(0, image.snap_protect("snap"));
+    }
+    {
+      librbd::Image image;
+      ASSERT_EQ(0, rbd.open(ioctx, image, "parent", NULL));
+      ASSERT_EQ(0, image.list_lockers(&lockers, &exclusive, &tag));
+      ASSERT_EQ(1u, lockers.size());
+    }
+
+    // writes to a clone's objects that we have written to need no
+    // guard, and must still keep the parent's data
+    ASSERT_EQ(0, rbd.clone(ioctx, "parent", "snap", ioctx, "child",
+			   features, &order));
+    {
+      librbd::Image child;
+      ASSERT_EQ(0, rbd.open(ioctx, child, "child", NULL));
+      ASSERT_EQ((ssize_t)bl1.length(),
+		child.write(3 * obj + 8192, bl1.length(), bl1));
+      ASSERT_EQ((ssize_t)bl1.length(),
+		child.write(3 * obj + 16384, bl1.length(), bl1));
+      ASSERT_EQ((ssize_t)bl2.length(), child.read(3 * obj, bl2.length(), read_bl));
+      ASSERT_TRUE(bl2.contents_equal(read_bl));
+      read_bl.clear();
+      ASSERT_EQ((ssize_t)bl1.length(),
+		child.read(3 * obj + 16384, bl1.length(), read_bl));
+      ASSERT_TRUE(bl1.contents_equal(read_bl));
+    }
+  }
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+TEST(LibRBD, CopyupPP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  {
+    librbd::RBD rbd;
+    int order = 16;
+    uint64_t obj = 1 << order;
+    uint64_t size = 4 * obj;
+    ASSERT_EQ(0, rbd.create2(ioctx, "parent", size, RBD_FEATURE_LAYERING,
+			     &order));
+
+    bufferlist parent_bl, bl;
+    parent_bl.append(string(4096, 'p'));
+    bl.append(string(4096, 'c'));
+    {
+      librbd::Image parent;
+      ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", NULL));
+      ASSERT_EQ((ssize_t)parent_bl.length(),
+		parent.write(0, parent_bl.length(), parent_bl));
+      ASSERT_EQ((ssize_t)parent_bl.length(),
+		parent.write(obj / 2, parent_bl.length(), parent_bl));
+      ASSERT_EQ(0, parent.snap_create("snap"));
+      ASSERT_EQ(0, parent.snap_protect("snap"));
+    }
+    ASSERT_EQ(0, rbd.clone(ioctx, "parent", "snap", ioctx, "child",
+			   RBD_FEATURE_LAYERING, &order));
+
+    // what object 0 of the child should hold
+    bufferlist expected;
+    expected.append_zero(obj);
+    expected.copy_in(0, parent_bl.length(), parent_bl.c_str());
+    expected.copy_in(obj / 2, parent_bl.length(), parent_bl.c_str());
+
+    librbd::Image child;
+    ASSERT_EQ(0, rbd.open(ioctx, child, "child", NULL));
+
+    // concurrent first writes to an object share one copyup
+    const int num_writes = 4;
+    librbd::RBD::AioCompletion *comps[num_writes];
+    for (int i = 0; i < num_writes; ++i) {
+      uint64_t off = (2 + i) * 4096;
+      comps[i] = new librbd::RBD::AioCompletion(NULL, NULL);
+      ASSERT_EQ(0, child.aio_write(off, bl.length(), bl, comps[i]));
+      expected.copy_in(off, bl.length(), bl.c_str());
+    }
+    for (int i = 0; i < num_writes; ++i) {
+      comps[i]->wait_for_complete();
+      ASSERT_EQ(0, comps[i]->get_return_value());
+      comps[i]->release();
+    }
+
+    bufferlist read_bl;
+    ASSERT_EQ((ssize_t)obj, child.read(0, obj, read_bl));
+    ASSERT_TRUE(expected.contents_equal(read_bl));
+
+    ASSERT_EQ(0, child.flatten());
+    read_bl.clear();
+    ASSERT_EQ((ssize_t)obj, child.read(0, obj, read_bl));
+    ASSERT_TRUE(expected.contents_equal(read_bl));
+  }
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+TEST(LibRBD, PersistentCachePP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  char dir[] = "/tmp/test_librbd_wlog.XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  ASSERT_EQ(0, rados.conf_set("rbd_persistent_cache_path", dir));
+  ASSERT_EQ(0, rados.conf_set("rbd_persistent_cache_size", "33554432"));
+
+  {
+    librbd::RBD rbd;
+    int order = 16;
+    uint64_t obj = 1 << order;
+    uint64_t size = 16 * obj;
+    uint64_t features = RBD_FEATURE_LAYERING | RBD_FEATURE_EXCLUSIVE_LOCK;
+    ASSERT_EQ(0, rbd.create2(ioctx, "image", size, features, &order));
+
+    bufferlist bl1, bl2, bl3, zeros;
+    bl1.append(string(3 * obj, '1'));
+    bl2.append(string(4096, '2'));
+    bl3.append(string(4096, '3'));
+    zeros.append_zero(1000);
+    bufferlist read_bl;
+    {
+      librbd::Image image, other;
+      ASSERT_EQ(0, rbd.open(ioctx, image, "image", NULL));
+      // the log is taken, so this one writes to the cluster
+      ASSERT_EQ(0, rbd.open(ioctx, other, "image", NULL));
+
+      // reads see the log's newest data, partly or wholly
+      ASSERT_EQ((ssize_t)bl1.length(), image.write(0, bl1.length(), bl1));
+      ASSERT_EQ((ssize_t)bl2.length(), image.write(obj - 100, bl2.length(), bl2));
+      ASSERT_EQ(1000, image.discard(2 * obj, 1000));
+      ASSERT_EQ(4096, image.read(obj - 100, 4096, read_bl));
+      ASSERT_TRUE(bl2.contents_equal(read_bl));
+      read_bl.clear();
+      ASSERT_EQ(1000, image.read(2 * obj, 1000, read_bl));
+      ASSERT_TRUE(zeros.contents_equal(read_bl));
+      read_bl.clear();
+      ASSERT_EQ(100, image.read(obj - 200, 100, read_bl));
+      ASSERT_EQ(string(100, '1'), string(read_bl.c_str(), 100));
+      read_bl.clear();
+      ASSERT_EQ(0, image.flush());
+
+      // everything is written back before the lock moves
+      ASSERT_EQ((ssize_t)bl2.length(), other.write(8 * obj, bl2.length(), bl2));
+      ASSERT_EQ(4096, other.read(obj - 100, 4096, read_bl));
+      ASSERT_TRUE(bl2.contents_equal(read_bl));
+      read_bl.clear();
+      ASSERT_EQ(1000, other.read(2 * obj, 1000, read_bl));
+      ASSERT_TRUE(zeros.contents_equal(read_bl));
+      read_bl.clear();
+
+      // and before a snapshot is taken
+      ASSERT_EQ((ssize_t)bl2.length(), image.write(4 * obj, bl2.length(), bl2));
+      ASSERT_EQ(0, image.snap_create("snap"));
+      ASSERT_EQ((ssize_t)bl3.length(), image.write(4 * obj, bl3.length(), bl3));
+      ASSERT_EQ(0, image.snap_set("snap"));
+      ASSERT_EQ(4096, image.read(4 * obj, 4096, read_bl));
+      ASSERT_TRUE(bl2.contents_equal(read_bl));
+      read_bl.clear();
+      ASSERT_EQ(0, image.snap_set(NULL));
+      ASSERT_EQ(4096, image.read(4 * obj, 4096, read_bl));
+      ASSERT_TRUE(bl3.contents_equal(read_bl));
+      read_bl.clear();
+    }
+    {
+      // closing wrote everything back
+      ASSERT_EQ(0, rados.conf_set("rbd_persistent_cache_path", ""));
+      librbd::Image image;
+      ASSERT_EQ(0, rbd.open(ioctx, image, "image", NULL));
+      ASSERT_EQ(4096, image.read(4 * obj, 4096, read_bl));
+      ASSERT_TRUE(bl3.contents_equal(read_bl));
+      read_bl.clear();
+      ASSERT_EQ(4096, image.read(8 * obj, 4096, read_bl));
+      ASSERT_TRUE(bl2.contents_equal(read_bl));
+    }
+  }
+
+  DIR *d = opendir(dir);
+  ASSERT_TRUE(d != NULL);
+  struct dirent *de;
+  while ((de = readdir(d)) != NULL) {
+    if (de->d_name[0] != '.')
+      ASSERT_EQ(0, unlinkat(dirfd(d), de->d_name, 0));
+  }
+  closedir(d);
+  ASSERT_EQ(0, rmdir(dir));
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
 int main(int argc, char **argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
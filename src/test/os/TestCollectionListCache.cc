@@ -0,0 +1,135 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <algorithm>
+#include "os/CollectionListCache.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include <gtest/gtest.h>
+
+static ghobject_t make_obj(unsigned hash, snapid_t snap = CEPH_NOSNAP)
+{
+  char name[20];
+  snprintf(name, sizeof(name), "obj_%u", hash);
+  return ghobject_t(hobject_t(object_t(name), "", snap, hash, 0, ""));
+}
+
+static vector<ghobject_t> make_sorted(unsigned n)
+{
+  vector<ghobject_t> ls;
+  for (unsigned i = 0; i < n; ++i)
+    ls.push_back(make_obj(i * 0x01010101));
+  sort(ls.begin(), ls.end());
+  return ls;
+}
+
+TEST(CollectionListCache, ListInPages) {
+  CollectionListCache cache(100);
+  coll_t c("A");
+  vector<ghobject_t> ls, all = make_sorted(20);
+  ghobject_t next;
+  ASSERT_FALSE(cache.list_partial(c, ghobject_t(), 0, 0, &ls, &next));
+
+  cache.fill(c, all);
+  vector<ghobject_t> got;
+  next = ghobject_t();
+  while (!next.is_max()) {
+    ls.clear();
+    ASSERT_TRUE(cache.list_partial(c, next, 7, 0, &ls, &next));
+    ASSERT_TRUE(ls.size() <= 7u);
+    got.insert(got.end(), ls.begin(), ls.end());
+  }
+  ASSERT_EQ(all, got);
+}
+
+TEST(CollectionListCache, SkipOldSnaps) {
+  CollectionListCache cache(100);
+  coll_t c("A");
+  vector<ghobject_t> all;
+  all.push_back(make_obj(1, 2));
+  all.push_back(make_obj(2, 5));
+  all.push_back(make_obj(3));
+  sort(all.begin(), all.end());
+  cache.fill(c, all);
+
+  vector<ghobject_t> ls;
+  ASSERT_TRUE(cache.list_partial(c, ghobject_t(), 0, 4, &ls, NULL));
+  ASSERT_EQ(2u, ls.size());
+  for (vector<ghobject_t>::iterator i = ls.begin(); i != ls.end(); ++i)
+    ASSERT_TRUE(i->hobj.snap >= 4);
+}
+
+TEST(CollectionListCache, AddRemoveClear) {
+  CollectionListCache cache(100);
+  coll_t c("A");
+  cache.fill(c, make_sorted(5));
+
+  ghobject_t extra = make_obj(0x12345678);
+  cache.add(c, extra);
+  cache.remove(c, make_obj(0));
+
+  vector<ghobject_t> ls;
+  ASSERT_TRUE(cache.list_partial(c, ghobject_t(), 0, 0, &ls, NULL));
+  ASSERT_EQ(5u, ls.size());
+  ASSERT_TRUE(find(ls.begin(), ls.end(), extra) != ls.end());
+  ASSERT_TRUE(find(ls.begin(), ls.end(), make_obj(0)) == ls.end());
+  for (unsigned i = 1; i < ls.size(); ++i)
+    ASSERT_TRUE(ls[i - 1] < ls[i]);
+
+  // objects in collections that are not cached are ignored
+  cache.add(coll_t("B"), extra);
+  ls.clear();
+  ASSERT_FALSE(cache.list_partial(coll_t("B"), ghobject_t(), 0, 0, &ls, NULL));
+
+  cache.clear(c);
+  ASSERT_FALSE(cache.list_partial(c, ghobject_t(), 0, 0, &ls, NULL));
+}
+
+TEST(CollectionListCache, Evict) {
+  CollectionListCache cache(25);
+  coll_t a("A"), b("B"), c("C");
+  vector<ghobject_t> ls;
+
+  cache.fill(a, make_sorted(10));
+  cache.fill(b, make_sorted(10));
+  // a is now the most recently listed
+  ASSERT_TRUE(cache.list_partial(a, ghobject_t(), 0, 0, &ls, NULL));
+  cache.fill(c, make_sorted(10));
+  ASSERT_TRUE(cache.list_partial(a, ghobject_t(), 0, 0, &ls, NULL));
+  ASSERT_FALSE(cache.list_partial(b, ghobject_t(), 0, 0, &ls, NULL));
+  ASSERT_TRUE(cache.list_partial(c, ghobject_t(), 0, 0, &ls, NULL));
+
+  // too large to cache at all
+  cache.fill(b, make_sorted(30));
+  ASSERT_FALSE(cache.list_partial(b, ghobject_t(), 0, 0, &ls, NULL));
+
+  cache.set_max(0);
+  ASSERT_FALSE(cache.list_partial(a, ghobject_t(), 0, 0, &ls, NULL));
+  ASSERT_FALSE(cache.list_partial(c, ghobject_t(), 0, 0, &ls, NULL));
+  cache.fill(a, make_sorted(1));
+  ASSERT_FALSE(cache.list_partial(a, ghobject_t(), 0, 0, &ls, NULL));
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make unittest_collection_list_cache ; ./unittest_collection_list_cache"
+// End:
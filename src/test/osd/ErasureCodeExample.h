@@ -81,6 +81,18 @@ public:
     return minimum_to_decode(want_to_read, available_chunks, minimum);
   }
 
+  virtual unsigned get_chunk_count() {
+    return DATA_CHUNKS + CODING_CHUNKS;
+  }
+
+  virtual unsigned get_data_chunk_count() {
+    return DATA_CHUNKS;
+  }
+
+  virtual unsigned get_chunk_size(unsigned object_size) {
+    return ( object_size / DATA_CHUNKS ) + 1;
+  }
+
   virtual int encode(const set<int> &want_to_encode,
                      const bufferlist &in,
                      map<int, bufferlist> *encoded) {
@@ -88,7 +100,7 @@ public:
     // make sure all data chunks have the same length, allocating
     // padding if necessary.
     //
-    unsigned chunk_length = ( in.length() / DATA_CHUNKS ) + 1;
+    unsigned chunk_length = get_chunk_size(in.length());
     unsigned length = chunk_length * ( DATA_CHUNKS + CODING_CHUNKS );
     bufferlist out(in);
     bufferptr pad(length - in.length());
@@ -0,0 +1,175 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <stdlib.h>
+#include "global/global_init.h"
+#include "osd/ECUtil.h"
+#include "osd/ErasureCodePluginJerasure/ErasureCodeJerasure.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "gtest/gtest.h"
+
+TEST(ECUtil, stripe_info)
+{
+  ECUtil::stripe_info_t sinfo(4, 4096);
+  EXPECT_EQ(1024u, sinfo.get_chunk_size());
+  EXPECT_EQ(4096u, sinfo.logical_to_prev_stripe_offset(5000));
+  EXPECT_EQ(8192u, sinfo.logical_to_next_stripe_offset(5000));
+  EXPECT_EQ(8192u, sinfo.logical_to_next_stripe_offset(8192));
+  EXPECT_EQ(2048u, sinfo.aligned_logical_offset_to_chunk_offset(8192));
+  EXPECT_EQ(8192u, sinfo.aligned_chunk_offset_to_logical_offset(2048));
+  EXPECT_EQ(make_pair((uint64_t)4096, (uint64_t)8192),
+	    sinfo.offset_len_to_stripe_bounds(5000, 4000));
+
+  set<int> chunks;
+  sinfo.get_data_chunks(5000, 10, &chunks);
+  EXPECT_EQ(1u, chunks.size());
+  EXPECT_EQ(1u, chunks.count(0));
+
+  chunks.clear();
+  sinfo.get_data_chunks(1000, 100, &chunks);
+  EXPECT_EQ(2u, chunks.size());
+  EXPECT_EQ(1u, chunks.count(0));
+  EXPECT_EQ(1u, chunks.count(1));
+
+  // the end of one stripe and the start of the next
+  chunks.clear();
+  sinfo.get_data_chunks(4000, 200, &chunks);
+  EXPECT_EQ(2u, chunks.size());
+  EXPECT_EQ(1u, chunks.count(0));
+  EXPECT_EQ(1u, chunks.count(3));
+
+  chunks.clear();
+  sinfo.get_data_chunks(100, 4096, &chunks);
+  EXPECT_EQ(4u, chunks.size());
+}
+
+class ECUtilRead : public ::testing::Test {
+public:
+  ECUtil::stripe_info_t sinfo;
+  ErasureCodeInterfaceRef ec;
+  bufferlist object;
+  map<int, bufferlist> shards;
+
+  ECUtilRead() : sinfo(4, 4096) {}
+
+  virtual void SetUp() {
+    ErasureCodeJerasureReedSolomonVandermonde *jerasure =
+      new ErasureCodeJerasureReedSolomonVandermonde();
+    map<std::string,std::string> parameters;
+    parameters["erasure-code-k"] = "4";
+    parameters["erasure-code-m"] = "2";
+    jerasure->init(parameters);
+    ec = ErasureCodeInterfaceRef(jerasure);
+
+    bufferptr bp(4 * 4096);
+    for (unsigned i = 0; i < bp.length(); i++)
+      bp[i] = rand();
+    object.append(bp);
+
+    set<int> want;
+    for (int i = 0; i < 6; i++)
+      want.insert(i);
+    EXPECT_EQ(0, ECUtil::encode(sinfo, ec, object, want, &shards));
+    EXPECT_EQ(6u, shards.size());
+    EXPECT_EQ(4u * 1024, shards[0].length());
+  }
+
+  // read [off, off+len) from the shards with the given costs
+  void read(uint64_t off, uint64_t len, const map<int, int> &available,
+	    unsigned expected_shards) {
+    set<int> want, to_read;
+    pair<uint64_t, uint64_t> extent;
+    EXPECT_EQ(0, ECUtil::plan_read(sinfo, ec, off, len, available,
+				   &want, &to_read, &extent));
+    EXPECT_EQ(expected_shards, to_read.size());
+
+    map<int, bufferlist> from;
+    for (set<int>::iterator i = to_read.begin(); i != to_read.end(); ++i) {
+      EXPECT_TRUE(available.count(*i));
+      from[*i].substr_of(shards[*i], extent.first, extent.second);
+    }
+    bufferlist out;
+    EXPECT_EQ(0, ECUtil::decode_range(sinfo, ec, off, len, want, extent,
+				      from, &out));
+    bufferlist expected;
+    expected.substr_of(object, off, len);
+    EXPECT_TRUE(expected.contents_equal(out));
+  }
+};
+
+TEST_F(ECUtilRead, partial)
+{
+  map<int, int> available;
+  for (int i = 0; i < 6; i++)
+    available[i] = 1;
+
+  // within one chunk, one shard is enough
+  read(5000, 10, available, 1);
+  // across a chunk boundary
+  read(1000, 100, available, 2);
+  // across a stripe boundary
+  read(4000, 200, available, 2);
+  // whole stripes
+  read(0, 8192, available, 4);
+}
+
+TEST_F(ECUtilRead, degraded)
+{
+  map<int, int> available;
+  for (int i = 1; i < 6; i++)
+    available[i] = 1;
+
+  // chunk 0 is gone, rebuild it from k others
+  read(5000, 10, available, 4);
+  read(1000, 100, available, 4);
+  read(4000, 200, available, 4);
+  // chunk 0 is not needed
+  read(5120, 10, available, 1);
+
+  // rebuild from the cheapest shards
+  available[1] = 10;
+  set<int> want, to_read;
+  pair<uint64_t, uint64_t> extent;
+  EXPECT_EQ(0, ECUtil::plan_read(sinfo, ec, 5000, 10, available,
+				 &want, &to_read, &extent));
+  EXPECT_EQ(4u, to_read.size());
+  EXPECT_EQ(0u, to_read.count(1));
+  read(5000, 10, available, 4);
+}
+
+TEST_F(ECUtilRead, random)
+{
+  map<int, int> available;
+  for (int i = 0; i < 6; i++)
+    if (i != 2)
+      available[i] = 1;
+  for (int i = 0; i < 100; i++) {
+    uint64_t off = rand() % object.length();
+    uint64_t len = 1 + rand() % (object.length() - off);
+    set<int> want;
+    sinfo.get_data_chunks(off, len, &want);
+    read(off, len, available, want.count(2) ? 4 : want.size());
+  }
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
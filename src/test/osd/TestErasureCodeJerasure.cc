@@ -281,6 +281,45 @@ TEST(ErasureCodeTest, encode)
     EXPECT_EQ(alignment, encoded[0].length());
     EXPECT_EQ(in.c_str(), encoded[0].c_str());
   }
+
+  {
+    //
+    // When each buffer of the input holds whole chunks, the data
+    // chunks point to them even though the input is not contiguous.
+    // A chunk spanning two buffers is the only one copied.
+    //
+    EXPECT_EQ(alignment, jerasure.get_chunk_size(alignment * 2));
+    EXPECT_EQ(alignment, jerasure.get_chunk_size(alignment + 1));
+    bufferptr first(alignment);
+    bufferptr second(alignment);
+    first.zero();
+    second.zero();
+    bufferlist in;
+    in.push_back(first);
+    in.push_back(second);
+    map<int,bufferlist> encoded;
+    int want_to_encode[] = { 0, 1, 2, 3 };
+    EXPECT_EQ(0, jerasure.encode(set<int>(want_to_encode, want_to_encode+4),
+				 in,
+				 &encoded));
+    EXPECT_EQ(first.c_str(), encoded[0].c_str());
+    EXPECT_EQ(second.c_str(), encoded[1].c_str());
+    EXPECT_EQ(2u, in.buffers().size());
+
+    bufferptr half(alignment / 2);
+    half.zero();
+    bufferlist split;
+    split.push_back(first);
+    split.push_back(half);
+    split.push_back(half);
+    encoded.clear();
+    EXPECT_EQ(0, jerasure.encode(set<int>(want_to_encode, want_to_encode+4),
+				 split,
+				 &encoded));
+    EXPECT_EQ(first.c_str(), encoded[0].c_str());
+    EXPECT_NE(half.c_str(), encoded[1].c_str());
+    EXPECT_EQ(3u, split.buffers().size());
+  }
 }
 
 int main(int argc, char **argv)
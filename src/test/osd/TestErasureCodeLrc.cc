@@ -0,0 +1,152 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include "global/global_init.h"
+#include "osd/ErasureCodePluginLrc/ErasureCodeLrc.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "gtest/gtest.h"
+
+class ErasureCodeLrcTest : public ::testing::Test {
+public:
+  ErasureCodeLrc lrc;
+  bufferlist in;
+  map<int, bufferlist> encoded;
+  set<int> all;
+
+  virtual void SetUp() {
+    map<std::string,std::string> parameters;
+    parameters["erasure-code-k"] = "4";
+    parameters["erasure-code-m"] = "2";
+    parameters["erasure-code-l"] = "3";
+    lrc.init(parameters);
+
+    bufferptr bp(4096);
+    for (unsigned i = 0; i < bp.length(); i++)
+      bp[i] = rand();
+    in.append(bp);
+
+    for (int i = 0; i < (int)lrc.get_chunk_count(); i++)
+      all.insert(i);
+    EXPECT_EQ(0, lrc.encode(all, in, &encoded));
+    EXPECT_EQ(all.size(), encoded.size());
+  }
+
+  // decode want without the lost chunks and compare with the encoded ones
+  void check_decode(const set<int> &want, const set<int> &lost) {
+    map<int, bufferlist> chunks(encoded);
+    for (set<int>::const_iterator i = lost.begin(); i != lost.end(); ++i)
+      chunks.erase(*i);
+    map<int, bufferlist> decoded;
+    EXPECT_EQ(0, lrc.decode(want, chunks, &decoded));
+    for (set<int>::const_iterator i = want.begin(); i != want.end(); ++i)
+      EXPECT_TRUE(encoded[*i].contents_equal(decoded[*i]));
+  }
+};
+
+TEST_F(ErasureCodeLrcTest, layout)
+{
+  EXPECT_EQ(2, lrc.get_group_count());
+  EXPECT_EQ(8u, lrc.get_chunk_count());
+  EXPECT_EQ(0, lrc.get_group(2));
+  EXPECT_EQ(1, lrc.get_group(3));
+  EXPECT_EQ(1, lrc.get_group(5));
+  EXPECT_EQ(0, lrc.get_group(6));
+  EXPECT_EQ(1, lrc.get_group(7));
+
+  set<int> group;
+  lrc.get_group_chunks(1, &group);
+  EXPECT_EQ(4u, group.size());
+  EXPECT_EQ(1u, group.count(3));
+  EXPECT_EQ(1u, group.count(5));
+  EXPECT_EQ(1u, group.count(7));
+
+  // the data chunks hold the input
+  bufferlist data;
+  for (int i = 0; i < 4; i++)
+    data.append(encoded[i]);
+  bufferlist head;
+  head.substr_of(data, 0, in.length());
+  EXPECT_TRUE(in.contents_equal(head));
+}
+
+TEST_F(ErasureCodeLrcTest, local_repair)
+{
+  // a lost chunk is read from the rest of its group
+  for (int lost = 0; lost < (int)lrc.get_chunk_count(); lost++) {
+    set<int> want, available, minimum;
+    want.insert(lost);
+    available = all;
+    available.erase(lost);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want, available, &minimum));
+    set<int> group;
+    lrc.get_group_chunks(lrc.get_group(lost), &group);
+    group.erase(lost);
+    EXPECT_EQ(group, minimum);
+    check_decode(want, set<int>(&lost, &lost + 1));
+  }
+}
+
+TEST_F(ErasureCodeLrcTest, global_repair)
+{
+  // two losses in group 0 are beyond its local parity
+  set<int> lost;
+  lost.insert(0);
+  lost.insert(1);
+  set<int> available;
+  for (set<int>::iterator i = all.begin(); i != all.end(); ++i)
+    if (!lost.count(*i))
+      available.insert(*i);
+  set<int> minimum;
+  EXPECT_EQ(0, lrc.minimum_to_decode(lost, available, &minimum));
+  EXPECT_EQ(4u, minimum.size());
+  for (set<int>::iterator i = minimum.begin(); i != minimum.end(); ++i)
+    EXPECT_GT(6, *i);
+  check_decode(lost, lost);
+
+  // a lost local parity with its group damaged too
+  lost.insert(6);
+  check_decode(all, lost);
+
+  // one loss in each group is repaired locally
+  lost.clear();
+  lost.insert(2);
+  lost.insert(4);
+  check_decode(lost, lost);
+}
+
+TEST_F(ErasureCodeLrcTest, too_many_losses)
+{
+  map<int, bufferlist> chunks(encoded);
+  chunks.erase(0);
+  chunks.erase(1);
+  chunks.erase(3);
+  chunks.erase(4);
+  set<int> want;
+  want.insert(0);
+  map<int, bufferlist> decoded;
+  EXPECT_EQ(-EIO, lrc.decode(want, chunks, &decoded));
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,183 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "osd/HitSet.h"
+#include "gtest/gtest.h"
+
+static hobject_t obj(uint32_t hash)
+{
+  return hobject_t(object_t("obj"), "", CEPH_NOSNAP, hash, 0, "");
+}
+
+TEST(HitSet, Types)
+{
+  HitSet none;
+  EXPECT_EQ(HitSet::TYPE_NONE, none.get_type());
+  EXPECT_FALSE(none.contains(obj(1)));
+
+  HitSet::impl_type_t types[] = { HitSet::TYPE_EXPLICIT_HASH,
+				  HitSet::TYPE_BLOOM };
+  for (unsigned i = 0; i < 2; ++i) {
+    HitSet s(types[i], 100, .01);
+    EXPECT_EQ(types[i], s.get_type());
+    EXPECT_EQ(types[i],
+	      HitSet::get_type_from_name(HitSet::get_type_name(types[i])));
+    for (uint32_t h = 0; h < 50; ++h)
+      s.insert(obj(h * 0x9e3779b1));
+    EXPECT_EQ(50u, s.insert_count());
+    for (uint32_t h = 0; h < 50; ++h)
+      EXPECT_TRUE(s.contains(obj(h * 0x9e3779b1)));
+
+    bufferlist bl;
+    ::encode(s, bl);
+    HitSet d;
+    bufferlist::iterator p = bl.begin();
+    ::decode(d, p);
+    EXPECT_EQ(types[i], d.get_type());
+    EXPECT_EQ(50u, d.insert_count());
+    for (uint32_t h = 0; h < 50; ++h)
+      EXPECT_TRUE(d.contains(obj(h * 0x9e3779b1)));
+  }
+
+  // the explicit set has no false positives
+  HitSet e(HitSet::TYPE_EXPLICIT_HASH, 0, 0);
+  e.insert(obj(1));
+  EXPECT_FALSE(e.contains(obj(2)));
+}
+
+TEST(HitSetHistory, Disabled)
+{
+  HitSetHistory h;
+  utime_t now(1000, 0);
+  h.insert(obj(1), now);
+  EXPECT_EQ(0u, h.size());
+  EXPECT_EQ(0u, h.temperature(obj(1), now));
+  EXPECT_FALSE(h.in_current(obj(1), now));
+}
+
+TEST(HitSetHistory, Temperature)
+{
+  HitSetHistory h;
+  h.set_params(HitSet::TYPE_BLOOM, 3, 10, 100, .01);
+  utime_t now(1000, 0);
+
+  h.insert(obj(1), now);
+  h.insert(obj(2), now);
+  EXPECT_EQ(1u, h.temperature(obj(1), now));
+  EXPECT_TRUE(h.in_current(obj(1), now));
+
+  now += utime_t(10, 0);
+  h.insert(obj(1), now);
+  EXPECT_EQ(2u, h.size());
+  EXPECT_EQ(2u, h.temperature(obj(1), now));
+  EXPECT_EQ(1u, h.temperature(obj(2), now));
+  EXPECT_FALSE(h.in_current(obj(2), now));
+
+  now += utime_t(10, 0);
+  h.insert(obj(1), now);
+  now += utime_t(10, 0);
+  h.insert(obj(1), now);
+  // only the last three intervals are kept
+  EXPECT_EQ(3u, h.size());
+  EXPECT_EQ(3u, h.temperature(obj(1), now));
+  EXPECT_EQ(0u, h.temperature(obj(2), now));
+}
+
+TEST(HitSetHistory, Expire)
+{
+  HitSetHistory h;
+  h.set_params(HitSet::TYPE_BLOOM, 2, 10, 100, .01);
+  utime_t now(1000, 0);
+  h.insert(obj(1), now);
+  EXPECT_EQ(1u, h.temperature(obj(1), now));
+
+  // idle for longer than the whole history
+  now += utime_t(30, 0);
+  EXPECT_EQ(0u, h.temperature(obj(1), now));
+  EXPECT_EQ(1u, h.size());
+}
+
+TEST(HitSetHistory, SetParams)
+{
+  HitSetHistory h;
+  h.set_params(HitSet::TYPE_BLOOM, 2, 10, 100, .01);
+  utime_t now(1000, 0);
+  h.insert(obj(1), now);
+
+  // same parameters keep the history
+  h.set_params(HitSet::TYPE_BLOOM, 2, 10, 100, .01);
+  EXPECT_EQ(1u, h.temperature(obj(1), now));
+
+  h.set_params(HitSet::TYPE_BLOOM, 4, 10, 100, .01);
+  EXPECT_EQ(0u, h.temperature(obj(1), now));
+}
+
+TEST(HitSetHistory, Recent)
+{
+  HitSetHistory h;
+  h.set_params(HitSet::TYPE_EXPLICIT_HASH, 4, 10, 100, .01);
+  utime_t now(1000, 0);
+  h.insert(obj(1), now);
+  h.insert(obj(2), now);
+  now += utime_t(10, 0);
+  h.insert(obj(2), now);
+  now += utime_t(10, 0);
+  h.insert(obj(2), now);
+
+  // seen in n of the last m intervals
+  EXPECT_EQ(0u, h.temperature(obj(1), now, 2));
+  EXPECT_EQ(1u, h.temperature(obj(1), now, 3));
+  EXPECT_EQ(2u, h.temperature(obj(2), now, 2));
+  EXPECT_EQ(3u, h.temperature(obj(2), now));
+}
+
+TEST(HitSetHistory, Archive)
+{
+  HitSetHistory h;
+  h.set_params(HitSet::TYPE_EXPLICIT_HASH, 3, 10, 100, .01);
+  utime_t now(1000, 0);
+  h.insert(obj(1), now);
+  EXPECT_FALSE(h.archive_pending());
+  now += utime_t(10, 0);
+  h.insert(obj(2), now);
+  EXPECT_TRUE(h.archive_pending());
+
+  bufferlist bl;
+  ::encode(h, bl);
+  h.archived();
+  EXPECT_FALSE(h.archive_pending());
+
+  HitSetHistory d;
+  d.set_params(HitSet::TYPE_EXPLICIT_HASH, 3, 10, 100, .01);
+  bufferlist::iterator p = bl.begin();
+  ::decode(d, p);
+  EXPECT_EQ(2u, d.size());
+  EXPECT_EQ(1u, d.temperature(obj(1), now));
+  EXPECT_TRUE(d.in_current(obj(2), now));
+  // the current interval carries on
+  EXPECT_EQ(2u, d.size());
+
+  // sets of another type are dropped
+  HitSetHistory b;
+  b.set_params(HitSet::TYPE_BLOOM, 3, 10, 100, .01);
+  p = bl.begin();
+  ::decode(b, p);
+  EXPECT_EQ(0u, b.size());
+
+  // and so are those beyond the count
+  HitSetHistory one;
+  one.set_params(HitSet::TYPE_EXPLICIT_HASH, 1, 10, 100, .01);
+  p = bl.begin();
+  ::decode(one, p);
+  EXPECT_EQ(1u, one.size());
+  EXPECT_EQ(0u, one.temperature(obj(1), now));
+}
@@ -1629,6 +1629,41 @@ TEST_F(PGLogTest, proc_replica_log) {
 
 }
 
+TEST_F(PGLogTest, log_bytes) {
+  clear();
+  atomic_t total;
+  set_bytes_total(&total);
+  EXPECT_EQ(0u, get_log_bytes());
+
+  hobject_t oid(object_t("obj"), "", CEPH_NOSNAP, 1, 0, "");
+  pg_info_t info;
+  for (unsigned i = 1; i <= 10; i++) {
+    pg_log_entry_t e;
+    e.op = pg_log_entry_t::MODIFY;
+    e.soid = oid;
+    e.version = eversion_t(1, i);
+    e.prior_version = eversion_t(1, i - 1);
+    add(e);
+  }
+  uint64_t ten = get_log_bytes();
+  EXPECT_LT(0u, ten);
+  EXPECT_EQ(ten, (uint64_t)total.read());
+
+  // a rebuilt index comes to the same
+  index();
+  EXPECT_EQ(ten, get_log_bytes());
+
+  info.last_complete = info.last_update = eversion_t(1, 10);
+  trim(eversion_t(1, 5), info);
+  EXPECT_EQ(ten / 2, get_log_bytes());
+  EXPECT_EQ(ten / 2, (uint64_t)total.read());
+
+  clear();
+  EXPECT_EQ(0u, get_log_bytes());
+  EXPECT_EQ(0, total.read());
+  set_bytes_total(NULL);
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
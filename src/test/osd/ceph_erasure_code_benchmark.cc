@@ -0,0 +1,357 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ */
+
+/*
+ * Time the encoding or decoding of a buffer with an erasure code
+ * plugin, for every combination of the techniques, k, m and sizes
+ * given, and report the throughput and latency percentiles.  Each
+ * decode loses a random set of chunks and, with --verify, the
+ * rebuilt chunks are compared with the encoded ones.
+ */
+
+#include <boost/program_options/option.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+
+#include "common/Clock.h"
+#include "common/Formatter.h"
+#include "common/ceph_context.h"
+#include "common/config.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "osd/ErasureCodePlugin.h"
+
+namespace po = boost::program_options;
+using namespace std;
+
+struct Result {
+  string technique;
+  unsigned k, m, chunks;
+  unsigned size;
+  string workload;
+  unsigned iterations;
+  unsigned erasures;
+  unsigned failures;      // round trips that did not match
+  double elapsed;         // seconds
+  vector<double> latency; // seconds, sorted
+
+  Result() : k(0), m(0), chunks(0), size(0), iterations(0), erasures(0),
+	     failures(0), elapsed(0) {}
+
+  double percentile(double p) const {
+    if (latency.empty())
+      return 0;
+    unsigned i = p * latency.size();
+    return latency[std::min(i, (unsigned)latency.size() - 1)];
+  }
+  double throughput() const {
+    return elapsed > 0 ? (double)size * iterations / elapsed / 1000000000.0 : 0;
+  }
+
+  void dump(Formatter *f) const {
+    f->open_object_section("result");
+    f->dump_string("technique", technique);
+    f->dump_unsigned("k", k);
+    f->dump_unsigned("m", m);
+    f->dump_unsigned("chunks", chunks);
+    f->dump_string("workload", workload);
+    f->dump_unsigned("size", size);
+    f->dump_unsigned("iterations", iterations);
+    f->dump_unsigned("erasures", erasures);
+    f->dump_unsigned("failures", failures);
+    f->dump_float("gbytes_per_sec", throughput());
+    f->dump_float("lat_p50_us", percentile(.5) * 1000000);
+    f->dump_float("lat_p90_us", percentile(.9) * 1000000);
+    f->dump_float("lat_p99_us", percentile(.99) * 1000000);
+    f->dump_float("lat_max_us", percentile(1) * 1000000);
+    f->close_section();
+  }
+
+  void print(ostream& out) const {
+    out << technique << "\tk=" << k << "\tm=" << m << "\tchunks=" << chunks
+	<< "\t" << workload << "\t" << size << "\t" << throughput() << " GB/s"
+	<< "\tp50=" << percentile(.5) * 1000000 << "us"
+	<< "\tp99=" << percentile(.99) * 1000000 << "us";
+    if (failures)
+      out << "\tFAILED " << failures << "/" << iterations;
+    out << std::endl;
+  }
+};
+
+static bool same_chunks(const set<int>& want,
+			map<int,bufferlist>& expected,
+			map<int,bufferlist>& decoded)
+{
+  for (set<int>::const_iterator i = want.begin(); i != want.end(); ++i)
+    if (!decoded.count(*i) || !expected[*i].contents_equal(decoded[*i]))
+      return false;
+  return true;
+}
+
+static int run(const string& plugin, map<string,string>& parameters,
+	       const string& workload, unsigned size, unsigned iterations,
+	       unsigned erasures, bool verify, Result *result)
+{
+  ErasureCodeInterfaceRef erasure_code;
+  int r = ErasureCodePluginRegistry::instance().factory(plugin, parameters,
+							 &erasure_code);
+  if (r) {
+    cerr << "technique " << parameters["erasure-code-technique"]
+	 << ": factory returned " << r << std::endl;
+    return r;
+  }
+  // some techniques override k or m, report what was used
+  unsigned chunk_count = erasure_code->get_chunk_count();
+  unsigned data_count = erasure_code->get_data_chunk_count();
+  result->technique = parameters["erasure-code-technique"];
+  result->k = data_count;
+  result->m = chunk_count - data_count;
+  result->chunks = chunk_count;
+  result->workload = workload;
+  result->size = size;
+  result->iterations = iterations;
+  result->erasures = std::min(erasures, chunk_count - data_count);
+
+  bufferlist in;
+  in.append(buffer::create_page_aligned(size));
+  for (unsigned i = 0; i < size; i++)
+    in.c_str()[i] = rand();
+
+  set<int> want;
+  for (unsigned i = 0; i < chunk_count; i++)
+    want.insert(i);
+
+  map<int,bufferlist> encoded;
+  r = erasure_code->encode(want, in, &encoded);
+  if (r)
+    return r;
+  if (verify) {
+    bufferlist data;
+    for (unsigned i = 0; i < data_count; i++)
+      data.append(encoded[i]);
+    bufferlist head;
+    head.substr_of(data, 0, size);
+    if (encoded.size() != chunk_count || !head.contents_equal(in))
+      result->failures++;
+  }
+
+  for (unsigned i = 0; i < iterations; i++) {
+    utime_t start;
+    if (workload == "encode") {
+      map<int,bufferlist> out;
+      start = ceph_clock_now(g_ceph_context);
+      r = erasure_code->encode(want, in, &out);
+      result->latency.push_back(ceph_clock_now(g_ceph_context) - start);
+      if (r || (verify && !same_chunks(want, encoded, out)))
+	result->failures++;
+    } else {
+      // lose a random set of chunks, read the minimum from the rest
+      set<int> lost, available, minimum;
+      while (lost.size() < result->erasures)
+	lost.insert(rand() % chunk_count);
+      for (unsigned c = 0; c < chunk_count; c++)
+	if (!lost.count(c))
+	  available.insert(c);
+      r = erasure_code->minimum_to_decode(lost, available, &minimum);
+      if (r) {
+	result->failures++;
+	continue;
+      }
+      map<int,bufferlist> chunks;
+      for (set<int>::iterator c = minimum.begin(); c != minimum.end(); ++c)
+	chunks[*c] = encoded[*c];
+      map<int,bufferlist> out;
+      start = ceph_clock_now(g_ceph_context);
+      r = erasure_code->decode(lost, chunks, &out);
+      result->latency.push_back(ceph_clock_now(g_ceph_context) - start);
+      if (r || (verify && !same_chunks(lost, encoded, out)))
+	result->failures++;
+    }
+  }
+  for (vector<double>::iterator l = result->latency.begin();
+       l != result->latency.end();
+       ++l)
+    result->elapsed += *l;
+  sort(result->latency.begin(), result->latency.end());
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", "produce help message")
+    ("plugin", po::value<string>()->default_value("jerasure"),
+     "erasure code plugin")
+    ("directory", po::value<string>()->default_value(CEPH_LIBDIR "/erasure-code"),
+     "directory the plugin is loaded from")
+    ("technique", po::value<vector<string> >(),
+     "technique, may be given several times (default: all jerasure ones)")
+    ("parameter", po::value<vector<string> >(),
+     "name=value passed to the plugin, may be given several times")
+    ("k", po::value<vector<int> >(),
+     "data chunks, may be given several times (default 7)")
+    ("m", po::value<vector<int> >(),
+     "coding chunks, may be given several times (default 3)")
+    ("size", po::value<vector<unsigned> >(),
+     "bytes encoded at once, may be given several times (default 1048576)")
+    ("iterations", po::value<unsigned>()->default_value(100),
+     "number of encodes or decodes")
+    ("workload", po::value<vector<string> >(),
+     "encode or decode, may be given several times (default encode)")
+    ("erasures", po::value<unsigned>()->default_value(1),
+     "random chunks lost before each decode")
+    ("verify", "check every encode and decode against the first encode")
+    ("format", po::value<string>()->default_value("plain"),
+     "plain, json or xml")
+    ;
+
+  po::variables_map vm;
+  po::parsed_options parsed =
+    po::command_line_parser(argc, argv).options(desc).allow_unregistered().run();
+  po::store(
+    parsed,
+    vm);
+  po::notify(vm);
+
+  vector<const char *> ceph_options, def_args;
+  vector<string> ceph_option_strings = po::collect_unrecognized(
+    parsed.options, po::include_positional);
+  ceph_options.reserve(ceph_option_strings.size());
+  for (vector<string>::iterator i = ceph_option_strings.begin();
+       i != ceph_option_strings.end();
+       ++i) {
+    ceph_options.push_back(i->c_str());
+  }
+
+  global_init(
+    &def_args, ceph_options, CEPH_ENTITY_TYPE_CLIENT,
+    CODE_ENVIRONMENT_UTILITY,
+    CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  if (vm.count("help")) {
+    cout << desc << std::endl;
+    return 1;
+  }
+
+  vector<string> workloads;
+  if (vm.count("workload"))
+    workloads = vm["workload"].as<vector<string> >();
+  else
+    workloads.push_back("encode");
+  for (vector<string>::iterator w = workloads.begin(); w != workloads.end(); ++w) {
+    if (*w != "encode" && *w != "decode") {
+      cout << "workload must be encode or decode" << std::endl
+	   << desc << std::endl;
+      return 1;
+    }
+  }
+
+  string plugin = vm["plugin"].as<string>();
+  vector<string> techniques;
+  if (vm.count("technique")) {
+    techniques = vm["technique"].as<vector<string> >();
+  } else if (plugin == "jerasure") {
+    const char *all[] = {
+      "reed_sol_van", "reed_sol_r6_op", "cauchy_orig", "cauchy_good",
+      "liberation", "blaum_roth", "liber8tion", 0
+    };
+    for (const char **t = all; *t; t++)
+      techniques.push_back(*t);
+  } else {
+    techniques.push_back("");
+  }
+
+  vector<int> ks, ms;
+  vector<unsigned> sizes;
+  if (vm.count("k"))
+    ks = vm["k"].as<vector<int> >();
+  else
+    ks.push_back(7);
+  if (vm.count("m"))
+    ms = vm["m"].as<vector<int> >();
+  else
+    ms.push_back(3);
+  if (vm.count("size"))
+    sizes = vm["size"].as<vector<unsigned> >();
+  else
+    sizes.push_back(1<<20);
+
+  map<string,string> extra;
+  if (vm.count("parameter")) {
+    vector<string> p = vm["parameter"].as<vector<string> >();
+    for (vector<string>::iterator i = p.begin(); i != p.end(); ++i) {
+      size_t equal = i->find('=');
+      if (equal == string::npos) {
+	cout << "--parameter " << *i << " is not name=value" << std::endl;
+	return 1;
+      }
+      extra[i->substr(0, equal)] = i->substr(equal + 1);
+    }
+  }
+
+  string format = vm["format"].as<string>();
+  Formatter *f = NULL;
+  if (format != "plain") {
+    f = new_formatter(format);
+    if (!f) {
+      cout << "format must be plain, json or xml" << std::endl;
+      return 1;
+    }
+    f->open_array_section("results");
+  }
+
+  int ret = 0;
+  for (vector<string>::iterator t = techniques.begin(); t != techniques.end(); ++t)
+    for (vector<int>::iterator k = ks.begin(); k != ks.end(); ++k)
+      for (vector<int>::iterator m = ms.begin(); m != ms.end(); ++m)
+	for (vector<unsigned>::iterator size = sizes.begin(); size != sizes.end(); ++size)
+	  for (vector<string>::iterator w = workloads.begin(); w != workloads.end(); ++w) {
+	    map<string,string> parameters(extra);
+	    parameters["erasure-code-directory"] = vm["directory"].as<string>();
+	    if (!t->empty())
+	      parameters["erasure-code-technique"] = *t;
+	    ostringstream k_str, m_str;
+	    k_str << *k;
+	    m_str << *m;
+	    parameters["erasure-code-k"] = k_str.str();
+	    parameters["erasure-code-m"] = m_str.str();
+	    Result result;
+	    if (run(plugin, parameters, *w, *size, vm["iterations"].as<unsigned>(),
+		    vm["erasures"].as<unsigned>(), vm.count("verify"), &result) < 0) {
+	      ret = 1;
+	      continue;
+	    }
+	    if (result.failures)
+	      ret = 1;
+	    if (f)
+	      result.dump(f);
+	    else
+	      result.print(cout);
+	  }
+
+  if (f) {
+    f->close_section();
+    f->flush(cout);
+    cout << std::endl;
+    delete f;
+  }
+  return ret;
+}
@@ -81,6 +81,19 @@ tid_t FakeWriteback::write(const object_t& oid,
   return m_tid.inc();
 }
 
+tid_t FakeWriteback::write_extents(const object_t& oid,
+				   const object_locator_t& oloc,
+				   const vector<pair<uint64_t, bufferlist> >& extents,
+				   const SnapContext& snapc, utime_t mtime,
+				   uint64_t trunc_size, __u32 trunc_seq,
+				   Context *oncommit)
+{
+  C_Delay *wrapper = new C_Delay(m_cct, oncommit, m_lock, extents.front().first,
+				 NULL, m_delay_ns);
+  m_finisher->queue(wrapper, 0);
+  return m_tid.inc();
+}
+
 bool FakeWriteback::may_copy_on_write(const object_t&, uint64_t, uint64_t, snapid_t)
 {
   return false;
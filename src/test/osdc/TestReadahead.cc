@@ -0,0 +1,110 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "osdc/Readahead.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include <gtest/gtest.h>
+
+TEST(Readahead, Disabled) {
+  Readahead ra;
+  for (uint64_t off = 0; off < 10 * 4096; off += 4096)
+    ASSERT_EQ(0u, ra.update(off, 4096, 1 << 30).second);
+}
+
+TEST(Readahead, Sequential) {
+  Readahead ra;
+  ra.set_limits(16384, 65536, 1);
+
+  // the first read of a stream gets nothing
+  ASSERT_EQ(0u, ra.update(0, 4096, 1 << 30).second);
+
+  // then the window starts at min and grows up to max, staying ahead
+  Readahead::extent_t e = ra.update(4096, 4096, 1 << 30);
+  ASSERT_EQ(8192u, e.first);
+  ASSERT_EQ(16384u, e.second);
+  uint64_t ra_end = e.first + e.second;
+  uint64_t largest = 0;
+  for (uint64_t off = 8192; off < 1 << 20; off += 4096) {
+    e = ra.update(off, 4096, 1 << 30);
+    if (e.second) {
+      ASSERT_EQ(ra_end, e.first);   // contiguous with the last
+      ra_end = e.first + e.second;
+      largest = MAX(largest, e.second);
+    }
+    ASSERT_TRUE(ra_end > off + 4096);
+    ASSERT_TRUE(ra_end <= off + 4096 + 65536);
+  }
+  ASSERT_TRUE(largest > 16384);
+
+  Readahead::stats_t s = ra.take_stats();
+  ASSERT_TRUE(s.issued > 0);
+  ASSERT_TRUE(s.hit > 0);
+  ASSERT_EQ(0u, s.wasted);
+  s = ra.take_stats();
+  ASSERT_EQ(0u, s.issued);
+}
+
+TEST(Readahead, Limit) {
+  Readahead ra;
+  ra.set_limits(16384, 65536, 1);
+  ra.update(0, 4096, 10000);
+  Readahead::extent_t e = ra.update(4096, 4096, 10000);
+  ASSERT_EQ(8192u, e.first);
+  ASSERT_EQ(10000u - 8192u, e.second);
+  ASSERT_EQ(0u, ra.update(8192, 1808, 10000).second);
+}
+
+TEST(Readahead, Streams) {
+  Readahead ra;
+  ra.set_limits(16384, 65536, 2);
+  uint64_t a = 0, b = 1 << 24;
+  ra.update(a, 4096, 1 << 30);
+  ra.update(b, 4096, 1 << 30);
+  // interleaved, both keep their readahead
+  ASSERT_TRUE(ra.update(a + 4096, 4096, 1 << 30).second > 0);
+  ASSERT_TRUE(ra.update(b + 4096, 4096, 1 << 30).second > 0);
+
+  // a third stream replaces the least recently used (a), whose
+  // readahead is then wasted; b carries on
+  ra.update(1 << 28, 4096, 1 << 30);
+  ASSERT_TRUE(ra.update(b + 8192, 4096, 1 << 30).second > 0);
+  ASSERT_EQ(0u, ra.update(a + 8192, 4096, 1 << 30).second);
+  Readahead::stats_t s = ra.take_stats();
+  ASSERT_EQ(16384u, s.wasted);
+}
+
+TEST(Readahead, Align) {
+  Readahead ra;
+  ra.set_limits(16384, 1 << 20, 1);
+  ra.set_alignments(65536, 10000);
+  ra.update(0, 4096, 1 << 30);
+  // 8192 + 16384 crosses a small unit, so ends on one
+  Readahead::extent_t e = ra.update(4096, 4096, 1 << 30);
+  ASSERT_EQ(8192u, e.first);
+  ASSERT_EQ(20000u, e.first + e.second);
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make unittest_readahead ; ./unittest_readahead"
+// End:
@@ -17,10 +17,12 @@
 
 
 #include "common/perf_counters.h"
+#include "common/perf_counters_stream.h"
 #include "common/admin_socket_client.h"
 #include "common/ceph_context.h"
 #include "common/config.h"
 #include "common/errno.h"
+#include "common/Formatter.h"
 #include "common/safe_io.h"
 
 #include "common/code_environment.h"
@@ -163,3 +165,183 @@ TEST(PerfCounters, MultiplePerfCounters) {
   ASSERT_EQ("", client.do_request("{ \"prefix\": \"perfcounters_dump\", \"format\": \"json\" }", &msg));
   ASSERT_EQ("{}", msg);
 }
+
+enum {
+  TEST_PERFCOUNTERS3_ELEMENT_FIRST = 600,
+  TEST_PERFCOUNTERS3_ELEMENT_LAT,
+  TEST_PERFCOUNTERS3_ELEMENT_LAT_SIZE,
+  TEST_PERFCOUNTERS3_ELEMENT_LAST,
+};
+
+// the json array of latency bucket counts
+static std::string hist(const std::map<unsigned, unsigned> &counts)
+{
+  std::ostringstream ss;
+  ss << "[";
+  for (unsigned i = 0; i < PERF_HIST_LAT_BUCKETS; i++) {
+    std::map<unsigned, unsigned>::const_iterator p = counts.find(i);
+    ss << (i ? "," : "") << (p == counts.end() ? 0 : p->second);
+  }
+  ss << "]";
+  return ss.str();
+}
+
+TEST(PerfCounters, Histogram) {
+  PerfCountersBuilder bld(g_ceph_context, "test_perfcounter_3",
+	  TEST_PERFCOUNTERS3_ELEMENT_FIRST, TEST_PERFCOUNTERS3_ELEMENT_LAST);
+  bld.add_time_histogram(TEST_PERFCOUNTERS3_ELEMENT_LAT, "lat");
+  bld.add_time_size_histogram(TEST_PERFCOUNTERS3_ELEMENT_LAT_SIZE, "lat_size");
+  PerfCounters *pf = bld.create_perf_counters();
+
+  pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_LAT, utime_t(0, 500));      // 0us
+  pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_LAT, utime_t(0, 3000));     // 3us
+  pf->tinc(TEST_PERFCOUNTERS3_ELEMENT_LAT, utime_t(1, 0));        // 2^19 < 10^6 < 2^20
+  pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_LAT_SIZE, utime_t(0, 3000), 4096);
+  pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_LAT_SIZE, utime_t(0, 3000), 1ull << 40);
+
+  std::map<unsigned, unsigned> lat;
+  lat[0] = 1;
+  lat[2] = 1;
+  lat[20] = 1;
+  std::map<unsigned, unsigned> lat2;
+  lat2[2] = 1;
+  std::string size_hist = "[";
+  for (unsigned i = 0; i < PERF_HIST_SIZE_BUCKETS; i++) {
+    if (i)
+      size_hist += ",";
+    // 4096 is in bucket 13, 2^40 in the last bucket
+    size_hist += (i == 13 || i == PERF_HIST_SIZE_BUCKETS - 1) ?
+      hist(lat2) : hist(std::map<unsigned, unsigned>());
+  }
+  size_hist += "]";
+
+  JSONFormatter f;
+  pf->dump_formatted(&f, false);
+  std::ostringstream out;
+  f.flush(out);
+  ASSERT_EQ("{\"test_perfcounter_3\":{"
+	    "\"lat\":{\"avgcount\":3,\"sum\":1.000003500,\"histogram\":" +
+	    hist(lat) + "},"
+	    "\"lat_size\":{\"avgcount\":2,\"sum\":0.000006000,\"histogram\":" +
+	    size_hist + "}}}", out.str());
+  ASSERT_EQ(make_pair((uint64_t)3, (uint64_t)1000),
+	    pf->get_tavg_ms(TEST_PERFCOUNTERS3_ELEMENT_LAT));
+  delete pf;
+}
+
+TEST(PerfCounters, Sample) {
+  PerfCountersCollection *coll = g_ceph_context->get_perfcounters_collection();
+  coll->clear();
+  PerfCounters* fake_pf = setup_test_perfcounters1(g_ceph_context);
+  coll->add(fake_pf);
+
+  std::vector<std::string> names;
+  std::vector<int> types;
+  uint64_t version = coll->get_schema(names, types);
+  ASSERT_EQ(3u, names.size());
+  ASSERT_EQ("test_perfcounter_1.element1", names[0]);
+  ASSERT_EQ("test_perfcounter_1.element3", names[2]);
+  ASSERT_EQ(PERFCOUNTER_TIME | PERFCOUNTER_LONGRUNAVG, types[2]);
+
+  fake_pf->inc(TEST_PERFCOUNTERS1_ELEMENT_1, 7);
+  fake_pf->tinc(TEST_PERFCOUNTERS1_ELEMENT_3, utime_t(2, 0));
+  std::vector<uint64_t> values;
+  ASSERT_EQ(version, coll->sample(values));
+  ASSERT_EQ(6u, values.size());
+  ASSERT_EQ(7u, values[0]);
+  ASSERT_EQ(0u, values[1]);
+  ASSERT_EQ(2000000000u, values[4]);
+  ASSERT_EQ(1u, values[5]);
+
+  PerfCounters* fake_pf2 = setup_test_perfcounter2(g_ceph_context);
+  coll->add(fake_pf2);
+  ASSERT_NE(version, coll->sample(values));
+  ASSERT_EQ(10u, values.size());
+  coll->clear();
+}
+
+static void read_frame(int fd, __u8 *type, bufferlist& body)
+{
+  __u32 len;
+  ASSERT_EQ(0, safe_read_exact(fd, &len, sizeof(len)));
+  bufferptr bp(len);
+  ASSERT_EQ(0, safe_read_exact(fd, bp.c_str(), len));
+  body.clear();
+  body.append(bp);
+  bufferlist::iterator p = body.begin();
+  ::decode(*type, p);
+}
+
+TEST(PerfCounters, Stream) {
+  PerfCountersCollection *coll = g_ceph_context->get_perfcounters_collection();
+  coll->clear();
+  PerfCounters* fake_pf = setup_test_perfcounters1(g_ceph_context);
+  coll->add(fake_pf);
+  fake_pf->inc(TEST_PERFCOUNTERS1_ELEMENT_1, 3);
+
+  std::string path = std::string(get_rand_socket_path()) + ".perf";
+  PerfCountersStream *stream = new PerfCountersStream(g_ceph_context, 1 << 20, .05);
+  ASSERT_TRUE(stream->init(path));
+
+  int fd = socket(PF_UNIX, SOCK_STREAM, 0);
+  ASSERT_GE(fd, 0);
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  snprintf(address.sun_path, sizeof(address.sun_path), "%s", path.c_str());
+  ASSERT_EQ(0, connect(fd, (struct sockaddr*)&address, sizeof(address)));
+
+  // a schema, then all the nonzero values
+  __u8 type;
+  bufferlist body;
+  read_frame(fd, &type, body);
+  ASSERT_EQ(PerfCountersStream::FRAME_SCHEMA, type);
+  bufferlist::iterator p = body.begin();
+  ::decode(type, p);
+  __u32 n;
+  ::decode(n, p);
+  ASSERT_EQ(3u, n);
+  std::string name;
+  ::decode(name, p);
+  ASSERT_EQ("test_perfcounter_1.element1", name);
+
+  read_frame(fd, &type, body);
+  ASSERT_EQ(PerfCountersStream::FRAME_SAMPLE, type);
+  p = body.begin();
+  ::decode(type, p);
+  utime_t stamp;
+  ::decode(stamp, p);
+  __u8 key;
+  ::decode(key, p);
+  ASSERT_EQ(1, key);
+  ::decode(n, p);
+  ASSERT_EQ(1u, n);
+  __u32 idx;
+  uint64_t v;
+  ::decode(idx, p);
+  ::decode(v, p);
+  ASSERT_EQ(0u, idx);
+  ASSERT_EQ(3u, v);
+
+  // then only what changed, as deltas
+  fake_pf->inc(TEST_PERFCOUNTERS1_ELEMENT_1, 2);
+  do {
+    read_frame(fd, &type, body);
+    ASSERT_EQ(PerfCountersStream::FRAME_SAMPLE, type);
+    p = body.begin();
+    ::decode(type, p);
+    ::decode(stamp, p);
+    ::decode(key, p);
+    ASSERT_EQ(0, key);
+    ::decode(n, p);
+  } while (n == 0);
+  ASSERT_EQ(1u, n);
+  ::decode(idx, p);
+  ::decode(v, p);
+  ASSERT_EQ(0u, idx);
+  ASSERT_EQ(2u, v);
+
+  close(fd);
+  delete stream;
+  coll->clear();
+}
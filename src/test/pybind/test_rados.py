@@ -286,6 +286,72 @@ class TestIoctx(object):
         eq(retval[0], "bar")
         [i.remove() for i in self.ioctx.list_objects()]
 
+    def test_aio_read_nul(self):
+        retval = [None]
+        lock = threading.Condition()
+        def cb(_, buf):
+            with lock:
+                retval[0] = buf
+                lock.notify()
+        self.ioctx.write("foo", "b\0r")
+        self.ioctx.aio_read("foo", 3, 0, cb)
+        with lock:
+            while retval[0] is None:
+                lock.wait()
+        eq(retval[0], "b\0r")
+        [i.remove() for i in self.ioctx.list_objects()]
+
+    def test_read_into(self):
+        self.ioctx.write("foo", "barbaz")
+        buf = bytearray(4)
+        eq(self.ioctx.read_into("foo", buf, 2), 4)
+        eq(str(buf), "rbaz")
+        eq(self.ioctx.read_into("foo", buf, 4), 2)
+        eq(str(buf[:2]), "az")
+        assert_raises(TypeError, self.ioctx.read_into, "foo", "abcd")
+        [i.remove() for i in self.ioctx.list_objects()]
+
+    def test_aio_read_into(self):
+        self.ioctx.write("foo", "barbaz")
+        buf = bytearray(6)
+        comp = self.ioctx.aio_read_into("foo", buf)
+        comp.wait_for_complete_and_cb()
+        eq(comp.get_return_value(), 6)
+        eq(str(buf), "barbaz")
+        [i.remove() for i in self.ioctx.list_objects()]
+
+    def test_aio_remove(self):
+        self.ioctx.write("foo", "bar")
+        comp = self.ioctx.aio_remove("foo")
+        comp.wait_for_safe_and_cb()
+        eq(comp.get_return_value(), 0)
+        assert_raises(ObjectNotFound, self.ioctx.read, "foo")
+
+    def test_completion_set(self):
+        comps = self.ioctx.create_completion_set()
+        eq(comps.wait_for_any(), None)
+        written = []
+        for i in range(8):
+            name = "foo%d" % i
+            comp = self.ioctx.aio_write_full(name, name)
+            written.append(comp)
+            comps.add(comp)
+        eq(len(comps), 8)
+        done = []
+        while len(comps):
+            done.append(comps.wait_for_any())
+        eq(set(written), set(done))
+        for comp in done:
+            eq(comp.get_return_value(), 0)
+
+        bufs = [bytearray(4) for i in range(8)]
+        for i in range(8):
+            comps.add(self.ioctx.aio_read_into("foo%d" % i, bufs[i]))
+        comps.wait_for_all()
+        eq(len(comps), 0)
+        eq([str(b) for b in bufs], ["foo%d" % i for i in range(8)])
+        [i.remove() for i in self.ioctx.list_objects()]
+
 class TestObject(object):
 
     def setUp(self):
@@ -2,6 +2,7 @@ import functools
 import random
 import struct
 import os
+import threading
 
 from nose import with_setup, SkipTest
 from nose.tools import eq_ as eq, assert_raises
@@ -259,6 +260,42 @@ class TestImage(object):
     def test_read_bad_offset(self):
         assert_raises(InvalidArgument, self.image.read, IMG_SIZE + 1, IMG_SIZE)
 
+    def test_aio_write_read(self):
+        data = rand_data(256)
+        comp = self.image.aio_write(data, 50)
+        comp.wait_for_complete()
+        eq(comp.get_return_value(), 256)
+        retval = [None]
+        lock = threading.Condition()
+        def cb(_, buf):
+            with lock:
+                retval[0] = buf
+                lock.notify()
+        self.image.aio_read(50, 256, cb)
+        with lock:
+            while retval[0] is None:
+                lock.wait()
+        eq(retval[0], data)
+
+    def test_aio_read_into(self):
+        data = rand_data(4096)
+        self.image.write(data, 0)
+        buf = bytearray(4096)
+        comp = self.image.aio_read_into(0, buf)
+        comp.wait_for_complete()
+        eq(comp.get_return_value(), 4096)
+        eq(str(buf), data)
+
+    def test_aio_discard_flush(self):
+        self.image.write('a' * 256, 0)
+        comp = self.image.aio_discard(0, 256)
+        comp.wait_for_complete()
+        eq(comp.get_return_value(), 0)
+        comp = self.image.aio_flush()
+        comp.wait_for_complete()
+        eq(comp.get_return_value(), 0)
+        eq(self.image.read(0, 256), '\0' * 256)
+
     def test_resize(self):
         new_size = IMG_SIZE * 2
         self.image.resize(new_size)
@@ -13,7 +13,9 @@ int main(int argc, char **argv)
 	assert(ceph_arch_probed);
 
 	printf("ceph_arch_intel_sse42 = %d\n", ceph_arch_intel_sse42);
+	printf("ceph_arch_intel_pclmul = %d\n", ceph_arch_intel_pclmul);
 	printf("ceph_arch_neon = %d\n", ceph_arch_neon);
+	printf("ceph_arch_aarch64_crc32 = %d\n", ceph_arch_aarch64_crc32);
 
 	return 0;
 }
@@ -542,3 +542,51 @@ TEST(TestFileJournal, ReplayDetectCorruptHeader) {
   j.close();
   ::close(fd);
 }
+
+TEST(TestFileJournal, ReplayStriped) {
+  char stripe_path[220];
+  snprintf(stripe_path, sizeof(stripe_path), "%s.stripe", path);
+  g_ceph_context->_conf->set_val("journal_stripe_path", stripe_path);
+  g_ceph_context->_conf->set_val("journal_stripe_unit", "8192");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  fsid.generate_random();
+  FileJournal j(fsid, finisher, &sync_cond, path, directio, aio);
+  ASSERT_EQ(0, j.create());
+  j.make_writeable();
+
+  C_GatherBuilder gb(g_ceph_context, new C_SafeCond(&lock, &cond, &done));
+
+  // entries larger than a stripe unit land on both devices
+  vector<bufferlist> origbls(5);
+  for (unsigned i = 0; i < origbls.size(); ++i) {
+    char buf[20000];
+    memset(buf, 'a' + i, sizeof(buf));
+    origbls[i].append(buf, sizeof(buf));
+    bufferlist bl(origbls[i]);
+    j.submit_entry(i + 1, bl, 0, gb.new_sub());
+  }
+  gb.activate();
+  wait();
+
+  j.close();
+
+  j.open(0);
+  for (unsigned i = 0; i < origbls.size(); ++i) {
+    bufferlist inbl;
+    uint64_t seq = 0;
+    ASSERT_TRUE(j.read_entry(inbl, seq));
+    ASSERT_EQ(i + 1, seq);
+    ASSERT_TRUE(inbl.contents_equal(origbls[i]));
+  }
+  bufferlist inbl;
+  uint64_t seq = 0;
+  ASSERT_FALSE(j.read_entry(inbl, seq));
+
+  j.make_writeable();
+  j.close();
+
+  g_ceph_context->_conf->set_val("journal_stripe_path", "");
+  g_ceph_context->_conf->apply_changes(NULL);
+  unlink(stripe_path);
+}
@@ -118,6 +118,42 @@ TEST(hobject, prefixes5)
   ASSERT_EQ(prefixes_out, prefixes_correct);
 }
 
+TEST(hobject, sort_key)
+{
+  const char *names[] = { "", "a", "ab", "b" };
+  string nul("a");
+  nul.push_back('\0');
+  vector<ghobject_t> objs;
+  for (unsigned n = 0; n < 5; ++n) {
+    string name = n < 4 ? string(names[n]) : nul;
+    for (int64_t pool = -1; pool <= 1; ++pool) {
+      objs.push_back(ghobject_t(hobject_t(object_t(name), "", CEPH_NOSNAP,
+					  0x10 * n + pool, pool, "")));
+      objs.push_back(ghobject_t(hobject_t(object_t(name), "b", 3,
+					  0x10 * n + pool, pool, name)));
+      objs.push_back(ghobject_t(hobject_t(object_t(name), nul, 3, 0x1234,
+					  pool, "ns"), n, 1));
+    }
+  }
+  objs.push_back(ghobject_t());
+  objs.push_back(ghobject_t::get_max());
+
+  for (unsigned i = 0; i < objs.size(); ++i) {
+    for (unsigned j = 0; j < objs.size(); ++j) {
+      int c = objs[i].get_sort_key().compare(objs[j].get_sort_key());
+      ASSERT_EQ(objs[i] < objs[j], c < 0) << objs[i] << " " << objs[j];
+      ASSERT_EQ(objs[i] > objs[j], c > 0) << objs[i] << " " << objs[j];
+      ASSERT_EQ(objs[i].hobj < objs[j].hobj,
+		objs[i].hobj.get_sort_key() < objs[j].hobj.get_sort_key());
+    }
+  }
+
+  vector<ghobject_t> sorted(objs);
+  sort(sorted.begin(), sorted.end());
+  sort_by_key(objs);
+  ASSERT_EQ(sorted, objs);
+}
+
 TEST(pg_interval_t, check_new_interval)
 {
   //
@@ -969,6 +1005,81 @@ TEST(pg_missing_t, split_into)
   EXPECT_TRUE(missing.is_missing(oid2));
 }
 
+TEST(pg_history_t, merge_deep_scrub_resume)
+{
+  hobject_t a(object_t("a"), "", CEPH_NOSNAP, 0x10, 0, "");
+  hobject_t b(object_t("b"), "", CEPH_NOSNAP, 0x20, 0, "");
+  ASSERT_TRUE(a < b);
+
+  // a peer that got further in the same pass wins
+  {
+    pg_history_t h, o;
+    h.deep_scrub_resume = a;
+    h.deep_scrub_resume_stamp = utime_t(10, 0);
+    o.deep_scrub_resume = b;
+    o.deep_scrub_resume_stamp = utime_t(10, 0);
+    o.deep_scrub_resume_deep_errors = 2;
+    EXPECT_TRUE(h.merge(o));
+    EXPECT_EQ(b, h.deep_scrub_resume);
+    EXPECT_EQ(2u, h.deep_scrub_resume_deep_errors);
+    EXPECT_FALSE(h.merge(o));
+  }
+
+  // an older pass does not replace a newer one, however far it got
+  {
+    pg_history_t h, o;
+    h.deep_scrub_resume = a;
+    h.deep_scrub_resume_stamp = utime_t(20, 0);
+    o.deep_scrub_resume = b;
+    o.deep_scrub_resume_stamp = utime_t(10, 0);
+    EXPECT_FALSE(h.merge(o));
+    EXPECT_EQ(a, h.deep_scrub_resume);
+    EXPECT_EQ(utime_t(20, 0), h.deep_scrub_resume_stamp);
+  }
+
+  // a deep scrub that finished since the pass started ends it
+  {
+    pg_history_t h, o;
+    h.deep_scrub_resume = a;
+    h.deep_scrub_resume_stamp = utime_t(10, 0);
+    o.last_deep_scrub_stamp = utime_t(10, 0);
+    EXPECT_TRUE(h.merge(o));
+    EXPECT_FALSE(h.has_deep_scrub_resume());
+    EXPECT_EQ(hobject_t(), h.deep_scrub_resume);
+  }
+}
+
+TEST(pg_log_entry_t, dirty_extents)
+{
+  hobject_t oid(object_t("foo"), "", CEPH_NOSNAP, 0x10, 0, "");
+  pg_log_entry_t e(pg_log_entry_t::MODIFY, oid, eversion_t(1, 2),
+		   eversion_t(1, 1), 2, osd_reqid_t(), utime_t());
+  EXPECT_FALSE(e.dirty_extents_known);
+
+  e.dirty_extents_known = true;
+  e.dirty_extents.insert(0, 4096);
+  e.dirty_extents.insert(65536, 100);
+  bufferlist bl;
+  ::encode(e, bl);
+  pg_log_entry_t d;
+  bufferlist::iterator p = bl.begin();
+  ::decode(d, p);
+  EXPECT_TRUE(d.dirty_extents_known);
+  EXPECT_EQ(e.dirty_extents, d.dirty_extents);
+  EXPECT_EQ(4196u, d.dirty_extents.size());
+
+  // entries from before the extents were recorded are never trusted
+  pg_log_entry_t u(e);
+  u.dirty_extents_known = false;
+  u.dirty_extents.clear();
+  bl.clear();
+  ::encode(u, bl);
+  p = bl.begin();
+  ::decode(d, p);
+  EXPECT_FALSE(d.dirty_extents_known);
+  EXPECT_TRUE(d.dirty_extents.empty());
+}
+
 class ObjectContextTest : public ::testing::Test {
 protected:
 
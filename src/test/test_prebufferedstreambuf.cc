@@ -93,3 +93,27 @@ TEST(PrebufferedStreambuf, ManyOverflow)
   ASSERT_EQ(s, out);
 }
 
+
+TEST(PrebufferedStreambuf, CopyOut)
+{
+  char buf[10];
+  PrebufferedStreambuf sb(buf, sizeof(buf));
+  ASSERT_EQ(0u, sb.size());
+
+  std::ostream os(&sb);
+  os << "short";
+  ASSERT_EQ(5u, sb.size());
+  char out[64];
+  ASSERT_EQ(5u, sb.copy_out(out, sizeof(out)));
+  ASSERT_EQ(std::string("short"), std::string(out, 5));
+
+  os << ", now longer than buf[10]";
+  std::string s = sb.get_str();
+  ASSERT_EQ(s.size(), sb.size());
+  ASSERT_EQ(s.size(), sb.copy_out(out, sizeof(out)));
+  ASSERT_EQ(s, std::string(out, s.size()));
+
+  // truncated
+  ASSERT_EQ(12u, sb.copy_out(out, 12));
+  ASSERT_EQ(s.substr(0, 12), std::string(out, 12));
+}
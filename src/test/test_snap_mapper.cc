@@ -542,6 +542,54 @@ public:
     snap_to_hobject.erase(snap);
   }
 
+  void trim_snap_batched(unsigned max) {
+    Mutex::Locker l(lock);
+    if (snap_to_hobject.empty())
+      return;
+    map<snapid_t, set<hobject_t> >::iterator snap =
+      rand_choose(snap_to_hobject);
+    set<hobject_t> hobjects = snap->second;
+
+    vector<hobject_t> batch;
+    while (mapper->get_next_objects_to_trim(snap->first, max, &batch) == 0) {
+      ASSERT_GE(max, batch.size());
+      ASSERT_FALSE(batch.empty());
+      for (vector<hobject_t>::iterator i = batch.begin();
+	   i != batch.end();
+	   ++i) {
+	// no duplicates within a batch
+	ASSERT_TRUE(hobjects.count(*i));
+	hobjects.erase(*i);
+      }
+      for (vector<hobject_t>::iterator i = batch.begin();
+	   i != batch.end();
+	   ++i) {
+	map<hobject_t, set<snapid_t> >::iterator j =
+	  hobject_to_snap.find(*i);
+	assert(j->second.count(snap->first));
+	set<snapid_t> old_snaps(j->second);
+	j->second.erase(snap->first);
+
+	{
+	  PausyAsyncMap::Transaction t;
+	  mapper->update_snaps(
+	    *i,
+	    j->second,
+	    &old_snaps,
+	    &t);
+	  driver->submit(&t);
+	}
+	if (j->second.empty()) {
+	  hobject_to_snap.erase(j);
+	}
+      }
+    }
+    ASSERT_TRUE(batch.empty());
+    ASSERT_TRUE(hobjects.empty());
+
+    snap_to_hobject.erase(snap);
+  }
+
   void remove_oid() {
     Mutex::Locker l(lock);
     if (hobject_to_snap.empty())
@@ -619,7 +667,7 @@ protected:
     for (int i = 0; i < 5000; ++i) {
       if (!(i % 50))
 	std::cout << i << std::endl;
-      switch (rand() % 5) {
+      switch (rand() % 6) {
       case 0:
 	get_tester().create_snap();
 	break;
@@ -635,6 +683,9 @@ protected:
       case 4:
 	get_tester().remove_oid();
 	break;
+      case 5:
+	get_tester().trim_snap_batched(1 + (rand() % 32));
+	break;
       }
     }
   }
@@ -647,6 +698,14 @@ TEST_F(SnapMapperTest, Simple) {
   get_tester().trim_snap();
 }
 
+TEST_F(SnapMapperTest, Batched) {
+  init(1);
+  get_tester().create_snap();
+  for (int i = 0; i < 100; ++i)
+    get_tester().create_object();
+  get_tester().trim_snap_batched(16);
+}
+
 TEST_F(SnapMapperTest, More) {
   init(1);
   run();
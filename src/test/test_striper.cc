@@ -26,7 +26,60 @@ TEST(Striper, Stripe1)
   ASSERT_EQ(94208u, ex[2].truncate_size);
 }
 
+static void check_unstriped(ceph_file_layout *l, const char *format,
+			    uint64_t off, uint64_t len, uint64_t trunc_size)
+{
+  map<object_t, vector<ObjectExtent> > object_extents;
+  Striper::file_to_extents(g_ceph_context, format, l, off, len, trunc_size,
+			   object_extents, 7);
+  vector<ObjectExtent> expected;
+  Striper::assimilate_extents(object_extents, expected);
+
+  vector<ObjectExtent> ex;
+  Striper::file_to_extents(g_ceph_context, format, l, off, len, trunc_size,
+			   ex, 7);
+  ASSERT_EQ(expected.size(), ex.size());
+  for (unsigned i = 0; i < ex.size(); ++i) {
+    ASSERT_EQ(expected[i].oid, ex[i].oid);
+    ASSERT_EQ(expected[i].objectno, ex[i].objectno);
+    ASSERT_EQ(expected[i].offset, ex[i].offset);
+    ASSERT_EQ(expected[i].length, ex[i].length);
+    ASSERT_EQ(expected[i].truncate_size, ex[i].truncate_size);
+    // the general case splits buffer extents at stripe units
+    ASSERT_EQ(expected[i].buffer_extents.front().first,
+	      ex[i].buffer_extents.front().first);
+    uint64_t blen = 0;
+    for (unsigned j = 0; j < ex[i].buffer_extents.size(); ++j)
+      blen += ex[i].buffer_extents[j].second;
+    ASSERT_EQ(ex[i].length, blen);
+  }
+}
 
+TEST(Striper, Unstriped)
+{
+  ceph_file_layout l;
+  memset(&l, 0, sizeof(l));
+
+  l.fl_object_size = 4194304;
+  l.fl_stripe_unit = 4194304;
+  l.fl_stripe_count = 1;
+
+  vector<ObjectExtent> ex;
+  Striper::file_to_extents(g_ceph_context, "rbd_data.1234.%016llx", &l,
+			   3 * 4194304 + 4096, 4096, 0, ex);
+  ASSERT_EQ(1u, ex.size());
+  ASSERT_EQ(object_t("rbd_data.1234.0000000000000003"), ex[0].oid);
+  ASSERT_EQ(4096u, ex[0].offset);
+
+  check_unstriped(&l, "rbd_data.1234.%016llx", 4194304 - 512, 8192, 0);
+  check_unstriped(&l, "rb.0.1234.%012llx", 1, 3 * 4194304, 0);
+  check_unstriped(&l, "10000000000.%08llx", 0x123456789ull, 65536, 0);
+  check_unstriped(&l, "odd.%llx.name", 12345678, 4194304, 4194304 * 2 + 9);
+
+  // stripe unit smaller than, and not dividing, the object size
+  l.fl_stripe_unit = 65536 * 3;
+  check_unstriped(&l, "10000000000.%08llx", 100, 20000000, 9000000);
+}
 
 int main(int argc, char **argv)
 {
@@ -14,6 +14,7 @@
 
 #include <iostream>
 #include "common/ceph_argparse.h"
+#include "common/Clock.h"
 #include "common/debug.h"
 #include "os/FileStore.h"
 #include "global/global_init.h"
@@ -32,6 +33,113 @@ struct Foo : public Thread {
   }
 } foo;
 
+/*
+ * Time the encode paths a replicated write takes through a
+ * Transaction: building it, encoding it for the replicas, encoding it
+ * again into a journal entry, and decoding it on the other side.  The
+ * data payloads should be referenced all the way, never copied.
+ */
+static void usage_bench()
+{
+  cout << "usage: ceph_test_trans --bench [--ops N] [--size bytes] [--iterations N]"
+       << std::endl;
+}
+
+static int bench(vector<const char*>& args)
+{
+  int num_ops = 16;
+  int size = 1 << 20;
+  int iterations = 100;
+  for (std::vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    string val;
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_witharg(args, i, &val, "--ops", (char*)NULL)) {
+      num_ops = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--size", (char*)NULL)) {
+      size = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--iterations", (char*)NULL)) {
+      iterations = atoi(val.c_str());
+    } else {
+      usage_bench();
+      return -1;
+    }
+  }
+  if (num_ops <= 0 || size <= 0 || iterations <= 0) {
+    usage_bench();
+    return -1;
+  }
+
+  vector<bufferptr> payloads;
+  for (int i = 0; i < num_ops; i++) {
+    bufferptr bp = buffer::create_page_aligned(size);
+    memset(bp.c_str(), i, size);
+    payloads.push_back(bp);
+  }
+
+  utime_t build, encode, journal, decode;
+  int copied = 0;
+  uint64_t encoded_bytes = 0;
+  for (int n = 0; n < iterations; n++) {
+    utime_t start = ceph_clock_now(g_ceph_context);
+    ObjectStore::Transaction t;
+    for (int i = 0; i < num_ops; i++) {
+      char f[30];
+      snprintf(f, sizeof(f), "foo%d", i);
+      bufferlist bl;
+      bl.append(payloads[i]);
+      t.write(coll_t(), hobject_t(sobject_t(f, CEPH_NOSNAP)), 0, bl.length(), bl);
+    }
+    utime_t built = ceph_clock_now(g_ceph_context);
+
+    // what issue_repop ships to every replica
+    bufferlist opt_bl;
+    ::encode(t, opt_bl);
+    utime_t encoded = ceph_clock_now(g_ceph_context);
+
+    // what _op_journal_transactions hands the journal
+    bufferlist jbl;
+    ::encode(t, jbl);
+    utime_t journaled = ceph_clock_now(g_ceph_context);
+
+    bufferlist::iterator p = opt_bl.begin();
+    ObjectStore::Transaction rt(p);
+    ObjectStore::Transaction::iterator i = rt.begin();
+    int k = 0;
+    while (i.have_op()) {
+      assert(i.get_op() == ObjectStore::Transaction::OP_WRITE);
+      i.get_cid();
+      i.get_oid();
+      i.get_length();
+      i.get_length();
+      bufferlist bl;
+      i.get_bl(bl);
+      if (bl.buffers().size() != 1 ||
+	  bl.buffers().front().c_str() != payloads[k].c_str())
+	++copied;
+      ++k;
+    }
+    assert(k == num_ops);
+    utime_t decoded = ceph_clock_now(g_ceph_context);
+
+    build += built - start;
+    encode += encoded - built;
+    journal += journaled - encoded;
+    decode += decoded - journaled;
+    encoded_bytes = opt_bl.length() + jbl.length();
+  }
+
+  cout << "ops " << num_ops << " size " << size
+       << " iterations " << iterations << std::endl;
+  cout << "build   " << (double)build / iterations * 1000000 << " us/txn" << std::endl;
+  cout << "encode  " << (double)encode / iterations * 1000000 << " us/txn" << std::endl;
+  cout << "journal " << (double)journal / iterations * 1000000 << " us/txn" << std::endl;
+  cout << "decode  " << (double)decode / iterations * 1000000 << " us/txn" << std::endl;
+  cout << "encoded " << encoded_bytes << " bytes/txn, payload copies "
+       << copied << std::endl;
+  return copied ? 1 : 0;
+}
+
 int main(int argc, const char **argv)
 {
   vector<const char*> args;
@@ -41,6 +149,11 @@ int main(int argc, const char **argv)
   global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
   common_init_finish(g_ceph_context);
 
+  if (!args.empty() && strcmp(args[0], "--bench") == 0) {
+    args.erase(args.begin());
+    return bench(args);
+  }
+
   // args
   if (args.size() < 2) return -1;
   const char *filename = args[0];
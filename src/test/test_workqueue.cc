@@ -57,6 +57,73 @@ TEST(WorkQueue, Resize)
   tp.stop();
 }
 
+struct CountWQ : public ThreadPool::WorkQueue<unsigned> {
+  list<unsigned*> q;
+  atomic_t processed;
+  unsigned finished;  // under the pool lock
+  CountWQ(ThreadPool *tp, bool prefetchable)
+    : ThreadPool::WorkQueue<unsigned>("CountWQ", 60, 0, tp), finished(0) {
+    if (prefetchable)
+      set_prefetchable();
+  }
+  bool _enqueue(unsigned *item) {
+    q.push_back(item);
+    return true;
+  }
+  void _dequeue(unsigned *item) { assert(0); }
+  unsigned *_dequeue() {
+    if (q.empty())
+      return 0;
+    unsigned *item = q.front();
+    q.pop_front();
+    return item;
+  }
+  void _process(unsigned *item) {
+    processed.inc();
+  }
+  void _process_finish(unsigned *item) {
+    finished++;
+    delete item;
+  }
+  void _clear() { q.clear(); }
+  bool _empty() { return q.empty(); }
+};
+
+TEST(WorkQueue, WorkStealing)
+{
+  ThreadPool tp(g_ceph_context, "steal", 4, "");
+  tp.set_work_stealing(8);
+  CountWQ prefetched(&tp, true), ordered(&tp, false);
+  tp.start();
+
+  for (unsigned i = 0; i < 10000; i++) {
+    prefetched.queue(new unsigned(i));
+    if (i % 10 == 0)
+      ordered.queue(new unsigned(i));
+  }
+  tp.drain(&prefetched);
+  tp.drain(&ordered);
+  ASSERT_EQ(10000, prefetched.processed.read());
+  ASSERT_EQ(1000, ordered.processed.read());
+  tp.lock();
+  ASSERT_EQ(10000u, prefetched.finished);
+  ASSERT_EQ(1000u, ordered.finished);
+  tp.unlock();
+
+  // nothing is left half done once paused
+  for (unsigned i = 0; i < 1000; i++)
+    prefetched.queue(new unsigned(i));
+  tp.pause();
+  tp.lock();
+  ASSERT_EQ((unsigned)prefetched.processed.read(), prefetched.finished);
+  tp.unlock();
+  tp.unpause();
+  tp.drain(&prefetched);
+  ASSERT_EQ(11000, prefetched.processed.read());
+
+  tp.stop();
+}
+
 
 int main(int argc, char **argv)
 {
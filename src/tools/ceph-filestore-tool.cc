@@ -50,6 +50,8 @@ int main(int argc, char **argv)
   string fspath, jpath, pgidstr;
   bool list_lost_objects = false;
   bool fix_lost_objects = false;
+  uint64_t pre_split_objects = 0;
+  unsigned pg_num = 0;
   unsigned LIST_AT_A_TIME = 100;
   unsigned scanned = 0;
   
@@ -68,6 +70,10 @@ int main(int argc, char **argv)
     ("fix-lost-objects", po::value<bool>(
       &fix_lost_objects)->default_value(false),
      "fix lost objects")
+    ("pre-split-objects", po::value<uint64_t>(&pre_split_objects),
+     "create the subdirs the empty PG given with --pgid needs for this many objects")
+    ("pg-num", po::value<unsigned>(&pg_num),
+     "pg_num of the PG's pool, for --pre-split-objects")
     ;
 
   po::variables_map vm;
@@ -103,6 +109,11 @@ int main(int argc, char **argv)
     cerr << "Invalid params" << desc << std::endl;
     exit(1);
   }
+  if (pre_split_objects && (!pgidstr.length() || !pg_num)) {
+    cerr << "--pre-split-objects needs --pgid and --pg-num" << std::endl
+	 << desc << std::endl;
+    return 1;
+  }
 
   vector<const char *> ceph_options, def_args;
   vector<string> ceph_option_strings = po::collect_unrecognized(
@@ -167,6 +178,19 @@ int main(int argc, char **argv)
       cout << "Invalid pgid '" << pgidstr << "' specified" << std::endl;
       exit(1);
     }
+    if (pre_split_objects) {
+      // every object in the pg shares the hash bits that select it
+      r = static_cast<FileStore*>(fs)->pre_split_collection(
+	coll_t(pgid), pgid.get_split_bits(pg_num), pgid.ps(),
+	pre_split_objects);
+      if (r < 0)
+	cerr << "Error pre-splitting " << coll_t(pgid) << ": "
+	     << cpp_strerror(r) << std::endl;
+      else
+	cerr << "Pre-split " << coll_t(pgid) << " for "
+	     << pre_split_objects << " objects" << std::endl;
+      goto UMOUNT;
+    }
     colls_to_check.push_back(coll_t(pgid));
   } else {
     vector<coll_t> candidates;
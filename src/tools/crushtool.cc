@@ -24,6 +24,7 @@
 #include "common/config.h"
 
 #include "common/ceph_argparse.h"
+#include "common/Formatter.h"
 #include "global/global_context.h"
 #include "global/global_init.h"
 #include "crush/CrushWrapper.h"
@@ -87,7 +88,7 @@ void usage()
   cout << "                         specify output for for (de)compilation\n";
   cout << "   --build --num_osds N layer1 ...\n";
   cout << "                         build a new map, where each 'layer' is\n";
-  cout << "                           'name (uniform|straw|list|tree) size'\n";
+  cout << "                           'name (uniform|straw|straw2|list|tree) size'\n";
   cout << "   -i mapfn --test       test a range of inputs on the map\n";
   cout << "      [--min-x x] [--max-x x] [--x x]\n";
   cout << "      [--min-rule r] [--max-rule r] [--rule r]\n";
@@ -98,6 +99,9 @@ void usage()
   cout << "      [--simulate]       simulate placements using a random\n";
   cout << "                         number generator in place of the CRUSH\n";
   cout << "                         algorithm\n";
+  cout << "      [--benchmark]      time the mappings and report mappings/sec\n";
+  cout << "                         instead\n";
+  cout << "      [--threads n]      map with n threads (default: one per cpu)\n";
   cout << "   -i mapfn --add-item id weight name [--loc type name ...]\n";
   cout << "                         insert an item into the hierarchy at the\n";
   cout << "                         given location\n";
@@ -116,6 +120,12 @@ void usage()
   cout << "   --show-statistics     show chi squared statistics\n";
   cout << "   --show-bad-mappings   show bad mappings\n";
   cout << "   --show-choose-tries   show choose tries histogram\n";
+  cout << "   --show-distribution   show how evenly copies and primaries spread\n";
+  cout << "                         over the devices and failure domains\n";
+  cout << "      [--failure-domain type]\n";
+  cout << "                         bucket type to summarize by (default: host)\n";
+  cout << "      [--format json|json-pretty]\n";
+  cout << "                         dump the distribution to stdout instead\n";
   cout << "   --set-choose-local-tries N\n";
   cout << "                         set choose local retries before re-descent\n";
   cout << "   --set-choose-local-fallback-tries N\n";
@@ -141,6 +151,7 @@ struct bucket_types_t {
   { "uniform", CRUSH_BUCKET_UNIFORM },
   { "list", CRUSH_BUCKET_LIST },
   { "straw", CRUSH_BUCKET_STRAW },
+  { "straw2", CRUSH_BUCKET_STRAW2 },
   { "tree", CRUSH_BUCKET_TREE },
   { 0, 0 },
 };
@@ -184,6 +195,10 @@ int main(int argc, const char **argv)
   int choose_total_tries = -1;
   int chooseleaf_descend_once = -1;
 
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  std::string failure_domain = "host";
+  std::string format;
+
   CrushWrapper crush;
 
   CrushTester tester(crush, cerr);
@@ -229,6 +244,21 @@ int main(int argc, const char **argv)
     } else if (ceph_argparse_flag(args, i, "--show_choose_tries", (char*)NULL)) {
       display = true;
       tester.set_output_choose_tries(true);
+    } else if (ceph_argparse_flag(args, i, "--show_distribution", (char*)NULL)) {
+      display = true;
+      tester.set_output_distribution(true);
+    } else if (ceph_argparse_witharg(args, i, &val, "--failure_domain", (char*)NULL)) {
+      failure_domain = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--format", (char*)NULL)) {
+      format = val;
+    } else if (ceph_argparse_withint(args, i, &threads, &err, "--threads", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
+    } else if (ceph_argparse_flag(args, i, "--benchmark", (char*)NULL)) {
+      display = true;
+      tester.set_output_benchmark(true);
     } else if (ceph_argparse_witharg(args, i, &val, "-c", "--compile", (char*)NULL)) {
       srcfn = val;
       compile = true;
@@ -719,7 +749,23 @@ int main(int argc, const char **argv)
   }
 
   if (test) {
+    tester.set_threads(threads);
+    tester.set_failure_domain(failure_domain);
+    Formatter *f = NULL;
+    if (!format.empty()) {
+      f = new_formatter(format);
+      if (!f) {
+	cerr << me << ": unknown format '" << format << "'" << std::endl;
+	exit(EXIT_FAILURE);
+      }
+      tester.set_formatter(f);
+    }
     int r = tester.test();
+    if (f) {
+      f->flush(cout);
+      cout << std::endl;
+      delete f;
+    }
     if (r < 0)
       exit(1);
   }
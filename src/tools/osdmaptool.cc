@@ -16,6 +16,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <math.h>
 
 #include <iostream>
 #include <string>
@@ -24,8 +25,12 @@ using namespace std;
 #include "common/config.h"
 
 #include "common/errno.h"
+#include "common/Thread.h"
+#include "common/Formatter.h"
+#include "crush/CrushTester.h"
 #include "osd/OSDMap.h"
 #include "mon/MonMap.h"
+#include "mon/PGMap.h"
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
 
@@ -37,9 +42,355 @@ void usage()
   cout << "   --test-map-pg <pgid>    map a pgid to osds" << std::endl;
   cout << "   --test-map-object <objectname> [--pool <poolid>] map an object to osds"
        << std::endl;
+  cout << "   --test-map-pgs          map all pgs, show how many land on each osd" << std::endl;
+  cout << "      [--failure-domain <type>] also show the balance over buckets of type (default host)" << std::endl;
+  cout << "      [--format json|json-pretty] dump the distribution instead" << std::endl;
+  cout << "   --compare <file>        show which pgs would move with the osdmap in <file>" << std::endl;
+  cout << "   --compare-crush <file>  show which pgs would move with the crush map in <file>" << std::endl;
+  cout << "      [--pgmap <file>]     with pg sizes from <file> (ceph pg getmap), count bytes" << std::endl;
+  cout << "      [--dump-remapped]    list each pg that moves" << std::endl;
+  cout << "      [--threads <n>]      map with n threads (default: one per cpu)" << std::endl;
+  cout << "   --reweight-by-pg        adjust osd weights to even out pg counts" << std::endl;
+  cout << "      [--deviation <pct>]  stop when every osd is within pct of its share (default 5)" << std::endl;
+  cout << "      [--max-change <w>]   change each weight by at most w per round (default .05)" << std::endl;
+  cout << "      [--max-rounds <n>]   give up after n rounds (default 10)" << std::endl;
   exit(1);
 }
 
+struct remapped_pg_t {
+  pg_t pgid;
+  vector<int> from, to;
+  uint64_t bytes;   // to be copied
+};
+
+/*
+ * Maps a range of the pgs with both the current and the proposed map.
+ * Each worker decodes its own copy of both, since a CrushWrapper only
+ * maps one input at a time.
+ */
+class RemapWorker : public Thread {
+  bufferlist cur_bl, new_bl;
+  const vector<pg_t>& pgs;
+  unsigned begin, end;
+  const PGMap *pgmap;
+  bool keep;
+
+public:
+  vector<remapped_pg_t> remapped;
+  uint64_t num_remapped, copies, bytes;
+
+  RemapWorker(const bufferlist& c, const bufferlist& n, const vector<pg_t>& p,
+	      unsigned b, unsigned e, const PGMap *pm, bool k)
+    : cur_bl(c), new_bl(n), pgs(p), begin(b), end(e), pgmap(pm), keep(k),
+      num_remapped(0), copies(0), bytes(0) {}
+
+  void *entry() {
+    OSDMap cur, proposed;
+    cur.decode(cur_bl);
+    proposed.decode(new_bl);
+    for (unsigned i = begin; i < end; ++i) {
+      vector<int> from, to, acting;
+      cur.pg_to_up_acting_osds(pgs[i], from, acting);
+      proposed.pg_to_up_acting_osds(pgs[i], to, acting);
+      if (from == to)
+	continue;
+      unsigned n = 0;
+      for (unsigned j = 0; j < to.size(); ++j)
+	if (std::find(from.begin(), from.end(), to[j]) == from.end())
+	  ++n;
+      uint64_t b = 0;
+      if (pgmap && n) {
+	hash_map<pg_t,pg_stat_t>::const_iterator p = pgmap->pg_stat.find(pgs[i]);
+	if (p != pgmap->pg_stat.end())
+	  b = p->second.stats.sum.num_bytes * n;
+      }
+      ++num_remapped;
+      copies += n;
+      bytes += b;
+      if (keep) {
+	remapped.push_back(remapped_pg_t());
+	remapped_pg_t& r = remapped.back();
+	r.pgid = pgs[i];
+	r.from.swap(from);
+	r.to.swap(to);
+	r.bytes = b;
+      }
+    }
+    return 0;
+  }
+};
+
+/*
+ * Maps a range of the pgs and counts where their acting sets land,
+ * with its own copy of the map like RemapWorker.
+ */
+class MapPGsWorker : public Thread {
+  bufferlist bl;
+  const vector<pg_t>& pgs;
+  unsigned begin, end;
+
+public:
+  CrushDistribution dist;
+
+  MapPGsWorker(const bufferlist& b, const vector<pg_t>& p, unsigned bg,
+	       unsigned e, int max_osd)
+    : bl(b), pgs(p), begin(bg), end(e), dist(max_osd) {}
+
+  void *entry() {
+    OSDMap osdmap;
+    osdmap.decode(bl);
+    for (unsigned i = begin; i < end; ++i) {
+      vector<int> up, acting;
+      osdmap.pg_to_up_acting_osds(pgs[i], up, acting);
+      dist.add(acting);
+    }
+    return 0;
+  }
+};
+
+static void map_all_pgs(OSDMap& osdmap, int threads,
+			const string& failure_domain, Formatter *f)
+{
+  vector<pg_t> pgs;
+  for (map<int64_t,pg_pool_t>::const_iterator p = osdmap.get_pools().begin();
+       p != osdmap.get_pools().end();
+       ++p) {
+    if (!f)
+      cout << "pool " << p->first << " pg_num " << p->second.get_pg_num()
+	   << std::endl;
+    for (ps_t ps = 0; ps < p->second.get_pg_num(); ps++)
+      pgs.push_back(pg_t(ps, p->first, -1));
+  }
+
+  bufferlist bl;
+  osdmap.encode(bl);
+
+  if (threads < 1)
+    threads = 1;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  vector<MapPGsWorker*> workers;
+  unsigned per = (pgs.size() + threads - 1) / threads;
+  for (unsigned b = 0; b < pgs.size(); b += per) {
+    MapPGsWorker *w = new MapPGsWorker(bl, pgs, b, MIN(b + per, pgs.size()),
+				       osdmap.get_max_osd());
+    w->create();
+    workers.push_back(w);
+  }
+  CrushDistribution dist(osdmap.get_max_osd());
+  for (vector<MapPGsWorker*>::iterator p = workers.begin(); p != workers.end(); ++p) {
+    (*p)->join();
+    dist.add((*p)->dist);
+    delete *p;
+  }
+  double elapsed = ceph_clock_now(g_ceph_context) - start;
+
+  // an osd's share is its crush weight, as long as it is in
+  CrushWrapper& crush = *osdmap.crush;
+  vector<float> weight(osdmap.get_max_osd(), 0);
+  for (int i = 0; i < osdmap.get_max_osd(); i++)
+    if (osdmap.exists(i) && osdmap.is_in(i))
+      weight[i] = MAX(crush.get_item_weightf(i), 0);
+  int domain_type = -1;
+  if (!failure_domain.empty()) {
+    domain_type = crush.get_type_id(failure_domain);
+    if (domain_type < 0)
+      cerr << "no bucket type " << failure_domain
+	   << ", not summarizing by failure domain" << std::endl;
+  }
+
+  if (f) {
+    f->open_object_section("test_map_pgs");
+    f->dump_unsigned("pgs", pgs.size());
+    f->dump_float("seconds", elapsed);
+    f->dump_unsigned("threads", workers.size());
+    dist.dump(crush, weight, domain_type, f);
+    f->close_section();
+    f->flush(cout);
+    cout << std::endl;
+    return;
+  }
+
+  cout << "mapped " << pgs.size() << " pgs in " << elapsed << "s with "
+       << workers.size() << " threads" << std::endl;
+  cout << "#osd\tcount\tfirst" << std::endl;
+  for (int i = 0; i < osdmap.get_max_osd(); i++) {
+    if (!osdmap.exists(i))
+      continue;
+    cout << "osd." << i << "\t" << dist.count[i] << "\t" << dist.primary[i]
+	 << std::endl;
+  }
+  dist.print(crush, weight, domain_type, cout);
+}
+
+/*
+ * Count the pg copies each osd holds and compare it with the osd's
+ * share by crush weight.  Returns the largest relative deviation of
+ * any osd that is in.
+ */
+static float pg_deviation(OSDMap& osdmap, vector<float>& expected,
+			  vector<int>& count, float *stddev)
+{
+  osdmap.precompute_pg_mappings();
+
+  int max = osdmap.get_max_osd();
+  count.assign(max, 0);
+  expected.assign(max, 0);
+  unsigned total = 0;
+  for (map<int64_t,pg_pool_t>::const_iterator p = osdmap.get_pools().begin();
+       p != osdmap.get_pools().end();
+       ++p) {
+    for (ps_t ps = 0; ps < p->second.get_pg_num(); ps++) {
+      vector<int> up, acting;
+      osdmap.pg_to_up_acting_osds(pg_t(ps, p->first, -1), up, acting);
+      for (unsigned i = 0; i < up.size(); i++)
+	count[up[i]]++;
+      total += up.size();
+    }
+  }
+
+  // osds outside the crush hierarchy get -ENOENT, and no share
+  vector<float> crush_weight(max, 0);
+  float weight_sum = 0;
+  for (int i = 0; i < max; i++) {
+    if (!osdmap.exists(i) || !osdmap.is_in(i))
+      continue;
+    crush_weight[i] = MAX(osdmap.crush->get_item_weightf(i), 0);
+    weight_sum += crush_weight[i];
+  }
+  if (weight_sum <= 0)
+    return 0;
+
+  float worst = 0, sq = 0;
+  unsigned n = 0;
+  for (int i = 0; i < max; i++) {
+    expected[i] = (float)total * crush_weight[i] / weight_sum;
+    if (expected[i] <= 0)
+      continue;
+    float dev = ((float)count[i] - expected[i]) / expected[i];
+    worst = MAX(worst, fabs(dev));
+    sq += dev * dev;
+    n++;
+  }
+  *stddev = n ? sqrt(sq / n) : 0;
+  return worst;
+}
+
+/*
+ * Nudge the reweight value of each osd that is off its share of pgs,
+ * one bounded step per round, until all are within the deviation or we
+ * run out of rounds.  Weights are only ever lowered from 1.0 or raised
+ * back toward it, so the crush weights keep describing capacity.
+ */
+static bool reweight_by_pg(OSDMap& osdmap, float deviation, float max_change,
+			   int max_rounds)
+{
+  vector<float> expected;
+  vector<int> count;
+  float stddev;
+  float worst = pg_deviation(osdmap, expected, count, &stddev);
+  cout << "start: max deviation " << worst * 100 << "%, stddev "
+       << stddev * 100 << "%" << std::endl;
+
+  bool changed = false;
+  for (int round = 1; round <= max_rounds && worst > deviation; round++) {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.fsid = osdmap.get_fsid();
+    for (int i = 0; i < osdmap.get_max_osd(); i++) {
+      if (expected[i] <= 0 || count[i] == 0)
+	continue;
+      float dev = ((float)count[i] - expected[i]) / expected[i];
+      if (fabs(dev) <= deviation)
+	continue;
+      float w = osdmap.get_weightf(i);
+      float nw = w * expected[i] / (float)count[i];
+      nw = MIN(nw, w + max_change);
+      nw = MAX(nw, w - max_change);
+      nw = MIN(nw, 1.0);
+      nw = MAX(nw, 0.01);
+      unsigned iw = (unsigned)(nw * (float)CEPH_OSD_IN);
+      if (iw == osdmap.get_weight(i))
+	continue;
+      inc.new_weight[i] = iw;
+    }
+    if (inc.new_weight.empty())
+      break;
+    osdmap.apply_incremental(inc);
+    changed = true;
+
+    worst = pg_deviation(osdmap, expected, count, &stddev);
+    cout << "round " << round << ": reweighted " << inc.new_weight.size()
+	 << " osds, max deviation " << worst * 100 << "%, stddev "
+	 << stddev * 100 << "%" << std::endl;
+  }
+
+  if (changed) {
+    cout << "#osd\tweight\tpgs\texpected" << std::endl;
+    for (int i = 0; i < osdmap.get_max_osd(); i++) {
+      if (expected[i] <= 0)
+	continue;
+      cout << "osd." << i << "\t" << osdmap.get_weightf(i) << "\t" << count[i]
+	   << "\t" << expected[i] << std::endl;
+    }
+  }
+  return changed;
+}
+
+static int compare_maps(OSDMap& cur, OSDMap& proposed, const PGMap *pgmap,
+			bool dump_remapped, int threads)
+{
+  vector<pg_t> pgs;
+  for (map<int64_t,pg_pool_t>::const_iterator p = cur.get_pools().begin();
+       p != cur.get_pools().end();
+       ++p)
+    for (ps_t ps = 0; ps < p->second.get_pg_num(); ps++)
+      pgs.push_back(pg_t(ps, p->first, -1));
+
+  bufferlist cur_bl, new_bl;
+  cur.encode(cur_bl);
+  proposed.encode(new_bl);
+
+  if (threads < 1)
+    threads = 1;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  vector<RemapWorker*> workers;
+  unsigned per = (pgs.size() + threads - 1) / threads;
+  for (unsigned b = 0; b < pgs.size(); b += per) {
+    RemapWorker *w = new RemapWorker(cur_bl, new_bl, pgs, b,
+				     MIN(b + per, pgs.size()), pgmap,
+				     dump_remapped);
+    w->create();
+    workers.push_back(w);
+  }
+
+  uint64_t num_remapped = 0, copies = 0, bytes = 0;
+  for (vector<RemapWorker*>::iterator p = workers.begin(); p != workers.end(); ++p) {
+    (*p)->join();
+    num_remapped += (*p)->num_remapped;
+    copies += (*p)->copies;
+    bytes += (*p)->bytes;
+    for (vector<remapped_pg_t>::iterator q = (*p)->remapped.begin();
+	 q != (*p)->remapped.end();
+	 ++q) {
+      cout << q->pgid << "\t" << q->from << " -> " << q->to;
+      if (pgmap)
+	cout << "\t" << prettybyte_t(q->bytes);
+      cout << std::endl;
+    }
+    delete *p;
+  }
+
+  cout << "compared " << pgs.size() << " pgs in "
+       << (ceph_clock_now(g_ceph_context) - start) << "s with "
+       << workers.size() << " threads" << std::endl;
+  cout << num_remapped << " pgs would remap ("
+       << (pgs.empty() ? 0 : 100.0 * num_remapped / pgs.size()) << "%), "
+       << copies << " pg copies would move";
+  if (pgmap)
+    cout << ", " << prettybyte_t(bytes) << " of data";
+  cout << std::endl;
+  return 0;
+}
+
 int main(int argc, const char **argv)
 {
   vector<const char*> args;
@@ -65,6 +416,14 @@ int main(int argc, const char **argv)
   bool modified = false;
   std::string export_crush, import_crush, test_map_pg, test_map_object;
   bool test_crush = false;
+  bool test_map_pgs = false;
+  std::string compare, compare_crush, pgmap_fn;
+  bool dump_remapped = false;
+  std::string failure_domain = "host", format;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  bool reweight = false;
+  float deviation = .05, max_change = .05;
+  int max_rounds = 10;
   int range_first = -1;
   int range_last = -1;
   int pool = 0;
@@ -112,6 +471,36 @@ int main(int argc, const char **argv)
       test_map_object = val;
     } else if (ceph_argparse_flag(args, i, "--test_crush", (char*)NULL)) {
       test_crush = true;
+    } else if (ceph_argparse_flag(args, i, "--test_map_pgs", (char*)NULL)) {
+      test_map_pgs = true;
+    } else if (ceph_argparse_witharg(args, i, &val, "--compare", (char*)NULL)) {
+      compare = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--compare_crush", (char*)NULL)) {
+      compare_crush = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--pgmap", (char*)NULL)) {
+      pgmap_fn = val;
+    } else if (ceph_argparse_flag(args, i, "--reweight_by_pg", (char*)NULL)) {
+      reweight = true;
+    } else if (ceph_argparse_witharg(args, i, &val, "--deviation", (char*)NULL)) {
+      deviation = atof(val.c_str()) / 100.0;
+    } else if (ceph_argparse_witharg(args, i, &val, "--max_change", (char*)NULL)) {
+      max_change = atof(val.c_str());
+    } else if (ceph_argparse_withint(args, i, &max_rounds, &err, "--max_rounds", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
+    } else if (ceph_argparse_witharg(args, i, &val, "--failure_domain", (char*)NULL)) {
+      failure_domain = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--format", (char*)NULL)) {
+      format = val;
+    } else if (ceph_argparse_flag(args, i, "--dump_remapped", (char*)NULL)) {
+      dump_remapped = true;
+    } else if (ceph_argparse_withint(args, i, &threads, &err, "--threads", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
     } else if (ceph_argparse_withint(args, i, &range_first, &err, "--range_first", (char*)NULL)) {
     } else if (ceph_argparse_withint(args, i, &range_last, &err, "--range_last", (char*)NULL)) {
     } else if (ceph_argparse_withint(args, i, &pool, &err, "--pool", (char*)NULL)) {
@@ -305,9 +694,77 @@ int main(int argc, const char **argv)
     }
   }
 
+  if (test_map_pgs) {
+    Formatter *f = NULL;
+    if (!format.empty()) {
+      f = new_formatter(format);
+      if (!f) {
+	cerr << me << ": unknown format '" << format << "'" << std::endl;
+	exit(1);
+      }
+    }
+    map_all_pgs(osdmap, threads, failure_domain, f);
+    delete f;
+  }
+
+  if (reweight) {
+    if (reweight_by_pg(osdmap, deviation, max_change, max_rounds))
+      modified = true;
+  }
+
+  if (!compare.empty() || !compare_crush.empty()) {
+    PGMap pgmap;
+    if (!pgmap_fn.empty()) {
+      bufferlist pbl;
+      std::string error;
+      r = pbl.read_file(pgmap_fn.c_str(), &error);
+      if (r < 0) {
+	cerr << me << ": error reading pgmap from " << pgmap_fn << ": " << error << std::endl;
+	exit(1);
+      }
+      try {
+	bufferlist::iterator p = pbl.begin();
+	pgmap.decode(p);
+      }
+      catch (const buffer::error &e) {
+	cerr << me << ": error decoding pgmap '" << pgmap_fn << "'" << std::endl;
+	exit(1);
+      }
+    }
+
+    OSDMap proposed;
+    bufferlist cbl;
+    std::string error;
+    if (!compare.empty()) {
+      r = cbl.read_file(compare.c_str(), &error);
+      if (r < 0) {
+	cerr << me << ": error reading osdmap from " << compare << ": " << error << std::endl;
+	exit(1);
+      }
+      proposed.decode(cbl);
+    } else {
+      r = cbl.read_file(compare_crush.c_str(), &error);
+      if (r < 0) {
+	cerr << me << ": error reading crush map from " << compare_crush << ": " << error << std::endl;
+	exit(1);
+      }
+      bufferlist obl;
+      osdmap.encode(obl);
+      proposed.decode(obl);
+      OSDMap::Incremental inc;
+      inc.fsid = proposed.get_fsid();
+      inc.epoch = proposed.get_epoch() + 1;
+      inc.crush = cbl;
+      proposed.apply_incremental(inc);
+    }
+    compare_maps(osdmap, proposed, pgmap_fn.empty() ? NULL : &pgmap,
+		 dump_remapped, threads);
+  }
+
   if (!print && !print_json && !tree && !modified && 
       export_crush.empty() && import_crush.empty() && 
-      test_map_pg.empty() && test_map_object.empty()) {
+      test_map_pg.empty() && test_map_object.empty() && !test_map_pgs &&
+      compare.empty() && compare_crush.empty() && !reweight) {
     cerr << me << ": no action specified?" << std::endl;
     usage();
   }
@@ -62,7 +62,8 @@ void usage(ostream& out)
 "   rmpool <pool-name> [<pool-name> --yes-i-really-really-mean-it]\n"
 "                                    remove pool <pool-name>'\n"
 "   df                               show per-pool and total usage\n"
-"   ls                               list objects in pool\n\n"
+"   ls                               list objects in pool\n"
+"                                    (--part P/N for only part P of N)\n\n"
 "   chown 123                        change the pool owner to auid 123\n"
 "\n"
 "OBJECT COMMANDS\n"
@@ -85,9 +86,11 @@ void usage(ostream& out)
 "   rollback <obj-name> <snap-name>  roll back object to snap <snap-name>\n"
 "\n"
 "   listsnaps <obj-name>             list the snapshots of this object\n"
-"   bench <seconds> write|seq|rand [-t concurrent_operations] [--no-cleanup]\n"
+"   bench <seconds> write|seq|rand|mixed [-t concurrent_operations] [--no-cleanup]\n"
 "                                    default is 16 concurrent IOs and 4 MB ops\n"
 "                                    default is to clean up after write benchmark\n"
+"                                    rand and mixed use the objects of the last\n"
+"                                    write benchmark run with --no-cleanup\n"
 "   cleanup <prefix>                 clean up a previous benchmark operation\n"
 "   load-gen [options]               generate load on the cluster\n"
 "   listomapkeys <obj-name>          list the keys in the object map\n"
@@ -159,6 +162,13 @@ void usage(ostream& out)
 "        Set number of concurrent I/O operations\n"
 "   --show-time\n"
 "        prefix output with date/time\n"
+"   --read-percent=P\n"
+"        percentage of the ops of a mixed benchmark that are reads (default 50)\n"
+"   --format=json\n"
+"        print the status of each second and the summary as json\n"
+"   --run-name=NAME --clients=N --client-id=I\n"
+"        start together with the other N-1 clients of run NAME; client 0\n"
+"        prints the aggregate of everyone's results\n"
 "\n"
 "LOAD GEN OPTIONS:\n"
 "   --num-objects                    total number of objects\n"
@@ -1070,6 +1080,9 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   int64_t read_percent = -1;
   uint64_t num_objs = 0;
   int run_length = 0;
+  string run_name;
+  int num_clients = 1;
+  int client_id = 0;
 
   bool show_time = false;
 
@@ -1159,6 +1172,18 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   if (i != opts.end()) {
     run_length = strtol(i->second.c_str(), NULL, 10);
   }
+  i = opts.find("run-name");
+  if (i != opts.end()) {
+    run_name = i->second;
+  }
+  i = opts.find("clients");
+  if (i != opts.end()) {
+    num_clients = strtol(i->second.c_str(), NULL, 10);
+  }
+  i = opts.find("client-id");
+  if (i != opts.end()) {
+    client_id = strtol(i->second.c_str(), NULL, 10);
+  }
   i = opts.find("show-time");
   if (i != opts.end()) {
     show_time = true;
@@ -1375,6 +1400,16 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
       goto out;
     }
 
+    unsigned part = 0, nparts = 1;
+    i = opts.find("part");
+    if (i != opts.end() &&
+	(sscanf(i->second.c_str(), "%u/%u", &part, &nparts) != 2 ||
+	 part >= nparts)) {
+      cerr << "--part must be P/N with P < N" << std::endl;
+      ret = -1;
+      goto out;
+    }
+
     bool stdout = (nargs.size() < 2) || (strcmp(nargs[1], "-") == 0);
     ostream *outstream;
     if(stdout)
@@ -1384,7 +1419,7 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
 
     {
       try {
-	librados::ObjectIterator i = io_ctx.objects_begin();
+	librados::ObjectIterator i = io_ctx.objects_begin(part, nparts);
 	librados::ObjectIterator i_end = io_ctx.objects_end();
 	for (; i != i_end; ++i) {
 	  if (i->second.size())
@@ -2038,10 +2073,23 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
       operation = OP_SEQ_READ;
     else if (strcmp(nargs[2], "rand") == 0)
       operation = OP_RAND_READ;
+    else if (strcmp(nargs[2], "mixed") == 0)
+      operation = OP_MIXED;
     else
       usage_exit();
+    if (!run_name.empty() &&
+	(num_clients < 1 || client_id < 0 || client_id >= num_clients)) {
+      cerr << "client id must be between 0 and the number of clients - 1" << std::endl;
+      ret = -EINVAL;
+      goto out;
+    }
     RadosBencher bencher(g_ceph_context, rados, io_ctx);
     bencher.set_show_time(show_time);
+    bencher.set_formatter(formatter);
+    if (read_percent >= 0)
+      bencher.set_read_percent(read_percent);
+    if (!run_name.empty())
+      bencher.set_run(run_name, num_clients, client_id);
     ret = bencher.aio_bench(operation, seconds, num_objs,
 			    concurrent_ios, op_size, cleanup);
     if (ret != 0)
@@ -2371,6 +2419,12 @@ int main(int argc, const char **argv)
       opts["num-objects"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--run-length", (char*)NULL)) {
       opts["run-length"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--run-name", (char*)NULL)) {
+      opts["run-name"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--clients", (char*)NULL)) {
+      opts["clients"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--client-id", (char*)NULL)) {
+      opts["client-id"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--workers", (char*)NULL)) {
       opts["workers"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--format", (char*)NULL)) {
@@ -2387,6 +2441,8 @@ int main(int argc, const char **argv)
       opts["lock-type"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "-N", "--namespace", (char*)NULL)) {
       opts["namespace"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--part", (char*)NULL)) {
+      opts["part"] = val;
     } else {
       if (val[0] == '-')
         usage_exit();